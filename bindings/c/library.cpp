@@ -37,11 +37,26 @@ POSSIBILITY OF SUCH DAMAGE.
 
 #include <libtorrent.h>
 #include <stdarg.h>
+#include <string.h>
+#include <unordered_map>
 
 namespace
 {
 	std::vector<libtorrent::torrent_handle> handles;
 
+	// the last torrent_status_brief returned for each handle, to tell which
+	// ones changed. tor is -1 for handles that haven't been reported yet
+	std::vector<torrent_status_brief> reported;
+
+	void reset_reported(int i)
+	{
+		torrent_status_brief empty;
+		memset(&empty, 0, sizeof(empty));
+		empty.tor = -1;
+		if (i >= int(reported.size())) reported.resize(i + 1, empty);
+		else memcpy(&reported[i], &empty, sizeof(empty));
+	}
+
 	int find_handle(libtorrent::torrent_handle h)
 	{
 		std::vector<libtorrent::torrent_handle>::const_iterator i
@@ -64,10 +79,12 @@ namespace
 		if (i != handles.end())
 		{
 			*i = h;
+			reset_reported(i - handles.begin());
 			return i - handles.begin();
 		}
 
 		handles.push_back(h);
+		reset_reported(handles.size() - 1);
 		return handles.size() - 1;
 	}
 
@@ -535,6 +552,73 @@ TORRENT_EXPORT int torrent_get_status(int tor, torrent_status* s, int struct_siz
 	return 0;
 }
 
+TORRENT_EXPORT int session_get_torrent_statuses(void* sesptr
+	, torrent_status_brief* s, int num, int struct_size, int flags)
+{
+	using namespace libtorrent;
+
+	if (struct_size != sizeof(torrent_status_brief)) return -1;
+	session* ses = (session*)sesptr;
+
+	// this is a single call into the session thread for all torrents. None
+	// of the optional fields are part of the brief, so none are requested
+	std::vector<libtorrent::torrent_status> st;
+	ses->get_torrent_status(&st
+		, [](libtorrent::torrent_status const&) { return true; }, 0);
+
+	std::unordered_map<torrent_handle, int> ids;
+	for (int i = 0; i < int(handles.size()); ++i)
+	{
+		if (handles[i].is_valid()) ids[handles[i]] = i;
+	}
+
+	int ret = 0;
+	for (libtorrent::torrent_status const& ts : st)
+	{
+		// torrents that weren't added through this API are given an id the
+		// first time they're seen
+		std::unordered_map<torrent_handle, int>::iterator i = ids.find(ts.handle);
+		int const tor = i == ids.end() ? add_handle(ts.handle) : i->second;
+
+		torrent_status_brief b;
+		memset(&b, 0, sizeof(b));
+		b.tor = tor;
+		b.state = (state_t)ts.state;
+		b.flags = (ts.paused ? torrent_status_paused : 0)
+			| (ts.auto_managed ? torrent_status_auto_managed : 0)
+			| (ts.seed_mode ? torrent_status_seed_mode : 0)
+			| (ts.has_incoming ? torrent_status_has_incoming : 0)
+			| (ts.is_finished ? torrent_status_finished : 0)
+			| (ts.errc ? torrent_status_error : 0);
+		b.progress = ts.progress;
+		b.total_done = ts.total_done;
+		b.total_wanted = ts.total_wanted;
+		b.total_payload_download = ts.total_payload_download;
+		b.total_payload_upload = ts.total_payload_upload;
+		b.download_payload_rate = ts.download_payload_rate;
+		b.upload_payload_rate = ts.upload_payload_rate;
+		b.num_seeds = ts.num_seeds;
+		b.num_peers = ts.num_peers;
+		b.num_complete = ts.num_complete;
+		b.num_incomplete = ts.num_incomplete;
+		b.num_connections = ts.num_connections;
+
+		if ((flags & statuses_changed_only)
+			&& memcmp(&b, &reported[tor], sizeof(b)) == 0)
+			continue;
+
+		// records that don't fit are not marked as reported, so that they're
+		// still considered changed by the next call
+		if (ret < num)
+		{
+			memcpy(&s[ret], &b, sizeof(b));
+			memcpy(&reported[tor], &b, sizeof(b));
+		}
+		++ret;
+	}
+	return ret;
+}
+
 TORRENT_EXPORT int torrent_set_settings(int tor, int tag, ...)
 {
 	using namespace libtorrent;
@@ -197,6 +197,46 @@ struct torrent_status
 	int seed_mode;
 };
 
+enum torrent_status_flags_t
+{
+	torrent_status_paused = 0x1,
+	torrent_status_auto_managed = 0x2,
+	torrent_status_seed_mode = 0x4,
+	torrent_status_has_incoming = 0x8,
+	torrent_status_finished = 0x10,
+	torrent_status_error = 0x20
+};
+
+// a compact subset of torrent_status, as filled in for many torrents at a
+// time by session_get_torrent_statuses()
+struct torrent_status_brief
+{
+	// the torrent, as passed to the torrent_* functions
+	int tor;
+	enum state_t state;
+	// torrent_status_flags_t bits
+	int flags;
+	float progress;
+	long long total_done;
+	long long total_wanted;
+	long long total_payload_download;
+	long long total_payload_upload;
+	int download_payload_rate;
+	int upload_payload_rate;
+	int num_seeds;
+	int num_peers;
+	int num_complete;
+	int num_incomplete;
+	int num_connections;
+};
+
+enum torrent_statuses_flags_t
+{
+	// only return the torrents whose record differs from the last one
+	// returned for it
+	statuses_changed_only = 0x1
+};
+
 struct session_status
 {
 	int has_incoming_connections;
@@ -284,6 +324,17 @@ int session_get_setting(void* ses, int tag, void* value, int* value_size);
 
 int torrent_get_status(int tor, struct torrent_status* s, int struct_size);
 
+// fills in up to num records in the array pointed to by s, for all torrents
+// in the session, with a single call into the session. With
+// statuses_changed_only in flags, only the torrents whose record changed
+// since it was last returned are included. Returns the number of records
+// there were, which may be greater than num, in which case only the first
+// num were filled in (with statuses_changed_only, the others are still
+// returned by the next call). Returns -1 if struct_size is not
+// sizeof(struct torrent_status_brief)
+int session_get_torrent_statuses(void* ses, struct torrent_status_brief* s
+	, int num, int struct_size, int flags);
+
 // use SET_* tags in tag list
 int torrent_set_settings(int tor, int first_tag, ...);
 int torrent_get_setting(int tor, int tag, void* value, int* value_size);
@@ -25,6 +25,41 @@ bytes get_buffer(read_piece_alert const& rpa)
        : bytes();
 }
 
+// holds a reference to the piece of a read_piece_alert and exposes it
+// through the buffer protocol. This lets memoryview() refer to the piece
+// without copying it, and keeps it valid after the alert is gone
+struct piece_buffer
+{
+    boost::shared_array<char> buffer;
+    int size;
+};
+
+int piece_buffer_getbuffer(PyObject* self, Py_buffer* view, int flags)
+{
+    static char empty;
+    piece_buffer const& b = extract<piece_buffer const&>(self);
+    return PyBuffer_FillInfo(view, self, b.buffer ? b.buffer.get() : &empty
+        , b.buffer ? b.size : 0, 1, flags);
+}
+
+void expose_buffer_protocol(object const& cls)
+{
+    static PyBufferProcs procs;
+    procs.bf_getbuffer = &piece_buffer_getbuffer;
+    procs.bf_releasebuffer = nullptr;
+    PyTypeObject* t = reinterpret_cast<PyTypeObject*>(cls.ptr());
+    t->tp_as_buffer = &procs;
+#if PY_MAJOR_VERSION < 3
+    t->tp_flags |= Py_TPFLAGS_HAVE_NEWBUFFER;
+#endif
+}
+
+object get_buffer_view(read_piece_alert const& rpa)
+{
+    object b(piece_buffer{rpa.buffer, rpa.size});
+    return object(handle<>(PyMemoryView_FromObject(b.ptr())));
+}
+
 list stats_alert_transferred(stats_alert const& alert)
 {
    list result;
@@ -45,6 +80,34 @@ list get_status_from_update_alert(state_update_alert const& alert)
    return result;
 }
 
+list get_peer_info_from_alert(peer_info_alert const& alert)
+{
+   list result;
+   for (auto const& p : alert.peer_info) result.append(p);
+   return result;
+}
+
+list get_files_from_progress_alert(file_progress_alert const& alert)
+{
+   list result;
+   for (auto const p : alert.files) result.append(p);
+   return result;
+}
+
+list get_priorities_from_alert(piece_priorities_alert const& alert)
+{
+   list result;
+   for (auto const p : alert.priorities) result.append(p);
+   return result;
+}
+
+list get_samples_from_alert(peer_sample_alert const& alert)
+{
+   list result;
+   for (auto const& s : alert.samples) result.append(s);
+   return result;
+}
+
 list dht_stats_active_requests(dht_stats_alert const& a)
 {
    list result;
@@ -119,6 +182,12 @@ dict dht_put_item(dht_put_alert const& alert)
     return d;
 }
 
+bytes session_stats_delta(session_stats_delta_alert const& alert)
+{
+    span<char const> const d = alert.delta();
+    return bytes(d.data(), int(d.size()));
+}
+
 dict session_stats_values(session_stats_alert const& alert)
 {
     std::vector<stats_metric> map = session_stats_metrics();
@@ -216,6 +285,12 @@ namespace boost
 	POLY(dht_mutable_item_alert)
 	POLY(dht_put_alert)
 	POLY(session_stats_alert)
+	POLY(session_stats_delta_alert)
+	POLY(network_stall_alert)
+	POLY(peer_info_alert)
+	POLY(file_progress_alert)
+	POLY(piece_priorities_alert)
+	POLY(peer_sample_alert)
 	POLY(dht_get_peers_reply_alert)
 
 #ifndef TORRENT_NO_DEPRECATE
@@ -313,6 +388,8 @@ void bind_alert()
         .def_readonly("info_hash", &torrent_removed_alert::info_hash)
         ;
 
+    expose_buffer_protocol(class_<piece_buffer>("piece_buffer", no_init));
+
     class_<read_piece_alert, bases<torrent_alert>, noncopyable>(
         "read_piece_alert", nullptr, no_init)
         .def_readonly("error", &read_piece_alert::error)
@@ -320,6 +397,7 @@ void bind_alert()
         .def_readonly("ec", &read_piece_alert::ec)
 #endif
         .add_property("buffer", get_buffer)
+        .add_property("buffer_view", get_buffer_view)
         .def_readonly("piece", &read_piece_alert::piece)
         .def_readonly("size", &read_piece_alert::size)
         ;
@@ -613,6 +691,7 @@ void bind_alert()
     class_<save_resume_data_alert, bases<torrent_alert>, noncopyable>(
         "save_resume_data_alert", no_init)
         .def_readonly("params", &save_resume_data_alert::params)
+        .def_readonly("changes", &save_resume_data_alert::changes)
 #ifndef TORRENT_NO_DEPRECATE
         .def_readonly("resume_data", &save_resume_data_alert::resume_data)
 #endif
@@ -894,6 +973,45 @@ void bind_alert()
         .add_property("values", &session_stats_values)
         ;
 
+    class_<session_stats_delta_alert, bases<alert>, noncopyable>(
+        "session_stats_delta_alert", no_init)
+        .add_property("delta", &session_stats_delta)
+        ;
+
+    enum_<network_stall_alert::handler_t>("network_stall_handler_t")
+        .value("session_call", network_stall_alert::session_call)
+        .value("torrent_call", network_stall_alert::torrent_call)
+        .value("tick", network_stall_alert::tick)
+        ;
+
+    class_<network_stall_alert, bases<alert>, noncopyable>(
+        "network_stall_alert", no_init)
+        .add_property("handler", make_getter(&network_stall_alert::handler, by_value()))
+        .add_property("queue_time", make_getter(&network_stall_alert::queue_time, by_value()))
+        .add_property("exec_time", make_getter(&network_stall_alert::exec_time, by_value()))
+        ;
+
+    class_<peer_info_alert, bases<torrent_alert>, noncopyable>(
+        "peer_info_alert", no_init)
+        .add_property("peer_info", &get_peer_info_from_alert)
+        ;
+
+    class_<file_progress_alert, bases<torrent_alert>, noncopyable>(
+        "file_progress_alert", no_init)
+        .add_property("files", &get_files_from_progress_alert)
+        ;
+
+    class_<piece_priorities_alert, bases<torrent_alert>, noncopyable>(
+        "piece_priorities_alert", no_init)
+        .add_property("priorities", &get_priorities_from_alert)
+        ;
+
+    class_<peer_sample_alert, bases<alert>, noncopyable>(
+        "peer_sample_alert", no_init)
+        .add_property("samples", &get_samples_from_alert)
+        .def_readonly("num_peers", &peer_sample_alert::num_peers)
+        ;
+
     std::vector<tcp::endpoint> (dht_get_peers_reply_alert::*peers)() const = &dht_get_peers_reply_alert::peers;
 
     class_<dht_get_peers_reply_alert, bases<alert>, noncopyable>(
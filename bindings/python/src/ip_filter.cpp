@@ -28,5 +28,6 @@ void bind_ip_filter()
         .def("add_rule", add_rule)
         .def("access", access0)
         .def("export_filter", allow_threads(&ip_filter::export_filter))
+        .def("compile", allow_threads(&ip_filter::compile))
     ;
 }
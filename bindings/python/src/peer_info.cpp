@@ -47,9 +47,26 @@ list get_pieces(peer_info const& pi)
     return ret;
 }
 
+tuple get_sample_ip(peer_sample const& s)
+{
+    return boost::python::make_tuple(s.ip.address().to_string(), s.ip.port());
+}
+
 using by_value = return_value_policy<return_by_value>;
 void bind_peer_info()
 {
+    class_<peer_sample>("peer_sample")
+        .def_readonly("info_hash", &peer_sample::info_hash)
+        .add_property("ip", get_sample_ip)
+        .def_readonly("up_rate", &peer_sample::up_rate)
+        .def_readonly("down_rate", &peer_sample::down_rate)
+        .def_readonly("download_queue_length", &peer_sample::download_queue_length)
+        .def_readonly("upload_queue_length", &peer_sample::upload_queue_length)
+        .def_readonly("queue_bytes", &peer_sample::queue_bytes)
+        .def_readonly("send_buffer_bytes", &peer_sample::send_buffer_bytes)
+        .def_readonly("rtt", &peer_sample::rtt)
+        ;
+
     scope pi = class_<peer_info>("peer_info")
         .def_readonly("flags", &peer_info::flags)
         .def_readonly("source", &peer_info::source)
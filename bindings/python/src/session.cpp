@@ -4,6 +4,11 @@
 
 #include <list>
 #include <string>
+#include <thread>
+#include <atomic>
+#include <algorithm>
+#include <typeinfo>
+#include <unordered_map>
 #include <libtorrent/session.hpp>
 #include <libtorrent/storage.hpp>
 #include <libtorrent/error_code.hpp>
@@ -330,6 +335,10 @@ namespace
                 p.renamed_files =
                     extract<std::map<lt::file_index_t, std::string>>(value);
             }
+            else if(key == "extra_save_paths")
+            {
+                p.extra_save_paths = extract<std::vector<std::string>>(value);
+            }
             else if(key == "file_priorities")
             {
                 p.file_priorities = extract<std::vector<std::uint8_t>>(value);
@@ -371,6 +380,90 @@ namespace
         s.async_add_torrent(p);
     }
 
+    void async_add_torrents(lt::session& s, list params)
+    {
+        std::vector<add_torrent_params> atps;
+        int const size = int(len(params));
+        for (int i = 0; i < size; ++i)
+        {
+            add_torrent_params p;
+            dict_to_add_torrent_params(dict(params[i]), p);
+            atps.push_back(std::move(p));
+        }
+
+        allow_threading_guard guard;
+
+        s.async_add_torrents(std::move(atps));
+    }
+
+    // like async_add_torrents(), but "ti" may be the filename of a .torrent
+    // file. Those are loaded by a pool of threads, without holding the GIL.
+    // Torrents that fail to load are not added, they are returned as a list
+    // of (index, error_code) tuples
+    list async_add_torrent_files(lt::session& s, list params, int threads)
+    {
+        int const size = int(len(params));
+        std::vector<add_torrent_params> atps(static_cast<std::size_t>(size));
+        std::vector<std::string> filenames(static_cast<std::size_t>(size));
+        for (int i = 0; i < size; ++i)
+        {
+            dict d = dict(params[i]).copy();
+            if (d.has_key("ti"))
+            {
+                extract<std::string> filename(d["ti"]);
+                if (filename.check())
+                {
+                    filenames[std::size_t(i)] = filename();
+                    d["ti"].del();
+                }
+            }
+            dict_to_add_torrent_params(d, atps[std::size_t(i)]);
+        }
+
+        std::vector<error_code> errors(static_cast<std::size_t>(size));
+        {
+            allow_threading_guard guard;
+
+            if (threads <= 0) threads = int(std::thread::hardware_concurrency());
+            threads = std::max(1, std::min(threads, size));
+
+            std::atomic<int> next(0);
+            auto load = [&]()
+            {
+                for (int i = next++; i < size; i = next++)
+                {
+                    std::string const& f = filenames[std::size_t(i)];
+                    if (f.empty()) continue;
+                    error_code& ec = errors[std::size_t(i)];
+                    auto ti = std::make_shared<torrent_info>(f, ec);
+                    if (!ec) atps[std::size_t(i)].ti = std::move(ti);
+                }
+            };
+
+            std::vector<std::thread> pool;
+            for (int i = 1; i < threads; ++i) pool.emplace_back(load);
+            load();
+            for (auto& t : pool) t.join();
+
+            std::vector<add_torrent_params> add;
+            add.reserve(atps.size());
+            for (int i = 0; i < size; ++i)
+            {
+                if (errors[std::size_t(i)]) continue;
+                add.push_back(std::move(atps[std::size_t(i)]));
+            }
+            s.async_add_torrents(std::move(add));
+        }
+
+        list ret;
+        for (int i = 0; i < size; ++i)
+        {
+            if (!errors[std::size_t(i)]) continue;
+            ret.append(boost::python::make_tuple(i, errors[std::size_t(i)]));
+        }
+        return ret;
+    }
+
 #ifndef TORRENT_NO_DEPRECATE
     void start_natpmp(lt::session& s)
     {
@@ -396,6 +489,18 @@ namespace
         return a;
     }
 
+    void post_torrent_status(lt::session& s, list handles, std::uint32_t flags)
+    {
+        std::vector<torrent_handle> hs;
+        int const size = int(len(handles));
+        for (int i = 0; i < size; ++i)
+            hs.push_back(extract<torrent_handle>(handles[i]));
+
+        allow_threading_guard guard;
+
+        s.post_torrent_status(std::move(hs), flags);
+    }
+
     list get_torrents(lt::session& s)
     {
         list ret;
@@ -497,6 +602,58 @@ namespace
         return ret;
     }
 
+    // like pop_alerts(), but only returns the alerts that are instances of
+    // one of the classes in ``types``, as (class, torrent handle or None,
+    // alert) tuples. No python objects are created for the other alerts
+    list pop_alerts_filtered(lt::session& ses, object const& types)
+    {
+        std::vector<PyTypeObject*> wanted;
+        stl_input_iterator<object> i(types), end;
+        for (; i != end; ++i)
+        {
+            if (!PyType_Check(i->ptr()))
+            {
+                PyErr_SetString(PyExc_TypeError, "expected alert classes");
+                throw_error_already_set();
+            }
+            wanted.push_back(reinterpret_cast<PyTypeObject*>(i->ptr()));
+        }
+
+        std::vector<alert*> alerts;
+        {
+            allow_threading_guard guard;
+            ses.pop_alerts(&alerts);
+        }
+
+        // the python class of every alert type that's wanted, or nullptr for
+        // the ones that aren't. Looked up the first time the type is seen
+        std::unordered_map<int, PyTypeObject*> classes;
+
+        list ret;
+        for (alert* a : alerts)
+        {
+            auto c = classes.find(a->type());
+            if (c == classes.end())
+            {
+                converter::registration const* r = converter::registry::query(
+                    boost::python::type_info(typeid(*a)));
+                PyTypeObject* cls = r ? r->m_class_object : nullptr;
+                bool const want = cls && std::any_of(wanted.begin(), wanted.end()
+                    , [cls](PyTypeObject* t) { return PyType_IsSubtype(cls, t) != 0; });
+                c = classes.emplace(a->type(), want ? cls : nullptr).first;
+            }
+            if (c->second == nullptr) continue;
+
+            object cls(boost::python::handle<>(boost::python::borrowed(
+                reinterpret_cast<PyObject*>(c->second))));
+            torrent_alert const* ta = dynamic_cast<torrent_alert const*>(a);
+            ret.append(boost::python::make_tuple(cls
+                , ta ? object(ta->handle) : object()
+                , boost::python::ptr(a)));
+        }
+        return ret;
+    }
+
 	void load_state(lt::session& ses, entry const& st, std::uint32_t flags)
 	{
 		allow_threading_guard guard;
@@ -685,6 +842,7 @@ void bind_session()
         .add_property("piece_priorities", PROP(&add_torrent_params::piece_priorities))
         .add_property("merkle_tree", PROP(&add_torrent_params::merkle_tree))
         .add_property("renamed_files", PROP(&add_torrent_params::renamed_files))
+        .add_property("extra_save_paths", PROP(&add_torrent_params::extra_save_paths))
 
 #ifndef TORRENT_NO_DEPRECATE
         .def_readwrite("url", &add_torrent_params::url)
@@ -785,7 +943,9 @@ void bind_session()
         .def("outgoing_ports", &outgoing_ports)
 #endif
         .def("post_torrent_updates", allow_threads(&lt::session::post_torrent_updates), arg("flags") = 0xffffffff)
+        .def("post_torrent_status", &post_torrent_status, (arg("handles"), arg("flags") = 0xffffffff))
         .def("post_session_stats", allow_threads(&lt::session::post_session_stats))
+        .def("post_session_stats_delta", allow_threads(&lt::session::post_session_stats_delta))
         .def("is_listening", allow_threads(&lt::session::is_listening))
         .def("listen_port", allow_threads(&lt::session::listen_port))
 #ifndef TORRENT_DISABLE_DHT
@@ -809,6 +969,9 @@ void bind_session()
         .def("add_torrent", &add_torrent)
         .def("async_add_torrent", &async_add_torrent)
         .def("async_add_torrent", &lt::session::async_add_torrent)
+        .def("async_add_torrents", &async_add_torrents)
+        .def("async_add_torrent_files", &async_add_torrent_files
+            , (arg("params"), arg("threads") = 0))
         .def("add_torrent", allow_threads((lt::torrent_handle (session_handle::*)(add_torrent_params const&))&lt::session::add_torrent))
 #ifndef BOOST_NO_EXCEPTIONS
 #ifndef TORRENT_NO_DEPRECATE
@@ -837,6 +1000,7 @@ void bind_session()
         .def("load_state", &load_state, (arg("entry"), arg("flags") = 0xffffffff))
         .def("save_state", &save_state, (arg("entry"), arg("flags") = 0xffffffff))
         .def("pop_alerts", &pop_alerts)
+        .def("pop_alerts_filtered", &pop_alerts_filtered)
         .def("wait_for_alert", &wait_for_alert, return_internal_reference<>())
         .def("add_extension", &add_extension)
 #ifndef TORRENT_NO_DEPRECATE
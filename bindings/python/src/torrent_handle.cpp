@@ -401,6 +401,10 @@ void bind_torrent_handle()
         .def(self < self)
         .def("get_peer_info", get_peer_info)
         .def("status", _(&torrent_handle::status), arg("flags") = 0xffffffff)
+        .def("post_status", _(&torrent_handle::post_status), arg("flags") = 0xffffffff)
+        .def("post_peer_info", _(&torrent_handle::post_peer_info))
+        .def("post_file_progress", _(&torrent_handle::post_file_progress), arg("flags") = 0)
+        .def("post_piece_priorities", _(&torrent_handle::post_piece_priorities))
         .def("get_download_queue", get_download_queue)
         .def("file_progress", file_progress, arg("flags") = 0)
         .def("trackers", trackers)
@@ -475,7 +479,10 @@ void bind_torrent_handle()
         .def("upload_limit", _(&torrent_handle::upload_limit))
         .def("set_download_limit", _(&torrent_handle::set_download_limit))
         .def("download_limit", _(&torrent_handle::download_limit))
+        .def("set_alert_mask", _(&torrent_handle::set_alert_mask))
+        .def("alert_mask", _(&torrent_handle::alert_mask))
         .def("set_sequential_download", _(&torrent_handle::set_sequential_download))
+        .def("set_stream_window", _(&torrent_handle::set_stream_window), (arg("file"), arg("offset"), arg("num_pieces")))
 #ifndef TORRENT_NO_DEPRECATE
         .def("set_peer_upload_limit", &torrent_handle::set_peer_upload_limit)
         .def("set_peer_download_limit", &torrent_handle::set_peer_download_limit)
@@ -533,6 +540,17 @@ void bind_torrent_handle()
         .value("flush_disk_cache", torrent_handle::flush_disk_cache)
         .value("save_info_dict", torrent_handle::save_info_dict)
         .value("only_if_modified", torrent_handle::only_if_modified)
+        .value("only_changes", torrent_handle::only_changes)
+    ;
+
+    enum_<torrent_handle::resume_data_changes_t>("resume_data_changes_t")
+        .value("resume_pieces", torrent_handle::resume_pieces)
+        .value("resume_priorities", torrent_handle::resume_priorities)
+        .value("resume_trackers", torrent_handle::resume_trackers)
+        .value("resume_settings", torrent_handle::resume_settings)
+        .value("resume_stats", torrent_handle::resume_stats)
+        .value("resume_peers", torrent_handle::resume_peers)
+        .value("resume_all", torrent_handle::resume_all)
     ;
 
     enum_<torrent_handle::deadline_flags>("deadline_flags")
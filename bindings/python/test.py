@@ -348,6 +348,24 @@ class test_alerts(unittest.TestCase):
                 print(a.message())
             time.sleep(0.1)
 
+    def test_pop_alerts_filtered(self):
+        ses = lt.session({'alert_mask': lt.alert.category_t.all_categories,
+                          'enable_dht': False})
+        ti = lt.torrent_info('url_seed_multi.torrent')
+        h = ses.add_torrent({'ti': ti, 'save_path': os.getcwd()})
+
+        alerts = []
+        for i in range(0, 10):
+            alerts += ses.pop_alerts_filtered([lt.torrent_alert])
+            time.sleep(0.1)
+        self.assertTrue(len(alerts) > 0)
+        for cls, handle, a in alerts:
+            self.assertTrue(isinstance(a, lt.torrent_alert))
+            self.assertTrue(isinstance(a, cls))
+            self.assertEqual(handle, h)
+
+        self.assertEqual(ses.pop_alerts_filtered([]), [])
+
 
 class test_bencoder(unittest.TestCase):
 
@@ -392,6 +410,22 @@ class test_session(unittest.TestCase):
             'banned_peers': [('8.7.6.5', 6881)],
             'file_priorities': [1,1,1,2,0]})
 
+    def test_async_add_torrent_files(self):
+        s = lt.session({'alert_mask': lt.alert.category_t.status_notification, 'enable_dht': False})
+        failed = s.async_add_torrent_files([
+            {'ti': 'base.torrent', 'save_path': '.'},
+            {'ti': 'does-not-exist.torrent', 'save_path': '.'}])
+        self.assertEqual(len(failed), 1)
+        self.assertEqual(failed[0][0], 1)
+
+        added = []
+        for i in range(0, 50):
+            s.wait_for_alert(100)
+            added += [a for a in s.pop_alerts() if isinstance(a, lt.add_torrent_alert)]
+            if added: break
+        self.assertEqual(len(added), 1)
+        self.assertTrue(added[0].handle.is_valid())
+
     def test_apply_settings(self):
 
         s = lt.session({'enable_dht': False})
@@ -95,6 +95,7 @@ category_mapping = {
 	'hasher.hpp': 'Utility',
 	'hasher512.hpp': 'Utility',
 	'identify_client.hpp': 'Utility',
+	'trace.hpp': 'Utility',
 	'ip_filter.hpp': 'Filter',
 	'session_settings.hpp': 'Settings',
 	'settings_pack.hpp': 'Settings',
@@ -133,6 +133,78 @@ void ge_double_scalarmult_vartime(ge_p2 *r, const unsigned char *a, const ge_p3
 }
 
 
+static void precompute_odd_multiples(ge_cached *Ai, const ge_p3 *A) {
+    ge_p1p1 t;
+    ge_p3 u;
+    ge_p3 A2;
+    int i;
+    ge_p3_to_cached(&Ai[0], A);
+    ge_p3_dbl(&t, A);
+    ge_p1p1_to_p3(&A2, &t);
+
+    for (i = 1; i < 8; ++i) {
+        ge_add(&t, &A2, &Ai[i - 1]);
+        ge_p1p1_to_p3(&u, &t);
+        ge_p3_to_cached(&Ai[i], &u);
+    }
+}
+
+/*
+r = a[0] * A[0] + ... + a[n-1] * A[n-1] + b * B
+
+using Straus' method, sharing the doublings between all the points. slides
+must have room for 256 * n values and table for 8 * n values.
+*/
+
+void ge_multi_scalarmult_vartime(ge_p2 *r, const unsigned char *const *a, const ge_p3 *A, size_t n, const unsigned char *b, signed char *slides, ge_cached *table) {
+    signed char bslide[256];
+    ge_p1p1 t;
+    ge_p3 u;
+    size_t j;
+    int i;
+
+    slide(bslide, b);
+    for (j = 0; j < n; ++j) {
+        slide(slides + 256 * j, a[j]);
+        precompute_odd_multiples(table + 8 * j, &A[j]);
+    }
+    ge_p2_0(r);
+
+    for (i = 255; i >= 0; --i) {
+        if (bslide[i]) break;
+        for (j = 0; j < n; ++j) {
+            if (slides[256 * j + i]) break;
+        }
+        if (j < n) break;
+    }
+
+    for (; i >= 0; --i) {
+        ge_p2_dbl(&t, r);
+
+        for (j = 0; j < n; ++j) {
+            signed char const s = slides[256 * j + i];
+            if (s > 0) {
+                ge_p1p1_to_p3(&u, &t);
+                ge_add(&t, &u, &table[8 * j + s / 2]);
+            } else if (s < 0) {
+                ge_p1p1_to_p3(&u, &t);
+                ge_sub(&t, &u, &table[8 * j + (-s) / 2]);
+            }
+        }
+
+        if (bslide[i] > 0) {
+            ge_p1p1_to_p3(&u, &t);
+            ge_madd(&t, &u, &Bi[bslide[i] / 2]);
+        } else if (bslide[i] < 0) {
+            ge_p1p1_to_p3(&u, &t);
+            ge_msub(&t, &u, &Bi[(-bslide[i]) / 2]);
+        }
+
+        ge_p1p1_to_p2(r, &t);
+    }
+}
+
+
 static const fe d = {
     -10913610, 13857413, -15372611, 6949391, 114729, -8787816, -6275908, -3247719, -18696448, -12055116
 };
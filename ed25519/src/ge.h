@@ -2,6 +2,7 @@
 #define GE_H
 
 #include "fe.h"
+#include <stddef.h>
 
 
 /*
@@ -58,6 +59,7 @@ int ge_frombytes_negate_vartime(ge_p3 *h, const unsigned char *s);
 void ge_add(ge_p1p1 *r, const ge_p3 *p, const ge_cached *q);
 void ge_sub(ge_p1p1 *r, const ge_p3 *p, const ge_cached *q);
 void ge_double_scalarmult_vartime(ge_p2 *r, const unsigned char *a, const ge_p3 *A, const unsigned char *b);
+void ge_multi_scalarmult_vartime(ge_p2 *r, const unsigned char *const *a, const ge_p3 *A, size_t n, const unsigned char *b, signed char *slides, ge_cached *table);
 void ge_madd(ge_p1p1 *r, const ge_p3 *p, const ge_precomp *q);
 void ge_msub(ge_p1p1 *r, const ge_p3 *p, const ge_precomp *q);
 void ge_scalarmult_base(ge_p3 *h, const unsigned char *a);
@@ -3,9 +3,14 @@
 
 #include "libtorrent/ed25519.hpp"
 #include "libtorrent/hasher512.hpp"
+#include "libtorrent/random.hpp"
 #include "ge.h"
 #include "sc.h"
 
+#include <vector>
+#include <array>
+#include <cstring>
+
 namespace libtorrent
 {
 
@@ -81,4 +86,82 @@ int ed25519_verify(const unsigned char *signature, const unsigned char *message,
     return 1;
 }
 
+/*
+verifies all count signatures at once, by checking the sum of the
+verification equations, each weighted by a random 128 bit scalar z:
+
+(sum z S) * B + sum (z h) * -A + sum z * -R = 0
+
+all of which is computed as a single multi-scalar multiplication. Returns 1
+if all signatures are valid. If any signature fails the ordinary verification,
+this returns 0 with overwhelming probability, but it does not tell which one.
+Since R is decoded rather than compared byte for byte, the only signatures
+this accepts but ed25519_verify() rejects are ones crafted by the holder of
+the private key (with a non-canonical R, or small order components)
+*/
+
+int ed25519_verify_batch(const unsigned char *const *signatures, const unsigned char *const *messages, const size_t *message_lens, const unsigned char *const *public_keys, size_t count) {
+    if (count == 0) {
+        return 1;
+    }
+
+    size_t const num_points = 2 * count;
+    std::vector<ge_p3> points(num_points);
+    std::vector<std::array<unsigned char, 32>> scalars(num_points);
+    std::vector<const unsigned char*> scalar_ptrs(num_points);
+    std::vector<signed char> slides(256 * num_points);
+    std::vector<ge_cached> table(8 * num_points);
+    unsigned char zero[32] = {0};
+    unsigned char base_scalar[32] = {0};
+    unsigned char identity[32] = {1};
+    unsigned char checker[32];
+    ge_p2 R;
+    size_t i;
+
+    for (i = 0; i < count; ++i) {
+        const unsigned char *signature = signatures[i];
+        const unsigned char *public_key = public_keys[i];
+
+        if (signature[63] & 224) {
+            return 0;
+        }
+
+        /* -R and -A */
+        if (ge_frombytes_negate_vartime(&points[2 * i], signature) != 0) {
+            return 0;
+        }
+        if (ge_frombytes_negate_vartime(&points[2 * i + 1], public_key) != 0) {
+            return 0;
+        }
+
+        hasher512 hash;
+        hash.update({reinterpret_cast<char const*>(signature), 32});
+        hash.update({reinterpret_cast<char const*>(public_key), 32});
+        hash.update({reinterpret_cast<char const*>(messages[i]), message_lens[i]});
+        sha512_hash h = hash.final();
+        sc_reduce(reinterpret_cast<unsigned char*>(h.data()));
+
+        unsigned char z[32] = {0};
+        aux::random_bytes({reinterpret_cast<char*>(z), 16});
+
+        std::memcpy(scalars[2 * i].data(), z, 32);
+        sc_muladd(scalars[2 * i + 1].data(), z
+            , reinterpret_cast<unsigned char*>(h.data()), zero);
+        sc_muladd(base_scalar, z, signature + 32, base_scalar);
+
+        scalar_ptrs[2 * i] = scalars[2 * i].data();
+        scalar_ptrs[2 * i + 1] = scalars[2 * i + 1].data();
+    }
+
+    ge_multi_scalarmult_vartime(&R, scalar_ptrs.data(), points.data(), num_points
+        , base_scalar, slides.data(), table.data());
+    ge_tobytes(checker, &R);
+
+    if (!consttime_equal(checker, identity)) {
+        return 0;
+    }
+
+    return 1;
+}
+
 }
@@ -42,6 +42,15 @@ POSSIBILITY OF SUCH DAMAGE.
 #include "libtorrent/socket_io.hpp"
 #include "libtorrent/file_pool.hpp"
 #include "libtorrent/string_view.hpp"
+#include "libtorrent/socket_type.hpp"
+#include "libtorrent/utp_stream.hpp"
+#include "libtorrent/utp_socket_manager.hpp"
+#include "libtorrent/deadline_timer.hpp"
+#include "libtorrent/performance_counters.hpp"
+#include "libtorrent/aux_/session_settings.hpp"
+#ifndef TORRENT_DISABLE_ENCRYPTION
+#include "libtorrent/pe_crypto.hpp"
+#endif
 #include <random>
 #include <cstring>
 #include <thread>
@@ -49,6 +58,10 @@ POSSIBILITY OF SUCH DAMAGE.
 #include <iostream>
 #include <atomic>
 #include <array>
+#include <memory>
+#include <vector>
+#include <algorithm>
+#include <mutex>
 
 #if BOOST_ASIO_DYN_LINK
 #if BOOST_VERSION >= 104500
@@ -106,6 +119,95 @@ std::atomic<int> num_suggest(0);
 // the number of requests made from suggested pieces
 std::atomic<int> num_suggested_requests(0);
 
+// when set, the connections are made over uTP instead of TCP
+bool use_utp = false;
+
+// when set, the connections are encrypted with RC4, negotiated by the
+// message stream encryption handshake (MSE/PE)
+bool use_encryption = false;
+
+// the io_services, one per network thread. Connections are spread evenly
+// across them
+std::vector<std::unique_ptr<io_service>> io_services;
+
+// the number of connections that have not been closed yet. When this
+// reaches zero, the test is done and the network threads are stopped
+std::atomic<int> num_active(0);
+
+void stop_network_threads()
+{
+	for (auto& ios : io_services) ios->stop();
+}
+
+// every network thread has its own UDP socket and uTP socket manager when
+// testing over uTP
+struct utp_context
+{
+	explicit utp_context(io_service& ios)
+		: sock(ios)
+		, mgr(std::bind(&utp_context::send_packet, this, _1, _2, _3, _4)
+			, [] {}
+			, [](std::shared_ptr<socket_type> const&) {}
+			, ios, sett, cnt, nullptr)
+		, tick_timer(ios)
+	{}
+
+	void start(error_code& ec)
+	{
+		sock.open(udp::v4(), ec);
+		if (ec) return;
+		sock.bind(udp::endpoint(address_v4::any(), 0), ec);
+		if (ec) return;
+		receive();
+		on_tick(error_code());
+	}
+
+	void send_packet(udp::endpoint const& ep, span<char const> p, error_code& ec, int)
+	{
+		sock.send_to(boost::asio::buffer(p.data(), p.size()), ep, 0, ec);
+	}
+
+	void receive()
+	{
+		sock.async_receive_from(boost::asio::buffer(buf), from
+			, std::bind(&utp_context::on_receive, this, _1, _2));
+	}
+
+	void on_receive(error_code const& ec, std::size_t const bytes)
+	{
+		if (ec == boost::asio::error::operation_aborted) return;
+		if (!ec)
+		{
+			mgr.start_batch();
+			mgr.incoming_packet(from, {buf.data(), bytes});
+			mgr.socket_drained();
+		}
+		receive();
+	}
+
+	void on_tick(error_code const& ec)
+	{
+		if (ec) return;
+		mgr.tick(clock_type::now());
+		tick_timer.expires_from_now(milliseconds(100));
+		tick_timer.async_wait(std::bind(&utp_context::on_tick, this, _1));
+	}
+
+	udp::socket sock;
+	aux::session_settings sett;
+	counters cnt;
+	utp_socket_manager mgr;
+	deadline_timer tick_timer;
+	std::array<char, 1500> buf;
+	udp::endpoint from;
+};
+
+// the time it took for each piece request to be answered, in microseconds,
+// across all connections. Connections collect their samples locally and add
+// them here when they close
+std::mutex latency_mutex;
+std::vector<int> request_latencies;
+
 void sleep_ms(int milliseconds)
 {
 #if defined TORRENT_WINDOWS || defined TORRENT_CYGWIN
@@ -156,9 +258,12 @@ std::mt19937 rng(dev());
 
 struct peer_conn
 {
-	peer_conn(io_service& ios, int num_pieces, int blocks_pp, tcp::endpoint const& ep
-		, char const* ih, bool seed_, int churn_, bool corrupt_)
-		: s(ios)
+	peer_conn(io_service& ios_, int num_pieces, int blocks_pp, tcp::endpoint const& ep
+		, char const* ih, bool seed_, int churn_, bool corrupt_
+		, utp_socket_manager* utp_mgr_)
+		: ios(ios_)
+		, s(ios_)
+		, utp_mgr(utp_mgr_)
 		, read_pos(0)
 		, state(handshaking)
 		, choked(true)
@@ -178,16 +283,31 @@ struct peer_conn
 		, corrupt(corrupt_)
 		, endpoint(ep)
 		, restarting(false)
+		, closed(false)
 	{
 		corruption_counter = rand() % 1000;
 		if (seed) ++num_seeds;
+		++num_active;
 		pieces.reserve(num_pieces);
-		start_conn();
+		// the connection is started by the network thread, which may already
+		// be running
+		ios.post(std::bind(&peer_conn::start_conn, this));
 	}
 
 	void start_conn()
 	{
-		if (local_bind)
+		if (utp_mgr != nullptr)
+		{
+			s.instantiate<utp_stream>(ios);
+			utp_stream* str = s.get<utp_stream>();
+			str->set_impl(utp_mgr->new_utp_socket(str));
+		}
+		else
+		{
+			s.instantiate<tcp::socket>(ios);
+		}
+
+		if (local_bind && utp_mgr == nullptr)
 		{
 			error_code ec;
 			s.open(endpoint.protocol(), ec);
@@ -209,10 +329,69 @@ struct peer_conn
 			}
 		}
 		restarting = false;
+		pending.clear();
+		requests.clear();
+#ifndef TORRENT_DISABLE_ENCRYPTION
+		rc4.reset();
+		dh.reset();
+#endif
 		s.async_connect(endpoint, std::bind(&peer_conn::on_connect, this, _1));
 	}
 
-	tcp::socket s;
+	// reads exactly len bytes into dst, decrypting them if the connection is
+	// encrypted. Bytes already received by the encryption handshake are
+	// consumed first
+	template <typename Handler>
+	void read(char* dst, int const len, Handler const& h)
+	{
+		int const buffered = std::min(len, int(pending.size()));
+		if (buffered > 0)
+		{
+			std::memcpy(dst, pending.data(), std::size_t(buffered));
+			pending.erase(pending.begin(), pending.begin() + buffered);
+		}
+		if (buffered == len)
+		{
+			decrypt(dst, len);
+			ios.post(std::bind(h, error_code(), std::size_t(len)));
+			return;
+		}
+		boost::asio::async_read(s, boost::asio::buffer(dst + buffered
+			, std::size_t(len - buffered))
+			, [this, dst, len, h](error_code const& ec, std::size_t)
+			{
+				if (!ec) decrypt(dst, len);
+				h(ec, std::size_t(len));
+			});
+	}
+
+	void encrypt(char* buf, int const len)
+	{
+#ifndef TORRENT_DISABLE_ENCRYPTION
+		if (!rc4 || len == 0) return;
+		span<char> vec(buf, std::size_t(len));
+		rc4->encrypt(vec);
+#else
+		TORRENT_UNUSED(buf);
+		TORRENT_UNUSED(len);
+#endif
+	}
+
+	void decrypt(char* buf, int const len)
+	{
+#ifndef TORRENT_DISABLE_ENCRYPTION
+		if (!rc4 || len == 0) return;
+		span<char> vec(buf, std::size_t(len));
+		rc4->decrypt(vec);
+#else
+		TORRENT_UNUSED(buf);
+		TORRENT_UNUSED(len);
+#endif
+	}
+
+	io_service& ios;
+	socket_type s;
+	utp_socket_manager* utp_mgr;
 	char write_buf_proto[100];
 	std::uint32_t write_buffer[17*1024/4];
 	std::uint32_t buffer[17*1024/4];
@@ -248,6 +427,37 @@ struct peer_conn
 	bool corrupt;
 	tcp::endpoint endpoint;
 	bool restarting;
+	bool closed;
+
+	// bytes received past the end of the encryption handshake, not yet
+	// consumed by read()
+	std::vector<char> pending;
+
+	// the outstanding piece requests and when they were sent, to measure the
+	// request latency
+	struct request_t
+	{
+		piece_index_t piece;
+		int start;
+		time_point sent;
+	};
+	std::vector<request_t> requests;
+
+	// the time it took to receive each requested block, in microseconds
+	std::vector<int> latencies;
+
+#ifndef TORRENT_DISABLE_ENCRYPTION
+	// the state of the encryption handshake. Once rc4 is set, everything
+	// sent and received is encrypted
+	std::unique_ptr<dh_key_exchange> dh;
+	std::shared_ptr<rc4_handler> rc4;
+
+	// the encrypted verification constant we expect from the other end, to
+	// find the end of its padding
+	std::array<char, 8> sync_vc;
+	char pe_buf[96 + 20 + 20 + 8 + 4 + 2 + 512 + 2];
+	std::vector<char> sync_buf;
+#endif
 
 	void on_connect(error_code const& ec)
 	{
@@ -257,6 +467,187 @@ struct peer_conn
 			return;
 		}
 
+#ifndef TORRENT_DISABLE_ENCRYPTION
+		if (use_encryption)
+		{
+			write_pe1();
+			return;
+		}
+#endif
+		write_handshake();
+	}
+
+#ifndef TORRENT_DISABLE_ENCRYPTION
+	// send our DH public key followed by random padding
+	void write_pe1()
+	{
+		dh.reset(new dh_key_exchange);
+		std::array<char, 96> const local_key = export_key(dh->get_local_key());
+		std::memcpy(pe_buf, local_key.data(), local_key.size());
+		int const pad_size = rand() % 512;
+		std::generate(pe_buf + 96, pe_buf + 96 + pad_size, &rand);
+		boost::asio::async_write(s, boost::asio::buffer(pe_buf, std::size_t(96 + pad_size))
+			, std::bind(&peer_conn::on_pe1_sent, this, _1, _2));
+	}
+
+	void on_pe1_sent(error_code const& ec, size_t)
+	{
+		if (ec)
+		{
+			close("ERROR SEND DH KEY: %s", ec);
+			return;
+		}
+		// the other end's public key
+		boost::asio::async_read(s, boost::asio::buffer(pe_buf, 96)
+			, std::bind(&peer_conn::on_pe2, this, _1, _2));
+	}
+
+	// we have the other end's public key. Send the stream key (the
+	// info-hash) and the encryption method we support, all but the hashes
+	// encrypted with the shared secret
+	void on_pe2(error_code const& ec, size_t)
+	{
+		if (ec)
+		{
+			close("ERROR READ DH KEY: %s", ec);
+			return;
+		}
+
+		dh->compute_secret(reinterpret_cast<std::uint8_t const*>(pe_buf));
+		std::array<char, 96> const secret = export_key(dh->get_secret());
+		sha1_hash const skey(info_hash);
+
+		char* ptr = pe_buf;
+		static char const req1[4] = {'r', 'e', 'q', '1'};
+		static char const req2[4] = {'r', 'e', 'q', '2'};
+		static char const req3[4] = {'r', 'e', 'q', '3'};
+		sha1_hash const sync_hash = hasher().update(req1).update(secret).final();
+		std::memcpy(ptr, sync_hash.data(), 20);
+		ptr += 20;
+		sha1_hash const obfuscated = hasher().update(req2).update(skey).final()
+			^ hasher().update(req3).update(secret).final();
+		std::memcpy(ptr, obfuscated.data(), 20);
+		ptr += 20;
+
+		static char const keyA[4] = {'k', 'e', 'y', 'A'};
+		static char const keyB[4] = {'k', 'e', 'y', 'B'};
+		rc4 = std::make_shared<rc4_handler>();
+		sha1_hash const out_key = hasher().update(keyA).update(secret).update(skey).final();
+		sha1_hash const in_key = hasher().update(keyB).update(secret).update(skey).final();
+		rc4->set_outgoing_key({reinterpret_cast<char const*>(out_key.data()), out_key.size()});
+		rc4->set_incoming_key({reinterpret_cast<char const*>(in_key.data()), in_key.size()});
+		dh.reset();
+
+		// the verification constant, as encrypted by the other end
+		rc4_handler tmp(*rc4);
+		sync_vc.fill(0);
+		span<char> vc(sync_vc.data(), sync_vc.size());
+		tmp.decrypt(vc);
+
+		// vc, crypto_provide, len(pad), pad, len(ia)
+		int const pad_size = rand() % 512;
+		char* const encrypted = ptr;
+		std::memset(ptr, 0, 8);
+		ptr += 8;
+		write_uint32(0x02, ptr); // rc4 only
+		write_uint16(pad_size, ptr);
+		std::memset(ptr, 0, std::size_t(pad_size));
+		ptr += pad_size;
+		write_uint16(0, ptr);
+		encrypt(encrypted, int(ptr - encrypted));
+
+		sync_buf.clear();
+		boost::asio::async_write(s, boost::asio::buffer(pe_buf, std::size_t(ptr - pe_buf))
+			, std::bind(&peer_conn::on_pe3_sent, this, _1, _2));
+	}
+
+	void on_pe3_sent(error_code const& ec, size_t)
+	{
+		if (ec)
+		{
+			close("ERROR SEND CRYPTO PROVIDE: %s", ec);
+			return;
+		}
+		read_pe4_sync();
+	}
+
+	// the other end's padding is followed by the encrypted verification
+	// constant. Read until we find it
+	void read_pe4_sync()
+	{
+		std::size_t const size = sync_buf.size();
+		sync_buf.resize(size + 512);
+		s.async_read_some(boost::asio::buffer(&sync_buf[size], 512)
+			, std::bind(&peer_conn::on_pe4_sync, this, size, _1, _2));
+	}
+
+	void on_pe4_sync(std::size_t const size, error_code const& ec, size_t bytes)
+	{
+		if (ec)
+		{
+			close("ERROR READ VC: %s", ec);
+			return;
+		}
+		sync_buf.resize(size + bytes);
+		auto const i = std::search(sync_buf.begin(), sync_buf.end()
+			, sync_vc.begin(), sync_vc.end());
+		if (i == sync_buf.end())
+		{
+			if (sync_buf.size() > 512 + sync_vc.size())
+			{
+				close("ERROR SYNC VC: %s", error_code(boost::asio::error::invalid_argument));
+				return;
+			}
+			read_pe4_sync();
+			return;
+		}
+
+		// advance the decryption past the verification constant. Everything
+		// following it is encrypted
+		decrypt(&*i, int(sync_vc.size()));
+		pending.assign(i + int(sync_vc.size()), sync_buf.end());
+		sync_buf.clear();
+
+		// crypto_select, len(pad)
+		read(pe_buf, 6, std::bind(&peer_conn::on_pe4, this, _1, _2));
+	}
+
+	void on_pe4(error_code const& ec, size_t)
+	{
+		if (ec)
+		{
+			close("ERROR READ CRYPTO SELECT: %s", ec);
+			return;
+		}
+		char const* ptr = pe_buf;
+		std::uint32_t const crypto_select = read_uint32(ptr);
+		int const pad_size = read_uint16(ptr);
+		if (crypto_select != 0x02 || pad_size > 512)
+		{
+			close("ERROR CRYPTO SELECT: %s", error_code(boost::asio::error::invalid_argument));
+			return;
+		}
+		if (pad_size == 0)
+		{
+			write_handshake();
+			return;
+		}
+		read(pe_buf, pad_size, std::bind(&peer_conn::on_pe4_pad, this, _1, _2));
+	}
+
+	void on_pe4_pad(error_code const& ec, size_t)
+	{
+		if (ec)
+		{
+			close("ERROR READ PAD: %s", ec);
+			return;
+		}
+		write_handshake();
+	}
+#endif
+
+	void write_handshake()
+	{
 		char handshake[] = "\x13" "BitTorrent protocol\0\0\0\0\0\0\0\x04"
 			"                    " // space for info-hash
 			"aaaaaaaaaaaaaaaaaaaa" // peer-id
@@ -266,7 +657,9 @@ struct peer_conn
 		std::memcpy(h + 28, info_hash, 20);
 		std::generate(h + 48, h + 68, &rand);
 		// for seeds, don't send the interested message
-		boost::asio::async_write(s, boost::asio::buffer(h, (sizeof(handshake) - 1) - (seed ? 5 : 0))
+		int const len = int(sizeof(handshake) - 1) - (seed ? 5 : 0);
+		encrypt(h, len);
+		boost::asio::async_write(s, boost::asio::buffer(h, std::size_t(len))
 			, std::bind(&peer_conn::on_handshake, this, h, _1, _2));
 	}
 
@@ -280,8 +673,7 @@ struct peer_conn
 		}
 
 		// read handshake
-		boost::asio::async_read(s, boost::asio::buffer((char*)buffer, 68)
-			, std::bind(&peer_conn::on_handshake2, this, _1, _2));
+		read((char*)buffer, 68, std::bind(&peer_conn::on_handshake2, this, _1, _2));
 	}
 
 	void on_handshake2(error_code const& ec, size_t)
@@ -318,7 +710,7 @@ struct peer_conn
 			// unchoke
 			write_uint32(1, ptr);
 			write_uint8(1, ptr);
-			error_code ec;
+			encrypt(write_buf_proto, int(ptr - write_buf_proto));
 			boost::asio::async_write(s, boost::asio::buffer(write_buf_proto, ptr - write_buf_proto)
 				, std::bind(&peer_conn::on_have_all_sent, this, _1, _2));
 		}
@@ -334,7 +726,7 @@ struct peer_conn
 			// unchoke
 			write_uint32(1, ptr);
 			write_uint8(1, ptr);
-			error_code ec;
+			encrypt((char*)buffer, len + 10);
 			boost::asio::async_write(s, boost::asio::buffer((char*)buffer, len + 10)
 				, std::bind(&peer_conn::on_have_all_sent, this, _1, _2));
 		}
@@ -349,8 +741,7 @@ struct peer_conn
 		}
 
 		// read message
-		boost::asio::async_read(s, boost::asio::buffer((char*)buffer, 4)
-			, std::bind(&peer_conn::on_msg_length, this, _1, _2));
+		read((char*)buffer, 4, std::bind(&peer_conn::on_msg_length, this, _1, _2));
 	}
 
 	bool write_request()
@@ -402,9 +793,10 @@ struct peer_conn
 		write_uint32(static_cast<int>(current_piece), ptr);
 		write_uint32(block * 16 * 1024, ptr);
 		write_uint32(16 * 1024, ptr);
-		error_code ec;
+		encrypt(m, int(sizeof(msg) - 1));
 		boost::asio::async_write(s, boost::asio::buffer(m, sizeof(msg) - 1)
 			, std::bind(&peer_conn::on_req_sent, this, m, _1, _2));
+		requests.push_back({current_piece, block * 16 * 1024, clock_type::now()});
 
 		++outstanding_requests;
 		++block;
@@ -431,6 +823,8 @@ struct peer_conn
 
 	void close(char const* fmt, error_code const& ec)
 	{
+		if (closed) return;
+		closed = true;
 		end_time = clock_type::now();
 		char tmp[1024];
 		std::snprintf(tmp, sizeof(tmp), fmt, ec.message().c_str());
@@ -453,6 +847,14 @@ struct peer_conn
 		std::printf("%s ep: %s sent: %d received: %d duration: %d ms up: %.1fMB/s down: %.1fMB/s\n"
 			, tmp, ep_str, blocks_sent, blocks_received, time, up, down);
 		if (seed) --num_seeds;
+		s.close(e);
+
+		{
+			std::lock_guard<std::mutex> l(latency_mutex);
+			request_latencies.insert(request_latencies.end()
+				, latencies.begin(), latencies.end());
+		}
+		if (--num_active == 0) stop_network_threads();
 	}
 
 	void work_download()
@@ -474,8 +876,7 @@ struct peer_conn
 		}
 
 		// read message
-		boost::asio::async_read(s, boost::asio::buffer((char*)buffer, 4)
-			, std::bind(&peer_conn::on_msg_length, this, _1, _2));
+		read((char*)buffer, 4, std::bind(&peer_conn::on_msg_length, this, _1, _2));
 	}
 
 	void on_msg_length(error_code const& ec, size_t)
@@ -500,8 +901,7 @@ struct peer_conn
 			close("ERROR RECEIVE MESSAGE PREFIX: packet too big", error_code());
 			return;
 		}
-		boost::asio::async_read(s, boost::asio::buffer((char*)buffer, length)
-			, std::bind(&peer_conn::on_message, this, _1, _2));
+		read((char*)buffer, int(length), std::bind(&peer_conn::on_message, this, _1, _2));
 	}
 
 	void on_message(error_code const& ec, size_t bytes_transferred)
@@ -552,8 +952,7 @@ struct peer_conn
 			else
 			{
 				// read another message
-				boost::asio::async_read(s, boost::asio::buffer(buffer, 4)
-					, std::bind(&peer_conn::on_msg_length, this, _1, _2));
+				read((char*)buffer, 4, std::bind(&peer_conn::on_msg_length, this, _1, _2));
 			}
 		}
 		else
@@ -592,17 +991,16 @@ struct peer_conn
 			}
 			else if (msg == 7) // piece
 			{
+				piece_index_t const piece = piece_index_t(detail::read_int32(ptr));
+				int start = detail::read_int32(ptr);
 				if (verify_downloads)
 				{
-					piece_index_t const piece(read_uint32(ptr));
-					int start = read_uint32(ptr);
 					int size = int(bytes_transferred) - 9;
 					verify_piece(piece, start, ptr, size);
 				}
 				++blocks_received;
 				--outstanding_requests;
-				piece_index_t const piece = piece_index_t(detail::read_int32(ptr));
-				int start = detail::read_int32(ptr);
+				complete_request(piece, start);
 
 				if (churn && (blocks_received % churn) == 0) {
 					outstanding_requests = 0;
@@ -650,6 +1048,7 @@ struct peer_conn
 					}
 				}
 				--outstanding_requests;
+				remove_request(piece, start);
 				std::fprintf(stderr, "REJECT: [ piece: %d start: %d length: %d ]\n"
 					, static_cast<int>(piece), start, length);
 			}
@@ -675,6 +1074,23 @@ struct peer_conn
 		}
 	}
 
+	void remove_request(piece_index_t const piece, int const start)
+	{
+		auto const i = std::find_if(requests.begin(), requests.end()
+			, [=](request_t const& r) { return r.piece == piece && r.start == start; });
+		if (i != requests.end()) requests.erase(i);
+	}
+
+	// record the latency of the request for this block
+	void complete_request(piece_index_t const piece, int const start)
+	{
+		auto const i = std::find_if(requests.begin(), requests.end()
+			, [=](request_t const& r) { return r.piece == piece && r.start == start; });
+		if (i == requests.end()) return;
+		latencies.push_back(int(total_microseconds(clock_type::now() - i->sent)));
+		requests.erase(i);
+	}
+
 	bool verify_piece(piece_index_t const piece, int start, char const* ptr, int size)
 	{
 		std::uint32_t* buf = (std::uint32_t*)ptr;
@@ -710,6 +1126,8 @@ struct peer_conn
 		write_uint8(7, ptr);
 		write_uint32(static_cast<int>(piece), ptr);
 		write_uint32(start, ptr);
+		encrypt(write_buf_proto, int(ptr - write_buf_proto));
+		encrypt((char*)write_buffer, length);
 		std::array<boost::asio::const_buffer, 2> vec;
 		vec[0] = boost::asio::buffer(write_buf_proto, ptr - write_buf_proto);
 		vec[1] = boost::asio::buffer(write_buffer, length);
@@ -728,6 +1146,7 @@ struct peer_conn
 		write_uint32(5, ptr);
 		write_uint8(4, ptr);
 		write_uint32(static_cast<int>(piece), ptr);
+		encrypt(write_buf_proto, 9);
 		boost::asio::async_write(s, boost::asio::buffer(write_buf_proto, 9), std::bind(&peer_conn::on_have_all_sent, this, _1, _2));
 	}
 };
@@ -761,7 +1180,13 @@ void print_usage()
 		"    -p <dst-port>      the port the target listens on\n"
 		"    -t <torrent-file>  the torrent file previously generated by gen-torrent\n"
 		"    -C                 send corrupt pieces sometimes (applies to upload and dual)\n"
-		"    -r <reconnects>    churn - number of reconnects per second\n\n"
+		"    -r <reconnects>    churn - number of reconnects per second\n"
+		"    -j <threads>       the number of network threads (defaults to the\n"
+		"                       number of cores)\n"
+		"    -u                 connect over uTP instead of TCP\n"
+		"    -E                 encrypt the connections with RC4\n"
+		"    -R <conns/sec>     the rate at which connections are opened\n"
+		"                       (defaults to 1000)\n\n"
 		"examples:\n\n"
 		"connection_tester gen-torrent -s 1024 -n 4 -t test.torrent\n"
 		"connection_tester upload -c 200 -d 127.0.0.1 -p 6881 -t test.torrent\n"
@@ -901,6 +1326,9 @@ int main(int argc, char* argv[])
 	char const* destination_ip = "127.0.0.1";
 	int destination_port = 6881;
 	int churn = 0;
+	int num_threads = int(std::thread::hardware_concurrency());
+	if (num_threads == 0) num_threads = 2;
+	int connect_rate = 1000;
 
 	argv += 2;
 	argc -= 2;
@@ -921,6 +1349,8 @@ int main(int argc, char* argv[])
 		switch (optname[1])
 		{
 			case 'C': test_corruption = true; continue;
+			case 'u': use_utp = true; continue;
+			case 'E': use_encryption = true; continue;
 		}
 
 		if (argc == 0)
@@ -944,6 +1374,8 @@ int main(int argc, char* argv[])
 			case 'p': destination_port = atoi(optarg); break;
 			case 'd': destination_ip = optarg; break;
 			case 'r': churn = atoi(optarg); break;
+			case 'j': num_threads = std::max(1, atoi(optarg)); break;
+			case 'R': connect_rate = std::max(1, atoi(optarg)); break;
 			default: std::fprintf(stderr, "unknown option: %s\n", optname);
 		}
 	}
@@ -1074,32 +1506,68 @@ int main(int argc, char* argv[])
 		return 1;
 	}
 
+#ifdef TORRENT_DISABLE_ENCRYPTION
+	if (use_encryption)
+	{
+		std::fprintf(stderr, "ERROR: encryption is disabled in this build\n");
+		return 1;
+	}
+#endif
+
+	// the network threads are started up-front and the connections are
+	// spread across them as they are created. The work objects keep the
+	// threads running until the last connection closes
+	std::vector<std::unique_ptr<utp_context>> utp_contexts;
+	std::vector<std::unique_ptr<io_service::work>> work;
+	for (int i = 0; i < num_threads; ++i)
+	{
+		io_services.emplace_back(new io_service);
+		work.emplace_back(new io_service::work(*io_services.back()));
+		if (!use_utp) continue;
+		utp_contexts.emplace_back(new utp_context(*io_services.back()));
+		utp_contexts.back()->start(ec);
+		if (ec)
+		{
+			std::fprintf(stderr, "ERROR OPEN UDP SOCKET: %s\n", ec.message().c_str());
+			return 1;
+		}
+	}
+
+	std::vector<std::thread> threads;
+	threads.reserve(std::size_t(num_threads));
+	for (auto& ios : io_services)
+		threads.emplace_back(&io_thread, ios.get());
+
+	// hold on to one reference while creating the connections, to not stop
+	// the network threads if the first connections close before the last
+	// ones are created
+	++num_active;
+
 	std::vector<peer_conn*> conns;
 	conns.reserve(num_connections);
-	int const num_threads = 2;
-	io_service ios[num_threads];
+	time_point const start = clock_type::now();
 	for (int i = 0; i < num_connections; ++i)
 	{
 		bool corrupt = test_corruption && (i & 1) == 0;
 		bool seed = false;
 		if (test_mode == upload_test) seed = true;
 		else if (test_mode == dual_test) seed = (i & 1);
-		conns.push_back(new peer_conn(ios[i % num_threads], ti.num_pieces(), ti.piece_length() / 16 / 1024
-			, ep, (char const*)&ti.info_hash()[0], seed, churn, corrupt));
-		sleep_ms(1);
-		ios[i % num_threads].poll_one(ec);
-		if (ec)
-		{
-			std::fprintf(stderr, "ERROR: %s\n", ec.message().c_str());
-			break;
-		}
+		int const thread = i % num_threads;
+		conns.push_back(new peer_conn(*io_services[std::size_t(thread)]
+			, ti.num_pieces(), ti.piece_length() / 16 / 1024
+			, ep, (char const*)&ti.info_hash()[0], seed, churn, corrupt
+			, use_utp ? &utp_contexts[std::size_t(thread)]->mgr : nullptr));
+
+		// pace the creation of connections to the requested rate
+		time_point const due = start + microseconds(std::int64_t(i + 1) * 1000000 / connect_rate);
+		time_point const now = clock_type::now();
+		if (due > now) sleep_ms(int(total_milliseconds(due - now)));
 	}
 
-	std::thread t1(&io_thread, &ios[0]);
-	std::thread t2(&io_thread, &ios[1]);
+	if (--num_active == 0) stop_network_threads();
+	work.clear();
 
-	t1.join();
-	t2.join();
+	for (auto& t : threads) t.join();
 
 	float up = 0.f;
 	float down = 0.f;
@@ -1127,5 +1595,21 @@ int main(int argc, char* argv[])
 		, total_received * 0x4000 * 100.f / float(ti.total_size())
 		, up, down);
 
+	if (!request_latencies.empty())
+	{
+		std::sort(request_latencies.begin(), request_latencies.end());
+		auto percentile = [](double const p)
+		{
+			std::size_t const idx = std::min(request_latencies.size() - 1
+				, std::size_t(double(request_latencies.size()) * p));
+			return request_latencies[idx] / 1000.f;
+		};
+		std::printf("request latency (%d samples): p50: %.2f ms p90: %.2f ms "
+			"p99: %.2f ms p99.9: %.2f ms max: %.2f ms\n"
+			, int(request_latencies.size())
+			, percentile(0.5), percentile(0.9), percentile(0.99), percentile(0.999)
+			, request_latencies.back() / 1000.f);
+	}
+
 	return 0;
 }
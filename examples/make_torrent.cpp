@@ -37,8 +37,10 @@ POSSIBILITY OF SUCH DAMAGE.
 #include "libtorrent/hasher.hpp"
 #include "libtorrent/create_torrent.hpp"
 #include "libtorrent/file_pool.hpp"
+#include "libtorrent/settings_pack.hpp"
 #include "libtorrent/aux_/max_path.hpp" // for TORRENT_MAX_PATH
 
+#include <chrono>
 #include <functional>
 #include <cstdio>
 #include <sstream>
@@ -113,9 +115,15 @@ bool file_filter(std::string const& f)
 	return true;
 }
 
-void print_progress(piece_index_t i, int num)
+void print_progress(piece_index_t i, int num, int piece_size
+	, std::chrono::steady_clock::time_point start)
 {
-	std::fprintf(stderr, "\r%d/%d", static_cast<int>(i)+1, num);
+	using namespace std::chrono;
+	double const seconds = duration_cast<duration<double>>(
+		steady_clock::now() - start).count();
+	double const bytes = (static_cast<int>(i) + 1) * double(piece_size);
+	std::fprintf(stderr, "\r%d/%d %.1f MB/s", static_cast<int>(i)+1, num
+		, seconds > 0 ? bytes / seconds / 1000000 : 0.0);
 }
 
 void print_usage()
@@ -157,6 +165,9 @@ void print_usage()
 		"              this means aligning large files and pad them in order\n"
 		"              for piece hashes to uniquely indentify a file without\n"
 		"              overlap\n"
+		"-T threads    the number of threads to hash pieces on. Defaults\n"
+		"              to one per CPU core\n"
+		"-D            read files with direct I/O, bypassing the OS cache\n"
 		, stderr);
 }
 
@@ -180,6 +191,7 @@ int main(int argc, char* argv[])
 		std::vector<std::string> web_seeds;
 		std::vector<std::string> trackers;
 		std::vector<std::string> collections;
+		settings_pack hash_settings;
 		std::vector<sha1_hash> similar;
 		int pad_file_limit = -1;
 		int piece_size = 0;
@@ -275,6 +287,14 @@ int main(int argc, char* argv[])
 					++i;
 					collections.push_back(argv[i]);
 					break;
+				case 'T':
+					++i;
+					hash_settings.set_int(settings_pack::hash_threads, atoi(argv[i]));
+					break;
+				case 'D':
+					hash_settings.set_int(settings_pack::disk_io_write_mode
+						, settings_pack::direct_io);
+					break;
 				default:
 					print_usage();
 					return 1;
@@ -331,8 +351,9 @@ int main(int argc, char* argv[])
 			t.add_similar_torrent(*i);
 
 		error_code ec;
-		set_piece_hashes(t, branch_path(full_path)
-			, std::bind(&print_progress, _1, t.num_pieces()), ec);
+		set_piece_hashes(t, branch_path(full_path), hash_settings
+			, std::bind(&print_progress, _1, t.num_pieces(), t.piece_length()
+				, std::chrono::steady_clock::now()), ec);
 		if (ec)
 		{
 			std::fprintf(stderr, "%s\n", ec.message().c_str());
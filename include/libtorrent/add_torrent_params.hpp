@@ -473,6 +473,17 @@ namespace libtorrent {
 		// applied before the torrent is added.
 		std::map<file_index_t, std::string> renamed_files;
 
+		// additional save paths, typically on other devices, to spread the
+		// files of the torrent over. When this is set, the files are
+		// distributed across ``save_path`` and these paths, balancing the
+		// number of bytes on each. Files assigned to one of these paths are
+		// renamed to absolute paths under it, which means the mapping is
+		// saved in the resume data as renamed files. This only takes effect
+		// when ``renamed_files`` is empty, i.e. when the torrent is first
+		// added. Files are not split, so a single large file still ends up on
+		// one path.
+		std::vector<std::string> extra_save_paths;
+
 #ifndef TORRENT_NO_DEPRECATE
 		// deprecated in 1.2
 
@@ -61,13 +61,14 @@ namespace libtorrent {
 		template <class T, typename... Args>
 		void emplace_alert(Args&&... args)
 		{
-			std::unique_lock<std::mutex> lock(m_mutex);
+			std::unique_lock<std::mutex> lock(m_post_mutex);
+			int const gen = enter_generation();
 
 			// don't add more than this number of alerts, unless it's a
 			// high priority alert, in which case we try harder to deliver it
 			// for high priority alerts, double the upper limit
-			if (m_alerts[m_generation].size() >= m_queue_size_limit
-				* (1 + T::priority))
+			if (m_num_queued[gen].load(std::memory_order_relaxed)
+				>= m_queue_size_limit * (1 + T::priority))
 			{
 //				if (T::priority > 0)
 //				{
@@ -75,22 +76,27 @@ namespace libtorrent {
 					// alert was dropped. Maybe add a flag to each m_alerts
 					// generation
 //				}
+				leave_generation();
 				return;
 			}
 
-			T& alert = m_alerts[m_generation].emplace_back<T>(
-				m_allocations[m_generation], std::forward<Args>(args)...);
+			T& alert = m_alerts[gen].emplace_back<T>(
+				m_allocations[gen], std::forward<Args>(args)...);
+			bool const first = publish(gen, &alert);
+			leave_generation();
 
-			maybe_notify(&alert, lock);
+			maybe_notify(&alert, first, lock);
 		}
 
 		bool pending() const;
 		void get_all(std::vector<alert*>& alerts);
 
+		// ``extra_mask`` is or:ed with the session's alert mask. It's used for
+		// categories that are only enabled for a specific torrent or peer
 		template <class T>
-		bool should_post() const
+		bool should_post(std::uint32_t const extra_mask = 0) const
 		{
-			if ((m_alert_mask.load(std::memory_order_relaxed)
+			if (((m_alert_mask.load(std::memory_order_relaxed) | extra_mask)
 				& T::static_category) == 0)
 			{
 				return false;
@@ -127,12 +133,46 @@ namespace libtorrent {
 		alert_manager& operator=(alert_manager const&);
 
 		bool should_post_impl(int priority) const;
-		void maybe_notify(alert* a, std::unique_lock<std::mutex>& lock);
+		void maybe_notify(alert* a, bool first, std::unique_lock<std::mutex>& lock);
 
+		// called by the posting thread around accessing m_alerts[gen]. While
+		// inside, get_all() won't hand out that generation to the client
+		int enter_generation()
+		{
+			m_posting.store(true);
+			return m_generation.load();
+		}
+		void leave_generation() { m_posting.store(false, std::memory_order_release); }
+
+		// makes a newly posted alert visible to the client. Returns true if it
+		// was the first one in the generation
+		bool publish(int const gen, alert* a)
+		{
+			if (m_num_queued[gen].load(std::memory_order_relaxed) == 0)
+				m_first[gen].store(a, std::memory_order_relaxed);
+			return m_num_queued[gen].fetch_add(1) == 0;
+		}
+
+		// serializes the threads posting alerts. In practice alerts are only
+		// posted from the network thread, so this is not contended. The
+		// client thread never takes it, posting never waits for the client
+		std::mutex m_post_mutex;
+
+		// serializes the threads popping alerts with get_all()
 		mutable std::mutex m_mutex;
+
+		// wait_for_alert() blocks on m_condition, with m_wait_mutex. When
+		// posting to an empty queue, the posting thread only takes
+		// m_wait_mutex (to notify) if there are threads waiting
+		std::mutex m_wait_mutex;
 		std::condition_variable m_condition;
+		std::atomic<int> m_num_waiters{0};
+
 		std::atomic<std::uint32_t> m_alert_mask;
-		int m_queue_size_limit;
+		std::atomic<int> m_queue_size_limit;
+
+		// protects m_notify
+		std::mutex m_notify_mutex;
 
 		// this function (if set) is called whenever the number of alerts in
 		// the alert queue goes from 0 to 1. The client is expected to wake up
@@ -146,13 +186,23 @@ namespace libtorrent {
 		// the alert_manager is allowed to use right now. This is swapped when
 		// the client calls get_all(), at which point all of the alert objects
 		// passed to the client will be owned by libtorrent again, and reset.
-		int m_generation = 0;
+		std::atomic<int> m_generation{0};
+
+		// this is set while the posting thread is between loading
+		// m_generation and being done with m_alerts[m_generation]. When
+		// get_all() has swapped the generation, it waits for this to be
+		// cleared before touching the old one. That's at most the time it
+		// takes to construct one alert
+		std::atomic<bool> m_posting{false};
+
+		// the number of alerts in each generation and the first alert in it
+		std::atomic<int> m_num_queued[2];
+		std::atomic<alert*> m_first[2];
 
 		// this is where all alerts are queued up. There are two heterogeneous
-		// queues to double buffer the thread access. The std::mutex in the alert
-		// manager gives exclusive access to m_alerts[m_generation] and
-		// m_allocations[m_generation] whereas the other copy is exclusively
-		// used by the client thread.
+		// queues to double buffer the thread access. m_alerts[m_generation]
+		// and m_allocations[m_generation] are owned by the posting thread
+		// whereas the other copy is exclusively used by the client thread.
 		heterogeneous_queue<alert> m_alerts[2];
 
 		// this is a stack where alerts can allocate variable length content,
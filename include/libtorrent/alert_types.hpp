@@ -43,6 +43,7 @@ POSSIBILITY OF SUCH DAMAGE.
 #include "libtorrent/stat.hpp"
 #include "libtorrent/add_torrent_params.hpp"
 #include "libtorrent/torrent_status.hpp"
+#include "libtorrent/peer_info.hpp"
 #include "libtorrent/entry.hpp"
 #include "libtorrent/peer_request.hpp"
 #include "libtorrent/performance_counters.hpp"
@@ -980,7 +981,9 @@ namespace libtorrent {
 		// internal
 		save_resume_data_alert(aux::stack_allocator& alloc
 			, add_torrent_params params
-			, torrent_handle const& h);
+			, torrent_handle const& h
+			, int changes = torrent_handle::resume_all
+			, std::vector<piece_index_t> passed = std::vector<piece_index_t>());
 
 		TORRENT_DEFINE_ALERT_PRIO(save_resume_data_alert, 37)
 
@@ -990,8 +993,24 @@ namespace libtorrent {
 		// the ``params`` structure is populated with the fields to be passed to
 		// add_torrent() or async_add_torrent() to resume the torrent. To
 		// save the state to disk, you may pass it on to write_resume_data().
+		// If the torrent_handle::only_changes flag was passed to
+		// save_resume_data(), only the fields belonging to the categories in
+		// ``changes`` are filled in.
 		add_torrent_params params;
 
+		// the categories of resume data (torrent_handle::resume_data_changes_t)
+		// that changed since the last time resume data was saved for this
+		// torrent
+		int changes;
+
+		// when saving with torrent_handle::only_changes, the pieces that passed
+		// the hash check since the last save. In this case
+		// ``params.have_pieces`` is left empty. If the pieces cannot be
+		// described as a list of additions, for instance because pieces were
+		// lost in a recheck, ``params.have_pieces`` holds the full bitfield and
+		// this list is empty.
+		std::vector<piece_index_t> passed_pieces;
+
 #ifndef TORRENT_NO_DEPRECATE
 		// points to the resume data.
 		std::shared_ptr<entry> resume_data;
@@ -1826,8 +1845,11 @@ namespace libtorrent {
 	// This alert is only posted when requested by the user, by calling
 	// session::post_torrent_updates() on the session. It contains the torrent
 	// status of all torrents that changed since last time this message was
-	// posted. Its category is ``status_notification``, but it's not subject to
-	// filtering, since it's only manually posted anyway.
+	// posted (up to settings_pack::max_state_updates of them). It's also
+	// posted in response to session::post_torrent_status() and
+	// torrent_handle::post_status(), with the status of the torrents that
+	// were asked for. Its category is ``status_notification``, but it's not
+	// subject to filtering, since it's only manually posted anyway.
 	struct TORRENT_EXPORT state_update_alert final : alert
 	{
 		state_update_alert(aux::stack_allocator& alloc
@@ -2569,11 +2591,199 @@ namespace libtorrent {
 		virtual std::string message() const override;
 	};
 
+	// This alert is posted for pieces with a deadline (see
+	// torrent_handle::set_piece_deadline()) whenever blocks of the piece are
+	// requested. ``predicted_arrival`` is when the last block of the piece is
+	// expected to have been received, based on the download rate and round
+	// trip time of the peers it was requested from. A streaming client can
+	// compare it to ``deadline`` and adapt, for instance by lowering the
+	// bitrate when pieces are predicted to be late.
+	struct TORRENT_EXPORT piece_arrival_alert final : torrent_alert
+	{
+		// internal
+		piece_arrival_alert(aux::stack_allocator& alloc, torrent_handle const& h
+			, piece_index_t index, time_point arrival, time_point deadline_);
+
+		TORRENT_DEFINE_ALERT(piece_arrival_alert, 93)
+
+		static const int static_category = alert::progress_notification;
+		virtual std::string message() const override;
+
+		piece_index_t const piece_index;
+		time_point const predicted_arrival;
+		time_point const deadline;
+	};
+
+	// posted for every BEP 51 ``sample_infohashes`` response received in a
+	// traversal started by session_handle::dht_sample_infohashes().
+	// ``interval`` is the number of seconds the responding node asks us to
+	// wait before querying it again and ``num_infohashes`` is the total
+	// number of info-hashes it stores. ``samples()`` is the random subset of
+	// those info-hashes it returned.
+	struct TORRENT_EXPORT dht_sample_infohashes_alert final : alert
+	{
+		// internal
+		dht_sample_infohashes_alert(aux::stack_allocator& alloc
+			, udp::endpoint const& ep
+			, time_duration interval
+			, int num
+			, std::vector<sha1_hash> const& samples);
+
+		static const int static_category = alert::dht_operation_notification;
+		TORRENT_DEFINE_ALERT(dht_sample_infohashes_alert, 94)
+
+		virtual std::string message() const override;
+
+		udp::endpoint const endpoint;
+		time_duration const interval;
+		int const num_infohashes;
+
+		int num_samples() const;
+		std::vector<sha1_hash> samples() const;
+
+	private:
+		std::reference_wrapper<aux::stack_allocator> m_alloc;
+		int const m_num_samples;
+		aux::allocation_slot m_samples_idx;
+	};
+
+	// posted by session_handle::post_session_stats_delta(). ``delta()`` is
+	// the compact encoding of the session stats values that changed since the
+	// previous session_stats_delta_alert (see encode_session_stats_delta()).
+	// Applying it with apply_session_stats_delta() to the values of the
+	// previous one yields the current values. It's empty if nothing changed.
+	struct TORRENT_EXPORT session_stats_delta_alert final : alert
+	{
+		// internal
+		session_stats_delta_alert(aux::stack_allocator& alloc
+			, span<char const> delta);
+		TORRENT_DEFINE_ALERT_PRIO(session_stats_delta_alert, 95)
+
+		static const int static_category = alert::stats_notification;
+		virtual std::string message() const override;
+
+		span<char const> delta() const;
+
+	private:
+		std::reference_wrapper<aux::stack_allocator> m_alloc;
+		int const m_size;
+		aux::allocation_slot m_delta_idx;
+	};
+
+	// posted when a handler on the network thread ran for longer than
+	// settings_pack::network_stall_threshold milliseconds. While the network
+	// thread is busy, no peer, tracker or DHT traffic is handled. Calls made
+	// through session_handle and torrent_handle, and the periodic tick of the
+	// session, are measured.
+	struct TORRENT_EXPORT network_stall_alert final : alert
+	{
+		// the kind of handler that stalled the network thread
+		enum handler_t : std::uint8_t
+		{
+			// a call made through session_handle
+			session_call,
+
+			// a call made through torrent_handle
+			torrent_call,
+
+			// the session's periodic tick
+			tick
+		};
+
+		// internal
+		network_stall_alert(aux::stack_allocator& alloc, handler_t h
+			, time_duration queue_time_, time_duration exec_time_);
+
+		TORRENT_DEFINE_ALERT(network_stall_alert, 96)
+
+		static const int static_category = alert::performance_warning;
+		virtual std::string message() const override;
+
+		handler_t const handler;
+
+		// the time the handler waited to start executing, and the time it ran
+		time_duration const queue_time;
+		time_duration const exec_time;
+	};
+
+	// posted in response to torrent_handle::post_peer_info(). It contains
+	// the same information get_peer_info() would have returned.
+	struct TORRENT_EXPORT peer_info_alert final : torrent_alert
+	{
+		// internal
+		peer_info_alert(aux::stack_allocator& alloc, torrent_handle const& h
+			, std::vector<libtorrent::peer_info> p);
+
+		TORRENT_DEFINE_ALERT_PRIO(peer_info_alert, 97)
+
+		static const int static_category = alert::status_notification;
+		virtual std::string message() const override;
+
+		// one entry for each peer connected to the torrent
+		std::vector<libtorrent::peer_info> const peer_info;
+	};
+
+	// posted in response to torrent_handle::post_file_progress(). ``files``
+	// has one entry for each file in the torrent, with the number of bytes
+	// downloaded of it. It's empty if the torrent doesn't have metadata yet.
+	struct TORRENT_EXPORT file_progress_alert final : torrent_alert
+	{
+		// internal
+		file_progress_alert(aux::stack_allocator& alloc, torrent_handle const& h
+			, std::vector<std::int64_t> fp);
+
+		TORRENT_DEFINE_ALERT_PRIO(file_progress_alert, 98)
+
+		static const int static_category = alert::status_notification;
+		virtual std::string message() const override;
+
+		std::vector<std::int64_t> const files;
+	};
+
+	// posted in response to torrent_handle::post_piece_priorities().
+	// ``priorities`` has one entry for each piece in the torrent. It's empty
+	// if the torrent doesn't have metadata yet.
+	struct TORRENT_EXPORT piece_priorities_alert final : torrent_alert
+	{
+		// internal
+		piece_priorities_alert(aux::stack_allocator& alloc, torrent_handle const& h
+			, std::vector<int> p);
+
+		TORRENT_DEFINE_ALERT_PRIO(piece_priorities_alert, 99)
+
+		static const int static_category = alert::status_notification;
+		virtual std::string message() const override;
+
+		std::vector<int> const priorities;
+	};
+
+	// posted every settings_pack::peer_sample_interval milliseconds, when
+	// enabled. It contains one peer_sample for each connected peer, up to
+	// settings_pack::max_peer_samples of them. When there are more peers, the
+	// ones with the highest transfer rates are included.
+	struct TORRENT_EXPORT peer_sample_alert final : alert
+	{
+		// internal
+		peer_sample_alert(aux::stack_allocator& alloc
+			, std::vector<peer_sample> s, int total);
+
+		TORRENT_DEFINE_ALERT(peer_sample_alert, 100)
+
+		static const int static_category = alert::stats_notification;
+		virtual std::string message() const override;
+
+		std::vector<peer_sample> const samples;
+
+		// the number of peers that were connected when the samples were taken.
+		// If this is greater than ``samples.size()``, some peers were left out
+		int const num_peers;
+	};
+
 #undef TORRENT_DEFINE_ALERT_IMPL
 #undef TORRENT_DEFINE_ALERT
 #undef TORRENT_DEFINE_ALERT_PRIO
 
-	enum { num_alert_types = 93 }; // this enum represents "max_alert_index" + 1
+	enum { num_alert_types = 101 }; // this enum represents "max_alert_index" + 1
 }
 
 #endif
@@ -0,0 +1,170 @@
+/*
+
+Copyright (c) 2017, Arvid Norberg
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions
+are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in
+      the documentation and/or other materials provided with the distribution.
+    * Neither the name of the author nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+
+#ifndef TORRENT_BENCODE_WRITER_HPP_INCLUDED
+#define TORRENT_BENCODE_WRITER_HPP_INCLUDED
+
+#include "libtorrent/config.hpp"
+#include "libtorrent/assert.hpp"
+#include "libtorrent/string_view.hpp"
+#include "libtorrent/bencode.hpp" // for write_integer, write_char
+
+#include <cstdint>
+#include <algorithm> // for copy
+
+#if TORRENT_USE_ASSERTS
+#include <string>
+#include <vector>
+#endif
+
+namespace libtorrent { namespace aux {
+
+	// writes a bencoded structure straight to an output iterator, one item at
+	// a time, without building an entry tree first. Every value in a
+	// dictionary must be preceded by its key, and keys must be added in
+	// sorted order. Both are only checked in debug builds. For example:
+	//
+	//	bencode_writer<char*> w(buf);
+	//	w.start_dict();
+	//	w.key("msg_type"); w.integer(1);
+	//	w.key("piece"); w.integer(0);
+	//	w.end();
+	template <typename OutIt>
+	struct bencode_writer
+	{
+		explicit bencode_writer(OutIt out) : m_out(out) {}
+
+		void start_dict() { start('d', true); }
+		void start_list() { start('l', false); }
+
+		// terminates the innermost dictionary or list
+		void end()
+		{
+#if TORRENT_USE_ASSERTS
+			TORRENT_ASSERT(!m_stack.empty());
+			TORRENT_ASSERT(!m_stack.back().expect_value);
+			m_stack.pop_back();
+#endif
+			detail::write_char(m_out, 'e');
+			++m_size;
+		}
+
+		void key(string_view const k)
+		{
+#if TORRENT_USE_ASSERTS
+			TORRENT_ASSERT(!m_stack.empty() && m_stack.back().dict);
+			frame& f = m_stack.back();
+			TORRENT_ASSERT(!f.expect_value);
+			// keys must be unique and sorted
+			TORRENT_ASSERT(f.first_key || string_view(f.last_key) < k);
+			f.last_key.assign(k.data(), k.size());
+			f.first_key = false;
+			f.expect_value = true;
+#endif
+			write_string(k);
+		}
+
+		void integer(std::int64_t const val)
+		{
+			value();
+			detail::write_char(m_out, 'i');
+			m_size += detail::write_integer(m_out, val);
+			detail::write_char(m_out, 'e');
+			m_size += 2;
+		}
+
+		void string(string_view const str)
+		{
+			value();
+			write_string(str);
+		}
+
+		// the number of bytes written so far
+		int size() const { return m_size; }
+
+		// the output iterator, pointing past the last byte written
+		OutIt out() const { return m_out; }
+
+	private:
+
+		void start(char const c, bool const dict)
+		{
+			value();
+#if TORRENT_USE_ASSERTS
+			m_stack.push_back(frame(dict));
+#else
+			TORRENT_UNUSED(dict);
+#endif
+			detail::write_char(m_out, c);
+			++m_size;
+		}
+
+		// called for every value, to keep track of the dictionary state
+		void value()
+		{
+#if TORRENT_USE_ASSERTS
+			if (m_stack.empty()) return;
+			frame& f = m_stack.back();
+			TORRENT_ASSERT(!f.dict || f.expect_value);
+			f.expect_value = false;
+#endif
+		}
+
+		void write_string(string_view const str)
+		{
+			m_size += detail::write_integer(m_out, str.size());
+			detail::write_char(m_out, ':');
+			m_out = std::copy(str.begin(), str.end(), m_out);
+			m_size += 1 + int(str.size());
+		}
+
+		OutIt m_out;
+		int m_size = 0;
+
+#if TORRENT_USE_ASSERTS
+		struct frame
+		{
+			explicit frame(bool const d) : dict(d) {}
+			std::string last_key;
+			bool dict;
+			bool first_key = true;
+			bool expect_value = false;
+		};
+		// the open dictionaries and lists
+		std::vector<frame> m_stack;
+#endif
+	};
+
+}}
+
+#endif
@@ -42,6 +42,9 @@ namespace libtorrent { namespace aux {
 	TORRENT_EXTRA_EXPORT extern bool const mmx_support;
 	TORRENT_EXTRA_EXPORT extern bool const arm_neon_support;
 	TORRENT_EXTRA_EXPORT extern bool const arm_crc32c_support;
+	TORRENT_EXTRA_EXPORT extern bool const sha_ni_support;
+	TORRENT_EXTRA_EXPORT extern bool const arm_sha1_support;
+	TORRENT_EXTRA_EXPORT extern bool const avx2_support;
 } }
 
 #endif // TORRENT_CPUID_HPP_INCLUDED
@@ -0,0 +1,92 @@
+/*
+
+Copyright (c) 2017, Arvid Norberg
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions
+are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in
+      the documentation and/or other materials provided with the distribution.
+    * Neither the name of the author nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+#ifndef TORRENT_DELETION_QUEUE_HPP_INCLUDED
+#define TORRENT_DELETION_QUEUE_HPP_INCLUDED
+
+#include "libtorrent/config.hpp"
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace libtorrent { namespace aux {
+
+	// runs file deletions on threads of their own, separate from the disk
+	// threads serving active torrents. Deleting the files of a large torrent
+	// can take a long time on some filesystems, and removing many torrents
+	// at once would otherwise occupy every disk thread. At most
+	// max_threads() deletions run at a time, the rest are queued. The
+	// threads run at the lowest I/O priority, where the OS supports it, and
+	// are started as deletions are pushed.
+	struct TORRENT_EXTRA_EXPORT deletion_queue
+	{
+		deletion_queue() = default;
+		~deletion_queue();
+
+		deletion_queue(deletion_queue const&) = delete;
+		deletion_queue& operator=(deletion_queue const&) = delete;
+
+		// the number of deletions that may run at a time. At least 1
+		void set_max_threads(int n);
+		int max_threads() const;
+
+		// queues f to be called on a deletion thread. Once drain() has been
+		// called, f is called right away, in the calling thread
+		void push(std::function<void()> f);
+
+		// waits for all queued deletions to complete and stops the threads
+		void drain();
+
+		// the number of deletions that are queued or running
+		int num_pending() const;
+
+	private:
+
+		void thread_fun();
+
+		mutable std::mutex m_mutex;
+		std::condition_variable m_cond;
+		std::deque<std::function<void()>> m_queue;
+		std::vector<std::thread> m_threads;
+		int m_max_threads = 1;
+
+		// the number of deletions running right now
+		int m_running = 0;
+		bool m_abort = false;
+	};
+}}
+
+#endif
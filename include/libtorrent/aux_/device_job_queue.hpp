@@ -0,0 +1,159 @@
+/*
+
+Copyright (c) 2017, Arvid Norberg
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions
+are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in
+      the documentation and/or other materials provided with the distribution.
+    * Neither the name of the author nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+
+#ifndef TORRENT_DEVICE_JOB_QUEUE_HPP_INCLUDED
+#define TORRENT_DEVICE_JOB_QUEUE_HPP_INCLUDED
+
+#include "libtorrent/config.hpp"
+#include "libtorrent/tailqueue.hpp"
+#include "libtorrent/time.hpp"
+#include "libtorrent/units.hpp"
+
+#include <vector>
+#include <cstdint>
+
+namespace libtorrent {
+
+	struct disk_io_job;
+	struct storage_interface;
+
+namespace aux {
+
+	// the disk jobs queued for a pool of disk threads, split up by the device
+	// (volume) the files of each job's storage are on (disk_io_job::device).
+	// The jobs of a device are executed in the order they were queued. The
+	// next job to execute is taken from the device with the fewest jobs
+	// executing, and with a device limit set, no device may have more than
+	// that many jobs executing at a time. This keeps a slow device from tying
+	// up all disk threads while jobs for a fast device wait behind it.
+	//
+	// Optionally, the read jobs at the front of a device's queue are
+	// reordered like an elevator: the next read is the one closest after the
+	// end of the previous one (by storage, piece and offset), wrapping around
+	// to the lowest when there are none after it. A read that has been queued
+	// for longer than the max wait is executed next regardless, so no read
+	// is starved.
+	struct TORRENT_EXTRA_EXPORT device_job_queue
+	{
+		// the max number of queued read jobs of a device considered when
+		// picking the next one
+		enum { max_reorder = 32 };
+
+		void push_back(disk_io_job* j);
+		void push_front(disk_io_job* j);
+
+		// queues all jobs in ``jobs``, and leaves it empty
+		void append(tailqueue<disk_io_job>& jobs);
+
+		// removes all queued jobs and returns them as a linked list (through
+		// their next pointers), like tailqueue::get_all()
+		disk_io_job* get_all();
+
+		// returns the next job to execute, or nullptr if no job may execute
+		// right now. The job counts as executing on its device until
+		// job_done() is called for it
+		disk_io_job* pop_front();
+
+		// the job the next call to pop_front() would return
+		disk_io_job* first();
+
+		// must be called once a job returned by pop_front() has been
+		// executed. ``device`` is the job's device, since the job itself may
+		// already have been freed by then
+		void job_done(std::uint8_t device);
+
+		// true if pop_front() would return a job
+		bool runnable();
+
+		bool empty() const { return m_size == 0; }
+		int size() const { return m_size; }
+
+		// the max number of jobs of a single device that may execute at the
+		// same time. 0 means there's no limit
+		void set_device_limit(int const limit) { m_limit = limit; }
+		int device_limit() const { return m_limit; }
+
+		// the number of jobs of ``device`` executing right now
+		int in_flight(std::uint8_t device) const;
+
+		// enables reordering read jobs when ``max_wait`` is greater than 0.
+		// No read job is held back for longer than this
+		void set_read_reorder(time_duration const max_wait) { m_max_read_wait = max_wait; }
+
+	private:
+
+		// the position of a read in the storage, to order reads by
+		struct read_position
+		{
+			storage_interface const* storage;
+			piece_index_t piece;
+			int offset;
+
+			bool operator<(read_position const& rhs) const;
+		};
+
+		struct device_queue
+		{
+			tailqueue<disk_io_job> jobs;
+			int in_flight = 0;
+
+			// where the last read of this device ended
+			read_position head{nullptr, piece_index_t(0), 0};
+		};
+
+		device_queue& queue_for(std::uint8_t device);
+
+		// returns the position in the queue of ``d`` of the job to execute
+		// next
+		int pick_job(device_queue const& d, time_point now) const;
+
+		// returns the index of the device to take the next job from, or -1
+		int pick();
+
+		std::vector<device_queue> m_devices;
+
+		// the total number of queued jobs
+		int m_size = 0;
+
+		int m_limit = 0;
+
+		// reads are only reordered if this is greater than 0
+		time_duration m_max_read_wait = time_duration(0);
+
+		// devices with the same number of jobs executing take turns. This is
+		// the device to start looking from the next time
+		int m_cursor = 0;
+	};
+}}
+
+#endif
@@ -0,0 +1,113 @@
+/*
+
+Copyright (c) 2017, Arvid Norberg
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions
+are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in
+      the documentation and/or other materials provided with the distribution.
+    * Neither the name of the author nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+
+#ifndef TORRENT_DISK_ARENA_HPP_INCLUDED
+#define TORRENT_DISK_ARENA_HPP_INCLUDED
+
+#include "libtorrent/config.hpp"
+#include "libtorrent/span.hpp"
+
+#include <atomic>
+#include <memory>
+#include <cstdint>
+#include <cstddef>
+
+namespace libtorrent { namespace aux {
+
+	// a fixed number of equally sized blocks, carved out of a single
+	// allocation made up-front. Where supported, the allocation is backed by
+	// huge pages, to reduce TLB misses when touching the disk cache. The free
+	// blocks are kept in a lock-free stack, so allocating and freeing blocks
+	// don't need a mutex. The arena is never resized, allocations fail once
+	// all blocks are in use.
+	struct TORRENT_EXTRA_EXPORT disk_arena
+	{
+		disk_arena() = default;
+		disk_arena(disk_arena const&) = delete;
+		disk_arena& operator=(disk_arena const&) = delete;
+		~disk_arena();
+
+		// allocates the memory for ``num_blocks`` blocks of ``block_size``
+		// bytes each. May only be called once. Returns false if the memory
+		// could not be allocated
+		bool reserve(int block_size, int num_blocks);
+
+		// returns nullptr if all blocks are in use
+		char* allocate();
+		void free(char* buf);
+
+		// allocates up to ``bufs.size()`` blocks with a single update of the
+		// free list. Returns the number of blocks actually allocated, which
+		// are stored at the front of ``bufs``
+		int allocate(span<char*> bufs);
+
+		// returns all blocks in ``bufs`` to the free list in one operation
+		void free(span<char* const> bufs);
+
+		bool owns(char const* buf) const
+		{ return buf >= m_base && buf < m_base + std::size_t(m_num_blocks) * std::size_t(m_block_size); }
+
+		int num_blocks() const { return m_num_blocks; }
+
+		// returns true if the arena is backed by explicitly requested huge
+		// pages (as opposed to regular, or transparent huge, pages)
+		bool huge_pages() const { return m_huge_pages; }
+
+	private:
+
+		char* m_base = nullptr;
+
+		// the number of bytes allocated at m_base
+		std::size_t m_size = 0;
+
+		int m_block_size = 0;
+		int m_num_blocks = 0;
+
+		// whether m_base was allocated with mmap() (as opposed to
+		// page_aligned_allocator)
+		bool m_mapped = false;
+		bool m_huge_pages = false;
+
+		// the free list. For each free block, this is the index + 1 of the next
+		// free block, 0 terminates the list
+		std::unique_ptr<std::atomic<std::uint32_t>[]> m_next;
+
+		// the low 32 bits are the index + 1 of the first free block (0 if
+		// there are none). The high 32 bits are incremented on every update, to
+		// make a compare-and-swap fail if the head was popped and pushed back
+		// in between (the ABA problem)
+		std::atomic<std::uint64_t> m_head{0};
+	};
+}}
+
+#endif
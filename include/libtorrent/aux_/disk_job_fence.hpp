@@ -35,9 +35,12 @@ POSSIBILITY OF SUCH DAMAGE.
 
 #include "libtorrent/config.hpp"
 #include "libtorrent/tailqueue.hpp"
+#include "libtorrent/units.hpp"
 
 #include <atomic>
 #include <mutex>
+#include <vector>
+#include <unordered_map>
 
 namespace libtorrent {
 
@@ -52,7 +55,11 @@ namespace aux {
 	// the fence, blocking all new jobs, until there are no longer
 	// any outstanding jobs on the torrent, then the fence is lowered
 	// and it can be performed, along with the backlog of jobs that
-	// accrued while the fence was up
+	// accrued while the fence was up.
+	//
+	// A fence may also be raised for just a single piece. It only holds back
+	// jobs on that piece (and jobs affecting the whole storage), and only
+	// waits for those to complete. Jobs on other pieces keep running.
 	struct TORRENT_EXPORT disk_job_fence
 	{
 		disk_job_fence();
@@ -72,6 +79,11 @@ namespace aux {
 		enum { fence_post_fence = 0, fence_post_flush = 1, fence_post_none = 2 };
 		int raise_fence(disk_io_job* fence_job, disk_io_job* flush_job
 			, counters& cnt);
+
+		// like raise_fence(), but the fence only covers the piece
+		// fence_job->piece. flush_job is expected to flush that piece.
+		int raise_piece_fence(disk_io_job* fence_job, disk_io_job* flush_job
+			, counters& cnt);
 		bool has_fence() const;
 
 		// called whenever a job completes and is posted back to the
@@ -89,11 +101,42 @@ namespace aux {
 		int num_blocked() const;
 
 	private:
-		// when > 0, this storage is blocked for new async
-		// operations until all outstanding jobs have completed.
-		// at that point, the m_blocked_jobs are issued
-		// the count is the number of fence job currently in the queue
-		int m_has_fence = 0;
+
+		struct fence_entry
+		{
+			disk_io_job* job;
+			piece_index_t piece;
+			// if true, this fence covers the whole storage, otherwise just
+			// the piece
+			bool whole_storage;
+			// true once the fence job has been issued
+			bool running;
+		};
+
+		int raise_fence_impl(disk_io_job* fence_job, disk_io_job* flush_job
+			, counters& cnt, bool whole_storage);
+
+		// finds the entry in m_fences for the specified fence job
+		std::vector<fence_entry>::iterator find_fence(disk_io_job const* j);
+
+		void add_outstanding(bool whole_storage, piece_index_t piece);
+		void remove_outstanding(bool whole_storage, piece_index_t piece);
+
+		// returns true if there are any outstanding jobs that overlap the
+		// specified scope
+		bool has_outstanding(bool whole_storage, piece_index_t piece) const;
+
+		// issues all blocked jobs that are no longer held back by a fence
+		// (including fence jobs whose scope has no more outstanding jobs),
+		// by adding them to job_queue. Returns the number of jobs issued
+		int issue_blocked_jobs(tailqueue<disk_io_job>& job_queue);
+
+		// the fences currently raised on this storage, in the order they were
+		// raised. This includes the running fence jobs. A storage with no
+		// fences is not blocked for new async operations. A job is blocked
+		// while any fence it overlaps has not completed yet. At that point,
+		// the m_blocked_jobs are issued
+		std::vector<fence_entry> m_fences;
 
 		// when there's a fence up, jobs are queued up in here
 		// until the fence is lowered
@@ -105,8 +148,14 @@ namespace aux {
 		// when the fence can be lowered
 		std::atomic<int> m_outstanding_jobs{0};
 
-		// must be held when accessing m_has_fence and
-		// m_blocked_jobs
+		// of m_outstanding_jobs, the number of jobs that affect the whole
+		// storage, and the number of jobs per piece for the ones that only
+		// operate on a single piece
+		int m_outstanding_storage_jobs = 0;
+		std::unordered_map<piece_index_t, int> m_outstanding_pieces;
+
+		// must be held when accessing m_fences, m_blocked_jobs and the
+		// outstanding job counters
 		mutable std::mutex m_mutex;
 	};
 
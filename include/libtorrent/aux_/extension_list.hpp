@@ -0,0 +1,150 @@
+/*
+
+Copyright (c) 2017, Arvid Norberg
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions
+are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in
+      the documentation and/or other materials provided with the distribution.
+    * Neither the name of the author nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+#ifndef TORRENT_EXTENSION_LIST_HPP_INCLUDED
+#define TORRENT_EXTENSION_LIST_HPP_INCLUDED
+
+#include "libtorrent/config.hpp"
+
+#include <vector>
+#include <memory>
+#include <cstdint>
+#include <algorithm>
+
+namespace libtorrent { namespace aux {
+
+	// the plugins attached to a torrent or a peer connection, in the order
+	// they were added, each along with the set of callbacks it implements, as
+	// returned by its implemented_features(). The union of the features of all
+	// plugins is kept too, so invoking a hook no plugin implements costs a
+	// single test, and hooks only visit the plugins that implement them.
+	template <typename Plugin>
+	struct extension_list
+	{
+		void push_back(std::shared_ptr<Plugin> p)
+		{
+			std::uint32_t const f = p->implemented_features();
+			m_features |= f;
+			m_list.push_back({std::move(p), f});
+		}
+
+		// removes p, if it's in the list
+		void erase(Plugin const* p)
+		{
+			remove_if([p](Plugin& e) { return &e == p; });
+		}
+
+		// removes the plugins f returns true for. It's called exactly once for
+		// every plugin, in order
+		template <typename Fun>
+		void remove_if(Fun f)
+		{
+			m_list.erase(std::remove_if(m_list.begin(), m_list.end()
+				, [&f](entry& e) { return f(*e.plugin); }), m_list.end());
+			m_features = 0;
+			for (auto const& e : m_list) m_features |= e.features;
+		}
+
+		void clear()
+		{
+			m_list.clear();
+			m_features = 0;
+		}
+
+		bool empty() const { return m_list.empty(); }
+		int size() const { return int(m_list.size()); }
+
+		// returns true if any plugin implements feature
+		bool has(std::uint32_t const feature) const
+		{ return (m_features & feature) != 0; }
+
+		// calls f on every plugin
+		template <typename Fun>
+		void for_each(Fun f) const
+		{
+			for (auto const& e : m_list) f(*e.plugin);
+		}
+
+		// calls f on every plugin implementing feature
+		template <typename Fun>
+		void for_each(std::uint32_t const feature, Fun f) const
+		{
+			if ((m_features & feature) == 0) return;
+			for (auto const& e : m_list)
+			{
+				if (e.features & feature) f(*e.plugin);
+			}
+		}
+
+		// calls f on every plugin, until one of them returns true, in which
+		// case true is returned
+		template <typename Fun>
+		bool any_of(Fun f) const
+		{
+			for (auto const& e : m_list)
+			{
+				if (f(*e.plugin)) return true;
+			}
+			return false;
+		}
+
+		// calls f on the plugins implementing feature, until one of them
+		// returns true, in which case true is returned. This is the semantics
+		// of the message handlers, where returning true means the message was
+		// handled
+		template <typename Fun>
+		bool any_of(std::uint32_t const feature, Fun f) const
+		{
+			if ((m_features & feature) == 0) return false;
+			for (auto const& e : m_list)
+			{
+				if ((e.features & feature) && f(*e.plugin)) return true;
+			}
+			return false;
+		}
+
+	private:
+
+		struct entry
+		{
+			std::shared_ptr<Plugin> plugin;
+			std::uint32_t features;
+		};
+
+		std::vector<entry> m_list;
+
+		// the union of the features of all plugins in m_list
+		std::uint32_t m_features = 0;
+	};
+}}
+
+#endif
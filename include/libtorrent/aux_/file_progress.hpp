@@ -38,12 +38,8 @@ POSSIBILITY OF SUCH DAMAGE.
 
 #include "libtorrent/export.hpp"
 #include "libtorrent/units.hpp"
-#include "libtorrent/aux_/vector.hpp"
-
-#if TORRENT_USE_INVARIANT_CHECKS
 #include "libtorrent/bitfield.hpp"
-#include "libtorrent/invariant_check.hpp"
-#endif
+#include "libtorrent/aux_/vector.hpp"
 
 #if TORRENT_USE_INVARIANT_CHECKS
 #include "libtorrent/invariant_check.hpp"
@@ -56,6 +52,7 @@ class piece_picker;
 class file_storage;
 class alert_manager;
 struct torrent_handle;
+struct piece_block;
 
 namespace aux {
 
@@ -64,9 +61,14 @@ namespace aux {
 		file_progress();
 
 		void init(piece_picker const& picker
-			, file_storage const& fs);
+			, file_storage const& fs, int block_size);
 
-		void export_progress(vector<std::int64_t, file_index_t> &fp);
+		// copies the number of bytes of each file that have passed the hash
+		// check into ``fp``. If ``blocks`` is true, the bytes of blocks that
+		// have been downloaded, but whose piece hasn't passed yet, are
+		// included too
+		void export_progress(vector<std::int64_t, file_index_t> &fp
+			, bool blocks = false);
 
 		bool empty() const { return m_file_progress.empty(); }
 		void clear();
@@ -74,8 +76,28 @@ namespace aux {
 		void update(file_storage const& fs, piece_index_t index
 			, alert_manager* alerts, torrent_handle const& h);
 
+		// these are called as individual blocks are downloaded (written or
+		// finished in the piece picker) and when they are lost again (write
+		// failures or cancellations). Adding a block that's already accounted
+		// for, or removing one that isn't, is a no-op
+		void add_block(file_storage const& fs, piece_block b);
+		void remove_block(file_storage const& fs, piece_block b);
+
+		// drops all downloaded blocks of the specified piece. This is called
+		// when a piece fails the hash check and is restored
+		void remove_piece_blocks(file_storage const& fs, piece_index_t index);
+
+		// adds ``bytes`` bytes of block ``b`` to ``fp``, split across the
+		// files the block overlaps. This is used for blocks that are still
+		// in flight from a peer
+		void add_block_bytes(file_storage const& fs
+			, vector<std::int64_t, file_index_t>& fp
+			, piece_block b, int bytes) const;
+
 	private:
 
+		void account_block(file_storage const& fs, piece_block b, int sign);
+
 		// this vector contains the number of bytes completely
 		// downloaded (as in passed-hash-check) in each file.
 		// this lets us trigger on individual files completing
@@ -83,6 +105,18 @@ namespace aux {
 		// is first queried by the client
 		vector<std::int64_t, file_index_t> m_file_progress;
 
+		// the number of bytes in each file belonging to blocks that have been
+		// downloaded, but whose piece hasn't passed the hash check yet. Kept
+		// separately from m_file_progress since these bytes may be lost again
+		vector<std::int64_t, file_index_t> m_block_progress;
+
+		// one bit per block in the torrent, set for the blocks accounted for
+		// in m_block_progress
+		bitfield m_downloaded_blocks;
+
+		int m_block_size = 0;
+		int m_blocks_per_piece = 0;
+
 #if TORRENT_USE_INVARIANT_CHECKS
 		friend class libtorrent::invariant_access;
 		void check_invariant() const;
@@ -0,0 +1,77 @@
+/*
+
+Copyright (c) 2017, Arvid Norberg
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions
+are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in
+      the documentation and/or other materials provided with the distribution.
+    * Neither the name of the author nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+
+#ifndef TORRENT_FREQUENCY_SKETCH_HPP_INCLUDED
+#define TORRENT_FREQUENCY_SKETCH_HPP_INCLUDED
+
+#include "libtorrent/config.hpp"
+
+#include <cstdint>
+#include <vector>
+
+namespace libtorrent { namespace aux {
+
+	// a count-min sketch with 4 bit counters, estimating how many times a key
+	// has been seen recently. This is the frequency filter of TinyLFU. Once
+	// the number of recorded events reaches 10 times the capacity, all
+	// counters are halved, to let old popularity fade out.
+	struct TORRENT_EXTRA_EXPORT frequency_sketch
+	{
+		explicit frequency_sketch(int capacity = 0);
+
+		// sizes the sketch to track about ``capacity`` distinct keys. This
+		// clears all counters
+		void resize(int capacity);
+
+		// record one access of ``key``
+		void increment(std::uint64_t key);
+
+		// returns the estimated number of times ``key`` has been seen
+		// (0 - 15)
+		int estimate(std::uint64_t key) const;
+
+		int sample_size() const { return m_sample_size; }
+
+	private:
+
+		int index_of(std::uint64_t hash, int row) const;
+		void reset();
+
+		// each word holds 16 4-bit counters
+		std::vector<std::uint64_t> m_table;
+		int m_sample_size;
+		int m_additions = 0;
+	};
+}}
+
+#endif
@@ -0,0 +1,268 @@
+/*
+
+Copyright (c) 2017, Arvid Norberg
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions
+are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in
+      the documentation and/or other materials provided with the distribution.
+    * Neither the name of the author nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+#ifndef TORRENT_INDEXED_QUEUE_HPP_INCLUDED
+#define TORRENT_INDEXED_QUEUE_HPP_INCLUDED
+
+#include "libtorrent/config.hpp"
+#include "libtorrent/assert.hpp"
+
+#include <vector>
+#include <cstdint>
+#include <algorithm>
+
+namespace libtorrent { namespace aux {
+
+	// an ordered sequence of values supporting insertion, removal, moving an
+	// element to a new position and looking up an element's position, all in
+	// O(log n). It's an implicit treap (a randomized balanced tree ordered by
+	// position rather than a key). Every element is identified by a handle,
+	// returned by insert(), which stays valid until the element is erased,
+	// regardless of how the elements around it are moved.
+	template <typename T>
+	struct indexed_queue
+	{
+		// inserts v at position pos, or at the end if pos is past it. Returns
+		// the handle of the new element
+		int insert(int pos, T v)
+		{
+			int h;
+			if (!m_free.empty())
+			{
+				h = m_free.back();
+				m_free.pop_back();
+				m_nodes[std::size_t(h)] = node{std::move(v), next_priority()};
+			}
+			else
+			{
+				h = int(m_nodes.size());
+				m_nodes.push_back(node{std::move(v), next_priority()});
+			}
+			link(h, pos);
+			return h;
+		}
+
+		void erase(int const h)
+		{
+			unlink(h);
+			m_nodes[std::size_t(h)].value = T();
+			m_free.push_back(h);
+		}
+
+		// moves the element to position pos, or to the end if pos is past it
+		void move(int const h, int const pos)
+		{
+			unlink(h);
+			link(h, pos);
+		}
+
+		// the current position of the element h refers to
+		int position(int h) const
+		{
+			TORRENT_ASSERT(h >= 0 && h < int(m_nodes.size()));
+			int pos = size(get(h).left);
+			for (int p = get(h).parent; p >= 0; h = p, p = get(p).parent)
+			{
+				if (get(p).right == h) pos += size(get(p).left) + 1;
+			}
+			return pos;
+		}
+
+		// the value at position pos
+		T const& at(int pos) const
+		{
+			TORRENT_ASSERT(pos >= 0 && pos < size());
+			int n = m_root;
+			for (;;)
+			{
+				int const left = size(get(n).left);
+				if (pos == left) return get(n).value;
+				if (pos < left)
+				{
+					n = get(n).left;
+				}
+				else
+				{
+					pos -= left + 1;
+					n = get(n).right;
+				}
+			}
+		}
+
+		T const& value(int const h) const { return get(h).value; }
+
+		int size() const { return size(m_root); }
+		bool empty() const { return m_root < 0; }
+
+		// calls f with every value, in queue order
+		template <typename Fun>
+		void for_each(Fun f) const
+		{
+			// in-order traversal, following parent links instead of
+			// keeping a stack
+			int n = m_root;
+			if (n < 0) return;
+			while (get(n).left >= 0) n = get(n).left;
+			while (n >= 0)
+			{
+				f(get(n).value);
+				if (get(n).right >= 0)
+				{
+					n = get(n).right;
+					while (get(n).left >= 0) n = get(n).left;
+					continue;
+				}
+				int p = get(n).parent;
+				while (p >= 0 && get(p).right == n)
+				{
+					n = p;
+					p = get(p).parent;
+				}
+				n = p;
+			}
+		}
+
+	private:
+
+		struct node
+		{
+			node() = default;
+			node(T v, std::uint32_t p) : value(std::move(v)), priority(p) {}
+
+			T value{};
+			std::uint32_t priority = 0;
+			int left = -1;
+			int right = -1;
+			int parent = -1;
+
+			// the number of nodes in the subtree rooted at this node
+			int count = 1;
+		};
+
+		node& get(int const n) { return m_nodes[std::size_t(n)]; }
+		node const& get(int const n) const { return m_nodes[std::size_t(n)]; }
+
+		int size(int const n) const { return n < 0 ? 0 : get(n).count; }
+
+		std::uint32_t next_priority()
+		{
+			// xorshift32. The priorities only need to be unpredictable enough
+			// to keep the tree balanced, not for anything else
+			m_seed ^= m_seed << 13;
+			m_seed ^= m_seed >> 17;
+			m_seed ^= m_seed << 5;
+			return m_seed;
+		}
+
+		void update(int const n)
+		{
+			node& e = get(n);
+			e.count = 1 + size(e.left) + size(e.right);
+			if (e.left >= 0) get(e.left).parent = n;
+			if (e.right >= 0) get(e.right).parent = n;
+		}
+
+		int merge(int const a, int const b)
+		{
+			if (a < 0) return b;
+			if (b < 0) return a;
+			if (get(a).priority > get(b).priority)
+			{
+				get(a).right = merge(get(a).right, b);
+				update(a);
+				return a;
+			}
+			get(b).left = merge(a, get(b).left);
+			update(b);
+			return b;
+		}
+
+		// splits the tree rooted at t into the first k nodes (l) and the
+		// rest (r)
+		void split(int const t, int const k, int& l, int& r)
+		{
+			if (t < 0)
+			{
+				l = r = -1;
+				return;
+			}
+			int const left = size(get(t).left);
+			if (left < k)
+			{
+				int right;
+				split(get(t).right, k - left - 1, right, r);
+				get(t).right = right;
+				update(t);
+				l = t;
+			}
+			else
+			{
+				int left_tree;
+				split(get(t).left, k, l, left_tree);
+				get(t).left = left_tree;
+				update(t);
+				r = t;
+			}
+		}
+
+		void link(int const h, int const pos)
+		{
+			node& e = get(h);
+			e.left = e.right = e.parent = -1;
+			e.count = 1;
+			int l, r;
+			split(m_root, std::max(0, std::min(pos, size())), l, r);
+			m_root = merge(merge(l, h), r);
+			get(m_root).parent = -1;
+		}
+
+		void unlink(int const h)
+		{
+			int l, mid, r;
+			split(m_root, position(h), l, mid);
+			split(mid, 1, mid, r);
+			TORRENT_ASSERT(mid == h);
+			m_root = merge(l, r);
+			if (m_root >= 0) get(m_root).parent = -1;
+		}
+
+		std::vector<node> m_nodes;
+
+		// handles of erased nodes, to be reused
+		std::vector<int> m_free;
+
+		int m_root = -1;
+		std::uint32_t m_seed = 0x9e3779b9;
+	};
+}}
+
+#endif
@@ -0,0 +1,146 @@
+/*
+
+Copyright (c) 2017, Arvid Norberg
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions
+are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in
+      the documentation and/or other materials provided with the distribution.
+    * Neither the name of the author nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+
+#ifndef TORRENT_IO_URING_HPP_INCLUDED
+#define TORRENT_IO_URING_HPP_INCLUDED
+
+#include "libtorrent/config.hpp"
+#include "libtorrent/file.hpp"
+#include "libtorrent/span.hpp"
+#include "libtorrent/error_code.hpp"
+#include "libtorrent/aux_/storage_utils.hpp" // for iovec_t
+
+#include "libtorrent/aux_/disable_warnings_push.hpp"
+#include <boost/noncopyable.hpp>
+#include "libtorrent/aux_/disable_warnings_pop.hpp"
+
+#include <vector>
+#include <cstdint>
+#include <functional>
+
+namespace libtorrent { namespace aux {
+
+	// a batch of file read and write operations. The operations are queued
+	// up with add_readv() and add_writev() and then issued all at once by
+	// run(). On linux, the batch is submitted to an io_uring instance, which
+	// lets the kernel keep all of them in flight at the same time. If
+	// io_uring is not supported (at compile time or by the running kernel)
+	// the operations are performed synchronously, one at a time, by run().
+	struct TORRENT_EXTRA_EXPORT io_uring_batch : boost::noncopyable
+	{
+		// ``queue_depth`` is the max number of operations submitted to the
+		// kernel at a time. Batches larger than this are submitted in chunks.
+		explicit io_uring_batch(int queue_depth);
+		~io_uring_batch();
+
+		// returns true if operations are submitted asynchronously via io_uring
+		// and false if they're performed synchronously
+		bool is_async() const;
+
+		// queue a read or write of ``bufs`` at ``offset`` in the file ``f``.
+		// The buffers pointed to by ``bufs`` must stay valid until run()
+		// returns, but the span itself is copied. ``tag`` is passed back to
+		// the completion handler to identify the operation. Multiple
+		// operations may have the same tag.
+		void add_readv(file_handle f, std::int64_t offset
+			, span<iovec_t const> bufs, int tag, std::uint32_t flags = 0);
+		void add_writev(file_handle f, std::int64_t offset
+			, span<iovec_t const> bufs, int tag, std::uint32_t flags = 0);
+
+		int size() const { return int(m_ops.size()); }
+		bool empty() const { return m_ops.empty(); }
+
+		// issue all queued operations and wait for all of them to complete.
+		// ``handler`` is called once per operation, with its tag, the number
+		// of bytes transferred and the error, if any. Short reads and writes
+		// are resumed synchronously; if the operation still cannot transfer
+		// all bytes it's reported as an error. Once this function returns the
+		// batch is empty and can be reused.
+		void run(std::function<void(int tag, int bytes, error_code const& ec)> const& handler);
+
+	private:
+
+		struct file_op
+		{
+			file_handle file;
+			std::int64_t offset;
+			std::vector<iovec_t> bufs;
+			int tag;
+			std::uint32_t flags;
+			bool write;
+		};
+
+		void add_op(file_handle f, std::int64_t offset
+			, span<iovec_t const> bufs, int tag, std::uint32_t flags, bool write);
+
+		// perform the rest of the operation synchronously, starting
+		// ``bytes`` bytes into it. returns the total number of bytes
+		// transferred by the operation. Note that this modifies op.bufs
+		static int finish_sync(file_op& op, int bytes, error_code& ec);
+
+#if TORRENT_USE_IO_URING
+		bool setup_ring(int entries);
+		void close_ring();
+
+		// submits the operations [begin, end) and reaps their completions.
+		// returns false if the ring failed and the remaining operations have
+		// to be performed synchronously
+		bool run_async(int begin, int end, std::vector<int>& result);
+
+		int m_ring_fd = -1;
+
+		// the submission and completion ring mappings
+		void* m_sq_ring = nullptr;
+		std::size_t m_sq_ring_size = 0;
+		void* m_cq_ring = nullptr;
+		std::size_t m_cq_ring_size = 0;
+		void* m_sqes = nullptr;
+		std::size_t m_sqes_size = 0;
+
+		// pointers into the rings
+		unsigned* m_sq_tail = nullptr;
+		unsigned const* m_sq_mask = nullptr;
+		unsigned* m_sq_array = nullptr;
+		unsigned* m_cq_head = nullptr;
+		unsigned const* m_cq_tail = nullptr;
+		unsigned const* m_cq_mask = nullptr;
+		void* m_cqes = nullptr;
+
+		int m_ring_entries = 0;
+#endif
+
+		std::vector<file_op> m_ops;
+	};
+}}
+
+#endif
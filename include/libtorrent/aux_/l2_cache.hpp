@@ -0,0 +1,221 @@
+/*
+
+Copyright (c) 2017, Arvid Norberg
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions
+are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in
+      the documentation and/or other materials provided with the distribution.
+    * Neither the name of the author nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+#ifndef TORRENT_L2_CACHE_HPP_INCLUDED
+#define TORRENT_L2_CACHE_HPP_INCLUDED
+
+#include "libtorrent/config.hpp"
+#include "libtorrent/units.hpp"
+#include "libtorrent/span.hpp"
+#include "libtorrent/error_code.hpp"
+#include "libtorrent/aux_/storage_utils.hpp" // for iovec_t
+
+#include <vector>
+#include <deque>
+#include <string>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <atomic>
+#include <unordered_map>
+#include <cstdint>
+
+namespace libtorrent {
+
+	struct disk_buffer_pool;
+	struct file;
+	struct counters;
+
+namespace aux {
+
+	// a second tier of the disk cache, in a file on fast storage (typically
+	// an SSD). When the block cache has to evict blocks of pieces that were
+	// requested again after falling out of the cache (ARC ghost list hits),
+	// it hands them over to the L2 cache instead of freeing them. A thread of
+	// its own writes them to the file, which is split up into block sized
+	// slots, reused in CLOCK order (approximating LRU). Reads that miss the
+	// block cache are served from the file, if all their blocks are in it,
+	// before reading from the torrent's storage.
+	//
+	// A block is only read from the file once it's been written in full. A
+	// read that races with its slot being reused is detected and fails, in
+	// which case the caller falls back to reading from the storage.
+	struct TORRENT_EXTRA_EXPORT l2_cache
+	{
+		// the max number of blocks waiting to be written to the file. Blocks
+		// spilled beyond this are freed right away
+		enum { max_pending = 256 };
+
+		l2_cache(disk_buffer_pool& pool, counters& cnt, int block_size);
+		~l2_cache();
+
+		// opens the cache file at ``path``, with room for ``num_blocks``
+		// blocks. When either changes, the cache starts out empty. An empty
+		// path or 0 blocks disables the cache
+		void set_settings(std::string const& path, int num_blocks, error_code& ec);
+
+		bool enabled() const { return m_enabled.load(std::memory_order_relaxed); }
+
+		// hands over the disk buffer ``buf``, holding the first ``len`` bytes
+		// of the block, to be written to the cache file. The buffer is freed
+		// back to the pool once it's been written. Returns false, without
+		// taking ownership of the buffer, if it's not accepted
+		bool insert(storage_index_t st, piece_index_t piece, int block
+			, char* buf, int len);
+
+		// reads consecutive blocks, starting at ``block``, into ``bufs``, one
+		// buffer per block. Returns true if all of them were in the cache and
+		// were read successfully
+		bool read(storage_index_t st, piece_index_t piece, int block
+			, span<iovec_t const> bufs);
+
+		// drops a block, or all blocks of a storage, from the cache. This must
+		// be called when the data in the storage changes, and before a storage
+		// index is reused for another torrent
+		void invalidate(storage_index_t st, piece_index_t piece, int block);
+		void invalidate(storage_index_t st);
+
+		// stops the thread writing blocks to the file, and frees the ones
+		// waiting to be written
+		void abort();
+
+		// the number of blocks that can be read from the cache
+		int size() const;
+
+	private:
+
+		struct key_t
+		{
+			storage_index_t storage;
+			piece_index_t piece;
+			int block;
+
+			bool operator==(key_t const& rhs) const
+			{
+				return storage == rhs.storage && piece == rhs.piece
+					&& block == rhs.block;
+			}
+		};
+
+		struct key_hash
+		{
+			std::size_t operator()(key_t const& k) const
+			{
+				return (std::size_t(static_cast<std::uint32_t>(static_cast<int>(k.storage))) << 24)
+					^ (std::size_t(static_cast<std::uint32_t>(static_cast<int>(k.piece))) << 8)
+					^ std::size_t(k.block);
+			}
+		};
+
+		struct slot_t
+		{
+			key_t key{storage_index_t(0), piece_index_t(0), 0};
+
+			// incremented every time the slot is reused or dropped. Readers
+			// and the fill thread use it to tell whether the slot still holds
+			// the block they looked up, once they're done with the file
+			std::uint32_t generation = 0;
+
+			// the number of bytes of the block stored in the slot
+			int len = 0;
+
+			// the slot is assigned to key (and in m_index)
+			bool used = false;
+
+			// the block has been written to the slot and may be read
+			bool valid = false;
+
+			// the CLOCK reference bit, set when the block is read
+			bool referenced = false;
+		};
+
+		struct pending_t
+		{
+			key_t key;
+			char* buf;
+			int len;
+		};
+
+		void fill_thread_fun();
+
+		// assigns a slot to ``k``, evicting the block in it, if any. Returns
+		// -1 if there's no slot to be had. Must be called with m_mutex held
+		int pick_slot(key_t const& k);
+
+		// must be called with m_mutex held
+		void drop_slot(int s);
+
+		// frees all pending blocks for which ``pred`` returns true. Must be
+		// called with m_mutex held, which is released while freeing
+		template <typename Pred>
+		void free_pending(std::unique_lock<std::mutex>& l, Pred pred);
+
+		void stop_thread(std::unique_lock<std::mutex>& l);
+
+		disk_buffer_pool& m_pool;
+		counters& m_stats_counters;
+		int const m_block_size;
+
+		mutable std::mutex m_mutex;
+		std::condition_variable m_cond;
+
+		std::string m_path;
+		std::shared_ptr<file> m_file;
+
+		std::vector<slot_t> m_slots;
+		std::unordered_map<key_t, int, key_hash> m_index;
+
+		// the next slot the CLOCK looks at for a slot to reuse
+		int m_hand = 0;
+
+		// the number of valid slots
+		int m_num_valid = 0;
+
+		// blocks waiting to be written to the file, oldest first
+		std::deque<pending_t> m_pending;
+
+		std::thread m_thread;
+
+		// tells m_thread to exit
+		bool m_stop = false;
+
+		// set by abort(), after which the cache stays disabled
+		bool m_aborted = false;
+
+		// m_file is open and there are slots. Readable without the mutex, for
+		// the common case of the cache being disabled
+		std::atomic<bool> m_enabled{false};
+	};
+}}
+
+#endif
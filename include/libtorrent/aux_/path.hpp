@@ -92,6 +92,9 @@ namespace libtorrent {
 		std::uint64_t atime = 0;
 		std::uint64_t mtime = 0;
 		std::uint64_t ctime = 0;
+
+		// identifies the device (volume) the file is on
+		std::uint64_t device = 0;
 		enum {
 #if defined TORRENT_WINDOWS
 			fifo = 0x1000, // named pipe (fifo)
@@ -0,0 +1,118 @@
+/*
+
+Copyright (c) 2017, Arvid Norberg
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions
+are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in
+      the documentation and/or other materials provided with the distribution.
+    * Neither the name of the author nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+#ifndef TORRENT_POOL_ALLOCATOR_HPP
+#define TORRENT_POOL_ALLOCATOR_HPP
+
+#include "libtorrent/config.hpp"
+#include "libtorrent/assert.hpp"
+
+#include <memory>
+#include <cstddef>
+#include <new>
+
+#include "libtorrent/aux_/disable_warnings_push.hpp"
+#include <boost/pool/pool.hpp>
+#include "libtorrent/aux_/disable_warnings_pop.hpp"
+
+namespace libtorrent { namespace aux {
+
+	// a pool of fixed size blocks, for objects of a single type that are
+	// created and destroyed at a high rate (like peer connections). The block
+	// size is set by the first allocation, since the size of the object
+	// actually allocated (e.g. by std::allocate_shared(), which puts the
+	// reference counts next to it) isn't known up-front. Allocations of any
+	// other size fall back to the heap. Freed blocks are kept for reuse
+	// until the pool is destructed
+	struct object_pool
+	{
+		void* allocate(std::size_t const size)
+		{
+			if (!m_pool) m_pool.reset(new boost::pool<>(size));
+			if (size != m_pool->get_requested_size())
+				return ::operator new(size);
+			void* ret = m_pool->malloc();
+			if (ret == nullptr) throw std::bad_alloc();
+			++m_live_allocations;
+			return ret;
+		}
+
+		void deallocate(void* p, std::size_t const size)
+		{
+			if (!m_pool || size != m_pool->get_requested_size())
+			{
+				::operator delete(p);
+				return;
+			}
+			TORRENT_ASSERT(m_live_allocations > 0);
+			--m_live_allocations;
+			m_pool->free(p);
+		}
+
+		int live_allocations() const { return m_live_allocations; }
+
+	private:
+		std::unique_ptr<boost::pool<>> m_pool;
+		int m_live_allocations = 0;
+	};
+
+	// an allocator drawing from an object_pool. Every copy keeps the pool
+	// alive, so objects may outlive whoever created the pool
+	template <typename T>
+	struct pool_allocator
+	{
+		using value_type = T;
+
+		explicit pool_allocator(std::shared_ptr<object_pool> p)
+			: m_pool(std::move(p)) {}
+
+		template <typename U>
+		pool_allocator(pool_allocator<U> const& a) : m_pool(a.m_pool) {}
+
+		T* allocate(std::size_t const n)
+		{ return static_cast<T*>(m_pool->allocate(sizeof(T) * n)); }
+
+		void deallocate(T* p, std::size_t const n)
+		{ m_pool->deallocate(p, sizeof(T) * n); }
+
+		template <typename U>
+		bool operator==(pool_allocator<U> const& a) const { return m_pool == a.m_pool; }
+		template <typename U>
+		bool operator!=(pool_allocator<U> const& a) const { return m_pool != a.m_pool; }
+
+	private:
+		template <typename U> friend struct pool_allocator;
+		std::shared_ptr<object_pool> m_pool;
+	};
+}}
+
+#endif
@@ -0,0 +1,85 @@
+/*
+
+Copyright (c) 2017, Arvid Norberg
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions
+are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in
+      the documentation and/or other materials provided with the distribution.
+    * Neither the name of the author nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+
+#ifndef TORRENT_READ_AHEAD_HPP_INCLUDED
+#define TORRENT_READ_AHEAD_HPP_INCLUDED
+
+#include "libtorrent/config.hpp"
+#include "libtorrent/units.hpp"
+#include "libtorrent/storage_defs.hpp" // for storage_index_t
+
+#include <array>
+#include <cstdint>
+
+namespace libtorrent { namespace aux {
+
+	// keeps track of the most recent read requests of a number of requesters
+	// (peers), to tell whether they read sequentially or at random. This is
+	// used to grow the read-ahead for sequential readers and to shrink it for
+	// random access, where reading ahead would just pollute the cache.
+	struct TORRENT_EXTRA_EXPORT read_ahead_tracker
+	{
+		// record a read request from ``requester`` for ``block`` of ``piece``
+		// in ``storage``
+		void record(void const* requester, storage_index_t storage
+			, piece_index_t piece, int block);
+
+		// returns the number of blocks to read when ``requester`` misses the
+		// cache, given the configured read cache line size (``line_size``). A
+		// requester with no (or a short) history gets ``line_size`` blocks,
+		// sequential readers get up to 8 times as many and random readers only
+		// get the block they asked for.
+		int read_ahead(void const* requester, int line_size) const;
+
+	private:
+
+		struct stream
+		{
+			void const* requester = nullptr;
+			storage_index_t storage{0};
+			piece_index_t piece{0};
+			int block = 0;
+			// the number of requests in a row that followed the previous one
+			int sequential = 0;
+			// the number of requests in a row that didn't
+			int random = 0;
+		};
+
+		stream const& slot(void const* requester) const;
+		stream& slot(void const* requester);
+
+		std::array<stream, 64> m_streams;
+	};
+}}
+
+#endif
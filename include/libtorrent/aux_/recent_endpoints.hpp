@@ -0,0 +1,78 @@
+/*
+
+Copyright (c) 2017, Arvid Norberg
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions
+are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in
+      the documentation and/or other materials provided with the distribution.
+    * Neither the name of the author nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+
+#ifndef TORRENT_RECENT_ENDPOINTS_HPP_INCLUDED
+#define TORRENT_RECENT_ENDPOINTS_HPP_INCLUDED
+
+#include "libtorrent/config.hpp"
+#include "libtorrent/socket.hpp"
+#include "libtorrent/address.hpp"
+#include "libtorrent/bloom_filter.hpp"
+
+#include <cstdint>
+
+namespace libtorrent { namespace aux {
+
+	// remembers the endpoints inserted into it recently, in a pair of bloom
+	// filters. Once the current filter has had rotate_interval endpoints
+	// inserted, the other one is cleared and becomes the current one. This
+	// way an endpoint is remembered for at least rotate_interval insertions,
+	// and at most twice that. Like any bloom filter, it may report an
+	// endpoint as seen when it wasn't. With both filters full that's about 3%
+	// of the time.
+	struct TORRENT_EXTRA_EXPORT recent_endpoints
+	{
+		enum { rotate_interval = 1024 };
+
+		// returns true if this endpoint, with this ``tag``, was (probably)
+		// inserted recently. Otherwise it's recorded and false is returned.
+		// The tag is any extra information that, when different, should make
+		// the same endpoint count as not seen.
+		bool insert(tcp::endpoint const& ep, std::uint32_t tag);
+
+		// forget all endpoints
+		void clear();
+
+	private:
+
+		bloom_filter<2048> m_filter[2];
+
+		// the index of the filter new endpoints are inserted into
+		int m_current = 0;
+
+		// the number of endpoints inserted into the current filter
+		int m_inserted = 0;
+	};
+}}
+
+#endif
@@ -39,6 +39,7 @@ POSSIBILITY OF SUCH DAMAGE.
 #include "libtorrent/linked_list.hpp"
 #include "libtorrent/torrent_peer.hpp"
 #include "libtorrent/torrent_peer_allocator.hpp"
+#include "libtorrent/aux_/pool_allocator.hpp"
 #include "libtorrent/performance_counters.hpp" // for counters
 #include "libtorrent/aux_/allocating_handler.hpp"
 
@@ -66,6 +67,7 @@ POSSIBILITY OF SUCH DAMAGE.
 #include "libtorrent/udp_socket.hpp"
 #include "libtorrent/assert.hpp"
 #include "libtorrent/alert_manager.hpp" // for alert_manager
+#include "libtorrent/alert_types.hpp" // for network_stall_alert
 #include "libtorrent/deadline_timer.hpp"
 #include "libtorrent/socket_io.hpp" // for print_address
 #include "libtorrent/address.hpp"
@@ -81,6 +83,9 @@ POSSIBILITY OF SUCH DAMAGE.
 #include "libtorrent/extensions.hpp"
 #include "libtorrent/aux_/portmap.hpp"
 #include "libtorrent/aux_/lsd.hpp"
+#include "libtorrent/aux_/upload_scheduler.hpp"
+#include "libtorrent/aux_/timer_wheel.hpp"
+#include "libtorrent/aux_/indexed_queue.hpp"
 
 #ifndef TORRENT_NO_DEPRECATE
 #include "libtorrent/session_settings.hpp"
@@ -91,13 +96,17 @@ POSSIBILITY OF SUCH DAMAGE.
 #endif
 
 #include <algorithm>
+#include <array>
 #include <vector>
 #include <set>
+#include <map>
+#include <queue>
 #include <list>
 #include <deque>
 #include <condition_variable>
 #include <mutex>
 #include <cstdarg> // for va_start, va_end
+#include <functional>
 #include <unordered_map>
 
 namespace libtorrent {
@@ -173,6 +182,10 @@ namespace dht {
 		// incoming packet is in the event queue when the socket is erased
 		std::shared_ptr<tcp::acceptor> sock;
 		std::shared_ptr<udp_socket> udp_sock;
+
+		// additional acceptors bound to the same endpoint as sock, with
+		// SO_REUSEPORT. See settings_pack::listen_acceptors
+		std::vector<std::shared_ptr<tcp::acceptor>> extra_socks;
 	};
 
 namespace aux {
@@ -245,6 +258,10 @@ namespace aux {
 
 			void start_session(settings_pack pack);
 
+			// must be called before start_session(). see
+			// session_params::thread_init
+			void set_thread_init(std::function<void(char const*)> f);
+
 			void init_peer_class_filter(bool unlimited_local);
 
 #ifndef TORRENT_DISABLE_EXTENSIONS
@@ -284,6 +301,9 @@ namespace aux {
 			torrent_peer_allocator_interface* get_peer_allocator() override
 			{ return &m_peer_allocator; }
 
+			std::shared_ptr<object_pool> const& connection_pool() override
+			{ return m_connection_pool; }
+
 			io_service& get_io_service() override { return m_io_service; }
 			resolver_interface& get_resolver() override { return m_host_resolver; }
 
@@ -308,6 +328,10 @@ namespace aux {
 				, std::weak_ptr<tcp::acceptor> listener, error_code const& e, bool ssl);
 
 			void incoming_connection(std::shared_ptr<socket_type> const& s);
+			void on_incoming_handshake(std::shared_ptr<socket_type> const& s
+				, std::int64_t limit, error_code const& e);
+			void start_incoming_connection(std::shared_ptr<socket_type> const& s
+				, tcp::endpoint const& endp, std::int64_t limit);
 
 			std::weak_ptr<torrent> find_torrent(sha1_hash const& info_hash) const override;
 #ifndef TORRENT_NO_DEPRECATE
@@ -338,6 +362,7 @@ namespace aux {
 			std::shared_ptr<torrent> delay_load_torrent(sha1_hash const& info_hash
 				, peer_connection* pc) override;
 			void set_queue_position(torrent* t, int p) override;
+			int queue_position(torrent const* t) const override;
 
 			peer_id const& get_peer_id() const override { return m_peer_id; }
 
@@ -385,11 +410,15 @@ namespace aux {
 					, std::int64_t&, std::string const&)> cb
 				, std::string salt = std::string());
 
+			void dht_put_items(std::vector<dht_mutable_put> const& items);
+
 			void dht_get_peers(sha1_hash const& info_hash);
 			void dht_announce(sha1_hash const& info_hash, int port = 0, int flags = 0);
 
 			void dht_live_nodes(sha1_hash const& nid);
 
+			void dht_sample_infohashes(sha1_hash const& target);
+
 			void dht_direct_request(udp::endpoint const& ep, entry& e
 				, void* userdata = nullptr);
 
@@ -444,8 +473,10 @@ namespace aux {
 			peer_class_pool const& peer_classes() const override { return m_classes; }
 			peer_class_pool& peer_classes() override { return m_classes; }
 			bool ignore_unchoke_slots_set(peer_class_set const& set) const override;
-			int copy_pertinent_channels(peer_class_set const& set
-				, int channel, bandwidth_channel** dst, int max) override;
+			bool utp_cubic_set(peer_class_set const& set) const override;
+			std::uint32_t peer_class_alert_mask(peer_class_set const& set) const override;
+			std::uint32_t extra_alert_mask() const override { return m_extra_alert_mask; }
+			void update_extra_alert_mask() override;
 			int use_quota_overhead(peer_class_set& set, int amount_down, int amount_up) override;
 			bool use_quota_overhead(bandwidth_channel* ch, int amount);
 
@@ -473,6 +504,7 @@ namespace aux {
 			std::pair<std::shared_ptr<torrent>, bool>
 			add_torrent_impl(add_torrent_params& p, error_code& ec);
 			void async_add_torrent(add_torrent_params* params);
+			void async_add_torrents(std::vector<add_torrent_params>* params);
 
 #ifndef TORRENT_NO_DEPRECATE
 			void on_async_load_torrent(add_torrent_params* params, error_code ec);
@@ -487,7 +519,19 @@ namespace aux {
 			void refresh_torrent_status(std::vector<torrent_status>* ret
 				, std::uint32_t flags) const;
 			void post_torrent_updates(std::uint32_t flags);
+			void post_torrent_status(std::vector<torrent_handle> const& handles
+				, std::uint32_t flags);
+			void post_peer_samples();
 			void post_session_stats();
+			void post_session_stats_delta();
+			// samples the counters that are only updated when stats are posted
+			void update_session_stats();
+
+			// records the time a handler spent queued and executing on the
+			// network thread, and posts a network_stall_alert if it ran longer
+			// than the network_stall_threshold
+			void handler_executed(network_stall_alert::handler_t h
+				, time_point queued, time_point started);
 			void post_dht_stats();
 
 			std::vector<torrent_handle> get_torrents() const;
@@ -561,6 +605,9 @@ namespace aux {
 
 			alert_manager& alerts() override { return m_alerts; }
 			disk_interface& disk_thread() override { return m_disk_thread; }
+			aux::upload_scheduler& upload_scheduler() override
+			{ return m_upload_scheduler; }
+			aux::timer_service& timers() override { return *m_timers; }
 
 			void abort();
 			void abort_stage2();
@@ -648,6 +695,7 @@ namespace aux {
 
 			virtual bool on_dht_request(string_view query
 				, dht::msg const& request, entry& response) override;
+			virtual bool has_dht_request_handler() const override;
 
 			void set_external_address(address const& ip
 				, int source_type, address const& source) override;
@@ -733,6 +781,10 @@ namespace aux {
 
 			peer_class_pool m_classes;
 
+			// the union of the alert masks of all torrents and peer classes,
+			// updated by update_extra_alert_mask()
+			std::uint32_t m_extra_alert_mask = 0;
+
 			void init(std::shared_ptr<settings_pack> pack);
 			void init_dht();
 
@@ -748,9 +800,19 @@ namespace aux {
 
 			counters m_stats_counters;
 
+			// the values reported by the last session_stats_delta_alert
+			std::array<std::int64_t, counters::num_counters> m_stats_delta_base{};
+
 			// this is a pool allocator for torrent_peer objects
 			torrent_peer_allocator m_peer_allocator;
 
+			// bt_peer_connection objects are allocated from this pool. During
+			// flash crowds, connections come and go at a high rate, many of
+			// them dropped right after the handshake. Reusing their memory
+			// keeps that from churning the heap
+			std::shared_ptr<object_pool> m_connection_pool
+				= std::make_shared<object_pool>();
+
 			// this vector is used to store the block_info
 			// objects pointed to by partial_piece_info returned
 			// by torrent::get_download_queue.
@@ -794,6 +856,8 @@ namespace aux {
 			// constructed after it.
 			disk_io_thread m_disk_thread;
 
+			aux::upload_scheduler m_upload_scheduler;
+
 			// the bandwidth manager is responsible for
 			// handing out bandwidth to connections that
 			// asks for it, it can also throttle the
@@ -822,8 +886,9 @@ namespace aux {
 			torrent_map m_torrents;
 
 			// all torrents that are downloading or queued,
-			// ordered by their queue position
-			aux::vector<torrent*> m_download_queue;
+			// ordered by their queue position. Each torrent holds
+			// the handle of its entry (torrent::queue_handle())
+			aux::indexed_queue<torrent*> m_download_queue;
 
 #if !defined(TORRENT_DISABLE_ENCRYPTION) && !defined(TORRENT_DISABLE_EXTENSIONS)
 			// this maps obfuscated hashes to torrents. It's only
@@ -859,6 +924,30 @@ namespace aux {
 			// they would linger and stall or hang session shutdown
 			std::set<std::shared_ptr<socket_type>> m_incoming_sockets;
 
+			// incoming plaintext TCP connections whose bittorrent handshake
+			// we're waiting for, before creating a peer_connection for
+			// them (see pre_handshake_check). Maps to the time each was
+			// accepted, to time them out. They are closed on shutdown
+			std::map<std::shared_ptr<socket_type>, time_point> m_pending_handshakes;
+
+			// the time by which an incoming peer connection has to complete its
+			// handshake and attach to a torrent
+			struct handshake_deadline
+			{
+				time_point deadline;
+				std::weak_ptr<peer_connection> peer;
+
+				// orders the queue with the earliest deadline on top
+				bool operator<(handshake_deadline const& rhs) const
+				{ return deadline > rhs.deadline; }
+			};
+
+			// deadlines of the incoming connections that have not been
+			// attached to a torrent yet. Every second, only the connections
+			// whose deadline has passed are looked at, instead of scanning all
+			// connections for unattached ones
+			std::priority_queue<handshake_deadline> m_handshake_deadlines;
+
 			// maps IP ranges to bitfields representing peer class IDs
 			// to assign peers matching a specific IP range based on its
 			// remote endpoint
@@ -1004,6 +1093,13 @@ namespace aux {
 			time_point m_last_tick;
 			time_point m_last_second_tick;
 
+			// the time the tick timer is due to fire next. Used to measure how
+			// late the network thread is in handling it
+			time_point m_next_tick;
+
+			// the last time a peer_sample_alert was posted
+			time_point m_last_peer_sample;
+
 			// the last time we went through the peers
 			// to decide which ones to choke/unchoke
 			time_point m_last_choke;
@@ -1016,6 +1112,9 @@ namespace aux {
 			// port we'll bind the next outgoing socket to
 			mutable int m_next_port = 0;
 
+			// called at the start of every thread we spawn
+			std::function<void(char const*)> m_thread_init;
+
 #ifndef TORRENT_DISABLE_DHT
 			std::unique_ptr<dht::dht_storage_interface> m_dht_storage;
 			std::shared_ptr<dht::dht_tracker> m_dht;
@@ -1060,6 +1159,10 @@ namespace aux {
 				, error_code& ec
 				, int flags);
 
+			// sends the packets queued on the UDP sockets by the uTP socket
+			// manager
+			void flush_udp_batches(bool ssl);
+
 			void on_udp_writeable(std::weak_ptr<udp_socket> s, error_code const& ec);
 
 			void on_udp_packet(std::weak_ptr<udp_socket> const& s
@@ -1077,6 +1180,15 @@ namespace aux {
 			// this is deducted from the connect speed
 			int m_boost_connections = 0;
 
+			// connection_speed is a rate per second, but new peers are
+			// connected every tick. This is the connection attempt budget
+			// accumulated since the last time we connected peers, in
+			// thousandths of an attempt, and the time of that last time.
+			// Carrying the remainder over lets the budget be spread evenly
+			// across ticks, regardless of tick_interval
+			int m_connect_credit = 0;
+			time_point m_last_connect_time = aux::time_now();
+
 			std::shared_ptr<natpmp> m_natpmp;
 			std::shared_ptr<upnp> m_upnp;
 			std::shared_ptr<lsd> m_lsd;
@@ -1117,6 +1229,10 @@ namespace aux {
 
 			// the timer used to fire the tick
 			deadline_timer m_timer;
+
+			// the timers of all torrents are kept in this wheel, which only
+			// arms one system timer
+			std::shared_ptr<aux::timer_service> m_timers;
 			aux::handler_storage<TORRENT_READ_HANDLER_MAX_SIZE> m_tick_handler_storage;
 
 			template <class Handler>
@@ -1236,6 +1352,26 @@ namespace aux {
 			bool m_paused = false;
 		};
 
+		// measures the time a handler runs on the network thread, from
+		// construction until it goes out of scope
+		struct handler_timer
+		{
+			handler_timer(session_impl& ses, network_stall_alert::handler_t const h
+				, time_point const queued)
+				: m_ses(ses), m_queued(queued), m_started(clock_type::now()), m_handler(h)
+			{}
+			~handler_timer() { m_ses.handler_executed(m_handler, m_queued, m_started); }
+
+			handler_timer(handler_timer const&) = delete;
+			handler_timer& operator=(handler_timer const&) = delete;
+
+		private:
+			session_impl& m_ses;
+			time_point const m_queued;
+			time_point const m_started;
+			network_stall_alert::handler_t const m_handler;
+		};
+
 #ifndef TORRENT_DISABLE_LOGGING
 		struct tracker_logger : request_callback
 		{
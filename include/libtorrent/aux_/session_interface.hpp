@@ -93,6 +93,7 @@ namespace libtorrent { namespace aux {
 
 	struct proxy_settings;
 	struct session_settings;
+	struct object_pool;
 
 #if !defined TORRENT_DISABLE_LOGGING || TORRENT_USE_ASSERTS
 	// This is the basic logging and debug interface offered by the session.
@@ -117,6 +118,8 @@ namespace libtorrent { namespace aux {
 #endif // TORRENT_DISABLE_LOGGING || TORRENT_USE_ASSERTS
 
 	struct ses_buffer_holder;
+	struct upload_scheduler;
+	struct timer_service;
 
 	// TODO: 2 make this interface a lot smaller. It could be split up into
 	// several smaller interfaces. Each subsystem could then limit the size
@@ -142,9 +145,20 @@ namespace libtorrent { namespace aux {
 
 		virtual disk_interface& disk_thread() = 0;
 
+		// orders the reads of blocks peers request from us, to make the most
+		// of the disk cache
+		virtual aux::upload_scheduler& upload_scheduler() = 0;
+
+		// coarse timers, for objects there are many of (like torrents), to
+		// avoid having a system timer armed for each of them
+		virtual aux::timer_service& timers() = 0;
+
 		virtual alert_manager& alerts() = 0;
 
 		virtual torrent_peer_allocator_interface* get_peer_allocator() = 0;
+
+		// the pool bittorrent peer connections are allocated from
+		virtual std::shared_ptr<object_pool> const& connection_pool() = 0;
 		virtual io_service& get_io_service() = 0;
 		virtual resolver_interface& get_resolver() = 0;
 
@@ -178,6 +192,7 @@ namespace libtorrent { namespace aux {
 		virtual void insert_uuid_torrent(std::string uuid, std::shared_ptr<torrent> const& t) = 0;
 #endif
 		virtual void set_queue_position(torrent* t, int p) = 0;
+		virtual int queue_position(torrent const* t) const = 0;
 		virtual int num_torrents() const = 0;
 
 		virtual peer_id const& get_peer_id() const = 0;
@@ -231,8 +246,14 @@ namespace libtorrent { namespace aux {
 		virtual peer_class_pool const& peer_classes() const = 0;
 		virtual peer_class_pool& peer_classes() = 0;
 		virtual bool ignore_unchoke_slots_set(peer_class_set const& set) const = 0;
-		virtual int copy_pertinent_channels(peer_class_set const& set
-			, int channel, bandwidth_channel** dst, int max) = 0;
+		virtual bool utp_cubic_set(peer_class_set const& set) const = 0;
+		virtual std::uint32_t peer_class_alert_mask(peer_class_set const& set) const = 0;
+
+		// a superset of the alert categories enabled by any torrent or peer
+		// class (via their alert masks). When a category is not in here, nor in
+		// the session's alert mask, no torrent or peer needs to look any further
+		virtual std::uint32_t extra_alert_mask() const = 0;
+		virtual void update_extra_alert_mask() = 0;
 		virtual int use_quota_overhead(peer_class_set& set, int amount_down, int amount_up) = 0;
 
 		virtual bandwidth_manager* get_bandwidth_manager(int channel) = 0;
@@ -40,6 +40,9 @@ POSSIBILITY OF SUCH DAMAGE.
 #include <string>
 #include <array>
 #include <bitset>
+#include <memory>
+#include <atomic>
+#include <cstdint>
 
 namespace libtorrent {
 
@@ -98,6 +101,74 @@ namespace libtorrent { namespace aux {
 		std::bitset<settings_pack::num_bool_settings> m_bools;
 	};
 
+	// the number of disk threads dedicated to hashing, as configured by
+	// settings_pack::hash_threads and settings_pack::aio_threads
+	TORRENT_EXTRA_EXPORT int num_hash_threads(session_settings const& s);
+
+	// the settings the disk threads look at for every job, pulled out of
+	// session_settings into plain fields. Aligned to not share a cache line
+	// with anything written to
+	struct alignas(64) TORRENT_EXTRA_EXPORT hot_settings
+	{
+		explicit hot_settings(session_settings const& s);
+
+		int read_cache_line_size;
+		int write_cache_line_size;
+		int max_retained_unhashed_blocks;
+		int cache_size;
+		int cache_expiry;
+		int aio_max;
+		int disk_io_backend;
+		int close_file_interval;
+		bool use_read_cache;
+		bool coalesce_reads;
+		bool coalesce_writes;
+		bool disable_hash_checks;
+		bool allow_partial_disk_writes;
+		bool adaptive_read_ahead;
+	};
+
+	// an immutable copy of the settings, as of one settings update. Every
+	// snapshot has a unique version, increasing with every publish
+	struct TORRENT_EXTRA_EXPORT settings_snapshot
+	{
+		settings_snapshot(session_settings const& s, std::uint64_t v);
+
+		session_settings const settings;
+		hot_settings const hot;
+		std::uint64_t const version;
+	};
+
+	// holds the most recently published settings_snapshot. The thread
+	// changing the settings publishes a new one, other threads read the
+	// current one without taking any lock, except for the first time they
+	// read it after a publish
+	class TORRENT_EXTRA_EXPORT settings_publisher
+	{
+	public:
+		explicit settings_publisher(session_settings const& s);
+		settings_publisher(settings_publisher const&) = delete;
+		settings_publisher& operator=(settings_publisher const&) = delete;
+
+		// replaces the current snapshot with a copy of ``s``
+		void publish(session_settings const& s);
+
+		// the current snapshot, as seen by the calling thread. Each thread
+		// keeps a reference to the last snapshot it read, and only loads the
+		// new one when the version has changed. The returned reference is
+		// valid until the calling thread calls current() again on any
+		// publisher
+		settings_snapshot const& current() const;
+
+		std::uint64_t version() const
+		{ return m_version.load(std::memory_order_acquire); }
+
+	private:
+		// only accessed with std::atomic_load() and std::atomic_store()
+		std::shared_ptr<settings_snapshot const> m_snapshot;
+		std::atomic<std::uint64_t> m_version;
+	};
+
 } }
 
 #endif
@@ -0,0 +1,97 @@
+/*
+
+Copyright (c) 2017, Arvid Norberg
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions
+are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in
+      the documentation and/or other materials provided with the distribution.
+    * Neither the name of the author nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+#ifndef TORRENT_SSL_SESSION_CACHE_HPP_INCLUDED
+#define TORRENT_SSL_SESSION_CACHE_HPP_INCLUDED
+
+#include "libtorrent/config.hpp"
+
+#ifdef TORRENT_USE_OPENSSL
+
+#include "libtorrent/socket.hpp"
+#include "libtorrent/span.hpp"
+
+#include <map>
+#include <memory>
+
+#include "libtorrent/aux_/disable_warnings_push.hpp"
+#include <openssl/ssl.h>
+#include "libtorrent/aux_/disable_warnings_pop.hpp"
+
+namespace libtorrent { namespace aux {
+
+	// holds on to the TLS sessions of outgoing connections, keyed by the
+	// endpoint of the peer. When reconnecting to the same peer, the session is
+	// offered for resumption, which lets both ends skip the certificate
+	// exchange and key agreement of a full handshake. Once max_size sessions
+	// are cached, an arbitrary one is evicted to make room for a new one.
+	struct TORRENT_EXTRA_EXPORT ssl_session_cache
+		: std::enable_shared_from_this<ssl_session_cache>
+	{
+		enum { default_max_size = 500 };
+
+		explicit ssl_session_cache(int max_size = default_max_size);
+		~ssl_session_cache();
+		ssl_session_cache(ssl_session_cache const&) = delete;
+		ssl_session_cache& operator=(ssl_session_cache const&) = delete;
+
+		// configures ctx to issue and resume sessions, with the sessions of
+		// connections set up by prepare() ending up in their cache. The
+		// session id context ties the sessions to ctx (e.g. with the info-hash
+		// of the torrent), so they won't be resumed in any other context.
+		static void enable_resumption(SSL_CTX* ctx, span<char const> sid_ctx);
+
+		// called before the handshake of an outgoing connection to ``ep``.
+		// Offers the previous session with this endpoint (if any) for
+		// resumption, and makes the session this connection ends up with
+		// replace it in the cache. The context of ``ssl`` must have been set
+		// up by enable_resumption().
+		void prepare(SSL* ssl, tcp::endpoint const& ep);
+
+		int size() const { return int(m_sessions.size()); }
+
+	private:
+
+		static int on_new_session(SSL* ssl, SSL_SESSION* s);
+
+		// takes over the reference to s
+		void insert(tcp::endpoint const& ep, SSL_SESSION* s);
+
+		std::map<tcp::endpoint, SSL_SESSION*> m_sessions;
+
+		int m_max_size;
+	};
+}}
+
+#endif // TORRENT_USE_OPENSSL
+
+#endif
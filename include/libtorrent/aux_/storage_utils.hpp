@@ -34,6 +34,9 @@ POSSIBILITY OF SUCH DAMAGE.
 #define TORRENT_STORAGE_UTILS_HPP_INCLUDE
 
 #include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
 
 #include "libtorrent/config.hpp"
 #include "libtorrent/span.hpp"
@@ -109,6 +112,16 @@ namespace libtorrent {
 		, stat_cache& stat
 		, std::string const& save_path
 		, storage_error& ec);
+
+	// distributes the files of fs across the torrent's save path and the
+	// save paths in ``extra_paths``, by assigning each file (largest first) to
+	// the path with the fewest bytes assigned to it so far. Files that end up
+	// on the torrent's own save path, pad files and files that already have
+	// absolute paths are left alone. The returned map holds the new
+	// (absolute) names of the other files
+	TORRENT_EXTRA_EXPORT std::map<file_index_t, std::string>
+	stripe_files(file_storage const& fs
+		, std::vector<std::string> const& extra_paths);
 }}
 
 #endif
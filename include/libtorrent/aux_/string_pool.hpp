@@ -0,0 +1,144 @@
+/*
+
+Copyright (c) 2017, Arvid Norberg
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions
+are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in
+      the documentation and/or other materials provided with the distribution.
+    * Neither the name of the author nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+
+#ifndef TORRENT_STRING_POOL_HPP_INCLUDED
+#define TORRENT_STRING_POOL_HPP_INCLUDED
+
+#include "libtorrent/config.hpp"
+#include "libtorrent/assert.hpp"
+#include "libtorrent/string_view.hpp"
+
+#include <memory>
+#include <vector>
+#include <cstring>
+#include <algorithm>
+
+namespace libtorrent { namespace aux {
+
+	// an append-only arena of strings. Strings are copied back-to-back into
+	// large blocks, rather than being allocated one at a time on the heap,
+	// which saves the per-allocation overhead for the millions of short file
+	// names a torrent may have. Strings are never freed individually, and
+	// they are not 0-terminated. A copy of the pool shares the blocks with
+	// the original (which keeps the strings valid as long as either one is
+	// alive) but new strings are always copied into blocks of its own
+	struct string_pool
+	{
+		string_pool() = default;
+		string_pool(string_pool const& p) : m_blocks(p.m_blocks) {}
+		string_pool& operator=(string_pool const& p)
+		{
+			m_blocks = p.m_blocks;
+			m_left = 0;
+			return *this;
+		}
+		string_pool(string_pool&& p) noexcept
+			: m_blocks(std::move(p.m_blocks)), m_left(p.m_left)
+		{ p.m_blocks.clear(); p.m_left = 0; }
+		string_pool& operator=(string_pool&& p) noexcept
+		{
+			m_blocks = std::move(p.m_blocks);
+			m_left = p.m_left;
+			p.m_blocks.clear();
+			p.m_left = 0;
+			return *this;
+		}
+
+		// copies the string into the pool and returns a pointer to the copy
+		char const* copy(string_view const str)
+		{
+			int const len = int(str.size());
+			if (len > m_left || m_blocks.empty())
+			{
+				// grow the blocks geometrically, to keep the number of blocks
+				// (and the cost of owns()) low
+				int const size = std::max(len, m_blocks.empty() ? int(min_block)
+					: std::min(int(max_block), m_blocks.back().size * 2));
+				m_blocks.emplace_back(size);
+				m_left = size;
+			}
+			block& b = m_blocks.back();
+			char* const ret = b.buf.get() + b.size - m_left;
+			std::memcpy(ret, str.data(), str.size());
+			m_left -= len;
+			return ret;
+		}
+
+		// returns true if p points into one of the blocks of this pool
+		bool owns(char const* const p) const
+		{
+			return std::any_of(m_blocks.begin(), m_blocks.end()
+				, [=](block const& b)
+				{ return p >= b.buf.get() && p < b.buf.get() + b.size; });
+		}
+
+		// the number of bytes allocated for blocks, including blocks shared
+		// with other pools
+		std::size_t memory_usage() const
+		{
+			std::size_t ret = m_blocks.capacity() * sizeof(block);
+			for (auto const& b : m_blocks) ret += std::size_t(b.size);
+			return ret;
+		}
+
+		void swap(string_pool& p)
+		{
+			using std::swap;
+			swap(m_blocks, p.m_blocks);
+			swap(m_left, p.m_left);
+		}
+
+	private:
+
+		enum { min_block = 1024, max_block = 1024 * 1024 };
+
+		struct block
+		{
+			explicit block(int const s)
+				: buf(new char[std::size_t(s)], std::default_delete<char[]>())
+				, size(s)
+			{}
+			std::shared_ptr<char> buf;
+			int size;
+		};
+
+		std::vector<block> m_blocks;
+
+		// the number of free bytes at the end of the last block. Blocks
+		// shared with other pools never have any free space, since both
+		// could otherwise append to it
+		int m_left = 0;
+	};
+}}
+
+#endif
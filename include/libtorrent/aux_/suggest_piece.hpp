@@ -38,6 +38,7 @@ POSSIBILITY OF SUCH DAMAGE.
 
 #include "libtorrent/bitfield.hpp"
 #include "libtorrent/sliding_average.hpp"
+#include "libtorrent/time.hpp"
 #include "libtorrent/aux_/vector.hpp"
 
 namespace libtorrent { namespace aux {
@@ -46,42 +47,65 @@ struct suggest_piece
 {
 	// pick at most n piece indices that are _not_ in p (which represents
 	// pieces the peer has already sent a suggest for) nor in bits (which are
-	// pieces the peer already has, and should not be suggested)
+	// pieces the peer already has, and should not be suggested). Only pieces
+	// read less than expiry ago are considered, since older ones are unlikely
+	// to still be in the read cache. Of those, the ones with the lowest
+	// current availability, as returned by avail(piece), are picked. Among
+	// equally available pieces, the most recently read ones are preferred.
+	// The picked pieces are appended to p, the highest priority one last.
+	template <typename Avail>
 	int get_pieces(std::vector<piece_index_t>& p
 		, typed_bitfield<piece_index_t> const& bits
-		, int n)
+		, int const n, time_point const now, time_duration const expiry
+		, Avail avail) const
 	{
-		if (m_priority_pieces.empty()) return 0;
+		if (m_priority_pieces.empty() || n <= 0) return 0;
 
-		int ret = 0;
-
-		// the highest priority pieces are at the end of m_priority_pieces.
-		// is we add any piece to the result (p), the farther back the better.
-		// the prioritization in p is the same, which means we have to first push
-		// back and then reverse the items we put there.
+		struct candidate
+		{
+			int availability;
+			// the position in m_priority_pieces. Higher is more recent
+			int recency;
+			piece_index_t piece;
+		};
+		std::vector<candidate> candidates;
+
+		// m_priority_pieces is ordered by the time the pieces were last read,
+		// the most recent at the end.
 		for (int i = int(m_priority_pieces.size()) - 1; i >= 0; --i)
 		{
-			piece_index_t const piece = m_priority_pieces[i];
+			entry const& e = m_priority_pieces[i];
+			if (now - e.last_read >= expiry) break;
+			piece_index_t const piece = e.piece;
 			if (bits.get_bit(piece)) continue;
-			if (std::any_of(p.begin(), p.end() - ret
+			if (std::any_of(p.begin(), p.end()
 				, [piece](piece_index_t pi) { return pi == piece; }))
 				continue;
 
-			p.push_back(piece);
-			++ret;
-			--n;
-			if (n == 0) break;
+			candidates.push_back({avail(piece), i, piece});
 		}
 
+		int const ret = std::min(n, int(candidates.size()));
+		std::partial_sort(candidates.begin(), candidates.begin() + ret
+			, candidates.end(), [](candidate const& lhs, candidate const& rhs)
+			{
+				if (lhs.availability != rhs.availability)
+					return lhs.availability < rhs.availability;
+				return lhs.recency > rhs.recency;
+			});
+
 		// this it to maintain a strict priority order of pieces. The farther
 		// back, the higher priority
-		std::reverse(p.end() - ret, p.end());
+		for (int i = ret - 1; i >= 0; --i)
+			p.push_back(candidates[std::size_t(i)].piece);
 
 		return ret;
 	}
 
+	// record that a block from this piece was read, at time now. If it's a
+	// low availability piece, it becomes a candidate for being suggested
 	void add_piece(piece_index_t const index, int const availability
-		, int const max_queue_size)
+		, int const max_queue_size, time_point const now)
 	{
 		// keep a running average of the availability of pieces, and filter
 		// anything above average.
@@ -90,8 +114,8 @@ struct suggest_piece
 
 		if (availability > mean) return;
 
-		auto const it = std::find(m_priority_pieces.begin()
-			, m_priority_pieces.end(), index);
+		auto const it = std::find_if(m_priority_pieces.begin()
+			, m_priority_pieces.end(), [index](entry const& e) { return e.piece == index; });
 
 		if (it != m_priority_pieces.end())
 		{
@@ -107,17 +131,24 @@ struct suggest_piece
 				, m_priority_pieces.begin() + to_remove);
 		}
 
-		m_priority_pieces.push_back(index);
+		m_priority_pieces.push_back({index, now});
 	}
 
 private:
 
+	struct entry
+	{
+		piece_index_t piece;
+
+		// the last time a block was read from this piece
+		time_point last_read;
+	};
+
 	// these are pieces that would be good candidates for suggesting
 	// to a peer. They represent low availability pieces that we recently
 	// read from disk (and are likely in our read cache).
-	// pieces closer to the end were inserted into the cache more recently and
-	// have higher priority
-	vector<piece_index_t, int> m_priority_pieces;
+	// pieces closer to the end were read more recently
+	vector<entry, int> m_priority_pieces;
 
 	sliding_average<30> m_availability;
 };
@@ -0,0 +1,102 @@
+/*
+
+Copyright (c) 2017, Arvid Norberg
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions
+are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in
+      the documentation and/or other materials provided with the distribution.
+    * Neither the name of the author nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+#ifndef TORRENT_SUPER_SEED_INDEX_HPP_INCLUDED
+#define TORRENT_SUPER_SEED_INDEX_HPP_INCLUDED
+
+#include "libtorrent/config.hpp"
+#include "libtorrent/units.hpp"
+#include "libtorrent/bitfield.hpp"
+#include "libtorrent/aux_/vector.hpp"
+
+#include <vector>
+
+namespace libtorrent { namespace aux {
+
+	// used in super seeding mode to pick the piece to announce to a peer. The
+	// pieces are kept in buckets by the number of connected peers that have
+	// them. Pieces that have been announced to a peer (but that it hasn't
+	// downloaded yet), are kept in a separate bucket, picked only when
+	// there's nothing else. Moving a piece between buckets is constant time,
+	// picking the rarest piece a peer doesn't have only visits the pieces of
+	// the rarer buckets that the peer has.
+	struct TORRENT_EXTRA_EXPORT super_seed_index
+	{
+		explicit super_seed_index(int num_pieces);
+
+		// a peer has, or no longer has, the piece
+		void inc_availability(piece_index_t p);
+		void dec_availability(piece_index_t p);
+
+		// we told one more peer, or one less, that we have the piece
+		void inc_given(piece_index_t p);
+		void dec_given(piece_index_t p);
+
+		int availability(piece_index_t const p) const { return m_availability[p]; }
+		int given(piece_index_t const p) const { return m_given[p]; }
+
+		// returns the piece with the lowest availability that's not in bits,
+		// preferring pieces that haven't been given to any peer. Ties are
+		// broken randomly. Returns -1 if bits has all pieces.
+		piece_index_t pick(typed_bitfield<piece_index_t> const& bits) const;
+
+	private:
+
+		// the bucket of pieces that have been given to a peer
+		static constexpr int given_bucket = -1;
+
+		int bucket_of(piece_index_t const p) const
+		{ return m_given[p] > 0 ? given_bucket : m_availability[p]; }
+
+		std::vector<piece_index_t>& bucket(int b);
+
+		// moves p from its bucket, which is from, to the bucket it belongs in
+		// now
+		void update(piece_index_t p, int from);
+
+		// the number of connected peers that have each piece
+		vector<int, piece_index_t> m_availability;
+
+		// the number of connected peers each piece has been announced to
+		vector<int, piece_index_t> m_given;
+
+		// the position of each piece in its bucket
+		vector<int, piece_index_t> m_position;
+
+		// the pieces with availability i are in m_buckets[i]
+		std::vector<std::vector<piece_index_t>> m_buckets;
+
+		std::vector<piece_index_t> m_given_pieces;
+	};
+}}
+
+#endif
@@ -0,0 +1,196 @@
+/*
+
+Copyright (c) 2017, Arvid Norberg
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions
+are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in
+      the documentation and/or other materials provided with the distribution.
+    * Neither the name of the author nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+#ifndef TORRENT_TIMER_WHEEL_HPP_INCLUDED
+#define TORRENT_TIMER_WHEEL_HPP_INCLUDED
+
+#include "libtorrent/config.hpp"
+#include "libtorrent/time.hpp"
+#include "libtorrent/error_code.hpp"
+#include "libtorrent/io_service.hpp"
+#include "libtorrent/deadline_timer.hpp"
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+namespace libtorrent { namespace aux {
+
+	// a hashed timer wheel. Timers are put in the slot of the tick they
+	// expire at (modulo the number of slots), which makes adding and
+	// removing a timer constant time and only the timers in one slot are
+	// looked at for every tick. Timers further away than one revolution of
+	// the wheel stay in their slot until the tick they expire at comes
+	// around. Timers never expire early, but may expire up to one
+	// resolution late.
+	struct TORRENT_EXTRA_EXPORT timer_wheel
+	{
+		using handler_t = std::function<void(error_code const&)>;
+
+		// 0 is never a valid timer id
+		using timer_id = std::uint64_t;
+
+		timer_wheel(time_point start, time_duration resolution, int slots);
+
+		// adds a timer expiring at ``expires``, which is expected to be in the
+		// future
+		timer_id add(time_point now, time_point expires, handler_t h);
+
+		// removes the timer and returns its handler. If the timer isn't
+		// pending (it has expired or never existed), an empty handler is
+		// returned
+		handler_t remove(timer_id id);
+
+		// moves the handlers of all timers that have expired at ``now`` into
+		// ``expired``
+		void advance(time_point now, std::vector<handler_t>& expired);
+
+		// removes all timers and returns their handlers
+		std::vector<handler_t> remove_all();
+
+		// the time the next tick is due. Only meaningful when there are
+		// timers pending
+		time_point next_tick() const;
+
+		bool empty() const { return m_timers.empty(); }
+		int size() const { return int(m_timers.size()); }
+
+	private:
+
+		// the number of whole ticks since m_start, rounded down or up
+		std::int64_t tick_floor(time_point t) const;
+		std::int64_t tick_ceil(time_point t) const;
+
+		void expire_slot(std::vector<timer_id>& slot, std::int64_t tick
+			, std::vector<handler_t>& expired);
+
+		struct entry
+		{
+			std::int64_t tick;
+			handler_t handler;
+		};
+
+		time_point const m_start;
+		time_duration const m_resolution;
+
+		// the last tick that has been processed
+		std::int64_t m_current = 0;
+
+		// the ids of the timers in each slot. Removed timers are only erased
+		// from m_timers, their ids are dropped from the slot lazily, the next
+		// time it's processed
+		std::vector<std::vector<timer_id>> m_slots;
+		std::unordered_map<timer_id, entry> m_timers;
+
+		timer_id m_next_id = 1;
+	};
+
+	// drives a timer_wheel from a single deadline_timer. This lets many
+	// objects (like torrents) have timers with a coarse resolution while only
+	// one system timer is armed, and only while there are timers pending.
+	// Handlers are called on the io_service's thread, with
+	// operation_aborted if the timer is cancelled, just like deadline_timer
+	struct TORRENT_EXTRA_EXPORT timer_service
+		: std::enable_shared_from_this<timer_service>
+	{
+		using handler_t = timer_wheel::handler_t;
+		using timer_id = timer_wheel::timer_id;
+
+		explicit timer_service(io_service& ios
+			, time_duration resolution = seconds(1), int slots = 1024);
+
+		timer_service(timer_service const&) = delete;
+		timer_service& operator=(timer_service const&) = delete;
+
+		// calls the handler once ``expires`` has passed. If it already has,
+		// the handler is posted right away and 0 is returned, since there's
+		// nothing left to cancel
+		timer_id async_wait(time_point expires, handler_t h);
+
+		// posts the handler of the timer with operation_aborted. Returns
+		// false if the timer isn't pending anymore
+		bool cancel(timer_id id);
+
+		// cancels all pending timers, and timers added from now on. Called
+		// when the session shuts down
+		void abort();
+
+		int num_timers() const { return m_wheel.size(); }
+
+	private:
+
+		void arm();
+		void on_tick(error_code const& ec);
+
+		io_service& m_ios;
+		deadline_timer m_timer;
+		timer_wheel m_wheel;
+		bool m_armed = false;
+		bool m_abort = false;
+	};
+
+	// a timer with the subset of the deadline_timer interface torrents use,
+	// backed by a timer_service. There can only be one outstanding
+	// async_wait() at a time
+	struct TORRENT_EXTRA_EXPORT wheel_timer
+	{
+		explicit wheel_timer(timer_service& s);
+		~wheel_timer();
+
+		wheel_timer(wheel_timer const&) = delete;
+		wheel_timer& operator=(wheel_timer const&) = delete;
+
+		// setting the expiry time cancels the outstanding wait, if any
+		void expires_at(time_point t);
+		void expires_at(time_point t, error_code&) { expires_at(t); }
+		time_point expires_at() const { return m_expires; }
+
+		void expires_from_now(time_duration d);
+		void expires_from_now(time_duration d, error_code&)
+		{ expires_from_now(d); }
+
+		void async_wait(timer_service::handler_t h);
+
+		void cancel();
+		void cancel(error_code&) { cancel(); }
+
+	private:
+
+		std::shared_ptr<timer_service> m_service;
+		time_point m_expires = min_time();
+		timer_service::timer_id m_id = 0;
+	};
+}}
+
+#endif
@@ -0,0 +1,107 @@
+/*
+
+Copyright (c) 2017, Arvid Norberg
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions
+are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in
+      the documentation and/or other materials provided with the distribution.
+    * Neither the name of the author nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+
+#ifndef TORRENT_AUX_TRACE_HPP_INCLUDED
+#define TORRENT_AUX_TRACE_HPP_INCLUDED
+
+#include "libtorrent/config.hpp"
+
+#include <atomic>
+#include <cstdint>
+#include <vector>
+
+namespace libtorrent { namespace aux {
+
+	// the kinds of events recorded by the trace facility. The values are
+	// part of the trace file format, new events must be added at the end
+	enum class trace_event : std::uint8_t
+	{
+		// a disk job started and finished executing. The arguments are the
+		// job action and the piece
+		disk_job_start,
+		disk_job_end,
+
+		// a block request was sent to a peer and a block was received from a
+		// peer, respectively. The arguments are the piece and the offset
+		// within the piece
+		peer_request,
+		peer_receive,
+
+		// the piece picker was invoked. The arguments are the number of
+		// blocks picked and the picker flags reporting which code paths were
+		// taken
+		piece_pick,
+
+		// a uTP packet was sent, resent or received. The arguments are the
+		// sequence number and the size of the packet
+		utp_send,
+		utp_resend,
+		utp_receive,
+
+		num_trace_events
+	};
+
+	struct trace_entry
+	{
+		// nanoseconds, measured by clock_type
+		std::int64_t time;
+
+		// a small integer identifying the thread that recorded the event.
+		// Threads are numbered in the order they first record an event
+		std::uint32_t thread;
+
+		trace_event event;
+		std::uint64_t arg0;
+		std::uint64_t arg1;
+	};
+
+	TORRENT_EXTRA_EXPORT extern std::atomic<bool> g_tracing;
+
+	TORRENT_EXTRA_EXPORT void record_trace(trace_event e
+		, std::uint64_t arg0, std::uint64_t arg1);
+
+	// records an event in the calling thread's trace buffer, if tracing is
+	// enabled
+	inline void trace(trace_event const e, std::uint64_t const arg0 = 0
+		, std::uint64_t const arg1 = 0)
+	{
+		if (!g_tracing.load(std::memory_order_relaxed)) return;
+		record_trace(e, arg0, arg1);
+	}
+
+	// returns the events in the trace buffers of all threads, ordered by
+	// time
+	TORRENT_EXTRA_EXPORT std::vector<trace_entry> collect_trace();
+}}
+
+#endif
@@ -0,0 +1,135 @@
+/*
+
+Copyright (c) 2017, Arvid Norberg
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions
+are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in
+      the documentation and/or other materials provided with the distribution.
+    * Neither the name of the author nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+#ifndef TORRENT_UPLOAD_SCHEDULER_HPP_INCLUDED
+#define TORRENT_UPLOAD_SCHEDULER_HPP_INCLUDED
+
+#include "libtorrent/config.hpp"
+#include "libtorrent/time.hpp"
+#include "libtorrent/units.hpp"
+#include "libtorrent/storage_defs.hpp"
+
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+namespace libtorrent {
+
+	class peer_connection;
+
+namespace aux {
+
+	// keeps track, on the network thread, of the pieces peers have recently
+	// been sent blocks from. Those pieces are likely to be in the disk
+	// cache (or to have a read in flight, which later reads of the same piece
+	// are queued behind), so serving them first turns requests from different
+	// peers for the same piece into cache hits. Reads of pieces that aren't
+	// warm ("cold" reads) are what costs disk seeks. The number of those in
+	// flight at a time is limited, and peers that only have cold requests
+	// left wait for one of them to complete, by which time some of their
+	// requests may have become warm.
+	struct TORRENT_EXTRA_EXPORT upload_scheduler
+	{
+		using piece_key = std::uint64_t;
+
+		// capacity is the max number of pieces remembered as warm
+		explicit upload_scheduler(int capacity = 1024);
+
+		static piece_key key(storage_index_t const st, piece_index_t const p)
+		{
+			return (std::uint64_t(static_cast<std::uint32_t>(st)) << 32)
+				| static_cast<std::uint32_t>(p);
+		}
+
+		// returns true if a block from this piece was read less than
+		// ``expiry`` ago, or if a read of it is in flight
+		bool is_warm(piece_key k, time_point now, time_duration expiry) const;
+
+		// the number of cold reads issued and not yet completed
+		int cold_reads() const { return m_cold_reads; }
+
+		// records that a block of the piece is being read. If cold is true,
+		// this is a cold read and counts against cold_reads() until the first
+		// read of the piece completes
+		void read_issued(piece_key k, time_point now, bool cold);
+
+		// called when a read of the piece completes. Returns true if that
+		// ended a cold read, in which case the waiting peers should be given
+		// a chance to issue reads again
+		bool read_complete(piece_key k);
+
+		// the peer has requests it can't serve until a cold read completes.
+		// Each peer should only be added once, until it's taken.
+		void wait(std::weak_ptr<peer_connection> p);
+		std::vector<std::weak_ptr<peer_connection>> take_waiting();
+
+		// cold reads that haven't completed after timeout are no longer
+		// counted as in flight. This protects against the limit leaking in
+		// case a completion is never reported. Called periodically.
+		// Returns true if any cold read was dropped, in which case the
+		// waiting peers should be given a chance to issue reads again
+		bool tick(time_point now, time_duration timeout);
+
+		int num_pieces() const { return int(m_pieces.size()); }
+
+	private:
+
+		struct piece_entry
+		{
+			// the last time a block from this piece was read
+			time_point last_read;
+
+			// if a cold read of this piece is in flight, this is when it was
+			// issued
+			time_point cold_read_issued;
+
+			// the position of this piece in m_lru
+			std::list<piece_key>::iterator lru;
+
+			bool cold_in_flight = false;
+		};
+
+		std::unordered_map<piece_key, piece_entry> m_pieces;
+
+		// the pieces in m_pieces, the most recently read at the back
+		std::list<piece_key> m_lru;
+
+		std::vector<std::weak_ptr<peer_connection>> m_waiting;
+
+		int const m_capacity;
+		int m_cold_reads = 0;
+	};
+}}
+
+#endif
@@ -0,0 +1,81 @@
+/*
+
+Copyright (c) 2017, Arvid Norberg
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions
+are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in
+      the documentation and/or other materials provided with the distribution.
+    * Neither the name of the author nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+#ifndef TORRENT_VERIFY_ORDER_HPP_INCLUDED
+#define TORRENT_VERIFY_ORDER_HPP_INCLUDED
+
+#include "libtorrent/config.hpp"
+#include "libtorrent/units.hpp"
+
+#include <deque>
+#include <functional>
+
+namespace libtorrent { namespace aux {
+
+	// decides the order in which a torrent in seed mode verifies its pieces
+	// in the background, to have verified the ones peers are likely to
+	// request before they do. Pieces following the ones peers requested
+	// recently come first, since peers tend to request pieces near each
+	// other. Otherwise, of the next few unverified pieces, the one the
+	// most peers are missing is picked.
+	struct TORRENT_EXTRA_EXPORT verify_order
+	{
+		// the number of unverified pieces looked at to pick the next one,
+		// when there are no hints
+		static constexpr int window = 64;
+
+		// the most recently requested pieces are remembered
+		static constexpr int max_hints = 32;
+
+		// a peer requested ``piece``
+		void requested(piece_index_t piece, int num_pieces);
+
+		// returns the next piece to verify, or -1 if there are none left.
+		// ``candidate`` tells whether a piece still needs verifying (and
+		// isn't being verified), ``score`` how likely it is to be requested
+		piece_index_t pick(int num_pieces
+			, std::function<bool(piece_index_t)> const& candidate
+			, std::function<int(piece_index_t)> const& score);
+
+		void clear();
+
+	private:
+
+		// pieces to verify first, the most recent hint at the front
+		std::deque<piece_index_t> m_hints;
+
+		// where to look for the next window of pieces
+		piece_index_t m_cursor{0};
+	};
+}}
+
+#endif
@@ -35,6 +35,7 @@ POSSIBILITY OF SUCH DAMAGE.
 
 #include <vector>
 #include <string>
+#include <utility>
 #include <cstdint>
 #include <cstddef>
 
@@ -364,6 +365,8 @@ private:
 	bdecode_node(detail::bdecode_token const* tokens, char const* buf
 		, int len, int idx);
 
+	void build_dict_index() const;
+
 	// if this is the root node, that owns all the tokens, they live in this
 	// vector. If this is a sub-node, this field is not used, instead the
 	// m_root_tokens pointer points to the root node's token.
@@ -390,6 +393,14 @@ private:
 	// the number of elements in this list or dict (computed on the first
 	// call to dict_size() or list_size())
 	mutable int m_size;
+
+	// for dictionaries that are looked up more than once, this is an index
+	// of their keys (sorted), each with the token index of its value. It
+	// makes repeated dict_find() calls O(log n). It's built by the second
+	// lookup, and only for dictionaries with enough entries for it to pay
+	// off
+	mutable std::vector<std::pair<string_view, int>> m_dict_index;
+	mutable bool m_dict_looked_up;
 };
 
 // print the bencoded structure in a human-readable format to a string
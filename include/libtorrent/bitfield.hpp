@@ -158,6 +158,11 @@ namespace libtorrent {
 		int find_first_set() const;
 		int find_last_clear() const;
 
+		// returns the index of the first bit that's set, at or after
+		// ``start``. Returns -1 if there is none. Runs of zero words are
+		// skipped, which makes walking the set bits of sparse bitfields cheap
+		int find_next_set(int start) const;
+
 		struct const_iterator
 		{
 		friend struct bitfield;
@@ -274,6 +279,10 @@ namespace libtorrent {
 		{ this->bitfield::set_bit(static_cast<int>(index)); }
 
 		IndexType end_index() const { return IndexType(this->size()); }
+
+		// returns IndexType(-1) if there are no more bits set
+		IndexType find_next_set(IndexType const start) const
+		{ return IndexType(this->bitfield::find_next_set(static_cast<int>(start))); }
 	};
 
 }
@@ -37,11 +37,13 @@ POSSIBILITY OF SUCH DAMAGE.
 #include <list>
 #include <vector>
 #include <unordered_set>
+#include <unordered_map>
 
 #include "libtorrent/time.hpp"
 #include "libtorrent/error_code.hpp"
 #include "libtorrent/io_service_fwd.hpp"
 #include "libtorrent/hasher.hpp"
+#include "libtorrent/sha1_hash.hpp"
 #include "libtorrent/sliding_average.hpp"
 #include "libtorrent/tailqueue.hpp"
 #include "libtorrent/linked_list.hpp"
@@ -49,6 +51,7 @@ POSSIBILITY OF SUCH DAMAGE.
 #include "libtorrent/aux_/storage_utils.hpp" // for iovec_t
 #include "libtorrent/disk_io_job.hpp"
 #include "libtorrent/aux_/unique_ptr.hpp"
+#include "libtorrent/aux_/frequency_sketch.hpp"
 #if TORRENT_USE_ASSERTS
 #include "libtorrent/aux_/vector.hpp"
 #endif
@@ -63,6 +66,7 @@ namespace aux {
 
 		struct session_settings;
 		struct block_cache_reference;
+		struct l2_cache;
 	}
 #if TORRENT_USE_ASSERTS
 	class file_storage;
@@ -227,6 +231,38 @@ namespace aux {
 		// of elements in the blocks array)
 		std::uint64_t blocks_in_piece:14;
 
+		// the reasons blocks of a piece are flushed before they've been
+		// hashed, which means they'll have to be read back from disk in
+		// order to hash the piece.
+		enum readback_reason_t
+		{
+			// no unhashed blocks have been flushed
+			readback_none,
+
+			// the write cache ran out of space
+			readback_cache_pressure,
+
+			// the blocks stayed in the write cache longer than cache_expiry
+			readback_expired,
+
+			// the cache was flushed explicitly, e.g. when the torrent was
+			// paused or its storage moved
+			readback_flush
+		};
+
+		// this is the reason need_readback was first set, one of the
+		// readback_reason_t enums
+		std::uint64_t readback_reason:2;
+
+		// set once the piece has been requested while in one of the ARC ghost
+		// lists, i.e. after its blocks were evicted. When its blocks are
+		// evicted again, they're spilled to the L2 cache (if enabled)
+		std::uint64_t ghost_hit:1;
+
+		// set while this piece is the entry for its piece hash in the
+		// content index of the block cache (content_addressed_cache)
+		std::uint64_t content_indexed:1;
+
 		// ---- 64 bit boundary ----
 
 		// while we have an outstanding async hash operation
@@ -384,6 +420,31 @@ namespace aux {
 		// hit the block we needed)
 		void cache_hit(cached_piece_entry* p, void* requester, bool volatile_read);
 
+		// the W-TinyLFU counterpart of cache_hit()
+		void tinylfu_cache_hit(cached_piece_entry* p, void* requester);
+
+		// under W-TinyLFU, admits pieces from the window (read_lru1) into the
+		// main cache (read_lru2) that are more popular than its eviction
+		// candidate. Returns true if blocks should be evicted from the window
+		// first
+		bool tinylfu_admit();
+
+		// hands the buffer of the (clean) block over to the L2 cache. Returns
+		// false if it's not accepted, in which case the buffer is still ours
+		bool spill_block(cached_piece_entry const* pe, int block, char* buf);
+
+		// the key identifying this piece in m_sketch
+		static std::uint64_t sketch_key(cached_piece_entry const* p);
+
+		// add the (clean, read) piece to the content index, unless another
+		// piece with the same hash already is in it
+		void index_content(cached_piece_entry* pe);
+		void unindex_content(cached_piece_entry* pe);
+
+		// try to serve the read job from a piece of another torrent with the
+		// same piece hash. Same return values as try_read()
+		int try_read_shared(disk_io_job* j, buffer_allocator_interface& allocator);
+
 		// free block from piece entry
 		void free_block(cached_piece_entry* pe, int block);
 
@@ -442,6 +503,10 @@ namespace aux {
 		// that couldn't be
 		int try_evict_blocks(int num, cached_piece_entry* ignore = nullptr);
 
+		// blocks of pieces with ghost hits are handed over to this cache when
+		// they're evicted, rather than freed
+		void set_l2_cache(aux::l2_cache* l2) { m_l2_cache = l2; }
+
 		// try to evict a single volatile piece, if there is one.
 		void try_evict_one_volatile();
 
@@ -497,6 +562,24 @@ namespace aux {
 		};
 		int m_last_cache_op;
 
+		// the eviction policy in use, one of
+		// settings_pack::cache_eviction_policy_t
+		int m_eviction_policy;
+
+		// the access frequency of pieces, used by the W-TinyLFU
+		// eviction policy
+		aux::frequency_sketch m_sketch;
+
+		// maps piece hashes to a cached piece with that content, used to
+		// share read cache blocks between torrents when
+		// settings_pack::content_addressed_cache is enabled
+		bool m_content_addressed = false;
+		std::unordered_map<sha1_hash, cached_piece_entry*> m_content_index;
+
+		// the number of blocks read from pieces of other torrents, through
+		// the content index
+		std::int64_t m_shared_read_blocks = 0;
+
 		// the number of pieces to keep in the ARC ghost lists
 		// this is determined by being a fraction of the cache size
 		int m_ghost_size;
@@ -526,6 +609,9 @@ namespace aux {
 		// the number of blocks with a refcount > 0, i.e.
 		// they may not be evicted
 		int m_pinned_blocks;
+
+		// the second tier of the cache, if any. See set_l2_cache()
+		aux::l2_cache* m_l2_cache = nullptr;
 	};
 
 }
@@ -172,6 +172,7 @@ namespace libtorrent {
 		void on_receive(error_code const& error
 			, std::size_t bytes_transferred) override;
 		void on_receive_impl(std::size_t bytes_transferred);
+		int on_receive_batch(int bytes) override;
 
 #if !defined(TORRENT_DISABLE_ENCRYPTION) && !defined(TORRENT_DISABLE_EXTENSIONS)
 		// next_barrier, buffers-to-prepend
@@ -328,10 +329,11 @@ namespace libtorrent {
 			if (!m_enc_handler.is_send_plaintext())
 			{
 				// if we're encrypting this buffer, we need to make a copy
-				// since we'll mutate it
-				std::unique_ptr<char[]> buf(new char[size]);
-				std::copy(buffer.get(), buffer.get() + size, buf.get());
-				append_send_buffer(std::move(buf), size);
+				// since we'll mutate it. Copy it straight into the send
+				// buffer (using the session's buffer pool) rather than
+				// allocating a new buffer, and release our reference to the
+				// original right away
+				copy_send_buffer(buffer.get(), size);
 			}
 			else
 #endif
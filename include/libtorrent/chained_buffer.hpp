@@ -39,27 +39,19 @@ POSSIBILITY OF SUCH DAMAGE.
 #include "libtorrent/debug.hpp"
 #include "libtorrent/buffer.hpp"
 
-#include <deque>
 #include <vector>
+#include <memory>
 
 #include "libtorrent/aux_/disable_warnings_push.hpp"
 #include <boost/asio/buffer.hpp>
 #include "libtorrent/aux_/disable_warnings_pop.hpp"
 
-#ifdef _MSC_VER
-// visual studio requires the value in a deque to be copyable. C++11
-// has looser requirements depending on which functions are actually used.
-#define TORRENT_CPP98_DEQUE 1
-#else
-#define TORRENT_CPP98_DEQUE 0
-#endif
-
 namespace libtorrent {
 
 	// TODO: 2 this type should probably be renamed to send_buffer
 	struct TORRENT_EXTRA_EXPORT chained_buffer : private single_threaded
 	{
-		chained_buffer(): m_bytes(0), m_capacity(0)
+		chained_buffer(): m_first(0), m_num(0), m_ring_size(0), m_bytes(0), m_capacity(0)
 		{
 			thread_started();
 #if TORRENT_USE_ASSERTS
@@ -76,42 +68,13 @@ namespace libtorrent {
 		struct buffer_t
 		{
 			buffer_t() {}
-#if TORRENT_CPP98_DEQUE
-			buffer_t(buffer_t&& rhs) noexcept
-			{
-				destruct_holder = rhs.destruct_holder;
-				move_holder = rhs.move_holder;
-				buf = rhs.buf;
-				size = rhs.size;
-				used_size = rhs.used_size;
-				move_holder(&holder, &rhs.holder);
-			}
-			buffer_t& operator=(buffer_t&& rhs) noexcept
-			{
-				destruct_holder(&holder);
-				destruct_holder = rhs.destruct_holder;
-				move_holder = rhs.move_holder;
-				buf = rhs.buf;
-				size = rhs.size;
-				used_size = rhs.used_size;
-				move_holder(&holder, &rhs.holder);
-				return *this;
-			}
-			buffer_t(buffer_t const& rhs) noexcept
-				: buffer_t(std::move(const_cast<buffer_t&>(rhs))) {}
-			buffer_t& operator=(buffer_t const& rhs) noexcept
-			{ return this->operator=(std::move(const_cast<buffer_t&>(rhs))); }
-#else
 			buffer_t(buffer_t&&) = delete;
 			buffer_t& operator=(buffer_t&&) = delete;
 			buffer_t(buffer_t const&) = delete;
 			buffer_t& operator=(buffer_t const&) = delete;
-#endif
 
 			destruct_holder_fun destruct_holder;
-#if TORRENT_CPP98_DEQUE
 			move_construct_holder_fun move_holder;
-#endif
 			aux::aligned_storage<24>::type holder;
 			char* buf; // the first byte of the buffer
 			int size; // the total size of the buffer
@@ -131,8 +94,9 @@ namespace libtorrent {
 		{
 			TORRENT_ASSERT(is_single_thread());
 			TORRENT_ASSERT(s >= used_size);
-			m_vec.emplace_back();
-			buffer_t& b = m_vec.back();
+			if (m_num == m_ring_size) grow_ring();
+			buffer_t& b = at(m_num);
+			++m_num;
 			init_buffer_entry<Holder>(b, buffer, s, used_size);
 		}
 
@@ -141,8 +105,10 @@ namespace libtorrent {
 		{
 			TORRENT_ASSERT(is_single_thread());
 			TORRENT_ASSERT(s >= used_size);
-			m_vec.emplace_front();
-			buffer_t& b = m_vec.front();
+			if (m_num == m_ring_size) grow_ring();
+			m_first = (m_first + m_ring_size - 1) & (m_ring_size - 1);
+			++m_num;
+			buffer_t& b = at(0);
 			init_buffer_entry<Holder>(b, buffer, s, used_size);
 		}
 
@@ -187,10 +153,8 @@ namespace libtorrent {
 			b.destruct_holder = [](void* holder)
 			{ reinterpret_cast<Holder*>(holder)->~Holder(); };
 
-#if TORRENT_CPP98_DEQUE
 			b.move_holder = [](void* dst, void* src)
 			{ new (dst) Holder(std::move(*reinterpret_cast<Holder*>(src))); };
-#endif
 
 #ifdef _MSC_VER
 #pragma warning(pop)
@@ -206,9 +170,32 @@ namespace libtorrent {
 		template <typename Buffer>
 		void build_vec(int bytes, std::vector<Buffer>& vec);
 
-		// this is the list of all the buffers we want to
-		// send
-		std::deque<buffer_t> m_vec;
+		// returns the i:th buffer in the chain, counting from the front
+		buffer_t& at(int const i)
+		{
+			TORRENT_ASSERT(i >= 0);
+			TORRENT_ASSERT(i < m_ring_size);
+			return m_ring[(m_first + i) & (m_ring_size - 1)];
+		}
+
+		// doubles the size of the ring, moving all buffers over to the new
+		// slab
+		void grow_ring();
+
+		// this is the list of all the buffers we want to send. It's a ring
+		// buffer whose size is always a power of two. Slots are reused as
+		// buffers are popped from the front and appended to the back, so
+		// in steady state, sending does not allocate any bookkeeping memory
+		std::unique_ptr<buffer_t[]> m_ring;
+
+		// the index into m_ring of the first buffer
+		int m_first;
+
+		// the number of buffers in the ring
+		int m_num;
+
+		// the number of slots in m_ring
+		int m_ring_size;
 
 		// this is the number of bytes in the send buf.
 		// this will always be equal to the sum of the
@@ -220,7 +207,8 @@ namespace libtorrent {
 		int m_capacity;
 
 		// this is the vector of buffers used when
-		// invoking the async write call
+		// invoking the async write call. It's kept around to reuse its
+		// storage across calls to build_iovec()
 		std::vector<boost::asio::const_buffer> m_tmp_vec;
 
 #if TORRENT_USE_ASSERTS
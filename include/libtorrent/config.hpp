@@ -208,6 +208,16 @@ POSSIBILITY OF SUCH DAMAGE.
 #define TORRENT_USE_IFCONF 1
 #define TORRENT_HAS_SALEN 0
 #define TORRENT_USE_FDATASYNC 1
+#define TORRENT_USE_DIRECT_IO 1
+#define TORRENT_USE_MMSG 1
+
+// io_uring is only available in linux 5.1 and later. Whether it actually
+// works is determined at runtime.
+#if !defined TORRENT_USE_IO_URING && defined __has_include
+#if __has_include(<linux/io_uring.h>)
+#define TORRENT_USE_IO_URING 1
+#endif
+#endif
 
 // ===== ANDROID ===== (almost linux, sort of)
 #if defined __ANDROID__
@@ -475,6 +485,18 @@ POSSIBILITY OF SUCH DAMAGE.
 #define TORRENT_USE_FDATASYNC 0
 #endif
 
+#ifndef TORRENT_USE_IO_URING
+#define TORRENT_USE_IO_URING 0
+#endif
+
+#ifndef TORRENT_USE_DIRECT_IO
+#define TORRENT_USE_DIRECT_IO 0
+#endif
+
+#ifndef TORRENT_USE_MMSG
+#define TORRENT_USE_MMSG 0
+#endif
+
 #ifndef TORRENT_USE_UNC_PATHS
 #define TORRENT_USE_UNC_PATHS 0
 #endif
@@ -634,4 +656,35 @@ POSSIBILITY OF SUCH DAMAGE.
 #endif
 #endif // TORRENT_HAS_ARM_CRC32
 
+// the SHA-NI kernel is compiled with a target attribute (on GCC and clang),
+// and only used if the CPU supports it (see aux::sha_ni_support), so it
+// doesn't need to be enabled on the command line
+#if TORRENT_HAS_SSE && ((defined _MSC_VER && _MSC_VER >= 1900) \
+	|| (defined __clang__ && __clang_major__ >= 4) \
+	|| (defined __GNUC__ && !defined __clang__ && __GNUC__ >= 5))
+#	define TORRENT_HAS_SHA_NI 1
+#else
+#	define TORRENT_HAS_SHA_NI 0
+#endif // TORRENT_HAS_SHA_NI
+
+// the AVX2 bitfield kernels are built the same way as the SHA-NI one, and
+// only used if aux::avx2_support is true
+#if TORRENT_HAS_SSE && ((defined _MSC_VER && _MSC_VER >= 1900) \
+	|| (defined __clang__ && __clang_major__ >= 4) \
+	|| (defined __GNUC__ && !defined __clang__ && __GNUC__ >= 5))
+#	define TORRENT_HAS_AVX2 1
+#else
+#	define TORRENT_HAS_AVX2 0
+#endif // TORRENT_HAS_AVX2
+
+// like the CRC32 instructions, the ARMv8 SHA1 instructions need to be enabled
+// at compile time (e.g. -march=armv8-a+crypto), and are only used if the CPU
+// supports them (see aux::arm_sha1_support)
+#if TORRENT_HAS_ARM && defined __aarch64__ && !defined __AARCH64EB__ \
+	&& (defined __ARM_FEATURE_CRYPTO || defined __ARM_FEATURE_SHA2)
+#	define TORRENT_HAS_ARM_SHA1 1
+#else
+#	define TORRENT_HAS_ARM_SHA1 0
+#endif // TORRENT_HAS_ARM_SHA1
+
 #endif // TORRENT_CONFIG_HPP_INCLUDED
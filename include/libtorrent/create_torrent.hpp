@@ -91,6 +91,7 @@ POSSIBILITY OF SUCH DAMAGE.
 namespace libtorrent {
 
 	class torrent_info;
+	struct settings_pack;
 
 	// This class holds state for creating a torrent. After having added
 	// all information to it, call create_torrent::generate() to generate
@@ -402,6 +403,17 @@ namespace detail {
 	//
 	// The overloads that don't take an ``error_code&`` may throw an exception in case of a
 	// file error, the other overloads sets the error code to reflect the error, if any.
+	//
+	// Pieces are hashed on all CPU cores, with enough pieces outstanding to keep
+	// the disk busy. The ``settings`` overload applies ``settings`` to the disk
+	// I/O subsystem used to read the files, on top of these defaults. For
+	// instance, settings_pack::hash_threads controls the number of hashing
+	// threads, and setting settings_pack::disk_io_write_mode to
+	// ``direct_io`` reads the files bypassing the OS page cache, to avoid
+	// evicting everything else from it when hashing very large data sets.
+	TORRENT_EXPORT void set_piece_hashes(create_torrent& t, std::string const& p
+		, settings_pack const& settings
+		, std::function<void(piece_index_t)> const& f, error_code& ec);
 	TORRENT_EXPORT void set_piece_hashes(create_torrent& t, std::string const& p
 		, std::function<void(piece_index_t)> const& f, error_code& ec);
 	inline void set_piece_hashes(create_torrent& t, std::string const& p, error_code& ec)
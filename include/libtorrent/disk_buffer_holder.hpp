@@ -65,6 +65,10 @@ namespace libtorrent {
 		// internal
 		disk_buffer_holder(buffer_allocator_interface& alloc, char* buf) noexcept;
 
+		// construct a holder that doesn't hold a buffer. A buffer can be
+		// moved into it
+		disk_buffer_holder() noexcept;
+
 		disk_buffer_holder& operator=(disk_buffer_holder&&) noexcept;
 		disk_buffer_holder(disk_buffer_holder&&) noexcept;
 
@@ -97,7 +101,9 @@ namespace libtorrent {
 		// swap pointers of two disk buffer holders.
 		void swap(disk_buffer_holder& h) noexcept
 		{
-			TORRENT_ASSERT(h.m_allocator == m_allocator);
+			TORRENT_ASSERT(h.m_allocator == m_allocator
+				|| h.m_allocator == nullptr || m_allocator == nullptr);
+			std::swap(h.m_allocator, m_allocator);
 			std::swap(h.m_buf, m_buf);
 			std::swap(h.m_ref, m_ref);
 		}
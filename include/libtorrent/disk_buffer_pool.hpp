@@ -51,10 +51,12 @@ POSSIBILITY OF SUCH DAMAGE.
 #include <mutex>
 #include <functional>
 #include <memory>
+#include <atomic>
 
 #include "libtorrent/io_service_fwd.hpp"
 #include "libtorrent/span.hpp"
 #include "libtorrent/aux_/storage_utils.hpp" // for iovec_t
+#include "libtorrent/aux_/disk_arena.hpp"
 
 namespace libtorrent {
 
@@ -89,11 +91,7 @@ namespace libtorrent {
 
 		void release_memory();
 
-		int in_use() const
-		{
-			std::unique_lock<std::mutex> l(m_pool_mutex);
-			return m_in_use;
-		}
+		int in_use() const { return m_in_use; }
 		int num_to_evict(int num_needed = 0);
 
 		void set_settings(aux::session_settings const& sett);
@@ -107,8 +105,10 @@ namespace libtorrent {
 		// protocol defines the block size to 16 KiB.
 		const int m_block_size;
 
-		// number of disk buffers currently allocated
-		int m_in_use;
+		// number of disk buffers currently allocated. This is atomic since
+		// blocks from the arena are allocated and freed without holding
+		// m_pool_mutex
+		std::atomic<int> m_in_use;
 
 		// cache size limit
 		int m_max_use;
@@ -128,7 +128,7 @@ namespace libtorrent {
 		std::function<void()> m_trigger_cache_trim;
 
 		// set to true to throttle more allocations
-		bool m_exceeded_max_size;
+		std::atomic<bool> m_exceeded_max_size;
 
 		// this is the main thread io_service. Callbacks are
 		// posted on this in order to have them execute in
@@ -140,6 +140,27 @@ namespace libtorrent {
 		void check_buffer_level(std::unique_lock<std::mutex>& l);
 		void remove_buffer_in_use(char* buf);
 
+		// returns the number of buffers in use at which the cache is asked to
+		// trim itself
+		int trim_threshold() const
+		{ return m_low_watermark + (m_max_use - m_low_watermark) / 2; }
+
+#ifndef TORRENT_DISABLE_POOL_ALLOCATOR
+		// with the arena enabled, these allocate and free blocks from it
+		// without taking m_pool_mutex, unless the buffer level needs
+		// attention. allocate_arena_buffer() returns nullptr if the arena
+		// isn't in use or is exhausted. free_arena_buffer() returns false if
+		// buf does not belong to the arena
+		char* allocate_arena_buffer();
+		// updates the number of buffers in use after allocating ``num``
+		// blocks from the arena, and triggers a cache trim if necessary
+		void arena_blocks_allocated(int num);
+		bool free_arena_buffer(char* buf);
+
+		// switches between the allocators once no buffers are in use
+		void maybe_switch_allocator(std::unique_lock<std::mutex>& l);
+#endif
+
 		mutable std::mutex m_pool_mutex;
 
 		int m_cache_buffer_chunk_size;
@@ -164,6 +185,18 @@ namespace libtorrent {
 		// memory pool for read and write operations
 		// and disk cache
 		boost::pool<page_aligned_allocator> m_pool;
+
+		// when ``disk_cache_arena`` is enabled, the whole cache is reserved
+		// up-front in this arena. Once reserved, it's kept until the pool is
+		// destructed, even if the setting is turned off again. Blocks
+		// allocated beyond its size come from page_aligned_allocator. Like
+		// the pool allocator, switching the arena on or off only takes effect
+		// when no buffers are in use. m_trim_threshold mirrors
+		// trim_threshold(), for the allocations that don't hold the mutex
+		aux::disk_arena m_arena;
+		std::atomic<bool> m_using_arena;
+		bool m_want_arena;
+		std::atomic<int> m_trim_threshold;
 #endif
 
 		// this is specifically exempt from release_asserts
@@ -129,6 +129,12 @@ namespace libtorrent {
 
 			// don't keep the read block in cache
 			volatile_read = 0x10,
+
+			// for async_check_files(), accept the resume data without
+			// touching the files on disk. The check has to be run again
+			// without this flag later, to verify the files and initialize the
+			// storage
+			trust_resume_data = 0x80
 		};
 
 		virtual storage_holder new_torrent(storage_constructor_type sc
@@ -143,8 +149,28 @@ namespace libtorrent {
 			, char const* buf, std::shared_ptr<disk_observer> o
 			, std::function<void(storage_error const&)> handler
 			, std::uint8_t flags = 0) = 0;
+
+		// allocates a buffer from the disk cache, that block data can be
+		// received into and then passed to async_write() without being copied.
+		// ``exceeded`` is set if the cache is over its limit, in which case
+		// ``o`` is notified once there's room again. Returns an empty holder
+		// if the allocation failed
+		virtual disk_buffer_holder allocate_disk_buffer(bool& exceeded
+			, std::shared_ptr<disk_observer> o, char const* category) = 0;
+		virtual void async_write(storage_index_t storage, peer_request const& r
+			, disk_buffer_holder buffer
+			, std::function<void(storage_error const&)> handler
+			, std::uint8_t flags = 0) = 0;
 		virtual void async_hash(storage_index_t storage, piece_index_t piece, std::uint8_t flags
 			, std::function<void(piece_index_t, sha1_hash const&, storage_error const&)> handler, void* requester) = 0;
+
+		// computes the SHA-1 digest of every block in the piece, each with
+		// ``salt`` appended to it. Blocks still in the cache are hashed from
+		// there, the rest are read from disk without being inserted into the
+		// cache. The handler is passed one digest per block
+		virtual void async_hash_blocks(storage_index_t storage, piece_index_t piece
+			, std::uint32_t salt
+			, std::function<void(piece_index_t, std::vector<sha1_hash>, storage_error const&)> handler) = 0;
 		virtual void async_move_storage(storage_index_t storage, std::string p, std::uint8_t flags
 			, std::function<void(status_t, std::string const&, storage_error const&)> handler) = 0;
 		virtual void async_release_files(storage_index_t storage
@@ -152,7 +178,8 @@ namespace libtorrent {
 		virtual void async_check_files(storage_index_t storage
 			, add_torrent_params const* resume_data
 			, aux::vector<std::string, file_index_t>& links
-			, std::function<void(status_t, storage_error const&)> handler) = 0;
+			, std::function<void(status_t, storage_error const&)> handler
+			, std::uint8_t flags = 0) = 0;
 		virtual void async_flush_piece(storage_index_t storage, piece_index_t piece
 			, std::function<void()> handler = std::function<void()>()) = 0;
 		virtual void async_stop_torrent(storage_index_t storage
@@ -41,6 +41,7 @@ POSSIBILITY OF SUCH DAMAGE.
 #include "libtorrent/disk_interface.hpp"
 #include "libtorrent/aux_/vector.hpp"
 #include "libtorrent/units.hpp"
+#include "libtorrent/time.hpp"
 
 #include "libtorrent/aux_/disable_warnings_push.hpp"
 #include <boost/variant/variant.hpp>
@@ -95,6 +96,7 @@ namespace libtorrent {
 			, trim_cache
 			, file_priority
 			, clear_piece
+			, hash_blocks
 			, resolve_links
 			, num_job_ids
 		};
@@ -114,7 +116,12 @@ namespace libtorrent {
 
 			// this job is currently being performed, or it's hanging
 			// on a cache piece that may be flushed soon
-			in_progress = 0x20
+			in_progress = 0x20,
+
+			// this read job was queued without first being looked up in the
+			// cache (because the cache was busy). The disk thread has to do
+			// that before executing it
+			unprepared_read = 0x40
 		};
 
 		// for write jobs, returns true if its block
@@ -131,6 +138,7 @@ namespace libtorrent {
 			, std::string
 			, add_torrent_params const*
 			, aux::vector<std::uint8_t, file_index_t>
+			, std::vector<sha1_hash>
 			, int> argument;
 
 		// the disk storage this job applies to (if applicable)
@@ -146,6 +154,7 @@ namespace libtorrent {
 		using check_handler = std::function<void(status_t, storage_error const&)>;
 		using rename_handler = std::function<void(std::string const&, file_index_t, storage_error const&)>;
 		using clear_piece_handler = std::function<void(piece_index_t)>;
+		using block_hash_handler = std::function<void(piece_index_t, std::vector<sha1_hash>, storage_error const&)>;
 
 		boost::variant<read_handler
 			, write_handler
@@ -154,7 +163,8 @@ namespace libtorrent {
 			, release_handler
 			, check_handler
 			, rename_handler
-			, clear_piece_handler> callback;
+			, clear_piece_handler
+			, block_hash_handler> callback;
 
 		// the error code from the file operation
 		// on error, this also contains the path of the
@@ -167,6 +177,10 @@ namespace libtorrent {
 			// result for hash jobs
 			char piece_hash[20];
 
+			// for hash_blocks jobs, the value appended to every block before
+			// hashing it
+			std::uint32_t salt;
+
 			// this is used for check_fastresume to pass in a vector of hard-links
 			// to create. Each element corresponds to a file in the file_storage.
 			// The string is the absolute path of the identical file to create
@@ -204,6 +218,15 @@ namespace libtorrent {
 		// flags controlling this job
 		std::uint8_t flags = 0;
 
+		// the index of the device (volume) the files of the job's storage are
+		// on. Set when the job is queued, and used to pick the next job to run
+		// (see aux::device_job_queue)
+		std::uint8_t device = 0;
+
+		// the time this job was allocated. Used to measure how long it sits in
+		// the queue before being executed
+		time_point issued;
+
 #if TORRENT_USE_ASSERTS
 		bool in_use = false;
 
@@ -46,12 +46,19 @@ POSSIBILITY OF SUCH DAMAGE.
 #include "libtorrent/disk_interface.hpp"
 #include "libtorrent/performance_counters.hpp"
 #include "libtorrent/aux_/session_settings.hpp"
+#include "libtorrent/aux_/read_ahead.hpp"
+#include "libtorrent/aux_/device_job_queue.hpp"
+#include "libtorrent/aux_/l2_cache.hpp"
+#include "libtorrent/aux_/deletion_queue.hpp"
 
 #include <mutex>
 #include <condition_variable>
 #include <atomic>
 #include <memory>
 #include <vector>
+#include <functional>
+#include <string>
+#include <cstdio>
 
 namespace libtorrent {
 
@@ -63,6 +70,7 @@ namespace libtorrent {
 namespace aux {
 
 		struct block_cache_reference;
+		struct io_uring_batch;
 	}
 
 	struct cached_piece_info
@@ -91,7 +99,17 @@ namespace aux {
 		// specifies if this piece is part of the read cache or the write cache.
 		kind_t kind;
 
+		// set to true once blocks of this piece have been flushed to disk
+		// before they were hashed, which means they will have to be read
+		// back in order to hash the piece.
 		bool need_readback;
+
+		enum readback_reason_t { readback_none = 0, readback_cache_pressure = 1
+			, readback_expired = 2, readback_flush = 3 };
+
+		// if need_readback is set, this is the reason the unhashed blocks
+		// were flushed
+		readback_reason_t readback_reason;
 	};
 
 	typedef tailqueue<disk_io_job> jobqueue_t;
@@ -260,7 +278,10 @@ namespace aux {
 		// ARC cache stats. All of these counters are in number of pieces
 		// not blocks. A piece does not necessarily correspond to a certain
 		// number of blocks. The pieces in the ghost list never have any
-		// blocks in them
+		// blocks in them. With the W-TinyLFU eviction policy, the mru list is
+		// the window, the mfu list is the main cache and the ghost lists are
+		// empty. The cache hit rate for either policy is
+		// ``num_blocks_cache_hits`` relative to ``num_blocks_read``.
 		int arc_mru_size;
 		int arc_mru_ghost_size;
 		int arc_mfu_size;
@@ -291,6 +312,11 @@ namespace aux {
 
 		void set_settings(settings_pack const* sett);
 
+		// sets the function to call at the start of every disk and hash
+		// thread. Must be called before any threads are started
+		void set_thread_init(std::function<void(char const*)> f)
+		{ m_thread_init = std::move(f); }
+
 		void abort(bool wait);
 
 		storage_holder new_torrent(storage_constructor_type sc
@@ -304,8 +330,17 @@ namespace aux {
 			, char const* buf, std::shared_ptr<disk_observer> o
 			, std::function<void(storage_error const&)> handler
 			, std::uint8_t flags = 0) override;
+		disk_buffer_holder allocate_disk_buffer(bool& exceeded
+			, std::shared_ptr<disk_observer> o, char const* category) override;
+		void async_write(storage_index_t storage, peer_request const& r
+			, disk_buffer_holder buffer
+			, std::function<void(storage_error const&)> handler
+			, std::uint8_t flags = 0) override;
 		void async_hash(storage_index_t storage, piece_index_t piece, std::uint8_t flags
 			, std::function<void(piece_index_t, sha1_hash const&, storage_error const&)> handler, void* requester) override;
+		void async_hash_blocks(storage_index_t storage, piece_index_t piece
+			, std::uint32_t salt
+			, std::function<void(piece_index_t, std::vector<sha1_hash>, storage_error const&)> handler) override;
 		void async_move_storage(storage_index_t storage, std::string p, std::uint8_t flags
 			, std::function<void(status_t, std::string const&, storage_error const&)> handler) override;
 		void async_release_files(storage_index_t storage
@@ -315,7 +350,8 @@ namespace aux {
 		void async_check_files(storage_index_t storage
 			, add_torrent_params const* resume_data
 			, aux::vector<std::string, file_index_t>& links
-			, std::function<void(status_t, storage_error const&)> handler) override;
+			, std::function<void(status_t, storage_error const&)> handler
+			, std::uint8_t flags = 0) override;
 		void async_rename_file(storage_index_t storage, file_index_t index, std::string name
 			, std::function<void(std::string const&, file_index_t, storage_error const&)> handler) override;
 		void async_stop_torrent(storage_index_t storage
@@ -369,6 +405,10 @@ namespace aux {
 		status_t do_hash(disk_io_job* j, jobqueue_t& completed_jobs);
 		status_t do_uncached_hash(disk_io_job* j);
 
+		// if the piece of this hash job is sparse on disk (and not in the
+		// cache), fill in the hash of an all-zero piece and return true
+		bool hash_sparse_piece(disk_io_job* j);
+
 		status_t do_move_storage(disk_io_job* j, jobqueue_t& completed_jobs);
 		status_t do_release_files(disk_io_job* j, jobqueue_t& completed_jobs);
 		status_t do_delete_files(disk_io_job* j, jobqueue_t& completed_jobs);
@@ -382,6 +422,7 @@ namespace aux {
 		status_t do_trim_cache(disk_io_job* j, jobqueue_t& completed_jobs);
 		status_t do_file_priority(disk_io_job* j, jobqueue_t& completed_jobs);
 		status_t do_clear_piece(disk_io_job* j, jobqueue_t& completed_jobs);
+		status_t do_hash_blocks(disk_io_job* j, jobqueue_t& completed_jobs);
 		status_t do_resolve_links(disk_io_job* j, jobqueue_t& completed_jobs);
 
 		void call_job_handlers();
@@ -413,8 +454,8 @@ namespace aux {
 			// jobs on the job queue (m_queued_jobs)
 			std::condition_variable m_job_cond;
 
-			// jobs queued for servicing
-			jobqueue_t m_queued_jobs;
+			// jobs queued for servicing, by device
+			aux::device_job_queue m_queued_jobs;
 		};
 
 		void thread_fun(job_queue& queue, disk_io_thread_pool& pool);
@@ -433,17 +474,54 @@ namespace aux {
 		void check_cache_level(std::unique_lock<std::mutex>& l, jobqueue_t& completed_jobs);
 
 		void perform_job(disk_io_job* j, jobqueue_t& completed_jobs);
+		void execute_read_batch(jobqueue_t& jobs, aux::io_uring_batch& batch);
+		void execute_hash_batch(jobqueue_t& jobs);
+		void maybe_check_cache_level(jobqueue_t& completed_jobs);
 
 		// this queues up another job to be submitted
 		void add_job(disk_io_job* j, bool user_add = true);
 		void add_fence_job(disk_io_job* j, bool user_add = true);
 
+		// like add_fence_job(), but the fence only blocks jobs on the
+		// piece of j
+		void add_piece_fence_job(disk_io_job* j, bool user_add = true);
+
+		// queues the fence job j and its flush job fj, depending on the
+		// result of raising the fence (one of the disk_job_fence::fence_*
+		// enums)
+		void post_fence_job(disk_io_job* j, disk_io_job* fj, int fence_state
+			, bool user_add);
+
 		// assumes l is locked (cache std::mutex).
 		// writes out the blocks [start, end) (releases the lock
 		// during the file operation)
 		int flush_range(cached_piece_entry* p, int start, int end
 			, jobqueue_t& completed_jobs, std::unique_lock<std::mutex>& l);
 
+		// assumes l is locked (cache std::mutex).
+		// writes out all dirty blocks of the specified pieces, in storage and
+		// piece order. Runs of adjacent pieces are written with a single
+		// write operation, rather than one per piece. If skip_hashing is
+		// true, pieces currently being hashed are left alone. Returns the
+		// number of blocks flushed. Pieces whose unhashed blocks are flushed
+		// are marked as needing read-back, for the specified reason (one of
+		// the cached_piece_entry::readback_reason_t enums)
+		int flush_pieces_sorted(
+			std::vector<std::pair<storage_interface*, piece_index_t>>& pieces
+			, bool skip_hashing, int readback_reason, jobqueue_t& completed_jobs
+			, std::unique_lock<std::mutex>& l);
+
+		// if any dirty blocks of pe past its hash cursor are about to be
+		// flushed, mark the piece as needing read-back
+		void mark_readback(cached_piece_entry* pe, int reason);
+
+		// returns true if the dirty blocks of pe that haven't been hashed yet
+		// should stay in the write cache, rather than being flushed, because
+		// there's still room for them within max_retained_unhashed_blocks.
+		// retained is the number of unhashed blocks retained so far, and is
+		// updated
+		bool retain_unhashed(cached_piece_entry const* pe, int& retained) const;
+
 		// low level flush operations, used by flush_range
 		int build_iovec(cached_piece_entry* pe, int start, int end
 			, span<iovec_t> iov, span<int> flushing, int block_base_index = 0);
@@ -486,8 +564,23 @@ namespace aux {
 		void maybe_flush_write_blocks();
 		void execute_job(disk_io_job* j);
 		void immediate_execute();
+
+		// returns the index of the device (volume) ``path`` is on. Devices are
+		// numbered in the order they're first seen. If the path doesn't exist
+		// yet, the device of its closest existing parent directory is used
+		std::uint8_t device_index(std::string const& path);
+
+		// sets the max number of jobs per device of the job queues, based on
+		// the settings, the number of threads and the number of devices. And
+		// whether read jobs are reordered
+		void update_queue_settings();
 		void abort_jobs();
 
+		// the settings looked at on the hot paths, as of the last snapshot
+		// the calling thread has seen
+		aux::hot_settings const& cached_settings() const
+		{ return m_published_settings.current().hot; }
+
 		// returns the maximum number of threads
 		// the actual number of threads may be less
 		int num_threads() const;
@@ -512,10 +605,19 @@ namespace aux {
 		job_queue m_generic_io_jobs;
 		disk_io_thread_pool m_generic_threads;
 		job_queue m_hash_io_jobs;
+
+		// called at the start of every thread in m_generic_threads and
+		// m_hash_threads
+		std::function<void(char const*)> m_thread_init;
 		disk_io_thread_pool m_hash_threads;
 
 		aux::session_settings m_settings;
 
+		// snapshots of m_settings, published by set_settings(). The disk
+		// threads read the settings they need for every job from here, without
+		// locking m_cache_mutex
+		aux::settings_publisher m_published_settings{m_settings};
+
 		// userdata pointer for the complete_job function, which
 		// is posted to the network thread when jobs complete
 		void* m_userdata;
@@ -533,6 +635,14 @@ namespace aux {
 		// disk cache
 		mutable std::mutex m_cache_mutex;
 		block_cache m_disk_cache;
+
+		// the second tier of the disk cache, in a file on fast storage (see
+		// settings_pack::l2_cache_path). It has its own locking
+		aux::l2_cache m_l2_cache;
+
+		// the recent read requests of peers, used to adapt the read-ahead to
+		// their access pattern. Protected by m_cache_mutex
+		aux::read_ahead_tracker m_read_ahead;
 		enum
 		{
 			cache_check_idle,
@@ -564,29 +674,57 @@ namespace aux {
 		// the main thread.
 		io_service& m_ios;
 
-		// jobs that are completed are put on this queue
-		// whenever the queue size grows from 0 to 1
-		// a message is posted to the network thread, which
-		// will then drain the queue and execute the jobs'
-		// handler functions
-		std::mutex m_completed_jobs_mutex;
-		jobqueue_t m_completed_jobs;
+		// jobs that are completed are pushed onto this lock-free stack
+		// (linked through disk_io_job::next, in reverse completion order).
+		// Whenever it goes from empty to non-empty a message is posted to
+		// the network thread, which will then take all jobs and execute the
+		// jobs' handler functions
+		std::atomic<disk_io_job*> m_completed_jobs{nullptr};
 
 		// storages that have had write activity recently and will get ticked
 		// soon, for deferred actions (say, flushing partfile metadata)
 		std::vector<std::pair<time_point, std::weak_ptr<storage_interface>>> m_need_tick;
 
-		// this is protected by the completed_jobs_mutex. It's true whenever
-		// there's a call_job_handlers message in-flight to the network thread. We
-		// only ever keep one such message in flight at a time, and coalesce
-		// completion callbacks in m_completed jobs
-		bool m_job_completions_in_flight = false;
+		// this is true whenever there's a call_job_handlers message in-flight
+		// to the network thread. We only ever keep one such message in flight
+		// at a time, and coalesce completion callbacks in m_completed jobs
+		std::atomic<bool> m_job_completions_in_flight{false};
 
 		aux::vector<std::shared_ptr<storage_interface>, storage_index_t> m_torrents;
 
 		// indices into m_torrents to empty slots
 		std::vector<storage_index_t> m_free_slots;
 
+		// the IDs of the devices (as reported by stat_file()) the storages
+		// have been on. A device's index in this vector is the device index of
+		// its storages' jobs. Protected by m_device_mutex
+		std::vector<std::uint64_t> m_device_ids;
+		std::mutex m_device_mutex;
+
+		// the hashes of all-zero pieces, by piece size. Used for pieces in
+		// never-written regions of sparse files. Protected by
+		// m_zero_hash_mutex
+		std::vector<std::pair<int, sha1_hash>> m_zero_hashes;
+		std::mutex m_zero_hash_mutex;
+
+		// appends one request to the trace file, if tracing is enabled (see
+		// settings_pack::disk_io_trace_file)
+		void trace_request(char op, storage_index_t storage, piece_index_t piece
+			, int offset, int size);
+
+		// the file requests are traced to, or nullptr if tracing is
+		// disabled. Requests are issued from the network thread, so this is
+		// only accessed from there
+		FILE* m_trace_file = nullptr;
+		std::string m_trace_path;
+		time_point m_trace_start;
+
+		// delete_files jobs hand the deleting of the files to this queue, to
+		// not occupy a disk thread while it's going on. Deletions complete
+		// their jobs, so this is declared last. Its threads are stopped
+		// before the members they use are destructed
+		aux::deletion_queue m_deletions;
+
 #if TORRENT_USE_ASSERTS
 		int m_magic = 0x1337;
 		std::atomic<bool> m_jobs_aborted{false};
@@ -38,15 +38,51 @@ POSSIBILITY OF SUCH DAMAGE.
 #include "libtorrent/deadline_timer.hpp"
 #include "libtorrent/io_service_fwd.hpp"
 #include "libtorrent/error_code.hpp"
+#include "libtorrent/time.hpp"
 
 #include <thread>
 #include <mutex>
 #include <atomic>
+#include <cstdint>
 
 namespace libtorrent {
 
 	struct disk_io_thread_pool;
 
+	// the policy deciding how many threads a disk_io_thread_pool should
+	// have, when auto scaling. It's fed the totals of the jobs performed over
+	// an interval, and returns the number of threads to have for the next
+	// one. The number only changes by one thread at a time
+	struct TORRENT_EXTRA_EXPORT disk_thread_scaler
+	{
+		// the number of threads to use when there's nothing to go on yet
+		explicit disk_thread_scaler(int threads) : m_threads(threads) {}
+
+		// ``wait`` and ``service`` are the sums of the time the jobs spent
+		// waiting in the queue and being performed, in microseconds.
+		// ``interval`` is the duration of the sample period, in microseconds
+		int update(int jobs, std::int64_t wait, std::int64_t service
+			, std::int64_t interval, int min_threads, int max_threads);
+
+		int threads() const { return m_threads; }
+
+	private:
+
+		int m_threads;
+
+		// the step taken at the end of the previous interval (-1, 0 or 1), and
+		// the throughput (jobs per second) and average service time of it, to
+		// tell whether adding a thread helped
+		int m_last_step = 0;
+		double m_last_throughput = 0;
+		std::int64_t m_last_service = 0;
+
+		// when adding a thread made jobs slower without getting more of them
+		// done, the pool isn't grown past this for a while
+		int m_ceiling = 0;
+		int m_ceiling_intervals = 0;
+	};
+
 	struct pool_thread_interface
 	{
 		virtual ~pool_thread_interface() {}
@@ -111,8 +147,39 @@ namespace libtorrent {
 		// not thread safe
 		void job_queued(int queue_size);
 
+		// enables or disables sizing the pool by the latency of its jobs.
+		// While enabled, the pool has between ``min_threads`` and
+		// max_threads() threads
+		void set_auto_scale(bool enable, int min_threads);
+
+		// this should be called for every job performed by the pool's threads,
+		// with the time (in microseconds) it waited in the queue and the time
+		// it took to perform. This is thread safe
+		void job_done(std::int64_t wait, std::int64_t service)
+		{
+			m_sample_jobs.fetch_add(1, std::memory_order_relaxed);
+			m_sample_wait.fetch_add(wait, std::memory_order_relaxed);
+			m_sample_service.fetch_add(service, std::memory_order_relaxed);
+		}
+
+		// the number of threads the pool is currently sized for
+		int target_threads() const
+		{ return m_auto_scale ? m_target_threads.load() : m_max_threads.load(); }
+
+		// the average time jobs waited in the queue, during the last scaling
+		// interval
+		std::int64_t queue_wait() const { return m_last_wait; }
+
+		// the number of times the pool has been scaled up and down
+		std::int64_t scaled_up() const { return m_scaled_up; }
+		std::int64_t scaled_down() const { return m_scaled_down; }
+
 	private:
 		void reap_idle_threads(error_code const& ec);
+		void scale_threads(error_code const& ec);
+
+		// the caller must hold m_mutex
+		void start_scale_timer();
 
 		// the caller must hold m_mutex
 		void stop_threads(int num_to_stop);
@@ -138,6 +205,25 @@ namespace libtorrent {
 
 		// timer to check for and reap idle threads
 		deadline_timer m_idle_timer;
+
+		// the totals of the jobs performed since the last scaling decision
+		std::atomic<int> m_sample_jobs;
+		std::atomic<std::int64_t> m_sample_wait;
+		std::atomic<std::int64_t> m_sample_service;
+
+		// must hold m_mutex to access these
+		bool m_auto_scale;
+		int m_min_threads;
+		disk_thread_scaler m_scaler;
+		time_point m_last_scale;
+
+		std::atomic<int> m_target_threads;
+		std::atomic<std::int64_t> m_last_wait;
+		std::atomic<std::int64_t> m_scaled_up;
+		std::atomic<std::int64_t> m_scaled_down;
+
+		// timer for the auto scaling decisions
+		deadline_timer m_scale_timer;
 	};
 } // namespace libtorrent
 
@@ -246,7 +246,14 @@ namespace libtorrent {
 		// ``alert_feature`` in the return value from implemented_features().
 		virtual void on_alert(alert const*) {}
 
-		// return true if the add_torrent_params should be added
+		// called when a peer connects asking for an info-hash that isn't in
+		// the session. Return true if the add_torrent_params should be added,
+		// the peer is then attached to the new torrent.
+		//
+		// This can be used to keep large archives of rarely requested torrents
+		// out of the session (and memory): remove torrents that have been
+		// idle for a while, keeping their .torrent file and resume data on
+		// disk, and load them back into ``p`` here when a peer asks for them.
 		virtual bool on_unknown_torrent(sha1_hash const& /* info_hash */
 			, peer_connection_handle const& /* pc */, add_torrent_params& /* p */)
 		{ return false; }
@@ -282,6 +289,36 @@ namespace libtorrent {
 		// hidden
 		virtual ~torrent_plugin() {}
 
+		// these are flags that can be returned by implemented_features()
+		// indicating which callbacks this plugin is interested in. The
+		// callbacks not covered by a flag are always called.
+		enum feature_flags_t
+		{
+			// new_connection()
+			new_connection_feature = 0x1,
+
+			// on_piece_pass() and on_piece_failed()
+			piece_check_feature = 0x2,
+
+			// tick()
+			tick_feature = 0x4,
+
+			// on_state()
+			state_feature = 0x8,
+
+			// on_add_peer()
+			add_peer_feature = 0x10,
+
+			all_features = 0xffffffff
+		};
+
+		// This function is expected to return a bitmask indicating which
+		// callbacks this plugin implements. The callbacks covered by
+		// feature_flags_t are only called if their flag is included. It's
+		// queried once, when the plugin is added to the torrent. The default
+		// is to have all callbacks called.
+		virtual std::uint32_t implemented_features() { return all_features; }
+
 		// This function is called each time a new peer is connected to the torrent. You
 		// may choose to ignore this by just returning a default constructed
 		// ``shared_ptr`` (in which case you don't need to override this member
@@ -370,6 +407,46 @@ namespace libtorrent {
 		// hidden
 		virtual ~peer_plugin() {}
 
+		// these are flags that can be returned by implemented_features()
+		// indicating which callbacks this plugin is interested in. The
+		// callbacks not covered by a flag (the handshake, connect and
+		// disconnect hooks) are always called.
+		enum feature_flags_t
+		{
+			choke_feature = 0x1, // on_choke()
+			unchoke_feature = 0x2, // on_unchoke()
+			interested_feature = 0x4, // on_interested()
+			not_interested_feature = 0x8, // on_not_interested()
+			have_feature = 0x10, // on_have()
+			dont_have_feature = 0x20, // on_dont_have()
+			bitfield_feature = 0x40, // on_bitfield()
+			have_all_feature = 0x80, // on_have_all()
+			have_none_feature = 0x100, // on_have_none()
+			allowed_fast_feature = 0x200, // on_allowed_fast()
+			request_feature = 0x400, // on_request()
+			piece_feature = 0x800, // on_piece()
+			cancel_feature = 0x1000, // on_cancel()
+			reject_feature = 0x2000, // on_reject()
+			suggest_feature = 0x4000, // on_suggest()
+			sent_unchoke_feature = 0x8000, // sent_unchoke()
+			sent_payload_feature = 0x10000, // sent_payload()
+			can_disconnect_feature = 0x20000, // can_disconnect()
+			extended_feature = 0x40000, // on_extended()
+			unknown_message_feature = 0x80000, // on_unknown_message()
+			piece_check_feature = 0x100000, // on_piece_pass() and on_piece_failed()
+			tick_feature = 0x200000, // tick()
+			write_request_feature = 0x400000, // write_request()
+
+			all_features = 0xffffffff
+		};
+
+		// This function is expected to return a bitmask indicating which
+		// callbacks this plugin implements. The callbacks covered by
+		// feature_flags_t are only called if their flag is included. It's
+		// queried once, when the plugin is added to the peer connection. The
+		// default is to have all callbacks called.
+		virtual std::uint32_t implemented_features() { return all_features; }
+
 		// can add entries to the extension handshake
 		// this is not called for web seeds
 		virtual void add_handshake(entry&) {}
@@ -0,0 +1,72 @@
+/*
+
+Copyright (c) 2017, Arvid Norberg
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions
+are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in
+      the documentation and/or other materials provided with the distribution.
+    * Neither the name of the author nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+#ifndef TORRENT_STATS_RECORDER_HPP_INCLUDED
+#define TORRENT_STATS_RECORDER_HPP_INCLUDED
+
+#ifndef TORRENT_DISABLE_EXTENSIONS
+
+#include "libtorrent/config.hpp"
+#include "libtorrent/error_code.hpp"
+
+#include <memory>
+#include <string>
+
+namespace libtorrent {
+
+	struct plugin;
+
+	// constructor function for the stats recorder extension. The extension
+	// appends every session_stats_alert to the file at ``path``, in a compact
+	// binary format meant to be left on for long periods of time. Every
+	// ``interval`` milliseconds it calls session_handle::post_session_stats(),
+	// so session_stats_alerts are posted at that rate. Pass 0 to only record
+	// the stats requested by the client. Samples are only recorded while
+	// the alert queue has room for them.
+	//
+	// The file starts with a header naming every metric, so it can be read
+	// without knowing which version of libtorrent wrote it. Each sample is
+	// stored as the difference to the previous one, in the same encoding as
+	// session_stats_delta_alert. Every few minutes, a complete snapshot is
+	// stored, so a reader does not need to apply every delta to look at a
+	// range of the file. ``tools/parse_session_stats.py`` can render the same
+	// graphs from this file as it does from a session log.
+	//
+	// If the file cannot be opened, ``ec`` is set and nullptr is returned.
+	// Otherwise, pass the returned plugin to session_handle::add_extension().
+	TORRENT_EXPORT std::shared_ptr<plugin> create_stats_recorder_plugin(
+		std::string const& path, int interval, error_code& ec);
+}
+
+#endif // TORRENT_DISABLE_EXTENSIONS
+
+#endif // TORRENT_STATS_RECORDER_HPP_INCLUDED
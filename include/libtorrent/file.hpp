@@ -36,6 +36,7 @@ POSSIBILITY OF SUCH DAMAGE.
 #include <memory>
 #include <string>
 #include <functional>
+#include <mutex>
 
 #include "libtorrent/config.hpp"
 #include "libtorrent/string_view.hpp"
@@ -168,6 +169,12 @@ namespace libtorrent {
 			// leaving running applications in the page cache
 			no_cache = 0x40,
 
+			// bypass the OS disk cache entirely (O_DIRECT on linux). Reads
+			// and writes that are not aligned to the device's block size
+			// are bounced through an aligned buffer. On systems without
+			// direct I/O support, this is treated as no_cache
+			direct_io = 0x80,
+
 			// this is only used for readv/writev flags
 			coalesce_buffers = 0x100,
 
@@ -190,6 +197,12 @@ namespace libtorrent {
 		void close();
 		bool set_size(std::int64_t size, error_code& ec);
 
+		// allocate disk space for the range [offset, offset + len), extending
+		// the file if it's shorter, without writing to it. Returns false if
+		// the platform or file system doesn't support this, without setting
+		// ``ec``, or on error
+		bool reserve(std::int64_t offset, std::int64_t len, error_code& ec);
+
 		std::uint32_t open_mode() const { return m_open_mode; }
 
 		std::int64_t writev(std::int64_t file_offset, span<iovec_t const> bufs
@@ -207,6 +220,17 @@ namespace libtorrent {
 
 	private:
 
+#if TORRENT_USE_DIRECT_IO
+		std::int64_t direct_readv(std::int64_t file_offset, span<iovec_t const> bufs
+			, error_code& ec);
+		std::int64_t direct_writev(std::int64_t file_offset, span<iovec_t const> bufs
+			, error_code& ec);
+
+		// serializes the read-modify-write cycles of partial blocks in
+		// direct_io mode
+		std::mutex m_direct_io_mutex;
+#endif
+
 		handle_type m_file_handle;
 
 		std::uint32_t m_open_mode;
@@ -33,15 +33,18 @@ POSSIBILITY OF SUCH DAMAGE.
 #ifndef TORRENT_FILE_POOL_HPP
 #define TORRENT_FILE_POOL_HPP
 
-#include <map>
 #include <mutex>
 #include <vector>
+#include <array>
+#include <atomic>
+#include <unordered_map>
 
 #include "libtorrent/file.hpp"
 #include "libtorrent/aux_/time.hpp"
 #include "libtorrent/units.hpp"
 #include "libtorrent/storage_defs.hpp"
 #include "libtorrent/disk_interface.hpp" // for open_file_state
+#include "libtorrent/linked_list.hpp"
 
 namespace libtorrent {
 
@@ -78,7 +81,7 @@ namespace libtorrent {
 
 		// returns the current limit of number of allowed open file handles held
 		// by the file_pool.
-		int size_limit() const { return m_size; }
+		int size_limit() const { return m_size.load(); }
 
 		// internal
 		void set_low_prio_io(bool b) { m_low_prio_io = b; }
@@ -101,26 +104,56 @@ namespace libtorrent {
 
 	private:
 
-		void remove_oldest(std::unique_lock<std::mutex>& l);
+		// the files of a storage all live in the same shard. Each shard has
+		// its own mutex, so disk threads working on different storages don't
+		// contend on it. The number of shards must be a power of two
+		static constexpr int num_shards = 8;
 
-		int m_size;
-		bool m_low_prio_io = false;
-
-		struct lru_file_entry
+		struct lru_file_entry : list_node<lru_file_entry>
 		{
+			explicit lru_file_entry(std::uint64_t k) : key(k) {}
+			std::uint64_t const key;
 			file_handle file_ptr;
 			time_point const opened{aux::time_now()};
 			time_point last_use{opened};
 			std::uint32_t mode = 0;
 		};
 
-		// maps storage pointer, file index pairs to the
-		// lru entry for the file
-		std::map<std::pair<storage_index_t, file_index_t>, lru_file_entry> m_files;
+		struct shard
+		{
+			// maps the storage and file index (see file_key()) to the entry
+			// for the file
+			std::unordered_map<std::uint64_t, lru_file_entry> files;
+
+			// all entries in ``files``, the most recently used first
+			linked_list<lru_file_entry> lru;
+
+			mutable std::mutex mutex;
+		};
+
+		static std::uint64_t file_key(storage_index_t st, file_index_t f);
+		shard& shard_for(storage_index_t st);
+		shard const& shard_for(storage_index_t st) const;
+
+		// closes the least recently used file of all shards. This must not
+		// be called with a shard mutex held
+		void remove_oldest();
+
+		// removes ``e`` from shard ``s`` (whose mutex must be held) and
+		// returns its file handle, to be closed after the mutex is released
+		file_handle remove_entry(shard& s, lru_file_entry& e);
+
+		std::atomic<int> m_size;
+		bool m_low_prio_io = false;
+
+		// the total number of files in all shards
+		std::atomic<int> m_num_files{0};
+
+		std::array<shard, num_shards> m_shards;
 #if TORRENT_USE_ASSERTS
 		std::vector<std::pair<std::string, void const*>> m_deleted_storages;
+		mutable std::mutex m_deleted_mutex;
 #endif
-		mutable std::mutex m_mutex;
 	};
 }
 
@@ -37,6 +37,7 @@ POSSIBILITY OF SUCH DAMAGE.
 #include <string>
 #include <vector>
 #include <unordered_set>
+#include <unordered_map>
 #include <ctime>
 #include <cstdint>
 
@@ -45,6 +46,7 @@ POSSIBILITY OF SUCH DAMAGE.
 #include "libtorrent/sha1_hash.hpp"
 #include "libtorrent/string_view.hpp"
 #include "libtorrent/aux_/vector.hpp"
+#include "libtorrent/aux_/string_pool.hpp"
 
 namespace libtorrent {
 
@@ -122,8 +124,8 @@ namespace libtorrent {
 		internal_file_entry();
 		internal_file_entry(internal_file_entry const& fe);
 		internal_file_entry& operator=(internal_file_entry const& fe);
-		internal_file_entry(internal_file_entry&& fe);
-		internal_file_entry& operator=(internal_file_entry&& fe);
+		internal_file_entry(internal_file_entry&& fe) noexcept;
+		internal_file_entry& operator=(internal_file_entry&& fe) noexcept;
 		~internal_file_entry();
 
 		void set_name(char const* n, bool borrow_string = false, int string_len = 0);
@@ -388,7 +390,7 @@ namespace libtorrent {
 		std::int64_t total_size() const { return m_total_size; }
 
 		// set and get the number of pieces in the torrent
-		void set_num_pieces(int n) { m_num_pieces = n; }
+		void set_num_pieces(int n) { m_num_pieces = n; m_piece_first_file.clear(); }
 		int num_pieces() const { TORRENT_ASSERT(m_piece_length > 0); return m_num_pieces; }
 
 		// returns the index of the one-past-end piece in the file storage
@@ -400,7 +402,7 @@ namespace libtorrent {
 
 		// set and get the size of each piece in this torrent. This size is typically an even power
 		// of 2. It doesn't have to be though. It should be divisible by 16kiB however.
-		void set_piece_length(int l)  { m_piece_length = l; }
+		void set_piece_length(int l)  { m_piece_length = l; m_piece_first_file.clear(); }
 		int piece_length() const { TORRENT_ASSERT(m_piece_length > 0); return m_piece_length; }
 
 		// returns the piece size of ``index``. This will be the same as piece_length(), except
@@ -417,6 +419,8 @@ namespace libtorrent {
 		{
 			using std::swap;
 			swap(ti.m_files, m_files);
+			swap(ti.m_file_offsets, m_file_offsets);
+			swap(ti.m_piece_first_file, m_piece_first_file);
 			swap(ti.m_file_hashes, m_file_hashes);
 			swap(ti.m_symlinks, m_symlinks);
 			swap(ti.m_mtime, m_mtime);
@@ -424,6 +428,8 @@ namespace libtorrent {
 			swap(ti.m_file_base, m_file_base);
 #endif
 			swap(ti.m_paths, m_paths);
+			swap(ti.m_path_index, m_path_index);
+			ti.m_name_pool.swap(m_name_pool);
 			swap(ti.m_name, m_name);
 			swap(ti.m_total_size, m_total_size);
 			swap(ti.m_num_pieces, m_num_pieces);
@@ -568,6 +574,10 @@ namespace libtorrent {
 		// offset to add to any pointers to make them point into the new buffer
 		void apply_pointer_offset(std::ptrdiff_t off);
 
+		// an estimate of the number of bytes of memory used by this
+		// file_storage, including its own size
+		std::size_t memory_usage() const;
+
 	private:
 
 		void add_pad_file(int size
@@ -584,11 +594,34 @@ namespace libtorrent {
 
 		void update_path_index(internal_file_entry& e, std::string const& path
 			, bool set_name = true);
+
+		// sets the name of e to a copy of n, stored in m_name_pool
+		void set_entry_name(internal_file_entry& e, string_view n);
 		void reorder_file(int index, int dst);
 
+		// returns the index of the file containing the byte at ``offset``,
+		// which is in ``piece``
+		file_index_t file_index_at(piece_index_t piece, std::int64_t offset) const;
+
+		// builds m_piece_first_file. This is done by torrent_info once the
+		// file list and piece size are final. Any change to the files or the
+		// piece layout drops the index again
+		void build_piece_index();
+
 		// the list of files that this torrent consists of
 		aux::vector<internal_file_entry, file_index_t> m_files;
 
+		// the offset of each file in m_files. Lookups by offset search this
+		// array rather than m_files, to touch as little memory as possible
+		aux::vector<std::int64_t, file_index_t> m_file_offsets;
+
+		// the file containing the first byte of each piece. The files
+		// overlapping piece p are in the range [m_piece_first_file[p],
+		// m_piece_first_file[p + 1]], which limits the search for an offset to
+		// the few files in that piece. This is empty for single-file torrents
+		// and until build_piece_index() is called
+		aux::vector<file_index_t, piece_index_t> m_piece_first_file;
+
 		// if there are sha1 hashes for each individual file there are as many
 		// entries in this array as the m_files array. Each entry in m_files has
 		// a corresponding hash pointer in this array. The reason to split it up
@@ -625,6 +658,15 @@ namespace libtorrent {
 		// entry appended, to form full file paths
 		aux::vector<std::string> m_paths;
 
+		// maps the hash of each path in m_paths to its index, to find
+		// existing paths without comparing against all of them
+		std::unordered_multimap<std::size_t, int> m_path_index;
+
+		// the storage for file names set by add_file() or rename_file(),
+		// i.e. the ones not borrowed from a .torrent file. This is shared
+		// with copies of this file_storage
+		aux::string_pool m_name_pool;
+
 		// name of torrent. For multi-file torrents
 		// this is always the root directory
 		std::string m_name;
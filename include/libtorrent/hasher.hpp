@@ -62,6 +62,21 @@ extern "C" {
 
 namespace libtorrent {
 
+	class hasher;
+
+namespace aux {
+
+	// the number of hashers update_multi() hashes at a time. This is 1 unless
+	// the built-in SHA-1 implementation is used and the CPU has SIMD
+	// instructions that beat hashing one buffer at a time
+	TORRENT_EXTRA_EXPORT int hash_lanes();
+
+	// the same as calling ``hashers[i]->update(data[i], len)`` for each
+	// hasher. ``hashers`` and ``data`` must be the same size
+	TORRENT_EXTRA_EXPORT void update_multi(span<hasher* const> hashers
+		, span<char const* const> data, int len);
+}
+
 	// this is a SHA-1 hash class.
 	//
 	// You use it by first instantiating it, then call ``update()`` to feed it
@@ -108,6 +123,9 @@ namespace libtorrent {
 
 	private:
 
+		friend void aux::update_multi(span<hasher* const>
+			, span<char const* const>, int);
+
 #ifdef TORRENT_USE_LIBGCRYPT
 		gcry_md_hd_t m_context;
 #elif TORRENT_USE_COMMONCRYPTO
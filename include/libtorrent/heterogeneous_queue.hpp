@@ -38,6 +38,8 @@ POSSIBILITY OF SUCH DAMAGE.
 #include <cstdlib> // for malloc
 #include <type_traits>
 #include <memory>
+#include <algorithm> // for max, min
+#include <utility> // for swap
 
 #include "libtorrent/assert.hpp"
 #include "libtorrent/aux_/throw.hpp"
@@ -57,10 +59,16 @@ namespace libtorrent {
 		}
 	}
 
+	// a queue of objects of different types, all derived from T, stored back
+	// to back with a small header in front of each one. The storage is made up
+	// of a list of chunks. When the last one is full, a new chunk is appended,
+	// so objects are never moved once constructed, and growing the queue is
+	// bounded to allocating one chunk. clear() keeps the chunks around, to be
+	// filled again in order
 	template <class T>
 	struct heterogeneous_queue
 	{
-		heterogeneous_queue() : m_storage(nullptr, aux::free_deleter()) {}
+		heterogeneous_queue() = default;
 		heterogeneous_queue(heterogeneous_queue const&) = delete;
 		heterogeneous_queue& operator=(heterogeneous_queue const&) = delete;
 
@@ -69,11 +77,14 @@ namespace libtorrent {
 		emplace_back(Args&&... args)
 		{
 			// make the conservative assumption that we'll need the maximum padding
-			// for this object, just for purposes of growing the storage
-			if (std::size_t(m_size) + sizeof(header_t) + alignof(U) + sizeof(U) > std::size_t(m_capacity))
-				grow_capacity(sizeof(header_t) + alignof(U) + sizeof(U));
+			// for this object, just for purposes of picking a chunk for it
+			int const max_size = int(sizeof(header_t) + alignof(U) + sizeof(U));
+			if (m_chunks.empty()
+				|| m_chunks[m_current].size + max_size > m_chunks[m_current].capacity)
+				next_chunk(max_size);
 
-			char* ptr = m_storage.get() + m_size;
+			chunk& c = m_chunks[m_current];
+			char* ptr = c.storage.get() + c.size;
 
 			std::size_t const pad_bytes = aux::calculate_pad_bytes(ptr + sizeof(header_t), alignof(U));
 
@@ -85,7 +96,7 @@ namespace libtorrent {
 			// if this assert triggers, the type being added to the queue has
 			// alignment requirements stricter than what malloc() returns. This is
 			// not supported
-			TORRENT_ASSERT((reinterpret_cast<std::uintptr_t>(m_storage.get())
+			TORRENT_ASSERT((reinterpret_cast<std::uintptr_t>(c.storage.get())
 				& (alignof(U) - 1)) == 0);
 
 			// make sure the current position in the storage is aligned for
@@ -96,7 +107,6 @@ namespace libtorrent {
 			// length prefix
 			header_t* hdr = new (ptr) header_t;
 			hdr->pad_bytes = static_cast<std::uint8_t>(pad_bytes);
-			hdr->move = &move<U>;
 			ptr += sizeof(header_t) + pad_bytes;
 			hdr->len = static_cast<std::uint16_t>(sizeof(U)
 				+ aux::calculate_pad_bytes(ptr + sizeof(U),  alignof(header_t)));
@@ -112,31 +122,23 @@ namespace libtorrent {
 			// if we constructed the object without throwing any exception
 			// update counters to indicate the new item is in there
 			++m_num_items;
-			m_size += int(sizeof(header_t) + pad_bytes + hdr->len);
+			c.size += int(sizeof(header_t) + pad_bytes + hdr->len);
+			TORRENT_ASSERT(c.size <= c.capacity);
 			return *ret;
 		}
 
 		void get_pointers(std::vector<T*>& out)
 		{
 			out.clear();
-
-			char* ptr = m_storage.get();
-			char const* const end = m_storage.get() + m_size;
-			while (ptr < end)
-			{
-				header_t* hdr = reinterpret_cast<header_t*>(ptr);
-				ptr += sizeof(header_t) + hdr->pad_bytes;
-				TORRENT_ASSERT(ptr + hdr->len <= end);
-				out.push_back(reinterpret_cast<T*>(ptr));
-				ptr += hdr->len;
-			}
+			out.reserve(std::size_t(m_num_items));
+			for_each([&out](T* e) { out.push_back(e); });
 		}
 
 		void swap(heterogeneous_queue& rhs)
 		{
-			std::swap(m_storage, rhs.m_storage);
+			std::swap(m_chunks, rhs.m_chunks);
+			std::swap(m_current, rhs.m_current);
 			std::swap(m_capacity, rhs.m_capacity);
-			std::swap(m_size, rhs.m_size);
 			std::swap(m_num_items, rhs.m_num_items);
 		}
 
@@ -145,31 +147,23 @@ namespace libtorrent {
 
 		void clear()
 		{
-			char* ptr = m_storage.get();
-			char const* const end = m_storage.get() + m_size;
-			while (ptr < end)
-			{
-				header_t* hdr = reinterpret_cast<header_t*>(ptr);
-				ptr += sizeof(header_t) + hdr->pad_bytes;
-				TORRENT_ASSERT(ptr + hdr->len <= end);
-				T* a = reinterpret_cast<T*>(ptr);
-				a->~T();
-				ptr += hdr->len;
-				hdr->~header_t();
-			}
-			m_size = 0;
+			for_each([](T* e) { e->~T(); });
+			for (auto& c : m_chunks) c.size = 0;
+			m_current = 0;
 			m_num_items = 0;
 		}
 
 		T* front()
 		{
-			if (m_size == 0) return nullptr;
+			if (m_num_items == 0) return nullptr;
 
-			TORRENT_ASSERT(m_size > 1);
-			char* ptr = m_storage.get();
+			// objects are always added to the first chunk first
+			chunk& c = m_chunks.front();
+			TORRENT_ASSERT(c.size > 1);
+			char* ptr = c.storage.get();
 			header_t* hdr = reinterpret_cast<header_t*>(ptr);
 			TORRENT_ASSERT(sizeof(header_t) + hdr->pad_bytes + hdr->len
-				<= std::size_t(m_size));
+				<= std::size_t(c.size));
 			ptr += sizeof(header_t) + hdr->pad_bytes;
 			return reinterpret_cast<T*>(ptr);
 		}
@@ -179,9 +173,7 @@ namespace libtorrent {
 	private:
 
 		// this header is put in front of every element. It tells us
-		// how many bytes it's using for its allocation, and it
-		// also tells us how to move this type if we need to grow our
-		// allocation.
+		// how many bytes it's using for its allocation
 		struct header_t
 		{
 			// the size of the object. From the start of the object, skip this many
@@ -193,64 +185,78 @@ namespace libtorrent {
 			// header and the start of the object. This supports allocating types with
 			// stricter alignment requirements
 			std::uint8_t pad_bytes;
-
-			void (*move)(char* dst, char* src);
 		};
 
-		void grow_capacity(int const size)
+		struct chunk
 		{
-			int const amount_to_grow = (std::max)(size
-				, (std::max)(m_capacity * 3 / 2, 128));
-
-			// we use malloc() to guarantee alignment
-			std::unique_ptr<char, aux::free_deleter> new_storage(
-				static_cast<char*>(std::malloc(std::size_t(m_capacity + amount_to_grow)))
-				, aux::free_deleter());
+			std::unique_ptr<char, aux::free_deleter> storage;
+			// number of bytes of storage allocated
+			int capacity;
+			// the number of bytes used
+			int size;
+		};
 
-			if (new_storage.get() == nullptr)
-				aux::throw_ex<std::bad_alloc>();
+		// the largest chunk we allocate, unless a single object needs more.
+		// Up to this size, every new chunk is as large as all previous ones
+		// combined
+		static constexpr int max_chunk_size = 256 * 1024;
 
-			char* src = m_storage.get();
-			char* dst = new_storage.get();
-			char const* const end = m_storage.get() + m_size;
-			while (src < end)
+		template <typename Fun>
+		void for_each(Fun f)
+		{
+			for (std::size_t i = 0; i < m_chunks.size() && i <= m_current; ++i)
 			{
-				header_t* src_hdr = reinterpret_cast<header_t*>(src);
-				new (dst) header_t(*src_hdr);
-				src += sizeof(header_t) + src_hdr->pad_bytes;
-				dst += sizeof(header_t) + src_hdr->pad_bytes;
-				int const len = src_hdr->len;
-				TORRENT_ASSERT(src + len <= end);
-				// TODO: if this throws, we should technically destruct the elements
-				// we've constructed so far, but maybe we should just disallow
-				// throwing move instead.
-				src_hdr->move(dst, src);
-				src_hdr->~header_t();
-				src += len ;
-				dst += len;
+				chunk& c = m_chunks[i];
+				char* ptr = c.storage.get();
+				char const* const end = ptr + c.size;
+				while (ptr < end)
+				{
+					header_t* hdr = reinterpret_cast<header_t*>(ptr);
+					ptr += sizeof(header_t) + hdr->pad_bytes;
+					TORRENT_ASSERT(ptr + hdr->len <= end);
+					f(reinterpret_cast<T*>(ptr));
+					ptr += hdr->len;
+				}
 			}
-
-			m_storage.swap(new_storage);
-			m_capacity += amount_to_grow;
 		}
 
-		template <class U>
-		static void move(char* dst, char* src)
+		// makes m_current refer to a chunk with room for at least size bytes,
+		// either the next one already allocated (by an earlier generation) or
+		// a new one
+		void next_chunk(int const size)
 		{
-			U& rhs = *reinterpret_cast<U*>(src);
+			std::size_t const next = m_chunks.empty() ? 0 : m_current + 1;
+			if (next < m_chunks.size() && m_chunks[next].capacity >= size)
+			{
+				TORRENT_ASSERT(m_chunks[next].size == 0);
+				m_current = next;
+				return;
+			}
 
-			TORRENT_ASSERT((reinterpret_cast<std::uintptr_t>(dst) & (alignof(U) - 1)) == 0);
+			int const capacity = (std::max)(size
+				, (std::min)((std::max)(m_capacity, 128), int(max_chunk_size)));
+
+			// we use malloc() to guarantee alignment
+			std::unique_ptr<char, aux::free_deleter> storage(
+				static_cast<char*>(std::malloc(std::size_t(capacity)))
+				, aux::free_deleter());
+
+			if (storage.get() == nullptr)
+				aux::throw_ex<std::bad_alloc>();
 
-			new (dst) U(std::move(rhs));
-			rhs.~U();
+			m_chunks.insert(m_chunks.begin() + std::ptrdiff_t(next)
+				, chunk{std::move(storage), capacity, 0});
+			m_current = next;
+			m_capacity += capacity;
 		}
 
-		std::unique_ptr<char, aux::free_deleter> m_storage;
-		// number of bytes of storage allocated
+		std::vector<chunk> m_chunks;
+		// the chunk new objects are added to. The ones before it are full, the
+		// ones after it are empty
+		std::size_t m_current = 0;
+		// number of bytes of storage allocated, in all chunks
 		int m_capacity = 0;
-		// the number of bytes used under m_storage
-		int m_size = 0;
-		// the number of objects allocated in m_storage
+		// the number of objects in the queue
 		int m_num_items = 0;
 	};
 }
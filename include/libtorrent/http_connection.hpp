@@ -120,6 +120,26 @@ struct TORRENT_EXTRA_EXPORT http_connection
 
 	void close(bool force = false);
 
+	// when enabled, requests ask the server to keep the connection open
+	// (``Connection: keep-alive``) and the socket is left open once a
+	// bottled response has been received in full. A subsequent call to
+	// get() for the same host and port is sent over it. This is used for
+	// pooling connections to HTTP trackers.
+	void keep_alive(bool k) { m_keep_alive = k; }
+
+	// returns true if the last request completed and the socket can be
+	// used for another one. i.e. keep-alive is enabled, the response
+	// was received in full and the server did not ask to close the
+	// connection
+	bool can_reuse() const;
+
+	// replaces the handlers. This is used to hand an idle keep-alive
+	// connection over to a new request, and to drop the references the
+	// handlers hold while it's idle
+	void set_handlers(http_handler const& handler
+		, http_connect_handler const& ch = http_connect_handler()
+		, http_filter_handler const& fh = http_filter_handler());
+
 	socket_type const& socket() const { return m_sock; }
 
 	std::vector<tcp::endpoint> const& endpoints() const { return m_endpoints; }
@@ -141,6 +161,10 @@ private:
 		, error_code const& e);
 	void on_assign_bandwidth(error_code const& e);
 
+	// the server closed a reused keep-alive connection before responding.
+	// Open a new connection and send the request again
+	void reconnect();
+
 	void callback(error_code e, char* data = nullptr, int size = 0);
 
 	aux::vector<char> m_recvbuffer;
@@ -240,6 +264,18 @@ private:
 
 	// true while waiting for an async_connect
 	bool m_connecting;
+
+	// true if requests should keep the connection open for reuse
+	bool m_keep_alive;
+
+	// set when a response has been received in full on a keep-alive
+	// connection, and it may be reused. Cleared when a new request starts
+	bool m_reusable;
+
+	// true while the current request is sent over a socket that was left
+	// open by a previous one. If the server has closed it in the meantime,
+	// we reconnect rather than failing the request
+	bool m_reused;
 };
 
 }
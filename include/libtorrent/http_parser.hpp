@@ -39,6 +39,7 @@ POSSIBILITY OF SUCH DAMAGE.
 #include <vector>
 #include <cstdint>
 #include <tuple>
+#include <array>
 
 #include "libtorrent/config.hpp"
 #include "libtorrent/buffer.hpp"
@@ -57,16 +58,45 @@ namespace libtorrent {
 	class TORRENT_EXTRA_EXPORT http_parser
 	{
 	public:
-		enum flags_t { dont_parse_chunks = 1 };
+		enum flags_t
+		{
+			dont_parse_chunks = 1,
+
+			// only the headers in known_header_t are recorded, into a fixed
+			// table whose strings are reused from one response to the next.
+			// Parsing a response then doesn't allocate any memory (once the
+			// table has grown to fit the values). headers() is always empty
+			// in this mode
+			known_headers_only = 2
+		};
+
+		// the headers recorded with the known_headers_only flag
+		enum known_header_t
+		{
+			content_length_header,
+			content_range_header,
+			content_type_header,
+			content_encoding_header,
+			transfer_encoding_header,
+			connection_header,
+			location_header,
+			retry_after_header,
+			server_header,
+			num_known_headers
+		};
+
+		// the (lower case) name of the known header
+		static char const* known_header_name(known_header_t h);
+
 		explicit http_parser(int flags = 0);
 		~http_parser();
-		std::string const& header(char const* key) const
-		{
-			static std::string empty;
-			auto const i = m_header.find(key);
-			if (i == m_header.end()) return empty;
-			return i->second;
-		}
+
+		// key is expected to be lower case
+		std::string const& header(char const* key) const;
+
+		// returns the value of the known header, or an empty string if it
+		// wasn't in the response. This works in either mode
+		std::string const& header(known_header_t h) const;
 
 		std::string const& protocol() const { return m_protocol; }
 		int status_code() const { return m_status_code; }
@@ -132,6 +162,10 @@ namespace libtorrent {
 		std::int64_t m_range_end = -1;
 
 		std::multimap<std::string, std::string> m_header;
+
+		// the values of the known headers, in known_headers_only mode
+		std::array<std::string, num_known_headers> m_known_headers;
+
 		span<char const> m_recv_buffer;
 		// contains offsets of the first and one-past-end of
 		// each chunked range in the response
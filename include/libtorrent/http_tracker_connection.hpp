@@ -86,6 +86,12 @@ namespace libtorrent {
 
 		tracker_manager& m_man;
 		std::shared_ptr<http_connection> m_tracker_connection;
+
+		// identifies the tracker host the connection is made to, for reusing
+		// keep-alive connections across requests. Empty if this request's
+		// connection should not be pooled
+		std::string m_pool_key;
+
 		address m_tracker_ip;
 #if TORRENT_USE_I2P
 		i2p_connection* m_i2p_conn;
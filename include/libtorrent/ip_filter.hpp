@@ -41,6 +41,8 @@ POSSIBILITY OF SUCH DAMAGE.
 #include <tuple>
 #include <iterator> // for next
 #include <limits>
+#include <utility> // for pair, declval
+#include <type_traits>
 
 #include "libtorrent/address.hpp"
 #include "libtorrent/assert.hpp"
@@ -126,12 +128,41 @@ namespace detail {
 	inline std::uint16_t max_addr<std::uint16_t>()
 	{ return (std::numeric_limits<std::uint16_t>::max)(); }
 
+	// the compiled form of a filter stores addresses in a representation
+	// that's cheap to compare. IPv4 and IPv6 addresses are turned into
+	// integers, in host byte order
+	template<class Addr>
+	Addr const& compiled_key(Addr const& a) { return a; }
+
+	inline std::uint32_t compiled_key(address_v4::bytes_type const& a)
+	{
+		return (std::uint32_t(a[0]) << 24) | (std::uint32_t(a[1]) << 16)
+			| (std::uint32_t(a[2]) << 8) | std::uint32_t(a[3]);
+	}
+
+#if TORRENT_USE_IPV6
+	inline std::pair<std::uint64_t, std::uint64_t> compiled_key(
+		address_v6::bytes_type const& a)
+	{
+		std::uint64_t high = 0;
+		std::uint64_t low = 0;
+		for (std::size_t i = 0; i < 8; ++i)
+		{
+			high = (high << 8) | a[i];
+			low = (low << 8) | a[i + 8];
+		}
+		return {high, low};
+	}
+#endif
+
 	// this is the generic implementation of
 	// a filter for a specific address type.
 	// it works with IPv4 and IPv6
 	template<class Addr>
 	class filter_impl
 	{
+		using key_type = typename std::decay<
+			decltype(compiled_key(std::declval<Addr>()))>::type;
 	public:
 
 		filter_impl()
@@ -145,6 +176,10 @@ namespace detail {
 			TORRENT_ASSERT(!m_access_list.empty());
 			TORRENT_ASSERT(first < last || first == last);
 
+			// the compiled form is no longer valid
+			std::vector<key_type>().swap(m_starts);
+			std::vector<std::uint32_t>().swap(m_flags);
+
 			auto i = m_access_list.upper_bound(first);
 			auto j = m_access_list.upper_bound(last);
 
@@ -195,8 +230,44 @@ namespace detail {
 			TORRENT_ASSERT(!m_access_list.empty());
 		}
 
+		// builds a flat, sorted array of the start of every range, used by
+		// access() in place of walking the set. It's discarded by the next
+		// call to add_rule()
+		void compile()
+		{
+			m_starts.clear();
+			m_flags.clear();
+			m_starts.reserve(m_access_list.size());
+			m_flags.reserve(m_access_list.size());
+			for (auto const& r : m_access_list)
+			{
+				m_starts.push_back(compiled_key(r.start));
+				m_flags.push_back(r.access);
+			}
+		}
+
+		bool compiled() const { return !m_starts.empty(); }
+
 		std::uint32_t access(Addr const& addr) const
 		{
+			if (!m_starts.empty())
+			{
+				// find the last range starting at or before addr. The first
+				// range always starts at the lowest address. The loop body
+				// doesn't branch on the comparison, which lets it compile into
+				// a conditional move, avoiding mispredictions
+				key_type const key = compiled_key(addr);
+				key_type const* base = m_starts.data();
+				std::size_t n = m_starts.size();
+				while (n > 1)
+				{
+					std::size_t const half = n / 2;
+					base = (key < base[half]) ? base : base + half;
+					n -= half;
+				}
+				return m_flags[std::size_t(base - m_starts.data())];
+			}
+
 			TORRENT_ASSERT(!m_access_list.empty());
 			auto i = m_access_list.upper_bound(addr);
 			if (i != m_access_list.begin()) --i;
@@ -244,6 +315,12 @@ namespace detail {
 		};
 
 		std::set<range> m_access_list;
+
+		// the compiled form of m_access_list. m_starts[i] is the first
+		// address of the i:th range and m_flags[i] its access flags. Both are
+		// empty unless compile() has been called since the last add_rule()
+		std::vector<key_type> m_starts;
+		std::vector<std::uint32_t> m_flags;
 	};
 
 }
@@ -286,6 +363,13 @@ struct TORRENT_EXPORT ip_filter
 	// the current filter.
 	std::uint32_t access(address const& addr) const;
 
+	// Builds a compact, flat lookup table from the current rules. This makes
+	// access() significantly cheaper for large filters, at the cost of
+	// keeping a copy of the rules. Adding a rule discards the table again,
+	// until the next call to compile(). The session compiles the filters
+	// passed to it, so there is rarely a need to call this explicitly.
+	void compile();
+
 #if TORRENT_USE_IPV6
 	using filter_tuple_t = std::tuple<std::vector<ip_range<address_v4>>
 		, std::vector<ip_range<address_v6>>>;
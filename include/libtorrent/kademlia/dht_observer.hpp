@@ -79,6 +79,11 @@ namespace libtorrent { namespace dht {
 		virtual bool on_dht_request(string_view query
 			, dht::msg const& request, entry& response) = 0;
 
+		// returns true if on_dht_request() may handle or modify the
+		// response to incoming requests. When it returns false, the node is
+		// free to write some responses without building an entry
+		virtual bool has_dht_request_handler() const = 0;
+
 	protected:
 		~dht_observer() {}
 	};
@@ -38,6 +38,7 @@ POSSIBILITY OF SUCH DAMAGE.
 #include <libtorrent/entry.hpp>
 
 #include <libtorrent/kademlia/node_id.hpp>
+#include <libtorrent/kademlia/node_entry.hpp>
 
 #include <vector>
 
@@ -65,6 +66,14 @@ namespace libtorrent { namespace dht {
 		// the bootstrap nodes saved from the IPv6 buckets node
 		std::vector<udp::endpoint> nodes6;
 
+		// the nodes of the IPv4 routing table, including the replacement
+		// buckets, with their IDs and RTTs. On startup they are put back in
+		// the routing table as not yet confirmed, so lookups can use them
+		// right away while they are pinged again
+		std::vector<node_entry> table;
+		// the nodes of the IPv6 routing table
+		std::vector<node_entry> table6;
+
 		void clear();
 	};
 
@@ -58,6 +58,9 @@ namespace libtorrent { namespace dht {
 		std::int32_t immutable_data;
 		std::int32_t mutable_data;
 
+		// an estimate of the number of bytes of memory used by the storage
+		std::int32_t memory;
+
 		// This member function set the counters to zero.
 		void reset();
 	};
@@ -38,6 +38,7 @@ POSSIBILITY OF SUCH DAMAGE.
 #include <libtorrent/kademlia/node.hpp>
 #include <libtorrent/kademlia/dos_blocker.hpp>
 #include <libtorrent/kademlia/dht_state.hpp>
+#include <libtorrent/kademlia/signing_pool.hpp>
 
 #include <libtorrent/socket.hpp>
 #include <libtorrent/deadline_timer.hpp>
@@ -111,15 +112,32 @@ namespace libtorrent { namespace dht {
 			, std::function<void(item const&, int)> cb
 			, std::function<void(item&)> data_cb, std::string salt = std::string());
 
+		// for mutable_item signed by us with the secret key sk. Once the
+		// current sequence number is known, value is signed under the next
+		// one on the signing thread and then stored.
+		void put_item(public_key const& key, secret_key const& sk
+			, entry const& value, std::string const& salt
+			, std::function<void(item const&, int)> cb);
+
 		// send an arbitrary DHT request directly to a node
 		void direct_request(udp::endpoint const& ep, entry& e
 			, std::function<void(msg const&)> f);
 
+		// run a BEP 51 traversal towards target on all nodes, reporting
+		// each sample response through f
+		void sample_infohashes(sha1_hash const& target
+			, std::function<void(udp::endpoint const&, time_duration
+				, int, std::vector<sha1_hash> const&)> f);
+
 #ifndef TORRENT_NO_DEPRECATE
 		void dht_status(session_status& s);
 #endif
 		void dht_status(std::vector<dht_routing_bucket>& table
 			, std::vector<dht_lookup>& requests);
+
+		// the number of requests in flight, summed over all running lookups
+		// of all nodes
+		int num_outstanding_requests() const;
 		void update_stats_counters(counters& c) const;
 
 		void incoming_error(error_code const& ec, udp::endpoint const& ep);
@@ -136,10 +154,16 @@ namespace libtorrent { namespace dht {
 		void refresh_timeout(error_code const& e);
 		void refresh_key(error_code const& e);
 		void update_storage_node_ids();
+		void restore_table(node& dht, std::vector<node_entry> const& table);
+		void sign_item(item& i, std::function<void(item const&)> f
+			, secret_key const& sk, entry const& value);
+		void verify_pending_puts();
 
 		// implements udp_socket_interface
 		virtual bool has_quota() override;
 		virtual bool send_packet(entry& e, udp::endpoint const& addr) override;
+		virtual bool send_raw_packet(span<char const> buf
+			, udp::endpoint const& addr) override;
 
 		// this is the bdecode_node DHT messages are parsed into. It's a member
 		// in order to avoid having to deallocate and re-allocate it for every
@@ -149,6 +173,10 @@ namespace libtorrent { namespace dht {
 		counters& m_counters;
 		dht_storage_interface& m_storage;
 		dht_state m_state; // to be used only once
+
+		// the observers of all nodes are allocated from this pool
+		boost::pool<> m_observer_pool;
+
 		node m_dht;
 #if TORRENT_USE_IPV6
 		node m_dht6;
@@ -177,6 +205,22 @@ namespace libtorrent { namespace dht {
 		// state for the send rate limit
 		int m_send_quota;
 		time_point m_last_tick;
+
+		// mutable items we put are signed by this pool, off the network
+		// thread
+		signing_pool m_signing;
+
+		// incoming mutable puts are not handled right away. They are queued
+		// up until all packets received in the same batch have been seen,
+		// and their signatures are then verified all at once
+		struct pending_put
+		{
+			udp::endpoint ep;
+			std::vector<char> buf;
+		};
+		std::vector<pending_put> m_pending_puts;
+
+		io_service& m_ios;
 	};
 }}
 
@@ -38,12 +38,22 @@ POSSIBILITY OF SUCH DAMAGE.
 #include "libtorrent/address.hpp"
 #include "libtorrent/assert.hpp"
 
+#include <array>
+#include <cstdint>
+
 namespace libtorrent { namespace dht {
 
 	struct dht_logger;
 
 	// this is a class that maintains a list of abusive DHT nodes,
 	// blocking their access to our DHT node.
+	//
+	// The packet rate of every source IP is estimated with a count-min
+	// sketch, a few rows of counters indexed by independent hashes of the
+	// address. An address' count is the smallest of its counters, which
+	// can only over-estimate it. The counters are halved every 10 seconds.
+	// This uses a fixed amount of memory and a constant amount of work per
+	// packet, no matter how many nodes send to us.
 	struct TORRENT_EXTRA_EXPORT dos_blocker
 	{
 		dos_blocker();
@@ -67,16 +77,42 @@ namespace libtorrent { namespace dht {
 
 	private:
 
-		// used to ignore abusive dht nodes
+		// returns the slot in m_ban_nodes for addr. If it isn't banned, this
+		// is the slot to ban it in
+		struct node_ban_entry;
+		node_ban_entry& ban_slot(address const& addr, std::uint32_t hash
+			, time_point now);
+
+		// halves the counters once for every 10 seconds that have passed
+		void decay(time_point now);
+
+		// nodes that exceeded the rate limit, and when they may send to us
+		// again
 		struct node_ban_entry
 		{
-			node_ban_entry(): count(0) {}
+			node_ban_entry(): limit(min_time()) {}
 			address src;
 			time_point limit;
-			int count;
 		};
 
-		enum { num_ban_nodes = 20 };
+		enum
+		{
+			sketch_depth = 4,
+			sketch_width = 1024,
+			num_ban_nodes = 64,
+			max_ban_probes = 8
+		};
+
+		// the count-min sketch. Each row is indexed by a different hash of
+		// the source address
+		std::array<std::array<std::uint16_t, sketch_width>, sketch_depth> m_sketch;
+
+		// the seeds for the row hashes. They are random, to make it hard for
+		// an attacker to find addresses that collide with someone else's
+		std::array<std::uint32_t, sketch_depth> m_seeds;
+
+		// the last time the counters were halved
+		time_point m_last_decay;
 
 		// the max number of packets we can receive per second from a node before
 		// we block it.
@@ -86,7 +122,8 @@ namespace libtorrent { namespace dht {
 		// limit
 		int m_block_timeout;
 
-		node_ban_entry m_ban_nodes[num_ban_nodes];
+		// a small open-addressed hash table of banned nodes
+		std::array<node_ban_entry, num_ban_nodes> m_ban_nodes;
 	};
 }}
 
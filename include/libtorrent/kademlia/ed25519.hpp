@@ -69,6 +69,13 @@ namespace libtorrent { namespace dht {
 	TORRENT_EXPORT bool ed25519_verify(signature const& sig
 		, span<char const> msg, public_key const& pk);
 
+	// Verifies a batch of signatures at once, ``sigs[i]`` being the signature
+	// of ``msgs[i]`` using ``pks[i]``. This is considerably cheaper than
+	// verifying them one at a time. Returns true if all signatures are
+	// valid, it doesn't tell which ones are invalid otherwise.
+	TORRENT_EXPORT bool ed25519_verify_batch(span<signature const> sigs
+		, span<span<char const> const> msgs, span<public_key const> pks);
+
 	// Adds a scalar to the given key pair where scalar is a 32 byte buffer
 	// (possibly generated with `ed25519_create_seed`), generating a new key pair.
 	//
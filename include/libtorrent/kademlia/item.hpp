@@ -39,6 +39,8 @@ POSSIBILITY OF SUCH DAMAGE.
 #include <libtorrent/span.hpp>
 #include <libtorrent/kademlia/types.hpp>
 
+#include <vector>
+
 namespace libtorrent { namespace dht {
 
 // calculate the target hash for an immutable item.
@@ -55,6 +57,24 @@ TORRENT_EXTRA_EXPORT bool verify_mutable_item(
 	, public_key const& pk
 	, signature const& sig);
 
+// the fields of a mutable item covered by its signature, referring to
+// buffers owned by someone else
+struct mutable_item_ref
+{
+	span<char const> v;
+	span<char const> salt;
+	sequence_number seq;
+	public_key pk;
+	signature sig;
+};
+
+// verifies the signatures of all ``items``, as a batch. Element i of the
+// returned vector is true if the signature of ``items[i]`` is valid. When the
+// batch contains invalid signatures, it's split in halves that are verified
+// separately, until the invalid ones are found
+TORRENT_EXTRA_EXPORT std::vector<bool> verify_mutable_items(
+	span<mutable_item_ref const> items);
+
 // TODO: since this is a public function, it should probably be moved
 // out of this header and into one with other public functions.
 
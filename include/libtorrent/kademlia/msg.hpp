@@ -33,6 +33,8 @@ POSSIBILITY OF SUCH DAMAGE.
 #ifndef TORRENT_KADEMLIA_MSG_HPP
 #define TORRENT_KADEMLIA_MSG_HPP
 
+#include <cstdint>
+
 #include "libtorrent/socket.hpp"
 #include "libtorrent/span.hpp"
 
@@ -52,6 +54,12 @@ struct msg
 	// the address of the process sending or receiving
 	// the message.
 	udp::endpoint addr;
+
+	// for mutable puts whose signature was verified up-front, as part of a
+	// batch, this is the outcome. Otherwise the signature is verified when
+	// the put is handled
+	enum class signature_state : std::uint8_t { unverified, valid, invalid };
+	signature_state sig = signature_state::unverified;
 private:
 	// explicitly disallow assignment, to silence msvc warning
 	msg& operator=(msg const&);
@@ -82,6 +90,9 @@ struct key_desc_t
 	};
 };
 
+// the client identifier sent in the "v" field of every outgoing message
+TORRENT_EXTRA_EXPORT extern char const client_version[4];
+
 // TODO: move this to its own .hpp/.cpp pair?
 TORRENT_EXTRA_EXPORT bool verify_message_impl(bdecode_node const& msg, span<key_desc_t const> desc
 	, span<bdecode_node> ret, span<char> error);
@@ -79,6 +79,11 @@ struct udp_socket_interface
 {
 	virtual bool has_quota() = 0;
 	virtual bool send_packet(entry& e, udp::endpoint const& addr) = 0;
+
+	// sends a message that has already been bencoded, including its "v"
+	// field. The default implementation decodes it and passes it on to
+	// send_packet()
+	virtual bool send_raw_packet(span<char const> buf, udp::endpoint const& addr);
 protected:
 	~udp_socket_interface() {}
 };
@@ -91,7 +96,8 @@ public:
 		, node_id const& nid
 		, dht_observer* observer, counters& cnt
 		, std::map<std::string, node*> const& nodes
-		, dht_storage_interface& storage);
+		, dht_storage_interface& storage
+		, boost::pool<>* observer_pool = nullptr);
 
 	~node();
 
@@ -137,6 +143,10 @@ public:
 	void direct_request(udp::endpoint const& ep, entry& e
 		, std::function<void(msg const&)> f);
 
+	void sample_infohashes(sha1_hash const& target
+		, std::function<void(udp::endpoint const&, time_duration
+			, int, std::vector<sha1_hash> const&)> f);
+
 	void get_item(sha1_hash const& target, std::function<void(item const&)> f);
 	void get_item(public_key const& pk, std::string const& salt, std::function<void(item const&, bool)> f);
 
@@ -145,6 +155,13 @@ public:
 		, std::function<void(item const&, int)> f
 		, std::function<void(item&)> data_cb);
 
+	// like put_item() above, but data_cb completes asynchronously by calling
+	// the function it's passed with the new item to store. This is used to
+	// sign the item on another thread
+	void put_item_async(public_key const& pk, std::string const& salt
+		, std::function<void(item const&, int)> f
+		, std::function<void(item&, std::function<void(item const&)>)> data_cb);
+
 	bool verify_token(string_view token, sha1_hash const& info_hash
 		, udp::endpoint const& addr) const;
 
@@ -179,6 +196,9 @@ public:
 	void status(std::vector<dht_routing_bucket>& table
 		, std::vector<dht_lookup>& requests);
 
+	// the number of requests in flight, summed over all running lookups
+	int num_outstanding_requests() const;
+
 	std::tuple<int, int, int> get_stats_counters() const;
 
 #ifndef TORRENT_NO_DEPRECATE
@@ -213,7 +233,7 @@ private:
 
 	libtorrent::dht_settings const& m_settings;
 
-	std::mutex m_mutex;
+	mutable std::mutex m_mutex;
 
 	// this list must be destructed after the rpc manager
 	// since it might have references to it
@@ -221,6 +241,11 @@ private:
 
 	void incoming_request(msg const& h, entry& e);
 
+	// replies to ping requests by bencoding the response straight into a
+	// stack buffer, without building an entry. Returns false if the
+	// request needs to go through incoming_request() instead
+	bool incoming_ping(msg const& m);
+
 	void write_nodes_entries(sha1_hash const& info_hash
 		, bdecode_node const& want, entry& r);
 
@@ -49,6 +49,11 @@ struct TORRENT_EXTRA_EXPORT node_entry
 	node_entry();
 	void update_rtt(int new_rtt);
 
+	// the number of milliseconds to wait for a response from this node
+	// before considering the request slow. It's derived from the smoothed
+	// RTT and its variance, and is -1 if we haven't measured the RTT yet
+	int request_timeout() const;
+
 	bool pinged() const { return timeout_count != 0xff; }
 	void set_pinged() { if (timeout_count == 0xff) timeout_count = 0; }
 	void timed_out() { if (pinged() && timeout_count < 0xfe) ++timeout_count; }
@@ -73,6 +78,9 @@ struct TORRENT_EXTRA_EXPORT node_entry
 	// the average RTT of this node
 	std::uint16_t rtt;
 
+	// the average deviation of the RTT samples from ``rtt``
+	std::uint16_t rtt_var;
+
 	// the number of times this node has failed to
 	// respond in a row
 	std::uint8_t timeout_count;
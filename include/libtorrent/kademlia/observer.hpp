@@ -55,6 +55,7 @@ struct TORRENT_EXTRA_EXPORT observer : boost::noncopyable
 		, m_id(id)
 		, m_port(0)
 		, m_transaction_id()
+		, m_short_timeout(1000)
 		, flags(0)
 	{
 		TORRENT_ASSERT(a);
@@ -108,6 +109,12 @@ struct TORRENT_EXTRA_EXPORT observer : boost::noncopyable
 	std::uint16_t transaction_id() const
 	{ return m_transaction_id; }
 
+	// the number of milliseconds after which short_timeout() is called
+	void set_short_timeout(int ms)
+	{ m_short_timeout = std::uint16_t(ms); }
+
+	int short_timeout_ms() const { return m_short_timeout; }
+
 	enum {
 		flag_queried = 1,
 		flag_initial = 2,
@@ -146,6 +153,9 @@ private:
 
 	// the transaction ID for this call
 	std::uint16_t m_transaction_id;
+
+	// milliseconds until this request is considered slow
+	std::uint16_t m_short_timeout;
 public:
 	std::uint8_t flags;
 
@@ -54,7 +54,11 @@ struct put_data: traversal_algorithm
 	virtual char const* name() const override;
 	virtual void start() override;
 
-	void set_data(item const& data) { m_data = data; }
+	void set_data(item const& data);
+
+	// the data will be signed asynchronously and passed in by a later call
+	// to set_data(). Until then, start() is deferred
+	void wait_for_data() { m_waiting_for_data = true; }
 
 	void set_targets(std::vector<std::pair<node_entry, std::string>> const& targets);
 
@@ -66,6 +70,8 @@ protected:
 	put_callback m_put_callback;
 	item m_data;
 	bool m_done = false;
+	bool m_waiting_for_data = false;
+	bool m_start_deferred = false;
 };
 
 struct put_data_observer : traversal_observer
@@ -211,6 +211,10 @@ public:
 	// are nearest to the given id.
 	void find_node(node_id const& id, std::vector<node_entry>& l
 		, int options, int count = 0);
+
+	// returns the live node with the given ID and endpoint, or nullptr if
+	// it's not in the table
+	node_entry const* find_live_node(node_id const& id, udp::endpoint const& ep);
 	void remove_node(node_entry* n
 		, table_t::iterator bucket) ;
 
@@ -35,6 +35,7 @@ POSSIBILITY OF SUCH DAMAGE.
 
 #include <unordered_map>
 #include <cstdint>
+#include <memory>
 
 #include "libtorrent/aux_/disable_warnings_push.hpp"
 #include <boost/pool/pool.hpp>
@@ -65,13 +66,21 @@ class TORRENT_EXTRA_EXPORT rpc_manager
 {
 public:
 
+	// observers are allocated from ``pool``, if one is given. It must be
+	// created with observer_size() and outlive this rpc_manager. It lets
+	// every node on the same socket share one pool. If it's null, the
+	// rpc_manager uses a pool of its own
 	rpc_manager(node_id const& our_id
 		, dht_settings const& settings
 		, routing_table& table
 		, udp_socket_interface* sock
-		, dht_logger* log);
+		, dht_logger* log
+		, boost::pool<>* pool = nullptr);
 	~rpc_manager();
 
+	// the size of the allocations made from the observer pool
+	static std::size_t observer_size();
+
 	void unreachable(udp::endpoint const& ep);
 
 	// returns true if the node needs a refresh
@@ -114,7 +123,9 @@ private:
 	void* allocate_observer();
 	void free_observer(void* ptr);
 
-	mutable boost::pool<> m_pool_allocator;
+	// this is used when we're not given a pool to share
+	std::unique_ptr<boost::pool<>> m_own_pool;
+	boost::pool<>& m_pool_allocator;
 
 	std::unordered_multimap<int, observer_ptr> m_transactions;
 
@@ -0,0 +1,81 @@
+/*
+
+Copyright (c) 2017, Arvid Norberg
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions
+are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in
+      the documentation and/or other materials provided with the distribution.
+    * Neither the name of the author nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+#ifndef LIBTORRENT_SAMPLE_INFOHASHES_HPP
+#define LIBTORRENT_SAMPLE_INFOHASHES_HPP
+
+#include <libtorrent/kademlia/find_data.hpp>
+#include <libtorrent/sha1_hash.hpp>
+#include <libtorrent/time.hpp>
+
+#include <vector>
+
+namespace libtorrent { namespace dht {
+
+// a BEP 51 traversal towards target, asking every node it visits for a
+// sample of the info-hashes it stores. Each response is passed to the
+// data callback as it arrives
+struct sample_infohashes : find_data
+{
+	typedef std::function<void(udp::endpoint const& ep, time_duration interval
+		, int num, std::vector<sha1_hash> const& samples)> data_callback;
+
+	sample_infohashes(node& dht_node, node_id const& target
+		, data_callback const& dcallback);
+
+	void got_samples(udp::endpoint const& ep, time_duration interval
+		, int num, std::vector<sha1_hash> const& samples);
+
+	virtual char const* name() const;
+
+protected:
+	virtual bool invoke(observer_ptr o);
+	virtual observer_ptr new_observer(udp::endpoint const& ep
+		, node_id const& id);
+
+	data_callback m_data_callback;
+};
+
+struct sample_infohashes_observer : find_data_observer
+{
+	sample_infohashes_observer(
+		std::shared_ptr<traversal_algorithm> const& algorithm
+		, udp::endpoint const& ep, node_id const& id)
+		: find_data_observer(algorithm, ep, id)
+	{}
+
+	virtual void reply(msg const&);
+};
+
+} } // namespace libtorrent::dht
+
+#endif // LIBTORRENT_SAMPLE_INFOHASHES_HPP
@@ -0,0 +1,101 @@
+/*
+
+Copyright (c) 2017, Arvid Norberg
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions
+are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in
+      the documentation and/or other materials provided with the distribution.
+    * Neither the name of the author nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+
+#ifndef TORRENT_DHT_SIGNING_POOL_HPP
+#define TORRENT_DHT_SIGNING_POOL_HPP
+
+#include "libtorrent/config.hpp"
+#include "libtorrent/disk_io_thread_pool.hpp"
+#include "libtorrent/entry.hpp"
+#include "libtorrent/io_service.hpp"
+#include "libtorrent/kademlia/item.hpp"
+
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <condition_variable>
+
+namespace libtorrent { namespace dht {
+
+	// signs mutable items on worker threads, to keep the cost of ed25519
+	// off the network thread when publishing many items. The signed item
+	// is passed to the handler via the io_service the pool was
+	// constructed with.
+	struct TORRENT_EXTRA_EXPORT signing_pool final : pool_thread_interface
+	{
+		using handler_t = std::function<void(item const&)>;
+
+		explicit signing_pool(io_service& ios);
+		~signing_pool();
+
+		void set_max_threads(int i);
+
+		void async_sign(entry value, std::string salt
+			, sequence_number seq, public_key const& pk
+			, secret_key const& sk, handler_t handler);
+
+		// drop all queued jobs and stop the worker threads. Handlers of
+		// dropped jobs are never called
+		void abort();
+
+	private:
+
+		void notify_all() override;
+		void thread_fun(disk_io_thread_pool& pool, io_service::work work) override;
+
+		struct job
+		{
+			entry value;
+			std::string salt;
+			sequence_number seq;
+			public_key pk;
+			secret_key sk;
+			handler_t handler;
+		};
+
+		io_service& m_ios;
+
+		std::mutex m_mutex;
+		std::condition_variable m_cond;
+
+		// protected by m_mutex
+		std::deque<job> m_jobs;
+		bool m_abort = false;
+
+		// this must be last, to make sure the threads are stopped before
+		// the members they access are destructed
+		disk_io_thread_pool m_threads;
+	};
+}}
+
+#endif
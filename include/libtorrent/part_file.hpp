@@ -36,7 +36,6 @@ POSSIBILITY OF SUCH DAMAGE.
 #include <string>
 #include <vector>
 #include <mutex>
-#include <unordered_map>
 #include <cstdint>
 
 #include "libtorrent/config.hpp"
@@ -79,6 +78,22 @@ namespace libtorrent {
 		void open_file(std::uint32_t mode, error_code& ec);
 		void flush_metadata_impl(error_code& ec);
 
+		// writes the slot entries for the pieces [first, last] to the header
+		void write_slot_entries(piece_index_t first, piece_index_t last
+			, error_code& ec);
+
+		struct piece_slot
+		{
+			piece_index_t piece;
+			slot_index_t slot;
+		};
+
+		// returns the entry for the specified piece, or m_piece_map.end()
+		std::vector<piece_slot>::iterator find_piece(piece_index_t piece);
+
+		// record that the slot entry for this piece has changed
+		void mark_dirty(piece_index_t piece);
+
 		std::string m_path;
 		std::string m_name;
 
@@ -114,8 +129,20 @@ namespace libtorrent {
 		// need to flush the metadata before closing the file
 		bool m_dirty_metadata = false;
 
-		// maps a piece index to the part-file slot it is stored in
-		std::unordered_map<piece_index_t, slot_index_t> m_piece_map;
+		// this is true when the file on disk has a complete and valid header.
+		// As long as it does, flushing the metadata only needs to update the
+		// slot entries of the pieces in m_dirty_pieces
+		bool m_header_on_disk = false;
+
+		// the pieces whose slot entries in the header have changed since we
+		// last flushed the metadata. May contain duplicates
+		std::vector<piece_index_t> m_dirty_pieces;
+
+		// maps a piece index to the part-file slot it is stored in. This is
+		// kept sorted by piece index. The part file typically only holds a
+		// small number of pieces, and this is a lot more compact than a hash
+		// table
+		std::vector<piece_slot> m_piece_map;
 
 		// this is the file handle to the part file
 		file m_file;
@@ -61,6 +61,10 @@ namespace libtorrent {
 
 	TORRENT_EXTRA_EXPORT std::array<char, 96> export_key(key_t const& k);
 
+	// returns (base ^ exponent) % P, where P is the 768 bit prime used by the
+	// encrypted handshake
+	TORRENT_EXTRA_EXPORT key_t dh_powm(key_t const& base, key_t const& exponent);
+
 	// RC4 state from libtomcrypt
 	struct rc4 {
 		int x, y;
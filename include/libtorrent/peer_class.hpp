@@ -88,6 +88,25 @@ namespace libtorrent {
 		// exceed 255.
 		int upload_priority;
 		int download_priority;
+
+		// ``utp_cubic`` selects the congestion controller used by uTP
+		// connections to peers in this class. By default uTP uses LEDBAT,
+		// which yields to other traffic by backing off as soon as it sees
+		// queuing delay. When this is true, a CUBIC style controller is used
+		// instead, which only backs off on packet loss. This is meant for
+		// transfers over links dedicated to bittorrent traffic, where LEDBAT
+		// is too conservative to fill the pipe. If *any* of the peer classes
+		// a peer belongs to has this set to true, its uTP connection uses
+		// CUBIC.
+		bool utp_cubic;
+
+		// ``alert_mask`` enables additional alert categories (see
+		// alert::category_t) for peers in this class, on top of the
+		// session-wide settings_pack::alert_mask. This makes it possible to
+		// get, say, peer_log_alert for a few peers of interest without paying
+		// for logging every peer in the session. Only alerts posted on behalf
+		// of a peer are affected. Defaults to 0.
+		std::uint32_t alert_mask;
 	};
 
 	struct TORRENT_EXTRA_EXPORT peer_class
@@ -97,6 +116,8 @@ namespace libtorrent {
 		explicit peer_class(std::string l)
 			: ignore_unchoke_slots(false)
 			, connection_limit_factor(100)
+			, utp_cubic(false)
+			, alert_mask(0)
 			, label(std::move(l))
 			, in_use(true)
 			, references(1)
@@ -123,6 +144,8 @@ namespace libtorrent {
 
 		bool ignore_unchoke_slots;
 		int connection_limit_factor;
+		bool utp_cubic;
+		std::uint32_t alert_mask;
 
 		// priority for bandwidth allocation
 		// in rate limiter. One for upload and one
@@ -147,6 +170,13 @@ namespace libtorrent {
 		peer_class* at(peer_class_t c);
 		peer_class const* at(peer_class_t c) const;
 
+		// one past the highest peer class index in use
+		peer_class_t end_index() const { return m_peer_classes.end_index(); }
+
+		// returns a number that has not been returned before. peer_class_set
+		// uses it to tag every change to its set of classes
+		std::uint32_t next_generation() { return ++m_generation; }
+
 	private:
 
 		// state for peer classes (a peer can belong to multiple classes)
@@ -155,6 +185,9 @@ namespace libtorrent {
 
 		// indices in m_peer_classes that are no longer used
 		std::vector<peer_class_t> m_free_list;
+
+		// the last generation returned by next_generation()
+		std::uint32_t m_generation = 0;
 	};
 }
 
@@ -53,11 +53,20 @@ namespace libtorrent {
 			return m_class[i];
 		}
 
+		// this changes every time a class is added to or removed from the
+		// set. The values come from the peer_class_pool, so two sets only
+		// have the same generation if neither has ever been changed, in
+		// which case they're both empty. This lets users cache what they
+		// derive from the set of classes
+		std::uint32_t class_generation() const { return m_generation; }
+
 	private:
 
 		// the number of elements used in the m_class array
 		std::int8_t m_size;
 
+		std::uint32_t m_generation = 0;
+
 		// if this object belongs to any peer-class, this vector contains all
 		// class IDs. Each ID refers to a an entry in m_ses.m_peer_classes which
 		// holds the metadata about the class. Classes affect bandwidth limits
@@ -38,6 +38,7 @@ POSSIBILITY OF SUCH DAMAGE.
 #include "libtorrent/peer_id.hpp"
 #include "libtorrent/stat.hpp"
 #include "libtorrent/alert.hpp"
+#include "libtorrent/alert_manager.hpp"
 #include "libtorrent/peer_request.hpp"
 #include "libtorrent/piece_block_progress.hpp"
 #include "libtorrent/bandwidth_limit.hpp"
@@ -65,6 +66,8 @@ POSSIBILITY OF SUCH DAMAGE.
 #include "libtorrent/piece_block.hpp"
 #include "libtorrent/peer_info.hpp"
 #include "libtorrent/aux_/vector.hpp"
+#include "libtorrent/aux_/extension_list.hpp"
+#include "libtorrent/aux_/upload_scheduler.hpp"
 
 #include <ctime>
 #include <algorithm>
@@ -339,6 +342,14 @@ namespace aux {
 		void request_large_blocks(bool b)
 		{ m_request_large_blocks = b; }
 
+		// the number of blocks to keep requested, regardless of the download
+		// rate. This lets web seeds keep several HTTP requests in flight
+		// from the start, rather than waiting a round-trip between each of
+		// them until the rate estimate has caught up. 0 means the queue size
+		// is only determined by the download rate
+		void min_desired_queue_size(int blocks)
+		{ m_min_desired_queue_size = blocks; }
+
 		void set_endgame(bool b);
 		bool endgame() const { return m_endgame_mode; }
 
@@ -364,6 +375,9 @@ namespace aux {
 		// this will tell the peer to announce the given piece
 		// and only allow it to request that piece
 		void superseed_piece(piece_index_t replace_piece, piece_index_t new_piece);
+		std::array<piece_index_t, 2> const& super_seeded_pieces() const
+		{ return m_superseed_piece; }
+
 		bool super_seeded_piece(piece_index_t index) const
 		{
 			return m_superseed_piece[0] == index
@@ -406,6 +420,10 @@ namespace aux {
 		// bytes as if they've been requested
 		time_duration download_queue_time(int extra_bytes = 0) const;
 
+		// the average time, in milliseconds, from sending a request to
+		// receiving the block
+		int rtt() const { return m_request_time.mean(); }
+
 		bool is_interesting() const { return m_interesting; }
 		bool is_choked() const override { return m_choked; }
 
@@ -418,6 +436,7 @@ namespace aux {
 		void update_interest();
 
 		void get_peer_info(peer_info& p) const override;
+		void get_peer_sample(peer_sample& s) const;
 
 		// returns the torrent this connection is a part of
 		// may be zero if the connection is an incoming connection
@@ -490,6 +509,10 @@ namespace aux {
 		bool on_local_network() const;
 		bool ignore_unchoke_slots() const;
 
+		// if this is a uTP connection, select its congestion controller
+		// based on the peer classes of this peer and its torrent
+		void update_utp_congestion_control();
+
 		bool failed() const override { return m_failed; }
 
 		int desired_queue_size() const
@@ -518,6 +541,19 @@ namespace aux {
 		void decrease_est_reciprocation_rate();
 		int est_reciprocation_rate() const { return m_est_reciprocation_rate; }
 
+		// returns true if an alert of type T, posted on behalf of this peer,
+		// would be delivered. On top of the session's alert mask, this takes
+		// the alert masks of the torrent and the peer classes into account
+		template <class T>
+		bool should_post() const
+		{ return alerts().should_post<T>(extra_alert_mask(T::static_category)); }
+
+		alert_manager& alerts() const;
+
+		// the alert categories enabled specifically for this peer (by its
+		// torrent or peer classes), limited to the ones in ``category``
+		std::uint32_t extra_alert_mask(std::uint32_t category) const;
+
 #ifndef TORRENT_DISABLE_LOGGING
 		bool should_log(peer_log_alert::direction_t direction) const override;
 		void peer_log(peer_log_alert::direction_t direction
@@ -552,6 +588,19 @@ namespace aux {
 		void start_receive_piece(peer_request const& r);
 		void incoming_cancel(peer_request const& r);
 
+		// called by the protocol layer once it has received the header of a
+		// piece message, and ``received`` bytes of its payload. If this returns
+		// true, the rest of the payload is read from the socket directly into
+		// a disk buffer, and passed on to incoming_piece() from there. The
+		// protocol layer should expect the next message instead.
+		bool start_direct_receive(peer_request const& r, span<char const> received);
+
+		// the piece message whose payload is being received directly into a
+		// disk buffer, if any, and the number of payload bytes received
+		bool direct_receive_active() const { return bool(m_direct_recv_buffer); }
+		peer_request const& direct_receive_request() const { return m_direct_recv_request; }
+		int direct_receive_pos() const { return m_direct_recv_pos; }
+
 		bool can_disconnect(error_code const& ec) const;
 		void incoming_dht_port(int listen_port);
 
@@ -601,8 +650,30 @@ namespace aux {
 		void cancel_request(piece_block const& b, bool force = false);
 		void send_block_requests();
 
+		// called by the upload scheduler when this peer was waiting for a
+		// cold read to complete, to have it issue reads again
+		void cold_read_slot_available();
+
+		// called by the torrent when it has verified a piece, in seed mode,
+		// in case this peer has requests waiting for it
+		void seed_mode_piece_verified();
+
 		void assign_bandwidth(int channel, int amount) override;
 
+		// when send_pacing is enabled, ask the kernel to spread out the
+		// quota we were just assigned over the rate limiter tick, rather
+		// than writing it to the wire in a single burst. A rate of 0 means
+		// unlimited
+		void set_pacing_rate(int rate);
+
+		// sets TCP_NOTSENT_LOWAT on the socket, if enabled by
+		// send_not_sent_low_watermark
+		void set_notsent_lowat();
+
+		// sets TCP_FASTOPEN_CONNECT on the socket of an outgoing
+		// connection, if enabled by outgoing_tcp_fast_open
+		void set_tcp_fast_open();
+
 #if TORRENT_USE_INVARIANT_CHECKS
 		void check_invariant() const;
 #endif
@@ -623,6 +694,11 @@ namespace aux {
 		void send_buffer(char const* begin, int size, int flags = 0);
 		void setup_send();
 
+		// copies the buffer into the send buffer (filling up the last buffer
+		// first, then using buffers from the session's pool) without
+		// initiating a send
+		void copy_send_buffer(char const* buf, int size);
+
 		template <typename Holder>
 		void append_send_buffer(Holder buffer, int size)
 		{
@@ -709,6 +785,13 @@ namespace aux {
 		virtual void on_sent(error_code const& error
 			, std::size_t bytes_transferred) = 0;
 
+		// called before received bytes are fed to on_receive(), with the
+		// number of bytes not yet passed on. A connection class may parse
+		// complete messages straight out of the receive buffer here, as long
+		// as it accounts for them itself (received_bytes()). Returns the
+		// number of bytes it consumed
+		virtual int on_receive_batch(int /* bytes */) { return 0; }
+
 		void send_piece_suggestions(int num);
 
 		virtual
@@ -744,16 +827,23 @@ namespace aux {
 			, std::size_t bytes_transferred);
 		void on_receive_data(error_code const& error
 			, std::size_t bytes_transferred);
+		void on_receive_direct(error_code const& error
+			, std::size_t bytes_transferred);
 
 		void account_received_bytes(int bytes_transferred);
 
+		// updates the receive_buffer_bytes gauge after the receive buffer may
+		// have been reallocated
+		void update_recv_buffer_memory();
+
 		// explicitly disallow assignment, to silence msvc warning
 		peer_connection& operator=(peer_connection const&);
 
 		void do_update_interest();
 		void fill_send_buffer();
 		void on_disk_read_complete(disk_buffer_holder disk_block, int flags
-			, storage_error const& error, peer_request const& r, time_point issue_time);
+			, storage_error const& error, peer_request const& r, time_point issue_time
+			, aux::upload_scheduler::piece_key piece_key);
 		void on_disk_write_complete(storage_error const& error
 			, peer_request const &r, std::shared_ptr<torrent> t);
 		void on_seed_mode_hashed(piece_index_t piece
@@ -764,6 +854,10 @@ namespace aux {
 		int wanted_transfer(int channel);
 		int request_bandwidth(int channel, int bytes = 0);
 
+		// collects the peer classes of this connection and of the torrent
+		// into m_bw_classes
+		void update_bandwidth_classes(torrent const* t);
+
 		std::shared_ptr<socket_type> m_socket;
 
 		// the queue of blocks we have requested
@@ -798,9 +892,34 @@ namespace aux {
 	protected:
 		receive_buffer m_recv_buffer;
 
+		// the capacity of m_recv_buffer, last time it was accounted for in the
+		// receive_buffer_bytes gauge
+		int m_recv_buffer_memory = 0;
+
+		// when the payload of a piece message is being received directly into
+		// a disk buffer (see start_direct_receive()), this is the buffer, the
+		// request it belongs to and the number of payload bytes received so far.
+		// m_direct_recv_exceeded is set if the disk cache was over its limit
+		// when the buffer was allocated
+		disk_buffer_holder m_direct_recv_buffer;
+		peer_request m_direct_recv_request;
+		int m_direct_recv_pos = 0;
+		bool m_direct_recv_exceeded = false;
+
 		// number of bytes this peer can send and receive
 		int m_quota[2];
 
+		// the SO_MAX_PACING_RATE currently set on the socket, in bytes per
+		// second. 0 means no pacing rate has been set
+		int m_pacing_rate = 0;
+
+		// the peer classes of this connection followed by the ones of its
+		// torrent, as of the class generations below. request_bandwidth()
+		// only collects them again when either set of classes has changed
+		std::vector<peer_class*> m_bw_classes;
+		std::uint32_t m_bw_classes_generation = 0;
+		std::uint32_t m_bw_torrent_classes_generation = 0;
+
 		// the blocks we have reserved in the piece
 		// picker and will request from this peer.
 		std::vector<pending_block> m_request_queue;
@@ -830,7 +949,7 @@ namespace aux {
 
 	protected:
 #ifndef TORRENT_DISABLE_EXTENSIONS
-		std::list<std::shared_ptr<peer_plugin>> m_extensions;
+		aux::extension_list<peer_plugin> m_extensions;
 #endif
 	private:
 
@@ -844,6 +963,12 @@ namespace aux {
 		// receive a payload message after it has been requested.
 		sliding_average<20> m_request_time;
 
+		// the time it takes from sending a request to a peer whose request
+		// queue was empty, until receiving the block. Unlike m_request_time,
+		// this is not diluted by pipelined requests, and approximates the
+		// round-trip time (plus the transfer time of a single block)
+		sliding_average<20> m_round_trip_time;
+
 		// keep the io_service running as long as we
 		// have peer connections
 		io_service::work m_work;
@@ -1056,6 +1181,10 @@ namespace aux {
 		// are preferred.
 		int m_prefer_contiguous_blocks = 0;
 
+		// the min number of blocks to keep requested. See
+		// min_desired_queue_size()
+		int m_min_desired_queue_size = 0;
+
 		// this is the number of times this peer has had
 		// a request rejected because of a disk I/O failure.
 		// once this reaches a certain threshold, the
@@ -1159,6 +1288,14 @@ namespace aux {
 		// outstanding requests need to increase at the same pace to keep up.
 		bool m_slow_start:1;
 
+		// set when a request was sent on an empty request queue. The time
+		// until that block arrives is a sample for m_round_trip_time
+		bool m_rtt_probe:1;
+
+		// set while this peer is in the upload scheduler's list of peers
+		// waiting for a cold read to complete
+		bool m_waiting_for_cold_read:1;
+
 		template <class Handler>
 		aux::allocating_handler<Handler, TORRENT_READ_HANDLER_MAX_SIZE>
 			make_read_handler(Handler const& handler)
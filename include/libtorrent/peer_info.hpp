@@ -440,6 +440,38 @@ namespace libtorrent {
 		std::uint8_t source;
 	};
 
+	// a compact snapshot of a peer connection, posted in peer_sample_alert.
+	// Unlike peer_info, it's fixed-size and doesn't own any memory, which
+	// makes it cheap to collect for every connected peer.
+	struct TORRENT_EXPORT peer_sample
+	{
+		// the torrent the peer is connected to
+		sha1_hash info_hash;
+
+		// the IP and port of the peer
+		tcp::endpoint ip;
+
+		// the upload and download rates to and from the peer, in bytes per
+		// second, including protocol overhead
+		int up_rate;
+		int down_rate;
+
+		// the number of blocks we have requested from the peer (including
+		// the ones not yet sent) and the number of blocks the peer has
+		// requested from us
+		int download_queue_length;
+		int upload_queue_length;
+
+		// the number of bytes we are waiting for the peer to send us and the
+		// number of bytes in our send buffer to the peer
+		int queue_bytes;
+		int send_buffer_bytes;
+
+		// the estimated round-trip time of requests to the peer, in
+		// milliseconds
+		int rtt;
+	};
+
 }
 
 #endif // TORRENT_PEER_INFO_HPP_INCLUDED
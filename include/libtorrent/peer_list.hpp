@@ -46,7 +46,9 @@ POSSIBILITY OF SUCH DAMAGE.
 #include "libtorrent/config.hpp"
 #include "libtorrent/debug.hpp"
 #include "libtorrent/peer_connection_interface.hpp"
-#include "libtorrent/aux_/deque.hpp"
+
+#include <vector>
+#include <cstdint>
 
 namespace libtorrent {
 
@@ -86,8 +88,8 @@ namespace libtorrent {
 		// the number of iterations over the peer list for this operation
 		int loop_counter;
 
-		// these are used only by find_connect_candidates in order
-		// to implement peer ranking. See:
+		// these are used by the peer_list to rank connect candidates,
+		// in order to implement peer ranking. See:
 		// http://blog.libtorrent.org/2012/12/swarm-connectivity/
 		external_ip ip;
 		int port;
@@ -167,7 +169,9 @@ namespace libtorrent {
 
 		int num_peers() const { return int(m_peers.size()); }
 
-		using peers_t = aux::deque<torrent_peer*>;
+		// the peers are not kept in any particular order. Erasing a peer
+		// moves the last peer into its place
+		using peers_t = std::vector<torrent_peer*>;
 		using iterator = peers_t::iterator;
 		using const_iterator = peers_t::const_iterator;
 		iterator begin() { return m_peers.begin(); }
@@ -175,21 +179,9 @@ namespace libtorrent {
 		const_iterator begin() const { return m_peers.begin(); }
 		const_iterator end() const { return m_peers.end(); }
 
-		std::pair<iterator, iterator> find_peers(address const& a)
-		{
-#if TORRENT_USE_I2P
-			if (a == address())
-				return std::pair<iterator, iterator>(m_peers.end(), m_peers.end());
-#endif
-			return std::equal_range(
-				m_peers.begin(), m_peers.end(), a, peer_address_compare());
-		}
-
-		std::pair<const_iterator, const_iterator> find_peers(address const& a) const
-		{
-			return std::equal_range(
-				m_peers.begin(), m_peers.end(), a, peer_address_compare());
-		}
+		// returns all peers with the address ``a``. There is more than one
+		// only when multiple connections per IP are allowed
+		std::vector<torrent_peer*> find_peers(address const& a) const;
 
 		torrent_peer* connect_one_peer(int session_time, torrent_state* state);
 
@@ -207,18 +199,52 @@ namespace libtorrent {
 
 		void recalculate_connect_candidates(torrent_state* state);
 
-		void update_connect_candidates(int delta);
+		// adds, removes or re-sorts p in the connect candidate index,
+		// depending on whether it is a connect candidate now
+		void update_candidate(torrent_peer const* p);
+		void update_candidate(int idx);
 
 		void update_peer(torrent_peer* p, int src, int flags
 		, tcp::endpoint const& remote, char const* destination);
-		bool insert_peer(torrent_peer* p, iterator iter, int flags, torrent_state* state);
+		bool insert_peer(torrent_peer* p, int flags, torrent_state* state);
 
-		bool compare_peer_erase(torrent_peer const& lhs, torrent_peer const& rhs) const;
-		bool compare_peer(torrent_peer const* lhs, torrent_peer const* rhs
-			, external_ip const& external, int source_port) const;
+		// hash index of m_peers, by IP (or i2p destination)
+		static std::uint32_t peer_hash(torrent_peer const& p);
+		static std::uint32_t address_hash(address const& a);
+#if TORRENT_USE_I2P
+		static std::uint32_t destination_hash(char const* dest);
+#endif
+		// returns the index into m_peers of p, or -1 if it's not in the list
+		int peer_index(torrent_peer const* p) const;
+		// returns the index into m_peers of the first peer with address a
+		// (and port, if it's not 0), or -1
+		int find_peer(address const& a, int port = 0) const;
+#if TORRENT_USE_I2P
+		int find_i2p_peer(char const* destination) const;
+#endif
+		int find_slot(int idx) const;
+		void index_insert(int idx);
+		void index_erase(int idx);
+		void grow_index();
 
-		void find_connect_candidates(std::vector<torrent_peer*>& peers
-			, int session_time, torrent_state* state);
+		// the connect candidate index
+		struct candidate_entry
+		{
+			// see candidate_key(). Lower is better
+			std::uint64_t key;
+			// index into m_peers
+			std::uint32_t peer;
+		};
+		std::uint64_t candidate_key(torrent_peer const& p) const;
+		int candidate_bucket(torrent_peer const& p) const;
+		void candidate_insert(int idx);
+		void candidate_erase(int idx);
+		void candidate_set(int bucket, int pos, candidate_entry e);
+		void candidate_sift_up(int bucket, int pos);
+		void candidate_sift_down(int bucket, int pos);
+		void rebuild_candidates();
+
+		bool compare_peer_erase(torrent_peer const& lhs, torrent_peer const& rhs) const;
 
 		bool is_connect_candidate(torrent_peer const& p) const;
 		bool is_erase_candidate(torrent_peer const& p) const;
@@ -230,6 +256,42 @@ namespace libtorrent {
 
 		peers_t m_peers;
 
+		// open addressing hash table, with linear probing, of the peers in
+		// m_peers, keyed by their address. Each slot is an index into
+		// m_peers + 1, 0 means the slot is empty. The size is always a power
+		// of two, and at least twice the number of peers
+		std::vector<std::uint32_t> m_index;
+
+		// connect candidates are kept in one binary min-heap per combination
+		// of failcount and whether the peer is on the local network, in that
+		// order of preference. m_candidates[failcount * 2 + !local]. Within a
+		// heap, peers are ordered by last connection attempt (oldest first),
+		// then source and then peer rank, see candidate_key(). Since the
+		// reconnect timeout only depends on the failcount, if the top of a
+		// heap isn't ready to be connected to yet, no other peer in it is.
+		// This replaces scanning the peer list for candidates, which doesn't
+		// scale to torrents with a very large number of known peers
+		std::vector<std::vector<candidate_entry>> m_candidates;
+
+		// for each peer in m_peers, where it is in m_candidates. 0 means it's
+		// not a connect candidate. Otherwise the low 6 bits are the heap and
+		// the remaining bits are the position in the heap + 1
+		std::vector<std::uint32_t> m_candidate_pos;
+
+		// one bit per heap in m_candidates, set if the heap is not empty.
+		// This lets connect_one_peer() skip straight to the heaps that have
+		// candidates in them rather than visiting all 64 of them
+		std::uint64_t m_candidate_buckets;
+
+		// the external address and port used to compute the rank of peers.
+		// They're cached here since the candidate index must be maintained
+		// even by operations that aren't given the torrent_state. When
+		// m_ranks_dirty is set, the ranks in m_candidates will be recomputed
+		// with the current external address before picking the next peer
+		external_ip m_external;
+		int m_external_port;
+		bool m_ranks_dirty;
+
 		// this should be nullptr for the most part. It's set
 		// to point to a valid torrent_peer object if that
 		// object needs to be kept alive. If we ever feel
@@ -251,13 +313,6 @@ namespace libtorrent {
 		// recalculate the connect candidates.
 		std::uint32_t m_finished:1;
 
-		// since the torrent_peer list can grow too large
-		// to scan all of it, start at this index
-		int m_round_robin;
-
-		// a list of good connect candidates
-		std::vector<torrent_peer*> m_candidate_cache;
-
 		// The number of peers in our torrent_peer list
 		// that are connect candidates. i.e. they're
 		// not already connected and they have not
@@ -40,6 +40,15 @@ POSSIBILITY OF SUCH DAMAGE.
 #include <atomic>
 #include <mutex>
 
+// when atomic 64 bit integers are available, the monotonic counters are
+// sharded across threads, to avoid threads incrementing counters on the same
+// cache lines. Define TORRENT_DISABLE_SHARDED_COUNTERS to keep a single copy
+#if defined ATOMIC_LLONG_LOCK_FREE && !defined TORRENT_DISABLE_SHARDED_COUNTERS
+#define TORRENT_SHARDED_COUNTERS 1
+#else
+#define TORRENT_SHARDED_COUNTERS 0
+#endif
+
 namespace libtorrent {
 
 	struct TORRENT_EXTRA_EXPORT counters
@@ -101,6 +110,12 @@ namespace libtorrent {
 			piece_picker_rand_loops,
 			piece_picker_busy_loops,
 
+			// the number of times the piece picker had to rebuild its
+			// list of pieces, sorted by priority, before picking. This
+			// happens after a change in availability or priority moved
+			// pieces across priority levels
+			piece_picker_rebuilds,
+
 			// reasons to disconnect peers
 			connect_timeouts,
 			uninteresting_peers,
@@ -131,6 +146,13 @@ namespace libtorrent {
 			on_disk_queue_counter,
 			on_disk_counter,
 
+			// handlers run on the network thread, for calls through
+			// session_handle and torrent_handle and the session tick
+			network_handler_calls,
+			network_handler_queue_time,
+			network_handler_exec_time,
+			network_thread_stalls,
+
 #ifndef TORRENT_NO_DEPRECATE
 			torrent_evicted_counter,
 #endif
@@ -178,6 +200,9 @@ namespace libtorrent {
 			num_outgoing_metadata,
 			num_outgoing_extended,
 
+			num_suggested_piece_cache_hits,
+			num_suggested_piece_cache_misses,
+
 			num_piece_passed,
 			num_piece_failed,
 
@@ -191,12 +216,167 @@ namespace libtorrent {
 			num_write_ops,
 			num_read_ops,
 			num_read_back,
+			num_read_back_cache_pressure,
+			num_read_back_expired,
+			num_read_back_flush,
+			num_blocks_read_l2,
+			num_blocks_written_l2,
+			num_blocks_read_shared,
+
+			// the number of times the disk thread pools have been scaled up or
+			// down, with auto_scale_aio_threads
+			disk_threads_scaled_up,
+			disk_threads_scaled_down,
 
 			disk_read_time,
 			disk_write_time,
 			disk_hash_time,
 			disk_job_time,
 
+			// histograms of the time disk jobs spend queued and executing,
+			// by kind of job. Each counter counts the jobs that took less
+			// than 1 << n microseconds, where n is the number at the end of
+			// the counter name, and at least half that. The first counter
+			// also counts shorter jobs, the last one longer jobs
+
+			// 32, 64, 128, 256, 512, 1024, 2048, 4096, 8192, 16384, 32768,
+			// 65536, 131072, 262144, 524288, 1048576
+			disk_read_queue_time5,
+			disk_read_queue_time6,
+			disk_read_queue_time7,
+			disk_read_queue_time8,
+			disk_read_queue_time9,
+			disk_read_queue_time10,
+			disk_read_queue_time11,
+			disk_read_queue_time12,
+			disk_read_queue_time13,
+			disk_read_queue_time14,
+			disk_read_queue_time15,
+			disk_read_queue_time16,
+			disk_read_queue_time17,
+			disk_read_queue_time18,
+			disk_read_queue_time19,
+			disk_read_queue_time20,
+
+			disk_read_exec_time5,
+			disk_read_exec_time6,
+			disk_read_exec_time7,
+			disk_read_exec_time8,
+			disk_read_exec_time9,
+			disk_read_exec_time10,
+			disk_read_exec_time11,
+			disk_read_exec_time12,
+			disk_read_exec_time13,
+			disk_read_exec_time14,
+			disk_read_exec_time15,
+			disk_read_exec_time16,
+			disk_read_exec_time17,
+			disk_read_exec_time18,
+			disk_read_exec_time19,
+			disk_read_exec_time20,
+
+			disk_write_queue_time5,
+			disk_write_queue_time6,
+			disk_write_queue_time7,
+			disk_write_queue_time8,
+			disk_write_queue_time9,
+			disk_write_queue_time10,
+			disk_write_queue_time11,
+			disk_write_queue_time12,
+			disk_write_queue_time13,
+			disk_write_queue_time14,
+			disk_write_queue_time15,
+			disk_write_queue_time16,
+			disk_write_queue_time17,
+			disk_write_queue_time18,
+			disk_write_queue_time19,
+			disk_write_queue_time20,
+
+			disk_write_exec_time5,
+			disk_write_exec_time6,
+			disk_write_exec_time7,
+			disk_write_exec_time8,
+			disk_write_exec_time9,
+			disk_write_exec_time10,
+			disk_write_exec_time11,
+			disk_write_exec_time12,
+			disk_write_exec_time13,
+			disk_write_exec_time14,
+			disk_write_exec_time15,
+			disk_write_exec_time16,
+			disk_write_exec_time17,
+			disk_write_exec_time18,
+			disk_write_exec_time19,
+			disk_write_exec_time20,
+
+			disk_hash_queue_time5,
+			disk_hash_queue_time6,
+			disk_hash_queue_time7,
+			disk_hash_queue_time8,
+			disk_hash_queue_time9,
+			disk_hash_queue_time10,
+			disk_hash_queue_time11,
+			disk_hash_queue_time12,
+			disk_hash_queue_time13,
+			disk_hash_queue_time14,
+			disk_hash_queue_time15,
+			disk_hash_queue_time16,
+			disk_hash_queue_time17,
+			disk_hash_queue_time18,
+			disk_hash_queue_time19,
+			disk_hash_queue_time20,
+
+			disk_hash_exec_time5,
+			disk_hash_exec_time6,
+			disk_hash_exec_time7,
+			disk_hash_exec_time8,
+			disk_hash_exec_time9,
+			disk_hash_exec_time10,
+			disk_hash_exec_time11,
+			disk_hash_exec_time12,
+			disk_hash_exec_time13,
+			disk_hash_exec_time14,
+			disk_hash_exec_time15,
+			disk_hash_exec_time16,
+			disk_hash_exec_time17,
+			disk_hash_exec_time18,
+			disk_hash_exec_time19,
+			disk_hash_exec_time20,
+
+			disk_other_queue_time5,
+			disk_other_queue_time6,
+			disk_other_queue_time7,
+			disk_other_queue_time8,
+			disk_other_queue_time9,
+			disk_other_queue_time10,
+			disk_other_queue_time11,
+			disk_other_queue_time12,
+			disk_other_queue_time13,
+			disk_other_queue_time14,
+			disk_other_queue_time15,
+			disk_other_queue_time16,
+			disk_other_queue_time17,
+			disk_other_queue_time18,
+			disk_other_queue_time19,
+			disk_other_queue_time20,
+
+			disk_other_exec_time5,
+			disk_other_exec_time6,
+			disk_other_exec_time7,
+			disk_other_exec_time8,
+			disk_other_exec_time9,
+			disk_other_exec_time10,
+			disk_other_exec_time11,
+			disk_other_exec_time12,
+			disk_other_exec_time13,
+			disk_other_exec_time14,
+			disk_other_exec_time15,
+			disk_other_exec_time16,
+			disk_other_exec_time17,
+			disk_other_exec_time18,
+			disk_other_exec_time19,
+			disk_other_exec_time20,
+
 			waste_piece_timed_out,
 			waste_piece_cancelled,
 			waste_piece_unknown,
@@ -256,6 +436,10 @@ namespace libtorrent {
 			utp_invalid_pkts_in,
 			utp_redundant_pkts_in,
 
+			// the sum of the queuing delay samples (in microseconds) the uTP
+			// congestion controller has acted on
+			utp_queuing_delay,
+
 			// the buffer sizes accepted by
 			// socket send calls. The larger
 			// the more efficient. The size is
@@ -332,6 +516,21 @@ namespace libtorrent {
 			// IP filter applied to them.
 			non_filter_torrents,
 
+			// the number of bytes of memory used by the piece pickers of
+			// all torrents. Seeds release their piece picker
+			piece_picker_bytes,
+
+			// the number of bytes of memory used by the torrent_info objects,
+			// the peer entries of the peer lists, the send and receive
+			// buffers of peer connections, disk buffers (including the block
+			// cache) and the items stored in the DHT, respectively
+			torrent_info_bytes,
+			peer_list_bytes,
+			send_buffer_bytes,
+			receive_buffer_bytes,
+			disk_buffer_bytes,
+			dht_storage_bytes,
+
 			// these counter indices deliberately
 			// match the order of socket type IDs
 			// defined in socket_type.hpp.
@@ -395,6 +594,14 @@ namespace libtorrent {
 			num_jobs,
 			num_writing_threads,
 			num_running_threads,
+
+			// the number of threads the generic and hash disk thread pools are
+			// sized for, when auto_scale_aio_threads is enabled, and the average
+			// time (in microseconds) jobs waited in the queue during the last
+			// second
+			disk_threads_target,
+			disk_hash_threads_target,
+			disk_queue_wait_time,
 			blocked_disk_jobs,
 			queued_write_bytes,
 			num_unchoke_slots,
@@ -440,6 +647,8 @@ namespace libtorrent {
 			limiter_up_bytes,
 			limiter_down_bytes,
 
+			network_thread_lag,
+
 			// the number of uTP connections in each respective state
 			// these must be defined in the same order as the state_t enum
 			// in utp_stream
@@ -459,7 +668,10 @@ namespace libtorrent {
 		counters(counters const&);
 		counters& operator=(counters const&);
 
-		// returns the new value
+		// returns the new value. For counters (as opposed to gauges) in the
+		// sharded configuration, this is only the value of the calling
+		// thread's shard. Reading the total requires summing all shards, use
+		// operator[] for that
 		std::int64_t inc_stats_counter(int c, std::int64_t value = 1);
 		std::int64_t operator[](int i) const;
 
@@ -469,11 +681,29 @@ namespace libtorrent {
 	private:
 
 		// TODO: some space could be saved here by making gauges 32 bits
-		// TODO: restore these to regular integers. Instead have one copy
-		// of the counters per thread and collect them at convenient
-		// synchronization points
 #ifdef ATOMIC_LLONG_LOCK_FREE
 		aux::array<std::atomic<std::int64_t>, num_counters> m_stats_counter;
+#if TORRENT_SHARDED_COUNTERS
+		// must be a power of two
+		static constexpr int num_shards = 8;
+
+		// the shard the calling thread increments counters in. Threads are
+		// assigned shards round-robin, the first time they touch any counters
+		static int thread_shard();
+
+		// the sum of all shards
+		std::int64_t shard_sum(int c) const;
+
+		// each shard is padded by a cache line, to keep the tail of one from
+		// sharing a cache line with the head of the next
+		using shard_t = aux::array<std::atomic<std::int64_t>
+			, num_stats_counters + 64 / int(sizeof(std::int64_t))>;
+
+		// the monotonic counters are incremented in the shard of the calling
+		// thread. Their values are the value in m_stats_counter plus the sum
+		// of all shards
+		aux::array<shard_t, num_shards> m_shards;
+#endif
 #else
 		// if the atomic type is't lock-free, use a single lock instead, for
 		// the whole array
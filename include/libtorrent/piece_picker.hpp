@@ -47,10 +47,6 @@ POSSIBILITY OF SUCH DAMAGE.
 #include <set>
 #endif
 
-#if TORRENT_USE_ASSERTS
-#include <set>
-#endif
-
 #include "libtorrent/peer_id.hpp"
 #include "libtorrent/assert.hpp"
 #include "libtorrent/time.hpp"
@@ -79,7 +75,9 @@ namespace libtorrent {
 			// the number of priority levels
 			priority_levels = 8,
 			// priority factor
-			prio_factor = 3
+			prio_factor = 3,
+			// the piece priority pieces start out with
+			default_priority = 4
 		};
 
 		struct block_info
@@ -97,7 +95,12 @@ namespace libtorrent {
 #if TORRENT_USE_ASSERTS
 			// to allow verifying the invariant of blocks belonging to the right piece
 			piece_index_t piece_index{-1};
-			std::set<torrent_peer*> peers;
+			// all peers that have this block in their download or request
+			// queues. This is typically a handful of peers (more than one only
+			// in end-game), so a flat vector is cheaper than a node based set.
+			// Its capacity is kept when the block_info is reused for another
+			// piece
+			std::vector<torrent_peer*> peers;
 #endif
 		};
 
@@ -395,6 +398,10 @@ namespace libtorrent {
 
 		bool is_seeding() const { return m_num_have == int(m_piece_map.size()); }
 
+		// an estimate of the number of bytes of memory used by this piece
+		// picker, including its own size
+		int memory_usage() const;
+
 		// the number of pieces we want and don't have
 		int num_want_left() const { return num_pieces() - m_num_have - m_num_filtered + m_num_have_filtered; }
 
@@ -456,7 +463,7 @@ namespace libtorrent {
 			piece_pos(int const peer_count_, int const index_)
 				: peer_count(static_cast<std::uint16_t>(peer_count_))
 				, download_state(piece_pos::piece_open)
-				, piece_priority(4)
+				, piece_priority(default_priority)
 				, index(index_)
 			{
 				TORRENT_ASSERT(peer_count_ >= 0);
@@ -659,6 +666,11 @@ namespace libtorrent {
 
 		void break_one_seed();
 
+		// returns true if updating the position of num_changed pieces whose
+		// availability changed by one is expected to be cheaper than marking
+		// the piece list as dirty and rebuilding it
+		bool incremental_update(int num_changed) const;
+
 		void update_pieces() const;
 
 		prio_index_t priority_begin(int prio) const;
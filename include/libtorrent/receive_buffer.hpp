@@ -88,6 +88,15 @@ struct TORRENT_EXTRA_EXPORT receive_buffer
 	// This is the "current" packet.
 	span<char const> get() const;
 
+	// returns the received bytes beyond the read cursor, i.e. the ones not
+	// yet passed on to the upper layer
+	span<char const> unconsumed() const;
+
+	// drop ``size`` bytes of complete messages from the front of the current
+	// packet. The read cursor must be at the start of the packet, and it
+	// stays there. The bytes are never passed on through advance_pos()
+	void skip(int size);
+
 #if !defined(TORRENT_DISABLE_ENCRYPTION) && !defined(TORRENT_DISABLE_EXTENSIONS)
 	// returns the buffer from the current packet start position to the last
 	// received byte (possibly part of another packet)
@@ -62,15 +62,32 @@ struct TORRENT_EXTRA_EXPORT resolver final : resolver_interface
 private:
 
 	void on_lookup(error_code const& ec, tcp::resolver::iterator i
-		, resolver_interface::callback_t h, std::string hostname);
+		, std::string hostname, bool critical);
+
+	// starts a lookup of the hostname, unless one is already in progress
+	// in which case the handler (if any) is added to it
+	void start_lookup(std::string const& host, bool critical
+		, resolver_interface::callback_t const& h);
 
 	struct dns_cache_entry
 	{
 		time_point last_seen;
 		std::vector<address> addresses;
+
+		// if the last lookup failed (and there were no addresses to fall
+		// back to) this is the error. It's returned for lookups until the
+		// negative cache timeout expires
+		error_code error;
 	};
 
 	std::unordered_map<std::string, dns_cache_entry> m_cache;
+
+	// the handlers waiting for lookups in progress, keyed by hostname. All
+	// lookups of the same host share a single DNS query. The critical
+	// lookups are made with m_critical_resolver
+	std::unordered_map<std::string, std::vector<callback_t>> m_pending;
+	std::unordered_map<std::string, std::vector<callback_t>> m_critical_pending;
+
 	io_service& m_ios;
 
 	// all lookups in this resolver are aborted on shutdown.
@@ -84,6 +101,10 @@ private:
 
 	// timeout of cache entries
 	time_duration m_timeout;
+
+	// timeout of failed lookups in the cache. This is kept short, to
+	// recover quickly from transient failures
+	time_duration m_negative_timeout;
 };
 
 }
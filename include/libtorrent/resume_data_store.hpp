@@ -0,0 +1,154 @@
+/*
+
+Copyright (c) 2017, Arvid Norberg
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions
+are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in
+      the documentation and/or other materials provided with the distribution.
+    * Neither the name of the author nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+
+#ifndef TORRENT_RESUME_DATA_STORE_HPP_INCLUDE
+#define TORRENT_RESUME_DATA_STORE_HPP_INCLUDE
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <cstdint>
+
+#include "libtorrent/config.hpp"
+#include "libtorrent/file.hpp"
+#include "libtorrent/sha1_hash.hpp"
+#include "libtorrent/span.hpp"
+#include "libtorrent/error_code.hpp"
+
+namespace libtorrent {
+
+	struct add_torrent_params;
+
+	// resume_data_store keeps the resume data for all torrents in a session in
+	// a single, append-only file. Saving resume data for a torrent appends a
+	// new record to the end of the file, superseding any earlier record for
+	// the same info-hash. An in-memory index maps info-hashes to the offset of
+	// their most recent record, so loading the resume data for one torrent is
+	// a single read, regardless of how many torrents are in the file.
+	//
+	// Each record consists of a 32 byte header followed by the payload, which
+	// is the bencoded resume data as produced by write_resume_data_buf(). The
+	// payload can be passed straight to read_resume_data(). The header is::
+	//
+	//	uint32_t magic; // "LTRD"
+	//	uint32_t payload_size; // 0 means the torrent was removed
+	//	uint32_t crc32; // of the payload
+	//	uint8_t info_hash[20];
+	//
+	// Since records are only ever appended, the file grows over time. Call
+	// compact() to rewrite it with only the live records, for instance when
+	// garbage_size() makes up a large portion of file_size().
+	//
+	// This class is not thread safe.
+	struct TORRENT_EXPORT resume_data_store
+	{
+		resume_data_store();
+		~resume_data_store();
+		resume_data_store(resume_data_store const&) = delete;
+		resume_data_store& operator=(resume_data_store const&) = delete;
+
+		// opens (or creates) the resume data file at ``path`` and builds the
+		// index of the records in it. Only record headers are read. A
+		// truncated record at the end of the file (e.g. from being interrupted
+		// while writing) is discarded.
+		void open(std::string const& path, error_code& ec);
+		bool is_open() const { return m_file.is_open(); }
+		void close();
+
+		// appends a record for ``ih`` with the resume data in ``buf``,
+		// replacing any previous resume data for this torrent. An empty
+		// ``buf`` is not allowed, use remove() instead.
+		void save(sha1_hash const& ih, span<char const> buf, error_code& ec);
+
+		// serializes ``atp`` with write_resume_data_buf() and saves it under
+		// its info-hash
+		void save(add_torrent_params const& atp, error_code& ec);
+
+		// reads the most recent resume data for ``ih`` into ``buf``. Returns
+		// false if there is no resume data for this torrent, or if it could
+		// not be read (in which case ``ec`` is set). A record whose checksum
+		// does not match fails with errors::invalid_file_tag.
+		bool load(sha1_hash const& ih, std::vector<char>& buf, error_code& ec);
+
+		// appends a tombstone for ``ih``, so that it will not be loaded again
+		void remove(sha1_hash const& ih, error_code& ec);
+
+		bool contains(sha1_hash const& ih) const
+		{ return m_index.count(ih) > 0; }
+
+		// returns the info-hashes of all torrents with resume data in the file
+		std::vector<sha1_hash> torrents() const;
+
+		int num_torrents() const { return int(m_index.size()); }
+
+		// the total size of the file, and the number of bytes in it taken up
+		// by superseded or removed records
+		std::int64_t file_size() const { return m_end; }
+		std::int64_t garbage_size() const { return m_garbage; }
+
+		// rewrites the file, keeping only the most recent record for each
+		// torrent. The new file is written next to the old one, and then moved
+		// in place.
+		void compact(error_code& ec);
+
+		enum { header_size = 32 };
+
+	private:
+
+		struct record_t
+		{
+			std::int64_t offset;
+			std::uint32_t size;
+			std::uint32_t crc;
+		};
+
+		void append(sha1_hash const& ih, span<char const> buf, error_code& ec);
+		bool read_record(record_t const& r, std::vector<char>& buf
+			, error_code& ec);
+
+		std::string m_path;
+		file m_file;
+
+		// maps info-hash to the last record for that torrent
+		std::unordered_map<sha1_hash, record_t> m_index;
+
+		// the offset where the next record is appended
+		std::int64_t m_end = 0;
+
+		// the number of bytes in the file that belong to superseded
+		// records and tombstones
+		std::int64_t m_garbage = 0;
+	};
+}
+
+#endif
@@ -34,6 +34,7 @@ POSSIBILITY OF SUCH DAMAGE.
 #define TORRENT_SESSION_HPP_INCLUDED
 
 #include <thread>
+#include <functional>
 
 #include "libtorrent/config.hpp"
 #include "libtorrent/build_config.hpp"
@@ -156,6 +157,29 @@ namespace aux {
 		dht::dht_state dht_state;
 
 		dht::dht_storage_constructor_type dht_storage_constructor;
+
+		// if set, this is called at the start of every thread the session
+		// spawns, from within that new thread, before it does any work. It
+		// can be used to name the threads, set their CPU affinity or
+		// scheduling priority. The argument identifies the kind of thread:
+		//
+		// ``"network"``
+		// 	the thread running the session's message loop. This is only
+		// 	spawned when the session is not given an io_service to run on.
+		// ``"disk"``
+		// 	a disk I/O thread. See settings_pack::aio_threads.
+		// ``"hash"``
+		// 	a thread dedicated to hashing. See settings_pack::hash_threads.
+		// ``"torrent load"``
+		// 	the thread loading .torrent files from ``file://`` URLs
+		// 	(deprecated).
+		//
+		// Disk and hash threads are started and stopped on demand, so this may
+		// be called many times over the life of the session. Threads inherit
+		// the affinity of the thread that spawns them (for disk threads, the
+		// network thread), so if the network thread is pinned to a core, the
+		// disk threads likely want a different mask set here.
+		std::function<void(char const*)> thread_init;
 	};
 
 	// This function helps to construct a ``session_params`` from a
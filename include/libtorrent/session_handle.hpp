@@ -67,6 +67,20 @@ namespace libtorrent {
 		, std::vector<char>&, error_code&)>;
 #endif
 
+	// a mutable item to be stored by session_handle::dht_put_items()
+	struct TORRENT_EXPORT dht_mutable_put
+	{
+		// the ed25519 key pair the item is stored and signed under
+		std::array<char, 32> key;
+		std::array<char, 64> secret_key;
+
+		// the value to store
+		entry data;
+
+		// optional, mixed in with the key to determine the target
+		std::string salt;
+	};
+
 	struct TORRENT_EXPORT session_handle
 	{
 		session_handle() : m_impl(nullptr) {}
@@ -180,6 +194,16 @@ namespace libtorrent {
 		// see torrent_handle::status_flags_t.
 		void post_torrent_updates(std::uint32_t flags = 0xffffffff);
 
+		// This function queries the status of all the torrents in ``handles``
+		// in one go, without blocking the calling thread. Once the network
+		// thread gets to it, a single state_update_alert is posted with one
+		// entry for each handle that still refers to a torrent in the session.
+		// This is a lot cheaper than calling torrent_handle::status() on each
+		// of them, since that blocks the caller once per torrent. The
+		// ``flags`` argument is the same as for torrent_handle::status().
+		void post_torrent_status(std::vector<torrent_handle> handles
+			, std::uint32_t flags = 0xffffffff);
+
 		// This function will post a session_stats_alert object, containing a
 		// snapshot of the performance counters from the internals of libtorrent.
 		// To interpret these counters, query the session via
@@ -188,6 +212,14 @@ namespace libtorrent {
 		// For more information, see the session-statistics_ section.
 		void post_session_stats();
 
+		// This function will post a session_stats_delta_alert, containing only
+		// the performance counters that changed since the previous call. The
+		// first call reports every counter that is not zero. This is a much
+		// cheaper way to export the stats at a high rate than
+		// post_session_stats(). Use apply_session_stats_delta() to keep an
+		// up-to-date copy of the values.
+		void post_session_stats_delta();
+
 		// This will cause a dht_stats_alert to be posted.
 		void post_dht_stats();
 
@@ -215,6 +247,15 @@ namespace libtorrent {
 		// immediately, without waiting for the torrent to add. Notification of
 		// the torrent being added is sent as add_torrent_alert.
 		//
+		// ``async_add_torrents()`` adds a whole batch of torrents the same way,
+		// posting one add_torrent_alert per torrent. When adding many torrents
+		// at once (like when restoring a session from resume data), this saves
+		// a message to the network thread per torrent and lets the session
+		// size its torrent table for the whole batch up-front. Parsing the
+		// .torrent files and resume data is done by the caller, and both
+		// torrent_info and read_resume_data() may be used from several threads
+		// in parallel to speed that up.
+		//
 		// The overload that does not take an error_code throws an exception on
 		// error and is not available when building without exception support.
 		// The torrent_handle returned by add_torrent() can be used to retrieve
@@ -233,6 +274,7 @@ namespace libtorrent {
 #endif
 		torrent_handle add_torrent(add_torrent_params const& params, error_code& ec);
 		void async_add_torrent(add_torrent_params params);
+		void async_add_torrents(std::vector<add_torrent_params> params);
 
 #ifndef BOOST_NO_EXCEPTIONS
 #ifndef TORRENT_NO_DEPRECATE
@@ -446,6 +488,14 @@ namespace libtorrent {
 				, std::int64_t&, std::string const&)> cb
 			, std::string salt = std::string());
 
+		// store a batch of mutable items, signed by libtorrent with the
+		// secret key of each item. Every item is looked up first, to find
+		// its current sequence number, and then stored under the next one,
+		// replacing whatever value is already there. The signing is done on
+		// a separate thread, to not stall the network thread when
+		// publishing many items. One dht_put_alert is posted per item.
+		void dht_put_items(std::vector<dht_mutable_put> items);
+
 		void dht_get_peers(sha1_hash const& info_hash);
 		void dht_announce(sha1_hash const& info_hash, int port = 0, int flags = 0);
 
@@ -456,6 +506,13 @@ namespace libtorrent {
 		// posted, regardless of the alert mask.
 		void dht_live_nodes(sha1_hash const& nid);
 
+		// Start a BEP 51 traversal towards ``target`` asking every node it
+		// visits for a sample of the info-hashes it stores. Each response is
+		// posted as a dht_sample_infohashes_alert. To crawl the DHT, issue
+		// many of these with different targets, respecting the ``interval``
+		// returned by each node.
+		void dht_sample_infohashes(sha1_hash const& target);
+
 		// Send an arbitrary DHT request directly to the specified endpoint. This
 		// function is intended for use by plugins. When a response is received
 		// or the request times out, a dht_direct_response_alert will be posted
@@ -163,8 +163,8 @@ namespace libtorrent {
 		bool ignore_dark_internet;
 
 		// the number of seconds a DHT node is banned if it exceeds the rate
-		// limit. The rate limit is averaged over 10 seconds to allow for bursts
-		// above the limit.
+		// limit. The rate limit is averaged over about 20 seconds to allow for
+		// bursts above the limit.
 		int block_timeout;
 
 		// the max number of packets per second a DHT node is allowed to send
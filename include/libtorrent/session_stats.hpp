@@ -34,8 +34,10 @@ POSSIBILITY OF SUCH DAMAGE.
 #define TORRENT_SESSION_STATS_HPP_INCLUDED
 
 #include "libtorrent/config.hpp"
+#include "libtorrent/span.hpp"
 
 #include <vector>
+#include <cstdint>
 
 namespace libtorrent {
 
@@ -61,6 +63,22 @@ namespace libtorrent {
 	// values array returned by session_stats_alert.
 	TORRENT_EXPORT int find_metric_idx(char const* name);
 
+	// appends the compact encoding of the difference between two snapshots
+	// of the session stats values to ``out``. Only the counters that changed
+	// are encoded, each as the distance to the index of the previous one
+	// followed by the change of its value (zig-zag), both as varints. This
+	// is the format of session_stats_delta_alert::delta().
+	TORRENT_EXPORT void encode_session_stats_delta(span<std::int64_t const> prev
+		, span<std::int64_t const> cur, std::vector<char>& out);
+
+	// applies a delta, as produced by encode_session_stats_delta(), to
+	// ``values``. Applying the deltas of every session_stats_delta_alert, in
+	// order, to an array of zeros reproduces the values of the session stats.
+	// Returns false if the delta is malformed or refers to counters outside
+	// of ``values``.
+	TORRENT_EXPORT bool apply_session_stats_delta(span<char const> delta
+		, span<std::int64_t> values);
+
 }
 
 #endif
@@ -238,6 +238,27 @@ namespace libtorrent {
 			// effect until the DHT is restarted.
 			dht_bootstrap_nodes,
 
+			// when set to a file path, every read, write, hash and clear-piece
+			// request issued to the disk I/O thread is logged to this file,
+			// along with the geometry of every storage added. The trace can be
+			// replayed offline with ``tools/disk_io_replay`` to evaluate other
+			// cache and disk settings against a real workload. Setting it to an
+			// empty string (the default) stops tracing and closes the file.
+			disk_io_trace_file,
+
+			// the path of a file to use as a second tier of the disk cache,
+			// typically on an SSD when the torrents are on spinning disks.
+			// Blocks of pieces that turn out to be requested again after
+			// being evicted from the read cache (the ARC ghost lists) are
+			// written to it when they're evicted again, and reads that miss the
+			// read cache are served from it before reading from the torrent's
+			// files. The file is created if it doesn't exist, and its contents
+			// are discarded at startup. ``l2_cache_size`` sets its size. An
+			// empty string (the default) disables the L2 cache. It has no
+			// effect with the ``w_tinylfu_eviction`` cache_eviction_policy,
+			// which doesn't have ghost lists.
+			l2_cache_path,
+
 			max_string_setting_internal
 		};
 
@@ -709,6 +730,119 @@ namespace libtorrent {
 			// any.
 			proxy_tracker_connections,
 
+			// when enabled, the number of blocks read into the read cache on a
+			// cache miss is adapted to the requesting peer's access pattern.
+			// Peers requesting blocks sequentially get up to 8 times
+			// ``read_cache_line_size`` blocks read ahead (still capped by the
+			// piece boundary), peers requesting blocks at random only get the
+			// blocks they asked for, to not pollute the cache.
+			adaptive_read_ahead,
+
+			// when enabled, outgoing data is paced instead of being sent in
+			// bursts. uTP sockets spread the packets of each congestion window
+			// across the round-trip time. Rate limited TCP connections ask the
+			// kernel to pace at the rate of the quota they were handed out
+			// (using ``SO_MAX_PACING_RATE``, where available), rather than
+			// writing the whole quota at once at the beginning of every
+			// ``tick_interval``. This avoids dropped packets in switches with
+			// shallow buffers.
+			send_pacing,
+
+			// when enabled, a peer that receives a block doesn't pick new blocks
+			// to request right away. Instead, the torrent picks for all peers
+			// that received blocks once the current batch of network events
+			// has been handled, fastest peers first. With many fast peers, this
+			// avoids running the piece picker once for every block received
+			// and keeps it warm in the CPU cache while picking.
+			batch_piece_picks,
+
+			// when true, the number of outstanding requests to a peer is
+			// sized from the bandwidth-delay product of the connection,
+			// rather than from ``request_queue_time``. The round-trip time
+			// is measured as the time it takes to receive a block requested
+			// from a peer with no other outstanding requests. Until there is
+			// such a measurement, ``request_queue_time`` is used. This keeps
+			// fewer blocks outstanding to slow peers, while still keeping the
+			// pipe full to fast ones.
+			bdp_request_queue,
+
+			// when true, the payload of incoming piece messages on unencrypted
+			// connections is read from the socket directly into a disk cache
+			// buffer, once the message header has been received. This saves
+			// copying all downloaded data from the peer's receive buffer into
+			// the disk cache.
+			direct_piece_receive,
+
+			// when true, HAVE messages for pieces that pass the hash check are
+			// not sent right away. They are queued up and sent to each peer
+			// together once the current batch of events has been handled.
+			// When many pieces pass back to back, each peer then gets its HAVE
+			// messages in a single write instead of one write per piece.
+			coalesce_have_messages,
+
+			// when true, incoming plaintext TCP connections are not turned into
+			// peer connections until the first part of their handshake has
+			// arrived. The handshake is peeked at in the socket, and if it
+			// refers to an info-hash that isn't in the session, the connection
+			// is closed without ever constructing a peer connection for it.
+			// Encrypted handshakes hide the info-hash behind the key exchange,
+			// so those (and handshakes that don't arrive in one piece) take
+			// the regular path.
+			pre_handshake_check,
+
+			// when enabled, torrents added with resume data are started right
+			// away, trusting the resume data, instead of first checking the
+			// files on disk against it. That check is instead run in the
+			// background once the torrent has started. If it fails, a fastresume_rejected_alert is posted and
+			// the torrent is rechecked. This makes session startup with many
+			// large torrents faster, at the cost of possibly serving peers
+			// from files that turn out not to match the resume data.
+			defer_resume_data_check,
+
+			// when enabled, the whole disk cache (as set by ``cache_size``) is
+			// reserved up front as one contiguous region, backed by huge pages
+			// where the operating system supports it. Blocks are handed out
+			// from a lock-free free list, avoiding the pool mutex on the
+			// common allocation path. Changes to this setting take effect the
+			// next time no disk buffers are in use. The region is not
+			// resized if ``cache_size`` changes later; buffers beyond it are
+			// allocated individually.
+			disk_cache_arena,
+
+			// when enabled, the read cache is also indexed by piece hash.
+			// A read that misses the cache of its own torrent is served from
+			// the cached blocks of another torrent with an identical piece
+			// (same hash, and hence the same size and alignment), instead of
+			// from disk. This saves memory and disk reads when many torrents
+			// share the same content. Only pieces that have been read by
+			// seeding (i.e. verified) are shared.
+			content_addressed_cache,
+
+			// when a piece fails the hash check, the digest of each of its
+			// blocks is recorded along with the peer it came from. Blocks that
+			// two different peers have sent the same data for are assumed to
+			// be good. If this is true and the piece fails again, only the other
+			// blocks are downloaded again, and peers whose data for a block
+			// contradicts two others are banned right away.
+			salvage_failed_pieces,
+
+			// when true, outgoing TCP peer connections are made with TCP Fast
+			// Open, where the operating system supports it (Linux 4.11 and
+			// later). Once the kernel has a fast open cookie from a peer, the
+			// handshake is sent along with the SYN of the following
+			// connections to it, saving a round-trip. Peers and middleboxes
+			// that don't support it fall back to a regular connect.
+			outgoing_tcp_fast_open,
+
+			// when true, the number of threads of each disk thread pool is
+			// adjusted once a second, based on how long jobs wait in the queue
+			// and how long they take to perform. Threads are added while jobs
+			// wait longer than they take, unless adding the last one made jobs
+			// slower without completing more of them (like a spinning disk
+			// seeking back and forth), and removed while jobs hardly wait. The
+			// pools stay within ``min_aio_threads`` and their regular size.
+			auto_scale_aio_threads,
+
 			max_bool_setting_internal
 		};
 
@@ -790,7 +924,8 @@ namespace libtorrent {
 			// controls the pipelining size of url-seeds. i.e. the number of HTTP
 			// request to keep outstanding before waiting for the first one to
 			// complete. It's common for web servers to limit this to a relatively
-			// low number, like 5
+			// low number, like 5. For BEP 19 web seeds that support keep-alive,
+			// at least this many pieces worth of requests are kept outstanding
 			urlseed_pipeline_size,
 
 			// time to wait until a new retry of a web seed takes place
@@ -988,6 +1123,15 @@ namespace libtorrent {
 			//   potentially evict all other processes' cache by simply handling
 			//   high throughput and large files. If libtorrent's read cache is
 			//   disabled, enabling this may reduce performance.
+			// direct_io
+			//   This bypasses the OS cache entirely, by opening files with
+			//   ``O_DIRECT`` on linux. Blocks are read and written straight
+			//   from and into libtorrent's own cache buffers, so the OS cache
+			//   and libtorrent's cache don't compete for memory. Operations
+			//   not aligned to 4 kiB (typically the edges of files in
+			//   multi-file torrents) are bounced through an aligned buffer.
+			//   Only ``disk_io_write_mode`` controls this, and on systems
+			//   without direct I/O it behaves like ``disable_os_cache``.
 			//
 			// One reason to disable caching is that it may help the operating
 			// system from growing its file cache indefinitely.
@@ -1637,6 +1781,227 @@ namespace libtorrent {
 			// as zero.
 			resolver_cache_timeout,
 
+			// selects how the disk threads issue file I/O. The options are
+			// defined by disk_io_backend_t.
+			//
+			// posix_disk_io
+			//   This is the default. Every read and write is a blocking
+			//   ``preadv()`` or ``pwritev()`` call on a disk thread.
+			// io_uring_disk_io
+			//   A disk thread picks up all queued read jobs (up to
+			//   ``aio_max``) and submits the file reads of the ones that miss
+			//   the cache to the kernel at once, via io_uring. This lets a few
+			//   disk threads keep many requests in flight, to saturate the
+			//   queue depth of fast devices. This requires linux 5.1 or later,
+			//   if io_uring is not available, reads fall back to the posix
+			//   mode. Reads that go through the read cache are not batched,
+			//   so this is most effective with ``use_read_cache`` disabled.
+			disk_io_backend,
+
+			// the algorithm used to decide which pieces to evict from the read
+			// cache. The options are defined by cache_eviction_policy_t.
+			//
+			// arc_eviction
+			//   This is the default. An adaptive replacement cache, balancing
+			//   between recently and frequently used pieces based on hits in
+			//   the lists of recently evicted pieces.
+			// w_tinylfu_eviction
+			//   Pieces are only let into the main part of the cache if they're
+			//   estimated to be accessed more often than the piece they would
+			//   replace. The access frequencies are tracked by a compact sketch
+			//   which ages over time. This keeps scans over large, rarely
+			//   requested torrents from flushing popular pieces out of the cache.
+			cache_eviction_policy,
+
+			// the number of threads dedicated to hashing pieces, both when
+			// checking files and when verifying downloaded pieces. Hash jobs
+			// read all blocks of a piece missing from the cache with a single
+			// read operation, so with enough threads, checking a torrent is
+			// bound by disk throughput rather than by SHA-1 on a single core.
+			// When checking, at least two pieces per hash thread are kept
+			// outstanding, regardless of ``checking_mem_usage``.
+			//
+			// 0 (the default) dedicates a quarter of the ``aio_threads`` to
+			// hashing. A positive number adds that many hash threads on top of
+			// ``aio_threads``. -1 adds one hash thread per CPU core.
+			hash_threads,
+
+			// the number of TCP acceptors to open for each listen socket. When
+			// this is greater than 1, the listen sockets are opened with
+			// ``SO_REUSEPORT``, and the kernel spreads incoming connections
+			// across the acceptors, each with its own accept queue of
+			// ``listen_queue_size``. This helps absorbing bursts of incoming
+			// connections. It has no effect on systems without ``SO_REUSEPORT``
+			// and, like ``listen_queue_size``, does not take effect until the
+			// ``listen_interfaces`` settings is updated.
+			listen_acceptors,
+
+			// when set to a value greater than 0, TCP peer sockets are opened
+			// with ``TCP_NOTSENT_LOWAT`` set to this number of bytes. The kernel
+			// then only reports the socket as writable once fewer than this many
+			// bytes are queued but not yet sent, instead of accepting as much as
+			// fits in the (possibly auto-tuned, several megabyte) socket send
+			// buffer. Data waiting to be sent stays in libtorrent's own send
+			// buffer instead, where it's accounted for by
+			// ``send_buffer_watermark``. This reduces the memory used per
+			// connection and the latency of messages like ``have`` and
+			// ``request`` queued behind piece data. 0 (the default) leaves the
+			// kernel default. It has no effect on uTP connections or on systems
+			// without ``TCP_NOTSENT_LOWAT``, and only applies to new connections.
+			send_not_sent_low_watermark,
+
+			// the largest number of contiguous pieces to assign to a single
+			// peer at a time. Peers that can download more than one piece
+			// within ``whole_pieces_threshold`` seconds are assigned as many
+			// contiguous pieces as they can download in that time, up to this
+			// limit. The range is aligned to a multiple of its size. The default,
+			// 1, only assigns whole pieces.
+			whole_pieces_extent,
+
+			// the max number of torrents to include in a single
+			// state_update_alert posted by ``post_torrent_updates()``. Torrents
+			// that don't fit are kept and posted first in the next update, so
+			// a client polling a very large number of torrents can bound the
+			// cost of each poll. 0 means no limit.
+			max_state_updates,
+
+			// when there are more torrents than seconds in
+			// ``dht_announce_interval``, several torrents are announced to the
+			// DHT every second. ``dht_announce_requests_limit`` caps the number
+			// of outstanding DHT requests, summed over all running lookups, at
+			// which new announces are still started. Torrents that don't get
+			// started are announced in a later second. 0 means no limit.
+			dht_announce_requests_limit,
+
+			// the max number of idle connections to keep open to each HTTP
+			// tracker. Announces and scrapes to the same tracker host are sent
+			// over these (with HTTP/1.1 keep-alive) instead of opening a new TCP
+			// (and possibly SSL) connection for every request. Idle connections
+			// are closed after 30 seconds. 0 disables keep-alive.
+			tracker_keepalive_connections,
+
+			// limits on the requests sent to any one tracker host, across all
+			// torrents. ``tracker_host_concurrency`` is the max number of
+			// outstanding announces and scrapes to a host, and
+			// ``tracker_host_request_rate`` the max number of requests per
+			// second, allowing a burst of one second's worth. Requests over the
+			// limits are queued, and sent with some random jitter as the limits
+			// allow. Torrents that are still downloading, and announces
+			// triggered manually, go first. ``stopped`` events are not subject
+			// to the limits. 0 means no limit.
+			tracker_host_concurrency,
+			tracker_host_request_rate,
+
+			// the number of connections to open to each BEP 19 web seed
+			// (url-seed). Additional connections are only opened once the
+			// first one is established and the server supports keep-alive. Each
+			// connection downloads its own pieces, which lets a fast server be
+			// downloaded from over several TCP streams. The connections count
+			// against ``max_web_seed_connections``.
+			urlseed_connections,
+
+			// the number of milliseconds a handler may run on the network thread
+			// before it's considered to stall it. Calls through session_handle
+			// and torrent_handle and the session's periodic tick running longer
+			// than this post a network_stall_alert and count as a
+			// ``net.network_thread_stalls`` in the session stats. 0 disables
+			// stall detection.
+			network_stall_threshold,
+
+			// the number of milliseconds between peer_sample_alerts. Each one
+			// contains a small, fixed-size record of the rates, request queues
+			// and round-trip time of connected peers. Samples are taken on the
+			// session's tick, so the effective interval is rounded up to a
+			// multiple of ``tick_interval``. 0 disables sampling. The alert is
+			// only posted if ``stats_notification`` is enabled in the alert mask.
+			peer_sample_interval,
+
+			// the max number of peers to include in a peer_sample_alert. When
+			// more peers are connected, the ones with the highest transfer rates
+			// are included.
+			max_peer_samples,
+
+			// when the files of torrents are on more than one device (volume),
+			// this is the max number of disk jobs that may execute at a time on
+			// the files of a single device, per disk thread pool (the generic one
+			// and the hashing one). It keeps a slow device (such as a USB drive
+			// or a network mount) from tying up all disk threads while jobs for
+			// other devices wait. 0 means one less than the number of threads in
+			// the pool, always leaving one thread to the other devices. -1 means
+			// there is no limit.
+			max_disk_jobs_per_device,
+
+			// when greater than 0, the read jobs queued for a device are not
+			// executed in the order they were issued, but in the order of their
+			// position in the torrent's files, sweeping from low to high offsets
+			// and starting over (like an elevator). This turns the random reads
+			// of many peers into mostly sequential ones, which matters on
+			// spinning disks. This is the max number of milliseconds a read may
+			// be held back for reads closer to the disk's head position. 0 (the
+			// default) executes reads in the order they were issued.
+			disk_read_elevator_wait,
+
+			// the max number of dirty blocks in the write cache, that were
+			// received out of order and haven't been hashed yet, to keep in the
+			// cache when it's flushed because of pressure or because the blocks
+			// expired (see cache_expiry). Flushing such blocks means they'll
+			// have to be read back from disk once the piece is complete, in
+			// order to hash it. The most recently written pieces are retained,
+			// since they're the most likely to be completed soon. Once a
+			// retained piece's missing blocks arrive and it's hashed, it's
+			// flushed as usual. Setting this to 0 flushes unhashed blocks along
+			// with everything else. The ``disk.num_read_back_*`` counters break
+			// down the blocks read back by the reason they were flushed early.
+			max_retained_unhashed_blocks,
+
+			// when greater than 0, peers are sent blocks from pieces that were
+			// read recently (and are likely to be in the disk cache) before
+			// other blocks, across all their outstanding requests. Reads of
+			// pieces that weren't read recently are limited to this many in
+			// flight at a time, across the session. A peer that only has such
+			// requests left waits for one of them to complete, which often
+			// makes some of its requests cheap to serve, from the cache. This
+			// saves disk seeks when many peers are downloading the same pieces,
+			// at the cost of a slight delay for the others. 0 (the default)
+			// serves requests in the order they were received.
+			upload_cold_read_limit,
+
+			// when greater than 0, checking torrents are scheduled by the
+			// device (volume) their files are on. At most this many torrents
+			// are checked at a time on each device, and checks on different
+			// devices run concurrently. ``active_checking`` still limits the
+			// total number of checking torrents, and should be raised (or set
+			// to -1) for this to have any effect. In this mode,
+			// ``checking_mem_usage`` is the budget for each device, shared by
+			// the torrents checking on it. 0 (the default) checks
+			// ``active_checking`` torrents at a time, regardless of where their
+			// files are.
+			active_checking_per_device,
+
+			// the size of the L2 cache file (see ``l2_cache_path``), in 16 kiB
+			// blocks. 0 disables the L2 cache
+			l2_cache_size,
+
+			// the fewest threads a disk thread pool is scaled down to, when
+			// ``auto_scale_aio_threads`` is enabled. The most is its regular
+			// size (see ``aio_threads`` and ``hash_threads``)
+			min_aio_threads,
+
+			// the number of torrents whose files may be deleted at a time (when
+			// removed with ``session::delete_files``). Deletions run on threads
+			// of their own, at the lowest I/O priority where supported, so they
+			// don't hold up the disk threads serving the other torrents. The
+			// ones exceeding this limit are queued
+			deletion_threads,
+
+			// the number of hash jobs a torrent in seed mode keeps outstanding
+			// to verify its pieces in the background, before peers request
+			// them. They're only issued while no other disk jobs are running.
+			// The pieces following the ones peers have requested recently are
+			// verified first, then the ones most connected peers are missing.
+			// 0 only verifies pieces as they're requested
+			seed_mode_background_checks,
+
 			max_int_setting_internal
 		};
 
@@ -1671,7 +2036,20 @@ namespace libtorrent {
 #else
 			deprecated = 1,
 #endif
-			disable_os_cache = 2
+			disable_os_cache = 2,
+			direct_io = 3
+		};
+
+		enum disk_io_backend_t
+		{
+			posix_disk_io = 0,
+			io_uring_disk_io = 1
+		};
+
+		enum cache_eviction_policy_t
+		{
+			arc_eviction = 0,
+			w_tinylfu_eviction = 1
 		};
 
 		enum bandwidth_mixed_algo_t
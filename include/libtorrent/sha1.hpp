@@ -30,6 +30,17 @@ namespace libtorrent {
 	TORRENT_EXTRA_EXPORT void SHA1_update(sha1_ctx* context
 		, std::uint8_t const* data, size_t len);
 	TORRENT_EXTRA_EXPORT void SHA1_final(std::uint8_t* digest, sha1_ctx* context);
+
+	// the number of contexts SHA1_update_multi() updates in lockstep on this
+	// CPU, or 1 if it doesn't support it (or if there's a faster single
+	// stream implementation, like SHA-NI)
+	TORRENT_EXTRA_EXPORT int SHA1_multi_lanes();
+
+	// the same as calling SHA1_update(contexts[i], data[i], len) for each of
+	// the num contexts, but several of them are hashed at a time, one per
+	// SIMD lane
+	TORRENT_EXTRA_EXPORT void SHA1_update_multi(sha1_ctx* const* contexts
+		, std::uint8_t const* const* data, size_t len, int num);
 }
 
 #endif
@@ -136,6 +136,78 @@ namespace libtorrent {
 	};
 #endif
 
+#ifdef SO_REUSEPORT
+#define TORRENT_HAS_REUSEPORT
+	struct reuse_port
+	{
+		explicit reuse_port(bool val): m_value(val) {}
+		template<class Protocol>
+		int level(Protocol const&) const { return SOL_SOCKET; }
+		template<class Protocol>
+		int name(Protocol const&) const { return SO_REUSEPORT; }
+		template<class Protocol>
+		int const* data(Protocol const&) const { return &m_value; }
+		template<class Protocol>
+		size_t size(Protocol const&) const { return sizeof(m_value); }
+		int m_value;
+	};
+#endif
+
+#ifdef TCP_NOTSENT_LOWAT
+#define TORRENT_HAS_NOTSENT_LOWAT
+	struct notsent_lowat
+	{
+		explicit notsent_lowat(int val): m_value(val) {}
+		template<class Protocol>
+		int level(Protocol const&) const { return IPPROTO_TCP; }
+		template<class Protocol>
+		int name(Protocol const&) const { return TCP_NOTSENT_LOWAT; }
+		template<class Protocol>
+		int const* data(Protocol const&) const { return &m_value; }
+		template<class Protocol>
+		size_t size(Protocol const&) const { return sizeof(m_value); }
+		int m_value;
+	};
+#endif
+
+#ifdef TCP_FASTOPEN_CONNECT
+#define TORRENT_HAS_TCP_FASTOPEN_CONNECT
+	// with this set, connect() returns right away if there's a fast open
+	// cookie for the destination, and the data of the first write goes out
+	// with the SYN
+	struct tcp_fastopen_connect
+	{
+		explicit tcp_fastopen_connect(bool val): m_value(val) {}
+		template<class Protocol>
+		int level(Protocol const&) const { return IPPROTO_TCP; }
+		template<class Protocol>
+		int name(Protocol const&) const { return TCP_FASTOPEN_CONNECT; }
+		template<class Protocol>
+		int const* data(Protocol const&) const { return &m_value; }
+		template<class Protocol>
+		size_t size(Protocol const&) const { return sizeof(m_value); }
+		int m_value;
+	};
+#endif
+
+#ifdef SO_MAX_PACING_RATE
+#define TORRENT_HAS_MAX_PACING_RATE
+	struct max_pacing_rate
+	{
+		// the rate is specified in bytes per second
+		explicit max_pacing_rate(std::uint32_t val): m_value(val) {}
+		template<class Protocol>
+		int level(Protocol const&) const { return SOL_SOCKET; }
+		template<class Protocol>
+		int name(Protocol const&) const { return SO_MAX_PACING_RATE; }
+		template<class Protocol>
+		std::uint32_t const* data(Protocol const&) const { return &m_value; }
+		template<class Protocol>
+		size_t size(Protocol const&) const { return sizeof(m_value); }
+		std::uint32_t m_value;
+	};
+#endif
+
 	struct type_of_service
 	{
 #ifdef _WIN32
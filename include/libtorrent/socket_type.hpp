@@ -207,6 +207,10 @@ namespace libtorrent {
 		void set_close_reason(close_reason_t code);
 		close_reason_t get_close_reason();
 
+		// selects the congestion controller of uTP sockets. This is a no-op
+		// for other socket types
+		void set_utp_cubic(bool cubic);
+
 		endpoint_type local_endpoint(error_code& ec) const;
 		endpoint_type remote_endpoint(error_code& ec) const;
 		void bind(endpoint_type const& endpoint, error_code& ec);
@@ -41,6 +41,8 @@ POSSIBILITY OF SUCH DAMAGE.
 
 #include <cstdio> // for vsnprintf
 #include <cstring>
+#include <array>
+#include <cstdint>
 
 namespace libtorrent { namespace aux {
 
@@ -87,6 +89,30 @@ namespace libtorrent { namespace aux {
 			return allocation_slot(ret);
 		}
 
+		// like copy_string(), but if the same string was interned recently
+		// (since the last reset()), the existing copy is returned.
+		// This is meant for strings that are repeated in many allocations,
+		// like torrent names and tracker URLs
+		allocation_slot intern_string(string_view str)
+		{
+			// FNV-1a
+			std::uint32_t h = 2166136261u;
+			for (char const c : str)
+			{
+				h ^= std::uint8_t(c);
+				h *= 16777619u;
+			}
+			interned& e = m_interned[h % m_interned.size()];
+			if (e.size == int(str.size())
+				&& std::memcmp(ptr(e.slot), str.data(), str.size()) == 0)
+			{
+				return e.slot;
+			}
+			e.slot = copy_string(str);
+			e.size = int(str.size());
+			return e.slot;
+		}
+
 		allocation_slot format_string(char const* fmt, va_list v)
 		{
 			int const ret = int(m_storage.size());
@@ -147,16 +173,27 @@ namespace libtorrent { namespace aux {
 		void swap(stack_allocator& rhs)
 		{
 			m_storage.swap(rhs.m_storage);
+			m_interned.swap(rhs.m_interned);
 		}
 
 		void reset()
 		{
 			m_storage.clear();
+			m_interned.fill(interned());
 		}
 
 	private:
 
 		vector<char> m_storage;
+
+		// a direct mapped cache of strings copied by intern_string(), indexed
+		// by their hash
+		struct interned
+		{
+			allocation_slot slot;
+			int size = -1;
+		};
+		std::array<interned, 256> m_interned;
 	};
 
 } }
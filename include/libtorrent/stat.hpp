@@ -92,6 +92,9 @@ namespace libtorrent {
 			m_total_counter = 0;
 		}
 
+		// resets the rate without affecting the total counter
+		void clear_rate() { m_5_sec_average = 0; }
+
 	private:
 
 		// total counters
@@ -269,6 +272,13 @@ namespace libtorrent {
 				m_stat[i].clear();
 		}
 
+		// resets all rates to 0, but keeps the totals
+		void clear_rates()
+		{
+			for (int i = 0; i < num_channels; ++i)
+				m_stat[i].clear_rate();
+		}
+
 		stat_channel const& operator[](int i) const
 		{
 			TORRENT_ASSERT(i >= 0 && i < num_channels);
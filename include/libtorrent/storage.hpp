@@ -130,7 +130,7 @@ namespace libtorrent {
 
 	class session;
 	struct file_pool;
-	namespace aux { struct session_settings; }
+	namespace aux { struct session_settings; struct io_uring_batch; }
 	struct add_torrent_params;
 
 	TORRENT_EXTRA_EXPORT void clear_bufs(span<iovec_t const> bufs);
@@ -212,6 +212,27 @@ namespace libtorrent {
 		virtual int writev(span<iovec_t const> bufs
 			, piece_index_t piece, int offset, std::uint32_t flags, storage_error& ec) = 0;
 
+		// This is an optional extension of readv(). Instead of performing the
+		// file reads, they are queued up in ``batch`` (tagged with ``tag``) to
+		// be issued together with the reads of other jobs. The operations are
+		// performed and completed when the disk thread calls
+		// ``batch.run()``, the buffers in ``bufs`` will stay valid until then.
+		// Storage implementations that don't support batched reads should
+		// return false, in which case the disk thread falls back to readv().
+		// If there's an error setting up the operations, return true and fill
+		// in ``ec``.
+		virtual bool readv_batch(aux::io_uring_batch& /* batch */, int /* tag */
+			, span<iovec_t const> /* bufs */, piece_index_t /* piece */
+			, int /* offset */, std::uint32_t /* flags */, storage_error& /* ec */)
+		{ return false; }
+
+		// This is an optional optimization for checking the files. Return true
+		// if the piece is known to be entirely made of holes in sparse files,
+		// i.e. it has never been written and reads back as zeros. The disk
+		// thread then hashes it as zeros without reading it. When in doubt
+		// (or on error), return false.
+		virtual bool is_sparse_piece(piece_index_t) { return false; }
+
 		// This function is called when first checking (or re-checking) the
 		// storage for a torrent. It should return true if any of the files that
 		// is used in this storage exists on disk. If so, the storage will be
@@ -333,6 +354,17 @@ namespace libtorrent {
 		storage_index_t storage_index() const { return m_storage_index; }
 		void set_storage_index(storage_index_t st) { m_storage_index = st; }
 
+		// the index of the device (volume) the files of this storage are on,
+		// as assigned by the disk_io_thread. Disk jobs are queued per device
+		std::uint8_t device() const { return m_device; }
+		void set_device(std::uint8_t const d) { m_device = d; }
+
+		// the torrent_info this storage was created for, if any. It's used by
+		// the disk cache to look up piece hashes, to share cached blocks
+		// between torrents with identical pieces
+		torrent_info const* info() const { return m_info; }
+		void set_info(torrent_info const* ti) { m_info = ti; }
+
 		int dec_refcount()
 		{
 			TORRENT_ASSERT(m_references > 0);
@@ -356,6 +388,11 @@ namespace libtorrent {
 
 		// the number of block_cache_reference objects referencing this storage
 		std::atomic<int> m_references{1};
+
+		std::atomic<std::uint8_t> m_device{0};
+
+		// owned by the torrent, which is kept alive by m_torrent
+		torrent_info const* m_info = nullptr;
 	};
 
 	// The default implementation of storage_interface. Behaves as a normal
@@ -365,6 +402,7 @@ namespace libtorrent {
 	{
 		friend struct write_fileop;
 		friend struct read_fileop;
+		friend struct mmap_fileop;
 	public:
 		// constructs the default_storage based on the give file_storage (fs).
 		// ``mapped`` is an optional argument (it may be nullptr). If non-nullptr it
@@ -401,6 +439,10 @@ namespace libtorrent {
 			, piece_index_t piece, int offset, std::uint32_t flags, storage_error& ec) override;
 		int writev(span<iovec_t const> bufs
 			, piece_index_t piece, int offset, std::uint32_t flags, storage_error& ec) override;
+		bool readv_batch(aux::io_uring_batch& batch, int tag
+			, span<iovec_t const> bufs, piece_index_t piece, int offset
+			, std::uint32_t flags, storage_error& ec) override;
+		bool is_sparse_piece(piece_index_t piece) override;
 
 		// if the files in this storage are mapped, returns the mapped
 		// file_storage, otherwise returns the original file_storage object.
@@ -409,6 +451,11 @@ namespace libtorrent {
 			return m_mapped_files ? *m_mapped_files : storage_interface::files();
 		}
 
+	protected:
+
+		// helper function to open a file in the file pool with the right mode
+		file_handle open_file(file_index_t file, std::uint32_t mode, storage_error& ec) const;
+
 	private:
 
 		void delete_one_file(std::string const& p, error_code& ec);
@@ -423,8 +470,6 @@ namespace libtorrent {
 		// each entry represents the size and timestamp of the file
 		mutable stat_cache m_stat_cache;
 
-		// helper function to open a file in the file pool with the right mode
-		file_handle open_file(file_index_t file, std::uint32_t mode, storage_error& ec) const;
 		file_handle open_file_impl(file_index_t file, std::uint32_t mode, error_code& ec) const;
 
 		aux::vector<std::uint8_t, file_index_t> m_file_priority;
@@ -444,9 +489,81 @@ namespace libtorrent {
 		// case of sparse allocation mode
 		mutable typed_bitfield<file_index_t> m_file_created;
 
+		// in full allocation mode, if the file system supports it, files are
+		// not allocated all at once when first written to. Instead, disk space
+		// is reserved in chunks, as the file is being written to. This
+		// reserves the chunks covering the range [offset, offset + size) and
+		// the one following it
+		void reserve_space(file_index_t index, file& f, std::int64_t offset
+			, std::int64_t size, error_code& ec);
+
+		// one bit per chunk of each file, set for the chunks that have been
+		// reserved on disk. Empty for files that aren't allocated in chunks.
+		// Protected by m_reserve_mutex
+		mutable aux::vector<bitfield, file_index_t> m_reserved_chunks;
+		mutable std::mutex m_reserve_mutex;
+
 		bool m_allocate_files;
 	};
 
+#if TORRENT_HAVE_MMAP
+	namespace aux { struct file_mapping; }
+
+	// a storage that accesses the files through memory mappings instead of
+	// explicit read and write calls. Each file is mapped in its entirety the
+	// first time it's accessed, and the mapping is kept until the files are
+	// released, moved, renamed or deleted. Reads are served straight out of
+	// the operating system's page cache, which makes it reasonable to run
+	// with a small (or disabled) disk cache without hitting the disk for
+	// every request. Pad files and files with priority 0 (which live in the
+	// part file) are accessed the same way default_storage does.
+	//
+	// If a file is truncated by another process while it's mapped, accessing
+	// the part past the new end will crash the process (``SIGBUS``).
+	class TORRENT_EXPORT mmap_storage final : public default_storage
+	{
+		friend struct mmap_fileop;
+	public:
+		// takes the same arguments as default_storage
+		explicit mmap_storage(storage_params const& params, file_pool&);
+
+		// hidden
+		~mmap_storage();
+
+		void rename_file(file_index_t index, std::string const& new_filename
+			, storage_error& ec) override;
+		void release_files(storage_error& ec) override;
+		void delete_files(int options, storage_error& ec) override;
+		status_t move_storage(std::string const& save_path, int flags
+			, storage_error& ec) override;
+
+		int readv(span<iovec_t const> bufs
+			, piece_index_t piece, int offset, std::uint32_t flags, storage_error& ec) override;
+		int writev(span<iovec_t const> bufs
+			, piece_index_t piece, int offset, std::uint32_t flags, storage_error& ec) override;
+
+		// the batched read path is not used for mapped files, reads are
+		// served synchronously out of the mapping
+		bool readv_batch(aux::io_uring_batch&, int
+			, span<iovec_t const>, piece_index_t, int
+			, std::uint32_t, storage_error&) override { return false; }
+
+	private:
+
+		// returns the mapping for the specified file, creating it if
+		// necessary. A null pointer (with no error) means the file could
+		// not be mapped and should be accessed through the file handle
+		// instead
+		std::shared_ptr<aux::file_mapping> map_file(file_index_t file
+			, bool write, storage_error& ec);
+
+		void unmap_files();
+
+		std::mutex m_mapping_mutex;
+		aux::vector<std::shared_ptr<aux::file_mapping>, file_index_t> m_mappings;
+	};
+#endif
+
 }
 
 #endif // TORRENT_STORAGE_HPP_INCLUDED
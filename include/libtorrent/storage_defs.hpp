@@ -115,6 +115,11 @@ namespace libtorrent {
 	TORRENT_EXPORT storage_interface* disabled_storage_constructor(storage_params const&, file_pool&);
 
 	TORRENT_EXPORT storage_interface* zero_storage_constructor(storage_params const&, file_pool&);
+
+	// the constructor function for mmap_storage, which accesses the files
+	// through memory mappings. On platforms without mmap() support, this
+	// returns a default_storage.
+	TORRENT_EXPORT storage_interface* mmap_storage_constructor(storage_params const&, file_pool&);
 }
 
 #endif
@@ -36,6 +36,7 @@ POSSIBILITY OF SUCH DAMAGE.
 #include <algorithm>
 #include <vector>
 #include <set>
+#include <map>
 #include <list>
 #include <deque>
 #include <limits> // for numeric_limits
@@ -50,6 +51,7 @@ POSSIBILITY OF SUCH DAMAGE.
 #include "libtorrent/tracker_manager.hpp"
 #include "libtorrent/stat.hpp"
 #include "libtorrent/alert.hpp"
+#include "libtorrent/alert_manager.hpp"
 #include "libtorrent/piece_picker.hpp"
 #include "libtorrent/config.hpp"
 #include "libtorrent/bandwidth_limit.hpp"
@@ -69,9 +71,14 @@ POSSIBILITY OF SUCH DAMAGE.
 #include "libtorrent/disk_interface.hpp" // for status_t
 #include "libtorrent/aux_/file_progress.hpp"
 #include "libtorrent/aux_/suggest_piece.hpp"
+#include "libtorrent/aux_/super_seed_index.hpp"
 #include "libtorrent/units.hpp"
 #include "libtorrent/aux_/vector.hpp"
+#include "libtorrent/aux_/extension_list.hpp"
 #include "libtorrent/aux_/deferred_handler.hpp"
+#include "libtorrent/aux_/recent_endpoints.hpp"
+#include "libtorrent/aux_/timer_wheel.hpp"
+#include "libtorrent/aux_/verify_order.hpp"
 
 #if TORRENT_COMPLETE_TYPES_REQUIRED
 #include "libtorrent/peer_connection.hpp"
@@ -95,6 +102,9 @@ namespace libtorrent {
 	struct storage_interface;
 	class bt_peer_connection;
 	struct listen_socket_t;
+#ifdef TORRENT_USE_OPENSSL
+	namespace aux { struct ssl_session_cache; }
+#endif
 
 	constexpr int default_piece_priority = 4;
 
@@ -119,6 +129,11 @@ namespace libtorrent {
 		int peers;
 		// the piece index
 		piece_index_t piece;
+		// when we expect the last block we've requested of this piece to
+		// arrive, based on the download queue time and round trip time of
+		// the peers they were requested from. min_time() until the first
+		// block is requested
+		time_point predicted_arrival;
 #if TORRENT_DEBUG_STREAMING > 0
 		// the number of multiple requests are allowed
 		// to blocks still not downloaded (debugging only)
@@ -168,6 +183,10 @@ namespace libtorrent {
 		// saved in the resume data
 		bool ephemeral = false;
 
+		// this is an additional connection to the same URL as another entry,
+		// see settings_pack::urlseed_connections. These are always ephemeral
+		bool secondary = false;
+
 		// if the web server doesn't support keepalive or a block request was
 		// interrupted, the block received so far is kept here for the next
 		// connection to pick up
@@ -198,6 +217,7 @@ namespace libtorrent {
 			resolving = std::move(rhs.resolving);
 			removed = std::move(rhs.removed);
 			ephemeral = std::move(rhs.ephemeral);
+			secondary = std::move(rhs.secondary);
 			restart_request = std::move(rhs.restart_request);
 			restart_piece = std::move(rhs.restart_piece);
 			redirects = std::move(rhs.redirects);
@@ -382,7 +402,10 @@ namespace libtorrent {
 		peer_connection* find_peer(sha1_hash const& pid);
 
 		void on_resume_data_checked(status_t status, storage_error const& error);
+		void on_resume_data_verified(status_t status, storage_error const& error);
 		void on_force_recheck(status_t status, storage_error const& error);
+		void on_background_verified(piece_index_t piece, sha1_hash const& piece_hash
+			, storage_error const& error);
 		void on_piece_hashed(piece_index_t piece, sha1_hash const& piece_hash
 			, storage_error const& error);
 		void files_checked();
@@ -424,6 +447,28 @@ namespace libtorrent {
 		void on_disk_read_complete(disk_buffer_holder block, int flags, storage_error const& se
 			, peer_request const& r, std::shared_ptr<read_piece_struct> rp);
 
+		// the state of a read_range() call
+		struct range_read
+		{
+			std::function<void(error_code const&, std::vector<range_buffer>)> handler;
+
+			// the block-sized reads the range is split into
+			std::vector<peer_request> requests;
+			std::vector<range_buffer> buffers;
+
+			// the pieces of the range we don't have yet
+			std::vector<piece_index_t> missing;
+
+			int outstanding = 0;
+			error_code error;
+		};
+		void read_range(file_index_t file, std::int64_t offset, int size
+			, std::function<void(error_code const&, std::vector<range_buffer>)> handler
+			, int deadline);
+		void issue_range_read(std::shared_ptr<range_read> rr);
+		void on_range_read_complete(disk_buffer_holder block, int flags
+			, storage_error const& se, std::shared_ptr<range_read> rr, int idx);
+
 		storage_mode_t storage_mode() const;
 
 		// this will flag the torrent as aborted. The main
@@ -449,14 +494,11 @@ namespace libtorrent {
 		void queue_up();
 		void queue_down();
 		void set_queue_position(int p);
-		int queue_position() const { return m_sequence_number; }
-		// used internally
-		void set_queue_position_impl(int const p)
-		{
-			if (m_sequence_number == p) return;
-			m_sequence_number = p;
-			state_updated();
-		}
+		int queue_position() const;
+		// used internally, the handle of this torrent's entry in the
+		// session's download queue, or -1 if it's not in it
+		int queue_handle() const { return m_queue_handle; }
+		void set_queue_handle(int const h) { m_queue_handle = h; }
 
 		void second_tick(int tick_interval_ms);
 
@@ -465,6 +507,8 @@ namespace libtorrent {
 		void maybe_connect_web_seeds();
 
 		std::string name() const;
+		// the same as name(), without copying the string
+		string_view name_view() const;
 
 		stat statistics() const { return m_stat; }
 		std::int64_t bytes_left() const;
@@ -531,13 +575,23 @@ namespace libtorrent {
 		{
 			// save resume data every 15 minutes regardless, just to
 			// keep stats up to date
-			return m_need_save_resume_data ||
+			return m_need_save_resume_data != 0 ||
 				aux::time_now32() - m_last_saved_resume > minutes(15);
 		}
 
-		void set_need_save_resume()
+		// ``categories`` is a combination of
+		// torrent_handle::resume_data_changes_t flags
+		void set_need_save_resume(int const categories)
+		{
+			m_need_save_resume_data |= std::uint8_t(categories);
+		}
+
+		// called when we lose pieces, e.g. because of a recheck. From then on,
+		// the pieces passed since the last save no longer describe the change
+		void invalidate_passed_pieces()
 		{
-			m_need_save_resume_data = true;
+			m_passed_since_save.clear();
+			m_passed_overflow = true;
 		}
 
 		bool is_auto_managed() const { return m_auto_managed; }
@@ -562,6 +616,7 @@ namespace libtorrent {
 		void prioritize_pieces(aux::vector<int, piece_index_t> const& pieces);
 		void prioritize_piece_list(std::vector<std::pair<piece_index_t, int>> const& pieces);
 		void piece_priorities(aux::vector<int, piece_index_t>*) const;
+		void post_piece_priorities();
 
 		void set_file_priority(file_index_t index, int priority);
 		int file_priority(file_index_t index) const;
@@ -577,12 +632,19 @@ namespace libtorrent {
 		void update_piece_priorities();
 
 		void status(torrent_status* st, std::uint32_t flags);
+		void post_status(std::uint32_t flags);
 
 		// this torrent changed state, if the user is subscribing to
 		// it, add it to the m_state_updates list in session_impl
 		void state_updated();
 
 		void file_progress(aux::vector<std::int64_t, file_index_t>& fp, int flags = 0);
+		void post_file_progress(int flags);
+
+		// called when a block is downloaded or lost again, to keep the
+		// per-file progress up to date without walking the download queue
+		void add_block_progress(piece_block b);
+		void remove_block_progress(piece_block b);
 
 #ifndef TORRENT_NO_DEPRECATE
 		void use_interface(std::string net_interface);
@@ -669,7 +731,7 @@ namespace libtorrent {
 		void update_peer_port(int port, torrent_peer* p, int src);
 		void set_seed(torrent_peer* p, bool s);
 		void clear_failcount(torrent_peer* p);
-		std::pair<peer_list::iterator, peer_list::iterator> find_peers(address const& a);
+		std::vector<torrent_peer*> find_peers(address const& a);
 
 		// the number of peers that belong to this torrent
 		int num_peers() const { return int(m_connections.size() - m_peers_to_disconnect.size()); }
@@ -687,6 +749,7 @@ namespace libtorrent {
 
 		void get_full_peer_list(std::vector<peer_list_entry>* v) const;
 		void get_peer_info(std::vector<peer_info>* v);
+		void post_peer_info();
 		void get_download_queue(std::vector<partial_piece_info>* queue) const;
 
 		void update_auto_sequential();
@@ -765,6 +828,10 @@ namespace libtorrent {
 		void set_super_seeding(bool on);
 		piece_index_t get_piece_to_super_seed(typed_bitfield<piece_index_t> const&);
 
+		// called when the pieces a peer is being super seeded change
+		void super_seeded_pieces_changed(std::array<piece_index_t, 2> const& before
+			, std::array<piece_index_t, 2> const& after);
+
 		// returns true if we have downloaded the given piece
 		bool have_piece(piece_index_t index) const
 		{
@@ -820,6 +887,12 @@ namespace libtorrent {
 				: m_have_all ? m_torrent_file->num_pieces() : 0;
 		}
 
+		// when batch_piece_picks is enabled, peers call this instead of
+		// request_a_block(). The blocks are picked, and requested, for all
+		// peers that called it once the network events currently queued have
+		// been handled
+		void defer_piece_pick(peer_connection& c);
+
 		// when we get a have message, this is called for that piece
 		void peer_has(piece_index_t index, peer_connection const* peer);
 
@@ -882,6 +955,10 @@ namespace libtorrent {
 		// inactive state is not instantaneous, but low-pass filtered)
 		bool is_inactive_internal() const;
 
+		// resets the transfer rates if there are no peers left to transfer
+		// with, to let the torrent leave the tick list
+		void clear_idle_rates();
+
 		// remove a web seed, or schedule it for removal in case there
 		// are outstanding operations on it
 		void remove_web_seed_iter(std::list<web_seed_t>::iterator web);
@@ -921,6 +998,22 @@ namespace libtorrent {
 		// this is the handler for write failure piece synchronization
 		void on_piece_fail_sync(piece_index_t piece, piece_block b);
 
+		// called with the digest of every block of a piece that failed the
+		// hash check. Records them in m_failed_blocks and decides which
+		// blocks, if any, to keep before clearing the piece
+		void on_failed_piece_hashed(std::vector<address> const& downloaders
+			, piece_index_t piece, std::vector<sha1_hash> const& digests
+			, storage_error const& error);
+
+		// the same as on_piece_sync(), except the blocks in ``keep`` stay
+		// finished. Only the other ones are downloaded again
+		void on_piece_salvage_sync(piece_index_t piece, std::vector<int> const& keep);
+
+		// after a failed piece has been restored in the picker, marks the
+		// blocks of it peers still have outstanding requests for as
+		// downloading again
+		void re_request_blocks(piece_index_t piece);
+
 		void add_redundant_bytes(int b, waste_reason reason);
 		void add_failed_bytes(int b);
 
@@ -935,6 +1028,17 @@ namespace libtorrent {
 
 		std::string save_path() const;
 		alert_manager& alerts() const;
+
+		// alert categories enabled for this torrent only, in addition to the
+		// session's alert mask
+		void set_alert_mask(std::uint32_t m);
+		std::uint32_t alert_mask() const { return m_alert_mask; }
+
+		// returns true if an alert of type T, posted on behalf of this torrent,
+		// would be delivered
+		template <class T>
+		bool should_post() const
+		{ return alerts().should_post<T>(m_alert_mask); }
 		piece_picker& picker()
 		{
 			TORRENT_ASSERT(m_picker.get());
@@ -964,6 +1068,10 @@ namespace libtorrent {
 		storage_index_t storage() const { return m_storage; }
 		storage_interface* get_storage_impl() const;
 
+		// the index of the device the torrent's files are on, as assigned by
+		// the disk thread. 0 if the torrent doesn't have a storage yet
+		int storage_device() const;
+
 		torrent_info const& torrent_file() const
 		{ return *m_torrent_file; }
 
@@ -993,6 +1101,18 @@ namespace libtorrent {
 
 		void write_resume_data(add_torrent_params& atp) const;
 
+		// fills in the fields of ``atp`` belonging to ``categories``
+		// (torrent_handle::resume_data_changes_t). If ``have_pieces`` is false,
+		// the have_pieces bitfield is left out of the resume_pieces category
+		void write_resume_data_impl(add_torrent_params& atp, int categories
+			, bool have_pieces) const;
+		void write_resume_stats(add_torrent_params& atp) const;
+		void write_resume_settings(add_torrent_params& atp) const;
+		void write_resume_pieces(add_torrent_params& atp, bool have_pieces) const;
+		void write_resume_trackers(add_torrent_params& atp) const;
+		void write_resume_peers(add_torrent_params& atp) const;
+		void write_resume_priorities(add_torrent_params& atp) const;
+
 		void seen_complete() { m_last_seen_complete = time(0); }
 		int time_since_complete() const { return int(time(0) - m_last_seen_complete); }
 		time_t last_seen_complete() const { return m_last_seen_complete; }
@@ -1046,7 +1166,7 @@ namespace libtorrent {
 			, char const* data, int size);
 #endif
 
-		int sequence_number() const { return m_sequence_number; }
+		int sequence_number() const { return queue_position(); }
 
 		bool seed_mode() const { return m_seed_mode; }
 		void leave_seed_mode(bool skip_checking);
@@ -1064,6 +1184,16 @@ namespace libtorrent {
 		{ return m_verified.get_bit(piece); }
 		void verified(piece_index_t piece);
 
+		// a peer requested a block from this piece while in seed mode. This
+		// decides which pieces are verified in the background first
+		void seed_mode_requested(piece_index_t const piece)
+		{ m_verify_order.requested(piece, m_torrent_file->num_pieces()); }
+
+		// while in seed mode, verifies pieces before peers request them, as
+		// long as the disk is otherwise idle. See
+		// settings_pack::seed_mode_background_checks
+		void verify_in_background();
+
 		bool add_merkle_nodes(std::map<int, sha1_hash> const& n, piece_index_t piece);
 
 		// this is called once periodically for torrents
@@ -1125,12 +1255,19 @@ namespace libtorrent {
 		int num_time_critical_pieces() const
 		{ return int(m_time_critical_pieces.size()); }
 
-		int get_suggest_pieces(std::vector<piece_index_t>& p
-			, typed_bitfield<piece_index_t> const& bits
-			, int const n)
+		void set_stream_window(file_index_t file, std::int64_t offset, int num_pieces);
+
+		// the range of pieces ahead of the streaming read position, that
+		// are picked before any other pieces. Empty if there is no window
+		std::pair<piece_index_t, piece_index_t> stream_window() const
 		{
-			return m_suggest_pieces.get_pieces(p, bits, n);
+			return {m_stream_window_start, piece_index_t(
+				static_cast<int>(m_stream_window_start) + m_stream_window_size)};
 		}
+
+		int get_suggest_pieces(std::vector<piece_index_t>& p
+			, typed_bitfield<piece_index_t> const& bits
+			, int n);
 		void add_suggest_piece(piece_index_t index);
 
 		enum { no_gauge_state = 0xf };
@@ -1140,6 +1277,12 @@ namespace libtorrent {
 		// trigger deferred disconnection of peers
 		void on_remove_peers();
 
+		// picks blocks for the peers in m_peers_to_pick
+		void on_deferred_piece_picks();
+
+		// sends the HAVE messages queued up in m_pending_haves to all peers
+		void on_deferred_haves();
+
 		void ip_filter_updated();
 
 		void inc_stats_counter(int c, int value = 1);
@@ -1149,6 +1292,13 @@ namespace libtorrent {
 		// on the erased member after the peer_list call
 		torrent_state get_peer_list_state();
 
+		// adds the peer to the peer list, with the peer list state st. This
+		// is the bulk of add_peer(), for adding many peers at once. The caller
+		// is responsible for calling peers_erased() on st.erased,
+		// update_want_peers() and state_updated() once it's done
+		torrent_peer* add_peer_impl(tcp::endpoint const& adr, int source
+			, int flags, torrent_state& st);
+
 		void construct_storage();
 		void update_list(int list, bool in);
 
@@ -1192,6 +1342,13 @@ namespace libtorrent {
 
 		std::shared_ptr<const ip_filter> m_ip_filter;
 
+		// the peers recently passed to add_peer_impl(), along with their
+		// source and flags. Trackers, the DHT and other peers keep telling us
+		// about the same peers, this lets us ignore those repeats without
+		// going through the filters and the peer list. It's allocated the
+		// first time a peer is added
+		std::unique_ptr<aux::recent_endpoints> m_recent_peers;
+
 		// all time totals of uploaded and downloaded payload
 		// stored in resume data
 		std::int64_t m_total_uploaded = 0;
@@ -1206,6 +1363,10 @@ namespace libtorrent {
 #ifdef TORRENT_USE_OPENSSL
 		std::shared_ptr<boost::asio::ssl::context> m_ssl_ctx;
 
+		// the TLS sessions of our outgoing connections, to resume them when
+		// reconnecting to the same peers
+		std::shared_ptr<aux::ssl_session_cache> m_ssl_sessions;
+
 		bool verify_peer_cert(bool preverified, boost::asio::ssl::verify_context& ctx);
 
 		void init_ssl(string_view cert);
@@ -1220,15 +1381,16 @@ namespace libtorrent {
 		std::list<web_seed_t> m_web_seeds;
 
 #ifndef TORRENT_DISABLE_EXTENSIONS
-		std::list<std::shared_ptr<torrent_plugin>> m_extensions;
+		aux::extension_list<torrent_plugin> m_extensions;
 #endif
 
-		// used for tracker announces
-		deadline_timer m_tracker_timer;
+		// used for tracker announces. Both these timers are kept in the
+		// session's timer wheel, rather than each arming a system timer
+		aux::wheel_timer m_tracker_timer;
 
 		// used to detect when we are active or inactive for long enough
 		// to trigger the auto-manage logic
-		deadline_timer m_inactivity_timer;
+		aux::wheel_timer m_inactivity_timer;
 
 		// this is the upload and download statistics for the whole torrent.
 		// it's updated from all its peers once every second.
@@ -1250,11 +1412,23 @@ namespace libtorrent {
 		// us.
 		aux::suggest_piece m_suggest_pieces;
 
+		// while super seeding, this keeps the pieces ordered by how many peers
+		// have them. It's built the first time a piece is picked
+		std::unique_ptr<aux::super_seed_index> m_super_seed_index;
+
 		aux::vector<announce_entry> m_trackers;
 
 		// this list is sorted by time_critical_piece::deadline
 		std::vector<time_critical_piece> m_time_critical_pieces;
 
+		// the first piece and the number of pieces in the streaming window,
+		// set by set_stream_window()
+		piece_index_t m_stream_window_start{0};
+		int m_stream_window_size = 0;
+
+		// read_range() calls waiting for pieces to be downloaded
+		std::vector<std::shared_ptr<range_read>> m_pending_range_reads;
+
 		std::string m_trackerid;
 #ifndef TORRENT_NO_DEPRECATE
 		// deprecated in 1.1
@@ -1292,6 +1466,28 @@ namespace libtorrent {
 		// separate class (to use as memeber here instead)
 		std::vector<piece_index_t> m_predictive_pieces;
 
+		// the blocks of a piece that failed the hash check, as seen by
+		// on_failed_piece_hashed(). For each block, the salted digest sent by
+		// every peer that has sent it (up to a few)
+		struct block_observation
+		{
+			address peer;
+			sha1_hash digest;
+		};
+		struct failed_piece
+		{
+			std::vector<std::vector<block_observation>> blocks;
+
+			// set once some blocks of the piece have been kept. If it fails
+			// again, two peers agreed on bad data and nothing is kept anymore
+			bool salvaged = false;
+		};
+		std::map<piece_index_t, failed_piece> m_failed_blocks;
+
+		// appended to the blocks when hashing them for m_failed_blocks, to
+		// keep peers from crafting blocks colliding with good ones
+		std::uint32_t m_block_salt;
+
 		// the performance counters of this session
 		counters& m_stats_counters;
 
@@ -1306,6 +1502,9 @@ namespace libtorrent {
 		// to verify each piece that has a 1
 		typed_bitfield<piece_index_t> m_verifying;
 
+		// the order pieces are verified in the background, in seed mode
+		aux::verify_order m_verify_order;
+
 		// set if there's an error on this torrent
 		error_code m_error;
 
@@ -1356,8 +1555,29 @@ namespace libtorrent {
 		// m_num_verified = m_verified.count()
 		std::uint32_t m_num_verified = 0;
 
+		// the number of hash jobs issued by verify_in_background() that
+		// haven't completed yet
+		int m_background_verifications = 0;
+
+		// alert categories enabled for this torrent, on top of the session's
+		std::uint32_t m_alert_mask = 0;
+
 		time_point32 m_last_saved_resume = aux::time_now32();
 
+		// the categories of resume data (torrent_handle::resume_data_changes_t)
+		// that have changed since resume data was last saved. Cleared when
+		// saving resume data
+		std::uint8_t m_need_save_resume_data = 0;
+
+		// set if m_passed_since_save no longer describes how the have_pieces
+		// bitfield changed since the last save, either because pieces were
+		// lost or because the list grew larger than the bitfield itself
+		bool m_passed_overflow = false;
+
+		// the pieces we got since resume data was last saved. Reported as a delta
+		// when saving with torrent_handle::only_changes
+		std::vector<piece_index_t> m_passed_since_save;
+
 		// if this torrent is running, this was the time
 		// when it was started. This is used to have a
 		// bias towards keeping seeding torrents that
@@ -1399,14 +1619,25 @@ namespace libtorrent {
 		std::int32_t m_total_failed_bytes = 0;
 		std::int32_t m_total_redundant_bytes = 0;
 
-		// the sequence number for this torrent, this is a
-		// monotonically increasing number for each added torrent
-		int m_sequence_number;
+		// the handle of this torrent's entry in the session's download
+		// queue, which determines its queue position. -1 if the torrent
+		// isn't queued
+		int m_queue_handle = -1;
 
 		// used to post a message to defer disconnecting peers
 		std::vector<peer_connection*> m_peers_to_disconnect;
 		aux::deferred_handler m_deferred_disconnect;
 
+		// peers waiting for blocks to be picked for them, see
+		// defer_piece_pick()
+		std::vector<std::shared_ptr<peer_connection>> m_peers_to_pick;
+		aux::deferred_handler m_deferred_pick;
+
+		// pieces that passed the hash check but haven't been announced to
+		// peers yet, when coalesce_have_messages is enabled
+		std::vector<piece_index_t> m_pending_haves;
+		aux::deferred_handler m_deferred_have;
+
 		// for torrents who have a bandwidth limit, this is != 0
 		// and refers to a peer_class in the session.
 		peer_class_t m_peer_class{0};
@@ -1505,11 +1736,7 @@ namespace libtorrent {
 		// from a non-downloading/seeding state, the torrent is paused.
 		bool m_stop_when_ready:1;
 
-		// set to false when saving resume data. Set to true
-		// whenever something is downloaded
-		bool m_need_save_resume_data:1;
-
-		// 2 bits here
+		// 3 bits here
 
 // ----
 
@@ -1564,6 +1791,11 @@ namespace libtorrent {
 		// quarantine
 		bool m_pending_active_change:1;
 
+		// set when the resume data check was skipped when starting the
+		// torrent (defer_resume_data_check). The files are then checked
+		// against the resume data once the torrent has started
+		bool m_deferred_resume_check:1;
+
 // ----
 
 		// the number of bytes of padding files
@@ -1633,6 +1865,14 @@ namespace libtorrent {
 		// the current stats gauge this torrent counts against
 		std::uint32_t m_current_gauge_state:4;
 
+		// the memory used by m_picker, as last reported to the
+		// piece_picker_bytes gauge
+		int m_picker_memory = 0;
+
+		// the memory used by m_torrent_file, as last reported to the
+		// torrent_info_bytes gauge
+		int m_torrent_file_memory = 0;
+
 		// set to true while moving the storage
 		bool m_moving_storage:1;
 
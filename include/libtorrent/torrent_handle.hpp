@@ -50,6 +50,7 @@ POSSIBILITY OF SUCH DAMAGE.
 #include "libtorrent/address.hpp"
 #include "libtorrent/socket.hpp" // tcp::endpoint
 #include "libtorrent/span.hpp"
+#include "libtorrent/error_code.hpp"
 #include "libtorrent/sha1_hash.hpp"
 #include "libtorrent/units.hpp"
 #include "libtorrent/aux_/vector.hpp"
@@ -147,6 +148,20 @@ namespace libtorrent { namespace aux {
 #endif
 	};
 
+	// a range of torrent data, passed to the handler of
+	// torrent_handle::read_range(). ``buffer`` refers to a block in the disk
+	// cache (or a buffer from the disk buffer pool), which is held for as
+	// long as any copy of ``buffer`` exists. Buffers must be released before
+	// the session is destructed.
+	struct TORRENT_EXPORT range_buffer
+	{
+		std::shared_ptr<char const> buffer;
+		int size = 0;
+
+		span<char const> data() const
+		{ return {buffer.get(), std::size_t(size)}; }
+	};
+
 	// This class holds information about pieces that have outstanding requests
 	// or outstanding writes
 	struct TORRENT_EXPORT partial_piece_info
@@ -298,6 +313,12 @@ namespace libtorrent { namespace aux {
 		// information about that particular peer. See peer_info.
 		void get_peer_info(std::vector<peer_info>& v) const;
 
+		// the asynchronous version of get_peer_info(). Instead of blocking the
+		// calling thread until the network thread has filled in the vector, a
+		// peer_info_alert is posted with the result. If the torrent is removed
+		// before the request is handled, no alert is posted.
+		void post_peer_info() const;
+
 		// flags to pass in to status() to specify which properties of the
 		// torrent to query for. By default all flags are set.
 		enum status_flags_t
@@ -340,6 +361,12 @@ namespace libtorrent { namespace aux {
 		// what to *include* are defined in the status_flags_t enum.
 		torrent_status status(std::uint32_t flags = 0xffffffff) const;
 
+		// the asynchronous version of status(). It does not block the calling
+		// thread, but posts a state_update_alert with the status of this
+		// torrent as its only entry. To query many torrents at once, see
+		// session_handle::post_torrent_status().
+		void post_status(std::uint32_t flags = 0xffffffff) const;
+
 		// ``get_download_queue()`` takes a non-const reference to a vector which
 		// it will fill with information about pieces that are partially
 		// downloaded or not downloaded at all but partially requested. See
@@ -443,6 +470,10 @@ namespace libtorrent { namespace aux {
 		// already keeps track of this internally and no calculation is required.
 		void file_progress(std::vector<std::int64_t>& progress, int flags = 0) const;
 
+		// the asynchronous version of file_progress(). The result is posted
+		// as a file_progress_alert.
+		void post_file_progress(int flags = 0) const;
+
 		// This function returns a vector with status about files
 		// that are open for this torrent. Any file that is not open
 		// will not be reported in the vector, i.e. it's possible that
@@ -662,7 +693,48 @@ namespace libtorrent { namespace aux {
 			// priorities having changed etc. If the resume data doesn't need
 			// saving, a save_resume_data_failed_alert is posted with the error
 			// resume_data_not_modified.
-			only_if_modified = 4
+			only_if_modified = 4,
+
+			// only fill in the fields of add_torrent_params belonging to
+			// categories that have changed since the last time resume data was
+			// saved (see resume_data_changes_t). The remaining fields are left
+			// at their defaults. save_resume_data_alert::changes tells which
+			// categories were filled in, and the pieces that passed since the
+			// last save are reported in save_resume_data_alert::passed_pieces
+			// instead of the full have_pieces bitfield. This is meant for
+			// clients that store resume data as a series of updates, and want
+			// periodic saving to be cheap for large numbers of torrents.
+			only_changes = 8
+		};
+
+		// categories of the state saved in resume data. These are used to
+		// report what has changed since the last time resume data was saved,
+		// in save_resume_data_alert::changes.
+		enum resume_data_changes_t
+		{
+			// have_pieces, unfinished_pieces, verified_pieces and merkle_tree
+			resume_pieces = 1,
+
+			// file_priorities and piece_priorities
+			resume_priorities = 2,
+
+			// trackers, tracker_tiers, url_seeds and http_seeds
+			resume_trackers = 4,
+
+			// flags, save_path, renamed_files and the transfer, connection and
+			// unchoke limits
+			resume_settings = 8,
+
+			// the upload and download counters, the active, seeding, finished,
+			// added and completed times and the scrape counts
+			resume_stats = 16,
+
+			// peers and banned_peers. Changes to the peer list are not tracked,
+			// it is considered changed once resume data hasn't been saved for 15
+			// minutes.
+			resume_peers = 32,
+
+			resume_all = 63
 		};
 
 		// ``save_resume_data()`` asks libtorrent to generate fast-resume data for
@@ -1008,6 +1080,10 @@ namespace libtorrent { namespace aux {
 		void prioritize_pieces(std::vector<std::pair<piece_index_t, int>> const& pieces) const;
 		std::vector<int> piece_priorities() const;
 
+		// the asynchronous version of piece_priorities(). The result is posted
+		// as a piece_priorities_alert.
+		void post_piece_priorities() const;
+
 		// ``index`` must be in the range [0, number_of_files).
 		//
 		// ``file_priority()`` queries or sets the priority of file ``index``.
@@ -1093,6 +1169,18 @@ namespace libtorrent { namespace aux {
 		void set_download_limit(int limit) const;
 		int download_limit() const;
 
+		// ``set_alert_mask()`` enables additional alert categories (see
+		// alert::category_t) for this torrent and its peers only, on top of
+		// the session-wide settings_pack::alert_mask. This is useful to turn on
+		// verbose categories, like ``block_progress_notification`` or
+		// ``peer_log_notification``, for a torrent being debugged, without
+		// generating those alerts for every torrent in the session.
+		// ``alert_mask()`` returns the current per-torrent mask. It defaults
+		// to 0. Peer classes can enable categories for their peers the same
+		// way, see peer_class_info::alert_mask.
+		void set_alert_mask(std::uint32_t m) const;
+		std::uint32_t alert_mask() const;
+
 #ifndef TORRENT_NO_DEPRECATE
 		// A pinned torrent may not be unloaded by libtorrent. When the dynamic
 		// loading and unloading of torrents is enabled (by setting a load
@@ -1121,6 +1209,32 @@ namespace libtorrent { namespace aux {
 		// negatively in the swarm. It should be used sparingly.
 		void set_sequential_download(bool sd) const;
 
+		// ``set_stream_window()`` keeps a window of ``num_pieces`` pieces,
+		// starting at the piece containing ``offset`` into ``file``, ahead of
+		// all other pieces. Pieces in the window are picked rarest first
+		// among themselves, so streaming reads see low latency without making
+		// the download sequential. Call it again as the read position moves.
+		// Setting ``num_pieces`` to 0, or an offset outside the file, removes
+		// the window.
+		void set_stream_window(file_index_t file, std::int64_t offset
+			, int num_pieces) const;
+
+		// ``read_range()`` reads ``size`` bytes starting at ``offset`` into
+		// ``file`` and passes them to ``handler``, as a sequence of buffers in
+		// file order, each at most one 16 kiB block. The buffers are those of
+		// the disk cache, no copy of the data is made. If some of the pieces
+		// haven't been downloaded yet, they are given a deadline of
+		// ``deadline`` milliseconds (see set_piece_deadline()) and the read
+		// is issued once they've all passed the hash check.
+		//
+		// ``handler`` is called from the network thread, and must not block.
+		// On failure, the error_code is set and the vector is empty. If the
+		// torrent is removed or the session is stopped before the data is
+		// available, the handler is called with ``operation_canceled``.
+		void read_range(file_index_t file, std::int64_t offset, int size
+			, std::function<void(error_code const&, std::vector<range_buffer>)> handler
+			, int deadline = 0) const;
+
 		// ``connect_peer()`` is a way to manually connect to peers that one
 		// believe is a part of the torrent. If the peer does not respond, or is
 		// not a member of this torrent, it will simply be disconnected. No harm
@@ -151,12 +151,24 @@ namespace libtorrent {
 		explicit torrent_info(bdecode_node const& torrent_file, int flags = 0);
 		explicit torrent_info(char const* buffer, int size, int flags = 0);
 		explicit torrent_info(std::string const& filename, int flags = 0);
+		torrent_info(std::shared_ptr<char const> buffer, int size, int flags = 0);
 #endif // BOOST_NO_EXCEPTIONS
 		explicit torrent_info(torrent_info const& t);
 		explicit torrent_info(sha1_hash const& info_hash, int flags = 0);
 		torrent_info(bdecode_node const& torrent_file, error_code& ec, int flags = 0);
 		torrent_info(char const* buffer, int size, error_code& ec, int flags = 0);
 		torrent_info(std::string const& filename, error_code& ec, int flags = 0);
+
+		// The overloads taking a ``std::shared_ptr<char const>`` parse the
+		// .torrent file in ``buffer`` without copying its info section.
+		// Instead, the torrent_info (and anyone holding on to its
+		// metadata()) keeps a reference to ``buffer``, and the file names and
+		// piece hashes point directly into it. This is useful for loading a
+		// large number of torrents from memory mapped .torrent files, with a
+		// deleter that unmaps the file. The buffer must not be modified for
+		// as long as it's referenced.
+		torrent_info(std::shared_ptr<char const> buffer, int size, error_code& ec
+			, int flags = 0);
 #ifndef TORRENT_NO_DEPRECATE
 		TORRENT_DEPRECATED
 		explicit torrent_info(lazy_entry const& torrent_file, int flags = 0);
@@ -433,11 +445,7 @@ namespace libtorrent {
 			TORRENT_ASSERT(index < m_files.end_piece());
 			TORRENT_ASSERT(is_loaded());
 			int const idx = static_cast<int>(index);
-			if (is_merkle_torrent())
-			{
-				TORRENT_ASSERT(idx < m_merkle_tree.end_index() - m_merkle_first_leaf);
-				return m_merkle_tree[m_merkle_first_leaf + idx].data();
-			}
+			if (is_merkle_torrent()) return merkle_node_ptr(m_merkle_first_leaf + idx);
 			else
 			{
 				TORRENT_ASSERT(m_piece_hashes);
@@ -448,10 +456,12 @@ namespace libtorrent {
 			}
 		}
 
-		bool is_loaded() const { return m_piece_hashes || !m_merkle_tree.empty(); }
+		bool is_loaded() const { return m_piece_hashes != nullptr; }
 
 		// ``merkle_tree()`` returns a reference to the merkle tree for this
-		// torrent, if any.
+		// torrent, if any. The tree is only allocated once a node other than
+		// the root is known (i.e. when a peer sends us hashes or when the tree
+		// is set with ``set_merkle_tree()``). Until then this is empty.
 		// ``set_merkle_tree()`` moves the passed in merkle tree into the
 		// torrent_info object. i.e. ``h`` will not be identical after the call.
 		// You need to set the merkle tree for a torrent that you've just created
@@ -460,8 +470,7 @@ namespace libtorrent {
 		// separately from the torrent file itself. Once it's added to
 		// libtorrent, the merkle tree will be persisted in the resume data.
 		std::vector<sha1_hash> const& merkle_tree() const { return m_merkle_tree; }
-		void set_merkle_tree(std::vector<sha1_hash>& h)
-		{ TORRENT_ASSERT(h.size() == m_merkle_tree.size() ); m_merkle_tree.swap(h); }
+		void set_merkle_tree(std::vector<sha1_hash>& h);
 
 		// ``name()`` returns the name of the torrent.
 		// name contains UTF-8 encoded string.
@@ -517,6 +526,10 @@ namespace libtorrent {
 		boost::shared_array<char> metadata() const
 		{ return m_info_section; }
 
+		// an estimate of the number of bytes of memory used by this
+		// torrent_info, including its own size
+		std::size_t memory_usage() const;
+
 		// internal
 		bool add_merkle_nodes(std::map<int, sha1_hash> const& subtree
 			, piece_index_t piece);
@@ -526,7 +539,7 @@ namespace libtorrent {
 		// see BEP30__.
 		//
 		// __ http://bittorrent.org/beps/bep_0030.html
-		bool is_merkle_torrent() const { return !m_merkle_tree.empty(); }
+		bool is_merkle_torrent() const { return (m_flags & merkle_torrent) != 0; }
 
 		bool parse_torrent_file(bdecode_node const& libtorrent, error_code& ec, int flags);
 
@@ -535,6 +548,23 @@ namespace libtorrent {
 
 		void resolve_duplicate_filenames();
 
+		// returns the hash of node ``n`` in the merkle tree. If the tree
+		// hasn't been allocated yet, all nodes except the root are unknown,
+		// i.e. all zeros
+		char const* merkle_node_ptr(int n) const;
+
+		// allocates m_merkle_tree, with only the root hash filled in
+		void allocate_merkle_tree();
+
+		// the implementations of parse_torrent_file() and
+		// parse_info_section(). If ``buffer`` is set, it's the buffer the
+		// nodes were decoded from and the info section is referenced in
+		// there, rather than copied
+		bool parse_torrent_file_impl(bdecode_node const& torrent_file
+			, error_code& ec, int flags, std::shared_ptr<char const> const& buffer);
+		bool parse_info_section_impl(bdecode_node const& e, error_code& ec
+			, int flags, std::shared_ptr<char const> const& buffer);
+
 		// the slow path, in case we detect/suspect a name collision
 		void resolve_duplicate_filenames_slow();
 
@@ -586,12 +616,17 @@ namespace libtorrent {
 
 		// if this is a merkle torrent, this is the merkle
 		// tree. It has space for merkle_num_nodes(merkle_num_leafs(num_pieces))
-		// hashes
+		// hashes. It's not allocated until we learn about nodes other than
+		// the root, which saves the memory (and the time to clear it) for
+		// merkle torrents we don't download. The root hash is always
+		// available via m_piece_hashes
 		aux::vector<sha1_hash> m_merkle_tree;
 
 		// this is a copy of the info section from the torrent.
 		// it use maintained in this flat format in order to
-		// make it available through the metadata extension
+		// make it available through the metadata extension. When constructed
+		// from a shared buffer, this refers into that buffer instead (and
+		// keeps it alive)
 		// TODO: change the type to std::shared_ptr in C++17
 		boost::shared_array<char> m_info_section;
 
@@ -648,6 +683,10 @@ namespace libtorrent {
 			// this flag is set if we found an ssl-cert field in the info
 			// dictionary
 			ssl_torrent = 8,
+
+			// this is a merkle torrent, m_piece_hashes points to the root
+			// hash
+			merkle_torrent = 16,
 		};
 
 		// any combination of values from flags_t enum
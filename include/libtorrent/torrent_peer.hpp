@@ -55,6 +55,9 @@ namespace libtorrent {
 		std::int64_t total_download() const;
 		std::int64_t total_upload() const;
 
+		// as computed by hashing our IP with the remote IP of this peer. This
+		// is not cached in the torrent_peer, to keep it small. The peer_list
+		// caches it for connect candidates
 		std::uint32_t rank(external_ip const& external, int external_port) const;
 
 		libtorrent::address address() const;
@@ -86,11 +89,6 @@ namespace libtorrent {
 		// will refer to a valid peer_connection
 		peer_connection_interface* connection;
 
-		// as computed by hashing our IP with the remote
-		// IP of this peer
-		// calculated lazily
-		mutable std::uint32_t peer_rank;
-
 		// the time when this torrent_peer was optimistically unchoked
 		// the last time. in seconds since session was created
 		// 16 bits is enough to last for 18.2 hours
@@ -197,6 +195,9 @@ namespace libtorrent {
 #endif
 	};
 
+	// with 64 bit pointers, this is 32 bytes on compilers that place members
+	// of derived classes in the tail padding of the base class (i.e. the
+	// Itanium C++ ABI)
 	struct TORRENT_EXTRA_EXPORT ipv4_peer : torrent_peer
 	{
 		ipv4_peer(tcp::endpoint const& ip, bool connectable, int src);
@@ -0,0 +1,63 @@
+/*
+
+Copyright (c) 2017, Arvid Norberg
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions
+are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in
+      the documentation and/or other materials provided with the distribution.
+    * Neither the name of the author nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+
+#ifndef TORRENT_TRACE_HPP_INCLUDED
+#define TORRENT_TRACE_HPP_INCLUDED
+
+#include "libtorrent/config.hpp"
+#include "libtorrent/error_code.hpp"
+
+#include <string>
+
+namespace libtorrent {
+
+	// enables or disables recording of trace events. Tracing is process wide
+	// and disabled by default. While enabled, every thread records events
+	// from the hot paths of libtorrent (disk jobs, block requests, piece
+	// picker invocations and uTP packets) into a ring buffer of its own,
+	// holding its most recent events. While disabled, each trace point costs
+	// a single relaxed atomic load.
+	TORRENT_EXPORT void set_tracing(bool enable);
+	TORRENT_EXPORT bool tracing_enabled();
+
+	// writes the events currently held in the trace buffers of all threads
+	// to ``filename``, in a compact binary format. ``tools/parse_trace.py``
+	// converts it to the chrome trace event format, which can be loaded in
+	// ``chrome://tracing`` or perfetto.
+	TORRENT_EXPORT void save_trace(std::string const& filename, error_code& ec);
+
+	// discards all events recorded so far
+	TORRENT_EXPORT void clear_trace();
+}
+
+#endif
@@ -70,6 +70,7 @@ namespace libtorrent {
 	struct timeout_handler;
 	class udp_tracker_connection;
 	class http_tracker_connection;
+	struct http_connection;
 	struct resolver_interface;
 	struct counters;
 	struct ip_filter;
@@ -391,8 +392,81 @@ namespace libtorrent {
 		void send(udp::endpoint const& ep, span<char const> p
 			, error_code& ec, int flags = 0);
 
+		// returns an idle keep-alive connection to the HTTP tracker
+		// identified by ``key``, or nullptr if there isn't one
+		std::shared_ptr<http_connection> get_idle_connection(std::string const& key);
+
+		// hands a connection back once its request has completed, to be
+		// reused by the next request with the same ``key``. If there are
+		// already enough idle connections, it's closed instead
+		void add_idle_connection(std::string const& key
+			, std::shared_ptr<http_connection> c);
+
+		// the number of requests waiting for the per-host limits to allow
+		// them to be sent
+		int num_queued() const { return m_num_queued; }
+
 	private:
 
+		struct queued_request
+		{
+			io_service* ios;
+			tracker_request req;
+			std::weak_ptr<request_callback> callback;
+
+			// lower values are sent first
+			int priority;
+
+			// requests with the same priority are sent in the order they
+			// were queued
+			std::uint32_t sequence;
+		};
+
+		// the state of requests to a tracker host
+		struct tracker_host
+		{
+			explicit tracker_host(io_service& ios) : timer(ios) {}
+
+			// requests waiting to be sent. This is a heap ordered by
+			// priority and sequence number
+			std::vector<queued_request> queue;
+
+			// the number of outstanding requests
+			int outstanding = 0;
+
+			// the rate limit allows a request to be sent as long as this is
+			// no more than one second in the future. Every request sent
+			// pushes it forward by the request interval
+			time_point next_send = min_time();
+
+			// fires when the queue can make progress again
+			deadline_timer timer;
+			bool timer_active = false;
+		};
+
+		// the order of the queue heap. The top is the request to send next
+		static bool compare_queued(queued_request const& lhs
+			, queued_request const& rhs);
+
+		tracker_host& get_host(io_service& ios, std::string const& key);
+		bool can_send(tracker_host const& h) const;
+		void start_request(io_service& ios, tracker_request req
+			, std::weak_ptr<request_callback> c, tracker_host& h);
+		void request_done(std::string const& url);
+		void schedule(std::string const& key, tracker_host& h);
+		void on_host_timer(error_code const& ec, std::string const& key);
+
+		struct idle_connection
+		{
+			std::shared_ptr<http_connection> conn;
+			time_point idle_since;
+		};
+
+		// closes and removes idle connections (for the given key) that have
+		// been idle for too long for the server to still be expected to
+		// keep them open
+		void prune_idle_connections(std::vector<idle_connection>& conns);
+
 		// maps transactionid to the udp_tracker_connection
 		// These must use shared_ptr to avoid a dangling reference
 		// if a connection is erased while a timeout event is in the queue
@@ -400,6 +474,25 @@ namespace libtorrent {
 
 		std::vector<std::shared_ptr<http_tracker_connection>> m_http_conns;
 
+		// the most recent UDP scrape for each tracker URL. Scrapes issued
+		// for the same tracker before it's sent are added to it, to go out
+		// in a single packet
+		std::unordered_map<std::string, std::weak_ptr<udp_tracker_connection>> m_udp_scrapes;
+
+		// idle keep-alive connections to HTTP trackers, keyed by scheme, host,
+		// port and the local address they're bound to. The most recently used
+		// connection is at the back
+		std::unordered_map<std::string, std::vector<idle_connection>> m_idle_http_conns;
+
+		// per-host request limits and queues, keyed by tracker hostname
+		std::unordered_map<std::string, std::unique_ptr<tracker_host>> m_hosts;
+
+		// the total number of requests in all m_hosts queues
+		int m_num_queued = 0;
+
+		// incremented for every request that's queued
+		std::uint32_t m_queue_sequence = 0;
+
 		send_fun_t m_send_fun;
 		send_fun_hostname_t m_send_fun_hostname;
 		resolver_interface& m_host_resolver;
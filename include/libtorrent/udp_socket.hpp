@@ -42,6 +42,7 @@ POSSIBILITY OF SUCH DAMAGE.
 
 #include <array>
 #include <memory>
+#include <vector>
 
 namespace libtorrent {
 
@@ -57,6 +58,9 @@ namespace libtorrent {
 			, tracker_connection = 2
 			, dont_queue = 4
 			, dont_fragment = 8
+			// queue the packet, to be sent together with other queued
+			// packets by the next call to flush_batch()
+			, batch = 16
 		};
 
 		bool is_open() const { return m_abort == false; }
@@ -89,6 +93,14 @@ namespace libtorrent {
 
 		void send(udp::endpoint const& ep, span<char const> p
 			, error_code& ec, int flags = 0);
+
+		// send all packets queued with the batch flag. On linux, this is a
+		// single sendmmsg() call, with runs of equally sized packets to the
+		// same endpoint sent as one UDP_SEGMENT (GSO) message. If the socket
+		// would block, the remaining packets are kept queued for the next
+		// call.
+		void flush_batch(error_code& ec);
+		bool has_queued_packets() const { return !m_send_queue.empty(); }
 		void open(udp const& protocol, error_code& ec);
 		void bind(udp::endpoint const& ep, error_code& ec);
 		void close();
@@ -142,8 +154,26 @@ namespace libtorrent {
 
 		udp::socket m_socket;
 
+#if TORRENT_USE_MMSG
+		// the number of packets read by a single recvmmsg() call
+		static constexpr int read_batch_size = 32;
+#else
+		static constexpr int read_batch_size = 1;
+#endif
 		using receive_buffer = std::array<char, 1500>;
-		std::unique_ptr<receive_buffer> m_buf;
+		std::unique_ptr<std::array<receive_buffer, read_batch_size>> m_buf;
+
+		// packets queued by send() with the batch flag. Their payloads are
+		// stored back-to-back in m_send_buffer
+		struct queued_packet
+		{
+			udp::endpoint to;
+			int offset;
+			int size;
+			bool dont_fragment;
+		};
+		std::vector<queued_packet> m_send_queue;
+		std::vector<char> m_send_buffer;
 
 		std::uint16_t m_bind_port;
 
@@ -155,6 +185,9 @@ namespace libtorrent {
 		bool m_force_proxy:1;
 		bool m_abort:1;
 
+		// cleared if the kernel rejects UDP_SEGMENT
+		bool m_gso_supported:1;
+
 #if TORRENT_USE_ASSERTS
 		bool m_started;
 		int m_magic;
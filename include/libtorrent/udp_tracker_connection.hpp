@@ -64,6 +64,16 @@ namespace libtorrent {
 
 		std::uint32_t transaction_id() const { return m_transaction_id; }
 
+		// BEP 15 lets a scrape carry as many info-hashes as fit in a
+		// packet, which is about 74
+		static constexpr int max_scrape_hashes = 74;
+
+		// add another scrape request for the same tracker to this one, to be
+		// sent in the same packet. Returns false if this connection can't
+		// take it, because the scrape has already been sent or it's full
+		bool add_scrape(tracker_request const& req
+			, std::weak_ptr<request_callback> c);
+
 	private:
 
 		enum class action_t : std::uint8_t
@@ -100,13 +110,28 @@ namespace libtorrent {
 			, seconds32 min_interval = seconds32(0));
 
 		void send_udp_connect();
-		void send_udp_announce();
-		void send_udp_scrape();
+		void send_udp_announce(std::int64_t connection_id);
+		void send_udp_scrape(std::int64_t connection_id);
 
 		virtual void on_timeout(error_code const& ec);
 
 		udp::endpoint pick_target_endpoint() const;
 
+		// if another connection is already connecting to m_target, wait for
+		// it to get the connection ID instead of sending a connect of our
+		// own. Returns true if we're waiting. The caller must hold
+		// m_cache_mutex
+		bool wait_for_connect();
+
+		// wake up the connections waiting for our connect to finish. If it
+		// failed they'll try connecting themselves. The caller must hold
+		// m_cache_mutex
+		void connect_done();
+
+		// post the error to all scrape requests batched with ours
+		void fail_batched_scrapes(error_code const& ec, int code
+			, char const* msg, seconds32 interval);
+
 		std::string m_hostname;
 		std::vector<tcp::endpoint> m_endpoints;
 
@@ -117,8 +142,18 @@ namespace libtorrent {
 		};
 
 		static std::map<address, connection_cache_entry> m_connection_cache;
+
+		// the connections waiting for a connect to a tracker that's in
+		// progress. If there's an entry for an address, a connect to it is
+		// in flight
+		static std::map<address, std::vector<std::weak_ptr<udp_tracker_connection>>>
+			m_pending_connects;
 		static std::mutex m_cache_mutex;
 
+		// additional scrape requests sent along with our own
+		std::vector<std::pair<tracker_request, std::weak_ptr<request_callback>>>
+			m_scrapes;
+
 		udp::endpoint m_target;
 
 		std::uint32_t m_transaction_id;
@@ -127,6 +162,10 @@ namespace libtorrent {
 		action_t m_state;
 
 		bool m_abort;
+
+		// true while we're the connection sending the connect to m_target
+		// that others may be waiting on
+		bool m_connecting = false;
 	};
 
 }
@@ -33,7 +33,9 @@ POSSIBILITY OF SUCH DAMAGE.
 #ifndef TORRENT_UTP_SOCKET_MANAGER_HPP_INCLUDED
 #define TORRENT_UTP_SOCKET_MANAGER_HPP_INCLUDED
 
+#include <vector>
 #include <map>
+#include <array>
 #include <functional>
 
 #include "libtorrent/socket_type.hpp"
@@ -42,6 +44,7 @@ POSSIBILITY OF SUCH DAMAGE.
 #include "libtorrent/aux_/session_settings.hpp"
 #include "libtorrent/span.hpp"
 #include "libtorrent/packet_pool.hpp"
+#include "libtorrent/deadline_timer.hpp"
 
 namespace libtorrent {
 
@@ -58,7 +61,11 @@ namespace libtorrent {
 		typedef std::function<void(std::shared_ptr<socket_type> const&)>
 			incoming_utp_callback_t;
 
+		// sends all packets queued while batching sends
+		typedef std::function<void()> flush_fun_t;
+
 		utp_socket_manager(send_fun_t const& send_fun
+			, flush_fun_t const& flush_fun
 			, incoming_utp_callback_t const& cb
 			, io_service& ios
 			, aux::session_settings const& sett
@@ -73,9 +80,16 @@ namespace libtorrent {
 		// called once the socket is writeable again
 		void writable();
 
+		// called by the upper layer before it starts reading packets off the
+		// underlying UDP socket. Until socket_drained() is called, every uTP
+		// packet sent (whether in response to an incoming packet or not) is
+		// queued rather than sent immediately
+		void start_batch() { m_batch_sends = true; }
+
 		// when the upper layer has drained the underlying UDP socket, this is
 		// called, and uTP sockets will send their ACKs. This ensures ACKs at
-		// least coalese packets returned during the same wakeup
+		// least coalese packets returned during the same wakeup. All packets
+		// queued since start_batch() are then handed to the kernel in one go
 		void socket_drained();
 
 		void tick(time_point now);
@@ -86,9 +100,19 @@ namespace libtorrent {
 			, error_code& ec, int flags = 0);
 		void subscribe_writable(utp_socket_impl* s);
 
+		// called by uTP sockets that are held back by send pacing. The socket
+		// is notified (via utp_pacing_ready()) at, or shortly after, when
+		void subscribe_paced(utp_socket_impl* s, time_point when);
+
 		// internal, used by utp_stream
 		void remove_socket(std::uint16_t id);
 
+		// internal, used by utp_stream. Sockets are looked up by their remote
+		// endpoint and receive connection ID. The socket calls unindex_socket()
+		// before changing its remote endpoint and index_socket() after
+		void index_socket(utp_socket_impl* s);
+		void unindex_socket(utp_socket_impl* s);
+
 		utp_socket_impl* new_utp_socket(utp_stream* str);
 		int gain_factor() const { return m_sett.get_int(settings_pack::utp_gain_factor); }
 		int target_delay() const { return m_sett.get_int(settings_pack::utp_target_delay) * 1000; }
@@ -98,8 +122,18 @@ namespace libtorrent {
 		int connect_timeout() const { return m_sett.get_int(settings_pack::utp_connect_timeout); }
 		int min_timeout() const { return m_sett.get_int(settings_pack::utp_min_timeout); }
 		int loss_multiplier() const { return m_sett.get_int(settings_pack::utp_loss_multiplier); }
-
-		void mtu_for_dest(address const& addr, int& link_mtu, int& utp_mtu);
+		bool send_pacing() const { return m_sett.get_bool(settings_pack::send_pacing); }
+
+		// utp_mtu_floor is set to the largest packet size known to make it
+		// through to addr, or 0 if unknown. This is learned from other uTP
+		// sockets to the same network, see update_mtu_cache()
+		void mtu_for_dest(address const& addr, int& link_mtu, int& utp_mtu
+			, int& utp_mtu_floor);
+
+		// called by uTP sockets when their MTU search space changes, to
+		// record that packets of mtu_floor bytes make it through to addr's
+		// network and packets larger than mtu_ceiling probably don't
+		void update_mtu_cache(address const& addr, int mtu_floor, int mtu_ceiling);
 		int num_sockets() const { return int(m_utp_sockets.size()); }
 
 		void defer_ack(utp_socket_impl* s);
@@ -129,14 +163,35 @@ namespace libtorrent {
 		utp_socket_manager& operator=(utp_socket_manager const&);
 
 		send_fun_t m_send_fun;
+		flush_fun_t m_flush_fun;
 		incoming_utp_callback_t m_cb;
 
-		// replace with a hash-map
-		typedef std::multimap<std::uint16_t, utp_socket_impl*> socket_map_t;
-		socket_map_t m_utp_sockets;
-
 		using socket_vector_t = std::vector<utp_socket_impl*>;
 
+		// all uTP sockets owned by this manager
+		socket_vector_t m_utp_sockets;
+
+		// returns the socket connected to ep with the receive connection ID
+		// id, or nullptr if there is none
+		utp_socket_impl* find_socket(udp::endpoint const& ep, std::uint16_t id) const;
+
+		void grow_index();
+
+		// an entry in the socket index. The hash is kept alongside the
+		// socket to avoid touching the socket itself while probing
+		struct index_slot
+		{
+			std::uint32_t hash;
+			utp_socket_impl* socket;
+		};
+
+		// open-addressing hash table (with linear probing) of the sockets
+		// whose remote endpoint is known, keyed on the endpoint and receive
+		// ID. The size is always a power of 2. Empty slots have a nullptr
+		// socket.
+		std::vector<index_slot> m_socket_index;
+		int m_num_indexed = 0;
+
 		// this is a list of sockets that needs to send an ack.
 		// once the UDP socket is drained, all of these will
 		// have a chance to do that. This is to avoid sending
@@ -159,11 +214,36 @@ namespace libtorrent {
 		// becomes writable again
 		socket_vector_t m_stalled_sockets;
 
+		void on_pacing_timer();
+
+		// sockets waiting for their next pacing slot. This is a timer wheel
+		// with 1 millisecond slots, m_pacing_pos being the slot for
+		// m_pacing_time. Sockets further out than the size of the wheel are
+		// woken up early, and will just subscribe again
+		enum { pacing_wheel_size = 64 };
+		std::array<socket_vector_t, pacing_wheel_size> m_pacing_wheel;
+		int m_pacing_pos = 0;
+		time_point m_pacing_time = min_time();
+		int m_num_paced = 0;
+
+		// the sockets from the pacing slot currently being notified
+		socket_vector_t m_pacing_ready;
+
+		// fires every millisecond for as long as there are sockets in
+		// m_pacing_wheel
+		deadline_timer m_pacing_timer;
+		bool m_pacing_timer_active = false;
+
 		// the last socket we received a packet on
 		utp_socket_impl* m_last_socket = nullptr;
 
 		int m_new_connection = -1;
 
+		// while this is true, outgoing packets are queued with the
+		// udp_socket::batch flag, and sent by m_flush_fun. It's set from
+		// start_batch() until the end of socket_drained()
+		bool m_batch_sends = false;
+
 		aux::session_settings const& m_sett;
 
 		// this is a copy of the routing table, used
@@ -195,6 +275,20 @@ namespace libtorrent {
 		void* m_ssl_context;
 
 		packet_pool m_packet_pool;
+
+		// the path MTU discovered per network. Keyed on whether it's IPv6
+		// and the network prefix
+		using mtu_cache_key_t = std::pair<bool, std::uint64_t>;
+		static mtu_cache_key_t mtu_cache_key(address const& addr);
+
+		struct mtu_cache_entry
+		{
+			std::uint16_t floor = 0;
+			std::uint16_t ceiling = 0;
+			time_point updated;
+		};
+		using mtu_cache_t = std::map<mtu_cache_key_t, mtu_cache_entry>;
+		mtu_cache_t m_mtu_cache;
 	};
 }
 
@@ -156,7 +156,7 @@ void detach_utp_impl(utp_socket_impl* s);
 void delete_utp_impl(utp_socket_impl* s);
 bool should_delete(utp_socket_impl* s);
 void tick_utp_impl(utp_socket_impl* s, time_point now);
-void utp_init_mtu(utp_socket_impl* s, int link_mtu, int utp_mtu);
+void utp_init_mtu(utp_socket_impl* s, int link_mtu, int utp_mtu, int utp_mtu_floor);
 bool utp_incoming_packet(utp_socket_impl* s, span<char const> p
 	, udp::endpoint const& ep, time_point receive_time);
 bool utp_match(utp_socket_impl* s, udp::endpoint const& ep, std::uint16_t id);
@@ -166,6 +166,7 @@ int utp_socket_state(utp_socket_impl const* s);
 void utp_send_ack(utp_socket_impl* s);
 void utp_socket_drained(utp_socket_impl* s);
 void utp_writable(utp_socket_impl* s);
+void utp_pacing_ready(utp_socket_impl* s);
 
 // this is the user-level stream interface to utp sockets.
 // the reason why it's split up in a utp_stream class and
@@ -258,6 +259,9 @@ struct TORRENT_EXTRA_EXPORT utp_stream
 	int send_delay() const;
 	int recv_delay() const;
 
+	// use the CUBIC congestion controller instead of LEDBAT
+	void set_cubic(bool cubic);
+
 	void do_connect(tcp::endpoint const& ep);
 
 	endpoint_type local_endpoint() const
@@ -49,6 +49,13 @@ namespace libtorrent {
 
 	class torrent;
 
+	// TODO: 2 web seeds only speak HTTP/1.1. Requests are kept outstanding
+	// on a keep-alive connection (urlseed_pipeline_size) and over several
+	// connections (urlseed_connections), but responses still arrive in
+	// order on each connection. An HTTP/2 transport, multiplexing range
+	// requests as streams over one TLS connection, would need ALPN
+	// negotiation in the SSL stream, HPACK and frame/flow control handling
+	// replacing http_parser in the receive path
 	class TORRENT_EXTRA_EXPORT web_connection_base
 		: public peer_connection
 	{
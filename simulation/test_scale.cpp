@@ -0,0 +1,264 @@
+/*
+
+Copyright (c) 2017, Arvid Norberg
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions
+are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in
+      the documentation and/or other materials provided with the distribution.
+    * Neither the name of the author nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+// this is a scalability harness rather than a regular test. It adds a large
+// number of torrents and peers to a single session and reports how long it
+// takes to start up, how much memory each torrent and peer costs and how much
+// CPU time is spent per session tick once all torrents are started. Each
+// measurement is printed as a line of JSON, to make it simple to track them
+// across versions. It's not part of the regular simulation run, build it
+// explicitly, in release mode, with:
+//
+//   b2 variant=release test_scale
+
+#include "test.hpp"
+#include "settings.hpp"
+#include "utils.hpp"
+#include "simulator/simulator.hpp"
+#include "simulator/utils.hpp" // for timer
+
+#include "libtorrent/session.hpp"
+#include "libtorrent/torrent_handle.hpp"
+#include "libtorrent/torrent_info.hpp"
+#include "libtorrent/settings_pack.hpp"
+#include "libtorrent/alert_types.hpp"
+#include "libtorrent/add_torrent_params.hpp"
+#include "libtorrent/hasher.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <memory>
+#include <string>
+#include <vector>
+
+using namespace libtorrent;
+namespace lt = libtorrent;
+
+namespace {
+
+// the size of the swarm. The peers are spread evenly over the torrents
+int const num_torrents = 100000;
+int const num_peers = 50000;
+
+// for how long (in simulated time) to run the session with all torrents
+// started, to measure the CPU cost of a tick
+lt::seconds const measure_duration(60);
+
+// the session tick interval, in milliseconds
+int const tick_interval = 500;
+
+// returns the resident set size of this process, in bytes, or -1 if it's not
+// known on this platform
+std::int64_t resident_memory()
+{
+#if defined TORRENT_LINUX
+	FILE* f = std::fopen("/proc/self/statm", "r");
+	if (f == nullptr) return -1;
+	long pages = 0;
+	long resident = 0;
+	int const ret = std::fscanf(f, "%ld %ld", &pages, &resident);
+	std::fclose(f);
+	if (ret != 2) return -1;
+	return std::int64_t(resident) * 4096;
+#else
+	return -1;
+#endif
+}
+
+void report(char const* metric, double const value, char const* unit)
+{
+	std::printf("{\"metric\": \"%s\", \"value\": %.3f, \"unit\": \"%s\""
+		", \"torrents\": %d, \"peers\": %d}\n"
+		, metric, value, unit, num_torrents, num_peers);
+	std::fflush(stdout);
+}
+
+// a small, single file torrent. The piece hashes are made up, the torrents
+// are never downloaded
+std::shared_ptr<torrent_info> make_torrent(int const i)
+{
+	int const num_pieces = 16;
+	char name[30];
+	std::snprintf(name, sizeof(name), "scale-%d", i);
+	std::string buf = "d4:infod6:lengthi" + std::to_string(num_pieces * 0x4000)
+		+ "e4:name" + std::to_string(std::strlen(name)) + ":" + name
+		+ "12:piece lengthi16384e6:pieces" + std::to_string(num_pieces * 20) + ":";
+	sha1_hash const h = hasher(name, int(std::strlen(name))).final();
+	for (int k = 0; k < num_pieces; ++k)
+		buf.append(h.data(), h.size());
+	buf += "ee";
+	error_code ec;
+	auto ret = std::make_shared<torrent_info>(buf.data(), int(buf.size()), ec);
+	TEST_CHECK(!ec);
+	return ret;
+}
+
+std::int64_t elapsed_ms(std::chrono::steady_clock::time_point const start)
+{
+	return std::chrono::duration_cast<std::chrono::milliseconds>(
+		std::chrono::steady_clock::now() - start).count();
+}
+
+} // anonymous namespace
+
+TORRENT_TEST(scale)
+{
+	sim::default_config network_cfg;
+	sim::simulation sim{network_cfg};
+	std::unique_ptr<sim::asio::io_service> ios = make_io_service(sim, 0);
+	lt::session_proxy zombie;
+
+	lt::settings_pack pack = settings();
+	pack.set_int(settings_pack::alert_mask, alert::status_notification
+		| alert::error_notification);
+	pack.set_int(settings_pack::alert_queue_size, num_torrents + 1000);
+
+	// the torrents are not auto-managed, but don't let the session limits
+	// make them stop anyway
+	pack.set_int(settings_pack::active_limit, num_torrents * 2);
+	pack.set_int(settings_pack::active_downloads, -1);
+	pack.set_int(settings_pack::active_seeds, -1);
+	pack.set_int(settings_pack::tick_interval, tick_interval);
+
+	std::int64_t const base_memory = resident_memory();
+	auto const start = std::chrono::steady_clock::now();
+	std::shared_ptr<lt::session> ses = std::make_shared<lt::session>(pack, *ios);
+
+	// build the torrents up front, to not include the cost of parsing them in
+	// the startup time
+	std::vector<add_torrent_params> params;
+	params.reserve(num_torrents);
+	for (int i = 0; i < num_torrents; ++i)
+	{
+		add_torrent_params p;
+		p.ti = make_torrent(i);
+		p.save_path = ".";
+		p.flags |= add_torrent_params::flag_paused;
+		p.flags &= ~add_torrent_params::flag_auto_managed;
+		params.push_back(std::move(p));
+	}
+	// the torrent_info objects stay alive, shared with the torrents. Measure
+	// memory from here, to only include the torrents themselves
+	std::int64_t const torrent_info_memory = resident_memory();
+
+	auto const add_start = std::chrono::steady_clock::now();
+	for (auto& p : params) ses->async_add_torrent(std::move(p));
+	params.clear();
+
+	std::vector<torrent_handle> handles;
+	handles.reserve(num_torrents);
+	std::int64_t torrents_memory = 0;
+
+	std::unique_ptr<sim::timer> peers_timer;
+	std::unique_ptr<sim::timer> done_timer;
+	std::int64_t peers_memory = 0;
+	std::clock_t cpu_start = 0;
+
+	auto const on_alert = [&](lt::session&, lt::alert const* a)
+	{
+		if (auto const* at = lt::alert_cast<lt::add_torrent_alert>(a))
+		{
+			TEST_CHECK(!at->error);
+			handles.push_back(at->handle);
+			if (int(handles.size()) < num_torrents) return;
+
+			std::int64_t const ms = elapsed_ms(add_start);
+			report("startup_time", double(ms), "ms");
+			report("torrents_per_second", ms > 0 ? num_torrents * 1000.0 / ms : 0.0
+				, "torrents/s");
+			torrents_memory = resident_memory();
+			if (torrents_memory >= 0)
+			{
+				report("memory_per_torrent", double(torrents_memory
+					- torrent_info_memory) / num_torrents, "bytes");
+			}
+
+			// spread the peers over the torrents. Nothing is listening on
+			// these addresses, the torrents are still paused
+			for (int i = 0; i < num_peers; ++i)
+			{
+				address_v4 const addr((60u << 24) + std::uint32_t(i));
+				handles[std::size_t(i % num_torrents)].connect_peer(
+					tcp::endpoint(addr, 6881));
+			}
+
+			peers_timer.reset(new sim::timer(sim, lt::seconds(1)
+				, [&](boost::system::error_code const&)
+			{
+				peers_memory = resident_memory();
+				if (peers_memory >= 0)
+				{
+					report("memory_per_peer", double(peers_memory - torrents_memory)
+						/ num_peers, "bytes");
+				}
+
+				// start all torrents and measure the CPU cost of running the
+				// session with all of them active
+				for (auto const& h : handles) h.resume();
+				cpu_start = std::clock();
+
+				done_timer.reset(new sim::timer(sim, measure_duration
+					, [&](boost::system::error_code const&)
+				{
+					double const cpu_ms = double(std::clock() - cpu_start)
+						* 1000.0 / CLOCKS_PER_SEC;
+					double const ticks = double(total_milliseconds(measure_duration))
+						/ tick_interval;
+					report("cpu_per_tick", cpu_ms / ticks, "ms");
+
+					std::int64_t const mem = resident_memory();
+					if (mem >= 0 && base_memory >= 0)
+						report("total_memory", double(mem - base_memory), "bytes");
+
+					zombie = ses->abort();
+					ses.reset();
+				}));
+			}));
+		}
+	};
+
+	ses->set_alert_notify([&] {
+		ses->get_io_service().post([&] {
+			if (!ses) return;
+			std::vector<lt::alert*> alerts;
+			ses->pop_alerts(&alerts);
+			for (lt::alert const* a : alerts) on_alert(*ses, a);
+		});
+	});
+
+	sim.run();
+
+	TEST_EQUAL(int(handles.size()), num_torrents);
+	report("total_time", double(elapsed_ms(start)), "ms");
+}
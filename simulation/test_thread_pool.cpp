@@ -211,3 +211,39 @@ TORRENT_TEST(disk_io_thread_pool_max_threads)
 	threads.wait_for_thread_exit(2);
 	TEST_EQUAL(pool.num_threads(), 2);
 }
+
+TORRENT_TEST(disk_thread_scaler_grows_while_jobs_wait)
+{
+	lt::disk_thread_scaler s(2);
+	// jobs wait 10 ms in the queue, and take 1 ms each
+	TEST_EQUAL(s.update(100, 1000000, 100000, 1000000, 1, 8), 3);
+	// adding a thread got more jobs done, keep going
+	TEST_EQUAL(s.update(150, 1500000, 150000, 1000000, 1, 8), 4);
+	TEST_EQUAL(s.update(200, 2000000, 200000, 1000000, 1, 8), 5);
+
+	// never past the max
+	lt::disk_thread_scaler m(8);
+	TEST_EQUAL(m.update(100, 1000000, 100000, 1000000, 1, 8), 8);
+}
+
+TORRENT_TEST(disk_thread_scaler_backs_off_when_saturated)
+{
+	lt::disk_thread_scaler s(2);
+	TEST_EQUAL(s.update(100, 1000000, 100000, 1000000, 1, 8), 3);
+	// with the third thread the jobs take twice as long, and no more of
+	// them get done. Take the thread back
+	TEST_EQUAL(s.update(100, 1000000, 200000, 1000000, 1, 8), 2);
+	// and don't grow again right away, even though jobs still wait
+	TEST_EQUAL(s.update(100, 1000000, 100000, 1000000, 1, 8), 2);
+	TEST_EQUAL(s.update(100, 1000000, 100000, 1000000, 1, 8), 2);
+}
+
+TORRENT_TEST(disk_thread_scaler_shrinks_when_idle)
+{
+	lt::disk_thread_scaler s(4);
+	// jobs hardly wait
+	TEST_EQUAL(s.update(100, 1000, 100000, 1000000, 1, 8), 3);
+	// no jobs at all
+	TEST_EQUAL(s.update(0, 0, 0, 1000000, 1, 8), 2);
+	TEST_EQUAL(s.update(0, 0, 0, 1000000, 2, 8), 2);
+}
@@ -0,0 +1,364 @@
+/*
+
+Copyright (c) 2017, Arvid Norberg
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions
+are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in
+      the documentation and/or other materials provided with the distribution.
+    * Neither the name of the author nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+// this is a benchmark rather than a regular test. It transfers a torrent
+// between two sessions over uTP, across a link with a given bandwidth,
+// propagation delay, queue size, packet loss and reordering, and reports the
+// goodput, the queuing delay measured by the uTP congestion controller and
+// the CPU time spent per transferred megabyte. Each measurement is printed as
+// a line of JSON, to make it simple to compare congestion control and
+// batching changes. It's not part of the regular simulation run, build it
+// explicitly, in release mode, with:
+//
+//   b2 variant=release test_utp_benchmark
+
+#include "test.hpp"
+#include "settings.hpp"
+#include "setup_swarm.hpp" // for utp_only
+#include "setup_transfer.hpp" // for create_torrent
+#include "utils.hpp"
+#include "simulator/simulator.hpp"
+#include "simulator/queue.hpp"
+#include "simulator/utils.hpp" // for timer
+
+#include "libtorrent/session.hpp"
+#include "libtorrent/session_stats.hpp"
+#include "libtorrent/torrent_handle.hpp"
+#include "libtorrent/torrent_status.hpp"
+#include "libtorrent/settings_pack.hpp"
+#include "libtorrent/alert_types.hpp"
+#include "libtorrent/deadline_timer.hpp"
+#include "libtorrent/performance_counters.hpp"
+#include "libtorrent/aux_/path.hpp"
+
+#include <cstdio>
+#include <ctime>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <random>
+#include <string>
+
+using namespace libtorrent;
+namespace lt = libtorrent;
+
+namespace {
+
+using duration = sim::chrono::high_resolution_clock::duration;
+
+// the size of the transferred torrent
+int const num_pieces = 512;
+int const piece_size = 0x4000;
+
+struct link_profile
+{
+	char const* name;
+	// the bottleneck bandwidth, in bytes per second
+	int rate;
+	// one-way propagation delay
+	int delay_ms;
+	// the size of the bottleneck queue, in bytes. Packets arriving at a full
+	// queue are dropped
+	int queue_size;
+	// the probability of a packet being dropped, in addition to drops at
+	// the bottleneck queue
+	double loss;
+	// the probability of a packet being delayed an extra 10 ms, letting the
+	// packets behind it overtake it
+	double reorder;
+};
+
+link_profile const clean_link{"clean", 1250000, 20, 100000, 0., 0.};
+link_profile const lossy_link{"lossy", 1250000, 50, 100000, 0.01, 0.};
+link_profile const reordering_link{"reordering", 1250000, 50, 100000, 0., 0.02};
+link_profile const bufferbloat_link{"bufferbloat", 250000, 20, 1000000, 0., 0.};
+link_profile const satellite_link{"satellite", 2500000, 300, 500000, 0.005, 0.};
+
+// drops and reorders packets passing through it. Packets to reorder take a
+// detour through a queue adding extra delay
+struct impaired_link : sim::sink
+{
+	impaired_link(sim::simulation& sim, link_profile const& p, std::uint32_t const seed)
+		: m_loss(p.loss)
+		, m_reorder(p.reorder)
+		, m_rng(seed)
+		, m_detour(std::make_shared<sim::queue>(std::ref(sim.get_io_service())
+			, p.rate * 10, lt::duration_cast<duration>(lt::milliseconds(10))
+			, p.queue_size * 10, "reorder detour"))
+	{}
+
+	void incoming_packet(sim::aux::packet p) override
+	{
+		double const r = m_dist(m_rng);
+		if (r < m_loss) return;
+		if (r < m_loss + m_reorder)
+		{
+			m_detour->incoming_packet(std::move(p));
+			return;
+		}
+		sim::forward_packet(std::move(p));
+	}
+
+	std::string label() const override { return "impaired link"; }
+
+private:
+	double const m_loss;
+	double const m_reorder;
+	std::mt19937 m_rng;
+	std::uniform_real_distribution<double> m_dist{0., 1.};
+	std::shared_ptr<sim::queue> m_detour;
+};
+
+// every node's incoming traffic passes through a bottleneck queue followed
+// by the impairments of the profile. Both directions of the transfer are
+// shaped, the payload and the ACKs
+struct impaired_config : sim::default_config
+{
+	explicit impaired_config(link_profile const& p) : m_profile(p) {}
+
+	sim::route incoming_route(lt::address ip) override
+	{
+		auto it = m_links.find(ip);
+		if (it == m_links.end())
+		{
+			link l;
+			l.bottleneck = std::make_shared<sim::queue>(std::ref(m_sim->get_io_service())
+				, m_profile.rate
+				, lt::duration_cast<duration>(lt::milliseconds(m_profile.delay_ms))
+				, m_profile.queue_size, "bottleneck");
+			l.impairment = std::make_shared<impaired_link>(*m_sim, m_profile
+				, std::uint32_t(m_links.size() + 1));
+			it = m_links.insert(it, std::make_pair(ip, l));
+		}
+		return sim::route().append(it->second.bottleneck).append(it->second.impairment);
+	}
+
+private:
+	struct link
+	{
+		std::shared_ptr<sim::queue> bottleneck;
+		std::shared_ptr<impaired_link> impairment;
+	};
+	link_profile const m_profile;
+	std::map<lt::address, link> m_links;
+};
+
+void report(link_profile const& p, char const* metric, double const value
+	, char const* unit)
+{
+	std::printf("{\"link\": \"%s\", \"metric\": \"%s\", \"value\": %.3f"
+		", \"unit\": \"%s\", \"rate\": %d, \"delay_ms\": %d, \"loss\": %.3f"
+		", \"reorder\": %.3f}\n"
+		, p.name, metric, value, unit, p.rate, p.delay_ms, p.loss, p.reorder);
+	std::fflush(stdout);
+}
+
+void run_benchmark(link_profile const& profile)
+{
+	impaired_config network_cfg(profile);
+	sim::simulation sim{network_cfg};
+
+	// the seed is the sender, whose congestion controller we measure
+	sim::asio::io_service seed_ios(sim, addr("50.0.0.1"));
+	sim::asio::io_service downloader_ios(sim, addr("50.0.0.2"));
+	lt::session_proxy zombies[2];
+
+	// start every transfer from scratch
+	lt::error_code ec;
+	lt::remove_all("utp-bench-downloader", ec);
+	lt::remove_all("utp-bench-seed", ec);
+	lt::create_directory("utp-bench-seed", ec);
+	std::ofstream file(lt::combine_path("utp-bench-seed", "utp-bench").c_str());
+	auto ti = ::create_torrent(&file, "utp-bench", piece_size, num_pieces, false);
+	file.close();
+
+	lt::settings_pack pack = settings();
+	utp_only(pack);
+	pack.set_int(settings_pack::alert_mask, alert::status_notification
+		| alert::error_notification | alert::stats_notification);
+	pack.set_str(settings_pack::listen_interfaces, "0.0.0.0:6881");
+
+	auto seed = std::make_shared<lt::session>(pack, seed_ios);
+	auto downloader = std::make_shared<lt::session>(pack, downloader_ios);
+
+	lt::add_torrent_params p;
+	p.ti = ti;
+	p.flags &= ~add_torrent_params::flag_auto_managed;
+	p.flags &= ~add_torrent_params::flag_paused;
+	p.flags |= add_torrent_params::flag_seed_mode;
+	p.save_path = "utp-bench-seed";
+	seed->async_add_torrent(p);
+
+	p.flags &= ~add_torrent_params::flag_seed_mode;
+	p.save_path = "utp-bench-downloader";
+	downloader->async_add_torrent(p);
+
+	lt::torrent_handle h;
+	lt::time_point start_time;
+	std::clock_t cpu_start = 0;
+	bool done = false;
+
+	std::function<void()> shut_down = [&]
+	{
+		zombies[0] = seed->abort();
+		zombies[1] = downloader->abort();
+		seed.reset();
+		downloader.reset();
+	};
+
+	seed->set_alert_notify([&] {
+		seed_ios.post([&] {
+			if (!seed) return;
+			std::vector<lt::alert*> alerts;
+			seed->pop_alerts(&alerts);
+			for (lt::alert const* a : alerts)
+			{
+				auto const* ss = lt::alert_cast<session_stats_alert>(a);
+				if (ss == nullptr) continue;
+
+				std::int64_t const samples = ss->values[counters::utp_samples_above_target]
+					+ ss->values[counters::utp_samples_below_target];
+				if (samples > 0)
+				{
+					report(profile, "queuing_delay"
+						, double(ss->values[counters::utp_queuing_delay]) / double(samples) / 1000.
+						, "ms");
+				}
+				std::int64_t const packets = ss->values[counters::utp_payload_pkts_out];
+				if (packets > 0)
+				{
+					report(profile, "retransmit_rate"
+						, double(ss->values[counters::utp_packet_resend]) * 100. / double(packets)
+						, "%");
+				}
+				shut_down();
+				return;
+			}
+		});
+	});
+
+	downloader->set_alert_notify([&] {
+		downloader_ios.post([&] {
+			if (!downloader) return;
+			std::vector<lt::alert*> alerts;
+			downloader->pop_alerts(&alerts);
+			for (lt::alert const* a : alerts)
+			{
+				if (auto const* at = lt::alert_cast<add_torrent_alert>(a))
+				{
+					TEST_CHECK(!at->error);
+					h = at->handle;
+				}
+			}
+		});
+	});
+
+	lt::deadline_timer poll(downloader_ios);
+	std::function<void(lt::error_code const&)> on_poll = [&](lt::error_code const& e)
+	{
+		if (e || !downloader || !h.is_valid()) return;
+
+		lt::torrent_status const st = h.status();
+		if (st.is_seeding)
+		{
+			double const cpu_seconds = double(std::clock() - cpu_start) / CLOCKS_PER_SEC;
+			double const seconds = double(lt::total_microseconds(
+				lt::clock_type::now() - start_time)) / 1000000.;
+			double const megabytes = double(ti->total_size()) / 1000000.;
+			report(profile, "transfer_time", seconds, "s");
+			report(profile, "goodput", megabytes * 8. / seconds, "Mbit/s");
+			report(profile, "link_utilization"
+				, double(ti->total_size()) * 100. / seconds / profile.rate, "%");
+			report(profile, "cpu_per_mb", cpu_seconds * 1000. / megabytes, "ms");
+			done = true;
+			// the queuing delay is reported when the stats arrive
+			seed->post_session_stats();
+			return;
+		}
+
+		if (lt::clock_type::now() - start_time > lt::seconds(600))
+		{
+			TEST_ERROR("transfer timed out");
+			shut_down();
+			return;
+		}
+		poll.expires_from_now(lt::milliseconds(100));
+		poll.async_wait(on_poll);
+	};
+
+	// give the seed a moment to start listening
+	sim::timer t(sim, lt::seconds(1), [&](boost::system::error_code const&)
+	{
+		start_time = lt::clock_type::now();
+		cpu_start = std::clock();
+		if (!h.is_valid())
+		{
+			TEST_ERROR("failed to add torrent");
+			shut_down();
+			return;
+		}
+		h.connect_peer(lt::tcp::endpoint(addr("50.0.0.1"), 6881));
+		poll.expires_from_now(lt::milliseconds(100));
+		poll.async_wait(on_poll);
+	});
+
+	sim.run();
+	TEST_CHECK(done);
+}
+
+} // anonymous namespace
+
+TORRENT_TEST(clean)
+{
+	run_benchmark(clean_link);
+}
+
+TORRENT_TEST(lossy)
+{
+	run_benchmark(lossy_link);
+}
+
+TORRENT_TEST(reordering)
+{
+	run_benchmark(reordering_link);
+}
+
+TORRENT_TEST(bufferbloat)
+{
+	run_benchmark(bufferbloat_link);
+}
+
+TORRENT_TEST(satellite)
+{
+	run_benchmark(satellite_link);
+}
+
@@ -33,6 +33,7 @@ POSSIBILITY OF SUCH DAMAGE.
 #include <string>
 #include <cstdio> // for snprintf
 #include <cinttypes> // for PRId64 et.al.
+#include <cstring> // for memcpy
 
 #include "libtorrent/config.hpp"
 #include "libtorrent/alert.hpp"
@@ -64,22 +65,26 @@ namespace libtorrent {
 		: handle(h)
 		, m_alloc(alloc)
 	{
+		// most alerts are posted for a handful of torrents at a time. Interning
+		// the names saves copying them into every alert
 		std::shared_ptr<torrent> t = h.native_handle();
 		if (t)
 		{
-			std::string name_str = t->name();
+			string_view const name_str = t->name_view();
 			if (!name_str.empty())
 			{
-				m_name_idx = alloc.copy_string(name_str);
+				m_name_idx = alloc.intern_string(name_str);
 			}
 			else
 			{
-				m_name_idx = alloc.copy_string(aux::to_hex(t->info_hash()));
+				char hex[sha1_hash::size() * 2];
+				aux::to_hex(t->info_hash(), hex);
+				m_name_idx = alloc.intern_string({hex, sizeof(hex)});
 			}
 		}
 		else
 		{
-			m_name_idx = alloc.copy_string("");
+			m_name_idx = alloc.intern_string("");
 		}
 
 #ifndef TORRENT_NO_DEPRECATE
@@ -122,7 +127,7 @@ namespace libtorrent {
 #ifndef TORRENT_NO_DEPRECATE
 		, url(u)
 #endif
-		, m_url_idx(alloc.copy_string(u))
+		, m_url_idx(alloc.intern_string(u))
 	{}
 
 	char const* tracker_alert::tracker_url() const
@@ -701,9 +706,13 @@ namespace libtorrent {
 
 	save_resume_data_alert::save_resume_data_alert(aux::stack_allocator& alloc
 		, add_torrent_params p
-		, torrent_handle const& h)
+		, torrent_handle const& h
+		, int const c
+		, std::vector<piece_index_t> passed)
 		: torrent_alert(alloc, h)
 		, params(std::move(p))
+		, changes(c)
+		, passed_pieces(std::move(passed))
 	{
 #ifndef TORRENT_NO_DEPRECATE
 		resume_data = std::make_shared<entry>(write_resume_data(params));
@@ -1784,7 +1793,7 @@ namespace {
 		, msg(convert_from_native(e.message()))
 #endif
 		, error(e)
-		, m_url_idx(alloc.copy_string(u))
+		, m_url_idx(alloc.intern_string(u))
 		, m_msg_idx()
 	{}
 
@@ -1795,7 +1804,7 @@ namespace {
 		, url(u)
 		, msg(m)
 #endif
-		, m_url_idx(alloc.copy_string(u))
+		, m_url_idx(alloc.intern_string(u))
 		, m_msg_idx(alloc.copy_string(m))
 	{}
 
@@ -2270,4 +2279,158 @@ namespace {
 		return stats_header;
 	}
 
+	piece_arrival_alert::piece_arrival_alert(aux::stack_allocator& alloc
+		, torrent_handle const& h, piece_index_t const index
+		, time_point const arrival, time_point const deadline_)
+		: torrent_alert(alloc, h)
+		, piece_index(index)
+		, predicted_arrival(arrival)
+		, deadline(deadline_)
+	{}
+
+	std::string piece_arrival_alert::message() const
+	{
+		char ret[400];
+		std::int64_t const margin = total_milliseconds(deadline - predicted_arrival);
+		std::snprintf(ret, sizeof(ret), "%s piece %d predicted to arrive %" PRId64 " ms %s its deadline"
+			, torrent_alert::message().c_str(), static_cast<int>(piece_index)
+			, margin < 0 ? -margin : margin, margin < 0 ? "after" : "before");
+		return ret;
+	}
+
+	dht_sample_infohashes_alert::dht_sample_infohashes_alert(aux::stack_allocator& alloc
+		, udp::endpoint const& ep, time_duration const interval_
+		, int const num, std::vector<sha1_hash> const& samples)
+		: endpoint(ep)
+		, interval(interval_)
+		, num_infohashes(num)
+		, m_alloc(alloc)
+		, m_num_samples(int(samples.size()))
+	{
+		m_samples_idx = alloc.allocate(m_num_samples * 20);
+		char* ptr = alloc.ptr(m_samples_idx);
+		if (m_num_samples > 0)
+			std::memcpy(ptr, samples.data(), samples.size() * 20);
+	}
+
+	std::string dht_sample_infohashes_alert::message() const
+	{
+		char msg[200];
+		std::snprintf(msg, sizeof(msg)
+			, "incoming dht sample_infohashes reply from: %s, samples %d, total %d"
+			, print_endpoint(endpoint).c_str(), m_num_samples, num_infohashes);
+		return msg;
+	}
+
+	int dht_sample_infohashes_alert::num_samples() const
+	{
+		return m_num_samples;
+	}
+
+	std::vector<sha1_hash> dht_sample_infohashes_alert::samples() const
+	{
+		std::vector<sha1_hash> ret(static_cast<std::size_t>(m_num_samples));
+		char const* ptr = m_alloc.get().ptr(m_samples_idx);
+		for (auto& s : ret)
+		{
+			std::memcpy(s.data(), ptr, 20);
+			ptr += 20;
+		}
+		return ret;
+	}
+
+	session_stats_delta_alert::session_stats_delta_alert(aux::stack_allocator& alloc
+		, span<char const> const d)
+		: m_alloc(alloc)
+		, m_size(int(d.size()))
+		, m_delta_idx(alloc.copy_buffer(d))
+	{}
+
+	span<char const> session_stats_delta_alert::delta() const
+	{
+		return { m_alloc.get().ptr(m_delta_idx), std::size_t(m_size) };
+	}
+
+	std::string session_stats_delta_alert::message() const
+	{
+		char msg[100];
+		std::snprintf(msg, sizeof(msg), "session stats delta (%d bytes)", m_size);
+		return msg;
+	}
+
+	network_stall_alert::network_stall_alert(aux::stack_allocator&
+		, handler_t const h, time_duration const queue_time_
+		, time_duration const exec_time_)
+		: handler(h)
+		, queue_time(queue_time_)
+		, exec_time(exec_time_)
+	{}
+
+	std::string network_stall_alert::message() const
+	{
+		static char const* const handler_str[] =
+		{
+			"session call", "torrent call", "tick"
+		};
+
+		char msg[200];
+		std::snprintf(msg, sizeof(msg), "network thread stalled by %s for %" PRId64
+			" ms (queued for %" PRId64 " ms)", handler_str[handler]
+			, total_milliseconds(exec_time), total_milliseconds(queue_time));
+		return msg;
+	}
+
+	peer_info_alert::peer_info_alert(aux::stack_allocator& alloc
+		, torrent_handle const& h, std::vector<libtorrent::peer_info> p)
+		: torrent_alert(alloc, h)
+		, peer_info(std::move(p))
+	{}
+
+	std::string peer_info_alert::message() const
+	{
+		char msg[200];
+		std::snprintf(msg, sizeof(msg), ": %d peers", int(peer_info.size()));
+		return torrent_alert::message() + msg;
+	}
+
+	file_progress_alert::file_progress_alert(aux::stack_allocator& alloc
+		, torrent_handle const& h, std::vector<std::int64_t> fp)
+		: torrent_alert(alloc, h)
+		, files(std::move(fp))
+	{}
+
+	std::string file_progress_alert::message() const
+	{
+		char msg[200];
+		std::snprintf(msg, sizeof(msg), ": file progress for %d files", int(files.size()));
+		return torrent_alert::message() + msg;
+	}
+
+	piece_priorities_alert::piece_priorities_alert(aux::stack_allocator& alloc
+		, torrent_handle const& h, std::vector<int> p)
+		: torrent_alert(alloc, h)
+		, priorities(std::move(p))
+	{}
+
+	std::string piece_priorities_alert::message() const
+	{
+		char msg[200];
+		std::snprintf(msg, sizeof(msg), ": piece priorities for %d pieces", int(priorities.size()));
+		return torrent_alert::message() + msg;
+	}
+
+	peer_sample_alert::peer_sample_alert(aux::stack_allocator&
+		, std::vector<peer_sample> s, int const total)
+		: samples(std::move(s))
+		, num_peers(total)
+	{}
+
+	std::string peer_sample_alert::message() const
+	{
+		char msg[200];
+		std::snprintf(msg, sizeof(msg), "samples of %d of %d peers"
+			, int(samples.size()), num_peers);
+		return msg;
+	}
+
 } // namespace libtorrent
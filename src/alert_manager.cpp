@@ -34,6 +34,8 @@ POSSIBILITY OF SUCH DAMAGE.
 #include "libtorrent/alert_manager.hpp"
 #include "libtorrent/alert_types.hpp"
 
+#include <thread> // for yield
+
 #ifndef TORRENT_DISABLE_EXTENSIONS
 #include "libtorrent/extensions.hpp"
 #endif
@@ -43,51 +45,69 @@ namespace libtorrent {
 	alert_manager::alert_manager(int const queue_limit, std::uint32_t const alert_mask)
 		: m_alert_mask(alert_mask)
 		, m_queue_size_limit(queue_limit)
-	{}
+	{
+		for (int i = 0; i < 2; ++i)
+		{
+			m_num_queued[i] = 0;
+			m_first[i] = nullptr;
+		}
+	}
 
 	alert_manager::~alert_manager() = default;
 
 	bool alert_manager::should_post_impl(int const priority) const
 	{
-		std::lock_guard<std::mutex> lock(m_mutex);
-		return m_alerts[m_generation].size()
-			< m_queue_size_limit * (1 + priority);
+		// this is only a hint, it doesn't need to be exact
+		int const gen = m_generation.load(std::memory_order_relaxed);
+		return m_num_queued[gen].load(std::memory_order_relaxed)
+			< m_queue_size_limit.load(std::memory_order_relaxed) * (1 + priority);
 	}
 
 	alert* alert_manager::wait_for_alert(time_duration max_wait)
 	{
-		std::unique_lock<std::mutex> lock(m_mutex);
-
-		if (!m_alerts[m_generation].empty())
-			return m_alerts[m_generation].front();
-
+		auto peek = [this]() -> alert*
+		{
+			int const gen = m_generation.load();
+			if (m_num_queued[gen].load() == 0) return nullptr;
+			return m_first[gen].load(std::memory_order_relaxed);
+		};
+
+		alert* ret = peek();
+		if (ret != nullptr) return ret;
+
+		std::unique_lock<std::mutex> lock(m_wait_mutex);
+		// once we're counted as a waiter, a posting thread will take
+		// m_wait_mutex to notify us, so we can't miss the edge between
+		// checking the queue and waiting
+		++m_num_waiters;
+		ret = peek();
 		// this call can be interrupted prematurely by other signals
-		m_condition.wait_for(lock, max_wait);
-		if (!m_alerts[m_generation].empty())
-			return m_alerts[m_generation].front();
-
-		return nullptr;
+		if (ret == nullptr) m_condition.wait_for(lock, max_wait);
+		--m_num_waiters;
+		return ret != nullptr ? ret : peek();
 	}
 
-	void alert_manager::maybe_notify(alert* a, std::unique_lock<std::mutex>& lock)
+	void alert_manager::maybe_notify(alert* a, bool const first
+		, std::unique_lock<std::mutex>& lock)
 	{
-		if (m_alerts[m_generation].size() == 1)
-		{
-			lock.unlock();
+		lock.unlock();
 
+		if (first)
+		{
 			// we just posted to an empty queue. If anyone is waiting for
 			// alerts, we need to notify them. Also (potentially) call the
 			// user supplied m_notify callback to let the client wake up its
 			// message loop to poll for alerts.
-			if (m_notify) m_notify();
-
-			// TODO: 2 keep a count of the number of threads waiting. Only if it's
-			// > 0 notify them
-			m_condition.notify_all();
-		}
-		else
-		{
-			lock.unlock();
+			{
+				std::lock_guard<std::mutex> l(m_notify_mutex);
+				if (m_notify) m_notify();
+			}
+
+			if (m_num_waiters.load() > 0)
+			{
+				std::lock_guard<std::mutex> l(m_wait_mutex);
+				m_condition.notify_all();
+			}
 		}
 
 #ifndef TORRENT_DISABLE_EXTENSIONS
@@ -100,13 +120,14 @@ namespace libtorrent {
 
 	void alert_manager::set_notify_function(std::function<void()> const& fun)
 	{
-		std::unique_lock<std::mutex> lock(m_mutex);
-		m_notify = fun;
-		if (!m_alerts[m_generation].empty())
+		{
+			std::lock_guard<std::mutex> lock(m_notify_mutex);
+			m_notify = fun;
+		}
+		if (m_num_queued[m_generation.load()].load() > 0)
 		{
 			// never call a callback with the lock held!
-			lock.unlock();
-			if (m_notify) m_notify();
+			if (fun) fun();
 		}
 	}
 
@@ -122,28 +143,35 @@ namespace libtorrent {
 		std::lock_guard<std::mutex> lock(m_mutex);
 
 		alerts.clear();
-		if (m_alerts[m_generation].empty()) return;
-
-		m_alerts[m_generation].get_pointers(alerts);
+		int const gen = m_generation.load();
+		if (m_num_queued[gen].load() == 0) return;
+
+		// clear the one the posting thread will start writing to now. The
+		// alerts in it were handed out by the previous call, and the posting
+		// thread won't touch it until we swap
+		int const next = (gen + 1) & 1;
+		m_alerts[next].clear();
+		m_allocations[next].reset();
+		m_num_queued[next] = 0;
+		m_first[next] = nullptr;
 
 		// swap buffers
-		m_generation = (m_generation + 1) & 1;
-		// clear the one we will start writing to now
-		m_alerts[m_generation].clear();
-		m_allocations[m_generation].reset();
+		m_generation.store(next);
+
+		// the posting thread may have loaded the old generation just before
+		// we swapped. Wait for it to finish the alert it's posting
+		while (m_posting.load()) std::this_thread::yield();
+
+		m_alerts[gen].get_pointers(alerts);
 	}
 
 	bool alert_manager::pending() const
 	{
-		std::lock_guard<std::mutex> lock(m_mutex);
-		return !m_alerts[m_generation].empty();
+		return m_num_queued[m_generation.load()].load() > 0;
 	}
 
 	int alert_manager::set_alert_queue_size_limit(int queue_size_limit_)
 	{
-		std::lock_guard<std::mutex> lock(m_mutex);
-
-		std::swap(m_queue_size_limit, queue_size_limit_);
-		return queue_size_limit_;
+		return m_queue_size_limit.exchange(queue_size_limit_);
 	}
 }
@@ -150,7 +150,11 @@ namespace libtorrent {
 
 		std::vector<bw_request> tm;
 
-		for (auto i = m_queue.begin(); i != m_queue.end();)
+		// requests that are done are removed by compacting the queue in
+		// place, in a single pass. Erasing them one at a time would make
+		// every tick quadratic in the number of queued peers
+		auto out = m_queue.begin();
+		for (auto i = m_queue.begin(); i != m_queue.end(); ++i)
 		{
 			if (i->peer->is_disconnecting())
 			{
@@ -165,8 +169,7 @@ namespace libtorrent {
 				}
 
 				i->assigned = 0;
-				tm.push_back(*i);
-				i = m_queue.erase(i);
+				tm.push_back(std::move(*i));
 				continue;
 			}
 			for (int j = 0; j < bw_request::max_bandwidth_channels && i->channel[j]; ++j)
@@ -174,8 +177,10 @@ namespace libtorrent {
 				bandwidth_channel* bwc = i->channel[j];
 				bwc->tmp = 0;
 			}
-			++i;
+			if (out != i) *out = std::move(*i);
+			++out;
 		}
+		m_queue.erase(out, m_queue.end());
 
 		for (auto const& r : m_queue)
 		{
@@ -193,7 +198,8 @@ namespace libtorrent {
 			ch->update_quota(int(dt_milliseconds));
 		}
 
-		for (auto i = m_queue.begin(); i != m_queue.end();)
+		out = m_queue.begin();
+		for (auto i = m_queue.begin(); i != m_queue.end(); ++i)
 		{
 			int a = i->assign_bandwidth();
 			if (i->assigned == i->request_size
@@ -201,15 +207,16 @@ namespace libtorrent {
 			{
 				a += i->request_size - i->assigned;
 				TORRENT_ASSERT(i->assigned <= i->request_size);
-				tm.push_back(*i);
-				i = m_queue.erase(i);
+				tm.push_back(std::move(*i));
 			}
 			else
 			{
-				++i;
+				if (out != i) *out = std::move(*i);
+				++out;
 			}
 			m_queued_bytes -= a;
 		}
+		m_queue.erase(out, m_queue.end());
 
 		while (!tm.empty())
 		{
@@ -34,6 +34,7 @@ POSSIBILITY OF SUCH DAMAGE.
 #include "libtorrent/aux_/alloca.hpp"
 #include "libtorrent/aux_/numeric_cast.hpp"
 #include <limits>
+#include <algorithm> // for stable_sort, lower_bound
 #include <cstring> // for memset
 #include <cstdio> // for snprintf
 #include <cinttypes> // for PRId64 et.al.
@@ -102,9 +103,13 @@ namespace {
 
 	struct stack_frame
 	{
-		explicit stack_frame(int const t): token(std::uint32_t(t)), state(0) {}
+		stack_frame(int const t, bool const d)
+			: token(std::uint32_t(t)), dict(d), state(0) {}
 		// this is an index into m_tokens
-		std::uint32_t token:31;
+		std::uint32_t token:30;
+		// set if this is a dictionary. This is the same as the type of the
+		// token, but saves looking it up in m_tokens for every item
+		std::uint32_t dict:1;
 		// this is used for dictionaries to indicate whether we're
 		// reading a key or a vale. 0 means key 1 is value
 		std::uint32_t state:1;
@@ -127,6 +132,15 @@ namespace {
 	char const* parse_int(char const* start, char const* end, char delimiter
 		, std::int64_t& val, bdecode_errors::error_code_enum& ec)
 	{
+		// as long as val has fewer than 18 digits, the next one can't make it
+		// overflow. This covers all practical string lengths and integers
+		std::int64_t constexpr no_overflow_limit = 100000000000000000LL;
+		while (start < end && val < no_overflow_limit && numeric(*start))
+		{
+			val = val * 10 + (*start - '0');
+			++start;
+		}
+
 		while (start < end && *start != delimiter)
 		{
 			if (!numeric(*start))
@@ -209,6 +223,7 @@ namespace {
 		, m_last_index(-1)
 		, m_last_token(-1)
 		, m_size(-1)
+		, m_dict_looked_up(false)
 	{}
 
 	bdecode_node::bdecode_node(bdecode_node const& n)
@@ -220,6 +235,7 @@ namespace {
 		, m_last_index(n.m_last_index)
 		, m_last_token(n.m_last_token)
 		, m_size(n.m_size)
+		, m_dict_looked_up(n.m_dict_looked_up)
 	{
 		(*this) = n;
 	}
@@ -234,6 +250,8 @@ namespace {
 		m_last_index = n.m_last_index;
 		m_last_token = n.m_last_token;
 		m_size = n.m_size;
+		m_dict_index = n.m_dict_index;
+		m_dict_looked_up = n.m_dict_looked_up;
 		if (!m_tokens.empty())
 		{
 			// if this is a root, make the token pointer
@@ -255,6 +273,7 @@ namespace {
 		, m_last_index(-1)
 		, m_last_token(-1)
 		, m_size(-1)
+		, m_dict_looked_up(false)
 	{
 		TORRENT_ASSERT(tokens != nullptr);
 		TORRENT_ASSERT(idx >= 0);
@@ -278,6 +297,8 @@ namespace {
 		m_size = -1;
 		m_last_index = -1;
 		m_last_token = -1;
+		m_dict_index.clear();
+		m_dict_looked_up = false;
 	}
 
 	void bdecode_node::switch_underlying_buffer(char const* buf)
@@ -286,6 +307,10 @@ namespace {
 		if (m_tokens.empty()) return;
 
 		m_buffer = buf;
+
+		// the keys in the index point into the old buffer
+		m_dict_index.clear();
+		m_dict_looked_up = false;
 	}
 
 	bdecode_node::type_t bdecode_node::type() const
@@ -476,12 +501,64 @@ namespace {
 		return ret;
 	}
 
+	void bdecode_node::build_dict_index() const
+	{
+		TORRENT_ASSERT(type() == dict_t);
+		TORRENT_ASSERT(m_dict_index.empty());
+
+		bdecode_token const* const tokens = m_root_tokens;
+		m_dict_index.reserve(std::size_t(dict_size()));
+
+		// this is the first item
+		int token = m_token_idx + 1;
+
+		while (tokens[token].type != bdecode_token::end)
+		{
+			bdecode_token const& t = tokens[token];
+			TORRENT_ASSERT(t.type == bdecode_token::string);
+			int const size = token_source_span(t) - t.start_offset();
+			string_view const k(m_buffer + t.offset + t.start_offset()
+				, std::size_t(size));
+
+			// skip key
+			token += t.next_item;
+			TORRENT_ASSERT(tokens[token].type != bdecode_token::end);
+			m_dict_index.emplace_back(k, token);
+
+			// skip value
+			token += tokens[token].next_item;
+		}
+
+		// keys are supposed to be sorted already, but that's not enforced.
+		// A stable sort keeps the first of duplicate keys first, which is
+		// what the linear search finds
+		std::stable_sort(m_dict_index.begin(), m_dict_index.end()
+			, [](std::pair<string_view, int> const& lhs
+				, std::pair<string_view, int> const& rhs)
+			{ return lhs.first < rhs.first; });
+	}
+
 	bdecode_node bdecode_node::dict_find(string_view key) const
 	{
 		TORRENT_ASSERT(type() == dict_t);
 
 		bdecode_token const* const tokens = m_root_tokens;
 
+		// a dictionary looked up more than once gets an index, unless it's
+		// small enough for a linear search to be as fast
+		if (m_dict_index.empty() && m_dict_looked_up && dict_size() >= 16)
+			build_dict_index();
+		m_dict_looked_up = true;
+
+		if (!m_dict_index.empty())
+		{
+			auto const i = std::lower_bound(m_dict_index.begin(), m_dict_index.end()
+				, key, [](std::pair<string_view, int> const& lhs, string_view const rhs)
+				{ return lhs.first < rhs; });
+			if (i == m_dict_index.end() || i->first != key) return bdecode_node();
+			return bdecode_node(tokens, m_buffer, m_buffer_size, i->second);
+		}
+
 		// this is the first item
 		int token = m_token_idx + 1;
 
@@ -639,6 +716,8 @@ namespace {
 		std::swap(m_last_index, n.m_last_index);
 		std::swap(m_last_token, n.m_last_token);
 		std::swap(m_size, n.m_size);
+		m_dict_index.swap(n.m_dict_index);
+		std::swap(m_dict_looked_up, n.m_dict_looked_up);
 	}
 
 #define TORRENT_FAIL_BDECODE(code) do { \
@@ -680,6 +759,14 @@ namespace {
 		if (start == end)
 			TORRENT_FAIL_BDECODE(bdecode_errors::unexpected_eof);
 
+		// small buffers, like DHT and extension messages, have about one
+		// token per 8 bytes. Reserving that up front means the token vector
+		// is allocated once, rather than grown a few times. Large buffers
+		// are often mostly made up of long strings, and their nodes may be
+		// kept around, so they don't get an estimate
+		if (buffer.size() <= 2048)
+			ret.m_tokens.reserve(buffer.size() / 8 + 2);
+
 		while (start <= end)
 		{
 			if (start >= end) TORRENT_FAIL_BDECODE(bdecode_errors::unexpected_eof);
@@ -698,8 +785,7 @@ namespace {
 
 			// if we're currently parsing a dictionary, assert that
 			// every other node is a string.
-			if (current_frame > 0
-				&& ret.m_tokens[stack[current_frame - 1].token].type == bdecode_token::dict)
+			if (current_frame > 0 && stack[current_frame - 1].dict)
 			{
 				if (stack[current_frame - 1].state == 0)
 				{
@@ -713,7 +799,7 @@ namespace {
 			switch (t)
 			{
 				case 'd':
-					stack[sp++] = stack_frame(int(ret.m_tokens.size()));
+					stack[sp++] = stack_frame(int(ret.m_tokens.size()), true);
 					// we push it into the stack so that we know where to fill
 					// in the next_node field once we pop this node off the stack.
 					// i.e. get to the node following the dictionary in the buffer
@@ -721,7 +807,7 @@ namespace {
 					++start;
 					break;
 				case 'l':
-					stack[sp++] = stack_frame(int(ret.m_tokens.size()));
+					stack[sp++] = stack_frame(int(ret.m_tokens.size()), false);
 					// we push it into the stack so that we know where to fill
 					// in the next_node field once we pop this node off the stack.
 					// i.e. get to the node following the list in the buffer
@@ -758,7 +844,7 @@ namespace {
 						TORRENT_FAIL_BDECODE(bdecode_errors::unexpected_eof);
 
 					if (sp > 0
-						&& ret.m_tokens[stack[sp - 1].token].type == bdecode_token::dict
+						&& stack[sp - 1].dict
 						&& stack[sp - 1].state == 1)
 					{
 						// this means we're parsing a dictionary and about to parse a
@@ -823,8 +909,7 @@ namespace {
 				}
 			}
 
-			if (current_frame > 0
-				&& ret.m_tokens[stack[current_frame - 1].token].type == bdecode_token::dict)
+			if (current_frame > 0 && stack[current_frame - 1].dict)
 			{
 				// the next item we parse is the opposite
 				stack[current_frame - 1].state = ~stack[current_frame - 1].state;
@@ -845,8 +930,7 @@ done:
 
 			// we may need to insert a dummy token to properly terminate the tree,
 			// in case we just parsed a key to a dict and failed in the value
-			if (ret.m_tokens[stack[sp].token].type == bdecode_token::dict
-				&& stack[sp].state == 1)
+			if (stack[sp].dict && stack[sp].state == 1)
 			{
 				// insert an empty dictionary as the value
 				ret.m_tokens.push_back({start - orig_start, 2, bdecode_token::dict});
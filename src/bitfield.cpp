@@ -38,8 +38,80 @@ POSSIBILITY OF SUCH DAMAGE.
 #include <intrin.h>
 #endif
 
+#if TORRENT_HAS_AVX2
+#include "libtorrent/aux_/disable_warnings_push.hpp"
+#include <immintrin.h>
+#include "libtorrent/aux_/disable_warnings_pop.hpp"
+#endif
+
 namespace libtorrent {
 
+namespace {
+
+#if TORRENT_HAS_AVX2
+
+#if defined __GNUC__
+#define TORRENT_AVX2_TARGET __attribute__((target("avx2")))
+#else
+#define TORRENT_AVX2_TARGET
+#endif
+
+	// counts the bits set in the first words - (words % 8) words of buf, 256
+	// bits at a time. Each nibble is looked up in a table of bit counts
+	// (vpshufb), and the byte counts are summed up with vpsadbw. This is only
+	// called if aux::avx2_support is true
+	TORRENT_AVX2_TARGET
+	int count_avx2(std::uint32_t const* buf, int const words)
+	{
+		__m256i const lookup = _mm256_setr_epi8(
+			0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4
+			, 0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4);
+		__m256i const low_mask = _mm256_set1_epi8(0x0f);
+		__m256i acc = _mm256_setzero_si256();
+
+		for (int i = 0; i + 8 <= words; i += 8)
+		{
+			__m256i const v = _mm256_loadu_si256(reinterpret_cast<__m256i const*>(buf + i));
+			__m256i const lo = _mm256_and_si256(v, low_mask);
+			__m256i const hi = _mm256_and_si256(_mm256_srli_epi16(v, 4), low_mask);
+			__m256i const cnt = _mm256_add_epi8(_mm256_shuffle_epi8(lookup, lo)
+				, _mm256_shuffle_epi8(lookup, hi));
+			acc = _mm256_add_epi64(acc, _mm256_sad_epu8(cnt, _mm256_setzero_si256()));
+		}
+
+		return int(_mm256_extract_epi64(acc, 0) + _mm256_extract_epi64(acc, 1)
+			+ _mm256_extract_epi64(acc, 2) + _mm256_extract_epi64(acc, 3));
+	}
+
+	// returns the index of the first non-zero word in buf, or num if they
+	// are all zero. 8 words are tested at a time
+	TORRENT_AVX2_TARGET
+	int first_nonzero_word_avx2(std::uint32_t const* buf, int const num)
+	{
+		int i = 0;
+		for (; i + 8 <= num; i += 8)
+		{
+			__m256i const v = _mm256_loadu_si256(reinterpret_cast<__m256i const*>(buf + i));
+			if (!_mm256_testz_si256(v, v)) break;
+		}
+		for (; i < num; ++i)
+			if (buf[i] != 0) break;
+		return i;
+	}
+#endif // TORRENT_HAS_AVX2
+
+	int first_nonzero_word(std::uint32_t const* buf, int const num)
+	{
+#if TORRENT_HAS_AVX2
+		if (aux::avx2_support) return first_nonzero_word_avx2(buf, num);
+#endif
+		int i = 0;
+		for (; i < num; ++i)
+			if (buf[i] != 0) break;
+		return i;
+	}
+}
+
 	bool bitfield::all_set() const
 	{
 		if(size() == 0) return false;
@@ -65,7 +137,15 @@ namespace libtorrent {
 #if TORRENT_HAS_SSE
 		if (aux::mmx_support)
 		{
-			for (int i = 1; i < words + 1; ++i)
+			int first = 1;
+#if TORRENT_HAS_AVX2
+			if (aux::avx2_support && words >= 8)
+			{
+				ret = count_avx2(&m_buf[1], words);
+				first += words & ~7;
+			}
+#endif
+			for (int i = first; i < words + 1; ++i)
 			{
 #ifdef __GNUC__
 				std::uint32_t cnt = 0;
@@ -201,6 +281,32 @@ namespace libtorrent {
 		return count != num * 32 ? count : -1;
 	}
 
+	int bitfield::find_next_set(int const start) const
+	{
+		TORRENT_ASSERT(start >= 0);
+		int const num = num_words();
+		int word = start / 32;
+		if (word >= num) return -1;
+
+		std::uint32_t const* b = buf();
+
+		// mask off the bits before start in its word
+		std::uint32_t const first = b[word]
+			& aux::host_to_network(0xffffffff >> (start & 31));
+		if (first == 0)
+		{
+			++word;
+			word += first_nonzero_word(b + word, num - word);
+			if (word == num) return -1;
+		}
+
+		std::uint32_t const w = first != 0 ? first : b[word];
+		int const ret = word * 32 + aux::count_leading_zeros({&w, 1});
+		TORRENT_ASSERT(ret >= start);
+		TORRENT_ASSERT(ret < size());
+		return ret;
+	}
+
 	int bitfield::find_last_clear() const
 	{
 		int const num = num_words();
@@ -43,6 +43,8 @@ POSSIBILITY OF SUCH DAMAGE.
 #include "libtorrent/aux_/time.hpp"
 #include "libtorrent/aux_/block_cache_reference.hpp"
 #include "libtorrent/aux_/numeric_cast.hpp"
+#include "libtorrent/aux_/l2_cache.hpp"
+#include "libtorrent/torrent_info.hpp"
 
 #include <boost/variant/get.hpp>
 
@@ -111,6 +113,24 @@ POSSIBILITY OF SUCH DAMAGE.
 	eviction algorithm to know which list to evict from. The volatile list is
 	always the first one to be evicted however.
 
+	W-TinyLFU
+	.........
+
+	When the cache_eviction_policy setting is set to w_tinylfu_eviction,
+	read_lru1 and read_lru2 are used as the window and the main part of a
+	W-TinyLFU cache instead. The ghost lists are not used, evicted read pieces
+	are removed right away. The number of (distinct requester) accesses of
+	every piece is estimated by a frequency sketch, which counts both hits
+	and misses, and periodically ages the counts. New pieces enter the window,
+	which is kept at about 1% of the read pieces. Cache hits don't promote
+	pieces, they just move them to the most recently used end of their list.
+	When blocks need to be evicted, the least recently used pieces of the
+	window in excess of its size are candidates for the main cache. A
+	candidate is admitted if it's estimated to be more popular than the least
+	recently used piece of the main cache, otherwise it's the first to be
+	evicted. This protects the popular pieces from being flushed out by large
+	scans, where every piece is only accessed once.
+
 	Write jobs
 	..........
 
@@ -205,6 +225,7 @@ const char* const job_action_name[] =
 	"trim_cache",
 	"set_file_priority",
 	"clear_piece",
+	"hash_blocks",
 	"resolve_links"
 };
 
@@ -308,6 +329,9 @@ cached_piece_entry::cached_piece_entry()
 	, num_dirty(0)
 	, num_blocks(0)
 	, blocks_in_piece(0)
+	, readback_reason(readback_none)
+	, ghost_hit(0)
+	, content_indexed(0)
 	, hashing(0)
 	, hashing_done(0)
 	, marked_for_deletion(false)
@@ -343,6 +367,7 @@ block_cache::block_cache(int block_size, io_service& ios
 	, std::function<void()> const& trigger_trim)
 	: disk_buffer_pool(block_size, ios, trigger_trim)
 	, m_last_cache_op(cache_miss)
+	, m_eviction_policy(settings_pack::arc_eviction)
 	, m_ghost_size(8)
 	, m_max_volatile_blocks(100)
 	, m_volatile_size(0)
@@ -370,7 +395,7 @@ int block_cache::try_read(disk_io_job* j, buffer_allocator_interface& allocator
 	// if the piece cannot be found in the cache,
 	// it's a cache miss
 	TORRENT_ASSERT(!expect_no_fail || p != nullptr);
-	if (p == nullptr) return -1;
+	if (p == nullptr) return try_read_shared(j, allocator);
 
 #if TORRENT_USE_ASSERTS
 	p->piece_log.push_back(piece_log_t(j->action, j->d.io.offset / 0x4000));
@@ -378,12 +403,79 @@ int block_cache::try_read(disk_io_job* j, buffer_allocator_interface& allocator
 	cache_hit(p, j->requester, (j->flags & disk_interface::volatile_read) != 0);
 
 	ret = copy_from_piece(p, j, allocator, expect_no_fail);
+	if (ret == -1 && !expect_no_fail) return try_read_shared(j, allocator);
 	if (ret < 0) return ret;
 
+	// this piece is read by a seed, so it's been verified. Make it available
+	// to other torrents with the same piece
+	if (m_content_addressed && !p->content_indexed) index_content(p);
+
 	ret = j->d.io.buffer_size;
 	return ret;
 }
 
+int block_cache::try_read_shared(disk_io_job* j, buffer_allocator_interface& allocator)
+{
+	if (!m_content_addressed || m_content_index.empty()) return -1;
+
+	torrent_info const* ti = j->storage->info();
+	if (ti == nullptr || !ti->is_valid()) return -1;
+
+	auto const i = m_content_index.find(ti->hash_for_piece(j->piece));
+	if (i == m_content_index.end()) return -1;
+
+	cached_piece_entry* p = i->second;
+	TORRENT_PIECE_ASSERT(p->in_use, p);
+	TORRENT_PIECE_ASSERT(p->content_indexed, p);
+	if (p->storage == j->storage) return -1;
+
+	// the hash covers the size of the piece too, but be defensive against
+	// hash collisions between pieces of different sizes
+	if (p->storage->files().piece_size(p->piece)
+		!= j->storage->files().piece_size(j->piece))
+		return -1;
+
+	cache_hit(p, j->requester, (j->flags & disk_interface::volatile_read) != 0);
+	int const ret = copy_from_piece(p, j, allocator);
+	if (ret < 0) return ret;
+
+	++m_shared_read_blocks;
+	return j->d.io.buffer_size;
+}
+
+void block_cache::index_content(cached_piece_entry* pe)
+{
+	TORRENT_PIECE_ASSERT(!pe->content_indexed, pe);
+	if (pe->num_dirty > 0 || pe->marked_for_deletion) return;
+	if (pe->cache_state != cached_piece_entry::read_lru1
+		&& pe->cache_state != cached_piece_entry::read_lru2
+		&& pe->cache_state != cached_piece_entry::volatile_read_lru)
+		return;
+
+	torrent_info const* ti = pe->storage->info();
+	if (ti == nullptr || !ti->is_valid()) return;
+
+	sha1_hash const h = ti->hash_for_piece(pe->piece);
+	if (h.is_all_zeros()) return;
+
+	// if there already is a piece with this content, leave it be. Reads of
+	// this torrent will be served from its own piece either way
+	if (!m_content_index.insert(std::make_pair(h, pe)).second) return;
+	pe->content_indexed = 1;
+}
+
+void block_cache::unindex_content(cached_piece_entry* pe)
+{
+	TORRENT_PIECE_ASSERT(pe->content_indexed, pe);
+	pe->content_indexed = 0;
+
+	torrent_info const* ti = pe->storage->info();
+	TORRENT_ASSERT(ti != nullptr);
+	auto const i = m_content_index.find(ti->hash_for_piece(pe->piece));
+	TORRENT_PIECE_ASSERT(i != m_content_index.end() && i->second == pe, pe);
+	if (i != m_content_index.end() && i->second == pe) m_content_index.erase(i);
+}
+
 void block_cache::bump_lru(cached_piece_entry* p)
 {
 	// move to the top of the LRU list
@@ -406,6 +498,13 @@ void block_cache::cache_hit(cached_piece_entry* p, void* requester, bool volatil
 	TORRENT_ASSERT(p);
 	TORRENT_ASSERT(p->in_use);
 
+	if (m_eviction_policy == settings_pack::w_tinylfu_eviction
+		&& p->cache_state != cached_piece_entry::volatile_read_lru)
+	{
+		tinylfu_cache_hit(p, requester);
+		return;
+	}
+
 	// move the piece into this queue. Whenever we have a cache
 	// hit, we move the piece into the lru2 queue (i.e. the most
 	// frequently used piece). However, we only do that if the
@@ -456,11 +555,13 @@ void block_cache::cache_hit(cached_piece_entry* p, void* requester, bool volatil
 	{
 		m_last_cache_op = ghost_hit_lru1;
 		p->storage->add_piece(p);
+		p->ghost_hit = 1;
 	}
 	else if (p->cache_state == cached_piece_entry::read_lru2_ghost)
 	{
 		m_last_cache_op = ghost_hit_lru2;
 		p->storage->add_piece(p);
+		p->ghost_hit = 1;
 	}
 
 	// move into L2 (frequently used)
@@ -484,6 +585,60 @@ void block_cache::cache_hit(cached_piece_entry* p, void* requester, bool volatil
 #endif
 }
 
+std::uint64_t block_cache::sketch_key(cached_piece_entry const* p)
+{
+	return (std::uint64_t(static_cast<std::uint32_t>(
+		static_cast<int>(p->storage->storage_index()))) << 32)
+		| static_cast<std::uint32_t>(static_cast<int>(p->piece));
+}
+
+void block_cache::tinylfu_cache_hit(cached_piece_entry* p, void* requester)
+{
+	// just like with ARC, several accesses in a row by the same requester
+	// only count as one
+	if (requester != nullptr && p->last_requester != requester)
+	{
+		m_sketch.increment(sketch_key(p));
+		p->last_requester = requester;
+	}
+
+	if (p->cache_state != cached_piece_entry::read_lru1
+		&& p->cache_state != cached_piece_entry::read_lru2)
+		return;
+
+	// move to the most recently used end of its list
+	m_lru[p->cache_state].erase(p);
+	m_lru[p->cache_state].push_back(p);
+	p->expire = aux::time_now();
+}
+
+bool block_cache::tinylfu_admit()
+{
+	linked_list<cached_piece_entry>& window = m_lru[cached_piece_entry::read_lru1];
+	linked_list<cached_piece_entry>& main = m_lru[cached_piece_entry::read_lru2];
+
+	int const window_size = std::max(1, (window.size() + main.size()) / 100);
+
+	while (window.size() > window_size)
+	{
+		cached_piece_entry* candidate = window.front();
+		cached_piece_entry* victim = main.front();
+
+		// if the window candidate isn't more popular than the piece that
+		// would be evicted from the main cache to make room for it, it's the
+		// one to go
+		if (victim != nullptr
+			&& m_sketch.estimate(sketch_key(candidate))
+				<= m_sketch.estimate(sketch_key(victim)))
+			return true;
+
+		window.erase(candidate);
+		main.push_back(candidate);
+		candidate->cache_state = cached_piece_entry::read_lru2;
+	}
+	return false;
+}
+
 // this is used to move pieces primarily from the write cache
 // to the read cache. Technically it can move from read to write
 // cache as well, it's unclear if that ever happens though
@@ -644,7 +799,11 @@ cached_piece_entry* block_cache::allocate_piece(disk_io_job const* j, std::uint1
 		// which end to evict blocks from next time we need to
 		// evict blocks
 		if (cache_state == cached_piece_entry::read_lru1)
+		{
 			m_last_cache_op = cache_miss;
+			if (m_eviction_policy == settings_pack::w_tinylfu_eviction)
+				m_sketch.increment(sketch_key(p));
+		}
 
 #if TORRENT_USE_ASSERTS
 		switch (p->cache_state)
@@ -729,6 +888,9 @@ cached_piece_entry* block_cache::add_dirty_block(disk_io_job* j)
 
 	TORRENT_PIECE_ASSERT(pe->in_use, pe);
 
+	// the content of the piece is about to change
+	if (pe->content_indexed) unindex_content(pe);
+
 	int block = j->d.io.offset / block_size();
 	TORRENT_ASSERT((j->d.io.offset % block_size()) == 0);
 
@@ -930,6 +1092,7 @@ void block_cache::mark_for_deletion(cached_piece_entry* p)
 		"piece: %d\n", static_cast<void*>(this), int(p->piece));
 
 	TORRENT_PIECE_ASSERT(p->jobs.empty(), p);
+	if (p->content_indexed) unindex_content(p);
 	tailqueue<disk_io_job> jobs;
 	if (!evict_piece(p, jobs))
 	{
@@ -944,6 +1107,7 @@ void block_cache::erase_piece(cached_piece_entry* pe)
 	TORRENT_PIECE_ASSERT(pe->ok_to_evict(), pe);
 	TORRENT_PIECE_ASSERT(pe->cache_state < cached_piece_entry::num_lrus, pe);
 	TORRENT_PIECE_ASSERT(pe->jobs.empty(), pe);
+	if (pe->content_indexed) unindex_content(pe);
 	linked_list<cached_piece_entry>* lru_list = &m_lru[pe->cache_state];
 	if (pe->hash)
 	{
@@ -985,7 +1149,20 @@ int block_cache::try_evict_blocks(int num, cached_piece_entry* ignore)
 	// first pieces to go when evicting
 	lru_list[0] = &m_lru[cached_piece_entry::volatile_read_lru];
 
-	if (m_last_cache_op == cache_miss)
+	if (m_eviction_policy == settings_pack::w_tinylfu_eviction)
+	{
+		if (tinylfu_admit())
+		{
+			lru_list[1] = &m_lru[cached_piece_entry::read_lru1];
+			lru_list[2] = &m_lru[cached_piece_entry::read_lru2];
+		}
+		else
+		{
+			lru_list[1] = &m_lru[cached_piece_entry::read_lru2];
+			lru_list[2] = &m_lru[cached_piece_entry::read_lru1];
+		}
+	}
+	else if (m_last_cache_op == cache_miss)
 	{
 		// when there was a cache miss, evict from the largest list, to tend to
 		// keep the lists of equal size when we don't know which one is
@@ -1059,7 +1236,10 @@ int block_cache::try_evict_blocks(int num, cached_piece_entry* ignore)
 
 				if (b.buf == nullptr || b.refcount > 0 || b.dirty || b.pending) continue;
 
-				to_delete[num_to_delete++] = b.buf;
+				// a piece that was requested again after being evicted once is
+				// likely to be requested again
+				if (!pe->ghost_hit || !spill_block(pe, j, b.buf))
+					to_delete[num_to_delete++] = b.buf;
 				b.buf = nullptr;
 				TORRENT_PIECE_ASSERT(pe->num_blocks > 0, pe);
 				--pe->num_blocks;
@@ -1175,6 +1355,17 @@ int block_cache::try_evict_blocks(int num, cached_piece_entry* ignore)
 	return num;
 }
 
+bool block_cache::spill_block(cached_piece_entry const* pe, int const block
+	, char* buf)
+{
+	if (m_l2_cache == nullptr || !m_l2_cache->enabled()) return false;
+
+	int const piece_size = pe->storage->files().piece_size(pe->piece);
+	int const len = std::min(block_size(), piece_size - block * block_size());
+	return m_l2_cache->insert(pe->storage->storage_index(), pe->piece, block
+		, buf, len);
+}
+
 void block_cache::clear(tailqueue<disk_io_job>& jobs)
 {
 	INVARIANT_CHECK;
@@ -1215,7 +1406,13 @@ void block_cache::move_to_ghost(cached_piece_entry* pe)
 	TORRENT_PIECE_ASSERT(pe->num_blocks == 0, pe);
 	TORRENT_PIECE_ASSERT(pe->in_use, pe);
 
-	if (pe->cache_state == cached_piece_entry::volatile_read_lru)
+	// a ghost has no blocks to share
+	if (pe->content_indexed) unindex_content(pe);
+
+	// W-TinyLFU doesn't use the ghost lists, the frequency sketch is what
+	// remembers evicted pieces
+	if (pe->cache_state == cached_piece_entry::volatile_read_lru
+		|| m_eviction_policy == settings_pack::w_tinylfu_eviction)
 	{
 		erase_piece(pe);
 		return;
@@ -1278,6 +1475,10 @@ void block_cache::insert_blocks(cached_piece_entry* pe, int block, span<iovec_t
 
 	TORRENT_ASSERT(pe->in_use);
 
+	// blocks we already have are freed all at once at the end
+	TORRENT_ALLOCA(to_delete, char*, iov.size());
+	int num_to_delete = 0;
+
 	for (auto const& buf : iov)
 	{
 		// each iovec buffer has to be the size of a block (or the size of the last block)
@@ -1299,7 +1500,7 @@ void block_cache::insert_blocks(cached_piece_entry* pe, int block, span<iovec_t
 		// either free the block or insert it. Never replace a block
 		if (pe->blocks[block].buf)
 		{
-			free_buffer(static_cast<char*>(buf.iov_base));
+			to_delete[num_to_delete++] = static_cast<char*>(buf.iov_base);
 		}
 		else
 		{
@@ -1324,6 +1525,8 @@ void block_cache::insert_blocks(cached_piece_entry* pe, int block, span<iovec_t
 		block++;
 	}
 
+	if (num_to_delete) free_multiple_buffers(to_delete.first(num_to_delete));
+
 	TORRENT_PIECE_ASSERT(pe->cache_state != cached_piece_entry::read_lru1_ghost, pe);
 	TORRENT_PIECE_ASSERT(pe->cache_state != cached_piece_entry::read_lru2_ghost, pe);
 }
@@ -1526,6 +1729,7 @@ void block_cache::update_stats_counters(counters& c) const
 	c.set_value(counters::arc_mfu_ghost_size, m_lru[cached_piece_entry::read_lru2_ghost].size());
 	c.set_value(counters::arc_write_size, m_lru[cached_piece_entry::write_lru].size());
 	c.set_value(counters::arc_volatile_size, m_lru[cached_piece_entry::volatile_read_lru].size());
+	c.set_value(counters::num_blocks_read_shared, m_shared_read_blocks);
 }
 
 #ifndef TORRENT_NO_DEPRECATE
@@ -1556,6 +1760,40 @@ void block_cache::set_settings(aux::session_settings const& sett)
 		/ (std::max)(sett.get_int(settings_pack::read_cache_line_size), 4) / 2);
 
 	m_max_volatile_blocks = sett.get_int(settings_pack::cache_size_volatile);
+
+	int const policy = sett.get_int(settings_pack::cache_eviction_policy);
+	int const sketch_size = (std::max)(sett.get_int(settings_pack::cache_size)
+		/ (std::max)(sett.get_int(settings_pack::read_cache_line_size), 4), 16);
+	if (policy != m_eviction_policy
+		|| (policy == settings_pack::w_tinylfu_eviction
+			&& sketch_size * 10 != m_sketch.sample_size()))
+	{
+		// the frequency sketch is only needed by W-TinyLFU
+		m_sketch.resize(policy == settings_pack::w_tinylfu_eviction ? sketch_size : 0);
+	}
+	if (policy == settings_pack::w_tinylfu_eviction
+		&& m_eviction_policy != policy)
+	{
+		// W-TinyLFU doesn't use the ghost lists
+		for (int const l : {cached_piece_entry::read_lru1_ghost
+			, cached_piece_entry::read_lru2_ghost})
+		{
+			for (list_iterator<cached_piece_entry> i = m_lru[l].iterate(); i.get();)
+			{
+				cached_piece_entry* pe = i.get();
+				i.next();
+				if (pe->ok_to_evict()) erase_piece(pe);
+			}
+		}
+	}
+	m_eviction_policy = policy;
+
+	m_content_addressed = sett.get_bool(settings_pack::content_addressed_cache);
+	if (!m_content_addressed)
+	{
+		for (auto const& e : m_content_index) e.second->content_indexed = 0;
+		m_content_index.clear();
+	}
 	disk_buffer_pool::set_settings(sett);
 }
 
@@ -1747,12 +1985,14 @@ int block_cache::copy_from_piece(cached_piece_entry* const pe
 
 		// make sure it didn't wrap
 		TORRENT_PIECE_ASSERT(pe->refcount > 0, pe);
-		int const blocks_per_piece = (j->storage->files().piece_length() + block_size() - 1) / block_size();
+		// the block is referenced by the piece it belongs to, which may be
+		// of a different storage than the job's (with content_addressed_cache)
+		int const blocks_per_piece = (pe->storage->files().piece_length() + block_size() - 1) / block_size();
 		j->argument = disk_buffer_holder(allocator
-			, aux::block_cache_reference{ j->storage->storage_index()
+			, aux::block_cache_reference{ pe->storage->storage_index()
 				, static_cast<int>(pe->piece) * blocks_per_piece + start_block}
 			, bl.buf + (j->d.io.offset & (block_size() - 1)));
-		j->storage->inc_refcount();
+		pe->storage->inc_refcount();
 
 		++m_send_buffer_blocks;
 		return j->d.io.buffer_size;
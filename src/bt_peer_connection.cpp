@@ -845,6 +845,17 @@ namespace libtorrent {
 		std::shared_ptr<torrent> t = associated_torrent().lock();
 		TORRENT_ASSERT(t);
 
+		if (direct_receive_active())
+		{
+			peer_request const& r = direct_receive_request();
+			piece_block_progress p;
+			p.piece_index = r.piece;
+			p.block_index = r.start / t->block_size();
+			p.bytes_downloaded = direct_receive_pos();
+			p.full_block_bytes = r.length;
+			return p;
+		}
+
 		span<char const> recv_buffer = m_recv_buffer.get();
 		// are we currently receiving a 'piece' message?
 		if (m_state != state_t::read_packet
@@ -1224,7 +1235,22 @@ namespace libtorrent {
 		}
 
 		incoming_piece_fragment(piece_bytes);
-		if (!m_recv_buffer.packet_finished()) return;
+		if (!m_recv_buffer.packet_finished())
+		{
+			// once we have the header, try to receive the rest of the payload
+			// straight into a disk buffer. If that works, this message is done
+			// as far as the receive buffer is concerned
+			if (!merkle
+#if !defined(TORRENT_DISABLE_ENCRYPTION) && !defined(TORRENT_DISABLE_EXTENSIONS)
+				&& m_enc_handler.is_recv_plaintext()
+#endif
+				&& start_direct_receive(p, recv_buffer.subspan(header_size)))
+			{
+				m_recv_buffer.cut(recv_pos, 5);
+				m_state = state_t::read_packet_size;
+			}
+			return;
+		}
 
 		if (merkle && list_size > 0)
 		{
@@ -1749,12 +1775,10 @@ namespace libtorrent {
 				, "msg: %d size: %d", extended_id, m_recv_buffer.packet_size());
 #endif
 
-		for (auto const& e : m_extensions)
-		{
-			if (e->on_extended(m_recv_buffer.packet_size() - 2, extended_id
-				, recv_buffer))
-				return;
-		}
+		if (m_extensions.any_of(peer_plugin::extended_feature
+			, [&](peer_plugin& e) { return e.on_extended(m_recv_buffer.packet_size() - 2
+				, extended_id, recv_buffer); }))
+			return;
 
 		disconnect(errors::invalid_message, op_bittorrent, 2);
 		return;
@@ -1794,16 +1818,10 @@ namespace libtorrent {
 		}
 #endif
 
-		for (auto i = m_extensions.begin();
-			!m_extensions.empty() && i != m_extensions.end();)
-		{
-			// a false return value means that the extension
-			// isn't supported by the other end. So, it is removed.
-			if (!(*i)->on_extension_handshake(root))
-				i = m_extensions.erase(i);
-			else
-				++i;
-		}
+		// a false return value means that the extension
+		// isn't supported by the other end. So, it is removed.
+		m_extensions.remove_if([&](peer_plugin& e)
+			{ return !e.on_extension_handshake(root); });
 		if (is_disconnecting()) return;
 
 		// upload_only
@@ -1934,12 +1952,10 @@ namespace libtorrent {
 			default:
 			{
 #ifndef TORRENT_DISABLE_EXTENSIONS
-				for (auto const& e : m_extensions)
-				{
-					if (e->on_unknown_message(m_recv_buffer.packet_size(), packet_type
-						, recv_buffer.subspan(1)))
-						return m_recv_buffer.packet_finished();
-				}
+				if (m_extensions.any_of(peer_plugin::unknown_message_feature
+					, [&](peer_plugin& e) { return e.on_unknown_message(m_recv_buffer.packet_size()
+						, packet_type, recv_buffer.subspan(1)); }))
+					return m_recv_buffer.packet_finished();
 #endif
 				received_bytes(0, received);
 				disconnect(errors::invalid_message, op_bittorrent);
@@ -2243,10 +2259,7 @@ namespace libtorrent {
 
 		// loop backwards, to make the first extension be the last
 		// to fill in the handshake (i.e. give the first extensions priority)
-		for (auto const& e : m_extensions)
-		{
-			e->add_handshake(handshake);
-		}
+		m_extensions.for_each([&](peer_plugin& e) { e.add_handshake(handshake); });
 
 #ifndef NDEBUG
 		// make sure there are not conflicting extensions
@@ -2302,10 +2315,8 @@ namespace libtorrent {
 		send_simple_message(msg_unchoke, counters::num_outgoing_unchoke);
 
 #ifndef TORRENT_DISABLE_EXTENSIONS
-		for (auto const& e : m_extensions)
-		{
-			e->sent_unchoke();
-		}
+		m_extensions.for_each(peer_plugin::sent_unchoke_feature
+			, [&](peer_plugin& e) { e.sent_unchoke(); });
 #endif
 	}
 
@@ -2509,6 +2520,75 @@ namespace libtorrent {
 			on_receive_impl(bytes_transferred);
 	}
 
+	// parses the run of complete HAVE, REQUEST and CANCEL messages at the
+	// front of the received (plaintext) bytes in one pass, without taking
+	// each of them through the read_packet_size/read_packet states, cutting
+	// and normalizing the receive buffer. The first message of any other
+	// kind, or a partial message, ends the batch and is left to
+	// on_receive()
+	int bt_peer_connection::on_receive_batch(int const bytes)
+	{
+		INVARIANT_CHECK;
+
+		if (m_state != state_t::read_packet_size) return 0;
+#if !defined(TORRENT_DISABLE_ENCRYPTION) && !defined(TORRENT_DISABLE_EXTENSIONS)
+		if (!m_enc_handler.is_recv_plaintext()) return 0;
+#endif
+		receive_buffer& buf = peer_connection::m_recv_buffer;
+		if (buf.pos() != 0 || buf.packet_size() != 5) return 0;
+
+		std::shared_ptr<torrent> t = associated_torrent().lock();
+		if (!t) return 0;
+
+		// make sure are much as possible of the responses end up in the same
+		// packet
+		cork c_(*this);
+
+		int consumed = 0;
+		while (bytes - consumed >= 9)
+		{
+			span<char const> const recv = buf.unconsumed();
+			TORRENT_ASSERT(int(recv.size()) >= bytes - consumed);
+			char const* ptr = recv.data();
+			int const packet_size = detail::read_int32(ptr);
+			int const packet_type = static_cast<std::uint8_t>(*ptr++);
+
+			int expected_size;
+			switch (packet_type)
+			{
+				case msg_have: expected_size = 5; break;
+				case msg_request:
+				case msg_cancel: expected_size = 13; break;
+				default: expected_size = 0; break;
+			}
+			// leave malformed messages to the regular path, to have them
+			// rejected there
+			if (expected_size == 0 || packet_size != expected_size) break;
+			if (bytes - consumed < 4 + packet_size) break;
+
+			buf.skip(4 + packet_size);
+			consumed += 4 + packet_size;
+			received_bytes(0, 4 + packet_size);
+			stats_counters().inc_stats_counter(counters::num_incoming_choke + packet_type);
+
+			if (packet_type == msg_have)
+			{
+				incoming_have(piece_index_t(detail::read_int32(ptr)));
+			}
+			else
+			{
+				peer_request r;
+				r.piece = piece_index_t(detail::read_int32(ptr));
+				r.start = detail::read_int32(ptr);
+				r.length = detail::read_int32(ptr);
+				if (packet_type == msg_request) incoming_request(r);
+				else incoming_cancel(r);
+			}
+			if (is_disconnecting()) break;
+		}
+		return consumed;
+	}
+
 	void bt_peer_connection::on_receive_impl(std::size_t bytes_transferred)
 	{
 		std::shared_ptr<torrent> t = associated_torrent().lock();
@@ -3306,18 +3386,8 @@ namespace libtorrent {
 			}
 
 #ifndef TORRENT_DISABLE_EXTENSIONS
-			for (auto i = m_extensions.begin()
-				, end(m_extensions.end()); i != end;)
-			{
-				if (!(*i)->on_handshake(m_reserved_bits))
-				{
-					i = m_extensions.erase(i);
-				}
-				else
-				{
-					++i;
-				}
-			}
+			m_extensions.remove_if([&](peer_plugin& e)
+				{ return !e.on_handshake(m_reserved_bits); });
 			if (is_disconnecting()) return;
 
 			if (m_supports_extensions) write_extensions();
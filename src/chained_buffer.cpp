@@ -42,9 +42,9 @@ namespace libtorrent {
 		TORRENT_ASSERT(is_single_thread());
 		TORRENT_ASSERT(!m_destructed);
 		TORRENT_ASSERT(bytes_to_pop <= m_bytes);
-		while (bytes_to_pop > 0 && !m_vec.empty())
+		while (bytes_to_pop > 0 && m_num > 0)
 		{
-			buffer_t& b = m_vec.front();
+			buffer_t& b = at(0);
 			if (b.used_size > bytes_to_pop)
 			{
 				b.buf += bytes_to_pop;
@@ -65,8 +65,32 @@ namespace libtorrent {
 			TORRENT_ASSERT(m_bytes >= 0);
 			TORRENT_ASSERT(m_capacity >= 0);
 			TORRENT_ASSERT(m_bytes <= m_capacity);
-			m_vec.pop_front();
+			m_first = (m_first + 1) & (m_ring_size - 1);
+			--m_num;
 		}
+		if (m_num == 0) m_first = 0;
+	}
+
+	void chained_buffer::grow_ring()
+	{
+		TORRENT_ASSERT(m_num == m_ring_size);
+		int const new_size = m_ring_size == 0 ? 8 : m_ring_size * 2;
+		std::unique_ptr<buffer_t[]> new_ring(new buffer_t[std::size_t(new_size)]);
+		for (int i = 0; i < m_num; ++i)
+		{
+			buffer_t& src = at(i);
+			buffer_t& dst = new_ring[std::size_t(i)];
+			dst.destruct_holder = src.destruct_holder;
+			dst.move_holder = src.move_holder;
+			dst.buf = src.buf;
+			dst.size = src.size;
+			dst.used_size = src.used_size;
+			src.move_holder(&dst.holder, &src.holder);
+			src.destruct_holder(&src.holder);
+		}
+		m_ring = std::move(new_ring);
+		m_ring_size = new_size;
+		m_first = 0;
 	}
 
 	// returns the number of bytes available at the
@@ -75,8 +99,8 @@ namespace libtorrent {
 	{
 		TORRENT_ASSERT(is_single_thread());
 		TORRENT_ASSERT(!m_destructed);
-		if (m_vec.empty()) return 0;
-		buffer_t& b = m_vec.back();
+		if (m_num == 0) return 0;
+		buffer_t& b = at(m_num - 1);
 		TORRENT_ASSERT(b.buf != nullptr);
 		return b.size - b.used_size;
 	}
@@ -101,8 +125,8 @@ namespace libtorrent {
 	{
 		TORRENT_ASSERT(is_single_thread());
 		TORRENT_ASSERT(!m_destructed);
-		if (m_vec.empty()) return nullptr;
-		buffer_t& b = m_vec.back();
+		if (m_num == 0) return nullptr;
+		buffer_t& b = at(m_num - 1);
 		TORRENT_ASSERT(b.buf != nullptr);
 		char* const insert = b.buf + b.used_size;
 		if (insert + s > b.buf + b.size) return nullptr;
@@ -117,6 +141,7 @@ namespace libtorrent {
 		TORRENT_ASSERT(is_single_thread());
 		TORRENT_ASSERT(!m_destructed);
 		m_tmp_vec.clear();
+		m_tmp_vec.reserve(std::size_t(m_num));
 		build_vec(to_send, m_tmp_vec);
 		return m_tmp_vec;
 	}
@@ -131,29 +156,34 @@ namespace libtorrent {
 	void chained_buffer::build_vec(int bytes, std::vector<Buffer>& vec)
 	{
 		TORRENT_ASSERT(!m_destructed);
-		for (auto i = m_vec.begin(), end(m_vec.end()); bytes > 0 && i != end; ++i)
+		for (int i = 0; bytes > 0 && i < m_num; ++i)
 		{
-			TORRENT_ASSERT(i->buf != nullptr);
-			if (i->used_size > bytes)
+			buffer_t& b = at(i);
+			TORRENT_ASSERT(b.buf != nullptr);
+			if (b.used_size > bytes)
 			{
 				TORRENT_ASSERT(bytes > 0);
-				vec.push_back(Buffer(i->buf, std::size_t(bytes)));
+				vec.push_back(Buffer(b.buf, std::size_t(bytes)));
 				break;
 			}
-			TORRENT_ASSERT(i->used_size > 0);
-			vec.push_back(Buffer(i->buf, std::size_t(i->used_size)));
-			bytes -= i->used_size;
+			TORRENT_ASSERT(b.used_size > 0);
+			vec.push_back(Buffer(b.buf, std::size_t(b.used_size)));
+			bytes -= b.used_size;
 		}
 	}
 
 	void chained_buffer::clear()
 	{
 		TORRENT_ASSERT(!m_destructed);
-		for (auto& b : m_vec)
+		for (int i = 0; i < m_num; ++i)
+		{
+			buffer_t& b = at(i);
 			b.destruct_holder(static_cast<void*>(&b.holder));
+		}
 		m_bytes = 0;
 		m_capacity = 0;
-		m_vec.clear();
+		m_first = 0;
+		m_num = 0;
 	}
 
 	chained_buffer::~chained_buffer()
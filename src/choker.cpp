@@ -37,6 +37,8 @@ POSSIBILITY OF SUCH DAMAGE.
 #include "libtorrent/torrent.hpp"
 
 #include <functional>
+#include <algorithm>
+#include <utility> // for pair
 
 using namespace std::placeholders;
 
@@ -44,190 +46,130 @@ namespace libtorrent {
 
 	namespace {
 
-	// return true if 'lhs' peer should be preferred to be unchoke over 'rhs'
-	bool unchoke_compare_rr(peer_connection const* lhs
-		, peer_connection const* rhs, int pieces)
+	// the sort key of a peer competing for an unchoke slot. It's computed
+	// once per peer and unchoke round, rather than once per comparison, to
+	// avoid locking the torrent and querying the peer's counters when
+	// ordering large numbers of peers
+	struct unchoke_key
 	{
-		// if one peer belongs to a higher priority torrent than the other one
-		// that one should be unchoked.
-		std::shared_ptr<torrent> t1 = lhs->associated_torrent().lock();
-		TORRENT_ASSERT(t1);
-		std::shared_ptr<torrent> t2 = rhs->associated_torrent().lock();
-		TORRENT_ASSERT(t2);
-
-		int prio1 = lhs->get_priority(peer_connection::upload_channel);
-		int prio2 = rhs->get_priority(peer_connection::upload_channel);
-
-		if (prio1 != prio2)
-			return prio1 > prio2;
-
-		// compare how many bytes they've sent us
-		std::int64_t c1;
-		std::int64_t c2;
-		c1 = lhs->downloaded_in_last_round();
-		c2 = rhs->downloaded_in_last_round();
-
-		if (c1 != c2) return c1 > c2;
-
-		// when seeding, rotate which peer is unchoked in a round-robin fasion
-
-		// the amount uploaded since unchoked (not just in the last round)
-		c1 = lhs->uploaded_since_unchoked();
-		c2 = rhs->uploaded_since_unchoked();
-
-		// the way the round-robin unchoker works is that it,
-		// by default, prioritizes any peer that is already unchoked.
-		// this maintain the status quo across unchoke rounds. However,
-		// peers that are unchoked, but have sent more than one quota
-		// since they were unchoked, they get de-prioritized.
-
-		// if a peer is already unchoked, the number of bytes sent since it was unchoked
-		// is greater than the send quanta, and it has been unchoked for at least one minute
-		// then it's done with its upload slot, and we can de-prioritize it
-		bool c1_quota_complete = !lhs->is_choked()
-			&& c1 > t1->torrent_file().piece_length() * pieces
-			&& aux::time_now() - lhs->time_of_last_unchoke() > minutes(1);
-		bool c2_quota_complete = !rhs->is_choked()
-			&& c2 > t2->torrent_file().piece_length() * pieces
-			&& aux::time_now() - rhs->time_of_last_unchoke() > minutes(1);
-
-		// if c2 has completed a quanta, it should be de-prioritized
-		// and vice versa
-		if (c1_quota_complete < c2_quota_complete) return true;
-		if (c1_quota_complete > c2_quota_complete) return false;
+		// the priority of the peer's torrent
+		int prio;
 
-		// when seeding, prefer the peer we're uploading the fastest to
+		// the number of bytes the peer sent us in the last round
+		std::int64_t downloaded;
 
-		// force the upload rate to zero for choked peers because
-		// if the peers just got choked the previous round
-		// there may have been a residual transfer which was already
-		// in-flight at the time and we don't want that to cause the peer
-		// to be ranked at the top of the choked peers
-		c1 = lhs->is_choked() ? 0 : lhs->uploaded_in_last_round();
-		c2 = rhs->is_choked() ? 0 : rhs->uploaded_in_last_round();
+		// set when the peer has used up its upload slot (round-robin only)
+		bool quota_complete;
 
-		if (c1 > c2) return true;
-		if (c2 > c1) return false;
+		// the algorithm specific rank of the peer when seeding, higher is better
+		std::int64_t score;
 
-		// if the peers are still identical (say, they're both waiting to be unchoked)
-		// prioritize the one that has waited the longest to be unchoked
-		// the round-robin unchoker relies on this logic. Don't change it
-		// without moving this into that unchoker logic
-		return lhs->time_of_last_unchoke() < rhs->time_of_last_unchoke();
-	}
+		time_point last_unchoke;
+		peer_connection* peer;
+	};
 
 	// return true if 'lhs' peer should be preferred to be unchoke over 'rhs'
-	bool unchoke_compare_fastest_upload(peer_connection const* lhs
-		, peer_connection const* rhs)
+	bool unchoke_compare(unchoke_key const& lhs, unchoke_key const& rhs)
 	{
 		// if one peer belongs to a higher priority torrent than the other one
 		// that one should be unchoked.
-		std::shared_ptr<torrent> t1 = lhs->associated_torrent().lock();
-		TORRENT_ASSERT(t1);
-		std::shared_ptr<torrent> t2 = rhs->associated_torrent().lock();
-		TORRENT_ASSERT(t2);
-
-		int prio1 = lhs->get_priority(peer_connection::upload_channel);
-		int prio2 = rhs->get_priority(peer_connection::upload_channel);
-
-		if (prio1 != prio2)
-			return prio1 > prio2;
+		if (lhs.prio != rhs.prio) return lhs.prio > rhs.prio;
 
 		// compare how many bytes they've sent us
-		std::int64_t c1;
-		std::int64_t c2;
-		c1 = lhs->downloaded_in_last_round();
-		c2 = rhs->downloaded_in_last_round();
-
-		if (c1 != c2) return c1 > c2;
-
-		// when seeding, prefer the peer we're uploading the fastest to
-		c1 = lhs->uploaded_in_last_round();
-		c2 = rhs->uploaded_in_last_round();
-
-		if (c1 > c2) return true;
-		if (c2 > c1) return false;
-
-		// prioritize the one that has waited the longest to be unchoked
-		// the round-robin unchoker relies on this logic. Don't change it
-		// without moving this into that unchoker logic
-		return lhs->time_of_last_unchoke() < rhs->time_of_last_unchoke();
-	}
-
-	// return true if 'lhs' peer should be preferred to be unchoke over 'rhs'
-	bool unchoke_compare_anti_leech(peer_connection const* lhs
-		, peer_connection const* rhs)
-	{
-		// if one peer belongs to a higher priority torrent than the other one
-		// that one should be unchoked.
-		std::shared_ptr<torrent> t1 = lhs->associated_torrent().lock();
-		TORRENT_ASSERT(t1);
-		std::shared_ptr<torrent> t2 = rhs->associated_torrent().lock();
-		TORRENT_ASSERT(t2);
+		if (lhs.downloaded != rhs.downloaded) return lhs.downloaded > rhs.downloaded;
 
-		int prio1 = lhs->get_priority(peer_connection::upload_channel);
-		int prio2 = rhs->get_priority(peer_connection::upload_channel);
-
-		if (prio1 != prio2)
-			return prio1 > prio2;
+		// if rhs has completed a quanta, it should be de-prioritized
+		// and vice versa
+		if (lhs.quota_complete != rhs.quota_complete) return rhs.quota_complete;
 
-		// compare how many bytes they've sent us
-		std::int64_t c1;
-		std::int64_t c2;
-		c1 = lhs->downloaded_in_last_round();
-		c2 = rhs->downloaded_in_last_round();
-
-		if (c1 != c2) return c1 > c2;
-
-		// the anti-leech seeding algorithm is based on the paper "Improving
-		// BitTorrent: A Simple Approach" from Chow et. al. and ranks peers based
-		// on how many pieces they have, preferring to unchoke peers that just
-		// started and peers that are close to completing. Like this:
-		//   ^
-		//   | \                       / |
-		//   |  \                     /  |
-		//   |   \                   /   |
-		// s |    \                 /    |
-		// c |     \               /     |
-		// o |      \             /      |
-		// r |       \           /       |
-		// e |        \         /        |
-		//   |         \       /         |
-		//   |          \     /          |
-		//   |           \   /           |
-		//   |            \ /            |
-		//   |             V             |
-		//   +---------------------------+
-		//   0%    num have pieces     100%
-		int t1_total = t1->torrent_file().num_pieces();
-		int t2_total = t2->torrent_file().num_pieces();
-		int score1 = (lhs->num_have_pieces() < t1_total / 2
-			? t1_total - lhs->num_have_pieces() : lhs->num_have_pieces()) * 1000 / t1_total;
-		int score2 = (rhs->num_have_pieces() < t2_total / 2
-			? t2_total - rhs->num_have_pieces() : rhs->num_have_pieces()) * 1000 / t2_total;
-		if (score1 > score2) return true;
-		if (score2 > score1) return false;
+		if (lhs.score != rhs.score) return lhs.score > rhs.score;
 
+		// if the peers are still identical (say, they're both waiting to be unchoked)
 		// prioritize the one that has waited the longest to be unchoked
 		// the round-robin unchoker relies on this logic. Don't change it
 		// without moving this into that unchoker logic
-		return lhs->time_of_last_unchoke() < rhs->time_of_last_unchoke();
+		return lhs.last_unchoke < rhs.last_unchoke;
 	}
 
-	bool upload_rate_compare(peer_connection const* lhs
-		, peer_connection const* rhs)
+	unchoke_key make_unchoke_key(peer_connection* p, int const algorithm
+		, int const pieces, time_point const now)
 	{
-		std::int64_t c1;
-		std::int64_t c2;
+		std::shared_ptr<torrent> t = p->associated_torrent().lock();
+		TORRENT_ASSERT(t);
 
-		c1 = lhs->uploaded_in_last_round();
-		c2 = rhs->uploaded_in_last_round();
-
-		// take torrent priority into account
-		c1 *= lhs->get_priority(peer_connection::upload_channel);
-		c2 *= rhs->get_priority(peer_connection::upload_channel);
+		unchoke_key k;
+		k.prio = p->get_priority(peer_connection::upload_channel);
+		k.downloaded = p->downloaded_in_last_round();
+		k.quota_complete = false;
+		k.last_unchoke = p->time_of_last_unchoke();
+		k.peer = p;
 
-		return c1 > c2;
+		switch (algorithm)
+		{
+			case settings_pack::fastest_upload:
+			{
+				// when seeding, prefer the peer we're uploading the fastest to
+				k.score = p->uploaded_in_last_round();
+				break;
+			}
+			case settings_pack::anti_leech:
+			{
+				// the anti-leech seeding algorithm is based on the paper "Improving
+				// BitTorrent: A Simple Approach" from Chow et. al. and ranks peers based
+				// on how many pieces they have, preferring to unchoke peers that just
+				// started and peers that are close to completing. Like this:
+				//   ^
+				//   | \                       / |
+				//   |  \                     /  |
+				//   |   \                   /   |
+				// s |    \                 /    |
+				// c |     \               /     |
+				// o |      \             /      |
+				// r |       \           /       |
+				// e |        \         /        |
+				//   |         \       /         |
+				//   |          \     /          |
+				//   |           \   /           |
+				//   |            \ /            |
+				//   |             V             |
+				//   +---------------------------+
+				//   0%    num have pieces     100%
+				int const total = t->torrent_file().num_pieces();
+				int const have = p->num_have_pieces();
+				k.score = (have < total / 2 ? total - have : have) * 1000 / total;
+				break;
+			}
+			case settings_pack::round_robin:
+			default:
+			{
+				// when seeding, rotate which peer is unchoked in a round-robin fasion
+
+				// the way the round-robin unchoker works is that it,
+				// by default, prioritizes any peer that is already unchoked.
+				// this maintain the status quo across unchoke rounds. However,
+				// peers that are unchoked, but have sent more than one quota
+				// since they were unchoked, they get de-prioritized.
+
+				// if a peer is already unchoked, the number of bytes sent since it
+				// was unchoked (not just in the last round) is greater than the
+				// send quanta, and it has been unchoked for at least one minute
+				// then it's done with its upload slot, and we can de-prioritize it
+				k.quota_complete = !p->is_choked()
+					&& p->uploaded_since_unchoked() > t->torrent_file().piece_length() * pieces
+					&& now - p->time_of_last_unchoke() > minutes(1);
+
+				// when seeding, prefer the peer we're uploading the fastest to
+
+				// force the upload rate to zero for choked peers because
+				// if the peers just got choked the previous round
+				// there may have been a residual transfer which was already
+				// in-flight at the time and we don't want that to cause the peer
+				// to be ranked at the top of the choked peers
+				k.score = p->is_choked() ? 0 : p->uploaded_in_last_round();
+				break;
+			}
+		}
+		return k;
 	}
 
 	bool bittyrant_unchoke_compare(peer_connection const* lhs
@@ -346,20 +288,26 @@ namespace libtorrent {
 			// it purely based on the current state of our peers.
 			upload_slots = 0;
 
-			// TODO: optimize this using partial_sort or something. We don't need
-			// to sort the entire list
+			// pairs of the upload rate weighted by torrent priority (the sort
+			// key) and the bytes uploaded in the last round
+			std::vector<std::pair<std::int64_t, std::int64_t>> uploaded;
+			uploaded.reserve(peers.size());
+			for (auto const p : peers)
+			{
+				std::int64_t const up = p->uploaded_in_last_round();
+				uploaded.emplace_back(up
+					* p->get_priority(peer_connection::upload_channel), up);
+			}
 
-			// TODO: make the comparison function a free function and move it
-			// into this cpp file
-			std::sort(peers.begin(), peers.end()
-				, std::bind(&upload_rate_compare, _1, _2));
+			std::sort(uploaded.begin(), uploaded.end()
+				, std::greater<std::pair<std::int64_t, std::int64_t>>());
 
 			// TODO: make configurable
 			int rate_threshold = 1024;
 
-			for (auto const p : peers)
+			for (auto const& u : uploaded)
 			{
-				int const rate = int(p->uploaded_in_last_round()
+				int const rate = int(u.second
 					* 1000 / total_milliseconds(unchoke_interval));
 
 				if (rate < rate_threshold) break;
@@ -377,41 +325,27 @@ namespace libtorrent {
 		// being seeded, the download rate will be 0, and the peers we have sent
 		// the least to should be unchoked
 
-		// we use partial sort here, because we only care about the top
-		// upload_slots peers.
-
-		if (sett.get_int(settings_pack::seed_choking_algorithm)
-			== settings_pack::round_robin)
-		{
-			int const pieces = sett.get_int(settings_pack::seeding_piece_quota);
-
-			std::partial_sort(peers.begin(), peers.begin()
-				+ (std::min)(upload_slots, int(peers.size())), peers.end()
-				, std::bind(&unchoke_compare_rr, _1, _2, pieces));
-		}
-		else if (sett.get_int(settings_pack::seed_choking_algorithm)
-			== settings_pack::fastest_upload)
-		{
-			std::partial_sort(peers.begin(), peers.begin()
-				+ (std::min)(upload_slots, int(peers.size())), peers.end()
-				, std::bind(&unchoke_compare_fastest_upload, _1, _2));
-		}
-		else if (sett.get_int(settings_pack::seed_choking_algorithm)
-			== settings_pack::anti_leech)
-		{
-			std::partial_sort(peers.begin(), peers.begin()
-				+ (std::min)(upload_slots, int(peers.size())), peers.end()
-				, std::bind(&unchoke_compare_anti_leech, _1, _2));
-		}
-		else
-		{
-			int const pieces = sett.get_int(settings_pack::seeding_piece_quota);
-			std::partial_sort(peers.begin(), peers.begin()
-				+ (std::min)(upload_slots, int(peers.size())), peers.end()
-				, std::bind(&unchoke_compare_rr, _1, _2, pieces));
-
-			TORRENT_ASSERT_FAIL();
-		}
+		int const algorithm = sett.get_int(settings_pack::seed_choking_algorithm);
+		TORRENT_ASSERT(algorithm == settings_pack::round_robin
+			|| algorithm == settings_pack::fastest_upload
+			|| algorithm == settings_pack::anti_leech);
+		int const pieces = sett.get_int(settings_pack::seeding_piece_quota);
+		time_point const now = aux::time_now();
+
+		std::vector<unchoke_key> keys;
+		keys.reserve(peers.size());
+		for (auto const p : peers)
+			keys.push_back(make_unchoke_key(p, algorithm, pieces, now));
+
+		// we only care about the order of the top upload_slots peers. Select
+		// them in linear time first, and then just sort that range
+		auto const mid = keys.begin() + (std::min)(upload_slots, int(keys.size()));
+		if (mid != keys.end())
+			std::nth_element(keys.begin(), mid, keys.end(), &unchoke_compare);
+		std::sort(keys.begin(), mid, &unchoke_compare);
+
+		for (std::size_t i = 0; i < keys.size(); ++i)
+			peers[i] = keys[i].peer;
 
 		return upload_slots;
 	}
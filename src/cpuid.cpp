@@ -42,10 +42,10 @@ POSSIBILITY OF SUCH DAMAGE.
 
 #if TORRENT_HAS_SSE && defined __GNUC__
 #include <cpuid.h>
-#else
-#include <cstring> // for std::memset
 #endif
 
+#include <cstring> // for std::memset
+
 #if defined __GLIBC__ && (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 16))
 #define TORRENT_HAS_AUXV 1
 #elif defined TORRENT_ANDROID
@@ -76,6 +76,26 @@ namespace libtorrent { namespace aux {
 		TORRENT_UNUSED(type);
 		// for non-x86 and non-amd64, just return zeroes
 		std::memset(&info[0], 0, sizeof(std::uint32_t) * 4);
+#endif
+	}
+
+	// internal. For leaves with sub-leaves, like 7 (extended features)
+	void cpuid_count(std::uint32_t* info, int type, int sub)
+	{
+#if defined _MSC_VER
+		__cpuidex((int*)info, type, sub);
+
+#elif defined __GNUC__
+		if (__get_cpuid_count(std::uint32_t(type), std::uint32_t(sub)
+			, &info[0], &info[1], &info[2], &info[3]) == 0)
+		{
+			// the leaf is not supported
+			std::memset(&info[0], 0, sizeof(std::uint32_t) * 4);
+		}
+#else
+		TORRENT_UNUSED(type);
+		TORRENT_UNUSED(sub);
+		std::memset(&info[0], 0, sizeof(std::uint32_t) * 4);
 #endif
 	}
 #endif
@@ -136,10 +156,63 @@ namespace libtorrent { namespace aux {
 #endif
 	}
 
+	bool supports_sha_ni()
+	{
+#if TORRENT_HAS_SHA_NI
+		// the kernel also relies on SSSE3 (pshufb) and SSE4.1 (pextrd)
+		std::uint32_t cpui[4] = {0};
+		cpuid(cpui, 1);
+		if ((cpui[2] & (1 << 9)) == 0 || (cpui[2] & (1 << 19)) == 0)
+			return false;
+		cpuid_count(cpui, 7, 0);
+		return (cpui[1] & (1 << 29)) != 0;
+#else
+		return false;
+#endif
+	}
+
+	bool supports_avx2()
+	{
+#if TORRENT_HAS_AVX2
+		// AVX needs to be supported by the CPU and the OS needs to save the
+		// YMM registers (OSXSAVE and XCR0 bits 1 and 2)
+		std::uint32_t cpui[4] = {0};
+		cpuid(cpui, 1);
+		if ((cpui[2] & (1 << 27)) == 0 || (cpui[2] & (1 << 28)) == 0)
+			return false;
+#if defined _MSC_VER
+		std::uint64_t const xcr0 = _xgetbv(0);
+#else
+		std::uint32_t eax = 0;
+		std::uint32_t edx = 0;
+		__asm__("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+		std::uint64_t const xcr0 = (std::uint64_t(edx) << 32) | eax;
+#endif
+		if ((xcr0 & 6) != 6) return false;
+		cpuid_count(cpui, 7, 0);
+		return (cpui[1] & (1 << 5)) != 0;
+#else
+		return false;
+#endif
+	}
+
+	bool supports_arm_sha1()
+	{
+#if TORRENT_HAS_ARM_SHA1 && TORRENT_HAS_AUXV
+		//return (getauxval(AT_HWCAP) & HWCAP_SHA1);
+		return (getauxval(16) & (1 << 5));
+#else
+		return false;
+#endif
+	}
+
 	} // anonymous namespace
 
 	bool const sse42_support = supports_sse42();
 	bool const mmx_support = supports_mmx();
 	bool const arm_neon_support = supports_arm_neon();
 	bool const arm_crc32c_support = supports_arm_crc32c();
+	bool const sha_ni_support = supports_sha_ni();
+	bool const arm_sha1_support = supports_arm_sha1();
+	bool const avx2_support = supports_avx2();
 } }
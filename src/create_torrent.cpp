@@ -40,6 +40,8 @@ POSSIBILITY OF SUCH DAMAGE.
 #include "libtorrent/performance_counters.hpp" // for counters
 #include "libtorrent/alert_manager.hpp"
 #include "libtorrent/aux_/path.hpp"
+#include "libtorrent/aux_/session_settings.hpp"
+#include "libtorrent/settings_pack.hpp"
 
 #include <sys/types.h>
 #include <sys/stat.h>
@@ -247,6 +249,13 @@ namespace {
 
 	void set_piece_hashes(create_torrent& t, std::string const& p
 		, std::function<void(piece_index_t)> const& f, error_code& ec)
+	{
+		set_piece_hashes(t, p, settings_pack(), f, ec);
+	}
+
+	void set_piece_hashes(create_torrent& t, std::string const& p
+		, settings_pack const& settings
+		, std::function<void(piece_index_t)> const& f, error_code& ec)
 	{
 		// optimized path
 		io_service ios;
@@ -283,10 +292,22 @@ namespace {
 		settings_pack sett;
 		sett.set_int(settings_pack::cache_size, 0);
 		sett.set_int(settings_pack::aio_threads, 1);
+		// hash on all cores
+		sett.set_int(settings_pack::hash_threads, -1);
 
 		disk_thread.set_settings(&sett);
-
-		int const piece_read_ahead = std::max(1, 15 * 1024 * 1024 / t.piece_length());
+		disk_thread.set_settings(&settings);
+
+		aux::session_settings effective;
+		apply_pack(&sett, effective);
+		apply_pack(&settings, effective);
+
+		// keep at least 15 MiB worth of pieces outstanding, and at least two
+		// pieces per hash thread, to keep all the hash threads and the disk
+		// busy. Each hash job reads its piece in a single sequential read
+		int const piece_read_ahead = std::max(
+			std::max(1, aux::num_hash_threads(effective)) * 2
+			, 15 * 1024 * 1024 / t.piece_length());
 
 		hash_state st = { t, std::move(storage), disk_thread, piece_index_t(0), piece_index_t(0), f, ec };
 		for (piece_index_t i(0); i < piece_index_t(piece_read_ahead); ++i)
@@ -0,0 +1,168 @@
+/*
+
+Copyright (c) 2017, Arvid Norberg
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions
+are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in
+      the documentation and/or other materials provided with the distribution.
+    * Neither the name of the author nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+#include "libtorrent/aux_/deletion_queue.hpp"
+#include "libtorrent/assert.hpp"
+
+#include <algorithm>
+
+#if defined TORRENT_LINUX
+#include "libtorrent/aux_/disable_warnings_push.hpp"
+#include <sys/syscall.h>
+#include <unistd.h>
+#include "libtorrent/aux_/disable_warnings_pop.hpp"
+#elif defined __APPLE__
+#include "libtorrent/aux_/disable_warnings_push.hpp"
+#include <sys/resource.h>
+#include "libtorrent/aux_/disable_warnings_pop.hpp"
+#elif defined TORRENT_WINDOWS
+#include "libtorrent/aux_/disable_warnings_push.hpp"
+#include <windows.h>
+#include "libtorrent/aux_/disable_warnings_pop.hpp"
+#endif
+
+namespace libtorrent { namespace aux {
+
+namespace {
+
+	// lowers the I/O priority of the calling thread, to only use the disk
+	// when no one else does
+	void set_idle_io_priority()
+	{
+#if defined TORRENT_LINUX && defined SYS_ioprio_set
+		// these are from include/linux/ioprio.h, which isn't exported to
+		// user space
+		int const ioprio_who_process = 1;
+		int const ioprio_class_idle = 3;
+		int const ioprio_class_shift = 13;
+		// 0 means the calling thread
+		::syscall(SYS_ioprio_set, ioprio_who_process, 0
+			, ioprio_class_idle << ioprio_class_shift);
+#elif defined __APPLE__ && defined IOPOL_TYPE_DISK
+		setiopolicy_np(IOPOL_TYPE_DISK, IOPOL_SCOPE_THREAD, IOPOL_THROTTLE);
+#elif defined TORRENT_WINDOWS && defined THREAD_MODE_BACKGROUND_BEGIN
+		SetThreadPriority(GetCurrentThread(), THREAD_MODE_BACKGROUND_BEGIN);
+#endif
+	}
+}
+
+	deletion_queue::~deletion_queue()
+	{
+		drain();
+	}
+
+	void deletion_queue::set_max_threads(int const n)
+	{
+		std::unique_lock<std::mutex> l(m_mutex);
+		m_max_threads = std::max(1, n);
+		l.unlock();
+		// threads that were waiting for a slot may be able to run now
+		m_cond.notify_all();
+	}
+
+	int deletion_queue::max_threads() const
+	{
+		std::lock_guard<std::mutex> l(m_mutex);
+		return m_max_threads;
+	}
+
+	void deletion_queue::push(std::function<void()> f)
+	{
+		std::unique_lock<std::mutex> l(m_mutex);
+		if (m_abort)
+		{
+			l.unlock();
+			f();
+			return;
+		}
+
+		m_queue.push_back(std::move(f));
+
+		// there are never more threads than deletions allowed to run at a
+		// time, so a new one is only needed when they're all busy
+		if (int(m_threads.size()) < m_max_threads
+			&& m_running + int(m_queue.size()) > int(m_threads.size()))
+		{
+			m_threads.emplace_back([=] { thread_fun(); });
+		}
+		l.unlock();
+		m_cond.notify_one();
+	}
+
+	void deletion_queue::drain()
+	{
+		std::unique_lock<std::mutex> l(m_mutex);
+		m_abort = true;
+		std::vector<std::thread> threads;
+		threads.swap(m_threads);
+		l.unlock();
+		m_cond.notify_all();
+
+		for (auto& t : threads) t.join();
+		TORRENT_ASSERT(m_queue.empty());
+	}
+
+	int deletion_queue::num_pending() const
+	{
+		std::lock_guard<std::mutex> l(m_mutex);
+		return m_running + int(m_queue.size());
+	}
+
+	void deletion_queue::thread_fun()
+	{
+		set_idle_io_priority();
+
+		std::unique_lock<std::mutex> l(m_mutex);
+		for (;;)
+		{
+			// when the max is lowered, surplus threads wait until the number
+			// of running deletions is below it again
+			m_cond.wait(l, [this] {
+				return (!m_queue.empty() && m_running < m_max_threads)
+					|| (m_abort && m_queue.empty()); });
+
+			if (m_queue.empty()) break;
+
+			std::function<void()> f = std::move(m_queue.front());
+			m_queue.pop_front();
+			++m_running;
+			l.unlock();
+
+			f();
+
+			l.lock();
+			--m_running;
+			// there may be a thread waiting for a slot
+			m_cond.notify_one();
+		}
+	}
+}}
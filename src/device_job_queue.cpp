@@ -0,0 +1,196 @@
+/*
+
+Copyright (c) 2017, Arvid Norberg
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions
+are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in
+      the documentation and/or other materials provided with the distribution.
+    * Neither the name of the author nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+
+#include "libtorrent/aux_/device_job_queue.hpp"
+#include "libtorrent/disk_io_job.hpp"
+#include "libtorrent/assert.hpp"
+
+#include <tuple>
+
+namespace libtorrent { namespace aux {
+
+	device_job_queue::device_queue& device_job_queue::queue_for(std::uint8_t const device)
+	{
+		if (device >= m_devices.size()) m_devices.resize(std::size_t(device) + 1);
+		return m_devices[device];
+	}
+
+	void device_job_queue::push_back(disk_io_job* j)
+	{
+		queue_for(j->device).jobs.push_back(j);
+		++m_size;
+	}
+
+	void device_job_queue::push_front(disk_io_job* j)
+	{
+		queue_for(j->device).jobs.push_front(j);
+		++m_size;
+	}
+
+	void device_job_queue::append(tailqueue<disk_io_job>& jobs)
+	{
+		while (!jobs.empty()) push_back(jobs.pop_front());
+	}
+
+	disk_io_job* device_job_queue::get_all()
+	{
+		tailqueue<disk_io_job> ret;
+		for (auto& d : m_devices) ret.append(d.jobs);
+		m_size = 0;
+		return ret.get_all();
+	}
+
+	bool device_job_queue::read_position::operator<(read_position const& rhs) const
+	{
+		return std::tie(storage, piece, offset)
+			< std::tie(rhs.storage, rhs.piece, rhs.offset);
+	}
+
+	int device_job_queue::pick_job(device_queue const& d, time_point const now) const
+	{
+		if (m_max_read_wait <= time_duration(0)) return 0;
+
+		// only the run of reads at the front of the queue is reordered. Other
+		// jobs, and the reads behind them, keep their place
+		int closest = -1;
+		read_position closest_pos{};
+		int lowest = -1;
+		read_position lowest_pos{};
+		int k = 0;
+		for (auto i = d.jobs.iterate(); i.get() != nullptr && k < max_reorder; i.next(), ++k)
+		{
+			disk_io_job const* j = i.get();
+			if (j->action != disk_io_job::read) break;
+
+			// this read has waited long enough
+			if (now - j->issued >= m_max_read_wait) return k;
+
+			read_position const pos{j->storage.get(), j->piece, j->d.io.offset};
+			if (!(pos < d.head))
+			{
+				if (closest < 0 || pos < closest_pos)
+				{
+					closest = k;
+					closest_pos = pos;
+				}
+			}
+			else if (lowest < 0 || pos < lowest_pos)
+			{
+				lowest = k;
+				lowest_pos = pos;
+			}
+		}
+		if (closest >= 0) return closest;
+		if (lowest >= 0) return lowest;
+		return 0;
+	}
+
+	int device_job_queue::pick()
+	{
+		int const num_devices = int(m_devices.size());
+		int best = -1;
+		for (int k = 0; k < num_devices; ++k)
+		{
+			int const i = (m_cursor + k) % num_devices;
+			device_queue const& d = m_devices[std::size_t(i)];
+			if (d.jobs.empty()) continue;
+			if (m_limit > 0 && d.in_flight >= m_limit) continue;
+			if (best >= 0 && m_devices[std::size_t(best)].in_flight <= d.in_flight) continue;
+			best = i;
+			// no device can do better than this
+			if (d.in_flight == 0) break;
+		}
+		return best;
+	}
+
+	disk_io_job* device_job_queue::first()
+	{
+		int const i = pick();
+		if (i < 0) return nullptr;
+		device_queue const& d = m_devices[std::size_t(i)];
+		int const k = pick_job(d, clock_type::now());
+		auto it = d.jobs.iterate();
+		for (int n = 0; n < k; ++n) it.next();
+		return const_cast<disk_io_job*>(it.get());
+	}
+
+	bool device_job_queue::runnable()
+	{
+		if (m_size == 0) return false;
+		return pick() >= 0;
+	}
+
+	disk_io_job* device_job_queue::pop_front()
+	{
+		int const i = pick();
+		if (i < 0) return nullptr;
+		device_queue& d = m_devices[std::size_t(i)];
+		++d.in_flight;
+		--m_size;
+		m_cursor = (i + 1) % int(m_devices.size());
+
+		int const k = pick_job(d, clock_type::now());
+		if (k == 0)
+		{
+			disk_io_job* j = d.jobs.pop_front();
+			if (j->action == disk_io_job::read)
+				d.head = {j->storage.get(), j->piece, j->d.io.offset + j->d.io.buffer_size};
+			return j;
+		}
+
+		// take the k jobs in front of the picked one off the queue, and put
+		// them back once it's been removed
+		TORRENT_ASSERT(k < max_reorder);
+		disk_io_job* skipped[max_reorder];
+		for (int n = 0; n < k; ++n) skipped[n] = d.jobs.pop_front();
+		disk_io_job* j = d.jobs.pop_front();
+		for (int n = k - 1; n >= 0; --n) d.jobs.push_front(skipped[n]);
+
+		TORRENT_ASSERT(j->action == disk_io_job::read);
+		d.head = {j->storage.get(), j->piece, j->d.io.offset + j->d.io.buffer_size};
+		return j;
+	}
+
+	void device_job_queue::job_done(std::uint8_t const device)
+	{
+		TORRENT_ASSERT(device < m_devices.size());
+		TORRENT_ASSERT(m_devices[device].in_flight > 0);
+		--m_devices[device].in_flight;
+	}
+
+	int device_job_queue::in_flight(std::uint8_t const device) const
+	{
+		if (device >= m_devices.size()) return 0;
+		return m_devices[device].in_flight;
+	}
+}}
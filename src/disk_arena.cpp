@@ -0,0 +1,205 @@
+/*
+
+Copyright (c) 2017, Arvid Norberg
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions
+are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in
+      the documentation and/or other materials provided with the distribution.
+    * Neither the name of the author nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+
+#include "libtorrent/aux_/disk_arena.hpp"
+#include "libtorrent/allocator.hpp" // for page_aligned_allocator
+#include "libtorrent/assert.hpp"
+
+#include <limits>
+
+#if TORRENT_HAVE_MMAP
+#include <sys/mman.h>
+#endif
+
+namespace libtorrent { namespace aux {
+
+	disk_arena::~disk_arena()
+	{
+		if (m_base == nullptr) return;
+#if TORRENT_HAVE_MMAP
+		if (m_mapped)
+		{
+			::munmap(m_base, m_size);
+			return;
+		}
+#endif
+		page_aligned_allocator::free(m_base);
+	}
+
+	bool disk_arena::reserve(int const block_size, int const num_blocks)
+	{
+		TORRENT_ASSERT(m_base == nullptr);
+		TORRENT_ASSERT(block_size > 0);
+		if (num_blocks <= 0) return false;
+		if (std::uint64_t(num_blocks) * std::uint64_t(block_size)
+			> std::numeric_limits<std::size_t>::max())
+			return false;
+
+		std::size_t const size = std::size_t(num_blocks) * std::size_t(block_size);
+
+#if TORRENT_HAVE_MMAP
+		void* p = MAP_FAILED;
+#ifdef MAP_HUGETLB
+		// explicit huge pages have to be set up by the administrator. The
+		// mapping size has to be a multiple of the huge page size (2 MiB)
+		std::size_t const huge_page = 2 * 1024 * 1024;
+		std::size_t const huge_size = (size + huge_page - 1) & ~(huge_page - 1);
+		p = ::mmap(nullptr, huge_size, PROT_READ | PROT_WRITE
+			, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+		if (p != MAP_FAILED)
+		{
+			m_size = huge_size;
+			m_huge_pages = true;
+		}
+#endif
+		if (p == MAP_FAILED)
+		{
+			p = ::mmap(nullptr, size, PROT_READ | PROT_WRITE
+				, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+			if (p == MAP_FAILED) return false;
+			m_size = size;
+#ifdef MADV_HUGEPAGE
+			// ask for transparent huge pages instead
+			::madvise(p, size, MADV_HUGEPAGE);
+#endif
+		}
+		m_mapped = true;
+		m_base = static_cast<char*>(p);
+#else
+		if (size >= 0x30000000) return false;
+		m_base = page_aligned_allocator::malloc(int(size));
+		if (m_base == nullptr) return false;
+		m_size = size;
+#endif
+
+		m_block_size = block_size;
+		m_num_blocks = num_blocks;
+		m_next.reset(new std::atomic<std::uint32_t>[std::size_t(num_blocks)]);
+		for (int i = 0; i < num_blocks - 1; ++i)
+			m_next[std::size_t(i)].store(std::uint32_t(i + 2), std::memory_order_relaxed);
+		m_next[std::size_t(num_blocks - 1)].store(0, std::memory_order_relaxed);
+		m_head.store(1, std::memory_order_release);
+		return true;
+	}
+
+	char* disk_arena::allocate()
+	{
+		std::uint64_t head = m_head.load(std::memory_order_acquire);
+		for (;;)
+		{
+			std::uint32_t const idx = std::uint32_t(head);
+			if (idx == 0) return nullptr;
+			std::uint32_t const next = m_next[idx - 1].load(std::memory_order_relaxed);
+			std::uint64_t const new_head = (((head >> 32) + 1) << 32) | next;
+			if (m_head.compare_exchange_weak(head, new_head
+				, std::memory_order_acquire, std::memory_order_acquire))
+			{
+				return m_base + std::size_t(idx - 1) * std::size_t(m_block_size);
+			}
+		}
+	}
+
+	void disk_arena::free(char* const buf)
+	{
+		TORRENT_ASSERT(owns(buf));
+		TORRENT_ASSERT((buf - m_base) % m_block_size == 0);
+		std::uint32_t const idx = std::uint32_t((buf - m_base) / m_block_size) + 1;
+		std::uint64_t head = m_head.load(std::memory_order_relaxed);
+		std::uint64_t new_head;
+		do
+		{
+			m_next[idx - 1].store(std::uint32_t(head), std::memory_order_relaxed);
+			new_head = (((head >> 32) + 1) << 32) | idx;
+		} while (!m_head.compare_exchange_weak(head, new_head
+			, std::memory_order_release, std::memory_order_relaxed));
+	}
+
+	int disk_arena::allocate(span<char*> const bufs)
+	{
+		if (bufs.empty()) return 0;
+		std::uint64_t head = m_head.load(std::memory_order_acquire);
+		for (;;)
+		{
+			// walk the free list to find what will become the new head. If
+			// another thread pops any of these blocks in the meantime, the
+			// links we read may be stale, but then the tag in the head has
+			// changed too and the compare-and-swap fails
+			int n = 0;
+			std::uint32_t next = std::uint32_t(head);
+			while (next != 0 && n < int(bufs.size()))
+			{
+				bufs[std::size_t(n++)] = m_base + std::size_t(next - 1) * std::size_t(m_block_size);
+				next = m_next[next - 1].load(std::memory_order_relaxed);
+			}
+			if (n == 0) return 0;
+			std::uint64_t const new_head = (((head >> 32) + 1) << 32) | next;
+			if (m_head.compare_exchange_weak(head, new_head
+				, std::memory_order_acquire, std::memory_order_acquire))
+			{
+				return n;
+			}
+		}
+	}
+
+	void disk_arena::free(span<char* const> const bufs)
+	{
+		if (bufs.empty()) return;
+
+		auto index = [this](char const* buf)
+		{
+			TORRENT_ASSERT(owns(buf));
+			TORRENT_ASSERT((buf - m_base) % m_block_size == 0);
+			return std::uint32_t((buf - m_base) / m_block_size) + 1;
+		};
+
+		// link the blocks to each other first. They're not reachable by
+		// anyone else until they're pushed onto the list
+		std::uint32_t const first = index(bufs[0]);
+		std::uint32_t last = first;
+		for (std::size_t i = 1; i < bufs.size(); ++i)
+		{
+			std::uint32_t const idx = index(bufs[i]);
+			m_next[last - 1].store(idx, std::memory_order_relaxed);
+			last = idx;
+		}
+
+		std::uint64_t head = m_head.load(std::memory_order_relaxed);
+		std::uint64_t new_head;
+		do
+		{
+			m_next[last - 1].store(std::uint32_t(head), std::memory_order_relaxed);
+			new_head = (((head >> 32) + 1) << 32) | first;
+		} while (!m_head.compare_exchange_weak(head, new_head
+			, std::memory_order_release, std::memory_order_relaxed));
+	}
+}}
@@ -40,6 +40,10 @@ namespace libtorrent {
 		: m_allocator(&alloc), m_buf(buf), m_ref()
 	{}
 
+	disk_buffer_holder::disk_buffer_holder() noexcept
+		: m_allocator(nullptr), m_buf(nullptr), m_ref()
+	{}
+
 	disk_buffer_holder& disk_buffer_holder::operator=(disk_buffer_holder&& h) noexcept
 	{
 		disk_buffer_holder(std::move(h)).swap(*this);
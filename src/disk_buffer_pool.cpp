@@ -38,6 +38,7 @@ POSSIBILITY OF SUCH DAMAGE.
 #include "libtorrent/io_service.hpp"
 #include "libtorrent/disk_observer.hpp"
 #include "libtorrent/platform_util.hpp" // for total_physical_ram
+#include "libtorrent/aux_/alloca.hpp"
 
 #include "libtorrent/aux_/disable_warnings_push.hpp"
 
@@ -81,6 +82,9 @@ namespace libtorrent {
 		, m_using_pool_allocator(false)
 		, m_want_pool_allocator(false)
 		, m_pool(block_size, 32)
+		, m_using_arena(false)
+		, m_want_arena(false)
+		, m_trim_threshold(0)
 #endif
 	{
 #if TORRENT_USE_ASSERTS
@@ -148,6 +152,8 @@ namespace libtorrent {
 #elif defined TORRENT_DISABLE_POOL_ALLOCATOR
 		return true;
 #else
+		if (m_arena.owns(buffer))
+			return true;
 		if (m_using_pool_allocator)
 			return m_pool.is_from(buffer);
 		else
@@ -164,6 +170,10 @@ namespace libtorrent {
 
 	char* disk_buffer_pool::allocate_buffer(char const* category)
 	{
+#ifndef TORRENT_DISABLE_POOL_ALLOCATOR
+		char* const ret = allocate_arena_buffer();
+		if (ret != nullptr) return ret;
+#endif
 		std::unique_lock<std::mutex> l(m_pool_mutex);
 		return allocate_buffer_impl(l, category);
 	}
@@ -178,6 +188,22 @@ namespace libtorrent {
 	char* disk_buffer_pool::allocate_buffer(bool& exceeded
 		, std::shared_ptr<disk_observer> o, char const* category)
 	{
+#ifndef TORRENT_DISABLE_POOL_ALLOCATOR
+		char* const buf = allocate_arena_buffer();
+		if (buf != nullptr)
+		{
+			if (m_exceeded_max_size)
+			{
+				std::unique_lock<std::mutex> l(m_pool_mutex);
+				if (m_exceeded_max_size)
+				{
+					exceeded = true;
+					if (o) m_observers.push_back(o);
+				}
+			}
+			return buf;
+		}
+#endif
 		std::unique_lock<std::mutex> l(m_pool_mutex);
 		char* ret = allocate_buffer_impl(l, category);
 		if (m_exceeded_max_size)
@@ -192,8 +218,26 @@ namespace libtorrent {
 // fills in the iovec array with the buffers
 	int disk_buffer_pool::allocate_iovec(span<iovec_t> iov)
 	{
+		std::size_t num_allocated = 0;
+#if !defined TORRENT_DISABLE_POOL_ALLOCATOR && !TORRENT_USE_INVARIANT_CHECKS
+		if (m_using_arena)
+		{
+			// take as many blocks as we can from the arena in one go, and only
+			// fall back to the mutex for whatever is left
+			TORRENT_ALLOCA(bufs, char*, iov.size());
+			num_allocated = std::size_t(m_arena.allocate(bufs));
+			for (std::size_t i = 0; i < num_allocated; ++i)
+			{
+				iov[i].iov_base = bufs[i];
+				iov[i].iov_len = std::size_t(block_size());
+			}
+			if (num_allocated > 0) arena_blocks_allocated(int(num_allocated));
+			if (num_allocated == iov.size()) return 0;
+		}
+#endif
+
 		std::unique_lock<std::mutex> l(m_pool_mutex);
-		for (auto& i : iov)
+		for (auto& i : iov.subspan(num_allocated))
 		{
 			i.iov_base = allocate_buffer_impl(l, "pending read");
 			i.iov_len = std::size_t(block_size());
@@ -218,16 +262,10 @@ namespace libtorrent {
 
 	void disk_buffer_pool::free_iovec(span<iovec_t const> iov)
 	{
-		// TODO: perhaps we should sort the buffers here?
-		std::unique_lock<std::mutex> l(m_pool_mutex);
-		for (auto i : iov)
-		{
-			char* buf = static_cast<char*>(i.iov_base);
-			TORRENT_ASSERT(is_disk_buffer(buf, l));
-			free_buffer_impl(buf, l);
-			remove_buffer_in_use(buf);
-		}
-		check_buffer_level(l);
+		TORRENT_ALLOCA(bufs, char*, iov.size());
+		for (std::size_t i = 0; i < iov.size(); ++i)
+			bufs[i] = static_cast<char*>(iov[i].iov_base);
+		free_multiple_buffers(bufs);
 	}
 
 	char* disk_buffer_pool::allocate_buffer_impl(std::unique_lock<std::mutex>& l
@@ -244,7 +282,13 @@ namespace libtorrent {
 		ret = page_aligned_allocator::malloc(m_block_size);
 
 #else
-		if (m_using_pool_allocator)
+		if (m_using_arena)
+		{
+			// once the arena is exhausted, fall back to regular allocations
+			ret = m_arena.allocate();
+			if (ret == nullptr) ret = page_aligned_allocator::malloc(m_block_size);
+		}
+		else if (m_using_pool_allocator)
 		{
 			int const effective_block_size
 				= m_in_use >= m_max_use
@@ -282,8 +326,7 @@ namespace libtorrent {
 		}
 #endif
 
-		if (m_in_use >= m_low_watermark + (m_max_use - m_low_watermark)
-			/ 2 && !m_exceeded_max_size)
+		if (m_in_use >= trim_threshold() && !m_exceeded_max_size)
 		{
 			m_exceeded_max_size = true;
 			m_trigger_cache_trim();
@@ -295,22 +338,59 @@ namespace libtorrent {
 
 	void disk_buffer_pool::free_multiple_buffers(span<char*> bufvec)
 	{
+		if (bufvec.empty()) return;
+
 		// sort the pointers in order to maximize cache hits
 		std::sort(bufvec.begin(), bufvec.end());
 
+		// the range of bufvec that was returned to the arena
+		std::size_t arena_begin = 0;
+		std::size_t arena_end = 0;
+#if !defined TORRENT_DISABLE_POOL_ALLOCATOR && !TORRENT_USE_INVARIANT_CHECKS
+		// the arena is contiguous, so once sorted, the buffers belonging to it
+		// form a single range. Those are all pushed back onto its free list in
+		// one operation, without the mutex
+		auto const owned = [this](char const* b) { return m_arena.owns(b); };
+		char** const first = std::find_if(bufvec.begin(), bufvec.end(), owned);
+		char** const last = std::find_if_not(first, bufvec.end(), owned);
+		arena_begin = std::size_t(first - bufvec.begin());
+		arena_end = std::size_t(last - bufvec.begin());
+		if (arena_end > arena_begin)
+		{
+			int const num = int(arena_end - arena_begin);
+			m_arena.free(bufvec.subspan(arena_begin, arena_end - arena_begin));
+			int const in_use = (m_in_use -= num);
+			if (arena_begin == 0 && arena_end == bufvec.size()
+				&& in_use != 0 && !m_exceeded_max_size)
+				return;
+		}
+#endif
+
 		std::unique_lock<std::mutex> l(m_pool_mutex);
-		for (char* buf : bufvec)
+		for (std::size_t i = 0; i < bufvec.size(); ++i)
 		{
+			if (i == arena_begin && arena_end > arena_begin)
+			{
+				i = arena_end - 1;
+				continue;
+			}
+			char* const buf = bufvec[i];
 			TORRENT_ASSERT(is_disk_buffer(buf, l));
 			free_buffer_impl(buf, l);
 			remove_buffer_in_use(buf);
 		}
 
+#ifndef TORRENT_DISABLE_POOL_ALLOCATOR
+		maybe_switch_allocator(l);
+#endif
 		check_buffer_level(l);
 	}
 
 	void disk_buffer_pool::free_buffer(char* buf)
 	{
+#ifndef TORRENT_DISABLE_POOL_ALLOCATOR
+		if (free_arena_buffer(buf)) return;
+#endif
 		std::unique_lock<std::mutex> l(m_pool_mutex);
 		TORRENT_ASSERT(is_disk_buffer(buf, l));
 		free_buffer_impl(buf, l);
@@ -329,9 +409,13 @@ namespace libtorrent {
 		// if the chunk size is set to 1, there's no point in creating a pool
 		m_want_pool_allocator = sett.get_bool(settings_pack::use_disk_cache_pool)
 			&& (m_cache_buffer_chunk_size != 1);
-		// if there are no allocated blocks, it's OK to switch allocator
-		if (m_in_use == 0)
-			m_using_pool_allocator = m_want_pool_allocator;
+#ifdef TORRENT_DEBUG_BUFFERS
+		// debug buffers are surrounded by guard pages, which the arena can't
+		// provide
+		m_want_arena = false;
+#else
+		m_want_arena = sett.get_bool(settings_pack::disk_cache_arena);
+#endif
 #endif
 
 		int const cache_size = sett.get_int(settings_pack::cache_size);
@@ -397,6 +481,13 @@ namespace libtorrent {
 		if (m_cache_buffer_chunk_size > m_max_use)
 			m_cache_buffer_chunk_size = m_max_use;
 
+#ifndef TORRENT_DISABLE_POOL_ALLOCATOR
+		m_trim_threshold = trim_threshold();
+		// if there are no allocated blocks, it's OK to switch allocator. The
+		// arena is sized by the cache size, so this has to come last
+		maybe_switch_allocator(l);
+#endif
+
 #if TORRENT_USE_ASSERTS
 		m_settings_set = true;
 #endif
@@ -425,7 +516,9 @@ namespace libtorrent {
 		page_aligned_allocator::free(buf);
 
 #else
-		if (m_using_pool_allocator)
+		if (m_arena.owns(buf))
+			m_arena.free(buf);
+		else if (m_using_pool_allocator)
 			m_pool.free(buf);
 		else
 			page_aligned_allocator::free(buf);
@@ -435,14 +528,87 @@ namespace libtorrent {
 
 #ifndef TORRENT_DISABLE_POOL_ALLOCATOR
 		// should we switch which allocator to use?
-		if (m_in_use == 0 && m_want_pool_allocator != m_using_pool_allocator)
+		maybe_switch_allocator(l);
+#endif
+	}
+
+#ifndef TORRENT_DISABLE_POOL_ALLOCATOR
+	char* disk_buffer_pool::allocate_arena_buffer()
+	{
+#if TORRENT_USE_INVARIANT_CHECKS
+		// m_buffers_in_use can only be maintained under the mutex
+		return nullptr;
+#else
+		if (!m_using_arena) return nullptr;
+		TORRENT_ASSERT(m_magic == 0x1337);
+		char* const ret = m_arena.allocate();
+		if (ret == nullptr) return nullptr;
+		arena_blocks_allocated(1);
+		return ret;
+#endif
+	}
+
+	void disk_buffer_pool::arena_blocks_allocated(int const num)
+	{
+		int const in_use = (m_in_use += num);
+		if (in_use >= m_trim_threshold && !m_exceeded_max_size)
 		{
-			m_pool.release_memory();
-			m_using_pool_allocator = m_want_pool_allocator;
+			std::unique_lock<std::mutex> l(m_pool_mutex);
+			if (!m_exceeded_max_size)
+			{
+				m_exceeded_max_size = true;
+				m_trigger_cache_trim();
+			}
+		}
+	}
+
+	bool disk_buffer_pool::free_arena_buffer(char* const buf)
+	{
+#if TORRENT_USE_INVARIANT_CHECKS
+		TORRENT_UNUSED(buf);
+		return false;
+#else
+		// the arena is only reserved while no buffers are in use, so it can't
+		// change under us while buf is outstanding
+		if (!m_arena.owns(buf)) return false;
+		TORRENT_ASSERT(m_magic == 0x1337);
+		m_arena.free(buf);
+
+		int const in_use = --m_in_use;
+		if (in_use == 0 || m_exceeded_max_size)
+		{
+			std::unique_lock<std::mutex> l(m_pool_mutex);
+			maybe_switch_allocator(l);
+			check_buffer_level(l);
 		}
+		return true;
 #endif
 	}
 
+	void disk_buffer_pool::maybe_switch_allocator(std::unique_lock<std::mutex>& l)
+	{
+		TORRENT_ASSERT(l.owns_lock());
+		TORRENT_UNUSED(l);
+		if (m_in_use != 0) return;
+
+		if (m_want_arena != m_using_arena)
+		{
+			// the arena is reserved the first time it's enabled. If that fails,
+			// we keep using the other allocators
+			if (m_want_arena && m_arena.num_blocks() == 0)
+				m_arena.reserve(m_block_size, m_max_use);
+			m_using_arena = m_want_arena && m_arena.num_blocks() > 0;
+		}
+
+		bool const want_pool = m_want_pool_allocator && !m_using_arena;
+		if (want_pool != m_using_pool_allocator)
+		{
+			m_pool.release_memory();
+			m_using_pool_allocator = want_pool;
+		}
+	}
+#endif
+
 	void disk_buffer_pool::release_memory()
 	{
 		TORRENT_ASSERT(m_magic == 0x1337);
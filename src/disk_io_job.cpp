@@ -95,6 +95,13 @@ namespace libtorrent {
 				h(m_job.piece);
 			}
 
+			void operator()(disk_io_job::block_hash_handler& h) const
+			{
+				if (!h) return;
+				h(m_job.piece, std::move(boost::get<std::vector<sha1_hash>>(m_job.argument))
+					, m_job.error);
+			}
+
 		private:
 			disk_io_job& m_job;
 		};
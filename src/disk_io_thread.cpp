@@ -52,8 +52,16 @@ POSSIBILITY OF SUCH DAMAGE.
 #include "libtorrent/units.hpp"
 #include "libtorrent/hasher.hpp"
 #include "libtorrent/aux_/array.hpp"
+#include "libtorrent/aux_/io_uring.hpp"
+#include "libtorrent/aux_/trace.hpp"
+#include "libtorrent/aux_/path.hpp"
+#include "libtorrent/aux_/l2_cache.hpp"
 
 #include <functional>
+#include <utility> // for pair
+#include <limits>
+#include <algorithm>
+#include <cinttypes> // for PRId64 et.al.
 
 #include <boost/variant/get.hpp>
 
@@ -134,6 +142,38 @@ namespace libtorrent {
 	// queue and try again later
 	constexpr status_t retry_job = static_cast<status_t>(201);
 
+	// returns the index of the bucket in the disk job latency histograms a
+	// duration falls in. The buckets are powers of two microseconds
+	int latency_bucket(time_duration const d)
+	{
+		std::int64_t us = total_microseconds(d) >> 5;
+		int bucket = 0;
+		while (us > 0 && bucket < 15)
+		{
+			us >>= 1;
+			++bucket;
+		}
+		return bucket;
+	}
+
+	// the first counter of the queue and execution time histograms for the
+	// kind of the job
+	std::pair<int, int> latency_histograms(disk_io_job const* j)
+	{
+		switch (j->action)
+		{
+			case disk_io_job::read:
+				return {counters::disk_read_queue_time5, counters::disk_read_exec_time5};
+			case disk_io_job::write:
+				return {counters::disk_write_queue_time5, counters::disk_write_exec_time5};
+			case disk_io_job::hash:
+			case disk_io_job::hash_blocks:
+				return {counters::disk_hash_queue_time5, counters::disk_hash_exec_time5};
+			default:
+				return {counters::disk_other_queue_time5, counters::disk_other_exec_time5};
+		}
+	}
+
 
 	struct piece_refcount_holder
 	{
@@ -195,11 +235,13 @@ namespace libtorrent {
 		, m_hash_io_jobs(*this)
 		, m_hash_threads(m_hash_io_jobs, ios)
 		, m_disk_cache(block_size, ios, std::bind(&disk_io_thread::trigger_cache_trim, this))
+		, m_l2_cache(m_disk_cache, cnt, block_size)
 		, m_stats_counters(cnt)
 		, m_ios(ios)
 	{
 		ADD_OUTSTANDING_ASYNC("disk_io_thread::work");
 		m_disk_cache.set_settings(m_settings);
+		m_disk_cache.set_l2_cache(&m_l2_cache);
 	}
 
 	storage_interface* disk_io_thread::get_torrent(storage_index_t const storage)
@@ -219,20 +261,48 @@ namespace libtorrent {
 		storage->set_owner(owner);
 
 		TORRENT_ASSERT(storage);
+		storage->set_device(device_index(p.path));
+		storage->set_info(p.info);
+		storage_index_t idx;
 		if (m_free_slots.empty())
 		{
-			storage_index_t const idx = m_torrents.end_index();
+			idx = m_torrents.end_index();
 			m_torrents.emplace_back(std::move(storage));
 			m_torrents.back()->set_storage_index(idx);
-			return storage_holder(idx, *this);
 		}
 		else
 		{
-			storage_index_t const idx = m_free_slots.back();
+			idx = m_free_slots.back();
 			m_free_slots.pop_back();
 			(m_torrents[idx] = std::move(storage))->set_storage_index(idx);
-			return storage_holder(idx, *this);
 		}
+
+		if (m_trace_file != nullptr)
+		{
+			// the geometry of the storage, for the replay tool to recreate it
+			file_storage const& fs = m_torrents[idx]->files();
+			std::fprintf(m_trace_file, "%" PRId64 " S %d %d %d %" PRId64 "\n"
+				, total_microseconds(clock_type::now() - m_trace_start)
+				, static_cast<int>(idx), fs.piece_length(), fs.num_pieces()
+				, fs.total_size());
+		}
+		return storage_holder(idx, *this);
+	}
+
+	// each line of the trace file is one request:
+	//
+	//   <microseconds> <op> <storage> <piece> <offset> <size>
+	//
+	// where op is R (read), W (write), H (hash) or C (clear piece). Storages
+	// are introduced by a line with the S op, followed by the storage index,
+	// piece length, number of pieces and total size
+	void disk_io_thread::trace_request(char const op, storage_index_t const storage
+		, piece_index_t const piece, int const offset, int const size)
+	{
+		if (m_trace_file == nullptr) return;
+		std::fprintf(m_trace_file, "%" PRId64 " %c %d %d %d %d\n"
+			, total_microseconds(clock_type::now() - m_trace_start), op
+			, static_cast<int>(storage), static_cast<int>(piece), offset, size);
 	}
 
 	void disk_io_thread::remove_torrent(storage_index_t const idx)
@@ -241,6 +311,8 @@ namespace libtorrent {
 		if (pos->dec_refcount() == 0)
 		{
 			pos.reset();
+			// the index will be reused by another torrent
+			m_l2_cache.invalidate(idx);
 			m_free_slots.push_back(idx);
 		}
 	}
@@ -255,6 +327,8 @@ namespace libtorrent {
 		TORRENT_ASSERT(pieces.first == pieces.second);
 #endif
 
+		if (m_trace_file != nullptr) std::fclose(m_trace_file);
+
 		TORRENT_ASSERT(m_magic == 0x1337);
 #if TORRENT_USE_ASSERTS
 		m_magic = 0xdead;
@@ -301,14 +375,129 @@ namespace libtorrent {
 		TORRENT_ASSERT(m_magic == 0x1337);
 		std::unique_lock<std::mutex> l(m_cache_mutex);
 		apply_pack(pack, m_settings);
+		m_published_settings.publish(m_settings);
 		m_disk_cache.set_settings(m_settings);
 		m_file_pool.resize(m_settings.get_int(settings_pack::file_pool_size));
 
 		int const num_threads = m_settings.get_int(settings_pack::aio_threads);
-		// add one hasher thread for every three generic threads
-		int const num_hash_threads = num_threads / 4;
-		m_generic_threads.set_max_threads(num_threads - num_hash_threads);
+		int const num_hash_threads = aux::num_hash_threads(m_settings);
+		if (m_settings.get_int(settings_pack::hash_threads) == 0)
+		{
+			// add one hasher thread for every three generic threads
+			m_generic_threads.set_max_threads(num_threads - num_hash_threads);
+		}
+		else
+		{
+			m_generic_threads.set_max_threads(num_threads);
+		}
 		m_hash_threads.set_max_threads(num_hash_threads);
+
+		bool const auto_scale = m_settings.get_bool(settings_pack::auto_scale_aio_threads);
+		int const min_threads = m_settings.get_int(settings_pack::min_aio_threads);
+		m_generic_threads.set_auto_scale(auto_scale, min_threads);
+		m_hash_threads.set_auto_scale(auto_scale, min_threads);
+		m_deletions.set_max_threads(m_settings.get_int(settings_pack::deletion_threads));
+		l.unlock();
+
+		std::string const& trace_path = m_settings.get_str(settings_pack::disk_io_trace_file);
+		if (trace_path != m_trace_path)
+		{
+			if (m_trace_file != nullptr) std::fclose(m_trace_file);
+			m_trace_file = nullptr;
+			m_trace_path = trace_path;
+			if (!m_trace_path.empty())
+			{
+				m_trace_file = std::fopen(m_trace_path.c_str(), "w");
+				m_trace_start = clock_type::now();
+				// storages added before tracing started are not known to the
+				// replay, record them now
+				for (auto const& st : m_torrents)
+				{
+					if (!st || m_trace_file == nullptr) continue;
+					file_storage const& fs = st->files();
+					std::fprintf(m_trace_file, "0 S %d %d %d %" PRId64 "\n"
+						, static_cast<int>(st->storage_index()), fs.piece_length()
+						, fs.num_pieces(), fs.total_size());
+				}
+			}
+		}
+
+		error_code ec;
+		m_l2_cache.set_settings(m_settings.get_str(settings_pack::l2_cache_path)
+			, m_settings.get_int(settings_pack::l2_cache_size), ec);
+		if (ec)
+		{
+			DLOG("failed to open L2 cache \"%s\": %s\n"
+				, m_settings.get_str(settings_pack::l2_cache_path).c_str()
+				, ec.message().c_str());
+		}
+
+		update_queue_settings();
+	}
+
+	std::uint8_t disk_io_thread::device_index(std::string const& path)
+	{
+		// the save path of a torrent typically doesn't exist until its first
+		// file is created. Use the device of the closest directory that does
+		std::string p = complete(path);
+		file_status s;
+		error_code ec;
+		for (;;)
+		{
+			stat_file(p, &s, ec);
+			if (!ec) break;
+			if (!has_parent_path(p)) return 0;
+			std::string parent = parent_path(p);
+			if (parent.empty() || parent == p) return 0;
+			p = std::move(parent);
+		}
+
+		std::unique_lock<std::mutex> l(m_device_mutex);
+		auto const i = std::find(m_device_ids.begin(), m_device_ids.end(), s.device);
+		if (i != m_device_ids.end())
+			return std::uint8_t(i - m_device_ids.begin());
+
+		// if there are this many distinct devices, the last index is shared
+		// by all the ones after it
+		if (m_device_ids.size() > std::numeric_limits<std::uint8_t>::max())
+			return std::numeric_limits<std::uint8_t>::max();
+
+		m_device_ids.push_back(s.device);
+		std::uint8_t const ret = std::uint8_t(m_device_ids.size() - 1);
+		l.unlock();
+
+		// the second device turns on the per device limits
+		if (ret == 1) update_queue_settings();
+		return ret;
+	}
+
+	void disk_io_thread::update_queue_settings()
+	{
+		std::size_t num_devices;
+		{
+			std::unique_lock<std::mutex> l(m_device_mutex);
+			num_devices = m_device_ids.size();
+		}
+
+		int const setting = m_settings.get_int(settings_pack::max_disk_jobs_per_device);
+		auto limit_for = [=](disk_io_thread_pool const& pool)
+		{
+			// with all storages on a single device, there's nothing to balance
+			if (setting < 0 || num_devices < 2) return 0;
+			if (setting > 0) return setting;
+			int const threads = pool.max_threads();
+			return threads > 1 ? threads - 1 : 0;
+		};
+
+		std::unique_lock<std::mutex> l(m_job_mutex);
+		m_generic_io_jobs.m_queued_jobs.set_device_limit(limit_for(m_generic_threads));
+		m_hash_io_jobs.m_queued_jobs.set_device_limit(limit_for(m_hash_threads));
+		m_generic_io_jobs.m_queued_jobs.set_read_reorder(milliseconds(
+			m_settings.get_int(settings_pack::disk_read_elevator_wait)));
+
+		// a higher limit may let waiting threads pick up jobs
+		m_generic_io_jobs.m_job_cond.notify_all();
+		m_hash_io_jobs.m_job_cond.notify_all();
 	}
 
 	// flush all blocks that are below p->hash.offset, since we've
@@ -379,7 +568,7 @@ namespace libtorrent {
 		// to download whole stripes at a time. This is why this setting is turned
 		// off by default, flushing only one piece at a time
 
-		if (cont_pieces <= 1 || m_settings.get_bool(settings_pack::allow_partial_disk_writes))
+		if (cont_pieces <= 1 || cached_settings().allow_partial_disk_writes)
 		{
 			DLOG("try_flush_hashed: (%d) blocks_in_piece: %d end: %d\n"
 				, int(p->piece), int(p->blocks_in_piece), end);
@@ -429,7 +618,7 @@ namespace libtorrent {
 			if (pe->num_dirty == pe->blocks_in_piece
 				&& (pe->hashing_done
 					|| hash_cursor == pe->blocks_in_piece
-					|| m_settings.get_bool(settings_pack::disable_hash_checks)))
+					|| cached_settings().disable_hash_checks))
 			{
 				DLOG("[%d hash-done] ", static_cast<int>(i));
 				continue;
@@ -659,7 +848,7 @@ namespace libtorrent {
 		DLOG("]\n");
 #endif
 
-		std::uint32_t const file_flags = m_settings.get_bool(settings_pack::coalesce_writes)
+		std::uint32_t const file_flags = cached_settings().coalesce_writes
 			? file::coalesce_buffers : static_cast<file::open_mode_t>(0);
 
 		// issue the actual write operation
@@ -802,6 +991,175 @@ namespace libtorrent {
 		return iov_len;
 	}
 
+	int disk_io_thread::flush_pieces_sorted(
+		std::vector<std::pair<storage_interface*, piece_index_t>>& pieces
+		, bool const skip_hashing, int const readback_reason
+		, jobqueue_t& completed_jobs, std::unique_lock<std::mutex>& l)
+	{
+		TORRENT_ASSERT(l.owns_lock());
+
+		// sort by storage, then piece, so that pieces adjacent on disk end up
+		// next to each other
+		std::sort(pieces.begin(), pieces.end()
+			, [](std::pair<storage_interface*, piece_index_t> const& lhs
+				, std::pair<storage_interface*, piece_index_t> const& rhs)
+			{
+				if (lhs.first != rhs.first)
+					return std::less<storage_interface*>()(lhs.first, rhs.first);
+				return lhs.second < rhs.second;
+			});
+		pieces.erase(std::unique(pieces.begin(), pieces.end()), pieces.end());
+
+		auto const flushable = [skip_hashing](cached_piece_entry const* pe)
+		{
+			return pe != nullptr
+				&& pe->cache_state == cached_piece_entry::write_lru
+				&& pe->num_dirty > 0
+				&& !(skip_hashing && pe->hashing);
+		};
+
+		// the max number of blocks in a single merged write
+		int const max_blocks = 1024;
+
+		int flushed = 0;
+		std::size_t i = 0;
+		while (i < pieces.size())
+		{
+			storage_interface* const st = pieces[i].first;
+			piece_index_t const run_start = pieces[i].second;
+			cached_piece_entry* const first = m_disk_cache.find_piece(st, run_start);
+			if (!flushable(first))
+			{
+				++i;
+				continue;
+			}
+
+			// block indices of all pieces in the run are relative to the first
+			// piece. Only the last piece in the torrent may be smaller than
+			// this, and it can only be last in a run
+			int const stride = first->blocks_in_piece;
+			std::size_t const max_pieces = std::size_t(std::max(1, max_blocks / stride));
+
+			// extend the run over the following adjacent pieces
+			std::size_t end = i + 1;
+			while (end < pieces.size()
+				&& end - i < max_pieces
+				&& pieces[end].first == st
+				&& static_cast<int>(pieces[end].second)
+					== static_cast<int>(run_start) + int(end - i))
+				++end;
+
+			int const run_len = int(end - i);
+			TORRENT_ALLOCA(iov, iovec_t, run_len * stride);
+			TORRENT_ALLOCA(flushing, int, run_len * stride);
+			TORRENT_ALLOCA(run, cached_piece_entry*, run_len);
+			TORRENT_ALLOCA(iovec_offset, int, run_len + 1);
+
+			int iov_len = 0;
+			for (int k = 0; k < run_len; ++k)
+			{
+				iovec_offset[k] = iov_len;
+				cached_piece_entry* pe = k == 0 ? first
+					: m_disk_cache.find_piece(st, pieces[i + std::size_t(k)].second);
+				if (!flushable(pe))
+				{
+					run[k] = nullptr;
+					continue;
+				}
+				run[k] = pe;
+#if TORRENT_USE_ASSERTS
+				pe->piece_log.push_back(piece_log_t(piece_log_t::flushing, -1));
+#endif
+				mark_readback(pe, readback_reason);
+				++pe->piece_refcount;
+				iov_len += build_iovec(pe, 0, pe->blocks_in_piece
+					, iov.subspan(iov_len), flushing.subspan(iov_len), k * stride);
+			}
+			iovec_offset[run_len] = iov_len;
+
+			if (iov_len > 0)
+			{
+				storage_error error;
+				{
+					// unlock while we're performing the actual disk I/O
+					// then lock again
+					auto unlock = scoped_unlock(l);
+					flush_iovec(first, iov, flushing, iov_len, error);
+				}
+
+				for (int k = 0; k < run_len; ++k)
+				{
+					if (run[k] == nullptr) continue;
+					iovec_flushed(run[k], flushing.subspan(iovec_offset[k]).data()
+						, iovec_offset[k + 1] - iovec_offset[k], k * stride
+						, error, completed_jobs);
+				}
+				flushed += iov_len;
+			}
+
+			for (int k = 0; k < run_len; ++k)
+			{
+				if (run[k] == nullptr) continue;
+				TORRENT_PIECE_ASSERT(run[k]->piece_refcount > 0, run[k]);
+				--run[k]->piece_refcount;
+				m_disk_cache.maybe_free_piece(run[k]);
+			}
+
+			i = end;
+		}
+
+		if (flushed > 0)
+		{
+			// if the cache is under high pressure, we need to evict
+			// the blocks we just flushed to make room for more write pieces
+			int const evict = m_disk_cache.num_to_evict(0);
+			if (evict > 0) m_disk_cache.try_evict_blocks(evict);
+		}
+
+		return flushed;
+	}
+
+	namespace {
+
+	// the number of dirty blocks of pe that haven't been hashed yet. Flushing
+	// any of these means they'll have to be read back from disk to hash the
+	// piece
+	int num_unhashed_dirty(cached_piece_entry const* pe, int const block_size)
+	{
+		if (pe->hashing_done || pe->num_dirty == 0) return 0;
+		int const cursor = pe->hash == nullptr ? 0
+			: (pe->hash->offset + block_size - 1) / block_size;
+		int ret = 0;
+		for (int i = cursor; i < int(pe->blocks_in_piece); ++i)
+			if (pe->blocks[i].dirty) ++ret;
+		return ret;
+	}
+
+	}
+
+	void disk_io_thread::mark_readback(cached_piece_entry* pe, int const reason)
+	{
+		if (pe->need_readback) return;
+		if (num_unhashed_dirty(pe, m_disk_cache.block_size()) == 0) return;
+		pe->need_readback = 1;
+		pe->readback_reason = static_cast<std::uint64_t>(reason) & 3;
+	}
+
+	bool disk_io_thread::retain_unhashed(cached_piece_entry const* pe
+		, int& retained) const
+	{
+		// once a piece needs read-back, there's no point in holding on to it
+		if (pe->need_readback) return false;
+		if (cached_settings().disable_hash_checks) return false;
+		int const unhashed = num_unhashed_dirty(pe, m_disk_cache.block_size());
+		if (unhashed == 0) return false;
+		if (retained + unhashed
+			> cached_settings().max_retained_unhashed_blocks)
+			return false;
+		retained += unhashed;
+		return true;
+	}
+
 	void disk_io_thread::fail_jobs(storage_error const& e, jobqueue_t& jobs_)
 	{
 		jobqueue_t jobs;
@@ -838,6 +1196,7 @@ namespace libtorrent {
 		else if ((flags & flush_write_cache) && pe->num_dirty > 0)
 		{
 			// issue write commands
+			mark_readback(pe, cached_piece_entry::readback_flush);
 			flush_range(pe, 0, INT_MAX, completed_jobs, l);
 
 			// if we're also flushing the read cache, this piece
@@ -868,6 +1227,18 @@ namespace libtorrent {
 				piece_index.push_back(p->piece);
 			}
 
+			if ((flags & flush_write_cache) && !(flags & flush_delete_cache))
+			{
+				// write out all dirty blocks in storage order first, merging
+				// adjacent pieces
+				std::vector<std::pair<storage_interface*, piece_index_t>> dirty;
+				dirty.reserve(piece_index.size());
+				for (auto idx : piece_index)
+					dirty.emplace_back(storage, idx);
+				flush_pieces_sorted(dirty, false, cached_piece_entry::readback_flush
+					, completed_jobs, l);
+			}
+
 			for (auto idx : piece_index)
 			{
 				cached_piece_entry* pe = m_disk_cache.find_piece(storage, idx);
@@ -967,31 +1338,28 @@ namespace libtorrent {
 
 		if (num == 0 || m_stats_counters[counters::num_writing_threads] > 0) return;
 
-		// if we still need to flush blocks, start over and flush
-		// everything in LRU order (degrade to lru cache eviction)
-		for (auto const& p : pieces)
+		// if we still need to flush blocks, start over and flush everything
+		// (degrade to lru cache eviction). Pieces being hashed by another
+		// thread are left alone. The pieces are written in storage order,
+		// merging adjacent ones, rather than in LRU order, to not seek back
+		// and forth. Out of order blocks that haven't been hashed yet are
+		// kept for the most recently written pieces, within the
+		// max_retained_unhashed_blocks budget, since flushing them would
+		// cause them to be read back once the piece completes
+		std::vector<std::pair<storage_interface*, piece_index_t>> dirty;
+		dirty.reserve(pieces.size());
+		int retained = 0;
+		for (auto i = pieces.rbegin(); i != pieces.rend(); ++i)
 		{
-			cached_piece_entry* pe = m_disk_cache.find_piece(p.first, p.second);
+			cached_piece_entry* pe = m_disk_cache.find_piece(i->first, i->second);
 			if (pe == nullptr) continue;
-			if (pe->num_dirty == 0) continue;
-
-			// another thread may flush this piece while we're looping and
-			// evict it into a read piece and then also evict it to ghost
-			if (pe->cache_state != cached_piece_entry::write_lru) continue;
-
-			// don't flush blocks that are being hashed by another thread
-			if (pe->num_dirty == 0 || pe->hashing) continue;
-
-#if TORRENT_USE_ASSERTS
-			pe->piece_log.push_back(piece_log_t(piece_log_t::try_flush_write_blocks2, -1));
-#endif
-			++pe->piece_refcount;
-
-			num -= flush_range(pe, 0, INT_MAX, completed_jobs, l);
-			--pe->piece_refcount;
-
-			m_disk_cache.maybe_free_piece(pe);
+			if (retain_unhashed(pe, retained)) continue;
+			dirty.push_back(*i);
 		}
+		flush_pieces_sorted(dirty, true, cached_piece_entry::readback_cache_pressure
+			, completed_jobs, l);
+		if (retained > 0)
+			DLOG("try_flush_write_blocks: retained %d unhashed blocks\n", retained);
 	}
 
 	void disk_io_thread::flush_expired_write_blocks(jobqueue_t& completed_jobs
@@ -1000,7 +1368,7 @@ namespace libtorrent {
 		DLOG("flush_expired_write_blocks\n");
 
 		time_point now = aux::time_now();
-		time_duration expiration_limit = seconds(m_settings.get_int(settings_pack::cache_expiry));
+		time_duration expiration_limit = seconds(cached_settings().cache_expiry);
 
 #if TORRENT_USE_ASSERTS
 		time_point timeout = min_time();
@@ -1033,9 +1401,21 @@ namespace libtorrent {
 			if (num_flush == 200) break;
 		}
 
+		// the expired pieces are in LRU order. Retain the unhashed blocks of
+		// the most recently written ones, like try_flush_write_blocks() does
+		std::vector<std::pair<storage_interface*, piece_index_t>> dirty;
+		dirty.reserve(std::size_t(num_flush));
+		int retained = 0;
+		for (int i = num_flush - 1; i >= 0; --i)
+		{
+			if (retain_unhashed(to_flush[i], retained)) continue;
+			dirty.emplace_back(to_flush[i]->storage.get(), to_flush[i]->piece);
+		}
+		flush_pieces_sorted(dirty, false, cached_piece_entry::readback_expired
+			, completed_jobs, l);
+
 		for (int i = 0; i < num_flush; ++i)
 		{
-			flush_range(to_flush[i], 0, INT_MAX, completed_jobs, l);
 			TORRENT_ASSERT(to_flush[i]->piece_refcount > 0);
 			--to_flush[i]->piece_refcount;
 			m_disk_cache.maybe_free_piece(to_flush[i]);
@@ -1063,7 +1443,8 @@ namespace libtorrent {
 		&disk_io_thread::do_flush_storage,
 		&disk_io_thread::do_trim_cache,
 		&disk_io_thread::do_file_priority,
-		&disk_io_thread::do_clear_piece
+		&disk_io_thread::do_clear_piece,
+		&disk_io_thread::do_hash_blocks
 	};
 
 	} // anonymous namespace
@@ -1080,7 +1461,7 @@ namespace libtorrent {
 	{
 		// when the read cache is disabled, always try to evict all read cache
 		// blocks
-		if (!m_settings.get_bool(settings_pack::use_read_cache))
+		if (!cached_settings().use_read_cache)
 		{
 			int const evict = m_disk_cache.read_cache_size();
 			m_disk_cache.try_evict_blocks(evict);
@@ -1100,6 +1481,27 @@ namespace libtorrent {
 		}
 	}
 
+	// only one thread at a time runs check_cache_level(). If another thread
+	// is already doing it, make it run one more time instead
+	void disk_io_thread::maybe_check_cache_level(jobqueue_t& completed_jobs)
+	{
+		std::unique_lock<std::mutex> l(m_cache_mutex);
+		if (m_cache_check_state == cache_check_idle)
+		{
+			m_cache_check_state = cache_check_active;
+			while (m_cache_check_state != cache_check_idle)
+			{
+				check_cache_level(l, completed_jobs);
+				TORRENT_ASSERT(l.owns_lock());
+				--m_cache_check_state;
+			}
+		}
+		else
+		{
+			m_cache_check_state = cache_check_reinvoke;
+		}
+	}
+
 	void disk_io_thread::perform_job(disk_io_job* j, jobqueue_t& completed_jobs)
 	{
 		TORRENT_ASSERT(j->next == nullptr);
@@ -1132,6 +1534,8 @@ namespace libtorrent {
 		time_point const start_time = clock_type::now();
 
 		m_stats_counters.inc_stats_counter(counters::num_running_disk_jobs, 1);
+		aux::trace(aux::trace_event::disk_job_start, j->action
+			, std::uint64_t(static_cast<int>(j->piece)));
 
 		// call disk function
 		// TODO: in the future, propagate exceptions back to the handlers
@@ -1164,23 +1568,10 @@ namespace libtorrent {
 			|| (j->error.ec && j->error.operation != 0));
 
 		m_stats_counters.inc_stats_counter(counters::num_running_disk_jobs, -1);
+		aux::trace(aux::trace_event::disk_job_end, j->action
+			, std::uint64_t(static_cast<int>(j->piece)));
 
-		std::unique_lock<std::mutex> l(m_cache_mutex);
-		if (m_cache_check_state == cache_check_idle)
-		{
-			m_cache_check_state = cache_check_active;
-			while (m_cache_check_state != cache_check_idle)
-			{
-				check_cache_level(l, completed_jobs);
-				TORRENT_ASSERT(l.owns_lock());
-				--m_cache_check_state;
-			}
-		}
-		else
-		{
-			m_cache_check_state = cache_check_reinvoke;
-		}
-		l.unlock();
+		maybe_check_cache_level(completed_jobs);
 
 		if (ret == retry_job)
 		{
@@ -1204,15 +1595,190 @@ namespace libtorrent {
 			return;
 		}
 
+		time_point const now = clock_type::now();
+		std::pair<int, int> const hist = latency_histograms(j);
+		m_stats_counters.inc_stats_counter(hist.first
+			+ latency_bucket(start_time - j->issued));
+		m_stats_counters.inc_stats_counter(hist.second
+			+ latency_bucket(now - start_time));
+
+		pool_for_job(j).job_done(total_microseconds(start_time - j->issued)
+			, total_microseconds(now - start_time));
+
 		if (ret == defer_handler) return;
 
 		j->ret = ret;
 
-		time_point now = clock_type::now();
 		m_job_time.add_sample(total_microseconds(now - start_time));
 		completed_jobs.push_back(j);
 	}
 
+	// performs all hash jobs in ``jobs``. The ones that would read the piece
+	// straight from disk, and have the same piece size, are hashed together,
+	// one SIMD lane per piece (see aux::update_multi()). The rest go through
+	// the regular path
+	void disk_io_thread::execute_hash_batch(jobqueue_t& jobs)
+	{
+		jobqueue_t completed_jobs;
+		std::vector<disk_io_job*> batched;
+		batched.reserve(std::size_t(jobs.size()));
+		bool const use_read_cache = cached_settings().use_read_cache;
+
+		while (!jobs.empty())
+		{
+			disk_io_job* j = jobs.pop_front();
+			TORRENT_ASSERT(j->action == disk_io_job::hash);
+			TORRENT_ASSERT((j->flags & disk_io_job::in_progress) || !j->storage);
+
+			if (j->storage->m_settings == nullptr)
+				j->storage->m_settings = &m_settings;
+
+			// pieces that are (partially) in the cache are best hashed from
+			// there. Volatile reads (i.e. checking files) would only pass
+			// through the cache, so they may as well be read directly
+			bool eligible = !use_read_cache || (j->flags & disk_interface::volatile_read);
+			if (eligible)
+			{
+				std::unique_lock<std::mutex> l(m_cache_mutex);
+				eligible = m_disk_cache.find_piece(j) == nullptr;
+			}
+
+			if (!eligible
+				|| (!batched.empty() && j->storage->files().piece_size(j->piece)
+					!= batched.front()->storage->files().piece_size(batched.front()->piece))
+				|| hash_sparse_piece(j))
+			{
+				perform_job(j, completed_jobs);
+				continue;
+			}
+			batched.push_back(j);
+		}
+
+		if (batched.size() == 1)
+		{
+			perform_job(batched.front(), completed_jobs);
+			batched.clear();
+		}
+
+		if (!batched.empty())
+		{
+			m_stats_counters.inc_stats_counter(counters::num_running_disk_jobs, 1);
+			time_point const batch_start = clock_type::now();
+
+			int const num_jobs = int(batched.size());
+			int const piece_size = batched.front()->storage->files().piece_size(batched.front()->piece);
+			int const block_size = m_disk_cache.block_size();
+			int const blocks_in_piece = (piece_size + block_size - 1) / block_size;
+			int const line_size = std::max(1, std::min(blocks_in_piece
+				, cached_settings().read_cache_line_size));
+
+			// one cache line worth of buffers per piece
+			TORRENT_ALLOCA(iov, iovec_t, num_jobs * line_size);
+			if (m_disk_cache.allocate_iovec(iov) < 0)
+			{
+				for (disk_io_job* j : batched)
+				{
+					j->error.ec = errors::no_memory;
+					j->error.operation = storage_error::alloc_cache_piece;
+					j->ret = status_t::fatal_disk_error;
+					completed_jobs.push_back(j);
+				}
+				batched.clear();
+			}
+
+			std::vector<hasher> hashers(batched.size());
+			// the jobs still being hashed. The ones failing to read drop out
+			std::vector<int> live;
+			for (int i = 0; i < int(batched.size()); ++i) live.push_back(i);
+			std::vector<hasher*> lane_hashers;
+			std::vector<char const*> lane_data;
+			int num_blocks_read = 0;
+			int num_read_ops = 0;
+
+			for (int i = 0; i < blocks_in_piece && !live.empty(); i += line_size)
+			{
+				int const num_blocks = std::min(line_size, blocks_in_piece - i);
+				int const offset = i * block_size;
+				int const read_size = std::min(num_blocks * block_size, piece_size - offset);
+
+				for (auto k = live.begin(); k != live.end();)
+				{
+					disk_io_job* j = batched[std::size_t(*k)];
+					span<iovec_t> const bufs = iov.subspan(std::size_t(*k * line_size)
+						, std::size_t(num_blocks));
+					for (int b = 0; b < num_blocks; ++b)
+					{
+						bufs[std::size_t(b)].iov_len = aux::numeric_cast<std::size_t>(
+							std::min(block_size, piece_size - offset - b * block_size));
+					}
+					std::uint32_t const file_flags = file_flags_for_job(j
+						, cached_settings().coalesce_reads);
+					int const ret = j->storage->readv(bufs, j->piece, offset
+						, file_flags, j->error);
+					if (ret < 0)
+					{
+						j->ret = status_t::fatal_disk_error;
+						completed_jobs.push_back(j);
+						k = live.erase(k);
+						continue;
+					}
+					num_blocks_read += num_blocks;
+					++num_read_ops;
+					++k;
+				}
+
+				// hash block b of the line of every piece at a time
+				for (int b = 0; b < num_blocks; ++b)
+				{
+					lane_hashers.clear();
+					lane_data.clear();
+					for (int const k : live)
+					{
+						lane_hashers.push_back(&hashers[std::size_t(k)]);
+						lane_data.push_back(static_cast<char const*>(
+							iov[std::size_t(k * line_size + b)].iov_base));
+					}
+					if (lane_hashers.empty()) break;
+					aux::update_multi(lane_hashers, lane_data
+						, std::min(block_size, read_size - b * block_size));
+				}
+			}
+
+			for (int const k : live)
+			{
+				disk_io_job* j = batched[std::size_t(k)];
+				sha1_hash const piece_hash = hashers[std::size_t(k)].final();
+				std::memcpy(j->d.piece_hash, piece_hash.data(), 20);
+				j->ret = status_t::no_error;
+				completed_jobs.push_back(j);
+			}
+
+			if (!batched.empty())
+			{
+				// restore the full buffer sizes before handing the buffers back
+				for (auto& b : iov) b.iov_len = std::size_t(block_size);
+				m_disk_cache.free_iovec(iov);
+			}
+
+			std::int64_t const batch_time = total_microseconds(clock_type::now() - batch_start);
+			m_stats_counters.inc_stats_counter(counters::num_running_disk_jobs, -1);
+			if (num_blocks_read > 0)
+			{
+				m_read_time.add_sample(batch_time / num_blocks_read);
+				m_stats_counters.inc_stats_counter(counters::num_blocks_read, num_blocks_read);
+				m_stats_counters.inc_stats_counter(counters::num_read_ops, num_read_ops);
+				m_stats_counters.inc_stats_counter(counters::disk_read_time, batch_time);
+				m_stats_counters.inc_stats_counter(counters::disk_job_time, batch_time);
+			}
+			m_job_time.add_sample(batch_time / num_jobs);
+
+			maybe_check_cache_level(completed_jobs);
+		}
+
+		if (completed_jobs.size())
+			add_completed_jobs(completed_jobs);
+	}
+
 	status_t disk_io_thread::do_uncached_read(disk_io_job* j)
 	{
 		j->argument = disk_buffer_holder(*this, m_disk_cache.allocate_buffer("send buffer"));
@@ -1227,9 +1793,17 @@ namespace libtorrent {
 		time_point const start_time = clock_type::now();
 
 		std::uint32_t const file_flags = file_flags_for_job(j
-			, m_settings.get_bool(settings_pack::coalesce_reads));
+			, cached_settings().coalesce_reads);
 		iovec_t b = {buffer.get(), std::size_t(j->d.io.buffer_size)};
 
+		int const block_size = m_disk_cache.block_size();
+		if ((j->d.io.offset % block_size) == 0
+			&& m_l2_cache.read(j->storage->storage_index(), j->piece
+				, j->d.io.offset / block_size, b))
+		{
+			return status_t::no_error;
+		}
+
 		int ret = j->storage->readv(b
 			, j->piece, j->d.io.offset, file_flags, j->error);
 
@@ -1250,18 +1824,143 @@ namespace libtorrent {
 		return status_t::no_error;
 	}
 
+	// performs all read jobs in ``jobs``. The ones that would be uncached reads
+	// are issued together, as one batch of file operations. The rest go through
+	// the regular path
+	void disk_io_thread::execute_read_batch(jobqueue_t& jobs
+		, aux::io_uring_batch& batch)
+	{
+		jobqueue_t completed_jobs;
+		std::vector<disk_io_job*> batched;
+		batched.reserve(std::size_t(jobs.size()));
+
+		while (!jobs.empty())
+		{
+			disk_io_job* j = jobs.pop_front();
+			TORRENT_ASSERT(j->action == disk_io_job::read);
+			TORRENT_ASSERT((j->flags & disk_io_job::in_progress) || !j->storage);
+
+			std::unique_lock<std::mutex> l(m_cache_mutex);
+			bool const cached = (j->flags & disk_io_job::unprepared_read)
+				|| m_disk_cache.find_piece(j) != nullptr;
+			l.unlock();
+
+			// jobs that haven't been looked up in the cache yet go through
+			// do_read(), which does that
+			if (cached)
+			{
+				perform_job(j, completed_jobs);
+				continue;
+			}
+
+			if (j->storage->m_settings == nullptr)
+				j->storage->m_settings = &m_settings;
+
+			j->argument = disk_buffer_holder(*this, m_disk_cache.allocate_buffer("send buffer"));
+			auto& buffer = boost::get<disk_buffer_holder>(j->argument);
+			if (buffer.get() == nullptr)
+			{
+				j->error.ec = error::no_memory;
+				j->error.operation = storage_error::alloc_cache_piece;
+				j->ret = status_t::fatal_disk_error;
+				completed_jobs.push_back(j);
+				continue;
+			}
+
+			std::uint32_t const file_flags = file_flags_for_job(j
+				, cached_settings().coalesce_reads);
+			iovec_t const b = {buffer.get(), std::size_t(j->d.io.buffer_size)};
+
+			int const block_size = m_disk_cache.block_size();
+			if ((j->d.io.offset % block_size) == 0
+				&& m_l2_cache.read(j->storage->storage_index(), j->piece
+					, j->d.io.offset / block_size, b))
+			{
+				j->ret = status_t::no_error;
+				completed_jobs.push_back(j);
+				continue;
+			}
+
+			if (!j->storage->readv_batch(batch, int(batched.size()), b
+				, j->piece, j->d.io.offset, file_flags, j->error))
+			{
+				// this storage does not support batched reads
+				j->storage->readv(b, j->piece, j->d.io.offset, file_flags, j->error);
+				j->ret = j->error ? status_t::fatal_disk_error : status_t::no_error;
+				completed_jobs.push_back(j);
+				continue;
+			}
+			batched.push_back(j);
+		}
+
+		if (!batched.empty())
+		{
+			m_stats_counters.inc_stats_counter(counters::num_running_disk_jobs, 1);
+			time_point const start_time = clock_type::now();
+
+			batch.run([&batched](int const tag, int, error_code const& ec)
+			{
+				if (!ec) return;
+				disk_io_job* j = batched[std::size_t(tag)];
+				if (j->error) return;
+				j->error.ec = ec;
+				j->error.operation = storage_error::read;
+			});
+
+			std::int64_t const read_time = total_microseconds(clock_type::now() - start_time);
+			m_stats_counters.inc_stats_counter(counters::num_running_disk_jobs, -1);
+
+			int num_read = 0;
+			for (disk_io_job* j : batched)
+			{
+				j->ret = j->error ? status_t::fatal_disk_error : status_t::no_error;
+				if (!j->error) ++num_read;
+				completed_jobs.push_back(j);
+			}
+
+			if (num_read > 0)
+			{
+				m_read_time.add_sample(read_time / num_read);
+				m_stats_counters.inc_stats_counter(counters::num_read_back, num_read);
+				m_stats_counters.inc_stats_counter(counters::num_blocks_read, num_read);
+				m_stats_counters.inc_stats_counter(counters::num_read_ops, num_read);
+				m_stats_counters.inc_stats_counter(counters::disk_read_time, read_time);
+				m_stats_counters.inc_stats_counter(counters::disk_job_time, read_time);
+			}
+			m_job_time.add_sample(read_time / int(batched.size()));
+
+			maybe_check_cache_level(completed_jobs);
+		}
+
+		if (completed_jobs.size())
+			add_completed_jobs(completed_jobs);
+	}
+
 	status_t disk_io_thread::do_read(disk_io_job* j, jobqueue_t& completed_jobs)
 	{
 		int const block_size = m_disk_cache.block_size();
 		int const piece_size = j->storage->files().piece_size(j->piece);
 		int const blocks_in_piece = (piece_size + block_size - 1) / block_size;
-		int const iov_len = m_disk_cache.pad_job(j, blocks_in_piece
-			, m_settings.get_int(settings_pack::read_cache_line_size));
-
-		TORRENT_ALLOCA(iov, iovec_t, iov_len);
 
 		std::unique_lock<std::mutex> l(m_cache_mutex);
 
+		if (j->flags & disk_io_job::unprepared_read)
+		{
+			// the fence was already checked when the job was added
+			int const state = prep_read_job_impl(j, false);
+			// the job completed right away (typically a cache hit)
+			if (state == 0) return j->ret;
+			// the job is waiting for an outstanding read of the same piece
+			if (state == 2) return defer_handler;
+		}
+
+		int read_ahead = cached_settings().read_cache_line_size;
+		if (cached_settings().adaptive_read_ahead)
+			read_ahead = m_read_ahead.read_ahead(j->requester, read_ahead);
+		int const iov_len = m_disk_cache.pad_job(j, blocks_in_piece, read_ahead);
+
+		TORRENT_ALLOCA(iov, iovec_t, iov_len);
+
 		int evict = m_disk_cache.num_to_evict(iov_len);
 		if (evict > 0) m_disk_cache.try_evict_blocks(evict);
 
@@ -1303,21 +2002,31 @@ namespace libtorrent {
 		// disk operations.
 
 		std::uint32_t const file_flags = file_flags_for_job(j
-			, m_settings.get_bool(settings_pack::coalesce_reads));
+			, cached_settings().coalesce_reads);
 		time_point const start_time = clock_type::now();
 
-		ret = j->storage->readv(iov
-			, j->piece, int(adjusted_offset), file_flags, j->error);
-
-		if (!j->error.ec)
+		// blocks spilled to the L2 cache are read from there rather than from
+		// the torrent's files
+		if (m_l2_cache.read(j->storage->storage_index(), j->piece
+			, int(adjusted_offset / block_size), iov))
 		{
-			std::int64_t const read_time = total_microseconds(clock_type::now() - start_time);
-			m_read_time.add_sample(read_time / iov_len);
+			ret = int(bufs_size(iov));
+		}
+		else
+		{
+			ret = j->storage->readv(iov
+				, j->piece, int(adjusted_offset), file_flags, j->error);
+
+			if (!j->error.ec)
+			{
+				std::int64_t const read_time = total_microseconds(clock_type::now() - start_time);
+				m_read_time.add_sample(read_time / iov_len);
 
-			m_stats_counters.inc_stats_counter(counters::num_blocks_read, iov_len);
-			m_stats_counters.inc_stats_counter(counters::num_read_ops);
-			m_stats_counters.inc_stats_counter(counters::disk_read_time, read_time);
-			m_stats_counters.inc_stats_counter(counters::disk_job_time, read_time);
+				m_stats_counters.inc_stats_counter(counters::num_blocks_read, iov_len);
+				m_stats_counters.inc_stats_counter(counters::num_read_ops);
+				m_stats_counters.inc_stats_counter(counters::disk_read_time, read_time);
+				m_stats_counters.inc_stats_counter(counters::disk_job_time, read_time);
+			}
 		}
 
 		l.lock();
@@ -1463,7 +2172,7 @@ namespace libtorrent {
 
 		iovec_t const b = { buffer.get(), std::size_t(j->d.io.buffer_size)};
 		std::uint32_t const file_flags = file_flags_for_job(j
-			, m_settings.get_bool(settings_pack::coalesce_writes));
+			, cached_settings().coalesce_writes);
 
 		m_stats_counters.inc_stats_counter(counters::num_writing_threads, 1);
 
@@ -1521,7 +2230,7 @@ namespace libtorrent {
 
 			if (!pe->hashing_done
 				&& pe->hash == nullptr
-				&& !m_settings.get_bool(settings_pack::disable_hash_checks))
+				&& !cached_settings().disable_hash_checks)
 			{
 				pe->hash.reset(new partial_hash);
 				m_disk_cache.update_cache_state(pe);
@@ -1538,8 +2247,7 @@ namespace libtorrent {
 			// flushes the piece to disk in case
 			// it satisfies the condition for a write
 			// piece to be flushed
-			try_flush_hashed(pe, m_settings.get_int(
-				settings_pack::write_cache_line_size), completed_jobs, l);
+			try_flush_hashed(pe, cached_settings().write_cache_line_size, completed_jobs, l);
 
 			--pe->piece_refcount;
 			m_disk_cache.maybe_free_piece(pe);
@@ -1560,6 +2268,7 @@ namespace libtorrent {
 
 		DLOG("do_read piece: %d block: %d\n", static_cast<int>(r.piece)
 			, r.start / m_disk_cache.block_size());
+		trace_request('R', storage, r.piece, r.start, r.length);
 
 		disk_io_job* j = allocate_job(disk_io_job::read);
 		j->storage = m_torrents[storage]->shared_from_this();
@@ -1571,7 +2280,16 @@ namespace libtorrent {
 		j->requester = requester;
 		j->callback = std::move(handler);
 
-		std::unique_lock<std::mutex> l(m_cache_mutex);
+		// the network thread must not stall waiting for disk threads holding
+		// the cache mutex. If it's busy, let a disk thread look up the job in
+		// the cache instead
+		std::unique_lock<std::mutex> l(m_cache_mutex, std::try_to_lock);
+		if (!l.owns_lock())
+		{
+			j->flags |= disk_io_job::unprepared_read;
+			add_job(j);
+			return;
+		}
 		int ret = prep_read_job_impl(j);
 		l.unlock();
 
@@ -1600,6 +2318,10 @@ namespace libtorrent {
 	int disk_io_thread::prep_read_job_impl(disk_io_job* j, bool check_fence)
 	{
 		TORRENT_ASSERT(j->action == disk_io_job::read);
+		j->flags &= ~disk_io_job::unprepared_read;
+
+		m_read_ahead.record(j->requester, j->storage->storage_index(), j->piece
+			, j->d.io.offset / m_disk_cache.block_size());
 
 		int ret = m_disk_cache.try_read(j, *this);
 		if (ret >= 0)
@@ -1628,8 +2350,8 @@ namespace libtorrent {
 			return 2;
 		}
 
-		if (!m_settings.get_bool(settings_pack::use_read_cache)
-			|| m_settings.get_int(settings_pack::cache_size) == 0)
+		if (!cached_settings().use_read_cache
+			|| cached_settings().cache_size == 0)
 		{
 			// if the read cache is disabled then we can skip going through the cache
 			// but only if there is no existing piece entry. Otherwise there may be a
@@ -1676,6 +2398,30 @@ namespace libtorrent {
 		if (!buffer) aux::throw_ex<std::bad_alloc>();
 		std::memcpy(buffer.get(), buf, aux::numeric_cast<std::size_t>(r.length));
 
+		async_write(storage, r, std::move(buffer), std::move(handler), flags);
+		return exceeded;
+	}
+
+	disk_buffer_holder disk_io_thread::allocate_disk_buffer(bool& exceeded
+		, std::shared_ptr<disk_observer> o, char const* category)
+	{
+		return disk_buffer_holder(*this, m_disk_cache.allocate_buffer(exceeded
+			, std::move(o), category));
+	}
+
+	void disk_io_thread::async_write(storage_index_t const storage, peer_request const& r
+		, disk_buffer_holder buffer
+		, std::function<void(storage_error const&)> handler
+		, std::uint8_t const flags)
+	{
+		TORRENT_ASSERT(r.length <= m_disk_cache.block_size());
+		TORRENT_ASSERT(r.length <= 16 * 1024);
+		TORRENT_ASSERT(buffer);
+		trace_request('W', storage, r.piece, r.start, r.length);
+
+		// whatever the L2 cache has for this block is about to be stale
+		m_l2_cache.invalidate(storage, r.piece, r.start / m_disk_cache.block_size());
+
 		disk_io_job* j = allocate_job(disk_io_job::write);
 		j->storage = m_torrents[storage]->shared_from_this();
 		j->piece = r.piece;
@@ -1724,7 +2470,7 @@ namespace libtorrent {
 			DLOG("blocked job: %s (torrent: %d total: %d)\n"
 				, job_action_name[j->action], j->storage ? j->storage->num_blocked() : 0
 				, int(m_stats_counters[counters::blocked_disk_jobs]));
-			return exceeded;
+			return;
 		}
 
 		std::unique_lock<std::mutex> l(m_cache_mutex);
@@ -1750,12 +2496,11 @@ namespace libtorrent {
 
 			// if we added the block (regardless of whether we also
 			// issued a flush job or not), we're done.
-			return exceeded;
+			return;
 		}
 		l.unlock();
 
 		add_job(j);
-		return exceeded;
 	}
 
 	void disk_io_thread::async_hash(storage_index_t const storage
@@ -1770,6 +2515,7 @@ namespace libtorrent {
 		j->requester = requester;
 
 		int piece_size = j->storage->files().piece_size(piece);
+		trace_request('H', storage, piece, 0, piece_size);
 
 		// first check to see if the hashing is already done
 		std::unique_lock<std::mutex> l(m_cache_mutex);
@@ -1870,7 +2616,8 @@ namespace libtorrent {
 	void disk_io_thread::async_check_files(storage_index_t const storage
 		, add_torrent_params const* resume_data
 		, aux::vector<std::string, file_index_t>& links
-		, std::function<void(status_t, storage_error const&)> handler)
+		, std::function<void(status_t, storage_error const&)> handler
+		, std::uint8_t const flags)
 	{
 		aux::vector<std::string, file_index_t>* links_vector
 			= new aux::vector<std::string, file_index_t>();
@@ -1880,6 +2627,7 @@ namespace libtorrent {
 		j->storage = m_torrents[storage]->shared_from_this();
 		j->argument = resume_data;
 		j->d.links = links_vector;
+		j->flags = flags & disk_interface::trust_resume_data;
 		j->callback = std::move(handler);
 
 		add_fence_job(j);
@@ -1966,9 +2714,24 @@ namespace libtorrent {
 		add_fence_job(j);
 	}
 
+	void disk_io_thread::async_hash_blocks(storage_index_t const storage
+		, piece_index_t const piece, std::uint32_t const salt
+		, std::function<void(piece_index_t, std::vector<sha1_hash>, storage_error const&)> handler)
+	{
+		disk_io_job* j = allocate_job(disk_io_job::hash_blocks);
+		j->storage = m_torrents[storage]->shared_from_this();
+		j->piece = piece;
+		j->d.salt = salt;
+		j->argument = std::vector<sha1_hash>();
+		j->callback = std::move(handler);
+
+		add_job(j);
+	}
+
 	void disk_io_thread::async_clear_piece(storage_index_t const storage
 		, piece_index_t const index, std::function<void(piece_index_t)> handler)
 	{
+		trace_request('C', storage, index, 0, 0);
 		disk_io_job* j = allocate_job(disk_io_job::clear_piece);
 		j->storage = m_torrents[storage]->shared_from_this();
 		j->piece = index;
@@ -1976,11 +2739,9 @@ namespace libtorrent {
 
 		// regular jobs are not guaranteed to be executed in-order
 		// since clear piece must guarantee that all write jobs that
-		// have been issued finish before the clear piece job completes
-
-		// TODO: this is potentially very expensive. One way to solve
-		// it would be to have a fence for just this one piece.
-		add_fence_job(j);
+		// have been issued finish before the clear piece job completes.
+		// The fence only holds back jobs on this piece
+		add_piece_fence_job(j);
 	}
 
 	void disk_io_thread::clear_piece(storage_index_t const storage
@@ -2133,52 +2894,109 @@ namespace libtorrent {
 		int const block_size = m_disk_cache.block_size();
 		int const blocks_in_piece = (piece_size + block_size - 1) / block_size;
 		std::uint32_t const file_flags = file_flags_for_job(j
-			, m_settings.get_bool(settings_pack::coalesce_reads));
+			, cached_settings().coalesce_reads);
+
+		// read a cache line worth of blocks at a time, to issue fewer and
+		// larger read operations
+		int const line_size = std::max(1, std::min(blocks_in_piece
+			, cached_settings().read_cache_line_size));
+		TORRENT_ALLOCA(iov_buf, iovec_t, line_size);
+		span<iovec_t> const iov = iov_buf;
+		if (m_disk_cache.allocate_iovec(iov) < 0)
+		{
+			j->error.ec = errors::no_memory;
+			j->error.operation = storage_error::alloc_cache_piece;
+			return status_t::fatal_disk_error;
+		}
 
-		iovec_t iov;
-		iov.iov_base = m_disk_cache.allocate_buffer("hashing");
 		hasher h;
 		int ret = 0;
 		int offset = 0;
-		for (int i = 0; i < blocks_in_piece; ++i)
+		for (int i = 0; i < blocks_in_piece; i += line_size)
 		{
 			DLOG("do_hash: (uncached) reading (piece: %d block: %d)\n"
 				, int(j->piece), i);
 
 			time_point const start_time = clock_type::now();
 
-			iov.iov_len = aux::numeric_cast<std::size_t>(std::min(block_size, piece_size - offset));
-			ret = j->storage->readv(iov, j->piece
+			int const num_blocks = std::min(line_size, blocks_in_piece - i);
+			int read_size = 0;
+			for (int k = 0; k < num_blocks; ++k)
+			{
+				iov[k].iov_len = aux::numeric_cast<std::size_t>(
+					std::min(block_size, piece_size - offset - read_size));
+				read_size += int(iov[k].iov_len);
+			}
+			span<iovec_t const> const bufs = span<iovec_t const>(iov).first(std::size_t(num_blocks));
+			ret = j->storage->readv(bufs, j->piece
 				, offset, file_flags, j->error);
 			if (ret < 0) break;
 
 			if (!j->error.ec)
 			{
 				std::int64_t const read_time = total_microseconds(clock_type::now() - start_time);
-				m_read_time.add_sample(read_time);
+				m_read_time.add_sample(read_time / num_blocks);
 
-				m_stats_counters.inc_stats_counter(counters::num_blocks_read);
+				m_stats_counters.inc_stats_counter(counters::num_blocks_read, num_blocks);
 				m_stats_counters.inc_stats_counter(counters::num_read_ops);
 				m_stats_counters.inc_stats_counter(counters::disk_read_time, read_time);
 				m_stats_counters.inc_stats_counter(counters::disk_job_time, read_time);
 			}
 
-			offset += block_size;
-			h.update(static_cast<char const*>(iov.iov_base), int(iov.iov_len));
+			offset += read_size;
+			for (auto const& b : bufs)
+				h.update(static_cast<char const*>(b.iov_base), int(b.iov_len));
 		}
 
-		m_disk_cache.free_buffer(static_cast<char*>(iov.iov_base));
+		// restore the full buffer sizes before handing the buffers back
+		for (auto& b : iov) b.iov_len = std::size_t(block_size);
+		m_disk_cache.free_iovec(iov);
 
 		sha1_hash piece_hash = h.final();
 		std::memcpy(j->d.piece_hash, piece_hash.data(), 20);
 		return ret >= 0 ? status_t::no_error : status_t::fatal_disk_error;
 	}
 
+	bool disk_io_thread::hash_sparse_piece(disk_io_job* j)
+	{
+		// this is only worth it when checking files. Pieces hashed as part of
+		// downloading have just been written
+		if (!(j->flags & disk_interface::volatile_read)) return false;
+		if (!j->storage->is_sparse_piece(j->piece)) return false;
+
+		{
+			// the file may be sparse, but the piece may still have blocks in
+			// the cache that haven't been flushed yet
+			std::unique_lock<std::mutex> l(m_cache_mutex);
+			if (m_disk_cache.find_piece(j) != nullptr) return false;
+		}
+
+		int const piece_size = j->storage->files().piece_size(j->piece);
+
+		std::lock_guard<std::mutex> l(m_zero_hash_mutex);
+		auto i = std::find_if(m_zero_hashes.begin(), m_zero_hashes.end()
+			, [=](std::pair<int, sha1_hash> const& e) { return e.first == piece_size; });
+		if (i == m_zero_hashes.end())
+		{
+			std::vector<char> const zeros(std::size_t(m_disk_cache.block_size()), 0);
+			hasher h;
+			for (int left = piece_size; left > 0; left -= int(zeros.size()))
+				h.update(zeros.data(), std::min(left, int(zeros.size())));
+			m_zero_hashes.emplace_back(piece_size, h.final());
+			i = m_zero_hashes.end() - 1;
+		}
+		std::memcpy(j->d.piece_hash, i->second.data(), 20);
+		DLOG("do_hash: (%d) (sparse)\n", int(j->piece));
+		return true;
+	}
+
 	status_t disk_io_thread::do_hash(disk_io_job* j, jobqueue_t& /* completed_jobs */ )
 	{
+		if (hash_sparse_piece(j)) return status_t::no_error;
+
 		int const piece_size = j->storage->files().piece_size(j->piece);
 		std::uint32_t const file_flags = file_flags_for_job(j
-			, m_settings.get_bool(settings_pack::coalesce_reads));
+			, cached_settings().coalesce_reads);
 
 		std::unique_lock<std::mutex> l(m_cache_mutex);
 
@@ -2216,7 +3034,7 @@ namespace libtorrent {
 				return status_t::no_error;
 			}
 		}
-		else if (m_settings.get_bool(settings_pack::use_read_cache) == false)
+		else if (cached_settings().use_read_cache == false)
 		{
 			return do_uncached_hash(j);
 		}
@@ -2289,6 +3107,7 @@ namespace libtorrent {
 
 		// save a local copy of offset to avoid concurrent access
 		int offset = ph->offset;
+		int const readback_reason = pe->readback_reason;
 #if TORRENT_USE_ASSERTS
 		int old_offset = offset;
 #endif
@@ -2297,92 +3116,117 @@ namespace libtorrent {
 
 		status_t ret = status_t::no_error;
 		int next_locked_block = 0;
-		for (int i = offset / block_size; i < blocks_in_piece; ++i)
+		for (int i = offset / block_size; i < blocks_in_piece;)
 		{
-			iovec_t iov;
-			iov.iov_len = aux::numeric_cast<std::size_t>(std::min(block_size, piece_size - offset));
-
 			if (next_locked_block < num_locked_blocks
 				&& locked_blocks[next_locked_block] == i)
 			{
 				++next_locked_block;
 				TORRENT_PIECE_ASSERT(pe->blocks[i].buf, pe);
 				TORRENT_PIECE_ASSERT(offset == i * block_size, pe);
-				offset += int(iov.iov_len);
-				ph->h.update({pe->blocks[i].buf, iov.iov_len});
+				std::size_t const len = aux::numeric_cast<std::size_t>(
+					std::min(block_size, piece_size - offset));
+				offset += int(len);
+				ph->h.update({pe->blocks[i].buf, len});
+				++i;
+				continue;
 			}
-			else
+
+			// read the whole run of blocks up to the next one we have in the
+			// cache with a single read operation, rather than one block at a
+			// time. When checking files, this is typically the entire piece
+			int const end = next_locked_block < num_locked_blocks
+				? locked_blocks[next_locked_block] : blocks_in_piece;
+			int const num_blocks = end - i;
+			TORRENT_ALLOCA(iov_buf, iovec_t, num_blocks);
+			span<iovec_t> const iov = iov_buf;
+
+			if (m_disk_cache.allocate_iovec(iov) < 0)
 			{
-				iov.iov_base = m_disk_cache.allocate_buffer("hashing");
+				l.lock();
 
-				if (iov.iov_base == nullptr)
-				{
-					l.lock();
+				// decrement the refcounts of the blocks we just hashed
+				for (int k = 0; k < num_locked_blocks; ++k)
+					m_disk_cache.dec_block_refcount(pe, locked_blocks[k], block_cache::ref_hashing);
 
-					// decrement the refcounts of the blocks we just hashed
-					for (int k = 0; k < num_locked_blocks; ++k)
-						m_disk_cache.dec_block_refcount(pe, locked_blocks[k], block_cache::ref_hashing);
+				refcount_holder.release();
+				pe->hashing = false;
+				pe->hash.reset();
 
-					refcount_holder.release();
-					pe->hashing = false;
-					pe->hash.reset();
+				m_disk_cache.maybe_free_piece(pe);
 
-					m_disk_cache.maybe_free_piece(pe);
+				j->error.ec = errors::no_memory;
+				j->error.operation = storage_error::alloc_cache_piece;
+				return status_t::fatal_disk_error;
+			}
 
-					j->error.ec = errors::no_memory;
-					j->error.operation = storage_error::alloc_cache_piece;
-					return status_t::fatal_disk_error;
-				}
+			int read_size = 0;
+			for (auto& b : iov)
+			{
+				b.iov_len = aux::numeric_cast<std::size_t>(
+					std::min(block_size, piece_size - offset - read_size));
+				read_size += int(b.iov_len);
+			}
 
-				DLOG("do_hash: reading (piece: %d block: %d)\n"
-					, static_cast<int>(pe->piece), i);
+			DLOG("do_hash: reading (piece: %d block: %d num: %d)\n"
+				, static_cast<int>(pe->piece), i, num_blocks);
 
-				time_point const start_time = clock_type::now();
+			time_point const start_time = clock_type::now();
 
-				TORRENT_PIECE_ASSERT(offset == i * block_size, pe);
-				int read_ret = j->storage->readv(iov, j->piece
-					, offset, file_flags, j->error);
+			TORRENT_PIECE_ASSERT(offset == i * block_size, pe);
+			int const read_ret = j->storage->readv(iov, j->piece
+				, offset, file_flags, j->error);
 
-				if (read_ret < 0)
-				{
-					ret = status_t::fatal_disk_error;
-					TORRENT_ASSERT(j->error.ec && j->error.operation != 0);
-					m_disk_cache.free_buffer(static_cast<char*>(iov.iov_base));
-					break;
-				}
+			if (read_ret < 0)
+			{
+				ret = status_t::fatal_disk_error;
+				TORRENT_ASSERT(j->error.ec && j->error.operation != 0);
+				m_disk_cache.free_iovec(iov);
+				break;
+			}
 
-				// treat a short read as an error. The hash will be invalid, the
-				// block cannot be cached and the main thread should skip the rest
-				// of this file
-				if (read_ret != int(iov.iov_len))
-				{
-					ret = status_t::fatal_disk_error;
-					j->error.ec = boost::asio::error::eof;
-					j->error.operation = storage_error::read;
-					m_disk_cache.free_buffer(static_cast<char*>(iov.iov_base));
-					break;
-				}
+			// treat a short read as an error. The hash will be invalid, the
+			// block cannot be cached and the main thread should skip the rest
+			// of this file
+			if (read_ret != read_size)
+			{
+				ret = status_t::fatal_disk_error;
+				j->error.ec = boost::asio::error::eof;
+				j->error.operation = storage_error::read;
+				m_disk_cache.free_iovec(iov);
+				break;
+			}
+
+			if (!j->error.ec)
+			{
+				std::int64_t read_time = total_microseconds(clock_type::now() - start_time);
+				m_read_time.add_sample(read_time / num_blocks);
 
-				if (!j->error.ec)
+				m_stats_counters.inc_stats_counter(counters::num_read_back, num_blocks);
+				if (readback_reason != cached_piece_entry::readback_none)
 				{
-					std::int64_t read_time = total_microseconds(clock_type::now() - start_time);
-					m_read_time.add_sample(read_time);
-
-					m_stats_counters.inc_stats_counter(counters::num_read_back);
-					m_stats_counters.inc_stats_counter(counters::num_blocks_read);
-					m_stats_counters.inc_stats_counter(counters::num_read_ops);
-					m_stats_counters.inc_stats_counter(counters::disk_read_time, read_time);
-					m_stats_counters.inc_stats_counter(counters::disk_job_time, read_time);
+					static int const readback_counters[] = {
+						counters::num_read_back_cache_pressure
+						, counters::num_read_back_expired
+						, counters::num_read_back_flush
+					};
+					m_stats_counters.inc_stats_counter(
+						readback_counters[readback_reason - 1], num_blocks);
 				}
+				m_stats_counters.inc_stats_counter(counters::num_blocks_read, num_blocks);
+				m_stats_counters.inc_stats_counter(counters::num_read_ops);
+				m_stats_counters.inc_stats_counter(counters::disk_read_time, read_time);
+				m_stats_counters.inc_stats_counter(counters::disk_job_time, read_time);
+			}
 
-				TORRENT_PIECE_ASSERT(offset == i * block_size, pe);
-				offset += int(iov.iov_len);
-				ph->h.update({static_cast<char const*>(iov.iov_base), iov.iov_len});
+			for (auto const& b : iov)
+				ph->h.update({static_cast<char const*>(b.iov_base), b.iov_len});
+			offset += read_size;
 
-				l.lock();
-				m_disk_cache.insert_blocks(pe, i, iov, j);
-				l.unlock();
-			}
+			l.lock();
+			m_disk_cache.insert_blocks(pe, i, iov, j);
+			l.unlock();
+			i = end;
 		}
 
 		l.lock();
@@ -2419,14 +3263,139 @@ namespace libtorrent {
 		return ret;
 	}
 
+	status_t disk_io_thread::do_hash_blocks(disk_io_job* j, jobqueue_t& /* completed_jobs */ )
+	{
+		int const piece_size = j->storage->files().piece_size(j->piece);
+		int const block_size = m_disk_cache.block_size();
+		int const blocks_in_piece = (piece_size + block_size - 1) / block_size;
+		std::uint32_t const file_flags = file_flags_for_job(j
+			, cached_settings().coalesce_reads);
+		std::uint32_t const salt = j->d.salt;
+
+		auto& digests = boost::get<std::vector<sha1_hash>>(j->argument);
+		digests.resize(std::size_t(blocks_in_piece));
+
+		// keep track of which blocks we have locked in the cache. Those are
+		// hashed straight out of their cache buffers
+		TORRENT_ALLOCA(locked_blocks, bool, blocks_in_piece);
+		std::fill(locked_blocks.begin(), locked_blocks.end(), false);
+
+		std::unique_lock<std::mutex> l(m_cache_mutex);
+		cached_piece_entry* pe = m_disk_cache.find_piece(j);
+		if (pe != nullptr)
+		{
+#if TORRENT_USE_ASSERTS
+			pe->piece_log.push_back(piece_log_t(j->action));
+#endif
+			++pe->piece_refcount;
+			for (int i = 0; i < blocks_in_piece; ++i)
+			{
+				if (pe->blocks[i].buf == nullptr) continue;
+				if (m_disk_cache.inc_block_refcount(pe, i, block_cache::ref_reading) == false)
+					continue;
+				locked_blocks[i] = true;
+			}
+		}
+		l.unlock();
+
+		status_t ret = status_t::no_error;
+
+		// the blocks that aren't in the cache are read into this buffer, one
+		// at a time. It's allocated the first time it's needed
+		char* read_buf = nullptr;
+		for (int i = 0; i < blocks_in_piece; ++i)
+		{
+			int const offset = i * block_size;
+			std::size_t const len = aux::numeric_cast<std::size_t>(
+				std::min(block_size, piece_size - offset));
+			char const* data;
+			if (locked_blocks[i])
+			{
+				data = pe->blocks[i].buf;
+			}
+			else
+			{
+				if (read_buf == nullptr)
+				{
+					read_buf = m_disk_cache.allocate_buffer("hash temp");
+					if (read_buf == nullptr)
+					{
+						j->error.ec = errors::no_memory;
+						j->error.operation = storage_error::alloc_cache_piece;
+						ret = status_t::fatal_disk_error;
+						break;
+					}
+				}
+
+				time_point const start_time = clock_type::now();
+
+				iovec_t b = {read_buf, len};
+				int const read_ret = j->storage->readv(b, j->piece
+					, offset, file_flags, j->error);
+				if (read_ret < 0)
+				{
+					ret = status_t::fatal_disk_error;
+					TORRENT_ASSERT(j->error.ec && j->error.operation != 0);
+					break;
+				}
+				if (read_ret != int(len))
+				{
+					ret = status_t::fatal_disk_error;
+					j->error.ec = boost::asio::error::eof;
+					j->error.operation = storage_error::read;
+					break;
+				}
+
+				std::int64_t const read_time = total_microseconds(clock_type::now() - start_time);
+				m_read_time.add_sample(read_time);
+
+				m_stats_counters.inc_stats_counter(counters::num_read_back);
+				m_stats_counters.inc_stats_counter(counters::num_blocks_read);
+				m_stats_counters.inc_stats_counter(counters::num_read_ops);
+				m_stats_counters.inc_stats_counter(counters::disk_read_time, read_time);
+				m_stats_counters.inc_stats_counter(counters::disk_job_time, read_time);
+				data = read_buf;
+			}
+
+			hasher h;
+			h.update({data, len});
+			h.update(reinterpret_cast<char const*>(&salt), sizeof(salt));
+			digests[std::size_t(i)] = h.final();
+		}
+
+		if (read_buf != nullptr) m_disk_cache.free_buffer(read_buf);
+
+		if (pe != nullptr)
+		{
+			l.lock();
+			for (int i = 0; i < blocks_in_piece; ++i)
+			{
+				if (!locked_blocks[i]) continue;
+				m_disk_cache.dec_block_refcount(pe, i, block_cache::ref_reading);
+			}
+			TORRENT_PIECE_ASSERT(pe->piece_refcount > 0, pe);
+			--pe->piece_refcount;
+			m_disk_cache.maybe_free_piece(pe);
+		}
+
+		if (ret != status_t::no_error) digests.clear();
+		return ret;
+	}
+
 	status_t disk_io_thread::do_move_storage(disk_io_job* j, jobqueue_t& /* completed_jobs */ )
 	{
 		// if this assert fails, something's wrong with the fence logic
 		TORRENT_ASSERT(j->storage->num_outstanding_jobs() == 1);
 
 		// if files have to be closed, that's the storage's responsibility
-		return j->storage->move_storage(boost::get<std::string>(j->argument)
+		status_t const ret = j->storage->move_storage(boost::get<std::string>(j->argument)
 			, j->flags, j->error);
+
+		// the storage's jobs are queued by the device of its new location
+		// from now on
+		if (ret != status_t::fatal_disk_error)
+			j->storage->set_device(device_index(boost::get<std::string>(j->argument)));
+		return ret;
 	}
 
 	status_t disk_io_thread::do_release_files(disk_io_job* j, jobqueue_t& completed_jobs)
@@ -2455,8 +3424,21 @@ namespace libtorrent {
 			, completed_jobs, l);
 		l.unlock();
 
-		j->storage->delete_files(boost::get<int>(j->argument), j->error);
-		return j->error ? status_t::fatal_disk_error : status_t::no_error;
+		m_l2_cache.invalidate(j->storage->storage_index());
+
+		// deleting the files may take a long time, and shouldn't keep this
+		// thread from serving other torrents. The job completes once the
+		// files are gone. Since it's a fence, no other job of this storage
+		// runs in the meantime
+		m_deletions.push([this, j]
+		{
+			j->storage->delete_files(boost::get<int>(j->argument), j->error);
+			j->ret = j->error ? status_t::fatal_disk_error : status_t::no_error;
+			jobqueue_t completed;
+			completed.push_back(j);
+			add_completed_jobs(completed);
+		});
+		return defer_handler;
 	}
 
 	status_t disk_io_thread::do_check_fastresume(disk_io_job* j, jobqueue_t& /* completed_jobs */ )
@@ -2480,6 +3462,15 @@ namespace libtorrent {
 
 		TORRENT_ASSERT(j->storage->files().piece_length() > 0);
 
+		// the torrent is started trusting the resume data. It will post this
+		// check again, without the flag, to verify the files and initialize
+		// the storage once it's running
+		if ((j->flags & disk_interface::trust_resume_data)
+			&& !rd->have_pieces.empty())
+		{
+			return status_t::no_error;
+		}
+
 		// if we don't have any resume data, return
 		// or if error is set and return value is 'no_error' or 'need_full_check'
 		// the error message indicates that the fast resume data was rejected
@@ -2562,6 +3553,8 @@ namespace libtorrent {
 		info.storage = i->storage.get();
 		info.last_use = i->expire;
 		info.need_readback = i->need_readback;
+		info.readback_reason = static_cast<cached_piece_info::readback_reason_t>(
+			i->readback_reason);
 		info.next_to_hash = i->hash == nullptr ? -1 : (i->hash->offset + block_size - 1) / block_size;
 		info.kind = i->cache_state == cached_piece_entry::write_lru
 			? cached_piece_info::write_cache
@@ -2593,7 +3586,17 @@ namespace libtorrent {
 		std::unique_lock<std::mutex> l(m_cache_mutex);
 
 		// gauges
+		c.set_value(counters::disk_threads_target, m_generic_threads.target_threads());
+		c.set_value(counters::disk_hash_threads_target, m_hash_threads.target_threads());
+		c.set_value(counters::disk_queue_wait_time, m_generic_threads.queue_wait());
+		c.set_value(counters::disk_threads_scaled_up
+			, m_generic_threads.scaled_up() + m_hash_threads.scaled_up());
+		c.set_value(counters::disk_threads_scaled_down
+			, m_generic_threads.scaled_down() + m_hash_threads.scaled_down());
+
 		c.set_value(counters::disk_blocks_in_use, m_disk_cache.in_use());
+		c.set_value(counters::disk_buffer_bytes
+			, std::int64_t(m_disk_cache.in_use()) * m_disk_cache.block_size());
 
 		m_disk_cache.update_stats_counters(c);
 	}
@@ -2704,8 +3707,9 @@ namespace libtorrent {
 #if TORRENT_USE_ASSERTS
 		pe->piece_log.push_back(piece_log_t(j->action));
 #endif
-		try_flush_hashed(pe, m_settings.get_int(
-			settings_pack::write_cache_line_size), completed_jobs, l);
+		// this is also used to flush the piece before it's cleared, in which
+		// case it may not have been hashed, so flush all dirty blocks
+		flush_piece(pe, flush_write_cache, completed_jobs, l);
 
 		return status_t::no_error;
 	}
@@ -2740,7 +3744,7 @@ namespace libtorrent {
 
 		if (!pe->hashing_done)
 		{
-			if (pe->hash == nullptr && !m_settings.get_bool(settings_pack::disable_hash_checks))
+			if (pe->hash == nullptr && !cached_settings().disable_hash_checks)
 			{
 				pe->hash.reset(new partial_hash);
 				m_disk_cache.update_cache_state(pe);
@@ -2756,8 +3760,7 @@ namespace libtorrent {
 		// it satisfies the condition for a write
 		// piece to be flushed
 		// #error if hash checks are disabled, always just flush
-		try_flush_hashed(pe, m_settings.get_int(
-			settings_pack::write_cache_line_size), completed_jobs, l);
+		try_flush_hashed(pe, cached_settings().write_cache_line_size, completed_jobs, l);
 
 		TORRENT_ASSERT(l.owns_lock());
 
@@ -2802,6 +3805,8 @@ namespace libtorrent {
 		pe->hashing_done = 0;
 		pe->hash.reset();
 		pe->hashing_done = false;
+		pe->need_readback = 0;
+		pe->readback_reason = cached_piece_entry::readback_none;
 
 #if TORRENT_USE_ASSERTS
 		pe->piece_log.push_back(piece_log_t(j->action));
@@ -2835,6 +3840,8 @@ namespace libtorrent {
 		// before the disk threads are shut down
 		TORRENT_ASSERT(!m_abort);
 
+		j->device = j->storage->device();
+
 		DLOG("add_fence:job: %s (outstanding: %d)\n"
 			, job_action_name[j->action]
 			, j->storage->num_outstanding_jobs());
@@ -2843,8 +3850,38 @@ namespace libtorrent {
 
 		disk_io_job* fj = allocate_job(disk_io_job::flush_storage);
 		fj->storage = j->storage;
+		fj->device = j->device;
+
+		int const ret = j->storage->raise_fence(j, fj, m_stats_counters);
+		post_fence_job(j, fj, ret, user_add);
+	}
+
+	void disk_io_thread::add_piece_fence_job(disk_io_job* j, bool const user_add)
+	{
+		TORRENT_ASSERT(!m_abort);
+
+		j->device = j->storage->device();
+
+		DLOG("add_piece_fence:job: %s piece: %d (outstanding: %d)\n"
+			, job_action_name[j->action], int(j->piece)
+			, j->storage->num_outstanding_jobs());
+
+		m_stats_counters.inc_stats_counter(counters::num_fenced_read + j->action);
+
+		// the outstanding write jobs on the piece won't complete until its
+		// blocks are flushed
+		disk_io_job* fj = allocate_job(disk_io_job::flush_piece);
+		fj->storage = j->storage;
+		fj->device = j->device;
+		fj->piece = j->piece;
+
+		int const ret = j->storage->raise_piece_fence(j, fj, m_stats_counters);
+		post_fence_job(j, fj, ret, user_add);
+	}
 
-		int ret = j->storage->raise_fence(j, fj, m_stats_counters);
+	void disk_io_thread::post_fence_job(disk_io_job* j, disk_io_job* fj
+		, int const ret, bool const user_add)
+	{
 		if (ret == aux::disk_job_fence::fence_post_fence)
 		{
 			std::unique_lock<std::mutex> l(m_job_mutex);
@@ -2895,6 +3932,8 @@ namespace libtorrent {
 			|| j->action == disk_io_job::flush_piece
 			|| j->action == disk_io_job::trim_cache);
 
+		if (j->storage) j->device = j->storage->device();
+
 		// this happens for read jobs that get hung on pieces in the
 		// block cache, and then get issued
 		if (j->flags & disk_io_job::in_progress)
@@ -2955,8 +3994,11 @@ namespace libtorrent {
 		while (!m_generic_io_jobs.m_queued_jobs.empty())
 		{
 			disk_io_job* j = m_generic_io_jobs.m_queued_jobs.pop_front();
+			if (j == nullptr) break;
+			std::uint8_t const device = j->device;
 			maybe_flush_write_blocks();
 			execute_job(j);
+			m_generic_io_jobs.m_queued_jobs.job_done(device);
 		}
 	}
 
@@ -3010,7 +4052,7 @@ namespace libtorrent {
 		// count to be lower than it should be
 		// for performance reasons we also want to avoid going idle and active again
 		// if there is already work to do
-		if (jobq.m_queued_jobs.empty())
+		if (!jobq.m_queued_jobs.runnable())
 		{
 			threads.thread_idle();
 
@@ -3032,7 +4074,7 @@ namespace libtorrent {
 				}
 
 				jobq.m_job_cond.wait(l);
-			} while (jobq.m_queued_jobs.empty());
+			} while (!jobq.m_queued_jobs.runnable());
 
 			threads.thread_active();
 		}
@@ -3051,18 +4093,71 @@ namespace libtorrent {
 
 		DLOG("started disk thread %s\n", thread_id_str.str().c_str());
 
+		if (m_thread_init)
+			m_thread_init(&queue == &m_hash_io_jobs ? "hash" : "disk");
+
 		std::unique_lock<std::mutex> l(m_job_mutex);
 		if (m_abort) return;
 
 		++m_num_running_threads;
 		m_stats_counters.inc_stats_counter(counters::num_running_threads, 1);
 
+		// the io_uring instance used by this thread, if the io_uring backend
+		// is enabled. It's created the first time it's needed
+		std::unique_ptr<aux::io_uring_batch> batch;
+
+		// the devices of the jobs being executed, to tell the queue once
+		// they're done
+		std::vector<std::uint8_t> devices;
+
 		for (;;)
 		{
 			disk_io_job* j = nullptr;
 			bool const should_exit = wait_for_job(queue, pool, l);
 			if (should_exit) break;
 			j = queue.m_queued_jobs.pop_front();
+			TORRENT_ASSERT(j != nullptr);
+			devices.clear();
+			devices.push_back(j->device);
+
+			// with the io_uring backend, pick up as many of the queued read
+			// jobs as we can, to issue them all at once
+			jobqueue_t read_jobs;
+			if (j->action == disk_io_job::read
+				&& cached_settings().disk_io_backend
+					== settings_pack::io_uring_disk_io)
+			{
+				int const max_batch = std::max(1, cached_settings().aio_max);
+				read_jobs.push_back(j);
+				while (read_jobs.size() < max_batch
+					&& queue.m_queued_jobs.first() != nullptr
+					&& queue.m_queued_jobs.first()->action == disk_io_job::read)
+				{
+					disk_io_job* rj = queue.m_queued_jobs.pop_front();
+					devices.push_back(rj->device);
+					read_jobs.push_back(rj);
+				}
+			}
+
+			// when several pieces are waiting to be hashed, pick up as many as
+			// there are SIMD lanes to hash them in
+			jobqueue_t hash_jobs;
+			int const hash_lanes = aux::hash_lanes();
+			if (j->action == disk_io_job::hash
+				&& hash_lanes > 1
+				&& queue.m_queued_jobs.first() != nullptr
+				&& queue.m_queued_jobs.first()->action == disk_io_job::hash)
+			{
+				hash_jobs.push_back(j);
+				while (hash_jobs.size() < hash_lanes
+					&& queue.m_queued_jobs.first() != nullptr
+					&& queue.m_queued_jobs.first()->action == disk_io_job::hash)
+				{
+					disk_io_job* hj = queue.m_queued_jobs.pop_front();
+					devices.push_back(hj->device);
+					hash_jobs.push_back(hj);
+				}
+			}
 			l.unlock();
 
 			TORRENT_ASSERT((j->flags & disk_io_job::in_progress) || !j->storage);
@@ -3082,7 +4177,7 @@ namespace libtorrent {
 
 				if (now > m_next_close_oldest_file)
 				{
-					seconds const interval(m_settings.get_int(settings_pack::close_file_interval));
+					seconds const interval(cached_settings().close_file_interval);
 					if (interval <= seconds(0))
 					{
 						m_next_close_oldest_file = max_time();
@@ -3095,9 +4190,35 @@ namespace libtorrent {
 				}
 			}
 
-			execute_job(j);
+			if (!read_jobs.empty())
+			{
+				if (!batch)
+				{
+					batch.reset(new aux::io_uring_batch(
+						std::max(1, cached_settings().aio_max)));
+				}
+				execute_read_batch(read_jobs, *batch);
+			}
+			else if (!hash_jobs.empty())
+			{
+				execute_hash_batch(hash_jobs);
+			}
+			else
+			{
+				execute_job(j);
+			}
 
 			l.lock();
+			for (auto const d : devices)
+				queue.m_queued_jobs.job_done(d);
+
+			// with a limit on the number of jobs per device, other threads may
+			// be waiting for a job of this device to finish
+			if (queue.m_queued_jobs.device_limit() > 0
+				&& !queue.m_queued_jobs.empty())
+			{
+				queue.m_job_cond.notify_all();
+			}
 		}
 
 		// do cleanup in the last running thread
@@ -3153,6 +4274,14 @@ namespace libtorrent {
 		TORRENT_ASSERT(m_magic == 0x1337);
 		TORRENT_ASSERT(!m_jobs_aborted.exchange(true));
 
+		// the files of removed torrents are still deleted. Their jobs complete
+		// like any other
+		m_deletions.drain();
+
+		// the blocks waiting to be written to the L2 cache are freed back to
+		// the block cache
+		m_l2_cache.abort();
+
 		jobqueue_t jobs;
 		m_disk_cache.clear(jobs);
 		fail_jobs(storage_error(boost::asio::error::operation_aborted), jobs);
@@ -3180,7 +4309,8 @@ namespace libtorrent {
 
 	disk_io_thread::job_queue& disk_io_thread::queue_for_job(disk_io_job* j)
 	{
-		if (m_hash_threads.max_threads() > 0 && j->action == disk_io_job::hash)
+		if (m_hash_threads.max_threads() > 0
+			&& (j->action == disk_io_job::hash || j->action == disk_io_job::hash_blocks))
 			return m_hash_io_jobs;
 		else
 			return m_generic_io_jobs;
@@ -3188,7 +4318,8 @@ namespace libtorrent {
 
 	disk_io_thread_pool& disk_io_thread::pool_for_job(disk_io_job* j)
 	{
-		if (m_hash_threads.max_threads() > 0 && j->action == disk_io_job::hash)
+		if (m_hash_threads.max_threads() > 0
+			&& (j->action == disk_io_job::hash || j->action == disk_io_job::hash_blocks))
 			return m_hash_threads;
 		else
 			return m_generic_threads;
@@ -3326,7 +4457,7 @@ namespace libtorrent {
 
 				if (!pe->hashing_done
 					&& pe->hash == nullptr
-					&& !m_settings.get_bool(settings_pack::disable_hash_checks))
+					&& !cached_settings().disable_hash_checks)
 				{
 					pe->hash.reset(new partial_hash);
 					m_disk_cache.update_cache_state(pe);
@@ -3366,31 +4497,50 @@ namespace libtorrent {
 			}
 		}
 
-		std::lock_guard<std::mutex> l(m_completed_jobs_mutex);
-		m_completed_jobs.append(jobs);
+		if (jobs.empty()) return;
 
-		if (!m_job_completions_in_flight)
+		// link the jobs in reverse order, and push them onto the completion
+		// stack as a single chain. call_job_handlers() reverses the whole
+		// stack, which restores the order the jobs completed in
+		disk_io_job* first = nullptr;
+		disk_io_job* const last = jobs.first();
+		for (disk_io_job* j = jobs.get_all(); j != nullptr;)
 		{
-			// we take this lock just to make the logging prettier (non-interleaved)
-			DLOG("posting job handlers (%d)\n", m_completed_jobs.size());
+			disk_io_job* const next = j->next;
+			j->next = first;
+			first = j;
+			j = next;
+		}
+
+		last->next = m_completed_jobs.load();
+		while (!m_completed_jobs.compare_exchange_weak(last->next, first));
 
+		if (!m_job_completions_in_flight.exchange(true))
+		{
+			DLOG("posting job handlers\n");
 			m_ios.post(std::bind(&disk_io_thread::call_job_handlers, this));
-			m_job_completions_in_flight = true;
 		}
 	}
 
 	// This is run in the network thread
 	void disk_io_thread::call_job_handlers()
 	{
-		std::unique_lock<std::mutex> l(m_completed_jobs_mutex);
-
-		DLOG("call_job_handlers (%d)\n", m_completed_jobs.size());
-
 		TORRENT_ASSERT(m_job_completions_in_flight);
+
+		// clear the flag before taking the jobs. Any job pushed after this
+		// point will post another call
 		m_job_completions_in_flight = false;
 
-		disk_io_job* j = m_completed_jobs.get_all();
-		l.unlock();
+		disk_io_job* j = nullptr;
+		for (disk_io_job* e = m_completed_jobs.exchange(nullptr); e != nullptr;)
+		{
+			disk_io_job* const next = e->next;
+			e->next = j;
+			j = e;
+			e = next;
+		}
+
+		DLOG("call_job_handlers\n");
 
 		aux::array<disk_io_job*, 64> to_delete;
 		int cnt = 0;
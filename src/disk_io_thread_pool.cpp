@@ -38,6 +38,11 @@ POSSIBILITY OF SUCH DAMAGE.
 namespace {
 
 	constexpr std::chrono::seconds reap_idle_threads_interval(60);
+	constexpr std::chrono::seconds scale_threads_interval(1);
+
+	// the number of intervals the pool isn't grown past the size where adding
+	// a thread didn't help
+	constexpr int ceiling_intervals = 30;
 }
 
 namespace libtorrent {
@@ -51,8 +56,71 @@ namespace libtorrent {
 		, m_num_idle_threads(0)
 		, m_min_idle_threads(0)
 		, m_idle_timer(ios)
+		, m_sample_jobs(0)
+		, m_sample_wait(0)
+		, m_sample_service(0)
+		, m_auto_scale(false)
+		, m_min_threads(1)
+		, m_scaler(1)
+		, m_target_threads(0)
+		, m_last_wait(0)
+		, m_scaled_up(0)
+		, m_scaled_down(0)
+		, m_scale_timer(ios)
 	{}
 
+	int disk_thread_scaler::update(int const jobs, std::int64_t const wait
+		, std::int64_t const service, std::int64_t const interval
+		, int const min_threads, int const max_threads)
+	{
+		TORRENT_ASSERT(min_threads <= max_threads);
+		int const threads = m_threads;
+
+		if (m_ceiling_intervals > 0 && --m_ceiling_intervals == 0)
+			m_ceiling = 0;
+		int const ceiling = m_ceiling > 0 ? std::min(m_ceiling, max_threads) : max_threads;
+
+		int step = 0;
+		if (jobs == 0)
+		{
+			// nothing to do, shrink towards the minimum
+			step = -1;
+		}
+		else
+		{
+			std::int64_t const avg_wait = wait / jobs;
+			std::int64_t const avg_service = service / jobs;
+			double const throughput = jobs * 1000000.0 / std::max(std::int64_t(1), interval);
+
+			if (m_last_step > 0
+				&& throughput < m_last_throughput * 1.05
+				&& avg_service > m_last_service + m_last_service / 4)
+			{
+				// the last thread added made jobs slower without completing
+				// more of them. The device is saturated, take it back
+				step = -1;
+				m_ceiling = threads - 1;
+				m_ceiling_intervals = ceiling_intervals;
+			}
+			else if (avg_wait > avg_service && threads < ceiling)
+			{
+				// jobs spend more time queued than being performed
+				step = 1;
+			}
+			else if (avg_wait < avg_service / 8)
+			{
+				step = -1;
+			}
+
+			m_last_throughput = throughput;
+			m_last_service = avg_service;
+		}
+
+		m_threads = std::max(min_threads, std::min(max_threads, threads + step));
+		m_last_step = m_threads - threads;
+		return m_threads;
+	}
+
 	disk_io_thread_pool::~disk_io_thread_pool()
 	{
 		abort(true);
@@ -63,10 +131,68 @@ namespace libtorrent {
 		std::lock_guard<std::mutex> l(m_mutex);
 		if (i == m_max_threads) return;
 		m_max_threads = i;
+		if (m_target_threads > i) m_target_threads = i;
 		if (int(m_threads.size()) < i) return;
 		stop_threads(int(m_threads.size()) - i);
 	}
 
+	void disk_io_thread_pool::set_auto_scale(bool const enable, int const min_threads)
+	{
+		std::lock_guard<std::mutex> l(m_mutex);
+		m_min_threads = std::max(1, min_threads);
+		if (enable == m_auto_scale) return;
+		m_auto_scale = enable;
+		if (!enable)
+		{
+			m_scale_timer.cancel();
+			return;
+		}
+
+		// start out at the full size, and let the latency bring it down
+		m_target_threads = m_max_threads.load();
+		m_scaler = disk_thread_scaler(m_max_threads);
+		m_sample_jobs = 0;
+		m_sample_wait = 0;
+		m_sample_service = 0;
+		if (!m_threads.empty()) start_scale_timer();
+	}
+
+	void disk_io_thread_pool::start_scale_timer()
+	{
+		m_last_scale = clock_type::now();
+		m_scale_timer.expires_from_now(scale_threads_interval);
+		m_scale_timer.async_wait([this](error_code const& ec) { scale_threads(ec); });
+	}
+
+	void disk_io_thread_pool::scale_threads(error_code const& ec)
+	{
+		if (ec) return;
+		std::lock_guard<std::mutex> l(m_mutex);
+		if (m_abort || !m_auto_scale) return;
+
+		time_point const now = clock_type::now();
+		std::int64_t const interval = total_microseconds(now - m_last_scale);
+		int const jobs = m_sample_jobs.exchange(0);
+		std::int64_t const wait = m_sample_wait.exchange(0);
+		std::int64_t const service = m_sample_service.exchange(0);
+		m_last_wait = jobs > 0 ? wait / jobs : 0;
+
+		int const max_threads = m_max_threads;
+		int const old_target = m_target_threads;
+		int const target = m_scaler.update(jobs, wait, service, interval
+			, std::min(m_min_threads, max_threads), max_threads);
+		m_target_threads = target;
+		if (target > old_target) ++m_scaled_up;
+		else if (target < old_target) ++m_scaled_down;
+
+		// threads above the target are asked to exit. New ones are only
+		// started by job_queued()
+		if (int(m_threads.size()) > target)
+			stop_threads(int(m_threads.size()) - target);
+
+		if (!m_threads.empty()) start_scale_timer();
+	}
+
 	void disk_io_thread_pool::abort(bool wait)
 	{
 		std::unique_lock<std::mutex> l(m_mutex);
@@ -74,6 +200,7 @@ namespace libtorrent {
 		m_max_threads = 0;
 		m_abort = true;
 		m_idle_timer.cancel();
+		m_scale_timer.cancel();
 		stop_threads(int(m_threads.size()));
 		for (auto& t : m_threads)
 		{
@@ -153,8 +280,11 @@ namespace libtorrent {
 
 		// now start threads until we either have enough to service
 		// all queued jobs without blocking or hit the max
+		int const max_threads = m_auto_scale
+			? std::max(1, int(m_target_threads))
+			: int(m_max_threads);
 		for (int i = m_num_idle_threads
-			; i < queue_size && int(m_threads.size()) < m_max_threads
+			; i < queue_size && int(m_threads.size()) < std::min(max_threads, int(m_max_threads))
 			; ++i)
 		{
 			// if this is the first thread started, start the reaper timer
@@ -162,6 +292,7 @@ namespace libtorrent {
 			{
 				m_idle_timer.expires_from_now(reap_idle_threads_interval);
 				m_idle_timer.async_wait([this](error_code const& ec) { reap_idle_threads(ec); });
+				if (m_auto_scale) start_scale_timer();
 			}
 
 			// work keeps the io_service::run() call blocked from returning.
@@ -35,6 +35,8 @@ POSSIBILITY OF SUCH DAMAGE.
 #include "libtorrent/disk_io_job.hpp"
 #include "libtorrent/performance_counters.hpp"
 
+#include <algorithm>
+
 #define DEBUG_STORAGE 0
 
 #if DEBUG_STORAGE
@@ -45,8 +47,78 @@ POSSIBILITY OF SUCH DAMAGE.
 
 namespace libtorrent { namespace aux {
 
+namespace {
+
+	// returns true if the job only operates on the piece j->piece, as
+	// opposed to the whole storage
+	bool piece_job(disk_io_job const* j)
+	{
+		switch (j->action)
+		{
+			case disk_io_job::read:
+			case disk_io_job::write:
+			case disk_io_job::hash:
+			case disk_io_job::flush_piece:
+			case disk_io_job::flush_hashed:
+			case disk_io_job::clear_piece:
+			case disk_io_job::hash_blocks:
+				return true;
+			default:
+				return false;
+		}
+	}
+
+	template <typename Fence>
+	bool overlaps(Fence const& f, bool const whole_storage, piece_index_t const piece)
+	{
+		return f.whole_storage || whole_storage || f.piece == piece;
+	}
+}
+
 	disk_job_fence::disk_job_fence() {}
 
+	std::vector<disk_job_fence::fence_entry>::iterator disk_job_fence::find_fence(
+		disk_io_job const* j)
+	{
+		auto const i = std::find_if(m_fences.begin(), m_fences.end()
+			, [j](fence_entry const& f) { return f.job == j; });
+		TORRENT_ASSERT(i != m_fences.end());
+		return i;
+	}
+
+	void disk_job_fence::add_outstanding(bool const whole_storage
+		, piece_index_t const piece)
+	{
+		++m_outstanding_jobs;
+		if (whole_storage) ++m_outstanding_storage_jobs;
+		else ++m_outstanding_pieces[piece];
+	}
+
+	void disk_job_fence::remove_outstanding(bool const whole_storage
+		, piece_index_t const piece)
+	{
+		TORRENT_ASSERT(m_outstanding_jobs > 0);
+		--m_outstanding_jobs;
+		if (whole_storage)
+		{
+			TORRENT_ASSERT(m_outstanding_storage_jobs > 0);
+			--m_outstanding_storage_jobs;
+			return;
+		}
+		auto const i = m_outstanding_pieces.find(piece);
+		TORRENT_ASSERT(i != m_outstanding_pieces.end());
+		if (i == m_outstanding_pieces.end()) return;
+		if (--i->second == 0) m_outstanding_pieces.erase(i);
+	}
+
+	bool disk_job_fence::has_outstanding(bool const whole_storage
+		, piece_index_t const piece) const
+	{
+		if (whole_storage) return m_outstanding_jobs > 0;
+		return m_outstanding_storage_jobs > 0
+			|| m_outstanding_pieces.count(piece) > 0;
+	}
+
 	int disk_job_fence::job_complete(disk_io_job* j, tailqueue<disk_io_job>& jobs)
 	{
 		std::lock_guard<std::mutex> l(m_mutex);
@@ -54,104 +126,136 @@ namespace libtorrent { namespace aux {
 		TORRENT_ASSERT(j->flags & disk_io_job::in_progress);
 		j->flags &= ~disk_io_job::in_progress;
 
-		TORRENT_ASSERT(m_outstanding_jobs > 0);
-		--m_outstanding_jobs;
+		bool whole_storage = !piece_job(j);
 		if (j->flags & disk_io_job::fence)
 		{
+			auto const f = find_fence(j);
+			TORRENT_ASSERT(f->running);
+			whole_storage = f->whole_storage;
+			m_fences.erase(f);
+			remove_outstanding(whole_storage, j->piece);
+
 			// a fence job just completed. Make sure the fence logic
 			// works by asserting m_outstanding_jobs is in fact 0 now
-			TORRENT_ASSERT(m_outstanding_jobs == 0);
-
-			// the fence can now be lowered
-			--m_has_fence;
+			TORRENT_ASSERT(!whole_storage || m_outstanding_jobs == 0);
 
 			// now we need to post all jobs that have been queued up
 			// while this fence was up. However, if there's another fence
 			// in the queue, stop there and raise the fence again
-			int ret = 0;
-			while (m_blocked_jobs.size())
+			return issue_blocked_jobs(jobs);
+		}
+
+		remove_outstanding(whole_storage, j->piece);
+
+		// if we don't have a fence that's waiting for this job to complete,
+		// we're done
+		bool const pending_fence = std::any_of(m_fences.begin(), m_fences.end()
+			, [=](fence_entry const& f)
+			{ return !f.running && overlaps(f, whole_storage, j->piece); });
+		if (!pending_fence) return 0;
+
+		// there may be a fence raised with no outstanding operations left.
+		// it means we can execute the fence job right now.
+		return issue_blocked_jobs(jobs);
+	}
+
+	int disk_job_fence::issue_blocked_jobs(tailqueue<disk_io_job>& jobs)
+	{
+		int ret = 0;
+
+		// the jobs that are still blocked, in order
+		tailqueue<disk_io_job> blocked;
+		blocked.swap(m_blocked_jobs);
+
+		// the indices into m_fences of the fence jobs we have passed in the
+		// blocked queue that are still blocked. Jobs queued after them that
+		// they overlap must stay blocked
+		std::vector<std::size_t> pending;
+
+		while (!blocked.empty())
+		{
+			disk_io_job* bj = blocked.pop_front();
+
+			if (bj->flags & disk_io_job::fence)
 			{
-				disk_io_job *bj = static_cast<disk_io_job*>(m_blocked_jobs.pop_front());
-				if (bj->flags & disk_io_job::fence)
+				auto const f = find_fence(bj);
+				TORRENT_ASSERT(!f->running);
+
+				// the fence can be raised once nothing it overlaps is running,
+				// and there are no earlier fences it overlaps
+				bool const wait = has_outstanding(f->whole_storage, f->piece)
+					|| std::any_of(m_fences.begin(), f, [&](fence_entry const& e)
+						{ return overlaps(e, f->whole_storage, f->piece); });
+
+				if (wait)
 				{
-					// we encountered another fence. We cannot post anymore
-					// jobs from the blocked jobs queue. We have to go back
-					// into a raised fence mode and wait for all current jobs
-					// to complete. The exception is that if there are no jobs
-					// executing currently, we should add the fence job.
-					if (m_outstanding_jobs == 0 && jobs.empty())
-					{
-						TORRENT_ASSERT((bj->flags & disk_io_job::in_progress) == 0);
-						bj->flags |= disk_io_job::in_progress;
-						++m_outstanding_jobs;
-						++ret;
-#if TORRENT_USE_ASSERTS
-						TORRENT_ASSERT(bj->blocked);
-						bj->blocked = false;
-#endif
-						jobs.push_back(bj);
-					}
-					else
+					m_blocked_jobs.push_back(bj);
+					if (f->whole_storage)
 					{
-						// put the fence job back in the blocked queue
-						m_blocked_jobs.push_front(bj);
+						// nothing can get past this fence
+						m_blocked_jobs.append(blocked);
+						break;
 					}
-					return ret;
+					pending.push_back(std::size_t(f - m_fences.begin()));
+					continue;
 				}
+
+				f->running = true;
 				TORRENT_ASSERT((bj->flags & disk_io_job::in_progress) == 0);
 				bj->flags |= disk_io_job::in_progress;
-
-				++m_outstanding_jobs;
+				add_outstanding(f->whole_storage, f->piece);
 				++ret;
 #if TORRENT_USE_ASSERTS
 				TORRENT_ASSERT(bj->blocked);
 				bj->blocked = false;
 #endif
-				jobs.push_back(bj);
+				// prioritize fence jobs since they're blocking other jobs
+				jobs.push_front(bj);
+				continue;
 			}
-			return ret;
-		}
-
-		// there are still outstanding jobs, even if we have a
-		// fence, it's not time to lower it yet
-		// also, if we don't have a fence, we're done
-		if (m_outstanding_jobs > 0 || m_has_fence == 0) return 0;
 
-		// there's a fence raised, and no outstanding operations.
-		// it means we can execute the fence job right now.
-		TORRENT_ASSERT(m_blocked_jobs.size() > 0);
+			bool const whole_storage = !piece_job(bj);
+			bool const wait = std::any_of(m_fences.begin(), m_fences.end()
+				, [&](fence_entry const& e)
+				{ return e.running && overlaps(e, whole_storage, bj->piece); })
+				|| std::any_of(pending.begin(), pending.end(), [&](std::size_t const e)
+				{ return overlaps(m_fences[e], whole_storage, bj->piece); });
 
-		// this is the fence job
-		disk_io_job *bj = static_cast<disk_io_job*>(m_blocked_jobs.pop_front());
-		TORRENT_ASSERT(bj->flags & disk_io_job::fence);
-
-		TORRENT_ASSERT((bj->flags & disk_io_job::in_progress) == 0);
-		bj->flags |= disk_io_job::in_progress;
+			if (wait)
+			{
+				m_blocked_jobs.push_back(bj);
+				continue;
+			}
 
-		++m_outstanding_jobs;
+			TORRENT_ASSERT((bj->flags & disk_io_job::in_progress) == 0);
+			bj->flags |= disk_io_job::in_progress;
+			add_outstanding(whole_storage, bj->piece);
+			++ret;
 #if TORRENT_USE_ASSERTS
-		TORRENT_ASSERT(bj->blocked);
-		bj->blocked = false;
+			TORRENT_ASSERT(bj->blocked);
+			bj->blocked = false;
 #endif
-		// prioritize fence jobs since they're blocking other jobs
-		jobs.push_front(bj);
-		return 1;
+			jobs.push_back(bj);
+		}
+		return ret;
 	}
 
 	bool disk_job_fence::is_blocked(disk_io_job* j)
 	{
 		std::lock_guard<std::mutex> l(m_mutex);
-		DLOG(stderr, "[%p] is_blocked: fence: %d num_outstanding: %d\n"
-			, static_cast<void*>(this), m_has_fence, int(m_outstanding_jobs));
+		DLOG(stderr, "[%p] is_blocked: fences: %d num_outstanding: %d\n"
+			, static_cast<void*>(this), int(m_fences.size()), int(m_outstanding_jobs));
 
 		// if this is the job that raised the fence, don't block it
 		// ignore fence can only ignore one fence. If there are several,
 		// this job still needs to get queued up
-		if (m_has_fence == 0)
+		bool const whole_storage = !piece_job(j);
+		if (std::none_of(m_fences.begin(), m_fences.end()
+			, [&](fence_entry const& f) { return overlaps(f, whole_storage, j->piece); }))
 		{
 			TORRENT_ASSERT((j->flags & disk_io_job::in_progress) == 0);
 			j->flags |= disk_io_job::in_progress;
-			++m_outstanding_jobs;
+			add_outstanding(whole_storage, j->piece);
 			return false;
 		}
 
@@ -168,7 +272,7 @@ namespace libtorrent { namespace aux {
 	bool disk_job_fence::has_fence() const
 	{
 		std::lock_guard<std::mutex> l(m_mutex);
-		return m_has_fence != 0;
+		return !m_fences.empty();
 	}
 
 	int disk_job_fence::num_blocked() const
@@ -182,18 +286,39 @@ namespace libtorrent { namespace aux {
 	// this job
 	int disk_job_fence::raise_fence(disk_io_job* j, disk_io_job* fj
 		, counters& cnt)
+	{
+		return raise_fence_impl(j, fj, cnt, true);
+	}
+
+	// j is the fence job. It must have exclusive access to the piece j->piece
+	// fj is the flush job for that piece
+	int disk_job_fence::raise_piece_fence(disk_io_job* j, disk_io_job* fj
+		, counters& cnt)
+	{
+		TORRENT_ASSERT(piece_job(j));
+		TORRENT_ASSERT(piece_job(fj));
+		TORRENT_ASSERT(fj->piece == j->piece);
+		return raise_fence_impl(j, fj, cnt, false);
+	}
+
+	int disk_job_fence::raise_fence_impl(disk_io_job* j, disk_io_job* fj
+		, counters& cnt, bool const whole_storage)
 	{
 		TORRENT_ASSERT((j->flags & disk_io_job::fence) == 0);
 		j->flags |= disk_io_job::fence;
 
 		std::lock_guard<std::mutex> l(m_mutex);
 
-		DLOG(stderr, "[%p] raise_fence: fence: %d num_outstanding: %d\n"
-			, static_cast<void*>(this), m_has_fence, int(m_outstanding_jobs));
+		DLOG(stderr, "[%p] raise_fence: fences: %d num_outstanding: %d\n"
+			, static_cast<void*>(this), int(m_fences.size()), int(m_outstanding_jobs));
 
-		if (m_has_fence == 0 && m_outstanding_jobs == 0)
+		piece_index_t const piece = j->piece;
+		bool const fence_ahead = std::any_of(m_fences.begin(), m_fences.end()
+			, [&](fence_entry const& f) { return overlaps(f, whole_storage, piece); });
+
+		if (!fence_ahead && !has_outstanding(whole_storage, piece))
 		{
-			++m_has_fence;
+			m_fences.push_back({j, piece, whole_storage, true});
 			DLOG(stderr, "[%p] raise_fence: need posting\n"
 				, static_cast<void*>(this));
 
@@ -203,12 +328,12 @@ namespace libtorrent { namespace aux {
 
 			// fj is expected to be discarded by the caller
 			j->flags |= disk_io_job::in_progress;
-			++m_outstanding_jobs;
+			add_outstanding(whole_storage, piece);
 			return fence_post_fence;
 		}
 
-		++m_has_fence;
-		if (m_has_fence > 1)
+		m_fences.push_back({j, piece, whole_storage, false});
+		if (fence_ahead)
 		{
 #if TORRENT_USE_ASSERTS
 			TORRENT_ASSERT(fj->blocked == false);
@@ -221,7 +346,7 @@ namespace libtorrent { namespace aux {
 		{
 			// in this case, fj is expected to be put on the job queue
 			fj->flags |= disk_io_job::in_progress;
-			++m_outstanding_jobs;
+			add_outstanding(!piece_job(fj), fj->piece);
 		}
 #if TORRENT_USE_ASSERTS
 		TORRENT_ASSERT(j->blocked == false);
@@ -230,8 +355,7 @@ namespace libtorrent { namespace aux {
 		m_blocked_jobs.push_back(j);
 		cnt.inc_stats_counter(counters::blocked_disk_jobs);
 
-		return m_has_fence > 1 ? fence_post_none : fence_post_flush;
+		return fence_ahead ? fence_post_none : fence_post_flush;
 	}
 
 }}
-
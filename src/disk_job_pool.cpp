@@ -62,6 +62,7 @@ namespace libtorrent {
 
 		new (ptr) disk_io_job;
 		ptr->action = static_cast<disk_io_job::action_t>(type);
+		ptr->issued = clock_type::now();
 #if TORRENT_USE_ASSERTS
 		ptr->in_use = true;
 #endif
@@ -76,6 +76,7 @@ POSSIBILITY OF SUCH DAMAGE.
 
 // for convert_to_wstring and convert_to_native
 #include "libtorrent/aux_/escape_string.hpp"
+#include "libtorrent/allocator.hpp" // for page_aligned_allocator
 #include "libtorrent/assert.hpp"
 #include "libtorrent/aux_/throw.hpp"
 
@@ -523,6 +524,12 @@ namespace libtorrent {
 		close();
 		native_path_string file_path = convert_to_native_path_string(path);
 
+#if !TORRENT_USE_DIRECT_IO
+		// without direct I/O, the closest we can get is to not let the
+		// file's pages linger in the OS cache
+		if (mode & direct_io) mode = (mode & ~direct_io) | no_cache;
+#endif
+
 #ifdef TORRENT_WINDOWS
 
 		struct open_mode_t
@@ -617,6 +624,9 @@ namespace libtorrent {
 #endif
 #ifdef O_SYNC
 			| ((mode & no_cache) ? O_SYNC : 0)
+#endif
+#if TORRENT_USE_DIRECT_IO
+			| ((mode & direct_io) ? O_DIRECT : 0)
 #endif
 			;
 
@@ -635,6 +645,17 @@ namespace libtorrent {
 			handle = ::open(file_path.c_str(), mode_array[mode & rw_mask] | open_mode
 				, permissions);
 		}
+#endif
+#if TORRENT_USE_DIRECT_IO
+		// not all filesystems support O_DIRECT (tmpfs on older kernels,
+		// for instance). fall back to regular I/O for those
+		if (handle == -1 && (mode & direct_io) && errno == EINVAL)
+		{
+			mode &= ~direct_io;
+			open_mode &= ~O_DIRECT;
+			handle = ::open(file_path.c_str(), mode_array[mode & rw_mask] | open_mode
+				, permissions);
+		}
 #endif
 		if (handle == -1)
 		{
@@ -946,8 +967,188 @@ typedef struct _FILE_ALLOCATED_RANGE_BUFFER {
 #endif // USE_PREADV
 	}
 
+#if TORRENT_USE_DIRECT_IO
+	// O_DIRECT requires file offsets, buffer addresses and transfer sizes to
+	// be multiples of the logical block size of the device. 4 kiB covers
+	// every device we care about and matches the page alignment of the
+	// buffers handed out by disk_buffer_pool, which means all block aligned
+	// operations on regular torrents take the fast path
+	std::int64_t const direct_io_alignment = 4096;
+
+	std::int64_t align_down(std::int64_t const v)
+	{ return v & ~(direct_io_alignment - 1); }
+
+	std::int64_t align_up(std::int64_t const v)
+	{ return align_down(v + direct_io_alignment - 1); }
+
+	bool direct_io_aligned(std::int64_t const file_offset, span<iovec_t const> bufs)
+	{
+		if (file_offset != align_down(file_offset)) return false;
+		for (auto const& b : bufs)
+		{
+			if ((reinterpret_cast<std::uintptr_t>(b.iov_base) | b.iov_len)
+				& std::uintptr_t(direct_io_alignment - 1))
+				return false;
+		}
+		return true;
+	}
+
+	// a page aligned scratch buffer to bounce unaligned direct I/O through
+	struct aligned_buffer
+	{
+		explicit aligned_buffer(std::int64_t const s)
+			: data(page_aligned_allocator::malloc(int(s))) {}
+		~aligned_buffer() { if (data) page_aligned_allocator::free(data); }
+		aligned_buffer(aligned_buffer const&) = delete;
+		aligned_buffer& operator=(aligned_buffer const&) = delete;
+		char* data;
+	};
+
+	bool set_direct_io(handle_type const fd, bool const enable)
+	{
+		int const flags = ::fcntl(fd, F_GETFL);
+		if (flags == -1) return false;
+		return ::fcntl(fd, F_SETFL, enable ? (flags | O_DIRECT) : (flags & ~O_DIRECT)) == 0;
+	}
+
+	// read exactly one aligned block at offset, zero filling anything past
+	// the end of the file
+	bool read_block(handle_type const fd, char* buf, std::int64_t const offset
+		, error_code& ec)
+	{
+		auto const ret = ::pread(fd, buf, std::size_t(direct_io_alignment), offset);
+		if (ret < 0)
+		{
+			ec.assign(errno, system_category());
+			return false;
+		}
+		std::memset(buf + ret, 0, std::size_t(direct_io_alignment - ret));
+		return true;
+	}
+#endif // TORRENT_USE_DIRECT_IO
+
 	} // anonymous namespace
 
+#if TORRENT_USE_DIRECT_IO
+	std::int64_t file::direct_readv(std::int64_t const file_offset
+		, span<iovec_t const> bufs, error_code& ec)
+	{
+		std::int64_t const size = bufs_size(bufs);
+		std::int64_t const start = align_down(file_offset);
+		std::int64_t const len = align_up(file_offset + size) - start;
+
+		aligned_buffer buf(len);
+		if (buf.data == nullptr)
+		{
+			ec = error_code(boost::system::errc::not_enough_memory, generic_category());
+			return -1;
+		}
+
+		auto const ret = ::pread(native_handle(), buf.data, std::size_t(len), start);
+		if (ret < 0)
+		{
+			ec.assign(errno, system_category());
+			return -1;
+		}
+
+		// a short read means we hit the end of the file
+		std::int64_t const head = file_offset - start;
+		if (ret <= head) return 0;
+		std::int64_t const copied = std::min(std::int64_t(ret) - head, size);
+
+		char const* src = buf.data + head;
+		std::int64_t left = copied;
+		for (auto const& b : bufs)
+		{
+			if (left == 0) break;
+			std::size_t const n = std::size_t(std::min(std::int64_t(b.iov_len), left));
+			std::memcpy(b.iov_base, src, n);
+			src += n;
+			left -= std::int64_t(n);
+		}
+		return copied;
+	}
+
+	std::int64_t file::direct_writev(std::int64_t const file_offset
+		, span<iovec_t const> bufs, error_code& ec)
+	{
+		std::int64_t const size = bufs_size(bufs);
+		std::int64_t const start = align_down(file_offset);
+		std::int64_t const end = align_up(file_offset + size);
+		handle_type const fd = native_handle();
+
+		// the partial blocks at either end are read, patched and written
+		// back. Two such cycles touching the same block must not interleave
+		std::lock_guard<std::mutex> l(m_direct_io_mutex);
+
+		struct stat st;
+		if (::fstat(fd, &st) != 0)
+		{
+			ec.assign(errno, system_category());
+			return -1;
+		}
+
+		if (end > st.st_size)
+		{
+			// padding out the last block would grow the file past its end
+			// and truncating it back afterwards could race with other
+			// writes extending the file. Instead, write this one through
+			// the page cache and drop the pages again right away. Clearing
+			// O_DIRECT is harmless for concurrent aligned operations on this
+			// descriptor, they're merely buffered while it's cleared
+			if (!set_direct_io(fd, false))
+			{
+				ec.assign(errno, system_category());
+				return -1;
+			}
+#if TORRENT_USE_PREADV
+			std::int64_t const ret = iov(&::pwritev, fd, file_offset, bufs, ec);
+#else
+			std::int64_t const ret = iov(&::pwrite, fd, file_offset, bufs, ec);
+#endif
+			if (ret > 0)
+			{
+				::fdatasync(fd);
+				::posix_fadvise(fd, file_offset, ret, POSIX_FADV_DONTNEED);
+			}
+			if (!set_direct_io(fd, true) && !ec)
+				ec.assign(errno, system_category());
+			return ret;
+		}
+
+		aligned_buffer buf(end - start);
+		if (buf.data == nullptr)
+		{
+			ec = error_code(boost::system::errc::not_enough_memory, generic_category());
+			return -1;
+		}
+
+		std::int64_t const head = file_offset - start;
+		std::int64_t const tail_block = end - direct_io_alignment;
+		if (head != 0 && !read_block(fd, buf.data, start, ec))
+			return -1;
+		if (file_offset + size != end && (tail_block != start || head == 0)
+			&& !read_block(fd, buf.data + (tail_block - start), tail_block, ec))
+			return -1;
+
+		char* dst = buf.data + head;
+		for (auto const& b : bufs)
+		{
+			std::memcpy(dst, b.iov_base, b.iov_len);
+			dst += b.iov_len;
+		}
+
+		auto const ret = ::pwrite(fd, buf.data, std::size_t(end - start), start);
+		if (ret < 0)
+		{
+			ec.assign(errno, system_category());
+			return -1;
+		}
+		if (ret <= head) return 0;
+		return std::min(std::int64_t(ret) - head, size);
+	}
+#endif // TORRENT_USE_DIRECT_IO
+
 	// this has to be thread safe and atomic. i.e. on posix systems it has to be
 	// turned into a series of pread() calls
 	std::int64_t file::readv(std::int64_t file_offset, span<iovec_t const> bufs
@@ -966,6 +1167,11 @@ typedef struct _FILE_ALLOCATED_RANGE_BUFFER {
 		TORRENT_ASSERT(!bufs.empty());
 		TORRENT_ASSERT(is_open());
 
+#if TORRENT_USE_DIRECT_IO
+		if ((m_open_mode & direct_io) && !direct_io_aligned(file_offset, bufs))
+			return direct_readv(file_offset, bufs, ec);
+#endif
+
 #if TORRENT_USE_PREADV
 		TORRENT_UNUSED(flags);
 
@@ -1022,6 +1228,11 @@ typedef struct _FILE_ALLOCATED_RANGE_BUFFER {
 
 		ec.clear();
 
+#if TORRENT_USE_DIRECT_IO
+		if ((m_open_mode & direct_io) && !direct_io_aligned(file_offset, bufs))
+			return direct_writev(file_offset, bufs, ec);
+#endif
+
 #if TORRENT_USE_PREADV
 		TORRENT_UNUSED(flags);
 
@@ -1283,6 +1494,27 @@ typedef struct _FILE_ALLOCATED_RANGE_BUFFER {
 		return true;
 	}
 
+	bool file::reserve(std::int64_t const offset, std::int64_t const len
+		, error_code& ec)
+	{
+		TORRENT_ASSERT(is_open());
+		TORRENT_ASSERT(offset >= 0);
+		TORRENT_ASSERT(len > 0);
+#if TORRENT_HAS_FALLOCATE && defined TORRENT_LINUX && !defined TORRENT_ANDROID
+		// unlike posix_fallocate(), this never falls back to writing zeroes
+		// to the file
+		if (fallocate(native_handle(), 0, offset, len) == 0) return true;
+		if (errno != EOPNOTSUPP && errno != ENOSYS)
+			ec.assign(errno, system_category());
+		return false;
+#else
+		TORRENT_UNUSED(offset);
+		TORRENT_UNUSED(len);
+		TORRENT_UNUSED(ec);
+		return false;
+#endif
+	}
+
 	std::int64_t file::get_size(error_code& ec) const
 	{
 #ifdef TORRENT_WINDOWS
@@ -1346,10 +1578,16 @@ typedef struct _FILE_ALLOCATED_RANGE_BUFFER {
 		return buffer.FileOffset.QuadPart;
 
 #elif defined SEEK_DATA
-		// this is supported on solaris
-		std::int64_t ret = lseek(native_handle(), start, SEEK_DATA);
-		if (ret < 0) return start;
-		return start;
+		// this is supported on solaris, linux and the BSDs
+		std::int64_t const ret = lseek(native_handle(), start, SEEK_DATA);
+		if (ret >= 0) return ret;
+
+		// ENXIO means there is no data at or after start
+		if (errno != ENXIO) return start;
+		error_code ec;
+		std::int64_t const file_size = get_size(ec);
+		if (ec) return start;
+		return std::max(start, file_size);
 #else
 		return start;
 #endif
@@ -44,12 +44,32 @@ POSSIBILITY OF SUCH DAMAGE.
 #endif
 
 #include <limits>
+#include <algorithm>
+#include <tuple>
 
 namespace libtorrent {
 
+	constexpr int file_pool::num_shards;
+
 	file_pool::file_pool(int size) : m_size(size) {}
 	file_pool::~file_pool() = default;
 
+	std::uint64_t file_pool::file_key(storage_index_t const st, file_index_t const f)
+	{
+		return (std::uint64_t(static_cast<std::uint32_t>(st)) << 32)
+			| std::uint32_t(static_cast<int>(f));
+	}
+
+	file_pool::shard& file_pool::shard_for(storage_index_t const st)
+	{
+		return m_shards[std::size_t(static_cast<std::uint32_t>(st) & (num_shards - 1))];
+	}
+
+	file_pool::shard const& file_pool::shard_for(storage_index_t const st) const
+	{
+		return m_shards[std::size_t(static_cast<std::uint32_t>(st) & (num_shards - 1))];
+	}
+
 #ifdef TORRENT_WINDOWS
 	void set_low_priority(file_handle const& f)
 	{
@@ -108,24 +128,35 @@ namespace libtorrent {
 		// time. We don't want to hold the std::mutex for that.
 		file_handle defer_destruction;
 
-		std::unique_lock<std::mutex> l(m_mutex);
-
 #if TORRENT_USE_ASSERTS
-		// we're not allowed to open a file
-		// from a deleted storage!
-		TORRENT_ASSERT(std::find(m_deleted_storages.begin(), m_deleted_storages.end()
-			, std::make_pair(fs.name(), static_cast<void const*>(&fs)))
-			== m_deleted_storages.end());
+		{
+			// we're not allowed to open a file
+			// from a deleted storage!
+			std::unique_lock<std::mutex> dl(m_deleted_mutex);
+			TORRENT_ASSERT(std::find(m_deleted_storages.begin(), m_deleted_storages.end()
+				, std::make_pair(fs.name(), static_cast<void const*>(&fs)))
+				== m_deleted_storages.end());
+		}
 #endif
 
 		TORRENT_ASSERT(is_complete(p));
 		TORRENT_ASSERT((m & file::rw_mask) == file::read_only
 			|| (m & file::rw_mask) == file::read_write);
-		auto const i = m_files.find(std::make_pair(st, file_index));
-		if (i != m_files.end())
+
+		shard& s = shard_for(st);
+		std::uint64_t const key = file_key(st, file_index);
+		std::unique_lock<std::mutex> l(s.mutex);
+
+		auto const i = s.files.find(key);
+		if (i != s.files.end())
 		{
 			lru_file_entry& e = i->second;
 			e.last_use = aux::time_now();
+			if (s.lru.front() != &e)
+			{
+				s.lru.erase(&e);
+				s.lru.push_front(&e);
+			}
 
 			// if we asked for a file in write mode,
 			// and the cached file is is not opened in
@@ -152,30 +183,34 @@ namespace libtorrent {
 			return e.file_ptr;
 		}
 
-		lru_file_entry e;
-		e.file_ptr = std::make_shared<file>();
-		if (!e.file_ptr)
+		file_handle file_ptr = std::make_shared<file>();
+		if (!file_ptr)
 		{
 			ec = error_code(boost::system::errc::not_enough_memory, generic_category());
 			return file_handle();
 		}
 		std::string full_path = fs.file_path(file_index, p);
-		if (!e.file_ptr->open(full_path, m, ec))
+		if (!file_ptr->open(full_path, m, ec))
 			return file_handle();
 #ifdef TORRENT_WINDOWS
 		if (m_low_prio_io)
-			set_low_priority(e.file_ptr);
+			set_low_priority(file_ptr);
 #endif
-		e.mode = m;
-		file_handle file_ptr = e.file_ptr;
-		m_files.insert(std::make_pair(std::make_pair(st, file_index), e));
 		TORRENT_ASSERT(file_ptr->is_open());
 
-		if (int(m_files.size()) >= m_size)
+		lru_file_entry& e = s.files.emplace(std::piecewise_construct
+			, std::forward_as_tuple(key), std::forward_as_tuple(key)).first->second;
+		e.file_ptr = file_ptr;
+		e.mode = m;
+		s.lru.push_front(&e);
+		int const num_files = ++m_num_files;
+		l.unlock();
+
+		if (num_files >= m_size)
 		{
 			// the file cache is at its maximum size, close
 			// the least recently used (lru) file from it
-			remove_oldest(l);
+			remove_oldest();
 		}
 		return file_ptr;
 	}
@@ -211,47 +246,65 @@ namespace libtorrent {
 	{
 		std::vector<open_file_state> ret;
 		{
-			std::unique_lock<std::mutex> l(m_mutex);
+			shard const& s = shard_for(st);
+			std::unique_lock<std::mutex> l(s.mutex);
 
-			auto const start = m_files.lower_bound(std::make_pair(st, file_index_t(0)));
-			auto const end = m_files.upper_bound(std::make_pair(st
-				, std::numeric_limits<file_index_t>::max()));
-
-			for (auto i = start; i != end; ++i)
+			for (auto const& i : s.files)
 			{
-				ret.push_back({i->first.second, to_file_open_mode(i->second.mode)
-					, i->second.last_use});
+				if ((i.first >> 32) != static_cast<std::uint32_t>(st)) continue;
+				ret.push_back({file_index_t(int(i.first & 0xffffffff))
+					, to_file_open_mode(i.second.mode), i.second.last_use});
 			}
 		}
+		std::sort(ret.begin(), ret.end(), [](open_file_state const& lhs
+			, open_file_state const& rhs) { return lhs.file_index < rhs.file_index; });
 		return ret;
 	}
 
-	void file_pool::remove_oldest(std::unique_lock<std::mutex>& l)
+	file_handle file_pool::remove_entry(shard& s, lru_file_entry& e)
 	{
-		using value_type = decltype(m_files)::value_type;
-		auto const i = std::min_element(m_files.begin(), m_files.end()
-			, [] (value_type const& lhs, value_type const& rhs)
-				{ return lhs.second.last_use < rhs.second.last_use; });
-		if (i == m_files.end()) return;
+		file_handle file_ptr = std::move(e.file_ptr);
+		s.lru.erase(&e);
+		s.files.erase(e.key);
+		--m_num_files;
+		return file_ptr;
+	}
 
-		file_handle file_ptr = i->second.file_ptr;
-		m_files.erase(i);
+	void file_pool::remove_oldest()
+	{
+		// the least recently used file of each shard is at the back of its
+		// lru list. Pick the one that was used the longest time ago
+		shard* oldest = nullptr;
+		time_point oldest_use = time_point::max();
+		for (auto& s : m_shards)
+		{
+			std::unique_lock<std::mutex> l(s.mutex);
+			if (s.lru.empty()) continue;
+			if (s.lru.back()->last_use >= oldest_use) continue;
+			oldest_use = s.lru.back()->last_use;
+			oldest = &s;
+		}
+		if (oldest == nullptr) return;
 
-		// closing a file may be long running operation (mac os x)
-		l.unlock();
-		file_ptr.reset();
-		l.lock();
+		file_handle file_ptr;
+		{
+			std::unique_lock<std::mutex> l(oldest->mutex);
+			if (oldest->lru.empty()) return;
+			file_ptr = remove_entry(*oldest, *oldest->lru.back());
+		}
+		// closing a file may be long running operation (mac os x), it's
+		// closed here, without holding the mutex
 	}
 
 	void file_pool::release(storage_index_t const st, file_index_t file_index)
 	{
-		std::unique_lock<std::mutex> l(m_mutex);
+		shard& s = shard_for(st);
+		std::unique_lock<std::mutex> l(s.mutex);
 
-		auto const i = m_files.find(std::make_pair(st, file_index));
-		if (i == m_files.end()) return;
+		auto const i = s.files.find(file_key(st, file_index));
+		if (i == s.files.end()) return;
 
-		file_handle file_ptr = i->second.file_ptr;
-		m_files.erase(i);
+		file_handle file_ptr = remove_entry(s, i->second);
 
 		// closing a file may take a long time (mac os x), so make sure
 		// we're not holding the mutex
@@ -263,23 +316,31 @@ namespace libtorrent {
 	// storage, or all if none is specified.
 	void file_pool::release()
 	{
-		std::unique_lock<std::mutex> l(m_mutex);
-		m_files.clear();
-		l.unlock();
+		for (auto& s : m_shards)
+		{
+			std::unique_lock<std::mutex> l(s.mutex);
+			std::unordered_map<std::uint64_t, lru_file_entry> to_close;
+			to_close.swap(s.files);
+			m_num_files -= int(to_close.size());
+			s.lru.get_all();
+			l.unlock();
+			// the files are closed here while the lock is not held
+		}
 	}
 
 	void file_pool::release(storage_index_t const st)
 	{
-		std::unique_lock<std::mutex> l(m_mutex);
-
-		auto const begin = m_files.lower_bound(std::make_pair(st, file_index_t(0)));
-		auto const end = m_files.upper_bound(std::make_pair(st
-				, std::numeric_limits<file_index_t>::max()));
+		shard& s = shard_for(st);
+		std::unique_lock<std::mutex> l(s.mutex);
 
 		std::vector<file_handle> to_close;
-		for (auto it = begin; it != end; ++it)
-			to_close.push_back(std::move(it->second.file_ptr));
-		if (!to_close.empty()) m_files.erase(begin, end);
+		for (auto it = s.files.begin(); it != s.files.end();)
+		{
+			lru_file_entry& e = it->second;
+			++it;
+			if ((e.key >> 32) != static_cast<std::uint32_t>(st)) continue;
+			to_close.push_back(remove_entry(s, e));
+		}
 		l.unlock();
 		// the files are closed here while the lock is not held
 	}
@@ -287,7 +348,7 @@ namespace libtorrent {
 #if TORRENT_USE_ASSERTS
 	void file_pool::mark_deleted(file_storage const& fs)
 	{
-		std::unique_lock<std::mutex> l(m_mutex);
+		std::unique_lock<std::mutex> l(m_deleted_mutex);
 		m_deleted_storages.push_back(std::make_pair(fs.name()
 			, static_cast<void const*>(&fs)));
 		if(m_deleted_storages.size() > 100)
@@ -296,11 +357,13 @@ namespace libtorrent {
 
 	bool file_pool::assert_idle_files(storage_index_t const st) const
 	{
-		std::unique_lock<std::mutex> l(m_mutex);
+		shard const& s = shard_for(st);
+		std::unique_lock<std::mutex> l(s.mutex);
 
-		for (auto const& i : m_files)
+		for (auto const& i : s.files)
 		{
-			if (i.first.first == st && !i.second.file_ptr.unique())
+			if ((i.first >> 32) == static_cast<std::uint32_t>(st)
+				&& !i.second.file_ptr.unique())
 				return false;
 		}
 		return true;
@@ -309,35 +372,43 @@ namespace libtorrent {
 
 	void file_pool::resize(int size)
 	{
-		std::unique_lock<std::mutex> l(m_mutex);
-
 		TORRENT_ASSERT(size > 0);
 
-		if (size == m_size) return;
-		m_size = size;
-		if (int(m_files.size()) <= m_size) return;
+		if (m_size.exchange(size) == size) return;
 
 		// close the least recently used files
-		while (int(m_files.size()) > m_size)
-			remove_oldest(l);
+		while (m_num_files > size)
+			remove_oldest();
 	}
 
 	void file_pool::close_oldest()
 	{
-		std::unique_lock<std::mutex> l(m_mutex);
-
-		using value_type = decltype(m_files)::value_type;
-		auto const i = std::min_element(m_files.begin(), m_files.end()
-			, [] (value_type const& lhs, value_type const& rhs)
-				{ return lhs.second.opened < rhs.second.opened; });
-		if (i == m_files.end()) return;
-
-		file_handle file_ptr = i->second.file_ptr;
-		m_files.erase(i);
+		// this is only called once every few seconds, scanning the files for
+		// the one opened first is cheap enough
+		shard* oldest = nullptr;
+		std::uint64_t oldest_key = 0;
+		time_point oldest_open = time_point::max();
+		for (auto& s : m_shards)
+		{
+			std::unique_lock<std::mutex> l(s.mutex);
+			for (auto const& i : s.files)
+			{
+				if (i.second.opened >= oldest_open) continue;
+				oldest_open = i.second.opened;
+				oldest_key = i.first;
+				oldest = &s;
+			}
+		}
+		if (oldest == nullptr) return;
 
-		// closing a file may be long running operation (mac os x)
-		l.unlock();
-		file_ptr.reset();
-		l.lock();
+		file_handle file_ptr;
+		{
+			std::unique_lock<std::mutex> l(oldest->mutex);
+			auto const i = oldest->files.find(oldest_key);
+			if (i == oldest->files.end()) return;
+			file_ptr = remove_entry(*oldest, i->second);
+		}
+		// closing a file may be long running operation (mac os x), it's
+		// closed here, without holding the mutex
 	}
 }
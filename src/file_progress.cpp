@@ -31,6 +31,7 @@ POSSIBILITY OF SUCH DAMAGE.
 */
 
 #include "libtorrent/piece_picker.hpp"
+#include "libtorrent/piece_block.hpp"
 #include "libtorrent/file_storage.hpp"
 #include "libtorrent/alert_manager.hpp"
 #include "libtorrent/aux_/file_progress.hpp"
@@ -43,7 +44,8 @@ namespace libtorrent { namespace aux {
 	{
 	}
 
-	void file_progress::init(piece_picker const& picker, file_storage const& fs)
+	void file_progress::init(piece_picker const& picker, file_storage const& fs
+		, int const block_size)
 	{
 		INVARIANT_CHECK;
 
@@ -63,6 +65,14 @@ namespace libtorrent { namespace aux {
 
 		m_file_progress.resize(num_files, 0);
 		std::fill(m_file_progress.begin(), m_file_progress.end(), 0);
+		m_block_progress.resize(num_files, 0);
+		std::fill(m_block_progress.begin(), m_block_progress.end(), 0);
+
+		TORRENT_ASSERT(block_size > 0);
+		m_block_size = block_size;
+		m_blocks_per_piece = (fs.piece_length() + block_size - 1) / block_size;
+		m_downloaded_blocks.resize(fs.num_pieces() * m_blocks_per_piece, false);
+		m_downloaded_blocks.clear_all();
 
 		// initialize the progress of each file
 
@@ -113,13 +123,30 @@ namespace libtorrent { namespace aux {
 				}
 			}
 		}
+
+		// and the blocks of pieces still being downloaded
+		for (auto const& dp : picker.get_download_queue())
+		{
+			int idx = 0;
+			for (auto const& info : picker.blocks_for_piece(dp))
+			{
+				if (info.state == piece_picker::block_info::state_writing
+					|| info.state == piece_picker::block_info::state_finished)
+					add_block(fs, piece_block(dp.index, idx));
+				++idx;
+			}
+		}
 	}
 
-	void file_progress::export_progress(vector<std::int64_t, file_index_t>& fp)
+	void file_progress::export_progress(vector<std::int64_t, file_index_t>& fp
+		, bool const blocks)
 	{
 		INVARIANT_CHECK;
 		fp.resize(m_file_progress.size(), 0);
 		std::copy(m_file_progress.begin(), m_file_progress.end(), fp.begin());
+		if (!blocks) return;
+		for (file_index_t i(0); i < fp.end_index(); ++i)
+			fp[i] += m_block_progress[i];
 	}
 
 	void file_progress::clear()
@@ -127,6 +154,9 @@ namespace libtorrent { namespace aux {
 		INVARIANT_CHECK;
 		m_file_progress.clear();
 		m_file_progress.shrink_to_fit();
+		m_block_progress.clear();
+		m_block_progress.shrink_to_fit();
+		m_downloaded_blocks.clear();
 #if TORRENT_USE_INVARIANT_CHECKS
 		m_have_pieces.clear();
 #endif
@@ -148,6 +178,9 @@ namespace libtorrent { namespace aux {
 		m_have_pieces.set_bit(index);
 #endif
 
+		// the blocks of this piece are now accounted for by the whole piece
+		remove_piece_blocks(fs, index);
+
 		int const piece_size = fs.piece_length();
 		std::int64_t off = std::int64_t(static_cast<int>(index)) * piece_size;
 		file_index_t file_index = fs.file_index_at_offset(off);
@@ -182,6 +215,91 @@ namespace libtorrent { namespace aux {
 		}
 	}
 
+	void file_progress::add_block(file_storage const& fs, piece_block const b)
+	{
+		INVARIANT_CHECK;
+		if (m_file_progress.empty()) return;
+
+		int const bit = static_cast<int>(b.piece_index) * m_blocks_per_piece
+			+ b.block_index;
+		if (m_downloaded_blocks.get_bit(bit)) return;
+		m_downloaded_blocks.set_bit(bit);
+		account_block(fs, b, 1);
+	}
+
+	void file_progress::remove_block(file_storage const& fs, piece_block const b)
+	{
+		INVARIANT_CHECK;
+		if (m_file_progress.empty()) return;
+
+		int const bit = static_cast<int>(b.piece_index) * m_blocks_per_piece
+			+ b.block_index;
+		if (!m_downloaded_blocks.get_bit(bit)) return;
+		m_downloaded_blocks.clear_bit(bit);
+		account_block(fs, b, -1);
+	}
+
+	void file_progress::remove_piece_blocks(file_storage const& fs
+		, piece_index_t const index)
+	{
+		if (m_file_progress.empty()) return;
+
+		int const num_blocks = (fs.piece_size(index) + m_block_size - 1)
+			/ m_block_size;
+		for (int i = 0; i < num_blocks; ++i)
+			remove_block(fs, piece_block(index, i));
+	}
+
+	void file_progress::add_block_bytes(file_storage const& fs
+		, vector<std::int64_t, file_index_t>& fp
+		, piece_block const b, int const bytes) const
+	{
+		TORRENT_ASSERT(bytes >= 0);
+		TORRENT_ASSERT(bytes <= m_block_size);
+		TORRENT_ASSERT(fp.end_index() == fs.end_file());
+
+		std::int64_t off = std::int64_t(static_cast<int>(b.piece_index))
+			* fs.piece_length() + std::int64_t(b.block_index) * m_block_size;
+		std::int64_t size = std::min(std::int64_t(bytes), fs.total_size() - off);
+		if (size <= 0) return;
+		file_index_t file_index = fs.file_index_at_offset(off);
+		for (; size > 0; ++file_index)
+		{
+			TORRENT_ASSERT(file_index != fs.end_file());
+			std::int64_t const file_offset = off - fs.file_offset(file_index);
+			std::int64_t const add = std::min(fs.file_size(file_index)
+				- file_offset, size);
+			fp[file_index] += add;
+			size -= add;
+			off += add;
+		}
+	}
+
+	void file_progress::account_block(file_storage const& fs
+		, piece_block const b, int const sign)
+	{
+		int const block_start = b.block_index * m_block_size;
+		int const block_bytes = std::min(m_block_size
+			, fs.piece_size(b.piece_index) - block_start);
+		TORRENT_ASSERT(block_bytes > 0);
+
+		std::int64_t off = std::int64_t(static_cast<int>(b.piece_index))
+			* fs.piece_length() + block_start;
+		std::int64_t size = block_bytes;
+		file_index_t file_index = fs.file_index_at_offset(off);
+		for (; size > 0; ++file_index)
+		{
+			TORRENT_ASSERT(file_index != fs.end_file());
+			std::int64_t const file_offset = off - fs.file_offset(file_index);
+			std::int64_t const add = std::min(fs.file_size(file_index)
+				- file_offset, size);
+			m_block_progress[file_index] += sign * add;
+			TORRENT_ASSERT(m_block_progress[file_index] >= 0);
+			size -= add;
+			off += add;
+		}
+	}
+
 #if TORRENT_USE_INVARIANT_CHECKS
 	void file_progress::check_invariant() const
 	{
@@ -190,7 +308,9 @@ namespace libtorrent { namespace aux {
 		file_index_t index(0);
 		for (std::int64_t progress : m_file_progress)
 		{
-			TORRENT_ASSERT(progress <= m_file_sizes[index++]);
+			TORRENT_ASSERT(progress + m_block_progress[index]
+				<= m_file_sizes[index]);
+			++index;
 		}
 	}
 #endif
@@ -99,6 +99,30 @@ namespace {
 		{
 			return lhs.offset < rhs.offset;
 		}
+
+		// FNV-1a, for the path index
+		std::size_t hash_path(char const* p, int const len)
+		{
+			std::uint32_t h = 2166136261u;
+			for (int i = 0; i < len; ++i)
+			{
+				h ^= std::uint8_t(p[i]);
+				h *= 16777619u;
+			}
+			return h;
+		}
+	}
+
+	void file_storage::set_entry_name(internal_file_entry& e, string_view const n)
+	{
+		// names that don't fit in the length field (and empty ones, which
+		// don't need any storage) are allocated separately
+		if (n.empty() || n.size() >= internal_file_entry::name_is_owned)
+		{
+			e.set_name(n.to_string().c_str());
+			return;
+		}
+		e.set_name(m_name_pool.copy(n), true, int(n.size()));
 	}
 
 	// path is not supposed to include the name of the torrent itself.
@@ -108,7 +132,7 @@ namespace {
 		if (is_complete(path))
 		{
 			TORRENT_ASSERT(set_name);
-			e.set_name(path.c_str());
+			set_entry_name(e, path);
 			e.path_index = -2;
 			return;
 		}
@@ -133,7 +157,7 @@ namespace {
 		}
 		if (branch_len <= 0)
 		{
-			if (set_name) e.set_name(leaf);
+			if (set_name) set_entry_name(e, leaf);
 			e.path_index = -1;
 			return;
 		}
@@ -154,14 +178,17 @@ namespace {
 		}
 
 		// do we already have this path in the path list?
-		auto p = std::find_if(m_paths.rbegin(), m_paths.rend()
-			, [&] (std::string const& str)
+		std::size_t const h = hash_path(branch_path, branch_len);
+		auto const range = m_path_index.equal_range(h);
+		auto const p = std::find_if(range.first, range.second
+			, [&] (std::pair<std::size_t const, int> const& i)
 			{
+				std::string const& str = m_paths[i.second];
 				if (int(str.size()) != branch_len) return false;
 				return std::memcmp(str.c_str(), branch_path, aux::numeric_cast<std::size_t>(branch_len)) == 0;
 			});
 
-		if (p == m_paths.rend())
+		if (p == range.second)
 		{
 			// no, we don't. add it
 			e.path_index = int(m_paths.size());
@@ -170,13 +197,14 @@ namespace {
 			// poor man's emplace back
 			m_paths.resize(m_paths.size() + 1);
 			m_paths.back().assign(branch_path, aux::numeric_cast<std::size_t>(branch_len));
+			m_path_index.emplace(h, e.path_index);
 		}
 		else
 		{
 			// yes we do. use it
-			e.path_index = int(p.base() - m_paths.begin() - 1);
+			e.path_index = p->second;
 		}
-		if (set_name) e.set_name(leaf);
+		if (set_name) set_entry_name(e, leaf);
 	}
 
 #ifndef TORRENT_NO_DEPRECATE
@@ -242,7 +270,7 @@ namespace {
 		return *this;
 	}
 
-	internal_file_entry::internal_file_entry(internal_file_entry&& fe)
+	internal_file_entry::internal_file_entry(internal_file_entry&& fe) noexcept
 		: offset(fe.offset)
 		, symlink_index(fe.symlink_index)
 		, no_root_dir(fe.no_root_dir)
@@ -259,7 +287,7 @@ namespace {
 		fe.name = nullptr;
 	}
 
-	internal_file_entry& internal_file_entry::operator=(internal_file_entry&& fe)
+	internal_file_entry& internal_file_entry::operator=(internal_file_entry&& fe) noexcept
 	{
 		offset = fe.offset;
 		size = fe.size;
@@ -319,11 +347,35 @@ namespace {
 		return name ? string_view(name) : string_view();
 	}
 
+	std::size_t file_storage::memory_usage() const
+	{
+		std::size_t ret = sizeof(*this)
+			+ m_files.capacity() * sizeof(internal_file_entry)
+			+ m_file_offsets.capacity() * sizeof(std::int64_t)
+			+ m_piece_first_file.capacity() * sizeof(file_index_t)
+			+ m_file_hashes.capacity() * sizeof(char const*)
+			+ m_symlinks.capacity() * sizeof(std::string)
+			+ m_mtime.capacity() * sizeof(std::time_t)
+#ifndef TORRENT_NO_DEPRECATE
+			+ m_file_base.capacity() * sizeof(std::int64_t)
+#endif
+			+ m_paths.capacity() * sizeof(std::string)
+			+ m_path_index.size() * (sizeof(std::pair<std::size_t const, int>) + sizeof(void*))
+			+ m_path_index.bucket_count() * sizeof(void*)
+			+ m_name_pool.memory_usage()
+			+ m_name.capacity();
+		for (auto const& s : m_symlinks) ret += s.capacity();
+		for (auto const& s : m_paths) ret += s.capacity();
+		return ret;
+	}
+
 	void file_storage::apply_pointer_offset(std::ptrdiff_t const off)
 	{
 		for (auto& f : m_files)
 		{
 			if (f.name_len == internal_file_entry::name_is_owned) continue;
+			// names in the pool don't point into the backing buffer
+			if (m_name_pool.owns(f.name)) continue;
 			f.name += off;
 		}
 
@@ -404,17 +456,49 @@ namespace {
 
 	file_index_t file_storage::file_index_at_offset(std::int64_t const offset) const
 	{
-		// find the file iterator and file offset
-		internal_file_entry target;
-		target.offset = aux::numeric_cast<std::uint64_t>(offset);
-		TORRENT_ASSERT(!compare_file_offset(target, m_files.front()));
+		piece_index_t const piece = m_piece_first_file.empty()
+			? piece_index_t(0) : piece_index_t(int(offset / m_piece_length));
+		return file_index_at(piece, offset);
+	}
 
-		auto file_iter = std::upper_bound(
-			m_files.begin(), m_files.end(), target, compare_file_offset);
+	file_index_t file_storage::file_index_at(piece_index_t const piece
+		, std::int64_t const offset) const
+	{
+		TORRENT_ASSERT(m_file_offsets.size() == m_files.size());
+		TORRENT_ASSERT(!m_file_offsets.empty());
+		TORRENT_ASSERT(offset >= m_file_offsets.front());
 
-		TORRENT_ASSERT(file_iter != m_files.begin());
-		--file_iter;
-		return file_index_t(int(file_iter - m_files.begin()));
+		auto begin = m_file_offsets.begin();
+		auto end = m_file_offsets.end();
+		if (!m_piece_first_file.empty() && piece < m_piece_first_file.end_index())
+		{
+			TORRENT_ASSERT(offset >= static_cast<int>(piece) * std::int64_t(m_piece_length));
+			TORRENT_ASSERT(offset < (static_cast<int>(piece) + 1) * std::int64_t(m_piece_length));
+			begin += static_cast<int>(m_piece_first_file[piece]);
+			if (next(piece) < m_piece_first_file.end_index())
+				end = m_file_offsets.begin()
+					+ static_cast<int>(m_piece_first_file[next(piece)]) + 1;
+		}
+
+		auto const i = std::upper_bound(begin, end, offset);
+		TORRENT_ASSERT(i != m_file_offsets.begin());
+		return file_index_t(int(i - m_file_offsets.begin()) - 1);
+	}
+
+	void file_storage::build_piece_index()
+	{
+		m_piece_first_file.clear();
+		if (m_files.size() <= 1 || m_piece_length <= 0 || m_num_pieces <= 0)
+			return;
+
+		m_piece_first_file.reserve(std::size_t(m_num_pieces));
+		file_index_t f(0);
+		for (piece_index_t p(0); p < end_piece(); ++p)
+		{
+			std::int64_t const off = static_cast<int>(p) * std::int64_t(m_piece_length);
+			while (next(f) < end_file() && m_file_offsets[next(f)] <= off) ++f;
+			m_piece_first_file.push_back(f);
+		}
 	}
 
 	char const* file_storage::file_name_ptr(file_index_t const index) const
@@ -438,22 +522,21 @@ namespace {
 		if (m_files.empty()) return ret;
 
 		// find the file iterator and file offset
-		internal_file_entry target;
-		target.offset = aux::numeric_cast<std::uint64_t>(static_cast<int>(piece) * std::int64_t(m_piece_length) + offset);
-		TORRENT_ASSERT_PRECOND(std::int64_t(target.offset) + size <= m_total_size);
-		TORRENT_ASSERT(!compare_file_offset(target, m_files.front()));
+		std::int64_t const target = static_cast<int>(piece) * std::int64_t(m_piece_length) + offset;
+		TORRENT_ASSERT_PRECOND(target + size <= m_total_size);
 
 		// in case the size is past the end, fix it up
-		if (std::int64_t(target.offset) + size > m_total_size)
-			size = aux::numeric_cast<int>(m_total_size - std::int64_t(target.offset));
+		if (target + size > m_total_size)
+			size = aux::numeric_cast<int>(m_total_size - target);
 
-		auto file_iter = std::upper_bound(
-			m_files.begin(), m_files.end(), target, compare_file_offset);
+		// offset may point past the end of the piece
+		piece_index_t const p = offset < m_piece_length ? piece
+			: piece_index_t(int(target / m_piece_length));
 
-		TORRENT_ASSERT(file_iter != m_files.begin());
-		--file_iter;
+		file_index_t const first = file_index_at(p, target);
+		auto file_iter = m_files.begin() + static_cast<int>(first);
 
-		std::int64_t file_offset = target.offset - file_iter->offset;
+		std::int64_t file_offset = target - m_file_offsets[first];
 		for (; size > 0; file_offset -= file_iter->size, ++file_iter)
 		{
 			TORRENT_ASSERT(file_iter != m_files.end());
@@ -584,6 +667,8 @@ namespace {
 
 		e.size = aux::numeric_cast<std::uint64_t>(file_size);
 		e.offset = aux::numeric_cast<std::uint64_t>(m_total_size);
+		m_file_offsets.push_back(m_total_size);
+		m_piece_first_file.clear();
 		e.pad_file = (file_flags & file_storage::flag_pad_file) != 0;
 		e.hidden_attribute = (file_flags & file_storage::flag_hidden) != 0;
 		e.executable_attribute = (file_flags & file_storage::flag_executable) != 0;
@@ -1072,6 +1157,12 @@ namespace {
 			}
 		}
 		m_total_size = off;
+
+		m_file_offsets.clear();
+		m_file_offsets.reserve(m_files.size());
+		for (auto const& f : m_files)
+			m_file_offsets.push_back(std::int64_t(f.offset));
+		m_piece_first_file.clear();
 	}
 
 	void file_storage::add_pad_file(int const size
@@ -1091,7 +1182,7 @@ namespace {
 		std::snprintf(name, sizeof(name), ".pad" TORRENT_SEPARATOR_STR "%d"
 			, pad_file_counter);
 		std::string path = combine_path(m_name, name);
-		e.set_name(path.c_str());
+		set_entry_name(e, path);
 		e.pad_file = true;
 		offset += size;
 		++pad_file_counter;
@@ -0,0 +1,119 @@
+/*
+
+Copyright (c) 2017, Arvid Norberg
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions
+are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in
+      the documentation and/or other materials provided with the distribution.
+    * Neither the name of the author nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+
+#include "libtorrent/aux_/frequency_sketch.hpp"
+
+#include <algorithm>
+
+namespace libtorrent { namespace aux {
+
+namespace {
+
+	// scrambles the bits of the key, so that keys differing only in a few
+	// bits (i.e. piece indices) end up in unrelated counters
+	std::uint64_t spread(std::uint64_t x)
+	{
+		x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+		x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+		return x ^ (x >> 31);
+	}
+
+	std::uint64_t const seeds[] = {
+		0xc3a5c85c97cb3127ULL, 0xb492b66fbe98f273ULL
+		, 0x9ae16a3b2f90404fULL, 0xcbf29ce484222325ULL };
+}
+
+	frequency_sketch::frequency_sketch(int const capacity)
+	{
+		resize(capacity);
+	}
+
+	void frequency_sketch::resize(int const capacity)
+	{
+		int const cap = std::max(capacity, 16);
+		std::size_t size = 1;
+		while (size < std::size_t(cap)) size <<= 1;
+		m_table.assign(size, 0);
+		m_sample_size = cap * 10;
+		m_additions = 0;
+	}
+
+	int frequency_sketch::index_of(std::uint64_t const hash, int const row) const
+	{
+		std::uint64_t x = (hash + seeds[row]) * seeds[row];
+		x += x >> 32;
+		return int(x & (m_table.size() - 1));
+	}
+
+	void frequency_sketch::increment(std::uint64_t const key)
+	{
+		std::uint64_t const hash = spread(key);
+
+		// each row uses a different one of the 16 counters in the word,
+		// picked by the low bits of the hash
+		int const start = int(hash & 3) << 2;
+		bool added = false;
+		for (int row = 0; row < 4; ++row)
+		{
+			std::uint64_t& word = m_table[std::size_t(index_of(hash, row))];
+			int const offset = (start + row) << 2;
+			if (((word >> offset) & 0xf) == 0xf) continue;
+			word += std::uint64_t(1) << offset;
+			added = true;
+		}
+
+		if (added && ++m_additions >= m_sample_size) reset();
+	}
+
+	int frequency_sketch::estimate(std::uint64_t const key) const
+	{
+		std::uint64_t const hash = spread(key);
+		int const start = int(hash & 3) << 2;
+		int ret = 0xf;
+		for (int row = 0; row < 4; ++row)
+		{
+			std::uint64_t const word = m_table[std::size_t(index_of(hash, row))];
+			int const offset = (start + row) << 2;
+			ret = std::min(ret, int((word >> offset) & 0xf));
+		}
+		return ret;
+	}
+
+	void frequency_sketch::reset()
+	{
+		// halve every counter
+		for (auto& word : m_table)
+			word = (word >> 1) & 0x7777777777777777ULL;
+		m_additions /= 2;
+	}
+}}
@@ -34,6 +34,7 @@ POSSIBILITY OF SUCH DAMAGE.
 #include "libtorrent/puff.hpp"
 #include "libtorrent/gzip.hpp"
 
+#include <algorithm>
 #include <vector>
 #include <string>
 
@@ -210,41 +211,57 @@ namespace {
 			return;
 		}
 
-		// start off with 4 kilobytes and grow
-		// if needed
-		unsigned long destlen = 4096;
-		int ret = 0;
-		unsigned long srclen = std::uint32_t(size - header_len);
+		unsigned long const input_len = std::uint32_t(size - header_len);
 		in += header_len;
 
-		do
-		{
-			TORRENT_TRY {
-				buffer.resize(destlen);
-			} TORRENT_CATCH (std::exception const&) {
-				ec = errors::no_memory;
-				return;
-			}
+		// guess the inflated size from the compressed size (bencoded
+		// responses rarely compress better than 4:1), so most responses are
+		// inflated in a single pass
+		unsigned long destlen = std::min(std::uint32_t(maximum_size)
+			, std::max(std::uint32_t(4096), std::uint32_t(input_len * 4)));
+		unsigned long srclen = input_len;
+
+		TORRENT_TRY {
+			buffer.resize(destlen);
+		} TORRENT_CATCH (std::exception const&) {
+			ec = errors::no_memory;
+			return;
+		}
+
+		int ret = puff(reinterpret_cast<unsigned char*>(buffer.data()), &destlen
+			, reinterpret_cast<const unsigned char*>(in), &srclen);
 
-			ret = puff(reinterpret_cast<unsigned char*>(&buffer[0]), &destlen
+		// 1: output space exhausted before completing inflate. Rather than
+		// growing the buffer and starting over repeatedly, scan the stream
+		// (without writing anything) to find its exact size, up to the
+		// maximum, and inflate it once more into a buffer of that size
+		if (ret == 1 && destlen < std::uint32_t(maximum_size))
+		{
+			destlen = std::uint32_t(maximum_size);
+			srclen = input_len;
+			ret = puff(nullptr, &destlen
 				, reinterpret_cast<const unsigned char*>(in), &srclen);
 
-			// if the destination buffer wasn't large enough, double its
-			// size and try again. Unless it's already at its max, in which
-			// case we fail
-			if (ret == 1) // 1:  output space exhausted before completing inflate
+			if (ret == 0)
 			{
-				if (destlen == std::uint32_t(maximum_size))
-				{
-					ec = gzip_errors::inflated_data_too_large;
+				TORRENT_TRY {
+					buffer.resize(destlen);
+				} TORRENT_CATCH (std::exception const&) {
+					ec = errors::no_memory;
 					return;
 				}
 
-				destlen *= 2;
-				if (destlen > std::uint32_t(maximum_size))
-					destlen = std::uint32_t(maximum_size);
+				srclen = input_len;
+				ret = puff(reinterpret_cast<unsigned char*>(buffer.data()), &destlen
+					, reinterpret_cast<const unsigned char*>(in), &srclen);
 			}
-		} while (ret == 1);
+		}
+
+		if (ret == 1)
+		{
+			ec = gzip_errors::inflated_data_too_large;
+			return;
+		}
 
 		if (ret != 0)
 		{
@@ -34,6 +34,7 @@ POSSIBILITY OF SUCH DAMAGE.
 #include "libtorrent/error_code.hpp"
 #include "libtorrent/assert.hpp"
 #include "libtorrent/aux_/openssl.hpp"
+#include <algorithm> // for min
 
 namespace libtorrent {
 
@@ -149,6 +150,51 @@ namespace libtorrent {
 #endif
 	}
 
+namespace aux {
+
+	int hash_lanes()
+	{
+#if defined TORRENT_USE_LIBGCRYPT \
+	|| TORRENT_USE_COMMONCRYPTO \
+	|| TORRENT_USE_CRYPTOAPI \
+	|| defined TORRENT_USE_LIBCRYPTO
+		return 1;
+#else
+		return SHA1_multi_lanes();
+#endif
+	}
+
+	void update_multi(span<hasher* const> hashers
+		, span<char const* const> data, int const len)
+	{
+		TORRENT_ASSERT(hashers.size() == data.size());
+		TORRENT_ASSERT(len > 0);
+#if defined TORRENT_USE_LIBGCRYPT \
+	|| TORRENT_USE_COMMONCRYPTO \
+	|| TORRENT_USE_CRYPTOAPI \
+	|| defined TORRENT_USE_LIBCRYPTO
+		for (std::size_t i = 0; i < hashers.size(); ++i)
+			hashers[i]->update(data[i], len);
+#else
+		// groups of 8, the widest SHA1_update_multi() goes
+		sha1_ctx* ctx[8];
+		std::uint8_t const* buf[8];
+		std::size_t i = 0;
+		while (i < hashers.size())
+		{
+			int const n = int(std::min(hashers.size() - i, std::size_t(8)));
+			for (int k = 0; k < n; ++k)
+			{
+				ctx[k] = &hashers[i + std::size_t(k)]->m_context;
+				buf[k] = reinterpret_cast<std::uint8_t const*>(data[i + std::size_t(k)]);
+			}
+			SHA1_update_multi(ctx, buf, std::size_t(len), n);
+			i += std::size_t(n);
+		}
+#endif
+	}
+}
+
 #ifdef TORRENT_MACOS_DEPRECATED_LIBCRYPTO
 #pragma clang diagnostic pop
 #endif
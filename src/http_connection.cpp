@@ -96,6 +96,9 @@ http_connection::http_connection(io_service& ios
 	, m_ssl(false)
 	, m_abort(false)
 	, m_connecting(false)
+	, m_keep_alive(false)
+	, m_reusable(false)
+	, m_reused(false)
 {
 	TORRENT_ASSERT(m_handler);
 }
@@ -210,7 +213,10 @@ void http_connection::get(std::string const& url, time_duration timeout, int pri
 	if (!auth.empty())
 		APPEND_FMT1("Authorization: Basic %s\r\n", base64encode(auth).c_str());
 
-	APPEND_FMT("Connection: close\r\n\r\n");
+	if (m_keep_alive)
+		APPEND_FMT("Connection: keep-alive\r\n\r\n");
+	else
+		APPEND_FMT("Connection: close\r\n\r\n");
 
 	m_sendbuffer.assign(request);
 	m_url = url;
@@ -252,6 +258,8 @@ void http_connection::start(std::string const& hostname, int port
 	m_timer.async_wait(std::bind(&http_connection::on_timeout
 		, std::weak_ptr<http_connection>(me), _1));
 	m_called = false;
+	m_reusable = false;
+	m_reused = false;
 	m_parser.reset();
 	m_recvbuffer.clear();
 	m_read_pos = 0;
@@ -267,6 +275,9 @@ void http_connection::start(std::string const& hostname, int port
 	if (m_sock.is_open() && m_hostname == hostname && m_port == port
 		&& m_ssl == ssl && m_bind_addr == bind_addr)
 	{
+		m_reused = true;
+		m_last_receive = clock_type::now();
+		m_start_time = m_last_receive;
 		ADD_OUTSTANDING_ASYNC("http_connection::on_write");
 		async_write(m_sock, boost::asio::buffer(m_sendbuffer)
 			, std::bind(&http_connection::on_write, me, _1));
@@ -474,6 +485,40 @@ void http_connection::close(bool force)
 	m_abort = true;
 }
 
+bool http_connection::can_reuse() const
+{
+	return m_reusable && !m_abort && m_sock.is_open();
+}
+
+void http_connection::set_handlers(http_handler const& handler
+	, http_connect_handler const& ch
+	, http_filter_handler const& fh)
+{
+	m_handler = handler;
+	m_connect_handler = ch;
+	m_filter_handler = fh;
+}
+
+void http_connection::reconnect()
+{
+	TORRENT_ASSERT(m_reused);
+	TORRENT_ASSERT(!m_sendbuffer.empty());
+
+	error_code ec;
+	m_sock.close(ec);
+
+	// the socket is closed now, so start() will open a new connection
+	// rather than reusing this one. m_hostname is assigned to by start(),
+	// so pass in a copy
+	std::string const hostname = m_hostname;
+	start(hostname, m_port, m_completion_timeout, m_priority, &m_proxy
+		, m_ssl, m_redirects, m_bind_addr, m_resolve_flags
+#if TORRENT_USE_I2P
+		, m_i2p_conn
+#endif
+		);
+}
+
 #if TORRENT_USE_I2P
 void http_connection::connect_i2p_tracker(char const* destination)
 {
@@ -663,6 +708,12 @@ void http_connection::on_write(error_code const& e)
 
 	if (e == boost::asio::error::operation_aborted) return;
 
+	if (e && m_reused && !m_abort)
+	{
+		reconnect();
+		return;
+	}
+
 	if (e)
 	{
 		callback(e);
@@ -671,7 +722,9 @@ void http_connection::on_write(error_code const& e)
 
 	if (m_abort) return;
 
-	std::string().swap(m_sendbuffer);
+	// hold on to the request until we know the reused connection is still
+	// alive, in case we need to send it again
+	if (!m_reused) std::string().swap(m_sendbuffer);
 	m_recvbuffer.resize(4096);
 
 	int amount_to_read = int(m_recvbuffer.size()) - m_read_pos;
@@ -714,6 +767,21 @@ void http_connection::on_read(error_code const& e
 	// deletes this object
 	std::shared_ptr<http_connection> me(shared_from_this());
 
+	// a keep-alive connection may have been closed by the server while it
+	// was idle, in which case we'll see EOF (or a reset) before receiving
+	// any of the response
+	if (e && m_reused && m_read_pos == 0)
+	{
+		reconnect();
+		return;
+	}
+
+	if (!e && m_reused)
+	{
+		m_reused = false;
+		std::string().swap(m_sendbuffer);
+	}
+
 	// when using the asio SSL wrapper, it seems like
 	// we get the shut_down error instead of EOF
 	if (e == boost::asio::error::eof || e == boost::asio::error::shut_down)
@@ -803,7 +871,20 @@ void http_connection::on_read(error_code const& e
 			m_timer.cancel(ec);
 			span<char> body(m_recvbuffer.data() + m_parser.body_start()
 				, m_parser.get_body().size());
+
+			// the connection can only be reused if the server wants to keep
+			// it open and we haven't received anything past the end of the
+			// response
+			bool const reuse = m_keep_alive
+				&& !m_parser.connection_close()
+				&& (m_parser.chunked_encoding()
+					|| m_read_pos == m_parser.body_start() + int(body.size()));
+			m_reusable = reuse;
 			callback(e, body.data(), int(body.size()));
+
+			// the connection is left idle. Don't issue another read, the
+			// handler may already have started a new request on it
+			if (reuse) return;
 		}
 	}
 	else
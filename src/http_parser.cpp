@@ -128,10 +128,65 @@ namespace libtorrent {
 		return url;
 	}
 
+	namespace {
+
+		char const* const known_header_names[] = {
+			"content-length",
+			"content-range",
+			"content-type",
+			"content-encoding",
+			"transfer-encoding",
+			"connection",
+			"location",
+			"retry-after",
+			"server"
+		};
+
+		static_assert(sizeof(known_header_names) / sizeof(known_header_names[0])
+			== http_parser::num_known_headers, "known header names out of sync");
+
+		// returns num_known_headers if the name isn't one of the known ones
+		int find_known_header(string_view const name)
+		{
+			for (int i = 0; i < http_parser::num_known_headers; ++i)
+			{
+				if (string_equal_no_case(name, known_header_names[i])) return i;
+			}
+			return http_parser::num_known_headers;
+		}
+	}
+
+	char const* http_parser::known_header_name(known_header_t const h)
+	{
+		TORRENT_ASSERT(h >= 0 && h < num_known_headers);
+		return known_header_names[h];
+	}
+
 	http_parser::~http_parser() = default;
 
 	http_parser::http_parser(int const flags) : m_flags(flags) {}
 
+	std::string const& http_parser::header(char const* key) const
+	{
+		static std::string const empty;
+		if (m_flags & known_headers_only)
+		{
+			int const h = find_known_header(key);
+			if (h == num_known_headers) return empty;
+			return m_known_headers[std::size_t(h)];
+		}
+		auto const i = m_header.find(key);
+		if (i == m_header.end()) return empty;
+		return i->second;
+	}
+
+	std::string const& http_parser::header(known_header_t const h) const
+	{
+		TORRENT_ASSERT(h >= 0 && h < num_known_headers);
+		if (m_flags & known_headers_only) return m_known_headers[std::size_t(h)];
+		return header(known_header_names[h]);
+	}
+
 	std::tuple<int, int> http_parser::incoming(
 		span<char const> recv_buffer, bool& error)
 	{
@@ -213,21 +268,20 @@ restart_response:
 			TORRENT_ASSERT(!m_finished);
 			TORRENT_ASSERT(pos <= recv_buffer.end());
 			char const* newline = std::find(pos, recv_buffer.end(), '\n');
-			std::string line;
 
 			while (newline != recv_buffer.end() && m_state == read_header)
 			{
 				// if the LF character is preceded by a CR
-				// character, don't copy it into the line string.
+				// character, it's not part of the line
+				char const* const line = pos;
 				char const* line_end = newline;
 				if (pos != line_end && *(line_end - 1) == '\r') --line_end;
-				line.assign(pos, line_end);
 				++newline;
 				m_recv_pos += newline - pos;
 				pos = newline;
 
-				std::string::size_type separator = line.find(':');
-				if (separator == std::string::npos)
+				char const* separator = std::find(line, line_end, ':');
+				if (separator == line_end)
 				{
 					if (m_status_code == 100)
 					{
@@ -249,17 +303,40 @@ restart_response:
 					break;
 				}
 
-				std::string name = line.substr(0, separator);
-				std::transform(name.begin(), name.end(), name.begin(), &to_lower);
-				++separator;
+				string_view const name(line, std::size_t(separator - line));
+				char const* value_start = separator + 1;
 				// skip whitespace
-				while (separator < line.size()
-					&& (line[separator] == ' ' || line[separator] == '\t'))
-					++separator;
-				std::string value = line.substr(separator, std::string::npos);
-				m_header.insert(std::make_pair(name, value));
+				while (value_start < line_end
+					&& (*value_start == ' ' || *value_start == '\t'))
+					++value_start;
+
+				int const known = find_known_header(name);
+
+				// the value of the header is parsed from here. It's always
+				// null terminated
+				std::string const* value_str;
+				if (m_flags & known_headers_only)
+				{
+					if (known == num_known_headers)
+					{
+						newline = std::find(pos, recv_buffer.end(), '\n');
+						continue;
+					}
+					std::string& v = m_known_headers[std::size_t(known)];
+					v.assign(value_start, line_end);
+					value_str = &v;
+				}
+				else
+				{
+					std::string lower_name(name.data(), name.size());
+					std::transform(lower_name.begin(), lower_name.end(), lower_name.begin(), &to_lower);
+					auto const i = m_header.insert(std::make_pair(std::move(lower_name)
+						, std::string(value_start, line_end)));
+					value_str = &i->second;
+				}
+				std::string const& value = *value_str;
 
-				if (name == "content-length")
+				if (known == content_length_header)
 				{
 					m_content_length = std::strtoll(value.c_str(), nullptr, 10);
 					if (m_content_length < 0)
@@ -269,11 +346,11 @@ restart_response:
 						return ret;
 					}
 				}
-				else if (name == "connection")
+				else if (known == connection_header)
 				{
 					m_connection_close = string_begins_no_case("close", value.c_str());
 				}
-				else if (name == "content-range")
+				else if (known == content_range_header)
 				{
 					bool success = true;
 					char const* ptr = value.c_str();
@@ -315,7 +392,7 @@ restart_response:
 					// the http range is inclusive
 					m_content_length = m_range_end - m_range_start + 1;
 				}
-				else if (name == "transfer-encoding")
+				else if (known == transfer_encoding_header)
 				{
 					m_chunked_encoding = string_begins_no_case("chunked", value.c_str());
 				}
@@ -540,6 +617,8 @@ restart_response:
 		m_state = read_status;
 		m_recv_buffer = span<char const>();
 		m_header.clear();
+		// the strings keep their capacity, to be reused by the next response
+		for (auto& h : m_known_headers) h.clear();
 		m_chunked_encoding = false;
 		m_chunked_ranges.clear();
 		m_cur_chunk_end = -1;
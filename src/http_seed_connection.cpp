@@ -274,14 +274,14 @@ namespace libtorrent {
 				// if the status code is not one of the accepted ones, abort
 				if (!is_ok_status(m_parser.status_code()))
 				{
-					int retry_time = atoi(m_parser.header("retry-after").c_str());
+					int retry_time = atoi(m_parser.header(http_parser::retry_after_header).c_str());
 					if (retry_time <= 0) retry_time = 5 * 60;
 					// temporarily unavailable, retry later
 					t->retry_web_seed(this, retry_time);
 
 					std::string error_msg = to_string(m_parser.status_code()).data()
 						+ (" " + m_parser.message());
-					if (t->alerts().should_post<url_seed_alert>())
+					if (should_post<url_seed_alert>())
 					{
 						t->alerts().emplace_alert<url_seed_alert>(t->get_handle(), url()
 							, error_msg);
@@ -305,7 +305,7 @@ namespace libtorrent {
 				{
 					// this means we got a redirection request
 					// look for the location header
-					std::string location = m_parser.header("location");
+					std::string location = m_parser.header(http_parser::location_header);
 					received_bytes(0, int(bytes_transferred));
 
 					if (location.empty())
@@ -321,7 +321,7 @@ namespace libtorrent {
 					return;
 				}
 
-				std::string const& server_version = m_parser.header("server");
+				std::string const& server_version = m_parser.header(http_parser::server_header);
 				if (!server_version.empty())
 				{
 					m_server_string = "URL seed @ ";
@@ -331,7 +331,7 @@ namespace libtorrent {
 					m_server_string += ")";
 				}
 
-				m_response_left = atol(m_parser.header("content-length").c_str());
+				m_response_left = atol(m_parser.header(http_parser::content_length_header).c_str());
 				if (m_response_left == -1)
 				{
 					received_bytes(0, int(bytes_transferred));
@@ -55,6 +55,7 @@ POSSIBILITY OF SUCH DAMAGE.
 #include "libtorrent/aux_/session_settings.hpp"
 #include "libtorrent/resolver_interface.hpp"
 #include "libtorrent/ip_filter.hpp"
+#include "libtorrent/parse_url.hpp"
 
 using namespace std::placeholders;
 
@@ -194,15 +195,59 @@ namespace libtorrent {
 		}
 #endif
 
-		m_tracker_connection = std::make_shared<http_connection>(get_io_service(), m_man.host_resolver()
-			, std::bind(&http_tracker_connection::on_response, shared_from_this(), _1, _2, _3, _4)
-			, true, settings.get_int(settings_pack::max_http_recv_buffer_size)
-			, std::bind(&http_tracker_connection::on_connect, shared_from_this(), _1)
-			, std::bind(&http_tracker_connection::on_filter, shared_from_this(), _1, _2)
+		// requests to the same tracker share keep-alive connections. i2p
+		// connections are tied to a destination, so those always get a
+		// connection of their own
+		m_pool_key.clear();
+		if (settings.get_int(settings_pack::tracker_keepalive_connections) > 0
+			&& !i2p)
+		{
+			std::string protocol;
+			std::string hostname;
+			int port;
+			error_code ec;
+			std::tie(protocol, std::ignore, hostname, port, std::ignore)
+				= parse_url_components(tracker_req().url, ec);
+			if (!ec)
+			{
+				error_code err;
+				m_pool_key = protocol + "://" + hostname + ":" + std::to_string(port)
+					+ "/" + bind_interface().to_string(err);
 #ifdef TORRENT_USE_OPENSSL
-			, tracker_req().ssl_ctx
+				// a connection is only reused by requests with the same SSL
+				// context, which holds the certificates it was set up with
+				char ctx[20];
+				std::snprintf(ctx, sizeof(ctx), "/%p", static_cast<void*>(tracker_req().ssl_ctx));
+				m_pool_key += ctx;
 #endif
-			);
+				m_tracker_connection = m_man.get_idle_connection(m_pool_key);
+			}
+		}
+
+		if (m_tracker_connection)
+		{
+			m_tracker_connection->set_handlers(
+				std::bind(&http_tracker_connection::on_response, shared_from_this(), _1, _2, _3, _4)
+				, std::bind(&http_tracker_connection::on_connect, shared_from_this(), _1)
+				, std::bind(&http_tracker_connection::on_filter, shared_from_this(), _1, _2));
+
+			// we won't get a connect callback for a connection that's already
+			// open
+			on_connect(*m_tracker_connection);
+		}
+		else
+		{
+			m_tracker_connection = std::make_shared<http_connection>(get_io_service(), m_man.host_resolver()
+				, std::bind(&http_tracker_connection::on_response, shared_from_this(), _1, _2, _3, _4)
+				, true, settings.get_int(settings_pack::max_http_recv_buffer_size)
+				, std::bind(&http_tracker_connection::on_connect, shared_from_this(), _1)
+				, std::bind(&http_tracker_connection::on_filter, shared_from_this(), _1, _2)
+#ifdef TORRENT_USE_OPENSSL
+				, tracker_req().ssl_ctx
+#endif
+				);
+			m_tracker_connection->keep_alive(!m_pool_key.empty());
+		}
 
 		int const timeout = tracker_req().event == tracker_request::stopped
 			? settings.get_int(settings_pack::stop_tracker_timeout)
@@ -253,7 +298,10 @@ namespace libtorrent {
 	{
 		if (m_tracker_connection)
 		{
-			m_tracker_connection->close();
+			if (!m_pool_key.empty() && m_tracker_connection->can_reuse())
+				m_man.add_idle_connection(m_pool_key, std::move(m_tracker_connection));
+			else
+				m_tracker_connection->close();
 			m_tracker_connection.reset();
 		}
 		cancel();
@@ -0,0 +1,288 @@
+/*
+
+Copyright (c) 2017, Arvid Norberg
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions
+are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in
+      the documentation and/or other materials provided with the distribution.
+    * Neither the name of the author nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+
+#include "libtorrent/config.hpp"
+#include "libtorrent/aux_/io_uring.hpp"
+#include "libtorrent/assert.hpp"
+
+#include "libtorrent/aux_/disable_warnings_push.hpp"
+#include <boost/asio/error.hpp>
+#include "libtorrent/aux_/disable_warnings_pop.hpp"
+
+#if TORRENT_USE_IO_URING
+#include "libtorrent/aux_/disable_warnings_push.hpp"
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+#include "libtorrent/aux_/disable_warnings_pop.hpp"
+
+// the system headers may be older than the kernel we're built for
+#if !defined __NR_io_uring_setup || !defined __NR_io_uring_enter
+#undef TORRENT_USE_IO_URING
+#define TORRENT_USE_IO_URING 0
+#endif
+#endif
+
+#include <algorithm>
+
+namespace libtorrent { namespace aux {
+
+	io_uring_batch::io_uring_batch(int const queue_depth)
+	{
+		TORRENT_ASSERT(queue_depth > 0);
+#if TORRENT_USE_IO_URING
+		if (!setup_ring(std::max(1, std::min(queue_depth, 4096))))
+			close_ring();
+#else
+		TORRENT_UNUSED(queue_depth);
+#endif
+	}
+
+	io_uring_batch::~io_uring_batch()
+	{
+#if TORRENT_USE_IO_URING
+		close_ring();
+#endif
+	}
+
+	bool io_uring_batch::is_async() const
+	{
+#if TORRENT_USE_IO_URING
+		return m_ring_fd >= 0;
+#else
+		return false;
+#endif
+	}
+
+	void io_uring_batch::add_readv(file_handle f, std::int64_t const offset
+		, span<iovec_t const> bufs, int const tag, std::uint32_t const flags)
+	{
+		add_op(std::move(f), offset, bufs, tag, flags, false);
+	}
+
+	void io_uring_batch::add_writev(file_handle f, std::int64_t const offset
+		, span<iovec_t const> bufs, int const tag, std::uint32_t const flags)
+	{
+		add_op(std::move(f), offset, bufs, tag, flags, true);
+	}
+
+	void io_uring_batch::add_op(file_handle f, std::int64_t const offset
+		, span<iovec_t const> bufs, int const tag, std::uint32_t const flags
+		, bool const write)
+	{
+		TORRENT_ASSERT(f);
+		TORRENT_ASSERT(!bufs.empty());
+		m_ops.push_back({std::move(f), offset
+			, std::vector<iovec_t>(bufs.begin(), bufs.end()), tag, flags, write});
+	}
+
+	int io_uring_batch::finish_sync(file_op& op, int const bytes, error_code& ec)
+	{
+		TORRENT_ASSERT(bytes >= 0);
+		int const total = bufs_size(op.bufs);
+		if (bytes >= total) return total;
+
+		span<iovec_t> bufs = advance_bufs(op.bufs, bytes);
+		std::int64_t const ret = op.write
+			? op.file->writev(op.offset + bytes, bufs, ec, op.flags)
+			: op.file->readv(op.offset + bytes, bufs, ec, op.flags);
+		if (ec) return -1;
+		if (bytes + ret < total) ec = boost::asio::error::eof;
+		return bytes + int(ret);
+	}
+
+	void io_uring_batch::run(std::function<void(int, int, error_code const&)> const& handler)
+	{
+		std::vector<int> result(m_ops.size(), 0);
+		int done = 0;
+
+#if TORRENT_USE_IO_URING
+		while (is_async() && done < int(m_ops.size()))
+		{
+			int const end = std::min(int(m_ops.size()), done + m_ring_entries);
+			if (!run_async(done, end, result))
+			{
+				// the ring is broken. Don't try to use it again, fall back to
+				// synchronous operations for the remainder of the batch
+				close_ring();
+				break;
+			}
+			done = end;
+		}
+#endif
+
+		for (int i = 0; i < int(m_ops.size()); ++i)
+		{
+			file_op& op = m_ops[std::size_t(i)];
+			error_code ec;
+			int bytes;
+			if (i < done && result[std::size_t(i)] < 0)
+			{
+				ec.assign(-result[std::size_t(i)], system_category());
+				bytes = -1;
+			}
+			else
+			{
+				// operations that weren't submitted start at 0, short
+				// transfers are resumed where they left off
+				bytes = finish_sync(op, i < done ? result[std::size_t(i)] : 0, ec);
+			}
+			handler(op.tag, bytes, ec);
+		}
+		m_ops.clear();
+	}
+
+#if TORRENT_USE_IO_URING
+
+	bool io_uring_batch::setup_ring(int const entries)
+	{
+		io_uring_params p;
+		std::memset(&p, 0, sizeof(p));
+		int const fd = int(::syscall(__NR_io_uring_setup, entries, &p));
+		// ENOSYS means the kernel does not support io_uring, EPERM may mean
+		// it's been disabled by seccomp. Either way, we'll fall back to
+		// synchronous operations
+		if (fd < 0) return false;
+		m_ring_fd = fd;
+
+		m_sq_ring_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+		m_cq_ring_size = p.cq_off.cqes + p.cq_entries * sizeof(io_uring_cqe);
+		m_sqes_size = p.sq_entries * sizeof(io_uring_sqe);
+
+		m_sq_ring = ::mmap(nullptr, m_sq_ring_size, PROT_READ | PROT_WRITE
+			, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+		if (m_sq_ring == MAP_FAILED) { m_sq_ring = nullptr; return false; }
+
+		m_cq_ring = ::mmap(nullptr, m_cq_ring_size, PROT_READ | PROT_WRITE
+			, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+		if (m_cq_ring == MAP_FAILED) { m_cq_ring = nullptr; return false; }
+
+		m_sqes = ::mmap(nullptr, m_sqes_size, PROT_READ | PROT_WRITE
+			, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+		if (m_sqes == MAP_FAILED) { m_sqes = nullptr; return false; }
+
+		char* sq = static_cast<char*>(m_sq_ring);
+		m_sq_tail = reinterpret_cast<unsigned*>(sq + p.sq_off.tail);
+		m_sq_mask = reinterpret_cast<unsigned const*>(sq + p.sq_off.ring_mask);
+		m_sq_array = reinterpret_cast<unsigned*>(sq + p.sq_off.array);
+
+		char* cq = static_cast<char*>(m_cq_ring);
+		m_cq_head = reinterpret_cast<unsigned*>(cq + p.cq_off.head);
+		m_cq_tail = reinterpret_cast<unsigned const*>(cq + p.cq_off.tail);
+		m_cq_mask = reinterpret_cast<unsigned const*>(cq + p.cq_off.ring_mask);
+		m_cqes = cq + p.cq_off.cqes;
+
+		// the completion queue is at least as large as the submission
+		// queue, so we'll never overflow it as long as we don't submit more
+		// than sq_entries at a time
+		m_ring_entries = int(std::min(p.sq_entries, p.cq_entries));
+		return true;
+	}
+
+	void io_uring_batch::close_ring()
+	{
+		if (m_sqes) ::munmap(m_sqes, m_sqes_size);
+		if (m_cq_ring) ::munmap(m_cq_ring, m_cq_ring_size);
+		if (m_sq_ring) ::munmap(m_sq_ring, m_sq_ring_size);
+		if (m_ring_fd >= 0) ::close(m_ring_fd);
+		m_sqes = nullptr;
+		m_cq_ring = nullptr;
+		m_sq_ring = nullptr;
+		m_ring_fd = -1;
+		m_ring_entries = 0;
+	}
+
+	bool io_uring_batch::run_async(int const begin, int const end
+		, std::vector<int>& result)
+	{
+		TORRENT_ASSERT(end - begin <= m_ring_entries);
+
+		io_uring_sqe* sqes = static_cast<io_uring_sqe*>(m_sqes);
+		unsigned const mask = *m_sq_mask;
+		unsigned tail = *m_sq_tail;
+		for (int i = begin; i < end; ++i)
+		{
+			file_op const& op = m_ops[std::size_t(i)];
+			unsigned const idx = tail & mask;
+			io_uring_sqe& sqe = sqes[idx];
+			std::memset(&sqe, 0, sizeof(sqe));
+			sqe.opcode = op.write ? IORING_OP_WRITEV : IORING_OP_READV;
+			sqe.fd = op.file->native_handle();
+			sqe.addr = reinterpret_cast<std::uint64_t>(op.bufs.data());
+			sqe.len = std::uint32_t(op.bufs.size());
+			sqe.off = std::uint64_t(op.offset);
+			sqe.user_data = std::uint64_t(i);
+			m_sq_array[idx] = idx;
+			++tail;
+		}
+		// the kernel must see the SQEs before it sees the new tail
+		__atomic_store_n(m_sq_tail, tail, __ATOMIC_RELEASE);
+
+		int to_submit = end - begin;
+		int outstanding = end - begin;
+		io_uring_cqe const* cqes = static_cast<io_uring_cqe const*>(m_cqes);
+		while (outstanding > 0)
+		{
+			int const ret = int(::syscall(__NR_io_uring_enter, m_ring_fd
+				, to_submit, 1, IORING_ENTER_GETEVENTS, nullptr, 0));
+			if (ret < 0)
+			{
+				if (errno == EINTR || errno == EAGAIN || errno == EBUSY) continue;
+				// if nothing has been submitted yet, it's safe to give up on
+				// the ring. Otherwise the operations in flight still reference
+				// our buffers and we have to wait for them to complete
+				if (to_submit == end - begin) return false;
+				continue;
+			}
+			to_submit -= std::min(to_submit, ret);
+
+			unsigned head = *m_cq_head;
+			unsigned const cq_tail = __atomic_load_n(m_cq_tail, __ATOMIC_ACQUIRE);
+			unsigned const cq_mask = *m_cq_mask;
+			for (; head != cq_tail; ++head)
+			{
+				io_uring_cqe const& cqe = cqes[head & cq_mask];
+				std::size_t const op = std::size_t(cqe.user_data);
+				TORRENT_ASSERT(int(op) >= begin && int(op) < end);
+				result[op] = cqe.res;
+				--outstanding;
+			}
+			__atomic_store_n(m_cq_head, head, __ATOMIC_RELEASE);
+		}
+		return true;
+	}
+#endif
+}}
@@ -64,6 +64,14 @@ namespace libtorrent {
 #endif
 	}
 
+	void ip_filter::compile()
+	{
+		m_filter4.compile();
+#if TORRENT_USE_IPV6
+		m_filter6.compile();
+#endif
+	}
+
 	ip_filter::filter_tuple_t ip_filter::export_filter() const
 	{
 #if TORRENT_USE_IPV6
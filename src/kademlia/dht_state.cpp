@@ -59,6 +59,53 @@ namespace {
 		}
 		return ret;
 	}
+
+	// each node is saved as its ID, endpoint and RTT
+	entry save_table(std::vector<node_entry> const& table)
+	{
+		entry ret(entry::list_t);
+		entry::list_type& list = ret.list();
+		for (auto const& n : table)
+		{
+			std::string node;
+			std::back_insert_iterator<std::string> out(node);
+			std::copy(n.id.begin(), n.id.end(), out);
+			detail::write_endpoint(n.ep(), out);
+			detail::write_uint16(n.rtt, out);
+			list.push_back(entry(node));
+		}
+		return ret;
+	}
+
+	std::vector<node_entry> read_table(bdecode_node const& list)
+	{
+		std::vector<node_entry> ret;
+		for (int i = 0; i < list.list_size(); ++i)
+		{
+			bdecode_node const e = list.list_at(i);
+			if (e.type() != bdecode_node::string_t) continue;
+			char const* ptr = e.string_ptr();
+			int const len = e.string_length();
+			if (len != 20 + 6 + 2
+#if TORRENT_USE_IPV6
+				&& len != 20 + 18 + 2
+#endif
+				) continue;
+
+			node_id const id(ptr);
+			ptr += 20;
+			udp::endpoint const ep = len == 20 + 6 + 2
+				? detail::read_v4_endpoint<udp::endpoint>(ptr)
+#if TORRENT_USE_IPV6
+				: detail::read_v6_endpoint<udp::endpoint>(ptr);
+#else
+				: udp::endpoint();
+#endif
+			int const rtt = detail::read_uint16(ptr);
+			ret.emplace_back(id, ep, rtt, false);
+		}
+		return ret;
+	}
 } // anonymous namespace
 
 	void dht_state::clear()
@@ -70,6 +117,11 @@ namespace {
 		nodes.shrink_to_fit();
 		nodes6.clear();
 		nodes6.shrink_to_fit();
+
+		table.clear();
+		table.shrink_to_fit();
+		table6.clear();
+		table6.shrink_to_fit();
 	}
 
 	dht_state read_dht_state(bdecode_node const& e)
@@ -90,6 +142,13 @@ namespace {
 			ret.nodes6 = detail::read_endpoint_list<udp::endpoint>(nodes);
 #endif
 
+		if (bdecode_node const table = e.dict_find_list("table"))
+			ret.table = read_table(table);
+#if TORRENT_USE_IPV6
+		if (bdecode_node const table = e.dict_find_list("table6"))
+			ret.table6 = read_table(table);
+#endif
+
 		return ret;
 	}
 
@@ -99,10 +158,12 @@ namespace {
 		ret["node-id"] = state.nid.to_string();
 		entry const nodes = save_nodes(state.nodes);
 		if (!nodes.list().empty()) ret["nodes"] = nodes;
+		if (!state.table.empty()) ret["table"] = save_table(state.table);
 #if TORRENT_USE_IPV6
 		ret["node-id6"] = state.nid6.to_string();
 		entry const nodes6 = save_nodes(state.nodes6);
 		if (!nodes6.list().empty()) ret["nodes6"] = nodes6;
+		if (!state.table6.empty()) ret["table6"] = save_table(state.table6);
 #endif
 		return ret;
 	}
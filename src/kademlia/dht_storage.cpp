@@ -35,7 +35,7 @@ POSSIBILITY OF SUCH DAMAGE.
 #include <tuple>
 #include <algorithm>
 #include <utility>
-#include <map>
+#include <unordered_map>
 #include <set>
 #include <string>
 
@@ -56,7 +56,7 @@ namespace {
 	// to remove stale peers
 	struct peer_entry
 	{
-		time_point added;
+		time_point32 added;
 		tcp::endpoint addr;
 		bool seed;
 	};
@@ -165,8 +165,8 @@ namespace {
 	// the fewest peers are announcing, and farthest
 	// from our node IDs)
 	template<class Item>
-	typename std::map<node_id, Item>::const_iterator pick_least_important_item(
-		std::vector<node_id> const& node_ids, std::map<node_id, Item> const& table)
+	typename std::unordered_map<node_id, Item>::const_iterator pick_least_important_item(
+		std::vector<node_id> const& node_ids, std::unordered_map<node_id, Item> const& table)
 	{
 		return std::min_element(table.begin(), table.end()
 			, immutable_item_comparator(node_ids));
@@ -326,7 +326,7 @@ namespace {
 
 			peer_entry peer;
 			peer.addr = endp;
-			peer.added = aux::time_now();
+			peer.added = aux::time_now32();
 			peer.seed = seed;
 			auto i = std::lower_bound(peersv.begin(), peersv.end(), peer);
 			if (i != peersv.end() && i->addr == endp)
@@ -532,7 +532,9 @@ namespace {
 
 		dht_storage_counters counters() const override
 		{
-			return m_counters;
+			dht_storage_counters ret = m_counters;
+			ret.memory = memory_usage();
+			return ret;
 		}
 
 	private:
@@ -540,15 +542,47 @@ namespace {
 		dht_storage_counters m_counters;
 
 		std::vector<node_id> m_node_ids;
-		std::map<node_id, torrent_entry> m_map;
-		std::map<node_id, dht_immutable_item> m_immutable_table;
-		std::map<node_id, dht_mutable_item> m_mutable_table;
+
+		// these are hash tables rather than ordered maps, since nodes
+		// tracking millions of info-hashes spend most of their time looking
+		// them up. Nothing depends on the order of the entries
+		std::unordered_map<node_id, torrent_entry> m_map;
+		std::unordered_map<node_id, dht_immutable_item> m_immutable_table;
+		std::unordered_map<node_id, dht_mutable_item> m_mutable_table;
 
 		infohashes_sample m_infohashes_sample;
 
+		// an estimate of the memory used by the tables. Each hash table node
+		// is assumed to carry a next-pointer and a cached hash value on top of
+		// its element, and each bucket a pointer
+		template <typename Map>
+		static std::size_t table_usage(Map const& m)
+		{
+			return m.size() * (sizeof(typename Map::value_type) + 2 * sizeof(void*))
+				+ m.bucket_count() * sizeof(void*);
+		}
+
+		std::int32_t memory_usage() const
+		{
+			std::size_t ret = table_usage(m_map)
+				+ table_usage(m_immutable_table)
+				+ table_usage(m_mutable_table);
+			for (auto const& t : m_map)
+			{
+				ret += t.second.name.capacity()
+					+ (t.second.peers4.capacity() + t.second.peers6.capacity())
+					* sizeof(peer_entry);
+			}
+			for (auto const& i : m_immutable_table)
+				ret += std::size_t(i.second.size);
+			for (auto const& i : m_mutable_table)
+				ret += std::size_t(i.second.size) + i.second.salt.capacity();
+			return std::int32_t(ret);
+		}
+
 		void purge_peers(std::vector<peer_entry>& peers)
 		{
-			auto now = aux::time_now();
+			auto now = aux::time_now32();
 			auto new_end = std::remove_if(peers.begin(), peers.end()
 				, [=](peer_entry const& e)
 			{
@@ -612,6 +646,7 @@ void dht_storage_counters::reset()
 	peers = 0;
 	immutable_data = 0;
 	mutable_data = 0;
+	memory = 0;
 }
 
 std::unique_ptr<dht_storage_interface> dht_default_storage_constructor(
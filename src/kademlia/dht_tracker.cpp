@@ -35,10 +35,10 @@ POSSIBILITY OF SUCH DAMAGE.
 #include <libtorrent/config.hpp>
 
 #include <libtorrent/kademlia/msg.hpp>
+#include <libtorrent/kademlia/item.hpp>
 #include <libtorrent/kademlia/dht_observer.hpp>
 
 #include <libtorrent/bencode.hpp>
-#include <libtorrent/version.hpp>
 #include <libtorrent/time.hpp>
 #include <libtorrent/performance_counters.hpp> // for counters
 #include <libtorrent/aux_/time.hpp>
@@ -77,6 +77,14 @@ namespace libtorrent { namespace dht {
 		return r;
 	}
 
+	bool is_mutable_put(bdecode_node const& msg)
+	{
+		if (msg.dict_find_string_value("y") != "q") return false;
+		if (msg.dict_find_string_value("q") != "put") return false;
+		bdecode_node const a = msg.dict_find_dict("a");
+		return a && a.dict_find_string("k") && a.dict_find_string("sig");
+	}
+
 	} // anonymous namespace
 
 	// class that puts the networking and the kademlia node in a single
@@ -91,11 +99,12 @@ namespace libtorrent { namespace dht {
 		: m_counters(cnt)
 		, m_storage(storage)
 		, m_state(std::move(state))
+		, m_observer_pool(rpc_manager::observer_size(), 10)
 		, m_dht(udp::v4(), this, settings, m_state.nid
-			, observer, cnt, m_nodes, storage)
+			, observer, cnt, m_nodes, storage, &m_observer_pool)
 #if TORRENT_USE_IPV6
 		, m_dht6(udp::v6(), this, settings, m_state.nid6
-			, observer, cnt, m_nodes, storage)
+			, observer, cnt, m_nodes, storage, &m_observer_pool)
 #endif
 		, m_send_fun(send_fun)
 		, m_log(observer)
@@ -110,6 +119,8 @@ namespace libtorrent { namespace dht {
 		, m_host_resolver(ios)
 		, m_send_quota(settings.upload_rate_limit)
 		, m_last_tick(aux::time_now())
+		, m_signing(ios)
+		, m_ios(ios)
 	{
 		m_blocker.set_block_timer(m_settings.block_timeout);
 		m_blocker.set_rate_limit(m_settings.block_ratelimit);
@@ -163,6 +174,14 @@ namespace libtorrent { namespace dht {
 		m_refresh_timer.expires_from_now(seconds(5), ec);
 		m_refresh_timer.async_wait(std::bind(&dht_tracker::refresh_timeout, self(), _1));
 
+		// put the nodes we knew about last time back in the routing tables.
+		// They're not confirmed until they respond again, but lookups
+		// don't have to wait for the bootstrap to find nodes
+		restore_table(m_dht, m_state.table);
+#if TORRENT_USE_IPV6
+		restore_table(m_dht6, m_state.table6);
+#endif
+
 		// bootstrap with mix of IP protocols via want/nodes/nodes6
 		m_dht.bootstrap(concat(m_state.nodes, m_state.nodes6), f);
 #if TORRENT_USE_IPV6
@@ -182,6 +201,7 @@ namespace libtorrent { namespace dht {
 #endif
 		m_refresh_timer.cancel(ec);
 		m_host_resolver.cancel();
+		m_signing.abort();
 	}
 
 #ifndef TORRENT_NO_DEPRECATE
@@ -212,6 +232,15 @@ namespace libtorrent { namespace dht {
 #endif
 	}
 
+	int dht_tracker::num_outstanding_requests() const
+	{
+		int ret = m_dht.num_outstanding_requests();
+#if TORRENT_USE_IPV6
+		ret += m_dht6.num_outstanding_requests();
+#endif
+		return ret;
+	}
+
 	void dht_tracker::update_stats_counters(counters& c) const
 	{
 		const dht_storage_counters& dht_cnt = m_storage.counters();
@@ -219,6 +248,7 @@ namespace libtorrent { namespace dht {
 		c.set_value(counters::dht_peers, dht_cnt.peers);
 		c.set_value(counters::dht_immutable_data, dht_cnt.immutable_data);
 		c.set_value(counters::dht_mutable_data, dht_cnt.mutable_data);
+		c.set_value(counters::dht_storage_bytes, dht_cnt.memory);
 
 		c.set_value(counters::dht_nodes, 0);
 		c.set_value(counters::dht_node_cache, 0);
@@ -442,6 +472,31 @@ namespace libtorrent { namespace dht {
 #endif
 	}
 
+	void dht_tracker::put_item(public_key const& key, secret_key const& sk
+		, entry const& value, std::string const& salt
+		, std::function<void(item const&, int)> cb)
+	{
+		auto ctx = std::make_shared<put_item_ctx>((TORRENT_USE_IPV6) ? 2 : 1);
+		auto const sign = std::bind(&dht_tracker::sign_item, this, _1, _2, sk, value);
+		m_dht.put_item_async(key, salt, std::bind(&put_mutable_item_callback
+			, _1, _2, ctx, cb), sign);
+#if TORRENT_USE_IPV6
+		m_dht6.put_item_async(key, salt, std::bind(&put_mutable_item_callback
+			, _1, _2, ctx, cb), sign);
+#endif
+	}
+
+	void dht_tracker::sign_item(item& i, std::function<void(item const&)> f
+		, secret_key const& sk, entry const& value)
+	{
+		// i is the most recent version found in the DHT, if any. The new
+		// value is stored under the next sequence number. The handler holds
+		// on to us until it has run on the network thread
+		auto self_ = self();
+		m_signing.async_sign(value, i.salt(), sequence_number(i.seq().value + 1), i.pk(), sk
+			, [self_, f](item const& signed_item) { f(signed_item); });
+	}
+
 	void dht_tracker::direct_request(udp::endpoint const& ep, entry& e
 		, std::function<void(msg const&)> f)
 	{
@@ -453,6 +508,16 @@ namespace libtorrent { namespace dht {
 			m_dht.direct_request(ep, e, f);
 	}
 
+	void dht_tracker::sample_infohashes(sha1_hash const& target
+		, std::function<void(udp::endpoint const&, time_duration
+			, int, std::vector<sha1_hash> const&)> f)
+	{
+		m_dht.sample_infohashes(target, f);
+#if TORRENT_USE_IPV6
+		m_dht6.sample_infohashes(target, f);
+#endif
+	}
+
 	void dht_tracker::incoming_error(error_code const& ec, udp::endpoint const& ep)
 	{
 		if (ec == boost::asio::error::connection_refused
@@ -537,6 +602,16 @@ namespace libtorrent { namespace dht {
 		m_log->log_packet(dht_logger::incoming_message, buf, ep);
 #endif
 
+		if (is_mutable_put(m_msg))
+		{
+			// defer it until the other packets in this batch have been
+			// received, to verify all signatures at once
+			m_pending_puts.push_back({ep, std::vector<char>(buf.begin(), buf.end())});
+			if (m_pending_puts.size() == 1)
+				m_ios.post(std::bind(&dht_tracker::verify_pending_puts, self()));
+			return true;
+		}
+
 		libtorrent::dht::msg m(m_msg, ep);
 		m_dht.incoming(m);
 #if TORRENT_USE_IPV6
@@ -545,6 +620,79 @@ namespace libtorrent { namespace dht {
 		return true;
 	}
 
+	void dht_tracker::verify_pending_puts()
+	{
+		std::vector<pending_put> puts;
+		puts.swap(m_pending_puts);
+		if (m_abort) return;
+
+		std::vector<bdecode_node> msgs(puts.size());
+		std::vector<mutable_item_ref> items;
+		std::vector<int> item_index(puts.size(), -1);
+		items.reserve(puts.size());
+
+		for (std::size_t i = 0; i < puts.size(); ++i)
+		{
+			error_code err;
+			int pos;
+			std::vector<char> const& buf = puts[i].buf;
+			if (bdecode(buf.data(), buf.data() + buf.size(), msgs[i], err
+				, &pos, 10, 500) != 0)
+				continue;
+
+			// only the puts that look well formed and carry a valid write
+			// token are included in the batch. The node rejects the rest, the
+			// same way it would have without batching
+			bdecode_node const a = msgs[i].dict_find_dict("a");
+			bdecode_node const v = a.dict_find("v");
+			bdecode_node const seq = a.dict_find_int("seq");
+			bdecode_node const k = a.dict_find_string("k");
+			bdecode_node const sig = a.dict_find_string("sig");
+			bdecode_node const salt = a.dict_find_string("salt");
+			if (!v || !seq || seq.int_value() < 0
+				|| k.string_length() != public_key::len
+				|| sig.string_length() != signature::len
+				|| v.data_section().size() > 1000
+				|| salt.string_length() > 64)
+				continue;
+
+			span<char const> const salt_buf = salt
+				? span<char const>(salt.string_ptr(), std::size_t(salt.string_length()))
+				: span<char const>();
+			public_key const pk(k.string_ptr());
+			sha1_hash const target = item_target_id(salt_buf, pk);
+			string_view const token = a.dict_find_string_value("token");
+			if (!m_dht.verify_token(token, target, puts[i].ep)
+#if TORRENT_USE_IPV6
+				&& !m_dht6.verify_token(token, target, puts[i].ep)
+#endif
+				)
+				continue;
+
+			item_index[i] = int(items.size());
+			items.push_back({v.data_section(), salt_buf
+				, sequence_number(seq.int_value()), pk, signature(sig.string_ptr())});
+		}
+
+		std::vector<bool> const valid = verify_mutable_items(items);
+
+		for (std::size_t i = 0; i < puts.size(); ++i)
+		{
+			if (msgs[i].type() != bdecode_node::dict_t) continue;
+			libtorrent::dht::msg m(msgs[i], puts[i].ep);
+			if (item_index[i] >= 0)
+			{
+				m.sig = valid[std::size_t(item_index[i])]
+					? msg::signature_state::valid
+					: msg::signature_state::invalid;
+			}
+			m_dht.incoming(m);
+#if TORRENT_USE_IPV6
+			m_dht6.incoming(m);
+#endif
+		}
+	}
+
 	std::vector<std::pair<node_id, udp::endpoint>> dht_tracker::live_nodes(node_id const& nid)
 	{
 		std::vector<std::pair<node_id, udp::endpoint>> ret;
@@ -577,6 +725,16 @@ namespace libtorrent { namespace dht {
 		return ret;
 	}
 
+	std::vector<node_entry> save_table(node const& dht)
+	{
+		std::vector<node_entry> ret;
+
+		dht.m_table.for_each_node([&ret](node_entry const& e)
+		{ ret.push_back(e); });
+
+		return ret;
+	}
+
 	} // anonymous namespace
 
 	dht_state dht_tracker::state() const
@@ -584,13 +742,25 @@ namespace libtorrent { namespace dht {
 		dht_state ret;
 		ret.nid = m_dht.nid();
 		ret.nodes = save_nodes(m_dht);
+		ret.table = save_table(m_dht);
 #if TORRENT_USE_IPV6
 		ret.nid6 = m_dht6.nid();
 		ret.nodes6 = save_nodes(m_dht6);
+		ret.table6 = save_table(m_dht6);
 #endif
 		return ret;
 	}
 
+	void dht_tracker::restore_table(node& dht, std::vector<node_entry> const& table)
+	{
+		for (auto const& e : table)
+		{
+			if (e.id == dht.nid()) continue;
+			if (m_settings.enforce_node_id && !verify_id(e.id, e.addr())) continue;
+			dht.m_table.add_node(e);
+		}
+	}
+
 	void dht_tracker::add_node(udp::endpoint const& node)
 	{
 		m_dht.add_node(node);
@@ -626,36 +796,40 @@ namespace libtorrent { namespace dht {
 
 	bool dht_tracker::send_packet(entry& e, udp::endpoint const& addr)
 	{
-		static char const version_str[] = {'L', 'T'
-			, LIBTORRENT_VERSION_MAJOR, LIBTORRENT_VERSION_MINOR};
-		e["v"] = std::string(version_str, version_str + 4);
+		e["v"] = std::string(client_version, client_version + 4);
 
 		m_send_buf.clear();
 		bencode(std::back_inserter(m_send_buf), e);
 
+		return send_raw_packet(m_send_buf, addr);
+	}
+
+	bool dht_tracker::send_raw_packet(span<char const> buf
+		, udp::endpoint const& addr)
+	{
 		// update the quota. We won't prevent the packet to be sent if we exceed
 		// the quota, we'll just (potentially) block the next incoming request.
 
-		m_send_quota -= int(m_send_buf.size());
+		m_send_quota -= int(buf.size());
 
 		error_code ec;
-		m_send_fun(addr, m_send_buf, ec, 0);
+		m_send_fun(addr, buf, ec, 0);
 		if (ec)
 		{
 			m_counters.inc_stats_counter(counters::dht_messages_out_dropped);
 #ifndef TORRENT_DISABLE_LOGGING
-			m_log->log_packet(dht_logger::outgoing_message, m_send_buf, addr);
+			m_log->log_packet(dht_logger::outgoing_message, buf, addr);
 #endif
 			return false;
 		}
 
-		m_counters.inc_stats_counter(counters::dht_bytes_out, int(m_send_buf.size()));
+		m_counters.inc_stats_counter(counters::dht_bytes_out, int(buf.size()));
 		// account for IP and UDP overhead
 		m_counters.inc_stats_counter(counters::sent_ip_overhead_bytes
 			, addr.address().is_v6() ? 48 : 28);
 		m_counters.inc_stats_counter(counters::dht_messages_out);
 #ifndef TORRENT_DISABLE_LOGGING
-		m_log->log_packet(dht_logger::outgoing_message, m_send_buf, addr);
+		m_log->log_packet(dht_logger::outgoing_message, buf, addr);
 #endif
 		return true;
 	}
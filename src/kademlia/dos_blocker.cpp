@@ -31,6 +31,9 @@ POSSIBILITY OF SUCH DAMAGE.
 */
 
 #include "libtorrent/kademlia/dos_blocker.hpp"
+#include "libtorrent/random.hpp"
+
+#include <algorithm> // for min
 
 #ifndef TORRENT_DISABLE_LOGGING
 #include "libtorrent/socket_io.hpp" // for print_address
@@ -39,74 +42,122 @@ POSSIBILITY OF SUCH DAMAGE.
 
 namespace libtorrent { namespace dht {
 
+namespace {
+
+	std::uint32_t hash_address(address const& addr)
+	{
+#if TORRENT_USE_IPV6
+		if (addr.is_v6())
+		{
+			address_v6::bytes_type const b = addr.to_v6().to_bytes();
+			std::uint32_t ret = 0;
+			for (std::size_t i = 0; i < b.size(); i += 4)
+			{
+				ret = ret * 0x01000193
+					^ ((std::uint32_t(b[i]) << 24) | (std::uint32_t(b[i + 1]) << 16)
+					| (std::uint32_t(b[i + 2]) << 8) | std::uint32_t(b[i + 3]));
+			}
+			return ret;
+		}
+#endif
+		return std::uint32_t(addr.to_v4().to_ulong());
+	}
+
+	// a cheap integer mixer, to derive the per-row hashes with
+	std::uint32_t mix(std::uint32_t h, std::uint32_t const seed)
+	{
+		h ^= seed;
+		h *= 0x85ebca6b;
+		h ^= h >> 13;
+		h *= 0xc2b2ae35;
+		h ^= h >> 16;
+		return h;
+	}
+}
+
 	dos_blocker::dos_blocker()
-		: m_message_rate_limit(5)
+		: m_last_decay(clock_type::now())
+		, m_message_rate_limit(5)
 		, m_block_timeout(5 * 60)
 	{
-		for (int i = 0; i < num_ban_nodes; ++i)
+		for (auto& row : m_sketch) row.fill(0);
+		for (auto& s : m_seeds) s = random(0xffffffff);
+	}
+
+	void dos_blocker::decay(time_point const now)
+	{
+		int shift = 0;
+		while (now - m_last_decay >= seconds(10) && shift < 16)
 		{
-			m_ban_nodes[i].count = 0;
-			m_ban_nodes[i].limit = min_time();
+			m_last_decay += seconds(10);
+			++shift;
 		}
+		if (shift == 0) return;
+		if (shift == 16) m_last_decay = now;
+
+		for (auto& row : m_sketch)
+			for (auto& c : row) c = std::uint16_t(c >> shift);
 	}
 
-	bool dos_blocker::incoming(address const& addr, time_point now, dht_logger* logger)
+	dos_blocker::node_ban_entry& dos_blocker::ban_slot(address const& addr
+		, std::uint32_t const hash, time_point const now)
 	{
-		node_ban_entry* match = nullptr;
-		node_ban_entry* min = m_ban_nodes;
-		for (node_ban_entry* i = m_ban_nodes; i < m_ban_nodes + num_ban_nodes; ++i)
+		node_ban_entry* free_slot = nullptr;
+		node_ban_entry* oldest = nullptr;
+		for (std::uint32_t i = 0; i < max_ban_probes; ++i)
 		{
-			if (i->src == addr)
+			node_ban_entry& e = m_ban_nodes[(hash + i) % num_ban_nodes];
+			if (e.src == addr) return e;
+			if (e.limit <= now)
 			{
-				match = i;
-				break;
+				if (free_slot == nullptr) free_slot = &e;
+			}
+			else if (oldest == nullptr || e.limit < oldest->limit)
+			{
+				oldest = &e;
 			}
-			if (i->count < min->count) min = i;
-			else if (i->count == min->count
-				&& i->limit < min->limit) min = i;
 		}
+		// if all slots hold active bans, replace the one expiring first
+		return free_slot != nullptr ? *free_slot : *oldest;
+	}
 
-		if (match)
+	bool dos_blocker::incoming(address const& addr, time_point now, dht_logger* logger)
+	{
+		std::uint32_t const hash = hash_address(addr);
+
+		node_ban_entry& slot = ban_slot(addr, mix(hash, ~m_seeds[0]), now);
+		if (slot.src == addr && now < slot.limit) return false;
+
+		decay(now);
+
+		int count = 0xffff;
+		for (int i = 0; i < sketch_depth; ++i)
 		{
-			++match->count;
+			std::uint16_t& c = m_sketch[std::size_t(i)]
+				[mix(hash, m_seeds[std::size_t(i)]) % sketch_width];
+			if (c < 0xffff) ++c;
+			count = std::min(count, int(c));
+		}
+
+		// the counters are halved every 10 seconds, so a node that keeps
+		// sending at the rate limit converges on a count of 20 times the
+		// limit
+		if (count < std::min(m_message_rate_limit * 20, 0xffff)) return true;
 
-			if (match->count >= m_message_rate_limit * 10)
-			{
-				if (now < match->limit)
-				{
-					if (match->count == m_message_rate_limit * 10)
-					{
 #ifndef TORRENT_DISABLE_LOGGING
-						if (logger != nullptr && logger->should_log(dht_logger::tracker))
-						{
-							logger->log(dht_logger::tracker, "BANNING PEER [ ip: %s time: %d ms count: %d ]"
-								, print_address(addr).c_str()
-								, int(total_milliseconds((now - match->limit) + seconds(10)))
-								, match->count);
-						}
-#else
-						TORRENT_UNUSED(logger);
-#endif // TORRENT_DISABLE_LOGGING
-						// we've received too many messages in less than 10 seconds
-						// from this node. Ignore it until it's silent for 5 minutes
-						match->limit = now + seconds(m_block_timeout);
-					}
-
-					return false;
-				}
-
-				// the messages we received from this peer took more than 10
-				// seconds. Reset the counter and the timer
-				match->count = 0;
-				match->limit = now + seconds(10);
-			}
-		}
-		else
+		if (logger != nullptr && logger->should_log(dht_logger::tracker))
 		{
-			min->count = 1;
-			min->limit = now + seconds(10);
-			min->src = addr;
+			logger->log(dht_logger::tracker, "BANNING PEER [ ip: %s count: %d ]"
+				, print_address(addr).c_str(), count);
 		}
-		return true;
+#else
+		TORRENT_UNUSED(logger);
+#endif // TORRENT_DISABLE_LOGGING
+
+		// we've received too many messages in a short time from this node.
+		// Ignore it for a while
+		slot.src = addr;
+		slot.limit = now + seconds(m_block_timeout);
+		return false;
 	}
 }}
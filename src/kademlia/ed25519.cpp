@@ -33,6 +33,9 @@ POSSIBILITY OF SUCH DAMAGE.
 #include <libtorrent/kademlia/ed25519.hpp>
 #include <libtorrent/random.hpp>
 #include <libtorrent/ed25519.hpp>
+#include <libtorrent/assert.hpp>
+
+#include <vector>
 
 namespace libtorrent { namespace dht {
 
@@ -83,6 +86,30 @@ namespace libtorrent { namespace dht {
 		return libtorrent::ed25519_verify(sig_ptr, msg_ptr, msg.size(), pk_ptr) == 1;
 	}
 
+	bool ed25519_verify_batch(span<signature const> const sigs
+		, span<span<char const> const> const msgs, span<public_key const> const pks)
+	{
+		TORRENT_ASSERT(sigs.size() == msgs.size());
+		TORRENT_ASSERT(sigs.size() == pks.size());
+
+		std::size_t const count = std::size_t(sigs.size());
+		std::vector<unsigned char const*> sig_ptrs(count);
+		std::vector<unsigned char const*> msg_ptrs(count);
+		std::vector<std::size_t> msg_lens(count);
+		std::vector<unsigned char const*> pk_ptrs(count);
+
+		for (std::size_t i = 0; i < count; ++i)
+		{
+			sig_ptrs[i] = reinterpret_cast<unsigned char const*>(sigs[i].bytes.data());
+			msg_ptrs[i] = reinterpret_cast<unsigned char const*>(msgs[i].data());
+			msg_lens[i] = msgs[i].size();
+			pk_ptrs[i] = reinterpret_cast<unsigned char const*>(pks[i].bytes.data());
+		}
+
+		return libtorrent::ed25519_verify_batch(sig_ptrs.data(), msg_ptrs.data()
+			, msg_lens.data(), pk_ptrs.data(), count) == 1;
+	}
+
 	public_key ed25519_add_scalar(public_key const& pk
 		, std::array<char, 32> const& scalar)
 	{
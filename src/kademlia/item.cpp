@@ -107,6 +107,60 @@ bool verify_mutable_item(
 	return ed25519_verify(sig, {str, size_t(len)}, pk);
 }
 
+namespace {
+
+	void verify_range(span<signature const> sigs
+		, span<span<char const> const> msgs
+		, span<public_key const> pks
+		, std::vector<bool>& ret, std::size_t const offset)
+	{
+		if (sigs.size() == 1)
+		{
+			ret[offset] = ed25519_verify(sigs[0], msgs[0], pks[0]);
+			return;
+		}
+
+		if (ed25519_verify_batch(sigs, msgs, pks))
+		{
+			std::fill(ret.begin() + std::ptrdiff_t(offset)
+				, ret.begin() + std::ptrdiff_t(offset + std::size_t(sigs.size())), true);
+			return;
+		}
+
+		std::size_t const half = std::size_t(sigs.size()) / 2;
+		verify_range(sigs.first(half), msgs.first(half), pks.first(half)
+			, ret, offset);
+		verify_range(sigs.subspan(half), msgs.subspan(half), pks.subspan(half)
+			, ret, offset + half);
+	}
+}
+
+std::vector<bool> verify_mutable_items(span<mutable_item_ref const> const items)
+{
+	std::vector<bool> ret(std::size_t(items.size()), false);
+	if (items.empty()) return ret;
+
+	std::vector<std::array<char, 1200>> strs(std::size_t(items.size()));
+	std::vector<span<char const>> msgs;
+	std::vector<signature> sigs;
+	std::vector<public_key> pks;
+	msgs.reserve(std::size_t(items.size()));
+	sigs.reserve(std::size_t(items.size()));
+	pks.reserve(std::size_t(items.size()));
+
+	for (std::size_t i = 0; i < std::size_t(items.size()); ++i)
+	{
+		mutable_item_ref const& it = items[i];
+		int const len = canonical_string(it.v, it.seq, it.salt, strs[i]);
+		msgs.emplace_back(strs[i].data(), std::size_t(len));
+		sigs.push_back(it.sig);
+		pks.push_back(it.pk);
+	}
+
+	verify_range(sigs, msgs, pks, ret, 0);
+	return ret;
+}
+
 // given the bencoded buffer ``v``, the salt (which is optional and may have
 // a length of zero to be omitted), sequence number ``seq``, public key (32
 // bytes ed25519 key) ``pk`` and a secret/private key ``sk`` (64 bytes ed25519
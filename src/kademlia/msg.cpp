@@ -33,9 +33,13 @@ POSSIBILITY OF SUCH DAMAGE.
 #include "libtorrent/kademlia/msg.hpp"
 #include "libtorrent/bdecode.hpp"
 #include "libtorrent/entry.hpp"
+#include "libtorrent/version.hpp"
 
 namespace libtorrent { namespace dht {
 
+char const client_version[4] = {'L', 'T'
+	, LIBTORRENT_VERSION_MAJOR, LIBTORRENT_VERSION_MINOR};
+
 bool verify_message_impl(bdecode_node const& message, span<key_desc_t const> desc
 	, span<bdecode_node> ret, span<char> error)
 {
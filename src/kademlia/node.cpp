@@ -60,6 +60,7 @@ POSSIBILITY OF SUCH DAMAGE.
 
 #include "libtorrent/kademlia/refresh.hpp"
 #include "libtorrent/kademlia/get_peers.hpp"
+#include "libtorrent/kademlia/sample_infohashes.hpp"
 #include "libtorrent/kademlia/get_item.hpp"
 #include "libtorrent/kademlia/msg.hpp"
 #include <libtorrent/kademlia/put_data.hpp>
@@ -99,19 +100,40 @@ void incoming_error(entry& e, char const* msg, int error_code = 203)
 	l.push_back(entry(msg));
 }
 
+// writes a bencoded string to ptr and advances it
+void write_bstring(char*& ptr, span<char const> str)
+{
+	detail::write_integer(ptr, str.size());
+	detail::write_char(ptr, ':');
+	std::memcpy(ptr, str.data(), str.size());
+	ptr += str.size();
+}
+
 } // anonymous namespace
 
+bool udp_socket_interface::send_raw_packet(span<char const> buf
+	, udp::endpoint const& addr)
+{
+	bdecode_node n;
+	error_code ec;
+	if (bdecode(buf.data(), buf.data() + buf.size(), n, ec) != 0) return false;
+	entry e;
+	e = n;
+	return send_packet(e, addr);
+}
+
 node::node(udp proto, udp_socket_interface* sock
 	, dht_settings const& settings
 	, node_id const& nid
 	, dht_observer* observer
 	, counters& cnt
 	, std::map<std::string, node*> const& nodes
-	, dht_storage_interface& storage)
+	, dht_storage_interface& storage
+	, boost::pool<>* observer_pool)
 	: m_settings(settings)
 	, m_id(calculate_node_id(nid, observer, proto))
 	, m_table(m_id, proto, 8, settings, observer)
-	, m_rpc(m_id, m_settings, m_table, sock, observer)
+	, m_rpc(m_id, m_settings, m_table, sock, observer, observer_pool)
 	, m_nodes(nodes)
 	, m_observer(observer)
 	, m_protocol(map_protocol_to_descriptor(proto))
@@ -321,6 +343,8 @@ void node::incoming(msg const& m)
 				return;
 			}
 
+			if (incoming_ping(m)) break;
+
 			entry e;
 			incoming_request(m, e);
 			m_sock->send_packet(e, m.addr);
@@ -466,6 +490,22 @@ void node::direct_request(udp::endpoint const& ep, entry& e
 	m_rpc.invoke(e, ep, o);
 }
 
+void node::sample_infohashes(sha1_hash const& target
+	, std::function<void(udp::endpoint const&, time_duration
+		, int, std::vector<sha1_hash> const&)> f)
+{
+#ifndef TORRENT_DISABLE_LOGGING
+	if (m_observer != nullptr && m_observer->should_log(dht_logger::node))
+	{
+		m_observer->log(dht_logger::node, "starting sample_infohashes [ target: %s ]"
+			, aux::to_hex(target).c_str());
+	}
+#endif
+
+	auto ta = std::make_shared<dht::sample_infohashes>(*this, target, f);
+	ta->start();
+}
+
 void node::get_item(sha1_hash const& target
 	, std::function<void(item const&)> f)
 {
@@ -520,6 +560,15 @@ void put_data_cb(item i, bool auth
 	}
 }
 
+void put_data_async_cb(item i, bool auth
+	, std::shared_ptr<put_data> ta
+	, std::function<void(item&, std::function<void(item const&)>)> f)
+{
+	if (!auth) return;
+	ta->wait_for_data();
+	f(i, std::bind(&put_data::set_data, ta, _1));
+}
+
 } // namespace
 
 void node::put_item(sha1_hash const& target, entry const& data, std::function<void(int)> f)
@@ -563,6 +612,27 @@ void node::put_item(public_key const& pk, std::string const& salt
 	ta->start();
 }
 
+void node::put_item_async(public_key const& pk, std::string const& salt
+	, std::function<void(item const&, int)> f
+	, std::function<void(item&, std::function<void(item const&)>)> data_cb)
+{
+#ifndef TORRENT_DISABLE_LOGGING
+	if (m_observer != nullptr && m_observer->should_log(dht_logger::node))
+	{
+		char hex_key[65];
+		aux::to_hex(pk.bytes, hex_key);
+		m_observer->log(dht_logger::node, "starting get for [ key: %s ]", hex_key);
+	}
+#endif
+
+	auto put_ta = std::make_shared<dht::put_data>(*this, f);
+
+	auto ta = std::make_shared<dht::get_item>(*this, pk, salt
+		, std::bind(&put_data_async_cb, _1, _2, put_ta, data_cb)
+		, std::bind(&put, _1, put_ta));
+	ta->start();
+}
+
 struct ping_observer : observer
 {
 	ping_observer(
@@ -708,6 +778,16 @@ void node::status(std::vector<dht_routing_bucket>& table
 	}
 }
 
+int node::num_outstanding_requests() const
+{
+	std::lock_guard<std::mutex> l(m_mutex);
+
+	int ret = 0;
+	for (auto const& r : m_running_requests)
+		ret += r->invoke_count();
+	return ret;
+}
+
 std::tuple<int, int, int> node::get_stats_counters() const
 {
 	int nodes, replacements;
@@ -754,6 +834,77 @@ entry write_nodes_entry(std::vector<node_entry> const& nodes)
 	return r;
 }
 
+bool node::incoming_ping(msg const& m)
+{
+	if (m.message.dict_find_string_value("q") != "ping") return false;
+
+	// plugins may want to see (and modify) the response
+	if (m_observer != nullptr && m_observer->has_dht_request_handler())
+		return false;
+
+	key_desc_t const top_desc[] = {
+		{"q", bdecode_node::string_t, 0, 0},
+		{"ro", bdecode_node::int_t, 0, key_desc_t::optional},
+		{"a", bdecode_node::dict_t, 0, key_desc_t::parse_children},
+			{"id", bdecode_node::string_t, 20, key_desc_t::last_child},
+	};
+
+	// malformed requests are left to incoming_request() to build the error
+	// response for
+	bdecode_node top_level[4];
+	char error_string[200];
+	if (!verify_message(m.message, top_desc, top_level, error_string))
+		return false;
+
+	// the transaction ID is echoed back verbatim. Unusually long ones don't
+	// fit in our buffer
+	string_view const tid = m.message.dict_find_string_value("t");
+	if (tid.size() > 32) return false;
+
+	node_id const id(top_level[3].string_ptr());
+	if (m_settings.enforce_node_id && !verify_id(id, m.addr.address()))
+		return false;
+
+	bool const read_only = top_level[1] && top_level[1].int_value() != 0;
+	if (!read_only)
+		m_table.heard_about(id, m.addr);
+
+	m_counters.inc_stats_counter(counters::dht_ping_in);
+
+	// this is the same response incoming_request() would build, with the
+	// keys in sorted order:
+	// d2:ip<ep>1:rd2:id20:<id>1:pi<port>ee1:t<tid>1:v4:<ver>1:y1:re
+	char ep[18];
+	char* ep_ptr = ep;
+	detail::write_endpoint(m.addr, ep_ptr);
+
+	std::array<char, 160> buf;
+	char* ptr = buf.data();
+	detail::write_char(ptr, 'd');
+	write_bstring(ptr, {"ip", 2});
+	write_bstring(ptr, {ep, std::size_t(ep_ptr - ep)});
+	write_bstring(ptr, {"r", 1});
+	detail::write_char(ptr, 'd');
+	write_bstring(ptr, {"id", 2});
+	write_bstring(ptr, {m_id.data(), m_id.size()});
+	write_bstring(ptr, {"p", 1});
+	detail::write_char(ptr, 'i');
+	detail::write_integer(ptr, m.addr.port());
+	detail::write_char(ptr, 'e');
+	detail::write_char(ptr, 'e');
+	write_bstring(ptr, {"t", 1});
+	write_bstring(ptr, {tid.data(), tid.size()});
+	write_bstring(ptr, {"v", 1});
+	write_bstring(ptr, client_version);
+	write_bstring(ptr, {"y", 1});
+	write_bstring(ptr, {"r", 1});
+	detail::write_char(ptr, 'e');
+	TORRENT_ASSERT(ptr <= buf.data() + buf.size());
+
+	m_sock->send_raw_packet({buf.data(), std::size_t(ptr - buf.data())}, m.addr);
+	return true;
+}
+
 // build response
 void node::incoming_request(msg const& m, entry& e)
 {
@@ -873,6 +1024,27 @@ void node::incoming_request(msg const& m, entry& e)
 
 		write_nodes_entries(target, msg_keys[1], reply);
 	}
+	else if (query == "sample_infohashes")
+	{
+		// BEP 51. The storage keeps its sample cached between refreshes, so
+		// answering is just a matter of copying it into the reply
+		key_desc_t const msg_desc[] = {
+			{"target", bdecode_node::string_t, 20, 0},
+			{"want", bdecode_node::list_t, 0, key_desc_t::optional},
+		};
+
+		bdecode_node msg_keys[2];
+		if (!verify_message(arg_ent, msg_desc, msg_keys, error_string))
+		{
+			incoming_error(e, error_string);
+			return;
+		}
+
+		sha1_hash const target(msg_keys[0].string_ptr());
+
+		write_nodes_entries(target, msg_keys[1], reply);
+		m_storage.get_infohashes_sample(reply);
+	}
 	else if (query == "announce_peer")
 	{
 		key_desc_t const msg_desc[] = {
@@ -1026,7 +1198,9 @@ void node::incoming_request(msg const& m, entry& e)
 			}
 
 			// msg_keys[4] is the signature, msg_keys[3] is the public key
-			if (!verify_mutable_item(buf, salt, seq, pk, sig))
+			if (m.sig == msg::signature_state::invalid
+				|| (m.sig == msg::signature_state::unverified
+					&& !verify_mutable_item(buf, salt, seq, pk, sig)))
 			{
 				m_counters.inc_stats_counter(counters::dht_invalid_put);
 				incoming_error(e, "invalid signature", 206);
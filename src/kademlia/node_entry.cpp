@@ -33,6 +33,8 @@ POSSIBILITY OF SUCH DAMAGE.
 #include "libtorrent/kademlia/node_entry.hpp"
 #include "libtorrent/aux_/time.hpp" // for aux::time_now()
 
+#include <cstdlib> // for abs
+
 namespace libtorrent { namespace dht {
 
 	node_entry::node_entry(node_id const& id_, udp::endpoint const& ep
@@ -42,6 +44,7 @@ namespace libtorrent { namespace dht {
 		, id(id_)
 		, endpoint(ep)
 		, rtt(roundtriptime & 0xffff)
+		, rtt_var(rtt == 0xffff ? 0 : std::uint16_t(rtt / 2))
 		, timeout_count(pinged ? 0 : 0xff)
 	{
 #ifndef TORRENT_DISABLE_LOGGING
@@ -54,6 +57,7 @@ namespace libtorrent { namespace dht {
 		, id(nullptr)
 		, endpoint(ep)
 		, rtt(0xffff)
+		, rtt_var(0)
 		, timeout_count(0xff)
 	{
 #ifndef TORRENT_DISABLE_LOGGING
@@ -65,6 +69,7 @@ namespace libtorrent { namespace dht {
 		: last_queried(min_time())
 		, id(nullptr)
 		, rtt(0xffff)
+		, rtt_var(0)
 		, timeout_count(0xff)
 	{
 #ifndef TORRENT_DISABLE_LOGGING
@@ -77,8 +82,22 @@ namespace libtorrent { namespace dht {
 		TORRENT_ASSERT(new_rtt <= 0xffff);
 		TORRENT_ASSERT(new_rtt >= 0);
 		if (new_rtt == 0xffff) return;
-		if (rtt == 0xffff) rtt = std::uint16_t(new_rtt);
-		else rtt = std::uint16_t(int(rtt) * 2 / 3 + new_rtt / 3);
+		if (rtt == 0xffff)
+		{
+			rtt = std::uint16_t(new_rtt);
+			rtt_var = std::uint16_t(new_rtt / 2);
+			return;
+		}
+		// the variance is updated against the previous average, like TCP
+		// does it
+		rtt_var = std::uint16_t(int(rtt_var) * 3 / 4 + std::abs(int(rtt) - new_rtt) / 4);
+		rtt = std::uint16_t(int(rtt) * 2 / 3 + new_rtt / 3);
+	}
+
+	int node_entry::request_timeout() const
+	{
+		if (rtt == 0xffff) return -1;
+		return int(rtt) + 4 * int(rtt_var);
 	}
 
 }}
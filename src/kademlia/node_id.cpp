@@ -31,10 +31,12 @@ POSSIBILITY OF SUCH DAMAGE.
 */
 
 #include <algorithm>
+#include <cstring> // for memcpy
 
 #include "libtorrent/kademlia/node_id.hpp"
 #include "libtorrent/kademlia/node_entry.hpp"
 #include "libtorrent/assert.hpp"
+#include "libtorrent/aux_/byteswap.hpp"
 #include "libtorrent/broadcast_socket.hpp" // for is_local et.al
 #include "libtorrent/random.hpp" // for random
 #include "libtorrent/hasher.hpp" // for hasher
@@ -52,9 +54,21 @@ node_id distance(node_id const& n1, node_id const& n2)
 // returns true if: distance(n1, ref) < distance(n2, ref)
 bool compare_ref(node_id const& n1, node_id const& n2, node_id const& ref)
 {
-	node_id const lhs = n1 ^ ref;
-	node_id const rhs = n2 ^ ref;
-	return lhs < rhs;
+	// the distances can only differ where n1 and n2 differ, so the first
+	// 32 bit word where they do decides the comparison. No need to build
+	// the full distances
+	for (std::size_t i = 0; i < node_id::size(); i += 4)
+	{
+		std::uint32_t w1;
+		std::uint32_t w2;
+		std::memcpy(&w1, n1.data() + i, 4);
+		std::memcpy(&w2, n2.data() + i, 4);
+		if (w1 == w2) continue;
+		std::uint32_t r;
+		std::memcpy(&r, ref.data() + i, 4);
+		return aux::network_to_host(w1 ^ r) < aux::network_to_host(w2 ^ r);
+	}
+	return false;
 }
 
 // returns n in: 2^n <= distance(n1, n2) < 2^(n+1)
@@ -47,12 +47,26 @@ char const* put_data::name() const { return "put_data"; }
 
 void put_data::start()
 {
+	if (m_waiting_for_data)
+	{
+		m_start_deferred = true;
+		return;
+	}
+
 	// router nodes must not be added to puts
 	init();
 	bool const is_done = add_requests();
 	if (is_done) done();
 }
 
+void put_data::set_data(item const& data)
+{
+	m_data = data;
+	if (!m_waiting_for_data) return;
+	m_waiting_for_data = false;
+	if (m_start_deferred) start();
+}
+
 void put_data::set_targets(std::vector<std::pair<node_entry, std::string>> const& targets)
 {
 	for (auto const& p : targets)
@@ -73,6 +73,23 @@ namespace {
 		// only when the node_id pass the verification, add it to routing table.
 		return !settings.enforce_node_id || verify_id(id, addr);
 	}
+
+	node_entry* find_endpoint(routing_table_node& bucket, udp::endpoint const& ep)
+	{
+		for (auto& n : bucket.replacements)
+		{
+			if (n.addr() != ep.address()) continue;
+			if (n.port() != ep.port()) continue;
+			return &n;
+		}
+		for (auto& n : bucket.live_nodes)
+		{
+			if (n.addr() != ep.address()) continue;
+			if (n.port() != ep.port()) continue;
+			return &n;
+		}
+		return nullptr;
+	}
 }
 
 void ip_set::insert(address const& addr)
@@ -335,27 +352,25 @@ node_entry* routing_table::find_node(udp::endpoint const& ep
 	for (table_t::iterator i = m_buckets.begin()
 		, end(m_buckets.end()); i != end; ++i)
 	{
-		for (bucket_t::iterator j = i->replacements.begin();
-			j != i->replacements.end(); ++j)
-		{
-			if (j->addr() != ep.address()) continue;
-			if (j->port() != ep.port()) continue;
-			*bucket = i;
-			return &*j;
-		}
-		for (bucket_t::iterator j = i->live_nodes.begin();
-			j != i->live_nodes.end(); ++j)
-		{
-			if (j->addr() != ep.address()) continue;
-			if (j->port() != ep.port()) continue;
-			*bucket = i;
-			return &*j;
-		}
+		node_entry* const n = find_endpoint(*i, ep);
+		if (n == nullptr) continue;
+		*bucket = i;
+		return n;
 	}
 	*bucket = m_buckets.end();
 	return nullptr;
 }
 
+node_entry const* routing_table::find_live_node(node_id const& id
+	, udp::endpoint const& ep)
+{
+	if (m_buckets.empty()) return nullptr;
+	bucket_t const& b = find_bucket(id)->live_nodes;
+	auto const i = std::find_if(b.begin(), b.end()
+		, [&](node_entry const& ne) { return ne.id == id && ne.ep() == ep; });
+	return i == b.end() ? nullptr : &*i;
+}
+
 void routing_table::fill_from_replacements(table_t::iterator bucket)
 {
 	bucket_t& b = bucket->live_nodes;
@@ -462,8 +477,13 @@ routing_table::add_node_status_t routing_table::add_node_impl(node_entry e)
 		// a response with a correct transaction ID, i.e. it is verified to not
 		// be the result of a poisoned routing table
 
-		table_t::iterator existing_bucket;
-		node_entry* existing = find_node(e.ep(), &existing_bucket);
+		// a node we already know is almost always found in the bucket its ID
+		// belongs in. Only if it isn't there do we need to scan the whole
+		// table
+		table_t::iterator existing_bucket = find_bucket(e.id);
+		node_entry* existing = find_endpoint(*existing_bucket, e.ep());
+		if (existing == nullptr)
+			existing = find_node(e.ep(), &existing_bucket);
 		if (existing == nullptr)
 		{
 			// the node we're trying to add is not a match with an existing node. we
@@ -1082,8 +1102,9 @@ void routing_table::find_node(node_id const& target
 
 		if (int(l.size()) > count)
 		{
-			// sort the nodes by how close they are to the target
-			std::sort(l.begin() + unsorted_start_idx, l.end()
+			// sort the nodes by how close they are to the target. Only the
+			// ones we keep need to end up in order
+			std::partial_sort(l.begin() + unsorted_start_idx, l.begin() + count, l.end()
 				, [&target](node_entry const& lhs, node_entry const& rhs)
 				{ return compare_ref(lhs.id, rhs.id, target); });
 
@@ -1121,8 +1142,9 @@ void routing_table::find_node(node_id const& target
 
 		if (int(l.size()) > count)
 		{
-			// sort the nodes by how close they are to the target
-			std::sort(l.begin() + unsorted_start_idx, l.end()
+			// sort the nodes by how close they are to the target. Only the
+			// ones we keep need to end up in order
+			std::partial_sort(l.begin() + unsorted_start_idx, l.begin() + count, l.end()
 				, [&target](node_entry const& lhs, node_entry const& rhs)
 				{ return compare_ref(lhs.id, rhs.id, target); });
 
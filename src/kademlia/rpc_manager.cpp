@@ -43,6 +43,7 @@ POSSIBILITY OF SUCH DAMAGE.
 #include <libtorrent/kademlia/dht_observer.hpp>
 #include <libtorrent/kademlia/direct_request.hpp>
 #include <libtorrent/kademlia/get_item.hpp>
+#include <libtorrent/kademlia/sample_infohashes.hpp>
 
 #include <libtorrent/socket_io.hpp> // for print_endpoint
 #include <libtorrent/hasher.hpp>
@@ -143,14 +144,17 @@ using observer_storage = aux::aligned_union<1
 	, get_item_observer
 	, get_peers_observer
 	, obfuscated_get_peers_observer
+	, sample_infohashes_observer
 	, null_observer
 	, traversal_observer>::type;
 
 rpc_manager::rpc_manager(node_id const& our_id
 	, dht_settings const& settings
 	, routing_table& table, udp_socket_interface* sock
-	, dht_logger* log)
-	: m_pool_allocator(sizeof(observer_storage), 10)
+	, dht_logger* log
+	, boost::pool<>* pool)
+	: m_own_pool(pool ? nullptr : new boost::pool<>(sizeof(observer_storage), 10))
+	, m_pool_allocator(pool ? *pool : *m_own_pool)
 	, m_sock(sock)
 #ifndef TORRENT_DISABLE_LOGGING
 	, m_log(log)
@@ -177,6 +181,11 @@ rpc_manager::~rpc_manager()
 	}
 }
 
+std::size_t rpc_manager::observer_size()
+{
+	return sizeof(observer_storage);
+}
+
 void* rpc_manager::allocate_observer()
 {
 	m_pool_allocator.set_next_size(10);
@@ -409,8 +418,16 @@ time_duration rpc_manager::tick()
 
 		// don't call short_timeout() again if we've
 		// already called it once
-		if (diff >= seconds(short_timeout) && !o->has_short_timeout())
+		if (!o->has_short_timeout())
 		{
+			time_duration const slow = milliseconds(o->short_timeout_ms());
+			if (diff < slow)
+			{
+				ret = std::min(duration_cast<time_duration>(slow - diff), ret);
+				++i;
+				continue;
+			}
+
 #ifndef TORRENT_DISABLE_LOGGING
 			if (m_log->should_log(dht_logger::rpc_manager))
 			{
@@ -471,6 +488,15 @@ bool rpc_manager::invoke(entry& e, udp::endpoint const& target_addr
 	o->set_target(target_addr);
 	o->set_transaction_id(tid);
 
+	// nodes we've heard from before get a short timeout based on how fast
+	// they have been responding. Without an RTT, we wait a second
+	constexpr int min_short_timeout = 300;
+	constexpr int max_short_timeout = 3000;
+	node_entry const* ne = m_table.find_live_node(o->id(), target_addr);
+	int const rto = ne == nullptr ? -1 : ne->request_timeout();
+	o->set_short_timeout(rto < 0 ? 1000
+		: std::max(min_short_timeout, std::min(rto, max_short_timeout)));
+
 #ifndef TORRENT_DISABLE_LOGGING
 	if (m_log != nullptr && m_log->should_log(dht_logger::rpc_manager))
 	{
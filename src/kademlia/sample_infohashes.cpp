@@ -0,0 +1,113 @@
+/*
+
+Copyright (c) 2017, Arvid Norberg
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions
+are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in
+      the documentation and/or other materials provided with the distribution.
+    * Neither the name of the author nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+#include <libtorrent/kademlia/sample_infohashes.hpp>
+#include <libtorrent/kademlia/node.hpp>
+#include <libtorrent/kademlia/dht_observer.hpp>
+
+namespace libtorrent { namespace dht {
+
+void sample_infohashes_observer::reply(msg const& m)
+{
+	bdecode_node const r = m.message.dict_find_dict("r");
+	if (!r)
+	{
+#ifndef TORRENT_DISABLE_LOGGING
+		get_observer()->log(dht_logger::traversal, "[%u] missing response dict"
+			, algorithm()->id());
+#endif
+		timeout();
+		return;
+	}
+
+	// nodes that don't support BEP 51 still return nodes, which keeps the
+	// traversal going. Only report the ones that sent samples
+	bdecode_node const samples = r.dict_find_string("samples");
+	if (samples && samples.string_length() % 20 == 0)
+	{
+		std::vector<sha1_hash> v;
+		v.reserve(std::size_t(samples.string_length() / 20));
+		char const* ptr = samples.string_ptr();
+		for (int i = 0; i < samples.string_length(); i += 20)
+			v.push_back(sha1_hash(ptr + i));
+
+		time_duration const interval = seconds(
+			std::max(int(r.dict_find_int_value("interval", 0)), 0));
+		int const num = int(r.dict_find_int_value("num", 0));
+
+		static_cast<sample_infohashes*>(algorithm())->got_samples(m.addr
+			, interval, num, v);
+	}
+
+	find_data_observer::reply(m);
+}
+
+sample_infohashes::sample_infohashes(node& dht_node, node_id const& target
+	, data_callback const& dcallback)
+	: find_data(dht_node, target, nodes_callback())
+	, m_data_callback(dcallback)
+{
+}
+
+char const* sample_infohashes::name() const { return "sample_infohashes"; }
+
+void sample_infohashes::got_samples(udp::endpoint const& ep
+	, time_duration const interval, int const num
+	, std::vector<sha1_hash> const& samples)
+{
+	if (m_data_callback) m_data_callback(ep, interval, num, samples);
+}
+
+bool sample_infohashes::invoke(observer_ptr o)
+{
+	if (m_done) return false;
+
+	entry e;
+	e["y"] = "q";
+	e["q"] = "sample_infohashes";
+	entry& a = e["a"];
+	a["target"] = target().to_string();
+
+	return m_node.m_rpc.invoke(e, o->target_ep(), o);
+}
+
+observer_ptr sample_infohashes::new_observer(udp::endpoint const& ep
+	, node_id const& id)
+{
+	auto o = m_node.m_rpc.allocate_observer<sample_infohashes_observer>(self(), ep, id);
+#if TORRENT_USE_ASSERTS
+	if (o) o->m_in_constructor = false;
+#endif
+	return o;
+}
+
+} } // namespace libtorrent::dht
@@ -0,0 +1,128 @@
+/*
+
+Copyright (c) 2017, Arvid Norberg
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions
+are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in
+      the documentation and/or other materials provided with the distribution.
+    * Neither the name of the author nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+
+#include "libtorrent/kademlia/signing_pool.hpp"
+
+#include <algorithm> // for max
+
+namespace libtorrent { namespace dht {
+
+	signing_pool::signing_pool(io_service& ios)
+		: m_ios(ios)
+		, m_threads(*this, ios)
+	{
+		m_threads.set_max_threads(1);
+	}
+
+	signing_pool::~signing_pool()
+	{
+		abort();
+	}
+
+	void signing_pool::set_max_threads(int const i)
+	{
+		m_threads.set_max_threads(std::max(i, 1));
+	}
+
+	void signing_pool::async_sign(entry value, std::string salt
+		, sequence_number const seq, public_key const& pk
+		, secret_key const& sk, handler_t handler)
+	{
+		std::unique_lock<std::mutex> l(m_mutex);
+		if (m_abort) return;
+		m_jobs.push_back(job{std::move(value), std::move(salt), seq, pk, sk
+			, std::move(handler)});
+		m_cond.notify_all();
+		m_threads.job_queued(int(m_jobs.size()));
+	}
+
+	void signing_pool::abort()
+	{
+		std::deque<job> dropped;
+		{
+			std::unique_lock<std::mutex> l(m_mutex);
+			if (m_abort) return;
+			m_abort = true;
+			dropped.swap(m_jobs);
+			m_cond.notify_all();
+		}
+		// the handlers may hold the last reference to our owner, make sure
+		// they're destructed outside of the lock
+		dropped.clear();
+		m_threads.abort(true);
+	}
+
+	void signing_pool::notify_all()
+	{
+		m_cond.notify_all();
+	}
+
+	void signing_pool::thread_fun(disk_io_thread_pool& pool, io_service::work work)
+	{
+		// the work object keeps the io_service running until we return,
+		// after we've posted the last handler
+		TORRENT_UNUSED(work);
+
+		std::unique_lock<std::mutex> l(m_mutex);
+		for (;;)
+		{
+			if (m_jobs.empty())
+			{
+				pool.thread_idle();
+				do
+				{
+					if (m_abort || (pool.should_exit()
+						&& pool.try_thread_exit(std::this_thread::get_id())))
+					{
+						pool.thread_active();
+						return;
+					}
+					m_cond.wait(l);
+				} while (m_jobs.empty());
+				pool.thread_active();
+			}
+
+			job j = std::move(m_jobs.front());
+			m_jobs.pop_front();
+			l.unlock();
+
+			item signed_item(std::move(j.value), j.salt, j.seq, j.pk, j.sk);
+
+			// the handler is moved into the posted function object, so that
+			// it's never destructed on this thread
+			m_ios.post(std::bind(std::move(j.handler), std::move(signed_item)));
+
+			l.lock();
+		}
+	}
+}}
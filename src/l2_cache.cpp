@@ -0,0 +1,313 @@
+/*
+
+Copyright (c) 2017, Arvid Norberg
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions
+are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in
+      the documentation and/or other materials provided with the distribution.
+    * Neither the name of the author nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+#include "libtorrent/aux_/l2_cache.hpp"
+#include "libtorrent/disk_buffer_pool.hpp"
+#include "libtorrent/performance_counters.hpp"
+#include "libtorrent/file.hpp"
+#include "libtorrent/assert.hpp"
+#include "libtorrent/aux_/alloca.hpp"
+
+#include <algorithm>
+
+namespace libtorrent { namespace aux {
+
+	l2_cache::l2_cache(disk_buffer_pool& pool, counters& cnt, int const block_size)
+		: m_pool(pool)
+		, m_stats_counters(cnt)
+		, m_block_size(block_size)
+	{}
+
+	l2_cache::~l2_cache() { abort(); }
+
+	void l2_cache::set_settings(std::string const& path, int const num_blocks
+		, error_code& ec)
+	{
+		std::unique_lock<std::mutex> l(m_mutex);
+		if (m_aborted) return;
+
+		int const size = path.empty() ? 0 : (std::max)(num_blocks, 0);
+		if (path == m_path && size == int(m_slots.size())) return;
+
+		// start over with an empty cache. The blocks waiting to be written
+		// would end up in slots of the old file
+		stop_thread(l);
+		free_pending(l, [](pending_t const&) { return true; });
+		m_enabled = false;
+		m_file.reset();
+		m_slots.clear();
+		m_index.clear();
+		m_hand = 0;
+		m_num_valid = 0;
+		m_path = path;
+
+		if (size == 0) return;
+
+		auto f = std::make_shared<file>();
+		if (!f->open(path, file::read_write | file::no_cache, ec)) return;
+		if (!f->set_size(std::int64_t(size) * m_block_size, ec)) return;
+
+		m_file = std::move(f);
+		m_slots.resize(std::size_t(size));
+		m_stop = false;
+		m_thread = std::thread(&l2_cache::fill_thread_fun, this);
+		m_enabled = true;
+	}
+
+	bool l2_cache::insert(storage_index_t const st, piece_index_t const piece
+		, int const block, char* buf, int const len)
+	{
+		TORRENT_ASSERT(len > 0 && len <= m_block_size);
+		if (!enabled()) return false;
+
+		std::unique_lock<std::mutex> l(m_mutex);
+		if (!m_enabled || m_stop) return false;
+		if (int(m_pending.size()) >= max_pending) return false;
+
+		key_t const k{st, piece, block};
+		if (m_index.count(k)) return false;
+
+		m_pending.push_back(pending_t{k, buf, len});
+		l.unlock();
+		m_cond.notify_one();
+		return true;
+	}
+
+	bool l2_cache::read(storage_index_t const st, piece_index_t const piece
+		, int const block, span<iovec_t const> bufs)
+	{
+		if (!enabled() || bufs.empty()) return false;
+
+		TORRENT_ALLOCA(slots, int, bufs.size());
+		TORRENT_ALLOCA(generations, std::uint32_t, bufs.size());
+
+		std::unique_lock<std::mutex> l(m_mutex);
+		if (!m_enabled) return false;
+		for (std::size_t i = 0; i < bufs.size(); ++i)
+		{
+			auto const it = m_index.find(key_t{st, piece, block + int(i)});
+			if (it == m_index.end()) return false;
+			slot_t& s = m_slots[std::size_t(it->second)];
+			if (!s.valid || int(bufs[i].iov_len) > s.len) return false;
+			slots[i] = it->second;
+			generations[i] = s.generation;
+		}
+		for (int const s : slots) m_slots[std::size_t(s)].referenced = true;
+		std::shared_ptr<file> f = m_file;
+		l.unlock();
+
+		// blocks in the cache file are rarely in consecutive slots, read them
+		// one at a time
+		for (std::size_t i = 0; i < bufs.size(); ++i)
+		{
+			error_code ec;
+			std::int64_t const ret = f->readv(std::int64_t(slots[i]) * m_block_size
+				, bufs.subspan(i, 1), ec);
+			if (ec || ret < std::int64_t(bufs[i].iov_len)) return false;
+		}
+
+		// if any of the slots were reused (or dropped) while we were reading,
+		// we may have read some other block
+		l.lock();
+		if (f != m_file) return false;
+		for (std::size_t i = 0; i < bufs.size(); ++i)
+		{
+			if (m_slots[std::size_t(slots[i])].generation != generations[i])
+				return false;
+		}
+		l.unlock();
+
+		m_stats_counters.inc_stats_counter(counters::num_blocks_read_l2
+			, int(bufs.size()));
+		return true;
+	}
+
+	void l2_cache::invalidate(storage_index_t const st, piece_index_t const piece
+		, int const block)
+	{
+		if (!enabled()) return;
+
+		key_t const k{st, piece, block};
+		std::unique_lock<std::mutex> l(m_mutex);
+		auto const it = m_index.find(k);
+		if (it != m_index.end()) drop_slot(it->second);
+
+		if (m_pending.empty()) return;
+		free_pending(l, [&k](pending_t const& p) { return p.key == k; });
+	}
+
+	void l2_cache::invalidate(storage_index_t const st)
+	{
+		if (!enabled()) return;
+
+		std::unique_lock<std::mutex> l(m_mutex);
+		for (int i = 0; i < int(m_slots.size()); ++i)
+		{
+			if (m_slots[std::size_t(i)].used && m_slots[std::size_t(i)].key.storage == st)
+				drop_slot(i);
+		}
+		free_pending(l, [st](pending_t const& p) { return p.key.storage == st; });
+	}
+
+	void l2_cache::abort()
+	{
+		std::unique_lock<std::mutex> l(m_mutex);
+		m_aborted = true;
+		m_enabled = false;
+		stop_thread(l);
+		free_pending(l, [](pending_t const&) { return true; });
+	}
+
+	int l2_cache::size() const
+	{
+		std::lock_guard<std::mutex> l(m_mutex);
+		return m_num_valid;
+	}
+
+	void l2_cache::fill_thread_fun()
+	{
+		std::unique_lock<std::mutex> l(m_mutex);
+		for (;;)
+		{
+			while (m_pending.empty() && !m_stop) m_cond.wait(l);
+			if (m_stop) return;
+
+			pending_t const p = m_pending.front();
+			m_pending.pop_front();
+
+			int const s = pick_slot(p.key);
+			if (s < 0)
+			{
+				l.unlock();
+				m_pool.free_buffer(p.buf);
+				l.lock();
+				continue;
+			}
+
+			std::uint32_t const generation = m_slots[std::size_t(s)].generation;
+			std::shared_ptr<file> f = m_file;
+			l.unlock();
+
+			error_code ec;
+			iovec_t const b = {p.buf, std::size_t(p.len)};
+			std::int64_t const ret = f->writev(std::int64_t(s) * m_block_size, b, ec);
+			m_pool.free_buffer(p.buf);
+
+			l.lock();
+			// the slot may have been invalidated while we were writing it
+			slot_t& sl = m_slots[std::size_t(s)];
+			if (sl.generation != generation) continue;
+			if (ec || ret < p.len)
+			{
+				drop_slot(s);
+				continue;
+			}
+			sl.valid = true;
+			sl.len = p.len;
+			++m_num_valid;
+			m_stats_counters.inc_stats_counter(counters::num_blocks_written_l2);
+		}
+	}
+
+	int l2_cache::pick_slot(key_t const& k)
+	{
+		// the same block may be spilled again before it was written the first
+		// time
+		if (m_index.count(k)) return -1;
+
+		int const num_slots = int(m_slots.size());
+		for (int i = 0; i < num_slots * 2; ++i)
+		{
+			int const s = m_hand;
+			m_hand = (m_hand + 1) % num_slots;
+			slot_t& sl = m_slots[std::size_t(s)];
+
+			// this slot is being written to
+			if (sl.used && !sl.valid) continue;
+
+			if (sl.used && sl.referenced)
+			{
+				sl.referenced = false;
+				continue;
+			}
+
+			if (sl.used) drop_slot(s);
+			sl.used = true;
+			sl.key = k;
+			m_index.insert(std::make_pair(k, s));
+			return s;
+		}
+		return -1;
+	}
+
+	void l2_cache::drop_slot(int const s)
+	{
+		slot_t& sl = m_slots[std::size_t(s)];
+		TORRENT_ASSERT(sl.used);
+		m_index.erase(sl.key);
+		if (sl.valid)
+		{
+			TORRENT_ASSERT(m_num_valid > 0);
+			--m_num_valid;
+		}
+		++sl.generation;
+		sl.used = false;
+		sl.valid = false;
+		sl.referenced = false;
+		sl.len = 0;
+	}
+
+	template <typename Pred>
+	void l2_cache::free_pending(std::unique_lock<std::mutex>& l, Pred pred)
+	{
+		std::vector<char*> to_free;
+		auto const i = std::stable_partition(m_pending.begin(), m_pending.end()
+			, [&pred](pending_t const& p) { return !pred(p); });
+		for (auto j = i; j != m_pending.end(); ++j) to_free.push_back(j->buf);
+		m_pending.erase(i, m_pending.end());
+		if (to_free.empty()) return;
+
+		l.unlock();
+		m_pool.free_multiple_buffers(to_free);
+		l.lock();
+	}
+
+	void l2_cache::stop_thread(std::unique_lock<std::mutex>& l)
+	{
+		if (!m_thread.joinable()) return;
+		m_stop = true;
+		l.unlock();
+		m_cond.notify_all();
+		m_thread.join();
+		l.lock();
+	}
+}}
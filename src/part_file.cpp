@@ -59,6 +59,10 @@ POSSIBILITY OF SUCH DAMAGE.
   // header to an even multiple of 1024 bytes.
   uint8_t padding[n];
 
+  Since every piece has a fixed location in the header, once a complete
+  header has been written, flushing the metadata only rewrites the slot
+  entries that changed since the last flush.
+
 */
 
 #include "libtorrent/part_file.hpp"
@@ -69,12 +73,17 @@ POSSIBILITY OF SUCH DAMAGE.
 
 #include <functional> // for std::function
 #include <cstdint>
+#include <algorithm>
 
 namespace {
 
 	// round up to even kilobyte
 	int round_up(int n)
 	{ return (n + 1023) & ~0x3ff; }
+
+	// if the dirty slot entries can't be written in this many contiguous
+	// ranges, just rewrite the whole header instead
+	int const max_header_ranges = 16;
 }
 
 namespace libtorrent {
@@ -96,7 +105,7 @@ namespace libtorrent {
 		if (ec) return;
 
 		// parse header
-		std::unique_ptr<std::uint32_t[]> header(new std::uint32_t[m_header_size]);
+		std::unique_ptr<char[]> header(new char[std::size_t(m_header_size)]);
 		iovec_t b = {header.get(), std::size_t(m_header_size)};
 		int n = int(m_file.readv(0, b, ec));
 		if (ec) return;
@@ -105,7 +114,7 @@ namespace libtorrent {
 		if (n < m_header_size) return;
 		using namespace libtorrent::detail;
 
-		char* ptr = reinterpret_cast<char*>(header.get());
+		char const* ptr = header.get();
 		// we have a header. Parse it
 		int const num_pieces_ = int(read_uint32(ptr));
 		int const piece_size_ = int(read_uint32(ptr));
@@ -132,8 +141,9 @@ namespace libtorrent {
 				m_num_allocated = next(slot);
 
 			free_slots[slot] = false;
-			m_piece_map[i] = slot;
+			m_piece_map.push_back({i, slot});
 		}
+		m_header_on_disk = true;
 
 		// now, populate the free_list with the "holes"
 		for (slot_index_t i(0); i < m_num_allocated; ++i)
@@ -150,16 +160,32 @@ namespace libtorrent {
 		flush_metadata_impl(ec);
 	}
 
+	std::vector<part_file::piece_slot>::iterator part_file::find_piece(
+		piece_index_t const piece)
+	{
+		auto const i = std::lower_bound(m_piece_map.begin(), m_piece_map.end()
+			, piece, [](piece_slot const& e, piece_index_t const p)
+			{ return e.piece < p; });
+		if (i == m_piece_map.end() || i->piece != piece) return m_piece_map.end();
+		return i;
+	}
+
+	void part_file::mark_dirty(piece_index_t const piece)
+	{
+		m_dirty_pieces.push_back(piece);
+		m_dirty_metadata = true;
+	}
+
 	slot_index_t part_file::allocate_slot(piece_index_t const piece)
 	{
 		// the mutex is assumed to be held here, since this is a private function
 
-		TORRENT_ASSERT(m_piece_map.find(piece) == m_piece_map.end());
+		TORRENT_ASSERT(find_piece(piece) == m_piece_map.end());
 		slot_index_t slot(-1);
 		if (!m_free_slots.empty())
 		{
-			slot = m_free_slots.front();
-			m_free_slots.erase(m_free_slots.begin());
+			slot = m_free_slots.back();
+			m_free_slots.pop_back();
 		}
 		else
 		{
@@ -167,8 +193,11 @@ namespace libtorrent {
 			++m_num_allocated;
 		}
 
-		m_piece_map[piece] = slot;
-		m_dirty_metadata = true;
+		auto const i = std::lower_bound(m_piece_map.begin(), m_piece_map.end()
+			, piece, [](piece_slot const& e, piece_index_t const p)
+			{ return e.piece < p; });
+		m_piece_map.insert(i, {piece, slot});
+		mark_dirty(piece);
 		return slot;
 	}
 
@@ -181,9 +210,9 @@ namespace libtorrent {
 		open_file(file::read_write, ec);
 		if (ec) return -1;
 
-		auto const i = m_piece_map.find(piece);
+		auto const i = find_piece(piece);
 		slot_index_t const slot = (i == m_piece_map.end())
-			? allocate_slot(piece) : i->second;
+			? allocate_slot(piece) : i->slot;
 
 		l.unlock();
 
@@ -197,7 +226,7 @@ namespace libtorrent {
 		TORRENT_ASSERT(offset >= 0);
 		std::unique_lock<std::mutex> l(m_mutex);
 
-		auto const i = m_piece_map.find(piece);
+		auto const i = find_piece(piece);
 		if (i == m_piece_map.end())
 		{
 			ec = error_code(boost::system::errc::no_such_file_or_directory
@@ -205,7 +234,7 @@ namespace libtorrent {
 			return -1;
 		}
 
-		slot_index_t const slot = i->second;
+		slot_index_t const slot = i->slot;
 		open_file(file::read_write, ec);
 		if (ec) return -1;
 
@@ -240,7 +269,7 @@ namespace libtorrent {
 	{
 		std::lock_guard<std::mutex> l(m_mutex);
 
-		auto const i = m_piece_map.find(piece);
+		auto const i = find_piece(piece);
 		if (i == m_piece_map.end()) return;
 
 		// TODO: what do we do if someone is currently reading from the disk
@@ -248,9 +277,9 @@ namespace libtorrent {
 		// data from disk, but it may be overwritten soon, it's probably not that
 		// big of a deal
 
-		m_free_slots.push_back(i->second);
+		m_free_slots.push_back(i->slot);
 		m_piece_map.erase(i);
-		m_dirty_metadata = true;
+		mark_dirty(piece);
 	}
 
 	void part_file::move_partfile(std::string const& path, error_code& ec)
@@ -296,11 +325,11 @@ namespace libtorrent {
 		std::int64_t file_offset = 0;
 		for (; piece < end; ++piece)
 		{
-			auto const i = m_piece_map.find(piece);
+			auto const i = find_piece(piece);
 			int const block_to_copy = int(std::min(m_piece_size - piece_offset, size));
 			if (i != m_piece_map.end())
 			{
-				slot_index_t const slot = i->second;
+				slot_index_t const slot = i->slot;
 				open_file(file::read_only, ec);
 				if (ec) return;
 
@@ -329,14 +358,14 @@ namespace libtorrent {
 					// another thread removed this slot map entry, and invalidated
 					// our iterator. Now that we hold the lock again, perform
 					// another lookup to be sure.
-					auto const j = m_piece_map.find(piece);
+					auto const j = find_piece(piece);
 					if (j != m_piece_map.end())
 					{
 						// if the slot moved, that's really suspicious
-						TORRENT_ASSERT(j->second == slot);
-						m_free_slots.push_back(j->second);
+						TORRENT_ASSERT(j->slot == slot);
+						m_free_slots.push_back(j->slot);
 						m_piece_map.erase(j);
-						m_dirty_metadata = true;
+						mark_dirty(piece);
 					}
 				}
 			}
@@ -353,8 +382,34 @@ namespace libtorrent {
 		flush_metadata_impl(ec);
 	}
 
-	// TODO: instead of rebuilding the whole file header
-	// and flushing it, update the slot entries as we go
+	void part_file::write_slot_entries(piece_index_t const first
+		, piece_index_t const last, error_code& ec)
+	{
+		int const num = static_cast<int>(last) - static_cast<int>(first) + 1;
+		TORRENT_ASSERT(num > 0);
+		std::unique_ptr<char[]> buf(new char[std::size_t(num) * 4]);
+
+		using namespace libtorrent::detail;
+
+		char* ptr = buf.get();
+		auto i = std::lower_bound(m_piece_map.begin(), m_piece_map.end()
+			, first, [](piece_slot const& e, piece_index_t const p)
+			{ return e.piece < p; });
+		for (piece_index_t piece = first; piece <= last; ++piece)
+		{
+			slot_index_t slot(-1);
+			if (i != m_piece_map.end() && i->piece == piece)
+			{
+				slot = i->slot;
+				++i;
+			}
+			write_int32(static_cast<int>(slot), ptr);
+		}
+
+		iovec_t b = {buf.get(), std::size_t(num) * 4};
+		m_file.writev(8 + std::int64_t(static_cast<int>(first)) * 4, b, ec);
+	}
+
 	void part_file::flush_metadata_impl(error_code& ec)
 	{
 		// do we need to flush the metadata?
@@ -371,31 +426,78 @@ namespace libtorrent {
 
 			if (ec == boost::system::errc::no_such_file_or_directory)
 				ec.clear();
+			if (ec) return;
+
+			m_header_on_disk = false;
+			m_dirty_pieces.clear();
+			m_dirty_metadata = false;
 			return;
 		}
 
 		open_file(file::read_write, ec);
 		if (ec) return;
 
-		std::unique_ptr<std::uint32_t[]> header(new std::uint32_t[m_header_size]);
+		if (m_header_on_disk)
+		{
+			// the header on disk is valid, we just need to update the slot
+			// entries that changed. Coalesce them into contiguous ranges
+			std::sort(m_dirty_pieces.begin(), m_dirty_pieces.end());
+			m_dirty_pieces.erase(std::unique(m_dirty_pieces.begin()
+				, m_dirty_pieces.end()), m_dirty_pieces.end());
+
+			int num_ranges = 0;
+			for (std::size_t i = 0; i < m_dirty_pieces.size(); ++i)
+			{
+				if (i == 0 || next(m_dirty_pieces[i - 1]) != m_dirty_pieces[i])
+					++num_ranges;
+			}
+
+			if (num_ranges <= max_header_ranges)
+			{
+				std::size_t first = 0;
+				for (std::size_t i = 1; i <= m_dirty_pieces.size(); ++i)
+				{
+					if (i < m_dirty_pieces.size()
+						&& next(m_dirty_pieces[i - 1]) == m_dirty_pieces[i])
+						continue;
+					write_slot_entries(m_dirty_pieces[first], m_dirty_pieces[i - 1], ec);
+					if (ec) return;
+					first = i;
+				}
+				m_dirty_pieces.clear();
+				m_dirty_metadata = false;
+				return;
+			}
+		}
+
+		std::unique_ptr<char[]> header(new char[std::size_t(m_header_size)]);
 
 		using namespace libtorrent::detail;
 
-		char* ptr = reinterpret_cast<char*>(header.get());
+		char* ptr = header.get();
 
 		write_uint32(m_max_pieces, ptr);
 		write_uint32(m_piece_size, ptr);
 
+		auto i = m_piece_map.begin();
 		for (piece_index_t piece(0); piece < piece_index_t(m_max_pieces); ++piece)
 		{
-			auto const i = m_piece_map.find(piece);
-			slot_index_t const slot(i == m_piece_map.end()
-				? slot_index_t(-1) : i->second);
+			slot_index_t slot(-1);
+			if (i != m_piece_map.end() && i->piece == piece)
+			{
+				slot = i->slot;
+				++i;
+			}
 			write_int32(static_cast<int>(slot), ptr);
 		}
-		std::memset(ptr, 0, std::size_t(m_header_size - (ptr - reinterpret_cast<char*>(header.get()))));
+		std::memset(ptr, 0, std::size_t(m_header_size - (ptr - header.get())));
 
 		iovec_t b = {header.get(), std::size_t(m_header_size)};
 		m_file.writev(0, b, ec);
+		if (ec) return;
+
+		m_header_on_disk = true;
+		m_dirty_pieces.clear();
+		m_dirty_metadata = false;
 	}
 }
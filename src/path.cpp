@@ -73,6 +73,8 @@ POSSIBILITY OF SUCH DAMAGE.
 #include "libtorrent/string_util.hpp"
 #include "libtorrent/aux_/max_path.hpp" // for TORRENT_MAX_PATH
 #include <cstring>
+#include <memory>
+#include <algorithm>
 
 // for convert_to_wstring and convert_to_native
 #include "libtorrent/aux_/escape_string.hpp"
@@ -113,6 +115,12 @@ POSSIBILITY OF SUCH DAMAGE.
 // linux specifics
 
 #include <sys/ioctl.h>
+#include <sys/sendfile.h>
+#include <sys/syscall.h>
+
+#ifndef FICLONE
+#define FICLONE _IOW(0x94, 9, int)
+#endif
 
 #elif defined __APPLE__ && defined __MACH__ && MAC_OS_X_VERSION_MIN_REQUIRED >= 1050
 // mac specifics
@@ -229,6 +237,7 @@ namespace libtorrent {
 		s->ctime = file_time_to_posix(data.ftCreationTime);
 		s->atime = file_time_to_posix(data.ftLastAccessTime);
 		s->mtime = file_time_to_posix(data.ftLastWriteTime);
+		s->device = data.dwVolumeSerialNumber;
 
 		s->mode = (data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)
 			? file_status::directory
@@ -255,6 +264,7 @@ namespace libtorrent {
 		s->atime = std::uint64_t(ret.st_atime);
 		s->mtime = std::uint64_t(ret.st_mtime);
 		s->ctime = std::uint64_t(ret.st_ctime);
+		s->device = std::uint64_t(ret.st_dev);
 
 		s->mode = (S_ISREG(ret.st_mode) ? file_status::regular_file : 0)
 			| (S_ISDIR(ret.st_mode) ? file_status::directory : 0)
@@ -419,6 +429,88 @@ namespace libtorrent {
 		}
 	}
 
+namespace {
+
+	// the size of the buffer files are copied through when they can't be
+	// copied by the kernel
+	std::size_t const copy_buffer_size = 256 * 1024;
+}
+
+#if defined TORRENT_LINUX
+namespace {
+
+	// the number of bytes copied by each system call. Smaller chunks don't
+	// hold up a signal (or the kernel) for as long
+	std::size_t const copy_chunk = 64 * 1024 * 1024;
+
+	// errors meaning the system call isn't supported for these files (or at
+	// all), and another method should be tried
+	bool not_supported(int const err)
+	{
+		return err == ENOSYS || err == EXDEV || err == EINVAL
+			|| err == EOPNOTSUPP || err == ENOTTY;
+	}
+
+	// copies all of ``infd`` to ``outfd`` without passing the data through
+	// user space. First by sharing the data (a reflink) on file systems that
+	// support it, such as btrfs and xfs. Then with copy_file_range(), which
+	// may let the file system or the storage device do the copy, and last
+	// with sendfile(). Returns false if none of them can be used for these
+	// files, in which case nothing has been copied.
+	bool kernel_copy(int const infd, int const outfd, error_code& ec)
+	{
+		if (::ioctl(outfd, FICLONE, infd) == 0) return true;
+
+		struct stat st;
+		if (::fstat(infd, &st) < 0)
+		{
+			ec.assign(errno, system_category());
+			return true;
+		}
+		std::int64_t remaining = st.st_size;
+		if (remaining == 0) return true;
+
+#ifdef SYS_copy_file_range
+		std::int64_t const size = remaining;
+		while (remaining > 0)
+		{
+			long const ret = ::syscall(SYS_copy_file_range, infd, nullptr, outfd, nullptr
+				, std::size_t(std::min(remaining, std::int64_t(copy_chunk))), 0u);
+			if (ret < 0)
+			{
+				if (errno == EINTR) continue;
+				if (remaining == size && not_supported(errno)) break;
+				ec.assign(errno, system_category());
+				return true;
+			}
+			// the file was truncated while we copied it
+			if (ret == 0) return true;
+			remaining -= ret;
+		}
+		if (remaining < size) return true;
+#endif
+
+		bool first = true;
+		while (remaining > 0)
+		{
+			ssize_t const ret = ::sendfile(outfd, infd, nullptr
+				, std::size_t(std::min(remaining, std::int64_t(copy_chunk))));
+			if (ret < 0)
+			{
+				if (errno == EINTR) continue;
+				if (first && not_supported(errno)) return false;
+				ec.assign(errno, system_category());
+				return true;
+			}
+			if (ret == 0) return true;
+			remaining -= ret;
+			first = false;
+		}
+		return true;
+	}
+}
+#endif
+
 	void copy_file(std::string const& inf, std::string const& newf, error_code& ec)
 	{
 		ec.clear();
@@ -456,30 +548,40 @@ namespace libtorrent {
 			| S_IRGRP | S_IWGRP
 			| S_IROTH | S_IWOTH;
 
-		int const outfd = ::open(f2.c_str(), O_WRONLY | O_CREAT, permissions);
+		int const outfd = ::open(f2.c_str(), O_WRONLY | O_CREAT | O_TRUNC, permissions);
 		if (outfd < 0)
 		{
 			close(infd);
 			ec.assign(errno, system_category());
 			return;
 		}
-		char buffer[4096];
+
+#if defined TORRENT_LINUX
+		if (kernel_copy(infd, outfd, ec))
+		{
+			close(infd);
+			close(outfd);
+			return;
+		}
+#endif
+
+		std::unique_ptr<char[]> buffer(new char[copy_buffer_size]);
 		for (;;)
 		{
-			int const num_read = int(read(infd, buffer, sizeof(buffer)));
+			ssize_t const num_read = read(infd, buffer.get(), copy_buffer_size);
 			if (num_read == 0) break;
 			if (num_read < 0)
 			{
+				if (errno == EINTR) continue;
 				ec.assign(errno, system_category());
 				break;
 			}
-			int const num_written = int(write(outfd, buffer, std::size_t(num_read)));
+			ssize_t const num_written = write(outfd, buffer.get(), std::size_t(num_read));
 			if (num_written < num_read)
 			{
-				ec.assign(errno, system_category());
+				ec.assign(num_written < 0 ? errno : ENOSPC, system_category());
 				break;
 			}
-			if (num_read < int(sizeof(buffer))) break;
 		}
 		close(infd);
 		close(outfd);
@@ -53,6 +53,15 @@ POSSIBILITY OF SUCH DAMAGE.
 #include "libtorrent/aux_/alloca.hpp"
 #include "libtorrent/pe_crypto.hpp"
 #include "libtorrent/hasher.hpp"
+#include "libtorrent/aux_/throw.hpp"
+
+#ifdef TORRENT_USE_LIBCRYPTO
+#include "libtorrent/aux_/disable_warnings_push.hpp"
+extern "C" {
+#include <openssl/bn.h>
+}
+#include "libtorrent/aux_/disable_warnings_pop.hpp"
+#endif
 
 namespace libtorrent {
 
@@ -62,6 +71,347 @@ namespace libtorrent {
 		// TODO: it would be nice to get the literal working
 		key_t const dh_prime
 			("0xFFFFFFFFFFFFFFFFC90FDAA22168C234C4C6628B80DC1CD129024E088A67CC74020BBEA63B139B22514A08798E3404DDEF9519B3CD3A431B302B0A6DF25F14374FE1356D6D51C245E485B576625E7EC6F44C42E9A63A36210000000000090563");
+
+		using key_bytes = std::array<std::uint8_t, 96>;
+
+#ifdef TORRENT_USE_LIBCRYPTO
+
+		// the prime and its montgomery context are set up once and only read
+		// from then on, which lets them be shared across threads
+		struct bn_field
+		{
+			bn_field()
+			{
+				std::array<char, 96> const buf = export_key(dh_prime);
+				p = BN_bin2bn(reinterpret_cast<unsigned char const*>(buf.data())
+					, int(buf.size()), nullptr);
+				BN_CTX* ctx = BN_CTX_new();
+				mont = BN_MONT_CTX_new();
+				if (p == nullptr || ctx == nullptr || mont == nullptr
+					|| BN_MONT_CTX_set(mont, p, ctx) == 0)
+				{
+					BN_CTX_free(ctx);
+					aux::throw_ex<std::bad_alloc>();
+				}
+				BN_CTX_free(ctx);
+			}
+			~bn_field()
+			{
+				BN_MONT_CTX_free(mont);
+				BN_free(p);
+			}
+			bn_field(bn_field const&) = delete;
+			bn_field& operator=(bn_field const&) = delete;
+
+			BIGNUM* p;
+			BN_MONT_CTX* mont;
+		};
+
+		// out = (base ^ exp) % dh_prime
+		void dh_powm(std::uint8_t const* base, std::uint8_t const* exp, std::uint8_t* out)
+		{
+			static bn_field const field;
+
+			BN_CTX* ctx = BN_CTX_new();
+			if (ctx == nullptr) aux::throw_ex<std::bad_alloc>();
+			BN_CTX_start(ctx);
+			BIGNUM* b = BN_CTX_get(ctx);
+			BIGNUM* e = BN_CTX_get(ctx);
+			BIGNUM* r = BN_CTX_get(ctx);
+			bool const ok = r != nullptr
+				&& BN_bin2bn(base, 96, b) != nullptr
+				&& BN_bin2bn(exp, 96, e) != nullptr
+				// the base may be a remote public key, not necessarily less than p
+				&& BN_nnmod(b, b, field.p, ctx) == 1
+				&& BN_mod_exp_mont_consttime(r, b, e, field.p, ctx, field.mont) == 1;
+			if (ok)
+			{
+				int const len = BN_num_bytes(r);
+				std::memset(out, 0, std::size_t(96 - len));
+				BN_bn2bin(r, out + 96 - len);
+			}
+			BN_CTX_end(ctx);
+			BN_CTX_free(ctx);
+			if (!ok) aux::throw_ex<std::bad_alloc>();
+		}
+
+#else
+
+		// the modular exponentiations of the handshake are performed on fixed
+		// width numbers, using montgomery multiplication. Every number is
+		// exactly as wide as the prime, which lets all loops be unrolled and
+		// avoids any allocations or normalization that cpp_int would do. The
+		// limbs are stored least significant first
+#if defined __SIZEOF_INT128__
+		using limb_t = std::uint64_t;
+		__extension__ using dlimb_t = unsigned __int128;
+#else
+		using limb_t = std::uint32_t;
+		using dlimb_t = std::uint64_t;
+#endif
+		int const limb_bits = int(sizeof(limb_t)) * 8;
+		int const num_limbs = 768 / limb_bits;
+		using bignum = std::array<limb_t, num_limbs>;
+
+		bignum bignum_from_bytes(std::uint8_t const* in)
+		{
+			bignum ret;
+			for (int i = 0; i < num_limbs; ++i)
+			{
+				limb_t l = 0;
+				std::uint8_t const* p = in + (num_limbs - 1 - i) * int(sizeof(limb_t));
+				for (int k = 0; k < int(sizeof(limb_t)); ++k)
+					l = static_cast<limb_t>((l << 8) | p[k]);
+				ret[std::size_t(i)] = l;
+			}
+			return ret;
+		}
+
+		void bignum_to_bytes(bignum const& n, std::uint8_t* out)
+		{
+			for (int i = 0; i < num_limbs; ++i)
+			{
+				limb_t l = n[std::size_t(i)];
+				std::uint8_t* p = out + (num_limbs - i) * int(sizeof(limb_t));
+				for (int k = 0; k < int(sizeof(limb_t)); ++k)
+				{
+					*--p = static_cast<std::uint8_t>(l & 0xff);
+					l >>= 8;
+				}
+			}
+		}
+
+		// sets r = a - b and returns the borrow
+		limb_t bignum_sub(bignum& r, bignum const& a, bignum const& b)
+		{
+			limb_t borrow = 0;
+			for (std::size_t i = 0; i < num_limbs; ++i)
+			{
+				dlimb_t const d = dlimb_t(a[i]) - b[i] - borrow;
+				r[i] = static_cast<limb_t>(d);
+				borrow = static_cast<limb_t>(d >> limb_bits) & 1;
+			}
+			return borrow;
+		}
+
+		// sets r = a + b and returns the carry
+		limb_t bignum_add(bignum& r, bignum const& a, bignum const& b)
+		{
+			limb_t carry = 0;
+			for (std::size_t i = 0; i < num_limbs; ++i)
+			{
+				dlimb_t const s = dlimb_t(a[i]) + b[i] + carry;
+				r[i] = static_cast<limb_t>(s);
+				carry = static_cast<limb_t>(s >> limb_bits);
+			}
+			return carry;
+		}
+
+		// sets r to a if select is all ones and leaves it unchanged if it's
+		// zero, without branching on select
+		void bignum_select(bignum& r, bignum const& a, limb_t const select)
+		{
+			for (std::size_t i = 0; i < num_limbs; ++i)
+				r[i] = static_cast<limb_t>((a[i] & select) | (r[i] & ~select));
+		}
+
+		struct montgomery
+		{
+			montgomery()
+			{
+				std::array<char, 96> const buf = export_key(dh_prime);
+				p = bignum_from_bytes(reinterpret_cast<std::uint8_t const*>(buf.data()));
+
+				// p_inv = -p^-1 mod 2^limb_bits. Each newton iteration doubles the
+				// number of correct low bits. p[0] is its own inverse modulo 8,
+				// giving 3 correct bits to start with
+				limb_t inv = p[0];
+				for (int i = 0; i < 6; ++i)
+					inv = static_cast<limb_t>(inv * (2 - p[0] * inv));
+				p_inv = static_cast<limb_t>(0 - inv);
+
+				// R = 2^768. Since the top bit of the prime is set, R mod p is
+				// simply R - p
+				bignum zero{};
+				bignum_sub(one, zero, p);
+
+				// R^2 mod p, by doubling R another 768 times
+				r2 = one;
+				for (int i = 0; i < 768; ++i)
+				{
+					limb_t const carry = bignum_add(r2, r2, r2);
+					reduce(r2, carry);
+				}
+			}
+
+			// given a number less than 2p (with the 769th bit in carry), reduce
+			// it to be less than p, in constant time
+			void reduce(bignum& n, limb_t const carry) const
+			{
+				bignum t;
+				limb_t const borrow = bignum_sub(t, n, p);
+				// use the difference unless it underflowed without there being a
+				// carry to absorb it
+				bignum_select(n, t, static_cast<limb_t>(0 - (carry | (borrow ^ 1))));
+			}
+
+			// returns a * b * R^-1 mod p (CIOS method)
+			bignum mul(bignum const& a, bignum const& b) const
+			{
+				std::array<limb_t, num_limbs + 2> t{};
+				for (std::size_t i = 0; i < num_limbs; ++i)
+				{
+					limb_t c = 0;
+					for (std::size_t j = 0; j < num_limbs; ++j)
+					{
+						dlimb_t const s = dlimb_t(a[j]) * b[i] + t[j] + c;
+						t[j] = static_cast<limb_t>(s);
+						c = static_cast<limb_t>(s >> limb_bits);
+					}
+					dlimb_t s = dlimb_t(t[num_limbs]) + c;
+					t[num_limbs] = static_cast<limb_t>(s);
+					t[num_limbs + 1] = static_cast<limb_t>(s >> limb_bits);
+
+					limb_t const m = static_cast<limb_t>(t[0] * p_inv);
+					s = dlimb_t(m) * p[0] + t[0];
+					c = static_cast<limb_t>(s >> limb_bits);
+					for (std::size_t j = 1; j < num_limbs; ++j)
+					{
+						s = dlimb_t(m) * p[j] + t[j] + c;
+						t[j - 1] = static_cast<limb_t>(s);
+						c = static_cast<limb_t>(s >> limb_bits);
+					}
+					s = dlimb_t(t[num_limbs]) + c;
+					t[num_limbs - 1] = static_cast<limb_t>(s);
+					t[num_limbs] = static_cast<limb_t>(t[num_limbs + 1] + (s >> limb_bits));
+				}
+
+				bignum ret;
+				std::copy(t.begin(), t.begin() + num_limbs, ret.begin());
+				reduce(ret, t[num_limbs]);
+				return ret;
+			}
+
+			// returns a * a * R^-1 mod p. Computes the full double width square,
+			// only computing each cross product once, followed by a separate
+			// montgomery reduction
+			bignum sqr(bignum const& a) const
+			{
+				std::array<limb_t, num_limbs * 2> t{};
+				for (std::size_t i = 0; i < num_limbs; ++i)
+				{
+					limb_t c = 0;
+					for (std::size_t j = i + 1; j < num_limbs; ++j)
+					{
+						dlimb_t const s = dlimb_t(a[i]) * a[j] + t[i + j] + c;
+						t[i + j] = static_cast<limb_t>(s);
+						c = static_cast<limb_t>(s >> limb_bits);
+					}
+					t[i + num_limbs] = c;
+				}
+
+				// double the cross products and add the squares
+				limb_t c = 0;
+				for (std::size_t i = 0; i < num_limbs; ++i)
+				{
+					dlimb_t const sq = dlimb_t(a[i]) * a[i];
+					dlimb_t s = (dlimb_t(t[2 * i]) << 1) + static_cast<limb_t>(sq) + c;
+					t[2 * i] = static_cast<limb_t>(s);
+					s = (dlimb_t(t[2 * i + 1]) << 1) + static_cast<limb_t>(sq >> limb_bits)
+						+ static_cast<limb_t>(s >> limb_bits);
+					t[2 * i + 1] = static_cast<limb_t>(s);
+					c = static_cast<limb_t>(s >> limb_bits);
+				}
+				// since a < p, the square fits in twice the number of limbs
+				TORRENT_ASSERT(c == 0);
+
+				// the carry out of the top limb of the current window
+				limb_t hi = 0;
+				for (std::size_t i = 0; i < num_limbs; ++i)
+				{
+					limb_t const m = static_cast<limb_t>(t[i] * p_inv);
+					c = 0;
+					for (std::size_t j = 0; j < num_limbs; ++j)
+					{
+						dlimb_t const s = dlimb_t(m) * p[j] + t[i + j] + c;
+						t[i + j] = static_cast<limb_t>(s);
+						c = static_cast<limb_t>(s >> limb_bits);
+					}
+					dlimb_t const s = dlimb_t(t[i + num_limbs]) + c + hi;
+					t[i + num_limbs] = static_cast<limb_t>(s);
+					hi = static_cast<limb_t>(s >> limb_bits);
+				}
+
+				bignum ret;
+				std::copy(t.begin() + num_limbs, t.begin() + num_limbs * 2, ret.begin());
+				reduce(ret, hi);
+				return ret;
+			}
+
+			// returns base ^ exp mod p. The exponent is processed in fixed
+			// windows of 4 bits, and the table lookup touches every entry, to
+			// not make the timing depend on the (secret) exponent
+			bignum pow(bignum base, bignum const& exp) const
+			{
+				// the base may be a remote public key, not necessarily less than p
+				bignum t;
+				bignum_select(base, t, static_cast<limb_t>(0 - (bignum_sub(t, base, p) ^ 1)));
+
+				std::array<bignum, 16> table;
+				table[0] = one;
+				table[1] = mul(base, r2);
+				for (std::size_t i = 2; i < table.size(); ++i)
+					table[i] = mul(table[i - 1], table[1]);
+
+				bignum ret = one;
+				for (int i = num_limbs - 1; i >= 0; --i)
+				{
+					for (int k = limb_bits - 4; k >= 0; k -= 4)
+					{
+						ret = sqr(ret);
+						ret = sqr(ret);
+						ret = sqr(ret);
+						ret = sqr(ret);
+
+						limb_t const window = (exp[std::size_t(i)] >> k) & 0xf;
+						bignum factor = one;
+						for (std::size_t w = 0; w < table.size(); ++w)
+						{
+							limb_t const diff = static_cast<limb_t>(window ^ w);
+							// all ones if diff is zero
+							limb_t const mask = static_cast<limb_t>(((diff | (0 - diff)) >> (limb_bits - 1)) - 1);
+							bignum_select(factor, table[w], mask);
+						}
+						ret = mul(ret, factor);
+					}
+				}
+
+				// convert back out of montgomery form
+				bignum const unit{{1}};
+				return mul(ret, unit);
+			}
+
+			// the prime
+			bignum p;
+
+			// -p^-1 mod 2^limb_bits
+			limb_t p_inv;
+
+			// R mod p, i.e. 1 in montgomery form
+			bignum one;
+
+			// R^2 mod p, used to convert into montgomery form
+			bignum r2;
+		};
+
+		// out = (base ^ exp) % dh_prime
+		void dh_powm(std::uint8_t const* base, std::uint8_t const* exp, std::uint8_t* out)
+		{
+			static montgomery const field;
+			bignum_to_bytes(field.pow(bignum_from_bytes(base), bignum_from_bytes(exp)), out);
+		}
+
+#endif // TORRENT_USE_LIBCRYPTO
 	}
 
 	std::array<char, 96> export_key(key_t const& k)
@@ -84,39 +434,59 @@ namespace libtorrent {
 	void rc4_init(const unsigned char* in, std::size_t len, rc4 *state);
 	std::size_t rc4_encrypt(unsigned char *out, std::size_t outlen, rc4 *state);
 
+	key_t dh_powm(key_t const& base, key_t const& exponent)
+	{
+		std::array<char, 96> const b = export_key(base);
+		std::array<char, 96> const e = export_key(exponent);
+		key_bytes r;
+		dh_powm(reinterpret_cast<std::uint8_t const*>(b.data())
+			, reinterpret_cast<std::uint8_t const*>(e.data()), r.data());
+		key_t ret;
+		mp::import_bits(ret, r.begin(), r.end());
+		return ret;
+	}
+
 	// Set the prime P and the generator, generate local public key
 	dh_key_exchange::dh_key_exchange()
 	{
-		std::array<std::uint8_t, 96> random_key;
+		key_bytes random_key;
 		aux::random_bytes({reinterpret_cast<char*>(random_key.data()), random_key.size()});
 
 		// create local key (random)
 		mp::import_bits(m_dh_local_secret, random_key.begin(), random_key.end());
 
 		// key = (2 ^ secret) % prime
-		m_dh_local_key = mp::powm(key_t(2), m_dh_local_secret, dh_prime);
+		key_bytes generator{};
+		generator.back() = 2;
+		key_bytes key;
+		dh_powm(generator.data(), random_key.data(), key.data());
+		mp::import_bits(m_dh_local_key, key.begin(), key.end());
 	}
 
 	// compute shared secret given remote public key
-	void dh_key_exchange::compute_secret(std::uint8_t const* remote_pubkey)
+	void dh_key_exchange::compute_secret(key_t const& remote_pubkey)
 	{
-		TORRENT_ASSERT(remote_pubkey);
-		key_t key;
-		mp::import_bits(key, remote_pubkey, remote_pubkey + 96);
-		compute_secret(key);
+		std::array<char, 96> const buf = export_key(remote_pubkey);
+		compute_secret(reinterpret_cast<std::uint8_t const*>(buf.data()));
 	}
 
-	void dh_key_exchange::compute_secret(key_t const& remote_pubkey)
+	void dh_key_exchange::compute_secret(std::uint8_t const* remote_pubkey)
 	{
+		TORRENT_ASSERT(remote_pubkey);
+
 		// shared_secret = (remote_pubkey ^ local_secret) % prime
-		m_dh_shared_secret = mp::powm(remote_pubkey, m_dh_local_secret, dh_prime);
+		std::array<char, 96> const local_secret = export_key(m_dh_local_secret);
 
-		std::array<char, 96> buffer;
-		mp::export_bits(m_dh_shared_secret, reinterpret_cast<std::uint8_t*>(buffer.data()), 8);
+		// the secret is always hashed as a full 96 byte number, including
+		// leading zeros
+		key_bytes buffer;
+		dh_powm(remote_pubkey, reinterpret_cast<std::uint8_t const*>(local_secret.data())
+			, buffer.data());
+		mp::import_bits(m_dh_shared_secret, buffer.begin(), buffer.end());
 
 		static char const req3[4] = {'r', 'e', 'q', '3'};
 		// calculate the xor mask for the obfuscated hash
-		m_xor_mask = hasher(req3).update(buffer).final();
+		m_xor_mask = hasher(req3).update({reinterpret_cast<char const*>(buffer.data()), buffer.size()}).final();
 	}
 
 	std::tuple<int, span<span<char const>>>
@@ -398,6 +768,25 @@ std::size_t rc4_encrypt(unsigned char *out, std::size_t outlen, rc4 *state)
 	x = state->x & 0xff;
 	y = state->y & 0xff;
 	s = state->buf.data();
+
+	// the permutation is inherently serial, but generating the key stream a
+	// block at a time keeps x, y and s in registers, and lets the compiler
+	// vectorize xor-ing it into the output
+	std::size_t const block_size = 64;
+	std::uint8_t ks[block_size];
+	while (outlen >= block_size) {
+		for (std::size_t i = 0; i < block_size; ++i) {
+			x = (x + 1) & 255;
+			y = (y + s[x]) & 255;
+			tmp = s[x]; s[x] = s[y]; s[y] = tmp;
+			ks[i] = s[(s[x] + s[y]) & 255];
+		}
+		for (std::size_t i = 0; i < block_size; ++i)
+			out[i] ^= ks[i];
+		out += block_size;
+		outlen -= block_size;
+	}
+
 	while (outlen--) {
 		x = (x + 1) & 255;
 		y = (y + s[x]) & 255;
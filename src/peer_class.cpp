@@ -60,6 +60,8 @@ namespace libtorrent {
 		pci->download_limit = channel[peer_connection::download_channel].throttle();
 		pci->upload_priority = priority[peer_connection::upload_channel];
 		pci->download_priority = priority[peer_connection::download_channel];
+		pci->utp_cubic = utp_cubic;
+		pci->alert_mask = alert_mask;
 	}
 
 	void peer_class::set_info(peer_class_info const* pci)
@@ -71,6 +73,8 @@ namespace libtorrent {
 		set_download_limit(pci->download_limit);
 		priority[peer_connection::upload_channel] = (std::max)(1, (std::min)(255, pci->upload_priority));
 		priority[peer_connection::download_channel] = (std::max)(1, (std::min)(255, pci->download_priority));
+		utp_cubic = pci->utp_cubic;
+		alert_mask = pci->alert_mask;
 	}
 
 	peer_class_t peer_class_pool::new_peer_class(std::string label)
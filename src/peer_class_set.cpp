@@ -48,6 +48,7 @@ namespace libtorrent {
 		m_class[m_size] = c;
 		pool.incref(c);
 		++m_size;
+		m_generation = pool.next_generation();
 	}
 
 	bool peer_class_set::has_class(peer_class_t c) const
@@ -68,5 +69,6 @@ namespace libtorrent {
 		}
 		--m_size;
 		pool.decref(c);
+		m_generation = pool.next_generation();
 	}
 }
@@ -33,6 +33,8 @@ POSSIBILITY OF SUCH DAMAGE.
 #include <vector>
 #include <functional>
 #include <cstdint>
+#include <limits>
+#include <algorithm> // for stable_partition
 
 #include "libtorrent/config.hpp"
 #include "libtorrent/peer_connection.hpp"
@@ -64,6 +66,7 @@ POSSIBILITY OF SUCH DAMAGE.
 #include "libtorrent/aux_/has_block.hpp"
 #include "libtorrent/aux_/time.hpp"
 #include "libtorrent/aux_/non_owning_handle.hpp"
+#include "libtorrent/aux_/trace.hpp"
 
 #if TORRENT_USE_ASSERTS
 #include <set>
@@ -96,6 +99,42 @@ namespace libtorrent {
 		return pb.send_buffer_offset != pending_block::not_in_buffer;
 	}
 
+	// plain TCP and uTP are by far the most common socket types. These check
+	// for them up-front and call the concrete stream directly, so in the
+	// common case the call is resolved at compile time and can be inlined
+	// with the buffer handling around it. Any other socket type goes through
+	// the socket_type switch
+	template <typename Buffers, typename Handler>
+	void socket_async_read(socket_type& s, Buffers const& b, Handler const& h)
+	{
+		if (tcp::socket* sock = s.get<tcp::socket>()) sock->async_read_some(b, h);
+		else if (utp_stream* usock = s.get<utp_stream>()) usock->async_read_some(b, h);
+		else s.async_read_some(b, h);
+	}
+
+	template <typename Buffers, typename Handler>
+	void socket_async_write(socket_type& s, Buffers const& b, Handler const& h)
+	{
+		if (tcp::socket* sock = s.get<tcp::socket>()) sock->async_write_some(b, h);
+		else if (utp_stream* usock = s.get<utp_stream>()) usock->async_write_some(b, h);
+		else s.async_write_some(b, h);
+	}
+
+	template <typename Buffers>
+	std::size_t socket_read(socket_type& s, Buffers const& b, error_code& ec)
+	{
+		if (tcp::socket* sock = s.get<tcp::socket>()) return sock->read_some(b, ec);
+		if (utp_stream* usock = s.get<utp_stream>()) return usock->read_some(b, ec);
+		return s.read_some(b, ec);
+	}
+
+	std::size_t socket_available(socket_type const& s, error_code& ec)
+	{
+		if (tcp::socket const* sock = s.get<tcp::socket>()) return sock->available(ec);
+		if (utp_stream const* usock = s.get<utp_stream>()) return usock->available(ec);
+		return s.available(ec);
+	}
+
 	}
 
 	constexpr piece_index_t piece_block_progress::invalid_index;
@@ -139,6 +178,8 @@ namespace libtorrent {
 		, m_has_metadata(true)
 		, m_exceeded_limit(false)
 		, m_slow_start(true)
+		, m_rtt_probe(false)
+		, m_waiting_for_cold_read(false)
 	{
 		m_counters.inc_stats_counter(counters::num_tcp_peers + m_socket->type() - 1);
 
@@ -301,6 +342,7 @@ namespace libtorrent {
 				m_socket->set_option(traffic_class(char(m_settings.get_int(settings_pack::peer_tos))), ec);
 			}
 #endif
+			set_notsent_lowat();
 		}
 
 #ifndef TORRENT_DISABLE_LOGGING
@@ -324,6 +366,8 @@ namespace libtorrent {
 		}
 #endif
 
+		update_utp_congestion_control();
+
 		if (t && t->ready_for_connections())
 		{
 			init();
@@ -364,6 +408,8 @@ namespace libtorrent {
 			return;
 		}
 
+		set_tcp_fast_open();
+
 #ifndef TORRENT_DISABLE_LOGGING
 		if (should_log(peer_log_alert::outgoing))
 		{
@@ -385,7 +431,7 @@ namespace libtorrent {
 
 		sent_syn(m_remote.address().is_v6());
 
-		if (t && t->alerts().should_post<peer_connect_alert>())
+		if (t && should_post<peer_connect_alert>())
 		{
 			t->alerts().emplace_alert<peer_connect_alert>(
 				t->get_handle(), remote(), pid(), m_socket->type());
@@ -447,11 +493,11 @@ namespace libtorrent {
 		{
 			t->need_picker();
 			piece_picker const& p = t->picker();
-			piece_index_t const end_piece(p.num_pieces());
-			for (piece_index_t j(0); j != end_piece; ++j)
+			// only look at the pieces the peer has
+			for (piece_index_t j = m_have_piece.find_next_set(piece_index_t(0));
+				j != piece_index_t(-1); j = m_have_piece.find_next_set(next(j)))
 			{
-				if (m_have_piece[j]
-					&& t->piece_priority(j) > 0
+				if (t->piece_priority(j) > 0
 					&& !p.has_piece_passed(j))
 				{
 					interested = true;
@@ -477,10 +523,27 @@ namespace libtorrent {
 		disconnect_if_redundant();
 	}
 
+	alert_manager& peer_connection::alerts() const
+	{
+		return m_ses.alerts();
+	}
+
+	std::uint32_t peer_connection::extra_alert_mask(std::uint32_t const category) const
+	{
+		// most of the time no torrent or peer class enables any additional
+		// categories, and we don't need to look any closer
+		if ((m_ses.extra_alert_mask() & category) == 0) return 0;
+
+		std::uint32_t ret = m_ses.peer_class_alert_mask(*this);
+		std::shared_ptr<torrent> t = m_torrent.lock();
+		if (t) ret |= t->alert_mask() | m_ses.peer_class_alert_mask(*t);
+		return ret & category;
+	}
+
 #ifndef TORRENT_DISABLE_LOGGING
 	bool peer_connection::should_log(peer_log_alert::direction_t) const
 	{
-		return m_ses.alerts().should_post<peer_log_alert>();
+		return should_post<peer_log_alert>();
 	}
 
 	void peer_connection::peer_log(peer_log_alert::direction_t direction
@@ -495,7 +558,7 @@ namespace libtorrent {
 	{
 		TORRENT_ASSERT(is_single_thread());
 
-		if (!m_ses.alerts().should_post<peer_log_alert>()) return;
+		if (!should_post<peer_log_alert>()) return;
 
 		va_list v;
 		va_start(v, fmt);
@@ -732,6 +795,7 @@ namespace libtorrent {
 	peer_connection::~peer_connection()
 	{
 		m_counters.inc_stats_counter(counters::num_tcp_peers + m_socket->type() - 1, -1);
+		m_counters.inc_stats_counter(counters::receive_buffer_bytes, -m_recv_buffer_memory);
 
 //		INVARIANT_CHECK;
 		TORRENT_ASSERT(!m_in_constructor);
@@ -1033,10 +1097,8 @@ namespace libtorrent {
 #ifndef TORRENT_DISABLE_EXTENSIONS
 		if (bytes_payload)
 		{
-			for (auto const& e : m_extensions)
-			{
-				e->sent_payload(bytes_payload);
-			}
+			m_extensions.for_each(peer_plugin::sent_payload_feature
+				, [&](peer_plugin& e) { e.sent_payload(bytes_payload); });
 		}
 #endif
 		if (m_ignore_stats) return;
@@ -1089,10 +1151,8 @@ namespace libtorrent {
 //		INVARIANT_CHECK;
 
 #ifndef TORRENT_DISABLE_EXTENSIONS
-		for (auto const& e : m_extensions)
-		{
-			e->on_piece_pass(index);
-		}
+		m_extensions.for_each(peer_plugin::piece_check_feature
+			, [&](peer_plugin& e) { e.on_piece_pass(index); });
 #else
 		TORRENT_UNUSED(index);
 #endif
@@ -1107,10 +1167,8 @@ namespace libtorrent {
 		TORRENT_UNUSED(single_peer);
 
 #ifndef TORRENT_DISABLE_EXTENSIONS
-		for (auto const& e : m_extensions)
-		{
-			e->on_piece_failed(index);
-		}
+		m_extensions.for_each(peer_plugin::piece_check_feature
+			, [&](peer_plugin& e) { e.on_piece_failed(index); });
 #else
 		TORRENT_UNUSED(index);
 #endif
@@ -1245,6 +1303,10 @@ namespace libtorrent {
 		// think it is
 		m_torrent = t;
 
+		// the torrent's peer classes may select a different congestion
+		// controller
+		update_utp_congestion_control();
+
 		if (m_exceeded_limit)
 		{
 			// find a peer in some torrent (presumably the one with most peers)
@@ -1332,10 +1394,9 @@ namespace libtorrent {
 		INVARIANT_CHECK;
 
 #ifndef TORRENT_DISABLE_EXTENSIONS
-		for (auto const& e : m_extensions)
-		{
-			if (e->on_choke()) return;
-		}
+		if (m_extensions.any_of(peer_plugin::choke_feature
+			, [&](peer_plugin& e) { return e.on_choke(); }))
+			return;
 #endif
 		if (is_disconnecting()) return;
 
@@ -1422,10 +1483,9 @@ namespace libtorrent {
 #endif
 
 #ifndef TORRENT_DISABLE_EXTENSIONS
-		for (auto const& e : m_extensions)
-		{
-			if (e->on_reject(r)) return;
-		}
+		if (m_extensions.any_of(peer_plugin::reject_feature
+			, [&](peer_plugin& e) { return e.on_reject(r); }))
+			return;
 #endif
 
 		if (is_disconnecting()) return;
@@ -1512,10 +1572,9 @@ namespace libtorrent {
 		if (!t) return;
 
 #ifndef TORRENT_DISABLE_EXTENSIONS
-		for (auto const& e : m_extensions)
-		{
-			if (e->on_suggest(index)) return;
-		}
+		if (m_extensions.any_of(peer_plugin::suggest_feature
+			, [&](peer_plugin& e) { return e.on_suggest(index); }))
+			return;
 #endif
 
 		if (is_disconnecting()) return;
@@ -1579,10 +1638,9 @@ namespace libtorrent {
 #endif
 
 #ifndef TORRENT_DISABLE_EXTENSIONS
-		for (auto const& e : m_extensions)
-		{
-			if (e->on_unchoke()) return;
-		}
+		if (m_extensions.any_of(peer_plugin::unchoke_feature
+			, [&](peer_plugin& e) { return e.on_unchoke(); }))
+			return;
 #endif
 
 #ifndef TORRENT_DISABLE_LOGGING
@@ -1616,10 +1674,9 @@ namespace libtorrent {
 		TORRENT_ASSERT(t);
 
 #ifndef TORRENT_DISABLE_EXTENSIONS
-		for (auto const& e : m_extensions)
-		{
-			if (e->on_interested()) return;
-		}
+		if (m_extensions.any_of(peer_plugin::interested_feature
+			, [&](peer_plugin& e) { return e.on_interested(); }))
+			return;
 #endif
 
 #ifndef TORRENT_DISABLE_LOGGING
@@ -1711,10 +1768,9 @@ namespace libtorrent {
 		INVARIANT_CHECK;
 
 #ifndef TORRENT_DISABLE_EXTENSIONS
-		for (auto const& e : m_extensions)
-		{
-			if (e->on_not_interested()) return;
-		}
+		if (m_extensions.any_of(peer_plugin::not_interested_feature
+			, [&](peer_plugin& e) { return e.on_not_interested(); }))
+			return;
 #endif
 
 		m_became_uninterested = aux::time_now();
@@ -1770,10 +1826,9 @@ namespace libtorrent {
 		TORRENT_ASSERT(t);
 
 #ifndef TORRENT_DISABLE_EXTENSIONS
-		for (auto const& e : m_extensions)
-		{
-			if (e->on_have(index)) return;
-		}
+		if (m_extensions.any_of(peer_plugin::have_feature
+			, [&](peer_plugin& e) { return e.on_have(index); }))
+			return;
 #endif
 
 		if (is_disconnecting()) return;
@@ -1935,10 +1990,9 @@ namespace libtorrent {
 		TORRENT_ASSERT(t);
 
 #ifndef TORRENT_DISABLE_EXTENSIONS
-		for (auto const& e : m_extensions)
-		{
-			if (e->on_dont_have(index)) return;
-		}
+		if (m_extensions.any_of(peer_plugin::dont_have_feature
+			, [&](peer_plugin& e) { return e.on_dont_have(index); }))
+			return;
 #endif
 
 		if (is_disconnecting()) return;
@@ -1995,10 +2049,9 @@ namespace libtorrent {
 		TORRENT_ASSERT(t);
 
 #ifndef TORRENT_DISABLE_EXTENSIONS
-		for (auto const& e : m_extensions)
-		{
-			if (e->on_bitfield(bits)) return;
-		}
+		if (m_extensions.any_of(peer_plugin::bitfield_feature
+			, [&](peer_plugin& e) { return e.on_bitfield(bits); }))
+			return;
 #endif
 
 		if (is_disconnecting()) return;
@@ -2167,10 +2220,9 @@ namespace libtorrent {
 	{
 		TORRENT_ASSERT(is_single_thread());
 #ifndef TORRENT_DISABLE_EXTENSIONS
-		for (auto const& e : m_extensions)
-		{
-			if (!e->can_disconnect(ec)) return false;
-		}
+		if (m_extensions.any_of(peer_plugin::can_disconnect_feature
+			, [&](peer_plugin& e) { return !e.can_disconnect(ec); }))
+			return false;
 #else
 		TORRENT_UNUSED(ec);
 #endif
@@ -2222,7 +2274,7 @@ namespace libtorrent {
 
 			write_reject_request(r);
 
-			if (t->alerts().should_post<invalid_request_alert>())
+			if (should_post<invalid_request_alert>())
 			{
 				// msvc 12 appears to deduce the rvalue reference template
 				// incorrectly for bool temporaries. So, create a dummy instance
@@ -2240,10 +2292,9 @@ namespace libtorrent {
 		if (is_disconnecting()) return;
 
 #ifndef TORRENT_DISABLE_EXTENSIONS
-		for (auto const& e : m_extensions)
-		{
-			if (e->on_request(r)) return;
-		}
+		if (m_extensions.any_of(peer_plugin::request_feature
+			, [&](peer_plugin& e) { return e.on_request(r); }))
+			return;
 #endif
 		if (is_disconnecting()) return;
 
@@ -2297,7 +2348,7 @@ namespace libtorrent {
 				peer_log(peer_log_alert::info, "INTERESTED", "artificial incoming INTERESTED message");
 			}
 #endif
-			if (t->alerts().should_post<invalid_request_alert>())
+			if (should_post<invalid_request_alert>())
 			{
 				// msvc 12 appears to deduce the rvalue reference template
 				// incorrectly for bool temporaries. So, create a dummy instance
@@ -2349,7 +2400,7 @@ namespace libtorrent {
 			write_reject_request(r);
 			++m_num_invalid_requests;
 
-			if (t->alerts().should_post<invalid_request_alert>())
+			if (should_post<invalid_request_alert>())
 			{
 				// msvc 12 appears to deduce the rvalue reference template
 				// incorrectly for bool temporaries. So, create a dummy instance
@@ -2429,7 +2480,7 @@ namespace libtorrent {
 
 			m_requests.push_back(r);
 
-			if (t->alerts().should_post<incoming_request_alert>())
+			if (should_post<incoming_request_alert>())
 			{
 				t->alerts().emplace_alert<incoming_request_alert>(r, t->get_handle()
 					, m_remote, m_peer_id);
@@ -2536,7 +2587,7 @@ namespace libtorrent {
 			m_download_queue.insert(m_download_queue.begin(), b);
 			if (!in_req_queue)
 			{
-				if (t->alerts().should_post<unwanted_block_alert>())
+				if (should_post<unwanted_block_alert>())
 				{
 					t->alerts().emplace_alert<unwanted_block_alert>(t->get_handle()
 						, m_remote, m_peer_id, b.block_index, b.piece_index);
@@ -2552,6 +2603,34 @@ namespace libtorrent {
 		}
 	}
 
+	bool peer_connection::start_direct_receive(peer_request const& r
+		, span<char const> const received)
+	{
+		TORRENT_ASSERT(is_single_thread());
+		TORRENT_ASSERT(!m_direct_recv_buffer);
+
+		if (!m_settings.get_bool(settings_pack::direct_piece_receive)) return false;
+
+		std::shared_ptr<torrent> t = m_torrent.lock();
+		if (!t || t->is_deleted()) return false;
+
+		// only blocks that are still to be received, and fit in a disk buffer
+		if (r.length <= int(received.size()) || r.length > t->block_size())
+			return false;
+
+		bool exceeded = false;
+		disk_buffer_holder buffer = m_disk_thread.allocate_disk_buffer(exceeded
+			, self(), "receive buffer");
+		if (!buffer) return false;
+
+		std::memcpy(buffer.get(), received.data(), received.size());
+		m_direct_recv_buffer = std::move(buffer);
+		m_direct_recv_request = r;
+		m_direct_recv_pos = int(received.size());
+		m_direct_recv_exceeded = exceeded;
+		return true;
+	}
+
 #if TORRENT_USE_INVARIANT_CHECKS
 	struct check_postcondition
 	{
@@ -2598,6 +2677,9 @@ namespace libtorrent {
 		// we're not receiving any block right now
 		m_receiving_block = piece_block::invalid;
 
+		aux::trace(aux::trace_event::peer_receive
+			, std::uint64_t(static_cast<int>(p.piece)), std::uint64_t(p.start));
+
 #ifdef TORRENT_CORRUPT_DATA
 		// corrupt all pieces from certain peers
 		if (m_remote.address().is_v4()
@@ -2619,16 +2701,14 @@ namespace libtorrent {
 		update_desired_queue_size();
 
 #ifndef TORRENT_DISABLE_EXTENSIONS
-		for (auto const& e : m_extensions)
+		if (m_extensions.any_of(peer_plugin::piece_feature
+			, [&](peer_plugin& e) { return e.on_piece(p, {data, size_t(p.length)}); }))
 		{
-			if (e->on_piece(p, {data, size_t(p.length)}))
-			{
 #if TORRENT_USE_ASSERTS
-				TORRENT_ASSERT(m_received_in_piece == p.length);
-				m_received_in_piece = 0;
+			TORRENT_ASSERT(m_received_in_piece == p.length);
+			m_received_in_piece = 0;
 #endif
-				return;
-			}
+			return;
 		}
 #endif
 		if (is_disconnecting()) return;
@@ -2651,7 +2731,7 @@ namespace libtorrent {
 
 		if (p.length == 0)
 		{
-			if (t->alerts().should_post<peer_error_alert>())
+			if (should_post<peer_error_alert>())
 			{
 				t->alerts().emplace_alert<peer_error_alert>(t->get_handle(), m_remote
 					, m_peer_id, op_bittorrent, errors::peer_sent_empty_piece);
@@ -2696,7 +2776,7 @@ namespace libtorrent {
 
 		if (b == m_download_queue.end())
 		{
-			if (t->alerts().should_post<unwanted_block_alert>())
+			if (should_post<unwanted_block_alert>())
 			{
 				t->alerts().emplace_alert<unwanted_block_alert>(t->get_handle()
 					, m_remote, m_peer_id, block_finished.block_index
@@ -2745,6 +2825,9 @@ namespace libtorrent {
 			if (m_disconnecting) return;
 
 			m_request_time.add_sample(int(total_milliseconds(now - m_requested)));
+			if (m_rtt_probe)
+				m_round_trip_time.add_sample(int(total_milliseconds(now - m_requested)));
+			m_rtt_probe = false;
 #ifndef TORRENT_DISABLE_LOGGING
 			if (should_log(peer_log_alert::info))
 			{
@@ -2772,7 +2855,7 @@ namespace libtorrent {
 			&& m_snubbed)
 		{
 			m_snubbed = false;
-			if (t->alerts().should_post<peer_unsnubbed_alert>())
+			if (should_post<peer_unsnubbed_alert>())
 			{
 				t->alerts().emplace_alert<peer_unsnubbed_alert>(t->get_handle()
 					, m_remote, m_peer_id);
@@ -2795,9 +2878,22 @@ namespace libtorrent {
 
 		if (t->is_deleted()) return;
 
-		bool const exceeded = m_disk_thread.async_write(t->storage(), p, data, self()
-			, std::bind(&peer_connection::on_disk_write_complete
-			, self(), _1, p, t));
+		bool exceeded;
+		if (m_direct_recv_buffer && m_direct_recv_buffer.get() == data)
+		{
+			// the payload was received straight into a disk buffer. Hand the
+			// buffer over rather than copying it
+			m_disk_thread.async_write(t->storage(), p, std::move(m_direct_recv_buffer)
+				, std::bind(&peer_connection::on_disk_write_complete
+				, self(), _1, p, t));
+			exceeded = m_direct_recv_exceeded;
+		}
+		else
+		{
+			exceeded = m_disk_thread.async_write(t->storage(), p, data, self()
+				, std::bind(&peer_connection::on_disk_write_complete
+				, self(), _1, p, t));
+		}
 
 		// every peer is entitled to have two disk blocks allocated at any given
 		// time, regardless of whether the cache size is exceeded or not. If this
@@ -2824,13 +2920,16 @@ namespace libtorrent {
 		if (write_queue_size > max_queue_size
 			&& write_queue_size - p.length < max_queue_size
 			&& m_settings.get_int(settings_pack::cache_size) > 5
-			&& t->alerts().should_post<performance_alert>())
+			&& should_post<performance_alert>())
 		{
 			t->alerts().emplace_alert<performance_alert>(t->get_handle()
 				, performance_alert::too_high_disk_queue_limit);
 		}
 
 		m_request_time.add_sample(int(total_milliseconds(now - m_requested)));
+		if (m_rtt_probe)
+			m_round_trip_time.add_sample(int(total_milliseconds(now - m_requested)));
+		m_rtt_probe = false;
 #ifndef TORRENT_DISABLE_LOGGING
 		if (should_log(peer_log_alert::info))
 		{
@@ -2851,6 +2950,7 @@ namespace libtorrent {
 //		std::fprintf(stderr, "peer_connection mark_as_writing peer: %p piece: %d block: %d\n"
 //			, peer_info_struct(), block_finished.piece_index, block_finished.block_index);
 		picker.mark_as_writing(block_finished, peer_info_struct());
+		t->add_block_progress(block_finished);
 
 		TORRENT_ASSERT(picker.num_peers(block_finished) == 0);
 		// if we requested this block from other peers, cancel it now
@@ -2922,6 +3022,12 @@ namespace libtorrent {
 
 		if (is_disconnecting()) return;
 
+		if (m_settings.get_bool(settings_pack::batch_piece_picks))
+		{
+			t->defer_piece_pick(*this);
+			return;
+		}
+
 		if (request_a_block(*t, *this))
 			m_counters.inc_stats_counter(counters::incoming_piece_picks);
 		send_block_requests();
@@ -2993,7 +3099,10 @@ namespace libtorrent {
 			if (error.ec == boost::asio::error::operation_aborted)
 			{
 				if (t->has_picker())
+				{
 					t->picker().mark_as_canceled(block_finished, nullptr);
+					t->remove_block_progress(block_finished);
+				}
 			}
 			else
 			{
@@ -3001,7 +3110,10 @@ namespace libtorrent {
 				// to cancel it too
 				t->cancel_block(block_finished);
 				if (t->has_picker())
+				{
 					t->picker().write_failed(block_finished);
+					t->remove_block_progress(block_finished);
+				}
 
 				if (t->has_storage())
 				{
@@ -3034,10 +3146,11 @@ namespace libtorrent {
 //		std::fprintf(stderr, "peer_connection mark_as_finished peer: %p piece: %d block: %d\n"
 //			, peer_info_struct(), block_finished.piece_index, block_finished.block_index);
 		picker.mark_as_finished(block_finished, peer_info_struct());
+		t->add_block_progress(block_finished);
 
 		t->maybe_done_flushing();
 
-		if (t->alerts().should_post<block_finished_alert>())
+		if (should_post<block_finished_alert>())
 		{
 			t->alerts().emplace_alert<block_finished_alert>(t->get_handle(),
 				remote(), pid(), block_finished.block_index
@@ -3076,10 +3189,9 @@ namespace libtorrent {
 		INVARIANT_CHECK;
 
 #ifndef TORRENT_DISABLE_EXTENSIONS
-		for (auto const& e : m_extensions)
-		{
-			if (e->on_cancel(r)) return;
-		}
+		if (m_extensions.any_of(peer_plugin::cancel_feature
+			, [&](peer_plugin& e) { return e.on_cancel(r); }))
+			return;
 #endif
 		if (is_disconnecting()) return;
 
@@ -3159,10 +3271,9 @@ namespace libtorrent {
 #endif
 
 #ifndef TORRENT_DISABLE_EXTENSIONS
-		for (auto const& e : m_extensions)
-		{
-			if (e->on_have_all()) return;
-		}
+		if (m_extensions.any_of(peer_plugin::have_all_feature
+			, [&](peer_plugin& e) { return e.on_have_all(); }))
+			return;
 #endif
 		if (is_disconnecting()) return;
 
@@ -3240,10 +3351,9 @@ namespace libtorrent {
 		TORRENT_ASSERT(t);
 
 #ifndef TORRENT_DISABLE_EXTENSIONS
-		for (auto const& e : m_extensions)
-		{
-			if (e->on_have_none()) return;
-		}
+		if (m_extensions.any_of(peer_plugin::have_none_feature
+			, [&](peer_plugin& e) { return e.on_have_none(); }))
+			return;
 #endif
 		if (is_disconnecting()) return;
 
@@ -3298,10 +3408,9 @@ namespace libtorrent {
 #endif
 
 #ifndef TORRENT_DISABLE_EXTENSIONS
-		for (auto const& e : m_extensions)
-		{
-			if (e->on_allowed_fast(index)) return;
-		}
+		if (m_extensions.any_of(peer_plugin::allowed_fast_feature
+			, [&](peer_plugin& e) { return e.on_allowed_fast(index); }))
+			return;
 #endif
 		if (is_disconnecting()) return;
 
@@ -3480,7 +3589,7 @@ namespace libtorrent {
 			return false;
 		}
 
-		if (t->alerts().should_post<block_downloading_alert>())
+		if (should_post<block_downloading_alert>())
 		{
 			t->alerts().emplace_alert<block_downloading_alert>(t->get_handle()
 				, remote(), pid(), block.block_index, block.piece_index);
@@ -3774,6 +3883,10 @@ namespace libtorrent {
 		int const new_suggestions = t->get_suggest_pieces(m_suggest_pieces
 			, m_have_piece, num);
 
+		// send all suggestions in a single write
+		std::shared_ptr<peer_connection> me(self());
+		cork c_(*this);
+
 		// higher priority pieces are farther back in the vector, the last
 		// suggested piece to be received is the highest priority, so send the
 		// highest priority piece last.
@@ -3836,6 +3949,12 @@ namespace libtorrent {
 		if (int(m_download_queue.size()) >= m_desired_queue_size
 			|| t->upload_mode()) return;
 
+		// the whole burst of requests is sent in a single write, once we're
+		// done queuing them up. The reference keeps this object alive until
+		// then, in case we get disconnected in the process
+		std::shared_ptr<peer_connection> me(self());
+		cork c_(*this);
+
 		bool const empty_download_queue = m_download_queue.empty();
 
 		while (!m_request_queue.empty()
@@ -3933,18 +4052,16 @@ namespace libtorrent {
 			TORRENT_ASSERT(verify_piece(r) || m_request_large_blocks);
 
 #ifndef TORRENT_DISABLE_EXTENSIONS
-			bool handled = false;
-			for (auto const& e : m_extensions)
-			{
-				handled = e->write_request(r);
-				if (handled) break;
-			}
+			bool const handled = m_extensions.any_of(peer_plugin::write_request_feature
+				, [&](peer_plugin& e) { return e.write_request(r); });
 			if (is_disconnecting()) return;
 			if (!handled)
 #endif
 			{
 				write_request(r);
 				m_last_request = aux::time_now();
+				aux::trace(aux::trace_event::peer_request
+					, std::uint64_t(static_cast<int>(r.piece)), std::uint64_t(r.start));
 			}
 
 #ifndef TORRENT_DISABLE_LOGGING
@@ -3967,6 +4084,7 @@ namespace libtorrent {
 			// previously did not have a request. That's when we start the
 			// request timeout.
 			m_requested = aux::time_now();
+			m_rtt_probe = true;
 #ifndef TORRENT_DISABLE_LOGGING
 			t->debug_log("REQUEST [%p]", static_cast<void*>(this));
 #endif
@@ -4221,17 +4339,14 @@ namespace libtorrent {
 		if (t) handle = t->get_handle();
 
 #ifndef TORRENT_DISABLE_EXTENSIONS
-		for (auto const& e : m_extensions)
-		{
-			e->on_disconnect(ec);
-		}
+		m_extensions.for_each([&](peer_plugin& e) { e.on_disconnect(ec); });
 #endif
 
 		if (ec == error::address_in_use
 			&& m_settings.get_int(settings_pack::outgoing_port) != 0
 			&& t)
 		{
-			if (t->alerts().should_post<performance_alert>())
+			if (should_post<performance_alert>())
 				t->alerts().emplace_alert<performance_alert>(
 					handle, performance_alert::too_few_outgoing_ports);
 		}
@@ -4243,13 +4358,13 @@ namespace libtorrent {
 			if (ec)
 			{
 				if ((error > 1 || ec.category() == socks_category())
-					&& t->alerts().should_post<peer_error_alert>())
+					&& should_post<peer_error_alert>())
 				{
 					t->alerts().emplace_alert<peer_error_alert>(handle, remote()
 						, pid(), op, ec);
 				}
 
-				if (error <= 1 && t->alerts().should_post<peer_disconnected_alert>())
+				if (error <= 1 && should_post<peer_disconnected_alert>())
 				{
 					t->alerts().emplace_alert<peer_disconnected_alert>(handle
 						, remote(), pid(), op, m_socket->type(), ec, close_reason);
@@ -4326,6 +4441,17 @@ namespace libtorrent {
 		return false;
 	}
 
+	void peer_connection::update_utp_congestion_control()
+	{
+		TORRENT_ASSERT(is_single_thread());
+		if (!is_utp(*m_socket)) return;
+
+		bool cubic = m_ses.utp_cubic_set(*this);
+		std::shared_ptr<torrent> t = m_torrent.lock();
+		if (!cubic && t) cubic = m_ses.utp_cubic_set(*t);
+		m_socket->set_utp_cubic(cubic);
+	}
+
 	bool peer_connection::on_local_network() const
 	{
 		TORRENT_ASSERT(is_single_thread());
@@ -4362,6 +4488,21 @@ namespace libtorrent {
 		return (std::max)(2, ret);
 	}
 
+	void peer_connection::get_peer_sample(peer_sample& s) const
+	{
+		TORRENT_ASSERT(is_single_thread());
+		std::shared_ptr<torrent> t = m_torrent.lock();
+		s.info_hash = t ? t->info_hash() : sha1_hash();
+		s.ip = remote();
+		s.up_rate = m_statistics.upload_rate();
+		s.down_rate = m_statistics.download_rate();
+		s.download_queue_length = int(m_download_queue.size() + m_request_queue.size());
+		s.upload_queue_length = int(m_requests.size());
+		s.queue_bytes = m_outstanding_bytes;
+		s.send_buffer_bytes = m_send_buffer.size();
+		s.rtt = m_request_time.mean();
+	}
+
 	void peer_connection::get_peer_info(peer_info& p) const
 	{
 		TORRENT_ASSERT(is_single_thread());
@@ -4503,17 +4644,20 @@ namespace libtorrent {
 		if (is_connecting()) return;
 		if (in_handshake()) return;
 
+		std::shared_ptr<torrent> t = m_torrent.lock();
+		assert(t);
+
 		if (new_piece == piece_index_t(-1))
 		{
 			if (m_superseed_piece[0] == piece_index_t(-1)) return;
+			auto const before = m_superseed_piece;
 			m_superseed_piece[0] = piece_index_t(-1);
 			m_superseed_piece[1] = piece_index_t(-1);
+			t->super_seeded_pieces_changed(before, m_superseed_piece);
 
 #ifndef TORRENT_DISABLE_LOGGING
 			peer_log(peer_log_alert::info, "SUPER_SEEDING", "ending");
 #endif
-			std::shared_ptr<torrent> t = m_torrent.lock();
-			assert(t);
 
 			// this will either send a full bitfield or
 			// a have-all message, effectively terminating
@@ -4531,6 +4675,7 @@ namespace libtorrent {
 #endif
 		write_have(new_piece);
 
+		auto const before = m_superseed_piece;
 		if (replace_piece >= piece_index_t(0))
 		{
 			// move the piece we're replacing to the tail
@@ -4540,6 +4685,7 @@ namespace libtorrent {
 
 		m_superseed_piece[1] = m_superseed_piece[0];
 		m_superseed_piece[0] = new_piece;
+		t->super_seeded_pieces_changed(before, m_superseed_piece);
 	}
 
 	void peer_connection::max_out_request_queue(int s)
@@ -4590,7 +4736,22 @@ namespace libtorrent {
 
 			TORRENT_ASSERT(block_size > 0);
 
-			m_desired_queue_size = std::uint16_t(queue_time * download_rate / block_size);
+			if (m_settings.get_bool(settings_pack::bdp_request_queue)
+				&& m_round_trip_time.num_samples() > 0)
+			{
+				// size the queue to the bandwidth-delay product of the
+				// connection. Twice the BDP leaves room for the rate to grow,
+				// and one extra block keeps the pipe full while the next
+				// request is in flight
+				std::int64_t const bdp = std::int64_t(download_rate)
+					* m_round_trip_time.mean() / 1000;
+				m_desired_queue_size = std::uint16_t(std::min(
+					bdp * 2 / block_size + 1, std::int64_t(m_max_out_request_queue)));
+			}
+			else
+			{
+				m_desired_queue_size = std::uint16_t(queue_time * download_rate / block_size);
+			}
 		}
 
 		if (m_desired_queue_size > m_max_out_request_queue)
@@ -4598,6 +4759,10 @@ namespace libtorrent {
 		if (m_desired_queue_size < min_request_queue)
 			m_desired_queue_size = min_request_queue;
 
+		int const min_queue = std::min(m_min_desired_queue_size, m_max_out_request_queue);
+		if (m_desired_queue_size < min_queue)
+			m_desired_queue_size = std::uint16_t(min_queue);
+
 #ifndef TORRENT_DISABLE_LOGGING
 		if (previous_queue_size != m_desired_queue_size)
 		{
@@ -4631,7 +4796,7 @@ namespace libtorrent {
 				, m_statistics.upload_ip_overhead());
 		}
 
-		if (warning && t->alerts().should_post<performance_alert>())
+		if (warning && should_post<performance_alert>())
 		{
 			for (int channel = 0; channel < 2; ++channel)
 			{
@@ -4690,10 +4855,8 @@ namespace libtorrent {
 		if (is_disconnecting()) return;
 
 #ifndef TORRENT_DISABLE_EXTENSIONS
-		for (auto const& e : m_extensions)
-		{
-			e->tick();
-		}
+		m_extensions.for_each(peer_plugin::tick_feature
+			, [&](peer_plugin& e) { e.tick(); });
 		if (is_disconnecting()) return;
 #endif
 
@@ -4877,7 +5040,7 @@ namespace libtorrent {
 		update_desired_queue_size();
 
 		if (m_desired_queue_size == m_max_out_request_queue
-				&& t->alerts().should_post<performance_alert>())
+				&& should_post<performance_alert>())
 		{
 			t->alerts().emplace_alert<performance_alert>(t->get_handle()
 				, performance_alert::outstanding_request_limit_reached);
@@ -4921,7 +5084,7 @@ namespace libtorrent {
 		{
 			m_snubbed = true;
 			m_slow_start = false;
-			if (t->alerts().should_post<peer_snubbed_alert>())
+			if (should_post<peer_snubbed_alert>())
 			{
 				t->alerts().emplace_alert<peer_snubbed_alert>(t->get_handle()
 					, m_remote, m_peer_id);
@@ -4977,7 +5140,7 @@ namespace libtorrent {
 				return;
 			}
 
-			if (t->alerts().should_post<block_timeout_alert>())
+			if (should_post<block_timeout_alert>())
 			{
 				t->alerts().emplace_alert<block_timeout_alert>(t->get_handle()
 					, remote(), pid(), qe.block.block_index
@@ -5045,6 +5208,21 @@ namespace libtorrent {
 		}
 #endif
 
+		aux::upload_scheduler& sched = m_ses.upload_scheduler();
+		int const cold_read_limit = m_settings.get_int(settings_pack::upload_cold_read_limit);
+		time_point const now = aux::time_now();
+		time_duration const cache_expiry = seconds(m_settings.get_int(settings_pack::cache_expiry));
+		storage_index_t const storage = t->storage();
+
+		// serve the requests for pieces that are likely to be in the cache
+		// first. The order is otherwise preserved
+		if (cold_read_limit > 0 && m_requests.size() > 1)
+		{
+			std::stable_partition(m_requests.begin(), m_requests.end()
+				, [&](peer_request const& r)
+				{ return sched.is_warm(aux::upload_scheduler::key(storage, r.piece), now, cache_expiry); });
+		}
+
 		// don't just pop the front element here, since in seed mode one request may
 		// be blocked because we have to verify the hash first, so keep going with the
 		// next request. However, only let each peer have one hash verification outstanding
@@ -5073,6 +5251,10 @@ namespace libtorrent {
 
 			bool const seed_mode = t->seed_mode();
 
+			// the pieces near the ones requested are likely to be requested
+			// next, and are verified in the background first
+			if (seed_mode) t->seed_mode_requested(r.piece);
+
 			if (seed_mode
 				&& !t->verified_piece(r.piece)
 				&& !m_settings.get_bool(settings_pack::disable_hash_checks))
@@ -5115,6 +5297,25 @@ namespace libtorrent {
 			}
 			else
 			{
+				auto const piece_key = aux::upload_scheduler::key(storage, r.piece);
+				if (cold_read_limit > 0)
+				{
+					bool const cold = !sched.is_warm(piece_key, now, cache_expiry);
+					if (cold && sched.cold_reads() >= cold_read_limit)
+					{
+						// hold off on this request until one of the cold reads in
+						// flight completes. Requests for pieces that become warm
+						// until then are served from the cache
+						if (!m_waiting_for_cold_read)
+						{
+							m_waiting_for_cold_read = true;
+							sched.wait(self());
+						}
+						continue;
+					}
+					sched.read_issued(piece_key, now, cold);
+				}
+
 #ifndef TORRENT_DISABLE_LOGGING
 				peer_log(peer_log_alert::info, "FILE_ASYNC_READ"
 					, "piece: %d s: %x l: %x", static_cast<int>(r.piece), r.start, r.length);
@@ -5130,7 +5331,7 @@ namespace libtorrent {
 
 				m_disk_thread.async_read(t->storage(), r
 					, std::bind(&peer_connection::on_disk_read_complete
-					, self(), _1, _2, _3, r, clock_type::now()), this);
+					, self(), _1, _2, _3, r, clock_type::now(), piece_key), this);
 			}
 			m_last_sent_payload = clock_type::now();
 			m_requests.erase(m_requests.begin() + i);
@@ -5145,6 +5346,21 @@ namespace libtorrent {
 			t->recalc_share_mode();
 	}
 
+	void peer_connection::cold_read_slot_available()
+	{
+		TORRENT_ASSERT(is_single_thread());
+		m_waiting_for_cold_read = false;
+		if (is_disconnecting()) return;
+		fill_send_buffer();
+	}
+
+	void peer_connection::seed_mode_piece_verified()
+	{
+		TORRENT_ASSERT(is_single_thread());
+		if (is_disconnecting() || m_requests.empty()) return;
+		fill_send_buffer();
+	}
+
 	// this is called when a previously unchecked piece has been
 	// checked, while in seed-mode
 	void peer_connection::on_seed_mode_hashed(piece_index_t const piece
@@ -5204,7 +5420,8 @@ namespace libtorrent {
 
 	void peer_connection::on_disk_read_complete(disk_buffer_holder buffer
 		, int const flags, storage_error const& error
-		, peer_request const& r, time_point issue_time)
+		, peer_request const& r, time_point issue_time
+		, aux::upload_scheduler::piece_key const piece_key)
 	{
 		TORRENT_ASSERT(is_single_thread());
 		// return value:
@@ -5213,6 +5430,18 @@ namespace libtorrent {
 
 		int const disk_rtt = int(total_microseconds(clock_type::now() - issue_time));
 
+		aux::upload_scheduler& sched = m_ses.upload_scheduler();
+		if (sched.read_complete(piece_key))
+		{
+			// the blocks of this piece are now in the cache, and there's room
+			// for another cold read. Let the peers that were waiting have a go
+			for (auto const& w : sched.take_waiting())
+			{
+				std::shared_ptr<peer_connection> p = w.lock();
+				if (p) p->cold_read_slot_available();
+			}
+		}
+
 #ifndef TORRENT_DISABLE_LOGGING
 		if (should_log(peer_log_alert::info))
 		{
@@ -5239,7 +5468,7 @@ namespace libtorrent {
 			TORRENT_ASSERT(buffer.get() == nullptr);
 			write_dont_have(r.piece);
 			write_reject_request(r);
-			if (t->alerts().should_post<file_error_alert>())
+			if (should_post<file_error_alert>())
 				t->alerts().emplace_alert<file_error_alert>(error.ec
 					, t->resolve_filename(error.file())
 					, error.operation_str(), t->get_handle());
@@ -5282,10 +5511,20 @@ namespace libtorrent {
 		// we probably just pulled this piece into the cache.
 		// if it's rare enough to make it into the suggested piece
 		// push another piece out
-		if (m_settings.get_int(settings_pack::suggest_mode) == settings_pack::suggest_read_cache
-			&& (flags & disk_interface::cache_hit) == 0)
+		if (m_settings.get_int(settings_pack::suggest_mode) == settings_pack::suggest_read_cache)
 		{
-			t->add_suggest_piece(r.piece);
+			if ((flags & disk_interface::cache_hit) == 0)
+				t->add_suggest_piece(r.piece);
+
+			// keep track of whether the pieces we suggest to peers are still in
+			// the cache by the time they request them
+			if (std::find(m_suggest_pieces.begin(), m_suggest_pieces.end(), r.piece)
+				!= m_suggest_pieces.end())
+			{
+				m_counters.inc_stats_counter((flags & disk_interface::cache_hit)
+					? counters::num_suggested_piece_cache_hits
+					: counters::num_suggested_piece_cache_misses);
+			}
 		}
 		write_piece(r, std::move(buffer));
 	}
@@ -5311,6 +5550,14 @@ namespace libtorrent {
 		if (is_disconnecting()) return;
 		if (channel == upload_channel)
 		{
+			if (m_settings.get_bool(settings_pack::send_pacing))
+			{
+				// spread this quota over the next tick. Allow some headroom
+				// so we don't fall behind the rate limiter
+				int const tick_interval = (std::max)(1, m_settings.get_int(settings_pack::tick_interval));
+				std::int64_t const rate = std::int64_t(amount) * 1000 * 5 / 4 / tick_interval;
+				set_pacing_rate(int((std::min)(rate, std::int64_t(std::numeric_limits<int>::max()))));
+			}
 			setup_send();
 		}
 		else if (channel == download_channel)
@@ -5319,6 +5566,65 @@ namespace libtorrent {
 		}
 	}
 
+	void peer_connection::set_notsent_lowat()
+	{
+		TORRENT_ASSERT(is_single_thread());
+#ifdef TORRENT_HAS_NOTSENT_LOWAT
+		int const lowat = m_settings.get_int(settings_pack::send_not_sent_low_watermark);
+		if (lowat <= 0) return;
+		if (is_utp(*m_socket)) return;
+
+		error_code ec;
+		m_socket->set_option(notsent_lowat(lowat), ec);
+#ifndef TORRENT_DISABLE_LOGGING
+		if (should_log(peer_log_alert::info))
+		{
+			peer_log(peer_log_alert::info, "SET_NOTSENT_LOWAT", "bytes: %d e: %s"
+				, lowat, ec.message().c_str());
+		}
+#endif
+#endif
+	}
+
+	void peer_connection::set_tcp_fast_open()
+	{
+		TORRENT_ASSERT(is_single_thread());
+#ifdef TORRENT_HAS_TCP_FASTOPEN_CONNECT
+		if (!m_settings.get_bool(settings_pack::outgoing_tcp_fast_open)) return;
+		if (is_utp(*m_socket)) return;
+
+		// failing to set it just means a regular connect
+		error_code ec;
+		m_socket->set_option(tcp_fastopen_connect(true), ec);
+#ifndef TORRENT_DISABLE_LOGGING
+		if (should_log(peer_log_alert::outgoing))
+		{
+			peer_log(peer_log_alert::outgoing, "SET_TCP_FASTOPEN", "e: %s"
+				, ec.message().c_str());
+		}
+#endif
+#endif
+	}
+
+	void peer_connection::set_pacing_rate(int const rate)
+	{
+		TORRENT_ASSERT(is_single_thread());
+		TORRENT_ASSERT(rate >= 0);
+#ifdef TORRENT_HAS_MAX_PACING_RATE
+		if (rate == m_pacing_rate) return;
+		// uTP does its own pacing
+		if (is_utp(*m_socket)) return;
+
+		error_code ignore;
+		m_socket->set_option(max_pacing_rate(rate == 0
+			? std::numeric_limits<std::uint32_t>::max()
+			: std::uint32_t(rate)), ignore);
+		m_pacing_rate = rate;
+#else
+		TORRENT_UNUSED(rate);
+#endif
+	}
+
 	// the number of bytes we expect to receive, or want to send
 	// channel either refer to upload or download. This is used
 	// by the rate limiter to allocate quota for this peer
@@ -5365,19 +5671,25 @@ namespace libtorrent {
 
 		int priority = get_priority(channel);
 
-		int max_channels = num_classes() + (t ? t->num_classes() : 0) + 2;
+		std::uint32_t const torrent_generation = t ? t->class_generation() : 0;
+		if (m_bw_classes_generation != class_generation()
+			|| m_bw_torrent_classes_generation != torrent_generation)
+		{
+			update_bandwidth_classes(t.get());
+		}
+
+		int const max_channels = int(m_bw_classes.size());
 		TORRENT_ALLOCA(channels, bandwidth_channel*, max_channels);
 
 		// collect the pointers to all bandwidth channels
-		// that apply to this torrent
+		// that apply to this torrent. There's no need to include channels
+		// that don't have any bandwidth limits
 		int c = 0;
-
-		c += m_ses.copy_pertinent_channels(*this, channel
-			, channels.subspan(c).data(), max_channels - c);
-		if (t)
+		for (peer_class* pc : m_bw_classes)
 		{
-			c += m_ses.copy_pertinent_channels(*t, channel
-				, channels.subspan(c).data(), max_channels - c);
+			bandwidth_channel* chan = &pc->channel[channel];
+			if (chan->throttle() == 0) continue;
+			channels[c++] = chan;
 		}
 
 #if TORRENT_USE_ASSERTS
@@ -5415,11 +5727,36 @@ namespace libtorrent {
 		else
 		{
 			m_quota[channel] += ret;
+			// the quota was granted immediately, which means this peer is
+			// not being rate limited. Lift any pacing rate set earlier
+			if (channel == upload_channel && m_pacing_rate != 0)
+				set_pacing_rate(0);
 		}
 
 		return ret;
 	}
 
+	void peer_connection::update_bandwidth_classes(torrent const* t)
+	{
+		TORRENT_ASSERT(is_single_thread());
+		peer_class_pool& pool = m_ses.peer_classes();
+		m_bw_classes.clear();
+		for (peer_class_set const* s : {static_cast<peer_class_set const*>(this)
+			, static_cast<peer_class_set const*>(t)})
+		{
+			if (s == nullptr) continue;
+			for (int i = 0; i < s->num_classes(); ++i)
+			{
+				peer_class* pc = pool.at(s->class_at(i));
+				TORRENT_ASSERT(pc);
+				if (pc == nullptr) continue;
+				m_bw_classes.push_back(pc);
+			}
+		}
+		m_bw_classes_generation = class_generation();
+		m_bw_torrent_classes_generation = t ? t->class_generation() : 0;
+	}
+
 	void peer_connection::setup_send()
 	{
 		TORRENT_ASSERT(is_single_thread());
@@ -5495,7 +5832,7 @@ namespace libtorrent {
 				// upload rate being virtually 0. If m_requests is empty, it doesn't
 				// matter anyway, because we don't have any more requests from the
 				// peer to hang on to the disk
-				if (t && t->alerts().should_post<performance_alert>())
+				if (t && should_post<performance_alert>())
 				{
 					t->alerts().emplace_alert<performance_alert>(t->get_handle()
 						, performance_alert::send_buffer_watermark_too_low);
@@ -5557,7 +5894,7 @@ namespace libtorrent {
 		m_socket_is_writing = true;
 #endif
 
-		m_socket->async_write_some(vec, make_write_handler(std::bind(
+		socket_async_write(*m_socket, vec, make_write_handler(std::bind(
 			&peer_connection::on_send_data, self(), _1, _2)));
 
 		m_channel_state[upload_channel] |= peer_info::bw_network;
@@ -5585,14 +5922,22 @@ namespace libtorrent {
 
 		if (m_disconnecting) return;
 
-		if (m_recv_buffer.capacity() < 100
+		// when receiving a block directly into a disk buffer, the rest of it
+		// goes there, rather than into the receive buffer
+		bool const direct = bool(m_direct_recv_buffer);
+
+		if (!direct
+			&& m_recv_buffer.capacity() < 100
 			&& m_recv_buffer.max_receive() == 0)
 		{
 			m_recv_buffer.reserve(100);
+			update_recv_buffer_memory();
 		}
 
 		// we may want to request more quota at this point
-		int const buffer_size = m_recv_buffer.max_receive();
+		int const buffer_size = direct
+			? m_direct_recv_request.length - m_direct_recv_pos
+			: m_recv_buffer.max_receive();
 		request_bandwidth(download_channel, buffer_size);
 
 		if (m_channel_state[download_channel] & peer_info::bw_network) return;
@@ -5631,7 +5976,24 @@ namespace libtorrent {
 
 		if (max_receive == 0) return;
 
+		if (direct)
+		{
+			TORRENT_ASSERT((m_channel_state[download_channel] & peer_info::bw_network) == 0);
+			m_channel_state[download_channel] |= peer_info::bw_network;
+#ifndef TORRENT_DISABLE_LOGGING
+			peer_log(peer_log_alert::incoming, "ASYNC_READ_DIRECT"
+				, "max: %d bytes", max_receive);
+#endif
+			ADD_OUTSTANDING_ASYNC("peer_connection::on_receive_direct");
+			socket_async_read(*m_socket, boost::asio::mutable_buffers_1(
+				m_direct_recv_buffer.get() + m_direct_recv_pos, std::size_t(max_receive))
+				, make_read_handler(std::bind(&peer_connection::on_receive_direct
+					, self(), _1, _2)));
+			return;
+		}
+
 		span<char> const vec = m_recv_buffer.reserve(max_receive);
+		update_recv_buffer_memory();
 		TORRENT_ASSERT((m_channel_state[download_channel] & peer_info::bw_network) == 0);
 		m_channel_state[download_channel] |= peer_info::bw_network;
 #ifndef TORRENT_DISABLE_LOGGING
@@ -5641,8 +6003,8 @@ namespace libtorrent {
 
 		// utp sockets aren't thread safe...
 		ADD_OUTSTANDING_ASYNC("peer_connection::on_receive_data");
-		m_socket->async_read_some(
-			boost::asio::mutable_buffers_1(vec.data(), vec.size()), make_read_handler(
+		socket_async_read(*m_socket
+			, boost::asio::mutable_buffers_1(vec.data(), vec.size()), make_read_handler(
 				std::bind(&peer_connection::on_receive_data, self(), _1, _2)));
 	}
 
@@ -5660,6 +6022,17 @@ namespace libtorrent {
 		TORRENT_ASSERT(is_single_thread());
 		TORRENT_UNUSED(flags);
 
+		// if the message fits in the last send buffer, it will be sent as part
+		// of whatever triggers the next send
+		bool const fits = size <= m_send_buffer.space_in_last_buffer();
+		copy_send_buffer(buf, size);
+		if (!fits) setup_send();
+	}
+
+	void peer_connection::copy_send_buffer(char const* buf, int size)
+	{
+		TORRENT_ASSERT(is_single_thread());
+
 		int free_space = m_send_buffer.space_in_last_buffer();
 		if (free_space > size) free_space = size;
 		if (free_space > 0)
@@ -5688,13 +6061,21 @@ namespace libtorrent {
 			m_send_buffer.append_buffer(std::move(session_buf), alloc_buf_size, buf_size);
 			++i;
 		}
-		setup_send();
 	}
 
 	// --------------------------
 	// RECEIVE DATA
 	// --------------------------
 
+	void peer_connection::update_recv_buffer_memory()
+	{
+		int const mem = m_recv_buffer.capacity();
+		if (mem == m_recv_buffer_memory) return;
+		m_counters.inc_stats_counter(counters::receive_buffer_bytes
+			, mem - m_recv_buffer_memory);
+		m_recv_buffer_memory = mem;
+	}
+
 	void peer_connection::account_received_bytes(int const bytes_transferred)
 	{
 		// tell the receive buffer we just fed it this many bytes of incoming data
@@ -5793,7 +6174,7 @@ namespace libtorrent {
 		if (grow_buffer)
 		{
 			error_code ec;
-			int buffer_size = int(m_socket->available(ec));
+			int buffer_size = int(socket_available(*m_socket, ec));
 			if (ec)
 			{
 				disconnect(ec, op_available);
@@ -5812,8 +6193,9 @@ namespace libtorrent {
 			if (buffer_size > 0)
 			{
 				span<char> const vec = m_recv_buffer.reserve(buffer_size);
-				std::size_t bytes = m_socket->read_some(
-					boost::asio::mutable_buffers_1(vec.data(), vec.size()), ec);
+				update_recv_buffer_memory();
+				std::size_t bytes = socket_read(*m_socket
+					, boost::asio::mutable_buffers_1(vec.data(), vec.size()), ec);
 
 				// this is weird. You would imagine read_some() would do this
 				if (bytes == 0 && !ec) ec = boost::asio::error::eof;
@@ -5850,6 +6232,12 @@ namespace libtorrent {
 		int bytes = int(bytes_transferred);
 		int sub_transferred = 0;
 		do {
+			int const batched = on_receive_batch(bytes);
+			TORRENT_ASSERT(batched >= 0 && batched <= bytes);
+			bytes -= batched;
+			if (m_disconnecting) return;
+			if (bytes == 0) break;
+
 			sub_transferred = m_recv_buffer.advance_pos(bytes);
 			TORRENT_ASSERT(sub_transferred > 0);
 			on_receive(error, std::size_t(sub_transferred));
@@ -5875,6 +6263,7 @@ namespace libtorrent {
 				, m_recv_buffer.capacity());
 #endif
 		}
+		update_recv_buffer_memory();
 
 		TORRENT_ASSERT(m_recv_buffer.pos_at_end());
 		TORRENT_ASSERT(m_recv_buffer.packet_size() > 0);
@@ -5892,6 +6281,77 @@ namespace libtorrent {
 		setup_receive();
 	}
 
+	void peer_connection::on_receive_direct(error_code const& error
+		, std::size_t const bytes_transferred)
+	{
+		TORRENT_ASSERT(is_single_thread());
+		COMPLETE_ASYNC("peer_connection::on_receive_direct");
+
+		TORRENT_ASSERT(m_channel_state[download_channel] & peer_info::bw_network);
+		TORRENT_ASSERT(bytes_transferred > 0 || error);
+
+		m_counters.inc_stats_counter(counters::on_read_counter);
+
+		INVARIANT_CHECK;
+
+		if (error)
+		{
+#ifndef TORRENT_DISABLE_LOGGING
+			if (should_log(peer_log_alert::info))
+			{
+				peer_log(peer_log_alert::info, "ERROR"
+					, "in peer_connection::on_receive_direct error: %s"
+					, error.message().c_str());
+			}
+#endif
+			disconnect(error, op_sock_read);
+			return;
+		}
+
+		m_last_receive = aux::time_now();
+
+		// submit all disk jobs later
+		m_ses.deferred_submit_jobs();
+
+		std::shared_ptr<peer_connection> me(self());
+		cork _c(*this);
+
+		int const bytes = int(bytes_transferred);
+		TORRENT_ASSERT(m_direct_recv_buffer);
+		TORRENT_ASSERT(m_direct_recv_pos + bytes <= m_direct_recv_request.length);
+
+		TORRENT_ASSERT(bytes <= m_quota[download_channel]);
+		m_quota[download_channel] -= bytes;
+		m_ses.received_buffer(bytes);
+		trancieve_ip_packet(bytes, m_remote.address().is_v6());
+#ifndef TORRENT_DISABLE_LOGGING
+		peer_log(peer_log_alert::incoming, "READ_DIRECT", "%d bytes", bytes);
+#endif
+
+		if (m_extension_outstanding_bytes > 0)
+			m_extension_outstanding_bytes -= std::min(m_extension_outstanding_bytes, bytes);
+
+		// all of it is payload, the header was counted by the protocol layer
+		received_bytes(bytes, 0);
+		incoming_piece_fragment(bytes);
+		m_direct_recv_pos += bytes;
+
+		if (m_direct_recv_pos == m_direct_recv_request.length)
+		{
+			incoming_piece(m_direct_recv_request, m_direct_recv_buffer.get());
+			// incoming_piece() takes the buffer if it writes the block to
+			// disk. If the block was discarded, free it here
+			m_direct_recv_buffer.reset();
+			if (m_disconnecting) return;
+		}
+
+		// allow reading from the socket again
+		TORRENT_ASSERT(m_channel_state[download_channel] & peer_info::bw_network);
+		m_channel_state[download_channel] &= ~peer_info::bw_network;
+
+		setup_receive();
+	}
+
 	bool peer_connection::can_write() const
 	{
 		TORRENT_ASSERT(is_single_thread());
@@ -6065,12 +6525,10 @@ namespace libtorrent {
 #endif
 		}
 #endif
+		set_notsent_lowat();
 
 #ifndef TORRENT_DISABLE_EXTENSIONS
-		for (auto const& ext : m_extensions)
-		{
-			ext->on_connected();
-		}
+		m_extensions.for_each([&](peer_plugin& e) { e.on_connected(); });
 #endif
 
 		on_connected();
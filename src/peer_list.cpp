@@ -31,6 +31,7 @@ POSSIBILITY OF SUCH DAMAGE.
 */
 
 #include <functional>
+#include <cstring> // for memcpy
 
 #include "libtorrent/peer_connection.hpp"
 #include "libtorrent/web_peer_connection.hpp"
@@ -78,6 +79,53 @@ namespace {
 		tcp::endpoint const& m_ep;
 	};
 
+	// the finalizer from MurmurHash3. The addresses are not random enough to
+	// be used as hashes directly
+	std::uint32_t mix_hash(std::uint64_t h)
+	{
+		h ^= h >> 33;
+		h *= 0xff51afd7ed558ccdULL;
+		h ^= h >> 33;
+		h *= 0xc4ceb9fe1a85ec53ULL;
+		h ^= h >> 33;
+		return std::uint32_t(h);
+	}
+
+	std::uint32_t encode_candidate_pos(int const bucket, int const pos)
+	{
+		TORRENT_ASSERT(bucket >= 0 && bucket < 64);
+		return (std::uint32_t(pos + 1) << 6) | std::uint32_t(bucket);
+	}
+
+	int candidate_pos_bucket(std::uint32_t const v) { return int(v & 63); }
+	int candidate_pos_index(std::uint32_t const v) { return int(v >> 6) - 1; }
+
+	// returns the index of the least significant set bit in v. v must not
+	// be 0
+	int lowest_bit(std::uint64_t v)
+	{
+		TORRENT_ASSERT(v != 0);
+#if TORRENT_HAS_BUILTIN_CTZ
+		return __builtin_ctzll(v);
+#else
+		int ret = 0;
+		while ((v & 1) == 0)
+		{
+			v >>= 1;
+			++ret;
+		}
+		return ret;
+#endif
+	}
+
+	// the part of a connect candidate's key that only depends on the
+	// torrent_peer itself, i.e. everything but the peer rank
+	std::uint64_t candidate_order(torrent_peer const& p)
+	{
+		return (std::uint64_t(p.last_connected) << 48)
+			| (std::uint64_t(63 - source_rank(int(p.source))) << 32);
+	}
+
 #if TORRENT_USE_INVARIANT_CHECKS
 	struct match_peer_connection
 	{
@@ -115,10 +163,12 @@ namespace {
 namespace libtorrent {
 
 	peer_list::peer_list()
-		: m_locked_peer(nullptr)
+		: m_candidate_buckets(0)
+		, m_external_port(0)
+		, m_ranks_dirty(true)
+		, m_locked_peer(nullptr)
 		, m_num_seeds(0)
 		, m_finished(0)
-		, m_round_robin(0)
 		, m_num_connect_candidates(0)
 		, m_max_failcount(3)
 	{
@@ -189,8 +239,9 @@ namespace libtorrent {
 
 	void peer_list::clear_peer_prio()
 	{
-		for (auto& p : m_peers)
-			p->peer_rank = 0;
+		// the ranks are recomputed the next time we pick a peer to connect
+		// to, when we're given the new external address
+		m_ranks_dirty = true;
 	}
 
 	// disconnects and removes all peers that are now filtered
@@ -254,10 +305,9 @@ namespace libtorrent {
 		TORRENT_ASSERT(p->in_use);
 		TORRENT_ASSERT(m_locked_peer != p);
 
-		std::pair<iterator, iterator> range = find_peers(p->address());
-		iterator iter = std::find_if(range.first, range.second, match_peer_endpoint(p->ip()));
-		if (iter == range.second) return;
-		erase_peer(iter, state);
+		int const idx = peer_index(p);
+		if (idx < 0) return;
+		erase_peer(m_peers.begin() + idx, state);
 	}
 
 	// any peer that is erased from m_peers will be
@@ -271,30 +321,44 @@ namespace libtorrent {
 		TORRENT_ASSERT(i != m_peers.end());
 		TORRENT_ASSERT(m_locked_peer != *i);
 
-		state->erased.push_back(*i);
-		if ((*i)->seed)
+		int const idx = int(i - m_peers.begin());
+		torrent_peer* const p = *i;
+
+		state->erased.push_back(p);
+		if (p->seed)
 		{
 			TORRENT_ASSERT(m_num_seeds > 0);
 			--m_num_seeds;
 		}
-		if (is_connect_candidate(**i))
-			update_connect_candidates(-1);
+		if (m_candidate_pos[std::size_t(idx)] != 0) candidate_erase(idx);
 		TORRENT_ASSERT(m_num_connect_candidates < int(m_peers.size()));
-		if (m_round_robin > i - m_peers.begin()) --m_round_robin;
-		if (m_round_robin >= int(m_peers.size())) m_round_robin = 0;
 
-		// if this peer is in the connect candidate
-		// cache, erase it from there as well
-		std::vector<torrent_peer*>::iterator ci = std::find(m_candidate_cache.begin(), m_candidate_cache.end(), *i);
-		if (ci != m_candidate_cache.end()) m_candidate_cache.erase(ci);
+		index_erase(idx);
+
+		// move the last peer into the hole, to avoid shifting all the peers
+		// after it
+		int const last = int(m_peers.size()) - 1;
+		if (idx != last)
+		{
+			m_index[std::size_t(find_slot(last))] = std::uint32_t(idx + 1);
+			m_peers[std::size_t(idx)] = m_peers[std::size_t(last)];
+			std::uint32_t const pos = m_candidate_pos[std::size_t(last)];
+			m_candidate_pos[std::size_t(idx)] = pos;
+			if (pos != 0)
+			{
+				m_candidates[std::size_t(candidate_pos_bucket(pos))]
+					[std::size_t(candidate_pos_index(pos))].peer = std::uint32_t(idx);
+			}
+		}
+		m_peers.pop_back();
+		m_candidate_pos.pop_back();
 
 #if TORRENT_USE_ASSERTS
-		TORRENT_ASSERT((*i)->in_use);
-		(*i)->in_use = false;
+		TORRENT_ASSERT(p->in_use);
+		p->in_use = false;
 #endif
 
-		state->peer_allocator->free_peer_entry(*i);
-		m_peers.erase(i);
+		state->peer_allocator->free_peer_entry(p);
 	}
 
 	bool peer_list::should_erase_immediately(torrent_peer const& p) const
@@ -363,10 +427,12 @@ namespace libtorrent {
 			{
 				if (should_erase_immediately(pe))
 				{
-					if (erase_candidate > current) --erase_candidate;
-					if (force_erase_candidate > current) --force_erase_candidate;
 					TORRENT_ASSERT(current >= 0 && current < int(m_peers.size()));
+					// erasing a peer moves the last one into its place
+					int const last = int(m_peers.size()) - 1;
 					erase_peer(m_peers.begin() + current, state);
+					if (erase_candidate == last) erase_candidate = current;
+					if (force_erase_candidate == last) force_erase_candidate = current;
 					continue;
 				}
 				else
@@ -404,10 +470,8 @@ namespace libtorrent {
 
 		TORRENT_ASSERT(p->in_use);
 
-		if (is_connect_candidate(*p))
-			update_connect_candidates(-1);
-
 		p->banned = true;
+		update_candidate(p);
 		TORRENT_ASSERT(!is_connect_candidate(*p));
 		return true;
 	}
@@ -420,9 +484,8 @@ namespace libtorrent {
 		TORRENT_ASSERT(p->in_use);
 		TORRENT_ASSERT(c);
 
-		const bool was_conn_cand = is_connect_candidate(*p);
 		p->connection = c;
-		if (was_conn_cand) update_connect_candidates(-1);
+		update_candidate(p);
 	}
 
 	void peer_list::inc_failcount(torrent_peer* p)
@@ -430,10 +493,8 @@ namespace libtorrent {
 		// failcount is a 5 bit value
 		if (p->failcount == 31) return;
 
-		bool const was_conn_cand = is_connect_candidate(*p);
 		++p->failcount;
-		if (was_conn_cand && !is_connect_candidate(*p))
-			update_connect_candidates(-1);
+		update_candidate(p);
 	}
 
 	void peer_list::set_failcount(torrent_peer* p, int const f)
@@ -442,12 +503,8 @@ namespace libtorrent {
 		INVARIANT_CHECK;
 
 		TORRENT_ASSERT(p->in_use);
-		bool const was_conn_cand = is_connect_candidate(*p);
 		p->failcount = aux::numeric_cast<std::uint32_t>(f);
-		if (was_conn_cand != is_connect_candidate(*p))
-		{
-			update_connect_candidates(was_conn_cand ? -1 : 1);
-		}
+		update_candidate(p);
 	}
 
 	bool peer_list::is_connect_candidate(torrent_peer const& p) const
@@ -465,93 +522,306 @@ namespace libtorrent {
 		return true;
 	}
 
-	void peer_list::find_connect_candidates(std::vector<torrent_peer*>& peers
-		, int session_time, torrent_state* state)
+	std::uint32_t peer_list::address_hash(address const& a)
 	{
-		TORRENT_ASSERT(is_single_thread());
-		INVARIANT_CHECK;
+#if TORRENT_USE_IPV6
+		if (a.is_v6())
+		{
+			address_v6::bytes_type const b = a.to_v6().to_bytes();
+			std::uint64_t h[2];
+			std::memcpy(h, b.data(), sizeof(h));
+			return mix_hash(h[0] ^ mix_hash(h[1]));
+		}
+#endif
+		return mix_hash(a.to_v4().to_ulong());
+	}
 
-		const int candidate_count = 10;
-		peers.reserve(candidate_count);
+#if TORRENT_USE_I2P
+	std::uint32_t peer_list::destination_hash(char const* dest)
+	{
+		// FNV-1a
+		std::uint64_t h = 14695981039346656037ULL;
+		for (; *dest != '\0'; ++dest)
+		{
+			h ^= std::uint8_t(*dest);
+			h *= 1099511628211ULL;
+		}
+		return mix_hash(h);
+	}
+#endif
 
-		int erase_candidate = -1;
+	std::uint32_t peer_list::peer_hash(torrent_peer const& p)
+	{
+#if TORRENT_USE_I2P
+		if (p.is_i2p_addr) return destination_hash(p.dest());
+#endif
+		return address_hash(p.address());
+	}
 
-		if (bool(m_finished) != state->is_finished)
-			recalculate_connect_candidates(state);
+	// it's important that we don't dereference p until we've found it in
+	// the index, since it may not be in the list at all (web seeds)
+	int peer_list::peer_index(torrent_peer const* p) const
+	{
+		if (m_index.empty()) return -1;
+		std::size_t const mask = m_index.size() - 1;
+		for (std::size_t s = peer_hash(*p) & mask;; s = (s + 1) & mask)
+		{
+			std::uint32_t const v = m_index[s];
+			if (v == 0) return -1;
+			if (m_peers[v - 1] == p) return int(v - 1);
+		}
+	}
 
-		external_ip const& external = state->ip;
-		int external_port = state->port;
+	int peer_list::find_peer(address const& a, int const port) const
+	{
+		if (m_index.empty()) return -1;
+		std::size_t const mask = m_index.size() - 1;
+		for (std::size_t s = address_hash(a) & mask;; s = (s + 1) & mask)
+		{
+			std::uint32_t const v = m_index[s];
+			if (v == 0) return -1;
+			torrent_peer const* p = m_peers[v - 1];
+#if TORRENT_USE_I2P
+			if (p->is_i2p_addr) continue;
+#endif
+			if (p->address() == a && (port == 0 || p->port == port))
+				return int(v - 1);
+		}
+	}
 
-		if (m_round_robin >= int(m_peers.size())) m_round_robin = 0;
+	std::vector<torrent_peer*> peer_list::find_peers(address const& a) const
+	{
+		std::vector<torrent_peer*> ret;
+		if (m_index.empty()) return ret;
+#if TORRENT_USE_I2P
+		if (a == address()) return ret;
+#endif
+		std::size_t const mask = m_index.size() - 1;
+		for (std::size_t s = address_hash(a) & mask;; s = (s + 1) & mask)
+		{
+			std::uint32_t const v = m_index[s];
+			if (v == 0) break;
+			torrent_peer* p = m_peers[v - 1];
+#if TORRENT_USE_I2P
+			if (p->is_i2p_addr) continue;
+#endif
+			if (p->address() == a) ret.push_back(p);
+		}
+		return ret;
+	}
 
-		int max_peerlist_size = state->max_peerlist_size;
+#if TORRENT_USE_I2P
+	int peer_list::find_i2p_peer(char const* destination) const
+	{
+		if (m_index.empty()) return -1;
+		std::size_t const mask = m_index.size() - 1;
+		for (std::size_t s = destination_hash(destination) & mask;; s = (s + 1) & mask)
+		{
+			std::uint32_t const v = m_index[s];
+			if (v == 0) return -1;
+			torrent_peer const* p = m_peers[v - 1];
+			if (p->is_i2p_addr && std::strcmp(p->dest(), destination) == 0)
+				return int(v - 1);
+		}
+	}
+#endif
 
-		// TODO: 2 it would be nice if there was a way to iterate over these
-		// torrent_peer objects in the order they are allocated in the pool
-		// instead. It would probably be more efficient
-		for (int iterations = std::min(int(m_peers.size()), 300);
-			iterations > 0; --iterations)
+	// returns the slot in m_index referring to m_peers[idx]
+	int peer_list::find_slot(int const idx) const
+	{
+		TORRENT_ASSERT(idx >= 0 && idx < int(m_peers.size()));
+		std::size_t const mask = m_index.size() - 1;
+		for (std::size_t s = peer_hash(*m_peers[std::size_t(idx)]) & mask;; s = (s + 1) & mask)
 		{
-			++state->loop_counter;
+			TORRENT_ASSERT(m_index[s] != 0);
+			if (m_index[s] == std::uint32_t(idx + 1)) return int(s);
+		}
+	}
 
-			if (m_round_robin >= int(m_peers.size())) m_round_robin = 0;
+	void peer_list::index_insert(int const idx)
+	{
+		TORRENT_ASSERT(idx >= 0 && idx < int(m_peers.size()));
+		if (m_peers.size() * 2 > m_index.size())
+		{
+			// this re-inserts all peers, including idx
+			grow_index();
+			return;
+		}
+		std::size_t const mask = m_index.size() - 1;
+		std::size_t s = peer_hash(*m_peers[std::size_t(idx)]) & mask;
+		while (m_index[s] != 0) s = (s + 1) & mask;
+		m_index[s] = std::uint32_t(idx + 1);
+	}
 
-			torrent_peer& pe = *m_peers[m_round_robin];
-			TORRENT_ASSERT(pe.in_use);
-			int current = m_round_robin;
+	void peer_list::index_erase(int const idx)
+	{
+		std::size_t const mask = m_index.size() - 1;
+		std::size_t hole = std::size_t(find_slot(idx));
 
-			// if the number of peers is growing large
-			// we need to start weeding.
+		// shift back any entry after the hole that would otherwise become
+		// unreachable by its probe sequence
+		for (std::size_t j = (hole + 1) & mask; m_index[j] != 0; j = (j + 1) & mask)
+		{
+			std::size_t const home = peer_hash(*m_peers[m_index[j] - 1]) & mask;
+			bool const reachable = hole <= j
+				? (home > hole && home <= j)
+				: (home > hole || home <= j);
+			if (reachable) continue;
+			m_index[hole] = m_index[j];
+			hole = j;
+		}
+		m_index[hole] = 0;
+	}
 
-			if (int(m_peers.size()) >= max_peerlist_size * 0.95
-				&& max_peerlist_size > 0)
-			{
-				if (is_erase_candidate(pe)
-					&& (erase_candidate == -1
-						|| !compare_peer_erase(*m_peers[erase_candidate], pe)))
-				{
-					if (should_erase_immediately(pe))
-					{
-						if (erase_candidate > current) --erase_candidate;
-						erase_peer(m_peers.begin() + current, state);
-						continue;
-					}
-					else
-					{
-						erase_candidate = current;
-					}
-				}
-			}
+	void peer_list::grow_index()
+	{
+		std::size_t size = std::max(m_index.size(), std::size_t(16));
+		while (size < m_peers.size() * 2) size *= 2;
+		m_index.assign(size, 0);
+		std::size_t const mask = size - 1;
+		for (std::size_t i = 0; i < m_peers.size(); ++i)
+		{
+			std::size_t s = peer_hash(*m_peers[i]) & mask;
+			while (m_index[s] != 0) s = (s + 1) & mask;
+			m_index[s] = std::uint32_t(i + 1);
+		}
+	}
 
-			++m_round_robin;
+	// the low 32 bits are the inverted peer rank, which is cached here. The
+	// rest only depends on fields of the torrent_peer
+	std::uint64_t peer_list::candidate_key(torrent_peer const& p) const
+	{
+		return candidate_order(p)
+			| std::uint32_t(~p.rank(m_external, m_external_port));
+	}
 
-			if (!is_connect_candidate(pe)) continue;
+	int peer_list::candidate_bucket(torrent_peer const& p) const
+	{
+		// Local peers should always be tried first
+		return int(p.failcount) * 2 + (is_local(p.address()) ? 0 : 1);
+	}
 
-			if (pe.last_connected
-				&& session_time - pe.last_connected <
-				(int(pe.failcount) + 1) * state->min_reconnect_time)
-				continue;
+	void peer_list::candidate_set(int const bucket, int const pos, candidate_entry const e)
+	{
+		m_candidates[std::size_t(bucket)][std::size_t(pos)] = e;
+		m_candidate_pos[e.peer] = encode_candidate_pos(bucket, pos);
+	}
+
+	void peer_list::candidate_sift_up(int const bucket, int pos)
+	{
+		auto const& heap = m_candidates[std::size_t(bucket)];
+		candidate_entry const e = heap[std::size_t(pos)];
+		while (pos > 0)
+		{
+			int const parent = (pos - 1) / 2;
+			if (heap[std::size_t(parent)].key <= e.key) break;
+			candidate_set(bucket, pos, heap[std::size_t(parent)]);
+			pos = parent;
+		}
+		candidate_set(bucket, pos, e);
+	}
+
+	void peer_list::candidate_sift_down(int const bucket, int pos)
+	{
+		auto const& heap = m_candidates[std::size_t(bucket)];
+		int const size = int(heap.size());
+		candidate_entry const e = heap[std::size_t(pos)];
+		for (;;)
+		{
+			int child = pos * 2 + 1;
+			if (child >= size) break;
+			if (child + 1 < size && heap[std::size_t(child + 1)].key < heap[std::size_t(child)].key)
+				++child;
+			if (e.key <= heap[std::size_t(child)].key) break;
+			candidate_set(bucket, pos, heap[std::size_t(child)]);
+			pos = child;
+		}
+		candidate_set(bucket, pos, e);
+	}
 
-			// compare peer returns true if lhs is better than rhs. In this
-			// case, it returns true if the current candidate is better than
-			// pe, which is the peer m_round_robin points to. If it is, just
-			// keep looking.
-			if (peers.size() == candidate_count
-				&& compare_peer(peers.back(), &pe, external, external_port)) continue;
+	void peer_list::candidate_insert(int const idx)
+	{
+		TORRENT_ASSERT(m_candidate_pos[std::size_t(idx)] == 0);
+		torrent_peer const& p = *m_peers[std::size_t(idx)];
+		TORRENT_ASSERT(is_connect_candidate(p));
+		int const bucket = candidate_bucket(p);
+		TORRENT_ASSERT(bucket < 64);
+		if (bucket >= int(m_candidates.size()))
+			m_candidates.resize(std::size_t(bucket + 1));
+		auto& heap = m_candidates[std::size_t(bucket)];
+		heap.push_back({candidate_key(p), std::uint32_t(idx)});
+		m_candidate_buckets |= std::uint64_t(1) << bucket;
+		candidate_sift_up(bucket, int(heap.size()) - 1);
+		++m_num_connect_candidates;
+	}
 
-			if (peers.size() >= candidate_count)
-				peers.resize(candidate_count - 1);
+	void peer_list::candidate_erase(int const idx)
+	{
+		std::uint32_t const v = m_candidate_pos[std::size_t(idx)];
+		TORRENT_ASSERT(v != 0);
+		int const bucket = candidate_pos_bucket(v);
+		int const pos = candidate_pos_index(v);
+		auto& heap = m_candidates[std::size_t(bucket)];
+		TORRENT_ASSERT(heap[std::size_t(pos)].peer == std::uint32_t(idx));
+
+		m_candidate_pos[std::size_t(idx)] = 0;
+		TORRENT_ASSERT(m_num_connect_candidates > 0);
+		--m_num_connect_candidates;
+
+		candidate_entry const last = heap.back();
+		heap.pop_back();
+		if (heap.empty()) m_candidate_buckets &= ~(std::uint64_t(1) << bucket);
+		if (pos == int(heap.size())) return;
+		candidate_set(bucket, pos, last);
+		if (pos > 0 && last.key < heap[std::size_t((pos - 1) / 2)].key)
+			candidate_sift_up(bucket, pos);
+		else
+			candidate_sift_down(bucket, pos);
+	}
 
-			// insert this candidate sorted into peers
-			auto const i = std::lower_bound(peers.begin(), peers.end()
-				, &pe, std::bind(&peer_list::compare_peer, this, _1, _2, std::cref(external), external_port));
+	void peer_list::update_candidate(torrent_peer const* p)
+	{
+		TORRENT_ASSERT(is_single_thread());
+		// web seeds are not in the list
+		if (p->web_seed) return;
+		int const idx = peer_index(p);
+		if (idx < 0) return;
+		update_candidate(idx);
+	}
 
-			peers.insert(i, &pe);
+	void peer_list::update_candidate(int const idx)
+	{
+		torrent_peer const& p = *m_peers[std::size_t(idx)];
+		std::uint32_t const v = m_candidate_pos[std::size_t(idx)];
+		if (!is_connect_candidate(p))
+		{
+			if (v != 0) candidate_erase(idx);
+			return;
 		}
 
-		if (erase_candidate > -1)
+		if (v != 0)
 		{
-			erase_peer(m_peers.begin() + erase_candidate, state);
+			// if nothing affecting its position changed, leave it
+			candidate_entry const& e = m_candidates[std::size_t(candidate_pos_bucket(v))]
+				[std::size_t(candidate_pos_index(v))];
+			if (candidate_pos_bucket(v) == candidate_bucket(p)
+				&& (e.key & 0xffffffff00000000ULL) == candidate_order(p))
+				return;
+			candidate_erase(idx);
+		}
+		candidate_insert(idx);
+	}
+
+	void peer_list::rebuild_candidates()
+	{
+		for (auto& heap : m_candidates) heap.clear();
+		m_candidate_buckets = 0;
+		std::fill(m_candidate_pos.begin(), m_candidate_pos.end(), 0);
+		m_num_connect_candidates = 0;
+		for (int i = 0; i < int(m_peers.size()); ++i)
+		{
+			if (is_connect_candidate(*m_peers[std::size_t(i)]))
+				candidate_insert(i);
 		}
 	}
 
@@ -565,46 +835,16 @@ namespace libtorrent {
 
 		TORRENT_ASSERT(!state->is_paused);
 
-		iterator iter;
 		torrent_peer* i = nullptr;
 
-		bool found = false;
-		if (state->allow_multiple_connections_per_ip)
-		{
-			tcp::endpoint remote = c.remote();
-			std::pair<iterator, iterator> range = find_peers(remote.address());
-			iter = std::find_if(range.first, range.second, match_peer_endpoint(remote));
-
-			if (iter != range.second)
-			{
-				TORRENT_ASSERT((*iter)->in_use);
-				found = true;
-			}
-		}
-		else
-		{
-			iter = std::lower_bound(
-				m_peers.begin(), m_peers.end()
-				, c.remote().address(), peer_address_compare()
-			);
-
-			if (iter != m_peers.end() && (*iter)->address() == c.remote().address())
-			{
-				TORRENT_ASSERT((*iter)->in_use);
-				found = true;
-			}
-		}
-
-		// make sure the iterator we got is properly sorted relative
-		// to the connection's address
-//		TORRENT_ASSERT(m_peers.empty()
-//			|| (iter == m_peers.end() && (*(iter-1))->address() < c.remote().address())
-//			|| (iter != m_peers.end() && c.remote().address() < (*iter)->address())
-//			|| (iter != m_peers.end() && iter != m_peers.begin() && (*(iter-1))->address() < c.remote().address()));
+		tcp::endpoint const remote = c.remote();
+		int const idx = state->allow_multiple_connections_per_ip
+			? find_peer(remote.address(), remote.port())
+			: find_peer(remote.address());
 
-		if (found)
+		if (idx >= 0)
 		{
-			i = *iter;
+			i = m_peers[std::size_t(idx)];
 			TORRENT_ASSERT(i->in_use);
 			TORRENT_ASSERT(i->connection != &c);
 			TORRENT_ASSERT(i->address() == c.remote().address());
@@ -715,9 +955,6 @@ namespace libtorrent {
 					}
 				}
 			}
-
-			if (is_connect_candidate(*i))
-				update_connect_candidates(-1);
 		}
 		else
 		{
@@ -727,18 +964,12 @@ namespace libtorrent {
 			if (state->max_peerlist_size
 				&& int(m_peers.size()) >= state->max_peerlist_size)
 			{
-				// this may invalidate our iterator!
 				erase_peers(state, force_erase);
 				if (int(m_peers.size()) >= state->max_peerlist_size)
 				{
 					c.disconnect(errors::too_many_connections, op_bittorrent);
 					return false;
 				}
-				// restore it
-				iter = std::lower_bound(
-					m_peers.begin(), m_peers.end()
-					, c.remote().address(), peer_address_compare()
-				);
 			}
 
 #if TORRENT_USE_IPV6
@@ -762,11 +993,11 @@ namespace libtorrent {
 			p->in_use = true;
 #endif
 
-			iter = m_peers.insert(iter, p);
+			m_peers.push_back(p);
+			m_candidate_pos.push_back(0);
+			index_insert(int(m_peers.size()) - 1);
 
-			if (m_round_robin >= iter - m_peers.begin()) ++m_round_robin;
-
-			i = *iter;
+			i = p;
 
 			i->source = peer_info::incoming;
 		}
@@ -782,6 +1013,7 @@ namespace libtorrent {
 		TORRENT_ASSERT(i->connection);
 		if (!c.fast_reconnect())
 			i->last_connected = std::uint16_t(session_time);
+		update_candidate(i);
 
 		// this cannot be a connect candidate anymore, since i->connection is set
 		TORRENT_ASSERT(!is_connect_candidate(*i));
@@ -802,23 +1034,18 @@ namespace libtorrent {
 
 		if (state->allow_multiple_connections_per_ip)
 		{
-			tcp::endpoint remote(p->address(), std::uint16_t(port));
-			std::pair<iterator, iterator> range = find_peers(remote.address());
-			iterator i = std::find_if(range.first, range.second
-				, match_peer_endpoint(remote));
-			if (i != range.second)
+			int const i = find_peer(p->address(), port);
+			if (i >= 0)
 			{
-				torrent_peer& pp = **i;
+				torrent_peer& pp = *m_peers[std::size_t(i)];
 				TORRENT_ASSERT(pp.in_use);
 				if (pp.connection)
 				{
-					bool const was_conn_cand = is_connect_candidate(pp);
 					// if we already have an entry with this
 					// new endpoint, disconnect this one
 					pp.connectable = true;
 					pp.source |= src;
-					if (!was_conn_cand && is_connect_candidate(pp))
-						update_connect_candidates(1);
+					update_candidate(&pp);
 					// calling disconnect() on a peer, may actually end
 					// up "garbage collecting" its torrent_peer entry
 					// as well, if it's considered useless (which this specific)
@@ -832,7 +1059,7 @@ namespace libtorrent {
 					erase_peer(p, state);
 					return false;
 				}
-				erase_peer(i, state);
+				erase_peer(m_peers.begin() + i, state);
 			}
 		}
 #if TORRENT_USE_ASSERTS
@@ -842,19 +1069,15 @@ namespace libtorrent {
 			if (!p->is_i2p_addr)
 #endif
 			{
-				std::pair<iterator, iterator> range = find_peers(p->address());
-				TORRENT_ASSERT(std::distance(range.first, range.second) == 1);
+				TORRENT_ASSERT(find_peers(p->address()).size() == 1);
 			}
 		}
 #endif
 
-		bool const was_conn_cand = is_connect_candidate(*p);
 		p->port = std::uint16_t(port);
 		p->source |= src;
 		p->connectable = true;
-
-		if (was_conn_cand != is_connect_candidate(*p))
-			update_connect_candidates(was_conn_cand ? -1 : 1);
+		update_candidate(p);
 		return true;
 	}
 
@@ -874,12 +1097,10 @@ namespace libtorrent {
 		if (p == nullptr) return;
 		TORRENT_ASSERT(p->in_use);
 		if (p->seed == s) return;
-		bool const was_conn_cand = is_connect_candidate(*p);
 		p->seed = s;
-		if (was_conn_cand && !is_connect_candidate(*p))
-			update_connect_candidates(-1);
 
 		if (p->web_seed) return;
+		update_candidate(p);
 		if (s)
 		{
 			TORRENT_ASSERT(m_num_seeds < int(m_peers.size()));
@@ -893,7 +1114,7 @@ namespace libtorrent {
 	}
 
 	// this is an internal function
-	bool peer_list::insert_peer(torrent_peer* p, iterator iter, int flags
+	bool peer_list::insert_peer(torrent_peer* p, int flags
 		, torrent_state* state)
 	{
 		TORRENT_ASSERT(is_single_thread());
@@ -910,26 +1131,12 @@ namespace libtorrent {
 			erase_peers(state);
 			if (int(m_peers.size()) >= max_peerlist_size)
 				return false;
-
-			// since some peers were removed, we need to
-			// update the iterator to make it valid again
-#if TORRENT_USE_I2P
-			if (p->is_i2p_addr)
-			{
-				iter = std::lower_bound(
-					m_peers.begin(), m_peers.end()
-					, p->dest(), peer_address_compare());
-			}
-			else
-#endif
-			iter = std::lower_bound(
-				m_peers.begin(), m_peers.end()
-				, p->address(), peer_address_compare());
 		}
 
-		iter = m_peers.insert(iter, p);
-
-		if (m_round_robin >= iter - m_peers.begin()) ++m_round_robin;
+		m_peers.push_back(p);
+		m_candidate_pos.push_back(0);
+		int const idx = int(m_peers.size()) - 1;
+		index_insert(idx);
 
 #if !defined(TORRENT_DISABLE_ENCRYPTION) && !defined(TORRENT_DISABLE_EXTENSIONS)
 		if (flags & flag_encryption) p->pe_support = true;
@@ -944,8 +1151,7 @@ namespace libtorrent {
 			p->supports_utp = true;
 		if (flags & flag_holepunch)
 			p->supports_holepunch = true;
-		if (is_connect_candidate(*p))
-			update_connect_candidates(1);
+		update_candidate(idx);
 
 		return true;
 	}
@@ -954,7 +1160,6 @@ namespace libtorrent {
 		, tcp::endpoint const& remote, char const* /* destination*/)
 	{
 		TORRENT_ASSERT(is_single_thread());
-		bool const was_conn_cand = is_connect_candidate(*p);
 
 		TORRENT_ASSERT(p->in_use);
 		p->connectable = true;
@@ -987,22 +1192,7 @@ namespace libtorrent {
 		if (flags & flag_holepunch)
 			p->supports_holepunch = true;
 
-		if (was_conn_cand != is_connect_candidate(*p))
-		{
-			update_connect_candidates(was_conn_cand ? -1 : 1);
-		}
-	}
-
-	void peer_list::update_connect_candidates(int delta)
-	{
-		TORRENT_ASSERT(is_single_thread());
-		if (delta == 0) return;
-		m_num_connect_candidates += delta;
-		if (delta < 0)
-		{
-			TORRENT_ASSERT(m_num_connect_candidates >= 0);
-			if (m_num_connect_candidates < 0) m_num_connect_candidates = 0;
-		}
+		update_candidate(p);
 	}
 
 #if TORRENT_USE_I2P
@@ -1012,18 +1202,11 @@ namespace libtorrent {
 		TORRENT_ASSERT(is_single_thread());
 		INVARIANT_CHECK;
 
-		bool found = false;
-		iterator iter = std::lower_bound(
-			m_peers.begin(), m_peers.end()
-			, destination, peer_address_compare()
-		);
-
-		if (iter != m_peers.end() && strcmp((*iter)->dest(), destination) == 0)
-			found = true;
+		int const idx = find_i2p_peer(destination);
 
 		torrent_peer* p = nullptr;
 
-		if (!found)
+		if (idx < 0)
 		{
 			// we don't have any info about this peer.
 			// add a new entry
@@ -1035,7 +1218,7 @@ namespace libtorrent {
 			p->in_use = true;
 #endif
 
-			if (!insert_peer(p, iter, flags, state))
+			if (!insert_peer(p, flags, state))
 			{
 #if TORRENT_USE_ASSERTS
 				p->in_use = false;
@@ -1047,7 +1230,7 @@ namespace libtorrent {
 		}
 		else
 		{
-			p = *iter;
+			p = m_peers[std::size_t(idx)];
 			update_peer(p, src, flags, tcp::endpoint(), destination);
 		}
 		return p;
@@ -1073,27 +1256,13 @@ namespace libtorrent {
 			return nullptr;
 #endif
 
-		iterator iter;
 		torrent_peer* p = nullptr;
 
-		bool found = false;
-		if (state->allow_multiple_connections_per_ip)
-		{
-			std::pair<iterator, iterator> range = find_peers(remote.address());
-			iter = std::find_if(range.first, range.second, match_peer_endpoint(remote));
-			if (iter != range.second) found = true;
-		}
-		else
-		{
-			iter = std::lower_bound(
-				m_peers.begin(), m_peers.end()
-				, remote.address(), peer_address_compare()
-			);
-
-			if (iter != m_peers.end() && (*iter)->address() == remote.address()) found = true;
-		}
+		int const idx = state->allow_multiple_connections_per_ip
+			? find_peer(remote.address(), remote.port())
+			: find_peer(remote.address());
 
-		if (!found)
+		if (idx < 0)
 		{
 			// we don't have any info about this peer.
 			// add a new entry
@@ -1119,7 +1288,7 @@ namespace libtorrent {
 			p->in_use = true;
 #endif
 
-			if (!insert_peer(p, iter, flags, state))
+			if (!insert_peer(p, flags, state))
 			{
 #if TORRENT_USE_ASSERTS
 				p->in_use = false;
@@ -1131,7 +1300,7 @@ namespace libtorrent {
 		}
 		else
 		{
-			p = *iter;
+			p = m_peers[std::size_t(idx)];
 			TORRENT_ASSERT(p->in_use);
 			update_peer(p, src, flags, remote, nullptr);
 			state->first_time_seen = false;
@@ -1145,28 +1314,58 @@ namespace libtorrent {
 		TORRENT_ASSERT(is_single_thread());
 		INVARIANT_CHECK;
 
-		if (bool(m_finished) != state->is_finished)
+		if (bool(m_finished) != state->is_finished
+			|| m_ranks_dirty
+			|| m_external_port != state->port)
 			recalculate_connect_candidates(state);
 
-		// clear out any peers from the cache that no longer
-		// are connection candidates
-		for (std::vector<torrent_peer*>::iterator i = m_candidate_cache.begin();
-			i != m_candidate_cache.end();)
+		// if the number of peers is growing large
+		// we need to start weeding.
+		int const max_peerlist_size = state->max_peerlist_size;
+		if (max_peerlist_size > 0
+			&& int(m_peers.size()) >= max_peerlist_size * 0.95)
 		{
-			if (!is_connect_candidate(**i))
-				i = m_candidate_cache.erase(i);
-			else
-				++i;
+			erase_peers(state);
 		}
 
-		if (m_candidate_cache.empty())
+		// the heaps are in order of preference. The first one whose top
+		// peer is ready to be connected to has the best candidate
+		torrent_peer* p = nullptr;
+		for (std::uint64_t buckets = m_candidate_buckets;
+			buckets != 0 && p == nullptr; buckets &= buckets - 1)
 		{
-			find_connect_candidates(m_candidate_cache, session_time, state);
-			if (m_candidate_cache.empty()) return nullptr;
+			int const bucket = lowest_bit(buckets);
+			auto& heap = m_candidates[std::size_t(bucket)];
+			while (!heap.empty())
+			{
+				++state->loop_counter;
+
+				candidate_entry const top = heap.front();
+				torrent_peer& pe = *m_peers[top.peer];
+				TORRENT_ASSERT(pe.in_use);
+				TORRENT_ASSERT(is_connect_candidate(pe));
+
+				// last_connected may have been updated without going through
+				// the peer_list. If so, put this peer where it belongs first
+				std::uint64_t const order = candidate_order(pe);
+				if ((top.key & 0xffffffff00000000ULL) != order)
+				{
+					candidate_set(bucket, 0, {order | (top.key & 0xffffffff), top.peer});
+					candidate_sift_down(bucket, 0);
+					continue;
+				}
+
+				if (pe.last_connected
+					&& session_time - pe.last_connected <
+					(int(pe.failcount) + 1) * state->min_reconnect_time)
+					break;
+
+				p = &pe;
+				break;
+			}
 		}
 
-		torrent_peer* p = m_candidate_cache.front();
-		m_candidate_cache.erase(m_candidate_cache.begin());
+		if (p == nullptr) return nullptr;
 
 		TORRENT_ASSERT(p->in_use);
 
@@ -1174,7 +1373,8 @@ namespace libtorrent {
 		TORRENT_ASSERT(!p->connection);
 		TORRENT_ASSERT(p->connectable);
 
-		// this should hold because find_connect_candidates should have done this
+		// this should hold because recalculate_connect_candidates should
+		// have done this
 		TORRENT_ASSERT(bool(m_finished) == state->is_finished);
 
 		TORRENT_ASSERT(is_connect_candidate(*p));
@@ -1224,8 +1424,7 @@ namespace libtorrent {
 			if (p->failcount < 31) ++p->failcount;
 		}
 
-		if (is_connect_candidate(*p))
-			update_connect_candidates(1);
+		update_candidate(p);
 
 		// if we're already a seed, it's not as important
 		// to keep all the possibly stale peers
@@ -1257,14 +1456,13 @@ namespace libtorrent {
 	{
 		TORRENT_ASSERT(is_single_thread());
 
-		m_num_connect_candidates = 0;
 		m_finished = state->is_finished;
 		m_max_failcount = state->max_failcount;
+		m_external = state->ip;
+		m_external_port = state->port;
+		m_ranks_dirty = false;
 
-		for (auto const& p : m_peers)
-		{
-			m_num_connect_candidates += is_connect_candidate(*p);
-		}
+		rebuild_candidates();
 
 #if TORRENT_USE_INVARIANT_CHECKS
 		// the invariant is not likely to be upheld at the entry of this function
@@ -1281,11 +1479,7 @@ namespace libtorrent {
 
 		TORRENT_ASSERT(c);
 
-		iterator iter = std::lower_bound(
-			m_peers.begin(), m_peers.end()
-			, c->remote().address(), peer_address_compare());
-
-		if (iter != m_peers.end() && (*iter)->address() == c->remote().address())
+		if (find_peer(c->remote().address()) >= 0)
 			return true;
 
 		return std::find_if(
@@ -1301,23 +1495,32 @@ namespace libtorrent {
 		TORRENT_ASSERT(is_single_thread());
 		TORRENT_ASSERT(m_num_connect_candidates >= 0);
 		TORRENT_ASSERT(m_num_connect_candidates <= int(m_peers.size()));
+		TORRENT_ASSERT(m_candidate_pos.size() == m_peers.size());
+		TORRENT_ASSERT(m_index.size() >= m_peers.size() * 2);
+		for (int i = 0; i < 64; ++i)
+		{
+			bool const nonempty = i < int(m_candidates.size())
+				&& !m_candidates[std::size_t(i)].empty();
+			TORRENT_ASSERT(nonempty == bool(m_candidate_buckets & (std::uint64_t(1) << i)));
+		}
 
 #ifdef TORRENT_EXPENSIVE_INVARIANT_CHECKS
 		int total_connections = 0;
 		int nonempty_connections = 0;
 		int connect_candidates = 0;
 
-		const_iterator prev = m_peers.end();
-		for (const_iterator i = m_peers.begin(); i != m_peers.end(); ++i)
+		for (int i = 0; i < int(m_peers.size()); ++i)
 		{
-			if (prev != m_peers.end()) ++prev;
-			if (i == m_peers.begin() + 1) prev = m_peers.begin();
-			if (prev != m_peers.end())
+			torrent_peer const& p = *m_peers[std::size_t(i)];
+			TORRENT_ASSERT(p.in_use);
+			TORRENT_ASSERT(m_index[std::size_t(find_slot(i))] == std::uint32_t(i + 1));
+			std::uint32_t const pos = m_candidate_pos[std::size_t(i)];
+			TORRENT_ASSERT((pos != 0) == is_connect_candidate(p));
+			if (pos != 0)
 			{
-				TORRENT_ASSERT(!((*i)->address() < (*prev)->address()));
+				TORRENT_ASSERT(m_candidates[std::size_t(candidate_pos_bucket(pos))]
+					[std::size_t(candidate_pos_index(pos))].peer == std::uint32_t(i));
 			}
-			torrent_peer const& p = **i;
-			TORRENT_ASSERT(p.in_use);
 			if (is_connect_candidate(p)) ++connect_candidates;
 			++total_connections;
 			if (!p.connection)
@@ -1363,31 +1566,4 @@ namespace libtorrent {
 
 		return lhs.trust_points < rhs.trust_points;
 	}
-
-	// this returns true if lhs is a better connect candidate than rhs
-	bool peer_list::compare_peer(torrent_peer const* lhs, torrent_peer const* rhs
-		, external_ip const& external, int external_port) const
-	{
-		TORRENT_ASSERT(is_single_thread());
-		// prefer peers with lower failcount
-		if (lhs->failcount != rhs->failcount)
-			return lhs->failcount < rhs->failcount;
-
-		// Local peers should always be tried first
-		bool lhs_local = is_local(lhs->address());
-		bool rhs_local = is_local(rhs->address());
-		if (lhs_local != rhs_local) return lhs_local > rhs_local;
-
-		if (lhs->last_connected != rhs->last_connected)
-			return lhs->last_connected < rhs->last_connected;
-
-		int lhs_rank = source_rank(lhs->source);
-		int rhs_rank = source_rank(rhs->source);
-		if (lhs_rank != rhs_rank) return lhs_rank > rhs_rank;
-
-		std::uint32_t lhs_peer_rank = lhs->rank(external, external_port);
-		std::uint32_t rhs_peer_rank = rhs->rank(external, external_port);
-		if (lhs_peer_rank > rhs_peer_rank) return true;
-		return false;
-	}
 }
@@ -36,11 +36,38 @@ POSSIBILITY OF SUCH DAMAGE.
 
 namespace libtorrent {
 
+#if TORRENT_SHARDED_COUNTERS
+	constexpr int counters::num_shards;
+
+	int counters::thread_shard()
+	{
+		static std::atomic<int> next_shard(0);
+		thread_local int const shard = next_shard.fetch_add(1
+			, std::memory_order_relaxed) & (num_shards - 1);
+		return shard;
+	}
+
+	std::int64_t counters::shard_sum(int const c) const
+	{
+		TORRENT_ASSERT(c >= 0);
+		TORRENT_ASSERT(c < num_stats_counters);
+		std::int64_t ret = 0;
+		for (auto const& s : m_shards)
+			ret += s[c].load(std::memory_order_relaxed);
+		return ret;
+	}
+#endif
+
 	counters::counters()
 	{
 #ifdef ATOMIC_LLONG_LOCK_FREE
 		for (auto& counter : m_stats_counter)
 			counter.store(0, std::memory_order_relaxed);
+#if TORRENT_SHARDED_COUNTERS
+		for (auto& s : m_shards)
+			for (auto& counter : s)
+				counter.store(0, std::memory_order_relaxed);
+#endif
 #else
 		std::memset(m_stats_counter, 0, sizeof(m_stats_counter));
 #endif
@@ -49,10 +76,13 @@ namespace libtorrent {
 	counters::counters(counters const& c)
 	{
 #ifdef ATOMIC_LLONG_LOCK_FREE
+#if TORRENT_SHARDED_COUNTERS
+		for (auto& s : m_shards)
+			for (auto& counter : s)
+				counter.store(0, std::memory_order_relaxed);
+#endif
 		for (int i = 0; i < m_stats_counter.end_index(); ++i)
-			m_stats_counter[i].store(
-				c.m_stats_counter[i].load(std::memory_order_relaxed)
-					, std::memory_order_relaxed);
+			m_stats_counter[i].store(c[i], std::memory_order_relaxed);
 #else
 		std::lock_guard<std::mutex> l(c.m_mutex);
 		std::memcpy(m_stats_counter, c.m_stats_counter, sizeof(m_stats_counter));
@@ -62,10 +92,14 @@ namespace libtorrent {
 	counters& counters::operator=(counters const& c)
 	{
 #ifdef ATOMIC_LLONG_LOCK_FREE
+		if (&c == this) return *this;
+#if TORRENT_SHARDED_COUNTERS
+		for (auto& s : m_shards)
+			for (auto& counter : s)
+				counter.store(0, std::memory_order_relaxed);
+#endif
 		for (int i = 0; i < m_stats_counter.end_index(); ++i)
-			m_stats_counter[i].store(
-				c.m_stats_counter[i].load(std::memory_order_relaxed)
-					, std::memory_order_relaxed);
+			m_stats_counter[i].store(c[i], std::memory_order_relaxed);
 #else
 		std::lock_guard<std::mutex> l(m_mutex);
 		std::lock_guard<std::mutex> l2(c.m_mutex);
@@ -80,6 +114,10 @@ namespace libtorrent {
 		TORRENT_ASSERT(i < num_counters);
 
 #ifdef ATOMIC_LLONG_LOCK_FREE
+#if TORRENT_SHARDED_COUNTERS
+		if (i < num_stats_counters)
+			return m_stats_counter[i].load(std::memory_order_relaxed) + shard_sum(i);
+#endif
 		return m_stats_counter[i].load(std::memory_order_relaxed);
 #else
 		std::lock_guard<std::mutex> l(m_mutex);
@@ -99,6 +137,16 @@ namespace libtorrent {
 		TORRENT_ASSERT(c < num_counters);
 
 #ifdef ATOMIC_LLONG_LOCK_FREE
+#if TORRENT_SHARDED_COUNTERS
+		if (c < num_stats_counters)
+		{
+			// only the calling thread (and the few others sharing its shard)
+			// writes to this cache line
+			std::int64_t const pv = m_shards[thread_shard()][c].fetch_add(value
+				, std::memory_order_relaxed);
+			return pv + value;
+		}
+#endif
 		std::int64_t pv = m_stats_counter[c].fetch_add(value, std::memory_order_relaxed);
 		TORRENT_ASSERT(pv + value >= 0);
 		return pv + value;
@@ -140,6 +188,15 @@ namespace libtorrent {
 		TORRENT_ASSERT(c < num_counters);
 
 #ifdef ATOMIC_LLONG_LOCK_FREE
+#if TORRENT_SHARDED_COUNTERS
+		if (c < num_stats_counters)
+		{
+			// increments racing with this may be lost, just like they would
+			// be with a single copy of the counter
+			for (auto& s : m_shards)
+				s[c].store(0, std::memory_order_relaxed);
+		}
+#endif
 		m_stats_counter[c].store(value);
 #else
 		std::lock_guard<std::mutex> l(m_mutex);
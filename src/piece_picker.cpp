@@ -1210,6 +1210,20 @@ namespace libtorrent {
 		if (prev_priority >= 0) update(prev_priority, p.index);
 	}
 
+	bool piece_picker::incremental_update(int const num_changed) const
+	{
+		// moving a piece into its new place in m_pieces costs one step per
+		// priority bucket it crosses. When the availability changes by one,
+		// that's (priority_levels - piece_priority) * prio_factor buckets, so
+		// assume the default piece priority. Rebuilding the piece list (in
+		// update_pieces()) is a few linear passes over all pieces, but it can
+		// be deferred and shared with other changes. Only update pieces
+		// incrementally when it's clearly cheaper
+		int const buckets_per_peer = (priority_levels - default_priority) * prio_factor;
+		return std::int64_t(num_changed) * buckets_per_peer
+			< std::int64_t(m_piece_map.size());
+	}
+
 	void piece_picker::inc_refcount(typed_bitfield<piece_index_t> const& bitmask
 		, const torrent_peer* peer)
 	{
@@ -1230,73 +1244,44 @@ namespace libtorrent {
 			return;
 		}
 
-		int const size = std::min(50, bitmask.size() / 2);
-
-		// this is an optimization where if just a few
-		// pieces end up changing, instead of making
-		// the piece list dirty, just update those pieces
-		// instead
-		TORRENT_ALLOCA(incremented, piece_index_t, size);
-		int num_inc = 0;
-
-		if (!m_dirty)
+		if (!m_dirty && incremental_update(bitmask.count()))
 		{
-			// first count how many pieces we're updating. If it's few (less than half)
-			// we'll just update them one at a time. Otherwise we'll just update the counters
-			// and mark the picker as dirty, so we'll rebuild it next time we need it.
-			// this only matters if we're not already dirty, in which case the fasted
-			// thing to do is to just update the counters and be done
-			piece_index_t index = piece_index_t(0);
-			for (auto i = bitmask.begin(), end(bitmask.end()); i != end; ++i, ++index)
-			{
-				if (!*i) continue;
-				if (num_inc < size) incremented[num_inc] = index;
-				++num_inc;
-				if (num_inc >= size) break;
-			}
-
-			if (num_inc < size)
+			// not that many pieces were updated
+			// just update those individually instead of
+			// rebuilding the whole piece list
+			for (piece_index_t piece = bitmask.find_next_set(piece_index_t(0));
+				piece != piece_index_t(-1); piece = bitmask.find_next_set(next(piece)))
 			{
-				// not that many pieces were updated
-				// just update those individually instead of
-				// rebuilding the whole piece list
-				for (int i = 0; i < num_inc; ++i)
-				{
-					piece_index_t const piece = incremented[i];
-					piece_pos& p = m_piece_map[piece];
-					int prev_priority = p.priority(this);
-					++p.peer_count;
+				piece_pos& p = m_piece_map[piece];
+				int prev_priority = p.priority(this);
+				++p.peer_count;
 #ifdef TORRENT_DEBUG_REFCOUNTS
-					TORRENT_ASSERT(p.have_peers.count(peer) == 0);
-					p.have_peers.insert(peer);
+				TORRENT_ASSERT(p.have_peers.count(peer) == 0);
+				p.have_peers.insert(peer);
 #else
-					TORRENT_UNUSED(peer);
+				TORRENT_UNUSED(peer);
 #endif
-					int new_priority = p.priority(this);
-					if (prev_priority == new_priority) continue;
-					else if (prev_priority >= 0) update(prev_priority, p.index);
-					else add(piece);
-				}
-				return;
+				int new_priority = p.priority(this);
+				if (prev_priority == new_priority) continue;
+				else if (prev_priority >= 0) update(prev_priority, p.index);
+				else add(piece);
 			}
+			return;
 		}
 
-		piece_index_t index = piece_index_t(0);
 		bool updated = false;
-		for (auto i = bitmask.begin(), end(bitmask.end()); i != end; ++i, ++index)
+		for (piece_index_t index = bitmask.find_next_set(piece_index_t(0));
+			index != piece_index_t(-1); index = bitmask.find_next_set(next(index)))
 		{
-			if (*i)
-			{
 #ifdef TORRENT_DEBUG_REFCOUNTS
-				TORRENT_ASSERT(m_piece_map[index].have_peers.count(peer) == 0);
-				m_piece_map[index].have_peers.insert(peer);
+			TORRENT_ASSERT(m_piece_map[index].have_peers.count(peer) == 0);
+			m_piece_map[index].have_peers.insert(peer);
 #else
-				TORRENT_UNUSED(peer);
+			TORRENT_UNUSED(peer);
 #endif
 
-				++m_piece_map[index].peer_count;
-				updated = true;
-			}
+			++m_piece_map[index].peer_count;
+			updated = true;
 		}
 
 		// if we're already dirty, no point in doing anything more
@@ -1326,73 +1311,17 @@ namespace libtorrent {
 			return;
 		}
 
-		int const size = std::min(50, bitmask.size() / 2);
-
-		// this is an optimization where if just a few
-		// pieces end up changing, instead of making
-		// the piece list dirty, just update those pieces
-		// instead
-		TORRENT_ALLOCA(decremented, piece_index_t, size);
-		int num_dec = 0;
-
-		if (!m_dirty)
+		if (!m_dirty && incremental_update(bitmask.count()))
 		{
-			// first count how many pieces we're updating. If it's few (less than half)
-			// we'll just update them one at a time. Otherwise we'll just update the counters
-			// and mark the picker as dirty, so we'll rebuild it next time we need it.
-			// this only matters if we're not already dirty, in which case the fasted
-			// thing to do is to just update the counters and be done
-			piece_index_t index = piece_index_t(0);
-			for (auto i = bitmask.begin(), end(bitmask.end()); i != end; ++i, ++index)
+			// not that many pieces were updated
+			// just update those individually instead of
+			// rebuilding the whole piece list
+			for (piece_index_t piece = bitmask.find_next_set(piece_index_t(0));
+				piece != piece_index_t(-1); piece = bitmask.find_next_set(next(piece)))
 			{
-				if (!*i) continue;
-				if (num_dec < size) decremented[num_dec] = index;
-				++num_dec;
-				if (num_dec >= size) break;
-			}
+				piece_pos& p = m_piece_map[piece];
+				int prev_priority = p.priority(this);
 
-			if (num_dec < size)
-			{
-				// not that many pieces were updated
-				// just update those individually instead of
-				// rebuilding the whole piece list
-				for (int i = 0; i < num_dec; ++i)
-				{
-					piece_index_t const piece = decremented[i];
-					piece_pos& p = m_piece_map[piece];
-					int prev_priority = p.priority(this);
-
-					if (p.peer_count == 0)
-					{
-						TORRENT_ASSERT(m_seeds > 0);
-						// this is the case where we have one or more
-						// seeds, and one of them saying: I don't have this
-						// piece anymore. we need to break up one of the seed
-						// counters into actual peer counters on the pieces
-						break_one_seed();
-					}
-
-#ifdef TORRENT_DEBUG_REFCOUNTS
-					TORRENT_ASSERT(p.have_peers.count(peer) == 1);
-					p.have_peers.erase(peer);
-#else
-					TORRENT_UNUSED(peer);
-#endif
-					TORRENT_ASSERT(p.peer_count > 0);
-					--p.peer_count;
-					if (!m_dirty && prev_priority >= 0) update(prev_priority, p.index);
-				}
-				return;
-			}
-		}
-
-		piece_index_t index = piece_index_t(0);
-		bool updated = false;
-		for (auto i = bitmask.begin(), end(bitmask.end()); i != end; ++i, ++index)
-		{
-			if (*i)
-			{
-				piece_pos& p = m_piece_map[index];
 				if (p.peer_count == 0)
 				{
 					TORRENT_ASSERT(m_seeds > 0);
@@ -1409,11 +1338,38 @@ namespace libtorrent {
 #else
 				TORRENT_UNUSED(peer);
 #endif
-
 				TORRENT_ASSERT(p.peer_count > 0);
 				--p.peer_count;
-				updated = true;
+				if (!m_dirty && prev_priority >= 0) update(prev_priority, p.index);
 			}
+			return;
+		}
+
+		bool updated = false;
+		for (piece_index_t index = bitmask.find_next_set(piece_index_t(0));
+			index != piece_index_t(-1); index = bitmask.find_next_set(next(index)))
+		{
+			piece_pos& p = m_piece_map[index];
+			if (p.peer_count == 0)
+			{
+				TORRENT_ASSERT(m_seeds > 0);
+				// this is the case where we have one or more
+				// seeds, and one of them saying: I don't have this
+				// piece anymore. we need to break up one of the seed
+				// counters into actual peer counters on the pieces
+				break_one_seed();
+			}
+
+#ifdef TORRENT_DEBUG_REFCOUNTS
+			TORRENT_ASSERT(p.have_peers.count(peer) == 1);
+			p.have_peers.erase(peer);
+#else
+			TORRENT_UNUSED(peer);
+#endif
+
+			TORRENT_ASSERT(p.peer_count > 0);
+			--p.peer_count;
+			updated = true;
 		}
 
 		// if we're already dirty, no point in doing anything more
@@ -1422,6 +1378,19 @@ namespace libtorrent {
 		if (updated) m_dirty = true;
 	}
 
+	int piece_picker::memory_usage() const
+	{
+		std::size_t ret = sizeof(*this)
+			+ m_piece_map.capacity() * sizeof(piece_pos)
+			+ m_pieces.capacity() * sizeof(piece_index_t)
+			+ m_priority_boundaries.capacity() * sizeof(prio_index_t)
+			+ m_block_info.capacity() * sizeof(block_info)
+			+ m_free_block_infos.capacity() * sizeof(std::uint16_t);
+		for (auto const& c : m_downloads)
+			ret += c.capacity() * sizeof(downloading_piece);
+		return int(ret);
+	}
+
 	void piece_picker::update_pieces() const
 	{
 		TORRENT_ASSERT(m_dirty);
@@ -1461,6 +1430,17 @@ namespace libtorrent {
 		}
 		m_pieces.resize(new_size, piece_index_t(0));
 
+		// as pieces complete (or get filtered), the list of pickable pieces
+		// shrinks, but the vector's capacity stays at its high watermark. For
+		// torrents with millions of pieces that are mostly complete, that's
+		// several megabytes of dead weight per torrent. Give it back when
+		// we're using less than half of it
+		if (m_pieces.capacity() - m_pieces.size() > m_pieces.size()
+			&& m_pieces.capacity() > 1024)
+		{
+			m_pieces.shrink_to_fit();
+		}
+
 #ifdef TORRENT_PICKER_LOG
 		print_pieces();
 #endif
@@ -1991,7 +1971,11 @@ namespace {
 
 		if (options & sequential)
 		{
-			if (m_dirty) update_pieces();
+			if (m_dirty)
+			{
+				update_pieces();
+				pc.inc_stats_counter(counters::piece_picker_rebuilds);
+			}
 			TORRENT_ASSERT(!m_dirty);
 
 			for (auto i = m_pieces.begin();
@@ -2052,7 +2036,11 @@ namespace {
 		}
 		else if (options & rarest_first)
 		{
-			if (m_dirty) update_pieces();
+			if (m_dirty)
+			{
+				update_pieces();
+				pc.inc_stats_counter(counters::piece_picker_rebuilds);
+			}
 			TORRENT_ASSERT(!m_dirty);
 
 			// in time critical mode, we're only allowed to pick high priority
@@ -2981,8 +2969,9 @@ get_out:
 			info.peer = peer;
 			info.num_peers = 1;
 #if TORRENT_USE_ASSERTS
-			TORRENT_ASSERT(info.peers.count(peer) == 0);
-			info.peers.insert(peer);
+			TORRENT_ASSERT(std::find(info.peers.begin(), info.peers.end(), peer)
+				== info.peers.end());
+			info.peers.push_back(peer);
 #endif
 			++dp->requested;
 			// update_full may move the downloading piece to
@@ -3040,8 +3029,9 @@ get_out:
 			}
 
 #if TORRENT_USE_ASSERTS
-			TORRENT_ASSERT(info.peers.count(peer) == 0);
-			info.peers.insert(peer);
+			TORRENT_ASSERT(std::find(info.peers.begin(), info.peers.end(), peer)
+				== info.peers.end());
+			info.peers.push_back(peer);
 #endif
 		}
 		return true;
@@ -3508,8 +3498,15 @@ get_out:
 		int prev_prio = p.priority(this);
 
 #if TORRENT_USE_ASSERTS
-		TORRENT_ASSERT(info.peers.count(peer));
-		info.peers.erase(peer);
+		{
+			auto const it = std::find(info.peers.begin(), info.peers.end(), peer);
+			TORRENT_ASSERT(it != info.peers.end());
+			if (it != info.peers.end())
+			{
+				*it = info.peers.back();
+				info.peers.pop_back();
+			}
+		}
 #endif
 		TORRENT_ASSERT(info.num_peers > 0);
 		if (info.num_peers > 0) --info.num_peers;
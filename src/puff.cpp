@@ -77,13 +77,20 @@
  *                      - Allow incomplete code only if single code length is 1
  *                      - Add full code coverage test to Makefile
  * 2.3  21 Jan 2013     - Check for invalid code length codes in dynamic blocks
+ *
+ * libtorrent changes:
+ *
+ *                      - Decode codes of up to FASTBITS bits with a single
+ *                        table lookup, falling back to decode_slow()
+ *                      - Copy non-overlapping matches with memcpy()
+ *                      - Honour destlen in scanning mode too
  */
 
 // this whole file is just preserved and warnings are suppressed
 #include "libtorrent/aux_/disable_warnings_push.hpp"
 
 #include <setjmp.h>             /* for setjmp(), longjmp(), and jmp_buf */
-#include <string.h>             /* for NULL */
+#include <string.h>             /* for NULL and memcpy() */
 #include "libtorrent/puff.hpp"             /* prototype for puff() */
 
 #define local static            /* for local function definitions */
@@ -97,6 +104,7 @@
 #define MAXDCODES 30            /* maximum number of distance codes */
 #define MAXCODES (MAXLCODES+MAXDCODES)  /* maximum codes lengths to read */
 #define FIXLCODES 288           /* number of fixed literal/length codes */
+#define FASTBITS 9              /* bits decoded by one lookup in decode() */
 
 /* input and output state */
 struct state {
@@ -185,9 +193,9 @@ local int stored(struct state *s)
     /* copy len bytes from in to out */
     if (s->incnt + len > s->inlen)
         return 2;                               /* not enough input */
+    if (s->outcnt + len > s->outlen)
+        return 1;                               /* not enough output space */
     if (s->out != NULL) {
-        if (s->outcnt + len > s->outlen)
-            return 1;                           /* not enough output space */
         while (len--)
             s->out[s->outcnt++] = s->in[s->incnt++];
     }
@@ -210,6 +218,8 @@ local int stored(struct state *s)
 struct huffman {
     short *count;       /* number of symbols of each length */
     short *symbol;      /* canonically ordered symbols */
+    short *fast;        /* (length << 9) | symbol, indexed by the next
+                           FASTBITS bits, zero for longer codes */
 };
 
 /*
@@ -264,7 +274,7 @@ local int decode(struct state *s, const struct huffman *h)
  * a few percent larger.
  */
 #else /* !SLOW */
-local int decode(struct state *s, const struct huffman *h)
+local int decode_slow(struct state *s, const struct huffman *h)
 {
     int len;            /* current number of bits in code */
     int code;           /* len bits being decoded */
@@ -307,6 +317,43 @@ local int decode(struct state *s, const struct huffman *h)
     }
     return -10;                         /* ran out of codes */
 }
+
+/*
+ * Look up the symbol of codes of up to FASTBITS bits in h->fast[], in one
+ * step.  Whole bytes left unused in the bit buffer are given back to the
+ * input, so the bit buffer always holds less than eight bits between calls,
+ * as bits(), stored() and decode_slow() expect.
+ */
+local int decode(struct state *s, const struct huffman *h)
+{
+    int entry;          /* fast table entry for the next bits */
+    int len;            /* length of the decoded code */
+
+    /* load up to FASTBITS bits, as far as the input allows */
+    while (s->bitcnt < FASTBITS && s->incnt < s->inlen) {
+        s->bitbuf |= int(s->in[s->incnt++]) << s->bitcnt;
+        s->bitcnt += 8;
+    }
+
+    /* bits above bitcnt are zero, so a code is only valid if it fits */
+    entry = h->fast[s->bitbuf & ((1 << FASTBITS) - 1)];
+    len = entry >> 9;
+    if (entry == 0 || len > s->bitcnt)
+        entry = -1;                     /* longer code, or end of input */
+    else {
+        s->bitbuf >>= len;
+        s->bitcnt -= len;
+    }
+
+    /* give back the whole bytes we didn't use */
+    s->incnt -= s->bitcnt >> 3;
+    s->bitcnt &= 7;
+    s->bitbuf &= (1 << s->bitcnt) - 1;
+
+    if (entry < 0)
+        return decode_slow(s, h);
+    return entry & 511;
+}
 #endif /* SLOW */
 
 /*
@@ -348,6 +395,9 @@ local int construct(struct huffman *h, const short *length, int n)
     int left;           /* number of possible codes left of current length */
     short offs[MAXBITS+1];      /* offsets in symbol table for each length */
 
+    /* no fast lookups until the table is known to be usable */
+    memset(h->fast, 0, sizeof(short) << FASTBITS);
+
     /* count number of codes of each length */
     for (len = 0; len <= MAXBITS; len++)
         h->count[len] = 0;
@@ -378,6 +428,30 @@ local int construct(struct huffman *h, const short *length, int n)
         if (length[symbol] != 0)
             h->symbol[offs[length[symbol]]++] = symbol;
 
+    /*
+     * fill in the fast lookup table for the codes of up to FASTBITS bits.
+     * Codes are stored bit reversed in the stream, and each code fills all
+     * the entries that start with it
+     */
+    {
+        int code = 0;   /* canonical code of the current symbol */
+        int index = 0;  /* index of first code of length len in symbol[] */
+        for (len = 1; len <= FASTBITS; len++) {
+            int i;
+            for (i = 0; i < h->count[len]; i++, code++) {
+                int rev = 0;
+                int bit;
+                int fill;
+                for (bit = 0; bit < len; bit++)
+                    rev |= ((code >> bit) & 1) << (len - 1 - bit);
+                for (fill = rev; fill < (1 << FASTBITS); fill += 1 << len)
+                    h->fast[fill] = short((len << 9) | h->symbol[index + i]);
+            }
+            index += h->count[len];
+            code <<= 1;
+        }
+    }
+
     /* return zero for complete set, positive for incomplete set */
     return left;
 }
@@ -466,11 +540,10 @@ local int codes(struct state *s,
             return symbol;              /* invalid symbol */
         if (symbol < 256) {             /* literal: symbol is the byte */
             /* write out the literal */
-            if (s->out != NULL) {
-                if (s->outcnt == s->outlen)
-                    return 1;
+            if (s->outcnt == s->outlen)
+                return 1;
+            if (s->out != NULL)
                 s->out[s->outcnt] = symbol;
-            }
             s->outcnt++;
         }
         else if (symbol > 256) {        /* length */
@@ -491,9 +564,16 @@ local int codes(struct state *s,
 #endif
 
             /* copy length bytes from distance bytes back */
+            if (s->outcnt + len > s->outlen)
+                return 1;
             if (s->out != NULL) {
-                if (s->outcnt + len > s->outlen)
-                    return 1;
+#ifndef INFLATE_ALLOW_INVALID_DISTANCE_TOOFAR_ARRR
+                if (dist >= len) {      /* no overlap, copy in one go */
+                    memcpy(s->out + s->outcnt, s->out + s->outcnt - dist, len);
+                    s->outcnt += len;
+                }
+                else
+#endif
                 while (len--) {
                     s->out[s->outcnt] =
 #ifdef INFLATE_ALLOW_INVALID_DISTANCE_TOOFAR_ARRR
@@ -542,6 +622,7 @@ local int fixed(struct state *s)
     static int virgin = 1;
     static short lencnt[MAXBITS+1], lensym[FIXLCODES];
     static short distcnt[MAXBITS+1], distsym[MAXDCODES];
+    static short lenfast[1 << FASTBITS], distfast[1 << FASTBITS];
     static struct huffman lencode, distcode;
 
     /* build fixed huffman tables if first call (may not be thread safe) */
@@ -552,8 +633,10 @@ local int fixed(struct state *s)
         /* construct lencode and distcode */
         lencode.count = lencnt;
         lencode.symbol = lensym;
+        lencode.fast = lenfast;
         distcode.count = distcnt;
         distcode.symbol = distsym;
+        distcode.fast = distfast;
 
         /* literal/length table */
         for (symbol = 0; symbol < 144; symbol++)
@@ -674,6 +757,7 @@ local int dynamic(struct state *s)
     short lengths[MAXCODES];            /* descriptor code lengths */
     short lencnt[MAXBITS+1], lensym[MAXLCODES];         /* lencode memory */
     short distcnt[MAXBITS+1], distsym[MAXDCODES];       /* distcode memory */
+    short lenfast[1 << FASTBITS], distfast[1 << FASTBITS];  /* fast lookups */
     struct huffman lencode, distcode;   /* length and distance codes */
     static const short order[19] =      /* permutation of code length codes */
         {16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15};
@@ -681,8 +765,10 @@ local int dynamic(struct state *s)
     /* construct lencode and distcode */
     lencode.count = lencnt;
     lencode.symbol = lensym;
+    lencode.fast = lenfast;
     distcode.count = distcnt;
     distcode.symbol = distsym;
+    distcode.fast = distfast;
 
     /* get number of lengths in each table, check lengths */
     nlen = bits(s, 5) + 257;
@@ -764,8 +850,9 @@ local int dynamic(struct state *s)
  *
  * puff() also has a mode to determine the size of the uncompressed output with
  * no output written.  For this dest must be (unsigned char *)0.  In this case,
- * the input value of *destlen is ignored, and on return *destlen is set to the
- * size of the uncompressed output.
+ * the input value of *destlen is the largest size to scan for (1 is returned
+ * if the output would be larger), and on return *destlen is set to the size
+ * of the uncompressed output.
  *
  * The return codes are:
  *
@@ -805,7 +892,7 @@ int puff(unsigned char *dest,           /* pointer to destination pointer */
 
     /* initialize output state */
     s.out = dest;
-    s.outlen = *destlen;                /* ignored if dest is NIL */
+    s.outlen = *destlen;                /* also limits scanning if dest is NIL */
     s.outcnt = 0;
 
     /* initialize input state */
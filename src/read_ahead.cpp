@@ -0,0 +1,108 @@
+/*
+
+Copyright (c) 2017, Arvid Norberg
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions
+are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in
+      the documentation and/or other materials provided with the distribution.
+    * Neither the name of the author nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+
+#include "libtorrent/aux_/read_ahead.hpp"
+
+#include <algorithm>
+#include <limits>
+
+namespace libtorrent { namespace aux {
+
+	read_ahead_tracker::stream const& read_ahead_tracker::slot(void const* requester) const
+	{
+		std::uintptr_t const h = reinterpret_cast<std::uintptr_t>(requester);
+		return m_streams[((h >> 4) ^ (h >> 12)) % m_streams.size()];
+	}
+
+	read_ahead_tracker::stream& read_ahead_tracker::slot(void const* requester)
+	{
+		return const_cast<stream&>(
+			static_cast<read_ahead_tracker const*>(this)->slot(requester));
+	}
+
+	void read_ahead_tracker::record(void const* const requester
+		, storage_index_t const storage, piece_index_t const piece, int const block)
+	{
+		if (requester == nullptr) return;
+
+		stream& s = slot(requester);
+		if (s.requester != requester)
+		{
+			// either the first request from this requester, or it collided
+			// with another one. Either way, start over
+			s = stream();
+			s.requester = requester;
+			s.storage = storage;
+			s.piece = piece;
+			s.block = block;
+			return;
+		}
+
+		// peers pipeline requests and may not receive them in order. Anything
+		// moving forward a few blocks at a time within the piece, or starting
+		// at the beginning of the next piece, is considered sequential
+		bool const sequential = s.storage == storage
+			&& ((s.piece == piece && block > s.block && block - s.block <= 4)
+				|| (next(s.piece) == piece && block < 4));
+
+		if (sequential)
+		{
+			++s.sequential;
+			s.random = 0;
+		}
+		else if (!(s.storage == storage && s.piece == piece && s.block == block))
+		{
+			s.sequential = 0;
+			++s.random;
+		}
+		s.storage = storage;
+		s.piece = piece;
+		s.block = block;
+	}
+
+	int read_ahead_tracker::read_ahead(void const* const requester, int const line_size) const
+	{
+		if (requester == nullptr || line_size >= (std::numeric_limits<int>::max() >> 3))
+			return line_size;
+
+		stream const& s = slot(requester);
+		if (s.requester != requester) return line_size;
+
+		if (s.random >= 3) return 1;
+
+		// double the read-ahead for every 16 sequential requests, up to 8
+		// times the line size
+		int const shift = std::min(s.sequential / 16, 3);
+		return line_size << shift;
+	}
+}}
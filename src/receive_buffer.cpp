@@ -150,6 +150,23 @@ span<char const> receive_buffer::get() const
 	return aux::typed_span<char const>(m_recv_buffer).subspan(m_recv_start, m_recv_pos);
 }
 
+span<char const> receive_buffer::unconsumed() const
+{
+	if (m_recv_buffer.empty()) return span<char const>();
+	int const start = m_recv_start + m_recv_pos;
+	TORRENT_ASSERT(start <= m_recv_end);
+	return aux::typed_span<char const>(m_recv_buffer).subspan(start, m_recv_end - start);
+}
+
+void receive_buffer::skip(int const size)
+{
+	INVARIANT_CHECK;
+	TORRENT_ASSERT(m_recv_pos == 0);
+	TORRENT_ASSERT(size >= 0);
+	TORRENT_ASSERT(m_recv_start + size <= m_recv_end);
+	m_recv_start += size;
+}
+
 #if !defined(TORRENT_DISABLE_ENCRYPTION) && !defined(TORRENT_DISABLE_EXTENSIONS)
 span<char> receive_buffer::mutable_buffer()
 {
@@ -0,0 +1,100 @@
+/*
+
+Copyright (c) 2017, Arvid Norberg
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions
+are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in
+      the documentation and/or other materials provided with the distribution.
+    * Neither the name of the author nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+
+#include "libtorrent/aux_/recent_endpoints.hpp"
+
+namespace libtorrent { namespace aux {
+
+namespace {
+
+	// the bloom filter only looks at the first 4 bytes of the key, they need
+	// to depend on every bit of the endpoint
+	sha1_hash endpoint_key(tcp::endpoint const& ep, std::uint32_t const tag)
+	{
+		std::uint64_t h = 0xcbf29ce484222325ULL;
+		auto mix = [&h](std::uint64_t const v)
+		{
+			h ^= v;
+			h *= 0x100000001b3ULL;
+			h ^= h >> 29;
+		};
+
+		address const& a = ep.address();
+#if TORRENT_USE_IPV6
+		if (a.is_v6())
+		{
+			address_v6::bytes_type const b = a.to_v6().to_bytes();
+			for (auto const c : b) mix(c);
+		}
+		else
+#endif
+		{
+			mix(a.to_v4().to_ulong());
+		}
+		mix((std::uint64_t(ep.port()) << 32) | tag);
+
+		h = (h ^ (h >> 30)) * 0xbf58476d1ce4e5b9ULL;
+		h = (h ^ (h >> 27)) * 0x94d049bb133111ebULL;
+		h ^= h >> 31;
+
+		sha1_hash ret;
+		for (int i = 0; i < 4; ++i)
+			ret[std::size_t(i)] = std::uint8_t(h >> (i * 8));
+		return ret;
+	}
+}
+
+	bool recent_endpoints::insert(tcp::endpoint const& ep, std::uint32_t const tag)
+	{
+		sha1_hash const k = endpoint_key(ep, tag);
+		if (m_filter[0].find(k) || m_filter[1].find(k)) return true;
+
+		if (m_inserted == rotate_interval)
+		{
+			m_current ^= 1;
+			m_filter[m_current].clear();
+			m_inserted = 0;
+		}
+		m_filter[m_current].set(k);
+		++m_inserted;
+		return false;
+	}
+
+	void recent_endpoints::clear()
+	{
+		m_filter[0].clear();
+		m_filter[1].clear();
+		m_current = 0;
+		m_inserted = 0;
+	}
+}}
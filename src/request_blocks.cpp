@@ -39,8 +39,10 @@ POSSIBILITY OF SUCH DAMAGE.
 #include "libtorrent/request_blocks.hpp"
 #include "libtorrent/alert_manager.hpp"
 #include "libtorrent/aux_/has_block.hpp"
+#include "libtorrent/aux_/trace.hpp"
 
 #include <vector>
+#include <algorithm>
 
 namespace libtorrent {
 
@@ -112,13 +114,26 @@ namespace libtorrent {
 		interesting_pieces.reserve(100);
 
 		int prefer_contiguous_blocks = c.prefer_contiguous_blocks();
+		int picker_options = c.picker_options();
 
 		if (prefer_contiguous_blocks == 0 && !time_critical_mode)
 		{
-			int blocks_per_piece = t.torrent_file().piece_length() / t.block_size();
-			prefer_contiguous_blocks = c.statistics().download_payload_rate()
-				* t.settings().get_int(settings_pack::whole_pieces_threshold)
-				> t.torrent_file().piece_length() ? blocks_per_piece : 0;
+			int const blocks_per_piece = t.torrent_file().piece_length() / t.block_size();
+			std::int64_t const threshold_bytes = std::int64_t(c.statistics().download_payload_rate())
+				* t.settings().get_int(settings_pack::whole_pieces_threshold);
+			if (threshold_bytes > t.torrent_file().piece_length())
+			{
+				// peers fast enough to download several pieces within the
+				// threshold are assigned an extent of that many contiguous
+				// pieces, aligned to a multiple of its size. This keeps the
+				// number of partial pieces down and lets the pieces be flushed
+				// and hashed as they complete
+				int const extent = std::max(1, std::min(
+					int(threshold_bytes / t.torrent_file().piece_length())
+					, t.settings().get_int(settings_pack::whole_pieces_extent)));
+				prefer_contiguous_blocks = blocks_per_piece * extent;
+				if (extent > 1) picker_options |= piece_picker::align_expanded_pieces;
+			}
 		}
 
 		// if we prefer whole pieces, the piece picker will pick at least
@@ -135,7 +150,35 @@ namespace libtorrent {
 		std::vector<pending_block> const& dq = c.download_queue();
 		std::vector<pending_block> const& rq = c.request_queue();
 
-		std::vector<piece_index_t> const& suggested = c.suggested_pieces();
+		std::vector<piece_index_t> const* suggested = &c.suggested_pieces();
+
+		// pieces in the streaming window are picked first, rarest first among
+		// themselves. They are passed to the picker ahead of the suggested
+		// pieces
+		std::vector<piece_index_t> window_pieces;
+		piece_index_t window_begin, window_end;
+		std::tie(window_begin, window_end) = t.stream_window();
+		if (window_begin < window_end)
+		{
+			for (piece_index_t i = window_begin; i < window_end; ++i)
+			{
+				if (!c.get_bitfield()[i] || p.have_piece(i)
+					|| p.piece_priority(i) == 0) continue;
+				window_pieces.push_back(i);
+			}
+			std::stable_sort(window_pieces.begin(), window_pieces.end()
+				, [&p](piece_index_t const lhs, piece_index_t const rhs)
+				{ return p.get_availability(lhs) < p.get_availability(rhs); });
+			if (!window_pieces.empty())
+			{
+				for (piece_index_t const i : *suggested)
+				{
+					if (i >= window_begin && i < window_end) continue;
+					window_pieces.push_back(i);
+				}
+				suggested = &window_pieces;
+			}
+		}
 		auto const* bits = &c.get_bitfield();
 		typed_bitfield<piece_index_t> fast_mask;
 
@@ -164,11 +207,13 @@ namespace libtorrent {
 		// then use this mode.
 		std::uint32_t const flags = p.pick_pieces(*bits, interesting_pieces
 			, num_requests, prefer_contiguous_blocks, c.peer_info_struct()
-			, c.picker_options(), suggested, t.num_peers()
+			, picker_options, *suggested, t.num_peers()
 			, ses.stats_counters());
 
+		aux::trace(aux::trace_event::piece_pick, interesting_pieces.size(), flags);
+
 #ifndef TORRENT_DISABLE_LOGGING
-		if (t.alerts().should_post<picker_log_alert>()
+		if (c.should_post<picker_log_alert>()
 			&& !interesting_pieces.empty())
 		{
 			t.alerts().emplace_alert<picker_log_alert>(t.get_handle(), c.remote()
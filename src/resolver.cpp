@@ -42,30 +42,59 @@ namespace libtorrent {
 		, m_critical_resolver(ios)
 		, m_max_size(700)
 		, m_timeout(seconds(1200))
+		, m_negative_timeout(seconds(60))
 	{}
 
 	void resolver::on_lookup(error_code const& ec, tcp::resolver::iterator i
-		, resolver_interface::callback_t h, std::string hostname)
+		, std::string hostname, bool critical)
 	{
 		COMPLETE_ASYNC("resolver::on_lookup");
-		if (ec)
+
+		auto& pending = critical ? m_critical_pending : m_pending;
+		std::vector<callback_t> handlers;
+		auto const p = pending.find(hostname);
+		if (p != pending.end())
+		{
+			handlers = std::move(p->second);
+			pending.erase(p);
+		}
+
+		if (ec == boost::asio::error::operation_aborted)
 		{
 			std::vector<address> empty;
-			h(ec, empty);
+			for (auto const& h : handlers) h(ec, empty);
 			return;
 		}
 
 		dns_cache_entry& ce = m_cache[hostname];
-		time_point now = aux::time_now();
-		ce.last_seen = now;
-		ce.addresses.clear();
-		while (i != tcp::resolver::iterator())
+		time_point const now = aux::time_now();
+		if (ec)
 		{
-			ce.addresses.push_back(i->endpoint().address());
-			++i;
+			// if this was a refresh of a host we had addresses for, keep
+			// using those rather than failing lookups that would have
+			// succeeded from the cache. Try again once they expire
+			if (ce.addresses.empty() || ce.error)
+			{
+				ce.error = ec;
+				ce.last_seen = now;
+			}
+		}
+		else
+		{
+			ce.last_seen = now;
+			ce.error.clear();
+			ce.addresses.clear();
+			while (i != tcp::resolver::iterator())
+			{
+				ce.addresses.push_back(i->endpoint().address());
+				++i;
+			}
 		}
 
-		h(ec, ce.addresses);
+		// copy the result, in case a handler ends up evicting the entry
+		error_code const result = ce.error;
+		std::vector<address> const addresses = ce.addresses;
+		for (auto const& h : handlers) h(result, addresses);
 
 		// if m_cache grows too big, weed out the
 		// oldest entries
@@ -89,12 +118,32 @@ namespace libtorrent {
 		auto const i = m_cache.find(host);
 		if (i != m_cache.end())
 		{
+			dns_cache_entry const& ce = i->second;
+			time_point const now = aux::time_now();
+
+			// failed lookups are cached for a short while, to not send a
+			// query for every request to a host that doesn't resolve
+			if (ce.error)
+			{
+				if (ce.last_seen + m_negative_timeout >= now)
+				{
+					m_ios.post(std::bind(h, ce.error, std::vector<address>()));
+					return;
+				}
+			}
 			// keep cache entries valid for m_timeout seconds
-			if ((flags & resolver_interface::prefer_cache)
-				|| i->second.last_seen + m_timeout >= aux::time_now())
+			else if ((flags & resolver_interface::prefer_cache)
+				|| ce.last_seen + m_timeout >= now)
 			{
 				error_code ec;
-				m_ios.post(std::bind(h, ec, i->second.addresses));
+				m_ios.post(std::bind(h, ec, ce.addresses));
+
+				// once an entry is three quarters of the way to expiring,
+				// refresh it in the background. Hosts that are looked up
+				// regularly, like trackers, then never have to wait for a
+				// DNS query
+				if (ce.last_seen + m_timeout * 3 / 4 < now)
+					start_lookup(host, false, callback_t());
 				return;
 			}
 		}
@@ -111,20 +160,37 @@ namespace libtorrent {
 			return;
 		}
 
+		start_lookup(host, (flags & resolver_interface::abort_on_shutdown) == 0, h);
+	}
+
+	void resolver::start_lookup(std::string const& host, bool const critical
+		, resolver_interface::callback_t const& h)
+	{
+		auto& pending = critical ? m_critical_pending : m_pending;
+		auto const i = pending.find(host);
+		if (i != pending.end())
+		{
+			if (h) i->second.push_back(h);
+			return;
+		}
+
+		std::vector<callback_t>& handlers = pending[host];
+		if (h) handlers.push_back(h);
+
 		// the port is ignored
 		tcp::resolver::query const q(host, "80");
 
 		using namespace std::placeholders;
 		ADD_OUTSTANDING_ASYNC("resolver::on_lookup");
-		if (flags & resolver_interface::abort_on_shutdown)
+		if (critical)
 		{
-			m_resolver.async_resolve(q, std::bind(&resolver::on_lookup, this, _1, _2
-				, h, host));
+			m_critical_resolver.async_resolve(q, std::bind(&resolver::on_lookup, this, _1, _2
+				, host, true));
 		}
 		else
 		{
-			m_critical_resolver.async_resolve(q, std::bind(&resolver::on_lookup, this, _1, _2
-				, h, host));
+			m_resolver.async_resolve(q, std::bind(&resolver::on_lookup, this, _1, _2
+				, host, false));
 		}
 	}
 
@@ -0,0 +1,275 @@
+/*
+
+Copyright (c) 2017, Arvid Norberg
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions
+are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in
+      the documentation and/or other materials provided with the distribution.
+    * Neither the name of the author nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+
+#include "libtorrent/resume_data_store.hpp"
+#include "libtorrent/write_resume_data.hpp"
+#include "libtorrent/add_torrent_params.hpp"
+#include "libtorrent/torrent_info.hpp"
+#include "libtorrent/aux_/path.hpp"
+#include "libtorrent/io.hpp"
+#include "libtorrent/assert.hpp"
+
+#include "libtorrent/aux_/disable_warnings_push.hpp"
+#include <boost/crc.hpp>
+#include "libtorrent/aux_/disable_warnings_pop.hpp"
+
+#include <cstring> // for memcpy
+
+namespace libtorrent {
+
+namespace {
+
+	// "LTRD"
+	std::uint32_t const record_magic = 0x4c545244;
+
+	std::uint32_t payload_crc(span<char const> buf)
+	{
+		boost::crc_32_type crc;
+		crc.process_bytes(buf.data(), std::size_t(buf.size()));
+		return crc.checksum();
+	}
+
+	void write_header(char* ptr, sha1_hash const& ih, std::uint32_t const size
+		, std::uint32_t const crc)
+	{
+		using namespace libtorrent::detail;
+		write_uint32(record_magic, ptr);
+		write_uint32(size, ptr);
+		write_uint32(crc, ptr);
+		std::memcpy(ptr, ih.data(), ih.size());
+	}
+}
+
+	resume_data_store::resume_data_store() = default;
+	resume_data_store::~resume_data_store() = default;
+
+	void resume_data_store::open(std::string const& path, error_code& ec)
+	{
+		close();
+		m_path = path;
+		m_file.open(path, file::read_write, ec);
+		if (ec) return;
+
+		std::int64_t const size = m_file.get_size(ec);
+		if (ec) return;
+
+		char header[header_size];
+		iovec_t b = {header, std::size_t(header_size)};
+		std::int64_t offset = 0;
+		while (offset + header_size <= size)
+		{
+			std::int64_t const n = m_file.readv(offset, b, ec);
+			if (ec) return;
+			if (n < header_size) break;
+
+			using namespace libtorrent::detail;
+			char const* ptr = header;
+			if (read_uint32(ptr) != record_magic) break;
+			std::uint32_t const payload_size = read_uint32(ptr);
+			std::uint32_t const crc = read_uint32(ptr);
+			sha1_hash const ih(ptr);
+
+			std::int64_t const record_size = header_size + payload_size;
+			// the last record was not completely written
+			if (offset + record_size > size) break;
+
+			auto const i = m_index.find(ih);
+			if (i != m_index.end())
+			{
+				m_garbage += header_size + i->second.size;
+				m_index.erase(i);
+			}
+
+			if (payload_size == 0)
+				m_garbage += header_size;
+			else
+				m_index[ih] = record_t{offset, payload_size, crc};
+
+			offset += record_size;
+		}
+
+		m_end = offset;
+
+		// drop anything following the last valid record, so that new records
+		// are appended to a well-formed file
+		if (offset < size) m_file.set_size(offset, ec);
+	}
+
+	void resume_data_store::close()
+	{
+		m_file.close();
+		m_index.clear();
+		m_end = 0;
+		m_garbage = 0;
+	}
+
+	void resume_data_store::append(sha1_hash const& ih, span<char const> buf
+		, error_code& ec)
+	{
+		TORRENT_ASSERT(m_file.is_open());
+
+		std::uint32_t const size = std::uint32_t(buf.size());
+		std::uint32_t const crc = size == 0 ? 0 : payload_crc(buf);
+		char header[header_size];
+		write_header(header, ih, size, crc);
+
+		iovec_t const bufs[2] = {
+			{header, std::size_t(header_size)},
+			{const_cast<char*>(buf.data()), std::size_t(buf.size())}};
+		span<iovec_t const> v = bufs;
+		if (buf.empty()) v = v.first(1);
+
+		std::int64_t const n = m_file.writev(m_end, v, ec);
+		if (ec) return;
+		if (n != header_size + std::int64_t(size))
+		{
+			ec = errors::file_too_short;
+			// make sure the next record overwrites this partial one
+			m_file.set_size(m_end, ec);
+			ec = errors::file_too_short;
+			return;
+		}
+
+		auto const i = m_index.find(ih);
+		if (i != m_index.end())
+		{
+			m_garbage += header_size + i->second.size;
+			m_index.erase(i);
+		}
+
+		if (size == 0)
+			m_garbage += header_size;
+		else
+			m_index[ih] = record_t{m_end, size, crc};
+
+		m_end += header_size + size;
+	}
+
+	void resume_data_store::save(sha1_hash const& ih, span<char const> buf
+		, error_code& ec)
+	{
+		TORRENT_ASSERT(!buf.empty());
+		if (buf.empty())
+		{
+			ec = errors::invalid_entry_type;
+			return;
+		}
+		append(ih, buf, ec);
+	}
+
+	void resume_data_store::save(add_torrent_params const& atp, error_code& ec)
+	{
+		sha1_hash const ih = atp.ti ? atp.ti->info_hash() : atp.info_hash;
+		std::vector<char> const buf = write_resume_data_buf(atp);
+		save(ih, buf, ec);
+	}
+
+	void resume_data_store::remove(sha1_hash const& ih, error_code& ec)
+	{
+		if (m_index.count(ih) == 0) return;
+		append(ih, span<char const>(), ec);
+	}
+
+	bool resume_data_store::read_record(record_t const& r
+		, std::vector<char>& buf, error_code& ec)
+	{
+		buf.resize(r.size);
+		iovec_t b = {buf.data(), buf.size()};
+		std::int64_t const n = m_file.readv(r.offset + header_size, b, ec);
+		if (ec) return false;
+		if (n != r.size)
+		{
+			ec = errors::file_too_short;
+			return false;
+		}
+		if (payload_crc(buf) != r.crc)
+		{
+			ec = errors::invalid_file_tag;
+			return false;
+		}
+		return true;
+	}
+
+	bool resume_data_store::load(sha1_hash const& ih, std::vector<char>& buf
+		, error_code& ec)
+	{
+		auto const i = m_index.find(ih);
+		if (i == m_index.end()) return false;
+		return read_record(i->second, buf, ec);
+	}
+
+	std::vector<sha1_hash> resume_data_store::torrents() const
+	{
+		std::vector<sha1_hash> ret;
+		ret.reserve(m_index.size());
+		for (auto const& r : m_index) ret.push_back(r.first);
+		return ret;
+	}
+
+	void resume_data_store::compact(error_code& ec)
+	{
+		TORRENT_ASSERT(m_file.is_open());
+		if (m_garbage == 0) return;
+
+		std::string const tmp_path = m_path + ".tmp";
+		{
+			// a left-over from an interrupted compaction
+			error_code ignore;
+			libtorrent::remove(tmp_path, ignore);
+		}
+		resume_data_store tmp;
+		tmp.open(tmp_path, ec);
+		if (ec) return;
+
+		std::vector<char> buf;
+		for (auto const& r : m_index)
+		{
+			if (!read_record(r.second, buf, ec)) return;
+			tmp.append(r.first, buf, ec);
+			if (ec) return;
+		}
+		tmp.close();
+
+		std::string const path = m_path;
+		close();
+		rename(tmp_path, path, ec);
+		if (ec)
+		{
+			// the original file is still in place, keep using it
+			error_code ignore;
+			open(path, ignore);
+			return;
+		}
+		open(path, ec);
+	}
+}
@@ -308,6 +308,9 @@ namespace libtorrent {
 		m_impl = std::make_shared<aux::session_impl>(*ios);
 		*static_cast<session_handle*>(this) = session_handle(m_impl.get());
 
+		if (params.thread_init)
+			m_impl->set_thread_init(params.thread_init);
+
 #ifndef TORRENT_DISABLE_EXTENSIONS
 		for (auto const& ext : params.extensions)
 		{
@@ -326,8 +329,9 @@ namespace libtorrent {
 		if (internal_executor)
 		{
 			// start a thread for the message pump
+			std::function<void(char const*)> const init = std::move(params.thread_init);
 			m_thread = std::make_shared<std::thread>(
-				[&] { m_io_service->run(); });
+				[this, init] { if (init) init("network"); m_io_service->run(); });
 		}
 	}
 
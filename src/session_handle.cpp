@@ -54,8 +54,10 @@ namespace libtorrent {
 	template <typename Fun, typename... Args>
 	void session_handle::async_call(Fun f, Args&&... a) const
 	{
+		time_point const queued = clock_type::now();
 		m_impl->get_io_service().dispatch([=]() mutable
 		{
+			aux::handler_timer const timer(*m_impl, network_stall_alert::session_call, queued);
 #ifndef BOOST_NO_EXCEPTIONS
 			try {
 #endif
@@ -81,8 +83,10 @@ namespace libtorrent {
 		bool done = false;
 
 		std::exception_ptr ex;
+		time_point const queued = clock_type::now();
 		m_impl->get_io_service().dispatch([=, &done, &ex]() mutable
 		{
+			aux::handler_timer const timer(*m_impl, network_stall_alert::session_call, queued);
 #ifndef BOOST_NO_EXCEPTIONS
 			try {
 #endif
@@ -110,8 +114,10 @@ namespace libtorrent {
 		bool done = false;
 		Ret r;
 		std::exception_ptr ex;
+		time_point const queued = clock_type::now();
 		m_impl->get_io_service().dispatch([=, &r, &done, &ex]() mutable
 		{
+			aux::handler_timer const timer(*m_impl, network_stall_alert::session_call, queued);
 #ifndef BOOST_NO_EXCEPTIONS
 			try {
 #endif
@@ -163,11 +169,22 @@ namespace libtorrent {
 		async_call(&session_impl::post_torrent_updates, flags);
 	}
 
+	void session_handle::post_torrent_status(std::vector<torrent_handle> handles
+		, std::uint32_t const flags)
+	{
+		async_call(&session_impl::post_torrent_status, std::move(handles), flags);
+	}
+
 	void session_handle::post_session_stats()
 	{
 		async_call(&session_impl::post_session_stats);
 	}
 
+	void session_handle::post_session_stats_delta()
+	{
+		async_call(&session_impl::post_session_stats_delta);
+	}
+
 	void session_handle::post_dht_stats()
 	{
 		async_call(&session_impl::post_dht_stats);
@@ -359,6 +376,22 @@ namespace {
 		async_call(&session_impl::async_add_torrent, p);
 	}
 
+	void session_handle::async_add_torrents(std::vector<add_torrent_params> params)
+	{
+		// see async_add_torrent() for why this is a raw pointer
+		auto* p = new std::vector<add_torrent_params>(std::move(params));
+		for (auto& atp : *p)
+		{
+			TORRENT_ASSERT_PRECOND(!atp.save_path.empty());
+			atp.save_path = complete(atp.save_path);
+#ifndef TORRENT_NO_DEPRECATE
+			handle_backwards_compatible_resume_data(atp);
+#endif
+		}
+
+		async_call(&session_impl::async_add_torrents, p);
+	}
+
 #ifndef BOOST_NO_EXCEPTIONS
 #ifndef TORRENT_NO_DEPRECATE
 	// if the torrent already exists, this will throw duplicate_torrent
@@ -584,6 +617,15 @@ namespace {
 #endif
 	}
 
+	void session_handle::dht_put_items(std::vector<dht_mutable_put> items)
+	{
+#ifndef TORRENT_DISABLE_DHT
+		async_call(&session_impl::dht_put_items, std::move(items));
+#else
+		TORRENT_UNUSED(items);
+#endif
+	}
+
 	void session_handle::dht_get_peers(sha1_hash const& info_hash)
 	{
 #ifndef TORRENT_DISABLE_DHT
@@ -613,6 +655,15 @@ namespace {
 #endif
 	}
 
+	void session_handle::dht_sample_infohashes(sha1_hash const& target)
+	{
+#ifndef TORRENT_DISABLE_DHT
+		async_call(&session_impl::dht_sample_infohashes, target);
+#else
+		TORRENT_UNUSED(target);
+#endif
+	}
+
 	void session_handle::dht_direct_request(udp::endpoint const& ep, entry const& e, void* userdata)
 	{
 #ifndef TORRENT_DISABLE_DHT
@@ -39,6 +39,8 @@ POSSIBILITY OF SUCH DAMAGE.
 #include <cinttypes> // for PRId64 et.al.
 #include <functional>
 #include <type_traits>
+#include <array>
+#include <cstring> // for memcmp
 
 #if TORRENT_USE_INVARIANT_CHECKS
 #include <unordered_set>
@@ -58,6 +60,7 @@ POSSIBILITY OF SUCH DAMAGE.
 #include "libtorrent/session.hpp"
 #include "libtorrent/fingerprint.hpp"
 #include "libtorrent/alert_types.hpp"
+#include "libtorrent/session_stats.hpp" // for encode_session_stats_delta
 #include "libtorrent/invariant_check.hpp"
 #include "libtorrent/bt_peer_connection.hpp"
 #include "libtorrent/peer_connection_handle.hpp"
@@ -447,18 +450,21 @@ namespace aux {
 #endif
 		, m_utp_socket_manager(
 			std::bind(&session_impl::send_udp_packet, this, false, _1, _2, _3, _4)
+			, std::bind(&session_impl::flush_udp_batches, this, false)
 			, std::bind(&session_impl::incoming_connection, this, _1)
 			, m_io_service
 			, m_settings, m_stats_counters, nullptr)
 #ifdef TORRENT_USE_OPENSSL
 		, m_ssl_utp_socket_manager(
 			std::bind(&session_impl::send_udp_packet, this, true, _1, _2, _3, _4)
+			, std::bind(&session_impl::flush_udp_batches, this, true)
 			, std::bind(&session_impl::on_incoming_utp_ssl, this, _1)
 			, m_io_service
 			, m_settings, m_stats_counters
 			, &m_ssl_ctx)
 #endif
 		, m_timer(m_io_service)
+		, m_timers(std::make_shared<aux::timer_service>(m_io_service))
 		, m_lsd_announce_timer(m_io_service)
 		, m_close_file_timer(m_io_service)
 	{
@@ -486,6 +492,12 @@ namespace aux {
 	}
 #endif
 
+	void session_impl::set_thread_init(std::function<void(char const*)> f)
+	{
+		m_disk_thread.set_thread_init(f);
+		m_thread_init = std::move(f);
+	}
+
 	// This function is called by the creating thread, not in the message loop's
 	// io_service thread.
 	// TODO: 2 is there a reason not to move all of this into init()? and just
@@ -926,6 +938,13 @@ namespace aux {
 		}
 		m_incoming_sockets.clear();
 
+		for (auto const& s : m_pending_handshakes)
+		{
+			s.first->close(ec);
+			TORRENT_ASSERT(!ec);
+		}
+		m_pending_handshakes.clear();
+
 		// close the listen sockets
 		for (auto const& l : m_listen_sockets)
 		{
@@ -934,6 +953,11 @@ namespace aux {
 				l.sock->close(ec);
 				TORRENT_ASSERT(!ec);
 			}
+			for (auto const& a : l.extra_socks)
+			{
+				a->close(ec);
+				TORRENT_ASSERT(!ec);
+			}
 
 			// TODO: 3 closing the udp sockets here means that
 			// the uTP connections cannot be closed gracefully
@@ -961,6 +985,7 @@ namespace aux {
 			te.second->abort();
 		}
 		m_torrents.clear();
+		m_timers->abort();
 
 #ifndef TORRENT_DISABLE_LOGGING
 		session_log(" aborting all tracker requests");
@@ -1032,6 +1057,7 @@ namespace aux {
 		INVARIANT_CHECK;
 
 		m_ip_filter = f;
+		if (m_ip_filter) m_ip_filter->compile();
 
 		// Close connections whose endpoint is filtered
 		// by the new ip-filter
@@ -1044,6 +1070,7 @@ namespace aux {
 		TORRENT_ASSERT(is_single_thread());
 		if (!m_ip_filter) m_ip_filter = std::make_shared<ip_filter>();
 		m_ip_filter->add_rule(addr, addr, ip_filter::blocked);
+		m_ip_filter->compile();
 		for (auto& i : m_torrents)
 			i.second->set_ip_filter(m_ip_filter);
 	}
@@ -1138,6 +1165,8 @@ namespace {
 			ret.connection_limit_factor = 0xf0f0f0f;
 			ret.upload_priority = 0xf0f0f0f;
 			ret.download_priority = 0xf0f0f0f;
+			ret.utp_cubic = false;
+			ret.alert_mask = 0;
 #endif
 			return ret;
 		}
@@ -1180,12 +1209,14 @@ namespace {
 		if (pc == nullptr) return;
 
 		pc->set_info(&pci);
+		update_extra_alert_mask();
 	}
 
 	void session_impl::set_peer_class_filter(ip_filter const& f)
 	{
 		INVARIANT_CHECK;
 		m_peer_class_filter = f;
+		m_peer_class_filter.compile();
 	}
 
 	ip_filter const& session_impl::get_peer_class_filter() const
@@ -1238,6 +1269,46 @@ namespace {
 		return false;
 	}
 
+	bool session_impl::utp_cubic_set(peer_class_set const& set) const
+	{
+		int num = set.num_classes();
+		for (int i = 0; i < num; ++i)
+		{
+			peer_class const* pc = m_classes.at(set.class_at(i));
+			if (pc == nullptr) continue;
+			if (pc->utp_cubic) return true;
+		}
+		return false;
+	}
+
+	std::uint32_t session_impl::peer_class_alert_mask(peer_class_set const& set) const
+	{
+		std::uint32_t ret = 0;
+		int num = set.num_classes();
+		for (int i = 0; i < num; ++i)
+		{
+			peer_class const* pc = m_classes.at(set.class_at(i));
+			if (pc == nullptr) continue;
+			ret |= pc->alert_mask;
+		}
+		return ret;
+	}
+
+	void session_impl::update_extra_alert_mask()
+	{
+		std::uint32_t mask = 0;
+		for (auto const& t : m_torrents)
+			mask |= t.second->alert_mask();
+
+		for (peer_class_t i{0}; i < m_classes.end_index(); ++i)
+		{
+			peer_class const* pc = m_classes.at(i);
+			if (pc == nullptr) continue;
+			mask |= pc->alert_mask;
+		}
+		m_extra_alert_mask = mask;
+	}
+
 	bandwidth_manager* session_impl::get_bandwidth_manager(int channel)
 	{
 		return (channel == peer_connection::download_channel)
@@ -1263,26 +1334,6 @@ namespace {
 	// is considered pertinent and copied
 	// returns the number of pointers copied
 	// channel is upload_channel or download_channel
-	int session_impl::copy_pertinent_channels(peer_class_set const& set
-		, int channel, bandwidth_channel** dst, int max)
-	{
-		int num_channels = set.num_classes();
-		int num_copied = 0;
-		for (int i = 0; i < num_channels; ++i)
-		{
-			peer_class* pc = m_classes.at(set.class_at(i));
-			TORRENT_ASSERT(pc);
-			if (pc == nullptr) continue;
-			bandwidth_channel* chan = &pc->channel[channel];
-			// no need to include channels that don't have any bandwidth limits
-			if (chan->throttle() == 0) continue;
-			dst[num_copied] = chan;
-			++num_copied;
-			if (num_copied == max) break;
-		}
-		return num_copied;
-	}
-
 	bool session_impl::use_quota_overhead(bandwidth_channel* ch, int amount)
 	{
 		ch->use_quota(amount);
@@ -1474,6 +1525,23 @@ namespace {
 #endif // TORRENT_DISABLE_LOGGING
 			}
 
+#ifdef TORRENT_HAS_REUSEPORT
+			if (m_settings.get_int(settings_pack::listen_acceptors) > 1)
+			{
+				// this is best-effort. If it fails, the additional acceptors
+				// will fail to bind
+				error_code err;
+				ret.sock->set_option(reuse_port(true), err);
+#ifndef TORRENT_DISABLE_LOGGING
+				if (err && should_log())
+				{
+					session_log("failed enable reuse-port on listen socket: %s"
+						, err.message().c_str());
+				}
+#endif // TORRENT_DISABLE_LOGGING
+			}
+#endif // TORRENT_HAS_REUSEPORT
+
 #if TORRENT_USE_IPV6
 			if (bind_ep.address().is_v6())
 			{
@@ -1626,6 +1694,44 @@ namespace {
 				}
 				return ret;
 			}
+
+#ifdef TORRENT_HAS_REUSEPORT
+			// open the additional acceptors on the endpoint we ended up binding
+			// to. Failing to open any of them is not fatal, we'll just have
+			// fewer acceptors
+			int const num_acceptors = m_settings.get_int(settings_pack::listen_acceptors);
+			for (int i = 1; i < num_acceptors; ++i)
+			{
+				auto a = std::make_shared<tcp::acceptor>(m_io_service);
+				error_code err;
+				a->open(ret.local_endpoint.protocol(), err);
+				if (!err) a->set_option(tcp::acceptor::reuse_address(true), err);
+				if (!err) a->set_option(reuse_port(true), err);
+#if TORRENT_USE_IPV6
+				if (!err && ret.local_endpoint.address().is_v6())
+					a->set_option(boost::asio::ip::v6_only(true), err);
+#endif
+#if TORRENT_HAS_BINDTODEVICE
+				if (!err && !device.empty())
+					a->set_option(bind_to_device(device.c_str()), err);
+#endif
+				if (!err) a->bind(ret.local_endpoint, err);
+				if (!err) a->listen(m_settings.get_int(settings_pack::listen_queue_size), err);
+				if (err)
+				{
+#ifndef TORRENT_DISABLE_LOGGING
+					if (should_log())
+					{
+						session_log("failed to open additional acceptor on %s: %s"
+							, print_endpoint(ret.local_endpoint).c_str()
+							, err.message().c_str());
+					}
+#endif
+					break;
+				}
+				ret.extra_socks.push_back(std::move(a));
+			}
+#endif // TORRENT_HAS_REUSEPORT
 		} // force-proxy mode
 
 		socket_type_t const udp_sock_type
@@ -1871,6 +1977,7 @@ namespace {
 			}
 #endif
 			if (remove_iter->sock) remove_iter->sock->close(ec);
+			for (auto const& a : remove_iter->extra_socks) a->close(ec);
 			if (remove_iter->udp_sock) remove_iter->udp_sock->close();
 			remove_iter = m_listen_sockets.erase(remove_iter);
 		}
@@ -1949,6 +2056,7 @@ namespace {
 		for (auto& s : m_listen_sockets)
 		{
 			if (s.sock) async_accept(s.sock, s.ssl);
+			for (auto const& a : s.extra_socks) async_accept(a, s.ssl);
 			remap_ports(remap_natpmp_and_upnp, s);
 		}
 
@@ -2147,6 +2255,27 @@ namespace {
 		ec = boost::asio::error::operation_not_supported;
 	}
 
+	void session_impl::flush_udp_batches(bool const ssl)
+	{
+		for (auto& i : m_listen_sockets)
+		{
+			if (i.ssl != ssl) continue;
+			if (!i.udp_sock || !i.udp_sock->has_queued_packets()) continue;
+
+			error_code ec;
+			i.udp_sock->flush_batch(ec);
+
+			if (i.udp_sock->has_queued_packets() && !i.udp_write_blocked)
+			{
+				// the rest is sent once the socket is writable again
+				i.udp_write_blocked = true;
+				ADD_OUTSTANDING_ASYNC("session_impl::on_udp_writeable");
+				i.udp_sock->async_write(std::bind(&session_impl::on_udp_writeable
+					, this, std::weak_ptr<udp_socket>(i.udp_sock), _1));
+			}
+		}
+	}
+
 	void session_impl::on_udp_writeable(std::weak_ptr<udp_socket> s, error_code const& ec)
 	{
 		COMPLETE_ASYNC("session_impl::on_udp_writeable");
@@ -2163,6 +2292,21 @@ namespace {
 
 		i->udp_write_blocked = false;
 
+		// first send what's left over from the last batch
+		if (i->udp_sock->has_queued_packets())
+		{
+			error_code err;
+			i->udp_sock->flush_batch(err);
+			if (i->udp_sock->has_queued_packets())
+			{
+				i->udp_write_blocked = true;
+				ADD_OUTSTANDING_ASYNC("session_impl::on_udp_writeable");
+				i->udp_sock->async_write(std::bind(&session_impl::on_udp_writeable
+					, this, std::weak_ptr<udp_socket>(i->udp_sock), _1));
+				return;
+			}
+		}
+
 		// notify the utp socket manager it can start sending on the socket again
 		struct utp_socket_manager& mgr =
 #ifdef TORRENT_USE_OPENSSL
@@ -2213,6 +2357,11 @@ namespace {
 #endif
 			m_utp_socket_manager;
 
+		// any uTP packets sent while handling the incoming packets (ACKs,
+		// as well as payload released by them) are queued up and sent in
+		// one go once the socket is drained
+		mgr.start_batch();
+
 		for (;;)
 		{
 			aux::array<udp_socket::packet, 50> p;
@@ -2715,6 +2864,85 @@ namespace {
 			}
 		}
 
+		if (m_settings.get_bool(settings_pack::pre_handshake_check)
+			&& s->get<tcp::socket>() != nullptr)
+		{
+			// wait for the handshake to arrive before committing to a
+			// peer_connection for this socket
+			m_pending_handshakes.insert(std::make_pair(s, aux::time_now()));
+			ADD_OUTSTANDING_ASYNC("session_impl::on_incoming_handshake");
+			s->get<tcp::socket>()->async_read_some(boost::asio::null_buffers()
+				, std::bind(&session_impl::on_incoming_handshake, this, s, limit, _1));
+			return;
+		}
+
+		start_incoming_connection(s, endp, limit);
+	}
+
+	void session_impl::on_incoming_handshake(std::shared_ptr<socket_type> const& s
+		, std::int64_t const limit, error_code const& e)
+	{
+		COMPLETE_ASYNC("session_impl::on_incoming_handshake");
+		TORRENT_ASSERT(is_single_thread());
+
+		// if it's not in the list anymore, it timed out or we're shutting down
+		auto const it = m_pending_handshakes.find(s);
+		if (it == m_pending_handshakes.end()) return;
+		m_pending_handshakes.erase(it);
+		if (e || m_abort) return;
+
+		error_code ec;
+		tcp::endpoint const endp = s->remote_endpoint(ec);
+		if (ec) return;
+
+		// peek at the handshake up to and including the info-hash, leaving it
+		// in the socket for the peer connection to read
+		std::array<char, 48> hs;
+		std::size_t const len = s->get<tcp::socket>()->receive(
+			boost::asio::buffer(hs.data(), hs.size()), tcp::socket::message_peek, ec);
+
+		// the other end closed the connection, or something went wrong
+		if (ec || len == 0) return;
+
+		static char const protocol[] = "\x13" "BitTorrent protocol";
+		if (len == hs.size() && std::memcmp(hs.data(), protocol, 20) == 0)
+		{
+			sha1_hash const info_hash(hs.data() + 28);
+			std::shared_ptr<torrent> const t = find_torrent(info_hash).lock();
+
+			// plugins may load torrents on demand when peers ask for them, so
+			// only reject the connection if there are none
+			if ((!t || t->is_aborted())
+#ifndef TORRENT_DISABLE_EXTENSIONS
+				&& m_ses_extensions[plugins_all_idx].empty()
+#endif
+				)
+			{
+#ifndef TORRENT_DISABLE_LOGGING
+				if (should_log())
+				{
+					session_log(" <== INCOMING CONNECTION [ %s ] rejected, unknown "
+						"info-hash: %s", print_endpoint(endp).c_str()
+						, aux::to_hex(info_hash).c_str());
+				}
+#endif
+#ifndef TORRENT_DISABLE_DHT
+				// see peer_connection::attach_to_torrent()
+				if (dht::verify_secret_id(info_hash))
+					ban_ip(endp.address());
+#endif
+				return;
+			}
+		}
+
+		// an encrypted handshake, or one that hasn't arrived in full yet. Let
+		// the peer connection handle it
+		start_incoming_connection(s, endp, limit);
+	}
+
+	void session_impl::start_incoming_connection(std::shared_ptr<socket_type> const& s
+		, tcp::endpoint const& endp, std::int64_t const limit)
+	{
 		m_stats_counters.inc_stats_counter(counters::incoming_connections);
 
 		if (m_alerts.should_post<incoming_connection_alert>())
@@ -2733,8 +2961,8 @@ namespace {
 		pack.endp = endp;
 		pack.peerinfo = nullptr;
 
-		std::shared_ptr<peer_connection> c
-			= std::make_shared<bt_peer_connection>(pack, get_peer_id());
+		std::shared_ptr<peer_connection> c = std::allocate_shared<bt_peer_connection>(
+			pool_allocator<bt_peer_connection>(m_connection_pool), pack, get_peer_id());
 #if TORRENT_USE_ASSERTS
 		c->m_in_constructor = false;
 #endif
@@ -2749,6 +2977,13 @@ namespace {
 
 			TORRENT_ASSERT(!c->m_in_constructor);
 			m_connections.insert(c);
+
+			int timeout = m_settings.get_int(settings_pack::handshake_timeout);
+#if TORRENT_USE_I2P
+			timeout *= is_i2p(*s) ? 4 : 1;
+#endif
+			m_handshake_deadlines.push({c->connected_time() + seconds(timeout), c});
+
 			c->start();
 		}
 	}
@@ -2873,7 +3108,7 @@ namespace {
 
 	bool session_impl::verify_queue_position(torrent const* t, int pos)
 	{
-		return m_download_queue.end_index() > pos && m_download_queue[pos] == t;
+		return m_download_queue.size() > pos && m_download_queue.at(pos) == t;
 	}
 #endif
 
@@ -2939,6 +3174,8 @@ namespace {
 	{
 		COMPLETE_ASYNC("session_impl::on_tick");
 		m_stats_counters.inc_stats_counter(counters::on_tick_counter);
+		handler_timer const timer(*this, network_stall_alert::tick
+			, m_next_tick == time_point() ? clock_type::now() : m_next_tick);
 
 		TORRENT_ASSERT(is_single_thread());
 
@@ -3004,9 +3241,16 @@ namespace {
 			std::abort();
 		}
 
+		if (m_next_tick != time_point())
+		{
+			m_stats_counters.set_value(counters::network_thread_lag
+				, std::max(std::int64_t(0), total_microseconds(clock_type::now() - m_next_tick)));
+		}
+
 		ADD_OUTSTANDING_ASYNC("session_impl::on_tick");
 		error_code ec;
-		m_timer.expires_at(now + milliseconds(m_settings.get_int(settings_pack::tick_interval)), ec);
+		m_next_tick = now + milliseconds(m_settings.get_int(settings_pack::tick_interval));
+		m_timer.expires_at(m_next_tick, ec);
 		m_timer.async_wait(make_tick_handler([this](error_code const& err) {
 			this->wrap(&session_impl::on_tick, err); }));
 
@@ -3020,6 +3264,24 @@ namespace {
 		m_ssl_utp_socket_manager.tick(now);
 #endif
 
+		if (m_upload_scheduler.tick(now, seconds(60)))
+		{
+			for (auto const& w : m_upload_scheduler.take_waiting())
+			{
+				std::shared_ptr<peer_connection> p = w.lock();
+				if (p) p->cold_read_slot_available();
+			}
+		}
+
+		int const sample_interval = m_settings.get_int(settings_pack::peer_sample_interval);
+		if (sample_interval > 0
+			&& now - m_last_peer_sample >= milliseconds(sample_interval)
+			&& m_alerts.should_post<peer_sample_alert>())
+		{
+			m_last_peer_sample = now;
+			post_peer_samples();
+		}
+
 		// only tick the following once per second
 		if (now - m_last_second_tick < seconds(1)) return;
 
@@ -3038,6 +3300,23 @@ namespace {
 		int const tick_interval_ms = aux::numeric_cast<int>(total_milliseconds(now - m_last_second_tick));
 		m_last_second_tick = now;
 
+		// close incoming connections that never sent a handshake
+		if (!m_pending_handshakes.empty())
+		{
+			time_duration const timeout = seconds(m_settings.get_int(settings_pack::handshake_timeout));
+			for (auto i = m_pending_handshakes.begin(); i != m_pending_handshakes.end();)
+			{
+				if (now - i->second < timeout)
+				{
+					++i;
+					continue;
+				}
+				error_code ec;
+				i->first->close(ec);
+				i = m_pending_handshakes.erase(i);
+			}
+		}
+
 		std::int32_t const stime = session_time();
 		if (stime > 65000)
 		{
@@ -3130,22 +3409,19 @@ namespace {
 		// check for incoming connections that might have timed out
 		// --------------------------------------------------------------
 
-		for (connection_map::iterator i = m_connections.begin();
-			i != m_connections.end();)
+		while (!m_handshake_deadlines.empty()
+			&& m_handshake_deadlines.top().deadline < m_last_tick)
 		{
-			peer_connection* p = (*i).get();
-			++i;
+			std::shared_ptr<peer_connection> const p
+				= m_handshake_deadlines.top().peer.lock();
+			m_handshake_deadlines.pop();
+
 			// ignore connections that already have a torrent, since they
 			// are ticked through the torrents' second_tick
-			if (!p->associated_torrent().expired()) continue;
+			if (!p || p->is_disconnecting()
+				|| !p->associated_torrent().expired()) continue;
 
-			// TODO: have a separate list for these connections, instead of having to loop through all of them
-			int timeout = m_settings.get_int(settings_pack::handshake_timeout);
-#if TORRENT_USE_I2P
-			timeout *= is_i2p(*p->get_socket()) ? 4 : 1;
-#endif
-			if (m_last_tick - p->connected_time () > seconds(timeout))
-				p->disconnect(errors::timed_out, op_bittorrent);
+			p->disconnect(errors::timed_out, op_bittorrent);
 		}
 
 		// --------------------------------------------------------------
@@ -3431,9 +3707,13 @@ namespace {
 
 		TORRENT_ASSERT(m_dht);
 
-		// announce to DHT every 15 minutes
-		int delay = std::max(m_settings.get_int(settings_pack::dht_announce_interval)
-			/ std::max(int(m_torrents.size()), 1), 1);
+		// announce to DHT every 15 minutes. The timer doesn't fire more than
+		// once a second, so with more torrents than that we announce several
+		// of them every time
+		int const num_torrents = std::max(int(m_torrents.size()), 1);
+		int const interval = std::max(m_settings.get_int(settings_pack::dht_announce_interval), 1);
+		int delay = std::max(interval / num_torrents, 1);
+		int const num_announces = (num_torrents + interval - 1) / interval;
 
 		if (!m_dht_torrents.empty())
 		{
@@ -3449,31 +3729,41 @@ namespace {
 		m_dht_announce_timer.async_wait([this](error_code const& err)
 			{ this->wrap(&session_impl::on_dht_announce, err); });
 
-		if (!m_dht_torrents.empty())
+		int const requests_limit = m_settings.get_int(settings_pack::dht_announce_requests_limit);
+
+		for (int i = 0; i < num_announces; ++i)
 		{
+			// don't start more lookups while the ones we have are keeping
+			// enough requests in flight. The torrents we skip are announced
+			// the next time around
+			if (requests_limit > 0
+				&& m_dht->num_outstanding_requests() >= requests_limit)
+				break;
+
 			std::shared_ptr<torrent> t;
-			do
+			while (!t && !m_dht_torrents.empty())
 			{
 				t = m_dht_torrents.front().lock();
 				m_dht_torrents.pop_front();
-			} while (!t && !m_dht_torrents.empty());
+			}
 
 			if (t)
 			{
 				t->dht_announce();
-				return;
+				continue;
 			}
-		}
-		if (m_torrents.empty()) return;
 
-		if (m_next_dht_torrent == m_torrents.end())
-			m_next_dht_torrent = m_torrents.begin();
-		m_next_dht_torrent->second->dht_announce();
-		// TODO: 2 make a list for torrents that want to be announced on the DHT so we
-		// don't have to loop over all torrents, just to find the ones that want to announce
-		++m_next_dht_torrent;
-		if (m_next_dht_torrent == m_torrents.end())
-			m_next_dht_torrent = m_torrents.begin();
+			if (m_torrents.empty()) return;
+
+			if (m_next_dht_torrent == m_torrents.end())
+				m_next_dht_torrent = m_torrents.begin();
+			m_next_dht_torrent->second->dht_announce();
+			// TODO: 2 make a list for torrents that want to be announced on the DHT so we
+			// don't have to loop over all torrents, just to find the ones that want to announce
+			++m_next_dht_torrent;
+			if (m_next_dht_torrent == m_torrents.end())
+				m_next_dht_torrent = m_torrents.begin();
+		}
 	}
 #endif
 
@@ -3508,11 +3798,21 @@ namespace {
 	void session_impl::auto_manage_checking_torrents(std::vector<torrent*>& list
 		, int& limit)
 	{
+		int const per_device = settings().get_int(settings_pack::active_checking_per_device);
+		// when checking per device, the number of torrents checking on each
+		// device, indexed by torrent::storage_device()
+		std::vector<int> device_checks;
+
 		for (auto& t : list)
 		{
 			TORRENT_ASSERT(t->state() == torrent_status::checking_files);
 			TORRENT_ASSERT(t->is_auto_managed());
-			if (limit <= 0)
+			int const device = per_device > 0 ? t->storage_device() : 0;
+			if (per_device > 0 && device >= int(device_checks.size()))
+				device_checks.resize(std::size_t(device) + 1, 0);
+
+			if (limit <= 0
+				|| (per_device > 0 && device_checks[std::size_t(device)] >= per_device))
 			{
 				t->pause();
 			}
@@ -3522,6 +3822,7 @@ namespace {
 				if (!t->should_check_files()) continue;
 				t->start_checking();
 				--limit;
+				if (per_device > 0) ++device_checks[std::size_t(device)];
 			}
 		}
 	}
@@ -3587,6 +3888,29 @@ namespace {
 		return v;
 	}
 
+	namespace {
+
+		// sorts the first n torrents of the list in ascending order of the
+		// given key. The keys are computed once per torrent up-front and
+		// sorted next to the torrent pointers, rather than being recomputed
+		// (and the torrents chased through their pointers) in every
+		// comparison
+		template <typename Key>
+		void partial_sort_torrents(std::vector<torrent*>& list, int const n, Key key)
+		{
+			std::vector<std::pair<int, torrent*>> keyed;
+			keyed.reserve(list.size());
+			for (auto t : list) keyed.emplace_back(key(*t), t);
+
+			std::partial_sort(keyed.begin(), keyed.begin() + n, keyed.end()
+				, [](std::pair<int, torrent*> const& lhs, std::pair<int, torrent*> const& rhs)
+				{ return lhs.first < rhs.first; });
+
+			for (std::size_t i = 0; i < keyed.size(); ++i)
+				list[i] = keyed[i].second;
+		}
+	}
+
 	void session_impl::recalculate_auto_managed_torrents()
 	{
 		INVARIANT_CHECK;
@@ -3623,20 +3947,22 @@ namespace {
 			// of checking torrents we allow. The rest of the list is still used to
 			// make sure the remaining torrents are paused, but their order is not
 			// relevant
-			std::partial_sort(checking.begin(), checking.begin() +
-				(std::min)(checking_limit, int(checking.size())), checking.end()
-				, [](torrent const* lhs, torrent const* rhs)
-				{ return lhs->sequence_number() < rhs->sequence_number(); });
+			// when checking per device, torrents on other devices may be
+			// started past the first checking_limit ones, so they all need to
+			// be in order
+			int const checking_sort = settings().get_int(settings_pack::active_checking_per_device) > 0
+				? int(checking.size()) : (std::min)(checking_limit, int(checking.size()));
+			partial_sort_torrents(checking, checking_sort
+				, [](torrent const& t) { return t.sequence_number(); });
 
-			std::partial_sort(downloaders.begin(), downloaders.begin() +
-				(std::min)(hard_limit, int(downloaders.size())), downloaders.end()
-				, [](torrent const* lhs, torrent const* rhs)
-				{ return lhs->sequence_number() < rhs->sequence_number(); });
+			partial_sort_torrents(downloaders
+				, (std::min)(hard_limit, int(downloaders.size()))
+				, [](torrent const& t) { return t.sequence_number(); });
 
-			std::partial_sort(seeds.begin(), seeds.begin() +
-				(std::min)(hard_limit, int(seeds.size())), seeds.end()
-				, [this](torrent const* lhs, torrent const* rhs)
-				{ return lhs->seed_rank(m_settings) > rhs->seed_rank(m_settings); });
+			// highest seed rank first. seed_rank() is never negative
+			partial_sort_torrents(seeds
+				, (std::min)(hard_limit, int(seeds.size()))
+				, [this](torrent const& t) { return -t.seed_rank(m_settings); });
 		}
 
 		auto_manage_checking_torrents(checking, checking_limit);
@@ -3865,13 +4191,34 @@ namespace {
 	{
 		if (m_abort) return;
 
+		int const connection_speed = m_settings.get_int(settings_pack::connection_speed);
+
+		// accrue connection attempts for the time since we were last called.
+		// At most one second worth of attempts is saved up, to not connect a
+		// burst of peers after a stall
+		time_point const now = aux::time_now();
+		int const elapsed_ms = int(std::min(std::int64_t(1000)
+			, std::max(std::int64_t(0), std::int64_t(total_milliseconds(now - m_last_connect_time)))));
+		m_last_connect_time = now;
+		if (connection_speed > 0)
+		{
+			m_connect_credit = int(std::min(std::int64_t(connection_speed) * 1000
+				, std::int64_t(m_connect_credit) + std::int64_t(connection_speed) * elapsed_ms));
+		}
+		else
+		{
+			m_connect_credit = 0;
+		}
+
+		// this is the maximum number of connections we will attempt this tick.
+		// Any part of it we don't use is lost, only the fraction of an attempt
+		// is carried over to the next tick
+		int max_connections = m_connect_credit / 1000;
+		m_connect_credit -= max_connections * 1000;
+
 		if (num_connections() >= m_settings.get_int(settings_pack::connections_limit))
 			return;
 
-		// this is the maximum number of connections we will
-		// attempt this tick
-		int max_connections = m_settings.get_int(settings_pack::connection_speed);
-
 		// zero connections speeds are allowed, we just won't make any connections
 		if (max_connections <= 0) return;
 
@@ -4192,63 +4539,38 @@ namespace {
 		int const current_pos = me->queue_position();
 		if (current_pos == p) return;
 
+		// the positions of the torrents between the old and new position are
+		// implied by the download queue, so they don't need to be renumbered.
+		// That also means they don't get state updates when they are shifted
 		if (p >= 0 && current_pos == -1)
 		{
 			// we're inserting the torrent into the download queue
-			int const last = m_download_queue.end_index();
-			if (p >= last)
-			{
-				m_download_queue.push_back(me);
-				me->set_queue_position_impl(last);
-				return;
-			}
-
-			m_download_queue.insert(m_download_queue.begin() + p, me);
-			for (int i = p; i < m_download_queue.end_index(); ++i)
-			{
-				m_download_queue[i]->set_queue_position_impl(i);
-			}
+			me->set_queue_handle(m_download_queue.insert(p, me));
 		}
 		else if (p < 0)
 		{
 			// we're removing the torrent from the download queue
 			TORRENT_ASSERT(current_pos >= 0);
 			TORRENT_ASSERT(p == -1);
-			TORRENT_ASSERT(m_download_queue[current_pos] == me);
-			m_download_queue.erase(m_download_queue.begin() + current_pos);
-			me->set_queue_position_impl(-1);
-			for (int i = current_pos; i < m_download_queue.end_index(); ++i)
-			{
-				m_download_queue[i]->set_queue_position_impl(i);
-			}
+			TORRENT_ASSERT(m_download_queue.value(me->queue_handle()) == me);
+			m_download_queue.erase(me->queue_handle());
+			me->set_queue_handle(-1);
 		}
-		else if (p < current_pos)
-		{
-			// we're moving the torrent up the queue
-			torrent* tmp = me;
-			for (int i = p; i <= current_pos; ++i)
-			{
-				std::swap(m_download_queue[i], tmp);
-				m_download_queue[i]->set_queue_position_impl(i);
-			}
-			TORRENT_ASSERT(tmp == me);
-		}
-		else if (p > current_pos)
+		else
 		{
-			// we're moving the torrent down the queue
-			p = std::min(p, m_download_queue.end_index() - 1);
-			for (int i = current_pos; i < p; ++i)
-			{
-				m_download_queue[i] = m_download_queue[i + 1];
-				m_download_queue[i]->set_queue_position_impl(i);
-			}
-			m_download_queue[p] = me;
-			me->set_queue_position_impl(p);
+			// we're moving the torrent up or down the queue
+			m_download_queue.move(me->queue_handle(), p);
 		}
 
 		trigger_auto_manage();
 	}
 
+	int session_impl::queue_position(torrent const* t) const
+	{
+		TORRENT_ASSERT(t->queue_handle() >= 0);
+		return m_download_queue.position(t->queue_handle());
+	}
+
 #if !defined(TORRENT_DISABLE_ENCRYPTION) && !defined(TORRENT_DISABLE_EXTENSIONS)
 	torrent const* session_impl::find_encrypted_torrent(sha1_hash const& info_hash
 		, sha1_hash const& xor_mask)
@@ -4379,17 +4701,20 @@ namespace {
 		m_posting_torrent_updates = true;
 #endif
 
+		// only post the first n torrents. Since torrents are always pushed
+		// back onto the list, the ones left over are posted first next time
+		int const limit = m_settings.get_int(settings_pack::max_state_updates);
+		int const num_updates = (limit > 0 && limit < int(state_updates.size()))
+			? limit : int(state_updates.size());
+
 		std::vector<torrent_status> status;
-		status.reserve(state_updates.size());
+		status.reserve(std::size_t(num_updates));
 
-		// TODO: it might be a nice feature here to limit the number of torrents
-		// to send in a single update. By just posting the first n torrents, they
-		// would nicely be round-robined because the torrent lists are always
-		// pushed back. Perhaps the status_update_alert could even have a fixed
-		// array of n entries rather than a vector, to further improve memory
-		// locality.
-		for (auto& t : state_updates)
+		// TODO: Perhaps the status_update_alert could have a fixed array of n
+		// entries rather than a vector, to further improve memory locality.
+		for (int i = 0; i < num_updates; ++i)
 		{
+			torrent* t = state_updates[std::size_t(i)];
 			TORRENT_ASSERT(t->m_links[aux::session_impl::torrent_state_updates].in_list());
 			status.push_back(torrent_status());
 			// querying accurate download counters may require
@@ -4399,7 +4724,18 @@ namespace {
 			t->status(&status.back(), flags);
 			t->clear_in_state_update();
 		}
-		state_updates.clear();
+
+		if (num_updates == int(state_updates.size()))
+		{
+			state_updates.clear();
+		}
+		else
+		{
+			state_updates.erase(state_updates.begin()
+				, state_updates.begin() + num_updates);
+			for (int i = 0; i < int(state_updates.size()); ++i)
+				state_updates[std::size_t(i)]->m_links[aux::session_impl::torrent_state_updates].index = i;
+		}
 
 #if TORRENT_USE_ASSERTS
 		m_posting_torrent_updates = false;
@@ -4408,7 +4744,100 @@ namespace {
 		m_alerts.emplace_alert<state_update_alert>(std::move(status));
 	}
 
+	void session_impl::post_torrent_status(std::vector<torrent_handle> const& handles
+		, std::uint32_t const flags)
+	{
+		TORRENT_ASSERT(is_single_thread());
+
+		std::vector<torrent_status> status;
+		status.reserve(handles.size());
+		for (auto const& h : handles)
+		{
+			std::shared_ptr<torrent> t = h.m_torrent.lock();
+			if (!t) continue;
+			status.push_back(torrent_status());
+			t->status(&status.back(), flags);
+		}
+
+		m_alerts.emplace_alert<state_update_alert>(std::move(status));
+	}
+
+	void session_impl::post_peer_samples()
+	{
+		TORRENT_ASSERT(is_single_thread());
+
+		// pick the peers to sample by their rates first, to avoid building
+		// records for the ones that won't fit in the alert
+		std::vector<std::pair<int, peer_connection const*>> peers;
+		peers.reserve(m_connections.size());
+		for (auto const& p : m_connections)
+		{
+			if (p->is_disconnecting() || p->in_handshake()) continue;
+			stat const& st = p->statistics();
+			peers.emplace_back(st.upload_rate() + st.download_rate(), p.get());
+		}
+
+		int const num_peers = int(peers.size());
+		int const limit = std::max(0, m_settings.get_int(settings_pack::max_peer_samples));
+		if (num_peers > limit)
+		{
+			std::nth_element(peers.begin(), peers.begin() + limit, peers.end()
+				, [](std::pair<int, peer_connection const*> const& lhs
+					, std::pair<int, peer_connection const*> const& rhs)
+				{ return lhs.first > rhs.first; });
+			peers.resize(std::size_t(limit));
+		}
+
+		std::vector<peer_sample> samples(peers.size());
+		for (std::size_t i = 0; i < peers.size(); ++i)
+			peers[i].second->get_peer_sample(samples[i]);
+
+		m_alerts.emplace_alert<peer_sample_alert>(std::move(samples), num_peers);
+	}
+
 	void session_impl::post_session_stats()
+	{
+		update_session_stats();
+		m_alerts.emplace_alert<session_stats_alert>(m_stats_counters);
+	}
+
+	void session_impl::post_session_stats_delta()
+	{
+		update_session_stats();
+
+		std::array<std::int64_t, counters::num_counters> values;
+		for (int i = 0; i < counters::num_counters; ++i)
+			values[std::size_t(i)] = m_stats_counters[i];
+
+		std::vector<char> delta;
+		encode_session_stats_delta(m_stats_delta_base, values, delta);
+		m_alerts.emplace_alert<session_stats_delta_alert>(delta);
+		m_stats_delta_base = values;
+	}
+
+	void session_impl::handler_executed(network_stall_alert::handler_t const h
+		, time_point const queued, time_point const started)
+	{
+		TORRENT_ASSERT(is_single_thread());
+		time_point const now = clock_type::now();
+		time_duration const queue_time = started > queued ? started - queued : time_duration(0);
+		time_duration const exec_time = now - started;
+
+		m_stats_counters.inc_stats_counter(counters::network_handler_calls);
+		m_stats_counters.inc_stats_counter(counters::network_handler_queue_time
+			, total_microseconds(queue_time));
+		m_stats_counters.inc_stats_counter(counters::network_handler_exec_time
+			, total_microseconds(exec_time));
+
+		int const threshold = m_settings.get_int(settings_pack::network_stall_threshold);
+		if (threshold <= 0 || exec_time < milliseconds(threshold)) return;
+
+		m_stats_counters.inc_stats_counter(counters::network_thread_stalls);
+		if (m_alerts.should_post<network_stall_alert>())
+			m_alerts.emplace_alert<network_stall_alert>(h, queue_time, exec_time);
+	}
+
+	void session_impl::update_session_stats()
 	{
 		m_disk_thread.update_stats_counters(m_stats_counters);
 
@@ -4417,6 +4846,9 @@ namespace {
 			m_dht->update_stats_counters(m_stats_counters);
 #endif
 
+		m_stats_counters.set_value(counters::peer_list_bytes
+			, m_peer_allocator.live_bytes());
+
 		m_stats_counters.set_value(counters::limiter_up_queue
 			, m_upload_rate.queue_size());
 		m_stats_counters.set_value(counters::limiter_down_queue
@@ -4426,8 +4858,6 @@ namespace {
 			, m_upload_rate.queued_bytes());
 		m_stats_counters.set_value(counters::limiter_down_bytes
 			, m_download_rate.queued_bytes());
-
-		m_alerts.emplace_alert<session_stats_alert>(m_stats_counters);
 	}
 
 	void session_impl::post_dht_stats()
@@ -4468,7 +4898,14 @@ namespace {
 		if (!params->ti && string_begins_no_case("file://", params->url.c_str()))
 		{
 			if (!m_torrent_load_thread)
+			{
 				m_torrent_load_thread.reset(new work_thread_t());
+				if (m_thread_init)
+				{
+					std::function<void(char const*)> init = m_thread_init;
+					m_torrent_load_thread->ios.post([init] { init("torrent load"); });
+				}
+			}
 
 			m_torrent_load_thread->ios.post([params, this]
 			{
@@ -4491,6 +4928,33 @@ namespace {
 		add_torrent(std::move(*params), ec);
 	}
 
+	void session_impl::async_add_torrents(std::vector<add_torrent_params>* params)
+	{
+		std::unique_ptr<std::vector<add_torrent_params>> holder(params);
+
+		// make room for the whole batch up-front, rather than rehashing the
+		// torrent table repeatedly as it grows. Rehashing invalidates the
+		// LSD and DHT announce cursors, so they have to be looked up again
+		sha1_hash next_lsd(nullptr);
+		sha1_hash next_dht(nullptr);
+		if (m_next_lsd_torrent != m_torrents.end())
+			next_lsd = m_next_lsd_torrent->first;
+#ifndef TORRENT_DISABLE_DHT
+		if (m_next_dht_torrent != m_torrents.end())
+			next_dht = m_next_dht_torrent->first;
+#endif
+		m_torrents.reserve(m_torrents.size() + params->size());
+		m_next_lsd_torrent = next_lsd.is_all_zeros()
+			? m_torrents.end() : m_torrents.find(next_lsd);
+#ifndef TORRENT_DISABLE_DHT
+		m_next_dht_torrent = next_dht.is_all_zeros()
+			? m_torrents.end() : m_torrents.find(next_dht);
+#endif
+
+		for (auto& p : *params)
+			async_add_torrent(new add_torrent_params(std::move(p)));
+	}
+
 #ifndef TORRENT_NO_DEPRECATE
 	void session_impl::on_async_load_torrent(add_torrent_params* params, error_code ec)
 	{
@@ -4762,7 +5226,7 @@ namespace {
 		torrent_ptr = std::make_shared<torrent>(*this
 			, 16 * 1024, m_paused
 			, params, params.info_hash);
-		torrent_ptr->set_queue_position(m_download_queue.end_index());
+		torrent_ptr->set_queue_position(m_download_queue.size());
 
 		return std::make_pair(torrent_ptr, true);
 	}
@@ -5671,6 +6135,17 @@ namespace {
 			, std::bind(&put_mutable_callback, _1, cb), salt);
 	}
 
+	void session_impl::dht_put_items(std::vector<dht_mutable_put> const& items)
+	{
+		if (!m_dht) return;
+		for (auto const& p : items)
+		{
+			m_dht->put_item(dht::public_key(p.key.data())
+				, dht::secret_key(p.secret_key.data()), p.data, p.salt
+				, std::bind(&on_dht_put_mutable_item, std::ref(m_alerts), _1, _2));
+		}
+	}
+
 	void session_impl::dht_get_peers(sha1_hash const& info_hash)
 	{
 		if (!m_dht) return;
@@ -5690,6 +6165,25 @@ namespace {
 		m_alerts.emplace_alert<dht_live_nodes_alert>(nid, nodes);
 	}
 
+	namespace {
+
+		void on_dht_sample_infohashes(alert_manager& alerts, udp::endpoint const& ep
+			, time_duration const interval, int const num
+			, std::vector<sha1_hash> const& samples)
+		{
+			if (alerts.should_post<dht_sample_infohashes_alert>())
+				alerts.emplace_alert<dht_sample_infohashes_alert>(ep, interval, num, samples);
+		}
+
+	} // anonymous namespace
+
+	void session_impl::dht_sample_infohashes(sha1_hash const& target)
+	{
+		if (!m_dht) return;
+		m_dht->sample_infohashes(target, std::bind(&on_dht_sample_infohashes
+			, std::ref(m_alerts), _1, _2, _3, _4));
+	}
+
 	void session_impl::dht_direct_request(udp::endpoint const& ep, entry& e, void* userdata)
 	{
 		if (!m_dht) return;
@@ -5859,6 +6353,11 @@ namespace {
 				}
 #endif
 			}
+			for (auto const& a : l.extra_socks)
+			{
+				error_code ec;
+				set_tos(*a, tos, ec);
+			}
 			if (l.udp_sock)
 			{
 				error_code ec;
@@ -6038,6 +6537,11 @@ namespace {
 					, l.sock->local_endpoint().port(), ec.value(), ec.message().c_str());
 			}
 #endif
+			for (auto const& a : l.extra_socks)
+			{
+				error_code err;
+				set_socket_buffer_size(*a, m_settings, err);
+			}
 		}
 	}
 
@@ -6098,6 +6602,12 @@ namespace {
 				i.sock->close(ec);
 				i.sock.reset();
 			}
+			for (auto const& a : i.extra_socks)
+			{
+				error_code ec;
+				a->close(ec);
+			}
+			i.extra_socks.clear();
 		}
 
 		if (!m_settings.get_bool(settings_pack::force_proxy)) return;
@@ -6542,6 +7052,15 @@ namespace {
 		return false;
 	}
 
+	bool session_impl::has_dht_request_handler() const
+	{
+#ifndef TORRENT_DISABLE_EXTENSIONS
+		return !m_ses_extensions[plugins_dht_request_idx].empty();
+#else
+		return false;
+#endif
+	}
+
 	void session_impl::set_external_address(address const& ip
 		, int const source_type, address const& source)
 	{
@@ -6588,6 +7107,9 @@ namespace {
 	{
 		TORRENT_ASSERT(is_single_thread());
 
+		m_stats_counters.inc_stats_counter(counters::send_buffer_bytes
+			, send_buffer_size());
+
 #ifdef TORRENT_DISABLE_POOL_ALLOCATOR
 		std::size_t num_bytes = aux::numeric_cast<std::size_t>(send_buffer_size());
 		return ses_buffer_holder(*this, static_cast<char*>(std::malloc(num_bytes)));
@@ -6600,6 +7122,9 @@ namespace {
 	{
 		TORRENT_ASSERT(is_single_thread());
 
+		m_stats_counters.inc_stats_counter(counters::send_buffer_bytes
+			, -send_buffer_size());
+
 #ifdef TORRENT_DISABLE_POOL_ALLOCATOR
 		free(buf);
 #else
@@ -6625,11 +7150,11 @@ namespace {
 			}
 
 			int idx = 0;
-			for (auto t : m_download_queue)
+			m_download_queue.for_each([&idx](torrent const* t)
 			{
 				TORRENT_ASSERT(t->queue_position() == idx);
 				++idx;
-			}
+			});
 		}
 
 		int const num_gauges = counters::num_error_torrents - counters::num_checking_torrents + 1;
@@ -32,11 +32,83 @@ POSSIBILITY OF SUCH DAMAGE.
 
 #include "libtorrent/aux_/session_settings.hpp"
 
+#include <algorithm>
+#include <thread>
+#include <memory>
+#include <atomic>
+
 namespace libtorrent { namespace aux {
 
 	session_settings::session_settings()
 	{
 		initialize_default_settings(*this);
 	}
+
+	int num_hash_threads(session_settings const& s)
+	{
+		int const hash_threads = s.get_int(settings_pack::hash_threads);
+		if (hash_threads > 0) return hash_threads;
+		if (hash_threads < 0)
+			return std::max(1, int(std::thread::hardware_concurrency()));
+		return s.get_int(settings_pack::aio_threads) / 4;
+	}
+
+	hot_settings::hot_settings(session_settings const& s)
+		: read_cache_line_size(s.get_int(settings_pack::read_cache_line_size))
+		, write_cache_line_size(s.get_int(settings_pack::write_cache_line_size))
+		, max_retained_unhashed_blocks(s.get_int(settings_pack::max_retained_unhashed_blocks))
+		, cache_size(s.get_int(settings_pack::cache_size))
+		, cache_expiry(s.get_int(settings_pack::cache_expiry))
+		, aio_max(s.get_int(settings_pack::aio_max))
+		, disk_io_backend(s.get_int(settings_pack::disk_io_backend))
+		, close_file_interval(s.get_int(settings_pack::close_file_interval))
+		, use_read_cache(s.get_bool(settings_pack::use_read_cache))
+		, coalesce_reads(s.get_bool(settings_pack::coalesce_reads))
+		, coalesce_writes(s.get_bool(settings_pack::coalesce_writes))
+		, disable_hash_checks(s.get_bool(settings_pack::disable_hash_checks))
+		, allow_partial_disk_writes(s.get_bool(settings_pack::allow_partial_disk_writes))
+		, adaptive_read_ahead(s.get_bool(settings_pack::adaptive_read_ahead))
+	{}
+
+namespace {
+
+	// versions are unique across all publishers, so a thread's cached
+	// snapshot can't be mistaken for the current one of another publisher
+	std::atomic<std::uint64_t> g_settings_version(0);
+
+	std::shared_ptr<settings_snapshot const> make_snapshot(session_settings const& s)
+	{
+		return std::make_shared<settings_snapshot const>(s
+			, g_settings_version.fetch_add(1, std::memory_order_relaxed) + 1);
+	}
+}
+
+	settings_snapshot::settings_snapshot(session_settings const& s
+		, std::uint64_t const v)
+		: settings(s)
+		, hot(s)
+		, version(v)
+	{}
+
+	settings_publisher::settings_publisher(session_settings const& s)
+		: m_snapshot(make_snapshot(s))
+		, m_version(m_snapshot->version)
+	{}
+
+	void settings_publisher::publish(session_settings const& s)
+	{
+		std::shared_ptr<settings_snapshot const> snap = make_snapshot(s);
+		std::uint64_t const v = snap->version;
+		std::atomic_store(&m_snapshot, std::move(snap));
+		m_version.store(v, std::memory_order_release);
+	}
+
+	settings_snapshot const& settings_publisher::current() const
+	{
+		thread_local std::shared_ptr<settings_snapshot const> cached;
+		if (!cached || cached->version != version())
+			cached = std::atomic_load(&m_snapshot);
+		return *cached;
+	}
 } }
 
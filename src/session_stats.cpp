@@ -152,6 +152,14 @@ namespace {
 		METRIC(peer, num_peers_up_disk)
 		METRIC(peer, num_peers_down_disk)
 
+		// the number of bytes allocated for peer send buffers
+		// (``send_buffer_bytes``) and receive buffers (``receive_buffer_bytes``)
+		// of all peer connections. Blocks sent straight out of disk buffers, and
+		// blocks received straight into them, are counted by
+		// ``disk.disk_buffer_bytes``.
+		METRIC(peer, send_buffer_bytes)
+		METRIC(peer, receive_buffer_bytes)
+
 		// These counters count the number of times the
 		// network thread wakes up for each respective
 		// reason. If these counters are very large, it
@@ -170,6 +178,16 @@ namespace {
 		METRIC(net, on_disk_queue_counter)
 		METRIC(net, on_disk_counter)
 
+		// the number of calls through session_handle and torrent_handle, and
+		// session ticks, executed by the network thread. The cumulative time
+		// (in microseconds) they spent in the queue before starting and
+		// executing, and the number of them that ran for longer than
+		// settings_pack::network_stall_threshold
+		METRIC(net, network_handler_calls)
+		METRIC(net, network_handler_queue_time)
+		METRIC(net, network_handler_exec_time)
+		METRIC(net, network_thread_stalls)
+
 		// total number of bytes sent and received by the session
 		METRIC(net, sent_payload_bytes)
 		METRIC(net, sent_bytes)
@@ -190,6 +208,11 @@ namespace {
 		METRIC(net, limiter_up_bytes)
 		METRIC(net, limiter_down_bytes)
 
+		// the number of microseconds the most recent session tick ran late.
+		// Since the tick is a timer, this is how far behind the network
+		// thread is in handling events
+		METRIC(net, network_thread_lag)
+
 		// the number of bytes downloaded that had to be discarded because they
 		// failed the hash check
 		METRIC(net, recv_failed_bytes)
@@ -224,6 +247,20 @@ namespace {
 		// IP filter applied to them.
 		METRIC(ses, non_filter_torrents)
 
+		// the number of bytes allocated by piece pickers. Torrents
+		// that are seeding don't have a piece picker, and don't count
+		// towards this.
+		METRIC(ses, piece_picker_bytes)
+
+		// the estimated number of bytes used by the torrent_info objects of
+		// all torrents in the session. This includes the file list and the
+		// info-dictionary (with the piece hashes)
+		METRIC(ses, torrent_info_bytes)
+
+		// the number of bytes allocated for the entries of the peer lists of all
+		// torrents, i.e. the peers we know about, whether connected or not
+		METRIC(ses, peer_list_bytes)
+
 		// these count the number of times a piece has passed the
 		// hash check, the number of times a piece was successfully
 		// written to disk and the number of total possible pieces
@@ -288,6 +325,13 @@ namespace {
 		METRIC(ses, num_outgoing_metadata)
 		METRIC(ses, num_outgoing_extended)
 
+		// the number of blocks peers requested from pieces we suggested to
+		// them, that were served from the read cache and that had to be read
+		// from disk, respectively. Along with num_outgoing_suggest, this shows
+		// how well the suggestions (see suggest_mode) work.
+		METRIC(ses, num_suggested_piece_cache_hits)
+		METRIC(ses, num_suggested_piece_cache_misses)
+
 		// the number of wasted downloaded bytes by reason of the bytes being
 		// wasted.
 		METRIC(ses, waste_piece_timed_out)
@@ -306,6 +350,7 @@ namespace {
 		METRIC(picker, piece_picker_rand_start_loops)
 		METRIC(picker, piece_picker_rand_loops)
 		METRIC(picker, piece_picker_busy_loops)
+		METRIC(picker, piece_picker_rebuilds)
 
 		// This breaks down the piece picks into the event that
 		// triggered it
@@ -336,6 +381,11 @@ namespace {
 		METRIC(disk, pinned_blocks)
 		METRIC(disk, disk_blocks_in_use)
 
+		// the number of bytes allocated for disk buffers. This is
+		// ``disk_blocks_in_use`` times the block size, and includes the block
+		// cache as well as blocks being read or written.
+		METRIC(disk, disk_buffer_bytes)
+
 		// ``queued_disk_jobs`` is the number of disk jobs currently queued,
 		// waiting to be executed by a disk thread. Deprecates
 		// ``cache_status::job_queue_length``.
@@ -348,6 +398,9 @@ namespace {
 
 		METRIC(disk, num_writing_threads)
 		METRIC(disk, num_running_threads)
+		METRIC(disk, disk_threads_target)
+		METRIC(disk, disk_hash_threads_target)
+		METRIC(disk, disk_queue_wait_time)
 
 		// the number of bytes we have sent to the disk I/O
 		// thread for writing. Every time we hear back from
@@ -387,6 +440,26 @@ namespace {
 		// hash a piece (when verifying against the piece hash)
 		METRIC(disk, num_read_back)
 
+		// the number of blocks read back to hash a piece, broken down by the
+		// reason they were flushed before they could be hashed. The write
+		// cache ran out of space, the blocks expired or the cache was flushed
+		// explicitly (e.g. when pausing a torrent)
+		METRIC(disk, num_read_back_cache_pressure)
+		METRIC(disk, num_read_back_expired)
+		METRIC(disk, num_read_back_flush)
+
+		// the number of blocks read from, and written to, the L2 cache file
+		// (see settings_pack::l2_cache_path)
+		METRIC(disk, num_blocks_read_l2)
+		METRIC(disk, num_blocks_written_l2)
+
+		// the number of blocks served from the cached pieces of other
+		// torrents with identical content (see
+		// settings_pack::content_addressed_cache)
+		METRIC(disk, num_blocks_read_shared)
+		METRIC(disk, disk_threads_scaled_up)
+		METRIC(disk, disk_threads_scaled_down)
+
 		// cumulative time spent in various disk jobs, as well
 		// as total for all disk jobs. Measured in microseconds
 		METRIC(disk, disk_read_time)
@@ -394,6 +467,144 @@ namespace {
 		METRIC(disk, disk_hash_time)
 		METRIC(disk, disk_job_time)
 
+		// histograms of the time disk jobs spend in the queue, from being
+		// issued until a disk thread picks them up, and the time they take to
+		// execute. The counters are broken down by read, write, hash and all
+		// other jobs. Each counts the jobs that took less than 1 << n
+		// microseconds, where n is the number at the end of the counter name,
+		// and at least half that. i.e. 32, 64, 128, 256, 512, 1024, 2048, 4096,
+		// 8192, 16384, 32768, 65536, 131072, 262144, 524288, 1048576
+		// microseconds. The first counter of each histogram also counts
+		// shorter jobs and the last one longer jobs
+		METRIC(disk, disk_read_queue_time5)
+		METRIC(disk, disk_read_queue_time6)
+		METRIC(disk, disk_read_queue_time7)
+		METRIC(disk, disk_read_queue_time8)
+		METRIC(disk, disk_read_queue_time9)
+		METRIC(disk, disk_read_queue_time10)
+		METRIC(disk, disk_read_queue_time11)
+		METRIC(disk, disk_read_queue_time12)
+		METRIC(disk, disk_read_queue_time13)
+		METRIC(disk, disk_read_queue_time14)
+		METRIC(disk, disk_read_queue_time15)
+		METRIC(disk, disk_read_queue_time16)
+		METRIC(disk, disk_read_queue_time17)
+		METRIC(disk, disk_read_queue_time18)
+		METRIC(disk, disk_read_queue_time19)
+		METRIC(disk, disk_read_queue_time20)
+		METRIC(disk, disk_read_exec_time5)
+		METRIC(disk, disk_read_exec_time6)
+		METRIC(disk, disk_read_exec_time7)
+		METRIC(disk, disk_read_exec_time8)
+		METRIC(disk, disk_read_exec_time9)
+		METRIC(disk, disk_read_exec_time10)
+		METRIC(disk, disk_read_exec_time11)
+		METRIC(disk, disk_read_exec_time12)
+		METRIC(disk, disk_read_exec_time13)
+		METRIC(disk, disk_read_exec_time14)
+		METRIC(disk, disk_read_exec_time15)
+		METRIC(disk, disk_read_exec_time16)
+		METRIC(disk, disk_read_exec_time17)
+		METRIC(disk, disk_read_exec_time18)
+		METRIC(disk, disk_read_exec_time19)
+		METRIC(disk, disk_read_exec_time20)
+		METRIC(disk, disk_write_queue_time5)
+		METRIC(disk, disk_write_queue_time6)
+		METRIC(disk, disk_write_queue_time7)
+		METRIC(disk, disk_write_queue_time8)
+		METRIC(disk, disk_write_queue_time9)
+		METRIC(disk, disk_write_queue_time10)
+		METRIC(disk, disk_write_queue_time11)
+		METRIC(disk, disk_write_queue_time12)
+		METRIC(disk, disk_write_queue_time13)
+		METRIC(disk, disk_write_queue_time14)
+		METRIC(disk, disk_write_queue_time15)
+		METRIC(disk, disk_write_queue_time16)
+		METRIC(disk, disk_write_queue_time17)
+		METRIC(disk, disk_write_queue_time18)
+		METRIC(disk, disk_write_queue_time19)
+		METRIC(disk, disk_write_queue_time20)
+		METRIC(disk, disk_write_exec_time5)
+		METRIC(disk, disk_write_exec_time6)
+		METRIC(disk, disk_write_exec_time7)
+		METRIC(disk, disk_write_exec_time8)
+		METRIC(disk, disk_write_exec_time9)
+		METRIC(disk, disk_write_exec_time10)
+		METRIC(disk, disk_write_exec_time11)
+		METRIC(disk, disk_write_exec_time12)
+		METRIC(disk, disk_write_exec_time13)
+		METRIC(disk, disk_write_exec_time14)
+		METRIC(disk, disk_write_exec_time15)
+		METRIC(disk, disk_write_exec_time16)
+		METRIC(disk, disk_write_exec_time17)
+		METRIC(disk, disk_write_exec_time18)
+		METRIC(disk, disk_write_exec_time19)
+		METRIC(disk, disk_write_exec_time20)
+		METRIC(disk, disk_hash_queue_time5)
+		METRIC(disk, disk_hash_queue_time6)
+		METRIC(disk, disk_hash_queue_time7)
+		METRIC(disk, disk_hash_queue_time8)
+		METRIC(disk, disk_hash_queue_time9)
+		METRIC(disk, disk_hash_queue_time10)
+		METRIC(disk, disk_hash_queue_time11)
+		METRIC(disk, disk_hash_queue_time12)
+		METRIC(disk, disk_hash_queue_time13)
+		METRIC(disk, disk_hash_queue_time14)
+		METRIC(disk, disk_hash_queue_time15)
+		METRIC(disk, disk_hash_queue_time16)
+		METRIC(disk, disk_hash_queue_time17)
+		METRIC(disk, disk_hash_queue_time18)
+		METRIC(disk, disk_hash_queue_time19)
+		METRIC(disk, disk_hash_queue_time20)
+		METRIC(disk, disk_hash_exec_time5)
+		METRIC(disk, disk_hash_exec_time6)
+		METRIC(disk, disk_hash_exec_time7)
+		METRIC(disk, disk_hash_exec_time8)
+		METRIC(disk, disk_hash_exec_time9)
+		METRIC(disk, disk_hash_exec_time10)
+		METRIC(disk, disk_hash_exec_time11)
+		METRIC(disk, disk_hash_exec_time12)
+		METRIC(disk, disk_hash_exec_time13)
+		METRIC(disk, disk_hash_exec_time14)
+		METRIC(disk, disk_hash_exec_time15)
+		METRIC(disk, disk_hash_exec_time16)
+		METRIC(disk, disk_hash_exec_time17)
+		METRIC(disk, disk_hash_exec_time18)
+		METRIC(disk, disk_hash_exec_time19)
+		METRIC(disk, disk_hash_exec_time20)
+		METRIC(disk, disk_other_queue_time5)
+		METRIC(disk, disk_other_queue_time6)
+		METRIC(disk, disk_other_queue_time7)
+		METRIC(disk, disk_other_queue_time8)
+		METRIC(disk, disk_other_queue_time9)
+		METRIC(disk, disk_other_queue_time10)
+		METRIC(disk, disk_other_queue_time11)
+		METRIC(disk, disk_other_queue_time12)
+		METRIC(disk, disk_other_queue_time13)
+		METRIC(disk, disk_other_queue_time14)
+		METRIC(disk, disk_other_queue_time15)
+		METRIC(disk, disk_other_queue_time16)
+		METRIC(disk, disk_other_queue_time17)
+		METRIC(disk, disk_other_queue_time18)
+		METRIC(disk, disk_other_queue_time19)
+		METRIC(disk, disk_other_queue_time20)
+		METRIC(disk, disk_other_exec_time5)
+		METRIC(disk, disk_other_exec_time6)
+		METRIC(disk, disk_other_exec_time7)
+		METRIC(disk, disk_other_exec_time8)
+		METRIC(disk, disk_other_exec_time9)
+		METRIC(disk, disk_other_exec_time10)
+		METRIC(disk, disk_other_exec_time11)
+		METRIC(disk, disk_other_exec_time12)
+		METRIC(disk, disk_other_exec_time13)
+		METRIC(disk, disk_other_exec_time14)
+		METRIC(disk, disk_other_exec_time15)
+		METRIC(disk, disk_other_exec_time16)
+		METRIC(disk, disk_other_exec_time17)
+		METRIC(disk, disk_other_exec_time18)
+		METRIC(disk, disk_other_exec_time19)
+		METRIC(disk, disk_other_exec_time20)
+
 		// for each kind of disk job, a counter of how many jobs of that kind
 		// are currently blocked by a disk fence
 		METRIC(disk, num_fenced_read)
@@ -433,6 +644,10 @@ namespace {
 		// the number of mutable data items tracked by our DHT node
 		METRIC(dht, dht_mutable_data)
 
+		// the estimated number of bytes used to store the torrents, peers and
+		// items tracked by our DHT node
+		METRIC(dht, dht_storage_bytes)
+
 		// the number of RPC observers currently allocated
 		METRIC(dht, dht_allocated_observers)
 
@@ -495,6 +710,12 @@ namespace {
 		METRIC(utp, utp_invalid_pkts_in)
 		METRIC(utp, utp_redundant_pkts_in)
 
+		// the sum of all queuing delay samples the uTP congestion controller
+		// has acted on, in microseconds. Divide by the sum of
+		// utp_samples_above_target and utp_samples_below_target to get the
+		// average queuing delay
+		METRIC(utp, utp_queuing_delay)
+
 		// the number of uTP sockets in each respective state
 		METRIC(utp, num_utp_idle)
 		METRIC(utp, num_utp_syn_sent)
@@ -568,6 +789,71 @@ namespace {
 		return stats;
 	}
 
+namespace {
+
+	void write_varint(std::uint64_t v, std::vector<char>& out)
+	{
+		while (v >= 0x80)
+		{
+			out.push_back(char((v & 0x7f) | 0x80));
+			v >>= 7;
+		}
+		out.push_back(char(v));
+	}
+
+	bool read_varint(span<char const>& in, std::uint64_t& v)
+	{
+		v = 0;
+		for (int shift = 0; shift < 64; shift += 7)
+		{
+			if (in.empty()) return false;
+			std::uint8_t const c = std::uint8_t(in[0]);
+			in = in.subspan(1);
+			v |= std::uint64_t(c & 0x7f) << shift;
+			if ((c & 0x80) == 0) return true;
+		}
+		return false;
+	}
+}
+
+	void encode_session_stats_delta(span<std::int64_t const> const prev
+		, span<std::int64_t const> const cur, std::vector<char>& out)
+	{
+		TORRENT_ASSERT(prev.size() == cur.size());
+		std::size_t const size = std::min(prev.size(), cur.size());
+		std::size_t next = 0;
+		for (std::size_t i = 0; i < size; ++i)
+		{
+			if (prev[i] == cur[i]) continue;
+			// the delta is computed as unsigned, to wrap around rather than
+			// overflow
+			std::uint64_t const d = std::uint64_t(cur[i]) - std::uint64_t(prev[i]);
+			std::uint64_t const zigzag = (d << 1) ^ ((d >> 63) != 0 ? ~std::uint64_t(0) : 0);
+			write_varint(i - next, out);
+			write_varint(zigzag, out);
+			next = i + 1;
+		}
+	}
+
+	bool apply_session_stats_delta(span<char const> delta
+		, span<std::int64_t> const values)
+	{
+		std::size_t next = 0;
+		while (!delta.empty())
+		{
+			std::uint64_t gap;
+			std::uint64_t zigzag;
+			if (!read_varint(delta, gap)) return false;
+			if (!read_varint(delta, zigzag)) return false;
+			if (gap >= values.size() - next) return false;
+			std::size_t const i = next + std::size_t(gap);
+			std::uint64_t const d = (zigzag >> 1) ^ ((zigzag & 1) ? ~std::uint64_t(0) : 0);
+			values[i] = std::int64_t(std::uint64_t(values[i]) + d);
+			next = i + 1;
+		}
+		return true;
+	}
+
 	// TODO: 3 use string_view for name
 	int find_metric_idx(char const* name)
 	{
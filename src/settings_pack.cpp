@@ -127,7 +127,9 @@ constexpr int CLOSE_FILE_INTERVAL = 0;
 		SET(proxy_password, "", &session_impl::update_proxy),
 		SET(i2p_hostname, "", &session_impl::update_i2p_bridge),
 		SET(peer_fingerprint, "-LT1200-", &session_impl::update_peer_fingerprint),
-		SET(dht_bootstrap_nodes, "dht.libtorrent.org:25401", &session_impl::update_dht_bootstrap_nodes)
+		SET(dht_bootstrap_nodes, "dht.libtorrent.org:25401", &session_impl::update_dht_bootstrap_nodes),
+		SET(disk_io_trace_file, "", nullptr),
+		SET(l2_cache_path, "", nullptr)
 	}});
 
 	aux::array<bool_setting_entry_t, settings_pack::num_bool_settings> const bool_settings
@@ -200,6 +202,19 @@ constexpr int CLOSE_FILE_INTERVAL = 0;
 		SET(proxy_peer_connections, true, nullptr),
 		SET(auto_sequential, true, &session_impl::update_auto_sequential),
 		SET(proxy_tracker_connections, true, nullptr),
+		SET(adaptive_read_ahead, false, nullptr),
+		SET(send_pacing, false, nullptr),
+		SET(batch_piece_picks, false, nullptr),
+		SET(bdp_request_queue, false, nullptr),
+		SET(direct_piece_receive, false, nullptr),
+		SET(coalesce_have_messages, false, nullptr),
+		SET(pre_handshake_check, false, nullptr),
+		SET(defer_resume_data_check, false, nullptr),
+		SET(disk_cache_arena, false, nullptr),
+		SET(content_addressed_cache, false, nullptr),
+		SET(salvage_failed_pieces, true, nullptr),
+		SET(outgoing_tcp_fast_open, false, nullptr),
+		SET(auto_scale_aio_threads, false, nullptr),
 	}});
 
 	aux::array<int_setting_entry_t, settings_pack::num_int_settings> const int_settings
@@ -336,6 +351,30 @@ constexpr int CLOSE_FILE_INTERVAL = 0;
 		SET(close_file_interval, CLOSE_FILE_INTERVAL, nullptr),
 		SET(max_web_seed_connections, 3, nullptr),
 		SET(resolver_cache_timeout, 1200, &session_impl::update_resolver_cache_timeout),
+		SET(disk_io_backend, settings_pack::posix_disk_io, nullptr),
+		SET(cache_eviction_policy, settings_pack::arc_eviction, nullptr),
+		SET(hash_threads, 0, nullptr),
+		SET(listen_acceptors, 1, nullptr),
+		SET(send_not_sent_low_watermark, 0, nullptr),
+		SET(whole_pieces_extent, 1, nullptr),
+		SET(max_state_updates, 0, nullptr),
+		SET(dht_announce_requests_limit, 300, nullptr),
+		SET(tracker_keepalive_connections, 4, nullptr),
+		SET(tracker_host_concurrency, 10, nullptr),
+		SET(tracker_host_request_rate, 50, nullptr),
+		SET(urlseed_connections, 1, nullptr),
+		SET(network_stall_threshold, 100, nullptr),
+		SET(peer_sample_interval, 0, nullptr),
+		SET(max_peer_samples, 1000, nullptr),
+		SET(max_disk_jobs_per_device, 0, nullptr),
+		SET(disk_read_elevator_wait, 0, nullptr),
+		SET(max_retained_unhashed_blocks, 1024, nullptr),
+		SET(upload_cold_read_limit, 0, nullptr),
+		SET(active_checking_per_device, 0, &session_impl::trigger_auto_manage),
+		SET(l2_cache_size, 0, nullptr),
+		SET(min_aio_threads, 1, nullptr),
+		SET(deletion_threads, 1, nullptr),
+		SET(seed_mode_background_checks, 1, nullptr),
 	}});
 
 #undef SET
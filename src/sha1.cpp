@@ -14,11 +14,32 @@ changelog at the end of the file.
 #include <cstring>
 
 #include "libtorrent/sha1.hpp"
+#include "libtorrent/aux_/cpuid.hpp"
 
 #include "libtorrent/aux_/disable_warnings_push.hpp"
 #include <boost/detail/endian.hpp> // for BIG_ENDIAN and LITTLE_ENDIAN macros
+
+#if TORRENT_HAS_SHA_NI
+#include <immintrin.h>
+#endif
+
+#if TORRENT_HAS_ARM_SHA1
+#include <arm_neon.h>
+#endif
 #include "libtorrent/aux_/disable_warnings_pop.hpp"
 
+#include <algorithm> // for min
+
+// the multi-buffer kernel is written with the GCC vector extensions, which
+// compile to SSE2 on x86-64 and NEON on AArch64. The 8 lane version is
+// compiled with AVX2 enabled, and only used if aux::avx2_support is true
+#if (defined __GNUC__ || defined __clang__) \
+	&& (defined __x86_64__ || (defined __aarch64__ && TORRENT_HAS_ARM_NEON))
+#define TORRENT_HAS_SHA1_MULTI 1
+#else
+#define TORRENT_HAS_SHA1_MULTI 0
+#endif
+
 typedef std::uint32_t u32;
 typedef std::uint8_t u8;
 
@@ -118,6 +139,329 @@ namespace {
 		state[4] += e;
 	}
 
+	// the transform functions hash a number of consecutive 64 byte blocks
+	template <class BlkFun>
+	struct portable_transform
+	{
+		static void apply(u32 state[5], u8 const* data, size_t blocks)
+		{
+			for (; blocks > 0; --blocks, data += 64)
+				SHA1transform<BlkFun>(state, data);
+		}
+	};
+
+#if TORRENT_HAS_SHA_NI
+
+#if defined __GNUC__
+#define TORRENT_SHA_NI_TARGET __attribute__((target("sha,ssse3,sse4.1")))
+#else
+#define TORRENT_SHA_NI_TARGET
+#endif
+
+	// this uses the intel SHA extensions. Each sha1rnds4 performs 4 rounds
+	// and the message schedule is computed 4 words at a time by sha1msg1,
+	// sha1msg2 and sha1nexte. This is only called if aux::sha_ni_support
+	// is true
+	TORRENT_SHA_NI_TARGET
+	void sha_ni_transform_impl(u32 state[5], u8 const* data, size_t blocks)
+	{
+		__m128i const mask = _mm_set_epi64x(0x0001020304050607ULL, 0x08090a0b0c0d0e0fULL);
+
+		__m128i abcd = _mm_loadu_si128(reinterpret_cast<__m128i const*>(state));
+		__m128i e0 = _mm_set_epi32(int(state[4]), 0, 0, 0);
+		abcd = _mm_shuffle_epi32(abcd, 0x1b);
+
+		for (; blocks > 0; --blocks, data += 64)
+		{
+			__m128i const abcd_save = abcd;
+			__m128i const e0_save = e0;
+			__m128i e1;
+
+			__m128i msg0 = _mm_shuffle_epi8(_mm_loadu_si128(
+				reinterpret_cast<__m128i const*>(data)), mask);
+			__m128i msg1 = _mm_shuffle_epi8(_mm_loadu_si128(
+				reinterpret_cast<__m128i const*>(data + 16)), mask);
+			__m128i msg2 = _mm_shuffle_epi8(_mm_loadu_si128(
+				reinterpret_cast<__m128i const*>(data + 32)), mask);
+			__m128i msg3 = _mm_shuffle_epi8(_mm_loadu_si128(
+				reinterpret_cast<__m128i const*>(data + 48)), mask);
+
+			// rounds 0-3
+			e0 = _mm_add_epi32(e0, msg0);
+			e1 = abcd;
+			abcd = _mm_sha1rnds4_epu32(abcd, e0, 0);
+
+			// rounds 4-7
+			e1 = _mm_sha1nexte_epu32(e1, msg1);
+			e0 = abcd;
+			abcd = _mm_sha1rnds4_epu32(abcd, e1, 0);
+			msg0 = _mm_sha1msg1_epu32(msg0, msg1);
+
+			// rounds 8-11
+			e0 = _mm_sha1nexte_epu32(e0, msg2);
+			e1 = abcd;
+			abcd = _mm_sha1rnds4_epu32(abcd, e0, 0);
+			msg1 = _mm_sha1msg1_epu32(msg1, msg2);
+			msg0 = _mm_xor_si128(msg0, msg2);
+
+// rounds 12-67 all follow the same pattern, with the message words rotating
+#define TORRENT_SHA_NI_ROUNDS(ecur, enext, m0, m1, m2, m3, f) \
+			ecur = _mm_sha1nexte_epu32(ecur, m0); \
+			enext = abcd; \
+			m1 = _mm_sha1msg2_epu32(m1, m0); \
+			abcd = _mm_sha1rnds4_epu32(abcd, ecur, f); \
+			m3 = _mm_sha1msg1_epu32(m3, m0); \
+			m2 = _mm_xor_si128(m2, m0)
+
+			TORRENT_SHA_NI_ROUNDS(e1, e0, msg3, msg0, msg1, msg2, 0); // 12-15
+			TORRENT_SHA_NI_ROUNDS(e0, e1, msg0, msg1, msg2, msg3, 0); // 16-19
+			TORRENT_SHA_NI_ROUNDS(e1, e0, msg1, msg2, msg3, msg0, 1); // 20-23
+			TORRENT_SHA_NI_ROUNDS(e0, e1, msg2, msg3, msg0, msg1, 1); // 24-27
+			TORRENT_SHA_NI_ROUNDS(e1, e0, msg3, msg0, msg1, msg2, 1); // 28-31
+			TORRENT_SHA_NI_ROUNDS(e0, e1, msg0, msg1, msg2, msg3, 1); // 32-35
+			TORRENT_SHA_NI_ROUNDS(e1, e0, msg1, msg2, msg3, msg0, 1); // 36-39
+			TORRENT_SHA_NI_ROUNDS(e0, e1, msg2, msg3, msg0, msg1, 2); // 40-43
+			TORRENT_SHA_NI_ROUNDS(e1, e0, msg3, msg0, msg1, msg2, 2); // 44-47
+			TORRENT_SHA_NI_ROUNDS(e0, e1, msg0, msg1, msg2, msg3, 2); // 48-51
+			TORRENT_SHA_NI_ROUNDS(e1, e0, msg1, msg2, msg3, msg0, 2); // 52-55
+			TORRENT_SHA_NI_ROUNDS(e0, e1, msg2, msg3, msg0, msg1, 2); // 56-59
+			TORRENT_SHA_NI_ROUNDS(e1, e0, msg3, msg0, msg1, msg2, 3); // 60-63
+			TORRENT_SHA_NI_ROUNDS(e0, e1, msg0, msg1, msg2, msg3, 3); // 64-67
+#undef TORRENT_SHA_NI_ROUNDS
+
+			// rounds 68-71
+			e1 = _mm_sha1nexte_epu32(e1, msg1);
+			e0 = abcd;
+			msg2 = _mm_sha1msg2_epu32(msg2, msg1);
+			abcd = _mm_sha1rnds4_epu32(abcd, e1, 3);
+			msg3 = _mm_xor_si128(msg3, msg1);
+
+			// rounds 72-75
+			e0 = _mm_sha1nexte_epu32(e0, msg2);
+			e1 = abcd;
+			msg3 = _mm_sha1msg2_epu32(msg3, msg2);
+			abcd = _mm_sha1rnds4_epu32(abcd, e0, 3);
+
+			// rounds 76-79
+			e1 = _mm_sha1nexte_epu32(e1, msg3);
+			e0 = abcd;
+			abcd = _mm_sha1rnds4_epu32(abcd, e1, 3);
+
+			e0 = _mm_sha1nexte_epu32(e0, e0_save);
+			abcd = _mm_add_epi32(abcd, abcd_save);
+		}
+
+		abcd = _mm_shuffle_epi32(abcd, 0x1b);
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(state), abcd);
+		state[4] = u32(_mm_extract_epi32(e0, 3));
+	}
+
+#undef TORRENT_SHA_NI_TARGET
+
+	struct sha_ni_transform
+	{
+		static void apply(u32 state[5], u8 const* data, size_t blocks)
+		{ sha_ni_transform_impl(state, data, blocks); }
+	};
+#endif // TORRENT_HAS_SHA_NI
+
+#if TORRENT_HAS_ARM_SHA1
+	// this uses the ARMv8 SHA1 instructions. Each of sha1c, sha1p and sha1m
+	// performs 4 rounds, the message schedule is computed by sha1su0 and
+	// sha1su1. This is only called if aux::arm_sha1_support is true
+	void arm_sha1_transform_impl(u32 state[5], u8 const* data, size_t blocks)
+	{
+		uint32x4_t const k0 = vdupq_n_u32(0x5A827999);
+		uint32x4_t const k1 = vdupq_n_u32(0x6ED9EBA1);
+		uint32x4_t const k2 = vdupq_n_u32(0x8F1BBCDC);
+		uint32x4_t const k3 = vdupq_n_u32(0xCA62C1D6);
+
+		uint32x4_t abcd = vld1q_u32(state);
+		u32 e0 = state[4];
+
+		for (; blocks > 0; --blocks, data += 64)
+		{
+			uint32x4_t const abcd_save = abcd;
+			u32 const e0_save = e0;
+			u32 e1;
+
+			uint32x4_t msg0 = vreinterpretq_u32_u8(vrev32q_u8(vld1q_u8(data)));
+			uint32x4_t msg1 = vreinterpretq_u32_u8(vrev32q_u8(vld1q_u8(data + 16)));
+			uint32x4_t msg2 = vreinterpretq_u32_u8(vrev32q_u8(vld1q_u8(data + 32)));
+			uint32x4_t msg3 = vreinterpretq_u32_u8(vrev32q_u8(vld1q_u8(data + 48)));
+
+			uint32x4_t tmp0 = vaddq_u32(msg0, k0);
+			uint32x4_t tmp1 = vaddq_u32(msg1, k0);
+
+// each group of 4 rounds hashes one of the pre-added message words and
+// prepares the one two groups ahead
+#define TORRENT_ARM_SHA1_ROUNDS(f, ein, eout, tcur, mnext, k) \
+			eout = vsha1h_u32(vgetq_lane_u32(abcd, 0)); \
+			abcd = f(abcd, ein, tcur); \
+			tcur = vaddq_u32(mnext, k)
+
+			TORRENT_ARM_SHA1_ROUNDS(vsha1cq_u32, e0, e1, tmp0, msg2, k0); // 0-3
+			msg0 = vsha1su0q_u32(msg0, msg1, msg2);
+			TORRENT_ARM_SHA1_ROUNDS(vsha1cq_u32, e1, e0, tmp1, msg3, k0); // 4-7
+			msg0 = vsha1su1q_u32(msg0, msg3);
+			msg1 = vsha1su0q_u32(msg1, msg2, msg3);
+			TORRENT_ARM_SHA1_ROUNDS(vsha1cq_u32, e0, e1, tmp0, msg0, k0); // 8-11
+			msg1 = vsha1su1q_u32(msg1, msg0);
+			msg2 = vsha1su0q_u32(msg2, msg3, msg0);
+			TORRENT_ARM_SHA1_ROUNDS(vsha1cq_u32, e1, e0, tmp1, msg1, k1); // 12-15
+			msg2 = vsha1su1q_u32(msg2, msg1);
+			msg3 = vsha1su0q_u32(msg3, msg0, msg1);
+			TORRENT_ARM_SHA1_ROUNDS(vsha1cq_u32, e0, e1, tmp0, msg2, k1); // 16-19
+			msg3 = vsha1su1q_u32(msg3, msg2);
+			msg0 = vsha1su0q_u32(msg0, msg1, msg2);
+			TORRENT_ARM_SHA1_ROUNDS(vsha1pq_u32, e1, e0, tmp1, msg3, k1); // 20-23
+			msg0 = vsha1su1q_u32(msg0, msg3);
+			msg1 = vsha1su0q_u32(msg1, msg2, msg3);
+			TORRENT_ARM_SHA1_ROUNDS(vsha1pq_u32, e0, e1, tmp0, msg0, k1); // 24-27
+			msg1 = vsha1su1q_u32(msg1, msg0);
+			msg2 = vsha1su0q_u32(msg2, msg3, msg0);
+			TORRENT_ARM_SHA1_ROUNDS(vsha1pq_u32, e1, e0, tmp1, msg1, k1); // 28-31
+			msg2 = vsha1su1q_u32(msg2, msg1);
+			msg3 = vsha1su0q_u32(msg3, msg0, msg1);
+			TORRENT_ARM_SHA1_ROUNDS(vsha1pq_u32, e0, e1, tmp0, msg2, k2); // 32-35
+			msg3 = vsha1su1q_u32(msg3, msg2);
+			msg0 = vsha1su0q_u32(msg0, msg1, msg2);
+			TORRENT_ARM_SHA1_ROUNDS(vsha1pq_u32, e1, e0, tmp1, msg3, k2); // 36-39
+			msg0 = vsha1su1q_u32(msg0, msg3);
+			msg1 = vsha1su0q_u32(msg1, msg2, msg3);
+			TORRENT_ARM_SHA1_ROUNDS(vsha1mq_u32, e0, e1, tmp0, msg0, k2); // 40-43
+			msg1 = vsha1su1q_u32(msg1, msg0);
+			msg2 = vsha1su0q_u32(msg2, msg3, msg0);
+			TORRENT_ARM_SHA1_ROUNDS(vsha1mq_u32, e1, e0, tmp1, msg1, k2); // 44-47
+			msg2 = vsha1su1q_u32(msg2, msg1);
+			msg3 = vsha1su0q_u32(msg3, msg0, msg1);
+			TORRENT_ARM_SHA1_ROUNDS(vsha1mq_u32, e0, e1, tmp0, msg2, k2); // 48-51
+			msg3 = vsha1su1q_u32(msg3, msg2);
+			msg0 = vsha1su0q_u32(msg0, msg1, msg2);
+			TORRENT_ARM_SHA1_ROUNDS(vsha1mq_u32, e1, e0, tmp1, msg3, k3); // 52-55
+			msg0 = vsha1su1q_u32(msg0, msg3);
+			msg1 = vsha1su0q_u32(msg1, msg2, msg3);
+			TORRENT_ARM_SHA1_ROUNDS(vsha1mq_u32, e0, e1, tmp0, msg0, k3); // 56-59
+			msg1 = vsha1su1q_u32(msg1, msg0);
+			msg2 = vsha1su0q_u32(msg2, msg3, msg0);
+			TORRENT_ARM_SHA1_ROUNDS(vsha1pq_u32, e1, e0, tmp1, msg1, k3); // 60-63
+			msg2 = vsha1su1q_u32(msg2, msg1);
+			msg3 = vsha1su0q_u32(msg3, msg0, msg1);
+			TORRENT_ARM_SHA1_ROUNDS(vsha1pq_u32, e0, e1, tmp0, msg2, k3); // 64-67
+			msg3 = vsha1su1q_u32(msg3, msg2);
+			TORRENT_ARM_SHA1_ROUNDS(vsha1pq_u32, e1, e0, tmp1, msg3, k3); // 68-71
+#undef TORRENT_ARM_SHA1_ROUNDS
+
+			// rounds 72-75
+			e1 = vsha1h_u32(vgetq_lane_u32(abcd, 0));
+			abcd = vsha1pq_u32(abcd, e0, tmp0);
+
+			// rounds 76-79
+			e0 = vsha1h_u32(vgetq_lane_u32(abcd, 0));
+			abcd = vsha1pq_u32(abcd, e1, tmp1);
+
+			e0 += e0_save;
+			abcd = vaddq_u32(abcd, abcd_save);
+		}
+
+		vst1q_u32(state, abcd);
+		state[4] = e0;
+	}
+
+	struct arm_sha1_transform
+	{
+		static void apply(u32 state[5], u8 const* data, size_t blocks)
+		{ arm_sha1_transform_impl(state, data, blocks); }
+	};
+#endif // TORRENT_HAS_ARM_SHA1
+
+#if TORRENT_HAS_SHA1_MULTI
+	typedef u32 u32x4 __attribute__((vector_size(16)));
+#if TORRENT_HAS_AVX2
+	typedef u32 u32x8 __attribute__((vector_size(32)));
+#endif
+
+	// a macro rather than a function, to not pass 32 byte vectors by value
+	// outside of the AVX2 enabled function
+#define TORRENT_VROL(v, bits) (((v) << (bits)) | ((v) >> (32 - (bits))))
+
+	// hashes blocks 64 byte blocks of each of the Lanes buffers in data,
+	// into the corresponding state. The lanes are the elements of the
+	// vector type V. The message words are gathered into the lanes by
+	// ordinary loads, the rounds are all vector operations
+	template <typename V, int Lanes>
+	__attribute__((always_inline)) inline
+	void multi_transform(u32* const* state, u8 const* const* data, size_t blocks)
+	{
+		V a, b, c, d, e;
+		for (int l = 0; l < Lanes; ++l)
+		{
+			a[l] = state[l][0];
+			b[l] = state[l][1];
+			c[l] = state[l][2];
+			d[l] = state[l][3];
+			e[l] = state[l][4];
+		}
+
+		for (size_t blk = 0; blk < blocks; ++blk)
+		{
+			V w[16];
+			for (int i = 0; i < 16; ++i)
+			{
+				for (int l = 0; l < Lanes; ++l)
+				{
+					u32 word;
+					std::memcpy(&word, data[l] + blk * 64 + std::size_t(i) * 4, 4);
+#if defined BOOST_BIG_ENDIAN
+					w[i][l] = word;
+#else
+					w[i][l] = __builtin_bswap32(word);
+#endif
+				}
+			}
+
+			V const a0 = a, b0 = b, c0 = c, d0 = d, e0 = e;
+
+#define TORRENT_SHA1_ROUND(i, f, k) do { \
+			if ((i) >= 16) w[(i) & 15] = TORRENT_VROL(w[((i) + 13) & 15] ^ w[((i) + 8) & 15] \
+				^ w[((i) + 2) & 15] ^ w[(i) & 15], 1); \
+			V const t = TORRENT_VROL(a, 5) + (f) + e + (k) + w[(i) & 15]; \
+			e = d; d = c; c = TORRENT_VROL(b, 30); b = a; a = t; } while (false)
+
+			for (int i = 0; i < 20; ++i) TORRENT_SHA1_ROUND(i, ((b & (c ^ d)) ^ d), 0x5A827999);
+			for (int i = 20; i < 40; ++i) TORRENT_SHA1_ROUND(i, (b ^ c ^ d), 0x6ED9EBA1);
+			for (int i = 40; i < 60; ++i) TORRENT_SHA1_ROUND(i, ((b & c) | (d & (b | c))), 0x8F1BBCDC);
+			for (int i = 60; i < 80; ++i) TORRENT_SHA1_ROUND(i, (b ^ c ^ d), 0xCA62C1D6);
+#undef TORRENT_SHA1_ROUND
+#undef TORRENT_VROL
+
+			a += a0;
+			b += b0;
+			c += c0;
+			d += d0;
+			e += e0;
+		}
+
+		for (int l = 0; l < Lanes; ++l)
+		{
+			state[l][0] = a[l];
+			state[l][1] = b[l];
+			state[l][2] = c[l];
+			state[l][3] = d[l];
+			state[l][4] = e[l];
+		}
+	}
+
+	void multi_transform_x4(u32* const* state, u8 const* const* data, size_t blocks)
+	{ multi_transform<u32x4, 4>(state, data, blocks); }
+
+#if TORRENT_HAS_AVX2
+	__attribute__((target("avx2")))
+	void multi_transform_x8(u32* const* state, u8 const* const* data, size_t blocks)
+	{ multi_transform<u32x8, 8>(state, data, blocks); }
+#endif
+#endif // TORRENT_HAS_SHA1_MULTI
+
 #ifdef VERBOSE
 	void SHAPrintContext(sha1_ctx *context, char *msg)
 	{
@@ -133,7 +477,7 @@ namespace {
 	}
 #endif
 
-	template <class BlkFun>
+	template <class Transform>
 	void internal_update(sha1_ctx* context, u8 const* data, size_t len)
 	{
 		using namespace std;
@@ -148,11 +492,10 @@ namespace {
 		if ((j + len) > 63)
 		{
 			memcpy(&context->buffer[j], data, (i = 64-j));
-			SHA1transform<BlkFun>(context->state, context->buffer);
-			for ( ; i + 63 < len; i += 64)
-			{
-				SHA1transform<BlkFun>(context->state, &data[i]);
-			}
+			Transform::apply(context->state, context->buffer, 1);
+			size_t const blocks = (len - i) / 64;
+			Transform::apply(context->state, &data[i], blocks);
+			i += blocks * 64;
 			j = 0;
 		}
 		else
@@ -194,21 +537,107 @@ void SHA1_update(sha1_ctx* context, u8 const* data, size_t len)
 {
 	// GCC standard defines for endianness
 	// test with: cpp -dM /dev/null
+#if TORRENT_HAS_SHA_NI
+	if (aux::sha_ni_support)
+	{
+		internal_update<sha_ni_transform>(context, data, len);
+		return;
+	}
+#endif
+#if TORRENT_HAS_ARM_SHA1
+	if (aux::arm_sha1_support)
+	{
+		internal_update<arm_sha1_transform>(context, data, len);
+		return;
+	}
+#endif
+
 #if defined BOOST_BIG_ENDIAN
-	internal_update<big_endian_blk0>(context, data, len);
+	internal_update<portable_transform<big_endian_blk0>>(context, data, len);
 #elif defined BOOST_LITTLE_ENDIAN
-	internal_update<little_endian_blk0>(context, data, len);
+	internal_update<portable_transform<little_endian_blk0>>(context, data, len);
 #else
 	// select different functions depending on endianess
 	// and figure out the endianess runtime
 	if (is_big_endian())
-		internal_update<big_endian_blk0>(context, data, len);
+		internal_update<portable_transform<big_endian_blk0>>(context, data, len);
 	else
-		internal_update<little_endian_blk0>(context, data, len);
+		internal_update<portable_transform<little_endian_blk0>>(context, data, len);
 #endif
 }
 
 
+int SHA1_multi_lanes()
+{
+#if TORRENT_HAS_SHA_NI
+	if (aux::sha_ni_support) return 1;
+#endif
+#if TORRENT_HAS_ARM_SHA1
+	if (aux::arm_sha1_support) return 1;
+#endif
+#if TORRENT_HAS_SHA1_MULTI
+#if TORRENT_HAS_AVX2
+	if (aux::avx2_support) return 8;
+#endif
+	return 4;
+#else
+	return 1;
+#endif
+}
+
+void SHA1_update_multi(sha1_ctx* const* contexts, u8 const* const* data
+	, size_t const len, int const num)
+{
+	int const lanes = SHA1_multi_lanes();
+	int i = 0;
+
+#if TORRENT_HAS_SHA1_MULTI
+	// the whole 64 byte blocks of the data of each group of lanes are hashed
+	// in lockstep. That requires all contexts in the group to be at a block
+	// boundary. The remainder of the data (and any group where that's not
+	// the case) falls back to SHA1_update()
+	size_t const blocks = len / 64;
+	if (lanes > 1 && blocks > 0)
+	{
+		for (; i + lanes <= num; i += lanes)
+		{
+			bool aligned = true;
+			for (int l = 0; l < lanes; ++l)
+				aligned = aligned && (contexts[i + l]->count[0] & 511) == 0;
+			if (!aligned)
+			{
+				for (int l = 0; l < lanes; ++l)
+					SHA1_update(contexts[i + l], data[i + l], len);
+				continue;
+			}
+
+			u32* state[8];
+			for (int l = 0; l < lanes; ++l)
+				state[l] = contexts[i + l]->state;
+#if TORRENT_HAS_AVX2
+			if (lanes == 8) multi_transform_x8(state, data + i, blocks);
+			else
+#endif
+			multi_transform_x4(state, data + i, blocks);
+
+			size_t const done = blocks * 64;
+			for (int l = 0; l < lanes; ++l)
+			{
+				sha1_ctx* const ctx = contexts[i + l];
+				if ((ctx->count[0] += u32(done << 3)) < u32(done << 3)) ctx->count[1]++;
+				ctx->count[1] += u32(done >> 29);
+				if (len > done) SHA1_update(ctx, data[i + l] + done, len - done);
+			}
+		}
+	}
+#else
+	TORRENT_UNUSED(lanes);
+#endif
+
+	for (; i < num; ++i)
+		SHA1_update(contexts[i], data[i], len);
+}
+
 // Add padding and return the message digest.
 
 void SHA1_final(u8* digest, sha1_ctx* context)
@@ -32,8 +32,9 @@ POSSIBILITY OF SUCH DAMAGE.
 
 #ifndef TORRENT_DISABLE_EXTENSIONS
 
+#include <algorithm>
 #include <vector>
-#include <map>
+#include <deque>
 #include <utility>
 #include <numeric>
 #include <cstdio>
@@ -64,6 +65,10 @@ class torrent;
 
 namespace {
 
+	// the max number of block records the plugin keeps per torrent. Once
+	// there are more than this, the records of the piece that failed the
+	// longest time ago are dropped
+	int const max_block_records = 16 * 1024;
 
 	struct smart_ban_plugin final
 		: torrent_plugin
@@ -74,6 +79,9 @@ namespace {
 			, m_salt(random(0xffffffff))
 		{}
 
+		std::uint32_t implemented_features() override
+		{ return piece_check_feature; }
+
 		void on_piece_pass(piece_index_t const p) override
 		{
 #ifndef TORRENT_DISABLE_LOGGING
@@ -81,101 +89,131 @@ namespace {
 				, static_cast<int>(p), int(m_block_hashes.size()));
 #endif
 			// has this piece failed earlier? If it has, go through the
-			// CRCs from the time it failed and ban the peers that
+			// digests from the time it failed and ban the peers that
 			// sent bad blocks
-			std::map<piece_block, block_entry>::iterator i = m_block_hashes.lower_bound(piece_block(p, 0));
-			if (i == m_block_hashes.end() || i->first.piece_index != p) return;
-
-			int size = m_torrent.torrent_file().piece_size(p);
-			peer_request r = {p, 0, (std::min)(16 * 1024, size)};
-			piece_block pb(p, 0);
-			while (size > 0)
+			auto const range = piece_records(p);
+			if (range.first != range.second)
 			{
-				if (i->first.block_index == pb.block_index)
-				{
-					m_torrent.session().disk_thread().async_read(m_torrent.storage()
-						, r, std::bind(&smart_ban_plugin::on_read_ok_block
-						, shared_from_this(), *i, i->second.peer->address(), _1, r.length, _2, _3)
-						, reinterpret_cast<void*>(1));
-					i = m_block_hashes.erase(i);
-				}
-				else
-				{
-					TORRENT_ASSERT(i->first.block_index > pb.block_index);
-				}
-
-				if (i == m_block_hashes.end() || i->first.piece_index != p)
-					break;
-
-				r.start += 16 * 1024;
-				size -= 16 * 1024;
-				r.length = (std::min)(16 * 1024, size);
-				++pb.block_index;
+				// the records are only needed to be compared against the good
+				// data, take them out of the table
+				std::vector<block_entry> records(range.first, range.second);
+				m_block_hashes.erase(range.first, range.second);
+				auto const failed = std::find(m_failed_pieces.begin()
+					, m_failed_pieces.end(), p);
+				TORRENT_ASSERT(failed != m_failed_pieces.end());
+				m_failed_pieces.erase(failed);
+
+				std::vector<address> addresses;
+				addresses.reserve(records.size());
+				for (auto const& e : records)
+					addresses.push_back(e.peer->address());
+
+				m_torrent.session().disk_thread().async_hash_blocks(m_torrent.storage()
+					, p, m_salt, std::bind(&smart_ban_plugin::on_hash_ok_piece
+					, shared_from_this(), std::move(records), std::move(addresses)
+					, _1, _2, _3));
 			}
 
-#ifndef NDEBUG
-			// make sure we actually removed all the entries for piece 'p'
-			i = m_block_hashes.lower_bound(piece_block(p, 0));
-			TORRENT_ASSERT(i == m_block_hashes.end() || i->first.piece_index != p);
-#endif
-
 			if (m_torrent.is_seed())
 			{
-				std::map<piece_block, block_entry>().swap(m_block_hashes);
-				return;
+				std::vector<block_entry>().swap(m_block_hashes);
+				std::deque<piece_index_t>().swap(m_failed_pieces);
 			}
 		}
 
 		void on_piece_failed(piece_index_t p) override
 		{
 			// The piece failed the hash check. Record
-			// the CRC and origin peer of every block
+			// the digest and origin peer of every block
 
 			// if the torrent is aborted, no point in starting
-			// a bunch of read operations on it
+			// to hash it
 			if (m_torrent.is_aborted()) return;
 
 			std::vector<torrent_peer*> downloaders;
 			m_torrent.picker().get_downloaders(downloaders, p);
 
-			int size = m_torrent.torrent_file().piece_size(p);
-			peer_request r = {p, 0, (std::min)(16*1024, size)};
-			piece_block pb(p, 0);
+			// the peers are looked up again by address once the blocks have
+			// been hashed, in case they have been removed by then. Blocks
+			// with no known downloader are left unspecified
+			std::vector<address> addresses;
+			addresses.reserve(downloaders.size());
 			for (auto const& i : downloaders)
-			{
-				if (i != nullptr)
-				{
-					// for very sad and involved reasons, this read need to force a copy out of the cache
-					// since the piece has failed, this block is very likely to be replaced with a newly
-					// downloaded one very soon, and to get a block by reference would fail, since the
-					// block read will have been deleted by the time it gets back to the network thread
-					m_torrent.session().disk_thread().async_read(m_torrent.storage(), r
-						, std::bind(&smart_ban_plugin::on_read_failed_block
-						, shared_from_this(), pb, i->address(), _1, r.length, _2, _3)
-						, reinterpret_cast<torrent_peer*>(1)
-						, disk_io_job::force_copy);
-				}
-
-				r.start += 16*1024;
-				size -= 16*1024;
-				r.length = (std::min)(16*1024, size);
-				++pb.block_index;
-			}
-			TORRENT_ASSERT(size <= 0);
+				addresses.push_back(i != nullptr ? i->address() : address());
+
+			// all blocks of the piece are hashed by a single disk job, which
+			// also reads the blocks before the failed piece is cleared from
+			// the cache
+			m_torrent.session().disk_thread().async_hash_blocks(m_torrent.storage()
+				, p, m_salt, std::bind(&smart_ban_plugin::on_hash_failed_piece
+				, shared_from_this(), std::move(addresses), _1, _2, _3));
 		}
 
 	private:
 
-		// this entry ties a specific block CRC to
+		// this entry ties a specific block digest to
 		// a peer.
 		struct block_entry
 		{
+			piece_index_t piece;
+			int block;
 			torrent_peer* peer;
 			sha1_hash digest;
 		};
 
-		void on_read_failed_block(piece_block b, address a
-			, disk_buffer_holder buffer, int const block_size, int
+		static bool block_less(block_entry const& lhs, block_entry const& rhs)
+		{
+			if (lhs.piece != rhs.piece) return lhs.piece < rhs.piece;
+			return lhs.block < rhs.block;
+		}
+
+		using record_iterator = std::vector<block_entry>::iterator;
+
+		// the range of records in m_block_hashes of piece ``p``
+		std::pair<record_iterator, record_iterator> piece_records(piece_index_t const p)
+		{
+			auto const first = std::lower_bound(m_block_hashes.begin(), m_block_hashes.end()
+				, p, [](block_entry const& e, piece_index_t const piece)
+				{ return e.piece < piece; });
+			auto const last = std::upper_bound(first, m_block_hashes.end()
+				, p, [](piece_index_t const piece, block_entry const& e)
+				{ return piece < e.piece; });
+			return {first, last};
+		}
+
+		void ban(torrent_peer* p, piece_index_t const piece, int const block
+			, sha1_hash const& digest1, sha1_hash const& digest2)
+		{
+#ifndef TORRENT_DISABLE_LOGGING
+			if (m_torrent.should_log())
+			{
+				char const* client = "-";
+				peer_info info;
+				if (p->connection)
+				{
+					p->connection->get_peer_info(info);
+					client = info.client.c_str();
+				}
+				m_torrent.debug_log(" BANNING PEER [ p: %d | b: %d | c: %s"
+					" | hash1: %s | hash2: %s | ip: %s ]"
+					, static_cast<int>(piece), block, client
+					, aux::to_hex(digest1).c_str()
+					, aux::to_hex(digest2).c_str()
+					, print_endpoint(p->ip()).c_str());
+			}
+#else
+			TORRENT_UNUSED(piece);
+			TORRENT_UNUSED(block);
+			TORRENT_UNUSED(digest1);
+			TORRENT_UNUSED(digest2);
+#endif
+			m_torrent.ban_peer(p);
+			if (p->connection) p->connection->disconnect(
+				errors::peer_banned, op_bittorrent);
+		}
+
+		void on_hash_failed_piece(std::vector<address> const& downloaders
+			, piece_index_t const piece, std::vector<sha1_hash> const& digests
 			, storage_error const& error)
 		{
 			TORRENT_ASSERT(m_torrent.session().is_single_thread());
@@ -183,81 +221,95 @@ namespace {
 			// ignore read errors
 			if (error) return;
 
-			hasher h;
-			h.update({buffer.get(), std::size_t(block_size)});
-			h.update(reinterpret_cast<char const*>(&m_salt), sizeof(m_salt));
+			auto const range = piece_records(piece);
+			std::vector<block_entry> new_records;
 
-			std::pair<peer_list::iterator, peer_list::iterator> const range
-				= m_torrent.find_peers(a);
+			int const num_blocks = int(std::min(digests.size(), downloaders.size()));
+			for (int b = 0; b < num_blocks; ++b)
+			{
+				address const& a = downloaders[std::size_t(b)];
+				if (a.is_unspecified()) continue;
 
-			// there is no peer with this address anymore
-			if (range.first == range.second) return;
+				std::vector<torrent_peer*> const peers = m_torrent.find_peers(a);
 
-			torrent_peer* p = (*range.first);
-			block_entry e = {p, h.final()};
+				// there is no peer with this address anymore
+				if (peers.empty()) continue;
 
-			std::map<piece_block, block_entry>::iterator i = m_block_hashes.lower_bound(b);
+				torrent_peer* p = peers.front();
+				sha1_hash const& digest = digests[std::size_t(b)];
 
-			if (i != m_block_hashes.end() && i->first == b && i->second.peer == p)
-			{
-				// this peer has sent us this block before
-				// if the peer is already banned, it doesn't matter if it sent
-				// good or bad data. Nothings going to change it
-				if (!p->banned && i->second.digest != e.digest)
+				auto const i = std::lower_bound(range.first, range.second, b
+					, [](block_entry const& e, int const block)
+					{ return e.block < block; });
+
+				if (i != range.second && i->block == b)
 				{
-					// this time the digest of the block is different
-					// from the first time it sent it
-					// at least one of them must be bad
-#ifndef TORRENT_DISABLE_LOGGING
-					if (m_torrent.should_log())
+					// this peer has sent us this block before
+					// if the peer is already banned, it doesn't matter if it sent
+					// good or bad data. Nothings going to change it
+					if (i->peer == p && !p->banned && i->digest != digest)
 					{
-						char const* client = "-";
-						peer_info info;
-						if (p->connection)
-						{
-							p->connection->get_peer_info(info);
-							client = info.client.c_str();
-						}
-						m_torrent.debug_log(" BANNING PEER [ p: %d | b: %d | c: %s"
-							" | hash1: %s | hash2: %s | ip: %s ]"
-							, static_cast<int>(b.piece_index), b.block_index, client
-							, aux::to_hex(i->second.digest).c_str()
-							, aux::to_hex(e.digest).c_str()
-							, print_endpoint(p->ip()).c_str());
+						// this time the digest of the block is different
+						// from the first time it sent it
+						// at least one of them must be bad
+						ban(p, piece, b, i->digest, digest);
 					}
-#endif
-					m_torrent.ban_peer(p);
-					if (p->connection) p->connection->disconnect(
-						errors::peer_banned, op_bittorrent);
+					// we already have an entry for this block, the first peer
+					// who sent it is the one we keep
+					continue;
 				}
-				// we already have this exact entry in the map
-				// we don't have to insert it
-				return;
-			}
 
-			m_block_hashes.insert(i, std::pair<const piece_block, block_entry>(b, e));
+				new_records.push_back({piece, b, p, digest});
 
 #ifndef TORRENT_DISABLE_LOGGING
-			if (m_torrent.should_log())
-			{
-				char const* client = "-";
-				peer_info info;
-				if (p->connection)
+				if (m_torrent.should_log())
 				{
-					p->connection->get_peer_info(info);
-					client = info.client.c_str();
+					char const* client = "-";
+					peer_info info;
+					if (p->connection)
+					{
+						p->connection->get_peer_info(info);
+						client = info.client.c_str();
+					}
+					m_torrent.debug_log(" STORE BLOCK CRC [ p: %d | b: %d | c: %s"
+						" | digest: %s | ip: %s ]"
+						, static_cast<int>(piece), b, client
+						, aux::to_hex(digest).c_str()
+						, print_address(p->ip().address()).c_str());
 				}
-				m_torrent.debug_log(" STORE BLOCK CRC [ p: %d | b: %d | c: %s"
-					" | digest: %s | ip: %s ]"
-					, static_cast<int>(b.piece_index), b.block_index, client
-					, aux::to_hex(e.digest).c_str()
-					, print_address(p->ip().address()).c_str());
-			}
 #endif
+			}
+
+			if (new_records.empty()) return;
+
+			// the new records are sorted by block, merge them into the table
+			// in a single linear pass
+			std::size_t const mid = m_block_hashes.size();
+			m_block_hashes.insert(m_block_hashes.end(), new_records.begin(), new_records.end());
+			std::inplace_merge(m_block_hashes.begin()
+				, m_block_hashes.begin() + std::ptrdiff_t(mid), m_block_hashes.end()
+				, &smart_ban_plugin::block_less);
+
+			if (std::find(m_failed_pieces.begin(), m_failed_pieces.end(), piece)
+				== m_failed_pieces.end())
+				m_failed_pieces.push_back(piece);
+
+			// bound the memory used by the table by forgetting the pieces that
+			// failed the longest time ago. Their peers can't be pinned down
+			// anymore then, but they'll most likely have sent bad data again
+			// since
+			while (int(m_block_hashes.size()) > max_block_records
+				&& m_failed_pieces.size() > 1)
+			{
+				auto const r = piece_records(m_failed_pieces.front());
+				m_block_hashes.erase(r.first, r.second);
+				m_failed_pieces.pop_front();
+			}
 		}
 
-		void on_read_ok_block(std::pair<piece_block, block_entry> b, address a
-			, disk_buffer_holder buffer, int const block_size, int
+		void on_hash_ok_piece(std::vector<block_entry> const& records
+			, std::vector<address> const& addresses
+			, piece_index_t const piece, std::vector<sha1_hash> const& digests
 			, storage_error const& error)
 		{
 			TORRENT_ASSERT(m_torrent.session().is_single_thread());
@@ -265,59 +317,39 @@ namespace {
 			// ignore read errors
 			if (error) return;
 
-			hasher h;
-			h.update({buffer.get(), std::size_t(block_size)});
-			h.update(reinterpret_cast<char const*>(&m_salt), sizeof(m_salt));
-			sha1_hash const ok_digest = h.final();
+			for (std::size_t k = 0; k < records.size(); ++k)
+			{
+				block_entry const& e = records[k];
+				if (e.block >= int(digests.size())) continue;
+				sha1_hash const& ok_digest = digests[std::size_t(e.block)];
 
-			if (b.second.digest == ok_digest) return;
+				if (e.digest == ok_digest) continue;
 
-			// find the peer
-			std::pair<peer_list::iterator, peer_list::iterator> range
-				= m_torrent.find_peers(a);
-			if (range.first == range.second) return;
-			torrent_peer* p = nullptr;
-			for (; range.first != range.second; ++range.first)
-			{
-				if (b.second.peer != *range.first) continue;
-				p = *range.first;
-			}
-			if (p == nullptr) return;
+				// find the peer
+				std::vector<torrent_peer*> const peers = m_torrent.find_peers(addresses[k]);
+				auto const it = std::find(peers.begin(), peers.end(), e.peer);
+				if (it == peers.end()) continue;
 
-#ifndef TORRENT_DISABLE_LOGGING
-			if (m_torrent.should_log())
-			{
-				char const* client = "-";
-				peer_info info;
-				if (p->connection)
-				{
-					p->connection->get_peer_info(info);
-					client = info.client.c_str();
-				}
-				m_torrent.debug_log(" BANNING PEER [ p: %d | b: %d | c: %s"
-					" | ok_digest: %s | bad_digest: %s | ip: %s ]"
-					, static_cast<int>(b.first.piece_index), b.first.block_index, client
-					, aux::to_hex(ok_digest).c_str()
-					, aux::to_hex(b.second.digest).c_str()
-					, print_address(p->ip().address()).c_str());
+				ban(*it, piece, e.block, ok_digest, e.digest);
 			}
-#endif
-			m_torrent.ban_peer(p);
-			if (p->connection) p->connection->disconnect(
-				errors::peer_banned, op_bittorrent);
 		}
 
 		torrent& m_torrent;
 
-		// This table maps a piece_block (piece and block index
-		// pair) to a peer and the block CRC. The CRC is calculated
-		// from the data in the block + the salt
-		std::map<piece_block, block_entry> m_block_hashes;
+		// This table ties a block (piece and block index
+		// pair) to a peer and the block digest. The digest is calculated
+		// from the data in the block + the salt. It's sorted by piece and
+		// block, and holds at most max_block_records entries (unless a
+		// single piece has more blocks than that)
+		std::vector<block_entry> m_block_hashes;
+
+		// the pieces with records in m_block_hashes, in the order they
+		// first failed
+		std::deque<piece_index_t> m_failed_pieces;
 
-		// This salt is a random value used to calculate the block CRCs
-		// Since the CRC function that is used is not a one way function
-		// the salt is required to avoid attacks where bad data is sent
-		// that is forged to match the CRC of the good data.
+		// This salt is a random value used to calculate the block digests.
+		// It makes it infeasible to forge bad data whose digest matches the
+		// one of the good data
 		std::uint32_t const m_salt;
 
 		// explicitly disallow assignment, to silence msvc warning
@@ -344,6 +344,22 @@ namespace libtorrent {
 		}
 	}
 
+	void socket_type::set_utp_cubic(bool const cubic)
+	{
+		switch (m_type)
+		{
+			case socket_type_int_impl<utp_stream>::value:
+				get<utp_stream>()->set_cubic(cubic);
+				break;
+#ifdef TORRENT_USE_OPENSSL
+			case socket_type_int_impl<ssl_stream<utp_stream>>::value:
+				get<ssl_stream<utp_stream>>()->lowest_layer().set_cubic(cubic);
+				break;
+#endif
+			default: break;
+		}
+	}
+
 	close_reason_t socket_type::get_close_reason()
 	{
 		switch (m_type)
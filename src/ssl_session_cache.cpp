@@ -0,0 +1,140 @@
+/*
+
+Copyright (c) 2017, Arvid Norberg
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions
+are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in
+      the documentation and/or other materials provided with the distribution.
+    * Neither the name of the author nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+#include "libtorrent/aux_/ssl_session_cache.hpp"
+
+#ifdef TORRENT_USE_OPENSSL
+
+#include "libtorrent/assert.hpp"
+
+namespace libtorrent { namespace aux {
+
+namespace {
+
+	// attached to the SSL object of every connection set up by prepare(), to
+	// know where to put the session once it's been established
+	struct session_tag
+	{
+		std::weak_ptr<ssl_session_cache> cache;
+		tcp::endpoint ep;
+	};
+
+	void free_tag(void*, void* ptr, CRYPTO_EX_DATA*, int, long, void*)
+	{
+		delete static_cast<session_tag*>(ptr);
+	}
+
+	int tag_index()
+	{
+		static int const idx = SSL_get_ex_new_index(0, nullptr, nullptr, nullptr, &free_tag);
+		return idx;
+	}
+}
+
+	ssl_session_cache::ssl_session_cache(int const max_size)
+		: m_max_size(max_size)
+	{
+		TORRENT_ASSERT(max_size > 0);
+	}
+
+	ssl_session_cache::~ssl_session_cache()
+	{
+		for (auto const& s : m_sessions)
+			SSL_SESSION_free(s.second);
+	}
+
+	void ssl_session_cache::enable_resumption(SSL_CTX* ctx, span<char const> sid_ctx)
+	{
+		// the session id context can't be longer than 32 bytes
+		TORRENT_ASSERT(sid_ctx.size() <= SSL_MAX_SID_CTX_LENGTH);
+		SSL_CTX_set_session_id_context(ctx
+			, reinterpret_cast<unsigned char const*>(sid_ctx.data())
+			, static_cast<unsigned int>(sid_ctx.size()));
+
+		// the client side sessions are stored in the ssl_session_cache of the
+		// torrent, rather than OpenSSL's internal cache, which is only keyed by
+		// session id
+		SSL_CTX_set_session_cache_mode(ctx, SSL_SESS_CACHE_BOTH);
+		SSL_CTX_sess_set_new_cb(ctx, &ssl_session_cache::on_new_session);
+	}
+
+	void ssl_session_cache::prepare(SSL* ssl, tcp::endpoint const& ep)
+	{
+		auto const i = m_sessions.find(ep);
+		if (i != m_sessions.end()) SSL_set_session(ssl, i->second);
+
+		session_tag* tag = new session_tag{shared_from_this(), ep};
+		if (SSL_set_ex_data(ssl, tag_index(), tag) == 0) delete tag;
+	}
+
+	int ssl_session_cache::on_new_session(SSL* ssl, SSL_SESSION* s)
+	{
+		// this is called for incoming connections too, which don't have a tag.
+		// We only remember sessions we can attempt to resume ourselves
+		auto const* tag = static_cast<session_tag const*>(SSL_get_ex_data(ssl, tag_index()));
+		if (tag == nullptr) return 0;
+		std::shared_ptr<ssl_session_cache> cache = tag->cache.lock();
+		if (!cache) return 0;
+#if OPENSSL_VERSION_NUMBER >= 0x10101000L
+		// OpenSSL marks the session of a connection that's closed without a
+		// TLS shutdown as not resumable. Peers are frequently disconnected
+		// that way, so hold on to a copy instead, which isn't affected by it
+		SSL_SESSION* copy = SSL_SESSION_dup(s);
+		if (copy) cache->insert(tag->ep, copy);
+		return 0;
+#else
+		cache->insert(tag->ep, s);
+		// returning 1 tells OpenSSL we hold on to the reference
+		return 1;
+#endif
+	}
+
+	void ssl_session_cache::insert(tcp::endpoint const& ep, SSL_SESSION* s)
+	{
+		auto const i = m_sessions.find(ep);
+		if (i != m_sessions.end())
+		{
+			SSL_SESSION_free(i->second);
+			i->second = s;
+			return;
+		}
+
+		if (int(m_sessions.size()) >= m_max_size)
+		{
+			SSL_SESSION_free(m_sessions.begin()->second);
+			m_sessions.erase(m_sessions.begin());
+		}
+		m_sessions.emplace(ep, s);
+	}
+}}
+
+#endif // TORRENT_USE_OPENSSL
@@ -0,0 +1,234 @@
+/*
+
+Copyright (c) 2017, Arvid Norberg
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions
+are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in
+      the documentation and/or other materials provided with the distribution.
+    * Neither the name of the author nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+#ifndef TORRENT_DISABLE_EXTENSIONS
+
+#include "libtorrent/extensions/stats_recorder.hpp"
+#include "libtorrent/extensions.hpp"
+#include "libtorrent/session_handle.hpp"
+#include "libtorrent/session_stats.hpp"
+#include "libtorrent/alert_types.hpp"
+#include "libtorrent/performance_counters.hpp"
+#include "libtorrent/io.hpp"
+#include "libtorrent/time.hpp"
+
+#include <array>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <iterator>
+#include <vector>
+
+// The file written by the stats recorder has this layout. All fixed size
+// integers are big endian. Varints are 7 bits per byte, least significant
+// group first, with the high bit set on all but the last byte.
+//
+// header:
+//   8 bytes    "ltstats\0"
+//   uint32     format version (1)
+//   uint64     time of the first sample, microseconds since the UNIX epoch
+//   uint32     the number of values in each sample
+//   uint32     the number of metrics
+//   for each metric:
+//     uint32   the index of its value in the sample
+//     uint8    0 = counter, 1 = gauge
+//     uint8    length of the name
+//     ...      the name (not null terminated)
+//
+// followed by one record per sample:
+//   uint8      0 = difference to the previous sample, 1 = complete snapshot
+//   varint     milliseconds since the previous sample
+//   varint     the size of the payload
+//   ...        payload, as encoded by encode_session_stats_delta(). Complete
+//              snapshots are encoded as the difference to all zeros
+
+namespace libtorrent {
+
+namespace {
+
+	// store a complete snapshot this often (in number of samples). At one
+	// sample per second, this is every 10 minutes
+	int const keyframe_interval = 600;
+
+	void write_varint(std::uint64_t v, std::vector<char>& out)
+	{
+		while (v >= 0x80)
+		{
+			out.push_back(char((v & 0x7f) | 0x80));
+			v >>= 7;
+		}
+		out.push_back(char(v));
+	}
+
+	struct stats_recorder final : plugin
+	{
+		stats_recorder(FILE* f, int const interval)
+			: m_file(f)
+			, m_interval(interval)
+			, m_start(clock_type::now())
+			, m_last_post(m_start)
+			, m_last_sample(m_start)
+		{
+			m_prev.fill(0);
+			write_header();
+		}
+
+		stats_recorder(stats_recorder const&) = delete;
+		stats_recorder& operator=(stats_recorder const&) = delete;
+
+		~stats_recorder() override
+		{
+			std::fclose(m_file);
+		}
+
+		std::uint32_t implemented_features() override
+		{ return tick_feature | alert_feature; }
+
+		void added(session_handle const& ses) override
+		{
+			m_ses = session_handle(ses.native_handle());
+		}
+
+		void on_tick() override
+		{
+			if (m_interval <= 0) return;
+			time_point const now = clock_type::now();
+			if (now - m_last_post < milliseconds(m_interval)) return;
+			m_last_post = now;
+			m_ses.post_session_stats();
+		}
+
+		void on_alert(alert const* a) override
+		{
+			auto const* ss = alert_cast<session_stats_alert>(a);
+			if (ss == nullptr) return;
+
+			// alerts may be posted from more than one thread. Samples that
+			// arrive out of order are recorded at the same time as the
+			// previous one
+			time_point const t = std::max(ss->timestamp(), m_last_sample);
+			std::int64_t const ms = total_milliseconds(t - m_last_sample);
+			m_last_sample = t;
+
+			bool const keyframe = m_since_keyframe == 0;
+			if (keyframe)
+			{
+				m_since_keyframe = keyframe_interval;
+				m_prev.fill(0);
+			}
+			--m_since_keyframe;
+
+			m_payload.clear();
+			encode_session_stats_delta(m_prev, ss->values, m_payload);
+			m_prev = ss->values;
+
+			m_buf.clear();
+			m_buf.push_back(keyframe ? 1 : 0);
+			write_varint(std::uint64_t(ms), m_buf);
+			write_varint(m_payload.size(), m_buf);
+			m_buf.insert(m_buf.end(), m_payload.begin(), m_payload.end());
+			std::fwrite(m_buf.data(), 1, m_buf.size(), m_file);
+
+			// make the file readable up to the latest snapshot, without
+			// flushing on every sample
+			if (keyframe) std::fflush(m_file);
+		}
+
+	private:
+
+		void write_header()
+		{
+			std::vector<stats_metric> const metrics = session_stats_metrics();
+			std::uint64_t const start = std::uint64_t(
+				std::chrono::duration_cast<std::chrono::microseconds>(
+				std::chrono::system_clock::now().time_since_epoch()).count());
+
+			std::vector<char> header;
+			auto out = std::back_inserter(header);
+			char const magic[] = "ltstats";
+			header.insert(header.end(), magic, magic + sizeof(magic));
+			detail::write_uint32(1, out);
+			detail::write_uint64(start, out);
+			detail::write_uint32(counters::num_counters, out);
+			detail::write_uint32(metrics.size(), out);
+			for (auto const& m : metrics)
+			{
+				std::size_t const len = std::min(std::strlen(m.name), std::size_t(255));
+				detail::write_uint32(m.value_index, out);
+				detail::write_uint8(m.type == stats_metric::type_gauge ? 1 : 0, out);
+				detail::write_uint8(len, out);
+				header.insert(header.end(), m.name, m.name + len);
+			}
+			std::fwrite(header.data(), 1, header.size(), m_file);
+			std::fflush(m_file);
+		}
+
+		FILE* const m_file;
+
+		// the number of milliseconds between calls to post_session_stats(),
+		// or 0 to not post them
+		int const m_interval;
+
+		session_handle m_ses;
+
+		time_point const m_start;
+		time_point m_last_post;
+		time_point m_last_sample;
+
+		// the number of samples left until the next complete snapshot
+		int m_since_keyframe = 0;
+
+		// the values of the last sample we recorded
+		std::array<std::int64_t, counters::num_counters> m_prev;
+
+		// these are kept around to reuse their storage across samples
+		std::vector<char> m_payload;
+		std::vector<char> m_buf;
+	};
+
+} // anonymous namespace
+
+	std::shared_ptr<plugin> create_stats_recorder_plugin(std::string const& path
+		, int const interval, error_code& ec)
+	{
+		FILE* f = std::fopen(path.c_str(), "wb");
+		if (f == nullptr)
+		{
+			ec.assign(errno, generic_category());
+			return {};
+		}
+		return std::make_shared<stats_recorder>(f, interval);
+	}
+}
+
+#endif // TORRENT_DISABLE_EXTENSIONS
@@ -33,12 +33,15 @@ POSSIBILITY OF SUCH DAMAGE.
 #include "libtorrent/config.hpp"
 #include "libtorrent/error_code.hpp"
 #include "libtorrent/aux_/storage_utils.hpp"
+#include "libtorrent/aux_/io_uring.hpp"
+#include "libtorrent/aux_/alloca.hpp"
 
 #include <ctime>
 #include <algorithm>
 #include <set>
 #include <functional>
 #include <cstdio>
+#include <limits>
 
 #include "libtorrent/aux_/disable_warnings_push.hpp"
 
@@ -55,6 +58,10 @@ POSSIBILITY OF SUCH DAMAGE.
 #include <sys/statfs.h>
 #endif
 
+#if TORRENT_HAVE_MMAP
+#include <sys/mman.h>
+#endif
+
 #if defined(__FreeBSD__)
 // for statfs()
 #include <sys/param.h>
@@ -77,12 +84,58 @@ POSSIBILITY OF SUCH DAMAGE.
 
 namespace libtorrent {
 
+namespace {
+
+	// in full allocation mode, disk space is reserved in chunks of this size
+	// as files are being written to
+	std::int64_t const reserve_chunk_size = 16 * 1024 * 1024;
+}
+
 	void clear_bufs(span<iovec_t const> bufs)
 	{
 		for (auto buf : bufs)
 			std::memset(buf.iov_base, 0, buf.iov_len);
 	}
 
+	// the part file stores each piece in its own slot, so operations spanning
+	// more than one piece have to be split up at the piece boundaries. ``op``
+	// is called once per piece, with the buffers for that piece
+	template <typename Op>
+	int partfile_op(file_storage const& fs, file_index_t const file_index
+		, std::int64_t const file_offset, span<iovec_t const> bufs
+		, error_code& ec, Op op)
+	{
+		peer_request const map = fs.map_file(file_index, file_offset, 0);
+		int const size = bufs_size(bufs);
+		if (size <= fs.piece_size(map.piece) - map.start)
+			return op(bufs, map.piece, map.start, ec);
+
+		TORRENT_ALLOCA(current, iovec_t, bufs.size());
+		aux::copy_bufs(bufs, size, current);
+		TORRENT_ALLOCA(tmp_buf, iovec_t, bufs.size());
+		span<iovec_t> const tmp = tmp_buf;
+		span<iovec_t> cur = current;
+
+		piece_index_t piece = map.piece;
+		int start = map.start;
+		int left = size;
+		int ret = 0;
+		for (;;)
+		{
+			int const chunk = std::min(left, fs.piece_size(piece) - start);
+			int const num_bufs = aux::copy_bufs(cur, chunk, tmp);
+			int const r = op(tmp.first(std::size_t(num_bufs)), piece, start, ec);
+			if (r < 0) return -1;
+			ret += r;
+			left -= chunk;
+			if (r < chunk || left == 0) break;
+			cur = aux::advance_bufs(cur, chunk);
+			++piece;
+			start = 0;
+		}
+		return ret;
+	}
+
 	struct write_fileop final : aux::fileop
 	{
 		write_fileop(default_storage& st, std::uint32_t const flags)
@@ -107,10 +160,12 @@ namespace libtorrent {
 				m_storage.need_partfile();
 
 				error_code e;
-				peer_request map = m_storage.files().map_file(file_index
-					, file_offset, 0);
-				int ret = m_storage.m_part_file->writev(bufs
-					, map.piece, map.start, e);
+				part_file& pf = *m_storage.m_part_file;
+				int const ret = partfile_op(m_storage.files(), file_index
+					, file_offset, bufs, e
+					, [&pf](span<iovec_t const> b, piece_index_t const piece
+						, int const start, error_code& err)
+					{ return pf.writev(b, piece, start, err); });
 
 				if (e)
 				{
@@ -138,6 +193,19 @@ namespace libtorrent {
 				file_offset;
 
 			error_code e;
+			if (m_storage.m_allocate_files)
+			{
+				m_storage.reserve_space(file_index, *handle, adjusted_offset
+					, bufs_size(bufs), e);
+				if (e)
+				{
+					ec.ec = e;
+					ec.file(file_index);
+					ec.operation = storage_error::fallocate;
+					return -1;
+				}
+			}
+
 			int const ret = int(handle->writev(adjusted_offset
 				, bufs, e, m_flags));
 
@@ -165,9 +233,12 @@ namespace libtorrent {
 
 	struct read_fileop final : aux::fileop
 	{
-		read_fileop(default_storage& st, std::uint32_t const flags)
+		read_fileop(default_storage& st, std::uint32_t const flags
+			, aux::io_uring_batch* batch = nullptr, int const tag = 0)
 			: m_storage(st)
 			, m_flags(flags)
+			, m_batch(batch)
+			, m_tag(tag)
 		{}
 
 		int file_op(file_index_t const file_index
@@ -188,10 +259,12 @@ namespace libtorrent {
 				m_storage.need_partfile();
 
 				error_code e;
-				peer_request map = m_storage.files().map_file(file_index
-					, file_offset, 0);
-				int ret = m_storage.m_part_file->readv(bufs
-					, map.piece, map.start, e);
+				part_file& pf = *m_storage.m_part_file;
+				int const ret = partfile_op(m_storage.files(), file_index
+					, file_offset, bufs, e
+					, [&pf](span<iovec_t const> b, piece_index_t const piece
+						, int const start, error_code& err)
+					{ return pf.readv(b, piece, start, err); });
 
 				if (e)
 				{
@@ -214,6 +287,16 @@ namespace libtorrent {
 #endif
 				file_offset;
 
+			if (m_batch != nullptr)
+			{
+				// the read is issued later, together with the rest of the
+				// batch. pretend it was successful for now
+				m_batch->add_readv(std::move(handle), adjusted_offset, bufs
+					, m_tag, m_flags);
+				ec.operation = storage_error::read;
+				return bufs_size(bufs);
+			}
+
 			error_code e;
 			int const ret = int(handle->readv(adjusted_offset
 				, bufs, e, m_flags));
@@ -239,6 +322,8 @@ namespace libtorrent {
 	private:
 		default_storage& m_storage;
 		std::uint32_t const m_flags;
+		aux::io_uring_batch* m_batch;
+		int const m_tag;
 	};
 
 	default_storage::default_storage(storage_params const& params
@@ -631,6 +716,15 @@ namespace libtorrent {
 		return readwritev(files(), bufs, piece, offset, op, ec);
 	}
 
+	bool default_storage::readv_batch(aux::io_uring_batch& batch, int const tag
+		, span<iovec_t const> bufs, piece_index_t const piece, int const offset
+		, std::uint32_t const flags, storage_error& ec)
+	{
+		read_fileop op(*this, flags, &batch, tag);
+		readwritev(files(), bufs, piece, offset, op, ec);
+		return true;
+	}
+
 	int default_storage::writev(span<iovec_t const> bufs
 		, piece_index_t const piece, int const offset
 		, std::uint32_t const flags, storage_error& ec)
@@ -639,6 +733,40 @@ namespace libtorrent {
 		return readwritev(files(), bufs, piece, offset, op, ec);
 	}
 
+	bool default_storage::is_sparse_piece(piece_index_t const piece)
+	{
+		file_storage const& fs = files();
+		std::vector<file_slice> const slices = fs.map_block(piece, 0
+			, fs.piece_size(piece));
+		for (auto const& s : slices)
+		{
+			if (fs.pad_file_at(s.file_index)) continue;
+
+			// we don't look for holes in the part file
+			if (s.file_index < m_file_priority.end_index()
+				&& m_file_priority[s.file_index] == 0)
+				return false;
+
+			storage_error se;
+			file_handle handle = open_file(s.file_index, file::read_only, se);
+			if (se) return false;
+
+			std::int64_t const file_offset =
+#ifndef TORRENT_NO_DEPRECATE
+				fs.file_base_deprecated(s.file_index) +
+#endif
+				s.offset;
+			std::int64_t const end = file_offset + s.size;
+
+			// if the file is short, let the read fail, to have the whole file
+			// skipped
+			error_code ec;
+			if (handle->get_size(ec) < end || ec) return false;
+			if (handle->sparse_end(file_offset) < end) return false;
+		}
+		return true;
+	}
+
 	file_handle default_storage::open_file(file_index_t const file
 		, std::uint32_t mode, storage_error& ec) const
 	{
@@ -685,7 +813,27 @@ namespace libtorrent {
 			{
 				error_code e;
 				std::int64_t const size = files().file_size(file);
-				h->set_size(size, e);
+
+				// allocating all of a large file can stall this disk thread for
+				// a long time. If the file system supports it, only reserve the
+				// last chunk now (which sets the size of the file). The
+				// rest is reserved as the file is written to
+				std::int64_t const tail = size == 0 ? 0
+					: (size - 1) / reserve_chunk_size * reserve_chunk_size;
+				if (size > 0 && h->reserve(tail, size - tail, e))
+				{
+					int const num_chunks = int(tail / reserve_chunk_size) + 1;
+					std::lock_guard<std::mutex> l(m_reserve_mutex);
+					if (m_reserved_chunks.end_index() <= file)
+						m_reserved_chunks.resize(files().num_files());
+					m_reserved_chunks[file].resize(num_chunks);
+					m_reserved_chunks[file].clear_all();
+					m_reserved_chunks[file].set_bit(num_chunks - 1);
+				}
+				else if (!e)
+				{
+					h->set_size(size, e);
+				}
 				m_file_created.set_bit(file);
 				if (e)
 				{
@@ -700,6 +848,33 @@ namespace libtorrent {
 		return h;
 	}
 
+	void default_storage::reserve_space(file_index_t const index, file& f
+		, std::int64_t const offset, std::int64_t const size, error_code& ec)
+	{
+		if (size <= 0) return;
+		int first;
+		int end;
+		{
+			std::lock_guard<std::mutex> l(m_reserve_mutex);
+			if (index >= m_reserved_chunks.end_index()) return;
+			bitfield& chunks = m_reserved_chunks[index];
+			if (chunks.empty()) return;
+
+			first = int(offset / reserve_chunk_size);
+			end = std::min(chunks.size()
+				, int((offset + size - 1) / reserve_chunk_size) + 2);
+			while (first < end && chunks.get_bit(first)) ++first;
+			while (end > first && chunks.get_bit(end - 1)) --end;
+			if (first == end) return;
+			for (int i = first; i < end; ++i) chunks.set_bit(i);
+		}
+
+		std::int64_t const start = std::int64_t(first) * reserve_chunk_size;
+		std::int64_t const stop = std::min(std::int64_t(end) * reserve_chunk_size
+			, files().file_size(index));
+		f.reserve(start, stop - start, ec);
+	}
+
 	file_handle default_storage::open_file_impl(file_index_t file, std::uint32_t mode
 		, error_code& ec) const
 	{
@@ -715,12 +890,13 @@ namespace libtorrent {
 		if (m_settings && settings().get_bool(settings_pack::no_atime_storage)) mode |= file::no_atime;
 
 		// if we have a cache already, don't store the data twice by leaving it in the OS cache as well
-		if (m_settings
-			&& settings().get_int(settings_pack::disk_io_write_mode)
-			== settings_pack::disable_os_cache)
-		{
+		int const io_mode = m_settings
+			? settings().get_int(settings_pack::disk_io_write_mode)
+			: settings_pack::enable_os_cache;
+		if (io_mode == settings_pack::disable_os_cache)
 			mode |= file::no_cache;
-		}
+		else if (io_mode == settings_pack::direct_io)
+			mode |= file::direct_io;
 
 		file_handle ret = m_pool.open_file(storage_index(), m_save_path, file
 			, files(), mode, ec);
@@ -751,6 +927,233 @@ namespace libtorrent {
 		return new default_storage(params, pool);
 	}
 
+	// -- mmap_storage ------------------------------------------------------
+
+#if TORRENT_HAVE_MMAP
+
+namespace aux {
+
+	// a read-only or read-write mapping of an entire file. The region is
+	// unmapped once the last operation using it completes
+	struct file_mapping : boost::noncopyable
+	{
+		file_mapping(void* p, std::int64_t const s, bool const w)
+			: base(static_cast<char*>(p)), size(s), writable(w) {}
+		~file_mapping()
+		{
+			if (base != nullptr) ::munmap(base, std::size_t(size));
+		}
+
+		char* const base;
+		std::int64_t const size;
+		bool const writable;
+	};
+}
+
+	struct mmap_fileop final : aux::fileop
+	{
+		mmap_fileop(mmap_storage& st, std::uint32_t const flags, bool const write)
+			: m_storage(st)
+			, m_flags(flags)
+			, m_write(write)
+		{}
+
+		int file_op(file_index_t const file_index
+			, std::int64_t const file_offset
+			, span<iovec_t const> bufs, storage_error& ec)
+			final
+		{
+			default_storage& ds = m_storage;
+			if (ds.files().pad_file_at(file_index)
+				|| (file_index < ds.m_file_priority.end_index()
+					&& ds.m_file_priority[file_index] == 0))
+			{
+				return fallback(file_index, file_offset, bufs, ec);
+			}
+
+			std::shared_ptr<aux::file_mapping> m = m_storage.map_file(file_index
+				, m_write, ec);
+			if (ec) return -1;
+			if (!m) return fallback(file_index, file_offset, bufs, ec);
+
+			// please ignore the adjusted_offset. It's just file_offset.
+			std::int64_t offset =
+#ifndef TORRENT_NO_DEPRECATE
+				ds.files().file_base_deprecated(file_index) +
+#endif
+				file_offset;
+
+			if (m_write)
+			{
+				// invalidate our stat cache for this file, since
+				// we're writing to it
+				ds.m_stat_cache.set_dirty(file_index);
+				ec.operation = storage_error::write;
+			}
+			else
+			{
+				ec.operation = storage_error::read;
+			}
+
+			int ret = 0;
+			for (auto const& b : bufs)
+			{
+				// reading past the end of the file is a short read, just like
+				// it would be with read()
+				if (offset >= m->size) break;
+				std::size_t const len = std::size_t(std::min(
+					std::int64_t(b.iov_len), m->size - offset));
+				if (m_write) std::memcpy(m->base + offset, b.iov_base, len);
+				else std::memcpy(b.iov_base, m->base + offset, len);
+				offset += std::int64_t(len);
+				ret += int(len);
+				if (len < b.iov_len) break;
+			}
+			return ret;
+		}
+
+	private:
+
+		int fallback(file_index_t const file_index
+			, std::int64_t const file_offset
+			, span<iovec_t const> bufs, storage_error& ec)
+		{
+			if (m_write)
+			{
+				write_fileop op(m_storage, m_flags);
+				return op.file_op(file_index, file_offset, bufs, ec);
+			}
+			read_fileop op(m_storage, m_flags);
+			return op.file_op(file_index, file_offset, bufs, ec);
+		}
+
+		mmap_storage& m_storage;
+		std::uint32_t const m_flags;
+		bool const m_write;
+	};
+
+	mmap_storage::mmap_storage(storage_params const& params, file_pool& pool)
+		: default_storage(params, pool)
+	{}
+
+	mmap_storage::~mmap_storage() = default;
+
+	std::shared_ptr<aux::file_mapping> mmap_storage::map_file(
+		file_index_t const file, bool const write, storage_error& ec)
+	{
+		std::lock_guard<std::mutex> l(m_mapping_mutex);
+		if (m_mappings.end_index() <= file)
+			m_mappings.resize(files().num_files());
+
+		std::shared_ptr<aux::file_mapping>& m = m_mappings[file];
+		if (m && (m->writable || !write)) return m;
+
+		file_handle h = open_file(file, write ? file::read_write : file::read_only, ec);
+		if (ec) return std::shared_ptr<aux::file_mapping>();
+
+		std::int64_t size = h->get_size(ec.ec);
+		if (ec.ec)
+		{
+			ec.file(file);
+			ec.operation = storage_error::stat;
+			return std::shared_ptr<aux::file_mapping>();
+		}
+
+		if (write)
+		{
+			// the whole file has to exist in order to map it for writing.
+			// In sparse mode, this won't allocate anything
+			std::int64_t const file_size = files().file_size(file);
+			if (size < file_size)
+			{
+				h->set_size(file_size, ec.ec);
+				if (ec.ec)
+				{
+					ec.file(file);
+					ec.operation = storage_error::fallocate;
+					return std::shared_ptr<aux::file_mapping>();
+				}
+				size = file_size;
+			}
+		}
+
+		// an empty file has nothing to map, and a file that doesn't fit in the
+		// address space can't be mapped. Access those through the file handle
+		if (size <= 0 || std::uint64_t(size) > std::numeric_limits<std::size_t>::max())
+			return std::shared_ptr<aux::file_mapping>();
+
+		void* p = ::mmap(nullptr, std::size_t(size)
+			, write ? (PROT_READ | PROT_WRITE) : PROT_READ
+			, MAP_SHARED, h->native_handle(), 0);
+		if (p == MAP_FAILED)
+			return std::shared_ptr<aux::file_mapping>();
+
+		// operations still using the old (read-only) mapping keep it alive
+		// until they're done
+		m = std::make_shared<aux::file_mapping>(p, size, write);
+		return m;
+	}
+
+	void mmap_storage::unmap_files()
+	{
+		std::lock_guard<std::mutex> l(m_mapping_mutex);
+		m_mappings.clear();
+	}
+
+	void mmap_storage::rename_file(file_index_t const index
+		, std::string const& new_filename, storage_error& ec)
+	{
+		unmap_files();
+		default_storage::rename_file(index, new_filename, ec);
+	}
+
+	void mmap_storage::release_files(storage_error& ec)
+	{
+		unmap_files();
+		default_storage::release_files(ec);
+	}
+
+	void mmap_storage::delete_files(int const options, storage_error& ec)
+	{
+		unmap_files();
+		default_storage::delete_files(options, ec);
+	}
+
+	status_t mmap_storage::move_storage(std::string const& sp, int const flags
+		, storage_error& ec)
+	{
+		unmap_files();
+		return default_storage::move_storage(sp, flags, ec);
+	}
+
+	int mmap_storage::readv(span<iovec_t const> bufs
+		, piece_index_t const piece, int const offset
+		, std::uint32_t const flags, storage_error& ec)
+	{
+		mmap_fileop op(*this, flags, false);
+		return readwritev(files(), bufs, piece, offset, op, ec);
+	}
+
+	int mmap_storage::writev(span<iovec_t const> bufs
+		, piece_index_t const piece, int const offset
+		, std::uint32_t const flags, storage_error& ec)
+	{
+		mmap_fileop op(*this, flags, true);
+		return readwritev(files(), bufs, piece, offset, op, ec);
+	}
+
+#endif // TORRENT_HAVE_MMAP
+
+	storage_interface* mmap_storage_constructor(storage_params const& params
+		, file_pool& pool)
+	{
+#if TORRENT_HAVE_MMAP
+		return new mmap_storage(params, pool);
+#else
+		return new default_storage(params, pool);
+#endif
+	}
+
 	// -- disabled_storage --------------------------------------------------
 
 namespace {
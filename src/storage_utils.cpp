@@ -41,6 +41,8 @@ POSSIBILITY OF SUCH DAMAGE.
 
 #include <set>
 #include <string>
+#include <vector>
+#include <algorithm>
 
 namespace libtorrent { namespace aux {
 
@@ -557,4 +559,41 @@ namespace libtorrent { namespace aux {
 		return true;
 	}
 
+	std::map<file_index_t, std::string> stripe_files(file_storage const& fs
+		, std::vector<std::string> const& extra_paths)
+	{
+		std::map<file_index_t, std::string> ret;
+		if (extra_paths.empty()) return ret;
+
+		std::vector<file_index_t> order;
+		for (file_index_t i(0); i < fs.end_file(); ++i)
+		{
+			if (fs.pad_file_at(i) || fs.file_absolute_path(i)) continue;
+			order.push_back(i);
+		}
+
+		// largest files first, ties broken by file index to keep the layout
+		// deterministic
+		std::sort(order.begin(), order.end(), [&fs](file_index_t const lhs
+			, file_index_t const rhs)
+		{
+			std::int64_t const ls = fs.file_size(lhs);
+			std::int64_t const rs = fs.file_size(rhs);
+			return ls != rs ? ls > rs : lhs < rhs;
+		});
+
+		// the number of bytes assigned to each path. Index 0 is the torrent's
+		// own save_path
+		std::vector<std::int64_t> load(extra_paths.size() + 1, 0);
+		for (file_index_t const i : order)
+		{
+			auto const target = std::min_element(load.begin(), load.end());
+			*target += fs.file_size(i);
+			std::size_t const path = std::size_t(target - load.begin());
+			if (path == 0) continue;
+			ret[i] = combine_path(complete(extra_paths[path - 1]), fs.file_path(i));
+		}
+		return ret;
+	}
+
 }}
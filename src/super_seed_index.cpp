@@ -0,0 +1,142 @@
+/*
+
+Copyright (c) 2017, Arvid Norberg
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions
+are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in
+      the documentation and/or other materials provided with the distribution.
+    * Neither the name of the author nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+#include "libtorrent/aux_/super_seed_index.hpp"
+#include "libtorrent/random.hpp"
+#include "libtorrent/assert.hpp"
+
+namespace libtorrent { namespace aux {
+
+	constexpr int super_seed_index::given_bucket;
+
+	super_seed_index::super_seed_index(int const num_pieces)
+		: m_availability(std::size_t(num_pieces), 0)
+		, m_given(std::size_t(num_pieces), 0)
+		, m_position(std::size_t(num_pieces), 0)
+		, m_buckets(1)
+	{
+		m_buckets[0].reserve(std::size_t(num_pieces));
+		for (piece_index_t i(0); i < m_position.end_index(); ++i)
+		{
+			m_position[i] = int(m_buckets[0].size());
+			m_buckets[0].push_back(i);
+		}
+	}
+
+	std::vector<piece_index_t>& super_seed_index::bucket(int const b)
+	{
+		if (b == given_bucket) return m_given_pieces;
+		if (b >= int(m_buckets.size())) m_buckets.resize(std::size_t(b) + 1);
+		return m_buckets[std::size_t(b)];
+	}
+
+	void super_seed_index::update(piece_index_t const p, int const from)
+	{
+		int const to = bucket_of(p);
+		if (to == from) return;
+
+		std::vector<piece_index_t>& src = bucket(from);
+		int const pos = m_position[p];
+		TORRENT_ASSERT(src[std::size_t(pos)] == p);
+		src[std::size_t(pos)] = src.back();
+		m_position[src.back()] = pos;
+		src.pop_back();
+
+		std::vector<piece_index_t>& dst = bucket(to);
+		m_position[p] = int(dst.size());
+		dst.push_back(p);
+	}
+
+	void super_seed_index::inc_availability(piece_index_t const p)
+	{
+		int const from = bucket_of(p);
+		++m_availability[p];
+		update(p, from);
+	}
+
+	// the counters don't go below zero. Peers may lose pieces they were never
+	// counted as having, if their bitfield was received before this index
+	// was built
+	void super_seed_index::dec_availability(piece_index_t const p)
+	{
+		if (m_availability[p] == 0) return;
+		int const from = bucket_of(p);
+		--m_availability[p];
+		update(p, from);
+	}
+
+	void super_seed_index::inc_given(piece_index_t const p)
+	{
+		int const from = bucket_of(p);
+		++m_given[p];
+		update(p, from);
+	}
+
+	void super_seed_index::dec_given(piece_index_t const p)
+	{
+		if (m_given[p] == 0) return;
+		int const from = bucket_of(p);
+		--m_given[p];
+		update(p, from);
+	}
+
+	namespace {
+
+	// picks a piece from b that's not in bits, starting at a random position
+	piece_index_t pick_from(std::vector<piece_index_t> const& b
+		, typed_bitfield<piece_index_t> const& bits)
+	{
+		if (b.empty()) return piece_index_t(-1);
+		std::size_t const size = b.size();
+		std::size_t const start = random(std::uint32_t(size - 1));
+		for (std::size_t i = 0; i < size; ++i)
+		{
+			piece_index_t const p = b[(start + i) % size];
+			if (!bits.get_bit(p)) return p;
+		}
+		return piece_index_t(-1);
+	}
+	}
+
+	piece_index_t super_seed_index::pick(typed_bitfield<piece_index_t> const& bits) const
+	{
+		TORRENT_ASSERT(bits.size() == int(m_availability.size()));
+		if (bits.all_set()) return piece_index_t(-1);
+
+		for (auto const& b : m_buckets)
+		{
+			piece_index_t const p = pick_from(b, bits);
+			if (p != piece_index_t(-1)) return p;
+		}
+		return pick_from(m_given_pieces, bits);
+	}
+}}
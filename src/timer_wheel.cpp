@@ -0,0 +1,239 @@
+/*
+
+Copyright (c) 2017, Arvid Norberg
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions
+are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in
+      the documentation and/or other materials provided with the distribution.
+    * Neither the name of the author nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+#include "libtorrent/aux_/timer_wheel.hpp"
+#include "libtorrent/assert.hpp"
+
+#include <algorithm>
+
+namespace libtorrent { namespace aux {
+
+	timer_wheel::timer_wheel(time_point const start
+		, time_duration const resolution, int const slots)
+		: m_start(start)
+		, m_resolution(resolution)
+		, m_slots(std::size_t(slots))
+	{
+		TORRENT_ASSERT(resolution > time_duration(0));
+		TORRENT_ASSERT(slots > 0);
+	}
+
+	std::int64_t timer_wheel::tick_floor(time_point const t) const
+	{
+		if (t <= m_start) return 0;
+		return (t - m_start) / m_resolution;
+	}
+
+	std::int64_t timer_wheel::tick_ceil(time_point const t) const
+	{
+		if (t <= m_start) return 0;
+		return (t - m_start + m_resolution - time_duration(1)) / m_resolution;
+	}
+
+	timer_wheel::timer_id timer_wheel::add(time_point const now
+		, time_point const expires, handler_t h)
+	{
+		// while the wheel is empty, the timer driving it isn't armed, so the
+		// ticks that passed in the meantime don't need to be processed
+		if (m_timers.empty()) m_current = std::max(m_current, tick_floor(now));
+
+		std::int64_t const tick = std::max(tick_ceil(expires), m_current + 1);
+		timer_id const id = m_next_id++;
+		m_slots[std::size_t(tick % std::int64_t(m_slots.size()))].push_back(id);
+		m_timers.emplace(id, entry{tick, std::move(h)});
+		return id;
+	}
+
+	timer_wheel::handler_t timer_wheel::remove(timer_id const id)
+	{
+		auto const i = m_timers.find(id);
+		if (i == m_timers.end()) return handler_t();
+		handler_t ret = std::move(i->second.handler);
+		m_timers.erase(i);
+		return ret;
+	}
+
+	void timer_wheel::expire_slot(std::vector<timer_id>& slot
+		, std::int64_t const tick, std::vector<handler_t>& expired)
+	{
+		auto const last = std::remove_if(slot.begin(), slot.end()
+			, [&](timer_id const id)
+		{
+			auto const i = m_timers.find(id);
+			// the timer was removed
+			if (i == m_timers.end()) return true;
+			// the timer is due on a later revolution of the wheel
+			if (i->second.tick > tick) return false;
+			expired.push_back(std::move(i->second.handler));
+			m_timers.erase(i);
+			return true;
+		});
+		slot.erase(last, slot.end());
+	}
+
+	void timer_wheel::advance(time_point const now
+		, std::vector<handler_t>& expired)
+	{
+		std::int64_t const target = tick_floor(now);
+		if (target <= m_current) return;
+
+		std::int64_t const num_slots = std::int64_t(m_slots.size());
+		if (target - m_current >= num_slots)
+		{
+			// more than a whole revolution has passed, every slot needs to be
+			// looked at once
+			for (auto& s : m_slots) expire_slot(s, target, expired);
+			m_current = target;
+			return;
+		}
+
+		while (m_current < target)
+		{
+			++m_current;
+			expire_slot(m_slots[std::size_t(m_current % num_slots)]
+				, m_current, expired);
+		}
+	}
+
+	std::vector<timer_wheel::handler_t> timer_wheel::remove_all()
+	{
+		std::vector<handler_t> ret;
+		ret.reserve(m_timers.size());
+		for (auto& t : m_timers) ret.push_back(std::move(t.second.handler));
+		m_timers.clear();
+		for (auto& s : m_slots) s.clear();
+		return ret;
+	}
+
+	time_point timer_wheel::next_tick() const
+	{
+		return m_start + m_resolution * (m_current + 1);
+	}
+
+	timer_service::timer_service(io_service& ios
+		, time_duration const resolution, int const slots)
+		: m_ios(ios)
+		, m_timer(ios)
+		, m_wheel(clock_type::now(), resolution, slots)
+	{}
+
+	timer_service::timer_id timer_service::async_wait(time_point const expires
+		, handler_t h)
+	{
+		if (m_abort)
+		{
+			m_ios.post([h] { h(boost::asio::error::operation_aborted); });
+			return 0;
+		}
+
+		time_point const now = clock_type::now();
+		if (expires <= now)
+		{
+			m_ios.post([h] { h(error_code()); });
+			return 0;
+		}
+
+		timer_id const id = m_wheel.add(now, expires, std::move(h));
+		arm();
+		return id;
+	}
+
+	bool timer_service::cancel(timer_id const id)
+	{
+		if (id == 0) return false;
+		handler_t h = m_wheel.remove(id);
+		if (!h) return false;
+		m_ios.post([h] { h(boost::asio::error::operation_aborted); });
+		return true;
+	}
+
+	void timer_service::abort()
+	{
+		m_abort = true;
+		for (auto& h : m_wheel.remove_all())
+			m_ios.post([h] { h(boost::asio::error::operation_aborted); });
+		error_code ec;
+		m_timer.cancel(ec);
+	}
+
+	void timer_service::arm()
+	{
+		if (m_armed || m_wheel.empty()) return;
+		m_armed = true;
+		error_code ec;
+		m_timer.expires_at(m_wheel.next_tick(), ec);
+		auto self = shared_from_this();
+		m_timer.async_wait([self](error_code const& e) { self->on_tick(e); });
+	}
+
+	void timer_service::on_tick(error_code const& ec)
+	{
+		m_armed = false;
+		if (ec || m_abort) return;
+
+		std::vector<handler_t> expired;
+		m_wheel.advance(clock_type::now(), expired);
+
+		// the handlers may add or cancel timers, which is fine since the
+		// expired ones have already been removed from the wheel
+		for (auto& h : expired) h(error_code());
+		arm();
+	}
+
+	wheel_timer::wheel_timer(timer_service& s)
+		: m_service(s.shared_from_this())
+	{}
+
+	wheel_timer::~wheel_timer() { cancel(); }
+
+	void wheel_timer::expires_at(time_point const t)
+	{
+		cancel();
+		m_expires = t;
+	}
+
+	void wheel_timer::expires_from_now(time_duration const d)
+	{
+		expires_at(clock_type::now() + d);
+	}
+
+	void wheel_timer::async_wait(timer_service::handler_t h)
+	{
+		m_id = m_service->async_wait(m_expires, std::move(h));
+	}
+
+	void wheel_timer::cancel()
+	{
+		m_service->cancel(m_id);
+		m_id = 0;
+	}
+}}
@@ -46,6 +46,7 @@ POSSIBILITY OF SUCH DAMAGE.
 
 #ifdef TORRENT_USE_OPENSSL
 #include "libtorrent/ssl_stream.hpp"
+#include "libtorrent/aux_/ssl_session_cache.hpp"
 #include "libtorrent/aux_/disable_warnings_push.hpp"
 #include <boost/asio/ssl/context.hpp>
 #include <boost/asio/ssl/verify_context.hpp>
@@ -89,6 +90,7 @@ POSSIBILITY OF SUCH DAMAGE.
 #include "libtorrent/resolve_links.hpp"
 #include "libtorrent/aux_/file_progress.hpp"
 #include "libtorrent/aux_/has_block.hpp"
+#include "libtorrent/aux_/merkle.hpp"
 #include "libtorrent/alert_manager.hpp"
 #include "libtorrent/disk_interface.hpp"
 #include "libtorrent/broadcast_socket.hpp" // for is_ip_address
@@ -98,6 +100,8 @@ POSSIBILITY OF SUCH DAMAGE.
 #include "libtorrent/disk_io_thread.hpp" // for cache_status
 #include "libtorrent/aux_/numeric_cast.hpp"
 #include "libtorrent/aux_/path.hpp"
+#include "libtorrent/aux_/pool_allocator.hpp"
+#include "libtorrent/aux_/storage_utils.hpp" // for stripe_files
 
 #ifndef TORRENT_DISABLE_LOGGING
 #include "libtorrent/aux_/session_impl.hpp" // for tracker_logger
@@ -166,8 +170,8 @@ namespace libtorrent {
 		, add_torrent_params const& p
 		, sha1_hash const& info_hash)
 		: torrent_hot_members(ses, p, block_size, session_paused)
-		, m_tracker_timer(ses.get_io_service())
-		, m_inactivity_timer(ses.get_io_service())
+		, m_tracker_timer(ses.timers())
+		, m_inactivity_timer(ses.timers())
 		, m_trackerid(p.trackerid)
 		, m_save_path(complete(p.save_path))
 #ifndef TORRENT_NO_DEPRECATE
@@ -179,7 +183,6 @@ namespace libtorrent {
 		, m_storage_constructor(p.storage)
 		, m_info_hash(info_hash)
 		, m_error_file(torrent_status::error_file_none)
-		, m_sequence_number(-1)
 		, m_announce_to_trackers((p.flags & add_torrent_params::flag_paused) == 0)
 		, m_announce_to_lsd((p.flags & add_torrent_params::flag_paused) == 0)
 		, m_has_incoming(false)
@@ -192,7 +195,6 @@ namespace libtorrent {
 		, m_seed_mode(false)
 		, m_super_seeding(false)
 		, m_stop_when_ready((p.flags & add_torrent_params::flag_stop_when_ready) != 0)
-		, m_need_save_resume_data((p.flags & add_torrent_params::flag_need_save_resume) != 0)
 		, m_max_uploads((1 << 24) - 1)
 		, m_save_resume_flags(0)
 		, m_num_uploads(0)
@@ -201,6 +203,7 @@ namespace libtorrent {
 		, m_magnet_link(false)
 		, m_apply_ip_filter((p.flags & add_torrent_params::flag_apply_ip_filter) != 0)
 		, m_pending_active_change(false)
+		, m_deferred_resume_check(false)
 		, m_padding(0)
 		, m_incomplete(0xffffff)
 		, m_announce_to_dht((p.flags & add_torrent_params::flag_paused) == 0)
@@ -223,6 +226,8 @@ namespace libtorrent {
 		// TODO: 2 p should probably be moved in here
 		m_add_torrent_params.reset(new add_torrent_params(p));
 
+		m_block_salt = random(0xffffffff);
+
 #if TORRENT_USE_UNC_PATHS
 		m_save_path = canonicalize_path(m_save_path);
 #endif
@@ -232,6 +237,9 @@ namespace libtorrent {
 			inc_stats_counter(counters::non_filter_torrents);
 		}
 
+		if (p.flags & add_torrent_params::flag_need_save_resume)
+			set_need_save_resume(torrent_handle::resume_all);
+
 		if (!p.ti || !p.ti->is_valid())
 		{
 			// we don't have metadata for this torrent. We'll download
@@ -310,9 +318,11 @@ namespace libtorrent {
 		// --- MERKLE TREE ---
 
 		if (m_torrent_file->is_valid()
-			&& m_torrent_file->is_merkle_torrent())
+			&& m_torrent_file->is_merkle_torrent()
+			&& !p.merkle_tree.empty())
 		{
-			if (p.merkle_tree.size() == m_torrent_file->merkle_tree().size())
+			if (int(p.merkle_tree.size()) == merkle_num_nodes(
+				merkle_num_leafs(m_torrent_file->num_pieces())))
 			{
 				// TODO: 2 set_merkle_tree should probably take the vector as &&
 				std::vector<sha1_hash> tree(p.merkle_tree);
@@ -421,7 +431,7 @@ namespace libtorrent {
 
 		m_ses.remove_torrent_impl(me, 0);
 
-		if (alerts().should_post<torrent_update_alert>())
+		if (should_post<torrent_update_alert>())
 			alerts().emplace_alert<torrent_update_alert>(get_handle(), info_hash(), tf->info_hash());
 
 		m_torrent_file = tf;
@@ -481,7 +491,7 @@ namespace libtorrent {
 		m_ses.add_obfuscated_hash(h.final(), shared_from_this());
 #endif
 
-		if (m_ses.alerts().should_post<metadata_received_alert>())
+		if (should_post<metadata_received_alert>())
 		{
 			m_ses.alerts().emplace_alert<metadata_received_alert>(
 				get_handle());
@@ -526,6 +536,24 @@ namespace libtorrent {
 		TORRENT_ASSERT(new_gauge_state >= 0);
 		TORRENT_ASSERT(new_gauge_state <= no_gauge_state);
 
+		// aborted torrents don't count towards any gauge, even if they still
+		// hold on to their piece picker
+		int const picker_memory = (m_picker && new_gauge_state != no_gauge_state)
+			? m_picker->memory_usage() : 0;
+		if (picker_memory != m_picker_memory)
+		{
+			inc_stats_counter(counters::piece_picker_bytes, picker_memory - m_picker_memory);
+			m_picker_memory = picker_memory;
+		}
+
+		int const file_memory = (m_torrent_file && new_gauge_state != no_gauge_state)
+			? int(m_torrent_file->memory_usage()) : 0;
+		if (file_memory != m_torrent_file_memory)
+		{
+			inc_stats_counter(counters::torrent_info_bytes, file_memory - m_torrent_file_memory);
+			m_torrent_file_memory = file_memory;
+		}
+
 		if (new_gauge_state == int(m_current_gauge_state)) return;
 
 		if (m_current_gauge_state != no_gauge_state)
@@ -569,8 +597,9 @@ namespace libtorrent {
 		m_num_verified = 0;
 		m_verified.clear();
 		m_verifying.clear();
+		m_verify_order.clear();
 
-		set_need_save_resume();
+		set_need_save_resume(torrent_handle::resume_pieces | torrent_handle::resume_settings);
 	}
 
 	void torrent::verified(piece_index_t const piece)
@@ -578,6 +607,94 @@ namespace libtorrent {
 		TORRENT_ASSERT(m_verified.get_bit(piece) == false);
 		++m_num_verified;
 		m_verified.set_bit(piece);
+
+		// the verified pieces are saved in the resume data, to not have to
+		// verify them again
+		set_need_save_resume(torrent_handle::resume_pieces);
+	}
+
+	void torrent::verify_in_background()
+	{
+		TORRENT_ASSERT(is_single_thread());
+		if (!m_seed_mode || m_abort || !m_storage || !m_files_checked
+			|| is_paused()) return;
+		if (settings().get_bool(settings_pack::disable_hash_checks)) return;
+
+		int const limit = settings().get_int(settings_pack::seed_mode_background_checks);
+		while (m_background_verifications < limit)
+		{
+			// jobs serving peers (of any torrent) take precedence, only issue
+			// more while there are none running
+			if (m_ses.stats_counters()[counters::num_running_disk_jobs] > 0) return;
+
+			piece_index_t const piece = m_verify_order.pick(m_torrent_file->num_pieces()
+				, [this](piece_index_t const p)
+				{ return !m_verified.get_bit(p) && !m_verifying.get_bit(p); }
+				, [this](piece_index_t const p)
+				{
+					// the more peers are missing the piece, the more likely it
+					// is to be requested
+					int ret = 0;
+					for (peer_connection const* c : m_connections)
+						if (!c->has_piece(p)) ++ret;
+					return ret;
+				});
+			if (piece < piece_index_t(0)) return;
+
+#ifndef TORRENT_DISABLE_LOGGING
+			debug_log("*** SEED MODE BACKGROUND HASH piece: %d", static_cast<int>(piece));
+#endif
+			verifying(piece);
+			++m_background_verifications;
+			m_ses.disk_thread().async_hash(m_storage, piece
+				, disk_interface::volatile_read
+				, std::bind(&torrent::on_background_verified
+					, shared_from_this(), _1, _2, _3), reinterpret_cast<void*>(1));
+		}
+	}
+
+	void torrent::on_background_verified(piece_index_t const piece
+		, sha1_hash const& piece_hash, storage_error const& error)
+	{
+		TORRENT_ASSERT(is_single_thread());
+		TORRENT_ASSERT(m_background_verifications > 0);
+		--m_background_verifications;
+
+		// leaving seed mode discards the verification state
+		if (m_abort || !m_seed_mode) return;
+
+		if (error)
+		{
+			handle_disk_error("hash", error);
+			leave_seed_mode(false);
+			return;
+		}
+
+		if (!settings().get_bool(settings_pack::disable_hash_checks)
+			&& piece_hash != m_torrent_file->hash_for_piece(piece))
+		{
+#ifndef TORRENT_DISABLE_LOGGING
+			debug_log("*** SEED MODE BACKGROUND HASH FAILED piece: %d"
+				, static_cast<int>(piece));
+#endif
+			leave_seed_mode(false);
+			return;
+		}
+
+		TORRENT_ASSERT(m_verifying.get_bit(piece));
+		verified(piece);
+		if (all_verified())
+		{
+			leave_seed_mode(true);
+			return;
+		}
+
+		// peers may have requests for this piece waiting for it to be
+		// verified
+		for (peer_connection* p : m_connections)
+			p->seed_mode_piece_verified();
+
+		verify_in_background();
 	}
 
 	void torrent::start(add_torrent_params const& p)
@@ -591,7 +708,7 @@ namespace libtorrent {
 #ifndef TORRENT_NO_DEPRECATE
 		if (m_add_torrent_params
 			&& m_add_torrent_params->internal_resume_data_error
-			&& m_ses.alerts().should_post<fastresume_rejected_alert>())
+			&& should_post<fastresume_rejected_alert>())
 		{
 			m_ses.alerts().emplace_alert<fastresume_rejected_alert>(get_handle()
 				, m_add_torrent_params->internal_resume_data_error, "", "");
@@ -643,7 +760,7 @@ namespace libtorrent {
 		if (p.flags & add_torrent_params::flag_super_seeding)
 		{
 			m_super_seeding = true;
-			set_need_save_resume();
+			set_need_save_resume(torrent_handle::resume_settings);
 		}
 
 		set_max_uploads(p.max_uploads, false);
@@ -1030,7 +1147,7 @@ namespace libtorrent {
 
 		if (error.ec == boost::system::errc::not_enough_memory)
 		{
-			if (alerts().should_post<file_error_alert>())
+			if (should_post<file_error_alert>())
 				alerts().emplace_alert<file_error_alert>(error.ec
 					, resolve_filename(error.file()), error.operation_str(), get_handle());
 			if (c) c->disconnect(errors::no_memory, op_file);
@@ -1040,7 +1157,7 @@ namespace libtorrent {
 		if (error.ec == boost::asio::error::operation_aborted) return;
 
 		// notify the user of the error
-		if (alerts().should_post<file_error_alert>())
+		if (should_post<file_error_alert>())
 			alerts().emplace_alert<file_error_alert>(error.ec
 				, resolve_filename(error.file()), error.operation_str(), get_handle());
 
@@ -1138,6 +1255,117 @@ namespace libtorrent {
 	}
 	catch (...) { handle_exception(); }
 
+	void torrent::read_range(file_index_t const file, std::int64_t const offset
+		, int const size
+		, std::function<void(error_code const&, std::vector<range_buffer>)> handler
+		, int const deadline)
+	{
+		if (m_abort || m_deleted)
+		{
+			handler(error_code(boost::system::errc::operation_canceled
+				, generic_category()), {});
+			return;
+		}
+
+		if (!valid_metadata())
+		{
+			handler(errors::no_metadata, {});
+			return;
+		}
+
+		file_storage const& fs = m_torrent_file->files();
+		if (file < file_index_t(0) || file >= fs.end_file()
+			|| offset < 0 || size < 0 || offset + size > fs.file_size(file))
+		{
+			handler(error_code(boost::system::errc::invalid_argument
+				, generic_category()), {});
+			return;
+		}
+
+		auto rr = std::make_shared<range_read>();
+		rr->handler = std::move(handler);
+
+		// split the range into reads that don't cross block boundaries, to
+		// have each of them served by a single block of the cache
+		int const piece_length = m_torrent_file->piece_length();
+		std::int64_t pos = fs.file_offset(file) + offset;
+		int left = size;
+		while (left > 0)
+		{
+			peer_request r;
+			r.piece = piece_index_t(int(pos / piece_length));
+			r.start = int(pos % piece_length);
+			r.length = std::min({left, block_size() - r.start % block_size()
+				, m_torrent_file->piece_size(r.piece) - r.start});
+			rr->requests.push_back(r);
+			if (!have_piece(r.piece)
+				&& (rr->missing.empty() || rr->missing.back() != r.piece))
+			{
+				rr->missing.push_back(r.piece);
+			}
+			pos += r.length;
+			left -= r.length;
+		}
+
+		if (rr->missing.empty())
+		{
+			issue_range_read(std::move(rr));
+			return;
+		}
+
+		for (auto const p : rr->missing)
+			set_piece_deadline(p, deadline, 0);
+		m_pending_range_reads.push_back(std::move(rr));
+	}
+
+	void torrent::issue_range_read(std::shared_ptr<range_read> rr)
+	{
+		if (rr->requests.empty())
+		{
+			rr->handler(error_code(), {});
+			return;
+		}
+
+		rr->buffers.resize(rr->requests.size());
+		rr->outstanding = int(rr->requests.size());
+		for (int i = 0; i < int(rr->requests.size()); ++i)
+		{
+			m_ses.disk_thread().async_read(m_storage, rr->requests[std::size_t(i)]
+				, std::bind(&torrent::on_range_read_complete
+				, shared_from_this(), _1, _2, _3, rr, i), reinterpret_cast<void*>(1));
+		}
+	}
+
+	void torrent::on_range_read_complete(disk_buffer_holder buffer
+		, int, storage_error const& se, std::shared_ptr<range_read> rr
+		, int const idx) try
+	{
+		TORRENT_ASSERT(is_single_thread());
+
+		if (se)
+		{
+			if (!rr->error) rr->error = se.ec;
+			handle_disk_error("read", se);
+		}
+		else
+		{
+			// keep the cache block (or disk buffer) alive for as long as the
+			// client holds on to it
+			auto holder = std::make_shared<disk_buffer_holder>(std::move(buffer));
+			range_buffer& b = rr->buffers[std::size_t(idx)];
+			b.buffer = std::shared_ptr<char const>(holder, holder->get());
+			b.size = rr->requests[std::size_t(idx)].length;
+		}
+
+		if (--rr->outstanding > 0) return;
+
+		if (rr->error)
+			rr->handler(rr->error, {});
+		else
+			rr->handler(error_code(), std::move(rr->buffers));
+	}
+	catch (...) { handle_exception(); }
+
 	storage_mode_t torrent::storage_mode() const
 	{ return storage_mode_t(m_storage_mode); }
 
@@ -1146,6 +1374,13 @@ namespace libtorrent {
 		return m_ses.disk_thread().get_torrent(m_storage);
 	}
 
+	int torrent::storage_device() const
+	{
+		if (!m_storage) return 0;
+		storage_interface const* s = get_storage_impl();
+		return s ? int(s->device()) : 0;
+	}
+
 	void torrent::need_picker()
 	{
 		if (m_picker) return;
@@ -1171,20 +1406,29 @@ namespace libtorrent {
 		// TODO: 3 the init function should be merged with the constructor
 		pp->init(blocks_per_piece, blocks_in_last_piece, m_torrent_file->num_pieces());
 
+		// seeds release their piece picker. If we need one again, rebuild it
+		// with all pieces marked as had
+		if (m_have_all)
+		{
+			for (piece_index_t i(0); i < m_torrent_file->end_piece(); ++i)
+				pp->we_have(i);
+		}
+
 		m_picker = std::move(pp);
 
 		// initialize the file progress too
 		if (m_file_progress.empty())
 		{
 			TORRENT_ASSERT(has_picker());
-			m_file_progress.init(picker(), m_torrent_file->files());
+			m_file_progress.init(picker(), m_torrent_file->files(), block_size());
 		}
 
 		update_gauge();
 
 		for (auto p : m_connections)
 		{
-			peer_has(p->get_bitfield(), p);
+			TORRENT_ASSERT(p->get_bitfield().size() == torrent_file().num_pieces());
+			m_picker->inc_refcount(p->get_bitfield(), p->peer_info_struct());
 		}
 	}
 
@@ -1252,6 +1496,7 @@ namespace libtorrent {
 
 			picker().mark_as_downloading(block, nullptr);
 			picker().mark_as_writing(block, nullptr);
+			add_block_progress(block);
 
 			if (multi) cancel_block(block);
 
@@ -1293,9 +1538,10 @@ namespace libtorrent {
 		if (picker().is_finished(block_finished)) return;
 
 		picker().mark_as_finished(block_finished, nullptr);
+		add_block_progress(block_finished);
 		maybe_done_flushing();
 
-		if (alerts().should_post<block_finished_alert>())
+		if (should_post<block_finished_alert>())
 		{
 			alerts().emplace_alert<block_finished_alert>(get_handle(),
 				tcp::endpoint(), peer_id(), int(block_finished.block_index)
@@ -1332,6 +1578,13 @@ namespace libtorrent {
 		return "";
 	}
 
+	string_view torrent::name_view() const
+	{
+		if (valid_metadata()) return m_torrent_file->name();
+		if (m_name) return *m_name;
+		return {};
+	}
+
 #ifndef TORRENT_DISABLE_EXTENSIONS
 
 	void torrent::add_extension(std::shared_ptr<torrent_plugin> ext)
@@ -1341,9 +1594,7 @@ namespace libtorrent {
 
 	void torrent::remove_extension(std::shared_ptr<torrent_plugin> ext)
 	{
-		auto i = std::find(m_extensions.begin(), m_extensions.end(), ext);
-		if (i == m_extensions.end()) return;
-		m_extensions.erase(i);
+		m_extensions.erase(ext.get());
 	}
 
 	void torrent::add_extension_fun(std::function<std::shared_ptr<torrent_plugin>(torrent_handle const&, void*)> const& ext
@@ -1516,6 +1767,13 @@ namespace libtorrent {
 		}
 
 		SSL_CTX* ssl_ctx = ctx->impl();
+
+		// let reconnecting peers resume their previous sessions, rather than
+		// going through a full handshake every time. Sessions are tied to
+		// this torrent by its info-hash
+		aux::ssl_session_cache::enable_resumption(ssl_ctx, m_torrent_file->info_hash());
+		auto sessions = std::make_shared<aux::ssl_session_cache>();
+
 		// create a new x.509 certificate store
 		X509_STORE* cert_store = X509_STORE_new();
 		if (!cert_store)
@@ -1565,6 +1823,7 @@ namespace libtorrent {
 #endif
 		// if all went well, set the torrent ssl context to this one
 		m_ssl_ctx = ctx;
+		m_ssl_sessions = std::move(sessions);
 		// tell the client we need a cert for this torrent
 		alerts().emplace_alert<torrent_need_cert_alert>(get_handle());
 	}
@@ -1667,6 +1926,23 @@ namespace libtorrent {
 				if (f.first < file_index_t(0) || f.first >= fs.end_file()) continue;
 				m_torrent_file->rename_file(file_index_t(f.first), f.second);
 			}
+
+			// spread the files over the extra save paths. Once done, the
+			// layout is recorded as renamed files in the resume data, and
+			// this won't run again
+			if (m_add_torrent_params->renamed_files.empty()
+				&& !m_add_torrent_params->extra_save_paths.empty())
+			{
+				for (auto const& f : aux::stripe_files(fs
+					, m_add_torrent_params->extra_save_paths))
+				{
+#ifndef TORRENT_DISABLE_LOGGING
+					debug_log("striping file %d to: %s", static_cast<int>(f.first)
+						, f.second.c_str());
+#endif
+					m_torrent_file->rename_file(f.first, f.second);
+				}
+			}
 		}
 
 		construct_storage();
@@ -1763,6 +2039,7 @@ namespace libtorrent {
 			{
 				if (pb.block_index == blocks_per_piece) { pb.block_index = 0; ++pb.piece_index; }
 				m_picker->mark_as_finished(pb, nullptr);
+				add_block_progress(pb);
 			}
 			// ugly edge case where padfiles are not used they way they're
 			// supposed to be. i.e. added back-to back or at the end
@@ -1771,6 +2048,7 @@ namespace libtorrent {
 				|| next(i) == fs.end_file()))
 			{
 				m_picker->mark_as_finished(pb, nullptr);
+				add_block_progress(pb);
 			}
 		}
 
@@ -1853,10 +2131,24 @@ namespace libtorrent {
 		TORRENT_ASSERT(m_outstanding_check_files == false);
 		m_outstanding_check_files = true;
 #endif
+		// when trusting the resume data, the files are only checked against it
+		// (and the storage initialized) once the torrent has started. Hard
+		// links to other torrents' files are set up by the check itself, so it
+		// can't be deferred then
+		std::uint8_t check_flags = 0;
+		if (settings().get_bool(settings_pack::defer_resume_data_check)
+			&& links.empty()
+			&& m_add_torrent_params
+			&& m_add_torrent_params->have_pieces.size() == m_torrent_file->num_pieces())
+		{
+			check_flags |= disk_interface::trust_resume_data;
+			m_deferred_resume_check = true;
+		}
+
 		m_ses.disk_thread().async_check_files(
 			m_storage, m_add_torrent_params ? m_add_torrent_params.get() : nullptr
 			, links, std::bind(&torrent::on_resume_data_checked
-			, shared_from_this(), _1, _2));
+			, shared_from_this(), _1, _2), check_flags);
 		// async_check_files will gut links
 #ifndef TORRENT_DISABLE_LOGGING
 		debug_log("init, async_check_files");
@@ -1918,7 +2210,7 @@ namespace libtorrent {
 		// want anything in this function to affect the state of
 		// m_need_save_resume_data, so we save it in a local variable and reset
 		// it at the end of the function.
-		bool const need_save_resume_data = m_need_save_resume_data;
+		std::uint8_t const need_save_resume_data = m_need_save_resume_data;
 
 		TORRENT_ASSERT(is_single_thread());
 
@@ -1970,7 +2262,7 @@ namespace libtorrent {
 		if ((error || status != status_t::no_error)
 			&& m_add_torrent_params
 			&& !m_add_torrent_params->have_pieces.empty()
-			&& m_ses.alerts().should_post<fastresume_rejected_alert>())
+			&& should_post<fastresume_rejected_alert>())
 		{
 			m_ses.alerts().emplace_alert<fastresume_rejected_alert>(get_handle()
 				, error.ec
@@ -2040,7 +2332,9 @@ namespace libtorrent {
 						i < piece_index_t(num_pieces2); ++i)
 					{
 						if (m_add_torrent_params->verified_pieces[i] == false) continue;
+						if (m_verified.get_bit(i)) continue;
 						m_verified.set_bit(i);
+						++m_num_verified;
 					}
 				}
 
@@ -2065,6 +2359,7 @@ namespace libtorrent {
 					if (has_picker() && m_picker->have_piece(piece))
 					{
 						m_picker->we_dont_have(piece);
+						invalidate_passed_pieces();
 						update_gauge();
 					}
 
@@ -2076,6 +2371,7 @@ namespace libtorrent {
 						if (blocks.get_bit(k))
 						{
 							m_picker->mark_as_finished(piece_block(piece, k), nullptr);
+							add_block_progress(piece_block(piece, k));
 						}
 					}
 					if (m_picker->is_piece_finished(piece))
@@ -2103,6 +2399,23 @@ namespace libtorrent {
 
 		maybe_done_flushing();
 		TORRENT_ASSERT(m_outstanding_check_files == false);
+
+		if (m_deferred_resume_check)
+		{
+			m_deferred_resume_check = false;
+			if (!should_start_full_check && m_add_torrent_params)
+			{
+				// now that the torrent is up and running, make sure the files
+				// actually match the resume data, and initialize the storage.
+				// The resume data has to stay alive until the disk job completes
+				std::shared_ptr<add_torrent_params> rd(std::move(m_add_torrent_params));
+				auto self = shared_from_this();
+				aux::vector<std::string, file_index_t> links;
+				m_ses.disk_thread().async_check_files(m_storage, rd.get(), links
+					, [self, rd](status_t const st, storage_error const& e)
+					{ self->wrap(&torrent::on_resume_data_verified, st, e); });
+			}
+		}
 		m_add_torrent_params.reset();
 
 		// restore m_need_save_resume_data to its state when we entered this
@@ -2111,6 +2424,47 @@ namespace libtorrent {
 	}
 	catch (...) { handle_exception(); }
 
+	void torrent::on_resume_data_verified(status_t const status
+		, storage_error const& error)
+	{
+		TORRENT_ASSERT(is_single_thread());
+		if (m_abort) return;
+
+		if (status == status_t::no_error && !error)
+		{
+#ifndef TORRENT_DISABLE_LOGGING
+			debug_log("deferred fastresume check passed");
+#endif
+			return;
+		}
+
+#ifndef TORRENT_DISABLE_LOGGING
+		if (should_log())
+		{
+			debug_log("deferred fastresume check failed: ret: %d (%d) %s"
+				, static_cast<int>(status), error.ec.value(), error.ec.message().c_str());
+		}
+#endif
+
+		if (status == status_t::fatal_disk_error)
+		{
+			handle_disk_error("check_resume_data", error);
+			return;
+		}
+
+		if (should_post<fastresume_rejected_alert>())
+		{
+			m_ses.alerts().emplace_alert<fastresume_rejected_alert>(get_handle()
+				, error.ec
+				, resolve_filename(error.file())
+				, error.operation_str());
+		}
+
+		// the files don't match what we've been advertising. Find out what we
+		// actually have
+		force_recheck();
+	}
+
 	void torrent::force_recheck()
 	{
 		INVARIANT_CHECK;
@@ -2136,6 +2490,7 @@ namespace libtorrent {
 
 		// forget that we have any pieces
 		m_have_all = false;
+		invalidate_passed_pieces();
 
 // removing the piece picker will clear the user priorities
 // instead, just clear which pieces we have
@@ -2147,7 +2502,7 @@ namespace libtorrent {
 			m_picker->init(blocks_per_piece, blocks_in_last_piece, m_torrent_file->num_pieces());
 
 			m_file_progress.clear();
-			m_file_progress.init(picker(), m_torrent_file->files());
+			m_file_progress.init(picker(), m_torrent_file->files(), block_size());
 		}
 
 
@@ -2209,11 +2564,22 @@ namespace libtorrent {
 
 		int num_outstanding = settings().get_int(settings_pack::checking_mem_usage) * block_size()
 			/ m_torrent_file->piece_length();
+
+		// when checking per device, the memory budget is for the device,
+		// shared by all torrents checking on it
+		int const per_device = settings().get_int(settings_pack::active_checking_per_device);
+		if (per_device > 0) num_outstanding /= per_device;
+
 		// if we only keep a single read operation in-flight at a time, we suffer
 		// significant performance degradation. Always keep at least two jobs
 		// outstanding
 		if (num_outstanding < 2) num_outstanding = 2;
 
+		// keep all hash threads busy, with one piece being hashed and one
+		// being read on each
+		num_outstanding = std::max(num_outstanding
+			, 2 * aux::num_hash_threads(settings()));
+
 		// we might already have some outstanding jobs, if we were paused and
 		// resumed quickly, before the outstanding jobs completed
 		if (m_checking_piece >= m_torrent_file->end_piece())
@@ -2285,7 +2651,7 @@ namespace libtorrent {
 			{
 				m_checking_piece = piece_index_t{0};
 				m_num_checked_pieces = piece_index_t{0};
-				if (m_ses.alerts().should_post<file_error_alert>())
+				if (should_post<file_error_alert>())
 					m_ses.alerts().emplace_alert<file_error_alert>(error.ec,
 						resolve_filename(error.file()), error.operation_str(), get_handle());
 
@@ -2349,7 +2715,7 @@ namespace libtorrent {
 				{
 					// we are paused, and we just completed the last outstanding job.
 					// now we can be considered paused
-					if (alerts().should_post<torrent_paused_alert>())
+					if (should_post<torrent_paused_alert>())
 						alerts().emplace_alert<torrent_paused_alert>(get_handle());
 				}
 				return;
@@ -2549,7 +2915,7 @@ namespace libtorrent {
 		if (m_abort) return;
 		if (peers.empty()) return;
 
-		if (m_ses.alerts().should_post<dht_reply_alert>())
+		if (should_post<dht_reply_alert>())
 		{
 			m_ses.alerts().emplace_alert<dht_reply_alert>(
 				get_handle(), int(peers.size()));
@@ -2723,7 +3089,7 @@ namespace libtorrent {
 					&& proxy_type == settings_pack::none)
 				{
 					ae.next_announce = now + minutes32(10);
-					if (m_ses.alerts().should_post<anonymous_mode_alert>()
+					if (should_post<anonymous_mode_alert>()
 						|| req.triggered_manually)
 					{
 						m_ses.alerts().emplace_alert<anonymous_mode_alert>(get_handle()
@@ -2741,7 +3107,7 @@ namespace libtorrent {
 					&& proxy_type != settings_pack::i2p_proxy)
 				{
 					ae.next_announce = now + minutes32(10);
-					if (m_ses.alerts().should_post<anonymous_mode_alert>()
+					if (should_post<anonymous_mode_alert>()
 						|| req.triggered_manually)
 					{
 						m_ses.alerts().emplace_alert<anonymous_mode_alert>(get_handle()
@@ -2787,7 +3153,7 @@ namespace libtorrent {
 			ae.next_announce = now + seconds32(20);
 			ae.min_announce = now + seconds32(10);
 
-			if (m_ses.alerts().should_post<tracker_announce_alert>())
+			if (should_post<tracker_announce_alert>())
 			{
 				m_ses.alerts().emplace_alert<tracker_announce_alert>(
 					get_handle(), req.url, req.event);
@@ -2843,7 +3209,7 @@ namespace libtorrent {
 			ae->message = msg;
 		}
 
-		if (m_ses.alerts().should_post<tracker_warning_alert>())
+		if (should_post<tracker_warning_alert>())
 			m_ses.alerts().emplace_alert<tracker_warning_alert>(get_handle(), req.url, msg);
 	}
 
@@ -2868,7 +3234,7 @@ namespace libtorrent {
 		// if this was triggered manually we need to post this unconditionally,
 		// since the client expects a response from its action, regardless of
 		// whether all tracker events have been enabled by the alert mask
-		if (m_ses.alerts().should_post<scrape_reply_alert>()
+		if (should_post<scrape_reply_alert>()
 			|| req.triggered_manually)
 		{
 			m_ses.alerts().emplace_alert<scrape_reply_alert>(
@@ -2906,7 +3272,7 @@ namespace libtorrent {
 			update_auto_sequential();
 
 			// these numbers are cached in the resume data
-			set_need_save_resume();
+			set_need_save_resume(torrent_handle::resume_stats);
 		}
 	}
 
@@ -2954,7 +3320,7 @@ namespace libtorrent {
 			if ((!resp.trackerid.empty()) && (ae->trackerid != resp.trackerid))
 			{
 				ae->trackerid = resp.trackerid;
-				if (m_ses.alerts().should_post<trackerid_alert>())
+				if (should_post<trackerid_alert>())
 					m_ses.alerts().emplace_alert<trackerid_alert>(get_handle()
 						, r.url, resp.trackerid);
 			}
@@ -3007,6 +3373,12 @@ namespace libtorrent {
 		}
 #endif
 
+		// the peers are all added with the same peer list state, and the
+		// torrent's state is updated once at the end, rather than for every
+		// peer
+		bool need_update = false;
+		torrent_state st = get_peer_list_state();
+
 		// for each of the peers we got from the tracker
 		for (auto const& i : resp.peers)
 		{
@@ -3028,16 +3400,24 @@ namespace libtorrent {
 				}
 				else
 				{
-					torrent_state st = get_peer_list_state();
 					need_peer_list();
 					if (m_peer_list->add_i2p_peer(i.hostname.c_str (), peer_info::tracker, 0, &st))
-						state_updated();
-					peers_erased(st.erased);
+						need_update = true;
 				}
 			}
 			else
 #endif
 			{
+				// peers given by IP address don't need a name lookup
+				error_code ec;
+				address const a = address::from_string(i.hostname, ec);
+				if (!ec)
+				{
+					tcp::endpoint const ep(a, i.port);
+					need_update |= bool(add_peer_impl(ep, peer_info::tracker, 0, st) != nullptr);
+					continue;
+				}
+
 				ADD_OUTSTANDING_ASYNC("torrent::on_peer_name_lookup");
 				m_ses.get_resolver().async_resolve(i.hostname, resolver_interface::abort_on_shutdown
 					, std::bind(&torrent::on_peer_name_lookup, shared_from_this(), _1, _2, i.port));
@@ -3053,26 +3433,26 @@ namespace libtorrent {
 		//    trackers records a peer's internal and external IP, and match up
 		//    peers on the same local network
 
-		bool need_update = false;
 		for (auto const& i : resp.peers4)
 		{
 			tcp::endpoint a(address_v4(i.ip), i.port);
-			need_update |= bool(add_peer(a, peer_info::tracker) != nullptr);
+			need_update |= bool(add_peer_impl(a, peer_info::tracker, 0, st) != nullptr);
 		}
 
 #if TORRENT_USE_IPV6
 		for (auto const& i : resp.peers6)
 		{
 			tcp::endpoint a(address_v6(i.ip), i.port);
-			need_update |= bool(add_peer(a, peer_info::tracker) != nullptr);
+			need_update |= bool(add_peer_impl(a, peer_info::tracker, 0, st) != nullptr);
 		}
 #endif
+		peers_erased(st.erased);
 		if (need_update) state_updated();
 
 		update_want_peers();
 
 		// post unconditionally if the announce was triggered manually
-		if (m_ses.alerts().should_post<tracker_reply_alert>()
+		if (should_post<tracker_reply_alert>()
 			|| r.triggered_manually)
 		{
 			m_ses.alerts().emplace_alert<tracker_reply_alert>(
@@ -3318,7 +3698,7 @@ namespace libtorrent {
 				debug_log("blocked ip from tracker: %s", host.address().to_string(ec).c_str());
 			}
 #endif
-			if (m_ses.alerts().should_post<peer_blocked_alert>())
+			if (should_post<peer_blocked_alert>())
 				m_ses.alerts().emplace_alert<peer_blocked_alert>(get_handle()
 					, host, peer_blocked_alert::ip_filter);
 			return;
@@ -3706,7 +4086,20 @@ namespace libtorrent {
 		int const availability = m_picker->get_availability(index) * 100 / peers;
 
 		m_suggest_pieces.add_piece(index, availability
-			, settings().get_int(settings_pack::max_suggest_pieces));
+			, settings().get_int(settings_pack::max_suggest_pieces), aux::time_now());
+	}
+
+	int torrent::get_suggest_pieces(std::vector<piece_index_t>& p
+		, typed_bitfield<piece_index_t> const& bits
+		, int const n)
+	{
+		// pieces that haven't been read for longer than the cache expiry are
+		// not likely to still be in the cache. Of the others, suggest the ones
+		// that are rarest right now
+		return m_suggest_pieces.get_pieces(p, bits, n, aux::time_now()
+			, seconds(settings().get_int(settings_pack::cache_expiry))
+			, [this](piece_index_t const i)
+			{ return m_picker ? m_picker->get_availability(i) : 0; });
 	}
 
 	// this is called once we have completely downloaded piece
@@ -3720,6 +4113,8 @@ namespace libtorrent {
 
 		inc_stats_counter(counters::num_have_pieces);
 
+		m_failed_blocks.erase(index);
+
 		// at this point, we have the piece for sure. It has been
 		// successfully written to disk. We may announce it to peers
 		// (unless it has already been announced through predictive_piece_announce
@@ -3734,6 +4129,21 @@ namespace libtorrent {
 			m_predictive_pieces.erase(it);
 		}
 
+		// with coalesced HAVE messages, the piece is announced to all peers
+		// together with any other pieces passing in the same batch of events
+		bool const defer_announce = announce_piece
+			&& settings().get_bool(settings_pack::coalesce_have_messages);
+		if (defer_announce)
+		{
+			m_pending_haves.push_back(index);
+			std::weak_ptr<torrent> weak_t = shared_from_this();
+			m_deferred_have.post(m_ses.get_io_service(), [=]()
+			{
+				std::shared_ptr<torrent> t = weak_t.lock();
+				if (t) t->on_deferred_haves();
+			});
+		}
+
 		// make a copy of the peer list since peers
 		// may disconnect while looping
 		for (auto c : m_connections)
@@ -3751,15 +4161,14 @@ namespace libtorrent {
 			// a request for it, and not sending it because
 			// we were waiting to receive the piece, now that
 			// we have received it, try to send stuff (fill_send_buffer)
+			if (defer_announce) continue;
 			if (announce_piece) p->announce_piece(index);
 			else p->fill_send_buffer();
 		}
 
 #ifndef TORRENT_DISABLE_EXTENSIONS
-		for (auto& ext : m_extensions)
-		{
-			ext->on_piece_pass(index);
-		}
+		m_extensions.for_each(torrent_plugin::piece_check_feature
+			, [&](torrent_plugin& e) { e.on_piece_pass(index); });
 #endif
 
 		// since this piece just passed, we might have
@@ -3777,10 +4186,19 @@ namespace libtorrent {
 			p->update_interest();
 		}
 
-		set_need_save_resume();
+		set_need_save_resume(torrent_handle::resume_pieces);
+		if (!m_passed_overflow)
+		{
+			// once the list of piece indices is larger than the bitfield, there's
+			// no point in keeping it
+			if (int(m_passed_since_save.size()) > m_torrent_file->num_pieces() / 32 + 16)
+				invalidate_passed_pieces();
+			else
+				m_passed_since_save.push_back(index);
+		}
 		state_updated();
 
-		if (m_ses.alerts().should_post<piece_finished_alert>())
+		if (should_post<piece_finished_alert>())
 			m_ses.alerts().emplace_alert<piece_finished_alert>(get_handle(), index);
 
 		// update m_file_progress (if we have one)
@@ -3829,12 +4247,28 @@ namespace libtorrent {
 		TORRENT_ASSERT(index >= piece_index_t(0));
 		TORRENT_ASSERT(index < m_torrent_file->end_piece());
 
-		set_need_save_resume();
+		set_need_save_resume(torrent_handle::resume_pieces);
 
 		inc_stats_counter(counters::num_piece_passed);
 
 		remove_time_critical_piece(index, true);
 
+		if (!m_pending_range_reads.empty())
+		{
+			// issue the range reads that were only waiting for this piece
+			std::vector<std::shared_ptr<range_read>> ready;
+			for (auto i = m_pending_range_reads.begin(); i != m_pending_range_reads.end();)
+			{
+				auto& missing = (*i)->missing;
+				missing.erase(std::remove(missing.begin(), missing.end(), index)
+					, missing.end());
+				if (!missing.empty()) { ++i; continue; }
+				ready.push_back(std::move(*i));
+				i = m_pending_range_reads.erase(i);
+			}
+			for (auto& rr : ready) issue_range_read(std::move(rr));
+		}
+
 		if (settings().get_int(settings_pack::suggest_mode)
 			== settings_pack::suggest_read_cache)
 		{
@@ -3933,7 +4367,7 @@ namespace libtorrent {
 
 		inc_stats_counter(counters::num_piece_failed);
 
-		if (m_ses.alerts().should_post<hash_failed_alert>())
+		if (should_post<hash_failed_alert>())
 			m_ses.alerts().emplace_alert<hash_failed_alert>(get_handle(), index);
 
 		auto it = std::lower_bound(m_predictive_pieces.begin()
@@ -3955,10 +4389,8 @@ namespace libtorrent {
 		add_failed_bytes(m_torrent_file->piece_size(index));
 
 #ifndef TORRENT_DISABLE_EXTENSIONS
-		for (auto& ext : m_extensions)
-		{
-			ext->on_piece_failed(index);
-		}
+		m_extensions.for_each(torrent_plugin::piece_check_feature
+			, [&](torrent_plugin& e) { e.on_piece_failed(index); });
 #endif
 
 		std::vector<torrent_peer*> downloaders;
@@ -4027,7 +4459,7 @@ namespace libtorrent {
 			{
 				// we don't trust this peer anymore
 				// ban it.
-				if (m_ses.alerts().should_post<peer_ban_alert>())
+				if (should_post<peer_ban_alert>())
 				{
 					peer_id pid(nullptr);
 					if (p->connection) pid = p->connection->pid();
@@ -4071,11 +4503,27 @@ namespace libtorrent {
 			// until we're done synchronizing with the disk threads.
 			m_picker->lock_piece(index);
 
-			// don't do this until after the plugins have had a chance
-			// to read back the blocks that failed, for blame purposes
-			// this way they have a chance to hit the cache
-			m_ses.disk_thread().async_clear_piece(m_storage, index
-				, std::bind(&torrent::on_piece_sync, shared_from_this(), _1));
+			if (settings().get_bool(settings_pack::salvage_failed_pieces))
+			{
+				// hash every block of the piece first, to tell which ones
+				// can be kept. The piece is cleared once that's done
+				std::vector<address> addresses;
+				addresses.reserve(downloaders.size());
+				for (auto const p : downloaders)
+					addresses.push_back(p != nullptr ? p->address() : address());
+
+				m_ses.disk_thread().async_hash_blocks(m_storage, index, m_block_salt
+					, std::bind(&torrent::on_failed_piece_hashed, shared_from_this()
+					, std::move(addresses), _1, _2, _3));
+			}
+			else
+			{
+				// don't do this until after the plugins have had a chance
+				// to read back the blocks that failed, for blame purposes
+				// this way they have a chance to hit the cache
+				m_ses.disk_thread().async_clear_piece(m_storage, index
+					, std::bind(&torrent::on_piece_sync, shared_from_this(), _1));
+			}
 		}
 		else
 		{
@@ -4098,6 +4546,152 @@ namespace libtorrent {
 #endif
 	}
 
+	void torrent::on_failed_piece_hashed(std::vector<address> const& downloaders
+		, piece_index_t const piece, std::vector<sha1_hash> const& digests
+		, storage_error const& error) try
+	{
+		TORRENT_ASSERT(is_single_thread());
+
+		// the number of peers whose data is remembered per block, and the
+		// number of pieces blocks are remembered for
+		std::size_t const max_observations = 4;
+		std::size_t const max_failed_pieces = 64;
+
+		if (!m_storage)
+		{
+			TORRENT_ASSERT(m_abort);
+			on_piece_sync(piece);
+			return;
+		}
+
+		// the blocks whose current data two different peers agree on
+		std::vector<int> keep;
+		std::vector<address> bad_peers;
+
+		auto rec = m_failed_blocks.find(piece);
+		if (rec != m_failed_blocks.end() && rec->second.salvaged)
+		{
+			// the piece failed even though only blocks other peers agreed on
+			// were kept. Start over from scratch
+			m_failed_blocks.erase(rec);
+		}
+		else if (!error && has_picker())
+		{
+			if (rec == m_failed_blocks.end())
+			{
+				if (m_failed_blocks.size() >= max_failed_pieces)
+					m_failed_blocks.erase(m_failed_blocks.begin());
+				rec = m_failed_blocks.insert({piece, failed_piece()}).first;
+			}
+			auto& blocks = rec->second.blocks;
+			blocks.resize(digests.size());
+
+			for (std::size_t b = 0; b < digests.size(); ++b)
+			{
+				auto& obs = blocks[b];
+				if (b < downloaders.size()
+					&& !downloaders[b].is_unspecified()
+					&& obs.size() < max_observations
+					&& std::none_of(obs.begin(), obs.end()
+						, [&](block_observation const& o) { return o.peer == downloaders[b]; }))
+				{
+					obs.push_back({downloaders[b], digests[b]});
+				}
+
+				// only the data of the block that's on disk now can be kept,
+				// and only if a second peer sent the same
+				if (std::count_if(obs.begin(), obs.end()
+					, [&](block_observation const& o) { return o.digest == digests[b]; }) < 2)
+					continue;
+
+				keep.push_back(int(b));
+				for (auto const& o : obs)
+				{
+					if (o.digest != digests[b]) bad_peers.push_back(o.peer);
+				}
+			}
+
+			if (keep.size() == digests.size())
+			{
+				// every block is agreed on, and still the piece is bad. Don't
+				// trust any of it
+				keep.clear();
+				bad_peers.clear();
+				m_failed_blocks.erase(rec);
+			}
+			else if (!keep.empty())
+			{
+				rec->second.salvaged = true;
+			}
+		}
+
+		// the peers who sent data for a block two other peers contradict
+		std::sort(bad_peers.begin(), bad_peers.end());
+		bad_peers.erase(std::unique(bad_peers.begin(), bad_peers.end()), bad_peers.end());
+		for (auto const& a : bad_peers)
+		{
+			for (torrent_peer* p : find_peers(a))
+			{
+				if (p->banned) continue;
+				if (should_post<peer_ban_alert>())
+				{
+					peer_id pid(nullptr);
+					if (p->connection) pid = p->connection->pid();
+					m_ses.alerts().emplace_alert<peer_ban_alert>(
+						get_handle(), p->ip(), pid);
+				}
+				if (!ban_peer(p)) continue;
+				inc_stats_counter(counters::banned_for_hash_failure);
+				if (p->connection)
+				{
+					peer_connection* peer = static_cast<peer_connection*>(p->connection);
+#ifndef TORRENT_DISABLE_LOGGING
+					if (should_log())
+					{
+						debug_log("*** BANNING PEER: \"%s\" Sent a block other peers disagree with (piece: %d)"
+							, print_endpoint(p->ip()).c_str(), static_cast<int>(piece));
+					}
+					peer->peer_log(peer_log_alert::info, "BANNING_PEER", "Corrupt block");
+#endif
+					peer->disconnect(errors::peer_banned, op_bittorrent);
+				}
+			}
+		}
+
+		if (keep.empty())
+		{
+			m_ses.disk_thread().async_clear_piece(m_storage, piece
+				, std::bind(&torrent::on_piece_sync, shared_from_this(), _1));
+			return;
+		}
+
+#ifndef TORRENT_DISABLE_LOGGING
+		if (should_log())
+		{
+			debug_log("salvaging %d of %d blocks of failed piece %d"
+				, int(keep.size()), int(digests.size()), static_cast<int>(piece));
+		}
+#endif
+
+		// the blocks to keep may still only be in the cache, which clearing
+		// the piece drops. Write them to disk first
+		std::weak_ptr<torrent> self(shared_from_this());
+		m_ses.disk_thread().async_flush_piece(m_storage, piece
+			, [self, piece, keep]()
+		{
+			auto t = self.lock();
+			if (!t) return;
+			if (!t->m_storage)
+			{
+				t->on_piece_sync(piece);
+				return;
+			}
+			t->m_ses.disk_thread().async_clear_piece(t->m_storage, piece
+				, std::bind(&torrent::on_piece_salvage_sync, t, _1, keep));
+		});
+	}
+	catch (...) { handle_exception(); }
+
 	void torrent::peer_is_interesting(peer_connection& c)
 	{
 		INVARIANT_CHECK;
@@ -4125,7 +4719,34 @@ namespace libtorrent {
 		// unlock the piece and restore it, as if no block was
 		// ever downloaded for it.
 		m_picker->restore_piece(piece);
+		m_file_progress.remove_piece_blocks(m_torrent_file->files(), piece);
+
+		re_request_blocks(piece);
+	}
+	catch (...) { handle_exception(); }
+
+	void torrent::on_piece_salvage_sync(piece_index_t const piece
+		, std::vector<int> const& keep) try
+	{
+		if (!has_picker()) return;
 
+		m_picker->restore_piece(piece);
+		m_file_progress.remove_piece_blocks(m_torrent_file->files(), piece);
+
+		// the data of these blocks is on disk, the piece will be hashed again
+		// once the others have been downloaded
+		for (int const b : keep)
+		{
+			m_picker->mark_as_finished(piece_block(piece, b), nullptr);
+			add_block_progress(piece_block(piece, b));
+		}
+
+		re_request_blocks(piece);
+	}
+	catch (...) { handle_exception(); }
+
+	void torrent::re_request_blocks(piece_index_t const piece)
+	{
 		// we have to let the piece_picker know that
 		// this piece failed the check as it can restore it
 		// and mark it as being interesting for download
@@ -4150,10 +4771,11 @@ namespace libtorrent {
 			}
 		}
 	}
-	catch (...) { handle_exception(); }
 
 	void torrent::peer_has(piece_index_t const index, peer_connection const* peer)
 	{
+		if (m_super_seed_index) m_super_seed_index->inc_availability(index);
+
 		if (has_picker())
 		{
 			torrent_peer* pp = peer->peer_info_struct();
@@ -4169,6 +4791,12 @@ namespace libtorrent {
 	void torrent::peer_has(typed_bitfield<piece_index_t> const& bits
 		, peer_connection const* peer)
 	{
+		if (m_super_seed_index)
+		{
+			for (piece_index_t i(0); i < bits.end_index(); ++i)
+				if (bits[i]) m_super_seed_index->inc_availability(i);
+		}
+
 		if (has_picker())
 		{
 			TORRENT_ASSERT(bits.size() == torrent_file().num_pieces());
@@ -4183,6 +4811,12 @@ namespace libtorrent {
 
 	void torrent::peer_has_all(peer_connection const* peer)
 	{
+		if (m_super_seed_index)
+		{
+			for (piece_index_t i(0); i < m_torrent_file->end_piece(); ++i)
+				m_super_seed_index->inc_availability(i);
+		}
+
 		if (has_picker())
 		{
 			torrent_peer* pp = peer->peer_info_struct();
@@ -4197,6 +4831,12 @@ namespace libtorrent {
 	void torrent::peer_lost(typed_bitfield<piece_index_t> const& bits
 		, peer_connection const* peer)
 	{
+		if (m_super_seed_index)
+		{
+			for (piece_index_t i(0); i < bits.end_index(); ++i)
+				if (bits[i]) m_super_seed_index->dec_availability(i);
+		}
+
 		if (has_picker())
 		{
 			TORRENT_ASSERT(bits.size() == torrent_file().num_pieces());
@@ -4211,6 +4851,8 @@ namespace libtorrent {
 
 	void torrent::peer_lost(piece_index_t const index, peer_connection const* peer)
 	{
+		if (m_super_seed_index) m_super_seed_index->dec_availability(index);
+
 		if (m_picker.get())
 		{
 			torrent_peer* pp = peer->peer_info_struct();
@@ -4244,6 +4886,15 @@ namespace libtorrent {
 		error_code ec;
 		m_inactivity_timer.cancel(ec);
 
+		// the pieces the pending range reads are waiting for won't arrive
+		std::vector<std::shared_ptr<range_read>> range_reads;
+		range_reads.swap(m_pending_range_reads);
+		for (auto const& rr : range_reads)
+		{
+			rr->handler(error_code(boost::system::errc::operation_canceled
+				, generic_category()), {});
+		}
+
 #ifndef TORRENT_DISABLE_LOGGING
 		log_to_all_peers("aborting");
 #endif
@@ -4265,7 +4916,7 @@ namespace libtorrent {
 		}
 		else
 		{
-			if (alerts().should_post<cache_flushed_alert>())
+			if (should_post<cache_flushed_alert>())
 				alerts().emplace_alert<cache_flushed_alert>(get_handle());
 		}
 
@@ -4297,11 +4948,13 @@ namespace libtorrent {
 		if (on == m_super_seeding) return;
 
 		m_super_seeding = on;
-		set_need_save_resume();
+		set_need_save_resume(torrent_handle::resume_settings);
 		state_updated();
 
 		if (m_super_seeding) return;
 
+		m_super_seed_index.reset();
+
 		// disable super seeding for all peers
 		for (auto pc : *this)
 		{
@@ -4318,40 +4971,37 @@ namespace libtorrent {
 		// seeded by any peer
 		TORRENT_ASSERT(m_super_seeding);
 
-		// do a linear search from the first piece
-		int min_availability = 9999;
-		std::vector<piece_index_t> avail_vec;
-		for (piece_index_t i(0); i < m_torrent_file->end_piece(); ++i)
+		if (!m_super_seed_index)
 		{
-			if (bits[i]) continue;
+			m_super_seed_index.reset(new aux::super_seed_index(
+				m_torrent_file->num_pieces()));
 
-			int availability = 0;
 			for (auto pc : *this)
 			{
-				if (pc->super_seeded_piece(i))
+				typed_bitfield<piece_index_t> const& have = pc->get_bitfield();
+				if (have.size() == m_torrent_file->num_pieces())
 				{
-					// avoid superseeding the same piece to more than one
-					// peer if we can avoid it. Do this by artificially
-					// increase the availability
-					availability = 999;
-					break;
+					for (piece_index_t i(0); i < have.end_index(); ++i)
+						if (have[i]) m_super_seed_index->inc_availability(i);
 				}
-				if (pc->has_piece(i)) ++availability;
-			}
-			if (availability > min_availability) continue;
-			if (availability == min_availability)
-			{
-				avail_vec.push_back(i);
-				continue;
+				for (auto const i : pc->super_seeded_pieces())
+					if (i != piece_index_t(-1)) m_super_seed_index->inc_given(i);
 			}
-			TORRENT_ASSERT(availability < min_availability);
-			min_availability = availability;
-			avail_vec.clear();
-			avail_vec.push_back(i);
 		}
 
-		if (avail_vec.empty()) return piece_index_t(-1);
-		return avail_vec[random(std::uint32_t(avail_vec.size() - 1))];
+		// avoid superseeding the same piece to more than one peer if we can
+		// avoid it. The index puts those pieces last
+		return m_super_seed_index->pick(bits);
+	}
+
+	void torrent::super_seeded_pieces_changed(std::array<piece_index_t, 2> const& before
+		, std::array<piece_index_t, 2> const& after)
+	{
+		if (!m_super_seed_index) return;
+		for (auto const p : before)
+			if (p != piece_index_t(-1)) m_super_seed_index->dec_given(p);
+		for (auto const p : after)
+			if (p != piece_index_t(-1)) m_super_seed_index->inc_given(p);
 	}
 
 	void torrent::on_files_deleted(storage_error const& error) try
@@ -4360,7 +5010,7 @@ namespace libtorrent {
 
 		if (error)
 		{
-			if (alerts().should_post<torrent_delete_failed_alert>())
+			if (should_post<torrent_delete_failed_alert>())
 				alerts().emplace_alert<torrent_delete_failed_alert>(get_handle()
 					, error.ec, m_torrent_file->info_hash());
 		}
@@ -4379,16 +5029,17 @@ namespace libtorrent {
 
 		if (error)
 		{
-			if (alerts().should_post<file_rename_failed_alert>())
+			if (should_post<file_rename_failed_alert>())
 				alerts().emplace_alert<file_rename_failed_alert>(get_handle()
 					, file_idx, error.ec);
 		}
 		else
 		{
-			if (alerts().should_post<file_renamed_alert>())
+			if (should_post<file_renamed_alert>())
 				alerts().emplace_alert<file_renamed_alert>(get_handle()
 					, filename, file_idx);
 			m_torrent_file->rename_file(file_idx, filename);
+			set_need_save_resume(torrent_handle::resume_settings);
 		}
 	}
 	catch (...) { handle_exception(); }
@@ -4397,7 +5048,7 @@ namespace libtorrent {
 	{
 		TORRENT_ASSERT(is_single_thread());
 
-		if (alerts().should_post<torrent_paused_alert>())
+		if (should_post<torrent_paused_alert>())
 			alerts().emplace_alert<torrent_paused_alert>(get_handle());
 	}
 	catch (...) { handle_exception(); }
@@ -4565,6 +5216,7 @@ namespace libtorrent {
 		p.deadline = deadline;
 		p.peers = 0;
 		p.piece = piece;
+		p.predicted_arrival = min_time();
 		std::vector<time_critical_piece>::iterator critical_piece_it
 			= std::upper_bound(m_time_critical_pieces.begin()
 			, m_time_critical_pieces.end(), p);
@@ -4781,7 +5433,7 @@ namespace libtorrent {
 		if (filter_updated)
 		{
 			// we need to save this new state
-			set_need_save_resume();
+			set_need_save_resume(torrent_handle::resume_priorities);
 
 			update_peer_interest(was_finished);
 		}
@@ -4823,7 +5475,7 @@ namespace libtorrent {
 		if (filter_updated)
 		{
 			// we need to save this new state
-			set_need_save_resume();
+			set_need_save_resume(torrent_handle::resume_priorities);
 
 			update_peer_interest(was_finished);
 			remove_time_critical_pieces(pieces);
@@ -4850,6 +5502,15 @@ namespace libtorrent {
 		m_picker->piece_priorities(*pieces);
 	}
 
+	void torrent::post_piece_priorities()
+	{
+		TORRENT_ASSERT(is_single_thread());
+		aux::vector<int, piece_index_t> prio;
+		// without metadata there are no pieces to report
+		if (valid_metadata()) piece_priorities(&prio);
+		alerts().emplace_alert<piece_priorities_alert>(get_handle(), std::move(prio));
+	}
+
 	void torrent::on_file_priority(storage_error const&) {}
 
 	void torrent::prioritize_files(aux::vector<int, file_index_t> const& files)
@@ -4882,6 +5543,7 @@ namespace libtorrent {
 				, m_file_priority, std::bind(&torrent::on_file_priority, this, _1));
 		}
 
+		set_need_save_resume(torrent_handle::resume_priorities);
 		update_piece_priorities();
 	}
 
@@ -4911,6 +5573,7 @@ namespace libtorrent {
 
 		if (m_file_priority[index] == prio) return;
 		m_file_priority[index] = std::uint8_t(prio);
+		set_need_save_resume(torrent_handle::resume_priorities);
 
 		if (!valid_metadata()) return;
 
@@ -5063,7 +5726,7 @@ namespace libtorrent {
 
 		if (!m_trackers.empty()) announce_with_tracker();
 
-		set_need_save_resume();
+		set_need_save_resume(torrent_handle::resume_trackers);
 	}
 
 	void torrent::prioritize_udp_trackers()
@@ -5110,6 +5773,7 @@ namespace libtorrent {
 		k = m_trackers.insert(k, url);
 		if (k->source == 0) k->source = announce_entry::source_client;
 		if (!m_paused && !m_trackers.empty()) announce_with_tracker();
+		set_need_save_resume(torrent_handle::resume_trackers);
 		return true;
 	}
 
@@ -5189,7 +5853,7 @@ namespace libtorrent {
 	{
 		if (!m_ssl_ctx)
 		{
-			if (alerts().should_post<torrent_error_alert>())
+			if (should_post<torrent_error_alert>())
 				alerts().emplace_alert<torrent_error_alert>(get_handle()
 					, errors::not_an_ssl_torrent, "");
 			return;
@@ -5200,13 +5864,13 @@ namespace libtorrent {
 		m_ssl_ctx->set_password_callback(std::bind(&password_callback, _1, _2, passphrase), ec);
 		if (ec)
 		{
-			if (alerts().should_post<torrent_error_alert>())
+			if (should_post<torrent_error_alert>())
 				alerts().emplace_alert<torrent_error_alert>(get_handle(), ec, "");
 		}
 		m_ssl_ctx->use_certificate_file(certificate, context::pem, ec);
 		if (ec)
 		{
-			if (alerts().should_post<torrent_error_alert>())
+			if (should_post<torrent_error_alert>())
 				alerts().emplace_alert<torrent_error_alert>(get_handle(), ec, certificate);
 		}
 #ifndef TORRENT_DISABLE_LOGGING
@@ -5216,7 +5880,7 @@ namespace libtorrent {
 		m_ssl_ctx->use_private_key_file(private_key, context::pem, ec);
 		if (ec)
 		{
-			if (alerts().should_post<torrent_error_alert>())
+			if (should_post<torrent_error_alert>())
 				alerts().emplace_alert<torrent_error_alert>(get_handle(), ec, private_key);
 		}
 #ifndef TORRENT_DISABLE_LOGGING
@@ -5226,7 +5890,7 @@ namespace libtorrent {
 		m_ssl_ctx->use_tmp_dh_file(dh_params, ec);
 		if (ec)
 		{
-			if (alerts().should_post<torrent_error_alert>())
+			if (should_post<torrent_error_alert>())
 				alerts().emplace_alert<torrent_error_alert>(get_handle(), ec, dh_params);
 		}
 #ifndef TORRENT_DISABLE_LOGGING
@@ -5248,7 +5912,7 @@ namespace libtorrent {
 		m_ssl_ctx->use_certificate(certificate_buf, context::pem, ec);
 		if (ec)
 		{
-			if (alerts().should_post<torrent_error_alert>())
+			if (should_post<torrent_error_alert>())
 				alerts().emplace_alert<torrent_error_alert>(get_handle(), ec, "[certificate]");
 		}
 
@@ -5256,7 +5920,7 @@ namespace libtorrent {
 		m_ssl_ctx->use_private_key(private_key_buf, context::pem, ec);
 		if (ec)
 		{
-			if (alerts().should_post<torrent_error_alert>())
+			if (should_post<torrent_error_alert>())
 				alerts().emplace_alert<torrent_error_alert>(get_handle(), ec, "[private key]");
 		}
 
@@ -5264,7 +5928,7 @@ namespace libtorrent {
 		m_ssl_ctx->use_tmp_dh(dh_params_buf, ec);
 		if (ec)
 		{
-			if (alerts().should_post<torrent_error_alert>())
+			if (should_post<torrent_error_alert>())
 				alerts().emplace_alert<torrent_error_alert>(get_handle(), ec, "[dh params]");
 		}
 	}
@@ -5315,6 +5979,15 @@ namespace libtorrent {
 			TORRENT_ASSERT(p->associated_torrent().lock().get() == nullptr
 				|| p->associated_torrent().lock().get() == this);
 
+			if (m_super_seed_index)
+			{
+				auto const& pieces = p->get_bitfield();
+				for (piece_index_t i(0); i < pieces.end_index(); ++i)
+					if (pieces[i]) m_super_seed_index->dec_availability(i);
+				super_seeded_pieces_changed(p->super_seeded_pieces()
+					, {{piece_index_t(-1), piece_index_t(-1)}});
+			}
+
 			if (has_picker())
 			{
 				if (p->is_seed())
@@ -5401,6 +6074,82 @@ namespace libtorrent {
 		update_want_tick();
 	}
 
+	void torrent::defer_piece_pick(peer_connection& c)
+	{
+		TORRENT_ASSERT(is_single_thread());
+		auto const self = c.self();
+		if (std::find(m_peers_to_pick.begin(), m_peers_to_pick.end(), self)
+			!= m_peers_to_pick.end())
+			return;
+
+		m_peers_to_pick.push_back(self);
+		std::weak_ptr<torrent> weak_t = shared_from_this();
+		m_deferred_pick.post(m_ses.get_io_service(), [=]()
+		{
+			std::shared_ptr<torrent> t = weak_t.lock();
+			if (t) t->on_deferred_piece_picks();
+		});
+	}
+
+	void torrent::on_deferred_piece_picks()
+	{
+		TORRENT_ASSERT(is_single_thread());
+
+		std::vector<std::shared_ptr<peer_connection>> peers;
+		m_peers_to_pick.swap(peers);
+
+		// pick for the fastest peers first, they are the most likely to
+		// complete whole pieces
+		std::sort(peers.begin(), peers.end()
+			, [](std::shared_ptr<peer_connection> const& lhs
+				, std::shared_ptr<peer_connection> const& rhs)
+			{
+				return lhs->statistics().download_payload_rate()
+					> rhs->statistics().download_payload_rate();
+			});
+
+		for (auto const& p : peers)
+		{
+			if (m_abort) break;
+			if (p->is_disconnecting()) continue;
+			if (p->associated_torrent().lock().get() != this) continue;
+
+			if (request_a_block(*this, *p))
+				inc_stats_counter(counters::incoming_piece_picks);
+			p->send_block_requests();
+		}
+	}
+
+	void torrent::on_deferred_haves()
+	{
+		TORRENT_ASSERT(is_single_thread());
+
+		std::vector<piece_index_t> haves;
+		m_pending_haves.swap(haves);
+
+		if (m_abort) return;
+
+		// a piece may have been lost again since it was queued up (e.g. by
+		// a force-recheck)
+		haves.erase(std::remove_if(haves.begin(), haves.end()
+			, [this](piece_index_t const i) { return !have_piece(i); })
+			, haves.end());
+		if (haves.empty()) return;
+
+		for (auto c : m_connections)
+		{
+			auto p = c->self();
+
+			// all HAVE messages to this peer go out in a single write
+			cork c_(*p);
+			for (auto const i : haves)
+			{
+				p->announce_piece(i);
+				if (p->is_disconnecting()) break;
+			}
+		}
+	}
+
 	void torrent::remove_web_seed_iter(std::list<web_seed_t>::iterator web)
 	{
 		if (web->resolving)
@@ -5462,7 +6211,7 @@ namespace libtorrent {
 			if (should_log())
 				debug_log("failed to parse web seed url: %s", ec.message().c_str());
 #endif
-			if (m_ses.alerts().should_post<url_seed_alert>())
+			if (should_post<url_seed_alert>())
 			{
 				m_ses.alerts().emplace_alert<url_seed_alert>(get_handle()
 					, web->url, ec);
@@ -5477,7 +6226,7 @@ namespace libtorrent {
 #ifndef TORRENT_DISABLE_LOGGING
 			debug_log("banned web seed: %s", web->url.c_str());
 #endif
-			if (m_ses.alerts().should_post<url_seed_alert>())
+			if (should_post<url_seed_alert>())
 			{
 				m_ses.alerts().emplace_alert<url_seed_alert>(get_handle(), web->url
 					, libtorrent::errors::peer_banned);
@@ -5493,7 +6242,7 @@ namespace libtorrent {
 		if (protocol != "http")
 #endif
 		{
-			if (m_ses.alerts().should_post<url_seed_alert>())
+			if (should_post<url_seed_alert>())
 			{
 				m_ses.alerts().emplace_alert<url_seed_alert>(get_handle(), web->url, errors::unsupported_url_protocol);
 			}
@@ -5504,7 +6253,7 @@ namespace libtorrent {
 
 		if (hostname.empty())
 		{
-			if (m_ses.alerts().should_post<url_seed_alert>())
+			if (should_post<url_seed_alert>())
 			{
 				m_ses.alerts().emplace_alert<url_seed_alert>(get_handle(), web->url
 					, errors::invalid_hostname);
@@ -5516,7 +6265,7 @@ namespace libtorrent {
 
 		if (port == 0)
 		{
-			if (m_ses.alerts().should_post<url_seed_alert>())
+			if (should_post<url_seed_alert>())
 			{
 				m_ses.alerts().emplace_alert<url_seed_alert>(get_handle(), web->url
 					, errors::invalid_port);
@@ -5528,7 +6277,7 @@ namespace libtorrent {
 
 		if (m_ses.get_port_filter().access(std::uint16_t(port)) & port_filter::blocked)
 		{
-			if (m_ses.alerts().should_post<url_seed_alert>())
+			if (should_post<url_seed_alert>())
 			{
 				m_ses.alerts().emplace_alert<url_seed_alert>(get_handle()
 					, web->url, errors::port_blocked);
@@ -5617,7 +6366,7 @@ namespace libtorrent {
 
 		if (e || addrs.empty())
 		{
-			if (m_ses.alerts().should_post<url_seed_alert>())
+			if (should_post<url_seed_alert>())
 			{
 				m_ses.alerts().emplace_alert<url_seed_alert>(get_handle()
 					, web->url, e);
@@ -5646,7 +6395,7 @@ namespace libtorrent {
 
 		if (ec)
 		{
-			if (m_ses.alerts().should_post<url_seed_alert>())
+			if (should_post<url_seed_alert>())
 			{
 				m_ses.alerts().emplace_alert<url_seed_alert>(get_handle()
 					, web->url, ec);
@@ -5657,7 +6406,7 @@ namespace libtorrent {
 
 		if (m_ip_filter && m_ip_filter->access(a.address()) & ip_filter::blocked)
 		{
-			if (m_ses.alerts().should_post<peer_blocked_alert>())
+			if (should_post<peer_blocked_alert>())
 				m_ses.alerts().emplace_alert<peer_blocked_alert>(get_handle()
 					, a, peer_blocked_alert::ip_filter);
 			return;
@@ -5700,7 +6449,7 @@ namespace libtorrent {
 
 		if (e || addrs.empty())
 		{
-			if (m_ses.alerts().should_post<url_seed_alert>())
+			if (should_post<url_seed_alert>())
 				m_ses.alerts().emplace_alert<url_seed_alert>(get_handle(), web->url, e);
 #ifndef TORRENT_DISABLE_LOGGING
 			if (should_log())
@@ -5744,7 +6493,7 @@ namespace libtorrent {
 
 		if (m_ip_filter && m_ip_filter->access(a.address()) & ip_filter::blocked)
 		{
-			if (m_ses.alerts().should_post<peer_blocked_alert>())
+			if (should_post<peer_blocked_alert>())
 				m_ses.alerts().emplace_alert<peer_blocked_alert>(get_handle()
 					, a, peer_blocked_alert::ip_filter);
 			return;
@@ -5800,7 +6549,7 @@ namespace libtorrent {
 			= parse_url_components(web->url, ec);
 		if (ec)
 		{
-			if (m_ses.alerts().should_post<url_seed_alert>())
+			if (should_post<url_seed_alert>())
 				m_ses.alerts().emplace_alert<url_seed_alert>(get_handle(), web->url, ec);
 			return;
 		}
@@ -5832,7 +6581,7 @@ namespace libtorrent {
 		setup_ssl_hostname(*s, hostname, ec);
 		if (ec)
 		{
-			if (m_ses.alerts().should_post<url_seed_alert>())
+			if (should_post<url_seed_alert>())
 				m_ses.alerts().emplace_alert<url_seed_alert>(get_handle(), web->url, ec);
 			return;
 		}
@@ -5863,12 +6612,13 @@ namespace libtorrent {
 #endif
 
 #ifndef TORRENT_DISABLE_EXTENSIONS
-		for (auto const& ext : m_extensions)
+		m_extensions.for_each(torrent_plugin::new_connection_feature
+			, [&](torrent_plugin& ext)
 		{
 			std::shared_ptr<peer_plugin>
-				pp(ext->new_connection(peer_connection_handle(c->self())));
+				pp(ext.new_connection(peer_connection_handle(c->self())));
 			if (pp) c->add_extension(pp);
-		}
+		});
 #endif
 
 		TORRENT_ASSERT(!c->m_in_constructor);
@@ -5919,9 +6669,41 @@ namespace libtorrent {
 	}
 
 	void torrent::write_resume_data(add_torrent_params& ret) const
+	{
+		write_resume_data_impl(ret, torrent_handle::resume_all, true);
+	}
+
+	void torrent::write_resume_data_impl(add_torrent_params& ret
+		, int const categories, bool const save_have_pieces) const
 	{
 		ret.version = LIBTORRENT_VERSION_NUM;
 		ret.storage_mode = storage_mode();
+		ret.info_hash = torrent_file().info_hash();
+
+		if (valid_metadata())
+		{
+			if (m_magnet_link || (m_save_resume_flags & torrent_handle::save_info_dict))
+			{
+				ret.ti = m_torrent_file;
+			}
+		}
+
+		if (categories & torrent_handle::resume_stats)
+			write_resume_stats(ret);
+		if (categories & torrent_handle::resume_settings)
+			write_resume_settings(ret);
+		if (categories & torrent_handle::resume_pieces)
+			write_resume_pieces(ret, save_have_pieces);
+		if (categories & torrent_handle::resume_trackers)
+			write_resume_trackers(ret);
+		if (categories & torrent_handle::resume_peers)
+			write_resume_peers(ret);
+		if (categories & torrent_handle::resume_priorities)
+			write_resume_priorities(ret);
+	}
+
+	void torrent::write_resume_stats(add_torrent_params& ret) const
+	{
 		ret.total_uploaded = m_total_uploaded;
 		ret.total_downloaded = m_total_downloaded;
 
@@ -5935,6 +6717,12 @@ namespace libtorrent {
 		ret.num_incomplete = m_incomplete;
 		ret.num_downloaded = m_downloaded;
 
+		ret.added_time = m_added_time;
+		ret.completed_time = m_completed_time;
+	}
+
+	void torrent::write_resume_settings(add_torrent_params& ret) const
+	{
 		ret.flags = 0;
 		if (m_sequential_download) ret.flags |= add_torrent_params::flag_sequential_download;
 		if (m_seed_mode ) ret.flags |= add_torrent_params::flag_seed_mode;
@@ -5942,9 +6730,6 @@ namespace libtorrent {
 		if (is_torrent_paused()) ret.flags |= add_torrent_params::flag_paused;
 		if (m_auto_managed ) ret.flags |= add_torrent_params::flag_auto_managed;
 
-		ret.added_time = m_added_time;
-		ret.completed_time = m_completed_time;
-
 		ret.save_path = m_save_path;
 
 #ifndef TORRENT_NO_DEPRECATE
@@ -5953,20 +6738,33 @@ namespace libtorrent {
 		ret.uuid = m_uuid;
 #endif
 
-		ret.info_hash = torrent_file().info_hash();
-
-		if (valid_metadata())
+		// write renamed files
+		if (&m_torrent_file->files() != &m_torrent_file->orig_files()
+			&& m_torrent_file->files().num_files() == m_torrent_file->orig_files().num_files())
 		{
-			if (m_magnet_link || (m_save_resume_flags & torrent_handle::save_info_dict))
+			file_storage const& fs = m_torrent_file->files();
+			file_storage const& orig_fs = m_torrent_file->orig_files();
+			for (file_index_t i(0); i < fs.end_file(); ++i)
 			{
-				ret.ti = m_torrent_file;
+				if (fs.file_path(i) != orig_fs.file_path(i))
+					ret.renamed_files[i] = fs.file_path(i);
 			}
 		}
 
+		ret.upload_limit = upload_limit();
+		ret.download_limit = download_limit();
+		ret.max_connections = max_connections();
+		ret.max_uploads = max_uploads();
+	}
+
+	void torrent::write_resume_pieces(add_torrent_params& ret
+		, bool const save_have_pieces) const
+	{
 		if (m_torrent_file->is_merkle_torrent())
 		{
 			// we need to save the whole merkle hash tree
-			// in order to resume
+			// in order to resume. If it hasn't been allocated, we don't
+			// know anything but the root, which is in the torrent file
 			ret.merkle_tree = m_torrent_file->merkle_tree();
 		}
 
@@ -5998,26 +6796,6 @@ namespace libtorrent {
 			}
 		}
 
-		// save trackers
-		for (announce_entry const& tr : m_trackers)
-		{
-			ret.trackers.push_back(tr.url);
-			ret.tracker_tiers.push_back(tr.tier);
-		}
-
-		// save web seeds
-		if (!m_web_seeds.empty())
-		{
-			for (web_seed_t const& ws : m_web_seeds)
-			{
-				if (ws.removed || ws.ephemeral) continue;
-				if (ws.type == web_seed_entry::url_seed)
-					ret.url_seeds.push_back(ws.url);
-				else if (ws.type == web_seed_entry::http_seed)
-					ret.http_seeds.push_back(ws.url);
-			}
-		}
-
 		// write have bitmask
 		// the pieces string has one byte per piece. Each
 		// byte is a bitmask representing different properties
@@ -6038,11 +6816,13 @@ namespace libtorrent {
 
 		if (max_piece > piece_index_t(0))
 		{
-			if (is_seed())
+			// when only saving changes, the pieces passed since the last save
+			// are reported instead of the whole bitfield
+			if (save_have_pieces && is_seed())
 			{
 				ret.have_pieces.resize(static_cast<int>(max_piece), m_have_all);
 			}
-			else if (has_picker())
+			else if (save_have_pieces && has_picker())
 			{
 				ret.have_pieces.resize(static_cast<int>(max_piece), false);
 				for (piece_index_t i(0); i < max_piece; ++i)
@@ -6054,20 +6834,33 @@ namespace libtorrent {
 			if (m_seed_mode)
 				ret.verified_pieces = m_verified;
 		}
+	}
 
-		// write renamed files
-		if (&m_torrent_file->files() != &m_torrent_file->orig_files()
-			&& m_torrent_file->files().num_files() == m_torrent_file->orig_files().num_files())
+	void torrent::write_resume_trackers(add_torrent_params& ret) const
+	{
+		// save trackers
+		for (announce_entry const& tr : m_trackers)
 		{
-			file_storage const& fs = m_torrent_file->files();
-			file_storage const& orig_fs = m_torrent_file->orig_files();
-			for (file_index_t i(0); i < fs.end_file(); ++i)
+			ret.trackers.push_back(tr.url);
+			ret.tracker_tiers.push_back(tr.tier);
+		}
+
+		// save web seeds
+		if (!m_web_seeds.empty())
+		{
+			for (web_seed_t const& ws : m_web_seeds)
 			{
-				if (fs.file_path(i) != orig_fs.file_path(i))
-					ret.renamed_files[i] = fs.file_path(i);
+				if (ws.removed || ws.ephemeral) continue;
+				if (ws.type == web_seed_entry::url_seed)
+					ret.url_seeds.push_back(ws.url);
+				else if (ws.type == web_seed_entry::http_seed)
+					ret.http_seeds.push_back(ws.url);
 			}
 		}
+	}
 
+	void torrent::write_resume_peers(add_torrent_params& ret) const
+	{
 		// write local peers
 		std::vector<torrent_peer const*> deferred_peers;
 		if (m_peer_list)
@@ -6122,12 +6915,10 @@ namespace libtorrent {
 				if (int(ret.peers.size()) >= 100) break;
 			}
 		}
+	}
 
-		ret.upload_limit = upload_limit();
-		ret.download_limit = download_limit();
-		ret.max_connections = max_connections();
-		ret.max_uploads = max_uploads();
-
+	void torrent::write_resume_priorities(add_torrent_params& ret) const
+	{
 		// piece priorities and file priorities are mutually exclusive. If there
 		// are file priorities set, don't save piece priorities.
 		if (!m_file_priority.empty())
@@ -6204,6 +6995,14 @@ namespace libtorrent {
 		}
 	}
 
+	void torrent::post_peer_info()
+	{
+		TORRENT_ASSERT(is_single_thread());
+		std::vector<peer_info> v;
+		get_peer_info(&v);
+		alerts().emplace_alert<peer_info_alert>(get_handle(), std::move(v));
+	}
+
 	void torrent::get_download_queue(std::vector<partial_piece_info>* queue) const
 	{
 		TORRENT_ASSERT(is_single_thread());
@@ -6344,7 +7143,7 @@ namespace libtorrent {
 			{
 				// we have an i2p torrent, but we're not connected to an i2p
 				// SAM proxy.
-				if (alerts().should_post<i2p_alert>())
+				if (should_post<i2p_alert>())
 					alerts().emplace_alert<i2p_alert>(errors::no_i2p_router);
 				return false;
 			}
@@ -6409,8 +7208,11 @@ namespace libtorrent {
 				std::string host_name = aux::to_hex(m_torrent_file->info_hash());
 
 #define CASE(t) case socket_type_int_impl<ssl_stream<t>>::value: \
-	s->get<ssl_stream<t>>()->set_host_name(host_name); break;
+	s->get<ssl_stream<t>>()->set_host_name(host_name); \
+	ssl_conn = s->get<ssl_stream<t>>()->native_handle(); \
+	break;
 
+				SSL* ssl_conn = nullptr;
 				switch (s->type())
 				{
 					CASE(tcp::socket)
@@ -6419,6 +7221,10 @@ namespace libtorrent {
 					CASE(utp_stream)
 					default: break;
 				};
+
+				// offer the session from the last time we were connected to this
+				// peer, if we have one
+				if (ssl_conn && m_ssl_sessions) m_ssl_sessions->prepare(ssl_conn, a);
 			}
 #undef CASE
 #endif
@@ -6437,8 +7243,9 @@ namespace libtorrent {
 		pack.endp = a;
 		pack.peerinfo = peerinfo;
 
-		std::shared_ptr<peer_connection> c = std::make_shared<bt_peer_connection>(
-			pack, m_ses.get_peer_id());
+		std::shared_ptr<peer_connection> c = std::allocate_shared<bt_peer_connection>(
+			aux::pool_allocator<bt_peer_connection>(m_ses.connection_pool())
+			, pack, m_ses.get_peer_id());
 
 		TORRENT_TRY
 		{
@@ -6452,12 +7259,13 @@ namespace libtorrent {
 			peerinfo->prev_amount_upload = 0;
 
 #ifndef TORRENT_DISABLE_EXTENSIONS
-			for (auto const& ext : m_extensions)
+			m_extensions.for_each(torrent_plugin::new_connection_feature
+				, [&](torrent_plugin& ext)
 			{
-				std::shared_ptr<peer_plugin> pp(ext->new_connection(
+				std::shared_ptr<peer_plugin> pp(ext.new_connection(
 					peer_connection_handle(c->self())));
 				if (pp) c->add_extension(pp);
-			}
+			});
 #endif
 
 			// add the newly connected peer to this torrent's peer list
@@ -6498,7 +7306,7 @@ namespace libtorrent {
 		sha1_hash const info_hash = hasher(metadata_buf).final();
 		if (info_hash != m_torrent_file->info_hash())
 		{
-			if (alerts().should_post<metadata_failed_alert>())
+			if (should_post<metadata_failed_alert>())
 			{
 				alerts().emplace_alert<metadata_failed_alert>(get_handle()
 					, errors::mismatching_info_hash);
@@ -6515,7 +7323,7 @@ namespace libtorrent {
 			// this means the metadata is correct, since we
 			// verified it against the info-hash, but we
 			// failed to parse it. Pause the torrent
-			if (alerts().should_post<metadata_failed_alert>())
+			if (should_post<metadata_failed_alert>())
 			{
 				alerts().emplace_alert<metadata_failed_alert>(get_handle(), ec);
 			}
@@ -6526,7 +7334,7 @@ namespace libtorrent {
 
 		update_gauge();
 
-		if (m_ses.alerts().should_post<metadata_received_alert>())
+		if (should_post<metadata_received_alert>())
 		{
 			m_ses.alerts().emplace_alert<metadata_received_alert>(
 				get_handle());
@@ -6544,7 +7352,7 @@ namespace libtorrent {
 		for (auto p : m_connections)
 			p->disconnect_if_redundant();
 
-		set_need_save_resume();
+		set_need_save_resume(torrent_handle::resume_all);
 
 		return true;
 	}
@@ -6644,7 +7452,7 @@ namespace libtorrent {
 			&& m_ip_filter
 			&& m_ip_filter->access(p->remote().address()) & ip_filter::blocked)
 		{
-			if (m_ses.alerts().should_post<peer_blocked_alert>())
+			if (should_post<peer_blocked_alert>())
 				m_ses.alerts().emplace_alert<peer_blocked_alert>(get_handle()
 					, p->remote(), peer_blocked_alert::ip_filter);
 			p->disconnect(errors::banned_by_ip_filter, op_bittorrent);
@@ -6720,12 +7528,13 @@ namespace libtorrent {
 		}
 
 #ifndef TORRENT_DISABLE_EXTENSIONS
-		for (auto& ext : m_extensions)
+		m_extensions.for_each(torrent_plugin::new_connection_feature
+			, [&](torrent_plugin& ext)
 		{
-			std::shared_ptr<peer_plugin> pp(ext->new_connection(
+			std::shared_ptr<peer_plugin> pp(ext.new_connection(
 					peer_connection_handle(p->self())));
 			if (pp) p->add_extension(pp);
-		}
+		});
 #endif
 		torrent_state st = get_peer_list_state();
 		need_peer_list();
@@ -7286,7 +8095,7 @@ namespace libtorrent {
 
 		INVARIANT_CHECK;
 
-		if (m_ses.alerts().should_post<torrent_checked_alert>())
+		if (should_post<torrent_checked_alert>())
 		{
 			m_ses.alerts().emplace_alert<torrent_checked_alert>(
 				get_handle());
@@ -7310,7 +8119,7 @@ namespace libtorrent {
 			if (m_super_seeding)
 			{
 				m_super_seeding = false;
-				set_need_save_resume();
+				set_need_save_resume(torrent_handle::resume_settings);
 				state_updated();
 			}
 
@@ -7328,10 +8137,7 @@ namespace libtorrent {
 		}
 
 #ifndef TORRENT_DISABLE_EXTENSIONS
-		for (auto& ext : m_extensions)
-		{
-			ext->on_files_checked();
-		}
+		m_extensions.for_each([&](torrent_plugin& e) { e.on_files_checked(); });
 #endif
 
 		bool const notify_initialized = !m_connections_initialized;
@@ -7376,6 +8182,13 @@ namespace libtorrent {
 		return m_ses.alerts();
 	}
 
+	void torrent::set_alert_mask(std::uint32_t const m)
+	{
+		if (m == m_alert_mask) return;
+		m_alert_mask = m;
+		m_ses.update_extra_alert_mask();
+	}
+
 	bool torrent::is_seed() const
 	{
 		if (!valid_metadata()) return false;
@@ -7422,7 +8235,7 @@ namespace libtorrent {
 		// storage may be nullptr during shutdown
 		if (!m_storage)
 		{
-			if (alerts().should_post<file_rename_failed_alert>())
+			if (should_post<file_rename_failed_alert>())
 				alerts().emplace_alert<file_rename_failed_alert>(get_handle()
 					, index, errors::session_is_closing);
 			return;
@@ -7440,7 +8253,7 @@ namespace libtorrent {
 
 		if (m_abort)
 		{
-			if (alerts().should_post<storage_moved_failed_alert>())
+			if (should_post<storage_moved_failed_alert>())
 				alerts().emplace_alert<storage_moved_failed_alert>(get_handle(), boost::asio::error::operation_aborted
 					, "", "");
 			return;
@@ -7476,9 +8289,9 @@ namespace libtorrent {
 
 			m_save_path = save_path;
 #endif
-			set_need_save_resume();
+			set_need_save_resume(torrent_handle::resume_settings);
 
-			if (alerts().should_post<storage_moved_alert>())
+			if (should_post<storage_moved_alert>())
 			{
 				alerts().emplace_alert<storage_moved_alert>(get_handle(), m_save_path);
 			}
@@ -7494,16 +8307,16 @@ namespace libtorrent {
 		if (status == status_t::no_error
 			|| status == status_t::need_full_check)
 		{
-			if (alerts().should_post<storage_moved_alert>())
+			if (should_post<storage_moved_alert>())
 				alerts().emplace_alert<storage_moved_alert>(get_handle(), path);
 			m_save_path = path;
-			set_need_save_resume();
+			set_need_save_resume(torrent_handle::resume_settings);
 			if (status == status_t::need_full_check)
 				force_recheck();
 		}
 		else
 		{
-			if (alerts().should_post<storage_moved_failed_alert>())
+			if (should_post<storage_moved_failed_alert>())
 				alerts().emplace_alert<storage_moved_failed_alert>(get_handle(), error.ec
 					, resolve_filename(error.file()), error.operation_str());
 		}
@@ -7531,8 +8344,8 @@ namespace libtorrent {
 		TORRENT_ASSERT(current_stats_state() == int(m_current_gauge_state + counters::num_checking_torrents)
 			|| m_current_gauge_state == no_gauge_state);
 
-		TORRENT_ASSERT(m_sequence_number == -1
-			|| m_ses.verify_queue_position(this, m_sequence_number));
+		TORRENT_ASSERT(m_queue_handle == -1
+			|| m_ses.verify_queue_position(this, queue_position()));
 
 		for (auto const& i : m_time_critical_pieces)
 		{
@@ -7723,22 +8536,6 @@ namespace libtorrent {
 			TORRENT_ASSERT(m_abort || m_error || !m_picker || m_picker->num_pieces() == 0);
 		}
 
-#ifdef TORRENT_EXPENSIVE_INVARIANT_CHECKS
-		// make sure we haven't modified the peer object
-		// in a way that breaks the sort order
-		if (m_peer_list && m_peer_list->begin() != m_peer_list->end())
-		{
-			auto i = m_peer_list->begin();
-			auto p = i++;
-			auto end(m_peer_list->end());
-			peer_address_compare cmp;
-			for (; i != end; ++i, ++p)
-			{
-				TORRENT_ASSERT(!cmp(*i, *p));
-			}
-		}
-#endif
-
 		std::int64_t total_done = quantized_bytes_done();
 		if (m_torrent_file->is_valid())
 		{
@@ -7794,11 +8591,37 @@ namespace libtorrent {
 		debug_log("*** set-sequential-download: %d", sd);
 #endif
 
-		set_need_save_resume();
+		set_need_save_resume(torrent_handle::resume_settings);
 
 		state_updated();
 	}
 
+	void torrent::set_stream_window(file_index_t const file
+		, std::int64_t const offset, int num_pieces)
+	{
+		TORRENT_ASSERT(is_single_thread());
+		if (!valid_metadata() || num_pieces <= 0
+			|| file < file_index_t(0) || file >= m_torrent_file->files().end_file()
+			|| offset < 0 || offset >= m_torrent_file->files().file_size(file))
+		{
+			m_stream_window_size = 0;
+			return;
+		}
+
+		piece_index_t const start = m_torrent_file->map_file(file, offset, 0).piece;
+		num_pieces = (std::min)(num_pieces
+			, static_cast<int>(m_torrent_file->end_piece()) - static_cast<int>(start));
+		if (start == m_stream_window_start && num_pieces == m_stream_window_size)
+			return;
+
+		m_stream_window_start = start;
+		m_stream_window_size = num_pieces;
+#ifndef TORRENT_DISABLE_LOGGING
+		debug_log("*** set-stream-window: %d (%d pieces)"
+			, static_cast<int>(start), num_pieces);
+#endif
+	}
+
 	void torrent::queue_up()
 	{
 		// fix race conditions on async position change calls (from handler)
@@ -7813,6 +8636,12 @@ namespace libtorrent {
 		set_queue_position(queue_position() + 1);
 	}
 
+	int torrent::queue_position() const
+	{
+		if (m_queue_handle < 0) return -1;
+		return m_ses.queue_position(this);
+	}
+
 	void torrent::set_queue_position(int p)
 	{
 		TORRENT_ASSERT(is_single_thread());
@@ -7824,7 +8653,7 @@ namespace libtorrent {
 			|| (!m_auto_managed && p == -1)
 			|| (m_abort && p == -1)
 			|| (!m_added && p == -1));
-		if (p == m_sequence_number) return;
+		if (p == queue_position()) return;
 
 		TORRENT_ASSERT(p >= -1);
 
@@ -7845,7 +8674,7 @@ namespace libtorrent {
 #endif
 
 		if (state_update)
-			set_need_save_resume();
+			set_need_save_resume(torrent_handle::resume_settings);
 	}
 
 	void torrent::set_max_connections(int limit, bool const state_update)
@@ -7868,13 +8697,13 @@ namespace libtorrent {
 		}
 
 		if (state_update)
-			set_need_save_resume();
+			set_need_save_resume(torrent_handle::resume_settings);
 	}
 
 	void torrent::set_upload_limit(int limit)
 	{
 		set_limit_impl(limit, peer_connection::upload_channel);
-		set_need_save_resume();
+		set_need_save_resume(torrent_handle::resume_settings);
 #ifndef TORRENT_DISABLE_LOGGING
 		debug_log("*** set-upload-limit: %d", limit);
 #endif
@@ -7883,7 +8712,7 @@ namespace libtorrent {
 	void torrent::set_download_limit(int limit)
 	{
 		set_limit_impl(limit, peer_connection::download_channel);
-		set_need_save_resume();
+		set_need_save_resume(torrent_handle::resume_settings);
 #ifndef TORRENT_DISABLE_LOGGING
 		debug_log("*** set-download-limit: %d", limit);
 #endif
@@ -8014,7 +8843,7 @@ namespace libtorrent {
 
 		update_gauge();
 
-		if (alerts().should_post<torrent_error_alert>())
+		if (should_post<torrent_error_alert>())
 			alerts().emplace_alert<torrent_error_alert>(get_handle(), ec
 				, resolve_filename(error_file));
 
@@ -8047,7 +8876,7 @@ namespace libtorrent {
 		state_updated();
 
 		// we need to save this new state as well
-		set_need_save_resume();
+		set_need_save_resume(torrent_handle::resume_settings);
 
 		// recalculate which torrents should be
 		// paused
@@ -8186,7 +9015,25 @@ namespace libtorrent {
 			return;
 		}
 
-		m_need_save_resume_data = false;
+		int changes = m_need_save_resume_data;
+		// stats like the active time keep changing without being flagged, and
+		// changes to the peer list aren't tracked at all
+		if (aux::time_now32() - m_last_saved_resume > minutes(15))
+			changes |= torrent_handle::resume_stats | torrent_handle::resume_peers;
+
+		bool const only_changes = (flags & torrent_handle::only_changes) != 0;
+		int const categories = only_changes ? changes : int(torrent_handle::resume_all);
+
+		// the delta can only be used if the caller has all previous deltas, i.e.
+		// if it saved the full bitfield at some point, and we haven't lost any
+		// pieces since
+		bool const save_have_pieces = !only_changes || m_passed_overflow;
+		std::vector<piece_index_t> passed_pieces;
+		if (!save_have_pieces) passed_pieces.swap(m_passed_since_save);
+		m_passed_since_save.clear();
+		m_passed_overflow = false;
+
+		m_need_save_resume_data = 0;
 		m_last_saved_resume = aux::time_now32();
 		m_save_resume_flags = aux::numeric_cast<std::uint8_t>(flags);
 		state_updated();
@@ -8197,8 +9044,9 @@ namespace libtorrent {
 		state_updated();
 
 		add_torrent_params atp;
-		write_resume_data(atp);
-		alerts().emplace_alert<save_resume_data_alert>(std::move(atp), get_handle());
+		write_resume_data_impl(atp, categories, save_have_pieces);
+		alerts().emplace_alert<save_resume_data_alert>(std::move(atp), get_handle()
+			, changes, std::move(passed_pieces));
 	}
 
 	bool torrent::should_check_files() const
@@ -8231,7 +9079,7 @@ namespace libtorrent {
 
 		if (m_ses.is_aborted()) return;
 
-		if (alerts().should_post<cache_flushed_alert>())
+		if (should_post<cache_flushed_alert>())
 			alerts().emplace_alert<cache_flushed_alert>(get_handle());
 	}
 	catch (...) { handle_exception(); }
@@ -8249,7 +9097,7 @@ namespace libtorrent {
 		if (!m_paused)
 		{
 			// we need to save this new state
-			set_need_save_resume();
+			set_need_save_resume(torrent_handle::resume_settings);
 		}
 
 		int const flags = graceful ? flag_graceful_pause : 0;
@@ -8272,10 +9120,8 @@ namespace libtorrent {
 		}
 
 #ifndef TORRENT_DISABLE_EXTENSIONS
-		for (auto& ext : m_extensions)
-		{
-			if (ext->on_pause()) return;
-		}
+		if (m_extensions.any_of([](torrent_plugin& ext) { return ext.on_pause(); }))
+			return;
 #endif
 
 		m_need_connect_boost = true;
@@ -8315,7 +9161,7 @@ namespace libtorrent {
 		{
 			if (m_checking_piece == m_num_checked_pieces)
 			{
-				if (alerts().should_post<torrent_paused_alert>())
+				if (should_post<torrent_paused_alert>())
 					alerts().emplace_alert<torrent_paused_alert>(get_handle());
 			}
 			disconnect_all(errors::torrent_paused, op_bittorrent);
@@ -8334,7 +9180,7 @@ namespace libtorrent {
 			}
 			else
 			{
-				if (alerts().should_post<torrent_paused_alert>())
+				if (should_post<torrent_paused_alert>())
 					alerts().emplace_alert<torrent_paused_alert>(get_handle());
 			}
 
@@ -8411,7 +9257,7 @@ namespace libtorrent {
 		auto it = std::find(m_web_seeds.begin(), m_web_seeds.end(), ent);
 		if (it != m_web_seeds.end()) return &*it;
 		m_web_seeds.push_back(ent);
-		set_need_save_resume();
+		set_need_save_resume(torrent_handle::resume_trackers);
 		return &m_web_seeds.back();
 	}
 
@@ -8488,7 +9334,7 @@ namespace libtorrent {
 		update_gauge();
 
 		// we need to save this new state
-		set_need_save_resume();
+		set_need_save_resume(torrent_handle::resume_settings);
 
 		do_resume();
 	}
@@ -8503,13 +9349,11 @@ namespace libtorrent {
 		}
 
 #ifndef TORRENT_DISABLE_EXTENSIONS
-		for (auto& ext : m_extensions)
-		{
-			if (ext->on_resume()) return;
-		}
+		if (m_extensions.any_of([](torrent_plugin& ext) { return ext.on_resume(); }))
+			return;
 #endif
 
-		if (alerts().should_post<torrent_resumed_alert>())
+		if (should_post<torrent_resumed_alert>())
 			alerts().emplace_alert<torrent_resumed_alert>(get_handle());
 
 		m_started = aux::time_now32();
@@ -8750,10 +9594,8 @@ namespace libtorrent {
 		auto self = shared_from_this();
 
 #ifndef TORRENT_DISABLE_EXTENSIONS
-		for (auto const& ext : m_extensions)
-		{
-			ext->tick();
-		}
+		m_extensions.for_each(torrent_plugin::tick_feature
+			, [&](torrent_plugin& e) { e.tick(); });
 
 		if (m_abort) return;
 #endif
@@ -8767,15 +9609,24 @@ namespace libtorrent {
 			set_upload_mode(false);
 		}
 
+		// the piece picker grows as pieces are being downloaded. Keep the
+		// piece_picker_bytes gauge up to date
+		if (m_picker) update_gauge();
+
+		if (m_seed_mode && m_background_verifications == 0)
+			verify_in_background();
+
 		if (is_paused() && !m_graceful_pause_mode)
 		{
 			// let the stats fade out to 0
 			m_stat.second_tick(tick_interval_ms);
 			// if the rate is 0, there's no update because of network transfers
 			if (m_stat.low_pass_upload_rate() > 0 || m_stat.low_pass_download_rate() > 0)
+			{
 				state_updated();
-			else
-				update_want_tick();
+				clear_idle_rates();
+			}
+			update_want_tick();
 
 			return;
 		}
@@ -8787,7 +9638,7 @@ namespace libtorrent {
 
 			if (down_limit > 0
 				&& m_stat.download_ip_overhead() >= down_limit
-				&& alerts().should_post<performance_alert>())
+				&& should_post<performance_alert>())
 			{
 				alerts().emplace_alert<performance_alert>(get_handle()
 					, performance_alert::download_limit_too_low);
@@ -8795,7 +9646,7 @@ namespace libtorrent {
 
 			if (up_limit > 0
 				&& m_stat.upload_ip_overhead() >= up_limit
-				&& alerts().should_post<performance_alert>())
+				&& should_post<performance_alert>())
 			{
 				alerts().emplace_alert<performance_alert>(get_handle()
 					, performance_alert::upload_limit_too_low);
@@ -8846,20 +9697,25 @@ namespace libtorrent {
 			// resource requests
 			p->second_tick(tick_interval_ms);
 		}
-		if (m_ses.alerts().should_post<stats_alert>())
+		if (should_post<stats_alert>())
 			m_ses.alerts().emplace_alert<stats_alert>(get_handle(), tick_interval_ms, m_stat);
 
+		// these counters are saved in the resume data, if they changed we need
+		// to save the resume data too
+		if (m_stat.last_payload_uploaded() > 0
+			|| m_stat.last_payload_downloaded() > 0)
+			set_need_save_resume(torrent_handle::resume_stats);
+
 		m_total_uploaded += m_stat.last_payload_uploaded();
 		m_total_downloaded += m_stat.last_payload_downloaded();
 		m_stat.second_tick(tick_interval_ms);
 
-		// these counters are saved in the resume data, since they updated
-		// we need to save the resume data too
-		m_need_save_resume_data = true;
-
 		// if the rate is 0, there's no update because of network transfers
 		if (m_stat.low_pass_upload_rate() > 0 || m_stat.low_pass_download_rate() > 0)
+		{
 			state_updated();
+			clear_idle_rates();
+		}
 
 		// this section determines whether the torrent is active or not. When it
 		// changes state, it may also trigger the auto-manage logic to reconsider
@@ -8887,6 +9743,15 @@ namespace libtorrent {
 		update_want_tick();
 	}
 
+	void torrent::clear_idle_rates()
+	{
+		// with no connections left, nothing is being transferred. Rather than
+		// keeping the torrent in the tick list for another minute while the
+		// averages fade out, drop them to 0 right away
+		if (num_peers() > 0) return;
+		m_stat.clear_rates();
+	}
+
 	bool torrent::is_inactive_internal() const
 	{
 		if (is_finished())
@@ -8956,6 +9821,40 @@ namespace libtorrent {
 
 			connect_to_url_seed(w);
 		}
+
+		// open additional connections to the url-seeds we're connected to, as
+		// long as they support keep-alive
+		int const per_url = settings().get_int(settings_pack::urlseed_connections);
+		if (per_url <= 1) return;
+
+		for (std::list<web_seed_t>::iterator i = m_web_seeds.begin();
+			i != m_web_seeds.end() && limit > 0; ++i)
+		{
+			if (i->secondary
+				|| i->removed
+				|| i->type != web_seed_entry::url_seed
+				|| i->peer_info.connection == nullptr
+				|| !i->supports_keepalive)
+				continue;
+
+			int num = int(std::count_if(m_web_seeds.begin(), m_web_seeds.end()
+				, [&] (web_seed_t const& w) { return w.url == i->url && w.type == i->type; }));
+
+			for (; num < per_url && limit > 0; ++num, --limit)
+			{
+				web_seed_t ws(i->url, web_seed_entry::type_t(i->type), i->auth, i->extra_headers);
+				ws.ephemeral = true;
+				ws.secondary = true;
+				ws.redirects = i->redirects;
+				ws.have_files = i->have_files;
+				m_web_seeds.push_back(std::move(ws));
+
+#ifndef TORRENT_DISABLE_LOGGING
+				debug_log("adding connection %d to web seed: \"%s\"", num + 1, i->url.c_str());
+#endif
+				connect_to_url_seed(std::prev(m_web_seeds.end()));
+			}
+		}
 	}
 
 	void torrent::recalc_share_mode()
@@ -9289,6 +10188,19 @@ namespace libtorrent {
 		}
 	}
 
+	// the time we expect it to take for a block requested from this peer now
+	// to arrive. The peer first has to send everything we've already
+	// requested from it, and the request itself takes a round trip
+	time_duration expected_block_time(peer_connection const* p, int const extra_bytes)
+	{
+		return p->download_queue_time(extra_bytes) + milliseconds(p->rtt());
+	}
+
+	bool expected_block_time_less(peer_connection const* lhs, peer_connection const* rhs)
+	{
+		return expected_block_time(lhs, 16 * 1024) < expected_block_time(rhs, 16 * 1024);
+	}
+
 	void pick_time_critical_block(std::vector<peer_connection*>& peers
 		, std::vector<peer_connection*>& ignore_peers
 		, std::set<peer_connection*>& peers_with_requests
@@ -9461,6 +10373,10 @@ namespace libtorrent {
 
 			if (i->first_requested == min_time()) i->first_requested = now;
 
+			// the piece is complete when its slowest block arrives
+			i->predicted_arrival = (std::max)(i->predicted_arrival
+				, now + expected_block_time(&c, 0));
+
 			if (!c.can_request_time_critical())
 			{
 #if TORRENT_DEBUG_STREAMING > 1
@@ -9472,8 +10388,7 @@ namespace libtorrent {
 			}
 
 			// resort p, since it will have a higher download_queue_time now
-			while (p != peers.end()-1 && (*p)->download_queue_time()
-				> (*(p+1))->download_queue_time())
+			while (p != peers.end()-1 && expected_block_time_less(*(p+1), *p))
 			{
 				std::iter_swap(p, p+1);
 				++p;
@@ -9504,11 +10419,10 @@ namespace libtorrent {
 			{ return !p->can_request_time_critical(); });
 
 		// sort by the time we believe it will take this peer to send us all
-		// blocks we've requested from it. The shorter time, the better candidate
-		// it is to request a time critical block from.
-		std::sort(peers.begin(), peers.end()
-			, [] (peer_connection const* lhs, peer_connection const* rhs)
-			{ return lhs->download_queue_time(16*1024) < rhs->download_queue_time(16*1024); });
+		// blocks we've requested from it, plus the round trip for a new
+		// request. The shorter time, the better candidate it is to request a
+		// time critical block from.
+		std::sort(peers.begin(), peers.end(), &expected_block_time_less);
 
 		// remove the bottom 10% of peers from the candidate set.
 		// this is just to remove outliers that might stall downloads
@@ -9593,6 +10507,20 @@ namespace libtorrent {
 					timed_out = int(total_milliseconds(now - i.last_requested)
 						/ (std::max)(int(m_average_piece_time + m_piece_time_deviation / 2), 1));
 
+				// only duplicate requests when the deadline is at risk. If the
+				// blocks are expected to arrive in time, and they're not
+				// overdue, leave them with the peers they were requested from.
+				// If they're expected to be late, request them from another
+				// peer right away
+				if (i.predicted_arrival != min_time())
+				{
+					bool const overdue = now > i.predicted_arrival;
+					if (i.predicted_arrival > i.deadline)
+						timed_out = (std::max)(timed_out, 1);
+					else if (!overdue)
+						timed_out = 0;
+				}
+
 #if TORRENT_DEBUG_STREAMING > 0
 				i.timed_out = timed_out;
 #endif
@@ -9627,11 +10555,20 @@ namespace libtorrent {
 			// and sorted. when we issue a request to a peer, its download queue
 			// time will increase and it may need to be bumped in the peers list,
 			// since it's ordered by download queue time
+			time_point const prev_arrival = i.predicted_arrival;
+
 			pick_time_critical_block(peers, ignore_peers
 				, peers_with_requests
 				, pi, &i, m_picker.get()
 				, blocks_in_piece, timed_out);
 
+			if (i.predicted_arrival != prev_arrival
+				&& should_post<piece_arrival_alert>())
+			{
+				alerts().emplace_alert<piece_arrival_alert>(get_handle()
+					, i.piece, i.predicted_arrival, i.deadline);
+			}
+
 			// put back the peers we ignored into the peer list for the next piece
 			if (!ignore_peers.empty())
 			{
@@ -9640,9 +10577,7 @@ namespace libtorrent {
 
 				// TODO: instead of resorting the whole list, insert the peers
 				// directly into the right place
-				std::sort(peers.begin(), peers.end()
-					, [] (peer_connection const* lhs, peer_connection const* rhs)
-					{ return lhs->download_queue_time(16*1024) < rhs->download_queue_time(16*1024); });
+				std::sort(peers.begin(), peers.end(), &expected_block_time_less);
 			}
 
 			// if this peer's download time exceeds 2 seconds, we're done.
@@ -9674,10 +10609,12 @@ namespace libtorrent {
 
 	void torrent::remove_web_seed(std::string const& url, web_seed_entry::type_t type)
 	{
-		auto const i = std::find_if(m_web_seeds.begin(), m_web_seeds.end()
-			, [&] (web_seed_t const& w) { return w.url == url && w.type == type; });
-
-		if (i != m_web_seeds.end()) remove_web_seed_iter(i);
+		// this also removes any secondary connections to the URL
+		for (auto i = m_web_seeds.begin(); i != m_web_seeds.end();)
+		{
+			auto const w = i++;
+			if (w->url == url && w->type == type) remove_web_seed_iter(w);
+		}
 	}
 
 	void torrent::disconnect_web_seed(peer_connection* p)
@@ -9781,6 +10718,19 @@ namespace libtorrent {
 	{
 		TORRENT_ASSERT(is_single_thread());
 
+		torrent_state st = get_peer_list_state();
+		torrent_peer* p = add_peer_impl(adr, source, flags, st);
+		peers_erased(st.erased);
+		update_want_peers();
+		state_updated();
+		return p;
+	}
+
+	torrent_peer* torrent::add_peer_impl(tcp::endpoint const& adr, int source
+		, int flags, torrent_state& st)
+	{
+		TORRENT_ASSERT(is_single_thread());
+
 #if !TORRENT_USE_IPV6
 		if (!adr.address().is_v4())
 		{
@@ -9793,6 +10743,17 @@ namespace libtorrent {
 		}
 #endif
 
+		// if we were just told about this peer, from the same source and
+		// with the same flags, adding it again won't change anything.
+		// Peers from resume data are only added once anyway
+		if (source != peer_info::resume_data)
+		{
+			if (!m_recent_peers) m_recent_peers.reset(new aux::recent_endpoints);
+			if (m_recent_peers->insert(adr, std::uint32_t(source)
+				| (std::uint32_t(flags) << 8)))
+				return nullptr;
+		}
+
 #ifndef TORRENT_DISABLE_DHT
 		if (source != peer_info::resume_data)
 		{
@@ -9809,7 +10770,7 @@ namespace libtorrent {
 			&& m_ip_filter
 			&& m_ip_filter->access(adr.address()) & ip_filter::blocked)
 		{
-			if (alerts().should_post<peer_blocked_alert>())
+			if (should_post<peer_blocked_alert>())
 				alerts().emplace_alert<peer_blocked_alert>(get_handle()
 					, adr, peer_blocked_alert::ip_filter);
 
@@ -9821,7 +10782,7 @@ namespace libtorrent {
 
 		if (m_ses.get_port_filter().access(adr.port()) & port_filter::blocked)
 		{
-			if (alerts().should_post<peer_blocked_alert>())
+			if (should_post<peer_blocked_alert>())
 				alerts().emplace_alert<peer_blocked_alert>(get_handle()
 					, adr, peer_blocked_alert::port_filter);
 #ifndef TORRENT_DISABLE_EXTENSIONS
@@ -9835,7 +10796,7 @@ namespace libtorrent {
 		// no regular peers should ever be added!
 		if (!settings().get_bool(settings_pack::allow_i2p_mixed) && is_i2p())
 		{
-			if (alerts().should_post<peer_blocked_alert>())
+			if (should_post<peer_blocked_alert>())
 				alerts().emplace_alert<peer_blocked_alert>(get_handle()
 					, adr, peer_blocked_alert::i2p_mixed);
 			return nullptr;
@@ -9844,7 +10805,7 @@ namespace libtorrent {
 
 		if (settings().get_bool(settings_pack::no_connect_privileged_ports) && adr.port() < 1024)
 		{
-			if (alerts().should_post<peer_blocked_alert>())
+			if (should_post<peer_blocked_alert>())
 				alerts().emplace_alert<peer_blocked_alert>(get_handle()
 					, adr, peer_blocked_alert::privileged_ports);
 #ifndef TORRENT_DISABLE_EXTENSIONS
@@ -9854,9 +10815,7 @@ namespace libtorrent {
 		}
 
 		need_peer_list();
-		torrent_state st = get_peer_list_state();
 		torrent_peer* p = m_peer_list->add_peer(adr, source, char(flags), &st);
-		peers_erased(st.erased);
 
 #ifndef TORRENT_DISABLE_LOGGING
 		if (should_log())
@@ -9867,21 +10826,12 @@ namespace libtorrent {
 		}
 #endif
 
-		if (p)
-		{
-			state_updated();
 #ifndef TORRENT_DISABLE_EXTENSIONS
+		if (p)
 			notify_extension_add_peer(adr, source, st.first_time_seen ? torrent_plugin::first_time : 0);
-#endif
-		}
 		else
-		{
-#ifndef TORRENT_DISABLE_EXTENSIONS
 			notify_extension_add_peer(adr, source, torrent_plugin::filtered);
 #endif
-		}
-		update_want_peers();
-		state_updated();
 		return p;
 	}
 
@@ -9926,7 +10876,7 @@ namespace libtorrent {
 		update_want_peers();
 	}
 
-	std::pair<peer_list::iterator, peer_list::iterator> torrent::find_peers(address const& a)
+	std::vector<torrent_peer*> torrent::find_peers(address const& a)
 	{
 		need_peer_list();
 		return m_peer_list->find_peers(a);
@@ -9964,6 +10914,9 @@ namespace libtorrent {
 
 	void torrent::ip_filter_updated()
 	{
+		// peers that were filtered out may be allowed now
+		if (m_recent_peers) m_recent_peers->clear();
+
 		if (!m_apply_ip_filter) return;
 		if (!m_peer_list) return;
 		if (!m_ip_filter) return;
@@ -9972,7 +10925,7 @@ namespace libtorrent {
 		std::vector<address> banned;
 		m_peer_list->apply_ip_filter(*m_ip_filter, &st, banned);
 
-		if (alerts().should_post<peer_blocked_alert>())
+		if (should_post<peer_blocked_alert>())
 		{
 			for (auto const& addr : banned)
 				alerts().emplace_alert<peer_blocked_alert>(get_handle()
@@ -9985,6 +10938,8 @@ namespace libtorrent {
 
 	void torrent::port_filter_updated()
 	{
+		if (m_recent_peers) m_recent_peers->clear();
+
 		if (!m_apply_ip_filter) return;
 		if (!m_peer_list) return;
 
@@ -9992,7 +10947,7 @@ namespace libtorrent {
 		std::vector<address> banned;
 		m_peer_list->apply_port_filter(m_ses.get_port_filter(), &st, banned);
 
-		if (alerts().should_post<peer_blocked_alert>())
+		if (should_post<peer_blocked_alert>())
 		{
 			for (auto const& addr : banned)
 				alerts().emplace_alert<peer_blocked_alert>(get_handle()
@@ -10046,6 +11001,14 @@ namespace libtorrent {
 #endif
 #endif // TORRENT_NO_DEPRECATE
 
+	void torrent::post_file_progress(int const flags)
+	{
+		TORRENT_ASSERT(is_single_thread());
+		aux::vector<std::int64_t, file_index_t> fp;
+		file_progress(fp, flags);
+		alerts().emplace_alert<file_progress_alert>(get_handle(), std::move(fp));
+	}
+
 	void torrent::file_progress(aux::vector<std::int64_t, file_index_t>& fp, int const flags)
 	{
 		TORRENT_ASSERT(is_single_thread());
@@ -10075,100 +11038,45 @@ namespace libtorrent {
 			return;
 		}
 
-		m_file_progress.export_progress(fp);
-
 		if (flags & torrent_handle::piece_granularity)
+		{
+			m_file_progress.export_progress(fp);
 			return;
+		}
 
 		TORRENT_ASSERT(has_picker());
 
-		std::vector<piece_picker::downloading_piece> q = m_picker->get_download_queue();
+		// the bytes of blocks we've downloaded are tracked incrementally by
+		// m_file_progress, only the blocks currently being received from peers
+		// need to be added on top
+		m_file_progress.export_progress(fp, true);
 
 		file_storage const& fs = m_torrent_file->files();
-		for (auto const& dp : q)
+		for (peer_connection const* p : m_connections)
 		{
-			std::int64_t offset = std::int64_t(static_cast<int>(dp.index))
-				* m_torrent_file->piece_length();
-			file_index_t file = fs.file_index_at_offset(offset);
-			int idx = -1;
-			for (auto const& info : m_picker->blocks_for_piece(dp))
-			{
-				++idx;
-				TORRENT_ASSERT(file < fs.end_file());
-				TORRENT_ASSERT(offset == std::int64_t(static_cast<int>(dp.index))
-					* m_torrent_file->piece_length()
-					+ idx * block_size());
-				TORRENT_ASSERT(offset < m_torrent_file->total_size());
-				while (offset >= fs.file_offset(file) + fs.file_size(file))
-				{
-					++file;
-				}
-				TORRENT_ASSERT(file < fs.end_file());
-
-				std::int64_t block = block_size();
-
-				if (info.state == piece_picker::block_info::state_none)
-				{
-					offset += block;
-					continue;
-				}
+			piece_block_progress const pbp = p->downloading_piece_progress();
+			if (pbp.piece_index == piece_block_progress::invalid_index
+				|| pbp.bytes_downloaded <= 0)
+				continue;
 
-				if (info.state == piece_picker::block_info::state_requested)
-				{
-					block = 0;
-					torrent_peer* p = info.peer;
-					if (p != nullptr && p->connection)
-					{
-						peer_connection* peer = static_cast<peer_connection*>(p->connection);
-						auto pbp = peer->downloading_piece_progress();
-						if (pbp.piece_index == dp.index && pbp.block_index == idx)
-							block = pbp.bytes_downloaded;
-						TORRENT_ASSERT(block <= block_size());
-					}
+			piece_block const b(pbp.piece_index, pbp.block_index);
+			if (m_picker->is_downloaded(b)) continue;
+			m_file_progress.add_block_bytes(fs, fp, b, pbp.bytes_downloaded);
+		}
+	}
 
-					if (block == 0)
-					{
-						offset += block_size();
-						continue;
-					}
-				}
+	void torrent::add_block_progress(piece_block const b)
+	{
+		TORRENT_ASSERT(is_single_thread());
+		if (!has_picker() || m_picker->have_piece(b.piece_index)) return;
+		m_file_progress.add_block(m_torrent_file->files(), b);
+	}
 
-				if (offset + block > fs.file_offset(file) + fs.file_size(file))
-				{
-					std::int64_t left_over = block_size() - block;
-					// split the block on multiple files
-					while (block > 0)
-					{
-						TORRENT_ASSERT(offset <= fs.file_offset(file) + fs.file_size(file));
-						std::int64_t const slice = std::min(fs.file_offset(file) + fs.file_size(file) - offset
-							, block);
-						fp[file] += slice;
-						offset += slice;
-						block -= slice;
-						TORRENT_ASSERT(offset <= fs.file_offset(file) + fs.file_size(file));
-						if (offset == fs.file_offset(file) + fs.file_size(file))
-						{
-							++file;
-							if (file == fs.end_file())
-							{
-								offset += block;
-								break;
-							}
-						}
-					}
-					offset += left_over;
-					TORRENT_ASSERT(offset == std::int64_t(static_cast<int>(dp.index))
-						* m_torrent_file->piece_length()
-						+ (idx + 1) * block_size());
-				}
-				else
-				{
-					fp[file] += block;
-					offset += block_size();
-				}
-				TORRENT_ASSERT(file <= fs.end_file());
-			}
-		}
+	void torrent::remove_block_progress(piece_block const b)
+	{
+		TORRENT_ASSERT(is_single_thread());
+		if (!has_picker() || m_picker->is_downloaded(b)) return;
+		m_file_progress.remove_block(m_torrent_file->files(), b);
 	}
 
 	void torrent::new_external_ip()
@@ -10237,14 +11145,14 @@ namespace {
 
 		if (int(m_state) == s) return;
 
-		if (m_ses.alerts().should_post<state_changed_alert>())
+		if (should_post<state_changed_alert>())
 		{
 			m_ses.alerts().emplace_alert<state_changed_alert>(get_handle()
 				, s, static_cast<torrent_status::state_t>(m_state));
 		}
 
 		if (s == torrent_status::finished
-			&& alerts().should_post<torrent_finished_alert>())
+			&& should_post<torrent_finished_alert>())
 		{
 			alerts().emplace_alert<torrent_finished_alert>(
 				get_handle());
@@ -10279,10 +11187,8 @@ namespace {
 		state_updated();
 
 #ifndef TORRENT_DISABLE_EXTENSIONS
-		for (auto& ext : m_extensions)
-		{
-			ext->on_state(m_state);
-		}
+		m_extensions.for_each(torrent_plugin::state_feature
+			, [&](torrent_plugin& e) { e.on_state(m_state); });
 #endif
 	}
 
@@ -10290,10 +11196,8 @@ namespace {
 	void torrent::notify_extension_add_peer(tcp::endpoint const& ip
 		, int src, int flags)
 	{
-		for (auto& ext : m_extensions)
-		{
-			ext->on_add_peer(ip, src, flags);
-		}
+		m_extensions.for_each(torrent_plugin::add_peer_feature
+			, [&](torrent_plugin& e) { e.on_add_peer(ip, src, flags); });
 	}
 #endif
 
@@ -10331,6 +11235,14 @@ namespace {
 		m_links[aux::session_interface::torrent_state_updates].insert(list, this);
 	}
 
+	void torrent::post_status(std::uint32_t const flags)
+	{
+		TORRENT_ASSERT(is_single_thread());
+		std::vector<torrent_status> st(1);
+		status(&st.back(), flags);
+		alerts().emplace_alert<state_update_alert>(std::move(st));
+	}
+
 	void torrent::status(torrent_status* st, std::uint32_t flags)
 	{
 		INVARIANT_CHECK;
@@ -10666,7 +11578,7 @@ namespace {
 
 				deprioritize_tracker(tracker_index);
 			}
-			if (m_ses.alerts().should_post<tracker_error_alert>()
+			if (should_post<tracker_error_alert>()
 				|| r.triggered_manually)
 			{
 				m_ses.alerts().emplace_alert<tracker_error_alert>(get_handle()
@@ -10686,7 +11598,7 @@ namespace {
 			// if this was triggered manually we need to post this unconditionally,
 			// since the client expects a response from its action, regardless of
 			// whether all tracker events have been enabled by the alert mask
-			if (m_ses.alerts().should_post<scrape_failed_alert>()
+			if (should_post<scrape_failed_alert>()
 				|| r.triggered_manually)
 			{
 				m_ses.alerts().emplace_alert<scrape_failed_alert>(get_handle(), r.url, ec);
@@ -10701,13 +11613,13 @@ namespace {
 #ifndef TORRENT_DISABLE_LOGGING
 	bool torrent::should_log() const
 	{
-		return alerts().should_post<torrent_log_alert>();
+		return should_post<torrent_log_alert>();
 	}
 
 	TORRENT_FORMAT(2,3)
 	void torrent::debug_log(char const* fmt, ...) const
 	{
-		if (!alerts().should_post<torrent_log_alert>()) return;
+		if (!should_post<torrent_log_alert>()) return;
 
 		va_list v;
 		va_start(v, fmt);
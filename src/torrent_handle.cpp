@@ -70,8 +70,10 @@ namespace libtorrent {
 		std::shared_ptr<torrent> t = m_torrent.lock();
 		if (!t) aux::throw_ex<system_error>(errors::invalid_torrent_handle);
 		session_impl& ses = static_cast<session_impl&>(t->session());
+		time_point const queued = clock_type::now();
 		ses.get_io_service().dispatch([=,&ses] ()
 		{
+			aux::handler_timer const timer(ses, network_stall_alert::torrent_call, queued);
 #ifndef BOOST_NO_EXCEPTIONS
 			try {
 #endif
@@ -102,8 +104,10 @@ namespace libtorrent {
 		bool done = false;
 
 		std::exception_ptr ex;
+		time_point const queued = clock_type::now();
 		ses.get_io_service().dispatch([=,&done,&ses,&ex] ()
 		{
+			aux::handler_timer const timer(ses, network_stall_alert::torrent_call, queued);
 #ifndef BOOST_NO_EXCEPTIONS
 			try {
 #endif
@@ -138,8 +142,10 @@ namespace libtorrent {
 		bool done = false;
 
 		std::exception_ptr ex;
+		time_point const queued = clock_type::now();
 		ses.get_io_service().dispatch([=,&r,&done,&ses,&ex] ()
 		{
+			aux::handler_timer const timer(ses, network_stall_alert::torrent_call, queued);
 #ifndef BOOST_NO_EXCEPTIONS
 			try {
 #endif
@@ -212,6 +218,16 @@ namespace libtorrent {
 		return sync_call_ret<int>(0, &torrent::download_limit);
 	}
 
+	void torrent_handle::set_alert_mask(std::uint32_t const m) const
+	{
+		async_call(&torrent::set_alert_mask, m);
+	}
+
+	std::uint32_t torrent_handle::alert_mask() const
+	{
+		return sync_call_ret<std::uint32_t>(0, &torrent::alert_mask);
+	}
+
 	void torrent_handle::move_storage(
 		std::string const& save_path, int flags) const
 	{
@@ -395,6 +411,11 @@ namespace libtorrent {
 		sync_call(&torrent::file_progress, std::ref(arg), flags);
 	}
 
+	void torrent_handle::post_file_progress(int const flags) const
+	{
+		async_call(&torrent::post_file_progress, flags);
+	}
+
 	torrent_status torrent_handle::status(std::uint32_t flags) const
 	{
 		torrent_status st;
@@ -402,11 +423,30 @@ namespace libtorrent {
 		return st;
 	}
 
+	void torrent_handle::post_status(std::uint32_t const flags) const
+	{
+		async_call(&torrent::post_status, flags);
+	}
+
 	void torrent_handle::set_sequential_download(bool sd) const
 	{
 		async_call(&torrent::set_sequential_download, sd);
 	}
 
+	void torrent_handle::set_stream_window(file_index_t const file
+		, std::int64_t const offset, int const num_pieces) const
+	{
+		async_call(&torrent::set_stream_window, file, offset, num_pieces);
+	}
+
+	void torrent_handle::read_range(file_index_t const file
+		, std::int64_t const offset, int const size
+		, std::function<void(error_code const&, std::vector<range_buffer>)> handler
+		, int const deadline) const
+	{
+		async_call(&torrent::read_range, file, offset, size, handler, deadline);
+	}
+
 	void torrent_handle::piece_availability(std::vector<int>& avail) const
 	{
 		auto availr = std::ref(static_cast<aux::vector<int, piece_index_t>&>(avail));
@@ -441,6 +481,11 @@ namespace libtorrent {
 		return ret;
 	}
 
+	void torrent_handle::post_piece_priorities() const
+	{
+		async_call(&torrent::post_piece_priorities);
+	}
+
 	void torrent_handle::file_priority(file_index_t index, int priority) const
 	{
 		async_call(&torrent::set_file_priority, index, priority);
@@ -711,6 +756,11 @@ namespace libtorrent {
 		sync_call(&torrent::get_peer_info, vp);
 	}
 
+	void torrent_handle::post_peer_info() const
+	{
+		async_call(&torrent::post_peer_info);
+	}
+
 	void torrent_handle::get_download_queue(std::vector<partial_piece_info>& queue) const
 	{
 		auto queuep = &queue;
@@ -781,6 +781,7 @@ namespace libtorrent {
 		m_files = f;
 		m_files.set_num_pieces(m_orig_files->num_pieces());
 		m_files.set_piece_length(m_orig_files->piece_length());
+		m_files.build_piece_index();
 	}
 
 #ifndef TORRENT_NO_DEPRECATE
@@ -884,6 +885,21 @@ namespace libtorrent {
 		INVARIANT_CHECK;
 	}
 
+	torrent_info::torrent_info(std::shared_ptr<char const> buffer
+		, int const size
+		, int const flags)
+	{
+		error_code ec;
+		bdecode_node e;
+		if (bdecode(buffer.get(), buffer.get() + size, e, ec) != 0)
+			aux::throw_ex<system_error>(ec);
+
+		if (!parse_torrent_file_impl(e, ec, flags, buffer))
+			aux::throw_ex<system_error>(ec);
+
+		INVARIANT_CHECK;
+	}
+
 #if TORRENT_USE_WSTRING
 #ifndef TORRENT_NO_DEPRECATE
 	torrent_info::torrent_info(std::wstring const& filename
@@ -951,6 +967,19 @@ namespace libtorrent {
 		INVARIANT_CHECK;
 	}
 
+	torrent_info::torrent_info(std::shared_ptr<char const> buffer
+		, int const size
+		, error_code& ec
+		, int const flags)
+	{
+		bdecode_node e;
+		if (bdecode(buffer.get(), buffer.get() + size, e, ec) != 0)
+			return;
+		parse_torrent_file_impl(e, ec, flags, buffer);
+
+		INVARIANT_CHECK;
+	}
+
 #if TORRENT_USE_WSTRING
 #ifndef TORRENT_NO_DEPRECATE
 	torrent_info::torrent_info(std::wstring const& filename
@@ -995,6 +1024,27 @@ namespace libtorrent {
 		m_orig_files.reset(new file_storage(m_files));
 	}
 
+	std::size_t torrent_info::memory_usage() const
+	{
+		std::size_t ret = sizeof(*this) - sizeof(m_files)
+			+ m_files.memory_usage()
+			+ (m_orig_files ? m_orig_files->memory_usage() : 0)
+			+ m_urls.capacity() * sizeof(announce_entry)
+			+ m_web_seeds.capacity() * sizeof(web_seed_entry)
+			+ m_nodes.capacity() * sizeof(std::pair<std::string, int>)
+			+ m_similar_torrents.capacity() * sizeof(char const*)
+			+ m_owned_similar_torrents.capacity() * sizeof(sha1_hash)
+			+ m_collections.capacity() * sizeof(std::pair<char const*, int>)
+			+ m_owned_collections.capacity() * sizeof(std::string)
+			+ m_merkle_tree.capacity() * sizeof(sha1_hash)
+			+ std::size_t(m_info_section_size)
+			+ m_comment.capacity()
+			+ m_created_by.capacity();
+		for (auto const& u : m_urls) ret += u.url.capacity() + u.trackerid.capacity();
+		for (auto const& w : m_web_seeds) ret += w.url.capacity();
+		return ret;
+	}
+
 	void torrent_info::swap(torrent_info& ti)
 	{
 		INVARIANT_CHECK;
@@ -1038,6 +1088,12 @@ namespace libtorrent {
 
 	bool torrent_info::parse_info_section(bdecode_node const& info
 		, error_code& ec, int const flags)
+	{
+		return parse_info_section_impl(info, ec, flags, std::shared_ptr<char const>());
+	}
+
+	bool torrent_info::parse_info_section_impl(bdecode_node const& info
+		, error_code& ec, int const flags, std::shared_ptr<char const> const& buffer)
 	{
 		TORRENT_UNUSED(flags);
 		if (info.type() != bdecode_node::dict_t)
@@ -1055,10 +1111,20 @@ namespace libtorrent {
 			return false;
 		}
 
-		// copy the info section
 		m_info_section_size = int(section.size());
-		m_info_section.reset(new char[m_info_section_size]);
-		std::memcpy(m_info_section.get(), section.data(), aux::numeric_cast<std::size_t>(m_info_section_size));
+		if (buffer)
+		{
+			// refer to the info section in the caller's buffer, and hold a
+			// reference to it. It's never written to through m_info_section
+			m_info_section = boost::shared_array<char>(const_cast<char*>(section.data())
+				, [buffer](char*) {});
+		}
+		else
+		{
+			// copy the info section
+			m_info_section.reset(new char[m_info_section_size]);
+			std::memcpy(m_info_section.get(), section.data(), aux::numeric_cast<std::size_t>(m_info_section_size));
+		}
 		TORRENT_ASSERT(section[0] == 'd');
 		TORRENT_ASSERT(section[aux::numeric_cast<std::size_t>(m_info_section_size - 1)] == 'e');
 
@@ -1172,9 +1238,10 @@ namespace libtorrent {
 			int const num_leafs = merkle_num_leafs(files.num_pieces());
 			int const num_nodes = merkle_num_nodes(num_leafs);
 			m_merkle_first_leaf = num_nodes - num_leafs;
-			m_merkle_tree.resize(num_nodes);
-			std::memset(m_merkle_tree.data(), 0, aux::numeric_cast<std::size_t>(num_nodes * 20));
-			m_merkle_tree[0].assign(root_hash.string_ptr());
+			// the tree itself is allocated lazily, see allocate_merkle_tree()
+			m_merkle_tree.clear();
+			m_piece_hashes = root_hash.string_ptr() + info_ptr_diff;
+			m_flags |= merkle_torrent;
 		}
 
 		m_flags |= (info.dict_find_int_value("private", 0) != 0)
@@ -1215,6 +1282,8 @@ namespace libtorrent {
 		if (info.dict_find_string("ssl-cert"))
 			m_flags |= ssl_torrent;
 
+		files.build_piece_index();
+
 		// now, commit the files structure we just parsed out
 		// into the torrent_info object.
 		m_files.swap(files);
@@ -1234,6 +1303,35 @@ namespace libtorrent {
 	}
 
 
+	char const* torrent_info::merkle_node_ptr(int const n) const
+	{
+		TORRENT_ASSERT(is_merkle_torrent());
+		TORRENT_ASSERT(n >= 0);
+		if (n == 0) return m_piece_hashes;
+		if (m_merkle_tree.empty())
+		{
+			static char const unknown[20] = {};
+			return unknown;
+		}
+		TORRENT_ASSERT(n < m_merkle_tree.end_index());
+		return m_merkle_tree[n].data();
+	}
+
+	void torrent_info::allocate_merkle_tree()
+	{
+		if (!m_merkle_tree.empty()) return;
+		int const num_nodes = merkle_num_nodes(merkle_num_leafs(num_pieces()));
+		m_merkle_tree.resize(num_nodes);
+		m_merkle_tree[0].assign(m_piece_hashes);
+	}
+
+	void torrent_info::set_merkle_tree(std::vector<sha1_hash>& h)
+	{
+		TORRENT_ASSERT(is_merkle_torrent());
+		TORRENT_ASSERT(int(h.size()) == merkle_num_nodes(merkle_num_leafs(num_pieces())));
+		m_merkle_tree.swap(h);
+	}
+
 	bool torrent_info::add_merkle_nodes(std::map<int, sha1_hash> const& subtree
 		, piece_index_t const piece)
 	{
@@ -1271,10 +1369,11 @@ namespace libtorrent {
 			h = hs.final();
 			n = parent;
 		}
-		if (h != m_merkle_tree[0]) return false;
+		if (h != sha1_hash(m_piece_hashes)) return false;
 
 		// the nodes and piece hash matched the root-hash
 		// insert them into our tree
+		allocate_merkle_tree();
 
 		for (auto const& i : to_add)
 		{
@@ -1292,16 +1391,16 @@ namespace libtorrent {
 
 		std::map<int, sha1_hash> ret;
 		int n = m_merkle_first_leaf + static_cast<int>(piece);
-		ret[n] = m_merkle_tree[n];
-		ret[0] = m_merkle_tree[0];
+		ret[n] = sha1_hash(merkle_node_ptr(n));
+		ret[0] = sha1_hash(m_piece_hashes);
 		while (n > 0)
 		{
 			int sibling = merkle_get_sibling(n);
 			int parent = merkle_get_parent(n);
-			ret[sibling] = m_merkle_tree[sibling];
+			ret[sibling] = sha1_hash(merkle_node_ptr(sibling));
 			// we cannot build the tree path if one
 			// of the nodes in the tree is missing
-			TORRENT_ASSERT(!m_merkle_tree[sibling].is_all_zeros());
+			TORRENT_ASSERT(!ret[sibling].is_all_zeros());
 			n = parent;
 		}
 		return ret;
@@ -1309,6 +1408,12 @@ namespace libtorrent {
 
 	bool torrent_info::parse_torrent_file(bdecode_node const& torrent_file
 		, error_code& ec, int const flags)
+	{
+		return parse_torrent_file_impl(torrent_file, ec, flags, std::shared_ptr<char const>());
+	}
+
+	bool torrent_info::parse_torrent_file_impl(bdecode_node const& torrent_file
+		, error_code& ec, int const flags, std::shared_ptr<char const> const& buffer)
 	{
 		if (torrent_file.type() != bdecode_node::dict_t)
 		{
@@ -1339,7 +1444,7 @@ namespace libtorrent {
 			ec = errors::torrent_missing_info;
 			return false;
 		}
-		if (!parse_info_section(info, ec, flags)) return false;
+		if (!parse_info_section_impl(info, ec, flags, buffer)) return false;
 		resolve_duplicate_filenames();
 
 #ifndef TORRENT_DISABLE_MUTABLE_TORRENTS
@@ -145,7 +145,6 @@ namespace libtorrent {
 		: prev_amount_upload(0)
 		, prev_amount_download(0)
 		, connection(nullptr)
-		, peer_rank(0)
 		, last_optimistically_unchoked(0)
 		, last_connected(0)
 		, port(port_)
@@ -183,12 +182,9 @@ namespace libtorrent {
 
 	std::uint32_t torrent_peer::rank(external_ip const& external, int external_port) const
 	{
-//TODO: how do we deal with our external address changing?
-		if (peer_rank == 0)
-			peer_rank = peer_priority(
-				tcp::endpoint(external.external_address(this->address()), std::uint16_t(external_port))
-				, tcp::endpoint(this->address(), this->port));
-		return peer_rank;
+		return peer_priority(
+			tcp::endpoint(external.external_address(this->address()), std::uint16_t(external_port))
+			, tcp::endpoint(this->address(), this->port));
 	}
 
 #ifndef TORRENT_DISABLE_LOGGING
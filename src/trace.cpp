@@ -0,0 +1,252 @@
+/*
+
+Copyright (c) 2017, Arvid Norberg
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions
+are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in
+      the documentation and/or other materials provided with the distribution.
+    * Neither the name of the author nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+
+#include "libtorrent/trace.hpp"
+#include "libtorrent/aux_/trace.hpp"
+#include "libtorrent/aux_/storage_utils.hpp" // for iovec_t
+#include "libtorrent/file.hpp"
+#include "libtorrent/io.hpp"
+#include "libtorrent/time.hpp"
+#include "libtorrent/assert.hpp"
+
+#include <array>
+#include <memory>
+#include <mutex>
+#include <algorithm>
+#include <iterator>
+
+namespace libtorrent {
+
+namespace aux {
+
+	std::atomic<bool> g_tracing(false);
+
+namespace {
+
+	// the number of events each thread's ring buffer holds. Must be a power
+	// of two
+	constexpr std::uint64_t trace_buffer_size = 4096;
+
+	// the number of 64 bit words making up one event: the time, the thread
+	// and event id, and the two arguments
+	constexpr std::size_t words_per_event = 4;
+
+	struct trace_buffer
+	{
+		// the events, each made up of words_per_event words. The words are
+		// atomic for collect_trace() to be able to read them while the owning
+		// thread is recording new events. Readers discard the events that may
+		// have been overwritten while they were copied
+		std::array<std::atomic<std::uint64_t>, trace_buffer_size * words_per_event> events{};
+
+		// the total number of events recorded in this buffer. Only the owning
+		// thread writes to it
+		std::atomic<std::uint64_t> head{0};
+
+		// the events before this one have been cleared by clear_trace()
+		std::atomic<std::uint64_t> tail{0};
+
+		// true while a thread owns this buffer
+		bool in_use = true;
+	};
+
+	// the buffers are never freed, once a thread exits its buffer (and the
+	// events in it) is handed to the next thread starting to record events.
+	// They're heap allocated and leaked to outlive any thread recording events
+	// during shutdown
+	std::mutex& buffers_mutex()
+	{
+		static std::mutex* m = new std::mutex;
+		return *m;
+	}
+
+	std::vector<std::unique_ptr<trace_buffer>>& buffers()
+	{
+		static auto* b = new std::vector<std::unique_ptr<trace_buffer>>;
+		return *b;
+	}
+
+	struct thread_trace_buffer
+	{
+		thread_trace_buffer()
+		{
+			static std::atomic<std::uint32_t> next_thread(0);
+			thread = next_thread.fetch_add(1, std::memory_order_relaxed);
+
+			std::lock_guard<std::mutex> l(buffers_mutex());
+			for (auto& b : buffers())
+			{
+				if (b->in_use) continue;
+				b->in_use = true;
+				buf = b.get();
+				return;
+			}
+			buffers().emplace_back(new trace_buffer);
+			buf = buffers().back().get();
+		}
+
+		~thread_trace_buffer()
+		{
+			std::lock_guard<std::mutex> l(buffers_mutex());
+			buf->in_use = false;
+		}
+
+		thread_trace_buffer(thread_trace_buffer const&) = delete;
+		thread_trace_buffer& operator=(thread_trace_buffer const&) = delete;
+
+		trace_buffer* buf;
+		std::uint32_t thread;
+	};
+
+	void copy_events(trace_buffer const& b, std::vector<trace_entry>& out)
+	{
+		std::uint64_t const head = b.head.load(std::memory_order_acquire);
+		std::uint64_t start = std::max(b.tail.load(std::memory_order_relaxed)
+			, head > trace_buffer_size ? head - trace_buffer_size : 0);
+		std::size_t const first = out.size();
+
+		for (std::uint64_t i = start; i < head; ++i)
+		{
+			std::size_t const slot = std::size_t(i & (trace_buffer_size - 1)) * words_per_event;
+			trace_entry e;
+			e.time = std::int64_t(b.events[slot].load(std::memory_order_relaxed));
+			std::uint64_t const id = b.events[slot + 1].load(std::memory_order_relaxed);
+			e.thread = std::uint32_t(id & 0xffffffff);
+			e.event = static_cast<trace_event>(id >> 32);
+			e.arg0 = b.events[slot + 2].load(std::memory_order_relaxed);
+			e.arg1 = b.events[slot + 3].load(std::memory_order_relaxed);
+			out.push_back(e);
+		}
+
+		// the owning thread may have overwritten the oldest events while we
+		// copied them. The event it's recording right now overwrites event
+		// (head - trace_buffer_size), drop everything up to and including it
+		std::atomic_thread_fence(std::memory_order_acquire);
+		std::uint64_t const new_head = b.head.load(std::memory_order_relaxed);
+		if (new_head >= trace_buffer_size && new_head - trace_buffer_size + 1 > start)
+		{
+			std::uint64_t const drop = std::min(head
+				, new_head - trace_buffer_size + 1) - start;
+			out.erase(out.begin() + std::ptrdiff_t(first)
+				, out.begin() + std::ptrdiff_t(first + drop));
+		}
+	}
+}
+
+	void record_trace(trace_event const e, std::uint64_t const arg0
+		, std::uint64_t const arg1)
+	{
+		thread_local thread_trace_buffer t;
+		trace_buffer& b = *t.buf;
+
+		std::uint64_t const head = b.head.load(std::memory_order_relaxed);
+		std::size_t const slot = std::size_t(head & (trace_buffer_size - 1)) * words_per_event;
+		std::int64_t const now = std::chrono::duration_cast<std::chrono::nanoseconds>(
+			clock_type::now().time_since_epoch()).count();
+
+		// orders the store of head (by the previous event) before overwriting
+		// the slot. A reader that observes any of the stores below is then
+		// guaranteed to see a head at least as large, and to drop the event
+		// it replaces (see copy_events())
+		std::atomic_thread_fence(std::memory_order_release);
+		b.events[slot].store(std::uint64_t(now), std::memory_order_relaxed);
+		b.events[slot + 1].store(t.thread
+			| (std::uint64_t(e) << 32), std::memory_order_relaxed);
+		b.events[slot + 2].store(arg0, std::memory_order_relaxed);
+		b.events[slot + 3].store(arg1, std::memory_order_relaxed);
+		b.head.store(head + 1, std::memory_order_release);
+	}
+
+	std::vector<trace_entry> collect_trace()
+	{
+		std::vector<trace_entry> ret;
+		{
+			std::lock_guard<std::mutex> l(buffers_mutex());
+			for (auto const& b : buffers())
+				copy_events(*b, ret);
+		}
+		std::stable_sort(ret.begin(), ret.end()
+			, [](trace_entry const& lhs, trace_entry const& rhs)
+			{ return lhs.time < rhs.time; });
+		return ret;
+	}
+} // namespace aux
+
+	void set_tracing(bool const enable)
+	{
+		aux::g_tracing.store(enable, std::memory_order_relaxed);
+	}
+
+	bool tracing_enabled()
+	{
+		return aux::g_tracing.load(std::memory_order_relaxed);
+	}
+
+	void clear_trace()
+	{
+		std::lock_guard<std::mutex> l(aux::buffers_mutex());
+		for (auto& b : aux::buffers())
+			b->tail.store(b->head.load(std::memory_order_acquire), std::memory_order_relaxed);
+	}
+
+	// the trace file is a header of 8 bytes, "lttrace" followed by a version
+	// byte. The header is followed by the events, each 32 bytes. The time
+	// (int64 nanoseconds), the thread (uint32), the event (uint8), 3 bytes
+	// of padding and the two arguments (uint64). All integers are big endian
+	void save_trace(std::string const& filename, error_code& ec)
+	{
+		std::vector<aux::trace_entry> const events = aux::collect_trace();
+
+		std::vector<char> buf;
+		buf.reserve(8 + events.size() * 32);
+		char const header[] = "lttrace\x01";
+		buf.insert(buf.end(), header, header + 8);
+		auto out = std::back_inserter(buf);
+		for (auto const& e : events)
+		{
+			detail::write_int64(e.time, out);
+			detail::write_uint32(e.thread, out);
+			detail::write_uint8(static_cast<std::uint8_t>(e.event), out);
+			for (int i = 0; i < 3; ++i) detail::write_uint8(0, out);
+			detail::write_uint64(e.arg0, out);
+			detail::write_uint64(e.arg1, out);
+		}
+
+		file f;
+		if (!f.open(filename, file::write_only, ec)) return;
+		iovec_t const b = {buf.data(), buf.size()};
+		f.writev(0, b, ec);
+		if (ec) return;
+		f.set_size(std::int64_t(buf.size()), ec);
+	}
+}
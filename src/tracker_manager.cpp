@@ -31,14 +31,20 @@ POSSIBILITY OF SUCH DAMAGE.
 */
 
 #include <cctype>
+#include <algorithm>
 
 #include "libtorrent/tracker_manager.hpp"
 #include "libtorrent/http_tracker_connection.hpp"
 #include "libtorrent/udp_tracker_connection.hpp"
+#include "libtorrent/http_connection.hpp"
 #include "libtorrent/aux_/io.hpp"
+#include "libtorrent/aux_/time.hpp"
 #include "libtorrent/aux_/session_interface.hpp"
+#include "libtorrent/aux_/session_settings.hpp"
 #include "libtorrent/performance_counters.hpp"
 #include "libtorrent/socket_io.hpp"
+#include "libtorrent/parse_url.hpp"
+#include "libtorrent/random.hpp"
 
 using namespace std::placeholders;
 
@@ -225,13 +231,43 @@ namespace libtorrent {
 		if (i != m_http_conns.end())
 		{
 			m_http_conns.erase(i);
+			request_done(c->tracker_req().url);
 		}
 	}
 
 	void tracker_manager::remove_request(udp_tracker_connection const* c)
 	{
 		TORRENT_ASSERT(is_single_thread());
-		m_udp_conns.erase(c->transaction_id());
+		bool const removed = m_udp_conns.erase(c->transaction_id()) > 0;
+
+		auto const s = m_udp_scrapes.find(c->tracker_req().url);
+		if (s != m_udp_scrapes.end() && s->second.lock().get() == c)
+			m_udp_scrapes.erase(s);
+
+		if (removed) request_done(c->tracker_req().url);
+	}
+
+	namespace {
+
+		// lower values are sent first
+		int request_priority(tracker_request const& req)
+		{
+			if (req.triggered_manually) return 0;
+			if (req.kind & tracker_request::scrape_request) return 3;
+			// torrents that are still downloading are the ones that need peers
+			if (req.left != 0) return 1;
+			return 2;
+		}
+
+		// the limits apply per tracker host, regardless of protocol and port
+		std::string tracker_host_key(std::string const& url)
+		{
+			error_code ec;
+			std::string hostname;
+			std::tie(std::ignore, std::ignore, hostname, std::ignore, std::ignore)
+				= parse_url_components(url, ec);
+			return ec ? url : hostname;
+		}
 	}
 
 	void tracker_manager::update_transaction_id(
@@ -259,7 +295,154 @@ namespace libtorrent {
 		if (m_abort && req.event != tracker_request::stopped)
 			return;
 
+		if (req.url.substr(0, 6) == "udp://"
+			&& (req.kind & tracker_request::scrape_request) != 0)
+		{
+			// if there's a scrape to this tracker that hasn't been sent
+			// yet, ask for this info-hash in the same packet. This doesn't
+			// count against the tracker's limits
+			auto const s = m_udp_scrapes.find(req.url);
+			if (s != m_udp_scrapes.end())
+			{
+				std::shared_ptr<udp_tracker_connection> const sc = s->second.lock();
+				if (sc && sc->add_scrape(req, c)) return;
+			}
+		}
+
+		std::string const key = tracker_host_key(req.url);
+		tracker_host& h = get_host(ios, key);
+
+		// stopped events are typically sent when shutting down, they should
+		// not be held up behind other requests
+		if (req.event == tracker_request::stopped
+			|| (h.queue.empty() && can_send(h)))
+		{
+			start_request(ios, std::move(req), c, h);
+			return;
+		}
+
+		int const priority = request_priority(req);
+		h.queue.push_back({&ios, std::move(req), c, priority, m_queue_sequence++});
+		std::push_heap(h.queue.begin(), h.queue.end(), compare_queued);
+		++m_num_queued;
+
+#ifndef TORRENT_DISABLE_LOGGING
+		if (std::shared_ptr<request_callback> r = c.lock())
+			r->debug_log("*** queued tracker request [ host: %s queue: %d ]"
+				, key.c_str(), int(h.queue.size()));
+#endif
+		schedule(key, h);
+	}
+
+	bool tracker_manager::compare_queued(queued_request const& lhs
+		, queued_request const& rhs)
+	{
+		if (lhs.priority != rhs.priority) return lhs.priority > rhs.priority;
+		// the sequence number may wrap, compare the distance
+		return std::int32_t(lhs.sequence - rhs.sequence) > 0;
+	}
+
+	tracker_manager::tracker_host& tracker_manager::get_host(io_service& ios
+		, std::string const& key)
+	{
+		std::unique_ptr<tracker_host>& h = m_hosts[key];
+		if (!h) h.reset(new tracker_host(ios));
+		return *h;
+	}
+
+	bool tracker_manager::can_send(tracker_host const& h) const
+	{
+		int const limit = m_settings.get_int(settings_pack::tracker_host_concurrency);
+		if (limit > 0 && h.outstanding >= limit) return false;
+
+		int const rate = m_settings.get_int(settings_pack::tracker_host_request_rate);
+		if (rate > 0 && h.next_send > aux::time_now() + seconds(1)) return false;
+		return true;
+	}
+
+	void tracker_manager::request_done(std::string const& url)
+	{
+		auto const i = m_hosts.find(tracker_host_key(url));
+		if (i == m_hosts.end()) return;
+		tracker_host& h = *i->second;
+		TORRENT_ASSERT(h.outstanding > 0);
+		--h.outstanding;
+		schedule(i->first, h);
+	}
+
+	void tracker_manager::schedule(std::string const& key, tracker_host& h)
+	{
+		if (h.queue.empty() || h.timer_active || m_abort) return;
+
+		// if we're at the concurrency limit, we'll be called again once a
+		// request completes
+		int const limit = m_settings.get_int(settings_pack::tracker_host_concurrency);
+		if (limit > 0 && h.outstanding >= limit) return;
+
+		time_point const now = aux::time_now();
+		time_point at = now;
+		int const rate = m_settings.get_int(settings_pack::tracker_host_request_rate);
+		if (rate > 0 && h.next_send > now + seconds(1))
+		{
+			// add up to one request interval of jitter, to avoid sending
+			// requests to the tracker in lock-step
+			std::int64_t const interval = 1000000 / rate;
+			at = h.next_send - seconds(1)
+				+ microseconds(random(std::uint32_t(interval)));
+		}
+
+		h.timer_active = true;
+		error_code ec;
+		h.timer.expires_at(at, ec);
+		ADD_OUTSTANDING_ASYNC("tracker_manager::on_host_timer");
+		h.timer.async_wait(std::bind(&tracker_manager::on_host_timer, this, _1, key));
+	}
+
+	void tracker_manager::on_host_timer(error_code const& ec, std::string const& key)
+	{
+		COMPLETE_ASYNC("tracker_manager::on_host_timer");
+		if (ec) return;
+
+		auto const i = m_hosts.find(key);
+		if (i == m_hosts.end()) return;
+		tracker_host& h = *i->second;
+		h.timer_active = false;
+		if (m_abort) return;
+
+		while (!h.queue.empty() && can_send(h))
+		{
+			std::pop_heap(h.queue.begin(), h.queue.end(), compare_queued);
+			queued_request r = std::move(h.queue.back());
+			h.queue.pop_back();
+			--m_num_queued;
+
+			// the torrent may have been removed while the request was queued
+			if (r.callback.expired()) continue;
+
+			start_request(*r.ios, std::move(r.req), r.callback, h);
+		}
+		schedule(key, h);
+	}
+
+	void tracker_manager::start_request(io_service& ios, tracker_request req
+		, std::weak_ptr<request_callback> c, tracker_host& h)
+	{
+		TORRENT_ASSERT(is_single_thread());
 		std::string protocol = req.url.substr(0, req.url.find(':'));
+		bool const supported = protocol == "udp" || protocol == "http"
+#ifdef TORRENT_USE_OPENSSL
+			|| protocol == "https"
+#endif
+			;
+
+		if (supported)
+		{
+			++h.outstanding;
+			int const rate = m_settings.get_int(settings_pack::tracker_host_request_rate);
+			if (rate > 0)
+				h.next_send = std::max(h.next_send, aux::time_now())
+					+ microseconds(1000000 / rate);
+		}
 
 #ifdef TORRENT_USE_OPENSSL
 		if (protocol == "http" || protocol == "https")
@@ -274,8 +457,10 @@ namespace libtorrent {
 		}
 		else if (protocol == "udp")
 		{
+			bool const scrape = (req.kind & tracker_request::scrape_request) != 0;
 			auto con = std::make_shared<udp_tracker_connection>(ios, *this, req, c);
 			m_udp_conns[con->transaction_id()] = con;
+			if (scrape) m_udp_scrapes[req.url] = con;
 			con->start();
 			return;
 		}
@@ -424,22 +609,103 @@ namespace libtorrent {
 #endif
 		}
 
+		// requests that haven't been sent yet are dropped. Stopped events are
+		// never queued
+		for (auto& h : m_hosts)
+		{
+			m_num_queued -= int(h.second->queue.size());
+			h.second->queue.clear();
+			error_code ec;
+			h.second->timer.cancel(ec);
+		}
+		TORRENT_ASSERT(m_num_queued == 0);
+
 		for (auto const& c : close_http_connections)
 			c->close();
 
+		for (auto& p : m_idle_http_conns)
+			for (auto& c : p.second)
+				c.conn->close(true);
+		m_idle_http_conns.clear();
+
 		for (auto const& c : close_udp_connections)
 			c->close();
 	}
 
+	namespace {
+		// the number of seconds an idle keep-alive connection to a tracker is
+		// kept around. Servers commonly close idle connections after somewhere
+		// between 5 seconds and a minute. If the server closes it first, the
+		// request is sent again on a new connection
+		time_duration const idle_connection_timeout = seconds(30);
+	}
+
+	void tracker_manager::prune_idle_connections(std::vector<idle_connection>& conns)
+	{
+		time_point const now = aux::time_now();
+		auto const i = std::find_if(conns.begin(), conns.end()
+			, [now] (idle_connection const& c)
+			{ return now - c.idle_since < idle_connection_timeout; });
+		for (auto j = conns.begin(); j != i; ++j)
+			j->conn->close(true);
+		conns.erase(conns.begin(), i);
+	}
+
+	std::shared_ptr<http_connection> tracker_manager::get_idle_connection(
+		std::string const& key)
+	{
+		TORRENT_ASSERT(is_single_thread());
+		auto const i = m_idle_http_conns.find(key);
+		if (i == m_idle_http_conns.end()) return {};
+
+		prune_idle_connections(i->second);
+
+		std::shared_ptr<http_connection> ret;
+		while (!ret && !i->second.empty())
+		{
+			ret = std::move(i->second.back().conn);
+			i->second.pop_back();
+			if (!ret->can_reuse()) ret.reset();
+		}
+		if (i->second.empty()) m_idle_http_conns.erase(i);
+		return ret;
+	}
+
+	void tracker_manager::add_idle_connection(std::string const& key
+		, std::shared_ptr<http_connection> c)
+	{
+		TORRENT_ASSERT(is_single_thread());
+		TORRENT_ASSERT(c->can_reuse());
+
+		// the handlers refer to the tracker request that just completed
+		c->set_handlers(http_handler());
+
+		int const limit = m_settings.get_int(settings_pack::tracker_keepalive_connections);
+		if (m_abort || limit <= 0)
+		{
+			c->close();
+			return;
+		}
+
+		auto& conns = m_idle_http_conns[key];
+		prune_idle_connections(conns);
+		if (int(conns.size()) >= limit)
+		{
+			conns.front().conn->close();
+			conns.erase(conns.begin());
+		}
+		conns.push_back({std::move(c), aux::time_now()});
+	}
+
 	bool tracker_manager::empty() const
 	{
 		TORRENT_ASSERT(is_single_thread());
-		return m_http_conns.empty() && m_udp_conns.empty();
+		return m_http_conns.empty() && m_udp_conns.empty() && m_num_queued == 0;
 	}
 
 	int tracker_manager::num_requests() const
 	{
 		TORRENT_ASSERT(is_single_thread());
-		return int(m_http_conns.size() + m_udp_conns.size());
+		return int(m_http_conns.size() + m_udp_conns.size()) + m_num_queued;
 	}
 }
@@ -45,8 +45,27 @@ POSSIBILITY OF SUCH DAMAGE.
 
 #include "libtorrent/aux_/disable_warnings_push.hpp"
 #include <boost/asio/ip/v6_only.hpp>
+
+#if TORRENT_USE_MMSG
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/udp.h>
+#include <cerrno>
+#include <cstring>
+#endif
+
 #include "libtorrent/aux_/disable_warnings_pop.hpp"
 
+#if TORRENT_USE_MMSG
+// older headers don't define the generic segmentation offload option
+#ifndef SOL_UDP
+#define SOL_UDP 17
+#endif
+#ifndef UDP_SEGMENT
+#define UDP_SEGMENT 103
+#endif
+#endif
+
 namespace libtorrent {
 
 using namespace std::placeholders;
@@ -149,21 +168,141 @@ struct set_dont_frag
 
 udp_socket::udp_socket(io_service& ios)
 	: m_socket(ios)
-	, m_buf(new receive_buffer())
+	, m_buf(new std::array<receive_buffer, read_batch_size>())
 	, m_bind_port(0)
 	, m_force_proxy(false)
 	, m_abort(true)
+	, m_gso_supported(true)
 {}
 
+#if TORRENT_USE_MMSG
+namespace {
+
+	// the max number of packets to hold in the send queue. If the socket
+	// stays blocked, newly queued packets fail with would_block
+	std::size_t const max_queued_packets = 1024;
+
+	// the max number of packets passed to a single sendmmsg() call. This is
+	// also the max number of segments of a single GSO message, which the
+	// kernel caps at 64
+	int const send_batch_size = 64;
+
+	// the max payload of a single GSO message
+	int const max_gso_size = 0xffff - 28;
+
+	udp::endpoint to_endpoint(sockaddr_storage const& addr, socklen_t const len)
+	{
+		udp::endpoint ret;
+		std::size_t const size = std::min(std::size_t(len), std::size_t(ret.capacity()));
+		std::memcpy(ret.data(), &addr, size);
+		ret.resize(size);
+		return ret;
+	}
+}
+#endif
+
 int udp_socket::read(span<packet> pkts, error_code& ec)
 {
 	int const num = int(pkts.size());
 	int ret = 0;
 	packet p;
 
+#if TORRENT_USE_MMSG
+	std::array<mmsghdr, read_batch_size> msgs;
+	std::array<iovec, read_batch_size> iovs;
+	std::array<sockaddr_storage, read_batch_size> addrs;
+
 	while (ret < num)
 	{
-		int const len = int(m_socket.receive_from(boost::asio::buffer(*m_buf)
+		// pull in as many datagrams as we have buffers for with a single
+		// system call
+		int const batch = std::min(num, int(read_batch_size));
+		for (int i = 0; i < batch; ++i)
+		{
+			iovs[std::size_t(i)].iov_base = (*m_buf)[std::size_t(i)].data();
+			iovs[std::size_t(i)].iov_len = (*m_buf)[std::size_t(i)].size();
+			std::memset(&msgs[std::size_t(i)], 0, sizeof(mmsghdr));
+			msgs[std::size_t(i)].msg_hdr.msg_name = &addrs[std::size_t(i)];
+			msgs[std::size_t(i)].msg_hdr.msg_namelen = sizeof(sockaddr_storage);
+			msgs[std::size_t(i)].msg_hdr.msg_iov = &iovs[std::size_t(i)];
+			msgs[std::size_t(i)].msg_hdr.msg_iovlen = 1;
+		}
+
+		int const received = ::recvmmsg(m_socket.native_handle(), msgs.data()
+			, unsigned(batch), MSG_DONTWAIT, nullptr);
+
+		if (received < 0)
+		{
+			ec.assign(errno, system_category());
+
+			if (ec == error::would_block
+				|| ec == error::try_again
+				|| ec == error::operation_aborted
+				|| ec == error::bad_descriptor)
+			{
+				return ret;
+			}
+
+			if (ec == error::interrupted)
+			{
+				ec.clear();
+				continue;
+			}
+
+			// SOCKS5 cannot wrap ICMP errors. And even if it could, they certainly
+			// would not arrive as unwrapped (regular) ICMP errors. If we're using
+			// a proxy we must ignore these
+			if (m_force_proxy
+				|| (m_socks5_connection
+				&&  m_socks5_connection->active())) continue;
+
+			p.error = ec;
+			p.data = span<char>();
+			pkts[aux::numeric_cast<std::size_t>(ret)] = p;
+			++ret;
+			return ret;
+		}
+
+		ec.clear();
+		p.error.clear();
+		for (int i = 0; i < received; ++i)
+		{
+			mmsghdr const& m = msgs[std::size_t(i)];
+			p.from = to_endpoint(addrs[std::size_t(i)], m.msg_hdr.msg_namelen);
+			p.data = {(*m_buf)[std::size_t(i)].data()
+				, std::min(std::size_t(m.msg_len), (*m_buf)[std::size_t(i)].size())};
+
+			// support packets coming from the SOCKS5 proxy
+			if (m_socks5_connection && m_socks5_connection->active())
+			{
+				// if the source IP doesn't match the proxy's, ignore the packet
+				if (p.from != m_socks5_connection->target()) continue;
+				if (!unwrap(p.from, p.data)) continue;
+			}
+			// block incoming packets that aren't coming via the proxy
+			// if force proxy mode is enabled
+			else if (m_force_proxy) continue;
+
+			pkts[aux::numeric_cast<std::size_t>(ret)] = p;
+			++ret;
+		}
+
+		// the packets refer to our receive buffers, the next recvmmsg() call
+		// would overwrite them
+		break;
+	}
+#else
+	receive_buffer& buf = (*m_buf)[0];
+
+int udp_socket::read(span<packet> pkts, error_code& ec)
+{
+	int const num = int(pkts.size());
+	int ret = 0;
+	packet p;
+
+	while (ret < num)
+	{
+		int const len = int(m_socket.receive_from(boost::asio::buffer(buf)
 			, p.from, 0, ec));
 
 		if (ec == error::would_block
@@ -193,7 +332,7 @@ int udp_socket::read(span<packet> pkts, error_code& ec)
 		}
 		else
 		{
-			p.data = {m_buf->data(), aux::numeric_cast<std::size_t>(len)};
+			p.data = {buf.data(), aux::numeric_cast<std::size_t>(len)};
 
 			// support packets coming from the SOCKS5 proxy
 			if (m_socks5_connection && m_socks5_connection->active())
@@ -210,11 +349,11 @@ int udp_socket::read(span<packet> pkts, error_code& ec)
 		pkts[aux::numeric_cast<std::size_t>(ret)] = p;
 		++ret;
 
-		// we only have a single buffer for now, so we can only return a
-		// single packet. In the future though, we could attempt to drain
-		// the socket here, or maybe even use recvmmsg()
+		// we only have a single buffer, so we can only return a single
+		// packet
 		break;
 	}
+#endif
 
 	return ret;
 }
@@ -277,6 +416,27 @@ void udp_socket::send(udp::endpoint const& ep, span<char const> p
 
 	if (m_force_proxy) return;
 
+#if TORRENT_USE_MMSG
+	// if there are packets left over from a previous batch (because the
+	// socket would block) queue this one behind them, to preserve ordering
+	if ((flags & batch) || !m_send_queue.empty())
+	{
+		if (m_send_queue.size() >= max_queued_packets)
+		{
+			ec = error::would_block;
+			return;
+		}
+		queued_packet q;
+		q.to = ep;
+		q.offset = int(m_send_buffer.size());
+		q.size = int(p.size());
+		q.dont_fragment = (flags & dont_fragment) != 0 && ep.protocol() == udp::v4();
+		m_send_buffer.insert(m_send_buffer.end(), p.begin(), p.end());
+		m_send_queue.push_back(q);
+		return;
+	}
+#endif
+
 	// set the DF flag for the socket and clear it again in the destructor
 	set_dont_frag df(m_socket, (flags & dont_fragment) != 0
 		&& ep.protocol() == udp::v4());
@@ -284,6 +444,145 @@ void udp_socket::send(udp::endpoint const& ep, span<char const> p
 	m_socket.send_to(boost::asio::buffer(p.data(), p.size()), ep, 0, ec);
 }
 
+void udp_socket::flush_batch(error_code& ec)
+{
+	TORRENT_ASSERT(is_single_thread());
+#if TORRENT_USE_MMSG
+	if (m_send_queue.empty()) return;
+
+	if (!is_open())
+	{
+		m_send_queue.clear();
+		m_send_buffer.clear();
+		ec = error_code(boost::system::errc::bad_file_descriptor, generic_category());
+		return;
+	}
+
+	std::array<mmsghdr, send_batch_size> msgs;
+	std::array<iovec, send_batch_size> iovs;
+	// the number of queued packets in each message
+	std::array<int, send_batch_size> num_packets;
+	union control_buffer
+	{
+		char buf[CMSG_SPACE(sizeof(std::uint16_t))];
+		cmsghdr align;
+	};
+	std::array<control_buffer, send_batch_size> control;
+
+	std::size_t sent = 0;
+	while (sent < m_send_queue.size())
+	{
+		// build up to send_batch_size messages, all with the same DF flag,
+		// since that's a socket option
+		bool const df = m_send_queue[sent].dont_fragment;
+		int num_msgs = 0;
+		int num_iovs = 0;
+		bool gso = false;
+		std::size_t i = sent;
+		while (i < m_send_queue.size() && num_iovs < send_batch_size
+			&& m_send_queue[i].dont_fragment == df)
+		{
+			queued_packet const& first = m_send_queue[i];
+			mmsghdr& m = msgs[std::size_t(num_msgs)];
+			std::memset(&m, 0, sizeof(m));
+			m.msg_hdr.msg_name = const_cast<sockaddr*>(first.to.data());
+			m.msg_hdr.msg_namelen = socklen_t(first.to.size());
+			m.msg_hdr.msg_iov = &iovs[std::size_t(num_iovs)];
+
+			// consecutive packets to the same endpoint are sent as segments
+			// of a single message, as long as all but the last one are of
+			// the same size
+			int segments = 0;
+			int total = 0;
+			do
+			{
+				queued_packet const& q = m_send_queue[i];
+				iovs[std::size_t(num_iovs)].iov_base = m_send_buffer.data() + q.offset;
+				iovs[std::size_t(num_iovs)].iov_len = std::size_t(q.size);
+				total += q.size;
+				++num_iovs;
+				++segments;
+				++i;
+			} while (m_gso_supported
+				&& i < m_send_queue.size()
+				&& num_iovs < send_batch_size
+				&& m_send_queue[i].dont_fragment == df
+				&& m_send_queue[i - 1].size == first.size
+				&& m_send_queue[i].size <= first.size
+				&& m_send_queue[i].to == first.to
+				&& total + m_send_queue[i].size <= max_gso_size);
+
+			m.msg_hdr.msg_iovlen = std::size_t(segments);
+			if (segments > 1)
+			{
+				gso = true;
+				control_buffer& c = control[std::size_t(num_msgs)];
+				std::memset(&c, 0, sizeof(c));
+				m.msg_hdr.msg_control = c.buf;
+				m.msg_hdr.msg_controllen = sizeof(c.buf);
+				cmsghdr* cm = CMSG_FIRSTHDR(&m.msg_hdr);
+				cm->cmsg_level = SOL_UDP;
+				cm->cmsg_type = UDP_SEGMENT;
+				cm->cmsg_len = CMSG_LEN(sizeof(std::uint16_t));
+				std::uint16_t const segment_size = std::uint16_t(first.size);
+				std::memcpy(CMSG_DATA(cm), &segment_size, sizeof(segment_size));
+			}
+			num_packets[std::size_t(num_msgs)] = segments;
+			++num_msgs;
+		}
+
+		int ret;
+		{
+			// set the DF flag for the socket and clear it again in the destructor
+			set_dont_frag guard(m_socket, df);
+			ret = ::sendmmsg(m_socket.native_handle(), msgs.data()
+				, unsigned(num_msgs), MSG_DONTWAIT);
+		}
+
+		if (ret < 0)
+		{
+			int const err = errno;
+			if (err == EINTR) continue;
+
+			// kernels before 4.18, and some interfaces, don't support GSO.
+			// fall back to one message per packet
+			if (gso && (err == EIO || err == EINVAL || err == ENOPROTOOPT))
+			{
+				m_gso_supported = false;
+				continue;
+			}
+
+			ec.assign(err, system_category());
+			if (ec == error::would_block || ec == error::try_again)
+				break;
+
+			// the first message failed (e.g. the destination is
+			// unreachable). Drop it, and carry on with the rest
+			sent += std::size_t(num_packets[0]);
+			continue;
+		}
+
+		for (int k = 0; k < ret; ++k)
+			sent += std::size_t(num_packets[std::size_t(k)]);
+	}
+
+	if (sent == m_send_queue.size())
+	{
+		m_send_queue.clear();
+		m_send_buffer.clear();
+		return;
+	}
+
+	// keep the packets we couldn't send for the next flush
+	int const buffer_offset = m_send_queue[sent].offset;
+	m_send_queue.erase(m_send_queue.begin(), m_send_queue.begin() + std::ptrdiff_t(sent));
+	m_send_buffer.erase(m_send_buffer.begin(), m_send_buffer.begin() + buffer_offset);
+	for (auto& q : m_send_queue) q.offset -= buffer_offset;
+#else
+	TORRENT_UNUSED(ec);
+#endif
+}
+
 void udp_socket::wrap(udp::endpoint const& ep, span<char const> p
 	, error_code& ec, int const flags)
 {
@@ -402,6 +701,8 @@ void udp_socket::close()
 		m_socks5_connection->close();
 		m_socks5_connection.reset();
 	}
+	m_send_queue.clear();
+	m_send_buffer.clear();
 	m_abort = true;
 }
 
@@ -55,8 +55,13 @@ namespace libtorrent {
 	std::map<address, udp_tracker_connection::connection_cache_entry>
 		udp_tracker_connection::m_connection_cache;
 
+	std::map<address, std::vector<std::weak_ptr<udp_tracker_connection>>>
+		udp_tracker_connection::m_pending_connects;
+
 	std::mutex udp_tracker_connection::m_cache_mutex;
 
+	constexpr int udp_tracker_connection::max_scrape_hashes;
+
 	udp_tracker_connection::udp_tracker_connection(
 		io_service& ios
 		, tracker_manager& man
@@ -126,9 +131,44 @@ namespace libtorrent {
 			, settings.get_int(settings_pack::tracker_receive_timeout));
 	}
 
+	bool udp_tracker_connection::add_scrape(tracker_request const& req
+		, std::weak_ptr<request_callback> c)
+	{
+		TORRENT_ASSERT(tracker_req().kind & tracker_request::scrape_request);
+		TORRENT_ASSERT(req.kind & tracker_request::scrape_request);
+		if (m_abort || cancelled()) return false;
+
+		// once the scrape is sent, it's too late to add to it
+		if (m_state == action_t::scrape) return false;
+		if (int(m_scrapes.size()) + 1 >= max_scrape_hashes) return false;
+		if (req.bind_ip != tracker_req().bind_ip) return false;
+
+		m_scrapes.emplace_back(req, std::move(c));
+		return true;
+	}
+
+	void udp_tracker_connection::fail_batched_scrapes(error_code const& ec
+		, int const code, char const* msg, seconds32 const interval)
+	{
+		for (auto const& s : m_scrapes)
+		{
+			std::shared_ptr<request_callback> cb = s.second.lock();
+			if (!cb) continue;
+			// we need to post the error to avoid deadlock
+			get_io_service().post(std::bind(&request_callback::tracker_request_error
+				, cb, s.first, code, ec, std::string(msg), interval));
+		}
+		m_scrapes.clear();
+	}
+
 	void udp_tracker_connection::fail(error_code const& ec, int code
 		, char const* msg, seconds32 const interval, seconds32 const min_interval)
 	{
+		{
+			std::lock_guard<std::mutex> l(m_cache_mutex);
+			if (m_connecting) connect_done();
+		}
+
 		// m_target failed. remove it from the endpoint list
 		auto const i = std::find(m_endpoints.begin()
 			, m_endpoints.end(), tcp::endpoint(m_target.address(), m_target.port()));
@@ -138,6 +178,8 @@ namespace libtorrent {
 		// if that was the last one, fail the whole announce
 		if (m_endpoints.empty())
 		{
+			fail_batched_scrapes(ec, code, msg
+				, interval.count() == 0 ? min_interval : interval);
 			tracker_connection::fail(ec, code, msg, interval, min_interval);
 			return;
 		}
@@ -275,6 +317,8 @@ namespace libtorrent {
 
 	void udp_tracker_connection::start_announce()
 	{
+		if (cancelled()) return;
+
 		std::unique_lock<std::mutex> l(m_cache_mutex);
 		auto const cc = m_connection_cache.find(m_target.address());
 		if (cc != m_connection_cache.end())
@@ -283,20 +327,66 @@ namespace libtorrent {
 			// use if if it hasn't expired
 			if (aux::time_now() < cc->second.expires)
 			{
+				std::int64_t const connection_id = cc->second.connection_id;
+				l.unlock();
 				if (0 == (tracker_req().kind & tracker_request::scrape_request))
-					send_udp_announce();
-				else if (0 != (tracker_req().kind & tracker_request::scrape_request))
-					send_udp_scrape();
+					send_udp_announce(connection_id);
+				else
+					send_udp_scrape(connection_id);
 				return;
 			}
 			// if it expired, remove it from the cache
 			m_connection_cache.erase(cc);
 		}
+
+		// when many torrents announce to the same tracker at once, only one
+		// of them needs to send the connect
+		if (wait_for_connect()) return;
 		l.unlock();
 
 		send_udp_connect();
 	}
 
+	bool udp_tracker_connection::wait_for_connect()
+	{
+		// when we only know the tracker by its hostname (because it's
+		// resolved by the proxy) there's no address to key on
+		if (!m_hostname.empty()) return false;
+
+		auto const i = m_pending_connects.find(m_target.address());
+		if (i != m_pending_connects.end())
+		{
+			i->second.push_back(shared_from_this());
+			return true;
+		}
+
+		m_pending_connects[m_target.address()];
+		m_connecting = true;
+		return false;
+	}
+
+	void udp_tracker_connection::connect_done()
+	{
+		TORRENT_ASSERT(m_connecting);
+		m_connecting = false;
+		auto const i = m_pending_connects.find(m_target.address());
+		if (i == m_pending_connects.end()) return;
+
+		std::vector<std::weak_ptr<udp_tracker_connection>> waiters;
+		waiters.swap(i->second);
+		m_pending_connects.erase(i);
+
+		// if we got a connection ID, they'll find it in the cache. If not,
+		// the first one to run will send a connect of its own
+		for (auto const& w : waiters)
+		{
+			std::shared_ptr<udp_tracker_connection> c = w.lock();
+			if (!c) continue;
+			c->get_io_service().post(std::bind(
+				&udp_tracker_connection::start_announce, c));
+		}
+	}
+
 	void udp_tracker_connection::on_timeout(error_code const& ec)
 	{
 		if (ec)
@@ -314,6 +404,10 @@ namespace libtorrent {
 
 	void udp_tracker_connection::close()
 	{
+		{
+			std::lock_guard<std::mutex> l(m_cache_mutex);
+			if (m_connecting) connect_done();
+		}
 		cancel();
 		m_man.remove_request(this);
 	}
@@ -461,15 +555,18 @@ namespace libtorrent {
 		update_transaction_id();
 		std::int64_t const connection_id = aux::read_int64(buf);
 
-		std::lock_guard<std::mutex> l(m_cache_mutex);
-		connection_cache_entry& cce = m_connection_cache[m_target.address()];
-		cce.connection_id = connection_id;
-		cce.expires = aux::time_now() + seconds(m_man.settings().get_int(settings_pack::udp_tracker_token_expiry));
+		{
+			std::lock_guard<std::mutex> l(m_cache_mutex);
+			connection_cache_entry& cce = m_connection_cache[m_target.address()];
+			cce.connection_id = connection_id;
+			cce.expires = aux::time_now() + seconds(m_man.settings().get_int(settings_pack::udp_tracker_token_expiry));
+			if (m_connecting) connect_done();
+		}
 
 		if (0 == (tracker_req().kind & tracker_request::scrape_request))
-			send_udp_announce();
-		else if (0 != (tracker_req().kind & tracker_request::scrape_request))
-			send_udp_scrape();
+			send_udp_announce(connection_id);
+		else
+			send_udp_scrape(connection_id);
 		return true;
 	}
 
@@ -540,41 +637,41 @@ namespace libtorrent {
 		sent_bytes(16 + 28); // assuming UDP/IP header
 	}
 
-	void udp_tracker_connection::send_udp_scrape()
+	void udp_tracker_connection::send_udp_scrape(std::int64_t const connection_id)
 	{
 		if (m_abort) return;
 
-		auto const i = m_connection_cache.find(m_target.address());
-		// this isn't really supposed to happen
-		TORRENT_ASSERT(i != m_connection_cache.end());
-		if (i == m_connection_cache.end()) return;
-
-		char buf[8 + 4 + 4 + 20];
+		char buf[8 + 4 + 4 + 20 * max_scrape_hashes];
 		span<char> view = buf;
 
-		aux::write_int64(i->second.connection_id, view); // connection_id
+		aux::write_int64(connection_id, view); // connection_id
 		aux::write_int32(action_t::scrape, view); // action (scrape)
 		aux::write_int32(m_transaction_id, view); // transaction_id
-		// info_hash
+		// info_hashes, ours first, followed by the ones batched with it
 		std::copy(tracker_req().info_hash.begin(), tracker_req().info_hash.end()
 			, view.data());
-#if TORRENT_USE_ASSERTS
-		TORRENT_ASSERT(view.size() == 20);
-#endif
+		view = view.subspan(20);
+		for (auto const& s : m_scrapes)
+		{
+			std::copy(s.first.info_hash.begin(), s.first.info_hash.end()
+				, view.data());
+			view = view.subspan(20);
+		}
+		std::size_t const len = sizeof(buf) - std::size_t(view.size());
 
 		error_code ec;
 		if (!m_hostname.empty())
 		{
 			m_man.send_hostname(m_hostname.c_str(), m_target.port()
-				, buf, ec, udp_socket::tracker_connection);
+				, {buf, len}, ec, udp_socket::tracker_connection);
 		}
 		else
 		{
-			m_man.send(m_target, buf, ec
+			m_man.send(m_target, {buf, len}, ec
 				, udp_socket::tracker_connection);
 		}
 		m_state = action_t::scrape;
-		sent_bytes(sizeof(buf) + 28); // assuming UDP/IP header
+		sent_bytes(int(len) + 28); // assuming UDP/IP header
 		++m_attempts;
 		if (ec)
 		{
@@ -700,20 +797,35 @@ namespace libtorrent {
 		int const incomplete = aux::read_int32(buf);
 
 		std::shared_ptr<request_callback> cb = requester();
-		if (!cb)
+		if (cb)
 		{
-			close();
-			return true;
+			cb->tracker_scrape_response(tracker_req()
+				, complete, incomplete, downloaded, -1);
+		}
+
+		// the response has one entry per info-hash, in the order we sent
+		// them in
+		auto s = m_scrapes.begin();
+		for (; s != m_scrapes.end() && buf.size() >= 12; ++s)
+		{
+			int const c = aux::read_int32(buf);
+			int const d = aux::read_int32(buf);
+			int const i = aux::read_int32(buf);
+
+			std::shared_ptr<request_callback> scb = s->second.lock();
+			if (scb) scb->tracker_scrape_response(s->first, c, i, d, -1);
 		}
+		m_scrapes.erase(m_scrapes.begin(), s);
 
-		cb->tracker_scrape_response(tracker_req()
-			, complete, incomplete, downloaded, -1);
+		// whatever the tracker left out is an error
+		fail_batched_scrapes(error_code(errors::invalid_tracker_response_length)
+			, -1, "", seconds32(0));
 
 		close();
 		return true;
 	}
 
-	void udp_tracker_connection::send_udp_announce()
+	void udp_tracker_connection::send_udp_announce(std::int64_t const connection_id)
 	{
 		if (m_abort) return;
 
@@ -723,12 +835,7 @@ namespace libtorrent {
 		tracker_request const& req = tracker_req();
 		aux::session_settings const& settings = m_man.settings();
 
-		auto const i = m_connection_cache.find(m_target.address());
-		// this isn't really supposed to happen
-		TORRENT_ASSERT(i != m_connection_cache.end());
-		if (i == m_connection_cache.end()) return;
-
-		aux::write_int64(i->second.connection_id, out); // connection_id
+		aux::write_int64(connection_id, out); // connection_id
 		aux::write_int32(action_t::announce, out); // action (announce)
 		aux::write_int32(m_transaction_id, out); // transaction_id
 		std::copy(req.info_hash.begin(), req.info_hash.end(), out.data()); // info_hash
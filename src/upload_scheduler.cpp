@@ -0,0 +1,125 @@
+/*
+
+Copyright (c) 2017, Arvid Norberg
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions
+are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in
+      the documentation and/or other materials provided with the distribution.
+    * Neither the name of the author nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+#include "libtorrent/aux_/upload_scheduler.hpp"
+#include "libtorrent/assert.hpp"
+
+namespace libtorrent { namespace aux {
+
+	upload_scheduler::upload_scheduler(int const capacity)
+		: m_capacity(capacity)
+	{
+		TORRENT_ASSERT(capacity > 0);
+	}
+
+	bool upload_scheduler::is_warm(piece_key const k, time_point const now
+		, time_duration const expiry) const
+	{
+		auto const i = m_pieces.find(k);
+		if (i == m_pieces.end()) return false;
+		return i->second.cold_in_flight || now - i->second.last_read < expiry;
+	}
+
+	void upload_scheduler::read_issued(piece_key const k, time_point const now
+		, bool const cold)
+	{
+		auto i = m_pieces.find(k);
+		if (i == m_pieces.end())
+		{
+			// evict the least recently read piece, unless it has a read in
+			// flight. Those are bounded by the cold read limit
+			if (int(m_pieces.size()) >= m_capacity)
+			{
+				for (auto l = m_lru.begin(); l != m_lru.end(); ++l)
+				{
+					auto const e = m_pieces.find(*l);
+					TORRENT_ASSERT(e != m_pieces.end());
+					if (e->second.cold_in_flight) continue;
+					m_pieces.erase(e);
+					m_lru.erase(l);
+					break;
+				}
+			}
+			i = m_pieces.emplace(k, piece_entry()).first;
+			i->second.lru = m_lru.insert(m_lru.end(), k);
+		}
+		else
+		{
+			m_lru.splice(m_lru.end(), m_lru, i->second.lru);
+		}
+
+		piece_entry& e = i->second;
+		e.last_read = now;
+		if (cold && !e.cold_in_flight)
+		{
+			e.cold_in_flight = true;
+			e.cold_read_issued = now;
+			++m_cold_reads;
+		}
+	}
+
+	bool upload_scheduler::read_complete(piece_key const k)
+	{
+		auto const i = m_pieces.find(k);
+		if (i == m_pieces.end() || !i->second.cold_in_flight) return false;
+		i->second.cold_in_flight = false;
+		TORRENT_ASSERT(m_cold_reads > 0);
+		--m_cold_reads;
+		return true;
+	}
+
+	void upload_scheduler::wait(std::weak_ptr<peer_connection> p)
+	{
+		m_waiting.push_back(std::move(p));
+	}
+
+	std::vector<std::weak_ptr<peer_connection>> upload_scheduler::take_waiting()
+	{
+		std::vector<std::weak_ptr<peer_connection>> ret;
+		ret.swap(m_waiting);
+		return ret;
+	}
+
+	bool upload_scheduler::tick(time_point const now, time_duration const timeout)
+	{
+		if (m_cold_reads == 0) return false;
+		int const before = m_cold_reads;
+		for (auto& p : m_pieces)
+		{
+			piece_entry& e = p.second;
+			if (!e.cold_in_flight || now - e.cold_read_issued < timeout) continue;
+			e.cold_in_flight = false;
+			--m_cold_reads;
+		}
+		return m_cold_reads < before;
+	}
+}}
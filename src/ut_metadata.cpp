@@ -43,6 +43,7 @@ POSSIBILITY OF SUCH DAMAGE.
 #include "libtorrent/peer_connection_handle.hpp"
 #include "libtorrent/hasher.hpp"
 #include "libtorrent/bencode.hpp"
+#include "libtorrent/aux_/bencode_writer.hpp"
 #include "libtorrent/torrent.hpp"
 #include "libtorrent/torrent_handle.hpp"
 #include "libtorrent/extensions.hpp"
@@ -52,7 +53,6 @@ POSSIBILITY OF SUCH DAMAGE.
 #include "libtorrent/io.hpp"
 #include "libtorrent/performance_counters.hpp" // for counters
 #include "libtorrent/aux_/time.hpp"
-#include "libtorrent/aux_/non_owning_handle.hpp"
 
 namespace libtorrent {namespace {
 
@@ -74,6 +74,16 @@ namespace libtorrent {namespace {
 		// doesn't throttle its requests)
 		max_incoming_requests = 1024,
 
+		// the number of metadata requests we keep outstanding to a peer that
+		// announced it has the metadata. The pieces are striped across all
+		// such peers
+		max_outgoing_requests = 16,
+
+		// once every metadata piece has been requested, the remaining ones
+		// may be requested from up to this many peers at a time, to not have
+		// the last pieces wait for a slow peer
+		max_duplicate_requests = 2,
+
 		metadata_req = 0,
 		metadata_piece = 1,
 		metadata_dont_have = 2
@@ -84,6 +94,15 @@ namespace libtorrent {namespace {
 		return (numerator + denominator - 1) / denominator;
 	}
 
+	// holds a reference to the metadata buffer while a piece of it is in a
+	// peer's send buffer
+	struct metadata_holder
+	{
+		char* get() const { return buf.get() + offset; }
+		boost::shared_array<char> buf;
+		int offset;
+	};
+
 	struct ut_metadata_peer_plugin;
 
 	struct ut_metadata_plugin final
@@ -96,6 +115,9 @@ namespace libtorrent {namespace {
 				metadata();
 		}
 
+		std::uint32_t implemented_features() override
+		{ return new_connection_feature | piece_check_feature; }
+
 		void on_files_checked() override
 		{
 			// TODO: 2 if we were to initialize m_metadata_size lazily instead,
@@ -126,13 +148,63 @@ namespace libtorrent {namespace {
 			return {m_metadata.get(), aux::numeric_cast<std::size_t>(m_metadata_size)};
 		}
 
+		// the metadata buffer, for peers to keep a reference to while
+		// sending it
+		boost::shared_array<char> const& metadata_buffer() const
+		{
+			metadata();
+			return m_metadata;
+		}
+
+		// returns the bencoded dictionary of the data message for the
+		// specified metadata piece. It's the same for every peer, so the
+		// dictionaries of all pieces are encoded once, the first time one is
+		// needed
+		span<char const> piece_header(int const piece) const
+		{
+			TORRENT_ASSERT(m_torrent.valid_metadata());
+			if (m_piece_header_offsets.empty())
+			{
+				int const num_pieces = div_round_up(get_metadata_size(), 16 * 1024);
+				m_piece_header_offsets.reserve(std::size_t(num_pieces + 1));
+				aux::bencode_writer<std::back_insert_iterator<std::vector<char>>> e(
+					std::back_inserter(m_piece_headers));
+				for (int i = 0; i < num_pieces; ++i)
+				{
+					m_piece_header_offsets.push_back(int(m_piece_headers.size()));
+					e.start_dict();
+					e.key("msg_type");
+					e.integer(1);
+					e.key("piece");
+					e.integer(i);
+					e.key("total_size");
+					e.integer(get_metadata_size());
+					e.end();
+				}
+				m_piece_header_offsets.push_back(int(m_piece_headers.size()));
+			}
+			TORRENT_ASSERT(piece >= 0 && piece < int(m_piece_header_offsets.size()) - 1);
+			int const start = m_piece_header_offsets[std::size_t(piece)];
+			int const end = m_piece_header_offsets[std::size_t(piece) + 1];
+			return {m_piece_headers.data() + start, std::size_t(end - start)};
+		}
+
 		bool received_metadata(ut_metadata_peer_plugin& source
 			, char const* buf, int const size, int const piece, int const total_size);
 
-		// returns a piece of the metadata that
-		// we should request.
+		// returns a piece of the metadata that we should request, that's not
+		// in ``requested`` (the pieces already requested from this peer).
 		// returns -1 if we should hold off the request
-		int metadata_request(bool has_metadata);
+		int metadata_request(bool has_metadata, std::vector<int> const& requested);
+
+		// called when a request for the metadata piece has been answered, or
+		// won't be
+		void request_done(int const piece)
+		{
+			if (piece < 0 || piece >= m_requested_metadata.end_index()) return;
+			metadata_piece& mp = m_requested_metadata[piece];
+			if (mp.outstanding > 0) --mp.outstanding;
+		}
 
 		void on_piece_pass(piece_index_t) override
 		{
@@ -161,14 +233,21 @@ namespace libtorrent {namespace {
 
 		mutable int m_metadata_size = 0;
 
+		// the bencoded dictionaries of the data messages of all metadata
+		// pieces, back to back. Piece i's starts at m_piece_header_offsets[i]
+		// and ends where the next one starts. Built lazily by piece_header()
+		mutable std::vector<char> m_piece_headers;
+		mutable std::vector<int> m_piece_header_offsets;
+
 		struct metadata_piece
 		{
-			metadata_piece(): num_requests(0), last_request(min_time()) {}
+			metadata_piece(): num_requests(0), outstanding(0), last_request(min_time()) {}
 			int num_requests;
+
+			// the number of requests for this piece currently in flight
+			int outstanding;
 			time_point last_request;
 			std::weak_ptr<ut_metadata_peer_plugin> source;
-			bool operator<(metadata_piece const& rhs) const
-			{ return num_requests < rhs.num_requests; }
 		};
 
 		// this vector keeps track of how many times each metadata
@@ -195,6 +274,17 @@ namespace libtorrent {namespace {
 			, m_tp(tp)
 		{}
 
+		std::uint32_t implemented_features() override
+		{ return extended_feature | tick_feature; }
+
+		void on_disconnect(error_code const&) override
+		{
+			// let other peers pick up the pieces we were waiting for
+			for (int const piece : m_sent_requests)
+				m_tp.request_done(piece);
+			m_sent_requests.clear();
+		}
+
 		// can add entries to the extension handshake
 		void add_handshake(entry& h) override
 		{
@@ -242,15 +332,7 @@ namespace libtorrent {namespace {
 			// abort if the peer doesn't support the metadata extension
 			if (m_message_index == 0) return;
 
-			entry e;
-			e["msg_type"] = type;
-			e["piece"] = piece;
-
-			char const* metadata = nullptr;
-			int metadata_piece_size = 0;
-
-			if (m_torrent.valid_metadata())
-				e["total_size"] = m_tp.get_metadata_size();
+			namespace io = detail;
 
 			if (type == 1)
 			{
@@ -258,30 +340,54 @@ namespace libtorrent {namespace {
 				TORRENT_ASSERT(m_pc.associated_torrent().lock()->valid_metadata());
 				TORRENT_ASSERT(m_torrent.valid_metadata());
 
-				int offset = piece * 16 * 1024;
-				metadata = m_tp.metadata().data() + offset;
-				metadata_piece_size = (std::min)(
+				int const offset = piece * 16 * 1024;
+				int const metadata_piece_size = (std::min)(
 					m_tp.get_metadata_size() - offset, 16 * 1024);
 				TORRENT_ASSERT(metadata_piece_size > 0);
 				TORRENT_ASSERT(offset >= 0);
 				TORRENT_ASSERT(offset + metadata_piece_size <= int(m_tp.get_metadata_size()));
+
+				// the message is the pre-encoded dictionary followed by the
+				// piece of the metadata, which is referenced, not copied
+				span<char const> const dict = m_tp.piece_header(piece);
+				char msg[200];
+				TORRENT_ASSERT(dict.size() + 6 <= sizeof(msg));
+				char* header = msg;
+				io::write_uint32(2 + int(dict.size()) + metadata_piece_size, header);
+				io::write_uint8(bt_peer_connection::msg_extended, header);
+				io::write_uint8(m_message_index, header);
+				std::memcpy(header, dict.data(), dict.size());
+
+				m_pc.send_buffer(msg, 6 + int(dict.size()));
+				m_pc.append_const_send_buffer(
+					metadata_holder{m_tp.metadata_buffer(), offset}, metadata_piece_size);
+
+				m_pc.stats_counters().inc_stats_counter(counters::num_outgoing_extended);
+				m_pc.stats_counters().inc_stats_counter(counters::num_outgoing_metadata);
+				return;
 			}
 
 			char msg[200];
 			char* header = msg;
-			char* p = &msg[6];
-			int len = bencode(p, e);
-			int total_size = 2 + len + metadata_piece_size;
-			namespace io = detail;
+			aux::bencode_writer<char*> e(&msg[6]);
+			e.start_dict();
+			e.key("msg_type");
+			e.integer(type);
+			e.key("piece");
+			e.integer(piece);
+			if (m_torrent.valid_metadata())
+			{
+				e.key("total_size");
+				e.integer(m_tp.get_metadata_size());
+			}
+			e.end();
+			int len = e.size();
+			int total_size = 2 + len;
 			io::write_uint32(total_size, header);
 			io::write_uint8(bt_peer_connection::msg_extended, header);
 			io::write_uint8(m_message_index, header);
 
 			m_pc.send_buffer(msg, len + 6);
-			// TODO: we really need to increment the refcounter on the torrent
-			// while this buffer is still in the peer's send buffer
-			if (metadata_piece_size) m_pc.append_const_send_buffer(
-				aux::non_owning_handle(const_cast<char*>(metadata)), metadata_piece_size);
 
 			m_pc.stats_counters().inc_stats_counter(counters::num_outgoing_extended);
 			m_pc.stats_counters().inc_stats_counter(counters::num_outgoing_metadata);
@@ -381,6 +487,7 @@ namespace libtorrent {namespace {
 					}
 
 					m_sent_requests.erase(i);
+					m_tp.request_done(piece);
 					entry const* total_size = msg.find_key("total_size");
 					m_tp.received_metadata(*this, body.begin() + len, int(body.size()) - int(len), piece
 						, (total_size && total_size->type() == entry::int_t) ? int(total_size->integer()) : 0);
@@ -395,6 +502,7 @@ namespace libtorrent {namespace {
 					// unwanted piece?
 					if (i == m_sent_requests.end()) return true;
 					m_sent_requests.erase(i);
+					m_tp.request_done(piece);
 				}
 				break;
 			default:
@@ -423,16 +531,19 @@ namespace libtorrent {namespace {
 		{
 			if (m_pc.is_disconnecting()) return;
 
-			// if we don't have any metadata, and this peer
-			// supports the request metadata extension
-			// and we aren't currently waiting for a request
-			// reply. Then, send a request for some metadata.
-			if (!m_torrent.valid_metadata()
+			// if we don't have any metadata, and this peer supports the
+			// request metadata extension, keep a number of requests for
+			// metadata pieces outstanding. Peers that haven't told us they
+			// have the metadata only get one at a time
+			std::size_t const max_requests = m_pc.has_metadata()
+				? max_outgoing_requests : 1;
+			while (!m_torrent.valid_metadata()
 				&& m_message_index != 0
-				&& m_sent_requests.size() < 2
+				&& m_sent_requests.size() < max_requests
 				&& has_metadata())
 			{
-				int piece = m_tp.metadata_request(m_pc.has_metadata());
+				int const piece = m_tp.metadata_request(m_pc.has_metadata()
+					, m_sent_requests);
 				if (piece == -1) return;
 
 				m_sent_requests.push_back(piece);
@@ -485,38 +596,58 @@ namespace libtorrent {namespace {
 	}
 
 	// has_metadata is false if the peer making the request has not announced
-	// that it has metadata. In this case, it shouldn't prevent other peers
-	// from requesting this block by setting a timeout on it.
-	int ut_metadata_plugin::metadata_request(bool const has_metadata)
+	// that it has metadata. Such a peer is likely to reject the request, so it
+	// only gets pieces no other peer is downloading.
+	// Pieces nobody is downloading are handed out first, the ones requested
+	// the fewest times before them. Requests that haven't been answered
+	// within request_timeout don't count. Once every piece has been
+	// requested, the remaining ones are requested again from other peers
+	int ut_metadata_plugin::metadata_request(bool const has_metadata
+		, std::vector<int> const& requested)
 	{
-		std::vector<metadata_piece>::iterator i = std::min_element(
-			m_requested_metadata.begin(), m_requested_metadata.end());
-
 		if (m_requested_metadata.empty())
 		{
 			// if we don't know how many pieces there are
 			// just ask for piece 0
 			m_requested_metadata.resize(1);
-			i = m_requested_metadata.begin();
 		}
 
-		int const piece = int(i - m_requested_metadata.begin());
+		time_point const now = aux::time_now();
+		seconds const request_timeout(20);
 
-		// don't request the same block more than once every 3 seconds
-		time_point now = aux::time_now();
-		if (m_requested_metadata[piece].last_request != min_time()
-			&& total_seconds(now - m_requested_metadata[piece].last_request) < 3)
-			return -1;
-
-		++m_requested_metadata[piece].num_requests;
+		int best = -1;
+		int best_outstanding = 0;
+		for (int i = 0; i < m_requested_metadata.end_index(); ++i)
+		{
+			metadata_piece const& mp = m_requested_metadata[i];
+			if (mp.num_requests == std::numeric_limits<int>::max()) continue;
+			if (std::find(requested.begin(), requested.end(), i) != requested.end())
+				continue;
+
+			int const outstanding = now - mp.last_request < request_timeout
+				? mp.outstanding : 0;
+			if (outstanding > 0
+				&& (!has_metadata || outstanding >= max_duplicate_requests))
+				continue;
+
+			if (best == -1
+				|| outstanding < best_outstanding
+				|| (outstanding == best_outstanding
+					&& mp.num_requests < m_requested_metadata[best].num_requests))
+			{
+				best = i;
+				best_outstanding = outstanding;
+			}
+		}
 
-		// only set the timeout on this block, only if the peer
-		// has metadata. This is to prevent peers with no metadata
-		// to starve out sending requests to peers with metadata
-		if (has_metadata)
-			m_requested_metadata[piece].last_request = now;
+		if (best == -1) return -1;
 
-		return piece;
+		metadata_piece& mp = m_requested_metadata[best];
+		if (now - mp.last_request >= request_timeout) mp.outstanding = 0;
+		++mp.num_requests;
+		++mp.outstanding;
+		mp.last_request = now;
+		return best;
 	}
 
 	bool ut_metadata_plugin::received_metadata(
@@ -34,6 +34,7 @@ POSSIBILITY OF SUCH DAMAGE.
 #include "libtorrent/bt_peer_connection.hpp"
 #include "libtorrent/peer_connection_handle.hpp"
 #include "libtorrent/bencode.hpp"
+#include "libtorrent/aux_/bencode_writer.hpp"
 #include "libtorrent/torrent.hpp"
 #include "libtorrent/extensions.hpp"
 #include "libtorrent/broadcast_socket.hpp"
@@ -68,6 +69,120 @@ namespace libtorrent {namespace {
 		return true;
 	}
 
+	// the flags to advertise a peer with in a pex message
+	// 0x01 - peer supports encryption
+	// 0x02 - peer is a seed
+	// 0x04 - supports uTP. This is only a positive flags
+	//        passing 0 doesn't mean the peer doesn't
+	//        support uTP
+	// 0x08 - supports holepunching protocol. If this
+	//        flag is received from a peer, it can be
+	//        used as a rendezvous point in case direct
+	//        connections to the peer fail
+	int pex_flags(bt_peer_connection const& p)
+	{
+		int flags = p.is_seed() ? 2 : 0;
+#if !defined(TORRENT_DISABLE_ENCRYPTION) && !defined(TORRENT_DISABLE_EXTENSIONS)
+		flags |= p.supports_encryption() ? 1 : 0;
+#endif
+		flags |= is_utp(*p.get_socket()) ? 4 :  0;
+		flags |= p.supports_holepunch() ? 8 : 0;
+		return flags;
+	}
+
+	// the endpoint to advertise a peer with. If the peer has told us which
+	// port its listening on, use that port. But only if we didn't connect to
+	// the peer. if we connected to it, use the port we know works
+	tcp::endpoint pex_endpoint(peer_connection const& p)
+	{
+		tcp::endpoint remote = p.remote();
+		if (!p.is_outgoing())
+		{
+			torrent_peer const* const pi = p.peer_info_struct();
+			if (pi != nullptr && pi->port > 0)
+				remote.port(pi->port);
+		}
+		return remote;
+	}
+
+	// the added (and dropped) peers of a pex message, split by address
+	// family
+	struct pex_lists
+	{
+		std::string added;
+		std::string added_flags;
+		std::string dropped;
+#if TORRENT_USE_IPV6
+		std::string added6;
+		std::string added6_flags;
+		std::string dropped6;
+#endif
+
+		void add(tcp::endpoint const& ep, int const flags)
+		{
+#if TORRENT_USE_IPV6
+			if (!ep.address().is_v4())
+			{
+				std::back_insert_iterator<std::string> out(added6);
+				detail::write_endpoint(ep, out);
+				added6_flags.push_back(char(flags));
+				return;
+			}
+#endif
+			std::back_insert_iterator<std::string> out(added);
+			detail::write_endpoint(ep, out);
+			added_flags.push_back(char(flags));
+		}
+
+		void drop(tcp::endpoint const& ep)
+		{
+#if TORRENT_USE_IPV6
+			if (!ep.address().is_v4())
+			{
+				std::back_insert_iterator<std::string> out(dropped6);
+				detail::write_endpoint(ep, out);
+				return;
+			}
+#endif
+			std::back_insert_iterator<std::string> out(dropped);
+			detail::write_endpoint(ep, out);
+		}
+
+		std::shared_ptr<std::vector<char>> encode() const
+		{
+			auto ret = std::make_shared<std::vector<char>>();
+			aux::bencode_writer<std::back_insert_iterator<std::vector<char>>> pex(
+				std::back_inserter(*ret));
+			pex.start_dict();
+			pex.key("added");
+			pex.string(added);
+			pex.key("added.f");
+			pex.string(added_flags);
+#if TORRENT_USE_IPV6
+			pex.key("added6");
+			pex.string(added6);
+			pex.key("added6.f");
+			pex.string(added6_flags);
+#endif
+			pex.key("dropped");
+			pex.string(dropped);
+#if TORRENT_USE_IPV6
+			pex.key("dropped6");
+			pex.string(dropped6);
+#endif
+			pex.end();
+			return ret;
+		}
+	};
+
+	// holds a reference to a pex message shared by all peers of a torrent,
+	// while it's in the send buffer of one of them
+	struct shared_pex_msg
+	{
+		char* get() const { return const_cast<char*>(msg->data()); }
+		std::shared_ptr<std::vector<char> const> msg;
+	};
+
 	struct ut_pex_plugin final
 		: torrent_plugin
 	{
@@ -78,12 +193,18 @@ namespace libtorrent {namespace {
 		explicit ut_pex_plugin(torrent& t)
 			: m_torrent(t)
 			, m_last_msg(min_time())
-			, m_peers_in_message(0) {}
+			, m_peers_in_message(0)
+			, m_peers_in_full_message(0) {}
+
+		std::uint32_t implemented_features() override
+		{ return new_connection_feature | tick_feature; }
 
 		std::shared_ptr<peer_plugin> new_connection(
 			peer_connection_handle const& pc) override;
 
-		std::vector<char>& get_ut_pex_msg()
+		// the message with the peers added and dropped since the previous
+		// interval. nullptr until the first message has been built
+		std::shared_ptr<std::vector<char> const> const& get_ut_pex_msg() const
 		{
 			return m_ut_pex_msg;
 		}
@@ -93,40 +214,42 @@ namespace libtorrent {namespace {
 			return m_peers_in_message;
 		}
 
+		// the message with all peers of the current interval, sent to peers
+		// as their first pex message. The subsequent diff messages are
+		// relative to this set
+		std::shared_ptr<std::vector<char> const> const& get_ut_pex_full_msg() const
+		{
+			return m_ut_pex_full_msg;
+		}
+
+		int peers_in_full_msg() const
+		{
+			return m_peers_in_full_message;
+		}
+
 		// the second tick of the torrent
 		// each minute the new lists of "added" + "added.f" and "dropped"
-		// are calculated here and the pex message is created
-		// each peer connection will use this message
+		// are calculated here and the pex messages are created
+		// each peer connection will use these messages, which are only
+		// encoded once, no matter how many peers they are sent to
 		// max_peer_entries limits the packet size
 		void tick() override
 		{
 			time_point now = aux::time_now();
 			if (now - seconds(60) < m_last_msg) return;
-			m_last_msg = now;
 
 			int num_peers = m_torrent.num_peers();
 			if (num_peers == 0) return;
+			m_last_msg = now;
 
-			entry pex;
-			std::string& pla = pex["added"].string();
-			std::string& pld = pex["dropped"].string();
-			std::string& plf = pex["added.f"].string();
-			std::back_insert_iterator<std::string> pla_out(pla);
-			std::back_insert_iterator<std::string> pld_out(pld);
-			std::back_insert_iterator<std::string> plf_out(plf);
-#if TORRENT_USE_IPV6
-			std::string& pla6 = pex["added6"].string();
-			std::string& pld6 = pex["dropped6"].string();
-			std::string& plf6 = pex["added6.f"].string();
-			std::back_insert_iterator<std::string> pla6_out(pla6);
-			std::back_insert_iterator<std::string> pld6_out(pld6);
-			std::back_insert_iterator<std::string> plf6_out(plf6);
-#endif
+			pex_lists diff;
+			pex_lists full;
 
 			std::set<tcp::endpoint> dropped;
 			m_old_peers.swap(dropped);
 
 			m_peers_in_message = 0;
+			m_peers_in_full_message = 0;
 			int num_added = 0;
 			for (torrent::peer_iterator i = m_torrent.begin()
 				, end(m_torrent.end()); i != end; ++i)
@@ -134,85 +257,52 @@ namespace libtorrent {namespace {
 				peer_connection* peer = *i;
 				if (!send_peer(*peer)) continue;
 
-				tcp::endpoint remote = peer->remote();
+				tcp::endpoint const remote = peer->remote();
 				m_old_peers.insert(remote);
 
 				std::set<tcp::endpoint>::iterator di = dropped.find(remote);
-				if (di == dropped.end())
+				bool const added = di == dropped.end();
+				if (!added)
 				{
-					// don't write too big of a package
-					if (num_added >= max_peer_entries) break;
-
-					// only send proper bittorrent peers
-					if (peer->type() != connection_type::bittorrent)
-						continue;
-
-					bt_peer_connection* p = static_cast<bt_peer_connection*>(peer);
-
-					// if the peer has told us which port its listening on,
-					// use that port. But only if we didn't connect to the peer.
-					// if we connected to it, use the port we know works
-					if (!p->is_outgoing())
-					{
-						torrent_peer const* const pi = peer->peer_info_struct();
-						if (pi != nullptr && pi->port > 0)
-							remote.port(pi->port);
-					}
-
-					// no supported flags to set yet
-					// 0x01 - peer supports encryption
-					// 0x02 - peer is a seed
-					// 0x04 - supports uTP. This is only a positive flags
-					//        passing 0 doesn't mean the peer doesn't
-					//        support uTP
-					// 0x08 - supports holepunching protocol. If this
-					//        flag is received from a peer, it can be
-					//        used as a rendezvous point in case direct
-					//        connections to the peer fail
-					int flags = p->is_seed() ? 2 : 0;
-#if !defined(TORRENT_DISABLE_ENCRYPTION) && !defined(TORRENT_DISABLE_EXTENSIONS)
-					flags |= p->supports_encryption() ? 1 : 0;
-#endif
-					flags |= is_utp(*p->get_socket()) ? 4 :  0;
-					flags |= p->supports_holepunch() ? 8 : 0;
+					// this was in the previous message
+					// so, it wasn't dropped
+					dropped.erase(di);
+				}
+
+				// don't write too big of a package
+				if (added && num_added >= max_peer_entries) break;
+
+				// only send proper bittorrent peers
+				if (peer->type() != connection_type::bittorrent)
+					continue;
+
+				bt_peer_connection const& p = static_cast<bt_peer_connection const&>(*peer);
+				tcp::endpoint const ep = pex_endpoint(p);
+				int const flags = pex_flags(p);
 
+				if (m_peers_in_full_message < max_peer_entries)
+				{
+					full.add(ep, flags);
+					++m_peers_in_full_message;
+				}
+
+				if (added)
+				{
 					// i->first was added since the last time
-					if (remote.address().is_v4())
-					{
-						detail::write_endpoint(remote, pla_out);
-						detail::write_uint8(flags, plf_out);
-					}
-#if TORRENT_USE_IPV6
-					else
-					{
-						detail::write_endpoint(remote, pla6_out);
-						detail::write_uint8(flags, plf6_out);
-					}
-#endif
+					diff.add(ep, flags);
 					++num_added;
 					++m_peers_in_message;
 				}
-				else
-				{
-					// this was in the previous message
-					// so, it wasn't dropped
-					dropped.erase(di);
-				}
 			}
 
 			for (auto const& i : dropped)
 			{
-				if (i.address().is_v4())
-					detail::write_endpoint(i, pld_out);
-#if TORRENT_USE_IPV6
-				else
-					detail::write_endpoint(i, pld6_out);
-#endif
+				diff.drop(i);
 				++m_peers_in_message;
 			}
 
-			m_ut_pex_msg.clear();
-			bencode(std::back_inserter(m_ut_pex_msg), pex);
+			m_ut_pex_msg = diff.encode();
+			m_ut_pex_full_msg = full.encode();
 		}
 
 	private:
@@ -220,8 +310,10 @@ namespace libtorrent {namespace {
 
 		std::set<tcp::endpoint> m_old_peers;
 		time_point m_last_msg;
-		std::vector<char> m_ut_pex_msg;
+		std::shared_ptr<std::vector<char> const> m_ut_pex_msg;
+		std::shared_ptr<std::vector<char> const> m_ut_pex_full_msg;
 		int m_peers_in_message;
+		int m_peers_in_full_message;
 
 		// explicitly disallow assignment, to silence msvc warning
 		ut_pex_plugin& operator=(ut_pex_plugin const&);
@@ -230,7 +322,7 @@ namespace libtorrent {namespace {
 	struct ut_pex_peer_plugin final
 		: ut_pex_peer_store, peer_plugin
 	{
-		ut_pex_peer_plugin(torrent& t, peer_connection& pc, ut_pex_plugin& tp)
+		ut_pex_peer_plugin(torrent& t, bt_peer_connection& pc, ut_pex_plugin& tp)
 			: m_torrent(t)
 			, m_pc(pc)
 			, m_tp(tp)
@@ -245,6 +337,9 @@ namespace libtorrent {namespace {
 			}
 		}
 
+		std::uint32_t implemented_features() override
+		{ return extended_feature | tick_feature; }
+
 		void add_handshake(entry& h) override
 		{
 			entry& messages = h["m"];
@@ -434,6 +529,9 @@ namespace libtorrent {namespace {
 			int const num_peers = m_torrent.num_peers();
 			if (num_peers <= 1) return;
 
+			// the torrent hasn't built its first pex messages yet
+			if (!m_tp.get_ut_pex_full_msg()) return;
+
 			// don't send pex messages more often than 1 every 100 ms, and
 			// allow pex messages to be sent 5 seconds apart if there isn't
 			// contention
@@ -468,31 +566,39 @@ namespace libtorrent {namespace {
 			}
 		}
 
-		void send_ut_peer_diff()
+		// sends one of the pex messages shared by all peers of the torrent
+		void send_shared_msg(std::shared_ptr<std::vector<char> const> const& pex_msg)
 		{
-			// if there's no change in out peer set, don't send anything
-			if (m_tp.peers_in_msg() == 0) return;
-
-			std::vector<char> const& pex_msg = m_tp.get_ut_pex_msg();
-
 			char msg[6];
 			char* ptr = msg;
 
-			detail::write_uint32(1 + 1 + int(pex_msg.size()), ptr);
+			detail::write_uint32(1 + 1 + int(pex_msg->size()), ptr);
 			detail::write_uint8(bt_peer_connection::msg_extended, ptr);
 			detail::write_uint8(m_message_index, ptr);
 			m_pc.send_buffer(msg, sizeof(msg));
-			m_pc.send_buffer(&pex_msg[0], int(pex_msg.size()));
+			// this only copies the message if it has to be encrypted
+			m_pc.append_const_send_buffer(shared_pex_msg{pex_msg}, int(pex_msg->size()));
+			m_pc.setup_send();
 
 			m_pc.stats_counters().inc_stats_counter(counters::num_outgoing_extended);
 			m_pc.stats_counters().inc_stats_counter(counters::num_outgoing_pex);
+		}
+
+		void send_ut_peer_diff()
+		{
+			// if there's no change in out peer set, don't send anything
+			if (m_tp.peers_in_msg() == 0) return;
+
+			std::shared_ptr<std::vector<char> const> const& pex_msg = m_tp.get_ut_pex_msg();
+			TORRENT_ASSERT(pex_msg);
+			send_shared_msg(pex_msg);
 
 #ifndef TORRENT_DISABLE_LOGGING
 			if (m_pc.should_log(peer_log_alert::outgoing_message))
 			{
 				bdecode_node m;
 				error_code ec;
-				int ret = bdecode(&pex_msg[0], &pex_msg[0] + pex_msg.size(), m, ec);
+				int ret = bdecode(pex_msg->data(), pex_msg->data() + pex_msg->size(), m, ec);
 				TORRENT_ASSERT(ret == 0);
 				TORRENT_ASSERT(!ec);
 				TORRENT_UNUSED(ret);
@@ -507,109 +613,25 @@ namespace libtorrent {namespace {
 				e = m.dict_find_string("dropped6");
 				if (e) num_dropped += e.string_length() / 18;
 				m_pc.peer_log(peer_log_alert::outgoing_message, "PEX_DIFF", "dropped: %d added: %d msg_size: %d"
-					, num_dropped, num_added, int(pex_msg.size()));
+					, num_dropped, num_added, int(pex_msg->size()));
 			}
 #endif
 		}
 
 		void send_ut_peer_list()
 		{
-			entry pex;
-			// leave the dropped string empty
-			pex["dropped"].string();
-			std::string& pla = pex["added"].string();
-			std::string& plf = pex["added.f"].string();
-			std::back_insert_iterator<std::string> pla_out(pla);
-			std::back_insert_iterator<std::string> plf_out(plf);
-
-#if TORRENT_USE_IPV6
-			pex["dropped6"].string();
-			std::string& pla6 = pex["added6"].string();
-			std::string& plf6 = pex["added6.f"].string();
-			std::back_insert_iterator<std::string> pla6_out(pla6);
-			std::back_insert_iterator<std::string> plf6_out(plf6);
-#endif
-
-			int num_added = 0;
-			for (torrent::peer_iterator i = m_torrent.begin()
-				, end(m_torrent.end()); i != end; ++i)
-			{
-				peer_connection* peer = *i;
-				if (!send_peer(*peer)) continue;
-
-				// don't write too big of a package
-				if (num_added >= max_peer_entries) break;
-
-				// only send proper bittorrent peers
-				if (peer->type() != connection_type::bittorrent)
-					continue;
-
-				bt_peer_connection* p = static_cast<bt_peer_connection*>(peer);
-
-				// no supported flags to set yet
-				// 0x01 - peer supports encryption
-				// 0x02 - peer is a seed
-				// 0x04 - supports uTP. This is only a positive flags
-				//        passing 0 doesn't mean the peer doesn't
-				//        support uTP
-				// 0x08 - supports holepunching protocol. If this
-				//        flag is received from a peer, it can be
-				//        used as a rendezvous point in case direct
-				//        connections to the peer fail
-				int flags = p->is_seed() ? 2 : 0;
-#if !defined(TORRENT_DISABLE_ENCRYPTION) && !defined(TORRENT_DISABLE_EXTENSIONS)
-				flags |= p->supports_encryption() ? 1 : 0;
-#endif
-				flags |= is_utp(*p->get_socket()) ? 4 :  0;
-				flags |= p->supports_holepunch() ? 8 : 0;
-
-				tcp::endpoint remote = peer->remote();
-
-				if (!p->is_outgoing())
-				{
-					torrent_peer const* const pi = peer->peer_info_struct();
-					if (pi != nullptr && pi->port > 0)
-						remote.port(pi->port);
-				}
-
-				// i->first was added since the last time
-				if (remote.address().is_v4())
-				{
-					detail::write_endpoint(remote, pla_out);
-					detail::write_uint8(flags, plf_out);
-				}
-#if TORRENT_USE_IPV6
-				else
-				{
-					detail::write_endpoint(remote, pla6_out);
-					detail::write_uint8(flags, plf6_out);
-				}
-#endif
-				++num_added;
-			}
-			std::vector<char> pex_msg;
-			bencode(std::back_inserter(pex_msg), pex);
-
-			char msg[6];
-			char* ptr = msg;
-
-			detail::write_uint32(1 + 1 + int(pex_msg.size()), ptr);
-			detail::write_uint8(bt_peer_connection::msg_extended, ptr);
-			detail::write_uint8(m_message_index, ptr);
-			m_pc.send_buffer(msg, sizeof(msg));
-			m_pc.send_buffer(&pex_msg[0], int(pex_msg.size()));
-
-			m_pc.stats_counters().inc_stats_counter(counters::num_outgoing_extended);
-			m_pc.stats_counters().inc_stats_counter(counters::num_outgoing_pex);
+			std::shared_ptr<std::vector<char> const> const& pex_msg = m_tp.get_ut_pex_full_msg();
+			TORRENT_ASSERT(pex_msg);
+			send_shared_msg(pex_msg);
 
 #ifndef TORRENT_DISABLE_LOGGING
 			m_pc.peer_log(peer_log_alert::outgoing_message, "PEX_FULL"
-				, "added: %d msg_size: %d", num_added, int(pex_msg.size()));
+				, "added: %d msg_size: %d", m_tp.peers_in_full_msg(), int(pex_msg->size()));
 #endif
 		}
 
 		torrent& m_torrent;
-		peer_connection& m_pc;
+		bt_peer_connection& m_pc;
 		ut_pex_plugin& m_tp;
 
 		// the last pex messages we received
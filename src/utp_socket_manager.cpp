@@ -50,13 +50,16 @@ namespace libtorrent {
 
 	utp_socket_manager::utp_socket_manager(
 		send_fun_t const& send_fun
+		, flush_fun_t const& flush_fun
 		, incoming_utp_callback_t const& cb
 		, io_service& ios
 		, aux::session_settings const& sett
 		, counters& cnt
 		, void* ssl_context)
 		: m_send_fun(send_fun)
+		, m_flush_fun(flush_fun)
 		, m_cb(cb)
+		, m_pacing_timer(ios)
 		, m_sett(sett)
 		, m_counters(cnt)
 		, m_ios(ios)
@@ -67,30 +70,147 @@ namespace libtorrent {
 
 	utp_socket_manager::~utp_socket_manager()
 	{
-		for (auto& i : m_utp_sockets)
+		for (auto s : m_utp_sockets)
 		{
-			delete_utp_impl(i.second);
+			delete_utp_impl(s);
 		}
 	}
 
 	void utp_socket_manager::tick(time_point now)
 	{
-		for (auto i = m_utp_sockets.begin()
-			, end(m_utp_sockets.end()); i != end;)
+		auto last = m_utp_sockets.begin();
+		for (auto s : m_utp_sockets)
 		{
-			if (should_delete(i->second))
+			if (should_delete(s))
 			{
-				delete_utp_impl(i->second);
-				if (m_last_socket == i->second) m_last_socket = nullptr;
-				i = m_utp_sockets.erase(i);
+				unindex_socket(s);
+				if (m_last_socket == s) m_last_socket = nullptr;
+				delete_utp_impl(s);
 				continue;
 			}
-			tick_utp_impl(i->second, now);
-			++i;
+			tick_utp_impl(s, now);
+			*last++ = s;
 		}
+		m_utp_sockets.erase(last, m_utp_sockets.end());
 	}
 
-	void utp_socket_manager::mtu_for_dest(address const& addr, int& link_mtu, int& utp_mtu)
+namespace {
+
+	// MTU cache entries older than this are ignored, to make new sockets
+	// probe again in case the path changed
+	minutes const mtu_cache_timeout(10);
+	int const max_mtu_cache_size = 1000;
+
+	std::uint32_t socket_hash(udp::endpoint const& ep, std::uint16_t const id)
+	{
+		// FNV-1a over the address, port and connection ID
+		std::uint32_t h = 2166136261u;
+		auto mix = [&h](std::uint8_t const b) { h = (h ^ b) * 16777619u; };
+
+		if (ep.address().is_v6())
+		{
+			for (auto const b : ep.address().to_v6().to_bytes()) mix(b);
+		}
+		else
+		{
+			for (auto const b : ep.address().to_v4().to_bytes()) mix(b);
+		}
+		std::uint16_t const port = ep.port();
+		mix(std::uint8_t(port));
+		mix(std::uint8_t(port >> 8));
+		mix(std::uint8_t(id));
+		mix(std::uint8_t(id >> 8));
+		return h;
+	}
+}
+
+	utp_socket_impl* utp_socket_manager::find_socket(udp::endpoint const& ep
+		, std::uint16_t const id) const
+	{
+		if (m_socket_index.empty()) return nullptr;
+
+		std::uint32_t const h = socket_hash(ep, id);
+		std::size_t const mask = m_socket_index.size() - 1;
+		for (std::size_t i = h & mask;; i = (i + 1) & mask)
+		{
+			index_slot const& slot = m_socket_index[i];
+			if (slot.socket == nullptr) return nullptr;
+			if (slot.hash == h && utp_match(slot.socket, ep, id)) return slot.socket;
+		}
+	}
+
+	void utp_socket_manager::grow_index()
+	{
+		std::vector<index_slot> old(std::max(std::size_t(64), m_socket_index.size() * 2)
+			, index_slot{0, nullptr});
+		old.swap(m_socket_index);
+
+		std::size_t const mask = m_socket_index.size() - 1;
+		for (auto const& slot : old)
+		{
+			if (slot.socket == nullptr) continue;
+			std::size_t i = slot.hash & mask;
+			while (m_socket_index[i].socket != nullptr) i = (i + 1) & mask;
+			m_socket_index[i] = slot;
+		}
+	}
+
+	void utp_socket_manager::index_socket(utp_socket_impl* s)
+	{
+		udp::endpoint const ep = utp_remote_endpoint(s);
+		std::uint16_t const id = utp_receive_id(s);
+		TORRENT_ASSERT(find_socket(ep, id) != s);
+
+		// keep the load factor at or below 3/4
+		if ((m_num_indexed + 1) * 4 > int(m_socket_index.size()) * 3)
+			grow_index();
+
+		std::uint32_t const h = socket_hash(ep, id);
+		std::size_t const mask = m_socket_index.size() - 1;
+		std::size_t i = h & mask;
+		while (m_socket_index[i].socket != nullptr) i = (i + 1) & mask;
+		m_socket_index[i] = index_slot{h, s};
+		++m_num_indexed;
+	}
+
+	void utp_socket_manager::unindex_socket(utp_socket_impl* s)
+	{
+		if (m_socket_index.empty()) return;
+
+		std::uint32_t const h = socket_hash(utp_remote_endpoint(s), utp_receive_id(s));
+		std::size_t const mask = m_socket_index.size() - 1;
+		std::size_t i = h & mask;
+		for (;; i = (i + 1) & mask)
+		{
+			// the socket was never indexed
+			if (m_socket_index[i].socket == nullptr) return;
+			if (m_socket_index[i].socket == s) break;
+		}
+		--m_num_indexed;
+
+		// shift back any following entries that would no longer be
+		// reachable from their home slot, once this one is emptied
+		std::size_t j = i;
+		for (;;)
+		{
+			j = (j + 1) & mask;
+			index_slot const& slot = m_socket_index[j];
+			if (slot.socket == nullptr) break;
+			std::size_t const home = slot.hash & mask;
+			// the entry at j can move to i only if its home slot isn't in
+			// the (cyclic) range (i, j]
+			bool const stays = (i <= j)
+				? (i < home && home <= j)
+				: (i < home || home <= j);
+			if (stays) continue;
+			m_socket_index[i] = slot;
+			i = j;
+		}
+		m_socket_index[i] = index_slot{0, nullptr};
+	}
+
+	void utp_socket_manager::mtu_for_dest(address const& addr, int& link_mtu
+		, int& utp_mtu, int& utp_mtu_floor)
 	{
 		int mtu = 0;
 		if (is_teredo(addr)) mtu = TORRENT_TEREDO_MTU;
@@ -136,6 +256,60 @@ namespace libtorrent {
 		}
 
 		utp_mtu = std::min(mtu, restrict_mtu());
+		utp_mtu_floor = 0;
+
+		// if we've recently discovered the path MTU to this network, use that
+		auto const i = m_mtu_cache.find(mtu_cache_key(addr));
+		if (i == m_mtu_cache.end()) return;
+
+		if (aux::time_now() - i->second.updated > mtu_cache_timeout)
+		{
+			m_mtu_cache.erase(i);
+			return;
+		}
+
+		utp_mtu = std::min(utp_mtu, int(i->second.ceiling));
+		utp_mtu_floor = std::min(utp_mtu, int(i->second.floor));
+	}
+
+	utp_socket_manager::mtu_cache_key_t utp_socket_manager::mtu_cache_key(address const& addr)
+	{
+		// all addresses in the same /24 (IPv4) or /64 (IPv6) network are
+		// assumed to be on the same path
+#if TORRENT_USE_IPV6
+		if (addr.is_v6())
+		{
+			address_v6::bytes_type const b = addr.to_v6().to_bytes();
+			std::uint64_t prefix = 0;
+			for (int i = 0; i < 8; ++i) prefix = (prefix << 8) | b[std::size_t(i)];
+			return mtu_cache_key_t(true, prefix);
+		}
+#endif
+		return mtu_cache_key_t(false, addr.to_v4().to_ulong() >> 8);
+	}
+
+	void utp_socket_manager::update_mtu_cache(address const& addr
+		, int const mtu_floor, int const mtu_ceiling)
+	{
+		TORRENT_ASSERT(mtu_floor <= mtu_ceiling);
+
+		mtu_cache_key_t const key = mtu_cache_key(addr);
+		time_point const now = aux::time_now();
+		auto i = m_mtu_cache.find(key);
+		if (i == m_mtu_cache.end())
+		{
+			if (int(m_mtu_cache.size()) >= max_mtu_cache_size)
+			{
+				// evict the entry that was updated the longest time ago
+				m_mtu_cache.erase(std::min_element(m_mtu_cache.begin(), m_mtu_cache.end()
+					, [](mtu_cache_t::value_type const& lhs, mtu_cache_t::value_type const& rhs)
+					{ return lhs.second.updated < rhs.second.updated; }));
+			}
+			i = m_mtu_cache.insert(std::make_pair(key, mtu_cache_entry())).first;
+		}
+		i->second.floor = std::uint16_t(mtu_floor);
+		i->second.ceiling = std::uint16_t(mtu_ceiling);
+		i->second.updated = now;
 	}
 
 	void utp_socket_manager::send_packet(udp::endpoint const& ep, char const* p
@@ -152,6 +326,7 @@ namespace libtorrent {
 
 		m_send_fun(ep, {p, std::size_t(len)}, ec
 			, ((flags & dont_fragment) ? udp_socket::dont_fragment : 0)
+				| (m_batch_sends ? udp_socket::batch : 0)
 				| udp_socket::peer_connection);
 	}
 
@@ -182,14 +357,11 @@ namespace libtorrent {
 			return utp_incoming_packet(m_last_socket, p, ep, receive_time);
 		}
 
-		std::pair<socket_map_t::iterator, socket_map_t::iterator> r =
-			m_utp_sockets.equal_range(id);
-
-		for (; r.first != r.second; ++r.first)
+		utp_socket_impl* const s = find_socket(ep, id);
+		if (s != nullptr)
 		{
-			if (!utp_match(r.first->second, ep, id)) continue;
-			bool ret = utp_incoming_packet(r.first->second, p, ep, receive_time);
-			if (ret) m_last_socket = r.first->second;
+			bool ret = utp_incoming_packet(s, p, ep, receive_time);
+			if (ret) m_last_socket = s;
 			return ret;
 		}
 
@@ -227,9 +399,9 @@ namespace libtorrent {
 				str = c->get<utp_stream>();
 
 			TORRENT_ASSERT(str);
-			int link_mtu, utp_mtu;
-			mtu_for_dest(ep.address(), link_mtu, utp_mtu);
-			utp_init_mtu(str->get_impl(), link_mtu, utp_mtu);
+			int link_mtu, utp_mtu, utp_mtu_floor;
+			mtu_for_dest(ep.address(), link_mtu, utp_mtu, utp_mtu_floor);
+			utp_init_mtu(str->get_impl(), link_mtu, utp_mtu, utp_mtu_floor);
 			bool ret = utp_incoming_packet(str->get_impl(), p, ep, receive_time);
 			if (!ret) return false;
 			m_cb(c);
@@ -252,6 +424,68 @@ namespace libtorrent {
 		m_stalled_sockets.push_back(s);
 	}
 
+	void utp_socket_manager::subscribe_paced(utp_socket_impl* s
+		, time_point const when)
+	{
+		time_point const now = clock_type::now();
+		if (!m_pacing_timer_active) m_pacing_time = now;
+
+		// round up to the next slot, and never use the current one, since it
+		// may be the one being notified right now
+		std::int64_t const delay = (total_microseconds(when - m_pacing_time) + 999) / 1000;
+		int const slot = int(std::max(std::int64_t(1)
+			, std::min(delay, std::int64_t(pacing_wheel_size - 1))));
+
+		m_pacing_wheel[std::size_t((m_pacing_pos + slot) % pacing_wheel_size)].push_back(s);
+		++m_num_paced;
+
+		if (m_pacing_timer_active) return;
+		m_pacing_timer_active = true;
+		m_pacing_timer.expires_at(m_pacing_time + milliseconds(1));
+		m_pacing_timer.async_wait([this](error_code const& ec)
+		{
+			if (ec) return;
+			on_pacing_timer();
+		});
+	}
+
+	void utp_socket_manager::on_pacing_timer()
+	{
+		TORRENT_ASSERT(m_pacing_timer_active);
+		time_point const now = clock_type::now();
+
+		// if we fell behind by more than the whole wheel, there's no point
+		// in walking it more than once
+		if (now - m_pacing_time > milliseconds(pacing_wheel_size))
+			m_pacing_time = now - milliseconds(pacing_wheel_size);
+
+		while (m_num_paced > 0 && m_pacing_time + milliseconds(1) <= now)
+		{
+			m_pacing_pos = (m_pacing_pos + 1) % pacing_wheel_size;
+			m_pacing_time += milliseconds(1);
+
+			m_pacing_ready.clear();
+			m_pacing_ready.swap(m_pacing_wheel[std::size_t(m_pacing_pos)]);
+			m_num_paced -= int(m_pacing_ready.size());
+			for (auto const s : m_pacing_ready)
+				utp_pacing_ready(s);
+		}
+		TORRENT_ASSERT(m_num_paced >= 0);
+
+		if (m_num_paced == 0)
+		{
+			m_pacing_timer_active = false;
+			return;
+		}
+
+		m_pacing_timer.expires_at(m_pacing_time + milliseconds(1));
+		m_pacing_timer.async_wait([this](error_code const& ec)
+		{
+			if (ec) return;
+			on_pacing_timer();
+		});
+	}
+
 	void utp_socket_manager::writable()
 	{
 		if (!m_stalled_sockets.empty())
@@ -267,6 +501,9 @@ namespace libtorrent {
 
 	void utp_socket_manager::socket_drained()
 	{
+		// in case start_batch() wasn't called, at least queue the ACKs
+		m_batch_sends = true;
+
 		// flush all deferred acks
 
 		if (!m_deferred_acks.empty())
@@ -288,6 +525,9 @@ namespace libtorrent {
 				utp_socket_drained(s);
 			}
 		}
+
+		m_batch_sends = false;
+		if (m_flush_fun) m_flush_fun();
 	}
 
 	void utp_socket_manager::defer_ack(utp_socket_impl* s)
@@ -306,10 +546,12 @@ namespace libtorrent {
 
 	void utp_socket_manager::remove_socket(std::uint16_t id)
 	{
-		socket_map_t::iterator i = m_utp_sockets.find(id);
+		auto const i = std::find_if(m_utp_sockets.begin(), m_utp_sockets.end()
+			, [id](utp_socket_impl* s) { return utp_receive_id(s) == id; });
 		if (i == m_utp_sockets.end()) return;
-		delete_utp_impl(i->second);
-		if (m_last_socket == i->second) m_last_socket = nullptr;
+		unindex_socket(*i);
+		if (m_last_socket == *i) m_last_socket = nullptr;
+		delete_utp_impl(*i);
 		m_utp_sockets.erase(i);
 	}
 
@@ -338,7 +580,7 @@ namespace libtorrent {
 			recv_id = send_id - 1;
 		}
 		utp_socket_impl* impl = construct_utp_impl(recv_id, send_id, str, *this);
-		m_utp_sockets.insert(std::make_pair(recv_id, impl));
+		m_utp_sockets.push_back(impl);
 		return impl;
 	}
 }
@@ -41,8 +41,10 @@ POSSIBILITY OF SUCH DAMAGE.
 #include "libtorrent/invariant_check.hpp"
 #include "libtorrent/performance_counters.hpp"
 #include "libtorrent/io_service.hpp"
+#include "libtorrent/aux_/trace.hpp"
 #include <cstdint>
 #include <limits>
+#include <cmath>
 
 // the behavior of the sequence numbers as implemented by uTorrent is not
 // particularly regular. This switch indicates the odd parts.
@@ -154,6 +156,11 @@ enum
 	sack_resend_limit = 1
 };
 
+// the CUBIC multiplicative decrease factor and scaling constant (in MSS
+// per second cubed), as recommended by RFC 8312
+constexpr double cubic_beta = 0.7;
+constexpr double cubic_c = 0.4;
+
 // compare if lhs is less than rhs, taking wrapping
 // into account. if lhs is close to UINT_MAX and rhs
 // is close to 0, lhs is assumed to have wrapped and
@@ -220,6 +227,15 @@ bool compare_less_wrap(std::uint32_t lhs
 // simple to reuse the data structured and it provides all the
 // functionality needed for this buffer.
 
+// this means every received payload byte is copied once when there's a user
+// buffer (from the UDP receive buffer into it), and twice when there isn't
+// (into a packet, and from the packet into the user buffer once the next read
+// is issued). The packets in m_receive_buffer are not lent out to the user
+// instead. The bittorrent parser in peer_connection needs each message in
+// contiguous memory (the receive_buffer), and block payloads are received
+// directly into disk buffers. Both are copies either way, so handing out
+// packet buffers would not remove one.
+
 struct utp_socket_impl
 {
 	utp_socket_impl(std::uint16_t recv_id, std::uint16_t send_id
@@ -241,6 +257,8 @@ struct utp_socket_impl
 		, m_subscribe_drained(false)
 		, m_stalled(false)
 		, m_confirmed(false)
+		, m_cubic(false)
+		, m_paced(false)
 	{
 		m_sm.inc_stats_counter(counters::num_utp_idle);
 		TORRENT_ASSERT(m_userdata);
@@ -250,7 +268,12 @@ struct utp_socket_impl
 	~utp_socket_impl();
 
 	void tick(time_point now);
-	void init_mtu(int link_mtu, int utp_mtu);
+	// utp_mtu_floor is the largest packet size known to get through to the
+	// destination, or 0 if unknown
+	void init_mtu(int link_mtu, int utp_mtu, int utp_mtu_floor);
+	// sets m_remote_address and m_port, keeping the socket manager's
+	// index up to date
+	void set_remote_endpoint(udp::endpoint const& ep);
 	bool incoming_packet(span<std::uint8_t const> buf
 		, udp::endpoint const& ep, time_point receive_time);
 	void writable();
@@ -289,8 +312,15 @@ struct utp_socket_impl
 	std::uint32_t ack_packet(packet_ptr p, time_point const& receive_time
 		, std::uint16_t seq_nr);
 	void write_sack(std::uint8_t* buf, int size) const;
+	void detect_lost_packets();
 	void incoming(std::uint8_t const* buf, int size, packet_ptr p, time_point now);
+	// the congestion controllers. They are called for every ACK that
+	// acknowledges new bytes, and update m_cwnd. Which one is used is
+	// determined by m_cubic. On packet loss, experienced_loss() cuts
+	// the window according to the same controller.
 	void do_ledbat(int acked_bytes, int delay, int in_flight);
+	void do_cubic(int acked_bytes, int in_flight, time_point now);
+	void update_cwnd_full(int acked_bytes, int in_flight);
 	int packet_timeout() const;
 	bool test_socket_state();
 	void maybe_trigger_receive_callback();
@@ -424,6 +454,16 @@ public:
 	// the number of bytes we have buffered in m_inbuf
 	std::int32_t m_buffered_incoming_bytes = 0;
 
+	// the CUBIC congestion controller state. m_cubic_w_max is the
+	// congestion window (in bytes) at the last window reduction, and
+	// m_cubic_epoch is the start of the current congestion avoidance
+	// epoch (min_time() when it hasn't started yet). m_cubic_k is the time
+	// (in seconds) from the start of the epoch until the window is back at
+	// m_cubic_w_max
+	std::int32_t m_cubic_w_max = 0;
+	time_point m_cubic_epoch = min_time();
+	double m_cubic_k = 0.0;
+
 	// the timestamp diff in the last packet received
 	// this is what we'll send back
 	std::uint32_t m_reply_micro = 0;
@@ -508,6 +548,18 @@ public:
 	// to that packet's sequence number
 	std::uint16_t m_fast_resend_seq_nr = 0;
 
+	// the send time of the most recently sent packet that has been
+	// acknowledged, cumulatively or selectively. Any outstanding packet sent
+	// sufficiently long before this is considered lost (RACK style loss
+	// detection). Only packets that were sent once are considered, since the
+	// ACK of a re-sent packet is ambiguous
+	time_point m_rack_xmit_time = min_time();
+
+	// when send pacing is enabled, this is the earliest time the next
+	// payload packet may be sent. It's advanced by the packet size divided
+	// by the pacing rate (cwnd / rtt) every time a payload packet goes out
+	time_point m_next_send_time = min_time();
+
 	// this is the sequence number of the FIN packet
 	// we've received. This sequence number is only
 	// valid if m_eof is true. We should not accept
@@ -639,6 +691,15 @@ public:
 	// packet for this connection with a correct ack_nr, confirming that the
 	// other end is not spoofing its source IP
 	bool m_confirmed:1;
+
+	// when set, the CUBIC congestion controller is used instead of LEDBAT.
+	// It's set based on the peer classes of the connection
+	bool m_cubic:1;
+
+	// this is true while the socket is waiting in the utp socket manager's
+	// pacing timer wheel to be allowed to send its next payload packet. Just
+	// like m_stalled, the socket may not be deleted while this is set
+	bool m_paced:1;
 };
 
 utp_socket_impl* construct_utp_impl(std::uint16_t recv_id
@@ -668,9 +729,9 @@ void tick_utp_impl(utp_socket_impl* s, time_point now)
 	s->tick(now);
 }
 
-void utp_init_mtu(utp_socket_impl* s, int link_mtu, int utp_mtu)
+void utp_init_mtu(utp_socket_impl* s, int link_mtu, int utp_mtu, int utp_mtu_floor)
 {
-	s->init_mtu(link_mtu, utp_mtu);
+	s->init_mtu(link_mtu, utp_mtu, utp_mtu_floor);
 }
 
 bool utp_incoming_packet(utp_socket_impl* s
@@ -705,6 +766,13 @@ void utp_writable(utp_socket_impl* s)
 	s->writable();
 }
 
+void utp_pacing_ready(utp_socket_impl* s)
+{
+	TORRENT_ASSERT(s->m_paced);
+	s->m_paced = false;
+	s->writable();
+}
+
 void utp_send_ack(utp_socket_impl* s)
 {
 	TORRENT_ASSERT(s->m_deferred_ack);
@@ -738,6 +806,9 @@ void utp_socket_impl::update_mtu_limits()
 	UTP_LOGV("%8p: updating MTU to: %d [%d, %d]\n"
 		, static_cast<void*>(this), m_mtu, m_mtu_floor, m_mtu_ceiling);
 
+	// let new sockets to the same network start where we are
+	m_sm.update_mtu_cache(m_remote_address, m_mtu_floor, m_mtu_ceiling);
+
 	// clear the mtu probe sequence number since
 	// it was either dropped or acked
 	m_mtu_seq = 0;
@@ -748,6 +819,14 @@ int utp_socket_state(utp_socket_impl const* s)
 	return s->m_state;
 }
 
+void utp_stream::set_cubic(bool const cubic)
+{
+	if (!m_impl || m_impl->m_cubic == cubic) return;
+	m_impl->m_cubic = cubic;
+	m_impl->m_cubic_epoch = min_time();
+	m_impl->m_cubic_w_max = 0;
+}
+
 int utp_stream::send_delay() const
 {
 	return m_impl ? m_impl->m_send_delay : 0;
@@ -1098,12 +1177,11 @@ void utp_stream::issue_write()
 
 void utp_stream::do_connect(tcp::endpoint const& ep)
 {
-	int link_mtu, utp_mtu;
-	m_impl->m_sm.mtu_for_dest(ep.address(), link_mtu, utp_mtu);
-	m_impl->init_mtu(link_mtu, utp_mtu);
+	int link_mtu, utp_mtu, utp_mtu_floor;
+	m_impl->m_sm.mtu_for_dest(ep.address(), link_mtu, utp_mtu, utp_mtu_floor);
+	m_impl->init_mtu(link_mtu, utp_mtu, utp_mtu_floor);
 	TORRENT_ASSERT(m_impl->m_connect_handler == false);
-	m_impl->m_remote_address = ep.address();
-	m_impl->m_port = ep.port();
+	m_impl->set_remote_endpoint(udp::endpoint(ep.address(), ep.port()));
 
 	m_impl->m_connect_handler = true;
 
@@ -1163,7 +1241,7 @@ bool utp_socket_impl::should_delete() const
 	// the pointer is removed from that queue. Otherwise we would
 	// leave a dangling pointer in the socket manager
 	bool ret = (m_state >= UTP_STATE_ERROR_WAIT || m_state == UTP_STATE_NONE)
-		&& !m_attached && !m_stalled;
+		&& !m_attached && !m_stalled && !m_paced;
 
 	if (ret)
 	{
@@ -1747,6 +1825,28 @@ bool utp_socket_impl::send_pkt(int const flags)
 		}
 	}
 
+	// send pacing. Spread the payload packets out evenly over the round
+	// trip time instead of sending the whole window in a burst every time an
+	// ACK opens it up. ACKs and FINs are never held back
+	if (payload_size > 0
+		&& (flags & pkt_fin) == 0
+		&& m_sm.send_pacing()
+		&& clock_type::now() < m_next_send_time)
+	{
+		payload_size = 0;
+
+		if (!m_paced)
+		{
+			m_paced = true;
+			m_sm.subscribe_paced(this, m_next_send_time);
+		}
+
+		UTP_LOGV("%8p: pacing, next send in %d us\n", static_cast<void*>(this)
+			, int(total_microseconds(m_next_send_time - clock_type::now())));
+
+		if (!force) return false;
+	}
+
 	// if we don't have any data to send, or can't send any data
 	// and we don't have any data to force, don't send a packet
 	if (payload_size == 0 && !force && !m_nagle_packet)
@@ -1940,6 +2040,8 @@ bool utp_socket_impl::send_pkt(int const flags)
 
 	++m_out_packets;
 	m_sm.inc_stats_counter(counters::utp_packets_out);
+	aux::trace(aux::trace_event::utp_send, std::uint16_t(h->seq_nr)
+		, std::uint64_t(p->size));
 
 	if (ec == error::message_size)
 	{
@@ -2025,6 +2127,21 @@ bool utp_socket_impl::send_pkt(int const flags)
 		m_seq_nr = (m_seq_nr + 1) & ACK_MASK;
 		TORRENT_ASSERT(payload_size >= 0);
 		m_bytes_in_flight += new_in_flight;
+
+		if (m_sm.send_pacing())
+		{
+			// the pacing rate is cwnd / rtt, with some gain to let the window
+			// grow. We allow falling behind by a couple of milliseconds, to
+			// catch up after the timer wakeup
+			std::int64_t const cwnd = std::max(std::int64_t(m_cwnd >> 16)
+				, std::int64_t(m_mtu_floor));
+			std::int64_t const rtt_us = std::max(1, m_rtt.mean()) * 1000;
+			int const gain_percent = m_slow_start ? 200 : 125;
+			std::int64_t const interval = std::int64_t(packet_size) * rtt_us * 100
+				/ (cwnd * gain_percent);
+			m_next_send_time = std::max(m_next_send_time, now - milliseconds(2))
+				+ microseconds(interval);
+		}
 	}
 	else
 	{
@@ -2034,7 +2151,7 @@ bool utp_socket_impl::send_pkt(int const flags)
 	// if the socket is stalled, always return false, don't
 	// try to write more packets. We'll keep writing once
 	// the underlying UDP socket becomes writable
-	return m_write_buffer_size > 0 && !m_cwnd_full && !m_stalled;
+	return m_write_buffer_size > 0 && !m_cwnd_full && !m_stalled && !m_paced;
 }
 
 // size is in bytes
@@ -2139,6 +2256,8 @@ bool utp_socket_impl::resend_packet(packet* p, bool fast_resend)
 		, reinterpret_cast<char const*>(p->buf), p->size, ec);
 	++m_out_packets;
 	m_sm.inc_stats_counter(counters::utp_packets_out);
+	aux::trace(aux::trace_event::utp_resend, std::uint16_t(h->seq_nr)
+		, std::uint64_t(p->size));
 
 
 #if TORRENT_UTP_LOG
@@ -2197,9 +2316,26 @@ void utp_socket_impl::experienced_loss(std::uint32_t const seq_nr)
 	// same packet again, ignore it.
 	if (compare_less_wrap(seq_nr, m_loss_seq_nr + 1, ACK_MASK)) return;
 
-	// cut window size in 2
-	m_cwnd = std::max(m_cwnd * m_sm.loss_multiplier() / 100
-		, std::int64_t(m_mtu) * (1 << 16));
+	if (m_cubic)
+	{
+		// remember where we lost the packet, and start a new epoch growing
+		// back towards it. If the window didn't make it back to the
+		// previous maximum, we're likely competing for the link, release
+		// some more bandwidth (fast convergence)
+		std::int32_t const cwnd = std::int32_t(m_cwnd >> 16);
+		m_cubic_w_max = (cwnd < m_cubic_w_max)
+			? std::int32_t(cwnd * (1.0 + cubic_beta) / 2.0)
+			: cwnd;
+		m_cubic_epoch = min_time();
+		m_cwnd = std::max(std::int64_t(m_cwnd * cubic_beta)
+			, std::int64_t(m_mtu) * (1 << 16));
+	}
+	else
+	{
+		// cut window size in 2
+		m_cwnd = std::max(m_cwnd * m_sm.loss_multiplier() / 100
+			, std::int64_t(m_mtu) * (1 << 16));
+	}
 	m_loss_seq_nr = m_seq_nr;
 	UTP_LOGV("%8p: Lost packet %d caused cwnd cut\n", static_cast<void*>(this), seq_nr);
 
@@ -2302,10 +2438,66 @@ std::uint32_t utp_socket_impl::ack_packet(packet_ptr p, time_point const& receiv
 		, static_cast<void*>(this), seq_nr, p->size - p->header_size, rtt / 1000);
 
 	m_rtt.add_sample(rtt / 1000);
+
+	if (p->num_transmissions <= 1 && p->send_time > m_rack_xmit_time)
+		m_rack_xmit_time = p->send_time;
+
 	release_packet(std::move(p));
 	return rtt;
 }
 
+void utp_socket_impl::detect_lost_packets()
+{
+	INVARIANT_CHECK;
+
+	if (m_rack_xmit_time == min_time()) return;
+
+	// allow for some reordering of packets before we consider one lost
+	time_duration const reorder_window = milliseconds(std::max(1, m_rtt.mean() / 4));
+	time_point const threshold = m_rack_xmit_time - reorder_window;
+
+	int first_lost = -1;
+	for (int i = (m_acked_seq_nr + 1) & ACK_MASK; i != m_seq_nr; i = (i + 1) & ACK_MASK)
+	{
+		packet* p = m_outbuf.at(aux::numeric_cast<packet_buffer::index_type>(i));
+		if (!p || p->need_resend || p->num_transmissions == 0) continue;
+
+		if (p->send_time >= threshold)
+		{
+			// packets are first sent in sequence number order, so any later
+			// packet that hasn't been re-sent was sent even later than this
+			if (p->num_transmissions == 1) break;
+			continue;
+		}
+
+		// this packet has been re-sent too many times already, leave it
+		// for the timeout logic to fail the connection
+		if (p->num_transmissions >= m_sm.num_resends()) continue;
+
+		// a packet sent later than this one has been ACKed. This one is lost
+		p->need_resend = true;
+		TORRENT_ASSERT(m_bytes_in_flight >= p->size - p->header_size);
+		m_bytes_in_flight -= p->size - p->header_size;
+		if (first_lost == -1) first_lost = i;
+		UTP_LOGV("%8p: Packet %d lost (sent %d us before last ACKed packet).\n"
+			, static_cast<void*>(this), i, int(total_microseconds(m_rack_xmit_time - p->send_time)));
+	}
+
+	if (first_lost == -1) return;
+
+	experienced_loss(std::uint32_t(first_lost));
+
+	// re-send as many of the lost packets as the (now smaller) congestion
+	// window allows. The rest are re-sent by send_pkt() as the window opens
+	for (int i = first_lost; i != m_seq_nr; i = (i + 1) & ACK_MASK)
+	{
+		packet* p = m_outbuf.at(aux::numeric_cast<packet_buffer::index_type>(i));
+		if (!p || !p->need_resend) continue;
+		m_sm.inc_stats_counter(counters::utp_fast_retransmit);
+		if (!resend_packet(p)) break;
+	}
+}
+
 void utp_socket_impl::incoming(std::uint8_t const* buf, int size, packet_ptr p
 	, time_point /* now */)
 {
@@ -2541,7 +2733,16 @@ bool utp_socket_impl::test_socket_state()
 	return false;
 }
 
-void utp_socket_impl::init_mtu(int link_mtu, int utp_mtu)
+void utp_socket_impl::set_remote_endpoint(udp::endpoint const& ep)
+{
+	if (m_remote_address == ep.address() && m_port == ep.port()) return;
+	m_sm.unindex_socket(this);
+	m_remote_address = ep.address();
+	m_port = ep.port();
+	m_sm.index_socket(this);
+}
+
+void utp_socket_impl::init_mtu(int link_mtu, int utp_mtu, int const utp_mtu_floor)
 {
 	INVARIANT_CHECK;
 
@@ -2557,6 +2758,11 @@ void utp_socket_impl::init_mtu(int link_mtu, int utp_mtu)
 	// set the ceiling to what we found out from the interface
 	m_mtu_ceiling = std::uint16_t(utp_mtu);
 
+	// if other sockets have already discovered that larger packets make it
+	// through, start from there
+	if (utp_mtu_floor > m_mtu_floor)
+		m_mtu_floor = std::uint16_t(std::min(utp_mtu_floor, utp_mtu));
+
 	// start in the middle of the PMTU search space
 	m_mtu = (m_mtu_ceiling + m_mtu_floor) / 2;
 	if (m_mtu > m_mtu_ceiling) m_mtu = m_mtu_ceiling;
@@ -2579,6 +2785,8 @@ bool utp_socket_impl::incoming_packet(span<std::uint8_t const> buf
 	utp_header const* ph = reinterpret_cast<utp_header const*>(buf.data());
 
 	m_sm.inc_stats_counter(counters::utp_packets_in);
+	aux::trace(aux::trace_event::utp_receive, std::uint16_t(ph->seq_nr)
+		, buf.size());
 
 	if (ph->get_version() != 1)
 	{
@@ -2607,8 +2815,7 @@ bool utp_socket_impl::incoming_packet(span<std::uint8_t const> buf
 
 	if (m_state == UTP_STATE_NONE && ph->get_type() == ST_SYN)
 	{
-		m_remote_address = ep.address();
-		m_port = ep.port();
+		set_remote_endpoint(ep);
 	}
 
 	if (m_state != UTP_STATE_NONE && ph->get_type() == ST_SYN)
@@ -2856,7 +3063,9 @@ bool utp_socket_impl::incoming_packet(span<std::uint8_t const> buf
 			case utp_sack: // selective ACKs
 			{
 				std::uint32_t rtt;
-				std::tie(rtt, acked_bytes) = parse_sack(ph->ack_nr, ptr, len, receive_time);
+				int sacked_bytes;
+				std::tie(rtt, sacked_bytes) = parse_sack(ph->ack_nr, ptr, len, receive_time);
+				acked_bytes += sacked_bytes;
 				min_rtt = std::min(min_rtt, rtt);
 				break;
 			}
@@ -2895,6 +3104,11 @@ bool utp_socket_impl::incoming_packet(span<std::uint8_t const> buf
 		}
 	}
 
+	// any outstanding packet sent well before one that was just ACKed is
+	// considered lost, without waiting for duplicate ACKs or a timeout
+	detect_lost_packets();
+	if (m_state == UTP_STATE_ERROR_WAIT || m_state == UTP_STATE_DELETE) return true;
+
 	// ptr points to the payload of the packet
 	// size is the packet size, payload is the
 	// number of payload bytes are in this packet
@@ -2960,8 +3174,7 @@ bool utp_socket_impl::incoming_packet(span<std::uint8_t const> buf
 				// we accept are SYN packets.
 				set_state(UTP_STATE_CONNECTED);
 
-				m_remote_address = ep.address();
-				m_port = ep.port();
+				set_remote_endpoint(ep);
 
 				m_ack_nr = ph->seq_nr;
 				m_seq_nr = std::uint16_t(random(0xffff));
@@ -3038,7 +3251,10 @@ bool utp_socket_impl::incoming_packet(span<std::uint8_t const> buf
 				// sure to clamp it as a sanity check
 				if (delay > min_rtt) delay = min_rtt;
 
-				do_ledbat(acked_bytes, int(delay), prev_bytes_in_flight);
+				if (m_cubic)
+					do_cubic(acked_bytes, prev_bytes_in_flight, receive_time);
+				else
+					do_ledbat(acked_bytes, int(delay), prev_bytes_in_flight);
 				m_send_delay = std::int32_t(delay);
 			}
 
@@ -3314,6 +3530,7 @@ void utp_socket_impl::do_ledbat(const int acked_bytes, const int delay
 	{
 		m_sm.inc_stats_counter(counters::utp_samples_below_target);
 	}
+	m_sm.inc_stats_counter(counters::utp_queuing_delay, delay);
 
 	std::int64_t linear_gain = (window_factor * delay_factor) >> 16;
 	linear_gain *= std::int64_t(m_sm.gain_factor());
@@ -3377,6 +3594,91 @@ void utp_socket_impl::do_ledbat(const int acked_bytes, const int delay
 
 	TORRENT_ASSERT(m_cwnd >= 0);
 
+	update_cwnd_full(acked_bytes, in_flight);
+}
+
+void utp_socket_impl::do_cubic(int const acked_bytes, int const in_flight
+	, time_point const now)
+{
+	INVARIANT_CHECK;
+
+	TORRENT_ASSERT(in_flight > 0);
+	TORRENT_ASSERT(acked_bytes > 0);
+
+	// just like LEDBAT, don't grow the window unless we're limited by it
+	const bool cwnd_saturated = (m_bytes_in_flight + acked_bytes + m_mtu > (m_cwnd >> 16));
+
+	if (cwnd_saturated)
+	{
+		double const cwnd = double(m_cwnd) / (1 << 16);
+		double target;
+
+		if (m_slow_start && (m_ssthres == 0 || cwnd + acked_bytes <= m_ssthres))
+		{
+			target = cwnd + acked_bytes;
+		}
+		else
+		{
+			if (m_slow_start)
+			{
+				m_slow_start = false;
+				UTP_LOGV("%8p: cwnd > ssthres (%d) slow_start -> 0\n"
+					, static_cast<void*>(this), m_ssthres);
+			}
+
+			double const mss = std::max(1, int(m_mtu));
+			if (m_cubic_epoch == min_time())
+			{
+				m_cubic_epoch = now;
+				if (m_cubic_w_max <= cwnd)
+				{
+					m_cubic_k = 0.0;
+					m_cubic_w_max = std::int32_t(cwnd);
+				}
+				else
+				{
+					m_cubic_k = std::cbrt((m_cubic_w_max - cwnd) / mss / cubic_c);
+				}
+			}
+
+			double const rtt = std::max(1, m_rtt.mean()) / 1000.0;
+			double const t = total_microseconds(now - m_cubic_epoch) / 1000000.0;
+
+			// the cubic function, evaluated one RTT ahead
+			double const dt = t + rtt - m_cubic_k;
+			double const w_cubic = m_cubic_w_max + cubic_c * dt * dt * dt * mss;
+
+			// the window a TCP (Reno) flow would have grown to over the same
+			// time. On short RTT links this is what grows the window
+			double const w_est = m_cubic_w_max * cubic_beta
+				+ 3.0 * (1.0 - cubic_beta) / (1.0 + cubic_beta) * (t / rtt) * mss;
+
+			target = std::max(w_cubic, w_est);
+
+			// grow towards the target over the next RTT, but never faster
+			// than slow-start
+			if (target > cwnd)
+				target = cwnd + std::min(double(acked_bytes), (target - cwnd) * acked_bytes / cwnd);
+			else
+				target = cwnd;
+		}
+
+		std::int64_t const new_cwnd = std::int64_t(target * (1 << 16));
+		if (new_cwnd > m_cwnd && new_cwnd < (std::numeric_limits<std::int64_t>::max)() / 2)
+			m_cwnd = new_cwnd;
+	}
+
+	UTP_LOGV("%8p: do_cubic w_max:%d K:%f cwnd:%d slow_start:%d\n"
+		, static_cast<void*>(this), m_cubic_w_max, m_cubic_k, int(m_cwnd >> 16)
+		, int(m_slow_start));
+
+	TORRENT_ASSERT(m_cwnd >= 0);
+
+	update_cwnd_full(acked_bytes, in_flight);
+}
+
+void utp_socket_impl::update_cwnd_full(int const acked_bytes, int const in_flight)
+{
 	int window_size_left = std::min(int(m_cwnd >> 16), int(m_adv_wnd)) - in_flight + acked_bytes;
 	if (window_size_left >= m_mtu)
 	{
@@ -3499,6 +3801,11 @@ void utp_socket_impl::tick(time_point now)
 		{
 			// we timed out because a packet was not ACKed or because
 			// the cwnd was made smaller than one packet
+			if (m_cubic)
+			{
+				m_cubic_w_max = std::max(m_cubic_w_max, std::int32_t(m_cwnd >> 16));
+				m_cubic_epoch = min_time();
+			}
 			m_cwnd = std::int64_t(m_mtu) * (1 << 16);
 		}
 
@@ -0,0 +1,102 @@
+/*
+
+Copyright (c) 2017, Arvid Norberg
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions
+are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in
+      the documentation and/or other materials provided with the distribution.
+    * Neither the name of the author nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+#include "libtorrent/aux_/verify_order.hpp"
+#include "libtorrent/assert.hpp"
+
+#include <algorithm>
+
+namespace libtorrent { namespace aux {
+
+	constexpr int verify_order::window;
+	constexpr int verify_order::max_hints;
+
+	void verify_order::requested(piece_index_t const piece, int const num_pieces)
+	{
+		piece_index_t const n = next(piece);
+		if (static_cast<int>(n) >= num_pieces) return;
+
+		// peers request many blocks of the same piece in a row
+		if (!m_hints.empty() && m_hints.front() == n) return;
+
+		auto const i = std::find(m_hints.begin(), m_hints.end(), n);
+		if (i != m_hints.end()) m_hints.erase(i);
+		m_hints.push_front(n);
+		if (int(m_hints.size()) > max_hints) m_hints.pop_back();
+	}
+
+	piece_index_t verify_order::pick(int const num_pieces
+		, std::function<bool(piece_index_t)> const& candidate
+		, std::function<int(piece_index_t)> const& score)
+	{
+		while (!m_hints.empty())
+		{
+			piece_index_t const p = m_hints.front();
+			m_hints.pop_front();
+			if (static_cast<int>(p) < num_pieces && candidate(p)) return p;
+		}
+
+		if (num_pieces <= 0) return piece_index_t(-1);
+		if (static_cast<int>(m_cursor) >= num_pieces) m_cursor = piece_index_t(0);
+
+		piece_index_t best(-1);
+		int best_score = 0;
+		int found = 0;
+		piece_index_t p = m_cursor;
+		for (int i = 0; i < num_pieces && found < window; ++i)
+		{
+			if (candidate(p))
+			{
+				// the pieces before the first candidate don't need to be
+				// looked at again
+				if (found == 0) m_cursor = p;
+				int const s = score(p);
+				if (found == 0 || s > best_score)
+				{
+					best = p;
+					best_score = s;
+				}
+				++found;
+			}
+			++p;
+			if (static_cast<int>(p) == num_pieces) p = piece_index_t(0);
+		}
+		return best;
+	}
+
+	void verify_order::clear()
+	{
+		m_hints.clear();
+		m_cursor = piece_index_t(0);
+	}
+
+}}
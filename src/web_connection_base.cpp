@@ -50,7 +50,7 @@ namespace libtorrent {
 		, m_ssl(false)
 		, m_external_auth(web.auth)
 		, m_extra_headers(web.extra_headers)
-		, m_parser(http_parser::dont_parse_chunks)
+		, m_parser(http_parser::dont_parse_chunks | http_parser::known_headers_only)
 		, m_body_start(0)
 	{
 		TORRENT_ASSERT(&web.peer_info == pack.peerinfo);
@@ -88,6 +88,15 @@ web_peer_connection::web_peer_connection(peer_connection_args const& pack
 
 	prefer_contiguous_blocks(preferred_size / tor->block_size());
 
+	// keep a few pieces worth of requests outstanding, to not wait for a
+	// round-trip between each of them. Requests are only pipelined on
+	// connections to servers that support keep-alive
+	if (web.supports_keepalive)
+	{
+		min_desired_queue_size(m_settings.get_int(settings_pack::urlseed_pipeline_size)
+			* tor->torrent_file().piece_length() / tor->block_size());
+	}
+
 	std::shared_ptr<torrent> t = associated_torrent().lock();
 	bool const single_file_request = t->torrent_file().num_files() == 1;
 
@@ -474,7 +483,7 @@ namespace {
 		std::string ret = "URL seed @ ";
 		ret += host;
 
-		std::string const& server_version = p.header("server");
+		std::string const& server_version = p.header(http_parser::server_header);
 		if (!server_version.empty())
 		{
 			ret += " (";
@@ -578,13 +587,13 @@ void web_peer_connection::handle_error(int const bytes_left)
 	// associated with the file we just requested. Only
 	// when it doesn't have any of the file do the following
 	// pad files will make it complicated
-	int retry_time = atoi(m_parser.header("retry-after").c_str());
+	int retry_time = atoi(m_parser.header(http_parser::retry_after_header).c_str());
 	if (retry_time <= 0) retry_time = m_settings.get_int(settings_pack::urlseed_wait_retry);
 	// temporarily unavailable, retry later
 	t->retry_web_seed(this, retry_time);
 	std::string error_msg = to_string(m_parser.status_code()).data()
 		+ (" " + m_parser.message());
-	if (t->alerts().should_post<url_seed_alert>())
+	if (should_post<url_seed_alert>())
 	{
 		t->alerts().emplace_alert<url_seed_alert>(t->get_handle(), m_url
 			, error_msg);
@@ -598,7 +607,7 @@ void web_peer_connection::handle_redirect(int const bytes_left)
 {
 	// this means we got a redirection request
 	// look for the location header
-	std::string location = m_parser.header("location");
+	std::string location = m_parser.header(http_parser::location_header);
 	received_bytes(0, bytes_left);
 
 	std::shared_ptr<torrent> t = associated_torrent().lock();
@@ -791,9 +800,14 @@ void web_peer_connection::on_receive(error_code const& error
 			{
 				peer_log(peer_log_alert::info, "STATUS"
 					, "%d %s", m_parser.status_code(), m_parser.message().c_str());
-				std::multimap<std::string, std::string> const& headers = m_parser.headers();
-				for (auto const &i : headers)
-					peer_log(peer_log_alert::info, "STATUS", "   %s: %s", i.first.c_str(), i.second.c_str());
+				for (int i = 0; i < http_parser::num_known_headers; ++i)
+				{
+					auto const h = static_cast<http_parser::known_header_t>(i);
+					std::string const& value = m_parser.header(h);
+					if (value.empty()) continue;
+					peer_log(peer_log_alert::info, "STATUS", "   %s: %s"
+						, http_parser::known_header_name(h), value.c_str());
+				}
 			}
 #endif
 
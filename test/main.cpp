@@ -49,6 +49,8 @@ POSSIBILITY OF SUCH DAMAGE.
 #include "libtorrent/random.hpp"
 #include "libtorrent/aux_/escape_string.hpp"
 #include <csignal>
+#include <atomic>
+#include <new>
 
 #ifdef _WIN32
 #include <windows.h> // fot SetErrorMode
@@ -80,6 +82,9 @@ bool keep_files = false;
 // the current tests file descriptor
 unit_test_t* current_test = nullptr;
 
+// the number of calls to operator new, made by any thread
+std::atomic<std::int64_t> allocations(0);
+
 void output_test_log_to_terminal()
 {
 	if (current_test == nullptr
@@ -243,6 +248,49 @@ void change_directory(std::string const& f, error_code& ec)
 
 } // anonymous namespace
 
+std::int64_t EXPORT num_allocations()
+{
+	return allocations.load(std::memory_order_relaxed);
+}
+
+// these replace the global allocation functions, to let tests assert on the
+// number of allocations made by a piece of code. Only new and delete are
+// counted, memory allocated with malloc() directly is not
+void* operator new(std::size_t size)
+{
+	allocations.fetch_add(1, std::memory_order_relaxed);
+	if (size == 0) size = 1;
+	for (;;)
+	{
+		void* ret = std::malloc(size);
+		if (ret != nullptr) return ret;
+		std::new_handler const handler = std::get_new_handler();
+		if (handler == nullptr) throw std::bad_alloc();
+		handler();
+	}
+}
+
+void* operator new[](std::size_t size)
+{
+	return ::operator new(size);
+}
+
+void* operator new(std::size_t size, std::nothrow_t const&) noexcept
+{
+	try { return ::operator new(size); }
+	catch (std::bad_alloc const&) { return nullptr; }
+}
+
+void* operator new[](std::size_t size, std::nothrow_t const&) noexcept
+{
+	return ::operator new(size, std::nothrow);
+}
+
+void operator delete(void* ptr) noexcept { std::free(ptr); }
+void operator delete[](void* ptr) noexcept { std::free(ptr); }
+void operator delete(void* ptr, std::nothrow_t const&) noexcept { std::free(ptr); }
+void operator delete[](void* ptr, std::nothrow_t const&) noexcept { std::free(ptr); }
+
 struct unit_directory_guard
 {
 	std::string dir;
@@ -74,6 +74,12 @@ void EXPORT report_failure(char const* err, char const* file, int line);
 int EXPORT print_failures();
 int EXPORT test_counter();
 
+// returns the number of times the global operator new has been called by
+// any thread in this process. The test harness replaces operator new to
+// count allocations. On platforms where the replacement doesn't take effect
+// (e.g. when the harness is a DLL on windows), this never changes
+std::int64_t EXPORT num_allocations();
+
 typedef void (*unit_test_fun_t)();
 
 struct unit_test_t
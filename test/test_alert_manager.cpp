@@ -236,6 +236,40 @@ TORRENT_TEST(wait_for_alert)
 	posting_thread.join();
 }
 
+void post_many(alert_manager* mgr, int const num)
+{
+	for (int i = 0; i < num; ++i)
+		mgr->emplace_alert<torrent_finished_alert>(torrent_handle());
+}
+
+TORRENT_TEST(concurrent_post)
+{
+	int const num = 100000;
+	alert_manager mgr(num, 0xffffffff);
+
+	std::thread posting_thread(&post_many, &mgr, num);
+
+	// pop alerts while they are being posted. None may be lost or handed
+	// out twice
+	int received = 0;
+	std::vector<alert*> alerts;
+	time_point const start = clock_type::now();
+	while (received < num && clock_type::now() - start < seconds(20))
+	{
+		mgr.wait_for_alert(milliseconds(100));
+		mgr.get_all(alerts);
+		for (auto const a : alerts)
+			TEST_EQUAL(a->type(), torrent_finished_alert::alert_type);
+		received += int(alerts.size());
+	}
+	posting_thread.join();
+
+	mgr.get_all(alerts);
+	received += int(alerts.size());
+	TEST_EQUAL(received, num);
+	TEST_EQUAL(mgr.pending(), false);
+}
+
 TORRENT_TEST(alert_mask)
 {
 	alert_manager mgr(100, 0xffffffff);
@@ -249,3 +283,20 @@ TORRENT_TEST(alert_mask)
 	TEST_CHECK(!mgr.should_post<torrent_paused_alert>());
 }
 
+
+TORRENT_TEST(extra_alert_mask)
+{
+	alert_manager mgr(100, alert::error_notification);
+
+	TEST_CHECK(!mgr.should_post<block_finished_alert>());
+	TEST_CHECK(!mgr.should_post<peer_log_alert>());
+
+	// a torrent or peer may enable additional categories for alerts posted
+	// on its behalf
+	TEST_CHECK(mgr.should_post<block_finished_alert>(alert::progress_notification));
+	TEST_CHECK(!mgr.should_post<peer_log_alert>(alert::progress_notification));
+	TEST_CHECK(mgr.should_post<peer_log_alert>(alert::peer_log_notification));
+
+	// the session's mask still applies
+	TEST_CHECK(mgr.should_post<torrent_error_alert>(alert::peer_log_notification));
+}
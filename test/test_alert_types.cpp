@@ -160,10 +160,18 @@ TORRENT_TEST(alerts_types)
 	TEST_ALERT_TYPE(session_error_alert, 90, 0, alert::error_notification);
 	TEST_ALERT_TYPE(dht_live_nodes_alert, 91, 0, alert::dht_notification);
 	TEST_ALERT_TYPE(session_stats_header_alert, 92, 0, alert::stats_notification);
+	TEST_ALERT_TYPE(piece_arrival_alert, 93, 0, alert::progress_notification);
+	TEST_ALERT_TYPE(dht_sample_infohashes_alert, 94, 0, alert::dht_operation_notification);
+	TEST_ALERT_TYPE(session_stats_delta_alert, 95, 1, alert::stats_notification);
+	TEST_ALERT_TYPE(network_stall_alert, 96, 0, alert::performance_warning);
+	TEST_ALERT_TYPE(peer_info_alert, 97, 1, alert::status_notification);
+	TEST_ALERT_TYPE(file_progress_alert, 98, 1, alert::status_notification);
+	TEST_ALERT_TYPE(piece_priorities_alert, 99, 1, alert::status_notification);
+	TEST_ALERT_TYPE(peer_sample_alert, 100, 0, alert::stats_notification);
 
 #undef TEST_ALERT_TYPE
 
-	TEST_EQUAL(num_alert_types, 93);
+	TEST_EQUAL(num_alert_types, 101);
 	TEST_EQUAL(num_alert_types, count_alert_types);
 }
 
@@ -1302,3 +1302,46 @@ TORRENT_TEST(switch_buffer)
 	TEST_EQUAL(string1, string2);
 }
 
+
+// repeated lookups in large dictionaries use a sorted index of the keys
+TORRENT_TEST(dict_find_index)
+{
+	// keys out of order, and one duplicate (the first one should win)
+	std::string b = "d";
+	for (int i = 39; i >= 0; --i)
+	{
+		char key[10];
+		std::snprintf(key, sizeof(key), "k%02d", i);
+		b += "3:";
+		b += key;
+		b += "i" + std::to_string(i) + "e";
+	}
+	b += "3:k07i100ee";
+
+	error_code ec;
+	bdecode_node e = bdecode(b, ec);
+	TEST_CHECK(!ec);
+	TEST_EQUAL(e.dict_size(), 41);
+
+	for (int round = 0; round < 3; ++round)
+	{
+		for (int i = 0; i < 40; ++i)
+		{
+			char key[10];
+			std::snprintf(key, sizeof(key), "k%02d", i);
+			TEST_EQUAL(e.dict_find_int_value(key, -1), i);
+		}
+		TEST_CHECK(!e.dict_find("k40"));
+		TEST_CHECK(!e.dict_find("a"));
+		TEST_CHECK(!e.dict_find("z"));
+		TEST_CHECK(!e.dict_find(""));
+	}
+
+	// copies keep working, and so does switching the buffer
+	bdecode_node e2 = e;
+	TEST_EQUAL(e2.dict_find_int_value("k13"), 13);
+	std::string const b2 = b;
+	e.switch_underlying_buffer(b2.data());
+	TEST_EQUAL(e.dict_find_int_value("k13"), 13);
+	TEST_EQUAL(e.dict_find_int_value("k13"), 13);
+}
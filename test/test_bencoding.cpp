@@ -31,6 +31,7 @@ POSSIBILITY OF SUCH DAMAGE.
 */
 
 #include "libtorrent/bencode.hpp"
+#include "libtorrent/aux_/bencode_writer.hpp"
 
 #include <iostream>
 #include <cstring>
@@ -105,6 +106,47 @@ TORRENT_TEST(dictionaries)
 	TEST_CHECK(decode(encode(e)) == e);
 }
 
+TORRENT_TEST(bencode_writer)
+{
+	entry e(entry::dictionary_t);
+	e["a"] = entry(-12);
+	e["b"] = entry("foo");
+	entry::list_type& l = e["c"].list();
+	l.push_back(entry(0));
+	l.push_back(entry(entry::dictionary_t));
+	l.push_back(entry(""));
+	e["d"] = entry(entry::list_t);
+
+	std::string out;
+	aux::bencode_writer<std::back_insert_iterator<std::string>> w(std::back_inserter(out));
+	w.start_dict();
+	w.key("a");
+	w.integer(-12);
+	w.key("b");
+	w.string("foo");
+	w.key("c");
+	w.start_list();
+	w.integer(0);
+	w.start_dict();
+	w.end();
+	w.string("");
+	w.end();
+	w.key("d");
+	w.start_list();
+	w.end();
+	w.end();
+
+	TEST_EQUAL(out, encode(e));
+	TEST_EQUAL(w.size(), int(out.size()));
+
+	char buf[100];
+	aux::bencode_writer<char*> w2(buf);
+	w2.string("spam");
+	TEST_EQUAL(w2.size(), 6);
+	TEST_CHECK(w2.out() == buf + 6);
+	TEST_CHECK(std::memcmp(buf, "4:spam", 6) == 0);
+}
+
 TORRENT_TEST(preformatted)
 {
 	entry e(entry::preformatted_t);
@@ -295,6 +295,49 @@ TORRENT_TEST(find_first_set_late)
 	TEST_EQUAL(test1.find_first_set(), 98);
 }
 
+TORRENT_TEST(find_next_set)
+{
+	bitfield test1(1000, false);
+	TEST_EQUAL(test1.find_next_set(0), -1);
+	TEST_EQUAL(test1.find_next_set(999), -1);
+
+	int const bits[] = {0, 31, 32, 63, 300, 301, 555, 999};
+	for (int b : bits) test1.set_bit(b);
+
+	int i = 0;
+	for (int b = test1.find_next_set(0); b != -1; b = test1.find_next_set(b + 1), ++i)
+	{
+		TEST_CHECK(i < int(sizeof(bits) / sizeof(bits[0])));
+		TEST_EQUAL(b, bits[i]);
+	}
+	TEST_EQUAL(i, int(sizeof(bits) / sizeof(bits[0])));
+
+	TEST_EQUAL(test1.find_next_set(1), 31);
+	TEST_EQUAL(test1.find_next_set(302), 555);
+	TEST_EQUAL(test1.find_next_set(999), 999);
+	TEST_EQUAL(test1.find_next_set(1000), -1);
+}
+
+TORRENT_TEST(count_large)
+{
+	// large enough to exercise the vectorized path, with a tail that isn't
+	// a multiple of 256 bits
+	for (int size : {255, 256, 257, 1000, 2049})
+	{
+		bitfield test1(size, false);
+		int expected = 0;
+		for (int i = 0; i < size; i += 3)
+		{
+			test1.set_bit(i);
+			++expected;
+		}
+		TEST_EQUAL(test1.count(), expected);
+		test1.resize(size, true);
+		bitfield test2(size, true);
+		TEST_EQUAL(test2.count(), size);
+	}
+}
+
 TORRENT_TEST(find_last_clear_empty)
 {
 	bitfield test1(0);
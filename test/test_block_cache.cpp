@@ -38,6 +38,11 @@ POSSIBILITY OF SUCH DAMAGE.
 #include "libtorrent/disk_io_thread.hpp"
 #include "libtorrent/storage.hpp"
 #include "libtorrent/session.hpp"
+#include "libtorrent/create_torrent.hpp"
+#include "libtorrent/torrent_info.hpp"
+#include "libtorrent/bencode.hpp"
+
+#include <boost/variant/get.hpp>
 
 #include <functional>
 #include <memory>
@@ -465,6 +470,101 @@ void test_unaligned_read()
 	bc.clear(jobs);
 }
 
+// the torrent_info of a torrent with the files of fs and the piece hashes
+// hashes
+std::shared_ptr<torrent_info> make_info(file_storage& fs
+	, std::vector<sha1_hash> const& hashes)
+{
+	libtorrent::create_torrent t(fs, fs.piece_length(), -1, 0);
+	for (piece_index_t i(0); i < fs.end_piece(); ++i)
+		t.set_hash(i, hashes[std::size_t(static_cast<int>(i))]);
+
+	std::vector<char> buf;
+	bencode(std::back_inserter(buf), t.generate());
+	error_code ec;
+	auto ti = std::make_shared<torrent_info>(&buf[0], int(buf.size()), ec);
+	TEST_CHECK(!ec);
+	return ti;
+}
+
+void test_content_addressed()
+{
+	TEST_SETUP;
+
+	std::vector<sha1_hash> hashes;
+	for (int i = 0; i < 5; ++i)
+		hashes.push_back(hasher(reinterpret_cast<char const*>(&i), sizeof(i)).final());
+	auto ti = make_info(fs, hashes);
+	pm->set_info(ti.get());
+	pm->set_storage_index(storage_index_t(0));
+
+	// a torrent whose first piece is identical to piece 3 of the first one
+	file_storage fs2;
+	fs2.add_file("b/test", 0x10000);
+	fs2.set_piece_length(0x8000);
+	fs2.set_num_pieces(2);
+	std::vector<sha1_hash> hashes2 = { hashes[3], sha1_hash("abababababababababab") };
+	auto ti2 = make_info(fs2, hashes2);
+	std::shared_ptr<storage_interface> pm2
+		= std::make_shared<test_storage_impl>(fs2);
+	pm2->m_settings = &sett;
+	pm2->set_info(ti2.get());
+	pm2->set_storage_index(storage_index_t(1));
+
+	sett.set_bool(settings_pack::content_addressed_cache, true);
+	bc.set_settings(sett);
+
+	wj.storage = pm;
+	INSERT(3, 0);
+
+	// seeding the piece makes it available to other torrents
+	READ_BLOCK(3, 0, 1);
+	TEST_CHECK(ret >= 0);
+	rj.argument = 0;
+
+	disk_io_job rj2;
+	INITIALIZE_JOB(rj2)
+	rj2.action = disk_io_job::read;
+	rj2.flags = disk_io_job::force_copy;
+	rj2.d.io.offset = 0;
+	rj2.d.io.buffer_size = 0x4000;
+	rj2.piece = piece_index_t(0);
+	rj2.storage = pm2;
+	rj2.requester = (void*)2;
+	rj2.argument = disk_buffer_holder(alloc, nullptr);
+	ret = bc.try_read(&rj2, alloc);
+	TEST_EQUAL(ret, 0x4000);
+	TEST_EQUAL(std::memcmp(boost::get<disk_buffer_holder>(rj2.argument).get()
+		, pe->blocks[0].buf, 0x4000), 0);
+	rj2.argument = 0;
+
+	counters c;
+	bc.update_stats_counters(c);
+	TEST_EQUAL(c[counters::num_blocks_read_shared], 1);
+
+	// the second block isn't in the cache
+	rj2.d.io.offset = 0x4000;
+	rj2.argument = disk_buffer_holder(alloc, nullptr);
+	ret = bc.try_read(&rj2, alloc);
+	TEST_EQUAL(ret, -1);
+
+	// and the other piece has different content
+	rj2.d.io.offset = 0;
+	rj2.piece = piece_index_t(1);
+	ret = bc.try_read(&rj2, alloc);
+	TEST_EQUAL(ret, -1);
+
+	// disabling the setting stops the sharing
+	sett.set_bool(settings_pack::content_addressed_cache, false);
+	bc.set_settings(sett);
+	rj2.piece = piece_index_t(0);
+	ret = bc.try_read(&rj2, alloc);
+	TEST_EQUAL(ret, -1);
+
+	tailqueue<disk_io_job> jobs;
+	bc.clear(jobs);
+}
+
 TORRENT_TEST(block_cache)
 {
 	test_write();
@@ -475,6 +575,7 @@ TORRENT_TEST(block_cache)
 	test_arc_unghost();
 	test_iovec();
 	test_unaligned_read();
+	test_content_addressed();
 
 	// TODO: test try_evict_blocks
 	// TODO: test evicting volatile pieces, to see them be removed
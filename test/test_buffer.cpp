@@ -309,3 +309,49 @@ TORRENT_TEST(chained_buffer)
 	TEST_CHECK(buffer_list.empty());
 }
 
+
+TORRENT_TEST(chained_buffer_ring_wrap)
+{
+	char data[] = "0123456789abcdefghijklmnopqrstuvwxyz";
+	{
+		chained_buffer b;
+
+		// keep a window of buffers in flight while appending and popping,
+		// to make the ring wrap around and grow while it's wrapped
+		int next_append = 0;
+		int next_pop = 0;
+		for (int round = 0; round < 100; ++round)
+		{
+			int const num_append = round % 7 + 1;
+			for (int i = 0; i < num_append; ++i)
+			{
+				char* buf = allocate_buffer(1);
+				buf[0] = data[next_append % 36];
+				b.append_buffer(holder(buf), 1, 1);
+				++next_append;
+			}
+
+			std::vector<boost::asio::const_buffer> const& iov = b.build_iovec(b.size());
+			TEST_EQUAL(int(iov.size()), next_append - next_pop);
+			for (int i = 0; i < int(iov.size()); ++i)
+			{
+				TEST_EQUAL(*boost::asio::buffer_cast<char const*>(iov[std::size_t(i)])
+					, data[(next_pop + i) % 36]);
+			}
+
+			int const num_pop = (std::min)(round % 5 + 1, b.size());
+			b.pop_front(num_pop);
+			next_pop += num_pop;
+			TEST_EQUAL(b.size(), next_append - next_pop);
+		}
+
+		char* buf = allocate_buffer(1);
+		buf[0] = '!';
+		b.prepend_buffer(holder(buf), 1, 1);
+		std::vector<boost::asio::const_buffer> const& iov = b.build_iovec(2);
+		TEST_EQUAL(int(iov.size()), 2);
+		TEST_EQUAL(*boost::asio::buffer_cast<char const*>(iov[0]), '!');
+		TEST_EQUAL(*boost::asio::buffer_cast<char const*>(iov[1]), data[next_pop % 36]);
+	}
+	TEST_CHECK(buffer_list.empty());
+}
@@ -37,8 +37,13 @@ POSSIBILITY OF SUCH DAMAGE.
 #include "libtorrent/bencode.hpp"
 #include "libtorrent/aux_/escape_string.hpp" // for convert_path_to_posix
 #include "libtorrent/announce_entry.hpp"
+#include "libtorrent/settings_pack.hpp"
+#include "libtorrent/hasher.hpp"
+#include "libtorrent/aux_/path.hpp"
 
 #include <cstring>
+#include <cstdio>
+#include <algorithm>
 
 namespace lt = libtorrent;
 
@@ -71,3 +76,53 @@ TORRENT_TEST(create_verbatim_torrent)
 	TEST_CHECK(memcmp(dest_info, test_torrent + 1, sizeof(test_torrent)-3) == 0);
 }
 
+
+// hashing on several threads must produce the same piece hashes as hashing
+// the files sequentially
+TORRENT_TEST(set_piece_hashes_threads)
+{
+	int const piece_size = 0x4000;
+	lt::error_code ec;
+	lt::create_directory("test_create_torrent", ec);
+
+	std::vector<char> data(piece_size * 20 + 1234);
+	for (std::size_t i = 0; i < data.size(); ++i) data[i] = char(i % 251);
+
+	lt::file_storage fs;
+	int const sizes[] = {piece_size * 3 + 17, 0, piece_size / 2
+		, int(data.size()) - (piece_size * 3 + 17) - piece_size / 2};
+	int offset = 0;
+	for (int i = 0; i < 4; ++i)
+	{
+		std::string const name = lt::combine_path("test_create_torrent"
+			, "file" + std::to_string(i));
+		FILE* f = std::fopen(name.c_str(), "wb+");
+		TEST_CHECK(f != nullptr);
+		if (f == nullptr) return;
+		std::fwrite(&data[std::size_t(offset)], 1, std::size_t(sizes[i]), f);
+		std::fclose(f);
+		fs.add_file(name, sizes[i]);
+		offset += sizes[i];
+	}
+
+	lt::settings_pack sett;
+	sett.set_int(lt::settings_pack::hash_threads, 4);
+
+	// don't reorder the files, the expected hashes assume the original order
+	lt::create_torrent t(fs, piece_size, -1, 0);
+	lt::set_piece_hashes(t, ".", sett, lt::detail::nop, ec);
+	TEST_CHECK(!ec);
+
+	std::vector<char> buffer;
+	lt::bencode(std::back_inserter(buffer), t.generate());
+	lt::torrent_info info(buffer.data(), int(buffer.size()));
+	TEST_EQUAL(info.num_pieces(), (int(data.size()) + piece_size - 1) / piece_size);
+
+	for (lt::piece_index_t p(0); p < info.end_piece(); ++p)
+	{
+		int const start = static_cast<int>(p) * piece_size;
+		int const len = std::min(piece_size, int(data.size()) - start);
+		lt::sha1_hash const expected = lt::hasher(&data[std::size_t(start)], len).final();
+		TEST_CHECK(info.hash_for_piece(p) == expected);
+	}
+}
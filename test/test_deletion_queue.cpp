@@ -0,0 +1,114 @@
+/*
+
+Copyright (c) 2017, Arvid Norberg
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions
+are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in
+      the documentation and/or other materials provided with the distribution.
+    * Neither the name of the author nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+#include "test.hpp"
+#include "libtorrent/aux_/deletion_queue.hpp"
+#include "libtorrent/time.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <thread>
+
+using namespace libtorrent;
+using aux::deletion_queue;
+
+namespace {
+
+// pushes num deletions taking a little while each, and returns the most that
+// ran at the same time
+int max_concurrency(deletion_queue& q, int const num)
+{
+	std::atomic<int> running{0};
+	std::atomic<int> most{0};
+	std::atomic<int> done{0};
+	for (int i = 0; i < num; ++i)
+	{
+		q.push([&]
+		{
+			int const r = ++running;
+			int m = most;
+			while (r > m && !most.compare_exchange_weak(m, r));
+			std::this_thread::sleep_for(milliseconds(20));
+			--running;
+			++done;
+		});
+	}
+	while (done < num) std::this_thread::sleep_for(milliseconds(5));
+	return most;
+}
+
+} // anonymous namespace
+
+TORRENT_TEST(bounded_concurrency)
+{
+	deletion_queue q;
+	TEST_EQUAL(q.max_threads(), 1);
+	TEST_EQUAL(max_concurrency(q, 5), 1);
+
+	q.set_max_threads(3);
+	int const most = max_concurrency(q, 12);
+	TEST_CHECK(most <= 3);
+	TEST_CHECK(most > 1);
+
+	// lowering the limit holds back the surplus threads
+	q.set_max_threads(1);
+	TEST_EQUAL(max_concurrency(q, 5), 1);
+
+	// the limit is at least one
+	q.set_max_threads(0);
+	TEST_EQUAL(q.max_threads(), 1);
+}
+
+TORRENT_TEST(drain)
+{
+	deletion_queue q;
+	q.set_max_threads(2);
+	std::atomic<int> done{0};
+	for (int i = 0; i < 6; ++i)
+	{
+		q.push([&]
+		{
+			std::this_thread::sleep_for(milliseconds(10));
+			++done;
+		});
+	}
+
+	// draining waits for the queued deletions, it doesn't drop them
+	q.drain();
+	TEST_EQUAL(done, 6);
+	TEST_EQUAL(q.num_pending(), 0);
+
+	// once drained, deletions run in the calling thread
+	std::thread::id id;
+	q.push([&] { id = std::this_thread::get_id(); });
+	TEST_CHECK(id == std::this_thread::get_id());
+}
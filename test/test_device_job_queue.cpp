@@ -0,0 +1,254 @@
+/*
+
+Copyright (c) 2017, Arvid Norberg
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions
+are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in
+      the documentation and/or other materials provided with the distribution.
+    * Neither the name of the author nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+
+#include "libtorrent/aux_/device_job_queue.hpp"
+#include "libtorrent/disk_io_job.hpp"
+#include "test.hpp"
+
+#include <vector>
+
+using namespace libtorrent;
+
+namespace {
+
+struct jobs
+{
+	explicit jobs(int const n) : m_jobs(std::size_t(n)) {}
+	disk_io_job* operator()(int const i, int const device)
+	{
+		disk_io_job* j = &m_jobs[std::size_t(i)];
+		j->device = std::uint8_t(device);
+		return j;
+	}
+	int index(disk_io_job const* j) const { return int(j - m_jobs.data()); }
+private:
+	std::vector<disk_io_job> m_jobs;
+};
+
+} // anonymous namespace
+
+TORRENT_TEST(device_job_queue_fifo)
+{
+	jobs j(4);
+	aux::device_job_queue q;
+	TEST_CHECK(q.empty());
+	TEST_CHECK(!q.runnable());
+	TEST_CHECK(q.pop_front() == nullptr);
+
+	q.push_back(j(0, 0));
+	q.push_back(j(1, 0));
+	q.push_front(j(2, 0));
+	TEST_EQUAL(q.size(), 3);
+
+	TEST_EQUAL(j.index(q.first()), 2);
+	TEST_EQUAL(j.index(q.pop_front()), 2);
+	TEST_EQUAL(j.index(q.pop_front()), 0);
+	TEST_EQUAL(j.index(q.pop_front()), 1);
+	TEST_CHECK(q.empty());
+	TEST_EQUAL(q.in_flight(0), 3);
+
+	q.job_done(0);
+	q.job_done(0);
+	q.job_done(0);
+	TEST_EQUAL(q.in_flight(0), 0);
+}
+
+TORRENT_TEST(device_job_queue_least_loaded)
+{
+	jobs j(6);
+	aux::device_job_queue q;
+	q.push_back(j(0, 0));
+	q.push_back(j(1, 0));
+	q.push_back(j(2, 0));
+	q.push_back(j(3, 1));
+	q.push_back(j(4, 1));
+
+	// the devices take turns while they have the same number of jobs
+	// executing
+	TEST_EQUAL(j.index(q.pop_front()), 0);
+	TEST_EQUAL(j.index(q.pop_front()), 3);
+	TEST_EQUAL(j.index(q.pop_front()), 1);
+
+	// device 1 has fewer jobs executing now
+	TEST_EQUAL(j.index(q.pop_front()), 4);
+
+	// device 1 doesn't have any more jobs queued
+	TEST_EQUAL(j.index(q.pop_front()), 2);
+	TEST_CHECK(q.empty());
+}
+
+TORRENT_TEST(device_job_queue_limit)
+{
+	jobs j(6);
+	aux::device_job_queue q;
+	q.set_device_limit(2);
+	q.push_back(j(0, 0));
+	q.push_back(j(1, 0));
+	q.push_back(j(2, 0));
+	q.push_back(j(3, 0));
+
+	TEST_EQUAL(j.index(q.pop_front()), 0);
+	TEST_EQUAL(j.index(q.pop_front()), 1);
+
+	// device 0 is at its limit
+	TEST_CHECK(!q.runnable());
+	TEST_CHECK(q.pop_front() == nullptr);
+	TEST_CHECK(q.first() == nullptr);
+	TEST_EQUAL(q.size(), 2);
+
+	// but other devices' jobs can still execute
+	q.push_back(j(4, 2));
+	TEST_CHECK(q.runnable());
+	TEST_EQUAL(j.index(q.pop_front()), 4);
+
+	q.job_done(0);
+	TEST_CHECK(q.runnable());
+	TEST_EQUAL(j.index(q.pop_front()), 2);
+	TEST_CHECK(!q.runnable());
+
+	// no limit
+	q.set_device_limit(0);
+	TEST_EQUAL(j.index(q.pop_front()), 3);
+	TEST_EQUAL(q.in_flight(0), 3);
+}
+
+TORRENT_TEST(device_job_queue_get_all)
+{
+	jobs j(4);
+	aux::device_job_queue q;
+	q.push_back(j(0, 0));
+	q.push_back(j(1, 3));
+	q.push_back(j(2, 0));
+
+	int num = 0;
+	disk_io_job* i = q.get_all();
+	while (i != nullptr)
+	{
+		disk_io_job* next = i->next;
+		i->next = nullptr;
+		++num;
+		i = next;
+	}
+	TEST_EQUAL(num, 3);
+	TEST_CHECK(q.empty());
+	TEST_CHECK(q.pop_front() == nullptr);
+
+	tailqueue<disk_io_job> other;
+	other.push_back(j(3, 1));
+	q.append(other);
+	TEST_CHECK(other.empty());
+	TEST_EQUAL(j.index(q.pop_front()), 3);
+}
+
+namespace {
+
+disk_io_job* read_job(disk_io_job* j, int const piece
+	, time_point const issued = clock_type::now())
+{
+	j->action = disk_io_job::read;
+	j->piece = piece_index_t(piece);
+	j->d.io.offset = 0;
+	j->d.io.buffer_size = 0x4000;
+	j->issued = issued;
+	return j;
+}
+
+} // anonymous namespace
+
+TORRENT_TEST(device_job_queue_elevator)
+{
+	jobs j(8);
+	aux::device_job_queue q;
+	q.set_read_reorder(seconds(10));
+	q.push_back(read_job(j(0, 0), 5));
+	q.push_back(read_job(j(1, 0), 1));
+	q.push_back(read_job(j(2, 0), 3));
+
+	TEST_EQUAL(j.index(q.first()), 1);
+	TEST_EQUAL(j.index(q.pop_front()), 1);
+	TEST_EQUAL(j.index(q.pop_front()), 2);
+
+	// reads behind the last one's end are executed once the ones after it
+	// are done
+	q.push_back(read_job(j(3, 0), 2));
+	q.push_back(read_job(j(4, 0), 7));
+	TEST_EQUAL(j.index(q.pop_front()), 0);
+	TEST_EQUAL(j.index(q.pop_front()), 4);
+	TEST_EQUAL(j.index(q.pop_front()), 3);
+	TEST_CHECK(q.empty());
+}
+
+TORRENT_TEST(device_job_queue_elevator_max_wait)
+{
+	jobs j(4);
+	aux::device_job_queue q;
+	q.set_read_reorder(milliseconds(100));
+	q.push_back(read_job(j(0, 0), 5));
+	q.push_back(read_job(j(1, 0), 3, clock_type::now() - seconds(1)));
+	q.push_back(read_job(j(2, 0), 1));
+
+	// job 1 has waited too long to be held back for job 2
+	TEST_EQUAL(j.index(q.pop_front()), 1);
+	TEST_EQUAL(j.index(q.pop_front()), 0);
+	TEST_EQUAL(j.index(q.pop_front()), 2);
+}
+
+TORRENT_TEST(device_job_queue_elevator_other_jobs)
+{
+	jobs j(4);
+	aux::device_job_queue q;
+	q.set_read_reorder(seconds(10));
+	q.push_back(read_job(j(0, 0), 5));
+	disk_io_job* w = j(1, 0);
+	w->action = disk_io_job::write;
+	q.push_back(w);
+	q.push_back(read_job(j(2, 0), 1));
+
+	// reads aren't moved past other jobs
+	TEST_EQUAL(j.index(q.pop_front()), 0);
+	TEST_EQUAL(j.index(q.pop_front()), 1);
+	TEST_EQUAL(j.index(q.pop_front()), 2);
+}
+
+TORRENT_TEST(device_job_queue_no_elevator)
+{
+	jobs j(4);
+	aux::device_job_queue q;
+	q.push_back(read_job(j(0, 0), 5));
+	q.push_back(read_job(j(1, 0), 1));
+	q.push_back(read_job(j(2, 0), 3));
+
+	TEST_EQUAL(j.index(q.pop_front()), 0);
+	TEST_EQUAL(j.index(q.pop_front()), 1);
+	TEST_EQUAL(j.index(q.pop_front()), 2);
+}
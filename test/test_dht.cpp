@@ -54,6 +54,7 @@ POSSIBILITY OF SUCH DAMAGE.
 #include "libtorrent/kademlia/routing_table.hpp"
 #include "libtorrent/kademlia/item.hpp"
 #include "libtorrent/kademlia/dht_observer.hpp"
+#include "libtorrent/kademlia/signing_pool.hpp"
 
 #include <numeric>
 #include <cstdarg>
@@ -499,6 +500,7 @@ struct obs : dht::dht_observer
 #endif
 	bool on_dht_request(string_view query
 		, dht::msg const& request, entry& response) override { return false; }
+	bool has_dht_request_handler() const override { return false; }
 
 	address m_external_address = addr4("236.0.0.1");
 
@@ -777,6 +779,89 @@ TORRENT_TEST(ping)
 	}
 }
 
+TORRENT_TEST(ping_response_fields)
+{
+	// ping responses are written without building an entry. Make sure they
+	// carry the same fields as the regular responses
+	dht_test_setup t(udp::endpoint(rand_v4(), 20));
+	bdecode_node response;
+
+	send_dht_request(t.dht_node, "ping", t.source, &response, msg_args(), "abc");
+
+	dht::key_desc_t const pong_desc[] = {
+		{"ip", bdecode_node::string_t, 6, 0},
+		{"r", bdecode_node::dict_t, 0, key_desc_t::parse_children},
+			{"id", bdecode_node::string_t, 20, 0},
+			{"p", bdecode_node::int_t, 0, key_desc_t::last_child},
+		{"t", bdecode_node::string_t, 3, 0},
+		{"v", bdecode_node::string_t, 4, 0},
+		{"y", bdecode_node::string_t, 1, 0},
+	};
+
+	bdecode_node pong_keys[7];
+	bool const ret = dht::verify_message(response, pong_desc, pong_keys, t.error_string);
+	TEST_CHECK(ret);
+	if (!ret)
+	{
+		std::printf("   invalid ping response: %s\n", t.error_string);
+		return;
+	}
+
+	TEST_CHECK(pong_keys[0].string_value() == endpoint_to_bytes(t.source));
+	TEST_EQUAL(node_id(pong_keys[2].string_ptr()), t.dht_node.nid());
+	TEST_EQUAL(pong_keys[3].int_value(), t.source.port());
+	TEST_CHECK(pong_keys[4].string_value() == "abc");
+	TEST_CHECK(pong_keys[6].string_value() == "r");
+}
+
+TORRENT_TEST(sample_infohashes_request)
+{
+	dht_test_setup t(udp::endpoint(rand_v4(), 20));
+	bdecode_node response;
+
+	sha1_hash const ih1 = rand_hash();
+	sha1_hash const ih2 = rand_hash();
+	t.dht_storage->announce_peer(ih1, tcp::endpoint(rand_v4(), 1234), "", false);
+	t.dht_storage->announce_peer(ih2, tcp::endpoint(rand_v4(), 1234), "", false);
+
+	t.dht_node.m_table.add_node(node_entry(rand_hash(), udp::endpoint(rand_v4(), 1234)));
+
+	send_dht_request(t.dht_node, "sample_infohashes", t.source, &response
+		, msg_args().target(rand_hash()));
+
+	dht::key_desc_t const sample_desc[] = {
+		{"y", bdecode_node::string_t, 1, 0},
+		{"r", bdecode_node::dict_t, 0, key_desc_t::parse_children},
+			{"id", bdecode_node::string_t, 20, 0},
+			{"interval", bdecode_node::int_t, 0, 0},
+			{"num", bdecode_node::int_t, 0, 0},
+			{"samples", bdecode_node::string_t, 0, 0},
+			{"nodes", bdecode_node::string_t, 0, key_desc_t::last_child},
+	};
+
+	bdecode_node sample_keys[7];
+	bool const ret = dht::verify_message(response, sample_desc, sample_keys, t.error_string);
+	TEST_CHECK(ret);
+	if (!ret)
+	{
+		std::printf("   invalid sample_infohashes response: %s\n", t.error_string);
+		return;
+	}
+
+	TEST_CHECK(sample_keys[0].string_value() == "r");
+	TEST_EQUAL(sample_keys[4].int_value(), 2);
+	TEST_EQUAL(sample_keys[5].string_length(), 2 * 20);
+	std::vector<sha1_hash> samples;
+	for (int i = 0; i < sample_keys[5].string_length(); i += 20)
+		samples.push_back(sha1_hash(sample_keys[5].string_ptr() + i));
+	TEST_CHECK(std::find(samples.begin(), samples.end(), ih1) != samples.end());
+	TEST_CHECK(std::find(samples.begin(), samples.end(), ih2) != samples.end());
+
+	// the response also carries nodes, to let the sampler keep traversing
+	TEST_CHECK(sample_keys[6].string_length() >= 26);
+	TEST_EQUAL(sample_keys[6].string_length() % 26, 0);
+}
+
 TORRENT_TEST(invalid_message)
 {
 	dht_test_setup t(udp::endpoint(rand_v4(), 20));
@@ -2763,6 +2848,38 @@ TORRENT_TEST(signing_test3)
 	TEST_EQUAL(aux::to_hex(target_id), "e5f96f6f38320f0f33959cb4d3d656452117aadb");
 }
 
+TORRENT_TEST(signing_pool)
+{
+	public_key pk;
+	secret_key sk;
+	std::tie(pk, sk) = ed25519_create_keypair(ed25519_create_seed());
+
+	io_service ios;
+	dht::signing_pool pool(ios);
+
+	int num_signed = 0;
+	for (int i = 0; i < 10; ++i)
+	{
+		pool.async_sign(entry(i), "foobar", sequence_number(i + 1), pk, sk
+			, [&, i](item const& it)
+		{
+			TEST_EQUAL(it.value().integer(), i);
+			TEST_EQUAL(it.seq().value, i + 1);
+			TEST_CHECK(it.salt() == "foobar");
+
+			std::string buf;
+			bencode(std::back_inserter(buf), it.value());
+			TEST_CHECK(verify_mutable_item(buf, it.salt(), it.seq(), pk, it.sig()));
+
+			// let run() return once all items are signed
+			if (++num_signed == 10) pool.abort();
+		});
+	}
+
+	ios.run();
+	TEST_EQUAL(num_signed, 10);
+}
+
 // TODO: 2 split this up into smaller test cases
 TORRENT_TEST(verify_message)
 {
@@ -3433,6 +3550,51 @@ TORRENT_TEST(distance_exp)
 	}
 }
 
+TORRENT_TEST(compare_ref)
+{
+	// compare_ref() must order nodes the same way as comparing their full
+	// distances to the reference
+	for (int i = 0; i < 1000; ++i)
+	{
+		node_id const ref = generate_next();
+		node_id n1 = generate_next();
+		node_id n2 = generate_next();
+		// make the IDs share a prefix some of the time, to exercise the
+		// later words
+		if (i & 1) std::copy(n1.begin(), n1.begin() + (i % 20), n2.begin());
+
+		TEST_EQUAL(compare_ref(n1, n2, ref), distance(n1, ref) < distance(n2, ref));
+		TEST_EQUAL(compare_ref(n2, n1, ref), distance(n2, ref) < distance(n1, ref));
+	}
+	node_id const id = generate_next();
+	TEST_CHECK(!compare_ref(id, id, generate_next()));
+}
+
+TORRENT_TEST(node_entry_request_timeout)
+{
+	node_entry e(generate_next(), udp::endpoint(addr4("4.4.4.4"), 1234));
+	TEST_EQUAL(e.request_timeout(), -1);
+
+	// the first sample sets the variance to half of it
+	e.update_rtt(100);
+	TEST_EQUAL(e.rtt, 100);
+	TEST_EQUAL(e.request_timeout(), 100 + 4 * 50);
+
+	// a node that responds consistently converges on a timeout close to
+	// its RTT
+	for (int i = 0; i < 30; ++i) e.update_rtt(100);
+	TEST_CHECK(e.request_timeout() < 110);
+
+	// jitter widens it again
+	e.update_rtt(400);
+	TEST_CHECK(e.request_timeout() > 300);
+
+	// the invalid RTT is ignored
+	int const before = e.request_timeout();
+	e.update_rtt(0xffff);
+	TEST_EQUAL(e.request_timeout(), before);
+}
+
 TORRENT_TEST(compare_ip_cidr)
 {
 	using tst = std::tuple<char const*, char const*, bool>;
@@ -3511,6 +3673,53 @@ TORRENT_TEST(dht_state)
 	TEST_CHECK(s2.nodes.empty());
 	TEST_EQUAL(s2.nid6, node_id());
 	TEST_CHECK(s2.nodes6.empty());
+	TEST_CHECK(s2.table.empty());
+	TEST_CHECK(s2.table6.empty());
+}
+
+TORRENT_TEST(dht_state_table)
+{
+	dht_state s;
+
+	s.nid = to_hash("0000000000000000000000000000000000000001");
+	s.table.emplace_back(to_hash("1111111111111111111111111111111111111111")
+		, uep("1.1.1.1", 1), 50, true);
+	s.table.emplace_back(to_hash("2222222222222222222222222222222222222222")
+		, uep("2.2.2.2", 2));
+#if TORRENT_USE_IPV6
+	s.table6.emplace_back(to_hash("3333333333333333333333333333333333333333")
+		, udp::endpoint(addr6("2001::1"), 3), 120, true);
+#endif
+
+	entry const e = save_dht_state(s);
+
+	std::vector<char> tmp;
+	bencode(std::back_inserter(tmp), e);
+
+	bdecode_node n;
+	error_code ec;
+	int r = bdecode(&tmp[0], &tmp[0] + tmp.size(), n, ec);
+	TEST_CHECK(!r);
+
+	dht_state const s1 = read_dht_state(n);
+	TEST_EQUAL(s1.table.size(), 2);
+	for (std::size_t i = 0; i < std::min(s1.table.size(), s.table.size()); ++i)
+	{
+		TEST_EQUAL(s1.table[i].id, s.table[i].id);
+		TEST_CHECK(s1.table[i].ep() == s.table[i].ep());
+		TEST_EQUAL(s1.table[i].rtt, s.table[i].rtt);
+		// restored nodes have to respond again before they are trusted
+		TEST_CHECK(!s1.table[i].pinged());
+	}
+#if TORRENT_USE_IPV6
+	TEST_EQUAL(s1.table6.size(), 1);
+	if (s1.table6.size() == 1)
+	{
+		TEST_EQUAL(s1.table6[0].id, s.table6[0].id);
+		TEST_CHECK(s1.table6[0].ep() == s.table6[0].ep());
+		TEST_EQUAL(s1.table6[0].rtt, 120);
+	}
+#endif
 }
 
 // TODO: test obfuscated_get_peers
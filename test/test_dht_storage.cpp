@@ -340,6 +340,22 @@ TORRENT_TEST(mutable_item_limit)
 	TEST_EQUAL(cnt.mutable_data, 42);
 }
 
+TORRENT_TEST(memory_counter)
+{
+	dht_settings sett = test_settings();
+	std::unique_ptr<dht_storage_interface> s(create_default_dht_storage(sett));
+
+	std::int32_t const empty = s->counters().memory;
+
+	std::vector<char> const item(1000, 'a');
+	s->put_immutable_item(rand_hash(), item, rand_v4());
+	std::int32_t const one_item = s->counters().memory;
+	TEST_CHECK(one_item >= empty + 1000);
+
+	s->announce_peer(n1, tcp::endpoint(rand_v4(), 1234), "torrent_name", false);
+	TEST_CHECK(s->counters().memory > one_item);
+}
+
 TORRENT_TEST(get_peers_dist)
 {
 	// test that get_peers returns reasonably disjoint sets of peers with each call
@@ -0,0 +1,207 @@
+/*
+
+Copyright (c) 2017, Arvid Norberg
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions
+are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in
+      the documentation and/or other materials provided with the distribution.
+    * Neither the name of the author nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+
+#include "libtorrent/aux_/disk_arena.hpp"
+#include "test.hpp"
+
+#include <set>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <cstring>
+
+using namespace libtorrent;
+using libtorrent::aux::disk_arena;
+
+TORRENT_TEST(disk_arena_exhaust)
+{
+	disk_arena a;
+	TEST_CHECK(a.reserve(0x4000, 16));
+	TEST_EQUAL(a.num_blocks(), 16);
+
+	std::set<char*> blocks;
+	for (int i = 0; i < 16; ++i)
+	{
+		char* b = a.allocate();
+		TEST_CHECK(b != nullptr);
+		TEST_CHECK(a.owns(b));
+		TEST_CHECK(a.owns(b + 0x4000 - 1));
+		// make sure the memory is actually usable
+		std::memset(b, i, 0x4000);
+		blocks.insert(b);
+	}
+	// all blocks are distinct
+	TEST_EQUAL(int(blocks.size()), 16);
+
+	// all blocks are in use
+	TEST_CHECK(a.allocate() == nullptr);
+
+	char not_ours[10];
+	TEST_CHECK(!a.owns(not_ours));
+
+	char* const b = *blocks.begin();
+	a.free(b);
+	blocks.erase(blocks.begin());
+	char* const b2 = a.allocate();
+	TEST_CHECK(b2 == b);
+	TEST_CHECK(a.allocate() == nullptr);
+	blocks.insert(b2);
+
+	for (char* p : blocks) a.free(p);
+
+	for (int i = 0; i < 16; ++i)
+		TEST_CHECK(a.allocate() != nullptr);
+	TEST_CHECK(a.allocate() == nullptr);
+}
+
+TORRENT_TEST(disk_arena_unreserved)
+{
+	disk_arena a;
+	TEST_EQUAL(a.num_blocks(), 0);
+	TEST_CHECK(a.allocate() == nullptr);
+	char buf[10];
+	TEST_CHECK(!a.owns(buf));
+}
+
+TORRENT_TEST(disk_arena_threads)
+{
+	int const num_blocks = 64;
+	int const num_threads = 4;
+	disk_arena a;
+	TEST_CHECK(a.reserve(0x4000, num_blocks));
+
+	// every block carries the index of the thread that owns it. If two
+	// threads were ever handed the same block, one of them would see the
+	// other's mark
+	std::atomic<int> failures(0);
+	std::vector<std::thread> threads;
+	for (int t = 0; t < num_threads; ++t)
+	{
+		threads.emplace_back([&a, &failures, t]()
+		{
+			std::vector<char*> mine;
+			for (int round = 0; round < 2000; ++round)
+			{
+				for (int i = 0; i < 8; ++i)
+				{
+					char* const b = a.allocate();
+					if (b == nullptr) break;
+					b[0] = char(t);
+					mine.push_back(b);
+				}
+				for (char* b : mine)
+				{
+					if (b[0] != char(t)) ++failures;
+					a.free(b);
+				}
+				mine.clear();
+			}
+		});
+	}
+	for (auto& t : threads) t.join();
+	TEST_EQUAL(failures, 0);
+
+	// every block was returned
+	for (int i = 0; i < num_blocks; ++i)
+		TEST_CHECK(a.allocate() != nullptr);
+	TEST_CHECK(a.allocate() == nullptr);
+}
+
+TORRENT_TEST(disk_arena_batch)
+{
+	disk_arena a;
+	TEST_CHECK(a.reserve(0x4000, 16));
+
+	char* bufs[10];
+	TEST_EQUAL(a.allocate(bufs), 10);
+	std::set<char*> blocks(bufs, bufs + 10);
+	TEST_EQUAL(int(blocks.size()), 10);
+	for (char* b : bufs) TEST_CHECK(a.owns(b));
+
+	// only 6 blocks are left
+	char* more[10];
+	TEST_EQUAL(a.allocate(more), 6);
+	for (int i = 0; i < 6; ++i) blocks.insert(more[i]);
+	TEST_EQUAL(int(blocks.size()), 16);
+	TEST_EQUAL(a.allocate(more), 0);
+	TEST_CHECK(a.allocate() == nullptr);
+
+	a.free(span<char* const>(bufs));
+	a.free(span<char* const>(more, 6));
+
+	// every block is available again
+	char* all[20];
+	TEST_EQUAL(a.allocate(all), 16);
+	std::set<char*> again(all, all + 16);
+	TEST_CHECK(again == blocks);
+}
+
+TORRENT_TEST(disk_arena_batch_threads)
+{
+	int const num_blocks = 64;
+	int const num_threads = 4;
+	disk_arena a;
+	TEST_CHECK(a.reserve(0x4000, num_blocks));
+
+	std::atomic<int> failures(0);
+	std::vector<std::thread> threads;
+	for (int t = 0; t < num_threads; ++t)
+	{
+		threads.emplace_back([&a, &failures, t]()
+		{
+			char* bufs[12];
+			for (int round = 0; round < 2000; ++round)
+			{
+				// mix batch and single block operations
+				int const n = a.allocate(bufs);
+				for (int i = 0; i < n; ++i) bufs[i][0] = char(t);
+				char* const single = a.allocate();
+				if (single != nullptr) single[0] = char(t);
+
+				for (int i = 0; i < n; ++i)
+					if (bufs[i][0] != char(t)) ++failures;
+				if (single != nullptr)
+				{
+					if (single[0] != char(t)) ++failures;
+					a.free(single);
+				}
+				a.free(span<char* const>(bufs, std::size_t(n)));
+			}
+		});
+	}
+	for (auto& t : threads) t.join();
+	TEST_EQUAL(failures, 0);
+
+	char* all[num_blocks + 1];
+	TEST_EQUAL(a.allocate(all), num_blocks);
+}
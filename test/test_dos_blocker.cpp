@@ -97,6 +97,33 @@ TORRENT_TEST(dos_blocker)
 	now += milliseconds(1);
 
 	TEST_EQUAL(b.incoming(spammer, now, &l), false);
+
+	// the ban is lifted after the block timeout
+	now += seconds(5 * 60);
+	TEST_EQUAL(b.incoming(spammer, now, &l), true);
+#endif
+#endif
+}
+
+TORRENT_TEST(dos_blocker_below_limit)
+{
+#ifndef TORRENT_DISABLE_LOGGING
+#ifndef TORRENT_DISABLE_DHT
+	using namespace libtorrent::dht;
+
+	log_t l;
+	dos_blocker b;
+	b.set_rate_limit(5);
+
+	// a node sending just below the rate limit for a long time is never
+	// blocked
+	address const node = address_v4::from_string("10.10.10.10");
+	time_point now = clock_type::now();
+	for (int i = 0; i < 4 * 200; ++i)
+	{
+		TEST_EQUAL(b.incoming(node, now, &l), true);
+		now += milliseconds(250);
+	}
 #endif
 #endif
 }
@@ -37,6 +37,8 @@ POSSIBILITY OF SUCH DAMAGE.
 #include <memory>
 
 #include "libtorrent/kademlia/ed25519.hpp"
+#include "libtorrent/kademlia/item.hpp"
+#include "libtorrent/bencode.hpp"
 #include "libtorrent/hex.hpp"
 
 using namespace libtorrent;
@@ -280,6 +282,85 @@ TORRENT_TEST(key_exchange)
 	TEST_EQUAL(aux::to_hex(secretA), aux::to_hex(secretB));
 }
 
+TORRENT_TEST(verify_batch)
+{
+	int const num = 20;
+	std::vector<std::string> messages;
+	std::vector<signature> sigs;
+	std::vector<public_key> pks;
+	for (int i = 0; i < num; ++i)
+	{
+		public_key pk;
+		secret_key sk;
+		std::tie(pk, sk) = ed25519_create_keypair(ed25519_create_seed());
+		messages.push_back("message number " + std::to_string(i));
+		sigs.push_back(ed25519_sign(messages.back(), pk, sk));
+		pks.push_back(pk);
+	}
+	std::vector<span<char const>> msgs;
+	for (auto const& m : messages) msgs.emplace_back(m);
+
+	TEST_CHECK(ed25519_verify_batch(sigs, msgs, pks));
+	TEST_CHECK(ed25519_verify_batch(span<signature const>(sigs).first(1)
+		, span<span<char const> const>(msgs).first(1)
+		, span<public_key const>(pks).first(1)));
+
+	// a signature for another message
+	std::swap(msgs[3], msgs[4]);
+	TEST_CHECK(!ed25519_verify_batch(sigs, msgs, pks));
+	std::swap(msgs[3], msgs[4]);
+
+	// a corrupt signature
+	sigs[7].bytes[40] ^= 1;
+	TEST_CHECK(!ed25519_verify_batch(sigs, msgs, pks));
+	sigs[7].bytes[40] ^= 1;
+
+	// the wrong key
+	std::swap(pks[0], pks[19]);
+	TEST_CHECK(!ed25519_verify_batch(sigs, msgs, pks));
+	std::swap(pks[0], pks[19]);
+
+	TEST_CHECK(ed25519_verify_batch(sigs, msgs, pks));
+}
+
+TORRENT_TEST(verify_mutable_items)
+{
+	public_key pk;
+	secret_key sk;
+	std::tie(pk, sk) = ed25519_create_keypair(ed25519_create_seed());
+
+	int const num = 9;
+	std::vector<std::string> values;
+	for (int i = 0; i < num; ++i)
+	{
+		std::string v;
+		bencode(std::back_inserter(v), entry("value " + std::to_string(i)));
+		values.push_back(v);
+	}
+
+	std::string const salt = "salt";
+	std::vector<mutable_item_ref> items;
+	for (int i = 0; i < num; ++i)
+	{
+		sequence_number const seq(i);
+		span<char const> const s = i % 2 ? span<char const>(salt) : span<char const>();
+		items.push_back({values[std::size_t(i)], s, seq, pk
+			, sign_mutable_item(values[std::size_t(i)], s, seq, pk, sk)});
+	}
+
+	std::vector<bool> valid = verify_mutable_items(items);
+	TEST_CHECK(valid == std::vector<bool>(num, true));
+
+	// break two of them, the others should still be found valid
+	items[2].seq = sequence_number(100);
+	items[6].sig.bytes[0] ^= 0x55;
+	valid = verify_mutable_items(items);
+	for (int i = 0; i < num; ++i)
+		TEST_EQUAL(valid[std::size_t(i)], i != 2 && i != 6);
+
+	TEST_CHECK(verify_mutable_items({}).empty());
+}
+
 #else
 TORRENT_TEST(empty)
 {
@@ -0,0 +1,125 @@
+/*
+
+Copyright (c) 2017, Arvid Norberg
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions
+are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in
+      the documentation and/or other materials provided with the distribution.
+    * Neither the name of the author nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+#include "test.hpp"
+#include "libtorrent/extensions.hpp"
+#include "libtorrent/aux_/extension_list.hpp"
+
+using namespace libtorrent;
+
+namespace {
+
+struct test_plugin : peer_plugin
+{
+	explicit test_plugin(std::uint32_t f) : m_features(f) {}
+	std::uint32_t implemented_features() override { return m_features; }
+	std::uint32_t m_features;
+	int m_calls = 0;
+};
+
+} // anonymous namespace
+
+TORRENT_TEST(dispatch_by_feature)
+{
+	aux::extension_list<peer_plugin> l;
+	TEST_CHECK(l.empty());
+	TEST_CHECK(!l.has(peer_plugin::have_feature));
+
+	auto a = std::make_shared<test_plugin>(peer_plugin::have_feature);
+	auto b = std::make_shared<test_plugin>(peer_plugin::have_feature
+		| peer_plugin::tick_feature);
+	l.push_back(a);
+	l.push_back(b);
+	TEST_EQUAL(l.size(), 2);
+	TEST_CHECK(l.has(peer_plugin::tick_feature));
+	TEST_CHECK(!l.has(peer_plugin::choke_feature));
+
+	auto count = [](peer_plugin& p) { ++static_cast<test_plugin&>(p).m_calls; };
+
+	l.for_each(peer_plugin::tick_feature, count);
+	TEST_EQUAL(a->m_calls, 0);
+	TEST_EQUAL(b->m_calls, 1);
+
+	l.for_each(peer_plugin::have_feature, count);
+	TEST_EQUAL(a->m_calls, 1);
+	TEST_EQUAL(b->m_calls, 2);
+
+	l.for_each(peer_plugin::choke_feature, count);
+	TEST_EQUAL(a->m_calls, 1);
+	TEST_EQUAL(b->m_calls, 2);
+
+	// hooks not covered by a feature visit every plugin
+	l.for_each(count);
+	TEST_EQUAL(a->m_calls, 2);
+	TEST_EQUAL(b->m_calls, 3);
+}
+
+TORRENT_TEST(any_of_stops_at_first)
+{
+	aux::extension_list<peer_plugin> l;
+	auto a = std::make_shared<test_plugin>(peer_plugin::extended_feature);
+	auto b = std::make_shared<test_plugin>(peer_plugin::extended_feature);
+	l.push_back(a);
+	l.push_back(b);
+
+	TEST_CHECK(l.any_of(peer_plugin::extended_feature, [](peer_plugin& p)
+		{ ++static_cast<test_plugin&>(p).m_calls; return true; }));
+	TEST_EQUAL(a->m_calls, 1);
+	TEST_EQUAL(b->m_calls, 0);
+
+	TEST_CHECK(!l.any_of(peer_plugin::piece_feature, [](peer_plugin&)
+		{ return true; }));
+	TEST_CHECK(!l.any_of([](peer_plugin&) { return false; }));
+}
+
+TORRENT_TEST(remove_updates_features)
+{
+	aux::extension_list<peer_plugin> l;
+	auto a = std::make_shared<test_plugin>(peer_plugin::have_feature);
+	auto b = std::make_shared<test_plugin>(peer_plugin::tick_feature);
+	l.push_back(a);
+	l.push_back(b);
+
+	l.erase(b.get());
+	TEST_EQUAL(l.size(), 1);
+	TEST_CHECK(!l.has(peer_plugin::tick_feature));
+	TEST_CHECK(l.has(peer_plugin::have_feature));
+
+	l.remove_if([](peer_plugin&) { return true; });
+	TEST_CHECK(l.empty());
+	TEST_CHECK(!l.has(peer_plugin::have_feature));
+
+	l.push_back(a);
+	l.clear();
+	TEST_CHECK(l.empty());
+	TEST_CHECK(!l.has(peer_plugin::have_feature));
+}
@@ -241,3 +241,129 @@ TORRENT_TEST(double_fence)
 	fence.job_complete(&test_job[9], jobs);
 }
 
+
+TORRENT_TEST(piece_fence)
+{
+	counters cnt;
+	disk_job_fence fence;
+
+	disk_io_job test_job[10];
+	for (int i = 0; i < 10; ++i) test_job[i].piece = piece_index_t(i < 5 ? 1 : 2);
+
+	// two jobs on piece 1, one on piece 2
+	TEST_CHECK(fence.is_blocked(&test_job[0]) == false);
+	TEST_CHECK(fence.is_blocked(&test_job[1]) == false);
+	TEST_CHECK(fence.is_blocked(&test_job[5]) == false);
+
+	// fence piece 1. The outstanding jobs on it have to complete first
+	test_job[2].action = disk_io_job::clear_piece;
+	test_job[3].action = disk_io_job::flush_piece;
+	int ret_int = fence.raise_piece_fence(&test_job[2], &test_job[3], cnt);
+	TEST_CHECK(ret_int == disk_job_fence::fence_post_flush);
+
+	// jobs on piece 1 are blocked, jobs on piece 2 are not
+	TEST_CHECK(fence.is_blocked(&test_job[4]) == true);
+	TEST_CHECK(fence.is_blocked(&test_job[6]) == false);
+
+	// jobs affecting the whole storage are blocked too
+	test_job[7].action = disk_io_job::flush_storage;
+	TEST_CHECK(fence.is_blocked(&test_job[7]) == true);
+	TEST_CHECK(fence.num_blocked() == 3);
+
+	tailqueue<disk_io_job> jobs;
+
+	// completing jobs on other pieces doesn't affect the fence
+	fence.job_complete(&test_job[5], jobs);
+	fence.job_complete(&test_job[6], jobs);
+	TEST_CHECK(jobs.size() == 0);
+
+	fence.job_complete(&test_job[0], jobs);
+	fence.job_complete(&test_job[1], jobs);
+	TEST_CHECK(jobs.size() == 0);
+
+	// the flush job was the last job on piece 1
+	fence.job_complete(&test_job[3], jobs);
+	TEST_CHECK(jobs.size() == 1);
+	TEST_CHECK(jobs.first() == &test_job[2]);
+	jobs.pop_front();
+
+	// a fence on a different piece can run in parallel
+	test_job[8].action = disk_io_job::clear_piece;
+	test_job[9].action = disk_io_job::flush_piece;
+	ret_int = fence.raise_piece_fence(&test_job[8], &test_job[9], cnt);
+	TEST_CHECK(ret_int == disk_job_fence::fence_post_fence);
+
+	// when the first fence completes, the job on its piece can run, but the
+	// storage job still has to wait for the second fence
+	fence.job_complete(&test_job[2], jobs);
+	TEST_CHECK(jobs.size() == 1);
+	TEST_CHECK(jobs.first() == &test_job[4]);
+	jobs.pop_front();
+	fence.job_complete(&test_job[4], jobs);
+	TEST_CHECK(jobs.size() == 0);
+
+	fence.job_complete(&test_job[8], jobs);
+	TEST_CHECK(jobs.size() == 1);
+	TEST_CHECK(jobs.first() == &test_job[7]);
+	jobs.pop_front();
+
+	fence.job_complete(&test_job[7], jobs);
+	TEST_CHECK(fence.num_outstanding_jobs() == 0);
+	TEST_CHECK(fence.num_blocked() == 0);
+
+	// test_job[9] was never issued (the second fence didn't need it)
+}
+
+TORRENT_TEST(piece_fence_behind_storage_fence)
+{
+	counters cnt;
+	disk_job_fence fence;
+
+	disk_io_job test_job[6];
+	for (auto& j : test_job) j.piece = piece_index_t(3);
+
+	TEST_CHECK(fence.is_blocked(&test_job[0]) == false);
+
+	// a fence for the whole storage
+	test_job[1].action = disk_io_job::release_files;
+	test_job[2].action = disk_io_job::flush_storage;
+	TEST_CHECK(fence.raise_fence(&test_job[1], &test_job[2], cnt)
+		== disk_job_fence::fence_post_flush);
+
+	// a piece fence raised after it has to wait for it
+	test_job[3].action = disk_io_job::clear_piece;
+	test_job[4].action = disk_io_job::flush_piece;
+	TEST_CHECK(fence.raise_piece_fence(&test_job[3], &test_job[4], cnt)
+		== disk_job_fence::fence_post_none);
+
+	// and so does everything else
+	test_job[5].piece = piece_index_t(4);
+	TEST_CHECK(fence.is_blocked(&test_job[5]) == true);
+
+	tailqueue<disk_io_job> jobs;
+	fence.job_complete(&test_job[0], jobs);
+	TEST_CHECK(jobs.size() == 0);
+	fence.job_complete(&test_job[2], jobs);
+	TEST_CHECK(jobs.size() == 1);
+	TEST_CHECK(jobs.first() == &test_job[1]);
+	jobs.pop_front();
+
+	// once the storage fence completes, the flush job of the piece fence is
+	// issued, as well as the job on the other piece
+	fence.job_complete(&test_job[1], jobs);
+	TEST_CHECK(jobs.size() == 2);
+	TEST_CHECK(jobs.first() == &test_job[4]);
+	jobs.pop_front();
+	TEST_CHECK(jobs.first() == &test_job[5]);
+	jobs.pop_front();
+
+	fence.job_complete(&test_job[4], jobs);
+	TEST_CHECK(jobs.size() == 1);
+	TEST_CHECK(jobs.first() == &test_job[3]);
+	jobs.pop_front();
+
+	fence.job_complete(&test_job[3], jobs);
+	fence.job_complete(&test_job[5], jobs);
+	TEST_CHECK(jobs.size() == 0);
+	TEST_CHECK(fence.num_outstanding_jobs() == 0);
+}
@@ -31,13 +31,16 @@ POSSIBILITY OF SUCH DAMAGE.
 */
 
 #include "libtorrent/file.hpp"
+#include "libtorrent/aux_/io_uring.hpp"
 #include "libtorrent/aux_/path.hpp"
 #include "libtorrent/string_util.hpp" // for split_string
 #include "libtorrent/string_view.hpp"
+#include "libtorrent/allocator.hpp"
 #include "test.hpp"
 #include <vector>
 #include <set>
 #include <thread>
+#include <algorithm>
 
 namespace lt = libtorrent;
 using namespace libtorrent;
@@ -360,6 +363,127 @@ TORRENT_TEST(hard_link)
 		std::printf("remove failed: [%s] %s\n", ec.category().name(), ec.message().c_str());
 }
 
+namespace {
+
+std::vector<char> read_all(std::string const& filename)
+{
+	error_code ec;
+	file_status st;
+	stat_file(filename, &st, ec);
+	if (ec) return {};
+	std::vector<char> ret(std::size_t(st.file_size));
+	if (ret.empty()) return ret;
+	file f;
+	if (!f.open(filename, file::read_only, ec)) return {};
+	iovec_t b = {ret.data(), ret.size()};
+	if (f.readv(0, b, ec) != std::int64_t(ret.size())) return {};
+	return ret;
+}
+
+} // anonymous namespace
+
+TORRENT_TEST(copy_file)
+{
+	// larger than the buffer used when the kernel can't copy the file
+	int const size = 1024 * 1024 + 17;
+	TEST_EQUAL(touch_file("copy_file_src", size), 0);
+
+	// copying to an existing, larger file replaces its contents
+	TEST_EQUAL(touch_file("copy_file_dst", size * 2), 0);
+
+	error_code ec;
+	copy_file("copy_file_src", "copy_file_dst", ec);
+	TEST_EQUAL(ec, error_code());
+
+	std::vector<char> const src = read_all("copy_file_src");
+	std::vector<char> const dst = read_all("copy_file_dst");
+	TEST_EQUAL(int(src.size()), size);
+	TEST_CHECK(src == dst);
+
+	// empty files
+	TEST_EQUAL(touch_file("copy_file_empty", 0), 0);
+	copy_file("copy_file_empty", "copy_file_dst", ec);
+	TEST_EQUAL(ec, error_code());
+	TEST_CHECK(read_all("copy_file_dst").empty());
+
+	copy_file("copy_file_does_not_exist", "copy_file_dst2", ec);
+	TEST_CHECK(ec);
+
+	remove("copy_file_src", ec);
+	remove("copy_file_dst", ec);
+	remove("copy_file_empty", ec);
+}
+
+TORRENT_TEST(sparse_end)
+{
+	error_code ec;
+	file f;
+	TEST_CHECK(f.open("sparse_file", file::read_write | file::sparse, ec));
+	TEST_EQUAL(ec, error_code());
+
+	std::int64_t const file_size = 10 * 1024 * 1024;
+	std::int64_t const data_offset = 8 * 1024 * 1024;
+	TEST_CHECK(f.set_size(file_size, ec));
+	TEST_EQUAL(ec, error_code());
+
+	char buf[0x4000];
+	std::memset(buf, 1, sizeof(buf));
+	iovec_t b = {buf, sizeof(buf)};
+	TEST_EQUAL(f.writev(data_offset, b, ec), int(sizeof(buf)));
+	TEST_EQUAL(ec, error_code());
+
+	// file systems that don't support sparse files (or querying for holes)
+	// report everything as data
+	std::int64_t const hole_end = f.sparse_end(0);
+	TEST_CHECK(hole_end == 0 || (hole_end > 0 && hole_end <= data_offset));
+
+	// the start of the data region is not a hole
+	TEST_EQUAL(f.sparse_end(data_offset), data_offset);
+
+	// after the data region, there are no more data regions
+	std::int64_t const tail = f.sparse_end(data_offset + 0x100000);
+	TEST_CHECK(tail == data_offset + 0x100000 || tail == file_size);
+
+	f.close();
+	remove("sparse_file", ec);
+}
+
+TORRENT_TEST(reserve)
+{
+	error_code ec;
+	file f;
+	TEST_CHECK(f.open("reserve_file", file::read_write, ec));
+	TEST_EQUAL(ec, error_code());
+
+	// reserving space at the end extends the file
+	bool const supported = f.reserve(0x100000, 0x10000, ec);
+	TEST_EQUAL(ec, error_code());
+	if (!supported)
+	{
+		std::printf("reserving space not supported\n");
+		TEST_EQUAL(f.get_size(ec), 0);
+	}
+	else
+	{
+		TEST_EQUAL(f.get_size(ec), 0x110000);
+
+		// reserving space within the file doesn't change its size or contents
+		char buf[0x4000];
+		std::memset(buf, 0x55, sizeof(buf));
+		iovec_t b = {buf, sizeof(buf)};
+		TEST_EQUAL(f.writev(0, b, ec), int(sizeof(buf)));
+		TEST_CHECK(f.reserve(0, 0x100000, ec));
+		TEST_EQUAL(ec, error_code());
+		TEST_EQUAL(f.get_size(ec), 0x110000);
+		std::memset(buf, 0, sizeof(buf));
+		TEST_EQUAL(f.readv(0, b, ec), int(sizeof(buf)));
+		TEST_CHECK(std::count(buf, buf + sizeof(buf), 0x55) == int(sizeof(buf)));
+	}
+
+	f.close();
+	remove("reserve_file", ec);
+}
+
 TORRENT_TEST(coalesce_buffer)
 {
 	error_code ec;
@@ -392,6 +516,129 @@ TORRENT_TEST(coalesce_buffer)
 	f.close();
 }
 
+TORRENT_TEST(io_uring_batch)
+{
+	error_code ec;
+	remove("test_file_batch", ec);
+	ec.clear();
+	lt::file_handle f = std::make_shared<file>("test_file_batch", file::read_write, ec);
+	if (ec)
+		std::printf("open failed: [%s] %s\n", ec.category().name(), ec.message().c_str());
+	TEST_EQUAL(ec, error_code());
+
+	char data[64];
+	for (int i = 0; i < int(sizeof(data)); ++i) data[i] = char(i);
+	iovec_t b = {data, sizeof(data)};
+	TEST_EQUAL(f->writev(0, b, ec), int(sizeof(data)));
+	TEST_EQUAL(ec, error_code());
+
+	// use a queue depth smaller than the batch, to have it submitted in
+	// chunks
+	aux::io_uring_batch batch(2);
+
+	char buf1[16] = {0};
+	char buf2[8] = {0};
+	char buf3[8] = {0};
+	char buf4[16] = {0};
+	iovec_t b1 = {buf1, sizeof(buf1)};
+	iovec_t b2[2] = {{buf2, sizeof(buf2)}, {buf3, sizeof(buf3)}};
+	iovec_t b4 = {buf4, sizeof(buf4)};
+	batch.add_readv(f, 0, b1, 0);
+	batch.add_readv(f, 32, b2, 1);
+	// this read extends past the end of the file
+	batch.add_readv(f, 56, b4, 2);
+	TEST_EQUAL(batch.size(), 3);
+
+	int bytes[3] = {0, 0, 0};
+	error_code errors[3];
+	batch.run([&](int const tag, int const n, error_code const& e)
+	{
+		TEST_CHECK(tag >= 0 && tag < 3);
+		bytes[tag] = n;
+		errors[tag] = e;
+	});
+	TEST_CHECK(batch.empty());
+
+	TEST_EQUAL(bytes[0], 16);
+	TEST_EQUAL(errors[0], error_code());
+	TEST_CHECK(std::memcmp(buf1, data, 16) == 0);
+	TEST_EQUAL(bytes[1], 16);
+	TEST_EQUAL(errors[1], error_code());
+	TEST_CHECK(std::memcmp(buf2, data + 32, 8) == 0);
+	TEST_CHECK(std::memcmp(buf3, data + 40, 8) == 0);
+	TEST_CHECK(errors[2]);
+
+	// writes
+	char const new_data[] = "abcdefgh";
+	iovec_t w = {const_cast<char*>(new_data), 8};
+	batch.add_writev(f, 64, w, 0);
+	batch.run([&](int, int const n, error_code const& e)
+	{
+		TEST_EQUAL(n, 8);
+		TEST_EQUAL(e, error_code());
+	});
+
+	char check[8] = {0};
+	iovec_t c = {check, sizeof(check)};
+	TEST_EQUAL(f->readv(64, c, ec), 8);
+	TEST_CHECK(std::memcmp(check, new_data, 8) == 0);
+	f->close();
+}
+
+TORRENT_TEST(direct_io)
+{
+	error_code ec;
+	remove("test_file_direct", ec);
+	ec.clear();
+	file f;
+	TEST_CHECK(f.open("test_file_direct", file::read_write | file::direct_io, ec));
+	if (ec)
+		std::printf("open failed: [%s] %s\n", ec.category().name(), ec.message().c_str());
+	TEST_EQUAL(ec, error_code());
+
+	std::vector<char> data(3 * 4096 + 100);
+	for (int i = 0; i < int(data.size()); ++i) data[i] = char(i * 7);
+
+	// an unaligned write that grows the file
+	iovec_t b = {data.data() + 1, data.size() - 1};
+	TEST_EQUAL(f.writev(1, b, ec), int(data.size()) - 1);
+	TEST_EQUAL(ec, error_code());
+	b = {data.data(), 1};
+	TEST_EQUAL(f.writev(0, b, ec), 1);
+	TEST_EQUAL(ec, error_code());
+	TEST_EQUAL(f.get_size(ec), std::int64_t(data.size()));
+
+	// an unaligned write in the middle, patching partial blocks on both ends
+	std::vector<char> patch(5000, 'x');
+	std::copy(patch.begin(), patch.end(), data.begin() + 3000);
+	b = {patch.data(), patch.size()};
+	TEST_EQUAL(f.writev(3000, b, ec), int(patch.size()));
+	TEST_EQUAL(ec, error_code());
+
+	// an aligned write from an aligned buffer takes the fast path
+	char* aligned = page_aligned_allocator::malloc(4096);
+	std::memset(aligned, 'y', 4096);
+	std::memset(data.data() + 8192, 'y', 4096);
+	b = {aligned, 4096};
+	TEST_EQUAL(f.writev(8192, b, ec), 4096);
+	TEST_EQUAL(ec, error_code());
+	page_aligned_allocator::free(aligned);
+
+	TEST_EQUAL(f.get_size(ec), std::int64_t(data.size()));
+
+	std::vector<char> check(data.size() + 50);
+	iovec_t c[2] = {{check.data(), 17}, {check.data() + 17, check.size() - 17}};
+	// reading past the end of the file returns what's there
+	TEST_EQUAL(f.readv(0, c, ec), int(data.size()));
+	TEST_EQUAL(ec, error_code());
+	TEST_CHECK(std::equal(data.begin(), data.end(), check.begin()));
+
+	c[0] = {check.data(), 10};
+	TEST_EQUAL(f.readv(4095, {c, 1}, ec), 10);
+	TEST_CHECK(std::equal(check.begin(), check.begin() + 10, data.begin() + 4095));
+	f.close();
+}
+
 TORRENT_TEST(stat_file)
 {
 	file_status st;
@@ -0,0 +1,157 @@
+/*
+
+Copyright (c) 2017, Arvid Norberg
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions
+are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in
+      the documentation and/or other materials provided with the distribution.
+    * Neither the name of the author nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+
+#include "libtorrent/file_pool.hpp"
+#include "libtorrent/file_storage.hpp"
+#include "libtorrent/aux_/path.hpp"
+#include "libtorrent/aux_/time.hpp"
+#include "test.hpp"
+
+#include <thread>
+#include <chrono>
+
+using namespace libtorrent;
+
+namespace {
+
+file_storage make_files(int const num_files)
+{
+	file_storage fs;
+	for (int i = 0; i < num_files; ++i)
+		fs.add_file("file_pool_test/" + std::to_string(i), 10);
+	return fs;
+}
+
+// advances the cached clock the file pool uses to order its files by
+void tick()
+{
+	std::this_thread::sleep_for(std::chrono::milliseconds(2));
+	aux::update_time_now();
+}
+
+std::vector<int> open_files(file_pool const& fp, storage_index_t const st)
+{
+	std::vector<int> ret;
+	for (auto const& s : fp.get_status(st))
+		ret.push_back(static_cast<int>(s.file_index));
+	return ret;
+}
+
+void open(file_pool& fp, storage_index_t const st, file_storage const& fs, int const f)
+{
+	error_code ec;
+	std::string const p = complete(".");
+	auto const h = fp.open_file(st, p, file_index_t(f), fs, file::read_write, ec);
+	TEST_CHECK(!ec);
+	TEST_CHECK(h);
+	tick();
+}
+
+} // anonymous namespace
+
+TORRENT_TEST(file_pool_lru)
+{
+	error_code ec;
+	create_directory("file_pool_test", ec);
+	file_storage const fs = make_files(5);
+
+	// the pool closes a file once it holds as many as its limit
+	file_pool fp(4);
+	open(fp, storage_index_t(0), fs, 0);
+	open(fp, storage_index_t(0), fs, 1);
+	open(fp, storage_index_t(0), fs, 2);
+	TEST_CHECK((open_files(fp, storage_index_t(0)) == std::vector<int>{0, 1, 2}));
+
+	// using file 0 again makes file 1 the least recently used one
+	open(fp, storage_index_t(0), fs, 0);
+	open(fp, storage_index_t(0), fs, 3);
+	TEST_CHECK((open_files(fp, storage_index_t(0)) == std::vector<int>{0, 2, 3}));
+
+	fp.release(storage_index_t(0), file_index_t(2));
+	TEST_CHECK((open_files(fp, storage_index_t(0)) == std::vector<int>{0, 3}));
+}
+
+TORRENT_TEST(file_pool_storages)
+{
+	error_code ec;
+	create_directory("file_pool_test", ec);
+	file_storage const fs = make_files(5);
+
+	// files of different storages compete for the same limit, and the least
+	// recently used file of any storage is the one closed
+	file_pool fp(4);
+	open(fp, storage_index_t(0), fs, 0);
+	open(fp, storage_index_t(1), fs, 0);
+	open(fp, storage_index_t(2), fs, 0);
+	open(fp, storage_index_t(0), fs, 0);
+	open(fp, storage_index_t(2), fs, 1);
+	TEST_CHECK(open_files(fp, storage_index_t(1)).empty());
+	TEST_CHECK((open_files(fp, storage_index_t(0)) == std::vector<int>{0}));
+	TEST_CHECK((open_files(fp, storage_index_t(2)) == std::vector<int>{0, 1}));
+
+	// storages sharing a shard don't see each other's files
+	storage_index_t const st8(8);
+	open(fp, st8, fs, 4);
+	TEST_CHECK((open_files(fp, st8) == std::vector<int>{4}));
+	TEST_CHECK((open_files(fp, storage_index_t(0)) == std::vector<int>{0}));
+	TEST_CHECK((open_files(fp, storage_index_t(2)) == std::vector<int>{1}));
+
+	fp.release(storage_index_t(2));
+	TEST_CHECK(open_files(fp, storage_index_t(2)).empty());
+	TEST_CHECK((open_files(fp, st8) == std::vector<int>{4}));
+
+	fp.resize(1);
+	TEST_CHECK(open_files(fp, storage_index_t(0)).empty());
+	TEST_CHECK((open_files(fp, st8) == std::vector<int>{4}));
+}
+
+TORRENT_TEST(file_pool_close_oldest)
+{
+	error_code ec;
+	create_directory("file_pool_test", ec);
+	file_storage const fs = make_files(5);
+
+	file_pool fp(10);
+	open(fp, storage_index_t(0), fs, 0);
+	open(fp, storage_index_t(1), fs, 1);
+	open(fp, storage_index_t(0), fs, 2);
+
+	// close_oldest() goes by the time a file was opened, not used
+	open(fp, storage_index_t(0), fs, 0);
+	fp.close_oldest();
+	TEST_CHECK((open_files(fp, storage_index_t(0)) == std::vector<int>{2}));
+	TEST_CHECK((open_files(fp, storage_index_t(1)) == std::vector<int>{1}));
+
+	fp.release();
+	TEST_CHECK(open_files(fp, storage_index_t(1)).empty());
+}
@@ -34,6 +34,8 @@ POSSIBILITY OF SUCH DAMAGE.
 #include "libtorrent/aux_/file_progress.hpp"
 #include "libtorrent/file_storage.hpp"
 #include "libtorrent/piece_picker.hpp"
+#include "libtorrent/piece_block.hpp"
+#include "libtorrent/torrent_handle.hpp"
 
 using namespace libtorrent;
 
@@ -61,7 +63,7 @@ TORRENT_TEST(init)
 		picker.we_have(idx);
 
 		aux::file_progress fp;
-		fp.init(picker, fs);
+		fp.init(picker, fs, piece_size / 4);
 
 		aux::vector<std::int64_t, file_index_t> vec;
 		fp.export_progress(vec);
@@ -95,7 +97,7 @@ TORRENT_TEST(init2)
 		aux::vector<std::int64_t, file_index_t> vec;
 		aux::file_progress fp;
 
-		fp.init(picker, fs);
+		fp.init(picker, fs, piece_size / 4);
 		fp.export_progress(vec);
 
 		std::uint64_t sum = 0;
@@ -106,5 +108,126 @@ TORRENT_TEST(init2)
 	}
 }
 
-// TODO: test the update function too
+namespace {
+
+std::int64_t sum_progress(aux::file_progress& fp, bool blocks)
+{
+	aux::vector<std::int64_t, file_index_t> vec;
+	fp.export_progress(vec, blocks);
+	std::int64_t sum = 0;
+	for (file_index_t i(0); i < vec.end_index(); ++i)
+		sum += vec[i];
+	return sum;
+}
+
+}
+
+TORRENT_TEST(blocks)
+{
+	const int piece_size = 256;
+	const int block_size = piece_size / 4;
+
+	file_storage fs;
+	fs.add_file("torrent/1", 100);
+	fs.add_file("torrent/2", 10);
+	fs.add_file("torrent/3", 500);
+	fs.set_piece_length(piece_size);
+	fs.set_num_pieces((int(fs.total_size()) + piece_size - 1) / piece_size);
+
+	piece_picker picker;
+	picker.init(4, 2, fs.num_pieces());
+
+	aux::file_progress fp;
+	fp.init(picker, fs, block_size);
+	TEST_EQUAL(sum_progress(fp, true), 0);
+
+	// the second block straddles the first two files and the third one
+	fp.add_block(fs, piece_block(piece_index_t(0), 1));
+	TEST_EQUAL(sum_progress(fp, true), block_size);
+	TEST_EQUAL(sum_progress(fp, false), 0);
+
+	aux::vector<std::int64_t, file_index_t> vec;
+	fp.export_progress(vec, true);
+	TEST_EQUAL(vec[file_index_t(0)], 100 - block_size);
+	TEST_EQUAL(vec[file_index_t(1)], 10);
+	TEST_EQUAL(vec[file_index_t(2)], 2 * block_size - 110);
+
+	// adding the same block twice is a no-op
+	fp.add_block(fs, piece_block(piece_index_t(0), 1));
+	TEST_EQUAL(sum_progress(fp, true), block_size);
+
+	fp.add_block(fs, piece_block(piece_index_t(0), 0));
+	TEST_EQUAL(sum_progress(fp, true), 2 * block_size);
+
+	fp.remove_block(fs, piece_block(piece_index_t(0), 0));
+	TEST_EQUAL(sum_progress(fp, true), block_size);
+
+	// removing a block that isn't there is a no-op too
+	fp.remove_block(fs, piece_block(piece_index_t(0), 0));
+	TEST_EQUAL(sum_progress(fp, true), block_size);
+
+	// the last block of the last piece is short
+	fp.add_block(fs, piece_block(piece_index_t(2), 1));
+	TEST_EQUAL(sum_progress(fp, true), block_size + 610 - 2 * piece_size - block_size);
+
+	fp.remove_piece_blocks(fs, piece_index_t(2));
+	TEST_EQUAL(sum_progress(fp, true), block_size);
+
+	// when the piece passes, its blocks are folded into the piece progress
+	fp.add_block(fs, piece_block(piece_index_t(0), 3));
+	fp.update(fs, piece_index_t(0), nullptr, torrent_handle());
+	TEST_EQUAL(sum_progress(fp, false), piece_size);
+	TEST_EQUAL(sum_progress(fp, true), piece_size);
+}
+
+TORRENT_TEST(init_blocks)
+{
+	const int piece_size = 256;
+	const int block_size = piece_size / 4;
+
+	file_storage fs;
+	fs.add_file("torrent/1", 300);
+	fs.add_file("torrent/2", 300);
+	fs.set_piece_length(piece_size);
+	fs.set_num_pieces((int(fs.total_size()) + piece_size - 1) / piece_size);
+
+	piece_picker picker;
+	picker.init(4, 2, fs.num_pieces());
+	picker.mark_as_finished(piece_block(piece_index_t(1), 0), nullptr);
+	picker.mark_as_finished(piece_block(piece_index_t(1), 2), nullptr);
+
+	aux::file_progress fp;
+	fp.init(picker, fs, block_size);
+	TEST_EQUAL(sum_progress(fp, false), 0);
+	TEST_EQUAL(sum_progress(fp, true), 2 * block_size);
+
+	aux::vector<std::int64_t, file_index_t> vec;
+	fp.export_progress(vec, true);
+	TEST_EQUAL(vec[file_index_t(0)], 300 - piece_size);
+	TEST_EQUAL(vec[file_index_t(1)], 2 * block_size - (300 - piece_size));
+}
+
+TORRENT_TEST(block_bytes)
+{
+	const int piece_size = 256;
+	const int block_size = piece_size / 4;
+
+	file_storage fs;
+	fs.add_file("torrent/1", 70);
+	fs.add_file("torrent/2", 300);
+	fs.set_piece_length(piece_size);
+	fs.set_num_pieces((int(fs.total_size()) + piece_size - 1) / piece_size);
+
+	piece_picker picker;
+	picker.init(4, 2, fs.num_pieces());
+
+	aux::file_progress fp;
+	fp.init(picker, fs, block_size);
+
+	aux::vector<std::int64_t, file_index_t> vec;
+	fp.export_progress(vec, true);
+	fp.add_block_bytes(fs, vec, piece_block(piece_index_t(0), 1), 10);
+	TEST_EQUAL(vec[file_index_t(0)], 6);
+	TEST_EQUAL(vec[file_index_t(1)], 4);
+}
 
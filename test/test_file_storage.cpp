@@ -34,6 +34,8 @@ POSSIBILITY OF SUCH DAMAGE.
 #include "setup_transfer.hpp"
 
 #include "libtorrent/file_storage.hpp"
+#include "libtorrent/torrent_info.hpp"
+#include "libtorrent/bencode.hpp"
 #include "libtorrent/aux_/path.hpp"
 
 using namespace libtorrent;
@@ -368,12 +370,140 @@ TORRENT_TEST(piece_range)
 	TEST_CHECK(aux::file_piece_range_exclusive(fs, file_index_t(1)) == std::make_tuple(piece_index_t(3), piece_index_t(7)));
 }
 
+TORRENT_TEST(map_block_piece_index)
+{
+	// many small files, some of them empty, and some spanning several pieces.
+	// torrent_info builds the piece to file index for its file_storage, the
+	// results must be the same as for the plain file_storage without it
+	int const piece_size = 0x4000;
+	file_storage fs;
+	entry info;
+	info["name"] = "test";
+	info["piece length"] = piece_size;
+	entry::list_type& files = info["files"].list();
+	for (int i = 0; i < 300; ++i)
+	{
+		std::int64_t const size = (i % 7) == 0 ? 0 : (i * 997) % 40000 + 1;
+		std::string const name = "f" + std::to_string(i);
+		fs.add_file(combine_path("test", name), size);
+		entry f;
+		f["length"] = size;
+		f["path"].list().push_back(name);
+		files.push_back(f);
+	}
+	fs.set_piece_length(piece_size);
+	fs.set_num_pieces(int((fs.total_size() + piece_size - 1) / piece_size));
+	info["pieces"] = std::string(std::size_t(fs.num_pieces()) * 20, 'a');
+
+	entry torrent;
+	torrent["info"] = info;
+	std::vector<char> buf;
+	bencode(std::back_inserter(buf), torrent);
+	error_code ec;
+	torrent_info ti(buf.data(), int(buf.size()), ec);
+	TEST_CHECK(!ec);
+	file_storage const& indexed = ti.files();
+	TEST_EQUAL(indexed.num_files(), fs.num_files());
+	TEST_EQUAL(indexed.num_pieces(), fs.num_pieces());
+
+	int const offsets[] = {0, 1, 1000, piece_size - 1};
+	for (piece_index_t p(0); p < fs.end_piece(); ++p)
+	{
+		for (int const off : offsets)
+		{
+			int const size = std::min(fs.piece_size(p) - std::min(off, fs.piece_size(p)), 0x4000);
+			if (size <= 0) continue;
+			std::vector<file_slice> const expected = fs.map_block(p, off, size);
+			std::vector<file_slice> const actual = indexed.map_block(p, off, size);
+			TEST_EQUAL(expected.size(), actual.size());
+			for (std::size_t i = 0; i < std::min(expected.size(), actual.size()); ++i)
+			{
+				TEST_EQUAL(expected[i].file_index, actual[i].file_index);
+				TEST_EQUAL(expected[i].offset, actual[i].offset);
+				TEST_EQUAL(expected[i].size, actual[i].size);
+			}
+
+			std::int64_t const torrent_offset = static_cast<int>(p) * std::int64_t(piece_size) + off;
+			file_index_t const f = indexed.file_index_at_offset(torrent_offset);
+			TEST_EQUAL(f, fs.file_index_at_offset(torrent_offset));
+			// the file must actually contain the offset (i.e. not be empty)
+			TEST_CHECK(indexed.file_offset(f) <= torrent_offset);
+			TEST_CHECK(indexed.file_offset(f) + indexed.file_size(f) > torrent_offset);
+		}
+	}
+}
+
+TORRENT_TEST(file_name_pool)
+{
+	file_storage fs;
+	fs.set_piece_length(0x4000);
+	for (int i = 0; i < 100; ++i)
+	{
+		fs.add_file(combine_path("test", combine_path("dir-" + std::to_string(i % 3)
+			, "file-" + std::to_string(i))), 10);
+	}
+	fs.set_num_pieces(int((fs.total_size() + 0x3fff) / 0x4000));
+
+	// files in the same directory share the path entry
+	TEST_EQUAL(fs.paths().size(), 3);
+	fs.rename_file(file_index_t(4), combine_path("test", combine_path("dir-0", "renamed")));
+
+	file_storage copy(fs);
+	// names added to the copy must not clobber the ones in the original
+	copy.rename_file(file_index_t(5), combine_path("test", combine_path("new-dir", "x")));
+	copy.add_file(combine_path("test", combine_path("dir-1", "file-100")), 10);
+	TEST_EQUAL(copy.paths().size(), 4);
+	TEST_EQUAL(fs.paths().size(), 3);
+
+	for (file_index_t i(0); i < fs.end_file(); ++i)
+	{
+		std::string const name = "file-" + std::to_string(static_cast<int>(i));
+		if (i == file_index_t(4))
+		{
+			TEST_EQUAL(fs.file_name(i), "renamed");
+		}
+		else
+		{
+			TEST_EQUAL(fs.file_name(i), name);
+		}
+		if (i == file_index_t(5))
+		{
+			TEST_EQUAL(copy.file_name(i), "x");
+		}
+		else
+		{
+			TEST_EQUAL(copy.file_name(i), fs.file_name(i));
+		}
+	}
+	TEST_EQUAL(copy.file_name(file_index_t(100)), "file-100");
+	TEST_EQUAL(copy.file_path(file_index_t(100))
+		, combine_path("test", combine_path("dir-1", "file-100")));
+
+	// the copy keeps the names alive after the original is gone
+	fs = file_storage();
+	TEST_EQUAL(copy.file_name(file_index_t(0)), "file-0");
+	TEST_EQUAL(copy.file_path(file_index_t(4))
+		, combine_path("test", combine_path("dir-0", "renamed")));
+}
+
 // TODO: test file_storage::optimize
-// TODO: test map_block
 // TODO: test piece_size(int piece)
-// TODO: test file_index_at_offset
 // TODO: test file attributes
 // TODO: test symlinks
 // TODO: test pad_files
 // TODO: test reorder_file (make sure internal_file_entry::swap() is used)
 
+
+TORRENT_TEST(memory_usage)
+{
+	file_storage fs;
+	fs.set_piece_length(0x4000);
+	std::size_t const empty = fs.memory_usage();
+	TEST_CHECK(empty >= sizeof(file_storage));
+
+	for (int i = 0; i < 100; ++i)
+		fs.add_file(combine_path("test", "file-" + std::to_string(i)), 10);
+
+	// at least the file entries themselves are accounted for
+	TEST_CHECK(fs.memory_usage() >= empty + 100 * sizeof(internal_file_entry));
+}
@@ -0,0 +1,85 @@
+/*
+
+Copyright (c) 2017, Arvid Norberg
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions
+are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in
+      the documentation and/or other materials provided with the distribution.
+    * Neither the name of the author nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+
+#include "test.hpp"
+#include "libtorrent/aux_/frequency_sketch.hpp"
+
+using namespace libtorrent;
+
+TORRENT_TEST(frequency_sketch_estimate)
+{
+	aux::frequency_sketch s(100);
+
+	TEST_EQUAL(s.estimate(1), 0);
+
+	for (int i = 0; i < 5; ++i) s.increment(1);
+	s.increment(2);
+
+	// the estimate may be too high, but never too low
+	TEST_CHECK(s.estimate(1) >= 5);
+	TEST_CHECK(s.estimate(2) >= 1);
+	TEST_CHECK(s.estimate(1) > s.estimate(2));
+}
+
+TORRENT_TEST(frequency_sketch_saturate)
+{
+	aux::frequency_sketch s(100);
+
+	// the counters are 4 bits
+	for (int i = 0; i < 100; ++i) s.increment(42);
+	TEST_EQUAL(s.estimate(42), 15);
+}
+
+TORRENT_TEST(frequency_sketch_aging)
+{
+	aux::frequency_sketch s(16);
+	TEST_EQUAL(s.sample_size(), 160);
+
+	for (int i = 0; i < 8; ++i) s.increment(7);
+	int const before = s.estimate(7);
+	TEST_CHECK(before >= 8);
+
+	// once the sample size is reached, all counters are halved
+	for (std::uint64_t k = 1000; k < 1160; ++k) s.increment(k);
+	TEST_CHECK(s.estimate(7) < before);
+	TEST_CHECK(s.estimate(7) >= 4);
+}
+
+TORRENT_TEST(frequency_sketch_resize)
+{
+	aux::frequency_sketch s(16);
+	for (int i = 0; i < 3; ++i) s.increment(3);
+	s.resize(1000);
+	TEST_EQUAL(s.estimate(3), 0);
+	TEST_EQUAL(s.sample_size(), 10000);
+}
@@ -35,6 +35,10 @@ POSSIBILITY OF SUCH DAMAGE.
 #include "setup_transfer.hpp" // for load_file
 #include "libtorrent/aux_/path.hpp" // for combine_path
 
+#include <cstdio> // for snprintf
+#include <cstdint>
+#include <string>
+
 using namespace libtorrent;
 
 TORRENT_TEST(zeroes)
@@ -74,3 +78,71 @@ TORRENT_TEST(corrupt)
 	TEST_CHECK(ec);
 }
 
+
+namespace {
+
+// the gzip (with a dynamic huffman block) of what expected_payload() returns
+std::uint8_t const peers_gz[] = {
+	0x1f, 0x8b, 0x08, 0x00, 0x00, 0x00, 0x00, 0x00, 0x02, 0x03, 0xed, 0xd3,
+	0xb1, 0x0d, 0x03, 0x20, 0x0c, 0x44, 0xd1, 0x85, 0x52, 0x60, 0x03, 0xc6,
+	0x64, 0x9f, 0xf4, 0x51, 0xf6, 0x2f, 0x12, 0x68, 0xbe, 0x37, 0x48, 0x73,
+	0xdd, 0x55, 0x4f, 0x42, 0xe6, 0xbf, 0x5f, 0xaf, 0x4f, 0x7b, 0x46, 0xa6,
+	0x3d, 0xde, 0xbf, 0x69, 0x67, 0xfa, 0x9d, 0x7e, 0x66, 0xbf, 0xb3, 0x9f,
+	0x39, 0xee, 0x1c, 0x67, 0xce, 0x3b, 0xe7, 0x99, 0x71, 0x67, 0x9c, 0xb9,
+	0xee, 0x5c, 0x60, 0x09, 0xb6, 0xc1, 0xac, 0xa1, 0x35, 0x34, 0x43, 0x73,
+	0xb4, 0x8e, 0x36, 0xd0, 0x26, 0x5a, 0x80, 0x2d, 0xb0, 0x04, 0xdb, 0x60,
+	0x56, 0x1e, 0xda, 0xd0, 0x0c, 0xcd, 0xd1, 0x3a, 0xda, 0x40, 0x9b, 0x68,
+	0x01, 0xb6, 0xc0, 0x12, 0x6c, 0x83, 0x59, 0x79, 0x68, 0x43, 0x33, 0x34,
+	0x47, 0xeb, 0x68, 0x03, 0x6d, 0xa2, 0x05, 0xd8, 0x02, 0x4b, 0xb0, 0x5d,
+	0x0e, 0x5a, 0x1e, 0xda, 0xca, 0x11, 0xd0, 0x1c, 0xad, 0xa3, 0x0d, 0xb4,
+	0x89, 0x16, 0x60, 0x0b, 0x2c, 0xc1, 0x76, 0x39, 0x68, 0x79, 0x68, 0x2b,
+	0x47, 0x40, 0x73, 0xb4, 0x8e, 0x36, 0xd0, 0x26, 0x5a, 0x80, 0x2d, 0xb0,
+	0x04, 0xdb, 0xe5, 0xa0, 0xe5, 0xa1, 0xe5, 0xb3, 0x19, 0x9a, 0xa3, 0x75,
+	0xb4, 0x81, 0x36, 0xd1, 0x02, 0x6c, 0x81, 0x25, 0xd8, 0x2e, 0x07, 0x2d,
+	0x0f, 0x55, 0x55, 0xaa, 0x4a, 0x55, 0xa9, 0x2a, 0x55, 0xa5, 0xaa, 0x54,
+	0x95, 0xaa, 0x52, 0x55, 0xaa, 0x4a, 0x55, 0xa9, 0x2a, 0x55, 0xa5, 0xaa,
+	0x54, 0x95, 0xaa, 0x52, 0x55, 0xaa, 0x4a, 0x55, 0xa9, 0x2a, 0x55, 0xa5,
+	0xaa, 0xfe, 0x55, 0xd5, 0x17, 0x5c, 0xec, 0xd4, 0x5d, 0xfe, 0x19, 0x00,
+	0x00,
+};
+
+std::string expected_payload()
+{
+	std::string ret;
+	char buf[30];
+	for (int i = 0; i < 600; ++i)
+	{
+		std::snprintf(buf, sizeof(buf), "peer%d:%d,", i % 11, 6881 + i % 7);
+		ret += buf;
+	}
+	return ret;
+}
+
+}
+
+TORRENT_TEST(dynamic_block)
+{
+	std::string const expected = expected_payload();
+	// inflates to more than the initial guess, as well as to exactly the
+	// maximum size
+	for (int const max_size : {1000000, int(expected.size())})
+	{
+		std::vector<char> inflated;
+		error_code ec;
+		inflate_gzip(reinterpret_cast<char const*>(peers_gz), int(sizeof(peers_gz))
+			, inflated, max_size, ec);
+		TEST_CHECK(!ec);
+		TEST_CHECK(inflated.size() == expected.size());
+		TEST_CHECK(std::string(inflated.begin(), inflated.end()) == expected);
+	}
+}
+
+TORRENT_TEST(too_large)
+{
+	std::string const expected = expected_payload();
+	std::vector<char> inflated;
+	error_code ec;
+	inflate_gzip(reinterpret_cast<char const*>(peers_gz), int(sizeof(peers_gz))
+		, inflated, int(expected.size()) - 1, ec);
+	TEST_CHECK(ec == error_code(gzip_errors::inflated_data_too_large));
+}
@@ -33,6 +33,9 @@ POSSIBILITY OF SUCH DAMAGE.
 #include "libtorrent/hasher.hpp"
 #include "libtorrent/hex.hpp"
 
+#include <vector>
+#include <string>
+
 #include "test.hpp"
 
 using namespace libtorrent;
@@ -123,3 +126,65 @@ TORRENT_TEST(hasher_test_vec1)
 		, 16777216
 	);
 }
+
+// feed the input in chunks of varying sizes, to exercise hashing partial
+// blocks as well as runs of several whole blocks at a time
+TORRENT_TEST(hasher_chunked_updates)
+{
+	std::string const input(1000000, 'a');
+	hasher h;
+	std::size_t offset = 0;
+	int chunk = 1;
+	while (offset < input.size())
+	{
+		std::size_t const len = std::min(std::size_t(chunk), input.size() - offset);
+		h.update(input.data() + offset, int(len));
+		offset += len;
+		chunk = (chunk * 7 + 3) % 1000 + 1;
+	}
+
+	sha1_hash result;
+	aux::from_hex({result_array[2], 40}, (char*)&result[0]);
+	TEST_CHECK(result == h.final());
+}
+
+// hashing several buffers at a time must give the same digests as hashing
+// them one at a time. Use an odd number of hashers, a length that isn't a
+// multiple of the block size and one hasher that's not at a block boundary,
+// to cover all fall-backs
+TORRENT_TEST(hasher_update_multi)
+{
+	int const num = 19;
+	int const len = 16384 + 13;
+	std::vector<std::string> buffers;
+	for (int i = 0; i < num; ++i)
+	{
+		std::string buf(std::size_t(len), '\0');
+		for (int k = 0; k < len; ++k)
+			buf[std::size_t(k)] = char((k * 31 + i * 7) & 0xff);
+		buffers.push_back(buf);
+	}
+
+	std::vector<hasher> multi(num);
+	std::vector<hasher> single(num);
+	multi[num - 2].update("x", 1);
+	single[num - 2].update("x", 1);
+
+	std::vector<hasher*> hashers;
+	std::vector<char const*> data;
+	for (int i = 0; i < num; ++i)
+	{
+		hashers.push_back(&multi[std::size_t(i)]);
+		data.push_back(buffers[std::size_t(i)].data());
+		single[std::size_t(i)].update(buffers[std::size_t(i)]);
+	}
+
+	// feed it twice, the second round starts off the block boundary
+	aux::update_multi(hashers, data, len);
+	aux::update_multi(hashers, data, len);
+	for (int i = 0; i < num; ++i)
+		single[std::size_t(i)].update(buffers[std::size_t(i)]);
+
+	for (int i = 0; i < num; ++i)
+		TEST_CHECK(multi[std::size_t(i)].final() == single[std::size_t(i)].final());
+}
@@ -296,8 +296,8 @@ TORRENT_TEST(copy_move)
 
 	heterogeneous_queue<F> q;
 
-	// make sure the queue has to grow at some point, to exercise its
-	// copy/move of elements
+	// make sure the queue has to grow at some point, to exercise
+	// allocating more chunks
 	for (int i = 0; i < 1000; ++i)
 		q.emplace_back<F>(i);
 
@@ -326,3 +326,38 @@ TORRENT_TEST(nontrivial)
 		q.emplace_back<E>("testing to allocate non-trivial objects");
 	}
 }
+
+// objects are never moved once they're in the queue, and the storage is
+// reused after clearing it
+TORRENT_TEST(stable_pointers)
+{
+	using namespace libtorrent;
+
+	heterogeneous_queue<F> q;
+
+	std::vector<F*> first;
+	for (int i = 0; i < 5000; ++i)
+		first.push_back(&q.emplace_back<F>(i));
+
+	std::vector<F*> ptrs;
+	q.get_pointers(ptrs);
+	TEST_CHECK(ptrs == first);
+	TEST_CHECK(q.front() == first.front());
+
+	for (int i = 0; i < int(first.size()); ++i)
+	{
+		first[i]->check_invariant();
+		TEST_EQUAL(first[i]->f, i);
+	}
+
+	q.clear();
+	TEST_CHECK(q.empty());
+	TEST_CHECK(q.front() == nullptr);
+
+	// filling the queue up again, with objects of the same size, will put
+	// them in the same places as the first time around
+	for (int i = 0; i < 5000; ++i)
+		TEST_CHECK(&q.emplace_back<F>(i) == first[std::size_t(i)]);
+
+	TEST_EQUAL(q.size(), 5000);
+}
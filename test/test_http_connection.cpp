@@ -225,3 +225,38 @@ TORRENT_TEST(no_keepalive)
 {
 	run_suite("http", settings_pack::none, 0);
 }
+
+TORRENT_TEST(keepalive_reuse)
+{
+	write_test_file();
+	int const port = start_web_server(false, false, true);
+
+	reset_globals();
+
+	char url[256];
+	std::snprintf(url, sizeof(url), "http://127.0.0.1:%d/test_file", port);
+
+	std::shared_ptr<http_connection> h = std::make_shared<http_connection>(ios
+		, res, &::http_handler, true, 1024*1024, &::http_connect_handler);
+	h->keep_alive(true);
+
+	// the second request is expected to be sent over the same connection as
+	// the first one
+	for (int i = 0; i < 2; ++i)
+	{
+		h->get(url, seconds(1), 0, nullptr, 5, "test/user-agent");
+		ios.reset();
+		error_code e;
+		ios.run(e);
+		TEST_CHECK(h->can_reuse());
+	}
+
+	TEST_EQUAL(connect_handler_called, 1);
+	TEST_EQUAL(handler_called, 2);
+	TEST_EQUAL(http_status, 200);
+	TEST_EQUAL(data_size, 3216);
+	TEST_CHECK(!g_error_code);
+
+	h->close(true);
+	stop_web_server();
+}
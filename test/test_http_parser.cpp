@@ -614,3 +614,40 @@ TORRENT_TEST(invalid_chunk_afl)
 	TEST_CHECK(std::get<2>(received) == true);
 }
 
+TORRENT_TEST(known_headers_only)
+{
+	char const* web_seed_response =
+		"HTTP/1.1 206 Partial Content\r\n"
+		"Content-Type: application/octet-stream\r\n"
+		"X-Custom-Header: foobar\r\n"
+		"Content-Range: bytes 0-4/10\r\n"
+		"Server: test\r\n"
+		"Content-Length: 5\r\n"
+		"\r\n"
+		"tests";
+
+	http_parser parser(http_parser::known_headers_only);
+	for (int i = 0; i < 2; ++i)
+	{
+		std::tuple<int, int, bool> const received
+			= feed_bytes(parser, web_seed_response);
+
+		TEST_CHECK(std::get<2>(received) == false);
+		TEST_EQUAL(parser.status_code(), 206);
+		TEST_EQUAL(parser.content_length(), 5);
+		TEST_CHECK(parser.content_range() == (std::pair<std::int64_t, std::int64_t>(0, 4)));
+		TEST_EQUAL(parser.header("content-type"), "application/octet-stream");
+		TEST_EQUAL(parser.header(http_parser::server_header), "test");
+		TEST_EQUAL(parser.header("x-custom-header"), "");
+		TEST_EQUAL(parser.header(http_parser::location_header), "");
+		TEST_CHECK(parser.headers().empty());
+		parser.reset();
+	}
+
+	// the known header accessor works when all headers are recorded too
+	http_parser full_parser;
+	feed_bytes(full_parser, web_seed_response);
+	TEST_EQUAL(full_parser.header(http_parser::content_type_header), "application/octet-stream");
+	TEST_EQUAL(full_parser.header("x-custom-header"), "foobar");
+	TEST_EQUAL(full_parser.headers().size(), 5);
+}
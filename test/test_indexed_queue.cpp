@@ -0,0 +1,160 @@
+/*
+
+Copyright (c) 2017, Arvid Norberg
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions
+are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in
+      the documentation and/or other materials provided with the distribution.
+    * Neither the name of the author nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+#include "test.hpp"
+#include "libtorrent/aux_/indexed_queue.hpp"
+
+#include <vector>
+#include <cstdlib>
+
+using namespace libtorrent;
+
+namespace {
+
+std::vector<int> contents(aux::indexed_queue<int> const& q)
+{
+	std::vector<int> ret;
+	q.for_each([&ret](int const v) { ret.push_back(v); });
+	return ret;
+}
+
+} // anonymous namespace
+
+TORRENT_TEST(insert)
+{
+	aux::indexed_queue<int> q;
+	TEST_CHECK(q.empty());
+
+	int const a = q.insert(0, 1);
+	int const b = q.insert(10, 3);
+	int const c = q.insert(1, 2);
+	int const d = q.insert(0, 0);
+
+	TEST_EQUAL(q.size(), 4);
+	TEST_CHECK((contents(q) == std::vector<int>{0, 1, 2, 3}));
+	TEST_EQUAL(q.position(d), 0);
+	TEST_EQUAL(q.position(a), 1);
+	TEST_EQUAL(q.position(c), 2);
+	TEST_EQUAL(q.position(b), 3);
+	for (int i = 0; i < 4; ++i) TEST_EQUAL(q.at(i), i);
+	TEST_EQUAL(q.value(c), 2);
+}
+
+TORRENT_TEST(erase)
+{
+	aux::indexed_queue<int> q;
+	int h[5];
+	for (int i = 0; i < 5; ++i) h[i] = q.insert(i, i);
+
+	q.erase(h[2]);
+	TEST_EQUAL(q.size(), 4);
+	TEST_CHECK((contents(q) == std::vector<int>{0, 1, 3, 4}));
+	TEST_EQUAL(q.position(h[3]), 2);
+	TEST_EQUAL(q.position(h[4]), 3);
+
+	// the handle of the erased element is reused
+	int const n = q.insert(0, 10);
+	TEST_EQUAL(n, h[2]);
+	TEST_CHECK((contents(q) == std::vector<int>{10, 0, 1, 3, 4}));
+
+	q.erase(h[0]);
+	q.erase(h[1]);
+	q.erase(h[3]);
+	q.erase(h[4]);
+	q.erase(n);
+	TEST_CHECK(q.empty());
+}
+
+TORRENT_TEST(move)
+{
+	aux::indexed_queue<int> q;
+	int h[5];
+	for (int i = 0; i < 5; ++i) h[i] = q.insert(i, i);
+
+	q.move(h[4], 0);
+	TEST_CHECK((contents(q) == std::vector<int>{4, 0, 1, 2, 3}));
+
+	q.move(h[4], 100);
+	TEST_CHECK((contents(q) == std::vector<int>{0, 1, 2, 3, 4}));
+
+	q.move(h[1], 3);
+	TEST_CHECK((contents(q) == std::vector<int>{0, 2, 3, 1, 4}));
+	TEST_EQUAL(q.position(h[1]), 3);
+	TEST_EQUAL(q.position(h[3]), 2);
+}
+
+TORRENT_TEST(random_operations)
+{
+	// compare against a plain vector
+	aux::indexed_queue<int> q;
+	std::vector<int> ref;
+	std::vector<int> handles;
+
+	std::srand(0x1337);
+	for (int i = 0; i < 5000; ++i)
+	{
+		int const op = std::rand() % 3;
+		int const pos = std::rand() % (int(ref.size()) + 1);
+		if (op == 0 || ref.empty())
+		{
+			handles.resize(std::size_t(std::max(int(handles.size()), i + 1)));
+			handles[std::size_t(i)] = q.insert(pos, i);
+			ref.insert(ref.begin() + std::min(pos, int(ref.size())), i);
+		}
+		else
+		{
+			int const victim_pos = std::rand() % int(ref.size());
+			int const victim = ref[std::size_t(victim_pos)];
+			int const h = handles[std::size_t(victim)];
+			TEST_EQUAL(q.position(h), victim_pos);
+			ref.erase(ref.begin() + victim_pos);
+			if (op == 1)
+			{
+				q.erase(h);
+			}
+			else
+			{
+				int const new_pos = std::min(pos, int(ref.size()));
+				q.move(h, new_pos);
+				ref.insert(ref.begin() + new_pos, victim);
+			}
+		}
+		TEST_EQUAL(q.size(), int(ref.size()));
+	}
+
+	TEST_CHECK(contents(q) == ref);
+	for (int i = 0; i < int(ref.size()); ++i)
+	{
+		TEST_EQUAL(q.at(i), ref[std::size_t(i)]);
+		TEST_EQUAL(q.position(handles[std::size_t(ref[std::size_t(i)])]), i);
+	}
+}
@@ -33,10 +33,12 @@ POSSIBILITY OF SUCH DAMAGE.
 #include "libtorrent/ip_filter.hpp"
 #include "setup_transfer.hpp" // for addr()
 #include <utility>
+#include <algorithm>
 
 #include "test.hpp"
 #include "settings.hpp"
 #include "libtorrent/socket_io.hpp"
+#include "libtorrent/random.hpp"
 #include "libtorrent/session.hpp"
 
 /*
@@ -297,3 +299,54 @@ TORRENT_TEST(ip_filter)
 	TEST_CHECK(pf.access(6881) == 0);
 	TEST_CHECK(pf.access(65535) == 0);
 }
+
+TORRENT_TEST(compiled_ip_filter)
+{
+	ip_filter f;
+	for (int i = 0; i < 1000; ++i)
+	{
+		std::uint32_t const first = random(0xffffffff);
+		std::uint32_t const last = std::uint32_t(std::min(
+			std::uint64_t(first) + random(0xffff), std::uint64_t(0xffffffff)));
+		f.add_rule(address_v4(first), address_v4(last)
+			, (i % 3) ? ip_filter::blocked : 0);
+	}
+#if TORRENT_USE_IPV6
+	f.add_rule(addr("2::1"), addr("3::"), ip_filter::blocked);
+	f.add_rule(addr("1::"), addr("2::"), ip_filter::blocked);
+	f.add_rule(addr("1::8000:0:0:0"), addr("1::ffff:0:0:0"), 0);
+#endif
+
+	ip_filter compiled = f;
+	compiled.compile();
+
+	// the compiled filter must agree with the tree on every range boundary
+#if TORRENT_USE_IPV6
+	std::vector<ip_range<address_v4>> const range = std::get<0>(f.export_filter());
+	std::vector<ip_range<address_v6>> const range6 = std::get<1>(f.export_filter());
+	test_rules_invariant(range6, compiled);
+	TEST_EQUAL(range6.size(), 5);
+	TEST_EQUAL(compiled.access(addr("1::7fff:0:0:0")), ip_filter::blocked);
+	TEST_EQUAL(compiled.access(addr("1::8000:0:0:1")), 0);
+#else
+	std::vector<ip_range<address_v4>> const range = f.export_filter();
+#endif
+	test_rules_invariant(range, compiled);
+
+	for (int i = 0; i < 10000; ++i)
+	{
+		address const a = address_v4(random(0xffffffff));
+		TEST_EQUAL(compiled.access(a), f.access(a));
+	}
+
+	// adding a rule to a compiled filter must take effect immediately
+	compiled.add_rule(addr("0.0.0.0"), addr("255.255.255.255"), ip_filter::blocked);
+	TEST_EQUAL(compiled.access(addr("10.0.0.1")), ip_filter::blocked);
+	compiled.compile();
+	TEST_EQUAL(compiled.access(addr("10.0.0.1")), ip_filter::blocked);
+#if TORRENT_USE_IPV6
+	TEST_EQUAL(std::get<0>(compiled.export_filter()).size(), 1);
+#else
+	TEST_EQUAL(compiled.export_filter().size(), 1);
+#endif
+}
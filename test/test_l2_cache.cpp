@@ -0,0 +1,214 @@
+/*
+
+Copyright (c) 2017, Arvid Norberg
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions
+are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in
+      the documentation and/or other materials provided with the distribution.
+    * Neither the name of the author nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+#include "libtorrent/aux_/l2_cache.hpp"
+#include "libtorrent/disk_buffer_pool.hpp"
+#include "libtorrent/performance_counters.hpp"
+#include "libtorrent/aux_/session_settings.hpp"
+#include "libtorrent/aux_/path.hpp"
+#include "libtorrent/io_service.hpp"
+#include "test.hpp"
+
+#include <cstring>
+#include <thread>
+#include <chrono>
+
+using namespace libtorrent;
+
+namespace {
+
+int const block_size = 16 * 1024;
+char const* cache_file = "l2_cache_test";
+
+void nop() {}
+
+struct l2_fixture
+{
+	explicit l2_fixture(int const num_blocks)
+		: pool(block_size, ios, std::bind(&nop))
+		, l2(pool, cnt, block_size)
+	{
+		pool.set_settings(sett);
+		error_code ec;
+		l2.set_settings(cache_file, num_blocks, ec);
+		TEST_CHECK(!ec);
+		TEST_CHECK(l2.enabled());
+	}
+
+	~l2_fixture()
+	{
+		l2.abort();
+		error_code ec;
+		remove(cache_file, ec);
+	}
+
+	// spills a block filled with ``fill`` to the cache
+	bool insert(int const st, int const piece, int const block, char const fill)
+	{
+		char* buf = pool.allocate_buffer("test");
+		std::memset(buf, fill, block_size);
+		if (l2.insert(storage_index_t(st), piece_index_t(piece), block, buf, block_size))
+			return true;
+		pool.free_buffer(buf);
+		return false;
+	}
+
+	// waits for the fill thread to write ``n`` blocks to the file
+	void wait_for(int const n)
+	{
+		for (int i = 0; i < 500 && l2.size() < n; ++i)
+			std::this_thread::sleep_for(std::chrono::milliseconds(10));
+		TEST_EQUAL(l2.size(), n);
+	}
+
+	// returns true if the block was read from the cache, and it's filled
+	// with ``fill``
+	bool read(int const st, int const piece, int const block, char const fill)
+	{
+		std::vector<char> buf(block_size);
+		iovec_t const b = {buf.data(), buf.size()};
+		if (!l2.read(storage_index_t(st), piece_index_t(piece), block, b))
+			return false;
+		for (char const c : buf)
+			if (c != fill) return false;
+		return true;
+	}
+
+	io_service ios;
+	aux::session_settings sett;
+	counters cnt;
+	disk_buffer_pool pool;
+	aux::l2_cache l2;
+};
+
+} // anonymous namespace
+
+TORRENT_TEST(l2_cache_read_back)
+{
+	l2_fixture f(8);
+
+	TEST_CHECK(f.insert(0, 1, 0, 'a'));
+	TEST_CHECK(f.insert(0, 1, 1, 'b'));
+	TEST_CHECK(f.insert(1, 1, 0, 'c'));
+	f.wait_for(3);
+
+	TEST_CHECK(f.read(0, 1, 0, 'a'));
+	TEST_CHECK(f.read(0, 1, 1, 'b'));
+	TEST_CHECK(f.read(1, 1, 0, 'c'));
+	TEST_CHECK(!f.read(0, 2, 0, 'a'));
+	TEST_EQUAL(f.cnt[counters::num_blocks_written_l2], 3);
+	TEST_EQUAL(f.cnt[counters::num_blocks_read_l2], 3);
+
+	// the buffers are returned to the pool once they've been written
+	TEST_EQUAL(f.pool.in_use(), 0);
+
+	// reads of several blocks only succeed if all of them are there
+	std::vector<char> buf(block_size * 3);
+	iovec_t const two[] = {{&buf[0], block_size}, {&buf[block_size], block_size}};
+	TEST_CHECK(f.l2.read(storage_index_t(0), piece_index_t(1), 0, two));
+	iovec_t const three[] = {{&buf[0], block_size}, {&buf[block_size], block_size}
+		, {&buf[2 * block_size], block_size}};
+	TEST_CHECK(!f.l2.read(storage_index_t(0), piece_index_t(1), 0, three));
+
+	// a block that's already in the cache is not accepted again
+	TEST_CHECK(!f.insert(0, 1, 0, 'a'));
+}
+
+TORRENT_TEST(l2_cache_invalidate)
+{
+	l2_fixture f(8);
+
+	TEST_CHECK(f.insert(0, 1, 0, 'a'));
+	TEST_CHECK(f.insert(0, 1, 1, 'b'));
+	TEST_CHECK(f.insert(1, 1, 0, 'c'));
+	f.wait_for(3);
+
+	f.l2.invalidate(storage_index_t(0), piece_index_t(1), 1);
+	TEST_CHECK(f.read(0, 1, 0, 'a'));
+	TEST_CHECK(!f.read(0, 1, 1, 'b'));
+	TEST_EQUAL(f.l2.size(), 2);
+
+	f.l2.invalidate(storage_index_t(1));
+	TEST_CHECK(!f.read(1, 1, 0, 'c'));
+	TEST_CHECK(f.read(0, 1, 0, 'a'));
+	TEST_EQUAL(f.l2.size(), 1);
+
+	// the block can be spilled again, with new contents
+	TEST_CHECK(f.insert(0, 1, 1, 'd'));
+	f.wait_for(2);
+	TEST_CHECK(f.read(0, 1, 1, 'd'));
+}
+
+TORRENT_TEST(l2_cache_eviction)
+{
+	l2_fixture f(4);
+
+	for (int i = 0; i < 4; ++i)
+		TEST_CHECK(f.insert(0, i, 0, char('a' + i)));
+	f.wait_for(4);
+
+	// reading a block sets its reference bit, so it survives the next round
+	// of evictions
+	TEST_CHECK(f.read(0, 0, 0, 'a'));
+
+	for (int i = 4; i < 6; ++i)
+		TEST_CHECK(f.insert(0, i, 0, char('a' + i)));
+	for (int i = 0; i < 500 && f.cnt[counters::num_blocks_written_l2] < 6; ++i)
+		std::this_thread::sleep_for(std::chrono::milliseconds(10));
+	TEST_EQUAL(f.l2.size(), 4);
+
+	TEST_CHECK(f.read(0, 0, 0, 'a'));
+	TEST_CHECK(f.read(0, 4, 0, 'e'));
+	TEST_CHECK(f.read(0, 5, 0, 'f'));
+	int num_left = 0;
+	for (int i = 1; i < 4; ++i)
+		num_left += f.read(0, i, 0, char('a' + i)) ? 1 : 0;
+	TEST_EQUAL(num_left, 1);
+	TEST_EQUAL(f.pool.in_use(), 0);
+}
+
+TORRENT_TEST(l2_cache_disabled)
+{
+	io_service ios;
+	aux::session_settings sett;
+	counters cnt;
+	disk_buffer_pool pool(block_size, ios, std::bind(&nop));
+	pool.set_settings(sett);
+	aux::l2_cache l2(pool, cnt, block_size);
+	TEST_CHECK(!l2.enabled());
+
+	char* buf = pool.allocate_buffer("test");
+	TEST_CHECK(!l2.insert(storage_index_t(0), piece_index_t(0), 0, buf, block_size));
+	iovec_t const b = {buf, std::size_t(block_size)};
+	TEST_CHECK(!l2.read(storage_index_t(0), piece_index_t(0), 0, b));
+	pool.free_buffer(buf);
+}
@@ -137,3 +137,87 @@ TORRENT_TEST(part_file)
 	}
 }
 
+
+TORRENT_TEST(part_file_incremental_header)
+{
+	error_code ec;
+	std::string const cwd = complete(".");
+	std::string const dir = combine_path(cwd, "partfile_test_dir3");
+
+	remove_all(dir, ec);
+	if (ec) std::printf("remove_all: %s\n", ec.message().c_str());
+	create_directory(dir, ec);
+	if (ec) std::printf("create_directory: %s\n", ec.message().c_str());
+
+	int const piece_size = 0x4000;
+	int const num_pieces = 1000;
+	char buf[16];
+
+	{
+		part_file pf(dir, "partfile.parts", num_pieces, piece_size);
+
+		// the first flush writes the full header
+		for (int p : {1, 2, 500, 999})
+		{
+			std::memset(buf, p & 0xff, sizeof(buf));
+			iovec_t v = {&buf, sizeof(buf)};
+			pf.writev(v, piece_index_t(p), 0, ec);
+			TEST_CHECK(!ec);
+		}
+		pf.flush_metadata(ec);
+		TEST_CHECK(!ec);
+
+		// these are written as individual slot entries
+		pf.free_piece(piece_index_t(2));
+		for (int p : {0, 3, 998})
+		{
+			std::memset(buf, p & 0xff, sizeof(buf));
+			iovec_t v = {&buf, sizeof(buf)};
+			pf.writev(v, piece_index_t(p), 0, ec);
+			TEST_CHECK(!ec);
+		}
+		pf.flush_metadata(ec);
+		TEST_CHECK(!ec);
+
+		// dirty entries spread out over more ranges than we're willing to
+		// write one by one, falls back to rewriting the header
+		for (int p = 10; p < 100; p += 2)
+		{
+			std::memset(buf, p & 0xff, sizeof(buf));
+			iovec_t v = {&buf, sizeof(buf)};
+			pf.writev(v, piece_index_t(p), 0, ec);
+			TEST_CHECK(!ec);
+		}
+		pf.free_piece(piece_index_t(50));
+	}
+
+	{
+		// load the part file back in and make sure the slot map survived
+		part_file pf(dir, "partfile.parts", num_pieces, piece_size);
+
+		std::vector<int> expected = {0, 1, 3, 500, 998, 999};
+		for (int p = 10; p < 100; p += 2)
+			if (p != 50) expected.push_back(p);
+
+		for (int p : expected)
+		{
+			std::memset(buf, 0, sizeof(buf));
+			iovec_t v = {&buf, sizeof(buf)};
+			pf.readv(v, piece_index_t(p), 0, ec);
+			TEST_CHECK(!ec);
+			if (ec) std::printf("part_file::readv(%d): %s\n", p, ec.message().c_str());
+			ec.clear();
+			for (char c : buf) TEST_EQUAL(c, char(p & 0xff));
+		}
+
+		for (int p : {2, 4, 50, 501})
+		{
+			iovec_t v = {&buf, sizeof(buf)};
+			pf.readv(v, piece_index_t(p), 0, ec);
+			TEST_CHECK(ec);
+			ec.clear();
+		}
+	}
+
+	remove_all(dir, ec);
+}
@@ -31,6 +31,7 @@ POSSIBILITY OF SUCH DAMAGE.
 */
 
 #include <algorithm>
+#include <array>
 #include <iostream>
 
 #include "libtorrent/hasher.hpp"
@@ -136,6 +137,35 @@ TORRENT_TEST(diffie_hellman)
 	}
 }
 
+TORRENT_TEST(dh_powm)
+{
+	using namespace libtorrent;
+	namespace mp = boost::multiprecision;
+
+	lt::key_t const prime("0xFFFFFFFFFFFFFFFFC90FDAA22168C234C4C6628B80DC1CD129024E088A67CC74020BBEA63B139B22514A08798E3404DDEF9519B3CD3A431B302B0A6DF25F14374FE1356D6D51C245E485B576625E7EC6F44C42E9A63A36210000000000090563");
+	lt::key_t const all_ones = ~lt::key_t(0);
+
+	std::vector<lt::key_t> values = { lt::key_t(0), lt::key_t(1), lt::key_t(2), prime - 1
+		, prime, prime + 1, all_ones };
+	for (int i = 0; i < 8; ++i)
+	{
+		std::array<char, 96> buf;
+		lt::aux::random_bytes(buf);
+		lt::key_t k;
+		for (char const c : buf) k = (k << 8) | std::uint8_t(c);
+		values.push_back(k);
+	}
+
+	for (lt::key_t const& base : values)
+	{
+		for (lt::key_t const& e : values)
+		{
+			// the reference implementation requires the base to be reduced
+			TEST_CHECK(dh_powm(base, e) == mp::powm(lt::key_t(base % prime), e, prime));
+		}
+	}
+}
+
 TORRENT_TEST(rc4)
 {
 	using namespace libtorrent;
@@ -153,6 +183,71 @@ TORRENT_TEST(rc4)
 	test_enc_handler(rc41, rc42);
 }
 
+namespace {
+
+	// a straight-forward byte-at-a-time RC4, to check the rc4_handler's key
+	// stream against
+	struct reference_rc4
+	{
+		explicit reference_rc4(lt::span<char const> key)
+		{
+			for (int i = 0; i < 256; ++i) s[i] = std::uint8_t(i);
+			for (int i = 0, j = 0; i < 256; ++i)
+			{
+				j = (j + s[i] + std::uint8_t(key[i % int(key.size())])) & 255;
+				std::swap(s[i], s[j]);
+			}
+			// like the rc4_handler, discard the first 1024 bytes
+			std::vector<char> discard(1024);
+			apply(discard);
+		}
+
+		void apply(std::vector<char>& buf)
+		{
+			for (char& c : buf)
+			{
+				x = (x + 1) & 255;
+				y = (y + s[x]) & 255;
+				std::swap(s[x], s[y]);
+				c = char(c ^ s[(s[x] + s[y]) & 255]);
+			}
+		}
+
+		std::uint8_t s[256];
+		int x = 0;
+		int y = 0;
+	};
+}
+
+TORRENT_TEST(rc4_key_stream)
+{
+	using namespace libtorrent;
+
+	sha1_hash const key = hasher("test1_key",8).final();
+
+	rc4_handler rc4;
+	rc4.set_outgoing_key(key);
+	reference_rc4 ref(key);
+
+	// odd sized buffers, to cover both the block-wise and byte-wise paths,
+	// and the key stream carrying over from one buffer to the next
+	for (int const len : {1, 63, 64, 65, 1000, 4096, 16 * 1024 + 3})
+	{
+		std::vector<char> buf(static_cast<std::size_t>(len));
+		std::generate(buf.begin(), buf.end(), &std::rand);
+		std::vector<char> expected = buf;
+
+		// encrypt it as an iovec of two buffers
+		std::array<lt::span<char>, 2> iovec = {{
+			lt::span<char>(buf.data(), std::size_t(len / 3))
+			, lt::span<char>(buf.data() + len / 3, std::size_t(len - len / 3)) }};
+		rc4.encrypt(iovec);
+
+		ref.apply(expected);
+		TEST_CHECK(buf == expected);
+	}
+}
+
 #else
 TORRENT_TEST(disabled)
 {
@@ -34,6 +34,7 @@ POSSIBILITY OF SUCH DAMAGE.
 #include "libtorrent/peer_class.hpp"
 #include "libtorrent/peer_class_set.hpp"
 #include "libtorrent/peer_class_type_filter.hpp"
+#include "libtorrent/alert.hpp"
 #include "libtorrent/aux_/path.hpp"
 
 using namespace libtorrent;
@@ -85,6 +86,21 @@ TORRENT_TEST(peer_class)
 	TEST_EQUAL(i.upload_limit, 1000);
 	TEST_EQUAL(i.download_limit, 2000);
 
+	// the uTP congestion controller defaults to LEDBAT
+	TEST_EQUAL(i.utp_cubic, false);
+	i.utp_cubic = true;
+	pool.at(id2)->set_info(&i);
+	pool.at(id2)->get_info(&i);
+	TEST_EQUAL(i.utp_cubic, true);
+	TEST_EQUAL(i.upload_limit, 1000);
+
+	// no additional alerts are enabled by default
+	TEST_EQUAL(i.alert_mask, 0);
+	i.alert_mask = alert::peer_log_notification;
+	pool.at(id2)->set_info(&i);
+	pool.at(id2)->get_info(&i);
+	TEST_EQUAL(i.alert_mask, std::uint32_t(alert::peer_log_notification));
+
 	// test peer_class_type_filter
 	peer_class_type_filter filter;
 
@@ -115,3 +131,47 @@ TORRENT_TEST(peer_class)
 	TEST_CHECK(pool.at(id1) == nullptr);
 }
 
+TORRENT_TEST(peer_class_set_generation)
+{
+	peer_class_pool pool;
+	peer_class_t id1 = pool.new_peer_class("test1");
+	peer_class_t id2 = pool.new_peer_class("test2");
+
+	peer_class_set s1;
+	peer_class_set s2;
+
+	// sets that have never been changed share the generation
+	TEST_EQUAL(s1.class_generation(), s2.class_generation());
+
+	s1.add_class(pool, id1);
+	std::uint32_t const gen1 = s1.class_generation();
+	TEST_CHECK(gen1 != s2.class_generation());
+
+	// adding a class that's already in the set doesn't change it
+	s1.add_class(pool, id1);
+	TEST_EQUAL(s1.class_generation(), gen1);
+
+	// the same change to another set still gives a new generation
+	s2.add_class(pool, id1);
+	TEST_CHECK(s2.class_generation() != gen1);
+
+	s1.add_class(pool, id2);
+	std::uint32_t const gen2 = s1.class_generation();
+	TEST_CHECK(gen2 != gen1);
+
+	s1.remove_class(pool, id2);
+	TEST_CHECK(s1.class_generation() != gen2);
+	TEST_CHECK(s1.class_generation() != gen1);
+
+	// removing a class that isn't in the set doesn't change it
+	std::uint32_t const gen3 = s1.class_generation();
+	s1.remove_class(pool, id2);
+	TEST_EQUAL(s1.class_generation(), gen3);
+
+	s1.remove_class(pool, id1);
+	s2.remove_class(pool, id1);
+	pool.decref(id2);
+	pool.decref(id1);
+	TEST_CHECK(pool.at(id1) == nullptr);
+}
+
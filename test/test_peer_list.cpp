@@ -44,6 +44,7 @@ POSSIBILITY OF SUCH DAMAGE.
 #include "test.hpp"
 #include "setup_transfer.hpp"
 #include <vector>
+#include <set>
 #include <memory> // for shared_ptr
 #include <cstdarg>
 
@@ -160,8 +161,7 @@ void mock_peer_connection::disconnect(error_code const& ec
 
 bool has_peer(peer_list const& p, tcp::endpoint const& ep)
 {
-	auto const its = p.find_peers(ep.address());
-	return its.first != its.second;
+	return !p.find_peers(ep.address()).empty();
 }
 
 torrent_state init_state(torrent_peer_allocator& allocator)
@@ -923,6 +923,97 @@ TORRENT_TEST(new_peer_size_limit)
 		, 5);
 }
 
+// test that every connect candidate is handed out exactly once, peers that
+// have not failed first, and that the index stays consistent as peers are
+// erased from the middle of the list
+TORRENT_TEST(connect_candidate_order)
+{
+	torrent_state st = init_state(allocator);
+	mock_torrent t(&st);
+	st.max_peerlist_size = 2000;
+	peer_list p;
+	t.m_p = &p;
+
+	std::vector<torrent_peer*> peers;
+	for (int i = 0; i < 1000; ++i)
+	{
+		torrent_peer* peer = add_peer(p, st, tcp::endpoint(
+			address_v4((10 << 24) + (i << 8) + 1), std::uint16_t(i + 1000)));
+		TEST_CHECK(peer);
+		if (peer == nullptr) return;
+		// every third peer has failed once
+		if (i % 3 == 0) p.inc_failcount(peer);
+		peers.push_back(peer);
+	}
+	TEST_EQUAL(p.num_peers(), 1000);
+	TEST_EQUAL(p.num_connect_candidates(), 1000);
+
+	// erase every fifth peer
+	for (int i = 0; i < 1000; i += 5)
+	{
+		tcp::endpoint const ep = peers[std::size_t(i)]->ip();
+		p.erase_peer(peers[std::size_t(i)], &st);
+		TEST_CHECK(!has_peer(p, ep));
+	}
+	st.erased.clear();
+	TEST_EQUAL(p.num_peers(), 800);
+	TEST_EQUAL(p.num_connect_candidates(), 800);
+
+	for (int i = 0; i < 1000; ++i)
+	{
+		if (i % 5 == 0) continue;
+		TEST_CHECK(has_peer(p, tcp::endpoint(
+			address_v4((10 << 24) + (i << 8) + 1), std::uint16_t(i + 1000))));
+	}
+
+	std::set<torrent_peer*> handed_out;
+	bool seen_failed = false;
+	for (int i = 0; i < 800; ++i)
+	{
+		torrent_peer* tp = p.connect_one_peer(0, &st);
+		TEST_CHECK(tp);
+		if (tp == nullptr) break;
+		TEST_CHECK(handed_out.insert(tp).second);
+		if (tp->failcount > 0) seen_failed = true;
+		else TEST_CHECK(!seen_failed);
+		t.connect_to_peer(tp);
+		st.erased.clear();
+	}
+	TEST_EQUAL(int(handed_out.size()), 800);
+	TEST_EQUAL(p.num_connect_candidates(), 0);
+	TEST_CHECK(p.connect_one_peer(0, &st) == nullptr);
+}
+
+// make sure candidates are found even when all of them are in the heaps of
+// peers that have failed
+TORRENT_TEST(connect_candidate_failed_only)
+{
+	torrent_state st = init_state(allocator);
+	mock_torrent t(&st);
+	peer_list p;
+	t.m_p = &p;
+
+	torrent_peer* peer1 = add_peer(p, st, ep("11.0.0.1", 4000));
+	torrent_peer* peer2 = add_peer(p, st, ep("11.0.0.2", 4000));
+	TEST_CHECK(peer1 && peer2);
+	if (peer1 == nullptr || peer2 == nullptr) return;
+
+	p.set_failcount(peer1, 2);
+	p.set_failcount(peer2, 1);
+	TEST_EQUAL(p.num_connect_candidates(), 2);
+
+	torrent_peer* tp = p.connect_one_peer(0, &st);
+	TEST_CHECK(tp == peer2);
+	if (tp == nullptr) return;
+	t.connect_to_peer(tp);
+	tp = p.connect_one_peer(0, &st);
+	TEST_CHECK(tp == peer1);
+	if (tp == nullptr) return;
+	t.connect_to_peer(tp);
+	TEST_CHECK(p.connect_one_peer(0, &st) == nullptr);
+	TEST_EQUAL(p.num_connect_candidates(), 0);
+}
+
 // TODO: test erasing peers
 // TODO: test update_peer_port with allow_multiple_connections_per_ip and without
 // TODO: test add i2p peers
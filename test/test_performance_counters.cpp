@@ -0,0 +1,104 @@
+/*
+
+Copyright (c) 2017, Arvid Norberg
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions
+are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in
+      the documentation and/or other materials provided with the distribution.
+    * Neither the name of the author nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+
+#include "test.hpp"
+#include "libtorrent/performance_counters.hpp"
+
+#include <thread>
+#include <vector>
+
+using namespace libtorrent;
+
+TORRENT_TEST(counters_inc)
+{
+	counters c;
+	TEST_EQUAL(c[counters::piece_requests], 0);
+	c.inc_stats_counter(counters::piece_requests);
+	c.inc_stats_counter(counters::piece_requests, 10);
+	TEST_EQUAL(c[counters::piece_requests], 11);
+
+	// gauges return their new value
+	TEST_EQUAL(c.inc_stats_counter(counters::num_peers_connected, 5), 5);
+	TEST_EQUAL(c.inc_stats_counter(counters::num_peers_connected, -2), 3);
+	TEST_EQUAL(c[counters::num_peers_connected], 3);
+}
+
+TORRENT_TEST(counters_set_value)
+{
+	counters c;
+	c.inc_stats_counter(counters::piece_requests, 10);
+	c.set_value(counters::piece_requests, 100);
+	TEST_EQUAL(c[counters::piece_requests], 100);
+	c.inc_stats_counter(counters::piece_requests);
+	TEST_EQUAL(c[counters::piece_requests], 101);
+}
+
+TORRENT_TEST(counters_copy)
+{
+	counters c;
+	c.inc_stats_counter(counters::piece_requests, 7);
+	c.inc_stats_counter(counters::num_peers_connected, 3);
+
+	counters c2(c);
+	TEST_EQUAL(c2[counters::piece_requests], 7);
+	TEST_EQUAL(c2[counters::num_peers_connected], 3);
+
+	counters c3;
+	c3.inc_stats_counter(counters::piece_requests, 2);
+	c3 = c;
+	TEST_EQUAL(c3[counters::piece_requests], 7);
+	TEST_EQUAL(c3[counters::num_peers_connected], 3);
+}
+
+TORRENT_TEST(counters_threads)
+{
+	counters c;
+	int const num_threads = 12;
+	int const num_incs = 10000;
+	std::vector<std::thread> threads;
+	for (int i = 0; i < num_threads; ++i)
+	{
+		threads.emplace_back([&c]
+		{
+			for (int k = 0; k < num_incs; ++k)
+			{
+				c.inc_stats_counter(counters::piece_requests);
+				c.inc_stats_counter(counters::num_peers_connected);
+			}
+		});
+	}
+	for (auto& t : threads) t.join();
+
+	TEST_EQUAL(c[counters::piece_requests], num_threads * num_incs);
+	TEST_EQUAL(c[counters::num_peers_connected], num_threads * num_incs);
+}
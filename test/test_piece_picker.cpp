@@ -43,6 +43,7 @@ POSSIBILITY OF SUCH DAMAGE.
 #include <vector>
 #include <set>
 #include <map>
+#include <string>
 #include <iostream>
 
 #include "test.hpp"
@@ -1450,6 +1451,65 @@ TORRENT_TEST(bitfield_optimization)
 	TEST_CHECK(verify_availability(p, "1132123201220322"));
 }
 
+TORRENT_TEST(memory_usage)
+{
+	std::string const avail(2000, '1');
+	std::string const all(2000, '*');
+	auto p = setup_picker(avail.c_str(), std::string(2000, ' ').c_str(), "", "");
+	pick_pieces(p, all.c_str(), 1, blocks_per_piece, nullptr);
+
+	int const full = p->memory_usage();
+	TEST_CHECK(full >= 2000 * int(sizeof(piece_index_t) + 8));
+
+	for (piece_index_t i(0); i < piece_index_t(1800); ++i)
+		p->we_have(i);
+
+	// rebuilding the piece list releases the memory of the pieces we have
+	p->inc_refcount_all(&tmp0);
+	pick_pieces(p, all.c_str(), 1, blocks_per_piece, nullptr);
+	TEST_CHECK(p->memory_usage() <= full - 1800 * int(sizeof(piece_index_t)));
+}
+
+TORRENT_TEST(bitfield_incremental_update)
+{
+	// when only a few pieces of a large torrent change availability, the
+	// pieces are moved across the priority buckets rather than rebuilding the
+	// piece list
+	std::string const avail(64, '2');
+	std::string const all(64, '*');
+	std::string mask(64, ' ');
+	mask[3] = '*';
+	mask[40] = '*';
+
+	auto p = setup_picker(avail.c_str(), std::string(64, ' ').c_str(), "", "");
+	// make sure it's not dirty
+	pick_pieces(p, all.c_str(), 1, blocks_per_piece, nullptr);
+
+	p->dec_refcount(string2vec(mask.c_str()), &tmp0);
+	std::string expected = avail;
+	expected[3] = '1';
+	expected[40] = '1';
+	TEST_CHECK(verify_availability(p, expected.c_str()));
+
+	// the rarest pieces are the ones we just decremented
+	auto picked = pick_pieces(p, all.c_str(), 1, blocks_per_piece, nullptr);
+	TEST_CHECK(int(picked.size()) > 0);
+	TEST_CHECK(picked.front().piece_index == piece_index_t(3)
+		|| picked.front().piece_index == piece_index_t(40));
+
+	p->inc_refcount(string2vec(mask.c_str()), &tmp0);
+	p->inc_refcount(string2vec(mask.c_str()), &tmp1);
+	expected[3] = '3';
+	expected[40] = '3';
+	TEST_CHECK(verify_availability(p, expected.c_str()));
+
+	// and now they're the most common ones
+	picked = pick_pieces(p, all.c_str(), 1, blocks_per_piece, nullptr);
+	TEST_CHECK(int(picked.size()) > 0);
+	TEST_CHECK(picked.front().piece_index != piece_index_t(3)
+		&& picked.front().piece_index != piece_index_t(40));
+}
+
 TORRENT_TEST(seed_optimization)
 {
 	// test seed optimizaton
@@ -0,0 +1,94 @@
+/*
+
+Copyright (c) 2017, Arvid Norberg
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions
+are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in
+      the documentation and/or other materials provided with the distribution.
+    * Neither the name of the author nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+
+#include "test.hpp"
+#include "libtorrent/aux_/read_ahead.hpp"
+
+using namespace libtorrent;
+
+namespace {
+	int peer1;
+	int peer2;
+	storage_index_t const st{0};
+}
+
+TORRENT_TEST(read_ahead_no_history)
+{
+	aux::read_ahead_tracker t;
+	TEST_EQUAL(t.read_ahead(&peer1, 32), 32);
+	TEST_EQUAL(t.read_ahead(nullptr, 32), 32);
+
+	t.record(&peer1, st, piece_index_t(0), 0);
+	TEST_EQUAL(t.read_ahead(&peer1, 32), 32);
+}
+
+TORRENT_TEST(read_ahead_sequential)
+{
+	aux::read_ahead_tracker t;
+	for (piece_index_t p(0); p < piece_index_t(4); ++p)
+		for (int b = 0; b < 16; ++b)
+			t.record(&peer1, st, p, b);
+
+	// 63 sequential requests
+	TEST_EQUAL(t.read_ahead(&peer1, 32), 32 * 8);
+
+	// a different peer doesn't inherit the history
+	TEST_EQUAL(t.read_ahead(&peer2, 32), 32);
+}
+
+TORRENT_TEST(read_ahead_random)
+{
+	aux::read_ahead_tracker t;
+	t.record(&peer1, st, piece_index_t(10), 3);
+	t.record(&peer1, st, piece_index_t(2), 7);
+	t.record(&peer1, st, piece_index_t(30), 0);
+	TEST_EQUAL(t.read_ahead(&peer1, 32), 32);
+	t.record(&peer1, st, piece_index_t(5), 12);
+	TEST_EQUAL(t.read_ahead(&peer1, 32), 1);
+
+	// going sequential again restores the read-ahead
+	t.record(&peer1, st, piece_index_t(5), 13);
+	TEST_EQUAL(t.read_ahead(&peer1, 32), 32);
+}
+
+TORRENT_TEST(read_ahead_other_storage)
+{
+	aux::read_ahead_tracker t;
+	for (int b = 0; b < 20; ++b)
+		t.record(&peer1, st, piece_index_t(0), b);
+	TEST_EQUAL(t.read_ahead(&peer1, 32), 64);
+
+	// the same piece and block in another torrent is not sequential
+	t.record(&peer1, storage_index_t(1), piece_index_t(0), 20);
+	TEST_EQUAL(t.read_ahead(&peer1, 32), 32);
+}
@@ -39,12 +39,78 @@ POSSIBILITY OF SUCH DAMAGE.
 #include "libtorrent/hex.hpp" // to_hex
 #include "libtorrent/aux_/path.hpp"
 
+#include <condition_variable>
+#include <fstream>
+#include <mutex>
+
 enum flags_t
 {
 	seed_mode = 1,
-	time_critical = 2
+	time_critical = 2,
+	read_range = 4
 };
 
+void test_read_range(libtorrent::torrent_handle const& h
+	, libtorrent::torrent_info const& ti)
+{
+	using namespace libtorrent;
+
+	file_storage const& fs = ti.files();
+	file_index_t file(0);
+	while (fs.file_size(file) != 100000) ++file;
+
+	// an unaligned range, spanning several pieces
+	std::int64_t const offset = 5000;
+	int const size = 40000;
+
+	std::vector<char> expected(size);
+	std::ifstream f(fs.file_path(file, "tmp1_read_piece"), std::ios::binary);
+	f.seekg(offset);
+	f.read(expected.data(), size);
+	TEST_CHECK(f.good());
+
+	std::mutex m;
+	std::condition_variable cv;
+	bool done = false;
+	error_code result;
+	std::vector<char> data;
+
+	h.read_range(file, offset, size
+		, [&](error_code const& ec, std::vector<range_buffer> buffers)
+	{
+		std::unique_lock<std::mutex> l(m);
+		result = ec;
+		for (auto const& b : buffers)
+		{
+			TEST_CHECK(b.size <= 0x4000);
+			data.insert(data.end(), b.data().begin(), b.data().end());
+		}
+		done = true;
+		cv.notify_all();
+	});
+
+	std::unique_lock<std::mutex> l(m);
+	TEST_CHECK(cv.wait_for(l, std::chrono::seconds(10), [&] { return done; }));
+	TEST_CHECK(!result);
+	TEST_CHECK(data == expected);
+
+	// reading past the end of the file fails
+	done = false;
+	l.unlock();
+	h.read_range(file, 99000, 2000
+		, [&](error_code const& ec, std::vector<range_buffer> buffers)
+	{
+		std::unique_lock<std::mutex> l2(m);
+		result = ec;
+		TEST_CHECK(buffers.empty());
+		done = true;
+		cv.notify_all();
+	});
+	l.lock();
+	TEST_CHECK(cv.wait_for(l, std::chrono::seconds(10), [&] { return done; }));
+	TEST_CHECK(result);
+}
+
 void test_read_piece(int flags)
 {
 	using namespace libtorrent;
@@ -123,6 +189,13 @@ void test_read_piece(int flags)
 
 	TEST_CHECK(tor1.status().is_seeding);
 
+	if (flags & read_range)
+	{
+		test_read_range(tor1, *ti);
+		remove_all("tmp1_read_piece", ec);
+		return;
+	}
+
 	if (flags & time_critical)
 	{
 		tor1.set_piece_deadline(piece_index_t(1), 0, torrent_handle::alert_when_available);
@@ -165,3 +238,8 @@ TORRENT_TEST(time_critical)
 	test_read_piece(time_critical);
 }
 
+TORRENT_TEST(read_range)
+{
+	test_read_piece(read_range);
+}
+
@@ -113,6 +113,32 @@ TORRENT_TEST(recv_buffer_grow)
 	TEST_CHECK(b.capacity() < 300 + 500);
 }
 
+TORRENT_TEST(recv_buffer_skip)
+{
+	receive_buffer b;
+	b.cut(0, 5);
+	span<char> r = b.reserve(20);
+	for (int i = 0; i < 20; ++i) r[std::size_t(i)] = char(i);
+	b.received(20);
+
+	TEST_EQUAL(int(b.unconsumed().size()), 20);
+
+	// drop the first two 9 byte messages
+	b.skip(9);
+	b.skip(9);
+
+	TEST_EQUAL(b.pos(), 0);
+	TEST_EQUAL(b.packet_size(), 5);
+	TEST_EQUAL(int(b.unconsumed().size()), 2);
+	TEST_EQUAL(b.unconsumed()[0], 18);
+
+	b.advance_pos(2);
+	TEST_EQUAL(int(b.get().size()), 2);
+	TEST_EQUAL(b.get()[1], 19);
+	TEST_EQUAL(b.pos_at_end(), true);
+	TEST_EQUAL(b.unconsumed().size(), 0);
+}
+
 TORRENT_TEST(recv_buffer_grow_limit)
 {
 	receive_buffer b;
@@ -0,0 +1,99 @@
+/*
+
+Copyright (c) 2017, Arvid Norberg
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions
+are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in
+      the documentation and/or other materials provided with the distribution.
+    * Neither the name of the author nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+
+#include "test.hpp"
+#include "libtorrent/aux_/recent_endpoints.hpp"
+
+using namespace libtorrent;
+
+namespace {
+
+tcp::endpoint endpoint(int const i)
+{
+	return tcp::endpoint(address_v4(std::uint32_t((10 << 24) + i))
+		, std::uint16_t(6881 + i % 7));
+}
+
+}
+
+TORRENT_TEST(recent_endpoints_insert)
+{
+	aux::recent_endpoints f;
+	TEST_CHECK(!f.insert(endpoint(1), 0));
+	TEST_CHECK(f.insert(endpoint(1), 0));
+
+	// a different tag or port counts as a different endpoint
+	TEST_CHECK(!f.insert(endpoint(1), 1));
+	TEST_CHECK(!f.insert(tcp::endpoint(endpoint(1).address(), 1), 0));
+
+#if TORRENT_USE_IPV6
+	tcp::endpoint const ep6(address_v6::from_string("2001::1"), 6881);
+	TEST_CHECK(!f.insert(ep6, 0));
+	TEST_CHECK(f.insert(ep6, 0));
+#endif
+
+	f.clear();
+	TEST_CHECK(!f.insert(endpoint(1), 0));
+}
+
+TORRENT_TEST(recent_endpoints_rotate)
+{
+	aux::recent_endpoints f;
+	int const n = aux::recent_endpoints::rotate_interval;
+
+	// fill the first filter
+	int false_positives = 0;
+	for (int i = 0; i < n; ++i)
+		false_positives += f.insert(endpoint(i), 0);
+
+	// once the first filter is full, its endpoints are still remembered
+	// while the second one is filled
+	for (int i = 0; i < n; ++i)
+		TEST_CHECK(f.insert(endpoint(i), 0));
+	for (int i = n; i < n * 2; ++i)
+		false_positives += f.insert(endpoint(i), 0);
+	for (int i = 0; i < n * 2; ++i)
+		TEST_CHECK(f.insert(endpoint(i), 0));
+
+	// the next rotation forgets the first batch. Since the endpoints are
+	// inserted again as they are found missing, count how many are left
+	int remembered = 0;
+	for (int i = n * 2; i < n * 3; ++i)
+		false_positives += f.insert(endpoint(i), 0);
+	for (int i = 0; i < n; ++i)
+		remembered += f.insert(endpoint(i), 0);
+
+	// only false positives are left, which are expected to be a few percent
+	TEST_CHECK(remembered < n / 10);
+	TEST_CHECK(false_positives < n * 3 / 10);
+}
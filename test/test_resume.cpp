@@ -270,6 +270,45 @@ TORRENT_TEST(piece_priorities)
 	test_piece_priorities();
 }
 
+TORRENT_TEST(only_changes)
+{
+	lt::session ses(settings());
+	std::shared_ptr<torrent_info> ti = generate_torrent();
+	add_torrent_params p;
+	p.ti = ti;
+	p.save_path = ".";
+	torrent_handle h = ses.add_torrent(p);
+
+	// the first save establishes the baseline
+	h.save_resume_data();
+	alert const* a = wait_for_alert(ses, save_resume_data_alert::alert_type);
+	TEST_CHECK(a);
+
+	h.piece_priority(piece_index_t(0), 0);
+
+	h.save_resume_data(torrent_handle::only_changes);
+	a = wait_for_alert(ses, save_resume_data_alert::alert_type);
+	save_resume_data_alert const* ra = alert_cast<save_resume_data_alert>(a);
+	TEST_CHECK(ra);
+	if (ra)
+	{
+		TEST_CHECK(ra->changes & torrent_handle::resume_priorities);
+		TEST_CHECK((ra->changes & torrent_handle::resume_trackers) == 0);
+		TEST_CHECK(ra->params.info_hash == ti->info_hash());
+		TEST_EQUAL(int(ra->params.piece_priorities.size()), ti->num_pieces());
+		TEST_EQUAL(ra->params.piece_priorities[0], '\0');
+		TEST_CHECK(ra->params.trackers.empty());
+		TEST_CHECK(ra->params.url_seeds.empty());
+		TEST_CHECK(ra->params.have_pieces.empty());
+	}
+
+	// nothing changed since the last save
+	h.save_resume_data(torrent_handle::only_changes
+		| torrent_handle::only_if_modified);
+	a = wait_for_alert(ses, save_resume_data_failed_alert::alert_type);
+	TEST_CHECK(a);
+}
+
 
 // TODO: test what happens when loading a resume file with both piece priorities
 // and file priorities (file prio should take presedence)
@@ -0,0 +1,239 @@
+/*
+
+Copyright (c) 2017, Arvid Norberg
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions
+are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in
+      the documentation and/or other materials provided with the distribution.
+    * Neither the name of the author nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+
+#include "test.hpp"
+#include "libtorrent/resume_data_store.hpp"
+#include "libtorrent/add_torrent_params.hpp"
+#include "libtorrent/read_resume_data.hpp"
+#include "libtorrent/file.hpp"
+#include "libtorrent/aux_/path.hpp"
+#include "libtorrent/error_code.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+using namespace libtorrent;
+
+namespace {
+
+std::vector<char> make_buf(char const* str)
+{
+	return std::vector<char>(str, str + std::strlen(str));
+}
+
+span<char const> str(char const* s)
+{
+	return span<char const>(s, std::strlen(s));
+}
+
+std::string store_path()
+{
+	error_code ec;
+	std::string const p = combine_path(complete("."), "resume_store_test");
+	remove(p, ec);
+	return p;
+}
+
+} // anonymous namespace
+
+TORRENT_TEST(save_load)
+{
+	std::string const path = store_path();
+	sha1_hash const ih1("abababababababababab");
+	sha1_hash const ih2("cdcdcdcdcdcdcdcdcdcd");
+	std::vector<char> buf;
+
+	{
+		resume_data_store s;
+		error_code ec;
+		s.open(path, ec);
+		TEST_CHECK(!ec);
+		TEST_EQUAL(s.num_torrents(), 0);
+		TEST_CHECK(!s.load(ih1, buf, ec));
+
+		s.save(ih1, str("d3:fooi1ee"), ec);
+		TEST_CHECK(!ec);
+		s.save(ih2, str("d3:bari2ee"), ec);
+		TEST_CHECK(!ec);
+		s.save(ih1, str("d3:fooi3ee"), ec);
+		TEST_CHECK(!ec);
+
+		TEST_EQUAL(s.num_torrents(), 2);
+		TEST_EQUAL(s.garbage_size(), resume_data_store::header_size + 10);
+		TEST_CHECK(s.load(ih1, buf, ec));
+		TEST_CHECK(buf == make_buf("d3:fooi3ee"));
+	}
+
+	// make sure the index is rebuilt from the file
+	resume_data_store s;
+	error_code ec;
+	s.open(path, ec);
+	TEST_CHECK(!ec);
+	TEST_EQUAL(s.num_torrents(), 2);
+	TEST_EQUAL(s.file_size(), 3 * (resume_data_store::header_size + 10));
+	TEST_EQUAL(s.garbage_size(), resume_data_store::header_size + 10);
+	TEST_CHECK(s.load(ih1, buf, ec));
+	TEST_CHECK(buf == make_buf("d3:fooi3ee"));
+	TEST_CHECK(s.load(ih2, buf, ec));
+	TEST_CHECK(buf == make_buf("d3:bari2ee"));
+
+	std::vector<sha1_hash> t = s.torrents();
+	std::sort(t.begin(), t.end());
+	TEST_EQUAL(t.size(), 2);
+	TEST_CHECK(t[0] == ih1);
+	TEST_CHECK(t[1] == ih2);
+}
+
+TORRENT_TEST(remove_compact)
+{
+	std::string const path = store_path();
+	sha1_hash const ih1("abababababababababab");
+	sha1_hash const ih2("cdcdcdcdcdcdcdcdcdcd");
+	std::vector<char> buf;
+	error_code ec;
+
+	{
+		resume_data_store s;
+		s.open(path, ec);
+		s.save(ih1, str("d3:fooi1ee"), ec);
+		s.save(ih2, str("d3:bari2ee"), ec);
+		s.save(ih2, str("d3:bari3ee"), ec);
+		s.remove(ih1, ec);
+		TEST_CHECK(!ec);
+		TEST_CHECK(!s.contains(ih1));
+		TEST_CHECK(!s.load(ih1, buf, ec));
+		TEST_EQUAL(s.num_torrents(), 1);
+	}
+
+	resume_data_store s;
+	s.open(path, ec);
+	TEST_CHECK(!ec);
+	TEST_CHECK(!s.contains(ih1));
+	TEST_EQUAL(s.num_torrents(), 1);
+	TEST_EQUAL(s.garbage_size(), 3 * resume_data_store::header_size + 20);
+
+	s.compact(ec);
+	TEST_CHECK(!ec);
+	TEST_EQUAL(s.garbage_size(), 0);
+	TEST_EQUAL(s.file_size(), resume_data_store::header_size + 10);
+	TEST_CHECK(s.load(ih2, buf, ec));
+	TEST_CHECK(buf == make_buf("d3:bari3ee"));
+	TEST_CHECK(!exists(path + ".tmp"));
+}
+
+TORRENT_TEST(truncated_record)
+{
+	std::string const path = store_path();
+	sha1_hash const ih1("abababababababababab");
+	sha1_hash const ih2("cdcdcdcdcdcdcdcdcdcd");
+	std::vector<char> buf;
+	error_code ec;
+
+	{
+		resume_data_store s;
+		s.open(path, ec);
+		s.save(ih1, str("d3:fooi1ee"), ec);
+		s.save(ih2, str("d3:bari2ee"), ec);
+	}
+
+	{
+		// simulate being interrupted while writing the second record
+		file f(path, file::read_write, ec);
+		TEST_CHECK(!ec);
+		f.set_size(2 * resume_data_store::header_size + 15, ec);
+		TEST_CHECK(!ec);
+	}
+
+	resume_data_store s;
+	s.open(path, ec);
+	TEST_CHECK(!ec);
+	TEST_EQUAL(s.num_torrents(), 1);
+	TEST_CHECK(s.contains(ih1));
+	TEST_CHECK(!s.contains(ih2));
+	TEST_EQUAL(s.file_size(), resume_data_store::header_size + 10);
+
+	// the next record is appended right after the last valid one
+	s.save(ih2, str("d3:bari4ee"), ec);
+	TEST_CHECK(s.load(ih2, buf, ec));
+	TEST_CHECK(buf == make_buf("d3:bari4ee"));
+}
+
+TORRENT_TEST(corrupt_payload)
+{
+	std::string const path = store_path();
+	sha1_hash const ih1("abababababababababab");
+	std::vector<char> buf;
+	error_code ec;
+
+	{
+		resume_data_store s;
+		s.open(path, ec);
+		s.save(ih1, str("d3:fooi1ee"), ec);
+	}
+
+	{
+		file f(path, file::read_write, ec);
+		char c = 'x';
+		iovec_t b = {&c, 1};
+		f.writev(resume_data_store::header_size + 2, b, ec);
+		TEST_CHECK(!ec);
+	}
+
+	resume_data_store s;
+	s.open(path, ec);
+	TEST_CHECK(!s.load(ih1, buf, ec));
+	TEST_CHECK(ec == error_code(errors::invalid_file_tag));
+}
+
+TORRENT_TEST(add_torrent_params)
+{
+	std::string const path = store_path();
+	add_torrent_params atp;
+	atp.info_hash.assign("abababababababababab");
+	atp.save_path = "test";
+	atp.total_uploaded = 1337;
+
+	resume_data_store s;
+	error_code ec;
+	s.open(path, ec);
+	s.save(atp, ec);
+	TEST_CHECK(!ec);
+
+	std::vector<char> buf;
+	TEST_CHECK(s.load(atp.info_hash, buf, ec));
+	add_torrent_params const atp2 = read_resume_data(buf, ec);
+	TEST_CHECK(!ec);
+	TEST_CHECK(atp2.info_hash == atp.info_hash);
+	TEST_EQUAL(atp2.save_path, "test");
+	TEST_EQUAL(atp2.total_uploaded, 1337);
+}
@@ -41,9 +41,14 @@ POSSIBILITY OF SUCH DAMAGE.
 #include "libtorrent/bdecode.hpp"
 #include "libtorrent/bencode.hpp"
 #include "libtorrent/torrent_info.hpp"
+#include "libtorrent/extensions/stats_recorder.hpp"
+#include "libtorrent/io.hpp"
 #include "settings.hpp"
 
 #include <fstream>
+#include <thread>
+#include <limits>
+#include <cstring> // for memcmp
 
 using namespace std::placeholders;
 using namespace libtorrent;
@@ -152,6 +157,94 @@ TORRENT_TEST(async_add_torrent_duplicate)
 	TEST_CHECK(!a->error);
 }
 
+TORRENT_TEST(network_stall_alert)
+{
+	settings_pack p = settings();
+	p.set_int(settings_pack::alert_mask, alert::performance_warning);
+	p.set_int(settings_pack::network_stall_threshold, 50);
+	lt::session ses(p);
+
+	add_torrent_params atp;
+	atp.info_hash.assign("abababababababababab");
+	atp.save_path = ".";
+	ses.add_torrent(atp);
+
+	// the predicate runs on the network thread, stalling it
+	std::vector<torrent_status> status;
+	ses.get_torrent_status(&status, [](torrent_status const&)
+	{
+		std::this_thread::sleep_for(lt::milliseconds(100));
+		return false;
+	});
+
+	auto const* a = alert_cast<network_stall_alert>(
+		wait_for_alert(ses, network_stall_alert::alert_type, "ses"));
+	TEST_CHECK(a);
+	if (a == nullptr) return;
+	TEST_EQUAL(a->handler, network_stall_alert::session_call);
+	TEST_CHECK(a->exec_time >= lt::milliseconds(100));
+}
+
+TORRENT_TEST(async_torrent_queries)
+{
+	settings_pack p = settings();
+	p.set_int(settings_pack::alert_mask, alert::status_notification);
+	lt::session ses(p);
+
+	add_torrent_params atp;
+	atp.ti = create_torrent(nullptr, "temporary", 16 * 1024, 8, false);
+	atp.save_path = ".";
+	torrent_handle h = ses.add_torrent(atp);
+
+	h.post_piece_priorities();
+	auto const* pp = alert_cast<piece_priorities_alert>(
+		wait_for_alert(ses, piece_priorities_alert::alert_type, "ses"));
+	TEST_CHECK(pp);
+	if (pp)
+	{
+		TEST_CHECK(pp->handle == h);
+		TEST_EQUAL(int(pp->priorities.size()), 8);
+	}
+
+	h.post_file_progress();
+	auto const* fp = alert_cast<file_progress_alert>(
+		wait_for_alert(ses, file_progress_alert::alert_type, "ses"));
+	TEST_CHECK(fp);
+	if (fp) TEST_EQUAL(int(fp->files.size()), atp.ti->num_files());
+
+	h.post_peer_info();
+	auto const* pi = alert_cast<peer_info_alert>(
+		wait_for_alert(ses, peer_info_alert::alert_type, "ses"));
+	TEST_CHECK(pi);
+	if (pi) TEST_CHECK(pi->peer_info.empty());
+
+	// handles that don't refer to a torrent are skipped
+	ses.post_torrent_status({h, torrent_handle()});
+	auto const* su = alert_cast<state_update_alert>(
+		wait_for_alert(ses, state_update_alert::alert_type, "ses"));
+	TEST_CHECK(su);
+	if (su == nullptr) return;
+	TEST_EQUAL(int(su->status.size()), 1);
+	if (su->status.size() == 1) TEST_CHECK(su->status[0].handle == h);
+}
+
+TORRENT_TEST(peer_sample_alert)
+{
+	settings_pack p = settings();
+	p.set_int(settings_pack::alert_mask, alert::stats_notification);
+	p.set_int(settings_pack::peer_sample_interval, 100);
+	p.set_int(settings_pack::tick_interval, 100);
+	lt::session ses(p);
+
+	auto const* a = alert_cast<peer_sample_alert>(
+		wait_for_alert(ses, peer_sample_alert::alert_type, "ses"));
+	TEST_CHECK(a);
+	if (a == nullptr) return;
+	// there are no peers connected
+	TEST_EQUAL(a->num_peers, 0);
+	TEST_CHECK(a->samples.empty());
+}
+
 TORRENT_TEST(load_empty_file)
 {
 	settings_pack p = settings();
@@ -184,6 +277,140 @@ TORRENT_TEST(session_stats)
 	}
 }
 
+TORRENT_TEST(session_stats_delta)
+{
+	std::vector<std::int64_t> prev(lt::counters::num_counters, 0);
+	std::vector<std::int64_t> cur = prev;
+	cur[0] = 1;
+	cur[5] = -3;
+	cur[6] = std::numeric_limits<std::int64_t>::max();
+	cur.back() = 1000000;
+
+	std::vector<char> delta;
+	encode_session_stats_delta(prev, cur, delta);
+	std::vector<std::int64_t> values = prev;
+	TEST_CHECK(apply_session_stats_delta(delta, values));
+	TEST_CHECK(values == cur);
+
+	// wrapping around
+	prev = cur;
+	cur[6] = std::numeric_limits<std::int64_t>::min();
+	cur[5] = 2;
+	delta.clear();
+	encode_session_stats_delta(prev, cur, delta);
+	TEST_CHECK(apply_session_stats_delta(delta, values));
+	TEST_CHECK(values == cur);
+
+	// no changes
+	delta.clear();
+	encode_session_stats_delta(cur, cur, delta);
+	TEST_CHECK(delta.empty());
+	TEST_CHECK(apply_session_stats_delta(delta, values));
+	TEST_CHECK(values == cur);
+
+	// truncated varint
+	char const truncated[] = { 0, char(0x80) };
+	TEST_CHECK(!apply_session_stats_delta(truncated, values));
+
+	// counter index out of range
+	std::vector<std::int64_t> small(2, 0);
+	delta.clear();
+	encode_session_stats_delta(prev, cur, delta);
+	TEST_CHECK(!apply_session_stats_delta(delta, small));
+}
+
+#ifndef TORRENT_DISABLE_EXTENSIONS
+TORRENT_TEST(stats_recorder)
+{
+	std::vector<std::int64_t> expected;
+	{
+		error_code ec;
+		TEST_CHECK(!create_stats_recorder_plugin("non-existent/stats.bin", 0, ec));
+		TEST_CHECK(ec);
+
+		ec.clear();
+		std::shared_ptr<plugin> rec = create_stats_recorder_plugin("stats.bin", 0, ec);
+		TEST_CHECK(!ec);
+		TEST_CHECK(rec);
+		if (!rec) return;
+
+		lt::session ses(settings());
+		ses.add_extension(rec);
+		rec.reset();
+
+		for (int i = 0; i < 3; ++i)
+		{
+			ses.post_session_stats();
+			auto const* a = alert_cast<session_stats_alert>(
+				wait_for_alert(ses, session_stats_alert::alert_type, "ses"));
+			TEST_CHECK(a);
+			if (a == nullptr) return;
+			expected.assign(a->values.begin(), a->values.end());
+		}
+		// destructing the session closes the file
+	}
+
+	std::vector<char> buf;
+	{
+		std::ifstream in("stats.bin", std::ios::binary);
+		buf.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+	}
+
+	char const* ptr = buf.data();
+	char const* const end = buf.data() + buf.size();
+	TEST_CHECK(buf.size() > 28);
+	if (buf.size() <= 28) return;
+	TEST_CHECK(std::memcmp(ptr, "ltstats\0", 8) == 0);
+	ptr += 8;
+	TEST_EQUAL(detail::read_uint32(ptr), 1);
+	TEST_CHECK(detail::read_uint64(ptr) > 0);
+	TEST_EQUAL(int(detail::read_uint32(ptr)), counters::num_counters);
+	std::vector<stats_metric> const metrics = session_stats_metrics();
+	std::uint32_t const num_metrics = detail::read_uint32(ptr);
+	TEST_EQUAL(num_metrics, metrics.size());
+	for (std::uint32_t i = 0; i < num_metrics && ptr < end; ++i)
+	{
+		int const idx = int(detail::read_uint32(ptr));
+		int const type = detail::read_uint8(ptr);
+		int const len = detail::read_uint8(ptr);
+		std::string const name(ptr, std::size_t(std::min(len, int(end - ptr))));
+		ptr += len;
+		TEST_EQUAL(find_metric_idx(name.c_str()), idx);
+		TEST_EQUAL(type, metrics[i].type == stats_metric::type_gauge ? 1 : 0);
+	}
+
+	auto read_varint = [&]()
+	{
+		std::uint64_t ret = 0;
+		for (int shift = 0; ptr < end; shift += 7)
+		{
+			std::uint8_t const c = detail::read_uint8(ptr);
+			ret |= std::uint64_t(c & 0x7f) << shift;
+			if ((c & 0x80) == 0) break;
+		}
+		return ret;
+	};
+
+	std::vector<std::int64_t> values(counters::num_counters, 0);
+	int num_records = 0;
+	while (ptr < end)
+	{
+		int const kind = detail::read_uint8(ptr);
+		// the first sample is a complete snapshot
+		TEST_EQUAL(kind, num_records == 0 ? 1 : 0);
+		read_varint();
+		std::size_t const size = std::size_t(read_varint());
+		TEST_CHECK(size <= std::size_t(end - ptr));
+		if (size > std::size_t(end - ptr)) break;
+		TEST_CHECK(apply_session_stats_delta({ptr, size}, values));
+		ptr += size;
+		++num_records;
+	}
+	TEST_EQUAL(num_records, 3);
+	TEST_CHECK(values == expected);
+}
+#endif
+
 TORRENT_TEST(paused_session)
 {
 	lt::session s(settings());
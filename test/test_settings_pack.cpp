@@ -37,6 +37,7 @@ POSSIBILITY OF SUCH DAMAGE.
 #include "libtorrent/bencode.hpp"
 #include "libtorrent/bdecode.hpp"
 #include <iostream>
+#include <thread>
 
 using namespace libtorrent;
 using namespace libtorrent::aux;
@@ -257,3 +258,34 @@ TORRENT_TEST(settings_pack_abi)
 	TEST_EQUAL(settings_pack::max_web_seed_connections, settings_pack::int_type_base + 130);
 	TEST_EQUAL(settings_pack::resolver_cache_timeout, settings_pack::int_type_base + 131);
 }
+
+TORRENT_TEST(settings_snapshot)
+{
+	aux::session_settings sett;
+	sett.set_int(settings_pack::read_cache_line_size, 17);
+	aux::settings_publisher pub(sett);
+
+	aux::settings_snapshot const& s1 = pub.current();
+	TEST_EQUAL(s1.hot.read_cache_line_size, 17);
+	TEST_EQUAL(s1.settings.get_int(settings_pack::read_cache_line_size), 17);
+	TEST_EQUAL(s1.version, pub.version());
+	std::uint64_t const v1 = s1.version;
+
+	// reading it again without a publish in between gives the same snapshot
+	TEST_CHECK(&pub.current() == &s1);
+
+	sett.set_int(settings_pack::read_cache_line_size, 42);
+	sett.set_bool(settings_pack::use_read_cache, false);
+	pub.publish(sett);
+
+	aux::settings_snapshot const& s2 = pub.current();
+	TEST_EQUAL(s2.hot.read_cache_line_size, 42);
+	TEST_EQUAL(s2.hot.use_read_cache, false);
+	TEST_CHECK(s2.version > v1);
+
+	// another thread sees the current snapshot too
+	int seen = 0;
+	std::thread t([&] { seen = pub.current().hot.read_cache_line_size; });
+	t.join();
+	TEST_EQUAL(seen, 42);
+}
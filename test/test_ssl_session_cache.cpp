@@ -0,0 +1,193 @@
+/*
+
+Copyright (c) 2017, Arvid Norberg
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions
+are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in
+      the documentation and/or other materials provided with the distribution.
+    * Neither the name of the author nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+#include "libtorrent/aux_/ssl_session_cache.hpp"
+#include "libtorrent/aux_/path.hpp"
+#include "libtorrent/socket.hpp"
+
+#include "test.hpp"
+
+#ifdef TORRENT_USE_OPENSSL
+
+#include "libtorrent/aux_/disable_warnings_push.hpp"
+#include <openssl/ssl.h>
+#include <openssl/bio.h>
+#include "libtorrent/aux_/disable_warnings_pop.hpp"
+
+#include <memory>
+
+using namespace libtorrent;
+
+namespace {
+
+	struct ssl_deleter
+	{
+		void operator()(SSL* s) const { SSL_free(s); }
+		void operator()(SSL_CTX* c) const { SSL_CTX_free(c); }
+	};
+
+	using ssl_ptr = std::unique_ptr<SSL, ssl_deleter>;
+	using ctx_ptr = std::unique_ptr<SSL_CTX, ssl_deleter>;
+
+	std::string const sid_ctx = "ssl_session_cache";
+
+	ctx_ptr server_context()
+	{
+		ctx_ptr ctx(SSL_CTX_new(SSLv23_method()));
+		std::string const cert = combine_path("..", combine_path("ssl", "peer_certificate.pem"));
+		std::string const key = combine_path("..", combine_path("ssl", "peer_private_key.pem"));
+		SSL_CTX_set_default_passwd_cb_userdata(ctx.get(), const_cast<char*>("test"));
+		TEST_EQUAL(SSL_CTX_use_certificate_file(ctx.get(), cert.c_str(), SSL_FILETYPE_PEM), 1);
+		TEST_EQUAL(SSL_CTX_use_PrivateKey_file(ctx.get(), key.c_str(), SSL_FILETYPE_PEM), 1);
+		aux::ssl_session_cache::enable_resumption(ctx.get(), sid_ctx);
+		return ctx;
+	}
+
+	ctx_ptr client_context()
+	{
+		ctx_ptr ctx(SSL_CTX_new(SSLv23_method()));
+		SSL_CTX_set_verify(ctx.get(), SSL_VERIFY_NONE, nullptr);
+		aux::ssl_session_cache::enable_resumption(ctx.get(), sid_ctx);
+		return ctx;
+	}
+
+	// runs a handshake between a client and a server over an in-memory BIO
+	// pair, and returns whether the client resumed a previous session
+	bool handshake(SSL_CTX* client_ctx, SSL_CTX* server_ctx
+		, aux::ssl_session_cache& cache, tcp::endpoint const& ep)
+	{
+		ssl_ptr client(SSL_new(client_ctx));
+		ssl_ptr server(SSL_new(server_ctx));
+		BIO* client_bio = nullptr;
+		BIO* server_bio = nullptr;
+		BIO_new_bio_pair(&client_bio, 0, &server_bio, 0);
+		SSL_set_bio(client.get(), client_bio, client_bio);
+		SSL_set_bio(server.get(), server_bio, server_bio);
+		SSL_set_connect_state(client.get());
+		SSL_set_accept_state(server.get());
+
+		cache.prepare(client.get(), ep);
+
+		bool client_done = false;
+		bool server_done = false;
+		for (int i = 0; i < 100 && !(client_done && server_done); ++i)
+		{
+			if (!client_done) client_done = SSL_do_handshake(client.get()) == 1;
+			if (!server_done) server_done = SSL_do_handshake(server.get()) == 1;
+		}
+		TEST_CHECK(client_done);
+		TEST_CHECK(server_done);
+
+		// in TLS 1.3 the session tickets are sent after the handshake, let the
+		// client read them
+		char buf[10];
+		TEST_CHECK(SSL_read(client.get(), buf, sizeof(buf)) <= 0);
+
+		return SSL_session_reused(client.get()) == 1;
+	}
+}
+
+TORRENT_TEST(resume_session)
+{
+	ctx_ptr const server_ctx = server_context();
+	ctx_ptr const client_ctx = client_context();
+	auto cache = std::make_shared<aux::ssl_session_cache>();
+
+	tcp::endpoint const ep1(address_v4::from_string("10.0.0.1"), 6881);
+	tcp::endpoint const ep2(address_v4::from_string("10.0.0.2"), 6881);
+
+	TEST_CHECK(!handshake(client_ctx.get(), server_ctx.get(), *cache, ep1));
+	TEST_EQUAL(cache->size(), 1);
+
+	// reconnecting to the same endpoint resumes the session
+	TEST_CHECK(handshake(client_ctx.get(), server_ctx.get(), *cache, ep1));
+	TEST_EQUAL(cache->size(), 1);
+
+	// but a different endpoint needs a full handshake
+	TEST_CHECK(!handshake(client_ctx.get(), server_ctx.get(), *cache, ep2));
+	TEST_EQUAL(cache->size(), 2);
+}
+
+TORRENT_TEST(max_size)
+{
+	ctx_ptr const server_ctx = server_context();
+	ctx_ptr const client_ctx = client_context();
+	auto cache = std::make_shared<aux::ssl_session_cache>(2);
+
+	for (int i = 0; i < 4; ++i)
+	{
+		tcp::endpoint const ep(address_v4(std::uint32_t(0x0a000001 + i)), 6881);
+		TEST_CHECK(!handshake(client_ctx.get(), server_ctx.get(), *cache, ep));
+		TEST_CHECK(cache->size() <= 2);
+	}
+	TEST_EQUAL(cache->size(), 2);
+}
+
+TORRENT_TEST(cache_destructed)
+{
+	ctx_ptr const server_ctx = server_context();
+	ctx_ptr const client_ctx = client_context();
+	tcp::endpoint const ep(address_v4::from_string("10.0.0.1"), 6881);
+
+	ssl_ptr client(SSL_new(client_ctx.get()));
+	{
+		auto cache = std::make_shared<aux::ssl_session_cache>();
+		cache->prepare(client.get(), ep);
+	}
+	// the connection outliving the cache must not be a problem, any new
+	// session is just not remembered
+	ssl_ptr server(SSL_new(server_ctx.get()));
+	BIO* client_bio = nullptr;
+	BIO* server_bio = nullptr;
+	BIO_new_bio_pair(&client_bio, 0, &server_bio, 0);
+	SSL_set_bio(client.get(), client_bio, client_bio);
+	SSL_set_bio(server.get(), server_bio, server_bio);
+	SSL_set_connect_state(client.get());
+	SSL_set_accept_state(server.get());
+	bool done = false;
+	for (int i = 0; i < 100 && !done; ++i)
+	{
+		int const c = SSL_do_handshake(client.get());
+		int const s = SSL_do_handshake(server.get());
+		done = c == 1 && s == 1;
+	}
+	TEST_CHECK(done);
+	char buf[10];
+	TEST_CHECK(SSL_read(client.get(), buf, sizeof(buf)) <= 0);
+}
+
+#else
+TORRENT_TEST(disabled)
+{
+	std::printf("SSL session cache test not run because it's disabled\n");
+}
+#endif // TORRENT_USE_OPENSSL
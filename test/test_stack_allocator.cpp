@@ -107,3 +107,30 @@ TORRENT_TEST(swap)
 	TEST_CHECK(a2.ptr(idx1) == "testing"_sv);
 }
 
+
+TORRENT_TEST(intern_string)
+{
+	stack_allocator a;
+
+	allocation_slot const idx1 = a.intern_string("torrent name");
+	allocation_slot const idx2 = a.intern_string("http://tracker.com/announce");
+	allocation_slot const idx3 = a.intern_string("torrent name");
+	allocation_slot const idx4 = a.intern_string("torrent nam");
+
+	// the same string is only stored once
+	TEST_CHECK(idx1 == idx3);
+	TEST_CHECK(idx1 != idx4);
+	TEST_CHECK(a.ptr(idx1) == "torrent name"_sv);
+	TEST_CHECK(a.ptr(idx2) == "http://tracker.com/announce"_sv);
+	TEST_CHECK(a.ptr(idx4) == "torrent nam"_sv);
+
+	// interned strings are 0-terminated, just like copy_string()
+	TEST_EQUAL(std::strlen(a.ptr(idx1)), 12);
+
+	// after a reset, strings have to be copied again
+	a.reset();
+	a.copy_string("something else");
+	allocation_slot const idx5 = a.intern_string("torrent name");
+	TEST_CHECK(a.ptr(idx5) == "torrent name"_sv);
+	TEST_CHECK(a.intern_string("torrent name") == idx5);
+}
@@ -46,6 +46,7 @@ POSSIBILITY OF SUCH DAMAGE.
 #include "libtorrent/read_resume_data.hpp"
 #include "libtorrent/write_resume_data.hpp"
 #include "libtorrent/aux_/path.hpp"
+#include "libtorrent/aux_/storage_utils.hpp"
 
 #include <iostream>
 #include <fstream>
@@ -745,6 +746,79 @@ TORRENT_TEST(fastresume_deprecated)
 }
 #endif
 
+TORRENT_TEST(check_files_trust_resume_data)
+{
+	std::string const test_path = current_working_directory();
+	error_code ec;
+	remove_all(combine_path(test_path, "temp_storage"), ec);
+
+	// none of these files exist, but the resume data claims we're a seed
+	file_storage fs;
+	fs.add_file("temp_storage/test1.tmp", 0x4000);
+	fs.add_file("temp_storage/test2.tmp", 0x8000);
+	fs.set_piece_length(0x4000);
+	fs.set_num_pieces(3);
+
+	boost::asio::io_service ios;
+	counters cnt;
+	disk_io_thread io(ios, cnt);
+	settings_pack sett;
+	sett.set_int(settings_pack::aio_threads, 1);
+	io.set_settings(&sett);
+
+	storage_params p;
+	p.files = &fs;
+	p.path = test_path;
+	p.mode = storage_mode_sparse;
+	auto st = io.new_torrent(default_storage_constructor, std::move(p)
+		, std::shared_ptr<void>());
+
+	add_torrent_params frd;
+	frd.have_pieces.resize(3, true);
+
+	status_t status = status_t::fatal_disk_error;
+	storage_error error;
+	bool done = false;
+	auto handler = [&](status_t const s, storage_error const& e)
+	{
+		status = s;
+		error = e;
+		done = true;
+	};
+
+	// when trusting the resume data, the files aren't looked at
+	aux::vector<std::string, file_index_t> links;
+	io.async_check_files(st, &frd, links, handler
+		, disk_interface::trust_resume_data);
+	io.submit_jobs();
+	ios.reset();
+	run_until(ios, done);
+	TEST_CHECK(status == status_t::no_error);
+	TEST_CHECK(!error);
+
+	// the deferred check rejects it. Since there are no files at all, the
+	// storage is just initialized, but the error is still reported
+	done = false;
+	io.async_check_files(st, &frd, links, handler);
+	io.submit_jobs();
+	ios.reset();
+	run_until(ios, done);
+	TEST_EQUAL(error.ec, error_code(errors::mismatching_file_size));
+
+	// both check jobs were recorded in the latency histograms
+	std::int64_t queued = 0;
+	std::int64_t executed = 0;
+	for (int i = 0; i < 16; ++i)
+	{
+		queued += cnt[counters::disk_other_queue_time5 + i];
+		executed += cnt[counters::disk_other_exec_time5 + i];
+	}
+	TEST_EQUAL(queued, 2);
+	TEST_EQUAL(executed, 2);
+
+	io.abort(true);
+}
+
 
 bool got_file_rename_alert(alert const* a)
 {
@@ -1409,6 +1483,65 @@ TORRENT_TEST(move_storage_into_self)
 		, combine_path("_folder3", "test4.tmp")))));
 }
 
+#if TORRENT_HAVE_MMAP
+TORRENT_TEST(mmap_storage)
+{
+	std::string const save_path = current_working_directory();
+	std::string const test_path = combine_path(save_path, "temp_storage");
+	delete_dirs(test_path);
+
+	aux::session_settings set;
+	file_storage fs;
+	std::vector<char> buf;
+	setup_torrent_info(fs, buf);
+	file_pool fp;
+
+	storage_params p;
+	p.files = &fs;
+	p.path = save_path;
+	p.mode = storage_mode_sparse;
+	std::unique_ptr<storage_interface> s(mmap_storage_constructor(p, fp));
+	s->m_settings = &set;
+
+	storage_error se;
+	s->initialize(se);
+	TEST_CHECK(!se);
+
+	// write all 6 pieces in one go, spanning all files (including the empty
+	// ones)
+	std::vector<char> data = new_piece(24);
+	iovec_t const w = {data.data(), 24};
+	int ret = s->writev(w, piece_index_t(0), 0, 0, se);
+	TEST_EQUAL(ret, 24);
+	TEST_CHECK(!se);
+
+	std::vector<char> out(24);
+	iovec_t const r = {out.data(), 24};
+	ret = s->readv(r, piece_index_t(0), 0, 0, se);
+	TEST_EQUAL(ret, 24);
+	TEST_CHECK(!se);
+	TEST_CHECK(out == data);
+
+	// releasing the files drops the mappings. Make sure the data made it to
+	// the files and that it can be mapped again
+	s->release_files(se);
+	TEST_CHECK(!se);
+
+	TEST_EQUAL(file_size(combine_path(test_path, "test1.tmp")), 8);
+
+	std::fill(out.begin(), out.end(), 0);
+	ret = s->readv(r, piece_index_t(0), 0, 0, se);
+	TEST_EQUAL(ret, 24);
+	TEST_CHECK(out == data);
+
+	// an unaligned read inside a single file
+	iovec_t const r2 = {out.data(), 3};
+	ret = s->readv(r2, piece_index_t(2), 1, 0, se);
+	TEST_EQUAL(ret, 3);
+	TEST_CHECK(std::equal(out.begin(), out.begin() + 3, data.begin() + 9));
+}
+#endif
+
 TORRENT_TEST(storage_paths_string_pooling)
 {
 	file_storage file_storage;
@@ -1481,3 +1614,32 @@ TORRENT_TEST(dont_move_intermingled_files)
 	TEST_CHECK(!exists(combine_path(test_path, combine_path("temp_storage"
 		, combine_path("_folder3", "alien_folder1")))));
 }
+
+TORRENT_TEST(stripe_files)
+{
+	file_storage fs;
+	fs.add_file(combine_path("test_storage", "a"), 0x40000);
+	fs.add_file(combine_path("test_storage", "b"), 0x10000);
+	fs.add_file(combine_path("test_storage", "c"), 0x30000);
+	fs.add_file(combine_path("test_storage", "d"), 0x20000);
+
+	std::string const p1 = complete("path1");
+	std::string const p2 = complete("path2");
+
+	// no extra paths, nothing to do
+	TEST_CHECK(aux::stripe_files(fs, {}).empty());
+
+	// the files are assigned largest first, to the path with the fewest
+	// bytes: a -> save_path, c -> path1, d -> path2, b -> path2
+	auto const m = aux::stripe_files(fs, {p1, p2});
+	TEST_EQUAL(m.size(), 3);
+	TEST_CHECK(m.count(file_index_t(0)) == 0);
+	TEST_EQUAL(m.at(file_index_t(2)), combine_path(p1, fs.file_path(file_index_t(2))));
+	TEST_EQUAL(m.at(file_index_t(3)), combine_path(p2, fs.file_path(file_index_t(3))));
+	TEST_EQUAL(m.at(file_index_t(1)), combine_path(p2, fs.file_path(file_index_t(1))));
+
+	// files that already have absolute paths are left where they are
+	for (auto const& f : m) fs.rename_file(f.first, f.second);
+	auto const m2 = aux::stripe_files(fs, {p1, p2});
+	TEST_EQUAL(m2.size(), 0);
+}
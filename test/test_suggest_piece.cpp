@@ -0,0 +1,142 @@
+/*
+
+Copyright (c) 2017, Arvid Norberg
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions
+are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in
+      the documentation and/or other materials provided with the distribution.
+    * Neither the name of the author nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+#include "test.hpp"
+#include "libtorrent/aux_/suggest_piece.hpp"
+
+using namespace libtorrent;
+
+namespace {
+
+time_duration const expiry = seconds(10);
+
+int no_availability(piece_index_t) { return 0; }
+
+typed_bitfield<piece_index_t> none(int const num_pieces)
+{
+	typed_bitfield<piece_index_t> ret;
+	ret.resize(num_pieces, false);
+	return ret;
+}
+
+} // anonymous namespace
+
+TORRENT_TEST(most_recent_first)
+{
+	aux::suggest_piece sp;
+	time_point const now = clock_type::now();
+	for (int i = 0; i < 5; ++i)
+		sp.add_piece(piece_index_t(i), 0, 10, now);
+
+	std::vector<piece_index_t> p;
+	TEST_EQUAL(sp.get_pieces(p, none(10), 2, now, expiry, &no_availability), 2);
+
+	// the highest priority piece is last
+	TEST_EQUAL(p.size(), 2);
+	TEST_EQUAL(p[0], piece_index_t(3));
+	TEST_EQUAL(p[1], piece_index_t(4));
+
+	// pieces already in p aren't picked again
+	TEST_EQUAL(sp.get_pieces(p, none(10), 2, now, expiry, &no_availability), 2);
+	TEST_EQUAL(p.size(), 4);
+	TEST_EQUAL(p[2], piece_index_t(1));
+	TEST_EQUAL(p[3], piece_index_t(2));
+}
+
+TORRENT_TEST(rarest_first)
+{
+	aux::suggest_piece sp;
+	time_point const now = clock_type::now();
+	for (int i = 0; i < 5; ++i)
+		sp.add_piece(piece_index_t(i), 0, 10, now);
+
+	// piece 1 is the rarest, then piece 0
+	auto avail = [](piece_index_t const i)
+	{ return i == piece_index_t(1) ? 1 : i == piece_index_t(0) ? 2 : 3; };
+
+	std::vector<piece_index_t> p;
+	TEST_EQUAL(sp.get_pieces(p, none(10), 3, now, expiry, avail), 3);
+	TEST_EQUAL(p[0], piece_index_t(4));
+	TEST_EQUAL(p[1], piece_index_t(0));
+	TEST_EQUAL(p[2], piece_index_t(1));
+}
+
+TORRENT_TEST(skip_pieces_the_peer_has)
+{
+	aux::suggest_piece sp;
+	time_point const now = clock_type::now();
+	for (int i = 0; i < 3; ++i)
+		sp.add_piece(piece_index_t(i), 0, 10, now);
+
+	typed_bitfield<piece_index_t> bits = none(10);
+	bits.set_bit(piece_index_t(2));
+	bits.set_bit(piece_index_t(0));
+
+	std::vector<piece_index_t> p;
+	TEST_EQUAL(sp.get_pieces(p, bits, 3, now, expiry, &no_availability), 1);
+	TEST_EQUAL(p.size(), 1);
+	TEST_EQUAL(p[0], piece_index_t(1));
+}
+
+TORRENT_TEST(expired_pieces)
+{
+	aux::suggest_piece sp;
+	time_point const now = clock_type::now();
+	sp.add_piece(piece_index_t(0), 0, 10, now);
+	sp.add_piece(piece_index_t(1), 0, 10, now + seconds(5));
+
+	std::vector<piece_index_t> p;
+	TEST_EQUAL(sp.get_pieces(p, none(10), 3, now + seconds(12), expiry
+		, &no_availability), 1);
+	TEST_EQUAL(p[0], piece_index_t(1));
+
+	// reading the piece again makes it a candidate again
+	sp.add_piece(piece_index_t(0), 0, 10, now + seconds(12));
+	p.clear();
+	TEST_EQUAL(sp.get_pieces(p, none(10), 3, now + seconds(16), expiry
+		, &no_availability), 1);
+	TEST_EQUAL(p[0], piece_index_t(0));
+}
+
+TORRENT_TEST(max_queue_size)
+{
+	aux::suggest_piece sp;
+	time_point const now = clock_type::now();
+	for (int i = 0; i < 5; ++i)
+		sp.add_piece(piece_index_t(i), 0, 3, now);
+
+	std::vector<piece_index_t> p;
+	TEST_EQUAL(sp.get_pieces(p, none(10), 10, now, expiry, &no_availability), 3);
+	TEST_EQUAL(p[0], piece_index_t(2));
+	TEST_EQUAL(p[1], piece_index_t(3));
+	TEST_EQUAL(p[2], piece_index_t(4));
+}
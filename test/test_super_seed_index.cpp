@@ -0,0 +1,120 @@
+/*
+
+Copyright (c) 2017, Arvid Norberg
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions
+are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in
+      the documentation and/or other materials provided with the distribution.
+    * Neither the name of the author nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+#include "test.hpp"
+#include "libtorrent/aux_/super_seed_index.hpp"
+
+using namespace libtorrent;
+
+namespace {
+
+typed_bitfield<piece_index_t> bits(int const num_pieces
+	, std::initializer_list<int> have = {})
+{
+	typed_bitfield<piece_index_t> ret;
+	ret.resize(num_pieces, false);
+	for (int const p : have) ret.set_bit(piece_index_t(p));
+	return ret;
+}
+
+} // anonymous namespace
+
+TORRENT_TEST(rarest_piece)
+{
+	aux::super_seed_index idx(4);
+	for (int i = 0; i < 4; ++i)
+	{
+		if (i == 2) continue;
+		idx.inc_availability(piece_index_t(i));
+	}
+	idx.inc_availability(piece_index_t(0));
+
+	TEST_EQUAL(idx.availability(piece_index_t(0)), 2);
+	TEST_EQUAL(idx.availability(piece_index_t(2)), 0);
+	TEST_EQUAL(idx.pick(bits(4)), piece_index_t(2));
+
+	// the peer has piece 2, the next rarest are 1 and 3
+	for (int i = 0; i < 20; ++i)
+	{
+		piece_index_t const p = idx.pick(bits(4, {2}));
+		TEST_CHECK(p == piece_index_t(1) || p == piece_index_t(3));
+	}
+	TEST_EQUAL(idx.pick(bits(4, {1, 2, 3})), piece_index_t(0));
+	TEST_EQUAL(idx.pick(bits(4, {0, 1, 2, 3})), piece_index_t(-1));
+}
+
+TORRENT_TEST(given_pieces_last)
+{
+	aux::super_seed_index idx(3);
+	idx.inc_availability(piece_index_t(1));
+	idx.inc_availability(piece_index_t(1));
+	idx.inc_given(piece_index_t(0));
+	idx.inc_given(piece_index_t(2));
+
+	// piece 1 is the only one not given to any peer, even though it's the
+	// most available
+	TEST_EQUAL(idx.pick(bits(3)), piece_index_t(1));
+
+	// when there's nothing else, a given piece is picked
+	TEST_EQUAL(idx.pick(bits(3, {1, 2})), piece_index_t(0));
+
+	idx.dec_given(piece_index_t(0));
+	TEST_EQUAL(idx.given(piece_index_t(0)), 0);
+	TEST_EQUAL(idx.pick(bits(3)), piece_index_t(0));
+}
+
+TORRENT_TEST(dec_availability)
+{
+	aux::super_seed_index idx(2);
+	idx.inc_availability(piece_index_t(0));
+	TEST_EQUAL(idx.pick(bits(2)), piece_index_t(1));
+	idx.inc_availability(piece_index_t(1));
+	idx.inc_availability(piece_index_t(1));
+	idx.dec_availability(piece_index_t(0));
+	TEST_EQUAL(idx.pick(bits(2)), piece_index_t(0));
+
+	// the counters saturate at zero
+	idx.dec_availability(piece_index_t(0));
+	idx.dec_given(piece_index_t(0));
+	TEST_EQUAL(idx.availability(piece_index_t(0)), 0);
+	TEST_EQUAL(idx.given(piece_index_t(0)), 0);
+	TEST_EQUAL(idx.pick(bits(2)), piece_index_t(0));
+}
+
+TORRENT_TEST(random_tie_break)
+{
+	aux::super_seed_index idx(8);
+	std::vector<int> picked(8, 0);
+	for (int i = 0; i < 400; ++i)
+		++picked[std::size_t(static_cast<int>(idx.pick(bits(8))))];
+	for (int const c : picked) TEST_CHECK(c > 0);
+}
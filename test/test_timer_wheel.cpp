@@ -0,0 +1,217 @@
+/*
+
+Copyright (c) 2017, Arvid Norberg
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions
+are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in
+      the documentation and/or other materials provided with the distribution.
+    * Neither the name of the author nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+#include "test.hpp"
+#include "libtorrent/aux_/timer_wheel.hpp"
+#include "libtorrent/io_service.hpp"
+
+#include <vector>
+
+using namespace libtorrent;
+using aux::timer_wheel;
+
+namespace {
+
+timer_wheel::handler_t record(std::vector<int>& fired, int const n)
+{
+	return [&fired, n](error_code const&) { fired.push_back(n); };
+}
+
+void call_all(std::vector<timer_wheel::handler_t>& handlers)
+{
+	for (auto& h : handlers) h(error_code());
+	handlers.clear();
+}
+
+} // anonymous namespace
+
+TORRENT_TEST(expire_in_order)
+{
+	time_point const start = clock_type::now();
+	timer_wheel w(start, seconds(1), 16);
+	std::vector<int> fired;
+	std::vector<timer_wheel::handler_t> expired;
+
+	w.add(start, start + milliseconds(2500), record(fired, 2));
+	w.add(start, start + seconds(1), record(fired, 1));
+	w.add(start, start + seconds(5), record(fired, 5));
+	TEST_EQUAL(w.size(), 3);
+	TEST_CHECK(w.next_tick() == start + seconds(1));
+
+	w.advance(start + milliseconds(999), expired);
+	TEST_CHECK(expired.empty());
+
+	w.advance(start + seconds(1), expired);
+	call_all(expired);
+	TEST_CHECK(fired == std::vector<int>({1}));
+
+	// timers never expire early, the one at 2.5 seconds is rounded up to the
+	// tick at 3 seconds
+	w.advance(start + milliseconds(2900), expired);
+	TEST_CHECK(expired.empty());
+	w.advance(start + seconds(3), expired);
+	call_all(expired);
+	TEST_CHECK(fired == std::vector<int>({1, 2}));
+
+	w.advance(start + seconds(10), expired);
+	call_all(expired);
+	TEST_CHECK(fired == std::vector<int>({1, 2, 5}));
+	TEST_CHECK(w.empty());
+}
+
+TORRENT_TEST(remove)
+{
+	time_point const start = clock_type::now();
+	timer_wheel w(start, seconds(1), 16);
+	std::vector<int> fired;
+	std::vector<timer_wheel::handler_t> expired;
+
+	auto const id1 = w.add(start, start + seconds(2), record(fired, 1));
+	w.add(start, start + seconds(2), record(fired, 2));
+
+	auto h = w.remove(id1);
+	TEST_CHECK(bool(h));
+	TEST_EQUAL(w.size(), 1);
+
+	// removing it again is a no-op
+	TEST_CHECK(!w.remove(id1));
+
+	w.advance(start + seconds(2), expired);
+	call_all(expired);
+	TEST_CHECK(fired == std::vector<int>({2}));
+}
+
+TORRENT_TEST(multiple_revolutions)
+{
+	time_point const start = clock_type::now();
+	timer_wheel w(start, seconds(1), 4);
+	std::vector<int> fired;
+	std::vector<timer_wheel::handler_t> expired;
+
+	// these timers share slots with each other, but expire on different
+	// revolutions of the wheel
+	w.add(start, start + seconds(1), record(fired, 1));
+	w.add(start, start + seconds(5), record(fired, 5));
+	w.add(start, start + seconds(9), record(fired, 9));
+
+	for (int i = 1; i <= 9; ++i)
+	{
+		w.advance(start + seconds(i), expired);
+		call_all(expired);
+		if (i < 5)
+		{
+			TEST_CHECK(fired == std::vector<int>({1}));
+		}
+		else if (i < 9)
+		{
+			TEST_CHECK(fired == std::vector<int>({1, 5}));
+		}
+	}
+	TEST_CHECK(fired == std::vector<int>({1, 5, 9}));
+
+	// jumping more than a whole revolution at once
+	w.add(start + seconds(9), start + seconds(11), record(fired, 11));
+	w.add(start + seconds(9), start + seconds(30), record(fired, 30));
+	w.advance(start + seconds(20), expired);
+	call_all(expired);
+	TEST_CHECK(fired == std::vector<int>({1, 5, 9, 11}));
+	TEST_EQUAL(w.size(), 1);
+
+	auto const all = w.remove_all();
+	TEST_EQUAL(int(all.size()), 1);
+	TEST_CHECK(w.empty());
+}
+
+TORRENT_TEST(idle_wheel)
+{
+	time_point const start = clock_type::now();
+	timer_wheel w(start, seconds(1), 4);
+	std::vector<int> fired;
+	std::vector<timer_wheel::handler_t> expired;
+
+	// adding a timer to an empty wheel, long after the last tick, doesn't
+	// need to catch up on the ticks that passed
+	time_point const later = start + seconds(100);
+	w.add(later, later + seconds(2), record(fired, 1));
+	TEST_CHECK(w.next_tick() == later + seconds(1));
+
+	w.advance(later + seconds(1), expired);
+	TEST_CHECK(expired.empty());
+	w.advance(later + seconds(2), expired);
+	call_all(expired);
+	TEST_CHECK(fired == std::vector<int>({1}));
+}
+
+TORRENT_TEST(timer_service)
+{
+	io_service ios;
+	auto s = std::make_shared<aux::timer_service>(ios, milliseconds(10), 16);
+
+	std::vector<error_code> results;
+	{
+		aux::wheel_timer t1(*s);
+		aux::wheel_timer t2(*s);
+		aux::wheel_timer t3(*s);
+
+		t1.expires_from_now(milliseconds(20));
+		t1.async_wait([&](error_code const& ec) { results.push_back(ec); });
+
+		// setting a new expiry time cancels the outstanding wait
+		t2.expires_from_now(milliseconds(20));
+		t2.async_wait([&](error_code const& ec) { results.push_back(ec); });
+		t2.expires_from_now(seconds(10));
+		TEST_EQUAL(s->num_timers(), 1);
+
+		// a timer that has already expired is posted right away
+		t3.expires_at(clock_type::now() - seconds(1));
+		t3.async_wait([&](error_code const& ec) { results.push_back(ec); });
+
+		ios.run();
+	}
+
+	TEST_EQUAL(results.size(), 3);
+	TEST_CHECK(results[0] == boost::asio::error::operation_aborted);
+	TEST_CHECK(!results[1]);
+	TEST_CHECK(!results[2]);
+	TEST_EQUAL(s->num_timers(), 0);
+
+	// once aborted, timers are cancelled right away
+	results.clear();
+	s->abort();
+	aux::wheel_timer t(*s);
+	t.expires_from_now(milliseconds(10));
+	t.async_wait([&](error_code const& ec) { results.push_back(ec); });
+	ios.reset();
+	ios.run();
+	TEST_EQUAL(results.size(), 1);
+	TEST_CHECK(results[0] == boost::asio::error::operation_aborted);
+}
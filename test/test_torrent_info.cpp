@@ -38,8 +38,12 @@ POSSIBILITY OF SUCH DAMAGE.
 #include "libtorrent/announce_entry.hpp"
 #include "libtorrent/aux_/escape_string.hpp" // for convert_path_to_posix
 #include "libtorrent/hex.hpp" // to_hex
+#include "libtorrent/hasher.hpp"
+#include "libtorrent/bencode.hpp"
 
 #include <iostream>
+#include <cstdio> // for fopen
+#include <memory>
 
 using namespace libtorrent;
 
@@ -937,3 +941,131 @@ TORRENT_TEST(copy)
 		TEST_EQUAL(fs2.hash(i), file_hashes[i]);
 	}
 }
+
+TORRENT_TEST(copy_renamed)
+{
+	using namespace libtorrent;
+
+	std::shared_ptr<torrent_info> a = std::make_shared<torrent_info>(
+		combine_path(parent_path(current_working_directory())
+		, combine_path("test_torrents", "sample.torrent")));
+
+	// renamed files don't point into the torrent buffer. Make sure the copy
+	// doesn't adjust them as if they did
+	a->rename_file(file_index_t(2), combine_path("sample", "renamed.txt"));
+
+	std::shared_ptr<torrent_info> b = std::make_shared<torrent_info>(*a);
+	std::memset(a->metadata().get(), 0, a->metadata_size());
+	a.reset();
+
+	std::string p = b->files().file_path(file_index_t(2));
+	convert_path_to_posix(p);
+	TEST_EQUAL(p, "sample/renamed.txt");
+	p = b->files().file_path(file_index_t(0));
+	convert_path_to_posix(p);
+	TEST_EQUAL(p, "sample/text_file2.txt");
+}
+
+TORRENT_TEST(merkle_lazy_tree)
+{
+	sha1_hash const leaf0 = hasher("piece 0", 7).final();
+	sha1_hash const leaf1 = hasher("piece 1", 7).final();
+	hasher h;
+	h.update(leaf0);
+	h.update(leaf1);
+	sha1_hash const root = h.final();
+
+	entry info;
+	info["root hash"] = root.to_string();
+	info["name"] = "test";
+	info["piece length"] = 16 * 1024;
+	info["length"] = 20 * 1024;
+	entry torrent;
+	torrent["info"] = info;
+
+	std::vector<char> buf;
+	bencode(std::back_inserter(buf), torrent);
+	error_code ec;
+	torrent_info ti(&buf[0], int(buf.size()), ec);
+	TEST_CHECK(!ec);
+	TEST_CHECK(ti.is_merkle_torrent());
+	TEST_CHECK(ti.is_loaded());
+
+	// we only know the root, the tree isn't allocated yet
+	TEST_CHECK(ti.merkle_tree().empty());
+	TEST_CHECK(ti.hash_for_piece(piece_index_t(1)).is_all_zeros());
+
+	// copying a merkle torrent must work without a piece hash string
+	torrent_info copy(ti);
+	TEST_CHECK(copy.is_merkle_torrent());
+	TEST_CHECK(copy.merkle_tree().empty());
+
+	std::map<int, sha1_hash> nodes;
+	nodes[1] = leaf0;
+	nodes[2] = leaf0;
+	TEST_CHECK(!ti.add_merkle_nodes(nodes, piece_index_t(0)));
+	TEST_CHECK(ti.merkle_tree().empty());
+
+	nodes[2] = leaf1;
+	TEST_CHECK(ti.add_merkle_nodes(nodes, piece_index_t(0)));
+	TEST_EQUAL(ti.merkle_tree().size(), 3);
+	TEST_EQUAL(ti.merkle_tree()[0], root);
+	TEST_EQUAL(ti.hash_for_piece(piece_index_t(0)), leaf0);
+	TEST_EQUAL(ti.hash_for_piece(piece_index_t(1)), leaf1);
+
+	std::map<int, sha1_hash> const list = ti.build_merkle_list(piece_index_t(1));
+	TEST_EQUAL(list.size(), 3);
+	TEST_EQUAL(list.at(0), root);
+	TEST_EQUAL(list.at(1), leaf0);
+	TEST_EQUAL(list.at(2), leaf1);
+}
+
+TORRENT_TEST(shared_buffer)
+{
+	using namespace libtorrent;
+
+	std::string const filename = combine_path(parent_path(current_working_directory())
+		, combine_path("test_torrents", "sample.torrent"));
+
+	std::vector<char> file;
+	FILE* f = std::fopen(filename.c_str(), "rb");
+	TEST_CHECK(f != nullptr);
+	if (f == nullptr) return;
+	char buf[4096];
+	std::size_t len;
+	while ((len = std::fread(buf, 1, sizeof(buf), f)) > 0)
+		file.insert(file.end(), buf, buf + len);
+	std::fclose(f);
+
+	int const size = int(file.size());
+	std::shared_ptr<char> buffer(new char[file.size()], std::default_delete<char[]>());
+	std::memcpy(buffer.get(), file.data(), file.size());
+	std::weak_ptr<char> weak_buffer = buffer;
+
+	error_code ec;
+	auto ti = std::make_shared<torrent_info>(std::shared_ptr<char const>(buffer), size, ec);
+	TEST_CHECK(!ec);
+	buffer.reset();
+
+	torrent_info const reference(filename);
+	TEST_EQUAL(ti->info_hash(), reference.info_hash());
+	TEST_EQUAL(ti->num_files(), reference.num_files());
+	TEST_EQUAL(ti->metadata_size(), reference.metadata_size());
+
+	// the info section, file names and piece hashes all refer into the buffer
+	char const* const start = weak_buffer.lock().get();
+	TEST_CHECK(ti->metadata().get() >= start);
+	TEST_CHECK(ti->metadata().get() + ti->metadata_size() <= start + size);
+	TEST_CHECK(ti->hash_for_piece_ptr(piece_index_t(0)) > start);
+	TEST_CHECK(ti->hash_for_piece_ptr(piece_index_t(0)) < start + size);
+	for (file_index_t i(0); i < ti->files().end_file(); ++i)
+		TEST_EQUAL(ti->files().file_path(i), reference.files().file_path(i));
+	TEST_EQUAL(ti->hash_for_piece(piece_index_t(0)), reference.hash_for_piece(piece_index_t(0)));
+
+	// the metadata keeps the buffer alive, even once the torrent_info is gone
+	boost::shared_array<char> metadata = ti->metadata();
+	ti.reset();
+	TEST_CHECK(!weak_buffer.expired());
+	metadata.reset();
+	TEST_CHECK(weak_buffer.expired());
+}
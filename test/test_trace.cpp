@@ -0,0 +1,176 @@
+/*
+
+Copyright (c) 2017, Arvid Norberg
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions
+are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in
+      the documentation and/or other materials provided with the distribution.
+    * Neither the name of the author nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+
+#include "test.hpp"
+#include "libtorrent/trace.hpp"
+#include "libtorrent/aux_/trace.hpp"
+#include "libtorrent/aux_/path.hpp"
+#include "libtorrent/io.hpp"
+
+#include <thread>
+#include <atomic>
+#include <vector>
+#include <fstream>
+#include <iterator>
+
+using namespace libtorrent;
+using aux::trace_event;
+
+namespace {
+
+std::vector<aux::trace_entry> events_of(trace_event const e)
+{
+	std::vector<aux::trace_entry> ret;
+	for (auto const& t : aux::collect_trace())
+		if (t.event == e) ret.push_back(t);
+	return ret;
+}
+
+}
+
+TORRENT_TEST(trace_disabled)
+{
+	clear_trace();
+	TEST_CHECK(!tracing_enabled());
+	aux::trace(trace_event::piece_pick, 1, 2);
+	TEST_CHECK(events_of(trace_event::piece_pick).empty());
+}
+
+TORRENT_TEST(trace_record)
+{
+	clear_trace();
+	set_tracing(true);
+	TEST_CHECK(tracing_enabled());
+	aux::trace(trace_event::peer_request, 1, 0x4000);
+	aux::trace(trace_event::peer_receive, 1, 0x4000);
+	set_tracing(false);
+	aux::trace(trace_event::peer_request, 2, 0);
+
+	auto const requests = events_of(trace_event::peer_request);
+	TEST_EQUAL(requests.size(), 1);
+	TEST_EQUAL(requests.front().arg0, 1);
+	TEST_EQUAL(requests.front().arg1, 0x4000);
+
+	auto const receives = events_of(trace_event::peer_receive);
+	TEST_EQUAL(receives.size(), 1);
+	TEST_CHECK(receives.front().time >= requests.front().time);
+	TEST_EQUAL(receives.front().thread, requests.front().thread);
+
+	clear_trace();
+	TEST_CHECK(aux::collect_trace().empty());
+}
+
+TORRENT_TEST(trace_threads)
+{
+	clear_trace();
+	set_tracing(true);
+	int const num_threads = 4;
+	// more events than fit in the ring buffer
+	int const num_events = 10000;
+	// the buffers of threads that exited are reused by new threads. Keep
+	// all threads alive until they've all started, to give each its own
+	std::atomic<int> started(0);
+	std::vector<std::thread> threads;
+	for (int i = 0; i < num_threads; ++i)
+	{
+		threads.emplace_back([i, num_events, &started]
+		{
+			aux::trace(trace_event::utp_receive);
+			++started;
+			while (started < num_threads) std::this_thread::yield();
+			for (int k = 0; k < num_events; ++k)
+				aux::trace(trace_event::utp_send, std::uint64_t(i), std::uint64_t(k));
+		});
+	}
+
+	// reading while the threads are recording only returns complete events
+	for (int r = 0; r < 10; ++r)
+	{
+		for (auto const& e : events_of(trace_event::utp_send))
+			TEST_CHECK(e.arg0 < num_threads && e.arg1 < num_events);
+	}
+
+	for (auto& t : threads) t.join();
+	set_tracing(false);
+
+	auto const events = events_of(trace_event::utp_send);
+	TEST_CHECK(!events.empty());
+	TEST_CHECK(events.size() < std::size_t(num_threads * num_events));
+
+	// each thread keeps its most recent events, in order
+	std::vector<std::int64_t> last(num_threads, -1);
+	for (auto const& e : events)
+	{
+		TEST_CHECK(e.arg0 < num_threads);
+		if (e.arg0 >= num_threads) continue;
+		TEST_CHECK(std::int64_t(e.arg1) > last[e.arg0]);
+		last[e.arg0] = std::int64_t(e.arg1);
+	}
+	for (auto const l : last) TEST_EQUAL(l, num_events - 1);
+	clear_trace();
+}
+
+TORRENT_TEST(save_trace)
+{
+	clear_trace();
+	set_tracing(true);
+	aux::trace(trace_event::disk_job_start, 3, 7);
+	aux::trace(trace_event::disk_job_end, 3, 7);
+	set_tracing(false);
+
+	error_code ec;
+	save_trace("test.trace", ec);
+	TEST_CHECK(!ec);
+
+	std::ifstream f("test.trace", std::ios::binary);
+	std::vector<char> buf((std::istreambuf_iterator<char>(f))
+		, std::istreambuf_iterator<char>());
+	TEST_EQUAL(buf.size(), 8 + 2 * 32);
+	if (buf.size() != 8 + 2 * 32) return;
+	TEST_CHECK(std::string(buf.data(), 7) == "lttrace");
+	TEST_EQUAL(int(buf[7]), 1);
+
+	char const* ptr = buf.data() + 8;
+	detail::read_int64(ptr);
+	detail::read_uint32(ptr);
+	TEST_EQUAL(int(detail::read_uint8(ptr)), int(trace_event::disk_job_start));
+	ptr += 3;
+	TEST_EQUAL(detail::read_uint64(ptr), 3);
+	TEST_EQUAL(detail::read_uint64(ptr), 7);
+	detail::read_int64(ptr);
+	detail::read_uint32(ptr);
+	TEST_EQUAL(int(detail::read_uint8(ptr)), int(trace_event::disk_job_end));
+
+	libtorrent::remove("test.trace", ec);
+	clear_trace();
+}
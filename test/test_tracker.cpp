@@ -46,8 +46,14 @@ POSSIBILITY OF SUCH DAMAGE.
 #include "libtorrent/announce_entry.hpp"
 #include "libtorrent/torrent.hpp"
 #include "libtorrent/aux_/path.hpp"
+#include "libtorrent/aux_/session_interface.hpp" // for session_logger
+#include "libtorrent/aux_/session_settings.hpp"
+#include "libtorrent/resolver_interface.hpp"
+#include "libtorrent/performance_counters.hpp"
+#include "libtorrent/io.hpp"
 
 #include <fstream>
+#include <tuple>
 
 using namespace libtorrent;
 namespace lt = libtorrent;
@@ -619,3 +625,283 @@ TORRENT_TEST(tracker_proxy)
 	test_proxy(true);
 }
 
+
+namespace {
+
+	// resolves every hostname to the same address
+	struct mock_resolver final : resolver_interface
+	{
+		mock_resolver(io_service& ios, address a) : m_ios(ios), m_addr(a) {}
+
+		void async_resolve(std::string const&, int
+			, callback_t const& h) override
+		{
+			std::vector<address> ret{m_addr};
+			m_ios.post(std::bind(h, error_code(), ret));
+		}
+		void abort() override {}
+		void set_cache_timeout(seconds) override {}
+
+		io_service& m_ios;
+		address m_addr;
+	};
+
+#if !defined TORRENT_DISABLE_LOGGING || TORRENT_USE_ASSERTS
+	struct mock_logger final : aux::session_logger
+	{
+#ifndef TORRENT_DISABLE_LOGGING
+		bool should_log() const override { return false; }
+		void session_log(char const*, ...) const override {}
+#endif
+#if TORRENT_USE_ASSERTS
+		bool is_single_thread() const override { return true; }
+		bool has_peer(peer_connection const*) const override { return false; }
+		bool any_torrent_has_peer(peer_connection const*) const override { return false; }
+		bool is_posting_torrent_updates() const override { return false; }
+#endif
+	};
+#endif
+
+	struct mock_request_callback final : request_callback
+	{
+		void tracker_warning(tracker_request const&, std::string const&) override {}
+		void tracker_scrape_response(tracker_request const& req
+			, int complete, int incomplete, int downloads, int) override
+		{
+			scrapes.push_back(std::make_tuple(req.info_hash, complete, incomplete, downloads));
+		}
+		void tracker_response(tracker_request const&, address const&
+			, std::list<address> const&, struct tracker_response const&) override {}
+		void tracker_request_error(tracker_request const&, int
+			, error_code const&, std::string const&, seconds32) override
+		{ ++errors; }
+#ifndef TORRENT_DISABLE_LOGGING
+		bool should_log() const override { return false; }
+		void debug_log(const char*, ...) const override {}
+#endif
+
+		std::vector<std::tuple<sha1_hash, int, int, int>> scrapes;
+		int errors = 0;
+	};
+
+	struct udp_tracker_setup
+	{
+		explicit udp_tracker_setup(address a)
+			: resolver(ios, a)
+			, man([this](udp::endpoint const& ep, span<char const> p, error_code&, int)
+				{ sent.emplace_back(ep, std::vector<char>(p.begin(), p.end())); }
+				, [](char const*, int, span<char const>, error_code&, int) {}
+				, cnt, resolver, sett
+#if !defined TORRENT_DISABLE_LOGGING || TORRENT_USE_ASSERTS
+				, logger
+#endif
+				)
+		{}
+
+		~udp_tracker_setup()
+		{
+			man.abort_all_requests(true);
+			ios.poll();
+		}
+
+		io_service ios;
+		counters cnt;
+		aux::session_settings sett;
+		mock_resolver resolver;
+#if !defined TORRENT_DISABLE_LOGGING || TORRENT_USE_ASSERTS
+		mock_logger logger;
+#endif
+		std::vector<std::pair<udp::endpoint, std::vector<char>>> sent;
+		tracker_manager man;
+	};
+
+	std::uint32_t packet_action(std::vector<char> const& p)
+	{
+		char const* ptr = p.data() + 8;
+		return detail::read_uint32(ptr);
+	}
+
+	std::uint32_t packet_tid(std::vector<char> const& p)
+	{
+		char const* ptr = p.data() + 12;
+		return detail::read_uint32(ptr);
+	}
+
+	void respond_connect(udp_tracker_setup& t, std::vector<char> const& connect)
+	{
+		char buf[16];
+		char* ptr = buf;
+		detail::write_uint32(0, ptr); // action = connect
+		detail::write_uint32(packet_tid(connect), ptr);
+		detail::write_uint64(0x1337, ptr); // connection_id
+		t.man.incoming_packet(t.sent.front().first, buf);
+	}
+
+	void respond_announce(udp_tracker_setup& t, std::vector<char> const& announce)
+	{
+		char buf[20];
+		char* ptr = buf;
+		detail::write_uint32(1, ptr); // action = announce
+		detail::write_uint32(packet_tid(announce), ptr);
+		detail::write_uint32(1800, ptr); // interval
+		detail::write_uint32(0, ptr); // leechers
+		detail::write_uint32(0, ptr); // seeders
+		t.man.incoming_packet(t.sent.front().first, buf);
+	}
+
+	sha1_hash packet_info_hash(std::vector<char> const& p)
+	{
+		return sha1_hash(p.data() + 16);
+	}
+}
+
+TORRENT_TEST(udp_tracker_scrape_batch)
+{
+	udp_tracker_setup t(address_v4::from_string("10.0.0.1"));
+	auto cb = std::make_shared<mock_request_callback>();
+
+	std::vector<sha1_hash> ih;
+	for (int i = 0; i < 3; ++i)
+	{
+		tracker_request req;
+		req.url = "udp://tracker.test:1337/announce";
+		req.kind = tracker_request::scrape_request;
+		req.info_hash = rand_hash();
+		ih.push_back(req.info_hash);
+		t.man.queue_request(t.ios, req, cb);
+	}
+	t.ios.poll();
+
+	// a single connect, for all three scrapes
+	TEST_EQUAL(t.sent.size(), 1);
+	if (t.sent.size() != 1) return;
+	TEST_EQUAL(packet_action(t.sent[0].second), 0);
+
+	respond_connect(t, t.sent[0].second);
+	t.ios.poll();
+
+	// and a single scrape, asking for all three info-hashes
+	TEST_EQUAL(t.sent.size(), 2);
+	if (t.sent.size() != 2) return;
+	std::vector<char> const& scrape = t.sent[1].second;
+	TEST_EQUAL(packet_action(scrape), 2);
+	TEST_EQUAL(scrape.size(), 16 + 3 * 20);
+	if (scrape.size() != 16 + 3 * 20) return;
+	for (int i = 0; i < 3; ++i)
+		TEST_CHECK(sha1_hash(scrape.data() + 16 + i * 20) == ih[std::size_t(i)]);
+
+	char buf[8 + 3 * 12];
+	char* ptr = buf;
+	detail::write_uint32(2, ptr); // action = scrape
+	detail::write_uint32(packet_tid(scrape), ptr);
+	for (int i = 0; i < 3; ++i)
+	{
+		detail::write_uint32(10 + i, ptr); // complete
+		detail::write_uint32(20 + i, ptr); // downloaded
+		detail::write_uint32(30 + i, ptr); // incomplete
+	}
+	t.man.incoming_packet(t.sent[1].first, buf);
+	t.ios.poll();
+
+	TEST_EQUAL(cb->errors, 0);
+	TEST_EQUAL(cb->scrapes.size(), 3);
+	if (cb->scrapes.size() != 3) return;
+	for (int i = 0; i < 3; ++i)
+	{
+		auto const& s = cb->scrapes[std::size_t(i)];
+		TEST_CHECK(std::get<0>(s) == ih[std::size_t(i)]);
+		TEST_EQUAL(std::get<1>(s), 10 + i);
+		TEST_EQUAL(std::get<2>(s), 30 + i);
+		TEST_EQUAL(std::get<3>(s), 20 + i);
+	}
+	TEST_CHECK(t.man.empty());
+}
+
+TORRENT_TEST(udp_tracker_shared_connect)
+{
+	udp_tracker_setup t(address_v4::from_string("10.0.0.2"));
+	auto cb = std::make_shared<mock_request_callback>();
+
+	for (int i = 0; i < 3; ++i)
+	{
+		tracker_request req;
+		req.url = "udp://tracker.test:1337/announce";
+		req.info_hash = rand_hash();
+		req.num_want = 50;
+		t.man.queue_request(t.ios, req, cb);
+	}
+	t.ios.poll();
+
+	// the announces share a single connect
+	TEST_EQUAL(t.sent.size(), 1);
+	if (t.sent.size() != 1) return;
+	TEST_EQUAL(packet_action(t.sent[0].second), 0);
+
+	respond_connect(t, t.sent[0].second);
+	t.ios.poll();
+
+	TEST_EQUAL(t.sent.size(), 4);
+	for (std::size_t i = 1; i < t.sent.size(); ++i)
+	{
+		std::vector<char> const& p = t.sent[i].second;
+		TEST_EQUAL(packet_action(p), 1);
+		char const* ptr = p.data();
+		TEST_EQUAL(detail::read_uint64(ptr), 0x1337);
+	}
+}
+
+TORRENT_TEST(tracker_host_concurrency)
+{
+	udp_tracker_setup t(address_v4::from_string("10.0.0.3"));
+	t.sett.set_int(settings_pack::tracker_host_concurrency, 1);
+	auto cb = std::make_shared<mock_request_callback>();
+
+	sha1_hash const first = rand_hash();
+	sha1_hash const seed = rand_hash();
+	sha1_hash const downloading = rand_hash();
+
+	auto announce = [&](sha1_hash const& ih, std::int64_t const left)
+	{
+		tracker_request req;
+		req.url = "udp://tracker.test:1337/announce";
+		req.info_hash = ih;
+		req.left = left;
+		req.num_want = 50;
+		t.man.queue_request(t.ios, req, cb);
+	};
+	announce(first, 100);
+	announce(seed, 0);
+	announce(downloading, 100);
+	t.ios.poll();
+
+	// only one request at a time is sent to the tracker
+	TEST_EQUAL(t.man.num_queued(), 2);
+	TEST_EQUAL(t.sent.size(), 1);
+	if (t.sent.size() != 1) return;
+	respond_connect(t, t.sent[0].second);
+	t.ios.poll();
+
+	TEST_EQUAL(t.sent.size(), 2);
+	if (t.sent.size() != 2) return;
+	TEST_CHECK(packet_info_hash(t.sent[1].second) == first);
+	respond_announce(t, t.sent[1].second);
+	t.ios.poll();
+
+	// the torrent that's still downloading goes before the seed, even though
+	// it was queued after it
+	TEST_EQUAL(t.sent.size(), 3);
+	if (t.sent.size() != 3) return;
+	TEST_CHECK(packet_info_hash(t.sent[2].second) == downloading);
+	respond_announce(t, t.sent[2].second);
+	t.ios.poll();
+
+	TEST_EQUAL(t.sent.size(), 4);
+	if (t.sent.size() != 4) return;
+	TEST_CHECK(packet_info_hash(t.sent[3].second) == seed);
+	respond_announce(t, t.sent[3].second);
+	t.ios.poll();
+
+	TEST_EQUAL(cb->errors, 0);
+	TEST_EQUAL(t.man.num_queued(), 0);
+	TEST_CHECK(t.man.empty());
+}
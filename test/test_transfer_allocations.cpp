@@ -0,0 +1,206 @@
+/*
+
+Copyright (c) 2017, Arvid Norberg
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions
+are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in
+      the documentation and/or other materials provided with the distribution.
+    * Neither the name of the author nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+#include "libtorrent/session.hpp"
+#include "libtorrent/settings_pack.hpp"
+#include "libtorrent/alert_types.hpp"
+#include "libtorrent/torrent_info.hpp"
+#include "libtorrent/torrent_status.hpp"
+#include "libtorrent/aux_/path.hpp"
+
+#include "test.hpp"
+#include "setup_transfer.hpp"
+#include "test_utils.hpp"
+
+#include <tuple>
+#include <thread>
+#include <new>
+#include <fstream>
+
+using namespace libtorrent;
+namespace lt = libtorrent;
+
+using std::ignore;
+
+namespace {
+
+// this is the ceiling for the number of heap allocations made per 16 kiB
+// block while a piece is transferred between two sessions in this process.
+// It covers both the seed and the downloader, i.e. sending, receiving,
+// writing and hashing the block. Steady-state transfer is expected to be
+// well below this. If this test fails, something on the hot path started
+// allocating per block (or per message)
+int const max_allocations_per_block = 32;
+
+int const block_size = 16 * 1024;
+int const piece_size = 1024 * 1024;
+
+// calling the allocation functions directly, rather than through
+// new-expressions, keeps the compiler from eliding them
+bool allocations_are_counted()
+{
+	std::int64_t const before = num_allocations();
+	::operator delete(::operator new(1));
+	return num_allocations() != before;
+}
+
+} // anonymous namespace
+
+TORRENT_TEST(allocation_counter)
+{
+	if (!allocations_are_counted())
+	{
+		std::printf("allocations are not counted on this platform, skipping\n");
+		return;
+	}
+
+	std::int64_t const before = num_allocations();
+	void* a = ::operator new(10);
+	void* b = ::operator new[](10);
+	void* c = ::operator new(10, std::nothrow);
+	TEST_EQUAL(num_allocations() - before, 3);
+
+	// freeing memory is not counted
+	::operator delete(a);
+	::operator delete[](b);
+	::operator delete(c, std::nothrow);
+	TEST_EQUAL(num_allocations() - before, 3);
+}
+
+TORRENT_TEST(steady_state_transfer)
+{
+	if (!allocations_are_counted())
+	{
+		std::printf("allocations are not counted on this platform, skipping\n");
+		return;
+	}
+
+	error_code ec;
+	remove_all("tmp1_allocations", ec);
+	remove_all("tmp2_allocations", ec);
+
+	// these are declared before the session objects
+	// so that they are destructed last. This enables
+	// the sessions to destruct in parallel
+	session_proxy p1;
+	session_proxy p2;
+
+	settings_pack pack;
+	pack.set_str(settings_pack::listen_interfaces, "0.0.0.0:48085");
+	pack.set_bool(settings_pack::enable_upnp, false);
+	pack.set_bool(settings_pack::enable_natpmp, false);
+	pack.set_bool(settings_pack::enable_lsd, false);
+	pack.set_bool(settings_pack::enable_dht, false);
+	pack.set_bool(settings_pack::enable_outgoing_utp, false);
+	pack.set_bool(settings_pack::enable_incoming_utp, false);
+	pack.set_int(settings_pack::out_enc_policy, settings_pack::pe_disabled);
+	pack.set_int(settings_pack::in_enc_policy, settings_pack::pe_disabled);
+
+	// throttle the seed to make the transfer last long enough to be sampled
+	// in the middle, once the connection is up and all buffers and caches
+	// have been allocated
+	pack.set_int(settings_pack::upload_rate_limit, 2 * 1024 * 1024);
+	lt::session ses1(pack);
+
+	pack.set_int(settings_pack::upload_rate_limit, 0);
+	pack.set_str(settings_pack::listen_interfaces, "0.0.0.0:49085");
+	lt::session ses2(pack);
+
+	torrent_handle tor1;
+	torrent_handle tor2;
+
+	wait_for_listen(ses1, "ses1");
+	wait_for_listen(ses2, "ses2");
+
+	std::tie(tor1, tor2, ignore) = setup_transfer(&ses1, &ses2, nullptr
+		, true, false, true, "_allocations", piece_size);
+
+	// posting alerts allocates, and they are not popped during the
+	// measurement
+	settings_pack quiet;
+	quiet.set_int(settings_pack::alert_mask, alert::error_notification);
+	ses1.apply_settings(quiet);
+	ses2.apply_settings(quiet);
+	print_alerts(ses1, "ses1");
+	print_alerts(ses2, "ses2");
+
+	std::int64_t const total_size = tor2.torrent_file()->total_size();
+
+	std::int64_t start_allocs = -1;
+	std::int64_t start_bytes = 0;
+	std::int64_t end_allocs = -1;
+	std::int64_t end_bytes = 0;
+
+	for (int i = 0; i < 300; ++i)
+	{
+		std::this_thread::sleep_for(lt::milliseconds(50));
+
+		std::int64_t const allocs = num_allocations();
+		torrent_status const st = tor2.status(torrent_handle::query_accurate_download_counters);
+
+		if (st.is_seeding) break;
+
+		if (start_allocs < 0 && st.total_wanted_done > total_size / 5)
+		{
+			start_allocs = allocs;
+			start_bytes = st.total_wanted_done;
+		}
+		else if (start_allocs >= 0 && st.total_wanted_done > total_size * 4 / 5)
+		{
+			end_allocs = allocs;
+			end_bytes = st.total_wanted_done;
+			break;
+		}
+	}
+
+	print_alerts(ses1, "ses1");
+	print_alerts(ses2, "ses2");
+
+	TEST_CHECK(start_allocs >= 0);
+	TEST_CHECK(end_allocs >= 0);
+	if (start_allocs < 0 || end_allocs < 0) return;
+
+	std::int64_t const blocks = (end_bytes - start_bytes) / block_size;
+	TEST_CHECK(blocks > 0);
+	if (blocks <= 0) return;
+
+	double const per_block = double(end_allocs - start_allocs) / double(blocks);
+	double const per_piece = per_block * (piece_size / block_size);
+	std::printf("transferred %" PRId64 " blocks, %" PRId64 " allocations "
+		"(%.2f per block, %.1f per piece)\n", blocks
+		, end_allocs - start_allocs, per_block, per_piece);
+
+	TEST_CHECK(per_block <= max_allocations_per_block);
+
+	p1 = ses1.abort();
+	p2 = ses2.abort();
+}
@@ -0,0 +1,139 @@
+/*
+
+Copyright (c) 2017, Arvid Norberg
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions
+are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in
+      the documentation and/or other materials provided with the distribution.
+    * Neither the name of the author nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+#include "test.hpp"
+#include "libtorrent/aux_/upload_scheduler.hpp"
+
+using namespace libtorrent;
+using aux::upload_scheduler;
+
+namespace {
+
+time_duration const expiry = seconds(10);
+
+upload_scheduler::piece_key key(int const st, int const p)
+{ return upload_scheduler::key(storage_index_t(std::uint32_t(st)), piece_index_t(p)); }
+
+} // anonymous namespace
+
+TORRENT_TEST(warm_pieces)
+{
+	upload_scheduler s;
+	time_point const now = clock_type::now();
+
+	TEST_CHECK(!s.is_warm(key(0, 1), now, expiry));
+	s.read_issued(key(0, 1), now, false);
+	TEST_CHECK(s.is_warm(key(0, 1), now, expiry));
+	TEST_CHECK(s.is_warm(key(0, 1), now + seconds(9), expiry));
+	TEST_CHECK(!s.is_warm(key(0, 1), now + seconds(10), expiry));
+
+	// the same piece index in another storage is a different piece
+	TEST_CHECK(!s.is_warm(key(1, 1), now, expiry));
+	TEST_EQUAL(s.cold_reads(), 0);
+}
+
+TORRENT_TEST(cold_reads)
+{
+	upload_scheduler s;
+	time_point const now = clock_type::now();
+
+	s.read_issued(key(0, 1), now, true);
+	TEST_EQUAL(s.cold_reads(), 1);
+
+	// while the cold read is in flight, the piece counts as warm, since
+	// other reads of it are queued behind it by the disk thread
+	TEST_CHECK(s.is_warm(key(0, 1), now + seconds(20), expiry));
+
+	// issuing another cold read of the same piece doesn't count twice
+	s.read_issued(key(0, 1), now, true);
+	TEST_EQUAL(s.cold_reads(), 1);
+
+	s.read_issued(key(0, 2), now, true);
+	TEST_EQUAL(s.cold_reads(), 2);
+
+	TEST_CHECK(s.read_complete(key(0, 1)));
+	TEST_EQUAL(s.cold_reads(), 1);
+
+	// only the first completion ends the cold read
+	TEST_CHECK(!s.read_complete(key(0, 1)));
+	TEST_CHECK(!s.read_complete(key(0, 3)));
+	TEST_EQUAL(s.cold_reads(), 1);
+	TEST_CHECK(s.is_warm(key(0, 1), now, expiry));
+}
+
+TORRENT_TEST(tick_drops_stale_cold_reads)
+{
+	upload_scheduler s;
+	time_point const now = clock_type::now();
+
+	s.read_issued(key(0, 1), now, true);
+	TEST_CHECK(!s.tick(now + seconds(59), seconds(60)));
+	TEST_EQUAL(s.cold_reads(), 1);
+	TEST_CHECK(s.tick(now + seconds(60), seconds(60)));
+	TEST_EQUAL(s.cold_reads(), 0);
+	TEST_CHECK(!s.read_complete(key(0, 1)));
+}
+
+TORRENT_TEST(capacity)
+{
+	upload_scheduler s(2);
+	time_point const now = clock_type::now();
+
+	s.read_issued(key(0, 1), now, true);
+	s.read_issued(key(0, 2), now, false);
+	s.read_issued(key(0, 3), now, false);
+	TEST_EQUAL(s.num_pieces(), 2);
+
+	// piece 1 has a cold read in flight, it's not evicted
+	TEST_CHECK(s.is_warm(key(0, 1), now, expiry));
+	TEST_CHECK(!s.is_warm(key(0, 2), now, expiry));
+	TEST_CHECK(s.is_warm(key(0, 3), now, expiry));
+
+	// reading piece 1 again makes 3 the least recently read
+	TEST_CHECK(s.read_complete(key(0, 1)));
+	s.read_issued(key(0, 1), now, false);
+	s.read_issued(key(0, 4), now, false);
+	TEST_EQUAL(s.num_pieces(), 2);
+	TEST_CHECK(s.is_warm(key(0, 1), now, expiry));
+	TEST_CHECK(!s.is_warm(key(0, 3), now, expiry));
+	TEST_CHECK(s.is_warm(key(0, 4), now, expiry));
+}
+
+TORRENT_TEST(waiting)
+{
+	upload_scheduler s;
+	TEST_CHECK(s.take_waiting().empty());
+	s.wait(std::weak_ptr<peer_connection>());
+	s.wait(std::weak_ptr<peer_connection>());
+	TEST_EQUAL(s.take_waiting().size(), 2);
+	TEST_CHECK(s.take_waiting().empty());
+}
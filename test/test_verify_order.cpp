@@ -0,0 +1,138 @@
+/*
+
+Copyright (c) 2017, Arvid Norberg
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions
+are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in
+      the documentation and/or other materials provided with the distribution.
+    * Neither the name of the author nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+#include "test.hpp"
+#include "libtorrent/aux_/verify_order.hpp"
+#include "libtorrent/bitfield.hpp"
+
+using namespace libtorrent;
+using aux::verify_order;
+
+namespace {
+
+int const num_pieces = 200;
+
+struct pieces
+{
+	pieces() : done(num_pieces, false) {}
+
+	std::function<bool(piece_index_t)> candidate() const
+	{ return [this](piece_index_t const p) { return !done.get_bit(p); }; }
+
+	typed_bitfield<piece_index_t> done;
+};
+
+int no_score(piece_index_t) { return 0; }
+
+} // anonymous namespace
+
+TORRENT_TEST(in_order_without_hints)
+{
+	verify_order o;
+	pieces s;
+	for (int i = 0; i < num_pieces; ++i)
+	{
+		piece_index_t const p = o.pick(num_pieces, s.candidate(), &no_score);
+		TEST_EQUAL(p, piece_index_t(i));
+		s.done.set_bit(p);
+	}
+	TEST_EQUAL(o.pick(num_pieces, s.candidate(), &no_score), piece_index_t(-1));
+}
+
+TORRENT_TEST(requested_pieces_first)
+{
+	verify_order o;
+	pieces s;
+
+	o.requested(piece_index_t(10), num_pieces);
+	o.requested(piece_index_t(10), num_pieces);
+	o.requested(piece_index_t(50), num_pieces);
+
+	// the most recent request first
+	TEST_EQUAL(o.pick(num_pieces, s.candidate(), &no_score), piece_index_t(51));
+	s.done.set_bit(piece_index_t(51));
+	TEST_EQUAL(o.pick(num_pieces, s.candidate(), &no_score), piece_index_t(11));
+	s.done.set_bit(piece_index_t(11));
+
+	// hints for pieces that don't need verifying are skipped
+	s.done.set_bit(piece_index_t(31));
+	o.requested(piece_index_t(30), num_pieces);
+	TEST_EQUAL(o.pick(num_pieces, s.candidate(), &no_score), piece_index_t(0));
+
+	// there's nothing after the last piece
+	o.requested(piece_index_t(num_pieces - 1), num_pieces);
+	s.done.set_bit(piece_index_t(0));
+	TEST_EQUAL(o.pick(num_pieces, s.candidate(), &no_score), piece_index_t(1));
+}
+
+TORRENT_TEST(highest_score_in_window)
+{
+	verify_order o;
+	pieces s;
+
+	// piece 20 is missing from the most peers, 100 even more, but it's
+	// outside of the window
+	auto const score = [](piece_index_t const p)
+	{
+		if (p == piece_index_t(20)) return 5;
+		if (p == piece_index_t(100)) return 10;
+		return 1;
+	};
+	TEST_EQUAL(o.pick(num_pieces, s.candidate(), score), piece_index_t(20));
+	s.done.set_bit(piece_index_t(20));
+
+	// the pieces that were passed over are still coming
+	TEST_EQUAL(o.pick(num_pieces, s.candidate(), score), piece_index_t(0));
+	s.done.set_bit(piece_index_t(0));
+
+	// once the window reaches it
+	for (int i = 1; i < 40; ++i) s.done.set_bit(piece_index_t(i));
+	TEST_EQUAL(o.pick(num_pieces, s.candidate(), score), piece_index_t(100));
+}
+
+TORRENT_TEST(wrap_around)
+{
+	verify_order o;
+	pieces s;
+	for (int i = 0; i < num_pieces; ++i) s.done.set_bit(piece_index_t(i));
+	s.done.clear_bit(piece_index_t(150));
+	TEST_EQUAL(o.pick(num_pieces, s.candidate(), &no_score), piece_index_t(150));
+
+	// a piece behind the cursor is found by wrapping around
+	s.done.clear_bit(piece_index_t(3));
+	TEST_EQUAL(o.pick(num_pieces, s.candidate(), &no_score), piece_index_t(150));
+	s.done.set_bit(piece_index_t(150));
+	TEST_EQUAL(o.pick(num_pieces, s.candidate(), &no_score), piece_index_t(3));
+
+	o.clear();
+	TEST_EQUAL(o.pick(0, s.candidate(), &no_score), piece_index_t(-1));
+}
@@ -0,0 +1,123 @@
+/*
+
+Copyright (c) 2017, Arvid Norberg
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions
+are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in
+      the documentation and/or other materials provided with the distribution.
+    * Neither the name of the author nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <chrono>
+
+#include "libtorrent/bdecode.hpp"
+#include "libtorrent/error_code.hpp"
+
+using libtorrent::bdecode_node;
+using libtorrent::error_code;
+
+namespace {
+
+	// a DHT get_peers response with nodes and values
+	std::string dht_response()
+	{
+		std::string ret = "d1:rd2:id20:abababababababababab5:nodes208:";
+		ret.append(208, 'x');
+		ret += "5:token8:12345678";
+		ret += "6:valuesl";
+		for (int i = 0; i < 50; ++i) ret += "6:abcdef";
+		ret += "ee1:t2:aa1:y1:re";
+		return ret;
+	}
+
+	// resume-data like structure with many small integers, strings and
+	// nested lists
+	std::string resume_file()
+	{
+		std::string ret = "d";
+		ret += "10:file sizesl";
+		for (int i = 0; i < 2000; ++i)
+		{
+			char buf[50];
+			std::snprintf(buf, sizeof(buf), "li%dei%dee", i * 1337, 1500000000 + i);
+			ret += buf;
+		}
+		ret += "e";
+		ret += "5:peers";
+		ret += std::to_string(6 * 200) + ":";
+		ret.append(6 * 200, 'p');
+		ret += "6:piecesl";
+		for (int i = 0; i < 5000; ++i) ret += "i1e";
+		ret += "e";
+		ret += "5:treesl";
+		for (int i = 0; i < 500; ++i) ret += "d4:name9:file_name6:lengthi123456e4:pathl3:dir4:nameee";
+		ret += "ee";
+		return ret;
+	}
+
+	void benchmark(char const* name, std::string const& buf, int const iterations)
+	{
+		using clock = std::chrono::high_resolution_clock;
+		bdecode_node e;
+		error_code ec;
+		int tokens = 0;
+		auto const start = clock::now();
+		for (int i = 0; i < iterations; ++i)
+		{
+			e = libtorrent::bdecode(buf, ec);
+			if (ec)
+			{
+				std::fprintf(stderr, "%s: failed to decode: %s\n", name, ec.message().c_str());
+				return;
+			}
+			tokens += 1;
+		}
+		auto const end = clock::now();
+		double const seconds = std::chrono::duration_cast<std::chrono::nanoseconds>(
+			end - start).count() / 1000000000.0;
+		std::printf("%-10s %8d bytes %8d iterations %8.2f MB/s %10.0f decodes/s\n"
+			, name, int(buf.size()), tokens
+			, double(buf.size()) * iterations / seconds / 1000000.0
+			, iterations / seconds);
+	}
+}
+
+int main(int argc, char const* argv[])
+{
+	int const iterations = argc > 1 ? std::atoi(argv[1]) : 100000;
+	if (iterations <= 0)
+	{
+		std::fprintf(stderr, "usage: %s [iterations]\n", argv[0]);
+		return 1;
+	}
+
+	benchmark("dht", dht_response(), iterations);
+	benchmark("resume", resume_file(), iterations / 100 + 1);
+	return 0;
+}
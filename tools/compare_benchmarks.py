@@ -0,0 +1,77 @@
+#!/usr/bin/env python
+
+# Copyright (c) 2017, Arvid Norberg
+# All rights reserved.
+# 
+# Redistribution and use in source and binary forms, with or without
+# modification, are permitted provided that the following conditions
+# are met:
+# 
+#     * Redistributions of source code must retain the above copyright
+#       notice, this list of conditions and the following disclaimer.
+#     * Redistributions in binary form must reproduce the above copyright
+#       notice, this list of conditions and the following disclaimer in
+#       the documentation and/or other materials provided with the distribution.
+#     * Neither the name of the author nor the names of its
+#       contributors may be used to endorse or promote products derived
+#       from this software without specific prior written permission.
+# 
+# THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+# AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+# IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+# ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+# LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+# CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+# SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+# INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+# CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+# ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+# POSSIBILITY OF SUCH DAMAGE.
+
+# compares two runs of component_benchmark. Each file has one JSON object per
+# line. Prints the change in time per operation of every benchmark found in
+# both runs. Slowdowns beyond the threshold (in percent, defaults to 5) are
+# flagged, and make the script exit with status 1.
+#
+# usage: compare_benchmarks.py <baseline> <current> [threshold]
+
+from __future__ import print_function
+
+import json
+import sys
+
+
+def load(filename):
+    ret = {}
+    with open(filename) as f:
+        for line in f:
+            line = line.strip()
+            if not line.startswith('{'):
+                continue
+            b = json.loads(line)
+            ret[(b['benchmark'], b['params'])] = b['ns_per_op']
+    return ret
+
+
+if len(sys.argv) < 3:
+    print('usage: %s <baseline> <current> [threshold]' % sys.argv[0])
+    sys.exit(1)
+
+baseline = load(sys.argv[1])
+current = load(sys.argv[2])
+threshold = float(sys.argv[3]) if len(sys.argv) > 3 else 5.0
+
+regressions = 0
+for key in sorted(current.keys()):
+    if key not in baseline:
+        continue
+    old = baseline[key]
+    new = current[key]
+    change = (new - old) * 100.0 / old if old > 0 else 0.0
+    flag = ''
+    if change > threshold:
+        flag = ' <-- regression'
+        regressions += 1
+    print('%-32s %-26s %12.1f %12.1f %+8.1f%%%s' % (key[0], key[1], old, new, change, flag))
+
+sys.exit(1 if regressions > 0 else 0)
@@ -0,0 +1,533 @@
+/*
+
+Copyright (c) 2017, Arvid Norberg
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions
+are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in
+      the documentation and/or other materials provided with the distribution.
+    * Neither the name of the author nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+// micro-benchmarks of the components on the hot paths of a session. Each
+// benchmark prints one line of JSON, with the number of operations it ran
+// and the time per operation, to make it simple to collect and compare runs
+// across versions. All inputs are generated from a fixed seed, so runs are
+// reproducible.
+//
+// usage: component_benchmark [scale] [filter]
+//
+// scale multiplies the number of iterations of every benchmark (defaults to
+// 1). If filter is specified, only benchmarks whose name contains it are run.
+// Use compare_benchmarks.py to compare the output of two runs
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <random>
+#include <memory>
+#include <functional>
+
+#include "libtorrent/bdecode.hpp"
+#include "libtorrent/error_code.hpp"
+#include "libtorrent/hasher.hpp"
+#include "libtorrent/chained_buffer.hpp"
+#include "libtorrent/receive_buffer.hpp"
+#include "libtorrent/ip_filter.hpp"
+#include "libtorrent/piece_picker.hpp"
+#include "libtorrent/torrent_peer.hpp"
+#include "libtorrent/bitfield.hpp"
+#include "libtorrent/performance_counters.hpp"
+#include "libtorrent/block_cache.hpp"
+#include "libtorrent/disk_io_job.hpp"
+#include "libtorrent/disk_buffer_holder.hpp"
+#include "libtorrent/storage.hpp"
+#include "libtorrent/io_service.hpp"
+#include "libtorrent/aux_/session_settings.hpp"
+#include "libtorrent/file_storage.hpp"
+#include "libtorrent/add_torrent_params.hpp"
+#include "libtorrent/address.hpp"
+#include "libtorrent/socket.hpp"
+
+#ifndef TORRENT_DISABLE_DHT
+#include "libtorrent/kademlia/routing_table.hpp"
+#include "libtorrent/session_settings.hpp"
+#endif
+
+using namespace libtorrent;
+
+namespace {
+
+	char const* g_filter = nullptr;
+	int g_scale = 1;
+
+	// benchmarks accumulate their results in here, to keep the compiler from
+	// optimizing the work away
+	std::uint64_t volatile g_sink = 0;
+
+	// runs f() iterations times (scaled) and prints the time per call as a
+	// line of JSON. params describes the input, e.g. the swarm size
+	template <typename F>
+	void run(char const* name, char const* params, int iterations, F&& f)
+	{
+		if (g_filter != nullptr && std::strstr(name, g_filter) == nullptr) return;
+
+		using clock = std::chrono::high_resolution_clock;
+		iterations *= g_scale;
+
+		// warm up caches and lazily initialized state
+		for (int i = 0; i < iterations / 10 + 1; ++i) f(i);
+
+		auto const start = clock::now();
+		for (int i = 0; i < iterations; ++i) f(i);
+		auto const end = clock::now();
+
+		double const ns = double(std::chrono::duration_cast<std::chrono::nanoseconds>(
+			end - start).count());
+		std::printf("{\"benchmark\": \"%s\", \"params\": \"%s\", \"iterations\": %d"
+			", \"ns_per_op\": %.1f, \"ops_per_second\": %.0f}\n"
+			, name, params, iterations, ns / iterations
+			, ns > 0 ? iterations * 1000000000.0 / ns : 0.0);
+		std::fflush(stdout);
+	}
+
+	// ==== piece_picker ====
+
+	void bench_piece_picker(int const num_pieces, int const num_peers)
+	{
+		std::mt19937 rng(0x1337);
+		int const blocks_per_piece = 16;
+		piece_picker p;
+		p.init(blocks_per_piece, blocks_per_piece, num_pieces);
+
+		tcp::endpoint const ep;
+		ipv4_peer peer(ep, true, 0);
+
+		// every peer has a random half of the pieces
+		typed_bitfield<piece_index_t> have(num_pieces);
+		for (int k = 0; k < num_peers; ++k)
+		{
+			have.clear_all();
+			for (piece_index_t i(0); i < piece_index_t(num_pieces); ++i)
+				if (rng() & 1) have.set_bit(i);
+			p.inc_refcount(have, &peer);
+		}
+
+		// we've downloaded 10% of the pieces already
+		for (piece_index_t i(0); i < piece_index_t(num_pieces); ++i)
+			if (rng() % 10 == 0) p.we_have(i);
+
+		// the peer we're picking from has most pieces
+		typed_bitfield<piece_index_t> remote(num_pieces);
+		for (piece_index_t i(0); i < piece_index_t(num_pieces); ++i)
+			if (rng() % 4 != 0) remote.set_bit(i);
+
+		std::vector<piece_index_t> const suggested;
+		std::vector<piece_block> picked;
+		counters pc;
+
+		char params[100];
+		std::snprintf(params, sizeof(params), "pieces=%d peers=%d"
+			, num_pieces, num_peers);
+		int const iterations = std::max(10, 20000000 / num_pieces);
+		run("piece_picker.pick_pieces", params, iterations, [&](int)
+		{
+			picked.clear();
+			p.pick_pieces(remote, picked, 64, 0, &peer
+				, piece_picker::rarest_first, suggested, num_peers, pc);
+			g_sink += picked.size();
+		});
+	}
+
+	// ==== block_cache ====
+
+	struct bench_storage : storage_interface
+	{
+		explicit bench_storage(file_storage const& fs) : storage_interface(fs) {}
+		void initialize(storage_error&) override {}
+		int readv(span<iovec_t const> bufs, piece_index_t, int, std::uint32_t
+			, storage_error&) override { return bufs_size(bufs); }
+		int writev(span<iovec_t const> bufs, piece_index_t, int, std::uint32_t
+			, storage_error&) override { return bufs_size(bufs); }
+		bool has_any_file(storage_error&) override { return false; }
+		void set_file_priority(aux::vector<std::uint8_t, file_index_t> const&
+			, storage_error&) override {}
+		status_t move_storage(std::string const&, int, storage_error&) override
+		{ return status_t::no_error; }
+		bool verify_resume_data(add_torrent_params const&
+			, aux::vector<std::string, file_index_t> const&
+			, storage_error&) override { return true; }
+		void release_files(storage_error&) override {}
+		void rename_file(file_index_t, std::string const&, storage_error&) override {}
+		void delete_files(int, storage_error&) override {}
+	};
+
+	struct bench_allocator : buffer_allocator_interface
+	{
+		bench_allocator(block_cache& bc, storage_interface* st)
+			: m_cache(bc), m_storage(st) {}
+
+		void free_disk_buffer(char* b) override { m_cache.free_buffer(b); }
+
+		void reclaim_blocks(span<aux::block_cache_reference> refs) override
+		{
+			for (auto ref : refs)
+				m_cache.reclaim_block(m_storage, ref);
+		}
+	private:
+		block_cache& m_cache;
+		storage_interface* m_storage;
+	};
+
+	void nop() {}
+
+	void bench_block_cache()
+	{
+		int const block_size = 0x4000;
+		int const blocks_per_piece = 16;
+		int const num_pieces = 256;
+
+		io_service ios;
+		block_cache bc(block_size, ios, std::bind(&nop));
+		aux::session_settings sett;
+		bc.set_settings(sett);
+
+		file_storage fs;
+		fs.add_file("bench/file", std::int64_t(num_pieces) * blocks_per_piece * block_size);
+		fs.set_piece_length(blocks_per_piece * block_size);
+		fs.set_num_pieces(num_pieces);
+		std::shared_ptr<storage_interface> st = std::make_shared<bench_storage>(fs);
+		st->m_settings = &sett;
+		bench_allocator alloc(bc, st.get());
+
+		disk_io_job j;
+#if TORRENT_USE_ASSERTS
+		j.in_use = true;
+#endif
+		j.storage = st;
+		j.requester = reinterpret_cast<void*>(1);
+
+		// inserts all blocks of piece p into the read cache
+		auto insert_piece = [&](int const p)
+		{
+			j.piece = piece_index_t(p);
+			cached_piece_entry* pe = bc.allocate_piece(&j, cached_piece_entry::read_lru1);
+			if (pe == nullptr) return pe;
+			std::vector<iovec_t> iov(blocks_per_piece);
+			for (auto& b : iov) b.iov_len = block_size;
+			if (bc.allocate_iovec(iov) < 0) return static_cast<cached_piece_entry*>(nullptr);
+			bc.insert_blocks(pe, 0, iov, &j);
+			return pe;
+		};
+
+		// the hit path: the blocks being read are all in the cache
+		int const cached_pieces = 32;
+		for (int p = 0; p < cached_pieces; ++p) insert_piece(p);
+
+		std::mt19937 rng(0x1337);
+		run("block_cache.try_read_hit", "blocks=512", 2000000, [&](int)
+		{
+			int const p = int(rng() % cached_pieces);
+			int const b = int(rng() % blocks_per_piece);
+			j.action = disk_io_job::read;
+			j.piece = piece_index_t(p);
+			j.d.io.offset = b * block_size;
+			j.d.io.buffer_size = block_size;
+			j.argument = disk_buffer_holder(alloc, nullptr);
+			int const ret = bc.try_read(&j, alloc);
+			g_sink += std::uint64_t(ret);
+			// release the reference to the block
+			j.argument = disk_buffer_holder(alloc, nullptr);
+		});
+
+		// the eviction path: fill a piece and evict it to the ghost list
+		tailqueue<disk_io_job> jobs;
+		run("block_cache.insert_evict_piece", "blocks_per_piece=16", 100000, [&](int const i)
+		{
+			cached_piece_entry* pe = insert_piece(cached_pieces + i % (num_pieces - cached_pieces));
+			if (pe == nullptr) return;
+			g_sink += bc.evict_piece(pe, jobs);
+		});
+
+		j.argument = disk_buffer_holder(alloc, nullptr);
+		bc.clear(jobs);
+	}
+
+	// ==== bdecode ====
+
+	std::string dht_response()
+	{
+		std::string ret = "d1:rd2:id20:abababababababababab5:nodes208:";
+		ret.append(208, 'x');
+		ret += "5:token8:12345678";
+		ret += "6:valuesl";
+		for (int i = 0; i < 50; ++i) ret += "6:abcdef";
+		ret += "ee1:t2:aa1:y1:re";
+		return ret;
+	}
+
+	std::string resume_file()
+	{
+		std::string ret = "d";
+		ret += "10:file sizesl";
+		for (int i = 0; i < 2000; ++i)
+		{
+			char buf[50];
+			std::snprintf(buf, sizeof(buf), "li%dei%dee", i * 1337, 1500000000 + i);
+			ret += buf;
+		}
+		ret += "e";
+		ret += "6:piecesl";
+		for (int i = 0; i < 5000; ++i) ret += "i1e";
+		ret += "ee";
+		return ret;
+	}
+
+	// a multi-file .torrent with 200 files and 4000 pieces
+	std::string torrent_file()
+	{
+		std::string const announce = "http://tracker.example.com/announce";
+		std::string ret = "d8:announce" + std::to_string(announce.size()) + ":"
+			+ announce + "4:infod5:filesl";
+		for (int i = 0; i < 200; ++i)
+		{
+			char buf[100];
+			std::snprintf(buf, sizeof(buf), "d6:lengthi%de4:pathl6:folder11:file-%04d.xee"
+				, 1000000 + i, i);
+			ret += buf;
+		}
+		ret += "e4:name5:bench12:piece lengthi65536e6:pieces";
+		ret += std::to_string(20 * 4000) + ":";
+		ret.append(20 * 4000, 'h');
+		ret += "ee";
+		return ret;
+	}
+
+	void bench_bdecode(char const* name, std::string const& buf, int const iterations)
+	{
+		bdecode_node e;
+		error_code ec;
+		e = bdecode(buf, ec);
+		if (ec)
+		{
+			std::fprintf(stderr, "%s: failed to decode: %s\n", name, ec.message().c_str());
+			return;
+		}
+		char params[50];
+		std::snprintf(params, sizeof(params), "bytes=%d", int(buf.size()));
+		run(name, params, iterations, [&](int)
+		{
+			e = bdecode(buf, ec);
+			g_sink += std::uint64_t(e.type());
+		});
+	}
+
+	// ==== hasher ====
+
+	void bench_hasher(int const size, int const iterations)
+	{
+		std::vector<char> buf(std::size_t(size), 'a');
+		char params[50];
+		std::snprintf(params, sizeof(params), "bytes=%d", size);
+		run("hasher.sha1", params, iterations, [&](int)
+		{
+			sha1_hash const h = hasher(buf.data(), size).final();
+			g_sink += std::uint64_t(h[0]);
+		});
+	}
+
+	// ==== chained_buffer ====
+
+	struct bench_holder
+	{
+		explicit bench_holder(char* buf) : m_buf(buf) {}
+		bench_holder(bench_holder const&) = delete;
+		bench_holder& operator=(bench_holder const&) = delete;
+		bench_holder(bench_holder&& rhs) noexcept : m_buf(rhs.m_buf) { rhs.m_buf = nullptr; }
+		char* get() const { return m_buf; }
+	private:
+		char* m_buf;
+	};
+
+	void bench_chained_buffer()
+	{
+		// the send path of a peer connection: append 16 kiB blocks with a
+		// message header in front, build the iovec for a send and pop what
+		// was sent
+		std::vector<char> block(0x4000, 'b');
+		char header[13] = {};
+		chained_buffer b;
+		run("chained_buffer.send", "block=16384", 1000000, [&](int)
+		{
+			b.append_buffer(bench_holder(header), int(sizeof(header)), int(sizeof(header)));
+			b.append_buffer(bench_holder(block.data()), int(block.size()), int(block.size()));
+			auto const& iov = b.build_iovec(b.size());
+			g_sink += iov.size();
+			b.pop_front(b.size());
+		});
+	}
+
+	// ==== receive_buffer ====
+
+	void bench_receive_buffer()
+	{
+		// the receive path of a peer connection: receive piece messages in
+		// chunks and cut them off once they're complete
+		int const msg_size = 13 + 0x4000;
+		int const chunk = 1460 * 4;
+		receive_buffer b;
+		b.reset(msg_size);
+		run("receive_buffer.receive", "message=16397", 200000, [&](int)
+		{
+			int left = msg_size;
+			while (left > 0)
+			{
+				int const n = std::min(left, chunk);
+				span<char> const buf = b.reserve(n);
+				g_sink += std::uint64_t(buf.size());
+				b.received(n);
+				b.advance_pos(n);
+				left -= n;
+			}
+			g_sink += std::uint64_t(b.get().size());
+			b.cut(msg_size, msg_size);
+			b.normalize();
+		});
+	}
+
+	// ==== ip_filter ====
+
+	void bench_ip_filter(int const num_rules, bool const compiled)
+	{
+		std::mt19937 rng(0x1337);
+		ip_filter f;
+		for (int i = 0; i < num_rules; ++i)
+		{
+			std::uint32_t const first = rng() % 0xfffe0000u;
+			f.add_rule(address_v4(first), address_v4(first + (rng() & 0xffff))
+				, ip_filter::blocked);
+		}
+		if (compiled) f.compile();
+
+		std::vector<address> addrs;
+		for (int i = 0; i < 4096; ++i) addrs.push_back(address_v4(rng()));
+
+		char params[50];
+		std::snprintf(params, sizeof(params), "rules=%d compiled=%d"
+			, num_rules, int(compiled));
+		run("ip_filter.access", params, 2000000, [&](int const i)
+		{
+			g_sink += f.access(addrs[std::size_t(i & 4095)]);
+		});
+	}
+
+	// ==== routing_table ====
+
+#ifndef TORRENT_DISABLE_DHT
+	void bench_routing_table(int const num_nodes)
+	{
+		std::mt19937 rng(0x1337);
+		auto rand_id = [&]
+		{
+			dht::node_id ret;
+			for (auto& b : ret) b = std::uint8_t(rng());
+			return ret;
+		};
+
+		dht_settings s;
+		dht::node_id const id = rand_id();
+		dht::routing_table table(id, udp::v4(), 8, s, nullptr);
+		// a real table has nodes at all distances from our ID. Pick a random
+		// number of leading bits to share with our ID, so the buckets close to
+		// us fill up too
+		for (int i = 0; i < num_nodes; ++i)
+		{
+			dht::node_id n = rand_id();
+			int const prefix = int(rng() % 24);
+			for (int b = 0; b < prefix; ++b)
+			{
+				std::uint8_t const mask = std::uint8_t(0x80 >> (b & 7));
+				n[b / 8] = std::uint8_t((n[b / 8] & ~mask) | (id[b / 8] & mask));
+			}
+			table.add_node(dht::node_entry(n
+				, udp::endpoint(address_v4(rng()), 6881), 50, true));
+		}
+
+		std::vector<dht::node_id> targets;
+		for (int i = 0; i < 1024; ++i) targets.push_back(rand_id());
+
+		std::vector<dht::node_entry> nodes;
+		char params[50];
+		std::snprintf(params, sizeof(params), "nodes=%d",
+			std::get<0>(table.size()));
+		run("routing_table.find_node", params, 500000, [&](int const i)
+		{
+			nodes.clear();
+			table.find_node(targets[std::size_t(i & 1023)], nodes, 0, 8);
+			g_sink += nodes.size();
+		});
+	}
+#endif
+}
+
+int main(int argc, char const* argv[])
+{
+	if (argc > 1) g_scale = std::atoi(argv[1]);
+	if (argc > 2) g_filter = argv[2];
+	if (g_scale <= 0 || argc > 3)
+	{
+		std::fprintf(stderr, "usage: %s [scale] [filter]\n", argv[0]);
+		return 1;
+	}
+
+	bench_piece_picker(1000, 50);
+	bench_piece_picker(10000, 200);
+	bench_piece_picker(50000, 1000);
+
+	bench_block_cache();
+
+	bench_bdecode("bdecode.dht", dht_response(), 1000000);
+	bench_bdecode("bdecode.resume", resume_file(), 2000);
+	bench_bdecode("bdecode.torrent", torrent_file(), 5000);
+
+	bench_hasher(0x4000, 50000);
+	bench_hasher(64, 2000000);
+
+	bench_chained_buffer();
+	bench_receive_buffer();
+
+	bench_ip_filter(100, false);
+	bench_ip_filter(100000, false);
+	bench_ip_filter(100000, true);
+
+#ifndef TORRENT_DISABLE_DHT
+	bench_routing_table(1000);
+	bench_routing_table(10000);
+#endif
+
+	return 0;
+}
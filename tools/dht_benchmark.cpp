@@ -0,0 +1,449 @@
+/*
+
+Copyright (c) 2017, Arvid Norberg
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions
+are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in
+      the documentation and/or other materials provided with the distribution.
+    * Neither the name of the author nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+// measures how many incoming DHT queries per second a node can answer. The
+// queries are pre-encoded and fed to dht::node::incoming() the way
+// dht_tracker does, decoding included. Responses are bencoded into a buffer
+// but not sent anywhere. Every workload is made up of 4096 queries from 4096
+// distinct endpoints, cycled through. The mixed workload approximates the
+// query distribution seen by a node on the live DHT.
+//
+// Each workload prints one line of JSON, in the same format as
+// component_benchmark (so compare_benchmarks.py can compare runs), with the
+// number of heap allocations per query added.
+//
+// usage: dht_benchmark [scale] [filter]
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <map>
+#include <chrono>
+#include <random>
+#include <memory>
+#include <new>
+#include <iterator>
+#include <array>
+#include <tuple>
+#include <algorithm>
+#include <cinttypes> // for PRId64 et.al.
+
+#include "libtorrent/config.hpp"
+
+#ifndef TORRENT_DISABLE_DHT
+
+#include "libtorrent/kademlia/node.hpp"
+#include "libtorrent/kademlia/dht_observer.hpp"
+#include "libtorrent/kademlia/dht_storage.hpp"
+#include "libtorrent/kademlia/msg.hpp"
+#include "libtorrent/kademlia/item.hpp"
+#include "libtorrent/kademlia/ed25519.hpp"
+#include "libtorrent/session_settings.hpp"
+#include "libtorrent/performance_counters.hpp"
+#include "libtorrent/bdecode.hpp"
+#include "libtorrent/bencode.hpp"
+#include "libtorrent/entry.hpp"
+#include "libtorrent/socket.hpp"
+#include "libtorrent/socket_io.hpp"
+
+using namespace libtorrent;
+using namespace libtorrent::dht;
+
+namespace {
+
+	// the number of calls to operator new since the program started
+	std::uint64_t g_allocations = 0;
+
+} // anonymous namespace
+
+// count every heap allocation, to report allocations per query. This
+// replaces the allocation functions of the whole program, including the ones
+// used by libtorrent
+void* operator new(std::size_t const size)
+{
+	++g_allocations;
+	void* ret = std::malloc(size == 0 ? 1 : size);
+	if (ret == nullptr) throw std::bad_alloc();
+	return ret;
+}
+
+void* operator new[](std::size_t const size)
+{
+	return ::operator new(size);
+}
+
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete[](void* p) noexcept { std::free(p); }
+
+namespace {
+
+	char const* g_filter = nullptr;
+	int g_scale = 1;
+	int const num_queries = 4096;
+
+	// captures the node's responses. They are bencoded (if not already) to
+	// include the cost of that in the measurement
+	struct bench_socket final : udp_socket_interface
+	{
+		bool has_quota() override { return true; }
+
+		bool send_packet(entry& e, udp::endpoint const&) override
+		{
+			last.clear();
+			bencode(std::back_inserter(last), e);
+			++sent;
+			return true;
+		}
+
+		bool send_raw_packet(span<char const> buf, udp::endpoint const&) override
+		{
+			last.assign(buf.begin(), buf.end());
+			++sent;
+			return true;
+		}
+
+		std::vector<char> last;
+		std::int64_t sent = 0;
+	};
+
+	struct bench_observer final : dht_observer
+	{
+		void set_external_address(address const&, address const&) override {}
+		address external_address(udp) override { return address_v4::from_string("236.0.0.1"); }
+		void get_peers(sha1_hash const&) override {}
+		void outgoing_get_peers(sha1_hash const&, sha1_hash const&
+			, udp::endpoint const&) override {}
+		void announce(sha1_hash const&, address const&, int) override {}
+#ifndef TORRENT_DISABLE_LOGGING
+		bool should_log(module_t) const override { return false; }
+		void log(dht_logger::module_t, char const*, ...) override {}
+		void log_packet(message_direction_t, span<char const>
+			, udp::endpoint const&) override {}
+#endif
+		bool on_dht_request(string_view, dht::msg const&, entry&) override
+		{ return false; }
+		bool has_dht_request_handler() const override { return false; }
+	};
+
+	dht_settings bench_settings()
+	{
+		dht_settings sett;
+		// the querying nodes have random IDs
+		sett.enforce_node_id = false;
+		return sett;
+	}
+
+	struct query
+	{
+		std::vector<char> buf;
+		udp::endpoint ep;
+	};
+
+	struct bench_node
+	{
+		bench_node()
+			: sett(bench_settings())
+			, storage(dht_default_storage_constructor(sett))
+			, rng(0x1337)
+			, dht_node(udp::v4(), &sock, sett, random_id(), &observer, cnt
+				, nodes, *storage)
+		{
+			storage->update_node_ids({dht_node.nid()});
+
+			for (int i = 0; i < num_queries; ++i)
+			{
+				endpoints.push_back(udp::endpoint(address_v4(rng()), std::uint16_t(1024 + rng() % 60000)));
+				ids.push_back(random_id());
+			}
+			// the torrents and items queried for and announced to. A realistic
+			// node only stores a fraction of what's asked for
+			for (int i = 0; i < 512; ++i) info_hashes.push_back(random_id());
+		}
+
+		node_id random_id()
+		{
+			node_id ret;
+			for (auto& b : ret) b = std::uint8_t(rng());
+			return ret;
+		}
+
+		// encodes a query from the i:th endpoint
+		query make_query(int const i, char const* q, entry args)
+		{
+			entry e;
+			e["y"] = "q";
+			e["t"] = "aa";
+			e["q"] = q;
+			args["id"] = ids[std::size_t(i)].to_string();
+			e["a"] = args;
+			query ret;
+			bencode(std::back_inserter(ret.buf), e);
+			ret.ep = endpoints[std::size_t(i)];
+			return ret;
+		}
+
+		void deliver(query const& q)
+		{
+			error_code ec;
+			int const ret = bdecode(q.buf.data(), q.buf.data() + q.buf.size(), decoded, ec);
+			if (ret != 0) return;
+			dht::msg const m(decoded, q.ep);
+			dht_node.incoming(m);
+		}
+
+		// sends the query and returns the write token in the response
+		std::string token(query const& q)
+		{
+			sock.last.clear();
+			deliver(q);
+			bdecode_node response;
+			error_code ec;
+			if (sock.last.empty() || bdecode(sock.last.data()
+				, sock.last.data() + sock.last.size(), response, ec) != 0)
+				return std::string();
+			bdecode_node const r = response.dict_find_dict("r");
+			if (!r) return std::string();
+			return r.dict_find_string_value("token").to_string();
+		}
+
+		dht_settings sett;
+		bench_socket sock;
+		bench_observer observer;
+		counters cnt;
+		std::unique_ptr<dht_storage_interface> storage;
+		std::map<std::string, node*> nodes;
+		std::mt19937 rng;
+		dht::node dht_node;
+		bdecode_node decoded;
+
+		std::vector<udp::endpoint> endpoints;
+		std::vector<node_id> ids;
+		std::vector<sha1_hash> info_hashes;
+	};
+
+	// the kinds of queries in the workloads
+	enum query_type
+	{
+		ping_query,
+		find_node_query,
+		get_peers_query,
+		announce_peer_query,
+		get_query,
+		put_query,
+		put_mutable_query
+	};
+
+	query build_query(bench_node& n, int const i, query_type const type)
+	{
+		sha1_hash const& ih = n.info_hashes[n.rng() % n.info_hashes.size()];
+		switch (type)
+		{
+			case ping_query:
+				return n.make_query(i, "ping", entry(entry::dictionary_t));
+			case find_node_query:
+			{
+				entry a;
+				a["target"] = n.random_id().to_string();
+				return n.make_query(i, "find_node", a);
+			}
+			case get_peers_query:
+			{
+				entry a;
+				a["info_hash"] = ih.to_string();
+				return n.make_query(i, "get_peers", a);
+			}
+			case announce_peer_query:
+			{
+				entry a;
+				a["info_hash"] = ih.to_string();
+				std::string const token = n.token(n.make_query(i, "get_peers", a));
+				a["port"] = int(6881 + i % 1000);
+				a["token"] = token;
+				return n.make_query(i, "announce_peer", a);
+			}
+			case get_query:
+			{
+				// the immutable items stored by the put workloads
+				char value[30];
+				int const len = std::snprintf(value, sizeof(value), "%d:item-%05d"
+					, 10, int(n.rng() % 512));
+				entry a;
+				a["target"] = item_target_id({value, std::size_t(len)}).to_string();
+				return n.make_query(i, "get", a);
+			}
+			case put_query:
+			{
+				char value[30];
+				int const len = std::snprintf(value, sizeof(value), "%d:item-%05d"
+					, 10, int(n.rng() % 512));
+				entry a;
+				a["target"] = item_target_id({value, std::size_t(len)}).to_string();
+				std::string const token = n.token(n.make_query(i, "get", a));
+				entry put;
+				put["token"] = token;
+				put["v"] = std::string(value + 3, std::size_t(len - 3));
+				return n.make_query(i, "put", put);
+			}
+			case put_mutable_query:
+			{
+				std::array<char, 32> seed;
+				for (auto& c : seed) c = char(n.rng());
+				public_key pk;
+				secret_key sk;
+				std::tie(pk, sk) = ed25519_create_keypair(seed);
+				char value[30];
+				int const len = std::snprintf(value, sizeof(value), "%d:item-%05d"
+					, 10, i % 100000);
+				sequence_number const seq(1);
+
+				entry a;
+				a["target"] = item_target_id({}, pk).to_string();
+				std::string const token = n.token(n.make_query(i, "get", a));
+				signature const sig = sign_mutable_item({value, std::size_t(len)}
+					, {}, seq, pk, sk);
+				entry put;
+				put["token"] = token;
+				put["k"] = std::string(pk.bytes.data(), pk.bytes.size());
+				put["sig"] = std::string(sig.bytes.data(), sig.bytes.size());
+				put["seq"] = seq.value;
+				put["v"] = std::string(value + 3, std::size_t(len - 3));
+				return n.make_query(i, "put", put);
+			}
+		}
+		return query();
+	}
+
+	struct workload_mix
+	{
+		query_type type;
+		int weight;
+	};
+
+	void run(char const* name, std::vector<workload_mix> const& mix)
+	{
+		if (g_filter != nullptr && std::strstr(name, g_filter) == nullptr) return;
+
+		bench_node n;
+		int total_weight = 0;
+		for (auto const& m : mix) total_weight += m.weight;
+
+		// all queries that need a token are set up first, so the tokens are
+		// issued by the same secret
+		std::vector<query> queries;
+		queries.reserve(num_queries);
+		for (int i = 0; i < num_queries; ++i)
+		{
+			int w = int(n.rng() % std::uint32_t(total_weight));
+			query_type type = mix.front().type;
+			for (auto const& m : mix)
+			{
+				if (w < m.weight) { type = m.type; break; }
+				w -= m.weight;
+			}
+			queries.push_back(build_query(n, i, type));
+		}
+
+		using clock = std::chrono::high_resolution_clock;
+		int const iterations = 200000 * g_scale;
+
+		// warm up. This also populates the routing table and storage. Count
+		// the queries rejected with an error, a valid workload has none
+		int errors = 0;
+		for (auto const& q : queries)
+		{
+			n.sock.last.clear();
+			n.deliver(q);
+			char const error_tag[] = "1:y1:e";
+			if (std::search(n.sock.last.begin(), n.sock.last.end()
+				, error_tag, error_tag + sizeof(error_tag) - 1) != n.sock.last.end())
+				++errors;
+		}
+
+		std::int64_t const sent_start = n.sock.sent;
+		std::uint64_t const alloc_start = g_allocations;
+		auto const start = clock::now();
+		for (int i = 0; i < iterations; ++i)
+			n.deliver(queries[std::size_t(i % num_queries)]);
+		auto const end = clock::now();
+		std::uint64_t const allocations = g_allocations - alloc_start;
+		std::int64_t const responses = n.sock.sent - sent_start;
+
+		double const ns = double(std::chrono::duration_cast<std::chrono::nanoseconds>(
+			end - start).count());
+		std::printf("{\"benchmark\": \"dht_node_incoming\", \"params\": \"%s\""
+			", \"iterations\": %d, \"ns_per_op\": %.1f, \"ops_per_second\": %.0f"
+			", \"allocs_per_op\": %.2f, \"responses\": %" PRId64
+			", \"error_responses\": %d}\n"
+			, name, iterations, ns / iterations
+			, ns > 0 ? iterations * 1000000000.0 / ns : 0.0
+			, double(allocations) / iterations, responses, errors);
+		std::fflush(stdout);
+	}
+
+} // anonymous namespace
+
+int main(int argc, char* argv[])
+{
+	if (argc > 1) g_scale = std::max(1, std::atoi(argv[1]));
+	if (argc > 2) g_filter = argv[2];
+
+	run("ping", {{ping_query, 1}});
+	run("find_node", {{find_node_query, 1}});
+	run("get_peers", {{get_peers_query, 1}});
+	run("announce_peer", {{announce_peer_query, 1}});
+	run("get", {{get_query, 1}});
+	run("put", {{put_query, 1}});
+	run("put_mutable", {{put_mutable_query, 1}});
+	run("mixed", {
+		{ping_query, 30},
+		{find_node_query, 20},
+		{get_peers_query, 35},
+		{announce_peer_query, 8},
+		{get_query, 4},
+		{put_query, 2},
+		{put_mutable_query, 1}});
+
+	return 0;
+}
+
+#else
+
+int main()
+{
+	std::fprintf(stderr, "the DHT is disabled in this build\n");
+	return 1;
+}
+
+#endif // TORRENT_DISABLE_DHT
+
@@ -0,0 +1,426 @@
+/*
+
+Copyright (c) 2017, Arvid Norberg
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions
+are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in
+      the documentation and/or other materials provided with the distribution.
+    * Neither the name of the author nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+// replays a trace of disk requests, recorded by a session with the
+// settings_pack::disk_io_trace_file setting, against a fresh disk I/O thread.
+// Any setting can be overridden for the replay, to compare how different
+// cache and disk configurations perform under the same workload. The
+// storages are recreated as one (sparse) file each, in the directory given
+// by -d.
+//
+// At the end, the throughput, read cache hit rate and a latency histogram
+// for each kind of request is printed.
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cinttypes> // for PRId64 et.al.
+#include <string>
+#include <vector>
+#include <memory>
+#include <fstream>
+#include <thread>
+#include <chrono>
+#include <array>
+#include <algorithm>
+
+#include "libtorrent/disk_io_thread.hpp"
+#include "libtorrent/disk_buffer_holder.hpp"
+#include "libtorrent/storage.hpp"
+#include "libtorrent/file_storage.hpp"
+#include "libtorrent/settings_pack.hpp"
+#include "libtorrent/performance_counters.hpp"
+#include "libtorrent/io_service.hpp"
+#include "libtorrent/peer_request.hpp"
+#include "libtorrent/aux_/path.hpp"
+#include "libtorrent/time.hpp"
+
+using namespace libtorrent;
+
+namespace {
+
+	void print_usage()
+	{
+		std::fprintf(stderr, "usage: disk_io_replay [options] trace-file\n\n"
+			"replays a trace of disk requests recorded with the\n"
+			"disk_io_trace_file setting.\n\n"
+			"options:\n"
+			"  -d <path>      the directory to create the storage files in\n"
+			"                 (defaults to disk_io_replay)\n"
+			"  -s name=value  override a setting for the replay (may be\n"
+			"                 specified multiple times)\n"
+			"  -f             issue requests as fast as possible, instead of\n"
+			"                 at their recorded times\n"
+			"  -q <num>       the max number of outstanding requests\n"
+			"                 (defaults to 512)\n\n"
+			"example:\n\n"
+			"disk_io_replay -f -s cache_size=4096 -s aio_threads=8 disk.trace\n");
+		std::exit(1);
+	}
+
+	struct request
+	{
+		std::int64_t time;
+		char op;
+		int storage;
+		int piece;
+		int offset;
+		int size;
+		std::int64_t total_size;
+	};
+
+	// latencies are bucketed by powers of two microseconds
+	struct histogram
+	{
+		std::array<std::int64_t, 32> buckets{};
+		std::int64_t count = 0;
+		std::int64_t total = 0;
+
+		void add(std::int64_t const us)
+		{
+			int b = 0;
+			while (b < int(buckets.size()) - 1 && (std::int64_t(1) << b) < us) ++b;
+			++buckets[std::size_t(b)];
+			++count;
+			total += us;
+		}
+
+		// returns the upper bound of the bucket holding the given percentile
+		std::int64_t percentile(double const p) const
+		{
+			std::int64_t const target = std::int64_t(double(count) * p);
+			std::int64_t sum = 0;
+			for (std::size_t i = 0; i < buckets.size(); ++i)
+			{
+				sum += buckets[i];
+				if (sum > target) return std::int64_t(1) << i;
+			}
+			return std::int64_t(1) << (buckets.size() - 1);
+		}
+
+		void print(char const* name) const
+		{
+			if (count == 0) return;
+			std::printf("%s latency (%" PRId64 " requests): mean: %" PRId64 " us"
+				" p50: <%" PRId64 " us p90: <%" PRId64 " us p99: <%" PRId64 " us\n"
+				, name, count, total / count, percentile(0.5), percentile(0.9)
+				, percentile(0.99));
+			for (std::size_t i = 0; i < buckets.size(); ++i)
+			{
+				if (buckets[i] == 0) continue;
+				std::printf("  <= %10" PRId64 " us: %8" PRId64 " %5.1f %%\n"
+					, std::int64_t(1) << i, buckets[i]
+					, double(buckets[i]) * 100. / double(count));
+			}
+		}
+	};
+
+	// a storage recreated from the trace. The file_storage must outlive the
+	// storage referring to it
+	struct replay_storage
+	{
+		std::unique_ptr<file_storage> files;
+		storage_holder holder;
+	};
+
+	bool parse_trace(char const* path, std::vector<request>& out)
+	{
+		FILE* f = std::fopen(path, "r");
+		if (f == nullptr)
+		{
+			std::fprintf(stderr, "failed to open \"%s\": %s\n", path
+				, std::strerror(errno));
+			return false;
+		}
+
+		char line[200];
+		int line_no = 0;
+		while (std::fgets(line, sizeof(line), f))
+		{
+			++line_no;
+			request r{};
+			int ret = 0;
+			if (std::sscanf(line, "%" SCNd64 " %c", &r.time, &r.op) != 2) ret = -1;
+			else if (r.op == 'S')
+			{
+				ret = std::sscanf(line, "%*d %*c %d %d %d %" SCNd64
+					, &r.storage, &r.size, &r.piece, &r.total_size) == 4 ? 0 : -1;
+			}
+			else
+			{
+				ret = std::sscanf(line, "%*d %*c %d %d %d %d"
+					, &r.storage, &r.piece, &r.offset, &r.size) == 4 ? 0 : -1;
+			}
+
+			if (ret < 0 || r.storage < 0)
+			{
+				std::fprintf(stderr, "%s:%d: invalid trace line\n", path, line_no);
+				continue;
+			}
+			out.push_back(r);
+		}
+		std::fclose(f);
+		return true;
+	}
+}
+
+int main(int argc, char* argv[])
+{
+	std::string save_path = "disk_io_replay";
+	bool fast = false;
+	int max_outstanding = 512;
+	settings_pack pack;
+
+	int i = 1;
+	for (; i < argc && argv[i][0] == '-'; ++i)
+	{
+		char const* opt = argv[i];
+		if (std::strcmp(opt, "-f") == 0) { fast = true; continue; }
+		if (i + 1 >= argc) print_usage();
+		char const* arg = argv[++i];
+		if (std::strcmp(opt, "-d") == 0) save_path = arg;
+		else if (std::strcmp(opt, "-q") == 0) max_outstanding = std::max(1, std::atoi(arg));
+		else if (std::strcmp(opt, "-s") == 0)
+		{
+			char const* eq = std::strchr(arg, '=');
+			if (eq == nullptr) print_usage();
+			std::string const name(arg, eq);
+			int const s = setting_by_name(name);
+			if (s < 0)
+			{
+				std::fprintf(stderr, "unknown setting: %s\n", name.c_str());
+				return 1;
+			}
+			switch (s & settings_pack::type_mask)
+			{
+				case settings_pack::string_type_base: pack.set_str(s, eq + 1); break;
+				case settings_pack::int_type_base: pack.set_int(s, std::atoi(eq + 1)); break;
+				case settings_pack::bool_type_base: pack.set_bool(s, std::atoi(eq + 1) != 0); break;
+			}
+		}
+		else print_usage();
+	}
+	if (i != argc - 1) print_usage();
+
+	std::vector<request> trace;
+	if (!parse_trace(argv[i], trace)) return 1;
+
+	// the replay must not record a trace of its own
+	pack.set_str(settings_pack::disk_io_trace_file, "");
+
+	error_code ec;
+	create_directories(save_path, ec);
+	if (ec)
+	{
+		std::fprintf(stderr, "failed to create \"%s\": %s\n", save_path.c_str()
+			, ec.message().c_str());
+		return 1;
+	}
+
+	io_service ios;
+	counters cnt;
+	disk_io_thread disk(ios, cnt);
+	disk.set_settings(&pack);
+
+	std::vector<replay_storage> storages;
+	std::vector<std::unique_ptr<file_storage>> retired;
+
+	histogram read_latency;
+	histogram write_latency;
+	histogram hash_latency;
+	std::int64_t bytes_read = 0;
+	std::int64_t bytes_written = 0;
+	std::int64_t bytes_hashed = 0;
+	std::int64_t cache_hits = 0;
+	std::int64_t errors = 0;
+	int outstanding = 0;
+
+	auto complete = [&](histogram& h, time_point const issued, storage_error const& se)
+	{
+		h.add(total_microseconds(clock_type::now() - issued));
+		if (se) ++errors;
+		--outstanding;
+	};
+
+	time_point const start = clock_type::now();
+	std::size_t next = 0;
+	while (next < trace.size() || outstanding > 0)
+	{
+		time_point const now = clock_type::now();
+		while (next < trace.size() && outstanding < max_outstanding)
+		{
+			request const& r = trace[next];
+			if (!fast && start + microseconds(r.time) > now) break;
+			++next;
+
+			if (r.op == 'S')
+			{
+				if (std::size_t(r.storage) >= storages.size())
+					storages.resize(std::size_t(r.storage) + 1);
+				replay_storage& rs = storages[std::size_t(r.storage)];
+				rs.holder.reset();
+				// jobs still in flight may refer to the old file_storage
+				if (rs.files) retired.push_back(std::move(rs.files));
+
+				// recreate the storage as a single sparse file of the same size
+				std::string const name = "storage-" + std::to_string(r.storage);
+				rs.files.reset(new file_storage);
+				rs.files->add_file(name, r.total_size);
+				rs.files->set_piece_length(r.size);
+				rs.files->set_num_pieces(r.piece);
+				{
+					std::fstream f(combine_path(save_path, name).c_str()
+						, std::ios::out | std::ios::binary | std::ios::app);
+					f.close();
+					f.open(combine_path(save_path, name).c_str()
+						, std::ios::in | std::ios::out | std::ios::binary);
+					if (r.total_size > 0)
+					{
+						f.seekp(r.total_size - 1);
+						f.put(0);
+					}
+				}
+
+				storage_params p;
+				p.files = rs.files.get();
+				p.path = save_path;
+				p.mode = storage_mode_sparse;
+				rs.holder = disk.new_torrent(default_storage_constructor, std::move(p)
+					, std::shared_ptr<void>());
+				continue;
+			}
+
+			if (std::size_t(r.storage) >= storages.size()
+				|| !storages[std::size_t(r.storage)].holder
+				|| r.piece < 0
+				|| r.piece >= storages[std::size_t(r.storage)].files->num_pieces())
+			{
+				++errors;
+				continue;
+			}
+			storage_index_t const st = storages[std::size_t(r.storage)].holder;
+			time_point const issued = clock_type::now();
+
+			switch (r.op)
+			{
+				case 'R':
+				{
+					peer_request req;
+					req.piece = piece_index_t(r.piece);
+					req.start = r.offset;
+					req.length = r.size;
+					++outstanding;
+					bytes_read += r.size;
+					disk.async_read(st, req, [&, issued](disk_buffer_holder
+						, std::uint32_t const flags, storage_error const& se)
+					{
+						if (flags & disk_interface::cache_hit) ++cache_hits;
+						complete(read_latency, issued, se);
+					}, nullptr);
+					break;
+				}
+				case 'W':
+				{
+					bool exceeded = false;
+					disk_buffer_holder buf = disk.allocate_disk_buffer(exceeded
+						, std::shared_ptr<disk_observer>(), "replay");
+					if (!buf)
+					{
+						++errors;
+						break;
+					}
+					std::memset(buf.get(), r.piece & 0xff, std::size_t(r.size));
+					peer_request req;
+					req.piece = piece_index_t(r.piece);
+					req.start = r.offset;
+					req.length = r.size;
+					++outstanding;
+					bytes_written += r.size;
+					disk.async_write(st, req, std::move(buf)
+						, [&, issued](storage_error const& se)
+					{ complete(write_latency, issued, se); });
+					break;
+				}
+				case 'H':
+					++outstanding;
+					bytes_hashed += r.size;
+					disk.async_hash(st, piece_index_t(r.piece), 0
+						, [&, issued](piece_index_t, sha1_hash const&, storage_error const& se)
+					{ complete(hash_latency, issued, se); }, nullptr);
+					break;
+				case 'C':
+					++outstanding;
+					disk.async_clear_piece(st, piece_index_t(r.piece)
+						, [&](piece_index_t) { --outstanding; });
+					break;
+				default:
+					++errors;
+					break;
+			}
+		}
+		disk.submit_jobs();
+
+		ios.reset();
+		if (ios.poll(ec) == 0)
+			std::this_thread::sleep_for(std::chrono::microseconds(100));
+	}
+
+	double const seconds = double(total_microseconds(clock_type::now() - start)) / 1000000.;
+
+	for (auto& s : storages) s.holder.reset();
+	disk.abort(true);
+	ios.reset();
+	ios.poll(ec);
+
+	std::printf("replayed %d requests in %.2f s (%s, %d max outstanding)\n"
+		, int(trace.size()), seconds, fast ? "as fast as possible" : "recorded timing"
+		, max_outstanding);
+	std::printf("read: %.1f MB/s write: %.1f MB/s hash: %.1f MB/s\n"
+		, double(bytes_read) / seconds / 1000000.
+		, double(bytes_written) / seconds / 1000000.
+		, double(bytes_hashed) / seconds / 1000000.);
+	if (read_latency.count > 0)
+	{
+		std::printf("read cache hit rate: %.1f %% (%" PRId64 " of %" PRId64 ")\n"
+			, double(cache_hits) * 100. / double(read_latency.count)
+			, cache_hits, read_latency.count);
+	}
+	if (errors > 0)
+		std::printf("failed or skipped requests: %" PRId64 "\n", errors);
+
+	read_latency.print("read");
+	write_latency.print("write");
+	hash_latency.print("hash");
+
+	return 0;
+}
+
@@ -29,31 +29,121 @@
 # POSSIBILITY OF SUCH DAMAGE.
 
 # this script can parse and generate reports from the alert log from a
-# libtorrent session
-
-import os, sys, time, os, math
+# libtorrent session, or from a file written by the stats recorder extension
+# (see create_stats_recorder_plugin()).
+#
+# usage: parse_session_stats.py <log-file | stats-recording> [max-samples]
+#
+# a stats recording may span a long time. At most max-samples (default
+# 20000) evenly spaced samples are rendered. When that's fewer than one
+# sample per complete snapshot in the file, only the snapshots are decoded
+
+import os, sys, time, os, math, struct
 from multiprocessing.pool import ThreadPool
 
 thread_pool = ThreadPool(8)
 
 output_dir = 'session_stats_report'
 
-stat = open(sys.argv[1])
-line = stat.readline()
-while not 'session stats header:' in line:
-	line = stat.readline()
-
-keys = line.split('session stats header:')[1].strip().split(', ')
+max_samples = 20000
+if len(sys.argv) > 2: max_samples = int(sys.argv[2])
+
+def read_varint(buf, pos):
+	ret = 0
+	shift = 0
+	while True:
+		c = ord(buf[pos])
+		pos += 1
+		ret |= (c & 0x7f) << shift
+		if (c & 0x80) == 0: return (ret, pos)
+		shift += 7
+
+def apply_delta(payload, values):
+	pos = 0
+	next = 0
+	while pos < len(payload):
+		gap, pos = read_varint(payload, pos)
+		zigzag, pos = read_varint(payload, pos)
+		i = next + gap
+		d = (zigzag >> 1) ^ -(zigzag & 1)
+		# counters are 64 bit signed integers, and wrap around
+		values[i] = ((values[i] + d + 2**63) % 2**64) - 2**63
+		next = i + 1
+
+# returns the metric names, in the order the columns are written to
+# data_out, or None if the file is not a stats recording
+def parse_recording(filename, data_out):
+	f = open(filename, 'rb')
+	if f.read(8) != 'ltstats\0': return None
+	version, start, num_values, num_metrics = struct.unpack('>IQII', f.read(20))
+	if version != 1:
+		print 'unsupported stats recording version: %d' % version
+		sys.exit(1)
+
+	metrics = []
+	for i in range(num_metrics):
+		idx, kind, name_len = struct.unpack('>IBB', f.read(6))
+		metrics.append((idx, f.read(name_len)))
+	metrics.sort()
+
+	# first, index the records: (time, is-snapshot, payload offset, size)
+	records = []
+	data = f.read()
+	pos = 0
+	t = 0
+	while pos < len(data):
+		try:
+			kind = ord(data[pos])
+			ms, pos = read_varint(data, pos + 1)
+			size, pos = read_varint(data, pos)
+		except IndexError: break
+		if pos + size > len(data): break
+		t += ms
+		records.append((t, kind == 1, pos, size))
+		pos += size
+
+	num_snapshots = len([r for r in records if r[1]])
+	step = max(1, (len(records) + max_samples - 1) / max_samples)
+	only_snapshots = num_snapshots > 0 and num_snapshots <= max_samples \
+		and len(records) / num_snapshots <= step
+	if only_snapshots:
+		step = max(1, (num_snapshots + max_samples - 1) / max_samples)
+
+	print 'stats recording started at %s, %d samples' % \
+		(time.ctime(start / 1000000), len(records))
+
+	values = [0] * num_values
+	emitted = 0
+	for t, snapshot, pos, size in records:
+		if only_snapshots and not snapshot: continue
+		if snapshot: values = [0] * num_values
+		apply_delta(data[pos:pos+size], values)
+		emitted += 1
+		if (emitted - 1) % step != 0: continue
+		data_out.write(('%.3f\t' % (t / 1000.)) \
+			+ '\t'.join([str(values[i]) for i, name in metrics]) + '\n')
+
+	return [name for i, name in metrics]
 
 try: os.mkdir(output_dir)
 except: pass
 data_out = open(os.path.join(output_dir, 'counters.dat'), 'w+')
 
-idx = 0
-for l in stat:
-	if not 'session stats (' in l: continue
-	data_out.write(("%d\t" % idx) + l.split(' values): ')[1].strip().replace(', ', '\t') + '\n')
-	idx += 1
+keys = parse_recording(sys.argv[1], data_out)
+
+if keys == None:
+	stat = open(sys.argv[1])
+	line = stat.readline()
+	while not 'session stats header:' in line:
+		line = stat.readline()
+
+	keys = line.split('session stats header:')[1].strip().split(', ')
+
+	idx = 0
+	for l in stat:
+		if not 'session stats (' in l: continue
+		data_out.write(("%d\t" % idx) + l.split(' values): ')[1].strip().replace(', ', '\t') + '\n')
+		idx += 1
 
 data_out.close()
 
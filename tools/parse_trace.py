@@ -0,0 +1,99 @@
+#!/usr/bin/env python
+
+# Copyright (c) 2017, Arvid Norberg
+# All rights reserved.
+# 
+# Redistribution and use in source and binary forms, with or without
+# modification, are permitted provided that the following conditions
+# are met:
+# 
+#     * Redistributions of source code must retain the above copyright
+#       notice, this list of conditions and the following disclaimer.
+#     * Redistributions in binary form must reproduce the above copyright
+#       notice, this list of conditions and the following disclaimer in
+#       the documentation and/or other materials provided with the distribution.
+#     * Neither the name of the author nor the names of its
+#       contributors may be used to endorse or promote products derived
+#       from this software without specific prior written permission.
+# 
+# THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+# AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+# IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+# ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+# LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+# CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+# SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+# INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+# CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+# ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+# POSSIBILITY OF SUCH DAMAGE.
+
+# this script converts a trace file, as written by libtorrent's save_trace(),
+# into the chrome trace event format. The output can be loaded in
+# chrome://tracing or https://ui.perfetto.dev
+#
+# usage: parse_trace.py <trace-file> [<output.json>]
+
+from __future__ import print_function
+
+import json
+import struct
+import sys
+
+# these must match aux::trace_event in include/libtorrent/aux_/trace.hpp
+events = ['disk_job_start', 'disk_job_end', 'peer_request', 'peer_receive',
+	'piece_pick', 'utp_send', 'utp_resend', 'utp_receive']
+
+# these must match disk_io_job::action_t in include/libtorrent/disk_io_job.hpp
+disk_jobs = ['read', 'write', 'hash', 'move_storage', 'release_files',
+	'delete_files', 'check_fastresume', 'rename_file', 'stop_torrent',
+	'flush_piece', 'flush_hashed', 'flush_storage', 'trim_cache',
+	'file_priority', 'clear_piece', 'resolve_links']
+
+arguments = {
+	'peer_request': ('piece', 'start'),
+	'peer_receive': ('piece', 'start'),
+	'piece_pick': ('blocks', 'flags'),
+	'utp_send': ('seq_nr', 'size'),
+	'utp_resend': ('seq_nr', 'size'),
+	'utp_receive': ('seq_nr', 'size'),
+}
+
+record = struct.Struct('>qIB3xQQ')
+
+def convert(data):
+	if data[0:7] != b'lttrace' or bytearray(data[7:8])[0] != 1:
+		raise ValueError('not a libtorrent trace file (version 1)')
+
+	out = []
+	for offset in range(8, len(data) - record.size + 1, record.size):
+		time, thread, event, arg0, arg1 = record.unpack_from(data, offset)
+		name = events[event] if event < len(events) else 'event%d' % event
+		e = {'pid': 0, 'tid': thread, 'ts': time / 1000.0}
+		if name in ('disk_job_start', 'disk_job_end'):
+			e['name'] = disk_jobs[arg0] if arg0 < len(disk_jobs) else 'job%d' % arg0
+			e['cat'] = 'disk'
+			e['ph'] = 'B' if name == 'disk_job_start' else 'E'
+			e['args'] = {'piece': arg1}
+		else:
+			e['name'] = name
+			e['cat'] = name.split('_')[0]
+			e['ph'] = 'i'
+			e['s'] = 't'
+			keys = arguments.get(name, ('arg0', 'arg1'))
+			e['args'] = {keys[0]: arg0, keys[1]: arg1}
+		out.append(e)
+	return {'traceEvents': out, 'displayTimeUnit': 'ms'}
+
+if len(sys.argv) < 2:
+	print('usage: %s <trace-file> [<output.json>]' % sys.argv[0])
+	sys.exit(1)
+
+with open(sys.argv[1], 'rb') as f:
+	trace = convert(f.read())
+
+if len(sys.argv) > 2:
+	with open(sys.argv[2], 'w') as f:
+		json.dump(trace, f)
+else:
+	json.dump(trace, sys.stdout)
@@ -0,0 +1,644 @@
+/*
+
+Copyright (c) 2017, Arvid Norberg
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions
+are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in
+      the documentation and/or other materials provided with the distribution.
+    * Neither the name of the author nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+// drives piece_picker with a trace of peers joining and leaving a swarm and
+// announcing pieces, and measures the cost of picking blocks under realistic
+// availability. The local peer downloads from every peer in the trace. Each
+// peer has a queue of outstanding requests, refilled by picking blocks when
+// it connects, when it announces a piece and whenever one of its requests
+// completes. After every trace event, one request completes, taking turns
+// among the connected peers. When the download completes, it starts over.
+//
+// The trace is a text file, one event per line:
+//
+//   pieces <num-pieces> <blocks-per-piece>   (must be the first line)
+//   connect <peer> seed | - | <bitfield>     (bitfield is hex, as sent on the wire)
+//   have <peer> <piece>
+//   disconnect <peer>
+//
+// lines starting with # are ignored. Peers are identified by any integer.
+// Without a trace file, a synthetic one is generated (and can be saved with
+// -g). It models a swarm with piece popularity varying by an order of
+// magnitude, 10% seeds and constant churn.
+//
+// The trace is replayed once for each combination of picker options. Each
+// prints one line of JSON, in the same format as component_benchmark, with
+// pick latency percentiles, the number of rebuilds of the piece list (see
+// counters::piece_picker_rebuilds), the number of piece list entries visited
+// per pick and the number of partial pieces.
+//
+// usage: piece_picker_benchmark [options] [trace-file]
+//   -g <file>   write the synthetic trace to <file> and exit
+//   -p <n>      number of pieces in the synthetic trace (default 4000)
+//   -b <n>      blocks per piece in the synthetic trace (default 16)
+//   -n <n>      number of peers in the synthetic swarm (default 60)
+//   -e <n>      number of events in the synthetic trace (default 300000)
+//   -s <n>      random seed for the synthetic trace (default 1)
+//   -q <n>      number of outstanding requests per peer (default 16)
+//   -f <name>   only run the configurations whose name contains <name>
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <map>
+#include <chrono>
+#include <random>
+#include <memory>
+#include <algorithm>
+#include <cinttypes> // for PRId64 et.al.
+
+#include "libtorrent/piece_picker.hpp"
+#include "libtorrent/torrent_peer.hpp"
+#include "libtorrent/bitfield.hpp"
+#include "libtorrent/performance_counters.hpp"
+#include "libtorrent/hex.hpp"
+#include "libtorrent/socket.hpp"
+
+using namespace libtorrent;
+
+namespace {
+
+	enum class event_t : std::uint8_t { connect, have, disconnect };
+
+	struct trace_event
+	{
+		event_t type;
+		bool seed;
+		int peer;
+		piece_index_t piece;
+		// for connect events, the pieces the peer has
+		typed_bitfield<piece_index_t> bits;
+	};
+
+	struct trace
+	{
+		int num_pieces = 0;
+		int blocks_per_piece = 0;
+		std::vector<trace_event> events;
+	};
+
+	bool load_trace(char const* filename, trace& t)
+	{
+		FILE* f = std::fopen(filename, "r");
+		if (f == nullptr)
+		{
+			std::fprintf(stderr, "failed to open \"%s\": %s\n", filename, std::strerror(errno));
+			return false;
+		}
+
+		static char line[65536];
+		int line_no = 0;
+		bool ok = true;
+		while (ok && std::fgets(line, sizeof(line), f))
+		{
+			++line_no;
+			if (line[0] == '#' || line[0] == '\n') continue;
+
+			if (t.num_pieces == 0)
+			{
+				ok = std::sscanf(line, "pieces %d %d", &t.num_pieces, &t.blocks_per_piece) == 2
+					&& t.num_pieces > 0 && t.blocks_per_piece > 0;
+				continue;
+			}
+
+			char cmd[20];
+			int peer = 0;
+			int n = 0;
+			int piece = 0;
+			static char arg[sizeof(line)];
+			trace_event e;
+			e.seed = false;
+			if (std::sscanf(line, "%19s %d %n", cmd, &peer, &n) < 2)
+			{
+				ok = false;
+			}
+			else if (std::strcmp(cmd, "connect") == 0
+				&& std::sscanf(line + n, "%65535s", arg) == 1)
+			{
+				e.type = event_t::connect;
+				e.bits.resize(t.num_pieces, false);
+				if (std::strcmp(arg, "seed") == 0)
+				{
+					e.seed = true;
+					e.bits.set_all();
+				}
+				else if (std::strcmp(arg, "-") != 0)
+				{
+					int const bytes = (t.num_pieces + 7) / 8;
+					std::vector<char> buf(std::size_t(bytes), 0);
+					ok = int(std::strlen(arg)) == bytes * 2
+						&& aux::from_hex({arg, std::size_t(bytes * 2)}, buf.data());
+					e.bits.assign(buf.data(), t.num_pieces);
+				}
+			}
+			else if (std::strcmp(cmd, "have") == 0
+				&& std::sscanf(line + n, "%d", &piece) == 1
+				&& piece >= 0 && piece < t.num_pieces)
+			{
+				e.type = event_t::have;
+				e.piece = piece_index_t(piece);
+			}
+			else if (std::strcmp(cmd, "disconnect") == 0)
+			{
+				e.type = event_t::disconnect;
+			}
+			else
+			{
+				ok = false;
+			}
+			if (!ok) break;
+			e.peer = peer;
+			t.events.push_back(std::move(e));
+		}
+		std::fclose(f);
+
+		if (!ok || t.num_pieces == 0)
+		{
+			std::fprintf(stderr, "%s:%d: invalid trace event\n", filename, line_no);
+			return false;
+		}
+		return true;
+	}
+
+	struct synthetic_params
+	{
+		int num_pieces = 4000;
+		int blocks_per_piece = 16;
+		int num_peers = 60;
+		int num_events = 300000;
+		std::uint32_t seed = 1;
+	};
+
+	trace generate_trace(synthetic_params const& sp)
+	{
+		std::mt19937 rng(sp.seed);
+		std::uniform_real_distribution<double> uniform(0.0, 1.0);
+
+		trace t;
+		t.num_pieces = sp.num_pieces;
+		t.blocks_per_piece = sp.blocks_per_piece;
+
+		// how likely each piece is to be held by a peer, relative to the
+		// others. Spans an order of magnitude
+		std::vector<double> popularity(std::size_t(sp.num_pieces));
+		for (auto& p : popularity) p = 0.2 + 1.8 * uniform(rng) * uniform(rng);
+
+		struct swarm_peer
+		{
+			int id;
+			typed_bitfield<piece_index_t> bits;
+		};
+		std::vector<swarm_peer> swarm;
+		int next_id = 0;
+
+		auto connect = [&]()
+		{
+			trace_event e;
+			e.type = event_t::connect;
+			e.peer = next_id++;
+			e.seed = uniform(rng) < 0.1;
+			e.bits.resize(sp.num_pieces, e.seed);
+			if (!e.seed)
+			{
+				double const progress = uniform(rng);
+				for (piece_index_t i(0); i < e.bits.end_index(); ++i)
+				{
+					if (uniform(rng) < progress * popularity[std::size_t(static_cast<int>(i))])
+						e.bits.set_bit(i);
+				}
+			}
+			swarm.push_back({e.peer, e.bits});
+			t.events.push_back(std::move(e));
+		};
+
+		while (int(swarm.size()) < sp.num_peers) connect();
+
+		while (int(t.events.size()) < sp.num_events)
+		{
+			double const r = uniform(rng);
+			if (r < 0.01 && !swarm.empty())
+			{
+				// a peer leaves, and another one joins
+				std::size_t const idx = std::size_t(rng() % swarm.size());
+				trace_event e;
+				e.type = event_t::disconnect;
+				e.seed = false;
+				e.peer = swarm[idx].id;
+				t.events.push_back(std::move(e));
+				swarm.erase(swarm.begin() + std::ptrdiff_t(idx));
+				connect();
+				continue;
+			}
+
+			if (swarm.empty()) { connect(); continue; }
+
+			// a peer completes a piece. Pick one it doesn't have, biased
+			// towards popular pieces
+			swarm_peer& p = swarm[rng() % swarm.size()];
+			if (p.bits.all_set()) continue;
+			piece_index_t piece(0);
+			for (int attempt = 0; attempt < 20; ++attempt)
+			{
+				piece = piece_index_t(int(rng() % std::uint32_t(sp.num_pieces)));
+				if (p.bits.get_bit(piece)) continue;
+				if (uniform(rng) * 2.0 < popularity[std::size_t(static_cast<int>(piece))]) break;
+			}
+			if (p.bits.get_bit(piece)) continue;
+			p.bits.set_bit(piece);
+
+			trace_event e;
+			e.type = event_t::have;
+			e.seed = false;
+			e.peer = p.id;
+			e.piece = piece;
+			t.events.push_back(std::move(e));
+		}
+		return t;
+	}
+
+	bool save_trace(char const* filename, trace const& t)
+	{
+		FILE* f = std::fopen(filename, "w+");
+		if (f == nullptr)
+		{
+			std::fprintf(stderr, "failed to open \"%s\": %s\n", filename, std::strerror(errno));
+			return false;
+		}
+		std::fprintf(f, "pieces %d %d\n", t.num_pieces, t.blocks_per_piece);
+		for (auto const& e : t.events)
+		{
+			switch (e.type)
+			{
+				case event_t::connect:
+					if (e.seed)
+						std::fprintf(f, "connect %d seed\n", e.peer);
+					else if (e.bits.none_set())
+						std::fprintf(f, "connect %d -\n", e.peer);
+					else
+						std::fprintf(f, "connect %d %s\n", e.peer, aux::to_hex(
+							{e.bits.data(), std::size_t((e.bits.size() + 7) / 8)}).c_str());
+					break;
+				case event_t::have:
+					std::fprintf(f, "have %d %d\n", e.peer, static_cast<int>(e.piece));
+					break;
+				case event_t::disconnect:
+					std::fprintf(f, "disconnect %d\n", e.peer);
+					break;
+			}
+		}
+		std::fclose(f);
+		return true;
+	}
+
+	struct config
+	{
+		char const* name;
+		int options;
+		int prefer_contiguous_blocks;
+	};
+
+	struct sim_peer
+	{
+		explicit sim_peer(int const id)
+			: info(tcp::endpoint(address_v4(std::uint32_t(id) + 0x0a000000), 6881), true, 0)
+		{
+#if TORRENT_USE_ASSERTS
+			info.in_use = true;
+#endif
+		}
+
+		ipv4_peer info;
+		bool seed = false;
+		typed_bitfield<piece_index_t> bits;
+		std::vector<piece_block> queue;
+	};
+
+	using clock_type = std::chrono::steady_clock;
+
+	struct replay
+	{
+		replay(trace const& tr, config const& cfg, int const queue_depth)
+			: m_trace(tr), m_cfg(cfg), m_queue_depth(queue_depth)
+		{
+			reset_picker();
+		}
+
+		void run()
+		{
+			for (auto const& e : m_trace.events)
+			{
+				switch (e.type)
+				{
+					case event_t::connect: on_connect(e); break;
+					case event_t::have: on_have(e); break;
+					case event_t::disconnect: disconnect(e.peer); break;
+				}
+				complete_request();
+			}
+		}
+
+		void report() const
+		{
+			std::vector<std::int64_t> lat = m_latency;
+			std::sort(lat.begin(), lat.end());
+			auto pct = [&lat](double const p) -> std::int64_t
+			{
+				if (lat.empty()) return 0;
+				return lat[std::min(lat.size() - 1, std::size_t(double(lat.size()) * p))];
+			};
+
+			std::int64_t total_ns = 0;
+			for (auto const l : lat) total_ns += l;
+			std::int64_t loops = 0;
+			for (int c = counters::piece_picker_partial_loops;
+				c <= counters::piece_picker_busy_loops; ++c)
+				loops += m_counters[c];
+
+			double const picks = std::max(double(lat.size()), 1.0);
+			std::printf("{\"benchmark\": \"piece_picker\", \"params\": \"%s\""
+				", \"iterations\": %d, \"ns_per_op\": %.1f, \"ops_per_second\": %.0f"
+				", \"p50_ns\": %" PRId64 ", \"p99_ns\": %" PRId64 ", \"max_ns\": %" PRId64
+				", \"rebuilds\": %" PRId64 ", \"loops_per_pick\": %.1f"
+				", \"avg_partials\": %.1f, \"max_partials\": %d"
+				", \"downloads_completed\": %d}\n"
+				, m_cfg.name, int(lat.size()), double(total_ns) / picks
+				, total_ns > 0 ? double(lat.size()) * 1000000000.0 / double(total_ns) : 0.0
+				, pct(0.5), pct(0.99), pct(1.0)
+				, m_counters[counters::piece_picker_rebuilds], double(loops) / picks
+				, double(m_partials_sum) / picks, m_max_partials, m_completed);
+			std::fflush(stdout);
+		}
+
+	private:
+
+		void reset_picker()
+		{
+			m_picker.reset(new piece_picker);
+			m_picker->init(m_trace.blocks_per_piece, m_trace.blocks_per_piece
+				, m_trace.num_pieces);
+			for (auto& p : m_peers)
+			{
+				p.second->queue.clear();
+				if (p.second->seed) m_picker->inc_refcount_all(&p.second->info);
+				else m_picker->inc_refcount(p.second->bits, &p.second->info);
+			}
+		}
+
+		void on_connect(trace_event const& e)
+		{
+			if (m_peers.count(e.peer)) disconnect(e.peer);
+			std::unique_ptr<sim_peer>& p = m_peers[e.peer];
+			p.reset(new sim_peer(e.peer));
+			p->seed = e.seed;
+			p->bits = e.bits;
+			if (p->seed) m_picker->inc_refcount_all(&p->info);
+			else m_picker->inc_refcount(p->bits, &p->info);
+			request_blocks(*p);
+		}
+
+		void on_have(trace_event const& e)
+		{
+			auto const i = m_peers.find(e.peer);
+			if (i == m_peers.end()) return;
+			sim_peer& p = *i->second;
+			if (p.seed || p.bits.get_bit(e.piece)) return;
+			p.bits.set_bit(e.piece);
+			m_picker->inc_refcount(e.piece, &p.info);
+			request_blocks(p);
+		}
+
+		void disconnect(int const id)
+		{
+			auto const i = m_peers.find(id);
+			if (i == m_peers.end()) return;
+			sim_peer& p = *i->second;
+			for (auto const& b : p.queue) m_picker->abort_download(b, &p.info);
+			if (p.seed) m_picker->dec_refcount_all(&p.info);
+			else m_picker->dec_refcount(p.bits, &p.info);
+			m_picker->clear_peer(&p.info);
+			m_peers.erase(i);
+		}
+
+		// completes the oldest request of the next peer with outstanding
+		// requests, and refills its queue
+		void complete_request()
+		{
+			if (m_peers.empty()) return;
+			auto i = m_peers.upper_bound(m_cursor);
+			for (std::size_t n = 0; n < m_peers.size(); ++n, ++i)
+			{
+				if (i == m_peers.end()) i = m_peers.begin();
+				if (!i->second->queue.empty()) break;
+			}
+			if (i == m_peers.end()) i = m_peers.begin();
+			m_cursor = i->first;
+			sim_peer& p = *i->second;
+			if (p.queue.empty()) return;
+
+			piece_block const b = p.queue.front();
+			p.queue.erase(p.queue.begin());
+			if (m_picker->mark_as_writing(b, &p.info))
+			{
+				m_picker->mark_as_finished(b, &p.info);
+				if (m_picker->is_piece_finished(b.piece_index))
+				{
+					m_picker->piece_passed(b.piece_index);
+					m_picker->we_have(b.piece_index);
+				}
+			}
+
+			if (m_picker->is_seeding())
+			{
+				++m_completed;
+				reset_picker();
+				for (auto& peer : m_peers) request_blocks(*peer.second);
+				return;
+			}
+			request_blocks(p);
+		}
+
+		void request_blocks(sim_peer& p)
+		{
+			int const want = m_queue_depth - int(p.queue.size());
+			if (want <= 0) return;
+
+			m_picked.clear();
+			auto const start = clock_type::now();
+			m_picker->pick_pieces(p.bits, m_picked, want
+				, m_cfg.prefer_contiguous_blocks, &p.info, m_cfg.options
+				, m_suggested, int(m_peers.size()), m_counters);
+			auto const end = clock_type::now();
+			m_latency.push_back(std::chrono::duration_cast<std::chrono::nanoseconds>(
+				end - start).count());
+
+			// like peer_connection::request_a_block(), only request blocks
+			// that no other peer has been asked for, unless we're in end-game
+			// and there's nothing else to request
+			piece_block busy = piece_block::invalid;
+			for (auto const& b : m_picked)
+			{
+				if (int(p.queue.size()) >= m_queue_depth) break;
+				if (m_picker->is_requested(b))
+				{
+					if (busy == piece_block::invalid
+						&& m_picker->num_peers(b) > 0
+						&& std::find(p.queue.begin(), p.queue.end(), b) == p.queue.end())
+						busy = b;
+					continue;
+				}
+				if (m_picker->mark_as_downloading(b, &p.info, m_cfg.options))
+					p.queue.push_back(b);
+			}
+			if (p.queue.empty() && busy != piece_block::invalid
+				&& m_picker->mark_as_downloading(busy, &p.info, m_cfg.options))
+				p.queue.push_back(busy);
+
+			int partial = 0;
+			int full = 0;
+			int finished = 0;
+			int zero_prio = 0;
+			m_picker->get_download_queue_sizes(&partial, &full, &finished, &zero_prio);
+			m_partials_sum += partial;
+			m_max_partials = std::max(m_max_partials, partial);
+		}
+
+		trace const& m_trace;
+		config const m_cfg;
+		int const m_queue_depth;
+
+		std::unique_ptr<piece_picker> m_picker;
+		std::map<int, std::unique_ptr<sim_peer>> m_peers;
+
+		// the peer that completed the last request
+		int m_cursor = -1;
+
+		counters m_counters;
+		std::vector<piece_block> m_picked;
+		std::vector<piece_index_t> const m_suggested;
+
+		std::vector<std::int64_t> m_latency;
+		std::int64_t m_partials_sum = 0;
+		int m_max_partials = 0;
+		int m_completed = 0;
+	};
+
+	void print_usage()
+	{
+		std::fprintf(stderr, "usage: piece_picker_benchmark [options] [trace-file]\n"
+			"   -g <file>   write the synthetic trace to <file> and exit\n"
+			"   -p <n>      number of pieces in the synthetic trace\n"
+			"   -b <n>      blocks per piece in the synthetic trace\n"
+			"   -n <n>      number of peers in the synthetic swarm\n"
+			"   -e <n>      number of events in the synthetic trace\n"
+			"   -s <n>      random seed for the synthetic trace\n"
+			"   -q <n>      number of outstanding requests per peer\n"
+			"   -f <name>   only run configurations whose name contains <name>\n");
+	}
+
+} // anonymous namespace
+
+int main(int argc, char* argv[])
+{
+	synthetic_params sp;
+	char const* save_to = nullptr;
+	char const* filter = nullptr;
+	char const* trace_file = nullptr;
+	int queue_depth = 16;
+
+	for (int i = 1; i < argc; ++i)
+	{
+		char const* arg = argv[i];
+		if (arg[0] != '-')
+		{
+			trace_file = arg;
+			continue;
+		}
+		if (i + 1 >= argc || arg[1] == 0 || arg[2] != 0)
+		{
+			print_usage();
+			return 1;
+		}
+		char const* value = argv[++i];
+		switch (arg[1])
+		{
+			case 'g': save_to = value; break;
+			case 'p': sp.num_pieces = std::max(1, std::atoi(value)); break;
+			case 'b': sp.blocks_per_piece = std::max(1, std::atoi(value)); break;
+			case 'n': sp.num_peers = std::max(1, std::atoi(value)); break;
+			case 'e': sp.num_events = std::max(1, std::atoi(value)); break;
+			case 's': sp.seed = std::uint32_t(std::atoi(value)); break;
+			case 'q': queue_depth = std::max(1, std::atoi(value)); break;
+			case 'f': filter = value; break;
+			default:
+				print_usage();
+				return 1;
+		}
+	}
+
+	trace t;
+	if (trace_file != nullptr)
+	{
+		if (!load_trace(trace_file, t)) return 1;
+	}
+	else
+	{
+		t = generate_trace(sp);
+	}
+
+	if (save_to != nullptr) return save_trace(save_to, t) ? 0 : 1;
+
+	std::fprintf(stderr, "%d pieces, %d blocks per piece, %d events\n"
+		, t.num_pieces, t.blocks_per_piece, int(t.events.size()));
+
+	config const configs[] = {
+		{"rarest_first", piece_picker::rarest_first, 1},
+		{"rarest_first+prioritize_partials"
+			, piece_picker::rarest_first | piece_picker::prioritize_partials, 1},
+		{"rarest_first+contiguous"
+			, piece_picker::rarest_first | piece_picker::align_expanded_pieces, 4},
+		{"reverse_rarest_first", piece_picker::rarest_first | piece_picker::reverse, 1},
+		{"sequential", piece_picker::sequential, 1},
+		{"random", 0, 1},
+	};
+
+	for (auto const& cfg : configs)
+	{
+		if (filter != nullptr && std::strstr(cfg.name, filter) == nullptr) continue;
+		replay r(t, cfg, queue_depth);
+		r.run();
+		r.report();
+	}
+
+	return 0;
+}
@@ -0,0 +1,457 @@
+/*
+
+Copyright (c) 2017, Arvid Norberg
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions
+are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in
+      the documentation and/or other materials provided with the distribution.
+    * Neither the name of the author nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+// measures how long it takes for a session to start seeding a large number
+// of torrents. A synthetic session (the files, .torrent files and resume
+// data of N torrents) is generated in the directory given by -d, unless one
+// with the same parameters is already there. Then each phase of starting up
+// is timed:
+//
+//   parse_torrents    loading and parsing the .torrent files (torrent_info)
+//   read_resume_data  loading and parsing the resume files
+//   add_torrents      from adding the torrents until every add_torrent_alert
+//                     has been posted
+//   check             from adding the torrents until all of them are seeding,
+//                     i.e. the resume data has been checked against the files
+//   announce          from adding the torrents until all of them have sent
+//                     their first tracker announce, to a local port nothing
+//                     listens on
+//   time_to_seeding   from starting to parse until all torrents are seeding
+//   shutdown          destructing the session
+//
+// Each phase prints one line of JSON, in the same format as
+// component_benchmark (so compare_benchmarks.py can compare runs).
+//
+// usage: startup_benchmark [options]
+//   -n <num>        number of torrents (default 1000)
+//   -f <num>        number of files per torrent (default 1)
+//   -z <kiB>        size of each torrent (default 64)
+//   -p <kiB>        piece size (default 16)
+//   -d <path>       directory of the synthetic session (default startup_benchmark)
+//   -j <num>        parse torrents and resume data on this many threads (default 1)
+//   -i              add torrents one at a time, rather than as one batch
+//   -r              don't use resume data, forcing a full hash check
+//   -s name=value   override a setting (may be specified multiple times)
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cinttypes> // for PRId64 et.al.
+#include <string>
+#include <vector>
+#include <memory>
+#include <fstream>
+#include <thread>
+#include <chrono>
+#include <random>
+#include <atomic>
+#include <unordered_set>
+#include <algorithm>
+
+#include "libtorrent/session.hpp"
+#include "libtorrent/settings_pack.hpp"
+#include "libtorrent/alert_types.hpp"
+#include "libtorrent/torrent_info.hpp"
+#include "libtorrent/create_torrent.hpp"
+#include "libtorrent/file_storage.hpp"
+#include "libtorrent/read_resume_data.hpp"
+#include "libtorrent/write_resume_data.hpp"
+#include "libtorrent/add_torrent_params.hpp"
+#include "libtorrent/bencode.hpp"
+#include "libtorrent/error_code.hpp"
+#include "libtorrent/aux_/path.hpp"
+#include "libtorrent/time.hpp"
+
+using namespace libtorrent;
+namespace lt = libtorrent;
+
+namespace {
+
+	// announces go to this port on localhost. The connection is refused,
+	// but the announce is counted as soon as it's sent
+	char const* const tracker_url = "http://127.0.0.1:1/announce";
+
+	struct params
+	{
+		int num_torrents = 1000;
+		int num_files = 1;
+		int torrent_size = 64 * 1024;
+		int piece_size = 16 * 1024;
+		std::string dir = "startup_benchmark";
+	};
+
+	void print_usage()
+	{
+		std::fprintf(stderr, "usage: startup_benchmark [options]\n\n"
+			"measures the time it takes a session to start seeding a\n"
+			"large number of torrents.\n\n"
+			"options:\n"
+			"  -n <num>        number of torrents (default 1000)\n"
+			"  -f <num>        number of files per torrent (default 1)\n"
+			"  -z <kiB>        size of each torrent (default 64)\n"
+			"  -p <kiB>        piece size (default 16)\n"
+			"  -d <path>       directory of the synthetic session\n"
+			"                  (defaults to startup_benchmark)\n"
+			"  -j <num>        parse torrents and resume data on this many\n"
+			"                  threads (default 1)\n"
+			"  -i              add torrents one at a time, rather than as one\n"
+			"                  batch\n"
+			"  -r              don't use resume data, forcing a full hash check\n"
+			"  -s name=value   override a setting (may be specified multiple\n"
+			"                  times)\n");
+		std::exit(1);
+	}
+
+	std::string torrent_path(params const& p, int const i)
+	{
+		return combine_path(combine_path(p.dir, "torrents"), std::to_string(i) + ".torrent");
+	}
+
+	std::string resume_path(params const& p, int const i)
+	{
+		return combine_path(combine_path(p.dir, "resume"), std::to_string(i) + ".resume");
+	}
+
+	std::string data_path(params const& p)
+	{
+		return combine_path(p.dir, "data");
+	}
+
+	bool load_file(std::string const& filename, std::vector<char>& buf)
+	{
+		std::ifstream in(filename, std::ios::binary);
+		if (!in) return false;
+		buf.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+		return true;
+	}
+
+	bool save_file(std::string const& filename, std::vector<char> const& buf)
+	{
+		std::ofstream out(filename, std::ios::binary | std::ios::trunc);
+		out.write(buf.data(), std::streamsize(buf.size()));
+		return bool(out);
+	}
+
+	std::string params_string(params const& p)
+	{
+		return std::to_string(p.num_torrents) + " " + std::to_string(p.num_files)
+			+ " " + std::to_string(p.torrent_size) + " " + std::to_string(p.piece_size) + "\n";
+	}
+
+	// generates the files, .torrent files and resume data of the synthetic
+	// session, unless the directory already holds one with the same parameters
+	bool generate(params const& p)
+	{
+		std::string const marker = combine_path(p.dir, "params");
+		std::string const expected = params_string(p);
+		std::vector<char> existing;
+		if (load_file(marker, existing)
+			&& std::string(existing.begin(), existing.end()) == expected)
+			return true;
+
+		std::fprintf(stderr, "generating %d torrents in \"%s\"\n", p.num_torrents, p.dir.c_str());
+		error_code ec;
+		remove_all(p.dir, ec);
+		for (char const* sub : {"", "torrents", "resume", "data"})
+		{
+			create_directory(combine_path(p.dir, sub), ec);
+			if (ec)
+			{
+				std::fprintf(stderr, "failed to create directory: %s\n", ec.message().c_str());
+				return false;
+			}
+		}
+
+		std::mt19937 rng(1);
+		std::vector<char> buf;
+		int const file_size = std::max(1, p.torrent_size / p.num_files);
+		for (int i = 0; i < p.num_torrents; ++i)
+		{
+			std::string const name = "t" + std::to_string(i);
+			create_directory(combine_path(data_path(p), name), ec);
+
+			file_storage fs;
+			for (int f = 0; f < p.num_files; ++f)
+			{
+				std::string const file = combine_path(name, "f" + std::to_string(f));
+				buf.resize(std::size_t(file_size));
+				for (auto& c : buf) c = char(rng());
+				if (!save_file(combine_path(data_path(p), file), buf))
+				{
+					std::fprintf(stderr, "failed to write \"%s\"\n", file.c_str());
+					return false;
+				}
+				fs.add_file(file, file_size);
+			}
+
+			create_torrent ct(fs, p.piece_size);
+			ct.add_tracker(tracker_url);
+			set_piece_hashes(ct, data_path(p), ec);
+			if (ec)
+			{
+				std::fprintf(stderr, "failed to hash \"%s\": %s\n", name.c_str(), ec.message().c_str());
+				return false;
+			}
+			buf.clear();
+			bencode(std::back_inserter(buf), ct.generate());
+			if (!save_file(torrent_path(p, i), buf)) return false;
+
+			// the resume data marks every piece as downloaded, but doesn't
+			// embed the metadata. It's loaded from the .torrent file
+			torrent_info const ti(buf.data(), int(buf.size()), ec);
+			add_torrent_params atp;
+			atp.info_hash = ti.info_hash();
+			atp.save_path = data_path(p);
+			atp.have_pieces.resize(ti.num_pieces(), true);
+			atp.trackers.push_back(tracker_url);
+			if (!save_file(resume_path(p, i), write_resume_data_buf(atp))) return false;
+		}
+
+		std::vector<char> const marker_buf(expected.begin(), expected.end());
+		return save_file(marker, marker_buf);
+	}
+
+	void report(char const* phase, int const n, time_duration const d)
+	{
+		double const ns = double(std::chrono::duration_cast<std::chrono::nanoseconds>(d).count());
+		std::printf("{\"benchmark\": \"startup\", \"params\": \"%s\""
+			", \"iterations\": %d, \"ns_per_op\": %.1f, \"ops_per_second\": %.0f"
+			", \"total_ms\": %.1f}\n"
+			, phase, n, ns / std::max(n, 1), ns > 0 ? n * 1000000000.0 / ns : 0.0
+			, ns / 1000000.0);
+		std::fflush(stdout);
+	}
+
+	// runs fun(i) for every i in [0, n), spread over num_threads threads
+	template <typename Fun>
+	void parallel_for(int const n, int const num_threads, Fun fun)
+	{
+		std::atomic<int> next(0);
+		auto worker = [&]()
+		{
+			for (int i = next++; i < n; i = next++) fun(i);
+		};
+		std::vector<std::thread> threads;
+		for (int t = 1; t < num_threads; ++t) threads.emplace_back(worker);
+		worker();
+		for (auto& t : threads) t.join();
+	}
+
+} // anonymous namespace
+
+int main(int argc, char* argv[])
+{
+	params p;
+	int num_threads = 1;
+	bool batch = true;
+	bool use_resume = true;
+
+	settings_pack pack;
+	pack.set_str(settings_pack::listen_interfaces, "127.0.0.1:0");
+	pack.set_bool(settings_pack::enable_dht, false);
+	pack.set_bool(settings_pack::enable_lsd, false);
+	pack.set_bool(settings_pack::enable_upnp, false);
+	pack.set_bool(settings_pack::enable_natpmp, false);
+	pack.set_int(settings_pack::alert_mask, alert::status_notification
+		| alert::tracker_notification | alert::error_notification);
+
+	for (int i = 1; i < argc; ++i)
+	{
+		char const* opt = argv[i];
+		if (std::strcmp(opt, "-i") == 0) { batch = false; continue; }
+		if (std::strcmp(opt, "-r") == 0) { use_resume = false; continue; }
+		if (i + 1 >= argc) print_usage();
+		char const* arg = argv[++i];
+		if (std::strcmp(opt, "-n") == 0) p.num_torrents = std::max(1, std::atoi(arg));
+		else if (std::strcmp(opt, "-f") == 0) p.num_files = std::max(1, std::atoi(arg));
+		else if (std::strcmp(opt, "-z") == 0) p.torrent_size = std::max(1, std::atoi(arg)) * 1024;
+		else if (std::strcmp(opt, "-p") == 0) p.piece_size = std::max(16, std::atoi(arg)) * 1024;
+		else if (std::strcmp(opt, "-d") == 0) p.dir = arg;
+		else if (std::strcmp(opt, "-j") == 0) num_threads = std::max(1, std::atoi(arg));
+		else if (std::strcmp(opt, "-s") == 0)
+		{
+			char const* eq = std::strchr(arg, '=');
+			if (eq == nullptr) print_usage();
+			std::string const name(arg, eq);
+			int const s = setting_by_name(name);
+			if (s < 0)
+			{
+				std::fprintf(stderr, "unknown setting: %s\n", name.c_str());
+				return 1;
+			}
+			switch (s & settings_pack::type_mask)
+			{
+				case settings_pack::string_type_base: pack.set_str(s, eq + 1); break;
+				case settings_pack::int_type_base: pack.set_int(s, std::atoi(eq + 1)); break;
+				case settings_pack::bool_type_base: pack.set_bool(s, std::atoi(eq + 1) != 0); break;
+			}
+		}
+		else print_usage();
+	}
+
+	if (!generate(p)) return 1;
+
+	int const n = p.num_torrents;
+
+	// make sure the alerts of all torrents fit in the queue
+	if (!pack.has_val(settings_pack::alert_queue_size))
+		pack.set_int(settings_pack::alert_queue_size, std::max(1000, n * 4));
+
+	std::vector<add_torrent_params> atps(static_cast<std::size_t>(n));
+	std::atomic<int> errors(0);
+
+	auto const start = clock_type::now();
+	parallel_for(n, num_threads, [&](int const i)
+	{
+		std::vector<char> buf;
+		error_code ec;
+		if (!load_file(torrent_path(p, i), buf)) { ++errors; return; }
+		auto ti = std::make_shared<torrent_info>(buf.data(), int(buf.size()), ec);
+		if (ec) { ++errors; return; }
+		atps[std::size_t(i)].ti = std::move(ti);
+	});
+	auto const parsed = clock_type::now();
+	report("parse_torrents", n, parsed - start);
+
+	if (use_resume)
+	{
+		parallel_for(n, num_threads, [&](int const i)
+		{
+			std::vector<char> buf;
+			error_code ec;
+			if (!load_file(resume_path(p, i), buf)) { ++errors; return; }
+			add_torrent_params& atp = atps[std::size_t(i)];
+			std::shared_ptr<torrent_info> ti = std::move(atp.ti);
+			atp = read_resume_data(buf, ec);
+			if (ec) ++errors;
+			atp.ti = std::move(ti);
+		});
+		report("read_resume_data", n, clock_type::now() - parsed);
+	}
+	else
+	{
+		for (auto& atp : atps) atp.save_path = data_path(p);
+	}
+
+	if (errors > 0)
+	{
+		std::fprintf(stderr, "failed to load %d torrents. Delete \"%s\" to regenerate them\n"
+			, errors.load(), p.dir.c_str());
+		return 1;
+	}
+
+	for (auto& atp : atps)
+	{
+		// auto-managed torrents would be queued by the active limits, and
+		// only some of them would start
+		atp.flags &= ~add_torrent_params::flag_paused;
+		atp.flags &= ~add_torrent_params::flag_auto_managed;
+	}
+
+	std::unique_ptr<lt::session> ses(new lt::session(pack));
+
+	auto const add_start = clock_type::now();
+	if (batch)
+	{
+		ses->async_add_torrents(std::move(atps));
+	}
+	else
+	{
+		for (auto& atp : atps) ses->async_add_torrent(std::move(atp));
+	}
+
+	int added = 0;
+	std::unordered_set<torrent_handle> seeding;
+	std::unordered_set<torrent_handle> announced;
+	time_point added_time = add_start;
+	time_point seeding_time = add_start;
+	time_point announced_time = add_start;
+	time_point last_progress = add_start;
+
+	std::vector<alert*> alerts;
+	while (added < n || int(seeding.size()) < n || int(announced.size()) < n)
+	{
+		ses->wait_for_alert(lt::milliseconds(500));
+		ses->pop_alerts(&alerts);
+		time_point const now = clock_type::now();
+		for (alert* a : alerts)
+		{
+			if (auto const* at = alert_cast<add_torrent_alert>(a))
+			{
+				if (at->error)
+				{
+					std::fprintf(stderr, "failed to add torrent: %s\n", at->error.message().c_str());
+					return 1;
+				}
+				if (++added == n) added_time = now;
+			}
+			else if (auto const* sc = alert_cast<state_changed_alert>(a))
+			{
+				if (sc->state != torrent_status::seeding) continue;
+				seeding.insert(sc->handle);
+				if (int(seeding.size()) == n) seeding_time = now;
+			}
+			else if (auto const* ta = alert_cast<tracker_announce_alert>(a))
+			{
+				announced.insert(ta->handle);
+				if (int(announced.size()) == n) announced_time = now;
+			}
+			else if (alert_cast<tracker_error_alert>(a))
+			{
+				// expected, there's no tracker
+			}
+			else if (a->category() & alert::error_notification)
+			{
+				std::fprintf(stderr, "%s\n", a->message().c_str());
+			}
+			last_progress = now;
+		}
+
+		if (now - last_progress > std::chrono::seconds(60))
+		{
+			std::fprintf(stderr, "no progress in 60 seconds. added: %d seeding: %d announced: %d\n"
+				, added, int(seeding.size()), int(announced.size()));
+			return 1;
+		}
+	}
+
+	report("add_torrents", n, added_time - add_start);
+	report("check", n, seeding_time - add_start);
+	report("announce", n, announced_time - add_start);
+	report("time_to_seeding", n, seeding_time - start);
+
+	auto const shutdown_start = clock_type::now();
+	ses.reset();
+	report("shutdown", n, clock_type::now() - shutdown_start);
+
+	return 0;
+}